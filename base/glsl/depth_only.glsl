@@ -15,6 +15,10 @@ void main() {
 	Skin( Position, Normal );
 #endif
 
+#if INSTANCED
+	v_InstanceID = gl_InstanceID;
+#endif
+
 	gl_Position = u_P * u_V * u_M * Position;
 }
 
@@ -10,6 +10,41 @@ layout( std140 ) uniform u_View {
 	vec3 u_LightDir;
 };
 
+#if INSTANCED
+layout( std140 ) uniform u_Instances {
+	mat4 u_InstanceM[ MAX_INSTANCES ];
+};
+
+#define u_M u_InstanceM[ gl_InstanceID ]
+
+// same layout as u_Material, one per instance out of the material table
+struct Material {
+	vec4 color;
+	vec3 texture_matrix[ 2 ];
+	vec2 texture_size;
+	float specular;
+	float shininess;
+};
+
+layout( std140 ) uniform u_InstanceMaterials {
+	Material u_InstanceMaterial[ MAX_INSTANCES ];
+};
+
+// gl_InstanceID doesn't exist in fragment shaders
+flat v2f int v_InstanceID;
+
+#if VERTEX_SHADER
+#define INSTANCE_MATERIAL u_InstanceMaterial[ gl_InstanceID ]
+#else
+#define INSTANCE_MATERIAL u_InstanceMaterial[ v_InstanceID ]
+#endif
+
+#define u_MaterialColor INSTANCE_MATERIAL.color
+#define u_TextureMatrix INSTANCE_MATERIAL.texture_matrix
+#define u_TextureSize INSTANCE_MATERIAL.texture_size
+#define u_Specular INSTANCE_MATERIAL.specular
+#define u_Shininess INSTANCE_MATERIAL.shininess
+#else
 layout( std140 ) uniform u_Model {
 	mat4 u_M;
 };
@@ -21,6 +56,7 @@ layout( std140 ) uniform u_Material {
 	float u_Specular;
 	float u_Shininess;
 };
+#endif
 
 layout( std140 ) uniform u_ShadowMaps {
 	int u_ShadowCascades;
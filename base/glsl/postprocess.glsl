@@ -20,6 +20,7 @@ layout( std140 ) uniform u_PostProcess {
 	float u_CrtEffect;
 	float u_Brightness;
 	float u_Contrast;
+	vec2 u_ScreenScale;
 };
 
 out vec4 f_Albedo;
@@ -134,8 +135,10 @@ vec3 discolor( vec3 col ) {
 	return vec3( 0.0, 0.0, 0.0 );
 }
 
+// the scene only covers the bottom left u_ScreenScale of u_Screen
 vec3 SampleScreen( vec2 uv ) {
-	return texture( u_Screen, uv ).rgb;
+	vec2 max_uv = u_ScreenScale - 0.5 / vec2( textureSize( u_Screen, 0 ) );
+	return texture( u_Screen, min( uv * u_ScreenScale, max_uv ) ).rgb;
 }
 
 vec3 glitch( vec2 uv, float amount ) {
@@ -1,7 +1,11 @@
 #include "include/uniforms.glsl"
 #include "include/common.glsl"
+#include "include/fog.glsl"
 
 uniform sampler2D u_SilhouetteTexture;
+uniform sampler2D u_SilhouetteOutlineTexture;
+uniform sampler2D u_SilhouetteDepthTexture;
+uniform sampler2D u_DepthTexture;
 
 #if VERTEX_SHADER
 
@@ -15,8 +19,60 @@ void main() {
 
 out vec4 f_Albedo;
 
+// how far in front of whatever is behind it a model has to be to get
+// outlined, so limbs get outlined against the body like the old hull did
+#define OUTLINE_DEPTH_GAP 8.0
+#define OUTLINE_DEPTH_EPSILON 2.0
+
+float SafeLinearizeDepth( float depth ) {
+	return u_NearClip / max( 1.0 - depth, 0.000001 );
+}
+
+vec4 Outline( ivec2 p ) {
+	int radius = max( 1, int( u_ViewportSize.y / 720.0 + 0.5 ) );
+	ivec2 offsets[ 4 ] = ivec2[]( ivec2( radius, 0 ), ivec2( -radius, 0 ), ivec2( 0, radius ), ivec2( 0, -radius ) );
+
+	float depth = SafeLinearizeDepth( texelFetch( u_SilhouetteDepthTexture, p, 0 ).r );
+	float scene_depth = SafeLinearizeDepth( texelFetch( u_DepthTexture, p, 0 ).r );
+
+	vec4 outline = vec4( 0.0 );
+	float outline_depth = depth - OUTLINE_DEPTH_GAP;
+
+	for( int i = 0; i < 4; i++ ) {
+		ivec2 q = p + offsets[ i ];
+		vec4 colour = texelFetch( u_SilhouetteOutlineTexture, q, 0 );
+		if( colour.a == 0.0 )
+			continue;
+
+		// the neighbour has to be in front of this pixel's model, actually
+		// visible in the scene, and not behind whatever the scene has here
+		float neighbour_depth = SafeLinearizeDepth( texelFetch( u_SilhouetteDepthTexture, q, 0 ).r );
+		float neighbour_scene_depth = SafeLinearizeDepth( texelFetch( u_DepthTexture, q, 0 ).r );
+		if( neighbour_depth >= outline_depth )
+			continue;
+		if( neighbour_depth > neighbour_scene_depth + OUTLINE_DEPTH_EPSILON || neighbour_depth > scene_depth + OUTLINE_DEPTH_EPSILON )
+			continue;
+
+		outline = colour;
+		outline_depth = neighbour_depth;
+	}
+
+	if( outline.a == 0.0 )
+		return outline;
+
+	float ndc_depth = 1.0 - u_NearClip / outline_depth;
+	return vec4( VoidFog( outline.rgb, gl_FragCoord.xy, ndc_depth ), 1.0 );
+}
+
 void main() {
 	ivec2 p = ivec2( gl_FragCoord.xy );
+
+	vec4 outline = Outline( p );
+	if( outline.a > 0.0 ) {
+		f_Albedo = outline;
+		return;
+	}
+
 	ivec3 pixel = ivec3( 0, 1, -1 );
 
 	vec4 colour_up =        texelFetch( u_SilhouetteTexture, p + pixel.xz, 0 );
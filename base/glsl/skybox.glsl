@@ -4,15 +4,20 @@
 #include "include/fog.glsl"
 
 v2f vec3 v_Position;
-v2f float v_Height;
 
 #if VERTEX_SHADER
 
 in vec4 a_Position;
 
+// what the infinite projection gives directions, so it passes the depth
+// test against the cleared depth buffer and fails against everything else
+#define SKY_DEPTH ( 1.0 - 2.4e-6 )
+
 void main() {
-	v_Position = a_Position.xyz;
-	gl_Position = u_P * u_V * vec4( a_Position );
+	// world space view direction through this corner of the screen
+	vec4 near = u_InverseP * vec4( a_Position.xy, -1.0, 1.0 );
+	v_Position = mat3( u_InverseV ) * ( near.xyz / near.w );
+	gl_Position = vec4( a_Position.xy, SKY_DEPTH, 1.0 );
 }
 
 #else
@@ -34,6 +34,10 @@ void main() {
 	vec3 Normal = a_Normal;
 	vec2 TexCoord = a_TexCoord;
 
+#if INSTANCED
+	v_InstanceID = gl_InstanceID;
+#endif
+
 #if SKINNED
 	Skin( Position, Normal );
 #endif
@@ -4,23 +4,25 @@
 uniform sampler2D u_BaseTexture;
 
 layout( std140 ) uniform u_Text {
-	vec4 u_TextColor;
-	vec4 u_BorderColor;
+	vec4 u_BorderColor; // alpha is relative to the text alpha
 	vec2 u_AtlasSize;
 	float u_dSDFdTexel;
 	int u_HasBorder;
 };
 
 v2f vec2 v_TexCoord;
+v2f vec4 v_Color;
 
 #if VERTEX_SHADER
 
 in vec4 a_Position;
 in vec2 a_TexCoord;
+in vec4 a_Color;
 
 void main() {
 	gl_Position = u_P * a_Position;
 	v_TexCoord = a_TexCoord;
+	v_Color = sRGBToLinear( a_Color );
 }
 
 #else
@@ -41,14 +43,15 @@ vec4 SampleMSDF( vec2 uv, float half_pixel_size ) {
 
 	if( u_HasBorder != 0 ) {
 		float border_amount = LinearStep( -half_pixel_size, half_pixel_size, d );
-		vec4 color = mix( u_BorderColor, u_TextColor, border_amount );
+		vec4 border_color = vec4( u_BorderColor.rgb, u_BorderColor.a * v_Color.a );
+		vec4 color = mix( border_color, v_Color, border_amount );
 
 		float alpha = LinearStep( -3.0 * half_pixel_size, -half_pixel_size, d );
 		return vec4( color.rgb, color.a * alpha );
 	}
 
 	float alpha = LinearStep( -half_pixel_size, half_pixel_size, d );
-	return vec4( u_TextColor.rgb, u_TextColor.a * alpha );
+	return vec4( v_Color.rgb, v_Color.a * alpha );
 }
 
 void main() {
@@ -2,6 +2,10 @@
 #include "include/common.glsl"
 #include "include/skinning.glsl"
 
+layout( std140 ) uniform u_Outline {
+	vec4 u_OutlineColor;
+};
+
 #if VERTEX_SHADER
 
 in vec4 a_Position;
@@ -20,9 +24,11 @@ void main() {
 #else
 
 out vec4 f_Albedo;
+out vec4 f_Normal;
 
 void main() {
 	f_Albedo = u_MaterialColor;
+	f_Normal = u_OutlineColor;
 }
 
 #endif
@@ -289,7 +289,7 @@ void bombThink() {
 		case BombState_Dropped: {
 			// respawn the bomb if it falls in the void
 			if( bombModel.origin.z <= -1024.0f ) {
-				bombModel.origin = RandomEntity( "spawn_bomb_attacking" ).origin;
+				bombModel.origin = G_RandomSpawnPoint( "spawn_bomb_attacking" ).origin;
 				bombModel.velocity = Vec3();
 				bombModel.teleported = true;
 
@@ -372,13 +372,10 @@ void bombThink() {
 }
 
 Entity @ firstNearbyTeammate( Vec3 origin, int team ) {
-	array< Entity @ > @nearby = G_FindInRadius( origin, BOMB_ARM_DEFUSE_RADIUS );
+	array< Entity @ > @nearby = G_FindTeamPlayersInRadius( origin, BOMB_ARM_DEFUSE_RADIUS, team );
 	for( uint i = 0; i < nearby.size(); i++ ) {
 		Entity @target = nearby[i];
-		if( @target.client == null ) {
-			continue;
-		}
-		if( target.team != team || target.isGhosting() || !entCanSee( target, origin ) ) {
+		if( !entCanSee( target, origin ) ) {
 			continue;
 		}
 
@@ -426,8 +423,9 @@ void bombGiveToRandom() {
 	Team @team = @G_GetTeam( attackingTeam );
 	uint bots = 0;
 
-	for( uint i = 0; @team.ent( i ) != null; i++ ) {
-		if( ( team.ent( i ).svflags & SVF_FAKECLIENT ) != 0 ) {
+	array< Entity @ > @members = team.players();
+	for( uint i = 0; i < members.size(); i++ ) {
+		if( ( members[ i ].svflags & SVF_FAKECLIENT ) != 0 ) {
 			bots++;
 		}
 	}
@@ -437,8 +435,8 @@ void bombGiveToRandom() {
 	int carrier = RandomUniform( 0, n );
 	int seen = 0;
 
-	for( int i = 0; @team.ent( i ) != null; i++ ) {
-		Entity @ent = @team.ent( i );
+		for( uint i = 0; i < members.size(); i++ ) {
+		Entity @ent = @members[ i ];
 		Client @client = @ent.client;
 
 		cPlayer @player = @playerFromClient( @client );
@@ -57,8 +57,9 @@ float min( float a, float b ) {
 void setTeamProgress( int teamNum, int percent, BombProgress type ) {
 	Team @team = @G_GetTeam( teamNum );
 
-	for( int i = 0; @team.ent( i ) != null; i++ ) {
-		Entity @ent = @team.ent( i );
+	array< Entity @ > @members = team.players();
+	for( uint i = 0; i < members.size(); i++ ) {
+		Entity @ent = @members[ i ];
 
 		Client @client = @ent.client;
 
@@ -99,21 +100,21 @@ void spawn_gladiator( Entity @ent ) { }
 
 Entity @GT_SelectSpawnPoint( Entity @self ) {
 	// loading individual gladiator arenas loads bomb gt, so prioritise gladi spawns
-	Entity @gladi_spawn = RandomEntity( "spawn_gladiator" );
+	Entity @gladi_spawn = G_RandomSpawnPoint( "spawn_gladiator" );
 	if( @gladi_spawn != null )
 		return gladi_spawn;
 
 	if( self.team == attackingTeam ) {
-		Entity @spawn = RandomEntity( "spawn_bomb_attacking" );
+		Entity @spawn = G_RandomSpawnPoint( "spawn_bomb_attacking" );
 		if( @spawn != null )
 			return spawn;
-		return RandomEntity( "team_CTF_betaspawn" );
+		return G_RandomSpawnPoint( "team_CTF_betaspawn" );
 	}
 
-	Entity @spawn = RandomEntity( "spawn_bomb_defending" );
+	Entity @spawn = G_RandomSpawnPoint( "spawn_bomb_defending" );
 	if( @spawn != null )
 		return spawn;
-	return RandomEntity( "team_CTF_alphaspawn" );
+	return G_RandomSpawnPoint( "team_CTF_alphaspawn" );
 }
 
 void GT_updateScore( Client @client ) {
@@ -236,8 +237,9 @@ void GT_ThinkRules() {
 	for( int t = 0; t < GS_MAX_TEAMS; t++ ) {
 		Team @team = @G_GetTeam( t );
 
-		for( int i = 0; @team.ent( i ) != null; i++ ) {
-			Client @client = @team.ent( i ).client;
+		array< Entity @ > @members = team.players();
+		for( uint i = 0; i < members.size(); i++ ) {
+			Client @client = @members[ i ].client;
 			cPlayer @player = @playerFromClient( @client );
 
 			// this should only happen when match state is playtime
@@ -103,8 +103,9 @@ void newGame() {
 
 		Team @team = @G_GetTeam( t );
 
-		for( int i = 0; @team.ent( i ) != null; i++ ) {
-			team.ent( i ).client.stats.clear();
+		array< Entity @ > @members = team.players();
+		for( uint i = 0; i < members.size(); i++ ) {
+			members[ i ].client.stats.clear();
 		}
 	}
 
@@ -126,8 +127,9 @@ void roundWonBy( int winner ) {
 	Team @teamWinner = @G_GetTeam( winner );
 	teamWinner.addScore( 1 );
 
-	for( int i = 0; @teamWinner.ent( i ) != null; i++ ) {
-		Entity @ent = @teamWinner.ent( i );
+	array< Entity @ > @members = teamWinner.players();
+	for( uint i = 0; i < members.size(); i++ ) {
+		Entity @ent = @members[ i ];
 
 		if( !ent.isGhosting() ) {
 			ent.client.addAward( S_COLOR_GREEN + "Victory!" );
@@ -341,8 +343,9 @@ uint playersAliveOnTeam( int teamNum ) {
 
 	Team @team = @G_GetTeam( teamNum );
 
-	for( int i = 0; @team.ent( i ) != null; i++ ) {
-		Entity @ent = @team.ent( i );
+	array< Entity @ > @members = team.players();
+	for( uint i = 0; i < members.size(); i++ ) {
+		Entity @ent = @members[ i ];
 
 		// check health incase they died this frame
 		if( !ent.isGhosting() && ent.health > 0 ) {
@@ -356,8 +359,9 @@ uint playersAliveOnTeam( int teamNum ) {
 Client @firstAliveOnTeam( int teamNum ) {
 	Team @team = @G_GetTeam( teamNum );
 
-	for( int i = 0; @team.ent( i ) != null; i++ ) {
-		Entity @ent = @team.ent( i );
+	array< Entity @ > @members = team.players();
+	for( uint i = 0; i < members.size(); i++ ) {
+		Entity @ent = @members[ i ];
 
 		// check health incase they died this frame
 
@@ -375,8 +379,9 @@ void respawnAllPlayers() {
 	for( int t = TEAM_PLAYERS; t < GS_MAX_TEAMS; t++ ) {
 		Team @team = @G_GetTeam( t );
 
-		for( int i = 0; @team.ent( i ) != null; i++ ) {
-			team.ent( i ).client.respawn( false );
+		array< Entity @ > @members = team.players();
+		for( uint i = 0; i < members.size(); i++ ) {
+			members[ i ].client.respawn( false );
 		}
 	}
 }
@@ -389,8 +394,9 @@ void enableMovement() {
 	for( int t = TEAM_PLAYERS; t < GS_MAX_TEAMS; t++ ) {
 		Team @team = @G_GetTeam( t );
 
-		for( int i = 0; @team.ent( i ) != null; i++ ) {
-			Client @client = @team.ent( i ).client;
+		array< Entity @ > @members = team.players();
+		for( uint i = 0; i < members.size(); i++ ) {
+			Client @client = @members[ i ].client;
 
 			client.pmoveMaxSpeed = -1;
 			client.pmoveDashSpeed = -1;
@@ -410,8 +416,9 @@ void disableMovement() {
 	for( int t = TEAM_PLAYERS; t < GS_MAX_TEAMS; t++ ) {
 		Team @team = @G_GetTeam( t );
 
-		for( int i = 0; @team.ent( i ) != null; i++ ) {
-			Client @client = @team.ent( i ).client;
+		array< Entity @ > @members = team.players();
+		for( uint i = 0; i < members.size(); i++ ) {
+			Client @client = @members[ i ].client;
 
 			disableMovementFor( @client );
 		}
@@ -90,14 +90,6 @@ void GENERIC_SetUpEndMatch()
 	G_AnnouncerSound( null, sound, GS_MAX_TEAMS, true, null );
 }
 
-Entity @RandomEntity( String &className )
-{
-	array<Entity @> @spawnents = G_FindByClassname( className );
-	if( spawnents.size() == 0 )
-		return null;
-	return spawnents[ RandomUniform( 0, spawnents.size() ) ];
-}
-
 void GENERIC_UpdateMatchScore()
 {
 	if( gametype.isTeamBased ) {
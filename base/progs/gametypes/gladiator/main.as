@@ -240,8 +240,9 @@ class cDARound {
 		Entity @ent;
 
 		// respawn all clients inside the playing teams
-		for( int i = 0; @team.ent( i ) != null; i++ ) {
-			@ent = @team.ent( i );
+		array< Entity @ > @members = team.players();
+		for( uint i = 0; i < members.size(); i++ ) {
+			@ent = @members[ i ];
 			if( !ent.isGhosting() )
 				G_CenterPrintMsg( ent, string );
 
@@ -390,16 +391,17 @@ class cDARound {
 				int limit = Cvar( "g_scorelimit", "10", 0 ).integer;
 
 				RoundType type = RoundType_Normal;
-				for( int i = 0; @team.ent( i ) != null; i++ ) {
-					Client @client = @team.ent( i ).client;
+				array< Entity @ > @members = team.players();
+				for( uint i = 0; i < members.size(); i++ ) {
+					Client @client = @members[ i ].client;
 					if( client.stats.score == limit - 1 ) {
 						type = RoundType_MatchPoint;
 						break;
 					}
 				}
 
-				for( int i = 0; @team.ent( i ) != null; i++ ) {
-					Client @client = @team.ent( i ).client;
+				for( uint i = 0; i < members.size(); i++ ) {
+					Client @client = @members[ i ].client;
 					match.roundType = type;
 				}
 			} break;
@@ -56,8 +56,9 @@ void DoSpinner() {
 	currentDelay = CountdownInitialSwitchDelay;
 
 	Team @team = @G_GetTeam( TEAM_PLAYERS );
-	for( int i = 0; @team.ent( i ) != null; i++ ) {
-		Entity @ent = @team.ent( i );
+	array< Entity @ > @members = team.players();
+	for( uint i = 0; i < members.size(); i++ ) {
+		Entity @ent = @members[ i ];
 		ent.client.pmoveFeatures = ent.client.pmoveFeatures & ~( PMFEAT_WEAPONSWITCH | PMFEAT_SCOPE );
 	}
 
@@ -127,14 +127,14 @@ struct ImGuiShaderAndMaterial {
 	ImGuiShaderAndMaterial() {
 		shader = NULL;
 		material = NULL;
-		uniform_name = { };
+		uniform_slot = UniformSlot_None;
 		uniform_block = { };
 	}
 
 	ImGuiShaderAndMaterial( const Material * mat ) {
 		shader = &shaders.standard_vertexcolors;
 		material = mat;
-		uniform_name = { };
+		uniform_slot = UniformSlot_None;
 		uniform_block = { };
 	}
 
@@ -145,14 +145,14 @@ struct ImGuiShaderAndMaterial {
 	const Shader * shader;
 	const Material * material;
 
-	StringHash uniform_name;
+	UniformSlot uniform_slot;
 	UniformBlock uniform_block;
 };
 
 inline bool operator==( const ImGuiShaderAndMaterial & a, const ImGuiShaderAndMaterial & b ) {
 	return a.shader == b.shader
 		&& a.material == b.material
-		&& a.uniform_name == b.uniform_name
+		&& a.uniform_slot == b.uniform_slot
 		&& a.uniform_block.ubo == b.uniform_block.ubo
 		&& a.uniform_block.offset == b.uniform_block.offset
 		&& a.uniform_block.size == b.uniform_block.size;
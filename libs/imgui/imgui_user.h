@@ -3,6 +3,7 @@ enum WindowZOrder {
 	WindowZOrder_Scoreboard,
 	WindowZOrder_Menu,
 	WindowZOrder_Console,
+	WindowZOrder_Stats,
 };
 
 namespace ImGui {
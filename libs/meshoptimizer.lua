@@ -1,15 +1,15 @@
 lib( "meshoptimizer", {
 	"libs/meshoptimizer/allocator.cpp",
 	-- "libs/meshoptimizer/clusterizer.cpp",
-	-- "libs/meshoptimizer/indexcodec.cpp",
+	"libs/meshoptimizer/indexcodec.cpp",
 	"libs/meshoptimizer/indexgenerator.cpp",
 	"libs/meshoptimizer/overdrawanalyzer.cpp",
 	"libs/meshoptimizer/overdrawoptimizer.cpp",
-	-- "libs/meshoptimizer/simplifier.cpp",
+	"libs/meshoptimizer/simplifier.cpp",
 	-- "libs/meshoptimizer/stripifier.cpp",
 	"libs/meshoptimizer/vcacheanalyzer.cpp",
 	"libs/meshoptimizer/vcacheoptimizer.cpp",
-	-- "libs/meshoptimizer/vertexcodec.cpp",
+	"libs/meshoptimizer/vertexcodec.cpp",
 	"libs/meshoptimizer/vfetchanalyzer.cpp",
 	"libs/meshoptimizer/vfetchoptimizer.cpp",
 } )
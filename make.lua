@@ -42,6 +42,13 @@ require( "libs.zlib" )
 require( "libs.zstd" )
 
 require( "source.tools.bc4" )
+require( "source.tools.demostats" )
+require( "source.tools.packassets" )
+require( "source.tools.snapbench" )
+require( "source.tools.pmovebench" )
+require( "source.tools.hashbench" )
+require( "source.tools.tracebench" )
+require( "source.tools.loadtest" )
 
 do
 	local platform_srcs
@@ -111,7 +118,7 @@ do
 		rc = "source/windows/client",
 
 		gcc_extra_ldflags = "-lm -lpthread -ldl -lX11 -no-pie -static-libstdc++",
-		msvc_extra_ldflags = "gdi32.lib ole32.lib oleaut32.lib ws2_32.lib crypt32.lib winmm.lib version.lib imm32.lib /SUBSYSTEM:WINDOWS",
+		msvc_extra_ldflags = "gdi32.lib ole32.lib oleaut32.lib ws2_32.lib mswsock.lib crypt32.lib winmm.lib version.lib imm32.lib /SUBSYSTEM:WINDOWS",
 	} )
 
 	obj_cxxflags( "source/client/renderer/text.cpp", "-I libs/freetype" )
@@ -162,7 +169,7 @@ do
 		},
 
 		gcc_extra_ldflags = "-lm -lpthread -ldl -no-pie -static-libstdc++",
-		msvc_extra_ldflags = "ole32.lib ws2_32.lib crypt32.lib",
+		msvc_extra_ldflags = "ole32.lib ws2_32.lib mswsock.lib crypt32.lib",
 	} )
 end
 
@@ -15,6 +15,13 @@ enum ChatMode {
 struct ChatMessage {
 	s64 time;
 	char text[ CHAT_MESSAGE_SIZE ];
+
+	// wrapping is most of the cost of a message, so remember how big it
+	// came out and only redo it when the font or chat width changes
+	ImVec2 size;
+	const ImFont * size_font;
+	float size_font_size;
+	float size_wrap_width;
 };
 
 struct Chat {
@@ -64,6 +71,7 @@ void CG_AddChat( const char * str ) {
 	size_t idx = ( chat.history_head + chat.history_len ) % ARRAY_COUNT( chat.history );
 	chat.history[ idx ].time = cls.monotonicTime;
 	Q_strncpyz( chat.history[ idx ].text, str, sizeof( chat.history[ idx ].text ) );
+	chat.history[ idx ].size_font = NULL;
 
 	if( chat.history_len < ARRAY_COUNT( chat.history ) ) {
 		chat.history_len++;
@@ -148,10 +156,19 @@ void CG_DrawChat() {
 
 	for( size_t i = 0; i < chat.history_len; i++ ) {
 		size_t idx = ( chat.history_head + i ) % ARRAY_COUNT( chat.history );
-		const ChatMessage * msg = &chat.history[ idx ];
+		ChatMessage * msg = &chat.history[ idx ];
+
+		if( msg->size_font != ImGui::GetFont() || msg->size_font_size != ImGui::GetFontSize() || msg->size_wrap_width != wrap_width ) {
+			msg->size = ImGui::CalcTextSize( msg->text, NULL, false, wrap_width );
+			msg->size_font = ImGui::GetFont();
+			msg->size_font_size = ImGui::GetFontSize();
+			msg->size_wrap_width = wrap_width;
+		}
 
-		if( chat.mode == ChatMode_None && cls.monotonicTime > msg->time + GAMECHAT_NOTIFY_TIME ) {
-			ImGui::Dummy( ImGui::CalcTextSize( msg->text, NULL, false, wrap_width ) );
+		// faded out and scrolled out of view messages only need to take up space
+		bool faded = chat.mode == ChatMode_None && cls.monotonicTime > msg->time + GAMECHAT_NOTIFY_TIME;
+		if( faded || !ImGui::IsRectVisible( msg->size ) ) {
+			ImGui::Dummy( msg->size );
 		}
 		else {
 			ImGui::TextWrapped( "%s", msg->text );
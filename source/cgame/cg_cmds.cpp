@@ -203,22 +203,20 @@ static void CG_SC_DemoGet() {
 		return;
 	}
 
-	CL_DownloadFile( filename, []( const char * filename, Span< const u8 > data ) {
-		if( data.ptr == NULL )
-			return;
+	TempAllocator temp = cls.frame_arena.temp();
+	const char * path = temp( "{}/demos/server/{}", HomeDirPath(), FileName( filename ) );
 
-		TempAllocator temp = cls.frame_arena.temp();
-		const char * path = temp( "{}/demos/server/{}", HomeDirPath(), FileName( filename ) );
-
-		if( FileExists( &temp, path ) ) {
-			Com_Printf( "%s already exists!\n", path );
-			return;
-		}
+	if( FileExists( &temp, path ) ) {
+		Com_Printf( "%s already exists!\n", path );
+		return;
+	}
 
-		if( !WriteFile( &temp, path, data.ptr, data.num_bytes() ) ) {
-			Com_Printf( "Couldn't write to %s\n", path );
+	// demos can be big so they go straight to disk
+	CL_DownloadFile( filename, []( const char * filename, Span< const u8 > data ) {
+		if( data.ptr == NULL ) {
+			Com_Printf( "Couldn't download %s\n", filename );
 		}
-	} );
+	}, path );
 }
 
 static void CG_SC_ChangeLoadout() {
@@ -308,7 +306,7 @@ static void CG_Cmd_UseItem_f() {
 
 	const char * name = Cmd_Args();
 	for( WeaponType i = 0; i < Weapon_Count; i++ ) {
-		const WeaponDef * weapon = GS_GetWeaponDef( i );
+		const WeaponInfo * weapon = GetWeaponInfo( i );
 		if( ( Q_stricmp( weapon->name, name ) == 0 || Q_stricmp( weapon->short_name, name ) == 0 ) && GS_CanEquip( &cg.predictedPlayerState, i ) ) {
 			SwitchWeapon( i );
 		}
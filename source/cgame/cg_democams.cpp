@@ -17,6 +17,8 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
+#include <algorithm> // std::stable_sort, std::upper_bound
+
 #include "qcommon/base.h"
 #include "qcommon/fs.h"
 #include "qcommon/qcommon.h"
@@ -72,6 +74,7 @@ typedef struct cg_democam_s
 	Vec3 tangent;
 	Vec3 angles_tangent;
 	float speed;
+	float spline[ 3 ]; // lerpspline = spline[ 0 ] * t^3 + spline[ 1 ] * t^2 + spline[ 2 ] * t
 	struct cg_democam_s *next;
 } cg_democam_t;
 
@@ -86,38 +89,50 @@ static bool cam_3dPerson;
 static Vec3 cam_orbital_angles;
 static float cam_orbital_radius;
 
-static cg_democam_t *CG_Democam_FindCurrent( int64_t time ) {
-	int64_t higher_time = 0;
-	cg_democam_t *cam, *curcam;
+/*
+ * cams sorted by timestamp so finding the current and next cam is a binary
+ * search. it gets rebuilt the next time it's needed after a cam is added,
+ * removed or retimed
+ */
+static NonRAIIDynamicArray< cg_democam_t * > cam_timeline;
+static bool cam_timeline_dirty;
+
+static void CG_Democam_UpdateTimeline() {
+	if( !cam_timeline_dirty ) {
+		return;
+	}
 
-	cam = cg_cams_headnode;
-	curcam = NULL;
-	while( cam != NULL ) {
-		if( curcam == NULL || ( cam->timeStamp <= time && cam->timeStamp > higher_time ) ) {
-			higher_time = cam->timeStamp;
-			curcam = cam;
-		}
-		cam = cam->next;
+	cam_timeline.clear();
+	for( cg_democam_t *cam = cg_cams_headnode; cam != NULL; cam = cam->next ) {
+		cam_timeline.add( cam );
 	}
 
-	return curcam;
+	std::stable_sort( cam_timeline.begin(), cam_timeline.end(), []( const cg_democam_t * a, const cg_democam_t * b ) {
+		return a->timeStamp < b->timeStamp;
+	} );
+
+	cam_timeline_dirty = false;
 }
 
-static cg_democam_t *CG_Democam_FindNext( int64_t time ) {
-	int64_t lower_time = INT64_MAX;
-	cg_democam_t *cam, *ncam;
+// index of the first cam after time
+static size_t CG_Democam_UpperBound( int64_t time ) {
+	CG_Democam_UpdateTimeline();
 
-	cam = cg_cams_headnode;
-	ncam = NULL;
-	while( cam != NULL ) {
-		if( cam->timeStamp > time && cam->timeStamp < lower_time ) {
-			lower_time = cam->timeStamp;
-			ncam = cam;
-		}
-		cam = cam->next;
-	}
+	cg_democam_t ** it = std::upper_bound( cam_timeline.begin(), cam_timeline.end(), time, []( int64_t t, const cg_democam_t * cam ) {
+		return t < cam->timeStamp;
+	} );
+
+	return it - cam_timeline.begin();
+}
 
-	return ncam;
+static cg_democam_t *CG_Democam_FindCurrent( int64_t time ) {
+	size_t i = CG_Democam_UpperBound( time );
+	return i == 0 ? NULL : cam_timeline[ i - 1 ];
+}
+
+static cg_democam_t *CG_Democam_FindNext( int64_t time ) {
+	size_t i = CG_Democam_UpperBound( time );
+	return i == cam_timeline.size() ? NULL : cam_timeline[ i ];
 }
 
 static cg_democam_t *CG_Democam_RegisterCam( int type ) {
@@ -140,6 +155,8 @@ static cg_democam_t *CG_Democam_RegisterCam( int type ) {
 		cg_cams_headnode = cam;
 	}
 
+	cam_timeline_dirty = true;
+
 	cam->timeStamp = demo_time;
 	cam->type = type;
 	cam->origin = cam_origin;
@@ -163,6 +180,8 @@ static void CG_Democam_UnregisterCam( cg_democam_t *cam ) {
 		return;
 	}
 
+	cam_timeline_dirty = true;
+
 	// headnode shortcut
 	if( cg_cams_headnode == cam ) {
 		cg_cams_headnode = cg_cams_headnode->next;
@@ -195,6 +214,46 @@ void CG_Democam_FreeCams() {
 
 //===================================================================
 
+/*
+ * only depends on the timestamps around the cam, so it gets worked out with
+ * the tangents instead of every frame
+ */
+static void CG_Democam_SplineCoefficients( const cg_democam_t *previouscam, const cg_democam_t *currentcam, const cg_democam_t *nextcam, const cg_democam_t *secondnextcam, float * spline ) {
+	float A, B, C, n1, n2, n3;
+
+	spline[ 0 ] = 0;
+	spline[ 1 ] = 0;
+	spline[ 2 ] = 0;
+
+	if( !previouscam && nextcam && !secondnextcam ) {
+		spline[ 2 ] = 1;
+	} else if( !previouscam && nextcam && secondnextcam ) {
+		n1 = nextcam->timeStamp - currentcam->timeStamp;
+		n2 = secondnextcam->timeStamp - nextcam->timeStamp;
+		A = n1 * ( n1 - n2 ) / ( powf( n1, 2 ) + n1 * n2 - n1 - n2 );
+		B = ( 2 * n1 * n2 - n1 - n2 ) / ( powf( n1, 2 ) + n1 * n2 - n1 - n2 );
+		spline[ 1 ] = A;
+		spline[ 2 ] = B;
+	} else if( previouscam && nextcam && !secondnextcam ) {
+		n2 = currentcam->timeStamp - previouscam->timeStamp;
+		n3 = nextcam->timeStamp - currentcam->timeStamp;
+		A = n3 * ( n2 - n3 ) / ( -n2 - n3 + n2 * n3 + powf( n3, 2 ) );
+		B = -1 / ( -n2 - n3 + n2 * n3 + powf( n3, 2 ) ) * ( n2 + n3 - 2 * powf( n3, 2 ) );
+		spline[ 1 ] = A;
+		spline[ 2 ] = B;
+	} else if( previouscam && nextcam && secondnextcam ) {
+		n1 = currentcam->timeStamp - previouscam->timeStamp;
+		n2 = nextcam->timeStamp - currentcam->timeStamp;
+		n3 = secondnextcam->timeStamp - nextcam->timeStamp;
+		A = -2 * powf( n2, 2 ) * ( -powf( n2, 2 ) + n1 * n3 ) / ( 2 * n2 * n3 + powf( n2, 3 ) * n3 - 3 * powf( n2, 2 ) * n1 + n1 * powf( n2, 3 ) + 2 * n1 * n2 - 3 * powf( n2, 2 ) * n3 - 3 * powf( n2, 3 ) + 2 * powf( n2, 2 ) + powf( n2, 4 ) + n1 * powf( n2, 2 ) * n3 - 3 * n1 * n2 * n3 + 2 * n1 * n3 );
+		B = powf( n2, 2 ) * ( -2 * n1 - 3 * powf( n2, 2 ) - n2 * n3 + 2 * n3 + 3 * n1 * n3 + n1 * n2 ) / ( 2 * n2 * n3 + powf( n2, 3 ) * n3 - 3 * powf( n2, 2 ) * n1 + n1 * powf( n2, 3 ) + 2 * n1 * n2 - 3 * powf( n2, 2 ) * n3 - 3 * powf( n2, 3 ) + 2 * powf( n2, 2 ) + powf( n2, 4 ) + n1 * powf( n2, 2 ) * n3 - 3 * n1 * n2 * n3 + 2 * n1 * n3 );
+		C = -( powf( n2, 2 ) * n1 - 2 * n1 * n2 + 3 * n1 * n2 * n3 - 2 * n1 * n3 - 2 * powf( n2, 4 ) + 3 * powf( n2, 3 ) - 2 * powf( n2, 3 ) * n3 + 5 * powf( n2, 2 ) * n3 - 2 * powf( n2, 2 ) - 2 * n2 * n3 ) / ( 2 * n2 * n3 + powf( n2, 3 ) * n3 - 3 * powf( n2, 2 ) * n1 + n1 * powf( n2, 3 ) + 2 * n1 * n2 - 3 * powf( n2, 2 ) * n3 - 3 * powf( n2, 3 ) + 2 * powf( n2, 2 ) + powf( n2, 4 ) + n1 * powf( n2, 2 ) * n3 - 3 * n1 * n2 * n3 + 2 * n1 * n3 );
+		spline[ 0 ] = A;
+		spline[ 1 ] = B;
+		spline[ 2 ] = C;
+	}
+}
+
 static void CG_Democam_ExecutePathAnalysis() {
 	int64_t pathtime;
 	cg_democam_t *ccam, *ncam, *pcam, *sncam;
@@ -321,6 +380,8 @@ static void CG_Democam_ExecutePathAnalysis() {
 					ncam->angles_tangent = ncam->angles - ccam->angles;
 					ncam->angles_tangent = ncam->angles_tangent * ( 1.0 / 4.0 );
 				}
+
+				CG_Democam_SplineCoefficients( pcam, ccam, ncam, sncam, ccam->spline );
 			}
 		}
 
@@ -352,6 +413,7 @@ static bool CG_LoadRecamScriptFile( const char *filename ) {
 				break;
 			case 1:
 				cam->timeStamp = SpanToInt( token, 0 );
+				cam_timeline_dirty = true;
 				break;
 			case 2:
 				cam->origin.x = SpanToFloat( token, 0.0f );
@@ -436,7 +498,7 @@ static void CG_DrawEntityNumbers() {
 	// int shadowOffset = Max2( 1, frame_static.viewport_height / 600 );
 
 	for( i = 0; i < cg.frame.numEntities; i++ ) {
-		entnum = cg.frame.parsedEntities[i & ( MAX_PARSE_ENTITIES - 1 )].number;
+		entnum = cg.frame.parsedEntities[i & ( MAX_PARSE_ENTITIES - 1 )]->number;
 		if( entnum < 1 || entnum >= MAX_EDICTS ) {
 			continue;
 		}
@@ -773,48 +835,8 @@ static int CG_Democam_CalcView() {
 				} else {  // valid spline path
 #define VectorHermiteInterp( a, at, b, bt, c, v )  ( ( v ).x = ( 2 * powf( c, 3 ) - 3 * powf( c, 2 ) + 1 ) * a.x + ( powf( c, 3 ) - 2 * powf( c, 2 ) + c ) * 2 * at.x + ( -2 * powf( c, 3 ) + 3 * powf( c, 2 ) ) * b.x + ( powf( c, 3 ) - powf( c, 2 ) ) * 2 * bt.x, ( v ).y = ( 2 * powf( c, 3 ) - 3 * powf( c, 2 ) + 1 ) * a.y + ( powf( c, 3 ) - 2 * powf( c, 2 ) + c ) * 2 * at.y + ( -2 * powf( c, 3 ) + 3 * powf( c, 2 ) ) * b.y + ( powf( c, 3 ) - powf( c, 2 ) ) * 2 * bt.y, ( v ).z = ( 2 * powf( c, 3 ) - 3 * powf( c, 2 ) + 1 ) * a.z + ( powf( c, 3 ) - 2 * powf( c, 2 ) + c ) * 2 * at.z + ( -2 * powf( c, 3 ) + 3 * powf( c, 2 ) ) * b.z + ( powf( c, 3 ) - powf( c, 2 ) ) * 2 * bt.z )
 
-					float lerpspline, A, B, C, n1, n2, n3;
-					cg_democam_t *previouscam = NULL;
-					cg_democam_t *secondnextcam = NULL;
-
-					if( nextcam ) {
-						secondnextcam = CG_Democam_FindNext( nextcam->timeStamp );
-					}
-					if( currentcam->timeStamp > 0 ) {
-						previouscam = CG_Democam_FindCurrent( currentcam->timeStamp - 1 );
-					}
-
-					if( !previouscam && nextcam && !secondnextcam ) {
-						lerpfrac = (float)( demo_time - currentcam->timeStamp ) / (float)( nextcam->timeStamp - currentcam->timeStamp );
-						lerpspline = lerpfrac;
-					} else if( !previouscam && nextcam && secondnextcam ) {
-						n1 = nextcam->timeStamp - currentcam->timeStamp;
-						n2 = secondnextcam->timeStamp - nextcam->timeStamp;
-						A = n1 * ( n1 - n2 ) / ( powf( n1, 2 ) + n1 * n2 - n1 - n2 );
-						B = ( 2 * n1 * n2 - n1 - n2 ) / ( powf( n1, 2 ) + n1 * n2 - n1 - n2 );
-						lerpfrac = (float)( demo_time - currentcam->timeStamp ) / (float)( nextcam->timeStamp - currentcam->timeStamp );
-						lerpspline = A * powf( lerpfrac, 2 ) + B * lerpfrac;
-					} else if( previouscam && nextcam && !secondnextcam ) {
-						n2 = currentcam->timeStamp - previouscam->timeStamp;
-						n3 = nextcam->timeStamp - currentcam->timeStamp;
-						A = n3 * ( n2 - n3 ) / ( -n2 - n3 + n2 * n3 + powf( n3, 2 ) );
-						B = -1 / ( -n2 - n3 + n2 * n3 + powf( n3, 2 ) ) * ( n2 + n3 - 2 * powf( n3, 2 ) );
-						lerpfrac = (float)( demo_time - currentcam->timeStamp ) / (float)( nextcam->timeStamp - currentcam->timeStamp );
-						lerpspline = A * powf( lerpfrac, 2 ) + B * lerpfrac;
-					} else if( previouscam && nextcam && secondnextcam ) {
-						n1 = currentcam->timeStamp - previouscam->timeStamp;
-						n2 = nextcam->timeStamp - currentcam->timeStamp;
-						n3 = secondnextcam->timeStamp - nextcam->timeStamp;
-						A = -2 * powf( n2, 2 ) * ( -powf( n2, 2 ) + n1 * n3 ) / ( 2 * n2 * n3 + powf( n2, 3 ) * n3 - 3 * powf( n2, 2 ) * n1 + n1 * powf( n2, 3 ) + 2 * n1 * n2 - 3 * powf( n2, 2 ) * n3 - 3 * powf( n2, 3 ) + 2 * powf( n2, 2 ) + powf( n2, 4 ) + n1 * powf( n2, 2 ) * n3 - 3 * n1 * n2 * n3 + 2 * n1 * n3 );
-						B = powf( n2, 2 ) * ( -2 * n1 - 3 * powf( n2, 2 ) - n2 * n3 + 2 * n3 + 3 * n1 * n3 + n1 * n2 ) / ( 2 * n2 * n3 + powf( n2, 3 ) * n3 - 3 * powf( n2, 2 ) * n1 + n1 * powf( n2, 3 ) + 2 * n1 * n2 - 3 * powf( n2, 2 ) * n3 - 3 * powf( n2, 3 ) + 2 * powf( n2, 2 ) + powf( n2, 4 ) + n1 * powf( n2, 2 ) * n3 - 3 * n1 * n2 * n3 + 2 * n1 * n3 );
-						C = -( powf( n2, 2 ) * n1 - 2 * n1 * n2 + 3 * n1 * n2 * n3 - 2 * n1 * n3 - 2 * powf( n2, 4 ) + 3 * powf( n2, 3 ) - 2 * powf( n2, 3 ) * n3 + 5 * powf( n2, 2 ) * n3 - 2 * powf( n2, 2 ) - 2 * n2 * n3 ) / ( 2 * n2 * n3 + powf( n2, 3 ) * n3 - 3 * powf( n2, 2 ) * n1 + n1 * powf( n2, 3 ) + 2 * n1 * n2 - 3 * powf( n2, 2 ) * n3 - 3 * powf( n2, 3 ) + 2 * powf( n2, 2 ) + powf( n2, 4 ) + n1 * powf( n2, 2 ) * n3 - 3 * n1 * n2 * n3 + 2 * n1 * n3 );
-						lerpfrac = (float)( demo_time - currentcam->timeStamp ) / (float)( nextcam->timeStamp - currentcam->timeStamp );
-						lerpspline = A * powf( lerpfrac, 3 ) + B * powf( lerpfrac, 2 ) + C * lerpfrac;
-					} else {
-						lerpfrac = 0;
-						lerpspline = 0;
-					}
-
+					lerpfrac = (float)( demo_time - currentcam->timeStamp ) / (float)( nextcam->timeStamp - currentcam->timeStamp );
+					float lerpspline = ( ( currentcam->spline[ 0 ] * lerpfrac + currentcam->spline[ 1 ] ) * lerpfrac + currentcam->spline[ 2 ] ) * lerpfrac;
 
 					VectorHermiteInterp( currentcam->origin, currentcam->tangent, nextcam->origin, nextcam->tangent, lerpspline, cam_origin );
 					if( !CG_DemoCam_LookAt( currentcam->trackEnt, cam_origin, &cam_angles ) ) {
@@ -1067,6 +1089,7 @@ static void CG_EditCam_Cmd_f() {
 				newtimestamp = 1;
 			}
 			currentcam->timeStamp = newtimestamp;
+			cam_timeline_dirty = true;
 			currentcam = CG_Democam_FindCurrent( demo_time );
 			nextcam = CG_Democam_FindNext( demo_time );
 			Com_Printf( "cam edited\n" );
@@ -1207,6 +1230,9 @@ void CG_DemocamInit() {
 		Com_Error( "CG_DemocamInit: no demo name string\n" );
 	}
 
+	cam_timeline.init( sys_allocator );
+	cam_timeline_dirty = true;
+
 	// see if there is any script for this demo, and load it
 	TempAllocator temp = cls.frame_arena.temp();
 	char * path = temp( "{}/base/demos/{}.cam", HomeDirPath(), cgs.demoName );
@@ -1237,6 +1263,7 @@ void CG_DemocamShutdown() {
 	}
 
 	CG_Democam_FreeCams();
+	cam_timeline.shutdown();
 }
 
 void CG_DemocamReset() {
@@ -4,6 +4,10 @@
 #include "cgame/cg_local.h"
 #include "client/renderer/renderer.h"
 #include "qcommon/array.h"
+#include "qcommon/memory_budget.h"
+#include "qcommon/threadpool.h"
+
+#include <emmintrin.h>
 
 static TextureBuffer decal_tiles_buffer;
 static TextureBuffer dlight_tiles_buffer;
@@ -22,12 +26,6 @@ struct Decal {
 	// NOTE(msc): uvwh should all be < 1.0
 };
 
-struct PersistentDecal {
-	Decal decal;
-	s64 spawn_time;
-	s64 duration;
-};
-
 STATIC_ASSERT( sizeof( Decal ) == 2 * 4 * sizeof( float ) );
 STATIC_ASSERT( sizeof( Decal ) % alignof( Decal ) == 0 );
 
@@ -37,13 +35,6 @@ struct DynamicLight {
 	float radius;
 };
 
-struct PersistentDynamicLight {
-	DynamicLight dlight;
-	float start_intensity;
-	s64 spawn_time;
-	s64 duration;
-};
-
 STATIC_ASSERT( sizeof( DynamicLight ) == 1 * 4 * sizeof( float ) );
 STATIC_ASSERT( sizeof( DynamicLight ) % alignof( DynamicLight ) == 0 );
 
@@ -61,11 +52,39 @@ static u32 num_decals;
 static DynamicLight dlights[ MAX_DLIGHTS ];
 static u32 num_dlights;
 
-static PersistentDecal persistent_decals[ MAX_DECALS ];
-static u32 num_persistent_decals;
+// these get reset once they've been uploaded, so remember how many we drew
+static u32 last_frame_decals;
+static u32 last_frame_dlights;
 
-static PersistentDynamicLight persistent_dlights[ MAX_DLIGHTS ];
-static u32 num_persistent_dlights;
+/*
+ * persistent decals and dlights are stored SoA so culling and fading can go
+ * four at a time. the float arrays have room for a trailing partial block.
+ * nothing expires before next_expiry, so most frames skip compaction entirely
+ */
+struct PersistentDecals {
+	Decal decals[ MAX_DECALS ];
+	float x[ MAX_DECALS + 4 ], y[ MAX_DECALS + 4 ], z[ MAX_DECALS + 4 ];
+	float radius[ MAX_DECALS + 4 ];
+	s64 expiry[ MAX_DECALS ];
+	u32 n;
+	s64 next_expiry;
+};
+
+struct PersistentDynamicLights {
+	DynamicLight dlights[ MAX_DLIGHTS ];
+	float x[ MAX_DLIGHTS + 4 ], y[ MAX_DLIGHTS + 4 ], z[ MAX_DLIGHTS + 4 ];
+	float radius[ MAX_DLIGHTS + 4 ];
+	float start_intensity[ MAX_DLIGHTS + 4 ];
+	float inv_duration[ MAX_DLIGHTS + 4 ];
+	float age[ MAX_DLIGHTS + 4 ];
+	s64 spawn_time[ MAX_DLIGHTS ];
+	s64 expiry[ MAX_DLIGHTS ];
+	u32 n;
+	s64 next_expiry;
+};
+
+static PersistentDecals persistent_decals;
+static PersistentDynamicLights persistent_dlights;
 
 struct DecalTile {
 	u32 decals[ MAX_DECALS_PER_TILE ];
@@ -85,18 +104,70 @@ struct DynamicCount {
 
 static Span2D< DynamicCount > gpu_dynamic_counts;
 
+enum DynamicType {
+	DynamicType_Decal,
+	DynamicType_Light,
+};
+
+struct DynamicRect {
+	DynamicType type;
+	u32 minx, miny, maxx, maxy;
+	u32 idx;
+};
+
+struct DynamicSet {
+	u32 indices[ MAX_DYNAMICS_PER_SET ];
+	DynamicType types[ MAX_DYNAMICS_PER_SET ];
+	u32 num;
+};
+
+/*
+ * these get reused every frame so binning doesn't hit the allocator. each
+ * tile row only reads the coverage sets and writes its own tiles, so the
+ * rows get filled in on the thread pool
+ */
+static NonRAIIDynamicArray< DynamicRect > dynamic_rects;
+static Span< DynamicSet > rows_coverage;
+static Span< DynamicSet > cols_coverage;
+static u32 tile_cols;
+
+static void DecalsMemoryBudget( MemoryBudget * budget ) {
+	budget->add_array( "decals", decals, last_frame_decals );
+	budget->add_array( "dlights", dlights, last_frame_dlights );
+	budget->add_array( "persistent_decals", sizeof( persistent_decals ), persistent_decals.n, MAX_DECALS );
+	budget->add_array( "persistent_dlights", sizeof( persistent_dlights ), persistent_dlights.n, MAX_DLIGHTS );
+
+	size_t tiles_bytes = gpu_decal_tiles.num_bytes() + gpu_dlight_tiles.num_bytes() + gpu_dynamic_counts.num_bytes();
+	budget->heap_bytes += tiles_bytes;
+	budget->heap_bytes += rows_coverage.num_bytes() + cols_coverage.num_bytes();
+	budget->heap_bytes += dynamic_rects.size() * sizeof( DynamicRect );
+
+	budget->vram_bytes += tiles_bytes;
+	budget->vram_bytes += MAX_DECALS * sizeof( Decal ) + MAX_DECALS * sizeof( DynamicLight );
+}
+
 void InitDecals() {
-	num_persistent_decals = 0;
-	num_persistent_dlights = 0;
+	persistent_decals.n = 0;
+	persistent_decals.next_expiry = S64_MAX;
+	persistent_dlights.n = 0;
+	persistent_dlights.next_expiry = S64_MAX;
 
 	last_viewport_width = U32_MAX;
 	last_viewport_height = U32_MAX;
 
 	decals_buffer = NewTextureBuffer( TextureBufferFormat_Floatx4, MAX_DECALS * sizeof( Decal ) / sizeof( Vec4 ) );
 	dlights_buffer = NewTextureBuffer( TextureBufferFormat_Floatx4, MAX_DECALS * sizeof( DynamicLight ) / sizeof( Vec4 ) );
+
+	dynamic_rects.init( sys_allocator );
+
+	last_frame_decals = 0;
+	last_frame_dlights = 0;
+	AddMemoryBudget( "decals", DecalsMemoryBudget );
 }
 
 void ShutdownDecals() {
+	RemoveMemoryBudget( "decals" );
+
 	FREE( sys_allocator, gpu_decal_tiles.ptr );
 	gpu_decal_tiles.ptr = NULL;
 	DeferDeleteTextureBuffer( decal_tiles_buffer );
@@ -108,6 +179,13 @@ void ShutdownDecals() {
 	FREE( sys_allocator, gpu_dynamic_counts.ptr );
 	gpu_dynamic_counts.ptr = NULL;
 	DeferDeleteTextureBuffer( dynamic_count );
+
+	FREE( sys_allocator, rows_coverage.ptr );
+	rows_coverage.ptr = NULL;
+	FREE( sys_allocator, cols_coverage.ptr );
+	cols_coverage.ptr = NULL;
+
+	dynamic_rects.shutdown();
 }
 
 void DrawDecal( Vec3 origin, Vec3 normal, float radius, float angle, StringHash name, Vec4 color, float height ) {
@@ -133,11 +211,10 @@ void DrawDecal( Vec3 origin, Vec3 normal, float radius, float angle, StringHash
 }
 
 void AddPersistentDecal( Vec3 origin, Vec3 normal, float radius, float angle, StringHash name, Vec4 color, s64 duration, float height ) {
-	if( num_persistent_decals == ARRAY_COUNT( persistent_decals ) )
+	PersistentDecals * pd = &persistent_decals;
+	if( pd->n == ARRAY_COUNT( pd->decals ) )
 		return;
 
-	PersistentDecal * decal = &persistent_decals[ num_persistent_decals ];
-
 	Vec4 uvwh;
 	if( !TryFindDecal( name, &uvwh ) ) {
 		Com_GGPrint( S_COLOR_YELLOW "Material {} should have decal key", name );
@@ -147,30 +224,110 @@ void AddPersistentDecal( Vec3 origin, Vec3 normal, float radius, float angle, St
 	Vec3 c = Floor( color.xyz() * 255.0f );
 	c.x += floorf( height ) * 256.0f;
 
-	decal->decal.origin_normal = Floor( origin ) + ( normal * 0.4f + 0.5f );
-	decal->decal.radius_angle = floorf( radius ) + angle / 2.0f / PI;
-	decal->decal.color_uvwh_height = Vec4( uvwh.x, uvwh.y + c.x, uvwh.z + c.y, uvwh.w + c.z );
-	decal->spawn_time = cl.serverTime;
-	decal->duration = duration;
+	u32 i = pd->n;
+	Decal * decal = &pd->decals[ i ];
+	decal->origin_normal = Floor( origin ) + ( normal * 0.4f + 0.5f );
+	decal->radius_angle = floorf( radius ) + angle / 2.0f / PI;
+	decal->color_uvwh_height = Vec4( uvwh.x, uvwh.y + c.x, uvwh.z + c.y, uvwh.w + c.z );
 
-	num_persistent_decals++;
+	pd->x[ i ] = origin.x;
+	pd->y[ i ] = origin.y;
+	pd->z[ i ] = origin.z;
+	pd->radius[ i ] = radius;
+	pd->expiry[ i ] = cl.serverTime + duration;
+	pd->next_expiry = Min2( pd->next_expiry, pd->expiry[ i ] );
+
+	pd->n++;
+}
+
+struct FrustumPlanes {
+	__m128 x[ 5 ], y[ 5 ], z[ 5 ], d[ 5 ];
+};
+
+/*
+ * side and near planes of the view frustum, pulled out of the combined
+ * matrix. there's no far plane
+ */
+static FrustumPlanes ViewFrustumPlanes() {
+	Mat4 M = frame_static.P * frame_static.V;
+	Vec4 planes[] = {
+		M.row3() + M.row0(),
+		M.row3() - M.row0(),
+		M.row3() + M.row1(),
+		M.row3() - M.row1(),
+		M.row3() + M.row2(),
+	};
+
+	FrustumPlanes frustum;
+	for( size_t i = 0; i < ARRAY_COUNT( planes ); i++ ) {
+		float inv_length = 1.0f / Length( planes[ i ].xyz() );
+		frustum.x[ i ] = _mm_set1_ps( planes[ i ].x * inv_length );
+		frustum.y[ i ] = _mm_set1_ps( planes[ i ].y * inv_length );
+		frustum.z[ i ] = _mm_set1_ps( planes[ i ].z * inv_length );
+		frustum.d[ i ] = _mm_set1_ps( planes[ i ].w * inv_length );
+	}
+
+	return frustum;
+}
+
+// returns a 4 bit mask of which spheres in the block touch the frustum
+static int SpheresInFrustum( const FrustumPlanes & frustum, const float * x, const float * y, const float * z, const float * radius ) {
+	__m128 px = _mm_loadu_ps( x );
+	__m128 py = _mm_loadu_ps( y );
+	__m128 pz = _mm_loadu_ps( z );
+	__m128 neg_radius = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( radius ) );
+
+	__m128 inside = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+	for( int i = 0; i < 5; i++ ) {
+		__m128 dist = _mm_add_ps(
+			_mm_add_ps( _mm_mul_ps( frustum.x[ i ], px ), _mm_mul_ps( frustum.y[ i ], py ) ),
+			_mm_add_ps( _mm_mul_ps( frustum.z[ i ], pz ), frustum.d[ i ] ) );
+		inside = _mm_and_ps( inside, _mm_cmpge_ps( dist, neg_radius ) );
+	}
+
+	return _mm_movemask_ps( inside );
 }
 
 void DrawPersistentDecals() {
-	for( u32 i = 0; i < num_persistent_decals; i++ ) {
-		if( num_decals == ARRAY_COUNT( decals ) )
-			break;
-
-		PersistentDecal * decal = &persistent_decals[ i ];
-		if( decal->spawn_time + decal->duration < cl.serverTime ) {
-			num_persistent_decals--;
-			Swap2( decal, &persistent_decals[ num_persistent_decals ] );
-			i--;
-			continue;
+	ZoneScoped;
+
+	PersistentDecals * pd = &persistent_decals;
+
+	if( cl.serverTime > pd->next_expiry ) {
+		ZoneScopedN( "Expire decals" );
+
+		pd->next_expiry = S64_MAX;
+		u32 i = 0;
+		while( i < pd->n ) {
+			if( pd->expiry[ i ] < cl.serverTime ) {
+				pd->n--;
+				pd->decals[ i ] = pd->decals[ pd->n ];
+				pd->x[ i ] = pd->x[ pd->n ];
+				pd->y[ i ] = pd->y[ pd->n ];
+				pd->z[ i ] = pd->z[ pd->n ];
+				pd->radius[ i ] = pd->radius[ pd->n ];
+				pd->expiry[ i ] = pd->expiry[ pd->n ];
+				continue;
+			}
+
+			pd->next_expiry = Min2( pd->next_expiry, pd->expiry[ i ] );
+			i++;
 		}
+	}
 
-		decals[ num_decals ] = decal->decal;
-		num_decals++;
+	FrustumPlanes frustum = ViewFrustumPlanes();
+
+	for( u32 i = 0; i < pd->n; i += 4 ) {
+		int visible = SpheresInFrustum( frustum, &pd->x[ i ], &pd->y[ i ], &pd->z[ i ], &pd->radius[ i ] );
+		for( u32 j = 0; j < 4 && i + j < pd->n; j++ ) {
+			if( ( visible & ( 1 << j ) ) == 0 )
+				continue;
+			if( num_decals == ARRAY_COUNT( decals ) )
+				return;
+
+			decals[ num_decals ] = pd->decals[ i + j ];
+			num_decals++;
+		}
 	}
 }
 
@@ -187,40 +344,86 @@ void DrawDynamicLight( Vec3 origin, Vec4 color, float intensity ) {
 }
 
 void AddPersistentDynamicLight( Vec3 origin, Vec4 color, float intensity, s64 duration ) {
-	if( num_persistent_dlights == ARRAY_COUNT( persistent_dlights ) )
+	PersistentDynamicLights * pd = &persistent_dlights;
+	if( pd->n == ARRAY_COUNT( pd->dlights ) )
 		return;
 
-	PersistentDynamicLight * dlight = &persistent_dlights[ num_persistent_dlights ];
-
+	u32 i = pd->n;
+	pd->dlights[ i ].origin_color = Floor( origin ) + color.xyz() * 0.9f;
+	pd->dlights[ i ].radius = sqrtf( intensity / DLIGHT_CUTOFF );
 
-	dlight->dlight.origin_color = Floor( origin ) + color.xyz() * 0.9f;
-	dlight->dlight.radius = sqrtf( intensity / DLIGHT_CUTOFF );
-	dlight->start_intensity = intensity;
-	dlight->spawn_time = cl.serverTime;
-	dlight->duration = duration;
+	pd->x[ i ] = origin.x;
+	pd->y[ i ] = origin.y;
+	pd->z[ i ] = origin.z;
+	pd->start_intensity[ i ] = intensity;
+	pd->inv_duration[ i ] = duration > 0 ? 1.0f / duration : 0.0f;
+	pd->spawn_time[ i ] = cl.serverTime;
+	pd->expiry[ i ] = cl.serverTime + duration;
+	pd->next_expiry = Min2( pd->next_expiry, pd->expiry[ i ] );
 
-	num_persistent_dlights++;
+	pd->n++;
 }
 
 void DrawPersistentDynamicLights() {
-	for( u32 i = 0; i < num_persistent_dlights; i++ ) {
-		if( num_dlights == ARRAY_COUNT( dlights ) )
-			break;
-
-		PersistentDynamicLight * dlight = &persistent_dlights[ i ];
-		if( dlight->spawn_time + dlight->duration < cl.serverTime ) {
-			num_persistent_dlights--;
-			Swap2( dlight, &persistent_dlights[ num_persistent_dlights ] );
-			i--;
-			continue;
+	ZoneScoped;
+
+	PersistentDynamicLights * pd = &persistent_dlights;
+
+	if( cl.serverTime > pd->next_expiry ) {
+		ZoneScopedN( "Expire dlights" );
+
+		pd->next_expiry = S64_MAX;
+		u32 i = 0;
+		while( i < pd->n ) {
+			if( pd->expiry[ i ] < cl.serverTime ) {
+				pd->n--;
+				pd->dlights[ i ] = pd->dlights[ pd->n ];
+				pd->x[ i ] = pd->x[ pd->n ];
+				pd->y[ i ] = pd->y[ pd->n ];
+				pd->z[ i ] = pd->z[ pd->n ];
+				pd->start_intensity[ i ] = pd->start_intensity[ pd->n ];
+				pd->inv_duration[ i ] = pd->inv_duration[ pd->n ];
+				pd->spawn_time[ i ] = pd->spawn_time[ pd->n ];
+				pd->expiry[ i ] = pd->expiry[ pd->n ];
+				continue;
+			}
+
+			pd->next_expiry = Min2( pd->next_expiry, pd->expiry[ i ] );
+			i++;
 		}
+	}
+
+	// ages are small so they're safe to do in float, the rest goes four at a time
+	for( u32 i = 0; i < pd->n; i++ ) {
+		pd->age[ i ] = float( cl.serverTime - pd->spawn_time[ i ] );
+	}
 
-		// TODO: add better curves maybe
-		float fract = float( cl.serverTime - dlight->spawn_time ) / float( dlight->duration );
-		float intensity = Lerp( dlight->start_intensity, fract, 0.0f );
-		dlight->dlight.radius = sqrtf( intensity / DLIGHT_CUTOFF );
-		dlights[ num_dlights ] = dlight->dlight;
-		num_dlights++;
+	// TODO: add better curves maybe
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 inv_cutoff = _mm_set1_ps( 1.0f / DLIGHT_CUTOFF );
+	for( u32 i = 0; i < pd->n; i += 4 ) {
+		__m128 fract = _mm_mul_ps( _mm_loadu_ps( &pd->age[ i ] ), _mm_loadu_ps( &pd->inv_duration[ i ] ) );
+		__m128 intensity = _mm_mul_ps( _mm_loadu_ps( &pd->start_intensity[ i ] ), _mm_sub_ps( one, fract ) );
+		__m128 radius = _mm_sqrt_ps( _mm_max_ps( _mm_mul_ps( intensity, inv_cutoff ), zero ) );
+		_mm_storeu_ps( &pd->radius[ i ], radius );
+	}
+
+	FrustumPlanes frustum = ViewFrustumPlanes();
+
+	for( u32 i = 0; i < pd->n; i += 4 ) {
+		int visible = SpheresInFrustum( frustum, &pd->x[ i ], &pd->y[ i ], &pd->z[ i ], &pd->radius[ i ] );
+		for( u32 j = 0; j < 4 && i + j < pd->n; j++ ) {
+			if( ( visible & ( 1 << j ) ) == 0 )
+				continue;
+			if( num_dlights == ARRAY_COUNT( dlights ) )
+				return;
+
+			DynamicLight dlight = pd->dlights[ i + j ];
+			dlight.radius = pd->radius[ i + j ];
+			dlights[ num_dlights ] = dlight;
+			num_dlights++;
+		}
 	}
 }
 
@@ -313,35 +516,80 @@ void AllocateDecalBuffers() {
 		gpu_dynamic_counts = ALLOC_SPAN2D( sys_allocator, DynamicCount, cols, rows );
 		dynamic_count = NewTextureBuffer( TextureBufferFormat_U8x2, rows * cols );
 
+		FREE( sys_allocator, rows_coverage.ptr );
+		rows_coverage = ALLOC_SPAN( sys_allocator, DynamicSet, rows );
+		FREE( sys_allocator, cols_coverage.ptr );
+		cols_coverage = ALLOC_SPAN( sys_allocator, DynamicSet, cols );
+
 		last_viewport_width = frame_static.viewport_width;
 		last_viewport_height = frame_static.viewport_height;
 	}
-}
 
-enum DynamicType {
-	DynamicType_Decal,
-	DynamicType_Light,
-};
+	// the buffers are sized for the full viewport, but only use as many
+	// tiles as the scene needs so the layout matches what the shader expects
+	u32 scene_rows = ( frame_static.scene_height + TILE_SIZE - 1 ) / TILE_SIZE;
+	u32 scene_cols = ( frame_static.scene_width + TILE_SIZE - 1 ) / TILE_SIZE;
+	gpu_decal_tiles = Span2D< DecalTile >( gpu_decal_tiles.ptr, scene_cols, scene_rows );
+	gpu_dlight_tiles = Span2D< DynamicLightTile >( gpu_dlight_tiles.ptr, scene_cols, scene_rows );
+	gpu_dynamic_counts = Span2D< DynamicCount >( gpu_dynamic_counts.ptr, scene_cols, scene_rows );
+	rows_coverage = Span< DynamicSet >( rows_coverage.ptr, scene_rows );
+	cols_coverage = Span< DynamicSet >( cols_coverage.ptr, scene_cols );
+}
 
-struct DynamicRect {
-	DynamicType type;
-	u32 minx, miny, maxx, maxy;
-	u32 idx;
-};
+static void FillTileRow( TempAllocator * temp, void * data ) {
+	ZoneScoped;
 
-struct DynamicSet {
-	u32 indices[ MAX_DYNAMICS_PER_SET ];
-	DynamicType types[ MAX_DYNAMICS_PER_SET ];
-	u32 num;
-};
+	const DynamicSet & y_set = *( const DynamicSet * ) data;
+	u32 y = &y_set - rows_coverage.ptr;
+
+	for( u32 x = 0; x < tile_cols; x++ ) {
+		const DynamicSet & x_set = cols_coverage[ x ];
+		u32 x_idx = 0;
+		u32 y_idx = 0;
+		DecalTile & decal_tile = gpu_decal_tiles( x, y );
+		DynamicLightTile & dlight_tile = gpu_dlight_tiles( x, y );
+
+		// NOTE(msc): decals guaranteed to sorted front to back / high to low
+		while( x_idx < x_set.num && y_idx < y_set.num ) {
+			u32 x_instance = x_set.indices[ x_idx ];
+			u32 y_instance = y_set.indices[ y_idx ];
+			// NOTE(msc): instance in both column & row, must be active in this cell
+			if( x_instance == y_instance ) {
+				DynamicType type = x_set.types[ x_idx ];
+				DynamicCount &count = gpu_dynamic_counts( x, y );
+				if( type == DynamicType_Decal ) {
+					if( count.decal_count < MAX_DECALS_PER_TILE ) {
+						decal_tile.decals[ count.decal_count ] = x_instance;
+						count.decal_count++;
+					}
+				}
+				else if( type == DynamicType_Light ) {
+					if( count.dlight_count < MAX_DLIGHTS_PER_TILE ) {
+						dlight_tile.dlights[ count.dlight_count ] = x_instance - num_decals;
+						count.dlight_count++;
+					}
+				}
+				if( count.decal_count == MAX_DECALS_PER_TILE && count.dlight_count == MAX_DLIGHTS_PER_TILE ) {
+					break;
+				}
+				x_idx++;
+				y_idx++;
+			} else if( x_instance > y_instance ) {
+				// NOTE(msc): indices ordered high to low
+				x_idx++;
+			} else {
+				y_idx++;
+			}
+		}
+	}
+}
 
 void UploadDecalBuffers() {
 	ZoneScoped;
 
-	u32 rows = ( frame_static.viewport_height + TILE_SIZE - 1 ) / TILE_SIZE;
-	u32 cols = ( frame_static.viewport_width + TILE_SIZE - 1 ) / TILE_SIZE;
+	u32 cols = ( frame_static.scene_width + TILE_SIZE - 1 ) / TILE_SIZE;
 
-	DynamicArray< DynamicRect > rects( sys_allocator );
+	dynamic_rects.clear();
 
 	for( u32 i = 0; i < num_dlights; i++ ) {
 		u32 index = num_dlights - i - 1;
@@ -354,11 +602,11 @@ void UploadDecalBuffers() {
 			continue;
 		}
 
-		Vec2 mins = ( bounds.mins + 1.0f ) * 0.5f * frame_static.viewport;
-		mins = Clamp( Vec2( 0.0f ), mins, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+		Vec2 mins = ( bounds.mins + 1.0f ) * 0.5f * frame_static.scene_viewport;
+		mins = Clamp( Vec2( 0.0f ), mins, frame_static.scene_viewport - 1.0f ) / float( TILE_SIZE );
 
-		Vec2 maxs = ( bounds.maxs + 1.0f ) * 0.5f * frame_static.viewport;
-		maxs = Clamp( Vec2( 0.0f ), maxs, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+		Vec2 maxs = ( bounds.maxs + 1.0f ) * 0.5f * frame_static.scene_viewport;
+		maxs = Clamp( Vec2( 0.0f ), maxs, frame_static.scene_viewport - 1.0f ) / float( TILE_SIZE );
 
 		DynamicRect rect;
 		rect.type = DynamicType_Light;
@@ -367,7 +615,7 @@ void UploadDecalBuffers() {
 		rect.maxx = maxs.x;
 		rect.maxy = maxs.y;
 		rect.idx = num_decals + index;
-		rects.add( rect );
+		dynamic_rects.add( rect );
 	}
 
 	for( u32 i = 0; i < num_decals; i++ ) {
@@ -381,11 +629,11 @@ void UploadDecalBuffers() {
 			continue;
 		}
 
-		Vec2 mins = ( bounds.mins + 1.0f ) * 0.5f * frame_static.viewport;
-		mins = Clamp( Vec2( 0.0f ), mins, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+		Vec2 mins = ( bounds.mins + 1.0f ) * 0.5f * frame_static.scene_viewport;
+		mins = Clamp( Vec2( 0.0f ), mins, frame_static.scene_viewport - 1.0f ) / float( TILE_SIZE );
 
-		Vec2 maxs = ( bounds.maxs + 1.0f ) * 0.5f * frame_static.viewport;
-		maxs = Clamp( Vec2( 0.0f ), maxs, frame_static.viewport - 1.0f ) / float( TILE_SIZE );
+		Vec2 maxs = ( bounds.maxs + 1.0f ) * 0.5f * frame_static.scene_viewport;
+		maxs = Clamp( Vec2( 0.0f ), maxs, frame_static.scene_viewport - 1.0f ) / float( TILE_SIZE );
 
 		DynamicRect rect;
 		rect.type = DynamicType_Decal;
@@ -394,20 +642,20 @@ void UploadDecalBuffers() {
 		rect.maxx = maxs.x;
 		rect.maxy = maxs.y;
 		rect.idx = index;
-		rects.add( rect );
+		dynamic_rects.add( rect );
 	}
 
 	{
 		ZoneScopedN( "Fill buffers" );
 
-		Span< DynamicSet > rows_coverage = ALLOC_SPAN( sys_allocator, DynamicSet, rows );
-		Span< DynamicSet > cols_coverage = ALLOC_SPAN( sys_allocator, DynamicSet, cols );
-
-		memset( rows_coverage.ptr, 0, rows_coverage.num_bytes() );
-		memset( cols_coverage.ptr, 0, cols_coverage.num_bytes() );
+		for( DynamicSet & set : rows_coverage ) {
+			set.num = 0;
+		}
+		for( DynamicSet & set : cols_coverage ) {
+			set.num = 0;
+		}
 
-		for( u32 i = 0; i < rects.size(); i++ ) {
-			DynamicRect & rect = rects[ i ];
+		for( const DynamicRect & rect : dynamic_rects ) {
 			for( u32 x = rect.minx; x <= rect.maxx; x++ ) {
 				DynamicSet & set = cols_coverage[ x ];
 				if( set.num < MAX_DYNAMICS_PER_SET ) {
@@ -428,52 +676,8 @@ void UploadDecalBuffers() {
 
 		memset( gpu_dynamic_counts.ptr, 0, gpu_dynamic_counts.num_bytes() );
 
-		for( u32 y = 0; y < rows; y++ ) {
-			DynamicSet & y_set = rows_coverage[ y ];
-			for( u32 x = 0; x < cols; x++ ) {
-				DynamicSet & x_set = cols_coverage[ x ];
-				u32 x_idx = 0;
-				u32 y_idx = 0;
-				DecalTile & decal_tile = gpu_decal_tiles( x, y );
-				DynamicLightTile & dlight_tile = gpu_dlight_tiles( x, y );
-
-				// NOTE(msc): decals guaranteed to sorted front to back / high to low
-				while( x_idx < x_set.num && y_idx < y_set.num ) {
-					u32 x_instance = x_set.indices[ x_idx ];
-					u32 y_instance = y_set.indices[ y_idx ];
-					// NOTE(msc): instance in both column & row, must be active in this cell
-					if( x_instance == y_instance ) {
-						DynamicType type = x_set.types[ x_idx ];
-						DynamicCount &count = gpu_dynamic_counts( x, y );
-						if( type == DynamicType_Decal ) {
-							if( count.decal_count < MAX_DECALS_PER_TILE ) {
-								decal_tile.decals[ count.decal_count ] = x_instance;
-								count.decal_count++;
-							}
-						}
-						else if( type == DynamicType_Light ) {
-							if( count.dlight_count < MAX_DLIGHTS_PER_TILE ) {
-								dlight_tile.dlights[ count.dlight_count ] = x_instance - num_decals;
-								count.dlight_count++;
-							}
-						}
-						if( count.decal_count == MAX_DECALS_PER_TILE && count.dlight_count == MAX_DLIGHTS_PER_TILE ) {
-							break;
-						}
-						x_idx++;
-						y_idx++;
-					} else if( x_instance > y_instance ) {
-						// NOTE(msc): indices ordered high to low
-						x_idx++;
-					} else {
-						y_idx++;
-					}
-				}
-			}
-		}
-
-		FREE( sys_allocator, rows_coverage.ptr );
-		FREE( sys_allocator, cols_coverage.ptr );
+		tile_cols = cols;
+		ParallelFor( rows_coverage, FillTileRow );
 	}
 
 	{
@@ -485,18 +689,20 @@ void UploadDecalBuffers() {
 		WriteTextureBuffer( dlights_buffer, dlights, num_dlights * sizeof( DynamicLight ) );
 	}
 
+	last_frame_decals = num_decals;
+	last_frame_dlights = num_dlights;
 	num_decals = 0;
 	num_dlights = 0;
 }
 
 void AddDynamicsToPipeline( PipelineState * pipeline ) {
-	pipeline->set_uniform( "u_Decal", UploadUniformBlock( s32( num_decals ) ) );
-	pipeline->set_texture_buffer( "u_DecalTiles", decal_tiles_buffer );
-	pipeline->set_texture_buffer( "u_DecalData", decals_buffer );
+	pipeline->set_uniform( UniformSlot_Decal, UploadUniformBlock( s32( num_decals ) ) );
+	pipeline->set_texture_buffer( TextureBufferSlot_DecalTiles, decal_tiles_buffer );
+	pipeline->set_texture_buffer( TextureBufferSlot_DecalData, decals_buffer );
 
-	pipeline->set_uniform( "u_DynamicLight", UploadUniformBlock( s32( num_dlights ) ) );
-	pipeline->set_texture_buffer( "u_DynamicLightTiles", dlight_tiles_buffer );
-	pipeline->set_texture_buffer( "u_DynamicLightData", dlights_buffer );
+	pipeline->set_uniform( UniformSlot_DynamicLight, UploadUniformBlock( s32( num_dlights ) ) );
+	pipeline->set_texture_buffer( TextureBufferSlot_DynamicLightTiles, dlight_tiles_buffer );
+	pipeline->set_texture_buffer( TextureBufferSlot_DynamicLightData, dlights_buffer );
 
-	pipeline->set_texture_buffer( "u_DynamicCount", dynamic_count );
+	pipeline->set_texture_buffer( TextureBufferSlot_DynamicCount, dynamic_count );
 }
@@ -73,7 +73,7 @@ static bool CG_UpdateLinearProjectilePosition( centity_t *cent ) {
 	return true;
 }
 
-static void CG_NewPacketEntityState( SyncEntityState *state ) {
+static void CG_NewPacketEntityState( const SyncEntityState *state ) {
 	centity_t * cent = &cg_entities[state->number];
 
 	cent->prevVelocity = Vec3( 0.0f );
@@ -283,7 +283,7 @@ bool CG_NewFrameSnap( snapshot_t *frame, snapshot_t *lerpframe ) {
 	CG_UpdatePlayerState();
 
 	for( int i = 0; i < frame->numEntities; i++ ) {
-		CG_NewPacketEntityState( &frame->parsedEntities[i & ( MAX_PARSE_ENTITIES - 1 )] );
+		CG_NewPacketEntityState( frame->parsedEntities[i & ( MAX_PARSE_ENTITIES - 1 )] );
 	}
 
 	if( !cgs.precacheDone || !cg.frame.valid ) {
@@ -296,7 +296,7 @@ bool CG_NewFrameSnap( snapshot_t *frame, snapshot_t *lerpframe ) {
 	CG_UpdateEntities();
 	CG_CheckPredictionError();
 
-	cg.predictFrom = 0; // force the prediction to be restarted from the new snapshot
+	CG_CheckPredictionCache();
 	cg.fireEvents = true;
 
 	for( int i = 0; i < cg.frame.numgamecommands; i++ ) {
@@ -336,6 +336,34 @@ const cmodel_t *CG_CModelForEntity( int entNum ) {
 	return CM_ModelForBBox( cl.cms, cent->current.bounds.mins, cent->current.bounds.maxs );
 }
 
+/*
+ * CG_LerpEntities runs in two stages. the per type code works out origins
+ * and angles, and queues up anything that needs an axis. then everything
+ * gets its axis, transform and sound position in flat loops over contiguous
+ * arrays, so drawing doesn't rebuild matrices and the trig isn't interleaved
+ * with all the branchy lerping
+ */
+struct LerpedAngles {
+	centity_t * cent;
+	Vec3 angles;
+};
+
+static LerpedAngles lerped_angles[ MAX_PARSE_ENTITIES ];
+static int num_lerped_angles;
+
+static int lerped_entities[ MAX_PARSE_ENTITIES ];
+static Vec3 lerped_origins[ MAX_PARSE_ENTITIES ];
+static Vec3 lerped_velocities[ MAX_PARSE_ENTITIES ];
+static int num_lerped_entities;
+
+static Mat4 entity_transforms[ MAX_EDICTS ];
+
+static void QueueEntityAxis( centity_t * cent, Vec3 angles ) {
+	lerped_angles[ num_lerped_angles ].cent = cent;
+	lerped_angles[ num_lerped_angles ].angles = angles;
+	num_lerped_angles++;
+}
+
 static void CG_UpdateGenericEnt( centity_t *cent ) {
 	// start from clean
 	memset( &cent->interpolated, 0, sizeof( cent->interpolated ) );
@@ -352,7 +380,7 @@ void CG_ExtrapolateLinearProjectile( centity_t *cent ) {
 	cent->interpolated.origin = cent->current.origin;
 	cent->interpolated.origin2 = cent->current.origin;
 
-	AnglesToAxis( cent->current.angles, cent->interpolated.axis );
+	QueueEntityAxis( cent, cent->current.angles );
 }
 
 void CG_LerpGenericEnt( centity_t *cent ) {
@@ -365,11 +393,7 @@ void CG_LerpGenericEnt( centity_t *cent ) {
 		ent_angles = LerpAngles( cent->prev.angles, cg.lerpfrac, cent->current.angles );
 	}
 
-	if( ent_angles.x || ent_angles.y || ent_angles.z ) {
-		AnglesToAxis( ent_angles, cent->interpolated.axis );
-	} else {
-		Matrix3_Copy( axis_identity, cent->interpolated.axis );
-	}
+	QueueEntityAxis( cent, ent_angles );
 
 	if( ISVIEWERENTITY( cent->current.number ) || cg.view.POVent == cent->current.number ) {
 		cent->interpolated.origin = cg.predictedPlayerState.pmove.origin;
@@ -440,7 +464,7 @@ static void DrawEntityModel( centity_t * cent ) {
 	TempAllocator temp = cls.frame_arena.temp();
 
 	const Model * model = cent->interpolated.model;
-	Mat4 transform = FromAxisAndOrigin( cent->interpolated.axis, cent->interpolated.origin );
+	const Mat4 & transform = entity_transforms[ cent->current.number ];
 
 	Vec4 color = sRGBToLinear( cent->interpolated.color );
 
@@ -464,26 +488,25 @@ static void DrawEntityModel( centity_t * cent ) {
 		UniformBlock model_uniforms = UploadModelUniforms( transform * model->transform );
 		for( u32 i = 0; i < model->num_primitives; i++ ) {
 			if( model->primitives[ i ].material->blend_func == BlendFunc_Disabled ) {
-				{
-					PipelineState pipeline = MaterialToPipelineState( model->primitives[ i ].material );
-					pipeline.set_uniform( "u_View", frame_static.view_uniforms );
-					pipeline.set_uniform( "u_Model", model_uniforms );
+				PipelineState pipeline = MaterialToPipelineState( model->primitives[ i ].material );
+				pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
+				pipeline.set_uniform( UniformSlot_Model, model_uniforms );
 
-					DrawModelPrimitive( model, &model->primitives[ i ], pipeline );
-				}
-				for( u32 j = 0; j < frame_static.shadow_parameters.num_cascades; j++ ) {
-					PipelineState pipeline;
-					pipeline.pass = frame_static.shadowmap_pass[ j ];
-					pipeline.shader = &shaders.depth_only;
-					pipeline.clamp_depth = true;
-					// pipeline.cull_face = CullFace_Disabled;
-					pipeline.set_uniform( "u_View", frame_static.shadowmap_view_uniforms[ j ] );
-					pipeline.set_uniform( "u_Model", model_uniforms );
-
-					DrawModelPrimitive( model, &model->primitives[ i ], pipeline );
-				}
+				DrawModelPrimitive( model, &model->primitives[ i ], pipeline );
 			}
 		}
+
+		for( u32 j = 0; j < frame_static.shadow_parameters.num_cascades; j++ ) {
+			PipelineState pipeline;
+			pipeline.pass = frame_static.shadowmap_pass[ j ];
+			pipeline.shader = &shaders.depth_only;
+			pipeline.clamp_depth = true;
+			// pipeline.cull_face = CullFace_Disabled;
+			pipeline.set_uniform( UniformSlot_View, frame_static.shadowmap_view_uniforms[ j ] );
+			pipeline.set_uniform( UniformSlot_Model, model_uniforms );
+
+			DrawBSPModelShadows( model, pipeline );
+		}
 	}
 }
 
@@ -608,7 +631,7 @@ static void CG_LerpSpikes( centity_t * cent ) {
 	Vec3 up;
 	AngleVectors( cent->current.angles, NULL, NULL, &up );
 
-	AnglesToAxis( cent->current.angles, cent->interpolated.axis );
+	QueueEntityAxis( cent, cent->current.angles );
 	cent->interpolated.origin = cent->current.origin + up * position;
 	cent->interpolated.origin2 = cent->interpolated.origin;
 }
@@ -636,7 +659,7 @@ static void CG_UpdateSpikes( centity_t * cent ) {
 	}
 }
 
-void CG_EntityLoopSound( centity_t * cent, SyncEntityState * state ) {
+void CG_EntityLoopSound( centity_t * cent, const SyncEntityState * state ) {
 	cent->sound = S_ImmediateEntitySound( state->sound, state->number, 1.0f, cent->sound );
 }
 
@@ -655,7 +678,7 @@ void DrawEntities() {
 	ZoneScoped;
 
 	for( int pnum = 0; pnum < cg.frame.numEntities; pnum++ ) {
-		SyncEntityState * state = &cg.frame.parsedEntities[pnum & ( MAX_PARSE_ENTITIES - 1 )];
+		const SyncEntityState * state = cg.frame.parsedEntities[pnum & ( MAX_PARSE_ENTITIES - 1 )];
 		centity_t * cent = &cg_entities[state->number];
 
 		if( cent->current.linearMovement ) {
@@ -780,11 +803,36 @@ void DrawEntities() {
 * CG_LerpEntities
 * Interpolate the entity states positions into the entity_t structs
 */
+static void CG_BuildEntityTransforms() {
+	ZoneScoped;
+
+	for( int i = 0; i < num_lerped_angles; i++ ) {
+		const LerpedAngles * lerped = &lerped_angles[ i ];
+		if( lerped->angles == Vec3( 0.0f ) ) {
+			Matrix3_Copy( axis_identity, lerped->cent->interpolated.axis );
+		} else {
+			AnglesToAxis( lerped->angles, lerped->cent->interpolated.axis );
+		}
+	}
+
+	for( int i = 0; i < num_lerped_entities; i++ ) {
+		const centity_t * cent = &cg_entities[ lerped_entities[ i ] ];
+		entity_transforms[ lerped_entities[ i ] ] = FromAxisAndOrigin( cent->interpolated.axis, cent->interpolated.origin );
+	}
+
+	for( int i = 0; i < num_lerped_entities; i++ ) {
+		CG_GetEntitySpatialization( lerped_entities[ i ], &lerped_origins[ i ], &lerped_velocities[ i ] );
+	}
+}
+
 void CG_LerpEntities() {
 	ZoneScoped;
 
+	num_lerped_angles = 0;
+	num_lerped_entities = 0;
+
 	for( int pnum = 0; pnum < cg.frame.numEntities; pnum++ ) {
-		SyncEntityState * state = &cg.frame.parsedEntities[pnum & ( MAX_PARSE_ENTITIES - 1 )];
+		const SyncEntityState * state = cg.frame.parsedEntities[pnum & ( MAX_PARSE_ENTITIES - 1 )];
 		int number = state->number;
 		centity_t * cent = &cg_entities[number];
 
@@ -841,10 +889,14 @@ void CG_LerpEntities() {
 				break;
 		}
 
-		Vec3 origin, velocity;
-		CG_GetEntitySpatialization( number, &origin, &velocity );
-		S_UpdateEntity( number, origin, velocity );
+		lerped_entities[ num_lerped_entities ] = number;
+		num_lerped_entities++;
 	}
+
+	CG_BuildEntityTransforms();
+
+	S_UpdateEntities( Span< const int >( lerped_entities, num_lerped_entities ),
+		Span< const Vec3 >( lerped_origins, num_lerped_entities ), Span< const Vec3 >( lerped_velocities, num_lerped_entities ) );
 }
 
 /*
@@ -855,7 +907,7 @@ void CG_UpdateEntities() {
 	ZoneScoped;
 
 	for( int pnum = 0; pnum < cg.frame.numEntities; pnum++ ) {
-		SyncEntityState * state = &cg.frame.parsedEntities[pnum & ( MAX_PARSE_ENTITIES - 1 )];
+		const SyncEntityState * state = cg.frame.parsedEntities[pnum & ( MAX_PARSE_ENTITIES - 1 )];
 
 		if( cgs.demoPlaying ) {
 			if( ( state->svflags & SVF_ONLYTEAM ) && cg.predictedPlayerState.team != state->team )
@@ -432,7 +432,7 @@ void CG_Event_Fall( const SyncEntityState * state, u64 parm ) {
 /*
  * CG_Event_Pain
  */
-static void CG_Event_Pain( SyncEntityState * state, u64 parm ) {
+static void CG_Event_Pain( const SyncEntityState * state, u64 parm ) {
 	constexpr PlayerSound sounds[] = { PlayerSound_Pain25, PlayerSound_Pain50, PlayerSound_Pain75, PlayerSound_Pain100 };
 	if( parm >= ARRAY_COUNT( sounds ) )
 		return;
@@ -462,7 +462,7 @@ static void CG_Event_Die( int entNum, u64 parm ) {
 /*
  * CG_Event_Dash
  */
-void CG_Event_Dash( SyncEntityState * state, u64 parm ) {
+void CG_Event_Dash( const SyncEntityState * state, u64 parm ) {
 	constexpr int animations[] = { LEGS_DASH, LEGS_DASH_LEFT, LEGS_DASH_RIGHT, LEGS_DASH_BACK };
 	if( parm >= ARRAY_COUNT( animations ) )
 		return;
@@ -478,7 +478,7 @@ void CG_Event_Dash( SyncEntityState * state, u64 parm ) {
 /*
  * CG_Event_WallJump
  */
-void CG_Event_WallJump( SyncEntityState * state, u64 parm, int ev ) {
+void CG_Event_WallJump( const SyncEntityState * state, u64 parm, int ev ) {
 	Vec3 normal = U64ToDir( parm );
 
 	Vec3 forward, right;
@@ -511,7 +511,7 @@ static void CG_PlayJumpSound( const SyncEntityState * state ) {
 /*
  * CG_Event_Jump
  */
-static void CG_Event_Jump( SyncEntityState * state ) {
+static void CG_Event_Jump( const SyncEntityState * state ) {
 	CG_PlayJumpSound( state );
 
 	centity_t * cent = &cg_entities[ state->number ];
@@ -546,7 +546,7 @@ static void CG_Event_Jump( SyncEntityState * state ) {
 	}
 }
 
-void CG_EntityEvent( SyncEntityState * ent, int ev, u64 parm, bool predicted ) {
+void CG_EntityEvent( const SyncEntityState * ent, int ev, u64 parm, bool predicted ) {
 	bool viewer = ISVIEWERENTITY( ent->number );
 
 	if( viewer && ev < PREDICTABLE_EVENTS_MAX && predicted != cg.view.playerPrediction ) {
@@ -930,7 +930,7 @@ void CG_EntityEvent( SyncEntityState * ent, int ev, u64 parm, bool predicted ) {
 
 static void CG_FireEntityEvents( bool early ) {
 	for( int pnum = 0; pnum < cg.frame.numEntities; pnum++ ) {
-		SyncEntityState * state = &cg.frame.parsedEntities[ pnum & ( MAX_PARSE_ENTITIES - 1 ) ];
+		const SyncEntityState * state = cg.frame.parsedEntities[ pnum & ( MAX_PARSE_ENTITIES - 1 ) ];
 
 		if( cgs.demoPlaying ) {
 			if( ( state->svflags & SVF_ONLYTEAM ) && cg.predictedPlayerState.team != state->team )
@@ -952,6 +952,32 @@ static void CG_FireEntityEvents( bool early ) {
 			}
 		}
 	}
+
+	for( int i = 0; i < cg.frame.numEvents; i++ ) {
+		const SyncSnapEvent * ev = &cg.frame.events[ i ];
+
+		if( cgs.demoPlaying ) {
+			if( ( ev->svflags & SVF_ONLYTEAM ) && cg.predictedPlayerState.team != ev->team )
+				continue;
+			if( ( ( ev->svflags & SVF_ONLYOWNER ) || ( ev->svflags & SVF_OWNERANDCHASERS ) ) && cg.predictedPlayerState.POVnum != ev->ownerNum )
+				continue;
+		}
+
+		if( early != ISEARLYEVENT( ev->event.type ) )
+			continue;
+
+		// these used to be ET_EVENT entities, so dress them up as one
+		SyncEntityState state = { };
+		state.type = ET_EVENT;
+		state.svflags = ev->svflags;
+		state.origin = ev->origin;
+		state.origin2 = ev->origin2;
+		state.angles = ev->angles;
+		state.ownerNum = ev->ownerNum;
+		state.team = ev->team;
+
+		CG_EntityEvent( &state, ev->event.type, ev->event.parm, false );
+	}
 }
 
 /*
@@ -56,22 +56,80 @@ static const Font * GetHUDFont() {
 
 //=============================================================================
 
-using opFunc_t = float( * )( const float a, float b );
+enum LayoutOperator {
+	LayoutOperator_None,
+	LayoutOperator_Add,
+	LayoutOperator_Subtract,
+	LayoutOperator_Multiply,
+	LayoutOperator_Divide,
+	LayoutOperator_BitwiseAnd,
+	LayoutOperator_BitwiseOr,
+	LayoutOperator_BitwiseXor,
+	LayoutOperator_Equal,
+	LayoutOperator_NotEqual,
+	LayoutOperator_Greater,
+	LayoutOperator_GreaterOrEqual,
+	LayoutOperator_Smaller,
+	LayoutOperator_SmallerOrEqual,
+	LayoutOperator_And,
+	LayoutOperator_Or,
+};
+
+/*
+ * the script gets parsed into a tree of cg_layoutnode_t, which then gets
+ * compiled to a flat list of commands, each with a run of argument terms.
+ * if/ifnot store the index of the command after their endif, so execution is
+ * a single loop over the commands
+ */
+enum LayoutTermType {
+	LayoutTerm_Constant,
+	LayoutTerm_String,
+	LayoutTerm_Int,
+	LayoutTerm_U8,
+	LayoutTerm_S16,
+	LayoutTerm_Bool,
+	LayoutTerm_Cvar,
+	LayoutTerm_Callback,
+};
+
+struct LayoutTerm {
+	LayoutTermType type;
+	LayoutOperator op; // applied to this term and the rest of the expression
+	float value;
+	const char * string;
+	const void * ptr;
+	int ( *func )( const void * parameter );
+};
+
+struct LayoutArgs {
+	const LayoutTerm * cursor;
+	const LayoutTerm * end;
+};
+
+using LayoutFunc = bool ( * )( LayoutArgs * args );
+
+struct LayoutCommand {
+	LayoutFunc func;
+	u32 first_term;
+	u32 num_terms;
+	u32 next_if_false;
+};
 
 struct cg_layoutnode_t {
-	bool ( *func )( cg_layoutnode_t *argumentnode );
+	LayoutFunc func;
 	int type;
 	char *string;
 	int num_args;
 	size_t idx;
 	float value;
-	opFunc_t opFunc;
+	LayoutOperator op;
 	cg_layoutnode_t *args;
 	cg_layoutnode_t *next;
 	cg_layoutnode_t *ifthread;
 };
 
-static cg_layoutnode_t * hud_root;
+static NonRAIIDynamicArray< LayoutCommand > hud_commands;
+static NonRAIIDynamicArray< LayoutTerm > hud_terms;
 
 struct constant_numeric_t {
 	const char *name;
@@ -169,6 +227,10 @@ static int CG_GetFPS( const void *parameter ) {
 ;
 }
 
+static int CG_GetLatency( const void *parameter ) {
+	return int( cls.input_latency + 0.5f );
+}
+
 static int CG_GetMatchState( const void *parameter ) {
 	return client_gs.gameState.match_state;
 }
@@ -238,6 +300,7 @@ static const reference_numeric_t cg_numeric_references[] = {
 	{ "SPEED", CG_GetSpeed, NULL },
 	{ "SPEED_VERTICAL", CG_GetSpeedVertical, NULL },
 	{ "FPS", CG_GetFPS, NULL },
+	{ "LATENCY", CG_GetLatency, NULL },
 	{ "MATCH_STATE", CG_GetMatchState, NULL },
 	{ "PAUSED", CG_Paused, NULL },
 	{ "VIDWIDTH", CG_GetVidWidth, NULL },
@@ -248,6 +311,7 @@ static const reference_numeric_t cg_numeric_references[] = {
 
 	// cvars
 	{ "SHOW_FPS", CG_GetCvar, "cg_showFPS" },
+	{ "SHOW_LATENCY", CG_GetCvar, "cg_showLatency" },
 	{ "SHOW_POINTED_PLAYER", CG_GetCvar, "cg_showPointedPlayer" },
 	{ "SHOW_SPEED", CG_GetCvar, "cg_showSpeed" },
 	{ "SHOW_HOTKEYS", CG_GetCvar, "cg_showHotkeys" },
@@ -273,6 +337,11 @@ struct obituary_t {
 	int attacker_team;
 	DamageType damage_type;
 	bool wallbang;
+
+	// laid out the first time we draw them, and again if the HUD font changes
+	TextLayout victim_layout;
+	TextLayout attacker_layout;
+	const Material * icon;
 };
 
 static obituary_t cg_obituaries[MAX_OBITUARIES];
@@ -283,6 +352,8 @@ struct {
 	u64 entropy;
 	obituary_type_t type;
 	DamageType damage_type;
+	char text[ 256 ];
+	TextLayout layout;
 } self_obituary;
 
 void CG_SC_ResetObituaries() {
@@ -393,6 +464,9 @@ void CG_SC_Obituary() {
 	current->time = cls.monotonicTime;
 	current->damage_type = damage_type;
 	current->wallbang = wallbang;
+	current->victim_layout.font = NULL;
+	current->attacker_layout.font = NULL;
+	current->icon = NULL;
 
 	if( victim != NULL ) {
 		Q_strncpyz( current->victim, victim, sizeof( current->victim ) );
@@ -437,6 +511,8 @@ void CG_SC_Obituary() {
 		self_obituary.entropy = entropy;
 		self_obituary.type = current->type;
 		self_obituary.damage_type = damage_type;
+		Q_strncpyz( self_obituary.text, obituary, sizeof( self_obituary.text ) );
+		LayOutText( &self_obituary.layout, cgs.fontNormal, self_obituary.text );
 	}
 
 	if( attacker == victim ) {
@@ -560,7 +636,7 @@ static void CG_DrawObituaries(
 
 	i = next;
 	do {
-		const obituary_t * obr = &cg_obituaries[i];
+		obituary_t * obr = &cg_obituaries[i];
 		if( ++i >= MAX_OBITUARIES ) {
 			i = 0;
 		}
@@ -574,10 +650,18 @@ static void CG_DrawObituaries(
 			continue;
 		}
 
-		const Material * pic = DamageTypeToIcon( obr->damage_type );
+		if( obr->icon == NULL ) {
+			obr->icon = DamageTypeToIcon( obr->damage_type );
+		}
+		if( obr->attacker_layout.font != font ) {
+			LayOutText( &obr->attacker_layout, font, obr->attacker );
+		}
+		if( obr->victim_layout.font != font ) {
+			LayOutText( &obr->victim_layout, font, obr->victim );
+		}
 
-		float attacker_width = TextBounds( font, layout_cursor_font_size, obr->attacker ).maxs.x;
-		float victim_width = TextBounds( font, layout_cursor_font_size, obr->victim ).maxs.x;
+		float attacker_width = TextBounds( obr->attacker_layout, layout_cursor_font_size ).maxs.x;
+		float victim_width = TextBounds( obr->victim_layout, layout_cursor_font_size ).maxs.x;
 
 		int w = 0;
 		if( obr->type != OBITUARY_ACCIDENT ) {
@@ -607,13 +691,13 @@ static void CG_DrawObituaries(
 		int obituary_y = y + yoffset + ( line_height - layout_cursor_font_size ) / 2;
 		if( obr->type != OBITUARY_ACCIDENT ) {
 			Vec4 color = CG_TeamColorVec4( obr->attacker_team );
-			DrawText( font, layout_cursor_font_size, obr->attacker, x + xoffset, obituary_y, color, layout_cursor_font_border );
+			DrawText( obr->attacker_layout, layout_cursor_font_size, x + xoffset, obituary_y, color, layout_cursor_font_border );
 			xoffset += attacker_width;
 		}
 
 		xoffset += icon_padding;
 
-		Draw2DBox( x + xoffset, y + yoffset + ( line_height - icon_size ) / 2, icon_size, icon_size, pic, AttentionGettingColor() );
+		Draw2DBox( x + xoffset, y + yoffset + ( line_height - icon_size ) / 2, icon_size, icon_size, obr->icon, AttentionGettingColor() );
 		xoffset += icon_size + icon_padding;
 
 		if( obr->wallbang ) {
@@ -622,7 +706,7 @@ static void CG_DrawObituaries(
 		}
 
 		Vec4 color = CG_TeamColorVec4( obr->victim_team );
-		DrawText( font, layout_cursor_font_size, obr->victim, x + xoffset, obituary_y, color, layout_cursor_font_border );
+		DrawText( obr->victim_layout, layout_cursor_font_size, x + xoffset, obituary_y, color, layout_cursor_font_border );
 
 		yoffset += line_height;
 	} while( i != next );
@@ -637,15 +721,15 @@ static void CG_DrawObituaries(
 			Draw2DBox( 0, yy, frame_static.viewport.x, h, cls.white_material, Vec4( 0, 0, 0, Min2( 0.5f, t * 0.5f ) ) );
 
 			if( t >= 1.0f ) {
-				RNG rng = NewRNG( self_obituary.entropy, 0 );
-
-				TempAllocator temp = cls.frame_arena.temp();
-				const char * obituary = MakeObituary( &temp, &rng, self_obituary.type, self_obituary.damage_type );
-
 				float size = Lerp( h * 0.5f, Unlerp01( 1.0f, t, 3.0f ), h * 0.75f );
 				Vec4 color = CG_TeamColorVec4( TEAM_ENEMY );
 				color.w = Unlerp01( 1.0f, t, 2.0f );
-				DrawText( cgs.fontNormal, size, obituary, Alignment_CenterMiddle, frame_static.viewport.x * 0.5f, frame_static.viewport.y * 0.5f, color );
+				if( self_obituary.layout.font != NULL ) {
+					DrawText( self_obituary.layout, size, Alignment_CenterMiddle, frame_static.viewport.x * 0.5f, frame_static.viewport.y * 0.5f, color );
+				}
+				else {
+					DrawText( cgs.fontNormal, size, self_obituary.text, Alignment_CenterMiddle, frame_static.viewport.x * 0.5f, frame_static.viewport.y * 0.5f, color );
+				}
 			}
 		}
 	}
@@ -695,7 +779,7 @@ static void CG_DrawAwards( int x, int y, Alignment alignment, float font_size, V
 	}
 }
 
-static bool CG_LFuncDrawCallvote( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawCallvote( LayoutArgs * args ) {
 	const char * vote = cgs.configStrings[ CS_CALLVOTE ];
 	if( strlen( vote ) == 0 )
 		return true;
@@ -743,162 +827,64 @@ static bool CG_LFuncDrawCallvote( cg_layoutnode_t *argumentnode ) {
 // we will always operate with floats so we don't have to code 2 different numeric paths
 // it's not like using float or ints would make a difference in this simple-scripting case.
 
-static float CG_OpFuncAdd( const float a, const float b ) {
-	return a + b;
-}
-
-static float CG_OpFuncSubtract( const float a, const float b ) {
-	return a - b;
-}
-
-static float CG_OpFuncMultiply( const float a, const float b ) {
-	return a * b;
-}
-
-static float CG_OpFuncDivide( const float a, const float b ) {
-	return a / b;
-}
-
-static float CG_OpFuncAND( const float a, const float b ) {
-	return (int)a & (int)b;
-}
-
-static float CG_OpFuncOR( const float a, const float b ) {
-	return (int)a | (int)b;
-}
-
-static float CG_OpFuncXOR( const float a, const float b ) {
-	return (int)a ^ (int)b;
-}
-
-static float CG_OpFuncCompareEqual( const float a, const float b ) {
-	return ( a == b );
-}
-
-static float CG_OpFuncCompareNotEqual( const float a, const float b ) {
-	return ( a != b );
-}
-
-static float CG_OpFuncCompareGreater( const float a, const float b ) {
-	return ( a > b );
-}
-
-static float CG_OpFuncCompareGreaterOrEqual( const float a, const float b ) {
-	return ( a >= b );
-}
-
-static float CG_OpFuncCompareSmaller( const float a, const float b ) {
-	return ( a < b );
-}
-
-static float CG_OpFuncCompareSmallerOrEqual( const float a, const float b ) {
-	return ( a <= b );
-}
-
-static float CG_OpFuncCompareAnd( const float a, const float b ) {
-	return ( a && b );
-}
-
-static float CG_OpFuncCompareOr( const float a, const float b ) {
-	return ( a || b );
+static float ApplyLayoutOperator( LayoutOperator op, float a, float b ) {
+	switch( op ) {
+		case LayoutOperator_Add: return a + b;
+		case LayoutOperator_Subtract: return a - b;
+		case LayoutOperator_Multiply: return a * b;
+		case LayoutOperator_Divide: return a / b;
+		case LayoutOperator_BitwiseAnd: return int( a ) & int( b );
+		case LayoutOperator_BitwiseOr: return int( a ) | int( b );
+		case LayoutOperator_BitwiseXor: return int( a ) ^ int( b );
+		case LayoutOperator_Equal: return a == b;
+		case LayoutOperator_NotEqual: return a != b;
+		case LayoutOperator_Greater: return a > b;
+		case LayoutOperator_GreaterOrEqual: return a >= b;
+		case LayoutOperator_Smaller: return a < b;
+		case LayoutOperator_SmallerOrEqual: return a <= b;
+		case LayoutOperator_And: return a && b;
+		case LayoutOperator_Or: return a || b;
+		default: return a;
+	}
 }
 
 struct cg_layoutoperators_t {
 	const char *name;
-	opFunc_t opFunc;
+	LayoutOperator op;
 };
 
 static cg_layoutoperators_t cg_LayoutOperators[] = {
-	{
-		"+",
-		CG_OpFuncAdd
-	},
-
-	{
-		"-",
-		CG_OpFuncSubtract
-	},
-
-	{
-		"*",
-		CG_OpFuncMultiply
-	},
-
-	{
-		"/",
-		CG_OpFuncDivide
-	},
-
-	{
-		"&",
-		CG_OpFuncAND
-	},
-
-	{
-		"|",
-		CG_OpFuncOR
-	},
-
-	{
-		"^",
-		CG_OpFuncXOR
-	},
-
-	{
-		"==",
-		CG_OpFuncCompareEqual
-	},
-
-	{
-		"!=",
-		CG_OpFuncCompareNotEqual
-	},
-
-	{
-		">",
-		CG_OpFuncCompareGreater
-	},
-
-	{
-		">=",
-		CG_OpFuncCompareGreaterOrEqual
-	},
-
-	{
-		"<",
-		CG_OpFuncCompareSmaller
-	},
-
-	{
-		"<=",
-		CG_OpFuncCompareSmallerOrEqual
-	},
-
-	{
-		"&&",
-		CG_OpFuncCompareAnd
-	},
-
-	{
-		"||",
-		CG_OpFuncCompareOr
-	},
+	{ "+", LayoutOperator_Add },
+	{ "-", LayoutOperator_Subtract },
+	{ "*", LayoutOperator_Multiply },
+	{ "/", LayoutOperator_Divide },
+	{ "&", LayoutOperator_BitwiseAnd },
+	{ "|", LayoutOperator_BitwiseOr },
+	{ "^", LayoutOperator_BitwiseXor },
+	{ "==", LayoutOperator_Equal },
+	{ "!=", LayoutOperator_NotEqual },
+	{ ">", LayoutOperator_Greater },
+	{ ">=", LayoutOperator_GreaterOrEqual },
+	{ "<", LayoutOperator_Smaller },
+	{ "<=", LayoutOperator_SmallerOrEqual },
+	{ "&&", LayoutOperator_And },
+	{ "||", LayoutOperator_Or },
 };
 
-static opFunc_t CG_OperatorFuncForArgument( Span< const char > token ) {
+static LayoutOperator CG_OperatorForArgument( Span< const char > token ) {
 	for( cg_layoutoperators_t op : cg_LayoutOperators ) {
 		if( StrCaseEqual( token, op.name ) ) {
-			return op.opFunc;
+			return op.op;
 		}
 	}
 
-	return NULL;
+	return LayoutOperator_None;
 }
 
 //=============================================================================
 
-static const char *CG_GetStringArg( cg_layoutnode_t **argumentsnode );
-static float CG_GetNumericArg( cg_layoutnode_t **argumentsnode );
+static const char *CG_GetStringArg( LayoutArgs * args );
+static float CG_GetNumericArg( LayoutArgs * args );
 
 //=============================================================================
 
@@ -1017,7 +1003,7 @@ static void CG_DrawWeaponIcons( int x, int y, int offx, int offy, int iw, int ih
 
 		// first try the weapon specific bind
 		char bind[ 32 ];
-		if( !CG_GetBoundKeysString( va( "use %s", def->short_name ), bind, sizeof( bind ) ) ) {
+		if( !CG_GetBoundKeysString( va( "use %s", GetWeaponInfo( weap )->short_name ), bind, sizeof( bind ) ) ) {
 			CG_GetBoundKeysString( va( "weapon %i", i + 1 ), bind, sizeof( bind ) );
 		}
 
@@ -1025,10 +1011,10 @@ static void CG_DrawWeaponIcons( int x, int y, int offx, int offy, int iw, int ih
 	}
 }
 
-static bool CG_LFuncDrawPicByName( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawPicByName( LayoutArgs * args ) {
 	int x = CG_HorizontalAlignForWidth( layout_cursor_x, layout_cursor_alignment, layout_cursor_width );
 	int y = CG_VerticalAlignForHeight( layout_cursor_y, layout_cursor_alignment, layout_cursor_height );
-	Draw2DBox( x, y, layout_cursor_width, layout_cursor_height, FindMaterial( CG_GetStringArg( &argumentnode ) ), layout_cursor_color );
+	Draw2DBox( x, y, layout_cursor_width, layout_cursor_height, FindMaterial( CG_GetStringArg( args ) ), layout_cursor_color );
 	return true;
 }
 
@@ -1040,65 +1026,65 @@ static float ScaleY( float y ) {
 	return y * frame_static.viewport_height / 600.0f;
 }
 
-static bool CG_LFuncCursor( cg_layoutnode_t *argumentnode ) {
-	float x = ScaleX( CG_GetNumericArg( &argumentnode ) );
-	float y = ScaleY( CG_GetNumericArg( &argumentnode ) );
+static bool CG_LFuncCursor( LayoutArgs * args ) {
+	float x = ScaleX( CG_GetNumericArg( args ) );
+	float y = ScaleY( CG_GetNumericArg( args ) );
 
 	layout_cursor_x = Q_rint( x );
 	layout_cursor_y = Q_rint( y );
 	return true;
 }
 
-static bool CG_LFuncMoveCursor( cg_layoutnode_t *argumentnode ) {
-	float x = ScaleX( CG_GetNumericArg( &argumentnode ) );
-	float y = ScaleY( CG_GetNumericArg( &argumentnode ) );
+static bool CG_LFuncMoveCursor( LayoutArgs * args ) {
+	float x = ScaleX( CG_GetNumericArg( args ) );
+	float y = ScaleY( CG_GetNumericArg( args ) );
 
 	layout_cursor_x += Q_rint( x );
 	layout_cursor_y += Q_rint( y );
 	return true;
 }
 
-static bool CG_LFuncSize( cg_layoutnode_t *argumentnode ) {
-	float x = ScaleX( CG_GetNumericArg( &argumentnode ) );
-	float y = ScaleY( CG_GetNumericArg( &argumentnode ) );
+static bool CG_LFuncSize( LayoutArgs * args ) {
+	float x = ScaleX( CG_GetNumericArg( args ) );
+	float y = ScaleY( CG_GetNumericArg( args ) );
 
 	layout_cursor_width = Q_rint( x );
 	layout_cursor_height = Q_rint( y );
 	return true;
 }
 
-static bool CG_LFuncColor( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncColor( LayoutArgs * args ) {
 	for( int i = 0; i < 4; i++ ) {
-		layout_cursor_color[ i ] = Clamp01( CG_GetNumericArg( &argumentnode ) );
+		layout_cursor_color[ i ] = Clamp01( CG_GetNumericArg( args ) );
 	}
 	return true;
 }
 
-static bool CG_LFuncColorsRGB( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncColorsRGB( LayoutArgs * args ) {
 	for( int i = 0; i < 4; i++ ) {
-		layout_cursor_color[ i ] = sRGBToLinear( Clamp01( CG_GetNumericArg( &argumentnode ) ) );
+		layout_cursor_color[ i ] = sRGBToLinear( Clamp01( CG_GetNumericArg( args ) ) );
 	}
 	return true;
 }
 
-static bool CG_LFuncColorToTeamColor( cg_layoutnode_t *argumentnode ) {
-	layout_cursor_color = CG_TeamColorVec4( CG_GetNumericArg( &argumentnode ) );
+static bool CG_LFuncColorToTeamColor( LayoutArgs * args ) {
+	layout_cursor_color = CG_TeamColorVec4( CG_GetNumericArg( args ) );
 	return true;
 }
 
-static bool CG_LFuncAttentionGettingColor( cg_layoutnode_t * argumentnode ) {
+static bool CG_LFuncAttentionGettingColor( LayoutArgs * args ) {
 	layout_cursor_color = AttentionGettingColor();
 	return true;
 }
 
-static bool CG_LFuncColorAlpha( cg_layoutnode_t *argumentnode ) {
-	layout_cursor_color.w = CG_GetNumericArg( &argumentnode );
+static bool CG_LFuncColorAlpha( LayoutArgs * args ) {
+	layout_cursor_color.w = CG_GetNumericArg( args );
 	return true;
 }
 
-static bool CG_LFuncAlignment( cg_layoutnode_t *argumentnode ) {
-	const char * x = CG_GetStringArg( &argumentnode );
-	const char * y = CG_GetStringArg( &argumentnode );
+static bool CG_LFuncAlignment( LayoutArgs * args ) {
+	const char * x = CG_GetStringArg( args );
+	const char * y = CG_GetStringArg( args );
 
 	if( !Q_stricmp( x, "left" ) ) {
 		layout_cursor_alignment.x = XAlignment_Left;
@@ -1131,8 +1117,8 @@ static bool CG_LFuncAlignment( cg_layoutnode_t *argumentnode ) {
 	return true;
 }
 
-static bool CG_LFuncFontSize( cg_layoutnode_t *argumentnode ) {
-	cg_layoutnode_t *charnode = argumentnode;
+static bool CG_LFuncFontSize( LayoutArgs * args ) {
+	LayoutArgs charnode = *args;
 	const char * fontsize = CG_GetStringArg( &charnode );
 
 	if( !Q_stricmp( fontsize, "tiny" ) ) {
@@ -1148,14 +1134,14 @@ static bool CG_LFuncFontSize( cg_layoutnode_t *argumentnode ) {
 		layout_cursor_font_size = cgs.textSizeBig;
 	}
 	else {
-		layout_cursor_font_size = CG_GetNumericArg( &argumentnode );
+		layout_cursor_font_size = CG_GetNumericArg( args );
 	}
 
 	return true;
 }
 
-static bool CG_LFuncFontStyle( cg_layoutnode_t *argumentnode ) {
-	const char * fontstyle = CG_GetStringArg( &argumentnode );
+static bool CG_LFuncFontStyle( LayoutArgs * args ) {
+	const char * fontstyle = CG_GetStringArg( args );
 
 	if( !Q_stricmp( fontstyle, "normal" ) ) {
 		layout_cursor_font_style = FontStyle_Normal;
@@ -1177,45 +1163,45 @@ static bool CG_LFuncFontStyle( cg_layoutnode_t *argumentnode ) {
 	return true;
 }
 
-static bool CG_LFuncFontBorder( cg_layoutnode_t *argumentnode ) {
-	const char * border = CG_GetStringArg( &argumentnode );
+static bool CG_LFuncFontBorder( LayoutArgs * args ) {
+	const char * border = CG_GetStringArg( args );
 	layout_cursor_font_border = Q_stricmp( border, "on" ) == 0;
 	return true;
 }
 
-static bool CG_LFuncDrawObituaries( cg_layoutnode_t *argumentnode ) {
-	int internal_align = (int)CG_GetNumericArg( &argumentnode );
-	int icon_size = (int)CG_GetNumericArg( &argumentnode );
+static bool CG_LFuncDrawObituaries( LayoutArgs * args ) {
+	int internal_align = (int)CG_GetNumericArg( args );
+	int icon_size = (int)CG_GetNumericArg( args );
 
 	CG_DrawObituaries( layout_cursor_x, layout_cursor_y, layout_cursor_alignment,
 		layout_cursor_width, layout_cursor_height, internal_align, icon_size * frame_static.viewport_height / 600 );
 	return true;
 }
 
-static bool CG_LFuncDrawAwards( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawAwards( LayoutArgs * args ) {
 	CG_DrawAwards( layout_cursor_x, layout_cursor_y, layout_cursor_alignment, layout_cursor_font_size, layout_cursor_color, layout_cursor_font_border );
 	return true;
 }
 
-static bool CG_LFuncDrawClock( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawClock( LayoutArgs * args ) {
 	CG_DrawClock( layout_cursor_x, layout_cursor_y, layout_cursor_alignment, GetHUDFont(), layout_cursor_font_size, layout_cursor_color, layout_cursor_font_border );
 	return true;
 }
 
-static bool CG_LFuncDrawDamageNumbers( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawDamageNumbers( LayoutArgs * args ) {
 	CG_DrawDamageNumbers();
 	return true;
 }
 
-static bool CG_LFuncDrawBombIndicators( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawBombIndicators( LayoutArgs * args ) {
 	CG_DrawBombHUD();
 	return true;
 }
 
-static bool CG_LFuncDrawPlayerIcons( cg_layoutnode_t *argumentnode ) {
-	int team = int( CG_GetNumericArg( &argumentnode ) );
-	int alive = int( CG_GetNumericArg( &argumentnode ) );
-	int total = int( CG_GetNumericArg( &argumentnode ) );
+static bool CG_LFuncDrawPlayerIcons( LayoutArgs * args ) {
+	int team = int( CG_GetNumericArg( args ) );
+	int alive = int( CG_GetNumericArg( args ) );
+	int total = int( CG_GetNumericArg( args ) );
 
 	Vec4 team_color = CG_TeamColorVec4( team );
 
@@ -1241,13 +1227,13 @@ static bool CG_LFuncDrawPlayerIcons( cg_layoutnode_t *argumentnode ) {
 	return true;
 }
 
-static bool CG_LFuncDrawPointed( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawPointed( LayoutArgs * args ) {
 	CG_DrawPlayerNames( GetHUDFont(), layout_cursor_font_size, layout_cursor_color, layout_cursor_font_border );
 	return true;
 }
 
-static bool CG_LFuncDrawString( cg_layoutnode_t *argumentnode ) {
-	const char *string = CG_GetStringArg( &argumentnode );
+static bool CG_LFuncDrawString( LayoutArgs * args ) {
+	const char *string = CG_GetStringArg( args );
 
 	if( !string || !string[0] ) {
 		return false;
@@ -1258,9 +1244,9 @@ static bool CG_LFuncDrawString( cg_layoutnode_t *argumentnode ) {
 	return true;
 }
 
-static bool CG_LFuncDrawBindString( cg_layoutnode_t *argumentnode ) {
-	const char * fmt = CG_GetStringArg( &argumentnode );
-	const char * command = CG_GetStringArg( &argumentnode );
+static bool CG_LFuncDrawBindString( LayoutArgs * args ) {
+	const char * fmt = CG_GetStringArg( args );
+	const char * command = CG_GetStringArg( args );
 
 	char keys[ 128 ];
 	if( !CG_GetBoundKeysString( command, keys, sizeof( keys ) ) ) {
@@ -1275,8 +1261,8 @@ static bool CG_LFuncDrawBindString( cg_layoutnode_t *argumentnode ) {
 	return true;
 }
 
-static bool CG_LFuncDrawPlayerName( cg_layoutnode_t *argumentnode ) {
-	int index = (int)CG_GetNumericArg( &argumentnode ) - 1;
+static bool CG_LFuncDrawPlayerName( LayoutArgs * args ) {
+	int index = (int)CG_GetNumericArg( args ) - 1;
 
 	if( index >= 0 && index < client_gs.maxclients ) {
 		DrawText( GetHUDFont(), layout_cursor_font_size, PlayerName( index ), layout_cursor_alignment, layout_cursor_x, layout_cursor_y, layout_cursor_color, layout_cursor_font_border );
@@ -1286,49 +1272,49 @@ static bool CG_LFuncDrawPlayerName( cg_layoutnode_t *argumentnode ) {
 	return false;
 }
 
-static bool CG_LFuncDrawNumeric( cg_layoutnode_t *argumentnode ) {
-	int value = CG_GetNumericArg( &argumentnode );
+static bool CG_LFuncDrawNumeric( LayoutArgs * args ) {
+	int value = CG_GetNumericArg( args );
 	DrawText( GetHUDFont(), layout_cursor_font_size, va( "%i", value ), layout_cursor_alignment, layout_cursor_x, layout_cursor_y, layout_cursor_color, layout_cursor_font_border );
 	return true;
 }
 
-static bool CG_LFuncDrawWeaponIcons( cg_layoutnode_t *argumentnode ) {
-	int offx = CG_GetNumericArg( &argumentnode ) * frame_static.viewport_width / 800;
-	int offy = CG_GetNumericArg( &argumentnode ) * frame_static.viewport_height / 600;
-	int w = CG_GetNumericArg( &argumentnode ) * frame_static.viewport_width / 800;
-	int h = CG_GetNumericArg( &argumentnode ) * frame_static.viewport_height / 600;
-	float font_size = CG_GetNumericArg( &argumentnode );
+static bool CG_LFuncDrawWeaponIcons( LayoutArgs * args ) {
+	int offx = CG_GetNumericArg( args ) * frame_static.viewport_width / 800;
+	int offy = CG_GetNumericArg( args ) * frame_static.viewport_height / 600;
+	int w = CG_GetNumericArg( args ) * frame_static.viewport_width / 800;
+	int h = CG_GetNumericArg( args ) * frame_static.viewport_height / 600;
+	float font_size = CG_GetNumericArg( args );
 
 	CG_DrawWeaponIcons( layout_cursor_x, layout_cursor_y, offx, offy, w, h, layout_cursor_alignment, font_size );
 
 	return true;
 }
 
-static bool CG_LFuncDrawCrossHair( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawCrossHair( LayoutArgs * args ) {
 	CG_DrawCrosshair();
 	return true;
 }
 
-static bool CG_LFuncDrawNet( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncDrawNet( LayoutArgs * args ) {
 	CG_DrawNet( layout_cursor_x, layout_cursor_y, layout_cursor_width, layout_cursor_height, layout_cursor_alignment, layout_cursor_color );
 	return true;
 }
 
-static bool CG_LFuncIf( cg_layoutnode_t *argumentnode ) {
-	return (int)CG_GetNumericArg( &argumentnode ) != 0;
+static bool CG_LFuncIf( LayoutArgs * args ) {
+	return (int)CG_GetNumericArg( args ) != 0;
 }
 
-static bool CG_LFuncIfNot( cg_layoutnode_t *argumentnode ) {
-	return (int)CG_GetNumericArg( &argumentnode ) == 0;
+static bool CG_LFuncIfNot( LayoutArgs * args ) {
+	return (int)CG_GetNumericArg( args ) == 0;
 }
 
-static bool CG_LFuncEndIf( cg_layoutnode_t *argumentnode ) {
+static bool CG_LFuncEndIf( LayoutArgs * args ) {
 	return true;
 }
 
 struct cg_layoutcommand_t {
 	const char *name;
-	bool ( *func )( cg_layoutnode_t *argumentnode );
+	LayoutFunc func;
 	int numparms;
 	const char *help;
 };
@@ -1555,43 +1541,47 @@ static const cg_layoutcommand_t cg_LayoutCommands[] = {
 
 //=============================================================================
 
-static const char *CG_GetStringArg( cg_layoutnode_t **argumentsnode ) {
-	cg_layoutnode_t *anode = *argumentsnode;
-
-	if( anode == NULL ) {
+static const char *CG_GetStringArg( LayoutArgs * args ) {
+	if( args->cursor == args->end ) {
 		return "";
 	}
 
-	*argumentsnode = anode->next;
-	return anode->string;
+	const LayoutTerm * term = args->cursor;
+	args->cursor++;
+	return term->string;
+}
+
+static float EvaluateLayoutTerm( const LayoutTerm * term ) {
+	switch( term->type ) {
+		case LayoutTerm_Int: return *( const int * ) term->ptr;
+		case LayoutTerm_U8: return *( const u8 * ) term->ptr;
+		case LayoutTerm_S16: return *( const s16 * ) term->ptr;
+		case LayoutTerm_Bool: return *( const bool * ) term->ptr ? 1.0f : 0.0f;
+		case LayoutTerm_Cvar: return ( ( const cvar_t * ) term->ptr )->value;
+		case LayoutTerm_Callback: return term->func( term->ptr );
+		default: return term->value;
+	}
 }
 
 /*
 * CG_GetNumericArg
-* can use recursion for mathematical operations
+* operators are right associative, so a + b * c is a + ( b * c )
 */
-static float CG_GetNumericArg( cg_layoutnode_t **argumentsnode ) {
-	cg_layoutnode_t *anode = *argumentsnode;
-
-	if( anode == NULL ) {
+static float CG_GetNumericArg( LayoutArgs * args ) {
+	if( args->cursor == args->end ) {
 		return 0.0f;
 	}
 
-	if( anode->type != LNODE_NUMERIC && anode->type != LNODE_REFERENCE_NUMERIC ) {
-		Com_Printf( "WARNING: 'CG_LayoutGetNumericArg': arg %s is not numeric\n", anode->string );
+	const LayoutTerm * term = args->cursor;
+	if( term->type == LayoutTerm_String ) {
+		Com_Printf( "WARNING: 'CG_LayoutGetNumericArg': arg %s is not numeric\n", term->string );
 	}
 
-	*argumentsnode = anode->next;
-	float value;
-	if( anode->type == LNODE_REFERENCE_NUMERIC ) {
-		value = cg_numeric_references[anode->idx].func( cg_numeric_references[anode->idx].parameter );
-	} else {
-		value = anode->value;
-	}
+	args->cursor++;
+	float value = EvaluateLayoutTerm( term );
 
-	// recurse if there are operators
-	if( anode->opFunc != NULL ) {
-		value = anode->opFunc( value, CG_GetNumericArg( argumentsnode ) );
+	if( term->op != LayoutOperator_None ) {
+		value = ApplyLayoutOperator( term->op, value, CG_GetNumericArg( args ) );
 	}
 
 	return value;
@@ -1738,24 +1728,24 @@ static cg_layoutnode_t * CG_ParseArgs( Span< const char > * cursor, const char *
 		if( token == "" )
 			break;
 
-		opFunc_t op = CG_OperatorFuncForArgument( token );
-		if( op != NULL ) {
+		LayoutOperator op = CG_OperatorForArgument( token );
+		if( op != LayoutOperator_None ) {
 			if( nodes.tail == NULL ) {
 				Com_GGPrint( "WARNING 'CG_RecurseParseLayoutScript'({}): \"{}\" Operator hasn't any prior argument", command_name, token );
 				continue;
 			}
-			if( nodes.tail->opFunc != NULL ) {
+			if( nodes.tail->op != LayoutOperator_None ) {
 				Com_GGPrint( "WARNING 'CG_RecurseParseLayoutScript'({}): \"{}\" Found two operators in a row", command_name, token );
 			}
 			if( nodes.tail->type == LNODE_STRING ) {
 				Com_GGPrint( "WARNING 'CG_RecurseParseLayoutScript'({}): \"{}\" Operator was assigned to a string node", command_name, token );
 			}
 
-			nodes.tail->opFunc = op;
+			nodes.tail->op = op;
 			continue;
 		}
 
-		if( *parsed_args == expected_args && nodes.tail->opFunc == NULL ) {
+		if( *parsed_args == expected_args && nodes.tail->op == LayoutOperator_None ) {
 			*cursor = last_cursor;
 			break;
 		}
@@ -1768,7 +1758,7 @@ static cg_layoutnode_t * CG_ParseArgs( Span< const char > * cursor, const char *
 
 		cg_layoutnode_t * node = CG_LayoutParseArgumentNode( token );
 
-		if( nodes.tail == NULL || nodes.tail->opFunc == NULL ) {
+		if( nodes.tail == NULL || nodes.tail->op == LayoutOperator_None ) {
 			*parsed_args += 1;
 		}
 
@@ -1816,26 +1806,112 @@ static cg_layoutnode_t *CG_RecurseParseLayoutScript( Span< const char > * cursor
 	return nodes.head;
 }
 
+static LayoutTerm CompileLayoutTerm( const cg_layoutnode_t * node ) {
+	LayoutTerm term = { };
+	term.op = node->op;
+	term.value = node->value;
+	term.string = CopyString( sys_allocator, node->string );
+
+	if( node->type == LNODE_STRING ) {
+		term.type = LayoutTerm_String;
+	}
+	else if( node->type == LNODE_REFERENCE_NUMERIC ) {
+		const reference_numeric_t & ref = cg_numeric_references[ node->idx ];
+		term.ptr = ref.parameter;
+
+		const cvar_t * cvar = ref.func == CG_GetCvar ? Cvar_Find( ( const char * ) ref.parameter ) : NULL;
+
+		if( ref.func == CG_Int ) {
+			term.type = LayoutTerm_Int;
+		}
+		else if( ref.func == CG_U8 ) {
+			term.type = LayoutTerm_U8;
+		}
+		else if( ref.func == CG_S16 ) {
+			term.type = LayoutTerm_S16;
+		}
+		else if( ref.func == CG_Bool ) {
+			term.type = LayoutTerm_Bool;
+		}
+		else if( cvar != NULL ) {
+			term.type = LayoutTerm_Cvar;
+			term.ptr = cvar;
+		}
+		else {
+			term.type = LayoutTerm_Callback;
+			term.func = ref.func;
+		}
+	}
+	else {
+		term.type = LayoutTerm_Constant;
+	}
+
+	return term;
+}
+
 /*
-* CG_RecurseExecuteLayoutThread
-* Execution works like this: First node (on backwards) is expected to be the command, followed by arguments nodes.
-* we keep a pointer to the command and run the tree counting arguments until we reach the next command,
-* then we call the command function sending the pointer to first argument and the pointer to the command.
-* At return we advance one node (we stopped at last argument node) so it starts again from the next command (if any).
-*
-* When finding an "if" command with a subtree, we execute the "if" command. In the case it
-* returns any value, we recurse execute the subtree
+* operators are right associative so we can only fold a constant into the
+* term after it once everything after that has been folded too
 */
-static void CG_RecurseExecuteLayoutThread( cg_layoutnode_t * node ) {
-	if( node == NULL )
+static void FoldLayoutConstants( u32 first_term ) {
+	size_t n = hud_terms.size();
+	if( n <= first_term )
 		return;
 
-	// args->next to skip the dummy node
-	if( node->type != LNODE_DUMMY && node->func( node->args->next ) ) {
-		CG_RecurseExecuteLayoutThread( node->ifthread );
+	for( size_t i = n - 1; i > first_term; i-- ) {
+		LayoutTerm * lhs = &hud_terms[ i - 1 ];
+		const LayoutTerm * rhs = &hud_terms[ i ];
+
+		bool foldable = lhs->type == LayoutTerm_Constant && lhs->op != LayoutOperator_None;
+		foldable = foldable && rhs->type == LayoutTerm_Constant && rhs->op == LayoutOperator_None;
+		if( !foldable )
+			continue;
+
+		lhs->value = ApplyLayoutOperator( lhs->op, lhs->value, rhs->value );
+		lhs->op = LayoutOperator_None;
+
+		FREE( sys_allocator, const_cast< char * >( rhs->string ) );
+		memmove( &hud_terms[ i ], &hud_terms[ i + 1 ], ( n - i - 1 ) * sizeof( LayoutTerm ) );
+		n--;
 	}
 
-	CG_RecurseExecuteLayoutThread( node->next );
+	hud_terms.resize( n );
+}
+
+static void CompileLayoutThread( const cg_layoutnode_t * node ) {
+	for( ; node != NULL; node = node->next ) {
+		if( node->type == LNODE_DUMMY || node->func == CG_LFuncEndIf )
+			continue;
+
+		LayoutCommand command;
+		command.func = node->func;
+		command.first_term = checked_cast< u32 >( hud_terms.size() );
+
+		// args->next to skip the dummy node
+		for( const cg_layoutnode_t * arg = node->args->next; arg != NULL; arg = arg->next ) {
+			hud_terms.add( CompileLayoutTerm( arg ) );
+		}
+		FoldLayoutConstants( command.first_term );
+
+		command.num_terms = checked_cast< u32 >( hud_terms.size() ) - command.first_term;
+
+		size_t idx = hud_commands.add( command );
+		CompileLayoutThread( node->ifthread );
+
+		hud_commands[ idx ].next_if_false = checked_cast< u32 >( hud_commands.size() );
+	}
+}
+
+static void ExecuteLayoutProgram() {
+	const LayoutCommand * commands = hud_commands.ptr();
+	const LayoutTerm * terms = hud_terms.ptr();
+
+	size_t i = 0;
+	while( i < hud_commands.size() ) {
+		const LayoutCommand * command = &commands[ i ];
+		LayoutArgs args = { terms + command->first_term, terms + command->first_term + command->num_terms };
+		i = command->func( &args ) ? i + 1 : command->next_if_false;
+	}
 }
 
 static bool LoadHUDFile( const char * path, DynamicString & script ) {
@@ -1883,6 +1959,9 @@ void CG_InitHUD() {
 	TempAllocator temp = cls.frame_arena.temp();
 	const char * path = "huds/default.hud";
 
+	hud_commands.init( sys_allocator );
+	hud_terms.init( sys_allocator );
+
 	DynamicString script( &temp );
 	if( !LoadHUDFile( path, script ) ) {
 		Com_Printf( "HUD: failed to load %s file\n", path );
@@ -1890,14 +1969,22 @@ void CG_InitHUD() {
 	}
 
 	Span< const char > cursor = script.span();
-	hud_root = CG_RecurseParseLayoutScript( &cursor, 0 );
+	cg_layoutnode_t * root = CG_RecurseParseLayoutScript( &cursor, 0 );
+
+	CompileLayoutThread( root );
+	CG_RecurseFreeLayoutThread( root );
 
 	layout_cursor_font_style = FontStyle_Normal;
 	layout_cursor_font_size = cgs.textSizeSmall;
 }
 
 void CG_ShutdownHUD() {
-	CG_RecurseFreeLayoutThread( hud_root );
+	for( const LayoutTerm & term : hud_terms ) {
+		FREE( sys_allocator, const_cast< char * >( term.string ) );
+	}
+
+	hud_commands.shutdown();
+	hud_terms.shutdown();
 }
 
 void CG_DrawHUD() {
@@ -1915,5 +2002,5 @@ void CG_DrawHUD() {
 	}
 
 	ZoneScoped;
-	CG_RecurseExecuteLayoutThread( hud_root );
+	ExecuteLayoutProgram();
 }
@@ -171,19 +171,25 @@ void CG_DustCircle( Vec3 pos, Vec3 dir, float radius, int count ) {
 	// }
 }
 
-struct Gib {
-	Vec3 origin;
-	Vec3 velocity;
-	float scale;
-	float lifetime;
-	Vec4 color;
+/*
+ * gibs are kept SoA so DrawGibs can step them all at once and trace them
+ * as a batch, since multikills spawn hundreds in one frame
+ */
+#define MAX_GIBS 512
+
+struct Gibs {
+	Vec3 origins[ MAX_GIBS ];
+	Vec3 velocities[ MAX_GIBS ];
+	float scales[ MAX_GIBS ];
+	float lifetimes[ MAX_GIBS ];
+	Vec4 colors[ MAX_GIBS ];
+	u32 n;
 };
 
-static Gib gibs[ 512 ];
-static u32 num_gibs;
+static Gibs gibs;
 
 void InitGibs() {
-	num_gibs = 0;
+	gibs.n = 0;
 }
 
 void SpawnGibs( Vec3 origin, Vec3 velocity, int damage, Vec4 color ) {
@@ -197,24 +203,33 @@ void SpawnGibs( Vec3 origin, Vec3 velocity, int damage, Vec4 color ) {
 	float radius = player_radius - gib_radius - epsilon;
 
 	for( int i = 0; i < count; i++ ) {
-		if( num_gibs == ARRAY_COUNT( gibs ) )
+		if( gibs.n == MAX_GIBS )
 			break;
 
-		Gib * gib = &gibs[ num_gibs ];
-		num_gibs++;
+		u32 idx = gibs.n;
+		gibs.n++;
 
 		Vec3 dir = Vec3( UniformSampleInsideCircle( &cls.rng ), 0.0f );
-		gib->origin = origin + dir * radius;
+		gibs.origins[ idx ] = origin + dir * radius;
 
 		dir.z = RandomFloat01( &cls.rng );
-		gib->velocity = velocity * 0.5f + dir * Length( velocity ) * 0.5f;
+		gibs.velocities[ idx ] = velocity * 0.5f + dir * Length( velocity ) * 0.5f;
 
-		gib->scale = RandomUniformFloat( &cls.rng, 0.5f, 1.0f );
-		gib->lifetime = 10.0f;
-		gib->color = color;
+		gibs.scales[ idx ] = RandomUniformFloat( &cls.rng, 0.5f, 1.0f );
+		gibs.lifetimes[ idx ] = 10.0f;
+		gibs.colors[ idx ] = color;
 	}
 }
 
+static void RemoveGib( u32 i ) {
+	gibs.n--;
+	gibs.origins[ i ] = gibs.origins[ gibs.n ];
+	gibs.velocities[ i ] = gibs.velocities[ gibs.n ];
+	gibs.scales[ i ] = gibs.scales[ gibs.n ];
+	gibs.lifetimes[ i ] = gibs.lifetimes[ gibs.n ];
+	gibs.colors[ i ] = gibs.colors[ gibs.n ];
+}
+
 static void GibImpact( Vec3 pos, Vec3 normal, Vec4 color, float scale ) {
 	DoVisualEffect( "vfx/blood", pos, normal, 1.0f, color );
 
@@ -242,44 +257,53 @@ static void GibImpact( Vec3 pos, Vec3 normal, Vec4 color, float scale ) {
 void DrawGibs() {
 	ZoneScoped;
 
+	if( gibs.n == 0 )
+		return;
+
 	float dt = cls.frametime * 0.001f;
 
 	const Model * model = cgs.media.modGib;
 	Vec3 gravity = Vec3( 0, 0, -GRAVITY );
 
-	for( u32 i = 0; i < num_gibs; i++ ) {
-		Gib * gib = &gibs[ i ];
+	TempAllocator temp = cls.frame_arena.temp();
+	Vec3 * next_origins = ALLOC_MANY( &temp, Vec3, gibs.n );
+	MinMax3 * boxes = ALLOC_MANY( &temp, MinMax3, gibs.n );
+	trace_t * traces = ALLOC_MANY( &temp, trace_t, gibs.n );
 
-		gib->velocity += gravity * dt;
-		Vec3 next_origin = gib->origin + gib->velocity * dt;
-
-		float size = 0.5f * gib->scale;
-		MinMax3 bounds = model->bounds * size;
+	for( u32 i = 0; i < gibs.n; i++ ) {
+		gibs.velocities[ i ] += gravity * dt;
+		next_origins[ i ] = gibs.origins[ i ] + gibs.velocities[ i ] * dt;
+		boxes[ i ] = model->bounds * ( 0.5f * gibs.scales[ i ] );
+		gibs.lifetimes[ i ] -= dt;
+	}
 
-		trace_t trace;
-		CG_Trace( &trace, gib->origin, bounds.mins, bounds.maxs, next_origin, 0, MASK_SOLID );
+	CG_TraceBatch( traces, gibs.origins, next_origins, boxes, gibs.n, 0, MASK_SOLID );
 
+	// walk backwards so removing a gib doesn't skip the one swapped into it
+	for( u32 i = gibs.n; i-- > 0; ) {
+		const trace_t & trace = traces[ i ];
 		if( trace.startsolid || ( trace.contents & CONTENTS_NODROP ) || ( trace.surfFlags & SURF_SKY ) ) {
-			gib->lifetime = 0;
+			RemoveGib( i );
+			continue;
 		}
-		else if( trace.fraction != 1.0f ) {
-			gib->lifetime = 0;
 
-			GibImpact( trace.endpos, trace.plane.normal, gib->color, gib->scale );
+		if( trace.fraction != 1.0f ) {
+			GibImpact( trace.endpos, trace.plane.normal, gibs.colors[ i ], gibs.scales[ i ] );
+			RemoveGib( i );
+			continue;
 		}
 
-		gib->lifetime -= dt;
-		if( gib->lifetime <= 0 ) {
-			num_gibs--;
-			i--;
-			Swap2( gib, &gibs[ num_gibs ] );
+		if( gibs.lifetimes[ i ] <= 0 ) {
+			RemoveGib( i );
 			continue;
 		}
 
-		Mat4 transform = Mat4Translation( gib->origin ) * Mat4Scale( size );
-		DrawModel( model, transform, gib->color );
-		DrawModelShadow( model, transform, gib->color );
+		// DrawModel goes through DrawInstanceableMesh so these all end
+		// up in one instanced draw
+		Mat4 transform = Mat4Translation( gibs.origins[ i ] ) * Mat4Scale( 0.5f * gibs.scales[ i ] );
+		DrawModel( model, transform, gibs.colors[ i ] );
+		DrawModelShadow( model, transform, gibs.colors[ i ] );
 
-		gib->origin = next_origin;
+		gibs.origins[ i ] = next_origins[ i ];
 	}
 }
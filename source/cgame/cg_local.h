@@ -336,9 +336,11 @@ void CG_PredictedEvent( int entNum, int ev, u64 parm );
 void CG_PredictedFireWeapon( int entNum, u64 parm );
 void CG_PredictedUseGadget( int entNum, GadgetType gadget, u64 parm );
 void CG_PredictMovement();
+void CG_CheckPredictionCache();
 void CG_CheckPredictionError();
 void CG_BuildSolidList();
 void CG_Trace( trace_t *t, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int ignore, int contentmask );
+void CG_TraceBatch( trace_t * traces, const Vec3 * starts, const Vec3 * ends, const MinMax3 * boxes, size_t n, int ignore, int contentmask );
 int CG_PointContents( Vec3 point );
 void CG_Predict_TouchTriggers( pmove_t *pm, Vec3 previous_origin );
 
@@ -346,6 +348,7 @@ void CG_Predict_TouchTriggers( pmove_t *pm, Vec3 previous_origin );
 // cg_screen.c
 //
 extern cvar_t *cg_showFPS;
+extern cvar_t *cg_showLatency;
 
 void CG_ScreenInit();
 void CG_Draw2D();
@@ -365,7 +368,7 @@ void CG_DrawNet( int x, int y, int w, int h, Alignment alignment, Vec4 color );
 void CG_ClearPointedNum();
 
 void CG_InitDamageNumbers();
-void CG_AddDamageNumber( SyncEntityState * ent, u64 parm );
+void CG_AddDamageNumber( const SyncEntityState * ent, u64 parm );
 void CG_DrawDamageNumbers();
 
 void CG_AddBomb( centity_t * cent );
@@ -410,6 +413,8 @@ extern cvar_t *cg_projectileAntilagOffset;
 extern cvar_t *cg_chat;
 
 extern cvar_t *cg_particleDebug;
+extern cvar_t *cg_particleLodDistance;
+extern cvar_t *cg_particleLodMinSize;
 
 #define CG_Malloc( size ) _Mem_AllocExt( cg_mempool, size, 16, 1, 0, 0, __FILE__, __LINE__ );
 #define CG_Free( data ) Mem_Free( data )
@@ -529,7 +534,7 @@ void CG_Recoil( WeaponType weapon );
 // cg_events.c
 //
 void CG_FireEvents( bool early );
-void CG_EntityEvent( SyncEntityState *ent, int ev, u64 parm, bool predicted );
+void CG_EntityEvent( const SyncEntityState *ent, int ev, u64 parm, bool predicted );
 void CG_AddAnnouncerEvent( StringHash sound, bool queued );
 void CG_ReleaseAnnouncerEvents();
 void CG_ClearAnnouncerEvents();
@@ -45,6 +45,8 @@ cvar_t *cg_autoaction_spectator;
 cvar_t *cg_showClamp;
 
 cvar_t *cg_particleDebug;
+cvar_t *cg_particleLodDistance;
+cvar_t *cg_particleLodMinSize;
 
 void CG_LocalPrint( const char *format, ... ) {
 	va_list argptr;
@@ -127,6 +129,8 @@ static void CG_RegisterVariables() {
 	cg_showClamp =      Cvar_Get( "cg_showClamp", "0", CVAR_DEVELOPER );
 
 	cg_particleDebug =  Cvar_Get( "cg_particleDebug", "0", CVAR_DEVELOPER );
+	cg_particleLodDistance = Cvar_Get( "cg_particleLodDistance", "1024", CVAR_ARCHIVE );
+	cg_particleLodMinSize = Cvar_Get( "cg_particleLodMinSize", "1", CVAR_ARCHIVE );
 
 	Cvar_Get( "cg_loadout", "", CVAR_ARCHIVE | CVAR_USERINFO );
 }
@@ -66,7 +66,7 @@ void CG_RegisterMediaShaders() {
 	cgs.media.shaderLaser = FindMaterial( "gfx/misc/laser" );
 
 	for( WeaponType i = 0; i < Weapon_Count; i++ ) {
-		cgs.media.shaderWeaponIcon[ i ] = FindMaterial( temp( "weapons/{}/icon", GS_GetWeaponDef( i )->short_name ) );
+		cgs.media.shaderWeaponIcon[ i ] = FindMaterial( temp( "weapons/{}/icon", GetWeaponInfo( i )->short_name ) );
 	}
 
 	for( u8 i = 0; i < Gadget_Count; i++ ) {
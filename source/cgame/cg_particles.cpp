@@ -1,3 +1,6 @@
+#include <algorithm> // std::sort
+#include <math.h>
+
 #include "qcommon/fs.h"
 #include "qcommon/serialization.h"
 #include "client/assets.h"
@@ -98,11 +101,26 @@ void InitParticleSystem( Allocator * a, ParticleSystem * ps ) {
 	if( ps->feedback ) {
 		ps->particles_feedback = ALLOC_SPAN( a, GPUParticleFeedback, ps->max_particles );
 		memset( ps->particles_feedback.ptr, 0, ps->particles_feedback.num_bytes() );
-		ps->vb_feedback = NewVertexBuffer( ps->particles_feedback.begin(), ps->max_particles * sizeof( GPUParticleFeedback ) );
+		for( VertexBuffer & vb : ps->vb_feedback ) {
+			vb = NewVertexBuffer( ps->particles_feedback.begin(), ps->max_particles * sizeof( GPUParticleFeedback ) );
+		}
+		ps->prev_gpu_instances = ALLOC_SPAN( a, u32, ps->max_particles );
+		ps->num_prev_gpu_instances = 0;
+		ps->feedback_counts[ 0 ] = 0;
+		ps->feedback_counts[ 1 ] = 0;
+		ps->feedback_frames[ 0 ] = 0;
+		ps->feedback_frames[ 1 ] = 0;
+		ps->feedback_buffer = 0;
 	}
 	else {
 		ps->gpu_instances_time = ALLOC_SPAN( a, s64, ps->max_particles );
 	}
+	ps->sort = ps->blend_func == BlendFunc_Blend && ps->model == NULL;
+	if( ps->sort ) {
+		ps->depth_estimates = ALLOC_SPAN( a, ParticleDepthEstimate, ps->max_particles );
+		ps->sort_keys = ALLOC_SPAN( a, ParticleSortKey, ps->max_particles );
+		ps->sort_scratch = ALLOC_MANY( a, ParticleDepthEstimate, ps->max_particles );
+	}
 	ps->ibo = NewIndexBuffer( ps->max_particles * sizeof( ps->gpu_instances[ 0 ] ) );
 	ps->vb = NewParticleVertexBuffer( ps->max_particles );
 	ps->vb2 = NewParticleVertexBuffer( ps->max_particles );
@@ -722,10 +740,16 @@ void DeleteParticleSystem( Allocator * a, ParticleSystem * ps ) {
 	FREE( a, ps->particles_feedback.ptr );
 	FREE( a, ps->gpu_instances.ptr );
 	FREE( a, ps->gpu_instances_time.ptr );
+	FREE( a, ps->prev_gpu_instances.ptr );
+	FREE( a, ps->depth_estimates.ptr );
+	FREE( a, ps->sort_keys.ptr );
+	FREE( a, ps->sort_scratch );
 	DeleteIndexBuffer( ps->ibo );
 	DeleteVertexBuffer( ps->vb );
 	DeleteVertexBuffer( ps->vb2 );
-	DeleteVertexBuffer( ps->vb_feedback );
+	for( VertexBuffer vb : ps->vb_feedback ) {
+		DeleteVertexBuffer( vb );
+	}
 
 	DeleteMesh( ps->mesh );
 	DeleteMesh( ps->update_mesh );
@@ -788,6 +812,56 @@ bool ParticleFeedback( ParticleSystem * ps, GPUParticleFeedback * feedback ) {
 	return result;
 };
 
+static u32 skipped_feedback_reads;
+
+/*
+ * integrates the same motion as particle_update.glsl, v' = a * z - drag * v,
+ * in closed form
+ */
+static Vec3 EstimateParticlePosition( const ParticleDepthEstimate & estimate, float t ) {
+	Vec3 gravity = Vec3( 0.0f, 0.0f, estimate.acceleration );
+	if( estimate.drag <= 0.0f ) {
+		return estimate.origin + estimate.velocity * t + gravity * ( 0.5f * t * t );
+	}
+
+	float k = ( 1.0f - expf( -estimate.drag * t ) ) / estimate.drag;
+	return estimate.origin + estimate.velocity * k + gravity * ( ( t - k ) / estimate.drag );
+}
+
+template< typename T >
+static void PermuteParticles( T * values, void * scratch, Span< const ParticleSortKey > keys ) {
+	T * permuted = ( T * ) scratch;
+	for( size_t i = 0; i < keys.n; i++ ) {
+		permuted[ i ] = values[ keys[ i ].index ];
+	}
+	memcpy( values, permuted, keys.n * sizeof( T ) );
+}
+
+static void SortParticles( ParticleSystem * ps ) {
+	ZoneScopedN( "Sort particles" );
+
+	Vec4 view_z = frame_static.V.row2();
+	Span< ParticleSortKey > keys = ps->sort_keys.slice( 0, ps->num_particles );
+
+	for( size_t i = 0; i < keys.n; i++ ) {
+		const ParticleDepthEstimate & estimate = ps->depth_estimates[ i ];
+		float t = ( cls.gametime - estimate.spawn_time ) / 1000.0f;
+		keys[ i ].depth = Dot( view_z, Vec4( EstimateParticlePosition( estimate, t ), 1.0f ) );
+		keys[ i ].index = i;
+	}
+
+	// view space z is negative in front of the camera so furthest goes first
+	std::sort( keys.begin(), keys.end(), []( const ParticleSortKey & a, const ParticleSortKey & b ) {
+		return a.depth < b.depth;
+	} );
+
+	PermuteParticles( ps->gpu_instances.ptr, ps->sort_scratch, keys );
+	PermuteParticles( ps->depth_estimates.ptr, ps->sort_scratch, keys );
+	if( !ps->feedback ) {
+		PermuteParticles( ps->gpu_instances_time.ptr, ps->sort_scratch, keys );
+	}
+}
+
 void UpdateParticleSystem( ParticleSystem * ps, float dt ) {
 	ZoneScopedN( "Update particles" );
 
@@ -797,14 +871,32 @@ void UpdateParticleSystem( ParticleSystem * ps, float dt ) {
 		ZoneScopedN( "Despawn expired particles" );
 
 		if( ps->feedback ) {
-			ReadVertexBuffer( ps->vb_feedback, ps->particles_feedback.begin(), ps->num_particles * sizeof( GPUParticleFeedback ) );
+			// this buffer was written two frames ago, and last frame's update
+			// moved particle ps->prev_gpu_instances[ i ] into slot i
+			//
+			// if the GPU is running behind drop this frame's feedback rather
+			// than wait for it. ages get reported every frame so expired
+			// particles still go away next time, only collisions get lost
+			u32 num_feedback = ps->feedback_counts[ ps->feedback_buffer ];
+			if( num_feedback > 0 && !FrameFinished( ps->feedback_frames[ ps->feedback_buffer ] ) ) {
+				num_feedback = 0;
+				skipped_feedback_reads++;
+			}
+
+			ReadVertexBuffer( ps->vb_feedback[ ps->feedback_buffer ], ps->particles_feedback.begin(), num_feedback * sizeof( GPUParticleFeedback ) );
 
 			for( size_t i = 0; i < ps->num_particles; i++ ) {
 				size_t index = ps->gpu_instances[ i ];
-				GPUParticleFeedback feedback = ps->particles_feedback[ index ];
+				if( index >= ps->num_prev_gpu_instances || ps->prev_gpu_instances[ index ] >= num_feedback )
+					continue;
+
+				GPUParticleFeedback feedback = ps->particles_feedback[ ps->prev_gpu_instances[ index ] ];
 				if( !ParticleFeedback( ps, &feedback ) ) {
 					ps->num_particles--;
 					Swap2( &ps->gpu_instances[ i ], &ps->gpu_instances[ ps->num_particles ] );
+					if( ps->sort ) {
+						Swap2( &ps->depth_estimates[ i ], &ps->depth_estimates[ ps->num_particles ] );
+					}
 					i--;
 				}
 			}
@@ -814,6 +906,9 @@ void UpdateParticleSystem( ParticleSystem * ps, float dt ) {
 					ps->num_particles--;
 					Swap2( &ps->gpu_instances[ i ], &ps->gpu_instances[ ps->num_particles ] );
 					Swap2( &ps->gpu_instances_time[ i ], &ps->gpu_instances_time[ ps->num_particles ] );
+					if( ps->sort ) {
+						Swap2( &ps->depth_estimates[ i ], &ps->depth_estimates[ ps->num_particles ] );
+					}
 					i--;
 				}
 			}
@@ -829,6 +924,15 @@ void UpdateParticleSystem( ParticleSystem * ps, float dt ) {
 				if( !ps->feedback ) {
 					ps->gpu_instances_time[ ps->num_particles + i ] = cls.gametime + ps->particles[ i ].lifetime * 1000.0f;
 				}
+				if( ps->sort ) {
+					const GPUParticle & particle = ps->particles[ i ];
+					ParticleDepthEstimate & estimate = ps->depth_estimates[ ps->num_particles + i ];
+					estimate.origin = particle.position;
+					estimate.velocity = particle.velocity;
+					estimate.acceleration = particle.acceleration;
+					estimate.drag = particle.drag;
+					estimate.spawn_time = cls.gametime;
+				}
 			}
 		}
 	}
@@ -836,11 +940,20 @@ void UpdateParticleSystem( ParticleSystem * ps, float dt ) {
 	ps->num_particles += ps->new_particles;
 	ps->new_particles = 0;
 
+	if( ps->sort ) {
+		SortParticles( ps );
+	}
+
 	{
 		ZoneScopedN( "Upload index buffer" );
 		WriteIndexBuffer( ps->ibo, ps->gpu_instances.begin(), ps->num_particles * sizeof( ps->gpu_instances[ 0 ] ) );
 	}
 
+	if( ps->feedback ) {
+		memcpy( ps->prev_gpu_instances.ptr, ps->gpu_instances.ptr, ps->num_particles * sizeof( ps->gpu_instances[ 0 ] ) );
+		ps->num_prev_gpu_instances = ps->num_particles;
+	}
+
 	{
 		ZoneScopedN( "Reset order" );
 		for( size_t i = 0; i < ps->num_particles; i++ ) {
@@ -850,13 +963,21 @@ void UpdateParticleSystem( ParticleSystem * ps, float dt ) {
 }
 
 void DrawParticleSystem( ParticleSystem * ps, float dt ) {
+	// flip even when there's nothing to update so the readback stays two frames behind
+	u32 feedback_buffer = ps->feedback_buffer;
+	if( ps->feedback ) {
+		ps->feedback_counts[ feedback_buffer ] = ps->num_particles;
+		ps->feedback_frames[ feedback_buffer ] = FrameNumber();
+		ps->feedback_buffer ^= 1;
+	}
+
 	if( ps->num_particles == 0 )
 		return;
 
 	ZoneScoped;
 
 	if( ps->feedback ) {
-		UpdateParticlesFeedback( ps->update_mesh, ps->vb, ps->vb2, ps->vb_feedback, ps->radius, ps->num_particles, dt );
+		UpdateParticlesFeedback( ps->update_mesh, ps->vb, ps->vb2, ps->vb_feedback[ feedback_buffer ], ps->radius, ps->num_particles, dt );
 	}
 	else {
 		UpdateParticles( ps->update_mesh, ps->vb, ps->vb2, ps->radius, ps->num_particles, dt );
@@ -889,6 +1010,8 @@ void DrawParticles() {
 
 	TracyPlot( "Particles", total_particles );
 	TracyPlot( "New Particles", total_new_particles );
+	TracyPlot( "Skipped particle feedback reads", s64( skipped_feedback_reads ) );
+	skipped_feedback_reads = 0;
 
 	if( cg_particleDebug != NULL && cg_particleDebug->integer ) {
 		const ImGuiIO & io = ImGui::GetIO();
@@ -1005,6 +1128,33 @@ static void EmitParticle( ParticleSystem * ps, const ParticleEmitter * emitter,
 	}
 }
 
+/*
+ * returns how much of an emitter's output to actually spawn. emitters past
+ * cg_particleLodDistance fall off with the square of distance, and emitters
+ * whose particles would be smaller than cg_particleLodMinSize pixels get
+ * culled outright
+ */
+static float ParticleEmitterLOD( const ParticleEmitter * emitter, ParticleEmitterPosition pos ) {
+	float distance = Length( pos.origin - frame_static.position );
+	if( distance <= pos.radius ) {
+		return 1.0f;
+	}
+
+	float size = Max2( emitter->start_size, emitter->end_size );
+	float pixels = size * frame_static.P.row1().y / distance * frame_static.viewport_height * 0.5f;
+	if( pixels < cg_particleLodMinSize->value ) {
+		return 0.0f;
+	}
+
+	float lod_distance = cg_particleLodDistance->value;
+	if( lod_distance <= 0.0f || distance <= lod_distance ) {
+		return 1.0f;
+	}
+
+	float frac = lod_distance / distance;
+	return frac * frac;
+}
+
 void EmitParticles( ParticleEmitter * emitter, ParticleEmitterPosition pos, float count, Vec4 color ) {
 	ZoneScoped;
 
@@ -1020,7 +1170,12 @@ void EmitParticles( ParticleEmitter * emitter, ParticleEmitterPosition pos, floa
 	}
 	ParticleSystem * ps = &particleSystems[ idx ];
 
-	float p = emitter->count * count + emitter->emission * count * dt;
+	float lod = ParticleEmitterLOD( emitter, pos );
+	if( lod == 0.0f ) {
+		return;
+	}
+
+	float p = ( emitter->count * count + emitter->emission * count * dt ) * lod;
 	u32 n = u32( p );
 	float remaining_p = p - n;
 
@@ -81,6 +81,21 @@ struct ParticleEvents {
 	StringHash events[ MAX_PARTICLE_EMITTER_EVENTS ];
 };
 
+// where the CPU thinks a particle is, ignoring collisions. good enough to
+// depth sort by
+struct ParticleDepthEstimate {
+	Vec3 origin;
+	Vec3 velocity;
+	float acceleration;
+	float drag;
+	s64 spawn_time;
+};
+
+struct ParticleSortKey {
+	float depth;
+	u32 index;
+};
+
 struct ParticleSystem {
 	size_t max_particles;
 
@@ -104,10 +119,27 @@ struct ParticleSystem {
 	Span< u32 > gpu_instances;
 	Span< s64 > gpu_instances_time;
 
+	// feedback is double buffered and read back two frames late, and only
+	// once the fence for the frame that wrote it has passed, so we never wait
+	// on the GPU. the previous frame's index buffer maps particles back to the
+	// slots the feedback was written for
+	Span< u32 > prev_gpu_instances;
+	size_t num_prev_gpu_instances;
+	u32 feedback_counts[ 2 ];
+	u64 feedback_frames[ 2 ];
+	u32 feedback_buffer;
+
+	// alpha blended systems get sorted back to front. we sort the index
+	// buffer and the update pass writes the particles out in that order
+	bool sort;
+	Span< ParticleDepthEstimate > depth_estimates;
+	Span< ParticleSortKey > sort_keys;
+	void * sort_scratch;
+
 	IndexBuffer ibo;
 	VertexBuffer vb;
 	VertexBuffer vb2;
-	VertexBuffer vb_feedback;
+	VertexBuffer vb_feedback[ 2 ];
 
 	Mesh mesh;
 	Mesh update_mesh;
@@ -276,34 +276,15 @@ bool CG_PModel_GetProjectionSource( int entnum, orientation_t *tag_result ) {
 }
 
 /*
-* CG_OutlineScaleForDist
+* CG_OutlineForDist
+*
+* outlines are a fixed number of pixels wide so they only need cutting off
+* past maxdist
 */
-static float CG_OutlineScaleForDist( const InterpolatedEntity * e, float maxdist, float scale ) {
+static bool CG_OutlineForDist( const InterpolatedEntity * e, float maxdist ) {
 	Vec3 dir = e->origin - cg.view.origin;
 	float dist = Length( dir ) * cg.view.fracDistFOV;
-	if( dist > maxdist ) {
-		return 0;
-	}
-
-	dist *= scale;
-
-	if( dist < 64 ) {
-		return 0.14f;
-	}
-	if( dist < 128 ) {
-		return 0.30f;
-	}
-	if( dist < 256 ) {
-		return 0.42f;
-	}
-	if( dist < 512 ) {
-		return 0.56f;
-	}
-	if( dist < 768 ) {
-		return 0.70f;
-	}
-
-	return 1.0f;
+	return dist <= maxdist;
 }
 
 //======================================================================
@@ -829,14 +810,12 @@ void CG_DrawPlayer( centity_t *cent ) {
 	if( draw_model )
 		DrawModel( meta->model, transform, color, pose );
 	DrawModelShadow( meta->model, transform, color, pose );
-	if( !corpse && draw_silhouette ) {
-		DrawModelSilhouette( meta->model, transform, color, pose );
-	}
 
 	if( draw_model ) {
-		float outline_height = CG_OutlineScaleForDist( &cent->interpolated, 4096, 1.0f );
-		if( outline_height != 0.0f ) {
-			DrawOutlinedModel( meta->model, transform, color * 0.5f, outline_height, pose );
+		Vec4 silhouette_color = !corpse && draw_silhouette ? color : Vec4( 0 );
+		Vec4 outline_color = CG_OutlineForDist( &cent->interpolated, 4096 ) ? Vec4( color.xyz() * 0.5f, 1.0f ) : Vec4( 0 );
+		if( silhouette_color.w != 0.0f || outline_color.w != 0.0f ) {
+			DrawModelSilhouette( meta->model, transform, silhouette_color, outline_color, pose );
 		}
 	}
 
@@ -21,8 +21,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "cgame/cg_local.h"
 #include "qcommon/cmodel.h"
 
+/*
+ * the solid list gets built once per snapshot along with world space bounds
+ * for everything in it, so traces can skip entities nowhere near them
+ * without building a hull and doing a full transformed trace
+ */
+struct CGSolid {
+	const SyncEntityState * ent;
+	MinMax3 bounds;
+};
+
 static int cg_numSolids;
-static SyncEntityState *cg_solidList[MAX_PARSE_ENTITIES];
+static CGSolid cg_solidList[MAX_PARSE_ENTITIES];
 
 static int cg_numTriggers;
 static SyncEntityState *cg_triggersList[MAX_PARSE_ENTITIES];
@@ -30,6 +40,23 @@ static bool cg_triggersListTriggered[MAX_PARSE_ENTITIES];
 
 static bool ucmdReady = false;
 
+/*
+ * what we predicted after each command. when a new snapshot agrees with what
+ * we predicted for the last command it executed, everything we predicted
+ * after that still holds and we can carry on from cg.predictFrom instead of
+ * replaying every unacknowledged command again. commands that hit other
+ * entities or triggers always get replayed, since those move between
+ * snapshots
+ */
+struct PredictedCommand {
+	int64_t ucmd;
+	SyncPlayerState playerState;
+	bool touched_entity;
+};
+
+static PredictedCommand predictedCommands[CMD_BACKUP];
+static bool predictTouchedTrigger;
+
 /*
 * CG_PredictedEvent - shared code can fire events during prediction
 */
@@ -96,12 +123,37 @@ void CG_CheckPredictionError() {
 	}
 }
 
+static MinMax3 CG_SolidBounds( const SyncEntityState * ent ) {
+	const cmodel_t * cmodel = CG_CModelForEntity( ent->number );
+	if( cmodel == NULL || cmodel->builtin ) {
+		// boxes don't rotate
+		return MinMax3( ent->origin + ent->bounds.mins, ent->origin + ent->bounds.maxs );
+	}
+
+	// same time as CG_ClipMoveToEntities
+	Vec3 origin = ent->origin;
+	if( ent->linearMovement ) {
+		GS_LinearMovement( ent, cg.frame.serverTime, &origin );
+	}
+
+	Vec3 mins, maxs;
+	CM_InlineModelBounds( cl.cms, cmodel, &mins, &maxs );
+	if( ent->angles == Vec3( 0.0f ) ) {
+		return MinMax3( origin + mins, origin + maxs );
+	}
+
+	float radius = Max2( Length( mins ), Length( maxs ) );
+	return MinMax3( origin - Vec3( radius ), origin + Vec3( radius ) );
+}
+
 void CG_BuildSolidList() {
+	ZoneScoped;
+
 	cg_numSolids = 0;
 	cg_numTriggers = 0;
 
 	for( int i = 0; i < cg.frame.numEntities; i++ ) {
-		const SyncEntityState * ent = &cg.frame.parsedEntities[ i ];
+		const SyncEntityState * ent = cg.frame.parsedEntities[ i ];
 
 		if( ISEVENTENTITY( ent ) )
 			continue;
@@ -130,9 +182,11 @@ void CG_BuildSolidList() {
 				cg_triggersList[cg_numTriggers++] = &cg_entities[ ent->number ].current;
 				break;
 
-			default:
-				cg_solidList[cg_numSolids++] = &cg_entities[ ent->number ].current;
-				break;
+			default: {
+				CGSolid * solid = &cg_solidList[cg_numSolids++];
+				solid->ent = &cg_entities[ ent->number ].current;
+				solid->bounds = CG_SolidBounds( solid->ent );
+			} break;
 		}
 	}
 }
@@ -165,7 +219,7 @@ static bool CG_ClipEntityContact( Vec3 origin, Vec3 mins, Vec3 maxs, int entNum
 	Vec3 absmins = origin + mins;
 	Vec3 absmaxs = origin + maxs;
 	trace_t tr;
-	CM_TransformedBoxTrace( CM_Client, cl.cms, &tr, Vec3( 0.0f ), Vec3( 0.0f ), absmins, absmaxs, cmodel, MASK_ALL, entorigin, entangles );
+	CM_TransformedBoxTrace( CM_Client, cl.cms, NULL, &tr, Vec3( 0.0f ), Vec3( 0.0f ), absmins, absmaxs, cmodel, MASK_ALL, entorigin, entangles );
 	return tr.startsolid == true || tr.allsolid == true;
 }
 
@@ -183,57 +237,81 @@ void CG_Predict_TouchTriggers( pmove_t *pm, Vec3 previous_origin ) {
 				if( CG_ClipEntityContact( pm->playerState->pmove.origin, pm->mins, pm->maxs, state->number ) ) {
 					GS_TouchPushTrigger( &client_gs, pm->playerState, state );
 					cg_triggersListTriggered[i] = true;
+					predictTouchedTrigger = true;
 				}
 			}
 		}
 	}
 }
 
+static bool CG_IgnoreSolid( const SyncEntityState * ent, int ignore, int contentmask ) {
+	if( ent->number == ignore ) {
+		return true;
+	}
+
+	if( !( contentmask & CONTENTS_CORPSE ) && ent->type == ET_CORPSE ) {
+		return true;
+	}
+
+	if( ent->type == ET_PLAYER ) {
+		int teammask = contentmask & ( CONTENTS_TEAMALPHA | CONTENTS_TEAMBETA );
+		if( teammask != 0 ) {
+			int team = teammask == CONTENTS_TEAMALPHA ? TEAM_ALPHA : TEAM_BETA;
+			if( ent->team != team )
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static const cmodel_t * CG_SolidTransform( const SyncEntityState * ent, Vec3 * origin, Vec3 * angles ) {
+	const cmodel_t * cmodel = CG_CModelForEntity( ent->number );
+	if( !cmodel->builtin ) { // special value for bmodel
+		if( ent->linearMovement ) {
+			GS_LinearMovement( ent, cg.frame.serverTime, origin );
+		} else {
+			*origin = ent->origin;
+		}
+		*angles = ent->angles;
+	} else {
+		*origin = ent->origin;
+		*angles = Vec3( 0.0f ); // boxes don't rotate
+	}
+
+	return cmodel;
+}
+
+static void CG_ClipToSolid( trace_t * tr, const SyncEntityState * ent, const cmodel_t * cmodel, Vec3 origin, Vec3 angles, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int contentmask ) {
+	trace_t trace;
+	CM_TransformedBoxTrace( CM_Client, cl.cms, NULL, &trace, start, end, mins, maxs, cmodel, contentmask, origin, angles );
+	if( trace.allsolid || trace.fraction < tr->fraction ) {
+		trace.ent = ent->number;
+		*tr = trace;
+	} else if( trace.startsolid ) {
+		tr->startsolid = true;
+	}
+}
+
 static void CG_ClipMoveToEntities( Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int ignore, int contentmask, trace_t *tr ) {
-	int64_t serverTime = cg.frame.serverTime;
+	MinMax3 move_bounds = Extend( Extend( MinMax3::Empty(), start ), end );
+	Vec3 move_mins = move_bounds.mins + mins - Vec3( 1.0f );
+	Vec3 move_maxs = move_bounds.maxs + maxs + Vec3( 1.0f );
 
 	for( int i = 0; i < cg_numSolids; i++ ) {
-		const SyncEntityState * ent = cg_solidList[i];
+		const SyncEntityState * ent = cg_solidList[i].ent;
 
-		if( ent->number == ignore ) {
+		if( !BoundsOverlap( move_mins, move_maxs, cg_solidList[i].bounds.mins, cg_solidList[i].bounds.maxs ) ) {
 			continue;
 		}
 
-		if( !( contentmask & CONTENTS_CORPSE ) && ent->type == ET_CORPSE ) {
+		if( CG_IgnoreSolid( ent, ignore, contentmask ) ) {
 			continue;
 		}
 
-		if( ent->type == ET_PLAYER ) {
-			int teammask = contentmask & ( CONTENTS_TEAMALPHA | CONTENTS_TEAMBETA );
-			if( teammask != 0 ) {
-				int team = teammask == CONTENTS_TEAMALPHA ? TEAM_ALPHA : TEAM_BETA;
-				if( ent->team != team )
-					continue;
-			}
-		}
-
-		const cmodel_t * cmodel = CG_CModelForEntity( ent->number );
 		Vec3 origin, angles;
-		if( !cmodel->builtin ) { // special value for bmodel
-			if( ent->linearMovement ) {
-				GS_LinearMovement( ent, serverTime, &origin );
-			} else {
-				origin = ent->origin;
-			}
-			angles = ent->angles;
-		} else {
-			origin = ent->origin;
-			angles = Vec3( 0.0f ); // boxes don't rotate
-		}
-
-		trace_t trace;
-		CM_TransformedBoxTrace( CM_Client, cl.cms, &trace, start, end, mins, maxs, cmodel, contentmask, origin, angles );
-		if( trace.allsolid || trace.fraction < tr->fraction ) {
-			trace.ent = ent->number;
-			*tr = trace;
-		} else if( trace.startsolid ) {
-			tr->startsolid = true;
-		}
+		const cmodel_t * cmodel = CG_SolidTransform( ent, &origin, &angles );
+		CG_ClipToSolid( tr, ent, cmodel, origin, angles, start, mins, maxs, end, contentmask );
 
 		if( tr->allsolid ) {
 			return;
@@ -245,7 +323,7 @@ void CG_Trace( trace_t *t, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int ignor
 	ZoneScoped;
 
 	// check against world
-	CM_TransformedBoxTrace( CM_Client, cl.cms, t, start, end, mins, maxs, NULL, contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
+	CM_TransformedBoxTrace( CM_Client, cl.cms, NULL, t, start, end, mins, maxs, NULL, contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
 	t->ent = t->fraction < 1.0 ? 0 : -1; // world entity is 0
 	if( t->fraction == 0 ) {
 		return; // blocked by the world
@@ -255,13 +333,91 @@ void CG_Trace( trace_t *t, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int ignor
 	CG_ClipMoveToEntities( start, mins, maxs, end, ignore, contentmask, t );
 }
 
+/*
+* CG_TraceBatch
+*
+* Same as calling CG_Trace on every ray, but only looks at each solid
+* entity once for all of them. Each ray gets its own box
+*/
+#define MAX_TRACE_BATCH 64
+
+void CG_TraceBatch( trace_t * traces, const Vec3 * starts, const Vec3 * ends, const MinMax3 * boxes, size_t n, int ignore, int contentmask ) {
+	ZoneScoped;
+
+	while( n > MAX_TRACE_BATCH ) {
+		CG_TraceBatch( traces, starts, ends, boxes, MAX_TRACE_BATCH, ignore, contentmask );
+		traces += MAX_TRACE_BATCH;
+		starts += MAX_TRACE_BATCH;
+		ends += MAX_TRACE_BATCH;
+		boxes += MAX_TRACE_BATCH;
+		n -= MAX_TRACE_BATCH;
+	}
+
+	MinMax3 move_bounds[ MAX_TRACE_BATCH ];
+	bool active[ MAX_TRACE_BATCH ];
+	bool any_active = false;
+
+	for( size_t i = 0; i < n; i++ ) {
+		trace_t * tr = &traces[ i ];
+
+		// check against world
+		CM_TransformedBoxTrace( CM_Client, cl.cms, NULL, tr, starts[ i ], ends[ i ], boxes[ i ].mins, boxes[ i ].maxs, NULL, contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
+		tr->ent = tr->fraction < 1.0 ? 0 : -1; // world entity is 0
+		active[ i ] = tr->fraction != 0; // blocked by the world
+
+		MinMax3 bounds = Extend( Extend( MinMax3::Empty(), starts[ i ] ), ends[ i ] );
+		move_bounds[ i ] = MinMax3( bounds.mins + boxes[ i ].mins - Vec3( 1.0f ), bounds.maxs + boxes[ i ].maxs + Vec3( 1.0f ) );
+
+		any_active |= active[ i ];
+	}
+
+	if( !any_active ) {
+		return;
+	}
+
+	for( int i = 0; i < cg_numSolids; i++ ) {
+		const SyncEntityState * ent = cg_solidList[i].ent;
+		const MinMax3 & solid_bounds = cg_solidList[i].bounds;
+
+		bool overlaps[ MAX_TRACE_BATCH ];
+		bool any_overlap = false;
+		for( size_t j = 0; j < n; j++ ) {
+			overlaps[ j ] = active[ j ] && BoundsOverlap( move_bounds[ j ].mins, move_bounds[ j ].maxs, solid_bounds.mins, solid_bounds.maxs );
+			any_overlap |= overlaps[ j ];
+		}
+
+		if( !any_overlap || CG_IgnoreSolid( ent, ignore, contentmask ) ) {
+			continue;
+		}
+
+		Vec3 origin, angles;
+		const cmodel_t * cmodel = CG_SolidTransform( ent, &origin, &angles );
+
+		for( size_t j = 0; j < n; j++ ) {
+			if( !overlaps[ j ] ) {
+				continue;
+			}
+
+			CG_ClipToSolid( &traces[ j ], ent, cmodel, origin, angles, starts[ j ], boxes[ j ].mins, boxes[ j ].maxs, ends[ j ], contentmask );
+			if( traces[ j ].allsolid ) {
+				active[ j ] = false;
+			}
+		}
+	}
+}
+
 int CG_PointContents( Vec3 point ) {
 	ZoneScoped;
 
 	int contents = CM_TransformedPointContents( CM_Client, cl.cms, point, NULL, Vec3( 0.0f ), Vec3( 0.0f ) );
 
 	for( int i = 0; i < cg_numSolids; i++ ) {
-		const SyncEntityState * ent = cg_solidList[i];
+		const SyncEntityState * ent = cg_solidList[i].ent;
+
+		// the bounds are for where movers are at the snapshot time, but this uses their origin
+		if( !ent->linearMovement && !BoundsOverlap( point, point, cg_solidList[i].bounds.mins, cg_solidList[i].bounds.maxs ) ) {
+			continue;
+		}
 
 		cmodel_t * cmodel = CM_TryFindCModel( CM_Client, ent->model );
 		if( cmodel != NULL ) {
@@ -327,6 +483,53 @@ static void CG_PredictSmoothSteps() {
 	}
 }
 
+static bool CG_PmoveTouchedEntity( const pmove_t * pm ) {
+	if( pm->groundentity > 0 ) {
+		return true;
+	}
+
+	for( int i = 0; i < pm->numtouch; i++ ) {
+		if( pm->touchents[i] > 0 ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+* CG_CheckPredictionCache
+*
+* Called on each new snapshot, keeps cg.predictFrom if we predicted this snapshot correctly
+*/
+void CG_CheckPredictionCache() {
+	int64_t ucmdExecuted = cg.frame.ucmdExecuted;
+
+	bool keep = cg.predictFrom > ucmdExecuted;
+	if( keep ) {
+		const PredictedCommand * executed = &predictedCommands[ucmdExecuted & CMD_MASK];
+
+		// events aren't predicted
+		SyncPlayerState server = cg.frame.playerState;
+		memcpy( server.events, executed->playerState.events, sizeof( server.events ) );
+
+		keep = executed->ucmd == ucmdExecuted && MSG_PlayerStatesMatch( &executed->playerState, &server );
+	}
+
+	for( int64_t i = ucmdExecuted + 1; keep && i <= cg.predictFrom; i++ ) {
+		const PredictedCommand * cmd = &predictedCommands[i & CMD_MASK];
+		keep = cmd->ucmd == i && !cmd->touched_entity;
+	}
+
+	if( !keep ) {
+		cg.predictFrom = 0; // force the prediction to be restarted from the new snapshot
+		return;
+	}
+
+	// the old snapshot's copy of our entity is stale now
+	cg.predictFromEntityState = cg_entities[cg.frame.playerState.POVnum].current;
+}
+
 /*
 * CG_PredictMovement
 *
@@ -383,6 +586,7 @@ void CG_PredictMovement() {
 			cg.predictingTimeStamp = pm.cmd.serverTimeStamp;
 		}
 
+		predictTouchedTrigger = false;
 		Pmove( &client_gs, &pm );
 
 		// copy for stair smoothing
@@ -392,6 +596,10 @@ void CG_PredictMovement() {
 			UpdateWeapons( &client_gs, &cg.predictedPlayerState, pm.cmd, 0 );
 		}
 
+		predictedCommands[frame].ucmd = ucmdExecuted;
+		predictedCommands[frame].playerState = cg.predictedPlayerState;
+		predictedCommands[frame].touched_entity = predictTouchedTrigger || CG_PmoveTouchedEntity( &pm );
+
 		// save for debug checking
 		cg.predictedOrigins[frame] = cg.predictedPlayerState.pmove.origin; // store for prediction error checks
 
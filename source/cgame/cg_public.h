@@ -46,7 +46,9 @@ struct snapshot_t {
 	SyncPlayerState playerState;
 	SyncPlayerState playerStates[MAX_CLIENTS];
 	int numEntities;
-	SyncEntityState parsedEntities[MAX_PARSE_ENTITIES];
+	const SyncEntityState * parsedEntities[MAX_PARSE_ENTITIES]; // points into the client's entity ring
+	int numEvents;
+	SyncSnapEvent events[MAX_SNAP_EVENTS];
 	SyncGameState gameState;
 	int numgamecommands;
 	gcommand_t gamecommands[MAX_PARSE_GAMECOMMANDS];
@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 cvar_t *cg_centerTime;
 cvar_t *cg_showFPS;
+cvar_t *cg_showLatency;
 cvar_t *cg_showPointedPlayer;
 cvar_t *cg_draw2D;
 
@@ -69,6 +70,7 @@ static void CG_DrawCenterString() {
 
 void CG_ScreenInit() {
 	cg_showFPS =        Cvar_Get( "cg_showFPS", "0", CVAR_ARCHIVE );
+	cg_showLatency =    Cvar_Get( "cg_showLatency", "0", CVAR_ARCHIVE );
 	cg_draw2D =     Cvar_Get( "cg_draw2D", "1", 0 );
 	cg_centerTime =     Cvar_Get( "cg_centerTime", "2.5", 0 );
 
@@ -574,7 +576,7 @@ void CG_InitDamageNumbers() {
 	}
 }
 
-void CG_AddDamageNumber( SyncEntityState * ent, u64 parm ) {
+void CG_AddDamageNumber( const SyncEntityState * ent, u64 parm ) {
 	DamageNumber * dn = &damage_numbers[ damage_numbers_head ];
 
 	dn->t = cl.serverTime;
@@ -834,7 +836,7 @@ static void CG_DrawScope() {
 		pipeline.depth_func = DepthFunc_Disabled;
 		pipeline.blend_func = BlendFunc_Blend;
 		pipeline.write_depth = false;
-		pipeline.set_uniform( "u_View", frame_static.view_uniforms );
+		pipeline.set_uniform( UniformSlot_View, frame_static.ortho_view_uniforms );
 		DrawFullscreenMesh( pipeline );
 	}
 }
@@ -4,4 +4,3 @@
 
 void InitSprays();
 void AddSpray( Vec3 origin, Vec3 normal, Vec3 angles, u64 entropy );
-void DrawSprays();
@@ -19,6 +19,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "cgame/cg_local.h"
+#include "qcommon/cmodel.h"
+#include "qcommon/zone_sampler.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/skybox.h"
 
@@ -593,40 +595,48 @@ static void DrawWorld() {
 	u64 hash = Hash64( suffix, strlen( suffix ), cl.map->base_hash );
 	const Model * model = FindModel( StringHash( hash ) );
 
-	for( u32 i = 0; i < model->num_primitives; i++ ) {
-		if( model->primitives[ i ].material->blend_func == BlendFunc_Disabled ) {
-			for( u32 j = 0; j < frame_static.shadow_parameters.num_cascades; j++ ) {
-				PipelineState pipeline;
-				pipeline.pass = frame_static.shadowmap_pass[ j ];
-				pipeline.shader = &shaders.depth_only;
-				pipeline.clamp_depth = true;
-				// pipeline.cull_face = CullFace_Disabled;
-				pipeline.set_uniform( "u_View", frame_static.shadowmap_view_uniforms[ j ] );
-				pipeline.set_uniform( "u_Model", frame_static.identity_model_uniforms );
-
-				DrawModelPrimitive( model, &model->primitives[ i ], pipeline );
-			}
-		}
+	// the prepass and shadow passes don't care about materials, so draw the
+	// whole mesh/all the opaque primitives in one go. the world never moves
+	// so its shadows only get redrawn when the cached cascade goes stale
+	for( u32 j = 0; j < frame_static.shadow_parameters.num_cascades; j++ ) {
+		if( !frame_static.static_shadowmap_dirty[ j ] )
+			continue;
 
-		{
-			PipelineState pipeline;
-			pipeline.pass = frame_static.world_opaque_prepass_pass;
-			pipeline.shader = &shaders.depth_only;
-			pipeline.set_uniform( "u_View", frame_static.view_uniforms );
-			pipeline.set_uniform( "u_Model", frame_static.identity_model_uniforms );
+		PipelineState pipeline;
+		pipeline.pass = frame_static.static_shadowmap_pass[ j ];
+		pipeline.shader = &shaders.depth_only;
+		pipeline.clamp_depth = true;
+		// pipeline.cull_face = CullFace_Disabled;
+		pipeline.set_uniform( UniformSlot_View, frame_static.shadowmap_view_uniforms[ j ] );
+		pipeline.set_uniform( UniformSlot_Model, frame_static.identity_model_uniforms );
 
-			DrawModelPrimitive( model, &model->primitives[ i ], pipeline );
-		}
+		DrawBSPModelShadows( model, pipeline );
+	}
 
-		{
-			PipelineState pipeline = MaterialToPipelineState( model->primitives[ i ].material );
-			pipeline.set_uniform( "u_View", frame_static.view_uniforms );
-			pipeline.set_uniform( "u_Model", frame_static.identity_model_uniforms );
-			pipeline.write_depth = false;
-			pipeline.depth_func = DepthFunc_Equal;
+	// the prepass and the opaque pass have to cull the same chunks or the
+	// depth test won't line up
+	TempAllocator temp = cls.frame_arena.temp();
+	const u8 * pvs = CM_FatPVS( cl.cms, frame_static.position );
+	Span< const bool > visible = CullBSPModel( &temp, model, pvs, CM_ClusterRowSize( cl.cms ) * 8 );
 
-			DrawModelPrimitive( model, &model->primitives[ i ], pipeline );
-		}
+	{
+		PipelineState pipeline;
+		pipeline.pass = frame_static.world_opaque_prepass_pass;
+		pipeline.shader = &shaders.depth_only;
+		pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
+		pipeline.set_uniform( UniformSlot_Model, frame_static.identity_model_uniforms );
+
+		DrawBSPModel( model, visible, pipeline );
+	}
+
+	for( u32 i = 0; i < model->num_primitives; i++ ) {
+		PipelineState pipeline = MaterialToPipelineState( model->primitives[ i ].material );
+		pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
+		pipeline.set_uniform( UniformSlot_Model, frame_static.identity_model_uniforms );
+		pipeline.write_depth = false;
+		pipeline.depth_func = DepthFunc_Equal;
+
+		DrawBSPModelPrimitive( model, i, visible, pipeline );
 	}
 
 	{
@@ -642,10 +652,10 @@ static void DrawWorld() {
 		constexpr RGBA8 gray = RGBA8( 30, 30, 30, 255 );
 
 		const Framebuffer & fb = msaa ? frame_static.msaa_fb : frame_static.postprocess_fb;
-		pipeline.set_texture( "u_DepthTexture", &fb.depth_texture );
-		pipeline.set_uniform( "u_Fog", frame_static.fog_uniforms );
-		pipeline.set_uniform( "u_View", frame_static.view_uniforms );
-		pipeline.set_uniform( "u_Outline", UploadUniformBlock( sRGBToLinear( gray ) ) );
+		pipeline.set_texture( TextureSlot_DepthTexture, &fb.depth_texture );
+		pipeline.set_uniform( UniformSlot_Fog, frame_static.fog_uniforms );
+		pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
+		pipeline.set_uniform( UniformSlot_Outline, UploadUniformBlock( sRGBToLinear( gray ) ) );
 		DrawFullscreenMesh( pipeline );
 	}
 }
@@ -662,14 +672,18 @@ static void DrawSilhouettes() {
 		pipeline.write_depth = false;
 
 		const Framebuffer & fb = frame_static.silhouette_gbuffer;
-		pipeline.set_texture( "u_SilhouetteTexture", &fb.albedo_texture );
-		pipeline.set_uniform( "u_View", frame_static.ortho_view_uniforms );
+		pipeline.set_texture( TextureSlot_SilhouetteTexture, &fb.albedo_texture );
+		pipeline.set_texture( TextureSlot_SilhouetteOutlineTexture, &fb.normal_texture );
+		pipeline.set_texture( TextureSlot_SilhouetteDepthTexture, &fb.depth_texture );
+		pipeline.set_texture( TextureSlot_DepthTexture, &frame_static.postprocess_fb.depth_texture );
+		pipeline.set_uniform( UniformSlot_Fog, frame_static.fog_uniforms );
+		pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
 		DrawFullscreenMesh( pipeline );
 	}
 }
 
 void CG_RenderView( unsigned extrapolationTime ) {
-	ZoneScoped;
+	ZoneScopedSampled( "CG_RenderView" );
 
 	cg.frameCount++;
 
@@ -772,7 +786,6 @@ void CG_RenderView( unsigned extrapolationTime ) {
 	DrawPersistentDecals();
 	DrawPersistentDynamicLights();
 	DrawSkybox();
-	DrawSprays();
 
 	CG_AddLocalSounds();
 
@@ -31,7 +31,7 @@ static WeaponModelMetadata LoadWeaponModel( WeaponType weapon ) {
 
 	WeaponModelMetadata metadata;
 
-	const char * name = GS_GetWeaponDef( weapon )->short_name;
+	const char * name = GetWeaponInfo( weapon )->short_name;
 
 	metadata.model = FindModel( temp( "weapons/{}/model", name ) );
 
@@ -3,21 +3,40 @@
 
 #include "qcommon/qcommon.h"
 #include "qcommon/base.h"
+#include "qcommon/asset_archive.h"
+#include "qcommon/async_io.h"
 #include "qcommon/compression.h"
 #include "qcommon/fs.h"
 #include "qcommon/hash.h"
-#include "qcommon/hashtable.h"
+#include "qcommon/dynamic_hashtable.h"
+#include "qcommon/load_profile.h"
+#include "qcommon/memory_budget.h"
 #include "qcommon/string.h"
 #include "qcommon/threads.h"
 #include "client/assets.h"
-#include "client/threadpool.h"
+#include "qcommon/threadpool.h"
+
+/*
+ * .zst assets stay compressed until the first AssetBinary/AssetString call
+ * asks for them. once whoever loaded them says they're done with the data
+ * (AssetConsumed) they can be evicted again, least recently used first,
+ * whenever the decompressed assets go over budget. the next request just
+ * decompresses them again
+ *
+ * we remember which compressed assets each map ended up using and decompress
+ * them on the thread pool while the next game on that map is loading
+ */
 
 struct Asset {
 	char * path;
-	char * data;
+	char * data; // NULL for compressed assets that aren't resident
 	size_t len;
+	Span< const u8 > compressed; // the .zst, if this came from one
 	FileMetadata metadata;
-	bool compressed;
+	bool archived; // came from base.pak, and data/compressed point into the mapping
+	bool evictable;
+	bool used_this_map;
+	u64 last_used;
 };
 
 static constexpr u32 MAX_ASSETS = 4096;
@@ -31,14 +50,46 @@ static u32 num_assets;
 static const char * modified_asset_paths[ MAX_ASSETS ];
 static u32 num_modified_assets;
 
-static Hashtable< MAX_ASSETS * 2 > assets_hashtable;
+static NonRAIIDynamicHashtable assets_hashtable;
 
-enum IsCompressed {
-	IsCompressed_No,
-	IsCompressed_Yes,
+static Span< const u8 > archive;
+
+static size_t resident_bytes; // decompressed .zst assets only
+static u64 use_counter;
+static char * current_map;
+
+static bool IsCompressed( const Asset * a ) {
+	return a->compressed.ptr != NULL;
+}
+
+static void FreeAssetData( Asset * a ) {
+	if( IsCompressed( a ) ) {
+		if( a->data != NULL ) {
+			resident_bytes -= a->len;
+		}
+		FREE( sys_allocator, a->data );
+		if( !a->archived ) {
+			FREE( sys_allocator, const_cast< u8 * >( a->compressed.ptr ) );
+		}
+	}
+	else if( !a->archived ) {
+		FREE( sys_allocator, a->data );
+	}
+
+	a->data = NULL;
+	a->compressed = Span< const u8 >();
+}
+
+enum IsArchived {
+	IsArchived_No,
+	IsArchived_Yes,
 };
 
-static void AddAsset( const char * path, u64 hash, FileMetadata metadata, char * contents, size_t len, IsCompressed compressed ) {
+/*
+ * pass contents for uncompressed assets, or compressed and the decompressed
+ * size for .zst assets
+ */
+static void AddAsset( Span< const char > path, u64 hash, FileMetadata metadata, char * contents, size_t len, Span< const u8 > compressed, IsArchived archived ) {
 	Lock( assets_mutex );
 	defer { Unlock( assets_mutex ); };
 
@@ -53,18 +104,21 @@ static void AddAsset( const char * path, u64 hash, FileMetadata metadata, char *
 	Asset * a;
 	if( exists ) {
 		a = &assets[ idx ];
-		FREE( sys_allocator, a->data );
+		FreeAssetData( a );
 	}
 	else {
 		a = &assets[ num_assets ];
-		a->path = CopyString( sys_allocator, path );
+		*a = { };
+		a->path = ( *sys_allocator )( "{}", path );
 		asset_paths[ num_assets ] = a->path;
 	}
 
 	a->data = contents;
 	a->len = len;
+	a->compressed = compressed;
 	a->metadata = metadata;
-	a->compressed = compressed == IsCompressed_Yes;
+	a->archived = archived == IsArchived_Yes;
+	a->evictable = false;
 
 	modified_asset_paths[ num_modified_assets ] = a->path;
 	num_modified_assets++;
@@ -75,50 +129,76 @@ static void AddAsset( const char * path, u64 hash, FileMetadata metadata, char *
 	}
 }
 
-struct DecompressAssetJob {
-	char * path;
-	u64 hash;
+static u64 AssetHash( const char * game_path, Span< const char > * game_path_no_zst ) {
+	Span< const char > ext = LastFileExtension( game_path );
+	*game_path_no_zst = MakeSpan( game_path );
+	if( ext == ".zst" ) {
+		game_path_no_zst->n -= ext.n;
+	}
+
+	return Hash64( *game_path_no_zst );
+}
+
+static void AddLoadedAsset( const char * game_path, FileMetadata metadata, char * contents, size_t len ) {
+	LoadProfileAddBytes( len );
+
+	Span< const char > game_path_no_zst;
+	u64 hash = AssetHash( game_path, &game_path_no_zst );
+
+	if( LastFileExtension( game_path ) == ".zst" ) {
+		Span< const u8 > zst( ( const u8 * ) contents, len );
+		size_t decompressed_size;
+		if( !DecompressedSize( game_path, zst, &decompressed_size ) ) {
+			FREE( sys_allocator, contents );
+			return;
+		}
+
+		AddAsset( game_path_no_zst, hash, metadata, NULL, decompressed_size, zst, IsArchived_No );
+	}
+	else {
+		AddAsset( game_path_no_zst, hash, metadata, contents, len, Span< const u8 >(), IsArchived_No );
+	}
+}
+
+struct PendingHotload {
+	char * game_path;
 	FileMetadata metadata;
-	Span< u8 > compressed;
 };
 
-static void DecompressAsset( TempAllocator * temp, void * data ) {
-	ZoneScoped;
+static u32 num_pending_hotloads;
 
-	DecompressAssetJob * job = ( DecompressAssetJob * ) data;
+static FSWatcher * base_watcher;
+static bool tried_watching;
+static bool rescan_needed;
 
-	ZoneText( job->path, strlen( job->path ) );
+static void HotloadedAsset( void * user, const char * full_path, char * contents, size_t len ) {
+	PendingHotload * pending = ( PendingHotload * ) user;
+	defer {
+		FREE( sys_allocator, pending->game_path );
+		FREE( sys_allocator, pending );
+	};
 
-	char * path_with_zst = ( *temp )( "{}.zst", job->path );
-	Span< u8 > decompressed;
-	if( Decompress( path_with_zst, sys_allocator, job->compressed, &decompressed ) ) {
-		// TODO: we need to add a null terminator too so AssetString etc works
-		char * decompressed_and_terminated = ALLOC_MANY( sys_allocator, char, decompressed.n + 1 );
-		memcpy( decompressed_and_terminated, decompressed.ptr, decompressed.n );
-		decompressed_and_terminated[ decompressed.n ] = '\0';
+	num_pending_hotloads--;
 
-		AddAsset( job->path, job->hash, job->metadata, decompressed_and_terminated, decompressed.n, IsCompressed_Yes );
+	if( contents != NULL ) {
+		Com_Printf( "Hotloading %s\n", pending->game_path );
+		AddLoadedAsset( pending->game_path, pending->metadata, contents, len );
 	}
-
-	FREE( sys_allocator, decompressed.ptr );
-	FREE( sys_allocator, job->path );
-	FREE( sys_allocator, job->compressed.ptr );
-	FREE( sys_allocator, job );
 }
 
-static void LoadAsset( TempAllocator * temp, const char * game_path, const char * full_path ) {
+enum LoadAssetMode {
+	LoadAsset_Now,
+	LoadAsset_Async, // for hotloading, so the main thread doesn't hitch on the reads
+};
+
+static void LoadAsset( TempAllocator * temp, const char * game_path, const char * full_path, LoadAssetMode mode ) {
 	ZoneScoped;
 	ZoneText( game_path, strlen( game_path ) );
 
-	Span< const char > ext = LastFileExtension( game_path );
-	bool compressed = ext == ".zst";
-
-	Span< const char > game_path_no_zst = MakeSpan( game_path );
-	if( compressed ) {
-		game_path_no_zst.n -= ext.n;
-	}
+	bool compressed = LastFileExtension( game_path ) == ".zst";
 
-	u64 hash = Hash64( game_path_no_zst );
+	Span< const char > game_path_no_zst;
+	u64 hash = AssetHash( game_path, &game_path_no_zst );
 
 	FileMetadata metadata = FileMetadataOrZeroes( temp, full_path );
 
@@ -129,13 +209,17 @@ static void LoadAsset( TempAllocator * temp, const char * game_path, const char
 		u64 idx;
 		bool exists = assets_hashtable.get( hash, &idx );
 		if( exists ) {
+			const Asset * a = &assets[ idx ];
 			if( !StrEqual( game_path_no_zst, asset_paths[ idx ] ) ) {
-				Fatal( "Asset hash name collision: %s and %s", game_path, assets[ idx ].path );
+				Fatal( "Asset hash name collision: %s and %s", game_path, a->path );
 			}
 
-			bool same_file = assets[ idx ].compressed == compressed;
-			bool modified = assets[ idx ].metadata.modified_time != metadata.modified_time || assets[ idx ].metadata.size != metadata.size;
-			bool replaces = assets[ idx ].compressed && !compressed;
+			// archived assets get the archive's timestamp, so loose files that
+			// are newer than it win and you can iterate on top of base.pak
+			bool same_file = IsCompressed( a ) == compressed && !a->archived;
+			bool modified = a->metadata.modified_time != metadata.modified_time || a->metadata.size != metadata.size;
+			bool newer_than_archive = a->archived && metadata.modified_time > a->metadata.modified_time;
+			bool replaces = newer_than_archive || ( !a->archived && IsCompressed( a ) && !compressed );
 
 			bool hotload = ( same_file && modified ) || replaces;
 			if( !hotload ) {
@@ -144,26 +228,24 @@ static void LoadAsset( TempAllocator * temp, const char * game_path, const char
 		}
 	}
 
+	if( mode == LoadAsset_Async ) {
+		PendingHotload * pending = ALLOC( sys_allocator, PendingHotload );
+		pending->game_path = CopyString( sys_allocator, game_path );
+		pending->metadata = metadata;
+		num_pending_hotloads++;
+		AsyncReadFile( full_path, HotloadedAsset, pending );
+		return;
+	}
+
 	size_t len;
 	char * contents = ReadFileString( sys_allocator, full_path, &len );
 	if( contents == NULL )
 		return;
 
-	if( compressed ) {
-		DecompressAssetJob * job = ALLOC( sys_allocator, DecompressAssetJob );
-		job->path = ( *sys_allocator )( "{}", game_path_no_zst );
-		job->hash = hash;
-		job->compressed = Span< u8 >( ( u8 * ) contents, len );
-		job->metadata = metadata;
-
-		ThreadPoolDo( DecompressAsset, job );
-	}
-	else {
-		AddAsset( game_path, hash, metadata, contents, len, IsCompressed_No );
-	}
+	AddLoadedAsset( game_path, metadata, contents, len );
 }
 
-static void LoadAssetsRecursive( TempAllocator * temp, DynamicString * path, size_t skip ) {
+static void LoadAssetsRecursive( TempAllocator * temp, DynamicString * path, size_t skip, LoadAssetMode mode ) {
 	ListDirHandle scan = BeginListDir( temp, path->c_str() );
 
 	const char * name;
@@ -176,64 +258,272 @@ static void LoadAssetsRecursive( TempAllocator * temp, DynamicString * path, siz
 		size_t old_len = path->length();
 		path->append( "/{}", name );
 		if( dir ) {
-			LoadAssetsRecursive( temp, path, skip );
+			LoadAssetsRecursive( temp, path, skip, mode );
 		}
 		else {
-			LoadAsset( temp, path->c_str() + skip, path->c_str() );
+			LoadAsset( temp, path->c_str() + skip, path->c_str(), mode );
 		}
 		path->truncate( old_len );
 	}
 }
 
+static bool ArchiveRangeValid( u64 offset, u64 size ) {
+	return offset <= archive.n && size <= archive.n - offset;
+}
+
+static bool LoadArchive( s64 modified_time ) {
+	ZoneScoped;
+
+	if( !ArchiveRangeValid( 0, sizeof( AssetArchiveHeader ) ) )
+		return false;
+
+	const AssetArchiveHeader * header = ( const AssetArchiveHeader * ) archive.ptr;
+	if( header->magic != ASSET_ARCHIVE_MAGIC )
+		return false;
+	if( header->version != ASSET_ARCHIVE_VERSION && header->version != 1 )
+		return false;
+	bool rehash = header->version == 1;
+	if( header->num_entries > MAX_ASSETS || !ArchiveRangeValid( sizeof( *header ), header->num_entries * sizeof( AssetArchiveEntry ) ) )
+		return false;
+
+	const AssetArchiveEntry * entries = ( const AssetArchiveEntry * ) ( archive.ptr + sizeof( *header ) );
+
+	// validate everything up front so we never end up with half an archive
+	for( u64 i = 0; i < header->num_entries; i++ ) {
+		const AssetArchiveEntry * entry = &entries[ i ];
+		bool stored = entry->encoding == AssetArchiveEncoding_Stored;
+
+		if( entry->encoding != AssetArchiveEncoding_Stored && entry->encoding != AssetArchiveEncoding_Zstd )
+			return false;
+		if( !rehash && i > 0 && entry->hash <= entries[ i - 1 ].hash )
+			return false;
+		if( entry->path_offset >= archive.n || memchr( archive.ptr + entry->path_offset, '\0', archive.n - entry->path_offset ) == NULL )
+			return false;
+		if( entry->data_offset % ASSET_ARCHIVE_ALIGNMENT != 0 || !ArchiveRangeValid( entry->data_offset, entry->data_size ) )
+			return false;
+		if( stored && ( entry->data_size == archive.n - entry->data_offset || entry->size != entry->data_size || archive.ptr[ entry->data_offset + entry->size ] != '\0' ) )
+			return false;
+	}
+
+	for( u64 i = 0; i < header->num_entries; i++ ) {
+		const AssetArchiveEntry * entry = &entries[ i ];
+		const char * asset_path = ( const char * ) archive.ptr + entry->path_offset;
+		Span< const u8 > data = archive.slice( entry->data_offset, entry->data_offset + entry->data_size );
+		u64 hash = rehash ? Hash64( asset_path ) : entry->hash;
+
+		FileMetadata metadata;
+		metadata.size = entry->size;
+		metadata.modified_time = modified_time;
+
+		LoadProfileAddBytes( data.n );
+
+		if( entry->encoding == AssetArchiveEncoding_Stored ) {
+			AddAsset( MakeSpan( asset_path ), hash, metadata, ( char * ) const_cast< u8 * >( data.ptr ), data.n, Span< const u8 >(), IsArchived_Yes );
+		}
+		else {
+			AddAsset( MakeSpan( asset_path ), hash, metadata, NULL, entry->size, data, IsArchived_Yes );
+		}
+	}
+
+	return true;
+}
+
+static void AssetsMemoryBudget( MemoryBudget * budget ) {
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
+
+	budget->add_array( "assets", assets, num_assets );
+	budget->add_array( "asset_paths", asset_paths, num_assets );
+	budget->add_array( "modified_asset_paths", modified_asset_paths, num_modified_assets );
+
+	for( u32 i = 0; i < num_assets; i++ ) {
+		const Asset * a = &assets[ i ];
+		budget->heap_bytes += strlen( a->path ) + 1;
+		if( IsCompressed( a ) ) {
+			if( a->data != NULL ) {
+				budget->heap_bytes += a->len;
+			}
+			if( !a->archived ) {
+				budget->heap_bytes += a->compressed.n;
+			}
+		}
+		else if( !a->archived ) {
+			budget->heap_bytes += a->len;
+		}
+	}
+}
+
 void InitAssets( TempAllocator * temp ) {
 	ZoneScoped;
+	LoadProfileScoped( "InitAssets" );
 
 	assets_mutex = NewMutex();
 
 	num_assets = 0;
 	num_modified_assets = 0;
-	assets_hashtable.clear();
+	assets_hashtable.init( sys_allocator, MAX_ASSETS );
+	resident_bytes = 0;
+	use_counter = 0;
+	num_pending_hotloads = 0;
+	base_watcher = NULL;
+	tried_watching = false;
+	rescan_needed = false;
+	current_map = NULL;
+
+	const char * archive_path = ( *temp )( "{}/base.pak", RootDirPath() );
+	if( MapFile( temp, archive_path, &archive ) ) {
+		if( !LoadArchive( FileMetadataOrZeroes( temp, archive_path ).modified_time ) ) {
+			Com_Printf( S_COLOR_YELLOW "%s is corrupt, ignoring it\n", archive_path );
+			UnmapFile( archive );
+			archive = Span< const u8 >();
+		}
+	}
 
 	DynamicString base( temp, "{}/base", RootDirPath() );
-	LoadAssetsRecursive( temp, &base, base.length() + 1 );
+	LoadAssetsRecursive( temp, &base, base.length() + 1, LoadAsset_Now );
 
 	num_modified_assets = 0;
+
+	AddMemoryBudget( "assets", AssetsMemoryBudget );
 }
 
+/*
+ * the reads finish on the I/O thread and the assets get swapped in from
+ * AsyncIOFrame, so they show up in ModifiedAssetPaths a frame or two later
+ */
 void HotloadAssets( TempAllocator * temp ) {
 	ZoneScoped;
 
-	num_modified_assets = 0;
+	// don't queue the same files again while the last lot are still loading
+	if( num_pending_hotloads > 0 )
+		return;
+
+	rescan_needed = false;
 
 	DynamicString base( temp, "{}/base", RootDirPath() );
-	LoadAssetsRecursive( temp, &base, base.length() + 1 );
+	LoadAssetsRecursive( temp, &base, base.length() + 1, LoadAsset_Async );
+}
+
+bool PollHotloadAssets( TempAllocator * temp ) {
+	ZoneScoped;
 
-	if( num_modified_assets > 0 ) {
-		Com_Printf( "Hotloading:\n" );
-		for( const char * path : ModifiedAssetPaths() ) {
-			Com_Printf( "    %s\n", path );
+	if( !tried_watching ) {
+		tried_watching = true;
+		base_watcher = NewFSWatcher( sys_allocator, ( *temp )( "{}/base", RootDirPath() ) );
+		if( base_watcher == NULL ) {
+			Com_Printf( S_COLOR_YELLOW "Can't watch base/ for changes, hotloading will rescan it instead\n" );
 		}
 	}
+
+	if( base_watcher == NULL )
+		return false;
+
+	const char * path;
+	while( PollFSWatcher( base_watcher, &path ) ) {
+		if( path == NULL ) {
+			rescan_needed = true;
+			continue;
+		}
+
+		LoadAsset( temp, path, ( *temp )( "{}/base/{}", RootDirPath(), path ), LoadAsset_Async );
+	}
+
+	if( rescan_needed ) {
+		HotloadAssets( temp );
+	}
+
+	return true;
 }
 
 void DoneHotloadingAssets() {
 	num_modified_assets = 0;
 }
 
+static void SavePrefetchList();
+
 void ShutdownAssets() {
+	RemoveMemoryBudget( "assets" );
+
+	// let outstanding hotloads land before everything goes away
+	AsyncIOFlush();
+	DeleteFSWatcher( base_watcher );
+
+	SavePrefetchList();
+	FREE( sys_allocator, current_map );
+
 	for( u32 i = 0; i < num_assets; i++ ) {
 		FREE( sys_allocator, assets[ i ].path );
-		FREE( sys_allocator, assets[ i ].data );
+		FreeAssetData( &assets[ i ] );
 	}
 
+	UnmapFile( archive );
+	archive = Span< const u8 >();
+
+	assets_hashtable.shutdown();
+
 	DeleteMutex( assets_mutex );
 }
 
+enum UseAsset {
+	UseAsset_No, // prefetching
+	UseAsset_Yes,
+};
+
+static Span< const char > ResidentAsset( Asset * a, UseAsset use ) {
+	if( !IsCompressed( a ) )
+		return Span< const char >( a->data, a->len );
+
+	Span< const u8 > compressed;
+	{
+		Lock( assets_mutex );
+		defer { Unlock( assets_mutex ); };
+
+		if( use == UseAsset_Yes ) {
+			a->last_used = use_counter++;
+			a->used_this_map = true;
+			a->evictable = false;
+		}
+
+		if( a->data != NULL )
+			return Span< const char >( a->data, a->len );
+
+		compressed = a->compressed;
+	}
+
+	ZoneScoped;
+	ZoneText( a->path, strlen( a->path ) );
+
+	// decompress without holding the lock so the thread pool can prefetch
+	// lots of assets at once
+	Span< u8 > decompressed;
+	// pad with a null terminator so AssetString works
+	bool ok = Decompress( a->path, sys_allocator, compressed, &decompressed, 1 );
+
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
+
+	// someone else might have beaten us to it
+	if( ok && a->data == NULL && a->compressed.ptr == compressed.ptr ) {
+		a->data = ( char * ) decompressed.ptr;
+		resident_bytes += a->len;
+		if( use == UseAsset_No ) {
+			// nobody has asked for it yet, so it's fair game
+			a->last_used = use_counter++;
+			a->evictable = true;
+		}
+	}
+	else if( ok ) {
+		FREE( sys_allocator, decompressed.ptr );
+	}
+
+	return a->data == NULL ? Span< const char >() : Span< const char >( a->data, a->len );
+}
+
 Span< const char > AssetString( StringHash path ) {
 	size_t i;
 	if( !assets_hashtable.get( path.hash, &i ) )
 		return Span< const char >();
-	return Span< const char >( assets[ i ].data, assets[ i ].len );
+	return ResidentAsset( &assets[ i ], UseAsset_Yes );
 }
 
 Span< const char > AssetString( const char * path ) {
@@ -248,6 +538,126 @@ Span< const u8 > AssetBinary( const char * path ) {
 	return AssetBinary( StringHash( path ) );
 }
 
+bool AssetExists( StringHash path ) {
+	size_t i;
+	return assets_hashtable.get( path.hash, &i );
+}
+
+void AssetConsumed( StringHash path ) {
+	size_t i;
+	if( !assets_hashtable.get( path.hash, &i ) )
+		return;
+
+	Lock( assets_mutex );
+	assets[ i ].evictable = true;
+	Unlock( assets_mutex );
+}
+
+void EvictAssets( size_t budget ) {
+	ZoneScoped;
+
+	Lock( assets_mutex );
+	defer { Unlock( assets_mutex ); };
+
+	while( resident_bytes > budget ) {
+		Asset * lru = NULL;
+		for( u32 i = 0; i < num_assets; i++ ) {
+			Asset * a = &assets[ i ];
+			if( !IsCompressed( a ) || a->data == NULL || !a->evictable )
+				continue;
+			if( lru == NULL || a->last_used < lru->last_used ) {
+				lru = a;
+			}
+		}
+
+		if( lru == NULL )
+			break;
+
+		resident_bytes -= lru->len;
+		FREE( sys_allocator, lru->data );
+		lru->data = NULL;
+	}
+
+	TracyPlot( "Decompressed asset bytes", s64( resident_bytes ) );
+}
+
+void PrefetchAssets( Span< const char * > paths ) {
+	ZoneScoped;
+
+	DynamicArray< Asset * > jobs( sys_allocator );
+	for( const char * path : paths ) {
+		size_t i;
+		if( assets_hashtable.get( Hash64( path ), &i ) && IsCompressed( &assets[ i ] ) ) {
+			jobs.add( &assets[ i ] );
+		}
+	}
+
+	ParallelFor( jobs.span(), []( TempAllocator * temp, void * data ) {
+		ResidentAsset( *( Asset ** ) data, UseAsset_No );
+	} );
+}
+
+static const char * PrefetchListPath( TempAllocator * temp, const char * map ) {
+	return ( *temp )( "{}/prefetch/{}.txt", HomeDirPath(), map );
+}
+
+static void SavePrefetchList() {
+	if( current_map == NULL )
+		return;
+
+	u8 arena_memory[ 1024 ];
+	ArenaAllocator arena( arena_memory, sizeof( arena_memory ) );
+	TempAllocator temp = arena.temp();
+
+	DynamicString list( sys_allocator );
+	for( u32 i = 0; i < num_assets; i++ ) {
+		if( IsCompressed( &assets[ i ] ) && assets[ i ].used_this_map ) {
+			list.append( "{}\n", assets[ i ].path );
+		}
+	}
+
+	const char * path = PrefetchListPath( &temp, current_map );
+	if( !WriteFile( &temp, path, list.c_str(), list.length() ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write %s\n", path );
+	}
+}
+
+void PrefetchMapAssets( const char * map ) {
+	ZoneScoped;
+	LoadProfileScoped( "PrefetchMapAssets" );
+
+	SavePrefetchList();
+	FREE( sys_allocator, current_map );
+	current_map = CopyString( sys_allocator, map );
+
+	for( u32 i = 0; i < num_assets; i++ ) {
+		assets[ i ].used_this_map = false;
+	}
+
+	u8 arena_memory[ 1024 ];
+	ArenaAllocator arena( arena_memory, sizeof( arena_memory ) );
+	TempAllocator temp = arena.temp();
+
+	char * list = ReadFileString( sys_allocator, PrefetchListPath( &temp, map ) );
+	if( list == NULL )
+		return;
+	defer { FREE( sys_allocator, list ); };
+
+	DynamicArray< const char * > paths( sys_allocator );
+	for( char * cursor = list; *cursor != '\0'; ) {
+		char * newline = strchr( cursor, '\n' );
+		if( newline == NULL )
+			break;
+		*newline = '\0';
+		if( newline != cursor ) {
+			paths.add( cursor );
+		}
+		cursor = newline + 1;
+	}
+
+	PrefetchAssets( paths.span() );
+}
+
 Span< const char * > AssetPaths() {
 	return Span< const char * >( asset_paths, num_assets );
 }
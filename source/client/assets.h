@@ -7,6 +7,10 @@ void InitAssets( TempAllocator * temp );
 void ShutdownAssets();
 
 void HotloadAssets( TempAllocator * temp );
+
+// reloads whatever the OS says changed, which is cheap enough to call every
+// frame. returns false if we can't watch base/ so you have to rescan instead
+bool PollHotloadAssets( TempAllocator * temp );
 void DoneHotloadingAssets();
 
 Span< const char > AssetString( StringHash path );
@@ -15,5 +19,19 @@ Span< const char > AssetString( const char * path );
 Span< const u8 > AssetBinary( StringHash path );
 Span< const u8 > AssetBinary( const char * path );
 
+// doesn't decompress anything
+bool AssetExists( StringHash path );
+
+/*
+ * lets a decompressed .zst asset get evicted once the decompressed assets go
+ * over budget. only call it when nothing holds on to the data anymore. asking
+ * for the asset again makes it stick until the next AssetConsumed
+ */
+void AssetConsumed( StringHash path );
+void EvictAssets( size_t budget );
+
+void PrefetchAssets( Span< const char * > paths );
+void PrefetchMapAssets( const char * map );
+
 Span< const char * > AssetPaths();
 Span< const char * > ModifiedAssetPaths();
@@ -19,6 +19,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "client/client.h"
+#include "qcommon/async_io.h"
+
+#include "zstd/zstd.h"
 
 static void CL_PauseDemo( bool paused );
 
@@ -37,6 +40,49 @@ void CL_WriteDemoMessage( msg_t *msg ) {
 	SNAP_RecordDemoMessage( cls.demo.file, msg, 8 );
 }
 
+/*
+* CL_RecordDemoKeyframe
+*
+* Called for each frame we record. We only get full snapshots when we ask for
+* them, so ask every so often and turn whatever arrives into a keyframe
+*/
+void CL_RecordDemoKeyframe( const snapshot_t *snap ) {
+	int64_t last = cls.demo.num_keyframes > 0 ? cls.demo.keyframes[cls.demo.num_keyframes - 1].server_time : 0;
+	if( cls.demo.num_keyframes == SNAP_MAX_DEMO_KEYFRAMES ) {
+		return;
+	}
+
+	if( snap->delta ) {
+		if( !cls.demo.keyframe_requested && snap->serverTime >= last + SNAP_DEMO_KEYFRAME_INTERVAL ) {
+			CL_AddReliableCommand( "nodelta" );
+			cls.demo.keyframe_requested = true;
+		}
+		return;
+	}
+
+	// the server keeps sending full snapshots until it hears back, don't make each one a keyframe
+	if( cls.demo.num_keyframes > 0 && snap->serverTime < last + SNAP_DEMO_KEYFRAME_INTERVAL / 2 ) {
+		return;
+	}
+
+	DemoKeyframe *kf = &cls.demo.keyframes[cls.demo.num_keyframes++];
+	kf->server_time = snap->serverTime;
+	kf->reliable_sequence = cls.lastExecutedServerCommand;
+	kf->offset = FS_Tell( cls.demo.file );
+
+	// the message with the snapshot gets written after we're done parsing it
+	msg_t msg;
+	uint8_t msg_buffer[MAX_MSGLEN];
+	MSG_Init( &msg, msg_buffer, sizeof( msg_buffer ) );
+	for( int cs = 0; cs < MAX_CONFIGSTRINGS; ) {
+		cs = SNAP_WriteDemoConfigstrings( &msg, cl.configstrings[0], cs );
+		SNAP_RecordDemoMessage( cls.demo.file, &msg, 0 );
+		MSG_Clear( &msg );
+	}
+
+	cls.demo.keyframe_requested = false;
+}
+
 /*
 * CL_Stop_f
 *
@@ -65,7 +111,7 @@ void CL_Stop_f() {
 	}
 
 	// finish up
-	SNAP_StopDemoRecording( cls.demo.file );
+	int keyframes_offset = SNAP_StopDemoRecording( cls.demo.file, cls.demo.keyframes, cls.demo.num_keyframes );
 
 	// write some meta information about the match/demo
 	CL_SetDemoMetaKeyValue( "hostname", cl.configstrings[CS_HOSTNAME] );
@@ -74,6 +120,7 @@ void CL_Stop_f() {
 	CL_SetDemoMetaKeyValue( "duration", va( "%u", (int)ceilf( (double)cls.demo.duration / 1000.0 ) ) );
 	CL_SetDemoMetaKeyValue( "mapname", cl.map->name );
 	CL_SetDemoMetaKeyValue( "matchscore", cl.configstrings[CS_MATCHSCORE] );
+	CL_SetDemoMetaKeyValue( "keyframes", va( "%i", keyframes_offset ) );
 
 	FS_FCloseFile( cls.demo.file );
 
@@ -179,6 +226,8 @@ void CL_Record_f() {
 	cls.demo.recording = true;
 	cls.demo.basetime = cls.demo.duration = cls.demo.time = 0;
 	cls.demo.name = ZoneCopyString( demoname );
+	cls.demo.num_keyframes = 0;
+	cls.demo.keyframe_requested = false;
 
 	// don't start saving messages until a non-delta compressed message is received
 	CL_AddReliableCommand( "nodelta" ); // request non delta compressed frame from server
@@ -196,6 +245,125 @@ void CL_Record_f() {
 static int demofilehandle;
 static int demofilelen, demofilelentotal;
 
+/*
+ * playback reads ahead on the I/O thread into two buffers, and we only wait
+ * on it if we get through a whole buffer before the next one has arrived.
+ * flush before touching demofilehandle directly
+ */
+struct DemoReadBuffer {
+	u8 data[ 128 * 1024 ];
+	size_t len;
+	bool ready;
+};
+
+static DemoReadBuffer demo_read_buffers[ 2 ];
+static size_t demo_read_current;
+static size_t demo_read_cursor;
+
+static void DemoReadDone( void * user, int bytes_read ) {
+	DemoReadBuffer * buffer = ( DemoReadBuffer * ) user;
+	buffer->len = size_t( Max2( bytes_read, 0 ) );
+	buffer->ready = true;
+}
+
+static void QueueDemoRead( DemoReadBuffer * buffer ) {
+	buffer->len = 0;
+	buffer->ready = false;
+	AsyncFSRead( demofilehandle, Span< u8 >( buffer->data, sizeof( buffer->data ) ), DemoReadDone, buffer );
+}
+
+static void StartDemoReadAhead() {
+	demo_read_current = 0;
+	demo_read_cursor = 0;
+	for( DemoReadBuffer & buffer : demo_read_buffers ) {
+		QueueDemoRead( &buffer );
+	}
+}
+
+static DemoReadBuffer * WaitForDemoReadBuffer() {
+	DemoReadBuffer * buffer = &demo_read_buffers[ demo_read_current ];
+	if( !buffer->ready ) {
+		ZoneScopedN( "Wait for demo read" );
+		AsyncIOFlush();
+	}
+	return buffer;
+}
+
+// moves on to the next buffer if we're through this one, false at the end of the file
+static bool AdvanceDemoReadBuffer() {
+	DemoReadBuffer * buffer = &demo_read_buffers[ demo_read_current ];
+	if( demo_read_cursor < buffer->len )
+		return true;
+
+	// a short read means we hit the end of the file
+	if( buffer->len < sizeof( buffer->data ) )
+		return false;
+
+	QueueDemoRead( buffer );
+	demo_read_current = ( demo_read_current + 1 ) % ARRAY_COUNT( demo_read_buffers );
+	demo_read_cursor = 0;
+	return true;
+}
+
+/*
+ * server demos are zstd, which we decompress straight out of the read-ahead
+ * buffers. gzipped demos get decompressed by FS_Read on the I/O thread
+ */
+static ZSTD_DStream * demo_dstream;
+
+static size_t DecompressDemoBytes( void * dst, size_t n ) {
+	ZSTD_outBuffer output = { dst, n, 0 };
+	while( output.pos < output.size ) {
+		DemoReadBuffer * buffer = WaitForDemoReadBuffer();
+		ZSTD_inBuffer input = { buffer->data, buffer->len, demo_read_cursor };
+		size_t before = output.pos;
+
+		size_t r = ZSTD_decompressStream( demo_dstream, &output, &input );
+		if( ZSTD_isError( r ) ) {
+			Com_Printf( S_COLOR_RED "Can't decompress demo: %s\n", ZSTD_getErrorName( r ) );
+			break;
+		}
+		demo_read_cursor = input.pos;
+
+		// zstd can still have output to flush with no input left
+		if( !AdvanceDemoReadBuffer() && output.pos == before )
+			break;
+	}
+
+	return output.pos;
+}
+
+static size_t ReadDemoBytes( void * dst, size_t n ) {
+	if( demo_dstream != NULL ) {
+		return DecompressDemoBytes( dst, n );
+	}
+
+	size_t copied = 0;
+	while( copied < n ) {
+		DemoReadBuffer * buffer = WaitForDemoReadBuffer();
+
+		size_t chunk = Min2( n - copied, buffer->len - demo_read_cursor );
+		memcpy( ( u8 * ) dst + copied, buffer->data + demo_read_cursor, chunk );
+		copied += chunk;
+		demo_read_cursor += chunk;
+
+		if( !AdvanceDemoReadBuffer() )
+			break;
+	}
+
+	return copied;
+}
+
+static void SeekDemo( int offset ) {
+	demofilelen = demofilelentotal;
+	AsyncIOFlush();
+	FS_Seek( demofilehandle, offset, FS_SEEK_SET );
+	if( demo_dstream != NULL ) {
+		ZSTD_DCtx_reset( demo_dstream, ZSTD_reset_session_only );
+	}
+	StartDemoReadAhead();
+}
+
 /*
 * CL_DemoCompleted
 *
@@ -203,11 +371,15 @@ static int demofilelen, demofilelentotal;
 */
 void CL_DemoCompleted() {
 	if( demofilehandle ) {
+		AsyncIOFlush();
 		FS_FCloseFile( demofilehandle );
 		demofilehandle = 0;
 	}
 	demofilelen = demofilelentotal = 0;
 
+	ZSTD_freeDStream( demo_dstream );
+	demo_dstream = NULL;
+
 	cls.demo.playing = false;
 	cls.demo.basetime = cls.demo.duration = cls.demo.time = 0;
 	Mem_ZoneFree( cls.demo.filename );
@@ -245,12 +417,30 @@ static void CL_ReadDemoMessage() {
 		init = false;
 	}
 
-	read = SNAP_ReadDemoMessage( demofilehandle, &demomsg );
-	if( read == -1 ) {
+	// same as SNAP_ReadDemoMessage but out of the read-ahead buffers
+	int msglen = -1;
+	ReadDemoBytes( &msglen, 4 );
+	msglen = LittleLong( msglen );
+	if( msglen == -1 ) {
 		CL_Disconnect( NULL );
 		return;
 	}
 
+	if( msglen > MAX_MSGLEN ) {
+		Com_Error( "Error reading demo file: msglen > MAX_MSGLEN" );
+	}
+	if( (size_t )msglen > demomsg.maxsize ) {
+		Com_Error( "Error reading demo file: msglen > msg->maxsize" );
+	}
+
+	read = int( ReadDemoBytes( demomsg.data, msglen ) );
+	if( read != msglen ) {
+		Com_Error( "Error reading demo file: End of file" );
+	}
+
+	demomsg.cursize = msglen;
+	demomsg.readcount = 0;
+
 	CL_ParseServerMessage( &demomsg );
 }
 
@@ -275,6 +465,42 @@ void CL_ReadDemoPackets() {
 	cls.demo.play_jump = false;
 }
 
+/*
+* LoadDemoKeyframes
+*
+* Demos from before keyframes or that weren't stopped cleanly don't
+* have any, and jumps go back to reading from the start
+*/
+static void LoadDemoKeyframes() {
+	if( cls.demo.keyframes_loaded ) {
+		return;
+	}
+	cls.demo.keyframes_loaded = true;
+
+	const char *offset = SNAP_GetDemoMetaValue( cls.demo.meta_data, cls.demo.meta_data_realsize, "keyframes" );
+	if( offset == NULL || atoi( offset ) <= 0 ) {
+		return;
+	}
+
+	AsyncIOFlush();
+	int pos = FS_Tell( demofilehandle );
+	cls.demo.num_keyframes = SNAP_ReadDemoKeyframes( demofilehandle, atoi( offset ), cls.demo.keyframes, SNAP_MAX_DEMO_KEYFRAMES );
+	FS_Seek( demofilehandle, pos, FS_SEEK_SET );
+}
+
+/*
+* FindDemoKeyframe
+*
+* The last keyframe at or before serverTime
+*/
+static const DemoKeyframe *FindDemoKeyframe( int64_t serverTime ) {
+	const DemoKeyframe *best = NULL;
+	for( int i = 0; i < cls.demo.num_keyframes && cls.demo.keyframes[i].server_time <= serverTime; i++ ) {
+		best = &cls.demo.keyframes[i];
+	}
+	return best;
+}
+
 /*
 * CL_LatchedDemoJump
 *
@@ -293,9 +519,17 @@ void CL_LatchedDemoJump() {
 
 	CL_AdjustServerTime( 1 );
 
-	if( cl.serverTime < cl.snapShots[cl.receivedSnapNum & UPDATE_MASK].serverTime ) {
-		demofilelen = demofilelentotal;
-		FS_Seek( demofilehandle, 0, FS_SEEK_SET );
+	LoadDemoKeyframes();
+
+	// forwards it's only worth seeking if we skip past what we've read already
+	int64_t receivedTime = cl.snapShots[cl.receivedSnapNum & UPDATE_MASK].serverTime;
+	const DemoKeyframe *keyframe = FindDemoKeyframe( cl.serverTime );
+	if( keyframe != NULL && ( cl.serverTime < receivedTime || keyframe->server_time > receivedTime ) ) {
+		SeekDemo( keyframe->offset );
+		cls.lastExecutedServerCommand = keyframe->reliable_sequence;
+		cl.currentSnapNum = cl.receivedSnapNum = 0;
+	} else if( cl.serverTime < receivedTime ) {
+		SeekDemo( 0 );
 		cl.currentSnapNum = cl.receivedSnapNum = 0;
 	}
 
@@ -306,7 +540,7 @@ void CL_LatchedDemoJump() {
 /*
 * CL_StartDemo
 */
-static void CL_StartDemo( const char *demoname, bool yolo ) {
+void CL_StartDemo( const char *demoname, bool yolo ) {
 	size_t name_size;
 	char *name, *servername;
 	const char *filename = NULL;
@@ -326,15 +560,17 @@ static void CL_StartDemo( const char *demoname, bool yolo ) {
 		filename = name;
 	}
 
+	bool absolute = false;
 	if( filename ) {
-		tempdemofilelen = FS_FOpenBaseFile( filename, &tempdemofilehandle, FS_READ | SNAP_DEMO_GZ );  // open the demo file
+		tempdemofilelen = FS_FOpenBaseFile( filename, &tempdemofilehandle, FS_READ );  // open the demo file
 	}
 
 	if( !tempdemofilehandle ) {
 		// relative filename didn't work, try launching a demo from absolute path
 		snprintf( name, name_size, "%s", servername );
 		COM_DefaultExtension( name, APP_DEMO_EXTENSION_STR, name_size );
-		tempdemofilelen = FS_FOpenAbsoluteFile( name, &tempdemofilehandle, FS_READ | SNAP_DEMO_GZ );
+		tempdemofilelen = FS_FOpenAbsoluteFile( name, &tempdemofilehandle, FS_READ );
+		absolute = true;
 	}
 
 	if( !tempdemofilehandle ) {
@@ -345,6 +581,16 @@ static void CL_StartDemo( const char *demoname, bool yolo ) {
 		return;
 	}
 
+	bool zstd = SNAP_IsZstdDemo( tempdemofilehandle );
+	if( !zstd ) {
+		FS_FCloseFile( tempdemofilehandle );
+		if( absolute ) {
+			tempdemofilelen = FS_FOpenAbsoluteFile( name, &tempdemofilehandle, FS_READ | SNAP_DEMO_GZ );
+		} else {
+			tempdemofilelen = FS_FOpenBaseFile( name, &tempdemofilehandle, FS_READ | SNAP_DEMO_GZ );
+		}
+	}
+
 	// make sure a local server is killed
 	Cbuf_ExecuteText( EXEC_NOW, "killserver\n" );
 	CL_Disconnect( NULL );
@@ -355,6 +601,21 @@ static void CL_StartDemo( const char *demoname, bool yolo ) {
 	demofilelentotal = tempdemofilelen;
 	demofilelen = demofilelentotal;
 
+	if( zstd ) {
+		// the meta data and keyframes are in the trailer rather than svc_demoinfo
+		SNAP_ReadDemoTrailer( demofilehandle, cls.demo.meta_data, sizeof( cls.demo.meta_data ), &cls.demo.meta_data_realsize,
+			cls.demo.keyframes, SNAP_MAX_DEMO_KEYFRAMES, &cls.demo.num_keyframes );
+		cls.demo.keyframes_loaded = true;
+		FS_Seek( demofilehandle, 0, FS_SEEK_SET );
+
+		demo_dstream = ZSTD_createDStream();
+		if( demo_dstream == NULL ) {
+			Fatal( "ZSTD_createDStream" );
+		}
+	}
+
+	StartDemoReadAhead();
+
 	cls.servername = ZoneCopyString( COM_FileBase( servername ) );
 	COM_StripExtension( cls.servername );
 
@@ -511,17 +772,29 @@ size_t CL_ReadDemoMetaData( const char *demopath, char *meta_data, size_t meta_d
 		snprintf( name, name_size, "demos/%s", servername );
 		COM_DefaultExtension( name, APP_DEMO_EXTENSION_STR, name_size );
 
-		demolength = FS_FOpenFile( name, &demofile, FS_READ | SNAP_DEMO_GZ );
+		bool absolute = false;
+		demolength = FS_FOpenBaseFile( name, &demofile, FS_READ );
 
 		if( !demofile || demolength < 1 ) {
 			// relative filename didn't work, try launching a demo from absolute path
 			snprintf( name, name_size, "%s", servername );
 			COM_DefaultExtension( name, APP_DEMO_EXTENSION_STR, name_size );
 			demolength = FS_FOpenAbsoluteFile( name, &demofile, FS_READ );
+			absolute = true;
 		}
 
 		if( demolength > 0 ) {
-			meta_data_realsize = SNAP_ReadDemoMetaData( demofile, meta_data, meta_data_size );
+			if( SNAP_IsZstdDemo( demofile ) ) {
+				SNAP_ReadDemoTrailer( demofile, meta_data, meta_data_size, &meta_data_realsize, NULL, 0, NULL );
+			} else {
+				FS_FCloseFile( demofile );
+				if( absolute ) {
+					FS_FOpenAbsoluteFile( name, &demofile, FS_READ | SNAP_DEMO_GZ );
+				} else {
+					FS_FOpenBaseFile( name, &demofile, FS_READ | SNAP_DEMO_GZ );
+				}
+				meta_data_realsize = SNAP_ReadDemoMetaData( demofile, meta_data, meta_data_size );
+			}
 		}
 		FS_FCloseFile( demofile );
 
@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "client/client.h"
 #include "cgame/cg_local.h"
 #include "qcommon/cmodel.h"
+#include "qcommon/load_profile.h"
 #include "qcommon/version.h"
 
 static cgame_export_t *cge;
@@ -67,6 +68,8 @@ void CL_GetCurrentState( int64_t *incomingAcknowledged, int64_t *outgoingSequenc
 }
 
 void CL_GameModule_Init() {
+	LoadProfileScoped( "CG_Init" );
+
 	// stop all playing sounds
 	S_StopAllSounds( true );
 
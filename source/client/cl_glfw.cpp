@@ -1,6 +1,7 @@
 #include "client/client.h"
 #include "client/icon.h"
 #include "client/renderer/renderer.h"
+#include "qcommon/zone_sampler.h"
 
 #include "glad/glad.h"
 
@@ -502,7 +503,7 @@ void GlfwInputFrame() {
 }
 
 void SwapBuffers() {
-	ZoneScoped;
+	ZoneScopedSampled( "SwapBuffers" );
 	glfwSwapBuffers( window );
 }
 
@@ -6,6 +6,7 @@
 #include "imgui/imgui_freetype.h"
 
 #include "qcommon/base.h"
+#include "qcommon/hash.h"
 #include "qcommon/string.h"
 #include "qcommon/utf8.h"
 #include "client/client.h"
@@ -15,6 +16,28 @@
 static Texture atlas_texture;
 static Material atlas_material;
 
+static cvar_t * r_showgpustats;
+
+/*
+ * every draw list gets packed into one vertex and index buffer. there's one
+ * of those per frame in flight and they take turns, so the one being
+ * written was last drawn from at least FRAMES_IN_FLIGHT frames ago
+ *
+ * static menus and the scoreboard give the same vertices frame after frame,
+ * so when the draw data hashes the same as the last upload we keep drawing
+ * from those buffers and skip the upload
+ */
+struct ImGuiBuffers {
+	Mesh mesh;
+	u32 vertex_capacity;
+	u32 index_capacity;
+};
+
+static ImGuiBuffers imgui_buffers[ FRAMES_IN_FLIGHT ];
+static u32 imgui_buffers_head;
+static u64 imgui_uploaded_hash;
+static bool imgui_uploaded;
+
 static ImFont * AddFontAsset( StringHash path, float pixel_size ) {
 	Span< const u8 > data = AssetBinary( path );
 	ImFontConfig config;
@@ -33,6 +56,8 @@ void CL_InitImGui() {
 	ImGui::CreateContext();
 	ImGui_ImplGlfw_InitForOpenGL( window, false );
 
+	r_showgpustats = Cvar_Get( "r_showgpustats", "0", CVAR_ARCHIVE );
+
 	ImGuiIO & io = ImGui::GetIO();
 
 	{
@@ -133,10 +158,73 @@ void CL_InitImGui() {
 void CL_ShutdownImGui() {
 	DeleteTexture( atlas_texture );
 
+	for( ImGuiBuffers & buffers : imgui_buffers ) {
+		DeleteMesh( buffers.mesh );
+		buffers = { };
+	}
+	imgui_uploaded = false;
+
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
 }
 
+static void GrowImGuiBuffers( ImGuiBuffers * buffers, u32 num_vertices, u32 num_indices ) {
+	if( buffers->vertex_capacity >= num_vertices && buffers->index_capacity >= num_indices )
+		return;
+
+	DeferDeleteMesh( buffers->mesh );
+
+	buffers->vertex_capacity = Max2( num_vertices, buffers->vertex_capacity * 2 );
+	buffers->index_capacity = Max2( num_indices, buffers->index_capacity * 2 );
+
+	MeshConfig config;
+	config.name = "ImGui";
+	config.unified_buffer = NewVertexBuffer( buffers->vertex_capacity * sizeof( ImDrawVert ) );
+	config.positions_offset = offsetof( ImDrawVert, pos );
+	config.tex_coords_offset = offsetof( ImDrawVert, uv );
+	config.colors_offset = offsetof( ImDrawVert, col );
+	config.positions_format = VertexFormat_Floatx2;
+	config.stride = sizeof( ImDrawVert );
+	config.indices = NewIndexBuffer( buffers->index_capacity * sizeof( ImDrawIdx ) );
+	buffers->mesh = NewMesh( config );
+}
+
+static const ImGuiBuffers * UploadDrawData( const ImDrawData * draw_data ) {
+	ZoneScoped;
+
+	u64 hash = Hash64( u64( draw_data->CmdListsCount ) );
+	for( int n = 0; n < draw_data->CmdListsCount; n++ ) {
+		const ImDrawList * cmd_list = draw_data->CmdLists[ n ];
+		hash = Hash64( cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof( ImDrawVert ), hash );
+		hash = Hash64( cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof( ImDrawIdx ), hash );
+		hash = Hash64( hash ^ ( u64( cmd_list->VtxBuffer.Size ) << 32 | u64( cmd_list->IdxBuffer.Size ) ) );
+	}
+
+	if( imgui_uploaded && hash == imgui_uploaded_hash ) {
+		return &imgui_buffers[ imgui_buffers_head ];
+	}
+
+	imgui_buffers_head = ( imgui_buffers_head + 1 ) % ARRAY_COUNT( imgui_buffers );
+	ImGuiBuffers * buffers = &imgui_buffers[ imgui_buffers_head ];
+
+	GrowImGuiBuffers( buffers, draw_data->TotalVtxCount, draw_data->TotalIdxCount );
+
+	u32 vertex_offset = 0;
+	u32 index_offset = 0;
+	for( int n = 0; n < draw_data->CmdListsCount; n++ ) {
+		const ImDrawList * cmd_list = draw_data->CmdLists[ n ];
+		WriteVertexBuffer( buffers->mesh.positions, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof( ImDrawVert ), vertex_offset * sizeof( ImDrawVert ) );
+		WriteIndexBuffer( buffers->mesh.indices, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof( ImDrawIdx ), index_offset * sizeof( ImDrawIdx ) );
+		vertex_offset += cmd_list->VtxBuffer.Size;
+		index_offset += cmd_list->IdxBuffer.Size;
+	}
+
+	imgui_uploaded_hash = hash;
+	imgui_uploaded = true;
+
+	return buffers;
+}
+
 static void SubmitDrawCalls() {
 	ZoneScoped;
 
@@ -149,26 +237,19 @@ static void SubmitDrawCalls() {
 		return;
 	draw_data->ScaleClipRects( io.DisplayFramebufferScale );
 
+	if( draw_data->TotalVtxCount == 0 )
+		return;
+
+	const Mesh & mesh = UploadDrawData( draw_data )->mesh;
+
 	u32 pass = 0;
+	u32 vertex_offset = 0;
+	u32 index_offset = 0;
 
 	ImVec2 pos = draw_data->DisplayPos;
 	for( int n = 0; n < draw_data->CmdListsCount; n++ ) {
-		TempAllocator temp = cls.frame_arena.temp();
-
 		const ImDrawList * cmd_list = draw_data->CmdLists[ n ];
 
-		MeshConfig config;
-		config.name = temp( "ImGui - {}", n );
-		config.unified_buffer = NewVertexBuffer( cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof( ImDrawVert ) );
-		config.positions_offset = offsetof( ImDrawVert, pos );
-		config.tex_coords_offset = offsetof( ImDrawVert, uv );
-		config.colors_offset = offsetof( ImDrawVert, col );
-		config.positions_format = VertexFormat_Floatx2;
-		config.stride = sizeof( ImDrawVert );
-		config.indices = NewIndexBuffer( cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof( u16 ) );
-		Mesh mesh = NewMesh( config );
-		DeferDeleteMesh( mesh );
-
 		for( int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++ ) {
 			const ImDrawCmd * pcmd = &cmd_list->CmdBuffer[ cmd_i ];
 			if( pcmd->UserCallback ) {
@@ -195,20 +276,24 @@ static void SubmitDrawCalls() {
 					pipeline.scissor.w = scissor.maxs.x - scissor.mins.x;
 					pipeline.scissor.h = scissor.maxs.y - scissor.mins.y;
 
-					pipeline.set_uniform( "u_View", frame_static.ortho_view_uniforms );
-					pipeline.set_uniform( "u_Model", frame_static.identity_model_uniforms );
-					pipeline.set_uniform( "u_Material", frame_static.identity_material_uniforms );
+					pipeline.set_uniform( UniformSlot_View, frame_static.ortho_view_uniforms );
+					pipeline.set_uniform( UniformSlot_Model, frame_static.identity_model_uniforms );
+					pipeline.set_uniform( UniformSlot_Material, frame_static.identity_material_uniforms );
 
-					if( pcmd->TextureId.uniform_name != EMPTY_HASH ) {
-						pipeline.set_uniform( pcmd->TextureId.uniform_name, pcmd->TextureId.uniform_block );
+					if( pcmd->TextureId.uniform_slot != UniformSlot_None ) {
+						pipeline.set_uniform( pcmd->TextureId.uniform_slot, pcmd->TextureId.uniform_block );
 					}
 
-					pipeline.set_texture( "u_BaseTexture", pcmd->TextureId.material->texture );
+					TouchTexture( pcmd->TextureId.material->texture );
+					pipeline.set_texture( TextureSlot_BaseTexture, pcmd->TextureId.material->texture );
 
-					DrawMesh( mesh, pipeline, pcmd->ElemCount, pcmd->IdxOffset * sizeof( ImDrawIdx ) );
+					DrawMesh( mesh, pipeline, pcmd->ElemCount, ( index_offset + pcmd->IdxOffset ) * sizeof( ImDrawIdx ), vertex_offset );
 				}
 			}
 		}
+
+		vertex_offset += cmd_list->VtxBuffer.Size;
+		index_offset += cmd_list->IdxBuffer.Size;
 	}
 }
 
@@ -219,11 +304,36 @@ void CL_ImGuiBeginFrame() {
 	ImGui::NewFrame();
 }
 
+static void DrawGPUStats() {
+	if( r_showgpustats->integer == 0 )
+		return;
+
+	Span< const GPUPassTime > passes = GPUPassTimes();
+
+	ImGui::SetNextWindowPos( ImVec2( frame_static.viewport_width - 8.0f, 8.0f ), ImGuiCond_Always, ImVec2( 1.0f, 0.0f ) );
+	ImGui::SetNextWindowBgAlpha( 0.5f );
+	ImGui::Begin( "gpustats", WindowZOrder_Stats, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing );
+
+	float total = 0.0f;
+	for( const GPUPassTime & pass : passes ) {
+		ImGui::Text( "%-28s %6.2fms", pass.name, pass.average_ms );
+		total += pass.average_ms;
+	}
+
+	ImGui::Separator();
+	ImGui::Text( "%-28s %6.2fms", "GPU", total );
+	ImGui::Text( "%-28s %6.2f", "Resolution scale", frame_static.resolution_scale );
+
+	ImGui::End();
+}
+
 void CL_ImGuiEndFrame() {
 	ZoneScoped;
 
 	// ImGui::ShowDemoWindow();
 
+	DrawGPUStats();
+
 	ImGuiContext * ctx = ImGui::GetCurrentContext();
 	std::stable_sort( ctx->Windows.begin(), ctx->Windows.end(),
 		[]( const ImGuiWindow * a, const ImGuiWindow * b ) {
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "cgame/cg_local.h"
 
 cvar_t *cl_ucmdMaxResend;
+cvar_t *cl_ucmdAdaptiveResend;
 
 cvar_t *cl_ucmdFPS;
 
@@ -65,6 +66,7 @@ void CL_UserInputFrame( int realMsec ) {
 */
 void CL_InitInput() {
 	cl_ucmdMaxResend =  Cvar_Get( "cl_ucmdMaxResend", "3", CVAR_ARCHIVE );
+	cl_ucmdAdaptiveResend = Cvar_Get( "cl_ucmdAdaptiveResend", "1", CVAR_ARCHIVE );
 	cl_ucmdFPS =        Cvar_Get( "cl_ucmdFPS", "62", CVAR_DEVELOPER );
 }
 
@@ -116,6 +118,28 @@ static void CL_RefreshUcmd( UserCommand *ucmd, int msec, bool ready ) {
 	ucmd->angles[2] = ANGLE2SHORT( cl.viewangles.z );
 }
 
+#define UCMD_RESEND_TARGET_LOSS 0.001f // chance every copy of a ucmd gets dropped
+
+/*
+* CL_UcmdMaxResend
+*
+* cl_ucmdMaxResend is the floor. On lossy links send enough copies of each
+* ucmd that losing all of them is rare. We can't see which of our packets
+* arrive, only the server's, so assume the link loses as much going up as
+* it does coming down.
+*/
+static unsigned int CL_UcmdMaxResend() {
+	int resend = cl_ucmdMaxResend->integer;
+	if( !cl_ucmdAdaptiveResend->integer ) {
+		return resend;
+	}
+
+	float loss = Clamp( 0.01f, cls.netchan.loss, 0.9f );
+	int copies = int( ceilf( logf( UCMD_RESEND_TARGET_LOSS ) / logf( loss ) ) );
+
+	return Clamp( resend, copies - 1, int( CMD_BACKUP / 2 ) );
+}
+
 /*
 * CL_WriteUcmdsToMessage
 */
@@ -145,9 +169,7 @@ void CL_WriteUcmdsToMessage( msg_t *msg ) {
 	} else {
 		resendCount = ( cls.ucmdSent + 1 ) - ucmdFirst;
 	}
-	if( resendCount > (unsigned int)cl_ucmdMaxResend->integer ) {
-		resendCount = (unsigned int)cl_ucmdMaxResend->integer;
-	}
+	resendCount = Min2( resendCount, CL_UcmdMaxResend() );
 
 	if( ucmdFirst > ucmdHead ) {
 		ucmdFirst = ucmdHead;
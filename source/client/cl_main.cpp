@@ -21,16 +21,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qcommon/base.h"
 #include "client/client.h"
 #include "client/assets.h"
+#include "client/demo_video.h"
+#include "client/timedemo.h"
 #include "client/downloads.h"
-#include "client/threadpool.h"
+#include "qcommon/async_io.h"
+#include "qcommon/threadpool.h"
 #include "client/renderer/renderer.h"
-#include "qcommon/compression.h"
 #include "qcommon/csprng.h"
 #include "qcommon/hash.h"
 #include "qcommon/fs.h"
 #include "qcommon/livepp.h"
+#include "qcommon/load_profile.h"
 #include "qcommon/string.h"
 #include "qcommon/version.h"
+#include "qcommon/zone_sampler.h"
 #include "gameshared/gs_public.h"
 
 cvar_t *rcon_client_password;
@@ -38,11 +42,14 @@ cvar_t *rcon_address;
 
 cvar_t *cl_timeout;
 cvar_t *cl_maxfps;
+static cvar_t *cl_lowlatency;
+static cvar_t *cl_asset_budget;
 cvar_t *cl_pps;
 cvar_t *cl_shownet;
 
 cvar_t *cl_extrapolationTime;
 cvar_t *cl_extrapolate;
+cvar_t *cl_interpolationDelay;
 
 static cvar_t *cl_hotloadAssets;
 
@@ -60,7 +67,7 @@ cvar_t *cl_devtools;
 client_static_t cls;
 client_state_t cl;
 
-SyncEntityState cl_baselines[MAX_EDICTS];
+SyncEntityState cl_baselines[MAX_BASELINES];
 
 static bool cl_initialized = false;
 
@@ -175,8 +182,8 @@ static void CL_SendConnectPacket() {
 	userinfo_modified = false;
 
 	TempAllocator temp = cls.frame_arena.temp();
-	Netchan_OutOfBandPrint( cls.socket, &cls.serveraddress, "%s", temp( "connect {} {} {} \"{}\"\n",
-							APP_PROTOCOL_VERSION, Netchan_ClientSessionID(), cls.challenge, Cvar_Userinfo() ) );
+	Netchan_OutOfBandPrint( cls.socket, &cls.serveraddress, "%s", temp( "connect {} {} {} \"{}\" {}\n",
+							APP_PROTOCOL_VERSION, Netchan_ClientSessionID(), cls.challenge, Cvar_Userinfo(), Netchan_CompressionOffer() ) );
 }
 
 /*
@@ -424,7 +431,23 @@ void CL_ResetServerCount() {
 	cl.servercount = -1;
 }
 
+/*
+* CL_ClearConfigstrings
+*/
+void CL_ClearConfigstrings() {
+	// the server always sets CS_HOSTNAME, so this skips tables that are already cleared
+	if( !cls.demo.playing && cl.configstrings[CS_HOSTNAME][0] != '\0' ) {
+		memcpy( cls.cached_configstrings, cl.configstrings, sizeof( cls.cached_configstrings ) );
+		cls.cached_configstrings_address = cls.serveraddress;
+		cls.have_cached_configstrings = true;
+	}
+
+	memset( cl.configstrings, 0, sizeof( cl.configstrings ) );
+}
+
 void CL_ClearState() {
+	CL_ClearConfigstrings();
+
 	// wipe the entire cl structure
 	memset( &cl, 0, sizeof( client_state_t ) );
 	memset( cl_baselines, 0, sizeof( cl_baselines ) );
@@ -484,7 +507,7 @@ static void CL_Disconnect_SendCommand() {
 * This is also called on Com_Error, so it shouldn't cause any errors
 */
 void CL_Disconnect( const char *message ) {
-	CancelDownload(); // TODO: maybe shouldn't cancel when downloading a demo
+	CL_CancelDownloads(); // TODO: maybe shouldn't cancel when downloading a demo
 
 	if( cls.state == CA_UNINITIALIZED ) {
 		return;
@@ -554,7 +577,7 @@ void CL_Changing_f() {
 
 	Com_DPrintf( "CL:Changing\n" );
 
-	memset( cl.configstrings, 0, sizeof( cl.configstrings ) );
+	CL_ClearConfigstrings();
 
 	// ignore snapshots from previous connection
 	cl.pendingSnapNum = cl.currentSnapNum = cl.receivedSnapNum = 0;
@@ -577,7 +600,7 @@ void CL_ServerReconnect_f() {
 		return;
 	}
 
-	CancelDownload();
+	CL_CancelDownloads();
 
 	if( cls.demo.recording ) {
 		CL_Stop_f();
@@ -593,7 +616,7 @@ void CL_ServerReconnect_f() {
 
 	cls.connect_time = Sys_Milliseconds() - 1500;
 
-	memset( cl.configstrings, 0, sizeof( cl.configstrings ) );
+	CL_ClearConfigstrings();
 	CL_SetClientState( CA_HANDSHAKE );
 	CL_AddReliableCommand( "new" );
 }
@@ -697,7 +720,8 @@ static void CL_ConnectionlessPacket( const socket_t *socket, const netadr_t *add
 		Q_strncpyz( cls.session, MSG_ReadStringLine( msg ), sizeof( cls.session ) );
 
 		Netchan_Setup( &cls.netchan, socket, address, Netchan_ClientSessionID() );
-		memset( cl.configstrings, 0, sizeof( cl.configstrings ) );
+		cls.netchan.compression = Netchan_NegotiateCompression( MSG_ReadStringLine( msg ) );
+		CL_ClearConfigstrings();
 		CL_SetClientState( CA_HANDSHAKE );
 		CL_AddReliableCommand( "new" );
 		return;
@@ -834,7 +858,7 @@ static bool CL_ProcessPacket( netchan_t *netchan, msg_t *msg ) {
 	MSG_ReadInt32( msg ); // sequence
 	MSG_ReadInt32( msg ); // sequence_ack
 	if( msg->compressed ) {
-		zerror = Netchan_DecompressMessage( msg );
+		zerror = Netchan_DecompressMessage( netchan, msg );
 		if( zerror < 0 ) {
 			// compression error. Drop the packet
 			Com_Printf( "CL_ProcessPacket: Compression error %i. Dropping packet\n", zerror );
@@ -948,18 +972,10 @@ void CL_FinishConnect() {
 	CL_AddReliableCommand( va( "begin %i\n", precache_spawncount ) );
 }
 
-static bool AddDownloadedMap( const char * filename, Span< const u8 > compressed ) {
-	if( compressed.ptr == NULL )
+static bool AddDownloadedMap( const char * filename, Span< const u8 > data ) {
+	if( data.ptr == NULL )
 		return false;
 
-	Span< u8 > data;
-	defer { FREE( sys_allocator, data.ptr ); };
-
-	if( !Decompress( filename, sys_allocator, compressed, &data ) ) {
-		Com_Printf( "Downloaded map is corrupt.\n" );
-		return false;
-	}
-
 	if( !AddMap( data, filename + strlen( "base/" ) ) ) {
 		Com_Printf( "Downloaded map is corrupt.\n" );
 		return false;
@@ -993,6 +1009,8 @@ void CL_Precache_f() {
 	const char * mapname = Cmd_Argv( 2 );
 	u64 hash = Hash64( mapname, strlen( mapname ), Hash64( "maps/" ) );
 
+	PrefetchMapAssets( mapname );
+
 	if( FindMap( StringHash( hash ) ) == NULL ) {
 		TempAllocator temp = cls.frame_arena.temp();
 		CL_DownloadFile( temp( "base/maps/{}.bsp.zst", Cmd_Argv( 2 ) ), []( const char * filename, Span< const u8 > data ) {
@@ -1010,6 +1028,24 @@ void CL_Precache_f() {
 	CL_FinishConnect();
 }
 
+/*
+ * config.cfg gets written CONFIG_WRITE_DELAY after the last change to a bind
+ * or archived cvar, so dragging a slider around in the settings doesn't
+ * write it every frame, and the write happens on the async I/O thread. we
+ * also skip writes that wouldn't change anything
+ */
+#define CONFIG_WRITE_DELAY 1000
+
+static u64 last_written_config_hash;
+static int64_t config_write_time;
+
+static void ConfigWritten( void * user, const char * path, bool ok ) {
+	if( !ok ) {
+		Com_Printf( "Couldn't write %s.\n", path );
+		last_written_config_hash = 0;
+	}
+}
+
 static void CL_WriteConfiguration() {
 	TempAllocator temp = cls.frame_arena.temp();
 
@@ -1021,9 +1057,26 @@ static void CL_WriteConfiguration() {
 	config += "\r\n// variables\r\n";
 	Cvar_WriteVariables( &config );
 
+	u64 hash = Hash64( config.c_str(), config.length() );
+	if( hash == last_written_config_hash )
+		return;
+	last_written_config_hash = hash;
+
 	DynamicString path( &temp, "{}/base/config.cfg", HomeDirPath() );
-	if( !WriteFile( &temp, path.c_str(), config.c_str(), config.length() ) ) {
-		Com_Printf( "Couldn't write %s.\n", path.c_str() );
+	Span< u8 > data = ALLOC_SPAN( sys_allocator, u8, config.length() );
+	memcpy( data.ptr, config.c_str(), config.length() );
+	AsyncWriteFile( path.c_str(), data, ConfigWritten );
+}
+
+static void CL_WriteModifiedConfiguration() {
+	if( config_modified ) {
+		config_modified = false;
+		config_write_time = cls.monotonicTime + CONFIG_WRITE_DELAY;
+	}
+
+	if( config_write_time != 0 && cls.monotonicTime >= config_write_time ) {
+		config_write_time = 0;
+		CL_WriteConfiguration();
 	}
 }
 
@@ -1081,10 +1134,13 @@ static void CL_InitLocal() {
 	Com_SetClientState( CA_DISCONNECTED );
 
 	cl_maxfps = Cvar_Get( "cl_maxfps", "250", CVAR_ARCHIVE );
+	cl_lowlatency = Cvar_Get( "cl_lowlatency", "1", CVAR_ARCHIVE );
+	cl_asset_budget = Cvar_Get( "cl_asset_budget", "256", CVAR_ARCHIVE );
 	cl_pps = Cvar_Get( "cl_pps", "40", CVAR_ARCHIVE );
 
 	cl_extrapolationTime = Cvar_Get( "cl_extrapolationTime", "0", CVAR_DEVELOPER );
 	cl_extrapolate = Cvar_Get( "cl_extrapolate", "1", CVAR_ARCHIVE );
+	cl_interpolationDelay = Cvar_Get( "cl_interpolationDelay", "-1", CVAR_ARCHIVE );
 
 	cl_hotloadAssets = Cvar_Get( "cl_hotloadAssets", is_public_build ? "0" : "1", CVAR_ARCHIVE );
 
@@ -1176,6 +1232,17 @@ void CL_AdjustServerTime( unsigned int gameMsec ) {
 
 	cl.serverTime = cls.gametime + cl.serverTimeDelta;
 
+	// if snapshots stop coming don't run off into the future, hold at a
+	// snapshot past the newest one and let the delta catch up when they resume
+	cl.extrapolatedTime = 0;
+	if( !cls.demo.playing && cl.receivedSnapNum > 0 ) {
+		int extrapolation = cl_extrapolate->integer ? cl_extrapolationTime->integer : 0;
+		int64_t newest = cl.snapShots[cl.receivedSnapNum & UPDATE_MASK].serverTime;
+
+		cl.extrapolatedTime = Max2( int64_t( 0 ), cl.serverTime - extrapolation - newest );
+		cl.serverTime = Min2( cl.serverTime, newest + extrapolation + cl.snapFrameTime );
+	}
+
 	// it launches a new snapshot when the timestamp of the CURRENT snap is reached.
 	if( cl.pendingSnapNum && ( cl.serverTime >= cl.snapShots[cl.currentSnapNum & UPDATE_MASK].serverTime ) ) {
 		// fire next snapshot
@@ -1204,6 +1271,54 @@ void CL_RestartTimeDeltas( int newTimeDelta ) {
 	}
 }
 
+/*
+ * a steady connection delivers every snapshot the same time after the server
+ * made it, so running one snapshot behind is enough to always have the next
+ * one. with jitter some snapshots arrive late, so we run further behind by
+ * a couple of standard deviations of the arrival times, which covers nearly
+ * all of them without adding delay on connections that don't need it
+ */
+static constexpr float INTERPOLATION_JITTER_SCALE = 2.0f;
+
+void CL_AddSnapArrival( int64_t serverTime ) {
+	cl.snapArrivalOffsets[cl.numSnapArrivalOffsets % MAX_SNAP_JITTER_SAMPLES] = int( serverTime - cls.gametime );
+	cl.numSnapArrivalOffsets++;
+
+	int n = Min2( cl.numSnapArrivalOffsets, MAX_SNAP_JITTER_SAMPLES );
+	if( n < 2 ) {
+		cl.snapJitter = 0.0f;
+		return;
+	}
+
+	double mean = 0.0;
+	for( int i = 0; i < n; i++ ) {
+		mean += cl.snapArrivalOffsets[i];
+	}
+	mean /= n;
+
+	double variance = 0.0;
+	for( int i = 0; i < n; i++ ) {
+		double d = cl.snapArrivalOffsets[i] - mean;
+		variance += d * d;
+	}
+	variance /= n - 1;
+
+	cl.snapJitter = sqrtf( float( variance ) );
+}
+
+static int CL_InterpolationDelay() {
+	if( cls.demo.playing ) {
+		return 0;
+	}
+
+	int max_delay = 2 * int( cl.snapFrameTime );
+	if( cl_interpolationDelay->integer >= 0 ) {
+		return Min2( cl_interpolationDelay->integer, max_delay );
+	}
+
+	return Clamp( 0, int( cl.snapJitter * INTERPOLATION_JITTER_SCALE + 0.5f ), max_delay );
+}
+
 int CL_SmoothTimeDeltas() {
 	int i, count;
 	double delta;
@@ -1262,6 +1377,9 @@ void CL_UpdateSnapshot() {
 
 			cl.newServerTimeDelta = CL_SmoothTimeDeltas();
 
+			cl.interpolationDelay = CL_InterpolationDelay();
+			cl.newServerTimeDelta -= cl.interpolationDelay;
+
 			if( cl_extrapolationTime->modified ) {
 				if( cl_extrapolationTime->integer > (int)cl.snapFrameTime - 1 ) {
 					Cvar_ForceSet( "cl_extrapolationTime", va( "%i", (int)cl.snapFrameTime - 1 ) );
@@ -1290,7 +1408,7 @@ void CL_Netchan_Transmit( msg_t *msg ) {
 	Netchan_PushAllFragments( &cls.netchan );
 
 	if( msg->cursize > 60 ) {
-		int zerror = Netchan_CompressMessage( msg );
+		int zerror = Netchan_CompressMessage( &cls.netchan, msg );
 		if( zerror < 0 ) { // it's compression error, just send uncompressed
 			Com_DPrintf( "CL_Netchan_Transmit (ignoring compression): Compression error %i\n", zerror );
 		}
@@ -1410,13 +1528,92 @@ static void CL_NetFrame( int realMsec, int gameMsec ) {
 	CL_ServerListFrame();
 }
 
+/*
+ * low latency frame pacing. rather than starting a frame as soon as
+ * cl_maxfps allows and letting it sit in the driver's queue, we start it as
+ * late as we can get away with so the input it samples is as fresh as
+ * possible when it hits the screen:
+ *
+ * - frames aim for deadlines spaced 1/maxfps apart
+ * - we predict how long it takes to go from sampling input to SwapBuffers
+ *   and don't start until that long before the deadline
+ * - we don't start until the GPU has finished the frame before last, so at
+ *   most one frame is ever queued behind the one we're recording
+ *
+ * while we wait we go back to the main loop, which keeps polling events, so
+ * the frame we do render samples input right before it starts
+ */
+
+// the main loop comes round once a millisecond
+static constexpr s64 FRAME_PACER_SLACK_NS = 1000 * 1000;
+
+struct FramePacer {
+	s64 deadline_ns;
+	s64 frame_start_ns;
+	float predicted_ms;
+};
+
+static FramePacer frame_pacer;
+
+constexpr u64 LATENCY_SAMPLES = 8;
+static u64 input_sample_ns[ LATENCY_SAMPLES ];
+
+static bool FramePacerReady( float interval_ms, s64 now ) {
+	u64 frame = FrameNumber();
+	if( frame >= 2 && !FrameFinished( frame - 2 ) )
+		return false;
+
+	s64 predicted_ns = s64( frame_pacer.predicted_ms * 1000000.0f );
+	if( now + predicted_ns + FRAME_PACER_SLACK_NS < frame_pacer.deadline_ns )
+		return false;
+
+	// if we fell way behind pick a new deadline instead of rushing out frames to catch up
+	s64 interval_ns = s64( interval_ms * 1000000.0f );
+	frame_pacer.deadline_ns = Max2( frame_pacer.deadline_ns, now + predicted_ns ) + interval_ns;
+	frame_pacer.frame_start_ns = now;
+
+	return true;
+}
+
+static void FramePacerFinishFrame() {
+	// don't count SwapBuffers, with vsync it blocks until the flip
+	float ms = ( s64( Sys_Nanoseconds() ) - frame_pacer.frame_start_ns ) / 1000000.0f;
+
+	// predict high quickly and back off slowly so we don't miss deadlines
+	float rate = ms > frame_pacer.predicted_ms ? 0.5f : 0.05f;
+	frame_pacer.predicted_ms = Lerp( frame_pacer.predicted_ms, rate, ms );
+	TracyPlot( "Frame pacer predicted ms", frame_pacer.predicted_ms );
+}
+
+static void UpdateInputLatency() {
+	GPUFrameFinish finish = LastGPUFrameFinish();
+	if( finish.finished_ns == 0 || FrameNumber() - finish.frame >= LATENCY_SAMPLES )
+		return;
+
+	static u64 last_measured_frame = U64_MAX;
+	if( finish.frame == last_measured_frame )
+		return;
+	last_measured_frame = finish.frame;
+
+	u64 input_ns = input_sample_ns[ finish.frame % LATENCY_SAMPLES ];
+	if( input_ns == 0 || input_ns > finish.finished_ns )
+		return;
+
+	float ms = ( finish.finished_ns - input_ns ) / 1000000.0f;
+	cls.input_latency = cls.input_latency == 0.0f ? ms : Lerp( cls.input_latency, 0.1f, ms );
+	TracyPlot( "Input latency", ms );
+}
+
 void CL_Frame( int realMsec, int gameMsec ) {
-	ZoneScoped;
+	ZoneScopedSampled( "CL_Frame" );
 
 	LivePPFrame();
 
 	TracyPlot( "Client frame arena max utilisation", cls.frame_arena.max_utilisation() );
-	cls.frame_arena.clear();
+	ThreadPoolPlotArenas();
+	if( cls.frame_arena.flip() ) {
+		Com_DPrintf( "Client frame arena overflowed, high water mark %" PRIuPTR "k\n", uintptr_t( cls.frame_arena.high_water_mark() / 1024 ) );
+	}
 
 	u64 entropy[ 2 ];
 	CSPRNG( entropy, sizeof( entropy ) );
@@ -1441,13 +1638,19 @@ void CL_Frame( int realMsec, int gameMsec ) {
 		}
 	}
 
+	// every frame is one video frame while capturing, however long it takes
+	if( DemoVideoCapturing() && !cls.demo.paused ) {
+		gameMsec = DemoVideoFrameMsec();
+	}
+	else if( TimedemoRunning() && !cls.demo.paused ) {
+		gameMsec = TimedemoFrameMsec();
+	}
+
 	cls.gametime += gameMsec;
 
 	allRealMsec += realMsec;
 	allGameMsec += gameMsec;
 
-	DoneHotloadingAssets();
-
 	if( cl_hotloadAssets->integer != 0 ) {
 		static s64 last_hotload_time = 0;
 		static bool last_focused = true;
@@ -1455,12 +1658,15 @@ void CL_Frame( int realMsec, int gameMsec ) {
 		bool focused = IsWindowFocused();
 		bool just_became_focused = focused && !last_focused;
 
-		// hotload assets when the window regains focus or every 1 second when not focused
-		if( just_became_focused || ( !focused && cls.monotonicTime - last_hotload_time >= 1000 ) ) {
-			TempAllocator temp = cls.frame_arena.temp();
-			HotloadAssets( &temp );
+		TempAllocator temp = cls.frame_arena.temp();
 
-			last_hotload_time = cls.monotonicTime;
+		// if we can't watch for changes, rescan when the window regains focus
+		// or every 1 second when not focused
+		if( !PollHotloadAssets( &temp ) ) {
+			if( just_became_focused || ( !focused && cls.monotonicTime - last_hotload_time >= 1000 ) ) {
+				HotloadAssets( &temp );
+				last_hotload_time = cls.monotonicTime;
+			}
 		}
 
 		last_focused = focused;
@@ -1469,8 +1675,10 @@ void CL_Frame( int realMsec, int gameMsec ) {
 	CL_UpdateSnapshot();
 	CL_AdjustServerTime( gameMsec );
 	CL_UserInputFrame( realMsec );
+	s64 input_ns = s64( Sys_Nanoseconds() );
 	CL_NetFrame( realMsec, gameMsec );
 	PumpDownloads();
+	CL_WriteModifiedConfiguration();
 
 	const int absMinFps = 24;
 
@@ -1487,7 +1695,21 @@ void CL_Frame( int realMsec, int gameMsec ) {
 		roundingMsec -= (int)roundingMsec;
 	}
 
-	if( allRealMsec + extraMsec < minMsec ) {
+	bool frame_due;
+	if( cl_lowlatency->integer != 0 ) {
+		frame_due = FramePacerReady( 1000.0f / maxFps, input_ns );
+		extraMsec = 0;
+	}
+	else {
+		frame_due = allRealMsec + extraMsec >= minMsec;
+		frame_pacer.frame_start_ns = input_ns;
+	}
+
+	if( DemoVideoCapturing() || TimedemoRunning() ) {
+		frame_due = true;
+	}
+
+	if( !frame_due ) {
 		// let CPU sleep while minimized
 		bool sleep = cls.state == CA_DISCONNECTED || !IsWindowFocused();
 
@@ -1507,6 +1729,9 @@ void CL_Frame( int realMsec, int gameMsec ) {
 		extraMsec = Clamp( 0, allRealMsec - minMsec, 100 );
 	}
 
+	input_sample_ns[ FrameNumber() % LATENCY_SAMPLES ] = u64( input_ns );
+	UpdateInputLatency();
+
 	VID_CheckChanges();
 
 	// update the screen
@@ -1514,8 +1739,12 @@ void CL_Frame( int realMsec, int gameMsec ) {
 	GetFramebufferSize( &viewport_width, &viewport_height );
 	RendererBeginFrame( viewport_width, viewport_height );
 
+	TimedemoMark( TimedemoPhase_CGame );
 	SCR_UpdateScreen();
+	TimedemoMark( TimedemoPhase_Submit );
 	RendererSubmitFrame();
+	TimedemoFrame();
+	DemoVideoFrame();
 
 	// update audio
 	if( cls.state != CA_ACTIVE ) {
@@ -1527,19 +1756,28 @@ void CL_Frame( int realMsec, int gameMsec ) {
 
 	cl.prevviewangles = cl.viewangles;
 
+	// hotloaded assets can arrive from AsyncIOFrame on any frame, including
+	// ones we skip, so only forget about them once we've drawn one
+	DoneHotloadingAssets();
+
+	// MB of decompressed assets to keep around after they've been loaded
+	EvictAssets( size_t( Max2( cl_asset_budget->integer, 0 ) ) * 1024 * 1024 );
+
 	cls.framecount++;
 
+	FramePacerFinishFrame();
+
 	SwapBuffers();
 }
 
 void CL_Init() {
 	ZoneScoped;
+	LoadProfileScoped( "CL_Init" );
 
 	InitLivePP();
 
 	constexpr size_t frame_arena_size = 1024 * 1024; // 1MB
-	void * frame_arena_memory = ALLOC_SIZE( sys_allocator, frame_arena_size, 16 );
-	cls.frame_arena = ArenaAllocator( frame_arena_memory, frame_arena_size );
+	cls.frame_arena.init( sys_allocator, frame_arena_size );
 
 	u64 entropy[ 2 ];
 	CSPRNG( entropy, sizeof( entropy ) );
@@ -1563,6 +1801,11 @@ void CL_Init() {
 
 	ThreadPoolFinish();
 
+	// these only need the assets, so get them going on the thread pool
+	// while the renderer starts up
+	S_StartDecodingSounds();
+	StartImportingModels();
+
 	InitRenderer();
 	InitMaps();
 
@@ -1592,6 +1835,8 @@ void CL_Init() {
 	CL_InitInput();
 
 	InitDownloads();
+	InitDemoVideo();
+	InitTimedemo();
 
 	CL_InitImGui();
 	UI_Init();
@@ -1600,6 +1845,9 @@ void CL_Init() {
 
 	CL_InitServerList();
 
+	// everything so far came from config.cfg or is a default
+	config_modified = false;
+
 	Mem_DebugCheckSentinelsGlobal();
 }
 
@@ -1634,6 +1882,8 @@ void CL_Shutdown() {
 
 	CL_GameModule_Shutdown();
 	S_Shutdown();
+	ShutdownTimedemo();
+	ShutdownDemoVideo();
 	ShutdownMaps();
 	ShutdownRenderer();
 	DestroyWindow();
@@ -1651,5 +1901,5 @@ void CL_Shutdown() {
 	cls.state = CA_UNINITIALIZED;
 	cl_initialized = false;
 
-	FREE( sys_allocator, cls.frame_arena.get_memory() );
+	cls.frame_arena.shutdown();
 }
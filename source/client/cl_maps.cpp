@@ -3,10 +3,13 @@
 #include "qcommon/cmodel.h"
 #include "qcommon/compression.h"
 #include "qcommon/hashtable.h"
+#include "qcommon/load_profile.h"
 #include "qcommon/string.h"
+#include "qcommon/threadpool.h"
 #include "client/assets.h"
 #include "client/maps.h"
 #include "client/renderer/model.h"
+#include "client/renderer/renderer.h"
 #include "game/hotload_map.h"
 
 constexpr u32 MAX_MAPS = 128;
@@ -17,6 +20,7 @@ static u32 num_maps;
 static Hashtable< MAX_MAPS * 2 > maps_hashtable;
 
 static Hashtable< MAX_MAP_MODELS * 2 > map_models_hashtable;
+static bool map_models_dirty;
 
 static void DeleteMap( Map * map ) {
 	FREE( sys_allocator, const_cast< char * >( map->name ) );
@@ -27,6 +31,9 @@ static void DeleteMap( Map * map ) {
 bool AddMap( Span< const u8 > data, const char * path ) {
 	ZoneScoped;
 	ZoneText( path, strlen( path ) );
+	LoadProfileScoped( "AddMap" );
+
+	map_models_dirty = true;
 
 	u64 hash = Hash64( StripExtension( path ) );
 
@@ -41,12 +48,32 @@ bool AddMap( Span< const u8 > data, const char * path ) {
 
 	maps[ idx ].name = CopyString( sys_allocator, path );
 
+	// collision never touches the GPU, so it loads on the thread pool while
+	// the render data is built and uploaded here
+	struct CollisionLoadJob {
+		Span< const u8 > data;
+		u64 hash;
+		CollisionModel * cms;
+	};
+
+	CollisionLoadJob cm_job = { data, hash, NULL };
+	JobGroup cm_group;
+	ThreadPoolDo( &cm_group, []( TempAllocator * temp, void * data ) {
+		CollisionLoadJob * job = ( CollisionLoadJob * ) data;
+		job->cms = CM_ParseMap( job->data, job->hash );
+	}, &cm_job );
+
 	// TODO: need more map validation because they can be downloaded from the server
-	if( !LoadBSPRenderData( path, &maps[ idx ], hash, data ) ) {
+	bool render_ok = LoadBSPRenderData( path, &maps[ idx ], hash, data );
+
+	ThreadPoolWait( &cm_group );
+	CM_RegisterMap( CM_Client, cm_job.cms );
+	maps[ idx ].cms = cm_job.cms;
+
+	if( !render_ok ) {
 		return false;
 	}
 
-	maps[ idx ].cms = CM_LoadMap( CM_Client, data, hash );
 	if( maps[ idx ].cms == NULL ) {
 		// TODO: free render data
 		return false;
@@ -56,6 +83,7 @@ bool AddMap( Span< const u8 > data, const char * path ) {
 }
 
 static void FillMapModelsHashtable() {
+	map_models_dirty = false;
 	map_models_hashtable.clear();
 
 	for( u32 i = 0; i < num_maps; i++ ) {
@@ -72,6 +100,7 @@ static void FillMapModelsHashtable() {
 
 void InitMaps() {
 	ZoneScoped;
+	LoadProfileScoped( "InitMaps" );
 
 	num_maps = 0;
 
@@ -100,7 +129,14 @@ void HotloadMaps() {
 		hotloaded_anything = true;
 	}
 
-	FillMapModelsHashtable();
+	// downloaded maps go through AddMap too, so this isn't hotloaded_anything
+	if( map_models_dirty ) {
+		FillMapModelsHashtable();
+	}
+
+	if( hotloaded_anything ) {
+		InvalidateStaticShadows();
+	}
 
 	if( hotloaded_anything && Com_ServerState() != ss_dead ) {
 		G_HotloadMap();
@@ -124,6 +160,11 @@ const Map * FindMap( const char * name ) {
 	return FindMap( StringHash( name ) );
 }
 
+const CollisionModel * CL_FindMapCollisionModel( u64 base_hash ) {
+	const Map * map = FindMap( StringHash( base_hash ) );
+	return map == NULL ? NULL : map->cms;
+}
+
 const Model * FindMapModel( StringHash name ) {
 	u64 idx;
 	if( !map_models_hashtable.get( name.hash, &idx ) )
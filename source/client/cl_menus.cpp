@@ -3,6 +3,8 @@
 
 #include "client/client.h"
 #include "client/renderer/renderer.h"
+#include "qcommon/hash.h"
+#include "qcommon/hashtable.h"
 #include "qcommon/version.h"
 #include "qcommon/maplist.h"
 #include "qcommon/string.h"
@@ -59,8 +61,15 @@ struct Server {
 	int max_players;
 };
 
+/*
+ * servers never move around in servers, server_order is what gets sorted.
+ * when a server updates only its own row gets moved, so hundreds of ping
+ * replies coming in don't resort the whole list each time
+ */
 static Server servers[ 1024 ];
+static int server_order[ ARRAY_COUNT( servers ) ];
 static int num_servers = 0;
+static Hashtable< ARRAY_COUNT( servers ) * 2 > servers_by_address;
 
 static UIState uistate;
 
@@ -91,6 +100,7 @@ static void ResetServerBrowser() {
 	}
 
 	memset( servers, 0, sizeof( servers ) );
+	servers_by_address.clear();
 
 	num_servers = 0;
 	selected_server = -1;
@@ -240,6 +250,7 @@ static void SettingsGeneral() {
 	CvarCheckbox( "Show chat", "cg_chat", "1", CVAR_ARCHIVE );
 	CvarCheckbox( "Show hotkeys", "cg_showHotkeys", "1", CVAR_ARCHIVE );
 	CvarCheckbox( "Show FPS", "cg_showFPS", "0", CVAR_ARCHIVE );
+	CvarCheckbox( "Show latency", "cg_showLatency", "0", CVAR_ARCHIVE );
 	CvarCheckbox( "Show speed", "cg_showSpeed", "0", CVAR_ARCHIVE );
 }
 
@@ -522,6 +533,7 @@ static void SettingsVideo() {
 	}
 
 	CvarCheckbox( "Vsync", "vid_vsync", "0", CVAR_ARCHIVE );
+	CvarCheckbox( "Low latency", "cl_lowlatency", "1", CVAR_ARCHIVE );
 
 	CvarCheckbox( "Colorblind mode", "cg_colorBlind", "0", CVAR_ARCHIVE );
 }
@@ -630,7 +642,8 @@ static void ServerBrowser() {
 	ImGui::Text( "Ping" );
 	ImGui::NextColumn();
 
-	for( int i = 0; i < num_servers; i++ ) {
+	for( int j = 0; j < num_servers; j++ ) {
+		int i = server_order[ j ];
 		const char * name = servers[ i ].name != NULL ? servers[ i ].name : servers[ i ].address;
 		if( strstr( name, server_filter ) != NULL ) {
 			if( ImGui::Selectable( name, i == selected_server, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowDoubleClick ) ) {
@@ -863,13 +876,14 @@ static void GameMenuButton( const char * label, const char * command, bool * cli
 	}
 }
 
-static void WeaponTooltip( const WeaponDef * def ) {
+static void WeaponTooltip( WeaponType weapon ) {
 	if( ImGui::IsItemHovered() ) {
 		ImGui::BeginTooltip();
 
 		TempAllocator temp = cls.frame_arena.temp();
+		const WeaponDef * def = GS_GetWeaponDef( weapon );
 
-		ImGui::Text( "%s", temp( "{}Weapon: {}{}", ImGuiColorToken( 255, 200, 0, 255 ), ImGuiColorToken( 255, 255, 255, 255 ), def->name ) );
+		ImGui::Text( "%s", temp( "{}Weapon: {}{}", ImGuiColorToken( 255, 200, 0, 255 ), ImGuiColorToken( 255, 255, 255, 255 ), GetWeaponInfo( weapon )->name ) );
 		ImGui::Text( "%s", temp( "{}Type: {}{}", ImGuiColorToken( 255, 200, 0, 255 ), ImGuiColorToken( 255, 255, 255, 255 ), def->speed == 0 ? "Hitscan" : "Projectile" ) );
 		ImGui::Text( "%s", temp( "{}Damage: {}{}", ImGuiColorToken( 255, 200, 0, 255 ), ImGuiColorToken( 255, 255, 255, 255 ), int( def->damage * def->projectile_count ) ) );
 		char * reload = temp( "{.1}s", def->refire_time / 1000.f );
@@ -905,8 +919,8 @@ static void WeaponButton( WeaponType weapon, Vec2 size ) {
 	ImGui::PushStyleVar( ImGuiStyleVar_FrameRounding, 0 );
 	defer { ImGui::PopStyleVar( 2 ); };
 
-	const WeaponDef * def = GS_GetWeaponDef( weapon );
-	bool selected = selected_weapons[ def->category ] == weapon;
+	const WeaponInfo * info = GetWeaponInfo( weapon );
+	bool selected = selected_weapons[ info->category ] == weapon;
 
 	const Material * icon = cgs.media.shaderWeaponIcon[ weapon ];
 	Vec2 half_pixel = HalfPixelSize( icon );
@@ -917,17 +931,17 @@ static void WeaponButton( WeaponType weapon, Vec2 size ) {
 
 	bool clicked = ImGui::ImageButton( icon, size, half_pixel, 1.0f - half_pixel, 5, Vec4( 0.0f ), color );
 
-	WeaponTooltip( def );
+	WeaponTooltip( weapon );
 
 	ImGui::SameLine();
 	ImGui::Dummy( Vec2( 16, 0 ) );
 	ImGui::SameLine();
 
 	int weaponBinds[ 2 ] = { -1, -1 };
-	CG_GetBoundKeycodes( va( "use %s", def->short_name ), weaponBinds );
+	CG_GetBoundKeycodes( va( "use %s", info->short_name ), weaponBinds );
 
 	if( clicked || ImGui::Hotkey( weaponBinds[ 0 ] ) || ImGui::Hotkey( weaponBinds[ 1 ] ) ) {
-		selected_weapons[ def->category ] = selected ? WeaponType( Weapon_None ) : weapon;
+		selected_weapons[ info->category ] = selected ? WeaponType( Weapon_None ) : weapon;
 		SendLoadout();
 	}
 }
@@ -938,8 +952,7 @@ static void LoadoutCategory( const char * label, WeaponCategory category, Vec2 i
 	ImGui::NextColumn();
 
 	for( WeaponType i = 0; i < Weapon_Count; i++ ) {
-		const WeaponDef * def = GS_GetWeaponDef( i );
-		if( def->category == category ) {
+		if( GetWeaponInfo( i )->category == category ) {
 			WeaponButton( i, icon_size );
 		}
 	}
@@ -1247,31 +1260,71 @@ void UI_HideMenu() {
 	uistate = UIState_Hidden;
 }
 
-void UI_AddToServerList( const char * address, const char * info ) {
-	for( int i = 0; i < num_servers; i++ ) {
-		if( strcmp( address, servers[ i ].address ) == 0 ) {
-			char name[ 128 ];
-			char map[ 32 ];
-			int parsed = sscanf( info, "\\\\ping\\\\%d\\\\n\\\\%127[^\\]\\\\m\\\\ %31[^\\]\\\\u\\\\%d/%d\\\\EOT", &servers[ i ].ping, name, map, &servers[ i ].num_players, &servers[ i ].max_players );
-
-			if( parsed == 5 ) {
-				servers[ i ].name = CopyString( sys_allocator, name );
-				servers[ i ].map = CopyString( sys_allocator, map );
-			}
+// servers that replied first, then by ping
+static bool ServerSortsBefore( const Server & a, const Server & b ) {
+	if( ( a.name != NULL ) != ( b.name != NULL ) )
+		return a.name != NULL;
+	if( a.ping != b.ping )
+		return a.ping < b.ping;
+	return strcmp( a.address, b.address ) < 0;
+}
 
-			return;
-		}
+static void SortServerRow( int idx ) {
+	int pos = 0;
+	while( pos < num_servers - 1 && server_order[ pos ] != idx ) {
+		pos++;
 	}
 
-	if( size_t( num_servers ) < ARRAY_COUNT( servers ) ) {
-		servers[ num_servers ].address = CopyString( sys_allocator, address );
-		num_servers++;
+	memmove( &server_order[ pos ], &server_order[ pos + 1 ], ( num_servers - pos - 1 ) * sizeof( server_order[ 0 ] ) );
 
-		if( strcmp( info, "\\\\EOT" ) == 0 ) {
-			TempAllocator temp = cls.frame_arena.temp();
-			Cbuf_AddText( temp( "pingserver {}\n", address ) );
+	int lo = 0;
+	int hi = num_servers - 1;
+	while( lo < hi ) {
+		int mid = ( lo + hi ) / 2;
+		if( ServerSortsBefore( servers[ server_order[ mid ] ], servers[ idx ] ) ) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
 		}
 	}
+
+	memmove( &server_order[ lo + 1 ], &server_order[ lo ], ( num_servers - lo - 1 ) * sizeof( server_order[ 0 ] ) );
+	server_order[ lo ] = idx;
+}
+
+void UI_AddToServerList( const char * address, const char * info ) {
+	u64 hash = Hash64( address );
+	u64 idx;
+	if( !servers_by_address.get( hash, &idx ) ) {
+		if( size_t( num_servers ) == ARRAY_COUNT( servers ) )
+			return;
+
+		idx = num_servers;
+		servers[ idx ].address = CopyString( sys_allocator, address );
+		server_order[ num_servers ] = idx;
+		num_servers++;
+		servers_by_address.add( hash, idx );
+	}
+
+	Server * server = &servers[ idx ];
+
+	char name[ 128 ];
+	char map[ 32 ];
+	int ping, num_players, max_players;
+	int parsed = sscanf( info, "\\\\ping\\\\%d\\\\n\\\\%127[^\\]\\\\m\\\\ %31[^\\]\\\\u\\\\%d/%d\\\\EOT", &ping, name, map, &num_players, &max_players );
+	if( parsed != 5 )
+		return;
+
+	FREE( sys_allocator, const_cast< char * >( server->name ) );
+	FREE( sys_allocator, const_cast< char * >( server->map ) );
+	server->name = CopyString( sys_allocator, name );
+	server->map = CopyString( sys_allocator, map );
+	server->ping = ping;
+	server->num_players = num_players;
+	server->max_players = max_players;
+
+	SortServerRow( idx );
 }
 
 void UI_ShowLoadoutMenu( Span< int > weapons ) {
@@ -1286,7 +1339,7 @@ void UI_ShowLoadoutMenu( Span< int > weapons ) {
 		if( w <= Weapon_None || w >= Weapon_Count )
 			return;
 
-		WeaponCategory category = GS_GetWeaponDef( w )->category;
+		WeaponCategory category = GetWeaponInfo( w )->category;
 		if( category == WeaponCategory_Count || selected_weapons[ category ] != Weapon_None )
 			return;
 
@@ -31,20 +31,35 @@ struct DownloadInProgress {
 	DownloadCompleteCallback callback;
 };
 
-static DownloadInProgress download;
+// a reconnect can need a few things at once
+static DownloadInProgress downloads[ 8 ];
 
-static void OnDownloadDone( int http_status, Span< const u8 > data ) {
-	Com_Printf( "Download %s: %s (%i)\n", data.ptr != NULL ? "successful" : "failed", download.path, http_status );
+static void OnDownloadDone( void * user, int http_status, Span< const u8 > data ) {
+	DownloadInProgress * download = ( DownloadInProgress * ) user;
 
-	download.callback( download.path, data );
+	Com_Printf( "Download %s: %s (%i)\n", data.ptr != NULL ? "successful" : "failed", download->path, http_status );
 
-	FREE( sys_allocator, download.path );
-	download.path = NULL;
+	download->callback( download->path, data );
+
+	FREE( sys_allocator, download->path );
+	download->path = NULL;
 }
 
-bool CL_DownloadFile( const char * filename, DownloadCompleteCallback callback ) {
-	if( download.path ) {
-		Com_Printf( "Already downloading something.\n" );
+bool CL_DownloadFile( const char * filename, DownloadCompleteCallback callback, const char * save_to ) {
+	DownloadInProgress * download = NULL;
+	for( DownloadInProgress & d : downloads ) {
+		if( d.path != NULL && strcmp( d.path, filename ) == 0 ) {
+			Com_Printf( "Already downloading %s.\n", filename );
+			return false;
+		}
+
+		if( d.path == NULL && download == NULL ) {
+			download = &d;
+		}
+	}
+
+	if( download == NULL ) {
+		Com_Printf( "Too many downloads in progress.\n" );
 		return false;
 	}
 
@@ -60,29 +75,40 @@ bool CL_DownloadFile( const char * filename, DownloadCompleteCallback callback )
 
 	Com_Printf( "Asking to download: %s\n", filename );
 
-	download = { };
-	download.path = CopyString( sys_allocator, filename );
-	download.callback = callback;
+	*download = { };
+	download->path = CopyString( sys_allocator, filename );
+	download->callback = callback;
 
 	TempAllocator temp = cls.frame_arena.temp();
 
+	bool decompress = LastFileExtension( filename ) == ".zst";
+
 	const char * url = temp( "{}/{}", cls.download_url, filename );
+	Com_Printf( "Downloading %s\n", url );
+
 	if( cls.download_url_is_game_server ) {
 		const char * headers[] = {
 			temp( "X-Client: {}", cl.playernum ),
 			temp( "X-Session: {}", cls.session ),
 		};
-		StartDownload( url, OnDownloadDone, headers, ARRAY_COUNT( headers ) );
+		StartDownload( url, OnDownloadDone, download, headers, ARRAY_COUNT( headers ), decompress, save_to );
 	}
 	else {
-		StartDownload( url, OnDownloadDone, NULL, 0 );
+		StartDownload( url, OnDownloadDone, download, NULL, 0, decompress, save_to );
 	}
 
-	Com_Printf( "Downloading %s\n", url );
-
 	return true;
 }
 
+void CL_CancelDownloads() {
+	CancelAllDownloads();
+
+	for( DownloadInProgress & d : downloads ) {
+		FREE( sys_allocator, d.path );
+		d.path = NULL;
+	}
+}
+
 /*
 =====================================================================
 
@@ -136,8 +162,21 @@ static void CL_ParseServerData( msg_t *msg ) {
 		cls.download_url_is_game_server = true;
 	}
 
-	// get the configstrings request
-	CL_AddReliableCommand( temp( "configstrings {} 0", cl.servercount ) );
+	// get the configstrings request. if we were just on this server send what
+	// we have left from then so it only sends the ones that changed
+	if( cls.have_cached_configstrings && NET_CompareAddress( &cls.cached_configstrings_address, &cls.serveraddress ) ) {
+		memcpy( cl.configstrings, cls.cached_configstrings, sizeof( cl.configstrings ) );
+
+		DynamicString hashes( &temp );
+		for( size_t i = 0; i < NUM_CONFIGSTRING_BLOCKS; i++ ) {
+			hashes.append( "{016x}", ConfigstringBlockHash( cl.configstrings, i ) );
+		}
+
+		CL_AddReliableCommand( temp( "configstrings {} 0 {}", cl.servercount, hashes.c_str() ) );
+	}
+	else {
+		CL_AddReliableCommand( temp( "configstrings {} 0", cl.servercount ) );
+	}
 }
 
 static void CL_ParseBaseline( msg_t *msg ) {
@@ -172,6 +211,7 @@ static void CL_ParseFrame( msg_t *msg ) {
 
 			if( !cls.demo.waiting ) {
 				cls.demo.duration = snap->serverTime - cls.demo.basetime;
+				CL_RecordDemoKeyframe( snap );
 			}
 			cls.demo.time = cls.demo.duration;
 		}
@@ -184,19 +224,25 @@ static void CL_ParseFrame( msg_t *msg ) {
 
 		// the first snap, fill all the timeDeltas with the same value
 		// don't let delta add big jumps to the smoothing ( a stable connection produces jumps inside +-3 range)
+		// the jitter goes in before the clamping so late snapshots still count
+		CL_AddSnapArrival( snap->serverTime );
+
+		// compare against the delta without the jitter delay or it would get clamped away again
+		int smoothed = cl.newServerTimeDelta + cl.interpolationDelay;
+
 		delta = ( snap->serverTime - cl.snapFrameTime ) - cls.gametime;
-		if( cl.currentSnapNum <= 0 || delta < cl.newServerTimeDelta - 175 || delta > cl.newServerTimeDelta + 175 ) {
+		if( cl.currentSnapNum <= 0 || delta < smoothed - 175 || delta > smoothed + 175 ) {
 			CL_RestartTimeDeltas( delta );
 		} else {
 			if( cl_debug_timeDelta->integer ) {
-				if( delta < cl.newServerTimeDelta - (int)cl.snapFrameTime ) {
+				if( delta < smoothed - (int)cl.snapFrameTime ) {
 					Com_Printf( S_COLOR_CYAN "***** timeDelta low clamp\n" );
-				} else if( delta > cl.newServerTimeDelta + (int)cl.snapFrameTime ) {
+				} else if( delta > smoothed + (int)cl.snapFrameTime ) {
 					Com_Printf( S_COLOR_CYAN "***** timeDelta high clamp\n" );
 				}
 			}
 
-			delta = Clamp( cl.newServerTimeDelta - (int)cl.snapFrameTime, delta, cl.newServerTimeDelta + (int)cl.snapFrameTime );
+			delta = Clamp( smoothed - (int)cl.snapFrameTime, delta, smoothed + (int)cl.snapFrameTime );
 
 			cl.serverTimeDeltas[cl.receivedSnapNum & MASK_TIMEDELTAS_BACKUP] = delta;
 		}
@@ -251,6 +297,17 @@ static void CL_ParseConfigstringCommand() {
 	}
 }
 
+static void CL_ParseConfigstrings( msg_t *msg, bool execute ) {
+	u64 count = MSG_ReadUintBase128( msg );
+	for( u64 i = 0; i < count && msg->readcount < msg->cursize; i++ ) {
+		int idx = MSG_ReadUintBase128( msg );
+		const char *s = MSG_ReadString( msg );
+		if( execute ) {
+			CL_UpdateConfigString( idx, s );
+		}
+	}
+}
+
 typedef struct {
 	const char *name;
 	void ( *func )();
@@ -350,6 +407,21 @@ void CL_ParseServerMessage( msg_t *msg ) {
 				CL_ParseServerCommand( msg );
 				break;
 
+			case svc_configstrings: {
+				int cmdNum = MSG_ReadInt32( msg );
+				if( cmdNum < 0 ) {
+					Com_Error( "CL_ParseServerMessage: Invalid cmdNum value received: %i\n", cmdNum );
+					return;
+				}
+
+				bool execute = cmdNum > cls.lastExecutedServerCommand;
+				if( execute ) {
+					cls.lastExecutedServerCommand = cmdNum;
+				}
+
+				CL_ParseConfigstrings( msg, execute );
+			} break;
+
 			case svc_serverdata:
 				if( cls.state == CA_HANDSHAKE ) {
 					Cbuf_Execute(); // make sure any stuffed commands are done
@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "client/client.h"
 #include "client/renderer/renderer.h"
+#include "client/renderer/text.h"
 #include "cgame/cg_local.h"
 #include "qcommon/cmodel.h"
 
@@ -110,6 +111,18 @@ static void SCR_DrawDebugGraph() {
 	}
 }
 
+static void SCR_DrawNetStats() {
+	if( !cls.cgameActive )
+		return;
+
+	TempAllocator temp = cls.frame_arena.temp();
+	const char * stats = temp( "interp {}ms  jitter {.1}ms  extrap {}ms", cl.snapFrameTime + cl.interpolationDelay, cl.snapJitter, cl.extrapolatedTime );
+
+	float y = frame_static.viewport_height - scr_graphheight->integer - 4;
+	Vec4 color = cl.extrapolatedTime > 0 ? vec4_red : vec4_white;
+	DrawText( cgs.fontNormal, cgs.textSizeTiny, stats, Alignment_LeftBottom, 4, y, color, true );
+}
+
 void SCR_InitScreen() {
 	scr_netgraph = Cvar_Get( "netgraph", "0", 0 );
 	scr_timegraph = Cvar_Get( "timegraph", "0", 0 );
@@ -147,10 +160,11 @@ struct PostprocessUniforms {
 	float crt;
 	float brightness;
 	float contrast;
+	Vec2 screen_scale;
 };
 
 static UniformBlock UploadPostprocessUniforms( PostprocessUniforms uniforms ) {
-	return UploadUniformBlock( uniforms.time, uniforms.damage, uniforms.crt, uniforms.brightness, uniforms.contrast );
+	return UploadUniformBlock( uniforms.time, uniforms.damage, uniforms.crt, uniforms.brightness, uniforms.contrast, uniforms.screen_scale );
 }
 
 static void SubmitPostprocessPass() {
@@ -162,9 +176,9 @@ static void SubmitPostprocessPass() {
 	pipeline.shader = &shaders.postprocess;
 
 	const Framebuffer & fb = frame_static.postprocess_fb;
-	pipeline.set_uniform( "u_View", frame_static.ortho_view_uniforms );
-	pipeline.set_texture( "u_Screen", &fb.albedo_texture );
-	pipeline.set_texture( "u_Noise", FindMaterial( "textures/noise" )->texture );
+	pipeline.set_uniform( UniformSlot_View, frame_static.ortho_view_uniforms );
+	pipeline.set_texture( TextureSlot_Screen, &fb.albedo_texture );
+	pipeline.set_texture( TextureSlot_Noise, FindMaterial( "textures/noise" )->texture );
 	float damage_effect = cg.view.type == VIEWDEF_PLAYERVIEW ? cg.damage_effect : 0.0f;
 
 	float contrast = 1.0f;
@@ -196,8 +210,9 @@ static void SubmitPostprocessPass() {
 	uniforms.crt = chasing_amount;
 	uniforms.brightness = 0.0f;
 	uniforms.contrast = contrast;
+	uniforms.screen_scale = Vec2( frame_static.scene_width / float( fb.width ), frame_static.scene_height / float( fb.height ) );
 
-	pipeline.set_uniform( "u_PostProcess", UploadPostprocessUniforms( uniforms ) );
+	pipeline.set_uniform( UniformSlot_PostProcess, UploadPostprocessUniforms( uniforms ) );
 
 	DrawFullscreenMesh( pipeline );
 }
@@ -217,6 +232,10 @@ void SCR_UpdateScreen() {
 		if( scr_debuggraph->integer || scr_timegraph->integer || scr_netgraph->integer ) {
 			SCR_DrawDebugGraph();
 		}
+
+		if( scr_netgraph->integer ) {
+			SCR_DrawNetStats();
+		}
 	}
 	else {
 		cg.damage_effect = 0.0f;
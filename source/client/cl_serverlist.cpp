@@ -19,19 +19,43 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "client/client.h"
+#include "qcommon/hash.h"
+#include "qcommon/hashmap.h"
 #include "qcommon/threads.h"
 #include "qcommon/version.h"
 
+/*
+ * master servers can hand us hundreds of addresses at once, so pings go out
+ * at SERVER_PINGS_PER_SECOND instead of all in one frame, which would flood
+ * the socket and make the first replies look slower than they are. each
+ * server gets pinged a few times and the UI shows the best one, since a
+ * single sample picks up whatever jitter was around when it went out
+ */
+static constexpr int SERVER_PINGS_PER_SECOND = 100;
+static constexpr int SERVER_PING_SAMPLES = 3;
+static constexpr int SERVER_PING_ATTEMPTS = 6;
+static constexpr int64_t SERVER_PING_INTERVAL = 500;
+static constexpr int64_t SERVER_PING_LOST = 1000;
+
 struct serverlist_t {
 	char address[48];
-	int64_t pingTimeStamp;
+	netadr_t adr;
+	int64_t pingTimeStamp; // 0 when no ping is in flight
+	int64_t nextPing; // 0 when we're done pinging it
+	int pingsSent;
+	int pingsReceived;
+	int minPing;
+	int totalPing;
 	int64_t lastUpdatedByMasterServer;
 	int64_t masterServerUpdateSeq;
 	bool isLocal;
-	serverlist_t *pnext;
 };
 
-static serverlist_t *masterList;
+static Hashmap< serverlist_t, 1024 > masterList;
+
+static size_t nextPingedServer;
+static float pingBudget;
+static int64_t lastPingFrame;
 
 static bool filter_allow_full = false;
 static bool filter_allow_empty = false;
@@ -50,32 +74,11 @@ struct masterserver_t {
 
 static masterserver_t masterServers[ ARRAY_COUNT( MASTER_SERVERS ) ];
 
-static void CL_FreeServerlist( serverlist_t **serversList ) {
-	serverlist_t *ptr;
-
-	while( *serversList ) {
-		ptr = *serversList;
-		*serversList = ptr->pnext;
-		Mem_ZoneFree( ptr );
-	}
-}
-
-static serverlist_t *CL_ServerFindInList( serverlist_t *serversList, const char *adr ) {
-
-	serverlist_t *server;
-
-	server = serversList;
-	while( server ) {
-		if( !Q_stricmp( server->address, adr ) ) {
-			return server;
-		}
-		server = server->pnext;
-	}
-
-	return NULL;
+static serverlist_t *CL_ServerFindInList( const char *adr ) {
+	return masterList.get( Hash64( adr ) );
 }
 
-static bool CL_AddServerToList( serverlist_t **serversList, const char *adr ) {
+static bool CL_AddServerToList( const char *adr ) {
 	serverlist_t *newserv;
 	netadr_t nadr;
 
@@ -87,7 +90,7 @@ static bool CL_AddServerToList( serverlist_t **serversList, const char *adr ) {
 		return false;
 	}
 
-	newserv = CL_ServerFindInList( *serversList, adr );
+	newserv = CL_ServerFindInList( adr );
 	if( newserv ) {
 		// ignore excessive updates for about a second or so, which may happen
 		// when we're querying multiple master servers at once
@@ -99,18 +102,80 @@ static bool CL_AddServerToList( serverlist_t **serversList, const char *adr ) {
 		return false;
 	}
 
-	newserv = (serverlist_t *)Mem_ZoneMalloc( sizeof( serverlist_t ) );
+	newserv = masterList.add( Hash64( adr ) );
+	if( newserv == NULL ) {
+		return false;
+	}
+
 	Q_strncpyz( newserv->address, adr, sizeof( newserv->address ) );
+	newserv->adr = nadr;
 	newserv->pingTimeStamp = 0;
+	newserv->nextPing = 0;
+	newserv->pingsSent = 0;
+	newserv->pingsReceived = 0;
+	newserv->minPing = 0;
+	newserv->totalPing = 0;
 	newserv->lastUpdatedByMasterServer = Sys_Milliseconds();
 	newserv->masterServerUpdateSeq = masterServerUpdateSeq;
-	newserv->pnext = *serversList;
 	newserv->isLocal = NET_IsLocalAddress( &nadr );
-	*serversList = newserv;
 
 	return true;
 }
 
+static void CL_SchedulePings( serverlist_t *server ) {
+	server->pingsSent = 0;
+	server->pingsReceived = 0;
+	server->minPing = 0;
+	server->totalPing = 0;
+	server->pingTimeStamp = 0;
+	server->nextPing = Sys_Milliseconds();
+}
+
+static void CL_SendPing( serverlist_t *server, int64_t now ) {
+	TempAllocator temp = cls.frame_arena.temp();
+	const char * requestString = temp( "info {} {} {}", APP_PROTOCOL_VERSION,
+		filter_allow_full ? "full" : "",
+		filter_allow_empty ? "empty" : "" );
+
+	socket_t *socket = ( server->adr.type == NA_IP6 ? &cls.socket_udp6 : &cls.socket_udp );
+	Netchan_OutOfBandPrint( socket, &server->adr, "%s", requestString );
+
+	server->pingTimeStamp = now;
+	server->pingsSent++;
+	server->nextPing = 0;
+}
+
+static void CL_PingServers() {
+	int64_t now = Sys_Milliseconds();
+
+	pingBudget += ( now - lastPingFrame ) * SERVER_PINGS_PER_SECOND / 1000.0f;
+	pingBudget = Min2( pingBudget, float( SERVER_PINGS_PER_SECOND ) / 10.0f );
+	lastPingFrame = now;
+
+	// lost pings count towards pingsSent so a dead server gives up eventually
+	for( size_t i = 0; i < masterList.n; i++ ) {
+		serverlist_t *server = &masterList.values[ i ];
+		if( server->pingTimeStamp != 0 && server->pingTimeStamp + SERVER_PING_LOST < now ) {
+			server->pingTimeStamp = 0;
+			if( server->pingsReceived < SERVER_PING_SAMPLES && server->pingsSent < SERVER_PING_ATTEMPTS ) {
+				server->nextPing = now;
+			}
+		}
+	}
+
+	// round robin so one big master response can't starve the rest
+	for( size_t checked = 0; checked < masterList.n && pingBudget >= 1.0f; checked++ ) {
+		nextPingedServer = ( nextPingedServer + 1 ) % masterList.n;
+		serverlist_t *server = &masterList.values[ nextPingedServer ];
+
+		if( server->nextPing == 0 || server->nextPing > now || server->pingTimeStamp != 0 )
+			continue;
+
+		CL_SendPing( server, now );
+		pingBudget -= 1.0f;
+	}
+}
+
 /*
 * CL_ParseGetInfoResponse
 *
@@ -170,40 +235,22 @@ void CL_QueryGetStatusMessage_f() {
 }
 
 void CL_PingServer_f() {
-	const char *address_string;
-	char requestString[64];
-	netadr_t adr;
-	serverlist_t *pingserver;
-	socket_t *socket;
-
 	if( Cmd_Argc() < 2 ) {
 		Com_Printf( "Usage: pingserver [ip:port]\n" );
-	}
-
-	address_string = Cmd_Argv( 1 );
-
-	if( !NET_StringToAddress( address_string, &adr ) ) {
 		return;
 	}
 
-	pingserver = CL_ServerFindInList( masterList, address_string );
+	serverlist_t *pingserver = CL_ServerFindInList( Cmd_Argv( 1 ) );
 	if( !pingserver ) {
 		return;
 	}
 
-	// never request a second ping while awaiting for a ping reply
-	if( pingserver->pingTimeStamp + SERVER_PINGING_TIMEOUT > Sys_Milliseconds() ) {
+	// never request a second round while the first is still going
+	if( pingserver->nextPing != 0 || pingserver->pingTimeStamp != 0 ) {
 		return;
 	}
 
-	pingserver->pingTimeStamp = Sys_Milliseconds();
-
-	snprintf( requestString, sizeof( requestString ), "info %i %s %s", APP_PROTOCOL_VERSION,
-				 filter_allow_full ? "full" : "",
-				 filter_allow_empty ? "empty" : "" );
-
-	socket = ( adr.type == NA_IP6 ? &cls.socket_udp6 : &cls.socket_udp );
-	Netchan_OutOfBandPrint( socket, &adr, "%s", requestString );
+	CL_SchedulePings( pingserver );
 }
 
 /*
@@ -220,12 +267,24 @@ void CL_ParseStatusMessage( const socket_t *socket, const netadr_t *address, msg
 	Q_strncpyz( adrString, NET_AddressToString( address ), sizeof( adrString ) );
 
 	// ping response
-	pingserver = CL_ServerFindInList( masterList, adrString );
+	pingserver = CL_ServerFindInList( adrString );
 
 	if( pingserver && pingserver->pingTimeStamp ) { // valid ping
-		int ping = (int)(Sys_Milliseconds() - pingserver->pingTimeStamp);
-		UI_AddToServerList( adrString, va( "\\\\ping\\\\%i%s", ping, s ) );
+		int64_t now = Sys_Milliseconds();
+		int ping = (int)( now - pingserver->pingTimeStamp );
+		pingserver->minPing = pingserver->pingsReceived == 0 ? ping : Min2( pingserver->minPing, ping );
+		pingserver->totalPing += ping;
+		pingserver->pingsReceived++;
 		pingserver->pingTimeStamp = 0;
+
+		if( pingserver->pingsReceived < SERVER_PING_SAMPLES && pingserver->pingsSent < SERVER_PING_ATTEMPTS ) {
+			pingserver->nextPing = now + SERVER_PING_INTERVAL;
+		}
+
+		Com_DPrintf( "%s: %i/%i replies, min %ims, avg %ims\n", adrString, pingserver->pingsReceived, pingserver->pingsSent,
+			pingserver->minPing, pingserver->totalPing / pingserver->pingsReceived );
+
+		UI_AddToServerList( adrString, va( "\\\\ping\\\\%i%s", pingserver->minPing, s ) );
 		return;
 	}
 
@@ -301,7 +360,7 @@ static void CL_ParseGetServersResponseMessage( msg_t *msg, bool extended ) {
 			continue;
 		}
 
-		CL_AddServerToList( &masterList, adrString );
+		CL_AddServerToList( adrString );
 	}
 }
 
@@ -310,24 +369,20 @@ static void CL_ParseGetServersResponseMessage( msg_t *msg, bool extended ) {
 * Handle a reply from getservers message to master server
 */
 void CL_ParseGetServersResponse( const socket_t *socket, const netadr_t *address, msg_t *msg, bool extended ) {
-	serverlist_t *server;
-	netadr_t adr;
-
 	// add the new server addresses to the local addresses list
 	masterServerUpdateSeq++;
 
 	CL_ParseGetServersResponseMessage( msg, extended );
 
 	// dump servers we just received an update on from the master server
-	server = masterList;
-	while( server ) {
-		if( server->masterServerUpdateSeq == masterServerUpdateSeq
-			&& !( server->isLocal && Com_ServerState() )
-			&& NET_StringToAddress( server->address, &adr ) ) {
+	for( size_t i = 0; i < masterList.n; i++ ) {
+		serverlist_t *server = &masterList.values[ i ];
+		if( server->masterServerUpdateSeq == masterServerUpdateSeq && !( server->isLocal && Com_ServerState() ) ) {
 			UI_AddToServerList( server->address, "\\\\EOT" );
+			if( server->nextPing == 0 && server->pingTimeStamp == 0 ) {
+				CL_SchedulePings( server );
+			}
 		}
-
-		server = server->pnext;
 	}
 }
 
@@ -475,16 +530,21 @@ void CL_ServerListFrame() {
 
 		master.should_query = false;
 	}
+
+	CL_PingServers();
 }
 
 void CL_InitServerList() {
-	CL_FreeServerlist( &masterList );
+	masterList.clear();
+	nextPingedServer = 0;
+	pingBudget = 0.0f;
+	lastPingFrame = Sys_Milliseconds();
 
 	CL_MasterAddressCache_Init();
 }
 
 void CL_ShutDownServerList() {
-	CL_FreeServerlist( &masterList );
+	masterList.clear();
 
 	CL_MasterAddressCache_Shutdown();
 }
@@ -1,14 +1,19 @@
-#include <algorithm> // std::sort
+#include <algorithm> // std::sort, std::nth_element
+#include <math.h>
 
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
 #include "qcommon/hash.h"
 #include "qcommon/array.h"
 #include "qcommon/hashtable.h"
+#include "qcommon/memory_budget.h"
+#include "qcommon/cmodel.h"
 #include "client/client.h"
 #include "client/assets.h"
 #include "client/sound.h"
-#include "client/threadpool.h"
+#include "client/mixer.h"
+#include "qcommon/threadpool.h"
+#include "qcommon/zone_sampler.h"
 #include "gameshared/gs_public.h"
 
 #define AL_LIBTYPE_STATIC
@@ -20,8 +25,11 @@
 #include "stb/stb_vorbis.h"
 
 struct Sound {
-	ALuint buf;
-	bool mono;
+	s16 * samples;
+	Span< u8 > ogg; // our own copy for streamed sounds
+	u32 num_frames;
+	u32 channels;
+	u32 sample_rate;
 };
 
 struct SoundEffect {
@@ -62,7 +70,8 @@ struct PlayingSound {
 	Vec3 origin;
 	Vec3 end;
 
-	ALuint sources[ ARRAY_COUNT( &SoundEffect::sounds ) ];
+	u32 voices[ ARRAY_COUNT( &SoundEffect::sounds ) ];
+	u32 generations[ ARRAY_COUNT( &SoundEffect::sounds ) ];
 	bool started[ ARRAY_COUNT( &SoundEffect::sounds ) ];
 	bool stopped[ ARRAY_COUNT( &SoundEffect::sounds ) ];
 };
@@ -72,8 +81,15 @@ struct EntitySound {
 	Vec3 velocity;
 };
 
+struct Listener {
+	Vec3 origin;
+	Vec3 velocity;
+	Vec3 right;
+};
+
 static ALCdevice * al_device;
 static ALCcontext * al_context;
+static u32 output_sample_rate;
 
 // so we don't crash when some other application is running in exclusive playback mode (WASAPI/JACK/etc)
 static bool initialized;
@@ -82,10 +98,15 @@ cvar_t * s_device;
 static cvar_t * s_volume;
 static cvar_t * s_musicvolume;
 static cvar_t * s_muteinbackground;
+static cvar_t * s_occlusion;
 
 constexpr u32 MAX_SOUND_ASSETS = 4096;
 constexpr u32 MAX_SOUND_EFFECTS = 4096;
-constexpr u32 MAX_PLAYING_SOUNDS = 256;
+constexpr u32 MAX_PLAYING_SOUNDS = 512;
+constexpr u32 MAX_AUDIBLE_VOICES = 128;
+
+// oggs bigger than this get decoded as they play, mostly for the music
+constexpr size_t STREAM_SOUND_BYTES = 512 * 1024;
 
 static Sound sounds[ MAX_SOUND_ASSETS ];
 static u32 num_sounds;
@@ -95,8 +116,27 @@ static SoundEffect sound_effects[ MAX_SOUND_EFFECTS ];
 static u32 num_sound_effects;
 static Hashtable< MAX_SOUND_EFFECTS * 2 > sound_effects_hashtable;
 
-static ALuint free_sound_sources[ MAX_PLAYING_SOUNDS ];
-static u32 num_free_sound_sources;
+/*
+ * voice 0 is the music. voices that get stolen or finish have their
+ * generation bumped/reported by the mixer, so PlayingSounds check theirs
+ * still match before touching them
+ */
+constexpr u32 MUSIC_VOICE = 0;
+
+static MixerVoice voices[ MIXER_MAX_VOICES ];
+static float voice_priorities[ MIXER_MAX_VOICES ];
+static float voice_occlusion[ MIXER_MAX_VOICES ];
+static bool voice_occluded[ MIXER_MAX_VOICES ];
+static u32 voice_finished[ MIXER_MAX_VOICES ];
+static u32 num_voices;
+static u32 voice_generation_autoinc;
+
+static u32 free_voices[ MIXER_MAX_VOICES ];
+static u32 num_free_voices;
+
+static Listener listener;
+static float master_gain;
+static u32 occlusion_frame;
 
 static PlayingSound playing_sound_effects[ MAX_PLAYING_SOUNDS ];
 static u32 num_playing_sound_effects;
@@ -104,7 +144,6 @@ static u32 num_playing_sound_effects;
 static Hashtable< MAX_PLAYING_SOUNDS * 2 > immediate_sounds_hashtable;
 static u64 immediate_sounds_autoinc;
 
-static ALuint music_source;
 static bool music_playing;
 
 static EntitySound entities[ MAX_EDICTS ];
@@ -146,65 +185,6 @@ static void CheckALErrors( const char * fmt, const Rest & ... rest ) {
 	}
 }
 
-static void CheckedALListener( ALenum param, float x ) {
-	alListenerf( param, x );
-	CheckALErrors( "alListenerf( {}, {} )", param, x );
-}
-
-static void CheckedALListener( ALenum param, Vec3 v ) {
-	alListenerfv( param, v.ptr() );
-	CheckALErrors( "alListenerfv( {}, {} )", param, v );
-}
-
-static void CheckedALListener( ALenum param, const mat3_t m ) {
-	float forward_and_up[ 6 ];
-	forward_and_up[ 0 ] = m[ AXIS_FORWARD ];
-	forward_and_up[ 1 ] = m[ AXIS_FORWARD + 1 ];
-	forward_and_up[ 2 ] = m[ AXIS_FORWARD + 2 ];
-	forward_and_up[ 3 ] = m[ AXIS_UP ];
-	forward_and_up[ 4 ] = m[ AXIS_UP + 1 ];
-	forward_and_up[ 5 ] = m[ AXIS_UP + 2 ];
-	alListenerfv( param, forward_and_up );
-	CheckALErrors( "alListenerfv( {}, {}/{} )", param, FromQFAxis( m, AXIS_FORWARD ), FromQFAxis( m, AXIS_UP ) );
-}
-
-static ALint CheckedALGetSource( ALuint source, ALenum param ) {
-	ALint res;
-	alGetSourcei( source, param, &res );
-	CheckALErrors( "alGetSourcei( {}, {} )", source, param );
-	return res;
-}
-
-static void CheckedALSource( ALuint source, ALenum param, ALint x ) {
-	alSourcei( source, param, x );
-	CheckALErrors( "alSourcei( {}, {}, {} )", source, param, x );
-}
-
-static void CheckedALSource( ALuint source, ALenum param, ALuint x ) {
-	alSourcei( source, param, x );
-	CheckALErrors( "alSourcei( {}, {}, {} )", source, param, x );
-}
-
-static void CheckedALSource( ALuint source, ALenum param, float x ) {
-	alSourcef( source, param, x );
-	CheckALErrors( "alSourcef( {}, {}, {} )", source, param, x );
-}
-
-static void CheckedALSource( ALuint source, ALenum param, Vec3 v ) {
-	alSourcefv( source, param, v.ptr() );
-	CheckALErrors( "alSourcefv( {}, {}, {} )", source, param, v );
-}
-
-static void CheckedALSourcePlay( ALuint source ) {
-	alSourcePlay( source );
-	CheckALErrors( "alSourcePlay( {} )", source );
-}
-
-static void CheckedALSourceStop( ALuint source ) {
-	alSourceStop( source );
-	CheckALErrors( "alSourceStop( {} )", source );
-}
-
 static bool S_InitAL() {
 	ZoneScoped;
 
@@ -226,10 +206,11 @@ static bool S_InitAL() {
 		}
 	}
 
+	// the mixer does its own spatialisation and hands AL one stereo stream
 	ALCint attrs[] = {
-		ALC_HRTF_SOFT, ALC_HRTF_ENABLED_SOFT,
-		ALC_MONO_SOURCES, 256,
-		ALC_STEREO_SOURCES, 16,
+		ALC_HRTF_SOFT, ALC_FALSE,
+		ALC_MONO_SOURCES, 0,
+		ALC_STEREO_SOURCES, 1,
 		0
 	};
 	al_context = alcCreateContext( al_device, attrs );
@@ -240,19 +221,13 @@ static bool S_InitAL() {
 	}
 	alcMakeContextCurrent( al_context );
 
-	alDopplerFactor( 1.0f );
-	alDopplerVelocity( 10976.0f );
-	alSpeedOfSound( 10976.0f );
-
-	alDistanceModel( AL_INVERSE_DISTANCE_CLAMPED );
-
-	alGenSources( ARRAY_COUNT( free_sound_sources ), free_sound_sources );
-	alGenSources( 1, &music_source );
-	num_free_sound_sources = ARRAY_COUNT( free_sound_sources );
+	ALCint frequency = 0;
+	alcGetIntegerv( al_device, ALC_FREQUENCY, 1, &frequency );
+	output_sample_rate = frequency > 0 ? u32( frequency ) : 48000;
 
-	if( alGetError() != AL_NO_ERROR ) {
-		Com_Printf( S_COLOR_RED "Failed to allocate sound sources\n" );
-		S_Shutdown();
+	if( !InitMixer( output_sample_rate ) ) {
+		alcDestroyContext( al_context );
+		alcCloseDevice( al_device );
 		return false;
 	}
 
@@ -273,7 +248,32 @@ struct DecodeSoundJob {
 	} out;
 };
 
-static void AddSound( const char * path, int num_samples, int channels, int sample_rate, s16 * samples ) {
+static bool ShouldStream( Span< const u8 > ogg ) {
+	return ogg.n >= STREAM_SOUND_BYTES;
+}
+
+// streamed sounds only get their header read
+static int DecodeSound( Span< const u8 > ogg, int * channels, int * sample_rate, s16 ** samples ) {
+	*samples = NULL;
+
+	if( !ShouldStream( ogg ) ) {
+		return stb_vorbis_decode_memory( ogg.ptr, ogg.num_bytes(), channels, sample_rate, samples );
+	}
+
+	stb_vorbis * decoder = stb_vorbis_open_memory( ogg.ptr, ogg.num_bytes(), NULL, NULL );
+	if( decoder == NULL )
+		return -1;
+
+	stb_vorbis_info info = stb_vorbis_get_info( decoder );
+	*channels = info.channels;
+	*sample_rate = info.sample_rate;
+	int num_samples = stb_vorbis_stream_length_in_samples( decoder );
+	stb_vorbis_close( decoder );
+
+	return num_samples;
+}
+
+static void AddSound( const char * path, int num_samples, int channels, int sample_rate, s16 * samples, Span< const u8 > ogg ) {
 	ZoneScoped;
 	ZoneText( path, strlen( path ) );
 
@@ -309,27 +309,43 @@ static void AddSound( const char * path, int num_samples, int channels, int samp
 	else {
 		restart_music = music_playing;
 		S_StopAllSounds( true );
-		alDeleteBuffers( 1, &sounds[ idx ].buf );
+		MixerSync();
+		free( sounds[ idx ].samples );
+		FREE( sys_allocator, sounds[ idx ].ogg.ptr );
 	}
 
-	ALenum format = channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-	alGenBuffers( 1, &sounds[ idx ].buf );
-	alBufferData( sounds[ idx ].buf, format, samples, num_samples * channels * sizeof( s16 ), sample_rate );
-	CheckALErrors( "AddSound" );
-
-	sounds[ idx ].mono = channels == 1;
+	// the mixer reads straight out of these so we hang on to them
+	sounds[ idx ].samples = samples;
+	sounds[ idx ].ogg = Span< u8 >();
+	if( ShouldStream( ogg ) ) {
+		// the asset can get evicted or hotloaded while the decoder is using it
+		sounds[ idx ].ogg = ALLOC_SPAN( sys_allocator, u8, ogg.n );
+		memcpy( sounds[ idx ].ogg.ptr, ogg.ptr, ogg.n );
+	}
+	sounds[ idx ].num_frames = num_samples;
+	sounds[ idx ].channels = channels;
+	sounds[ idx ].sample_rate = sample_rate;
 
 	if( restart_music ) {
 		S_StartMenuMusic();
 	}
-
-	free( samples );
 }
 
-static void LoadSounds() {
+static NonRAIIDynamicArray< DecodeSoundJob > decode_jobs;
+static bool decoding_sounds;
+static JobGroup decode_group;
+
+/*
+ * decoding only needs the assets, so CL_Init starts it before the renderer
+ * and it overlaps with the rest of startup. LoadSounds waits for it and
+ * adds the sounds. long sounds only get their headers read here and are
+ * decoded as they play
+ */
+void S_StartDecodingSounds() {
 	ZoneScoped;
 
-	DynamicArray< DecodeSoundJob > jobs( sys_allocator );
+	decode_jobs.init( sys_allocator );
+
 	{
 		ZoneScopedN( "Build job list" );
 
@@ -339,27 +355,56 @@ static void LoadSounds() {
 				job.in.path = path;
 				job.in.ogg = AssetBinary( path );
 
-				jobs.add( job );
+				decode_jobs.add( job );
 			}
 		}
 
-		std::sort( jobs.begin(), jobs.end(), []( const DecodeSoundJob & a, const DecodeSoundJob & b ) {
+		std::sort( decode_jobs.begin(), decode_jobs.end(), []( const DecodeSoundJob & a, const DecodeSoundJob & b ) {
 			return a.in.ogg.n > b.in.ogg.n;
 		} );
 	}
 
-	ParallelFor( jobs.span(), []( TempAllocator * temp, void * data ) {
-		DecodeSoundJob * job = ( DecodeSoundJob * ) data;
+	for( DecodeSoundJob & job : decode_jobs ) {
+		ThreadPoolDo( &decode_group, []( TempAllocator * temp, void * data ) {
+			DecodeSoundJob * job = ( DecodeSoundJob * ) data;
 
-		ZoneScopedN( "stb_vorbis_decode_memory" );
-		ZoneText( job->in.path, strlen( job->in.path ) );
+			ZoneScopedN( "Decode sound" );
+			ZoneText( job->in.path, strlen( job->in.path ) );
 
-		job->out.num_samples = stb_vorbis_decode_memory( job->in.ogg.ptr, job->in.ogg.num_bytes(), &job->out.channels, &job->out.sample_rate, &job->out.samples );
-	} );
+			job->out.num_samples = DecodeSound( job->in.ogg, &job->out.channels, &job->out.sample_rate, &job->out.samples );
+		}, &job );
+	}
 
-	for( DecodeSoundJob job : jobs ) {
-		AddSound( job.in.path, job.out.num_samples, job.out.channels, job.out.sample_rate, job.out.samples );
+	decoding_sounds = true;
+}
+
+static void FinishDecodingSounds( bool add ) {
+	if( !decoding_sounds )
+		S_StartDecodingSounds();
+
+	{
+		ZoneScopedN( "Wait for sound decodes" );
+		ThreadPoolWait( &decode_group );
 	}
+
+	for( DecodeSoundJob job : decode_jobs ) {
+		AssetConsumed( StringHash( job.in.path ) );
+
+		if( add ) {
+			AddSound( job.in.path, job.out.num_samples, job.out.channels, job.out.sample_rate, job.out.samples, job.in.ogg );
+		}
+		else if( job.out.num_samples != -1 ) {
+			free( job.out.samples );
+		}
+	}
+
+	decode_jobs.shutdown();
+	decoding_sounds = false;
+}
+
+static void LoadSounds() {
+	ZoneScoped;
+	FinishDecodingSounds( true );
 }
 
 static void HotloadSounds() {
@@ -372,12 +417,13 @@ static void HotloadSounds() {
 			int num_samples, channels, sample_rate;
 			s16 * samples;
 			{
-				ZoneScopedN( "stb_vorbis_decode_memory" );
+				ZoneScopedN( "Decode sound" );
 				ZoneText( path, strlen( path ) );
-				num_samples = stb_vorbis_decode_memory( ogg.ptr, ogg.num_bytes(), &channels, &sample_rate, &samples );
+				num_samples = DecodeSound( ogg, &channels, &sample_rate, &samples );
 			}
 
-			AddSound( path, num_samples, channels, sample_rate, samples );
+			AddSound( path, num_samples, channels, sample_rate, samples, ogg );
+			AssetConsumed( StringHash( path ) );
 		}
 	}
 }
@@ -524,6 +570,21 @@ static void HotloadSoundEffects() {
 	}
 }
 
+static void SoundMemoryBudget( MemoryBudget * budget ) {
+	budget->add_array( "sounds", sounds, num_sounds );
+	budget->add_array( "sounds_hashtable", sizeof( sounds_hashtable ), num_sounds, MAX_SOUND_ASSETS * 2 );
+	budget->add_array( "sound_effects", sound_effects, num_sound_effects );
+	budget->add_array( "sound_effects_hashtable", sizeof( sound_effects_hashtable ), num_sound_effects, MAX_SOUND_EFFECTS * 2 );
+	budget->add_array( "playing_sound_effects", playing_sound_effects, num_playing_sound_effects );
+
+	for( u32 i = 0; i < num_sounds; i++ ) {
+		if( sounds[ i ].samples != NULL ) {
+			budget->heap_bytes += sounds[ i ].num_frames * sounds[ i ].channels * sizeof( s16 );
+		}
+		budget->heap_bytes += sounds[ i ].ogg.n;
+	}
+}
+
 bool S_Init() {
 	ZoneScoped;
 
@@ -539,19 +600,42 @@ bool S_Init() {
 
 	memset( entities, 0, sizeof( entities ) );
 
+	for( MixerVoice & voice : voices ) {
+		voice = { };
+	}
+	memset( voice_finished, 0, sizeof( voice_finished ) );
+	num_voices = MUSIC_VOICE + 1;
+	voice_generation_autoinc = 1;
+	master_gain = 1.0f;
+	occlusion_frame = 0;
+
+	// so they get handed out from the bottom up
+	num_free_voices = 0;
+	for( u32 i = MIXER_MAX_VOICES - 1; i > MUSIC_VOICE; i-- ) {
+		free_voices[ num_free_voices ] = i;
+		num_free_voices++;
+	}
+
 	s_device = Cvar_Get( "s_device", "", CVAR_ARCHIVE );
 	s_device->modified = false;
 	s_volume = Cvar_Get( "s_volume", "1", CVAR_ARCHIVE );
 	s_musicvolume = Cvar_Get( "s_musicvolume", "1", CVAR_ARCHIVE );
 	s_muteinbackground = Cvar_Get( "s_muteinbackground", "1", CVAR_ARCHIVE );
 	s_muteinbackground->modified = true;
+	s_occlusion = Cvar_Get( "s_occlusion", "1", CVAR_ARCHIVE );
 
-	if( !S_InitAL() )
+	if( !S_InitAL() ) {
+		if( decoding_sounds ) {
+			FinishDecodingSounds( false );
+		}
 		return false;
+	}
 
 	LoadSounds();
 	LoadSoundEffects();
 
+	AddMemoryBudget( "sound", SoundMemoryBudget );
+
 	initialized = true;
 
 	return true;
@@ -561,13 +645,14 @@ void S_Shutdown() {
 	if( !initialized )
 		return;
 
-	S_StopAllSounds( true );
+	RemoveMemoryBudget( "sound" );
 
-	alDeleteSources( ARRAY_COUNT( free_sound_sources ), free_sound_sources );
-	alDeleteSources( 1, &music_source );
+	S_StopAllSounds( true );
+	ShutdownMixer();
 
 	for( u32 i = 0; i < num_sounds; i++ ) {
-		alDeleteBuffers( 1, &sounds[ i ].buf );
+		free( sounds[ i ].samples );
+		FREE( sys_allocator, sounds[ i ].ogg.ptr );
 	}
 
 	CheckALErrors( "S_Shutdown" );
@@ -595,6 +680,145 @@ static const SoundEffect * FindSoundEffect( StringHash name ) {
 	return &sound_effects[ idx ];
 }
 
+static MixerSound ToMixerSound( const Sound & sound ) {
+	MixerSound ms;
+	ms.samples = sound.samples;
+	ms.ogg = sound.ogg;
+	ms.num_frames = sound.num_frames;
+	ms.channels = sound.channels;
+	ms.sample_rate = sound.sample_rate;
+	return ms;
+}
+
+static u32 NewVoiceGeneration() {
+	u32 generation = voice_generation_autoinc;
+	voice_generation_autoinc++;
+	if( voice_generation_autoinc == 0 )
+		voice_generation_autoinc++;
+	return generation;
+}
+
+static float MusicGain() {
+	return s_volume->value * s_musicvolume->value * MusicIsWayTooLoud;
+}
+
+static Vec3 SoundPosition( const PlayingSound * ps ) {
+	switch( ps->type ) {
+		case PlayingSoundType_Position:
+			return ps->origin;
+		case PlayingSoundType_Entity:
+			return entities[ ps->ent_num ].origin;
+		case PlayingSoundType_Line:
+			return ClosestPointOnSegment( ps->origin, ps->end, listener.origin );
+		default:
+			return listener.origin;
+	}
+}
+
+static bool IsOccluded( const PlayingSound * ps ) {
+	if( ps->type == PlayingSoundType_Global || s_occlusion->integer == 0 || cls.state != CA_ACTIVE || cl.cms == NULL )
+		return false;
+
+	Vec3 pos = SoundPosition( ps );
+
+	trace_t tr;
+	CM_TransformedBoxTrace( CM_Client, cl.cms, NULL, &tr, listener.origin, pos, Vec3( 0.0f ), Vec3( 0.0f ), NULL, MASK_SOLID, Vec3( 0.0f ), Vec3( 0.0f ) );
+	if( tr.startsolid )
+		return false;
+
+	// sounds right up against a wall would count as behind it otherwise
+	float dist = Length( pos - listener.origin );
+	return dist * ( 1.0f - tr.fraction ) > 16.0f;
+}
+
+/*
+ * distance attenuation matches the AL_INVERSE_DISTANCE_CLAMPED model we used
+ * before, and the doppler shift uses the same formula as AL. instead of HRTF
+ * the far ear gets a little quieter and hears it a fraction of a millisecond
+ * later, which is most of what your brain uses to place things left/right
+ *
+ * returns the voice's priority, i.e. how loud it is ignoring s_volume
+ */
+static float SpatialiseVoice( const PlayingSound * ps, u8 i, float occlusion, MixerVoice * voice ) {
+	constexpr float SpeedOfSound = 10976.0f;
+	constexpr float HeadShadow = 0.7f;
+	constexpr float MaxInterauralDelay = 0.00066f; // seconds
+	constexpr float OcclusionGainLoss = 0.5f;
+
+	const SoundEffect::PlaybackConfig * config = &ps->sfx->sounds[ i ];
+
+	float gain = ps->volume * config->volume;
+	voice->pitch = 1.0f;
+	voice->lowpass = 0.0f;
+	voice->delay[ 0 ] = 0;
+	voice->delay[ 1 ] = 0;
+
+	if( ps->type == PlayingSoundType_Global ) {
+		voice->gain[ 0 ] = gain * s_volume->value;
+		voice->gain[ 1 ] = gain * s_volume->value;
+		return gain;
+	}
+
+	Vec3 to_source = SoundPosition( ps ) - listener.origin;
+	float dist = Length( to_source );
+	Vec3 dir = dist > 0.01f ? to_source / dist : Vec3( 0.0f );
+
+	float clamped = Clamp( S_DEFAULT_ATTENUATION_REFDISTANCE, dist, S_DEFAULT_ATTENUATION_MAXDISTANCE );
+	gain *= S_DEFAULT_ATTENUATION_REFDISTANCE / ( S_DEFAULT_ATTENUATION_REFDISTANCE + config->attenuation * ( clamped - S_DEFAULT_ATTENUATION_REFDISTANCE ) );
+
+	gain *= 1.0f - OcclusionGainLoss * occlusion;
+	voice->lowpass = occlusion;
+
+	Vec3 source_velocity = ps->type == PlayingSoundType_Entity ? entities[ ps->ent_num ].velocity : Vec3( 0.0f );
+	float listener_speed = Min2( -Dot( dir, listener.velocity ), SpeedOfSound );
+	float source_speed = Min2( -Dot( dir, source_velocity ), SpeedOfSound * 0.5f );
+	voice->pitch = Clamp( 0.5f, ( SpeedOfSound - listener_speed ) / ( SpeedOfSound - source_speed ), 2.0f );
+
+	float pan = Dot( dir, listener.right );
+	voice->gain[ 0 ] = gain * sqrtf( 1.0f - HeadShadow * pan ) * s_volume->value;
+	voice->gain[ 1 ] = gain * sqrtf( 1.0f + HeadShadow * pan ) * s_volume->value;
+
+	u32 delay = u32( fabsf( pan ) * MaxInterauralDelay * output_sample_rate );
+	voice->delay[ 0 ] = pan > 0.0f ? delay : 0;
+	voice->delay[ 1 ] = pan < 0.0f ? delay : 0;
+
+	return gain;
+}
+
+static bool AllocVoice( float priority, u32 * v ) {
+	if( num_free_voices > 0 ) {
+		num_free_voices--;
+		*v = free_voices[ num_free_voices ];
+		return true;
+	}
+
+	// steal the least important voice, if it's less important than us
+	u32 quietest = MUSIC_VOICE;
+	float quietest_priority = priority;
+	for( u32 i = MUSIC_VOICE + 1; i < num_voices; i++ ) {
+		if( voice_priorities[ i ] < quietest_priority ) {
+			quietest = i;
+			quietest_priority = voice_priorities[ i ];
+		}
+	}
+
+	if( quietest == MUSIC_VOICE )
+		return false;
+
+	voices[ quietest ].playing = false;
+	*v = quietest;
+	return true;
+}
+
+static bool VoiceIsOurs( const PlayingSound * ps, u8 i ) {
+	const MixerVoice * voice = &voices[ ps->voices[ i ] ];
+	return voice->playing && voice->generation == ps->generations[ i ];
+}
+
+static bool VoiceFinished( const PlayingSound * ps, u8 i ) {
+	return voice_finished[ ps->voices[ i ] ] == ps->generations[ i ];
+}
+
 static bool StartSound( PlayingSound * ps, u8 i ) {
 	SoundEffect::PlaybackConfig config = ps->sfx->sounds[ i ];
 
@@ -611,69 +835,108 @@ static bool StartSound( PlayingSound * ps, u8 i ) {
 	if( !FindSound( config.sounds[ idx ], &sound ) )
 		return false;
 
-	if( num_free_sound_sources == 0 ) {
-		Com_Printf( S_COLOR_YELLOW "Too many playing sounds!\n" );
+	if( sound.channels != 1 && ps->type != PlayingSoundType_Global ) {
+		Com_Printf( S_COLOR_YELLOW "Positioned sounds must be mono!\n" );
 		return false;
 	}
 
-	if( !sound.mono && ps->type != PlayingSoundType_Global ) {
-		Com_Printf( S_COLOR_YELLOW "Positioned sounds must be mono!\n" );
+	bool occluded = IsOccluded( ps );
+
+	MixerVoice voice = { };
+	voice.sound = ToMixerSound( sound );
+	voice.playing = true;
+	voice.looping = ps->immediate_handle.x != 0;
+	voice.audible = true;
+	float priority = SpatialiseVoice( ps, i, occluded ? 1.0f : 0.0f, &voice );
+
+	u32 v;
+	if( !AllocVoice( priority, &v ) ) {
+		Com_Printf( S_COLOR_YELLOW "Too many playing sounds!\n" );
 		return false;
 	}
 
-	num_free_sound_sources--;
-	ALuint source = free_sound_sources[ num_free_sound_sources ];
-	ps->sources[ i ] = source;
+	voice.generation = NewVoiceGeneration();
+	voices[ v ] = voice;
+	MixerStartVoice( v, voice );
+	voice_priorities[ v ] = priority;
+	voice_occluded[ v ] = occluded;
+	voice_occlusion[ v ] = occluded ? 1.0f : 0.0f;
+	num_voices = Max2( num_voices, v + 1 );
 
-	CheckedALSource( source, AL_BUFFER, sound.buf );
-	CheckedALSource( source, AL_GAIN, ps->volume * config.volume * s_volume->value );
-	CheckedALSource( source, AL_REFERENCE_DISTANCE, S_DEFAULT_ATTENUATION_REFDISTANCE );
-	CheckedALSource( source, AL_MAX_DISTANCE, S_DEFAULT_ATTENUATION_MAXDISTANCE );
-	CheckedALSource( source, AL_ROLLOFF_FACTOR, config.attenuation );
+	ps->voices[ i ] = v;
+	ps->generations[ i ] = voice.generation;
 
-	switch( ps->type ) {
-		case PlayingSoundType_Global:
-			CheckedALSource( source, AL_POSITION, Vec3( 0.0f ) );
-			CheckedALSource( source, AL_VELOCITY, Vec3( 0.0f ) );
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_TRUE );
-			break;
+	return true;
+}
 
-		case PlayingSoundType_Position:
-			CheckedALSource( source, AL_POSITION, ps->origin );
-			CheckedALSource( source, AL_VELOCITY, Vec3( 0.0f ) );
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_FALSE );
-			break;
+static void UpdateSound( const PlayingSound * ps, u8 i ) {
+	constexpr u32 OcclusionFrames = 8; // retrace each voice this often
 
-		case PlayingSoundType_Entity:
-			CheckedALSource( source, AL_POSITION, entities[ ps->ent_num ].origin );
-			CheckedALSource( source, AL_VELOCITY, entities[ ps->ent_num ].velocity );
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_FALSE );
-			break;
+	u32 v = ps->voices[ i ];
 
-		case PlayingSoundType_Line:
-			CheckedALSource( source, AL_POSITION, ps->origin );
-			CheckedALSource( source, AL_VELOCITY, Vec3( 0.0f ) ); // TODO
-			CheckedALSource( source, AL_SOURCE_RELATIVE, AL_FALSE );
-			break;
+	if( v % OcclusionFrames == occlusion_frame % OcclusionFrames ) {
+		voice_occluded[ v ] = IsOccluded( ps );
 	}
 
-	CheckedALSource( source, AL_LOOPING, ps->immediate_handle.x == 0 ? AL_FALSE : AL_TRUE );
-	CheckedALSourcePlay( source );
+	float target = voice_occluded[ v ] ? 1.0f : 0.0f;
+	voice_occlusion[ v ] += ( target - voice_occlusion[ v ] ) * Min2( 1.0f, cls.frametime * 0.008f );
 
-	return true;
+	voice_priorities[ v ] = SpatialiseVoice( ps, i, voice_occlusion[ v ], &voices[ v ] );
 }
 
 static void StopSound( PlayingSound * ps, u8 i ) {
-	CheckedALSourceStop( ps->sources[ i ] );
-	CheckedALSource( ps->sources[ i ], AL_BUFFER, 0 );
-	free_sound_sources[ num_free_sound_sources ] = ps->sources[ i ];
-	num_free_sound_sources++;
+	if( VoiceIsOurs( ps, i ) ) {
+		voices[ ps->voices[ i ] ].playing = false;
+		MixerStopVoice( ps->voices[ i ] );
+		free_voices[ num_free_voices ] = ps->voices[ i ];
+		num_free_voices++;
+	}
 	ps->stopped[ i ] = true;
 }
 
-void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
+static void SendVoiceUpdates() {
 	ZoneScoped;
 
+	constexpr float MinAudiblePriority = 0.001f;
+
+	if( !MixerWantsUpdates() )
+		return;
+
+	/*
+	 * only mix the loudest few. the rest keep going silently so they're in
+	 * the right place if they get loud again
+	 */
+	u32 candidates[ MIXER_MAX_VOICES ];
+	u32 num_candidates = 0;
+	for( u32 i = MUSIC_VOICE + 1; i < num_voices; i++ ) {
+		voices[ i ].audible = false;
+		if( voices[ i ].playing && voice_priorities[ i ] >= MinAudiblePriority ) {
+			candidates[ num_candidates ] = i;
+			num_candidates++;
+		}
+	}
+
+	if( num_candidates > MAX_AUDIBLE_VOICES ) {
+		std::nth_element( candidates, candidates + MAX_AUDIBLE_VOICES, candidates + num_candidates, []( u32 a, u32 b ) {
+			return voice_priorities[ a ] > voice_priorities[ b ];
+		} );
+		num_candidates = MAX_AUDIBLE_VOICES;
+	}
+
+	for( u32 i = 0; i < num_candidates; i++ ) {
+		voices[ candidates[ i ] ].audible = true;
+	}
+
+	for( u32 i = 0; i < num_voices; i++ ) {
+		if( voices[ i ].playing ) {
+			MixerUpdateVoice( i, voices[ i ] );
+		}
+	}
+}
+
+void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
+	ZoneScopedSampled( "S_Update" );
+
 	if( !initialized )
 		return;
 
@@ -686,11 +949,21 @@ void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
 	HotloadSounds();
 	HotloadSoundEffects();
 
-	CheckedALListener( AL_GAIN, IsWindowFocused() || s_muteinbackground->integer == 0 ? 1 : 0 );
+	u32 finished_voice, finished_generation;
+	while( MixerPollFinished( &finished_voice, &finished_generation ) ) {
+		voice_finished[ finished_voice ] = finished_generation;
+	}
+
+	float gain = IsWindowFocused() || s_muteinbackground->integer == 0 ? 1.0f : 0.0f;
+	if( gain != master_gain ) {
+		master_gain = gain;
+		MixerSetMasterGain( gain );
+	}
 
-	CheckedALListener( AL_POSITION, origin );
-	CheckedALListener( AL_VELOCITY, velocity );
-	CheckedALListener( AL_ORIENTATION, axis );
+	listener.origin = origin;
+	listener.velocity = velocity;
+	listener.right = -FromQFAxis( axis, AXIS_RIGHT ); // AXIS_RIGHT points left
+	occlusion_frame++;
 
 	for( size_t i = 0; i < num_playing_sound_effects; i++ ) {
 		PlayingSound * ps = &playing_sound_effects[ i ];
@@ -705,8 +978,7 @@ void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
 				if( ps->stopped[ j ] )
 					continue;
 
-				ALint state = CheckedALGetSource( ps->sources[ j ], AL_SOURCE_STATE );
-				if( not_touched || state == AL_STOPPED ) {
+				if( not_touched || !VoiceIsOurs( ps, j ) || VoiceFinished( ps, j ) ) {
 					StopSound( ps, j );
 				}
 				else {
@@ -749,39 +1021,26 @@ void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis ) {
 		for( u8 j = 0; j < ps->sfx->num_sounds; j++ ) {
 			if( !ps->started[ j ] || ps->stopped[ j ] )
 				continue;
-
-			if( s_volume->modified ) {
-				CheckedALSource( ps->sources[ j ], AL_GAIN, ps->volume * ps->sfx->sounds[ j ].volume * s_volume->value );
-			}
-
-			if( ps->type == PlayingSoundType_Entity ) {
-				CheckedALSource( ps->sources[ j ], AL_POSITION, entities[ ps->ent_num ].origin );
-				CheckedALSource( ps->sources[ j ], AL_VELOCITY, entities[ ps->ent_num ].velocity );
-			}
-			else if( ps->type == PlayingSoundType_Position ) {
-				CheckedALSource( ps->sources[ j ], AL_POSITION, ps->origin );
-			}
-			else if( ps->type == PlayingSoundType_Line ) {
-				Vec3 p = ClosestPointOnSegment( ps->origin, ps->end, origin );
-				CheckedALSource( ps->sources[ j ], AL_POSITION, p );
-			}
+			UpdateSound( ps, j );
 		}
 	}
 
-	if( ( s_volume->modified || s_musicvolume->modified ) && music_playing ) {
-		CheckedALSource( music_source, AL_GAIN, s_volume->value * s_musicvolume->value * MusicIsWayTooLoud );
+	if( music_playing ) {
+		voices[ MUSIC_VOICE ].gain[ 0 ] = MusicGain();
+		voices[ MUSIC_VOICE ].gain[ 1 ] = MusicGain();
 	}
 
-	s_volume->modified = false;
-	s_musicvolume->modified = false;
+	SendVoiceUpdates();
 }
 
-void S_UpdateEntity( int ent_num, Vec3 origin, Vec3 velocity ) {
+void S_UpdateEntities( Span< const int > ent_nums, Span< const Vec3 > origins, Span< const Vec3 > velocities ) {
 	if( !initialized )
 		return;
 
-	entities[ ent_num ].origin  = origin;
-	entities[ ent_num ].velocity = velocity;
+	for( size_t i = 0; i < ent_nums.n; i++ ) {
+		entities[ ent_nums[ i ] ].origin = origins[ i ];
+		entities[ ent_nums[ i ] ].velocity = velocities[ i ];
+	}
 }
 
 static PlayingSound * FindEmptyPlayingSound( int ent_num, int channel ) {
@@ -972,20 +1231,25 @@ void S_StartMenuMusic() {
 	if( music_playing )
 		return;
 
-	CheckedALSource( music_source, AL_GAIN, s_volume->value * s_musicvolume->value * MusicIsWayTooLoud );
-	CheckedALSource( music_source, AL_DIRECT_CHANNELS_SOFT, AL_TRUE );
-	CheckedALSource( music_source, AL_LOOPING, AL_TRUE );
-	CheckedALSource( music_source, AL_BUFFER, sound.buf );
-
-	CheckedALSourcePlay( music_source );
+	MixerVoice * voice = &voices[ MUSIC_VOICE ];
+	*voice = { };
+	voice->sound = ToMixerSound( sound );
+	voice->generation = NewVoiceGeneration();
+	voice->playing = true;
+	voice->looping = true;
+	voice->audible = true;
+	voice->gain[ 0 ] = MusicGain();
+	voice->gain[ 1 ] = MusicGain();
+	voice->pitch = 1.0f;
+	MixerStartVoice( MUSIC_VOICE, *voice );
 
 	music_playing = true;
 }
 
 void S_StopBackgroundTrack() {
 	if( initialized && music_playing ) {
-		CheckedALSourceStop( music_source );
-		CheckedALSource( music_source, AL_BUFFER, 0 );
+		voices[ MUSIC_VOICE ].playing = false;
+		MixerStopVoice( MUSIC_VOICE );
 	}
 	music_playing = false;
 }
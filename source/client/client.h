@@ -43,6 +43,8 @@ constexpr RGBA8 rgba8_diesel_yellow = RGBA8( 255, 204, 38, 255 );
 #define MAX_TIMEDELTAS_BACKUP 8
 #define MASK_TIMEDELTAS_BACKUP ( MAX_TIMEDELTAS_BACKUP - 1 )
 
+#define MAX_SNAP_JITTER_SAMPLES 32
+
 //
 // the client_state_t structure is wiped completely at every
 // server map change
@@ -79,6 +81,14 @@ struct client_state_t {
 	int64_t serverTime;             // the best match we can guess about current time in the server
 	unsigned int snapFrameTime;
 
+	// how far snapshot arrival times wander, and how far behind the server
+	// that makes us render so late snapshots still arrive in time
+	int snapArrivalOffsets[MAX_SNAP_JITTER_SAMPLES];
+	int numSnapArrivalOffsets;
+	float snapJitter;
+	int interpolationDelay;
+	int extrapolatedTime;           // how far past the newest snapshot we are, 0 normally
+
 	//
 	// server state information
 	//
@@ -122,11 +132,17 @@ struct cl_demo_t {
 	char meta_data[SNAP_MAX_DEMO_META_DATA_SIZE];
 	size_t meta_data_realsize;
 
+	// written as we record, and only read from the demo the first time we jump
+	DemoKeyframe keyframes[SNAP_MAX_DEMO_KEYFRAMES];
+	int num_keyframes;
+	bool keyframe_requested;
+	bool keyframes_loaded;
+
 	bool yolo;
 };
 
 struct client_static_t {
-	ArenaAllocator frame_arena;
+	FrameArena frame_arena;
 
 	RNG rng;
 
@@ -141,6 +157,7 @@ struct client_static_t {
 	int64_t gametime;               // always increasing, no clamping, etc
 	int frametime;                  // milliseconds since last frame
 	int realFrameTime;
+	float input_latency;            // smoothed ms from sampling input to the GPU finishing the frame
 
 	socket_t socket_loopback;
 	socket_t socket_udp;
@@ -153,6 +170,12 @@ struct client_static_t {
 	char *servername;               // name of server from original connect
 	socket_type_t servertype;       // socket type used to connect to the server
 	netadr_t serveraddress;         // address of that server
+
+	// configstrings from the last time we were connected, so reconnecting to
+	// the same server only needs the ones that changed
+	char cached_configstrings[MAX_CONFIGSTRINGS][MAX_CONFIGSTRING_CHARS];
+	netadr_t cached_configstrings_address;
+	bool have_cached_configstrings;
 	int64_t connect_time;               // for connection retransmits
 	int connect_count;
 
@@ -215,6 +238,7 @@ extern cvar_t *cl_shownet;
 
 extern cvar_t *cl_extrapolationTime;
 extern cvar_t *cl_extrapolate;
+extern cvar_t *cl_interpolationDelay;
 
 // wsw : debug netcode
 extern cvar_t *cl_debug_serverCmd;
@@ -223,7 +247,7 @@ extern cvar_t *cl_debug_timeDelta;
 extern cvar_t *cl_devtools;
 
 // delta from this if not from a previous frame
-extern SyncEntityState cl_baselines[MAX_EDICTS];
+extern SyncEntityState cl_baselines[MAX_BASELINES];
 
 //=============================================================================
 
@@ -239,12 +263,14 @@ void CL_Netchan_Transmit( msg_t *msg );
 void CL_SendMessagesToServer( bool sendNow );
 void CL_RestartTimeDeltas( int newTimeDelta );
 void CL_AdjustServerTime( unsigned int gamemsec );
+void CL_AddSnapArrival( int64_t serverTime );
 
 void CL_SetKeyDest( keydest_t key_dest );
 void CL_SetOldKeyDest( keydest_t key_dest );
 void CL_ResetServerCount();
 void CL_SetClientState( connstate_t state );
 void CL_ClearState();
+void CL_ClearConfigstrings();
 void CL_ReadPackets();
 void CL_Disconnect_f();
 
@@ -306,7 +332,9 @@ void CL_WriteUcmdsToMessage( msg_t *msg );
 // cl_demo.c
 //
 void CL_WriteDemoMessage( msg_t *msg );
+void CL_RecordDemoKeyframe( const snapshot_t *snap );
 void CL_DemoCompleted();
+void CL_StartDemo( const char *demoname, bool yolo );
 void CL_PlayDemo_f();
 void CL_YoloDemo_f();
 void CL_ReadDemoPackets();
@@ -325,11 +353,13 @@ const char **CL_DemoComplete( const char *partial );
 void CL_ParseServerMessage( msg_t *msg );
 #define SHOWNET( msg,s ) _SHOWNET( msg,s,cl_shownet->integer );
 
+// .zst downloads get decompressed as they arrive, so data is the
+// decompressed file. data.ptr is NULL if it failed, and with save_to set the
+// file goes straight to that path and data is empty
 using DownloadCompleteCallback = void ( * )( const char * filename, Span< const u8 > data );
 
-bool CL_DownloadFile( const char * filename, DownloadCompleteCallback cb );
-bool CL_IsDownloading();
-void CL_CancelDownload();
+bool CL_DownloadFile( const char * filename, DownloadCompleteCallback cb, const char * save_to = NULL );
+void CL_CancelDownloads();
 
 //
 // cl_screen.c
@@ -9,17 +9,56 @@
 // TODO: revamp key_dest garbage
 // TODO: finish cleaning up old stuff
 
-static constexpr size_t CONSOLE_LOG_SIZE = 1000 * 1000; // 1MB
+/*
+ * the log is a ring buffer of text and a ring buffer of lines pointing into
+ * it, so printing never has to shift the whole log down. lines never wrap
+ * around the end of the text buffer, if one doesn't fit it moves to the
+ * start and the tail goes unused
+ *
+ * lines get broken into rows at the console's width when it gets drawn, and
+ * only rows that are on screen get drawn
+ */
+static constexpr size_t CONSOLE_LOG_SIZE = 1024 * 1024; // 1MB
+static constexpr size_t CONSOLE_LOG_LINES = 16 * 1024;
+static constexpr size_t CONSOLE_LOG_ROWS = 32 * 1024;
+static constexpr size_t CONSOLE_MAX_LINE_LENGTH = 16 * 1024;
 static constexpr size_t CONSOLE_INPUT_SIZE = 1024;
 
+// starts are offsets into an infinitely long log, so they never get reused
+struct ConsoleLine {
+	u64 start;
+	u32 length;
+	u32 color;
+	bool finished;
+};
+
+struct ConsoleRow {
+	u64 line;
+	u32 offset;
+	u32 length;
+	u32 color;
+};
+
 struct HistoryEntry {
 	char cmd[ CONSOLE_INPUT_SIZE ];
 };
 
 struct Console {
-	String< CONSOLE_LOG_SIZE > log;
+	char log[ CONSOLE_LOG_SIZE ];
+	u64 log_head;
 	Mutex * log_mutex = NULL;
 
+	ConsoleLine lines[ CONSOLE_LOG_LINES ];
+	u64 first_line;
+	u64 num_lines;
+	u32 print_color;
+
+	ConsoleRow rows[ CONSOLE_LOG_ROWS ];
+	u64 first_row;
+	u64 num_rows;
+	u64 wrapped_lines;
+	float wrap_width;
+
 	char input[ CONSOLE_INPUT_SIZE ];
 
 	bool at_bottom;
@@ -42,7 +81,13 @@ static void Con_ClearInput() {
 void Con_Init() {
 	console.log_mutex = NewMutex();
 
-	console.log.clear();
+	console.log_head = 0;
+	console.first_line = 0;
+	console.num_lines = 0;
+	console.first_row = 0;
+	console.num_rows = 0;
+	console.wrapped_lines = 0;
+	console.wrap_width = 0.0f;
 	Con_ClearInput();
 
 	console.at_bottom = true;
@@ -86,6 +131,71 @@ void Con_Close() {
 	}
 }
 
+static u32 ColorAfterText( u32 color, const char * p, const char * end ) {
+	for( ; p + 5 <= end; p++ ) {
+		if( p[ 0 ] == '\033' && p[ 1 ] && p[ 2 ] && p[ 3 ] && p[ 4 ] ) {
+			const u8 * u = ( const u8 * ) p;
+			color = IM_COL32( u[ 1 ], u[ 2 ], u[ 3 ], u[ 4 ] );
+			p += 4;
+		}
+	}
+	return color;
+}
+
+// drops every line except the last that would get overwritten by writing up to end
+static void TrimLines( u64 end ) {
+	while( console.first_line + 1 < console.num_lines ) {
+		const ConsoleLine * line = &console.lines[ console.first_line % CONSOLE_LOG_LINES ];
+		if( line->start + CONSOLE_LOG_SIZE >= end )
+			break;
+		console.first_line++;
+	}
+}
+
+static ConsoleLine * OpenLine() {
+	if( console.num_lines > console.first_line ) {
+		ConsoleLine * last = &console.lines[ ( console.num_lines - 1 ) % CONSOLE_LOG_LINES ];
+		if( !last->finished )
+			return last;
+	}
+
+	if( console.num_lines - console.first_line == CONSOLE_LOG_LINES ) {
+		console.first_line++;
+	}
+
+	ConsoleLine * line = &console.lines[ console.num_lines % CONSOLE_LOG_LINES ];
+	console.num_lines++;
+
+	line->start = console.log_head;
+	line->length = 0;
+	line->color = console.print_color;
+	line->finished = false;
+
+	return line;
+}
+
+// line has to be the last line
+static void AppendToLine( ConsoleLine * line, const char * str, size_t len ) {
+	len = Min2( len, CONSOLE_MAX_LINE_LENGTH - line->length );
+	if( len == 0 )
+		return;
+
+	if( console.log_head % CONSOLE_LOG_SIZE + len > CONSOLE_LOG_SIZE ) {
+		u64 new_start = console.log_head + CONSOLE_LOG_SIZE - console.log_head % CONSOLE_LOG_SIZE;
+		TrimLines( new_start + line->length + len );
+		memmove( console.log, console.log + line->start % CONSOLE_LOG_SIZE, line->length );
+		line->start = new_start;
+		console.log_head = new_start + line->length;
+	}
+	else {
+		TrimLines( console.log_head + len );
+	}
+
+	memcpy( console.log + console.log_head % CONSOLE_LOG_SIZE, str, len );
+	console.log_head += len;
+	line->length += len;
+}
+
 void Con_Print( const char * str ) {
 	if( console.log_mutex == NULL )
 		return;
@@ -93,22 +203,32 @@ void Con_Print( const char * str ) {
 	Lock( console.log_mutex );
 	defer { Unlock( console.log_mutex ); };
 
-	// delete lines until we have enough space to add str
-	size_t len = strlen( str );
-	size_t trim = 0;
-	while( console.log.length() - trim + len >= CONSOLE_LOG_SIZE ) {
-		const char * newline = StrChrUTF8( console.log.c_str() + trim, '\n' );
-		if( newline == NULL ) {
-			trim = console.log.length();
-			break;
+	// every print starts white, including when it continues an unfinished line
+	console.print_color = IM_COL32( 255, 255, 255, 255 );
+	bool reset_color = true;
+
+	const char * p = str;
+	while( *p != '\0' ) {
+		const char * newline = strchr( p, '\n' );
+		const char * end = newline == NULL ? p + strlen( p ) : newline;
+
+		ConsoleLine * line = OpenLine();
+		if( reset_color && line->length > 0 ) {
+			AppendToLine( line, S_COLOR_WHITE, strlen( S_COLOR_WHITE ) );
 		}
+		reset_color = false;
 
-		trim += newline - ( console.log.c_str() + trim ) + 1;
-	}
+		AppendToLine( line, p, end - p );
+		console.print_color = ColorAfterText( console.print_color, p, end );
 
-	console.log.remove( 0, trim );
-	console.log += S_COLOR_WHITE;
-	console.log.append_raw( str, len );
+		if( newline == NULL ) {
+			p = end;
+		}
+		else {
+			line->finished = true;
+			p = newline + 1;
+		}
+	}
 
 	if( console.at_bottom ) {
 		console.scroll_to_bottom = true;
@@ -303,19 +423,79 @@ static void Con_Execute() {
 	Con_ClearInput();
 }
 
-// break str into small chunks so we can print them individually because the
-// renderer doesn't like large dynamic meshes
-const char * NextChunkEnd( const char * str ) {
-	const char * p = str;
-	while( true ) {
-		p = strchr( p, '\n' );
-		if( p == NULL )
-			break;
-		p++;
-		if( p - str > 512 )
-			return p;
+static void AddRow( u64 line, u32 offset, u32 length, u32 color ) {
+	if( console.num_rows - console.first_row == CONSOLE_LOG_ROWS ) {
+		console.first_row++;
+	}
+
+	ConsoleRow * row = &console.rows[ console.num_rows % CONSOLE_LOG_ROWS ];
+	console.num_rows++;
+
+	row->line = line;
+	row->offset = offset;
+	row->length = length;
+	row->color = color;
+}
+
+static void WrapLine( u64 idx, const ImFont * font, float scale, float width ) {
+	const ConsoleLine * line = &console.lines[ idx % CONSOLE_LOG_LINES ];
+	const char * text = console.log + line->start % CONSOLE_LOG_SIZE;
+	const char * end = text + line->length;
+	u32 color = line->color;
+
+	const char * p = text;
+	do {
+		const char * eol = font->CalcWordWrapPositionA( scale, p, end, width );
+		if( eol == p && p < end ) {
+			// always make progress, even if the console is narrower than one character
+			eol++;
+			while( eol < end && ( *eol & 0xC0 ) == 0x80 ) {
+				eol++;
+			}
+		}
+
+		AddRow( idx, p - text, eol - p, color );
+		color = ColorAfterText( color, p, eol );
+
+		// same as ImGui, whitespace at a wrap point gets eaten
+		p = eol;
+		while( p < end && ( *p == ' ' || *p == '\t' ) ) {
+			p++;
+		}
+	} while( p < end );
+}
+
+// have to hold the log mutex
+static void WrapConsole( float width ) {
+	ZoneScoped;
+
+	if( width != console.wrap_width ) {
+		console.wrap_width = width;
+		console.first_row = 0;
+		console.num_rows = 0;
+		console.wrapped_lines = console.first_line;
+	}
+
+	while( console.first_row < console.num_rows && console.rows[ console.first_row % CONSOLE_LOG_ROWS ].line < console.first_line ) {
+		console.first_row++;
+	}
+
+	// the last line might have grown since we wrapped it
+	while( console.num_rows > console.first_row && console.rows[ ( console.num_rows - 1 ) % CONSOLE_LOG_ROWS ].line >= console.wrapped_lines ) {
+		console.num_rows--;
+	}
+
+	console.wrapped_lines = Max2( console.wrapped_lines, console.first_line );
+
+	const ImFont * font = ImGui::GetFont();
+	float scale = ImGui::GetFontSize() / font->FontSize;
+
+	for( u64 i = console.wrapped_lines; i < console.num_lines; i++ ) {
+		WrapLine( i, font, scale, width );
+		if( console.lines[ i % CONSOLE_LOG_LINES ].finished ) {
+			console.wrapped_lines = i + 1;
+		}
 	}
-	return NULL;
 }
 
 void Con_Draw() {
@@ -336,19 +516,27 @@ void Con_Draw() {
 	{
 		ImGui::PushStyleColor( ImGuiCol_ChildBg, bg );
 		ImGui::PushStyleVar( ImGuiStyleVar_WindowPadding, ImVec2( 8, 4 ) );
-		ImGui::BeginChild( "consoletext", ImVec2( 0, frame_static.viewport_height * 0.4 - ImGui::GetFrameHeightWithSpacing() - 3 ), false, ImGuiWindowFlags_AlwaysUseWindowPadding );
+		// the scrollbar is always there so it doesn't change the wrap width when it appears
+		ImGui::BeginChild( "consoletext", ImVec2( 0, frame_static.viewport_height * 0.4 - ImGui::GetFrameHeightWithSpacing() - 3 ), false, ImGuiWindowFlags_AlwaysUseWindowPadding | ImGuiWindowFlags_AlwaysVerticalScrollbar );
 		{
 			Lock( console.log_mutex );
 			defer { Unlock( console.log_mutex ); };
 
-			ImGui::PushTextWrapPos( 0 );
-			const char * p = console.log.c_str();
-			while( p != NULL ) {
-				const char * end = NextChunkEnd( p );
-				ImGui::TextUnformatted( p, end );
-				p = end;
+			WrapConsole( ImGui::GetContentRegionAvail().x );
+
+			ImGuiListClipper clipper;
+			clipper.Begin( int( console.num_rows - console.first_row ), ImGui::GetTextLineHeight() );
+			while( clipper.Step() ) {
+				for( int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++ ) {
+					const ConsoleRow * row = &console.rows[ ( console.first_row + i ) % CONSOLE_LOG_ROWS ];
+					const ConsoleLine * line = &console.lines[ row->line % CONSOLE_LOG_LINES ];
+					const char * text = console.log + line->start % CONSOLE_LOG_SIZE + row->offset;
+
+					ImGui::PushStyleColor( ImGuiCol_Text, row->color );
+					ImGui::TextUnformatted( text, text + row->length );
+					ImGui::PopStyleColor();
+				}
 			}
-			ImGui::PopTextWrapPos();
 
 			if( console.scroll_to_bottom ) {
 				ImGui::SetScrollHereY( 1.0f );
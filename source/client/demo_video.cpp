@@ -0,0 +1,358 @@
+#include "qcommon/base.h"
+#include "qcommon/async_io.h"
+#include "qcommon/fs.h"
+#include "qcommon/threadpool.h"
+#include "client/client.h"
+#include "client/demo_video.h"
+#include "client/renderer/renderer.h"
+
+#include "stb/stb_image_write.h"
+
+/*
+ * renders a demo to a video one frame at a time. each frame gets read back
+ * into a PBO and left alone until the GPU is done with it, then converted
+ * on the thread pool and written by async IO, so the main thread only
+ * waits when the whole ring is still busy
+ *
+ * png writes one file per frame, y4m and raw write one big file that can
+ * go straight into ffmpeg, e.g. ffmpeg -i 201014_123456.y4m out.mp4
+ */
+
+enum DemoVideoFormat {
+	DemoVideoFormat_PNG,
+	DemoVideoFormat_Y4M,
+	DemoVideoFormat_Raw,
+};
+
+enum FrameSlotState {
+	FrameSlotState_Readback,
+	FrameSlotState_Encoding,
+};
+
+struct FrameSlot {
+	FrameSlotState state;
+	FramebufferReadback readback;
+	JobGroup group;
+
+	DemoVideoFormat format;
+	u32 width, height;
+	RGB8 * pixels;
+	Span< u8 > encoded;
+	u64 frame;
+};
+
+constexpr u32 FRAME_RING_SIZE = 4;
+
+static struct {
+	bool capturing;
+	DemoVideoFormat format;
+	u32 fps;
+	u32 width, height;
+
+	char * dir;
+	int file;
+
+	u64 frames_started;
+	u64 frames_written;
+
+	FrameSlot slots[ FRAME_RING_SIZE ];
+	u32 head, count;
+} video;
+
+static cvar_t * cl_demovideo_fps;
+static cvar_t * cl_demovideo_format;
+
+static void CopyEncodedPNG( void * context, void * png, int png_size ) {
+	FrameSlot * slot = ( FrameSlot * ) context;
+	slot->encoded = ALLOC_SPAN( sys_allocator, u8, png_size );
+	memcpy( slot->encoded.ptr, png, png_size );
+}
+
+static u8 ClampU8( int x ) {
+	return u8( Clamp( 0, x, 255 ) );
+}
+
+// BT.601 studio range, the same as ffmpeg assumes for y4m
+static void EncodeY4M( FrameSlot * slot ) {
+	const char header[] = "FRAME\n";
+	constexpr size_t header_size = sizeof( header ) - 1;
+
+	size_t plane_size = size_t( slot->width ) * slot->height;
+	slot->encoded = ALLOC_SPAN( sys_allocator, u8, header_size + plane_size * 3 );
+	memcpy( slot->encoded.ptr, header, header_size );
+
+	u8 * Y = slot->encoded.ptr + header_size;
+	u8 * U = Y + plane_size;
+	u8 * V = U + plane_size;
+
+	for( u32 y = 0; y < slot->height; y++ ) {
+		// GL reads bottom up
+		const RGB8 * row = slot->pixels + size_t( slot->height - 1 - y ) * slot->width;
+		for( u32 x = 0; x < slot->width; x++ ) {
+			int r = row[ x ].r;
+			int g = row[ x ].g;
+			int b = row[ x ].b;
+			*Y++ = ClampU8( ( ( 66 * r + 129 * g + 25 * b + 128 ) >> 8 ) + 16 );
+			*U++ = ClampU8( ( ( -38 * r - 74 * g + 112 * b + 128 ) >> 8 ) + 128 );
+			*V++ = ClampU8( ( ( 112 * r - 94 * g - 18 * b + 128 ) >> 8 ) + 128 );
+		}
+	}
+}
+
+static void EncodeRaw( FrameSlot * slot ) {
+	size_t row_size = size_t( slot->width ) * sizeof( RGB8 );
+	slot->encoded = ALLOC_SPAN( sys_allocator, u8, row_size * slot->height );
+
+	for( u32 y = 0; y < slot->height; y++ ) {
+		const RGB8 * row = slot->pixels + size_t( slot->height - 1 - y ) * slot->width;
+		memcpy( slot->encoded.ptr + y * row_size, row, row_size );
+	}
+}
+
+static void EncodeFrame( TempAllocator * temp, void * data ) {
+	ZoneScoped;
+
+	FrameSlot * slot = ( FrameSlot * ) data;
+	switch( slot->format ) {
+		case DemoVideoFormat_PNG:
+			stbi_write_png_to_func( CopyEncodedPNG, slot, slot->width, slot->height, 3, slot->pixels, 0 );
+			break;
+		case DemoVideoFormat_Y4M:
+			EncodeY4M( slot );
+			break;
+		case DemoVideoFormat_Raw:
+			EncodeRaw( slot );
+			break;
+	}
+}
+
+static void WriteFrame( FrameSlot * slot ) {
+	if( slot->encoded.ptr == NULL ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't encode demo video frame %" PRIu64 "\n", slot->frame );
+		return;
+	}
+
+	if( video.format == DemoVideoFormat_PNG ) {
+		TempAllocator temp = cls.frame_arena.temp();
+		AsyncWriteFile( temp( "{}/{06}.png", video.dir, slot->frame ), slot->encoded );
+	}
+	else {
+		AsyncFSWrite( video.file, slot->encoded );
+	}
+
+	slot->encoded = Span< u8 >();
+	video.frames_written++;
+}
+
+/*
+ * readbacks finish in the order they were started, so this starts encoding
+ * every frame the GPU is done with, then writes every encoded frame from
+ * the head of the ring. with wait set it blocks until the head frame is
+ * written, which frees up a slot
+ */
+static void PumpFrames( bool wait ) {
+	ZoneScoped;
+
+	for( u32 i = 0; i < video.count; i++ ) {
+		FrameSlot * slot = &video.slots[ ( video.head + i ) % FRAME_RING_SIZE ];
+		if( slot->state != FrameSlotState_Readback )
+			continue;
+
+		if( !FinishFramebufferReadback( &slot->readback, slot->pixels, wait && i == 0 ) )
+			break;
+
+		slot->state = FrameSlotState_Encoding;
+		ThreadPoolDo( &slot->group, EncodeFrame, slot );
+	}
+
+	while( video.count > 0 ) {
+		FrameSlot * slot = &video.slots[ video.head ];
+		if( slot->state != FrameSlotState_Encoding )
+			break;
+
+		if( wait ) {
+			ThreadPoolWait( &slot->group );
+			wait = false;
+		}
+		else if( slot->group.pending.load() != 0 ) {
+			break;
+		}
+
+		WriteFrame( slot );
+
+		video.head = ( video.head + 1 ) % FRAME_RING_SIZE;
+		video.count--;
+	}
+}
+
+static bool ParseFormat( const char * str, DemoVideoFormat * format ) {
+	if( Q_stricmp( str, "png" ) == 0 ) {
+		*format = DemoVideoFormat_PNG;
+		return true;
+	}
+	if( Q_stricmp( str, "y4m" ) == 0 ) {
+		*format = DemoVideoFormat_Y4M;
+		return true;
+	}
+	if( Q_stricmp( str, "raw" ) == 0 ) {
+		*format = DemoVideoFormat_Raw;
+		return true;
+	}
+	return false;
+}
+
+static void StopCapture() {
+	while( video.count > 0 ) {
+		PumpFrames( true );
+	}
+
+	if( video.file != 0 ) {
+		AsyncIOFlush();
+		FS_FCloseFile( video.file );
+		video.file = 0;
+	}
+
+	for( FrameSlot & slot : video.slots ) {
+		DeleteFramebufferReadback( &slot.readback );
+		FREE( sys_allocator, slot.pixels );
+		slot.pixels = NULL;
+	}
+
+	Com_Printf( "Wrote %" PRIu64 " frames to %s\n", video.frames_written, video.dir );
+
+	FREE( sys_allocator, video.dir );
+	video.dir = NULL;
+	video.capturing = false;
+}
+
+static void StartCapture( DemoVideoFormat format ) {
+	TempAllocator temp = cls.frame_arena.temp();
+
+	char date[ 256 ];
+	Sys_FormatTime( date, sizeof( date ), "%y%m%d_%H%M%S" );
+
+	video.format = format;
+	video.fps = u32( Clamp( 1, cl_demovideo_fps->integer, 1000 ) );
+	video.width = frame_static.viewport_width;
+	video.height = frame_static.viewport_height;
+	video.frames_started = 0;
+	video.frames_written = 0;
+	video.head = 0;
+	video.count = 0;
+	video.file = 0;
+
+	const char * path;
+	if( format == DemoVideoFormat_PNG ) {
+		path = temp( "{}/demovideos/{}", HomeDirPath(), date );
+	}
+	else {
+		const char * name = format == DemoVideoFormat_Y4M ? temp( "{}.y4m", date ) : temp( "{}_{}x{}.rgb", date, video.width, video.height );
+		path = temp( "{}/demovideos/{}", HomeDirPath(), name );
+
+		if( FS_FOpenAbsoluteFile( path, &video.file, FS_WRITE ) == -1 ) {
+			Com_Printf( "Couldn't open %s\n", path );
+			video.file = 0;
+			return;
+		}
+
+		if( format == DemoVideoFormat_Y4M ) {
+			const char * header = temp( "YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C444\n", video.width, video.height, video.fps );
+			size_t len = strlen( header );
+			Span< u8 > data = ALLOC_SPAN( sys_allocator, u8, len );
+			memcpy( data.ptr, header, len );
+			AsyncFSWrite( video.file, data );
+		}
+	}
+
+	for( FrameSlot & slot : video.slots ) {
+		slot.pixels = ALLOC_MANY( sys_allocator, RGB8, size_t( video.width ) * video.height );
+	}
+
+	stbi_flip_vertically_on_write( 1 );
+
+	video.dir = CopyString( sys_allocator, path );
+	video.capturing = true;
+
+	Com_Printf( "Capturing demo to %s at %u fps, run demovideo again to stop\n", path, video.fps );
+}
+
+static void DemoVideo_f() {
+	if( video.capturing ) {
+		StopCapture();
+		return;
+	}
+
+	if( !cls.demo.playing ) {
+		Com_Printf( "You can only capture while playing a demo\n" );
+		return;
+	}
+
+	const char * format_str = Cmd_Argc() > 1 ? Cmd_Argv( 1 ) : cl_demovideo_format->string;
+	DemoVideoFormat format;
+	if( !ParseFormat( format_str, &format ) ) {
+		Com_Printf( "Usage: %s [png|y4m|raw]\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	StartCapture( format );
+}
+
+void InitDemoVideo() {
+	cl_demovideo_fps = Cvar_Get( "cl_demovideo_fps", "60", CVAR_ARCHIVE );
+	cl_demovideo_format = Cvar_Get( "cl_demovideo_format", "png", CVAR_ARCHIVE );
+
+	Cmd_AddCommand( "demovideo", DemoVideo_f );
+}
+
+void ShutdownDemoVideo() {
+	if( video.capturing ) {
+		StopCapture();
+	}
+
+	Cmd_RemoveCommand( "demovideo" );
+}
+
+bool DemoVideoCapturing() {
+	return video.capturing;
+}
+
+// frame n covers [n * 1000 / fps, (n + 1) * 1000 / fps) so the rounding never drifts
+int DemoVideoFrameMsec() {
+	u64 n = video.frames_started;
+	return int( ( n + 1 ) * 1000 / video.fps - n * 1000 / video.fps );
+}
+
+void DemoVideoFrame() {
+	ZoneScoped;
+
+	if( !video.capturing )
+		return;
+
+	if( !cls.demo.playing ) {
+		StopCapture();
+		return;
+	}
+
+	if( frame_static.viewport_width != video.width || frame_static.viewport_height != video.height ) {
+		Com_Printf( S_COLOR_YELLOW "The window changed size, stopping demo capture\n" );
+		StopCapture();
+		return;
+	}
+
+	PumpFrames( false );
+	if( video.count == FRAME_RING_SIZE ) {
+		PumpFrames( true );
+	}
+
+	FrameSlot * slot = &video.slots[ ( video.head + video.count ) % FRAME_RING_SIZE ];
+	slot->state = FrameSlotState_Readback;
+	slot->format = video.format;
+	slot->width = video.width;
+	slot->height = video.height;
+	slot->frame = video.frames_started;
+
+	StartFramebufferReadback( &slot->readback );
+
+	video.count++;
+	video.frames_started++;
+}
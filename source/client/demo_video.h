@@ -0,0 +1,17 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+void InitDemoVideo();
+void ShutdownDemoVideo();
+
+/*
+ * while capturing, every client frame advances the demo by exactly one
+ * video frame no matter how long it took to draw, so CL_Frame asks for the
+ * frame's msec instead of using the real frame time
+ */
+bool DemoVideoCapturing();
+int DemoVideoFrameMsec();
+
+// call once the frame has been submitted, before swapping buffers
+void DemoVideoFrame();
@@ -1,14 +1,20 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
 #include "qcommon/array.h"
+#include "qcommon/compression.h"
+#include "qcommon/fs.h"
+#include "qcommon/hash.h"
+#include "qcommon/string.h"
 
 #include "client/downloads.h"
 
 #define CURL_STATICLIB
 #include "curl/curl.h"
 
+static constexpr size_t MAX_DOWNLOADS = 16;
+static constexpr int MAX_DOWNLOAD_RETRIES = 3;
+
 static CURLM * curl;
-static CURL * request;
 
 /*
  * the headers curl_slist needs to stay alive for the entire request and
@@ -17,11 +23,36 @@ static CURL * request;
  * https://curl-library.cool.haxx.narkive.com/RJBkHeNm/http-headers-free-and-multi lol
  */
 struct CurlRequestContext {
-	NonRAIIDynamicArray< u8 > data;
-	CurlDoneCallback done_callback;
+	CURL * request;
+	char * url;
 	curl_slist * headers;
+
+	CurlDoneCallback done_callback;
+	void * user;
+
+	bool decompress;
+	DecompressionStream * zstd;
+	NonRAIIDynamicArray< u8 > data;
+
+	char * save_to;
+	char * partial_path; // save_to.part until it's done
+	FILE * file;
+
+	// everything below is about the raw bytes off the wire, which is what
+	// range requests count in
+	size_t received;
+	u64 hash;
+	int retries;
+	bool response_started;
+
+	String< 64 > etag;
+	bool has_expected_hash;
+	u64 expected_hash;
 };
 
+static CurlRequestContext * requests[ MAX_DOWNLOADS ];
+static size_t num_requests;
+
 static void CheckEasyError( const char * func, CURLcode err ) {
 	if( err != CURLE_OK ) {
 		Fatal( "Curl error in %s: %s (%d)", func, curl_easy_strerror( err ), err );
@@ -43,11 +74,11 @@ void InitDownloads() {
 
 	CheckMultiError( "curl_multi_setopt", curl_multi_setopt( curl, CURLMOPT_MAX_TOTAL_CONNECTIONS, 8l ) );
 
-	request = NULL;
+	num_requests = 0;
 }
 
 void ShutdownDownloads() {
-	CancelDownload();
+	CancelAllDownloads();
 	curl_multi_cleanup( curl );
 	curl_global_cleanup();
 }
@@ -63,70 +94,303 @@ static void CheckedEasyOpt( CURL * request, CURLoption opt, T val ) {
 	CheckEasyError( "curl_easy_setopt", curl_easy_setopt( request, opt, val ) );
 }
 
-static size_t CurlDataCallback( char * data, size_t size, size_t nmemb, void * user_data ) {
+static bool StoreDownloadedData( void * user_data, Span< const u8 > data ) {
+	CurlRequestContext * context = ( CurlRequestContext * ) user_data;
+
+	if( context->file != NULL ) {
+		return WritePartialFile( context->file, data.ptr, data.n );
+	}
+
+	constexpr size_t DOWNLOAD_MAX_DECOMPRESSED_SIZE = 250 * 1000 * 1000; // 250MB
+	if( context->data.size() + data.n > DOWNLOAD_MAX_DECOMPRESSED_SIZE ) {
+		return false;
+	}
+
+	size_t old_size = context->data.extend( data.n );
+	memcpy( context->data.ptr() + old_size, data.ptr, data.n );
+
+	return true;
+}
+
+// throws away everything we got so far, for when the server ignores our range
+static bool RestartDownloadedData( CurlRequestContext * context ) {
+	context->received = 0;
+	context->hash = Hash64Incremental( NULL, 0 );
+	context->data.clear();
+
+	if( context->decompress ) {
+		DeleteDecompressionStream( context->zstd );
+		context->zstd = NewDecompressionStream( sys_allocator );
+	}
+
+	if( context->file != NULL ) {
+		fclose( context->file );
+		context->file = OpenFile( sys_allocator, context->partial_path, "wb" );
+		if( context->file == NULL ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static size_t CurlHeaderCallback( char * data, size_t size, size_t nmemb, void * user_data ) {
 	CurlRequestContext * context = ( CurlRequestContext * ) user_data;
 	size_t len = size * nmemb;
 
-	constexpr size_t DOWNLOAD_MAX_SIZE = 50 * 1000 * 1000; // 50MB
-	if( context->data.size() + len > DOWNLOAD_MAX_SIZE ) {
-		return 0;
+	Span< const char > line = Span< const char >( data, len );
+	while( line.n > 0 && ( line[ line.n - 1 ] == '\r' || line[ line.n - 1 ] == '\n' ) ) {
+		line.n--;
 	}
 
-	size_t old_size = context->data.extend( len );
-	memcpy( context->data.ptr() + old_size, data, len );
+	// every response starts with a status line, including redirects
+	if( StartsWith( line, "HTTP/" ) ) {
+		context->has_expected_hash = false;
+		return len;
+	}
+
+	const char * colon = ( const char * ) memchr( line.ptr, ':', line.n );
+	if( colon == NULL ) {
+		return len;
+	}
+
+	Span< const char > key = line.slice( 0, colon - line.ptr );
+	Span< const char > value = line.slice( colon - line.ptr + 1, line.n );
+	while( value.n > 0 && value[ 0 ] == ' ' ) {
+		value = value + 1;
+	}
+
+	if( StrCaseEqual( key, "ETag" ) ) {
+		context->etag.format( "{}", value );
+	}
+	else if( StrCaseEqual( key, "X-Content-Hash" ) ) {
+		char buf[ 17 ];
+		ggformat( buf, sizeof( buf ), "{}", value );
+		context->expected_hash = strtoull( buf, NULL, 16 );
+		context->has_expected_hash = true;
+	}
 
 	return len;
 }
 
-void StartDownload( const char * url, CurlDoneCallback done_callback, const char ** headers, size_t num_headers ) {
-	request = curl_easy_init();
-	if( request == NULL ) {
-		Fatal( "curl_easy_init" );
-	}
+static size_t CurlDataCallback( char * data, size_t size, size_t nmemb, void * user_data ) {
+	CurlRequestContext * context = ( CurlRequestContext * ) user_data;
+	size_t len = size * nmemb;
 
-	CurlRequestContext * context = ALLOC( sys_allocator, CurlRequestContext );
-	context->data.init( sys_allocator );
-	context->done_callback = done_callback;
-	context->headers = NULL;
+	long http_status;
+	CheckEasyError( "curl_easy_getinfo", curl_easy_getinfo( context->request, CURLINFO_RESPONSE_CODE, &http_status ) );
 
-	for( size_t i = 0; i < num_headers; i++ ) {
-		context->headers = curl_slist_append( context->headers, headers[ i ] );
-		if( context->headers == NULL ) {
-			Fatal( "curl_slist_append" );
+	// don't keep error pages
+	if( http_status / 100 != 2 ) {
+		return len;
+	}
+
+	if( !context->response_started ) {
+		context->response_started = true;
+		if( http_status != 206 && context->received > 0 && !RestartDownloadedData( context ) ) {
+			return 0;
 		}
 	}
 
-	CheckedEasyOpt( request, CURLOPT_URL, url );
+	constexpr size_t DOWNLOAD_MAX_SIZE = 50 * 1000 * 1000; // 50MB
+	if( context->received + len > DOWNLOAD_MAX_SIZE ) {
+		return 0;
+	}
+	context->received += len;
+	context->hash = Hash64Incremental( data, len, context->hash );
+
+	Span< const u8 > received = Span< const u8 >( ( const u8 * ) data, len );
+	if( context->zstd != NULL ) {
+		if( !DecompressStream( context->zstd, "download", received, StoreDownloadedData, context ) )
+			return 0;
+		return len;
+	}
+
+	return StoreDownloadedData( context, received ) ? len : 0;
+}
+
+static void StartRequest( CurlRequestContext * context ) {
+	context->request = curl_easy_init();
+	if( context->request == NULL ) {
+		Fatal( "curl_easy_init" );
+	}
+
+	context->response_started = false;
+
+	CURL * request = context->request;
+	CheckedEasyOpt( request, CURLOPT_URL, context->url );
 	CheckedEasyOpt( request, CURLOPT_HTTPHEADER, context->headers );
 	CheckedEasyOpt( request, CURLOPT_WRITEFUNCTION, CurlDataCallback );
+	CheckedEasyOpt( request, CURLOPT_HEADERFUNCTION, CurlHeaderCallback );
 	CheckedEasyOpt( request, CURLOPT_FOLLOWLOCATION, 1l );
 	CheckedEasyOpt( request, CURLOPT_NOSIGNAL, 1l );
 	CheckedEasyOpt( request, CURLOPT_CONNECTTIMEOUT, 10l );
 	CheckedEasyOpt( request, CURLOPT_LOW_SPEED_TIME, 10l );
 	CheckedEasyOpt( request, CURLOPT_LOW_SPEED_LIMIT, 10l );
+	CheckedEasyOpt( request, CURLOPT_RESUME_FROM_LARGE, curl_off_t( context->received ) );
 
 	CheckedEasyOpt( request, CURLOPT_WRITEDATA, context );
+	CheckedEasyOpt( request, CURLOPT_HEADERDATA, context );
 	CheckedEasyOpt( request, CURLOPT_PRIVATE, context );
 
 	CheckMultiError( "curl_multi_add_handle", curl_multi_add_handle( curl, request ) );
 }
 
-void CancelDownload() {
-	if( request == NULL )
-		return;
+static void StopRequest( CurlRequestContext * context ) {
+	CheckMultiError( "curl_multi_remove_handle", curl_multi_remove_handle( curl, context->request ) );
+	curl_easy_cleanup( context->request );
+	context->request = NULL;
+}
 
-	CurlRequestContext * context;
-	CheckEasyError( "curl_easy_getinfo", curl_easy_getinfo( request, CURLINFO_PRIVATE, &context ) );
+static void DeleteRequest( CurlRequestContext * context ) {
+	if( context->request != NULL ) {
+		StopRequest( context );
+	}
 
-	CheckMultiError( "curl_multi_remove_handle", curl_multi_remove_handle( curl, request ) );
-	curl_easy_cleanup( request );
-	request = NULL;
+	if( context->file != NULL ) {
+		fclose( context->file );
+		RemoveFile( sys_allocator, context->partial_path );
+	}
 
 	curl_slist_free_all( context->headers );
+	DeleteDecompressionStream( context->zstd );
 	context->data.shutdown();
+	FREE( sys_allocator, context->url );
+	FREE( sys_allocator, context->save_to );
+	FREE( sys_allocator, context->partial_path );
+
+	for( size_t i = 0; i < num_requests; i++ ) {
+		if( requests[ i ] == context ) {
+			requests[ i ] = requests[ num_requests - 1 ];
+			num_requests--;
+			break;
+		}
+	}
+
+	context->~CurlRequestContext();
 	FREE( sys_allocator, context );
 }
 
+void StartDownload( const char * url, CurlDoneCallback done_callback, void * user,
+		const char ** headers, size_t num_headers, bool decompress, const char * save_to ) {
+	if( num_requests == ARRAY_COUNT( requests ) ) {
+		Com_Printf( "Too many downloads\n" );
+		done_callback( user, 0, Span< const u8 >() );
+		return;
+	}
+
+	CurlRequestContext * context = new ( ALLOC( sys_allocator, CurlRequestContext ) ) CurlRequestContext();
+	context->request = NULL;
+	context->url = CopyString( sys_allocator, url );
+	context->headers = NULL;
+	context->done_callback = done_callback;
+	context->user = user;
+	context->decompress = decompress;
+	context->zstd = decompress ? NewDecompressionStream( sys_allocator ) : NULL;
+	context->data.init( sys_allocator );
+	context->save_to = NULL;
+	context->partial_path = NULL;
+	context->file = NULL;
+	context->received = 0;
+	context->hash = Hash64Incremental( NULL, 0 );
+	context->retries = 0;
+	context->has_expected_hash = false;
+
+	for( size_t i = 0; i < num_headers; i++ ) {
+		context->headers = curl_slist_append( context->headers, headers[ i ] );
+		if( context->headers == NULL ) {
+			Fatal( "curl_slist_append" );
+		}
+	}
+
+	requests[ num_requests ] = context;
+	num_requests++;
+
+	if( save_to != NULL ) {
+		context->save_to = CopyString( sys_allocator, save_to );
+		context->partial_path = ( *sys_allocator )( "{}.part", save_to );
+		if( CreatePathForFile( sys_allocator, context->partial_path ) ) {
+			context->file = OpenFile( sys_allocator, context->partial_path, "wb" );
+		}
+		if( context->file == NULL ) {
+			Com_Printf( "Couldn't open %s for writing\n", context->partial_path );
+			done_callback( user, 0, Span< const u8 >() );
+			DeleteRequest( context );
+			return;
+		}
+	}
+
+	StartRequest( context );
+}
+
+void CancelAllDownloads() {
+	while( num_requests > 0 ) {
+		DeleteRequest( requests[ 0 ] );
+	}
+}
+
+// carry on from where the connection dropped, if the file hasn't changed
+static bool RetryRequest( CurlRequestContext * context, CURLcode result ) {
+	if( context->retries >= MAX_DOWNLOAD_RETRIES )
+		return false;
+
+	// we stopped it ourselves
+	if( result == CURLE_OK || result == CURLE_WRITE_ERROR )
+		return false;
+
+	context->retries++;
+	StopRequest( context );
+
+	if( context->received > 0 && context->etag.length() > 0 ) {
+		curl_slist * headers = NULL;
+		for( curl_slist * header = context->headers; header != NULL; header = header->next ) {
+			if( !StartsWith( header->data, "If-Range:" ) ) {
+				headers = curl_slist_append( headers, header->data );
+			}
+		}
+
+		String< 128 > if_range( "If-Range: {}", context->etag );
+		headers = curl_slist_append( headers, if_range.c_str() );
+		if( headers == NULL ) {
+			Fatal( "curl_slist_append" );
+		}
+
+		curl_slist_free_all( context->headers );
+		context->headers = headers;
+
+		Com_Printf( "Resuming download of %s from %zu bytes\n", context->url, context->received );
+	}
+	else if( !RestartDownloadedData( context ) ) {
+		return false;
+	}
+
+	StartRequest( context );
+	return true;
+}
+
+static bool FinishRequest( CurlRequestContext * context ) {
+	if( context->zstd != NULL && !DecompressionStreamFinished( context->zstd ) ) {
+		return false;
+	}
+
+	if( context->has_expected_hash && context->hash != context->expected_hash ) {
+		Com_Printf( S_COLOR_RED "Download of %s is corrupt\n", context->url );
+		return false;
+	}
+
+	if( context->save_to != NULL ) {
+		fclose( context->file );
+		context->file = NULL;
+
+		if( !MoveFile( sys_allocator, context->partial_path, context->save_to, MoveFile_DoReplace ) ) {
+			RemoveFile( sys_allocator, context->partial_path );
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void PumpDownloads() {
 	while( true ) {
 		int dont_care;
@@ -150,13 +414,18 @@ void PumpDownloads() {
 		long http_status;
 		CheckEasyError( "curl_easy_getinfo", curl_easy_getinfo( msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_status ) );
 
-		if( msg->data.result == CURLE_OK && http_status / 100 == 2 ) {
-			context->done_callback( http_status, context->data.span() );
+		CURLcode result = msg->data.result;
+		if( RetryRequest( context, result ) )
+			continue;
+
+		if( result == CURLE_OK && http_status / 100 == 2 && FinishRequest( context ) ) {
+			Span< const u8 > data = context->save_to != NULL ? Span< const u8 >( ( const u8 * ) "", 0 ) : context->data.span();
+			context->done_callback( context->user, http_status, data );
 		}
 		else {
-			context->done_callback( http_status, Span< const u8 >() );
+			context->done_callback( context->user, http_status, Span< const u8 >() );
 		}
 
-		CancelDownload();
+		DeleteRequest( context );
 	}
 }
@@ -2,11 +2,23 @@
 
 #include "qcommon/types.h"
 
-using CurlDoneCallback = void ( * )( int http_status, Span< const u8 > data );
+// data.ptr is NULL if the download failed, and empty if it went to disk
+using CurlDoneCallback = void ( * )( void * user, int http_status, Span< const u8 > data );
 
 void InitDownloads();
 void ShutdownDownloads();
 
-void StartDownload( const char * url, CurlDoneCallback done_callback, const char ** headers, size_t num_headers );
-void CancelDownload();
+/*
+ * any number of downloads can be in flight at once, and they get resumed
+ * with a range request if the connection drops partway through. if the
+ * server sends X-Content-Hash the download fails unless it matches
+ *
+ * with decompress set the download gets unzstd'd as it arrives and the
+ * callback gets the decompressed data. with save_to set the data goes
+ * straight to disk instead of memory, and only replaces save_to once the
+ * whole thing has arrived
+ */
+void StartDownload( const char * url, CurlDoneCallback done_callback, void * user,
+	const char ** headers, size_t num_headers, bool decompress = false, const char * save_to = NULL );
+void CancelAllDownloads();
 void PumpDownloads();
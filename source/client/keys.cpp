@@ -154,6 +154,8 @@ void Key_SetBinding( int keynum, const char *binding ) {
 	if( binding != NULL ) {
 		keybindings[keynum] = ZoneCopyString( binding );
 	}
+
+	config_modified = true;
 }
 
 static void Key_Unbind_f() {
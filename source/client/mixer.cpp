@@ -0,0 +1,751 @@
+#include <atomic>
+#include <math.h>
+#include <emmintrin.h>
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/threads.h"
+#include "qcommon/spsc_queue.h"
+#include "client/mixer.h"
+
+#define AL_LIBTYPE_STATIC
+#include "openal/al.h"
+#include "openal/alc.h"
+#include "openal/alext.h"
+
+#define STB_VORBIS_HEADER_ONLY
+#include "stb/stb_vorbis.h"
+
+/*
+ * OpenAL only sees one stereo source with a few buffers queued on it. the
+ * mixer thread waits for AL to finish with a buffer, mixes the next block of
+ * every voice into it and queues it back up
+ *
+ * commands only get applied between blocks, so once the mixer has reached
+ * a sync command nothing can still be reading samples from voices that were
+ * stopped before it
+ *
+ * streamed voices get a Stream, which the decoder thread keeps topped up
+ * with a second or so of PCM. the mixer only moves read_pos and the decoder
+ * only moves write_pos. the mixer hands streams over by setting them to
+ * Opening/Closing and only the decoder ever touches the stb_vorbis, which
+ * also means a sync has to wait for the decoder to let go of closed streams
+ */
+
+constexpr u32 MIX_FRAMES = 512; // multiple of 4
+constexpr u32 NUM_STREAM_BUFFERS = 4;
+
+constexpr u32 MAX_STREAMS = 16;
+constexpr u32 STREAM_RING_FRAMES = 32768; // power of 2
+constexpr u32 STREAM_DECODE_FRAMES = 4096;
+constexpr u32 STREAM_WINDOW_FRAMES = 4096; // enough for 4x pitch
+
+enum MixerCommandType {
+	MixerCommand_Start,
+	MixerCommand_Update,
+	MixerCommand_Stop,
+	MixerCommand_MasterGain,
+	MixerCommand_Sync,
+};
+
+struct MixerCommand {
+	MixerCommandType type;
+	u32 idx;
+	MixerVoice voice;
+	float master_gain;
+	u64 sync;
+};
+
+struct FinishedVoice {
+	u32 idx;
+	u32 generation;
+};
+
+enum StreamState {
+	StreamState_Free,
+	StreamState_Opening,
+	StreamState_Active,
+	StreamState_Closing,
+};
+
+struct Stream {
+	std::atomic< int > state;
+
+	Span< const u8 > ogg;
+	u32 channels;
+	bool looping;
+	stb_vorbis * decoder;
+
+	std::atomic< u64 > read_pos;
+	std::atomic< u64 > write_pos;
+	std::atomic< bool > ended;
+
+	s16 ring[ STREAM_RING_FRAMES * 2 ];
+};
+
+struct VoiceState {
+	u32 generation;
+	bool finished;
+	bool reported;
+	Stream * stream;
+	double cursor;
+	float gain[ 2 ];
+	float lowpass_state[ 2 ];
+	float history[ MIXER_MAX_DELAY ];
+};
+
+static ALuint stream_source;
+static ALuint stream_buffers[ NUM_STREAM_BUFFERS ];
+static u32 output_sample_rate;
+
+static SPSCQueue< MixerCommand, 8192 > commands;
+static SPSCQueue< FinishedVoice, MIXER_MAX_VOICES * 2 > finished_voices;
+
+static std::atomic< u64 > blocks_started;
+static std::atomic< u64 > syncs_done;
+static Semaphore * sync_sem;
+
+static Thread * mixer_thread;
+static Thread * decoder_thread;
+static Semaphore * decoder_sem;
+static std::atomic< bool > shutting_down;
+
+static Stream streams[ MAX_STREAMS ];
+
+// main thread
+static u64 blocks_seen;
+static u64 syncs_sent;
+
+// mixer thread
+static MixerVoice voices[ MIXER_MAX_VOICES ];
+static VoiceState states[ MIXER_MAX_VOICES ];
+static u32 num_voices;
+static float master_gain;
+static float mixed_master_gain;
+static u64 pending_sync;
+
+alignas( 16 ) static float mix[ 2 ][ MIX_FRAMES ];
+alignas( 16 ) static float scratch[ 2 ][ MIXER_MAX_DELAY + MIX_FRAMES ];
+alignas( 16 ) static s16 output[ MIX_FRAMES * 2 ];
+static s16 stream_window[ STREAM_WINDOW_FRAMES * 2 ];
+
+/*
+ * linear interpolation, four frames at a time. the gathers are scalar but
+ * everything else is SIMD. it goes a frame at a time near the end so it can
+ * wrap or zero the second sample, returns how many frames it wrote
+ */
+template< u32 channels >
+static u32 Resample( const MixerSound * sound, bool looping, double * cursor, float step, float * const * out ) {
+	const __m128 lane_steps = _mm_mul_ps( _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f ), _mm_set1_ps( step ) );
+	const __m128 to_float = _mm_set1_ps( 1.0f / 32768.0f );
+
+	double pos = *cursor;
+	u32 written = 0;
+
+	while( written < MIX_FRAMES ) {
+		if( pos >= sound->num_frames ) {
+			if( !looping )
+				break;
+			pos = fmod( pos, double( sound->num_frames ) );
+		}
+
+		u32 base = u32( pos );
+		float frac = float( pos - base );
+
+		// one frame of slack so rounding can't read past the end
+		double room = ( double( sound->num_frames ) - 1.0 - pos ) / step - 1.0;
+		u32 batch = room > 0.0 ? u32( Min2( room, double( MIX_FRAMES - written ) ) ) & ~3u : 0;
+
+		if( batch > 0 ) {
+			const s16 * src = sound->samples + base * channels;
+			for( u32 i = 0; i < batch; i += 4 ) {
+				__m128 p = _mm_add_ps( _mm_set1_ps( frac + i * step ), lane_steps );
+				__m128i idx = _mm_cvttps_epi32( p );
+				__m128 t = _mm_sub_ps( p, _mm_cvtepi32_ps( idx ) );
+
+				alignas( 16 ) s32 lanes[ 4 ];
+				_mm_store_si128( ( __m128i * ) lanes, idx );
+
+				for( u32 c = 0; c < channels; c++ ) {
+					const s16 * a = src + c;
+					const s16 * b = src + channels + c;
+					__m128 s0 = _mm_set_ps( a[ lanes[ 3 ] * channels ], a[ lanes[ 2 ] * channels ], a[ lanes[ 1 ] * channels ], a[ lanes[ 0 ] * channels ] );
+					__m128 s1 = _mm_set_ps( b[ lanes[ 3 ] * channels ], b[ lanes[ 2 ] * channels ], b[ lanes[ 1 ] * channels ], b[ lanes[ 0 ] * channels ] );
+					__m128 s = _mm_add_ps( s0, _mm_mul_ps( _mm_sub_ps( s1, s0 ), t ) );
+					_mm_storeu_ps( out[ c ] + written + i, _mm_mul_ps( s, to_float ) );
+				}
+			}
+
+			written += batch;
+			pos += batch * double( step );
+			continue;
+		}
+
+		u32 next = base + 1;
+		bool have_next = next < sound->num_frames || looping;
+		next %= sound->num_frames;
+
+		for( u32 c = 0; c < channels; c++ ) {
+			float s0 = sound->samples[ base * channels + c ];
+			float s1 = have_next ? sound->samples[ next * channels + c ] : 0.0f;
+			out[ c ][ written ] = ( s0 + ( s1 - s0 ) * frac ) * ( 1.0f / 32768.0f );
+		}
+
+		written++;
+		pos += step;
+	}
+
+	*cursor = pos;
+	return written;
+}
+
+static void Lowpass( float * samples, float * state, float amount ) {
+	float y = *state;
+	if( amount > 0.0f ) {
+		float a = 1.0f - amount * 0.9f;
+		for( u32 i = 0; i < MIX_FRAMES; i++ ) {
+			y += a * ( samples[ i ] - y );
+			samples[ i ] = y;
+		}
+	}
+	else {
+		y = samples[ MIX_FRAMES - 1 ];
+	}
+	*state = y;
+}
+
+// ramps the gain across the block so moving sounds don't zipper
+static void MixInto( float * dst, const float * src, float from, float to ) {
+	float dg = ( to - from ) / MIX_FRAMES;
+	__m128 gain = _mm_add_ps( _mm_set1_ps( from ), _mm_mul_ps( _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f ), _mm_set1_ps( dg ) ) );
+	__m128 dg4 = _mm_set1_ps( dg * 4.0f );
+
+	for( u32 i = 0; i < MIX_FRAMES; i += 4 ) {
+		_mm_store_ps( dst + i, _mm_add_ps( _mm_load_ps( dst + i ), _mm_mul_ps( _mm_loadu_ps( src + i ), gain ) ) );
+		gain = _mm_add_ps( gain, dg4 );
+	}
+}
+
+static void AdvanceVoice( const MixerVoice * voice, VoiceState * state, float step ) {
+	state->cursor += step * double( MIX_FRAMES );
+	if( state->cursor >= voice->sound.num_frames ) {
+		if( voice->looping ) {
+			state->cursor = fmod( state->cursor, double( voice->sound.num_frames ) );
+		}
+		else {
+			state->finished = true;
+		}
+	}
+}
+
+static bool OpenStream( const MixerVoice * voice, VoiceState * state ) {
+	if( voice->sound.channels > 2 )
+		return false;
+
+	for( Stream & stream : streams ) {
+		if( stream.state.load( std::memory_order_acquire ) != StreamState_Free )
+			continue;
+
+		stream.ogg = voice->sound.ogg;
+		stream.channels = voice->sound.channels;
+		stream.looping = voice->looping;
+		stream.read_pos.store( 0, std::memory_order_relaxed );
+		stream.write_pos.store( 0, std::memory_order_relaxed );
+		stream.ended.store( false, std::memory_order_relaxed );
+		stream.state.store( StreamState_Opening, std::memory_order_release );
+
+		state->stream = &stream;
+		return true;
+	}
+
+	return false;
+}
+
+static void CloseStream( VoiceState * state ) {
+	if( state->stream == NULL )
+		return;
+	state->stream->state.store( StreamState_Closing, std::memory_order_release );
+	state->stream = NULL;
+}
+
+/*
+ * copies the frames this block needs out of the ring and resamples them
+ * like any other sound. if the decoder is behind it plays silence rather
+ * than ending the voice
+ */
+static u32 ReadStream( const MixerVoice * voice, VoiceState * state, float step, float * const * out ) {
+	Stream * stream = state->stream;
+	u32 channels = stream->channels;
+
+	// ended first, so we can't see it without the frames written before it
+	bool ended = stream->ended.load( std::memory_order_acquire );
+	u64 read = stream->read_pos.load( std::memory_order_relaxed );
+	u64 write = stream->write_pos.load( std::memory_order_acquire );
+
+	u32 needed = Min2( u32( state->cursor + step * ( MIX_FRAMES - 1 ) ) + 2, STREAM_WINDOW_FRAMES );
+	u32 available = u32( Min2( write - read, u64( needed ) ) );
+
+	if( available < needed && !ended ) {
+		for( u32 c = 0; c < channels; c++ ) {
+			memset( out[ c ], 0, MIX_FRAMES * sizeof( float ) );
+		}
+		return MIX_FRAMES;
+	}
+
+	u32 start = read % STREAM_RING_FRAMES;
+	u32 first = Min2( available, STREAM_RING_FRAMES - start );
+	memcpy( stream_window, stream->ring + start * channels, first * channels * sizeof( s16 ) );
+	memcpy( stream_window + first * channels, stream->ring, ( available - first ) * channels * sizeof( s16 ) );
+
+	MixerSound window = voice->sound;
+	window.samples = stream_window;
+	window.ogg = Span< const u8 >();
+	window.num_frames = available;
+
+	double cursor = state->cursor;
+	u32 written = channels == 1 ?
+		Resample< 1 >( &window, false, &cursor, step, out ) :
+		Resample< 2 >( &window, false, &cursor, step, out );
+
+	u32 consumed = Min2( u32( cursor ), available );
+	stream->read_pos.store( read + consumed, std::memory_order_release );
+	state->cursor = cursor - consumed;
+
+	return written;
+}
+
+static void MixVoice( const MixerVoice * voice, VoiceState * state ) {
+	if( voice->generation != state->generation ) {
+		CloseStream( state );
+		*state = { };
+		state->generation = voice->generation;
+		// new voices start at full volume so we don't soften their attack
+		state->gain[ 0 ] = voice->gain[ 0 ];
+		state->gain[ 1 ] = voice->gain[ 1 ];
+	}
+
+	if( !voice->playing || state->finished || voice->sound.num_frames == 0 ) {
+		CloseStream( state );
+		return;
+	}
+
+	bool streamed = voice->sound.ogg.ptr != NULL;
+	if( streamed && state->stream == NULL ) {
+		if( !OpenStream( voice, state ) ) {
+			state->finished = true;
+			return;
+		}
+	}
+
+	float step = voice->sound.sample_rate * voice->pitch / float( output_sample_rate );
+	float target[ 2 ] = { 0.0f, 0.0f };
+	if( voice->audible ) {
+		target[ 0 ] = voice->gain[ 0 ];
+		target[ 1 ] = voice->gain[ 1 ];
+	}
+
+	if( !streamed && !voice->audible && state->gain[ 0 ] == 0.0f && state->gain[ 1 ] == 0.0f ) {
+		AdvanceVoice( voice, state, step );
+		return;
+	}
+
+	u32 channels = voice->sound.channels;
+	if( channels != 1 && channels != 2 ) {
+		state->finished = true;
+		return;
+	}
+
+	float * out[ 2 ] = { scratch[ 0 ] + MIXER_MAX_DELAY, scratch[ 1 ] + MIXER_MAX_DELAY };
+	memcpy( scratch[ 0 ], state->history, sizeof( state->history ) );
+
+	u32 written;
+	if( streamed ) {
+		written = ReadStream( voice, state, step, out );
+	}
+	else {
+		written = channels == 1 ?
+			Resample< 1 >( &voice->sound, voice->looping, &state->cursor, step, out ) :
+			Resample< 2 >( &voice->sound, voice->looping, &state->cursor, step, out );
+	}
+
+	if( written < MIX_FRAMES ) {
+		for( u32 c = 0; c < channels; c++ ) {
+			memset( out[ c ] + written, 0, ( MIX_FRAMES - written ) * sizeof( float ) );
+		}
+		state->finished = true;
+	}
+
+	for( u32 c = 0; c < channels; c++ ) {
+		Lowpass( out[ c ], &state->lowpass_state[ c ], voice->lowpass );
+	}
+
+	if( channels == 1 ) {
+		for( int ear = 0; ear < 2; ear++ ) {
+			u32 delay = Min2( voice->delay[ ear ], MIXER_MAX_DELAY );
+			MixInto( mix[ ear ], out[ 0 ] - delay, state->gain[ ear ], target[ ear ] );
+		}
+		memcpy( state->history, out[ 0 ] + MIX_FRAMES - MIXER_MAX_DELAY, sizeof( state->history ) );
+	}
+	else {
+		MixInto( mix[ 0 ], out[ 0 ], state->gain[ 0 ], target[ 0 ] );
+		MixInto( mix[ 1 ], out[ 1 ], state->gain[ 1 ], target[ 1 ] );
+	}
+
+	state->gain[ 0 ] = target[ 0 ];
+	state->gain[ 1 ] = target[ 1 ];
+}
+
+static void WriteOutput() {
+	float dg = ( master_gain - mixed_master_gain ) / MIX_FRAMES;
+	__m128 gain = _mm_add_ps( _mm_set1_ps( mixed_master_gain * 32767.0f ), _mm_mul_ps( _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f ), _mm_set1_ps( dg * 32767.0f ) ) );
+	__m128 dg4 = _mm_set1_ps( dg * 4.0f * 32767.0f );
+	const __m128 lo = _mm_set1_ps( -32768.0f );
+	const __m128 hi = _mm_set1_ps( 32767.0f );
+
+	for( u32 i = 0; i < MIX_FRAMES; i += 4 ) {
+		__m128 l = _mm_mul_ps( _mm_load_ps( mix[ 0 ] + i ), gain );
+		__m128 r = _mm_mul_ps( _mm_load_ps( mix[ 1 ] + i ), gain );
+		__m128 lr0 = _mm_min_ps( _mm_max_ps( _mm_unpacklo_ps( l, r ), lo ), hi );
+		__m128 lr1 = _mm_min_ps( _mm_max_ps( _mm_unpackhi_ps( l, r ), lo ), hi );
+		_mm_store_si128( ( __m128i * ) ( output + i * 2 ), _mm_packs_epi32( _mm_cvtps_epi32( lr0 ), _mm_cvtps_epi32( lr1 ) ) );
+		gain = _mm_add_ps( gain, dg4 );
+	}
+
+	mixed_master_gain = master_gain;
+}
+
+static void RunCommands() {
+	ZoneScoped;
+
+	MixerCommand cmd;
+	while( commands.pop( &cmd ) ) {
+		switch( cmd.type ) {
+			case MixerCommand_Start:
+				voices[ cmd.idx ] = cmd.voice;
+				num_voices = Max2( num_voices, cmd.idx + 1 );
+				break;
+
+			case MixerCommand_Update: {
+				MixerVoice * voice = &voices[ cmd.idx ];
+				if( voice->generation != cmd.voice.generation )
+					break;
+				voice->audible = cmd.voice.audible;
+				voice->gain[ 0 ] = cmd.voice.gain[ 0 ];
+				voice->gain[ 1 ] = cmd.voice.gain[ 1 ];
+				voice->delay[ 0 ] = cmd.voice.delay[ 0 ];
+				voice->delay[ 1 ] = cmd.voice.delay[ 1 ];
+				voice->pitch = cmd.voice.pitch;
+				voice->lowpass = cmd.voice.lowpass;
+			} break;
+
+			case MixerCommand_Stop:
+				voices[ cmd.idx ].playing = false;
+				break;
+
+			case MixerCommand_MasterGain:
+				master_gain = cmd.master_gain;
+				break;
+
+			case MixerCommand_Sync:
+				pending_sync = cmd.sync;
+				break;
+		}
+	}
+}
+
+static void MixBlock() {
+	ZoneScoped;
+
+	blocks_started.fetch_add( 1, std::memory_order_release );
+	RunCommands();
+
+	memset( mix, 0, sizeof( mix ) );
+	for( u32 i = 0; i < num_voices; i++ ) {
+		MixVoice( &voices[ i ], &states[ i ] );
+
+		if( states[ i ].finished && !states[ i ].reported ) {
+			FinishedVoice finished = { i, states[ i ].generation };
+			if( finished_voices.push( finished ) ) {
+				states[ i ].reported = true;
+			}
+		}
+	}
+
+	WriteOutput();
+
+	bool any_streams = false;
+	bool any_closing = false;
+	for( const Stream & stream : streams ) {
+		int stream_state = stream.state.load( std::memory_order_acquire );
+		any_streams = any_streams || stream_state != StreamState_Free;
+		any_closing = any_closing || stream_state == StreamState_Closing;
+	}
+
+	if( any_streams ) {
+		Signal( decoder_sem );
+	}
+
+	if( pending_sync != 0 && !any_closing ) {
+		syncs_done.store( pending_sync, std::memory_order_release );
+		Signal( sync_sem );
+		pending_sync = 0;
+	}
+}
+
+static void FillStream( Stream * stream ) {
+	ZoneScoped;
+
+	s16 chunk[ STREAM_DECODE_FRAMES * 2 ];
+	u64 write = stream->write_pos.load( std::memory_order_relaxed );
+	bool just_looped = false;
+
+	while( !stream->ended.load( std::memory_order_relaxed ) ) {
+		u64 read = stream->read_pos.load( std::memory_order_acquire );
+		if( write - read > STREAM_RING_FRAMES - STREAM_DECODE_FRAMES )
+			break;
+
+		int frames = 0;
+		if( stream->decoder != NULL ) {
+			frames = stb_vorbis_get_samples_short_interleaved( stream->decoder, stream->channels, chunk, STREAM_DECODE_FRAMES * stream->channels );
+		}
+
+		if( frames == 0 ) {
+			// just_looped stops empty files spinning forever
+			if( stream->looping && stream->decoder != NULL && !just_looped && stb_vorbis_seek_start( stream->decoder ) ) {
+				just_looped = true;
+				continue;
+			}
+			stream->ended.store( true, std::memory_order_release );
+			break;
+		}
+
+		just_looped = false;
+
+		u32 start = write % STREAM_RING_FRAMES;
+		u32 first = Min2( u32( frames ), STREAM_RING_FRAMES - start );
+		memcpy( stream->ring + start * stream->channels, chunk, first * stream->channels * sizeof( s16 ) );
+		memcpy( stream->ring, chunk + first * stream->channels, ( frames - first ) * stream->channels * sizeof( s16 ) );
+
+		write += frames;
+		stream->write_pos.store( write, std::memory_order_release );
+	}
+}
+
+static void DecoderThread( void * data ) {
+#if TRACY_ENABLE
+	tracy::SetThreadName( "Stream decoder" );
+#endif
+
+	while( true ) {
+		Wait( decoder_sem );
+		if( shutting_down.load( std::memory_order_acquire ) )
+			break;
+
+		for( Stream & stream : streams ) {
+			int stream_state = stream.state.load( std::memory_order_acquire );
+
+			if( stream_state == StreamState_Opening ) {
+				int err;
+				stream.decoder = stb_vorbis_open_memory( stream.ogg.ptr, stream.ogg.n, &err, NULL );
+
+				int expected = StreamState_Opening;
+				stream.state.compare_exchange_strong( expected, StreamState_Active, std::memory_order_acq_rel );
+				stream_state = stream.state.load( std::memory_order_acquire );
+			}
+
+			if( stream_state == StreamState_Active ) {
+				FillStream( &stream );
+			}
+			else if( stream_state == StreamState_Closing ) {
+				if( stream.decoder != NULL ) {
+					stb_vorbis_close( stream.decoder );
+					stream.decoder = NULL;
+				}
+				stream.state.store( StreamState_Free, std::memory_order_release );
+			}
+		}
+	}
+}
+
+static void MixerThread( void * data ) {
+#if TRACY_ENABLE
+	tracy::SetThreadName( "Mixer" );
+#endif
+
+	while( !shutting_down.load( std::memory_order_acquire ) ) {
+		ALint processed = 0;
+		alGetSourcei( stream_source, AL_BUFFERS_PROCESSED, &processed );
+
+		if( processed == 0 ) {
+			Sys_Sleep( 1 );
+			continue;
+		}
+
+		for( ALint i = 0; i < processed; i++ ) {
+			ALuint buffer;
+			alSourceUnqueueBuffers( stream_source, 1, &buffer );
+			MixBlock();
+			alBufferData( buffer, AL_FORMAT_STEREO16, output, sizeof( output ), output_sample_rate );
+			alSourceQueueBuffers( stream_source, 1, &buffer );
+		}
+
+		// AL stops the source if we ever fall behind
+		ALint state;
+		alGetSourcei( stream_source, AL_SOURCE_STATE, &state );
+		if( state != AL_PLAYING ) {
+			alSourcePlay( stream_source );
+		}
+	}
+}
+
+bool InitMixer( u32 sample_rate ) {
+	ZoneScoped;
+
+	output_sample_rate = sample_rate;
+	num_voices = 0;
+	master_gain = 1.0f;
+	mixed_master_gain = 1.0f;
+	for( MixerVoice & voice : voices ) {
+		voice = { };
+	}
+	memset( states, 0, sizeof( states ) );
+
+	commands.clear();
+	finished_voices.clear();
+	blocks_started.store( 0, std::memory_order_relaxed );
+	syncs_done.store( 0, std::memory_order_relaxed );
+	blocks_seen = 0;
+	syncs_sent = 0;
+	pending_sync = 0;
+
+	for( Stream & stream : streams ) {
+		stream.state.store( StreamState_Free, std::memory_order_relaxed );
+		stream.decoder = NULL;
+	}
+
+	alGenSources( 1, &stream_source );
+	alGenBuffers( ARRAY_COUNT( stream_buffers ), stream_buffers );
+	if( alGetError() != AL_NO_ERROR ) {
+		Com_Printf( S_COLOR_RED "Failed to allocate mixer stream\n" );
+		return false;
+	}
+
+	alSourcei( stream_source, AL_DIRECT_CHANNELS_SOFT, AL_TRUE );
+	alSourcei( stream_source, AL_SOURCE_RELATIVE, AL_TRUE );
+	alSourcef( stream_source, AL_ROLLOFF_FACTOR, 0.0f );
+
+	memset( output, 0, sizeof( output ) );
+	for( ALuint buffer : stream_buffers ) {
+		alBufferData( buffer, AL_FORMAT_STEREO16, output, sizeof( output ), output_sample_rate );
+	}
+	alSourceQueueBuffers( stream_source, ARRAY_COUNT( stream_buffers ), stream_buffers );
+	alSourcePlay( stream_source );
+
+	if( alGetError() != AL_NO_ERROR ) {
+		Com_Printf( S_COLOR_RED "Failed to start mixer stream\n" );
+		alDeleteSources( 1, &stream_source );
+		alDeleteBuffers( ARRAY_COUNT( stream_buffers ), stream_buffers );
+		return false;
+	}
+
+	sync_sem = NewSemaphore();
+	decoder_sem = NewSemaphore();
+
+	shutting_down.store( false, std::memory_order_release );
+	mixer_thread = NewThread( MixerThread );
+	decoder_thread = NewThread( DecoderThread );
+
+	return true;
+}
+
+void ShutdownMixer() {
+	shutting_down.store( true, std::memory_order_release );
+	JoinThread( mixer_thread );
+	Signal( decoder_sem );
+	JoinThread( decoder_thread );
+
+	for( Stream & stream : streams ) {
+		if( stream.decoder != NULL ) {
+			stb_vorbis_close( stream.decoder );
+		}
+	}
+
+	alSourceStop( stream_source );
+	alSourcei( stream_source, AL_BUFFER, 0 );
+	alDeleteSources( 1, &stream_source );
+	alDeleteBuffers( ARRAY_COUNT( stream_buffers ), stream_buffers );
+
+	DeleteSemaphore( decoder_sem );
+	DeleteSemaphore( sync_sem );
+}
+
+// the mixer drains it every few ms, so this only spins if it's wedged
+static void PushCommand( const MixerCommand & cmd ) {
+	while( !commands.push( cmd ) ) {
+		Sys_Sleep( 1 );
+	}
+}
+
+void MixerStartVoice( u32 idx, const MixerVoice & voice ) {
+	assert( idx < MIXER_MAX_VOICES );
+
+	MixerCommand cmd = { };
+	cmd.type = MixerCommand_Start;
+	cmd.idx = idx;
+	cmd.voice = voice;
+	PushCommand( cmd );
+}
+
+void MixerUpdateVoice( u32 idx, const MixerVoice & voice ) {
+	MixerCommand cmd = { };
+	cmd.type = MixerCommand_Update;
+	cmd.idx = idx;
+	cmd.voice = voice;
+	PushCommand( cmd );
+}
+
+void MixerStopVoice( u32 idx ) {
+	MixerCommand cmd = { };
+	cmd.type = MixerCommand_Stop;
+	cmd.idx = idx;
+	PushCommand( cmd );
+}
+
+void MixerSetMasterGain( float gain ) {
+	MixerCommand cmd = { };
+	cmd.type = MixerCommand_MasterGain;
+	cmd.master_gain = gain;
+	PushCommand( cmd );
+}
+
+bool MixerWantsUpdates() {
+	u64 started = blocks_started.load( std::memory_order_acquire );
+	if( started == blocks_seen )
+		return false;
+	blocks_seen = started;
+	return true;
+}
+
+bool MixerPollFinished( u32 * idx, u32 * generation ) {
+	FinishedVoice finished;
+	if( !finished_voices.pop( &finished ) )
+		return false;
+	*idx = finished.idx;
+	*generation = finished.generation;
+	return true;
+}
+
+void MixerSync() {
+	ZoneScoped;
+
+	syncs_sent++;
+
+	MixerCommand cmd = { };
+	cmd.type = MixerCommand_Sync;
+	cmd.sync = syncs_sent;
+	PushCommand( cmd );
+
+	while( syncs_done.load( std::memory_order_acquire ) < syncs_sent ) {
+		Wait( sync_sem );
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * mixes every playing voice into one stereo stream on its own thread, so the
+ * main thread never touches OpenAL per sound. the main thread works out
+ * gains/delays/pitch itself and sends them over through a lock-free queue
+ * that the mixer drains at the start of each block, so none of these ever
+ * wait on the mixer or the driver. only call them from one thread
+ */
+
+/*
+ * long sounds get decoded as they play instead. set ogg rather than
+ * samples, and it has to outlive the voice in the same way
+ */
+struct MixerSound {
+	const s16 * samples; // interleaved, and has to outlive any voice playing it
+	Span< const u8 > ogg;
+	u32 num_frames;
+	u32 channels;
+	u32 sample_rate;
+};
+
+struct MixerVoice {
+	MixerSound sound;
+	u32 generation; // give it a new one to restart the voice
+	bool playing;
+	bool looping;
+	bool audible; // voices that aren't audible only move their cursor along
+
+	float gain[ 2 ];
+	u32 delay[ 2 ]; // in frames, mono sounds only
+	float pitch;
+	float lowpass; // 0 leaves it alone, towards 1 muffles it
+};
+
+constexpr u32 MIXER_MAX_VOICES = 1024;
+constexpr u32 MIXER_MAX_DELAY = 64;
+
+// needs a current AL context
+bool InitMixer( u32 sample_rate );
+void ShutdownMixer();
+
+void MixerStartVoice( u32 idx, const MixerVoice & voice );
+void MixerUpdateVoice( u32 idx, const MixerVoice & voice ); // ignored if the generation doesn't match
+void MixerStopVoice( u32 idx );
+void MixerSetMasterGain( float gain );
+
+// true once for each block the mixer starts, there's no point sending updates more often
+bool MixerWantsUpdates();
+
+// voices that reached their end
+bool MixerPollFinished( u32 * idx, u32 * generation );
+
+// waits until the mixer has seen everything sent so far, e.g. before freeing samples it might be reading
+void MixerSync();
@@ -1,5 +1,5 @@
-#include <algorithm> // std::stable_sort
 #include <new>
+#include <algorithm>
 
 #include "glad/glad.h"
 
@@ -9,6 +9,12 @@
 #include "qcommon/qcommon.h"
 #include "qcommon/array.h"
 #include "qcommon/hash.h"
+#include "qcommon/memory_budget.h"
+#include "qcommon/fs.h"
+#include "qcommon/serialization.h"
+#include "qcommon/string.h"
+#include "qcommon/zone_sampler.h"
+#include "client/client.h"
 #include "client/renderer/renderer.h"
 
 #include "cgame/cg_local.h"
@@ -42,19 +48,42 @@ enum VertexAttribute : GLuint {
 static const u32 UNIFORM_BUFFER_SIZE = 64 * 1024;
 
 struct DrawCall {
-	PipelineState pipeline;
+	u32 pipeline; // index into pipelines
 	Mesh mesh;
 	u32 num_vertices;
 	u32 index_offset;
+	u32 base_vertex;
 
 	u32 num_instances;
 	VertexBuffer instance_data;
 	VertexBuffer update_data;
 	VertexBuffer feedback_data;
+
+	bool instanceable;
+	u32 model_transform; // index into model_transforms
+	u32 num_model_instances;
 };
 
 static NonRAIIDynamicArray< RenderPass > render_passes;
 static NonRAIIDynamicArray< DrawCall > draw_calls;
+static NonRAIIDynamicArray< PipelineState > pipelines;
+static NonRAIIDynamicArray< Mat4 > model_transforms;
+
+/*
+ * ParallelDrawCalls gives each job its own list to record into, then appends
+ * them to the main list in job order once they're all done
+ */
+struct DrawCallList {
+	NonRAIIDynamicArray< DrawCall > draw_calls;
+	NonRAIIDynamicArray< PipelineState > pipelines;
+	NonRAIIDynamicArray< Mat4 > model_transforms;
+	u32 num_vertices;
+};
+
+static DrawCallList parallel_draw_call_lists[ 16 ];
+static thread_local DrawCallList * recording_list;
+static NonRAIIDynamicArray< u64 > draw_call_keys;
+static NonRAIIDynamicArray< u64 > draw_call_keys_scratch;
 static NonRAIIDynamicArray< Mesh > deferred_mesh_deletes;
 static NonRAIIDynamicArray< TextureBuffer > deferred_tb_deletes;
 
@@ -67,20 +96,170 @@ static u32 num_vertices_this_frame;
 
 static bool in_frame;
 
+static u32 bench_frame_replays;
+static bool benchmarking_frame;
+static void BenchFrame_f();
+
+/*
+ * uniforms get streamed through a list of UBOs that grows when a frame runs
+ * out of space. with GL 4.4 each UBO is persistently mapped and split into
+ * FRAMES_IN_FLIGHT regions, and we wait on the fence from FRAMES_IN_FLIGHT
+ * frames ago before reusing a region. otherwise they get mapped with
+ * GL_MAP_INVALIDATE_BUFFER_BIT every frame and the driver orphans them
+ */
 struct UBO {
 	GLuint ubo;
-	u8 * buffer;
+	u8 * buffer; // start of this frame's region
+	u8 * persistent_buffer;
 	u32 bytes_used;
 };
 
-static UBO ubos[ 16 ]; // 1MB of uniform space
+static NonRAIIDynamicArray< UBO > ubos;
 static u32 ubo_offset_alignment;
+static bool persistent_ubos;
+
+static GLsync frame_fences[ FRAMES_IN_FLIGHT ];
+static u32 frame_in_flight;
+static u64 frame_number;
+
+/*
+ * a timestamp at the start of each render pass plus one at the end of the
+ * frame. they get read back after waiting on the frame fence so they never
+ * stall, and they're always on because they're basically free
+ */
+constexpr u32 MAX_RENDER_PASSES = U8_MAX + 1;
+
+struct FrameTimers {
+	GLuint queries[ MAX_RENDER_PASSES + 1 ];
+	const char * names[ MAX_RENDER_PASSES ];
+	u32 num_passes;
+	u64 frame;
+	bool pending;
+};
+
+static FrameTimers frame_timers[ FRAMES_IN_FLIGHT ];
+static GPUPassTime gpu_pass_times[ MAX_RENDER_PASSES ];
+static u32 num_gpu_pass_times;
+static float gpu_frame_time;
+static GPUFrameFinish gpu_frame_finish;
+
+/*
+ * linked programs get written to <home>/shadercache when the driver can give
+ * us binaries, and KHR_parallel_shader_compile lets glLinkProgram return
+ * before the driver is done so callers can kick off lots of shaders at once
+ */
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+static bool shader_cache_supported;
+static u64 shader_cache_driver_hash;
+static bool parallel_shader_compile;
 
 static PipelineState prev_pipeline;
 static GLuint prev_fbo;
 static u32 prev_viewport_width;
 static u32 prev_viewport_height;
 
+/*
+ * shadow of the UBO and texture unit bindings, so SetPipelineState only calls
+ * into GL when a binding changes. the 2D texture units can have either a 2D or
+ * a multisampled texture bound, and the other target is always kept unbound.
+ * texture creation binds on whatever unit is active so it invalidates that
+ * unit, and deleting a bound texture invalidates every unit it was bound to
+ */
+#define NUM_TEXTURE_UNITS ( ARRAY_COUNT( &Shader::textures ) + ARRAY_COUNT( &Shader::texture_buffers ) + ARRAY_COUNT( &Shader::texture_arrays ) )
+
+struct BoundUniformBlock {
+	bool valid;
+	UniformBlock block;
+};
+
+struct BoundTexture {
+	bool valid;
+	GLenum target;
+	GLuint texture;
+};
+
+static BoundUniformBlock bound_uniforms[ ARRAY_COUNT( &Shader::uniforms ) ];
+static BoundTexture bound_textures[ NUM_TEXTURE_UNITS ];
+static u32 active_texture_unit;
+
+static u32 skipped_ubo_binds;
+static u32 skipped_texture_binds;
+static u32 num_instanced_draw_calls;
+
+static void InvalidateBindings() {
+	for( BoundUniformBlock & bound : bound_uniforms ) {
+		bound.valid = false;
+	}
+	for( BoundTexture & bound : bound_textures ) {
+		bound.valid = false;
+	}
+
+	glActiveTexture( GL_TEXTURE0 );
+	active_texture_unit = 0;
+}
+
+static void InvalidateActiveTextureUnit() {
+	bound_textures[ active_texture_unit ].valid = false;
+}
+
+static void InvalidateDeletedTexture( GLuint texture ) {
+	for( BoundTexture & bound : bound_textures ) {
+		if( bound.texture == texture ) {
+			bound.valid = false;
+		}
+	}
+}
+
+static void BindUniformBlock( u32 slot, UniformBlock block ) {
+	BoundUniformBlock * bound = &bound_uniforms[ slot ];
+	if( bound->valid && bound->block.ubo == block.ubo && bound->block.offset == block.offset && bound->block.size == block.size ) {
+		skipped_ubo_binds++;
+		return;
+	}
+
+	if( block.size > 0 ) {
+		glBindBufferRange( GL_UNIFORM_BUFFER, slot, block.ubo, block.offset, block.size );
+	}
+	else {
+		glBindBufferBase( GL_UNIFORM_BUFFER, slot, 0 );
+	}
+
+	bound->valid = true;
+	bound->block = block;
+}
+
+// other_target is the target that shares the unit and has to stay unbound, or GL_NONE
+static void BindTexture( u32 unit, GLenum target, GLenum other_target, GLuint texture ) {
+	BoundTexture * bound = &bound_textures[ unit ];
+	if( bound->valid && bound->target == target && bound->texture == texture ) {
+		skipped_texture_binds++;
+		return;
+	}
+
+	if( unit != active_texture_unit ) {
+		glActiveTexture( GL_TEXTURE0 + unit );
+		active_texture_unit = unit;
+	}
+
+	if( !bound->valid ) {
+		if( other_target != GL_NONE ) {
+			glBindTexture( other_target, 0 );
+		}
+	}
+	else if( bound->target != target && bound->texture != 0 ) {
+		glBindTexture( bound->target, 0 );
+	}
+
+	glBindTexture( target, texture );
+
+	bound->valid = true;
+	bound->target = target;
+	bound->texture = texture;
+}
+
 static GLenum DepthFuncToGL( DepthFunc depth_func ) {
 	switch( depth_func ) {
 		case DepthFunc_Less:
@@ -244,6 +423,28 @@ static void VertexFormatToGL( VertexFormat format, GLenum * type, int * num_comp
 			*normalized = format == VertexFormat_U8x4_Norm;
 			return;
 
+		case VertexFormat_S8x2:
+		case VertexFormat_S8x2_Norm:
+			*type = GL_BYTE;
+			*num_components = 2;
+			*integral = true;
+			*normalized = format == VertexFormat_S8x2_Norm;
+			return;
+		case VertexFormat_S8x3:
+		case VertexFormat_S8x3_Norm:
+			*type = GL_BYTE;
+			*num_components = 3;
+			*integral = true;
+			*normalized = format == VertexFormat_S8x3_Norm;
+			return;
+		case VertexFormat_S8x4:
+		case VertexFormat_S8x4_Norm:
+			*type = GL_BYTE;
+			*num_components = 4;
+			*integral = true;
+			*normalized = format == VertexFormat_S8x4_Norm;
+			return;
+
 		case VertexFormat_U16x2:
 		case VertexFormat_U16x2_Norm:
 			*type = GL_UNSIGNED_SHORT;
@@ -266,6 +467,28 @@ static void VertexFormatToGL( VertexFormat format, GLenum * type, int * num_comp
 			*normalized = format == VertexFormat_U16x4_Norm;
 			return;
 
+		case VertexFormat_S16x2:
+		case VertexFormat_S16x2_Norm:
+			*type = GL_SHORT;
+			*num_components = 2;
+			*integral = true;
+			*normalized = format == VertexFormat_S16x2_Norm;
+			return;
+		case VertexFormat_S16x3:
+		case VertexFormat_S16x3_Norm:
+			*type = GL_SHORT;
+			*num_components = 3;
+			*integral = true;
+			*normalized = format == VertexFormat_S16x3_Norm;
+			return;
+		case VertexFormat_S16x4:
+		case VertexFormat_S16x4_Norm:
+			*type = GL_SHORT;
+			*num_components = 4;
+			*integral = true;
+			*normalized = format == VertexFormat_S16x4_Norm;
+			return;
+
 		case VertexFormat_U32x1:
 			*type = GL_UNSIGNED_INT;
 			*num_components = 1;
@@ -431,6 +654,41 @@ static void PlotVRAMUsage() {
 	}
 }
 
+static UBO * AddUBO() {
+	UBO ubo = { };
+	glGenBuffers( 1, &ubo.ubo );
+	glBindBuffer( GL_UNIFORM_BUFFER, ubo.ubo );
+
+	if( persistent_ubos ) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_UNIFORM_BUFFER, UNIFORM_BUFFER_SIZE * FRAMES_IN_FLIGHT, NULL, flags );
+		ubo.persistent_buffer = ( u8 * ) glMapBufferRange( GL_UNIFORM_BUFFER, 0, UNIFORM_BUFFER_SIZE * FRAMES_IN_FLIGHT, flags );
+		assert( ubo.persistent_buffer != NULL );
+	}
+	else {
+		glBufferData( GL_UNIFORM_BUFFER, UNIFORM_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW );
+	}
+
+	return &ubos[ ubos.add( ubo ) ];
+}
+
+static void MapUBO( UBO * ubo ) {
+	if( persistent_ubos ) {
+		ubo->buffer = ubo->persistent_buffer + frame_in_flight * UNIFORM_BUFFER_SIZE;
+	}
+	else {
+		glBindBuffer( GL_UNIFORM_BUFFER, ubo->ubo );
+		ubo->buffer = ( u8 * ) glMapBufferRange( GL_UNIFORM_BUFFER, 0, UNIFORM_BUFFER_SIZE, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+		assert( ubo->buffer != NULL );
+	}
+
+	ubo->bytes_used = 0;
+}
+
+static void RenderBackendMemoryBudget( MemoryBudget * budget ) {
+	budget->vram_bytes += ubos.size() * UNIFORM_BUFFER_SIZE * ( persistent_ubos ? FRAMES_IN_FLIGHT : 1 );
+}
+
 void RenderBackendInit() {
 	ZoneScoped;
 	TracyGpuContext;
@@ -460,6 +718,15 @@ void RenderBackendInit() {
 
 	render_passes.init( sys_allocator );
 	draw_calls.init( sys_allocator );
+	pipelines.init( sys_allocator );
+	model_transforms.init( sys_allocator );
+	for( DrawCallList & list : parallel_draw_call_lists ) {
+		list.draw_calls.init( sys_allocator );
+		list.pipelines.init( sys_allocator );
+		list.model_transforms.init( sys_allocator );
+	}
+	draw_call_keys.init( sys_allocator );
+	draw_call_keys_scratch.init( sys_allocator );
 	deferred_mesh_deletes.init( sys_allocator );
 	deferred_tb_deletes.init( sys_allocator );
 
@@ -482,11 +749,56 @@ void RenderBackendInit() {
 	glGetIntegerv( GL_MAX_UNIFORM_BLOCK_SIZE, &max_ubo_size );
 	assert( max_ubo_size >= s32( UNIFORM_BUFFER_SIZE ) );
 
-	for( UBO & ubo : ubos ) {
-		glGenBuffers( 1, &ubo.ubo );
-		glBindBuffer( GL_UNIFORM_BUFFER, ubo.ubo );
-		glBufferData( GL_UNIFORM_BUFFER, UNIFORM_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW );
+	{
+		GLint num_binary_formats = 0;
+		if( GLAD_GL_VERSION_4_1 != 0 ) {
+			glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats );
+		}
+		shader_cache_supported = num_binary_formats > 0;
+
+		const char * driver_strings[] = {
+			( const char * ) glGetString( GL_VENDOR ),
+			( const char * ) glGetString( GL_RENDERER ),
+			( const char * ) glGetString( GL_VERSION ),
+		};
+		shader_cache_driver_hash = Hash64( "shadercache" );
+		for( const char * str : driver_strings ) {
+			if( str != NULL ) {
+				shader_cache_driver_hash = Hash64( str, strlen( str ), shader_cache_driver_hash );
+			}
+		}
+
+		parallel_shader_compile = false;
+		GLint num_extensions;
+		glGetIntegerv( GL_NUM_EXTENSIONS, &num_extensions );
+		for( GLint i = 0; i < num_extensions; i++ ) {
+			const char * ext = ( const char * ) glGetStringi( GL_EXTENSIONS, i );
+			if( strcmp( ext, "GL_KHR_parallel_shader_compile" ) == 0 || strcmp( ext, "GL_ARB_parallel_shader_compile" ) == 0 ) {
+				parallel_shader_compile = true;
+			}
+		}
+	}
+
+	persistent_ubos = GLAD_GL_VERSION_4_4 != 0;
+	ubos.init( sys_allocator );
+	for( int i = 0; i < 16; i++ ) { // 1MB of uniform space
+		AddUBO();
+	}
+
+	for( GLsync & fence : frame_fences ) {
+		fence = NULL;
 	}
+	frame_in_flight = 0;
+	frame_number = 0;
+
+	for( FrameTimers & timers : frame_timers ) {
+		glGenQueries( ARRAY_COUNT( timers.queries ), timers.queries );
+		timers.num_passes = 0;
+		timers.pending = false;
+	}
+	num_gpu_pass_times = 0;
+	gpu_frame_time = 0.0f;
+	gpu_frame_finish = { };
 
 	in_frame = false;
 
@@ -494,35 +806,119 @@ void RenderBackendInit() {
 	prev_fbo = 0;
 	prev_viewport_width = 0;
 	prev_viewport_height = 0;
+
+	InvalidateBindings();
+
+	bench_frame_replays = 0;
+	benchmarking_frame = false;
+	Cmd_AddCommand( "r_benchframe", BenchFrame_f );
+
+	AddMemoryBudget( "render backend", RenderBackendMemoryBudget );
 }
 
 void RenderBackendShutdown() {
+	Cmd_RemoveCommand( "r_benchframe" );
+	RemoveMemoryBudget( "render backend" );
+
+	for( GLsync fence : frame_fences ) {
+		if( fence != NULL ) {
+			glDeleteSync( fence );
+		}
+	}
+
+	for( FrameTimers & timers : frame_timers ) {
+		glDeleteQueries( ARRAY_COUNT( timers.queries ), timers.queries );
+	}
+
 	for( UBO ubo : ubos ) {
 		glDeleteBuffers( 1, &ubo.ubo );
 	}
+	ubos.shutdown();
 
 	render_passes.shutdown();
 	draw_calls.shutdown();
+	pipelines.shutdown();
+	model_transforms.shutdown();
+	for( DrawCallList & list : parallel_draw_call_lists ) {
+		list.draw_calls.shutdown();
+		list.pipelines.shutdown();
+		list.model_transforms.shutdown();
+	}
+	draw_call_keys.shutdown();
+	draw_call_keys_scratch.shutdown();
 	deferred_mesh_deletes.shutdown();
 	deferred_tb_deletes.shutdown();
 }
 
+static void ReadFrameTimers( FrameTimers * timers ) {
+	if( !timers->pending )
+		return;
+	timers->pending = false;
+
+	GLuint64 timestamps[ MAX_RENDER_PASSES + 1 ];
+	for( u32 i = 0; i <= timers->num_passes; i++ ) {
+		glGetQueryObjectui64v( timers->queries[ i ], GL_QUERY_RESULT, &timestamps[ i ] );
+	}
+
+	// keep the averages going as long as the passes don't change
+	bool same_passes = num_gpu_pass_times == timers->num_passes;
+	for( u32 i = 0; same_passes && i < timers->num_passes; i++ ) {
+		same_passes = gpu_pass_times[ i ].name == timers->names[ i ];
+	}
+
+	for( u32 i = 0; i < timers->num_passes; i++ ) {
+		GPUPassTime * pass = &gpu_pass_times[ i ];
+		pass->name = timers->names[ i ];
+		pass->ms = ( timestamps[ i + 1 ] - timestamps[ i ] ) / 1000000.0f;
+		pass->average_ms = same_passes ? Lerp( pass->average_ms, 0.05f, pass->ms ) : pass->ms;
+	}
+	num_gpu_pass_times = timers->num_passes;
+
+	gpu_frame_time = ( timestamps[ timers->num_passes ] - timestamps[ 0 ] ) / 1000000.0f;
+	TracyPlot( "GPU frame time", gpu_frame_time );
+
+	/*
+	 * move the end of frame timestamp onto the CPU clock by sampling both
+	 * clocks back to back. the error is however long the two calls take to
+	 * go through, which is way under a millisecond
+	 */
+	GLint64 gpu_now;
+	glGetInteger64v( GL_TIMESTAMP, &gpu_now );
+	u64 cpu_now = Sys_Nanoseconds();
+	u64 ago = Min2( u64( Max2( gpu_now - GLint64( timestamps[ timers->num_passes ] ), GLint64( 0 ) ) ), cpu_now );
+
+	gpu_frame_finish.frame = timers->frame;
+	gpu_frame_finish.finished_ns = cpu_now - ago;
+}
+
 void RenderBackendBeginFrame() {
 	assert( !in_frame );
 	in_frame = true;
 
 	render_passes.clear();
 	draw_calls.clear();
+	pipelines.clear();
+	model_transforms.clear();
 	deferred_mesh_deletes.clear();
 	deferred_tb_deletes.clear();
 
 	num_vertices_this_frame = 0;
+	skipped_ubo_binds = 0;
+	skipped_texture_binds = 0;
+	num_instanced_draw_calls = 0;
+
+	if( frame_fences[ frame_in_flight ] != NULL ) {
+		ZoneScopedSampled( "Wait for frame fence" );
+		GLsync fence = frame_fences[ frame_in_flight ];
+		while( glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000 ) == GL_TIMEOUT_EXPIRED );
+		glDeleteSync( fence );
+		frame_fences[ frame_in_flight ] = NULL;
+	}
+
+	ReadFrameTimers( &frame_timers[ frame_in_flight ] );
 
 	for( UBO & ubo : ubos ) {
-		glBindBuffer( GL_UNIFORM_BUFFER, ubo.ubo );
-		ubo.buffer = ( u8 * ) glMapBufferRange( GL_UNIFORM_BUFFER, 0, UNIFORM_BUFFER_SIZE, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
-		assert( ubo.buffer != NULL );
-		ubo.bytes_used = 0;
+		MapUBO( &ubo );
 	}
 
 	if( frame_static.viewport_width != prev_viewport_width || frame_static.viewport_height != prev_viewport_height ) {
@@ -538,6 +934,22 @@ static bool operator!=( PipelineState::Scissor a, PipelineState::Scissor b ) {
 	return a.x != b.x || a.y != b.y || a.w != b.w || a.h != b.h;
 }
 
+static UniformBlock FindUniformBlock( const PipelineState & pipeline, UniformSlot slot ) {
+	return slot == UniformSlot_None ? UniformBlock() : pipeline.uniforms[ slot ];
+}
+
+static const Texture * FindTexture( const PipelineState & pipeline, TextureSlot slot ) {
+	return slot == TextureSlot_None ? NULL : pipeline.textures[ slot ];
+}
+
+static GLuint FindTextureBuffer( const PipelineState & pipeline, TextureBufferSlot slot ) {
+	return slot == TextureBufferSlot_None ? 0 : pipeline.texture_buffers[ slot ];
+}
+
+static GLuint FindTextureArray( const PipelineState & pipeline, TextureArraySlot slot ) {
+	return slot == TextureArraySlot_None ? 0 : pipeline.texture_arrays[ slot ];
+}
+
 static void SetPipelineState( PipelineState pipeline, bool ccw_winding ) {
 	TracyGpuZone( "Set pipeline state" );
 
@@ -546,80 +958,28 @@ static void SetPipelineState( PipelineState pipeline, bool ccw_winding ) {
 	}
 
 	// uniforms
-	// TODO: maybe these shouldn't always get rebound
 	for( size_t i = 0; i < ARRAY_COUNT( pipeline.shader->uniforms ); i++ ) {
-		bool found = false;
-		for( size_t j = 0; j < pipeline.num_uniforms; j++ ) {
-			UniformBlock block = pipeline.uniforms[ j ].block;
-			if( pipeline.uniforms[ j ].name_hash == pipeline.shader->uniforms[ i ] && block.size > 0 ) {
-				glBindBufferRange( GL_UNIFORM_BUFFER, i, block.ubo, block.offset, block.size );
-				found = true;
-				break;
-			}
-		}
-
-		if( !found ) {
-			glBindBufferBase( GL_UNIFORM_BUFFER, i, 0 );
-		}
+		BindUniformBlock( i, FindUniformBlock( pipeline, pipeline.shader->uniforms[ i ] ) );
 	}
 
 	// textures
 	for( size_t i = 0; i < ARRAY_COUNT( pipeline.shader->textures ); i++ ) {
-		glActiveTexture( GL_TEXTURE0 + i );
-
-		bool found = false;
-		for( size_t j = 0; j < pipeline.num_textures; j++ ) {
-			if( pipeline.textures[ j ].name_hash == pipeline.shader->textures[ i ] ) {
-				GLenum target = pipeline.textures[ j ].texture->msaa ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
-				GLenum other_target = pipeline.textures[ j ].texture->msaa ? GL_TEXTURE_2D : GL_TEXTURE_2D_MULTISAMPLE;
-				glBindTexture( other_target, 0 );
-				glBindTexture( target, pipeline.textures[ j ].texture->texture );
-				found = true;
-				break;
-			}
-		}
-
-		if( !found ) {
-			glBindTexture( GL_TEXTURE_2D, 0 );
-			glBindTexture( GL_TEXTURE_2D_MULTISAMPLE, 0 );
-		}
+		const Texture * texture = FindTexture( pipeline, pipeline.shader->textures[ i ] );
+		GLenum target = texture != NULL && texture->msaa ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+		GLenum other_target = target == GL_TEXTURE_2D ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+		BindTexture( i, target, other_target, texture == NULL ? 0 : texture->texture );
 	}
 
 	// texture buffers
 	for( size_t i = 0; i < ARRAY_COUNT( pipeline.shader->texture_buffers ); i++ ) {
-		glActiveTexture( GL_TEXTURE0 + ARRAY_COUNT( pipeline.shader->textures ) + i );
-
-		bool found = false;
-		for( size_t j = 0; j < pipeline.num_texture_buffers; j++ ) {
-			if( pipeline.texture_buffers[ j ].name_hash == pipeline.shader->texture_buffers[ i ] ) {
-				glBindTexture( GL_TEXTURE_BUFFER, pipeline.texture_buffers[ j ].tb.texture );
-				found = true;
-				break;
-			}
-		}
-
-		if( !found ) {
-			glBindTexture( GL_TEXTURE_BUFFER, 0 );
-		}
+		GLuint texture = FindTextureBuffer( pipeline, pipeline.shader->texture_buffers[ i ] );
+		BindTexture( ARRAY_COUNT( pipeline.shader->textures ) + i, GL_TEXTURE_BUFFER, GL_NONE, texture );
 	}
 
 	// texture arrays
 	for( size_t i = 0; i < ARRAY_COUNT( pipeline.shader->texture_arrays ); i++ ) {
-		glActiveTexture( GL_TEXTURE0 + ARRAY_COUNT( pipeline.shader->textures ) + ARRAY_COUNT( pipeline.shader->texture_buffers ) + i );
-		
-		bool found = false;
-		for( size_t j = 0; j < pipeline.num_texture_arrays; j++ ) {
-			if( pipeline.texture_arrays[ j ].name_hash == pipeline.shader->texture_arrays[ i ] ) {
-				glBindTexture( GL_TEXTURE_2D_ARRAY, pipeline.texture_arrays[ j ].ta.texture );
-				found = true;
-				break;
-			}
-		}
-		
-
-		if( !found ) {
-			glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
-		}
+		GLuint texture = FindTextureArray( pipeline, pipeline.shader->texture_arrays[ i ] );
+		BindTexture( ARRAY_COUNT( pipeline.shader->textures ) + ARRAY_COUNT( pipeline.shader->texture_buffers ) + i, GL_TEXTURE_2D_ARRAY, GL_NONE, texture );
 	}
 
 	// alpha blending
@@ -721,12 +1081,232 @@ static void SetPipelineState( PipelineState pipeline, bool ccw_winding ) {
 	prev_pipeline = pipeline;
 }
 
-static bool SortDrawCall( const DrawCall & a, const DrawCall & b ) {
-	if( a.pipeline.pass != b.pipeline.pass )
-		return a.pipeline.pass < b.pipeline.pass;
-	if( !render_passes[ a.pipeline.pass ].sorted )
+/*
+ * draw calls get sorted by pass, then by shader and instancing bucket in
+ * passes that allow it, and otherwise stay in submission order. the key is
+ * pass:8 shader:16 bucket:8 index:32, and since the keys start out in index
+ * order and LSD radix sort is stable, only the top 4 bytes need sorting
+ *
+ * the bucket is a hash of the mesh range and base texture so draws that
+ * might get instanced together end up next to each other, and draws that
+ * can't be instanced at least don't switch textures more than they need to
+ */
+#define DRAW_CALL_KEY_SORTED_BYTES 4
+
+static u64 DrawCallKey( const DrawCall & dc, size_t idx ) {
+	const PipelineState & pipeline = pipelines[ dc.pipeline ];
+
+	u64 shader = 0;
+	u64 bucket = 0;
+	if( render_passes[ pipeline.pass ].sorted ) {
+		// shaders only live in the Shaders struct, so this preserves pointer order
+		shader = ( uintptr_t( pipeline.shader ) - uintptr_t( &shaders ) ) / sizeof( Shader );
+		assert( shader <= U16_MAX );
+
+		const Texture * texture = pipeline.textures[ TextureSlot_BaseTexture ];
+		u32 mesh[] = { texture == NULL ? 0 : texture->texture, dc.mesh.vao, dc.num_vertices, dc.index_offset };
+		bucket = Hash32( mesh, dc.instanceable ? sizeof( mesh ) : sizeof( mesh[ 0 ] ) ) & 0xFF;
+	}
+
+	return ( u64( pipeline.pass ) << 56 ) | ( shader << 40 ) | ( bucket << 32 ) | checked_cast< u32 >( idx );
+}
+
+static void SortDrawCallKeys() {
+	size_t n = draw_call_keys.size();
+	draw_call_keys_scratch.resize( n );
+
+	u64 * keys = draw_call_keys.ptr();
+	u64 * scratch = draw_call_keys_scratch.ptr();
+
+	u32 counts[ DRAW_CALL_KEY_SORTED_BYTES ][ 256 ] = { };
+	for( size_t i = 0; i < n; i++ ) {
+		for( int j = 0; j < DRAW_CALL_KEY_SORTED_BYTES; j++ ) {
+			counts[ j ][ ( keys[ i ] >> ( 32 + j * 8 ) ) & 0xFF ]++;
+		}
+	}
+
+	for( int j = 0; j < DRAW_CALL_KEY_SORTED_BYTES; j++ ) {
+		int shift = 32 + j * 8;
+
+		// skip bytes that are the same for every key
+		if( counts[ j ][ ( keys[ 0 ] >> shift ) & 0xFF ] == n )
+			continue;
+
+		u32 offsets[ 256 ];
+		u32 total = 0;
+		for( int k = 0; k < 256; k++ ) {
+			offsets[ k ] = total;
+			total += counts[ j ][ k ];
+		}
+
+		for( size_t i = 0; i < n; i++ ) {
+			scratch[ offsets[ ( keys[ i ] >> shift ) & 0xFF ]++ ] = keys[ i ];
+		}
+
+		Swap2( &keys, &scratch );
+	}
+
+	if( keys != draw_call_keys.ptr() ) {
+		memcpy( draw_call_keys.ptr(), keys, n * sizeof( u64 ) );
+	}
+}
+
+static const Shader * InstancedShader( const Shader * shader ) {
+	const Shader * instanced = NULL;
+	if( shader == &shaders.standard )
+		instanced = &shaders.standard_instanced;
+	else if( shader == &shaders.standard_shaded )
+		instanced = &shaders.standard_shaded_instanced;
+	else if( shader == &shaders.depth_only )
+		instanced = &shaders.depth_only_instanced;
+
+	// draw them one at a time until the instanced variant has compiled
+	return instanced != NULL && RequestShader( instanced ) ? instanced : NULL;
+}
+
+static bool ShaderUsesUniform( const Shader * shader, UniformSlot slot ) {
+	for( UniformSlot uniform : shader->uniforms ) {
+		if( uniform == slot )
+			return true;
+	}
+	return false;
+}
+
+static bool SameTexture( const Texture * a, const Texture * b ) {
+	if( a == NULL || b == NULL )
+		return a == b;
+	return a->texture == b->texture && a->msaa == b->msaa;
+}
+
+/*
+ * only compares the bindings the shader actually uses, so e.g. shadow pass
+ * draws with different materials still match. u_Material is allowed to
+ * differ when both blocks are in the material table, since instanced shaders
+ * read it per instance from u_InstanceMaterials
+ */
+static bool CanInstanceTogether( const DrawCall & a, const DrawCall & b ) {
+	if( !b.instanceable || a.mesh.vao != b.mesh.vao || a.num_vertices != b.num_vertices || a.index_offset != b.index_offset )
+		return false;
+
+	const PipelineState & pa = pipelines[ a.pipeline ];
+	const PipelineState & pb = pipelines[ b.pipeline ];
+
+	if( pa.pass != pb.pass || pa.shader != pb.shader || pa.blend_func != pb.blend_func || pa.depth_func != pb.depth_func || pa.cull_face != pb.cull_face )
+		return false;
+	if( pa.scissor != pb.scissor || pa.write_depth != pb.write_depth || pa.clamp_depth != pb.clamp_depth )
+		return false;
+	if( pa.view_weapon_depth_hack != pb.view_weapon_depth_hack || pa.wireframe != pb.wireframe )
 		return false;
-	return a.pipeline.shader < b.pipeline.shader;
+
+	const Shader * shader = pa.shader;
+
+	for( UniformSlot slot : shader->uniforms ) {
+		if( slot == UniformSlot_Model )
+			continue;
+		UniformBlock ua = FindUniformBlock( pa, slot );
+		UniformBlock ub = FindUniformBlock( pb, slot );
+		if( ua.ubo == ub.ubo && ua.offset == ub.offset && ua.size == ub.size )
+			continue;
+		if( slot == UniformSlot_Material && FindMaterialUniforms( ua ) != NULL && FindMaterialUniforms( ub ) != NULL )
+			continue;
+		return false;
+	}
+
+	for( TextureSlot slot : shader->textures ) {
+		if( !SameTexture( FindTexture( pa, slot ), FindTexture( pb, slot ) ) )
+			return false;
+	}
+
+	for( TextureBufferSlot slot : shader->texture_buffers ) {
+		if( FindTextureBuffer( pa, slot ) != FindTextureBuffer( pb, slot ) )
+			return false;
+	}
+
+	for( TextureArraySlot slot : shader->texture_arrays ) {
+		if( FindTextureArray( pa, slot ) != FindTextureArray( pb, slot ) )
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * merge instanceable draw calls that only differ by u_Model and u_Material
+ * into instanced draws, with the materials packed into a per-instance table.
+ * only done in sorted passes, where the order of draws with the same shader
+ * doesn't matter. merged keys get replaced by a key pointing at a new draw
+ * call, and the rest get compacted out
+ */
+static void InstanceDrawCalls() {
+	ZoneScoped;
+
+	constexpr u64 merged = U64_MAX; // pass U8_MAX is never valid
+	u64 * keys = draw_call_keys.ptr();
+	size_t n = draw_call_keys.size();
+	size_t num_keys = 0;
+
+	for( size_t i = 0; i < n; i++ ) {
+		u64 key = keys[ i ];
+		if( key == merged )
+			continue;
+
+		DrawCall dc = draw_calls[ u32( key ) ];
+		const Shader * instanced_shader = InstancedShader( pipelines[ dc.pipeline ].shader );
+
+		// if the material didn't make it into the table we can't build u_InstanceMaterials
+		UniformBlock material = pipelines[ dc.pipeline ].uniforms[ UniformSlot_Material ];
+		bool material_table = instanced_shader != NULL && ShaderUsesUniform( instanced_shader, UniformSlot_InstanceMaterials );
+		bool can_instance = !material_table || FindMaterialUniforms( material ) != NULL;
+
+		if( dc.instanceable && instanced_shader != NULL && can_instance && render_passes[ pipelines[ dc.pipeline ].pass ].sorted ) {
+			Mat4 instances[ MAX_MODEL_INSTANCES ];
+			UniformBlock materials[ MAX_MODEL_INSTANCES ];
+			instances[ 0 ] = model_transforms[ dc.model_transform ];
+			materials[ 0 ] = material;
+			u32 num_instances = 1;
+
+			for( size_t j = i + 1; j < n && num_instances < ARRAY_COUNT( instances ); j++ ) {
+				if( keys[ j ] == merged )
+					continue;
+				if( ( keys[ j ] >> 32 ) != ( key >> 32 ) )
+					break;
+
+				const DrawCall & other = draw_calls[ u32( keys[ j ] ) ];
+				if( !CanInstanceTogether( dc, other ) )
+					continue;
+
+				instances[ num_instances ] = model_transforms[ other.model_transform ];
+				materials[ num_instances ] = pipelines[ other.pipeline ].uniforms[ UniformSlot_Material ];
+				num_instances++;
+				keys[ j ] = merged;
+			}
+
+			if( num_instances > 1 ) {
+				PipelineState pipeline = pipelines[ dc.pipeline ];
+				pipeline.shader = instanced_shader;
+				pipeline.set_uniform( UniformSlot_Instances, UploadUniforms( instances, num_instances * sizeof( instances[ 0 ] ) ) );
+
+				if( material_table ) {
+					char table[ MAX_MODEL_INSTANCES * MATERIAL_UNIFORMS_SIZE ];
+					for( u32 k = 0; k < num_instances; k++ ) {
+						memcpy( table + k * MATERIAL_UNIFORMS_SIZE, FindMaterialUniforms( materials[ k ] ), MATERIAL_UNIFORMS_SIZE );
+					}
+					pipeline.set_uniform( UniformSlot_InstanceMaterials, UploadUniforms( table, num_instances * MATERIAL_UNIFORMS_SIZE ) );
+				}
+
+				dc.pipeline = checked_cast< u32 >( pipelines.add( pipeline ) );
+				dc.num_model_instances = num_instances;
+				key = ( key & ~u64( U32_MAX ) ) | checked_cast< u32 >( draw_calls.add( dc ) );
+
+				num_instanced_draw_calls += num_instances;
+			}
+		}
+
+		keys[ num_keys ] = key;
+		num_keys++;
+	}
+
+	draw_call_keys.resize( num_keys );
 }
 
 static void SetupAttribute( GLuint index, VertexFormat format, u32 stride = 0, u32 offset = 0 ) {
@@ -738,8 +1318,12 @@ static void SetupAttribute( GLuint index, VertexFormat format, u32 stride = 0, u
 	GLboolean normalized;
 	VertexFormatToGL( format, &type, &num_components, &integral, &normalized );
 
+	// integer formats go to float attributes as plain numbers unless they're
+	// normalized, e.g. KHR_mesh_quantization positions
+	bool integer_attribute = index == VertexAttribute_JointIndices || index == VertexAttribute_ParticleFlags;
+
 	glEnableVertexAttribArray( index );
-	if( integral && !normalized )
+	if( integral && !normalized && integer_attribute )
 		glVertexAttribIPointer( index, num_components, type, stride, gl_offset );
 	else
 		glVertexAttribPointer( index, num_components, type, normalized, stride, gl_offset );
@@ -752,10 +1336,18 @@ static void SubmitFramebufferBlit( const RenderPass & pass ) {
 	GLbitfield clear_mask = 0;
 	clear_mask |= pass.clear_color ? GL_COLOR_BUFFER_BIT : 0;
 	clear_mask |= pass.clear_depth ? GL_DEPTH_BUFFER_BIT : 0;
-	glBlitFramebuffer( 0, 0, src.width, src.height, 0, 0, target.width, target.height, clear_mask, GL_NEAREST );
+	if( pass.viewport_width != 0 ) {
+		glBlitFramebuffer( 0, 0, pass.viewport_width, pass.viewport_height, 0, 0, pass.viewport_width, pass.viewport_height, clear_mask, GL_NEAREST );
+	}
+	else {
+		glBlitFramebuffer( 0, 0, src.width, src.height, 0, 0, target.width, target.height, clear_mask, GL_NEAREST );
+	}
 }
 
 static void SetupRenderPass( const RenderPass & pass ) {
+	if( pass.skip )
+		return;
+
 	ZoneScoped;
 	ZoneText( pass.name, strlen( pass.name ) );
 #if TRACY_ENABLE
@@ -766,19 +1358,30 @@ static void SetupRenderPass( const RenderPass & pass ) {
 		glPushDebugGroup( GL_DEBUG_SOURCE_APPLICATION, 0, -1, pass.name );
 	}
 
+	if( !benchmarking_frame ) {
+		FrameTimers * timers = &frame_timers[ frame_in_flight ];
+		timers->names[ timers->num_passes ] = pass.name;
+		glQueryCounter( timers->queries[ timers->num_passes ], GL_TIMESTAMP );
+		timers->num_passes++;
+	}
+
 	const Framebuffer & fb = pass.target;
 	if( fb.fbo != prev_fbo ) {
 		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, fb.fbo );
 		prev_fbo = fb.fbo;
+	}
 
-		u32 viewport_width = fb.fbo == 0 ? frame_static.viewport_width : fb.width;
-		u32 viewport_height = fb.fbo == 0 ? frame_static.viewport_height : fb.height;
+	u32 viewport_width = fb.fbo == 0 ? frame_static.viewport_width : fb.width;
+	u32 viewport_height = fb.fbo == 0 ? frame_static.viewport_height : fb.height;
+	if( pass.viewport_width != 0 ) {
+		viewport_width = pass.viewport_width;
+		viewport_height = pass.viewport_height;
+	}
 
-		if( viewport_width != prev_viewport_width || viewport_height != prev_viewport_height ) {
-			prev_viewport_width = viewport_width;
-			prev_viewport_height = viewport_height;
-			glViewport( 0, 0, viewport_width, viewport_height );
-		}
+	if( viewport_width != prev_viewport_width || viewport_height != prev_viewport_height ) {
+		prev_viewport_width = viewport_width;
+		prev_viewport_height = viewport_height;
+		glViewport( 0, 0, viewport_width, viewport_height );
 	}
 
 	if( pass.type == RenderPass_Blit ) {
@@ -812,7 +1415,10 @@ static void SetupRenderPass( const RenderPass & pass ) {
 	}
 }
 
-static void FinishRenderPass() {
+static void FinishRenderPass( const RenderPass & pass ) {
+	if( pass.skip )
+		return;
+
 	if( GLAD_GL_KHR_debug != 0 )
 		glPopDebugGroup();
 
@@ -821,116 +1427,386 @@ static void FinishRenderPass() {
 #endif
 }
 
-static void SubmitDrawCall( const DrawCall & dc ) {
+static void SubmitDrawCall( const DrawCall & dc ) {
+	ZoneScoped;
+	TracyGpuZone( "Draw call" );
+
+	SetPipelineState( pipelines[ dc.pipeline ], dc.mesh.ccw_winding );
+
+	glBindVertexArray( dc.mesh.vao );
+	GLenum primitive = PrimitiveTypeToGL( dc.mesh.primitive_type );
+
+	if( dc.num_instances != 0 ) {
+		glBindBuffer( GL_ARRAY_BUFFER, dc.instance_data.vbo );
+
+		SetupAttribute( VertexAttribute_ParticlePosition, VertexFormat_Floatx4, sizeof( GPUParticle ), offsetof( GPUParticle, position ) );
+		SetupAttribute( VertexAttribute_ParticleVelocity, VertexFormat_Floatx4, sizeof( GPUParticle ), offsetof( GPUParticle, velocity ) );
+		SetupAttribute( VertexAttribute_ParticleAccelDragRest, VertexFormat_Floatx3, sizeof( GPUParticle ), offsetof( GPUParticle, acceleration ) );
+		SetupAttribute( VertexAttribute_ParticleUVWH, VertexFormat_Floatx4, sizeof( GPUParticle ), offsetof( GPUParticle, uvwh ) );
+		SetupAttribute( VertexAttribute_ParticleStartColor, VertexFormat_U8x4_Norm, sizeof( GPUParticle ), offsetof( GPUParticle, start_color ) );
+		SetupAttribute( VertexAttribute_ParticleEndColor, VertexFormat_U8x4_Norm, sizeof( GPUParticle ), offsetof( GPUParticle, end_color ) );
+		SetupAttribute( VertexAttribute_ParticleSize, VertexFormat_Floatx2, sizeof( GPUParticle ), offsetof( GPUParticle, start_size ) );
+		SetupAttribute( VertexAttribute_ParticleAgeLifetime, VertexFormat_Floatx2, sizeof( GPUParticle ), offsetof( GPUParticle, age ) );
+		SetupAttribute( VertexAttribute_ParticleFlags, VertexFormat_U32x1, sizeof( GPUParticle ), offsetof( GPUParticle, flags ) );
+
+		if( dc.update_data.vbo ) {
+			glEnable( GL_RASTERIZER_DISCARD );
+			glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, dc.update_data.vbo );
+			if( dc.feedback_data.vbo ) {
+				glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 1, dc.feedback_data.vbo );
+			}
+
+			glBeginTransformFeedback( primitive );
+			GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			const void * offset = ( const void * ) uintptr_t( dc.index_offset );
+			glDrawElements( primitive, dc.num_instances, type, offset );
+			glEndTransformFeedback();
+
+			glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0 );
+			if( dc.feedback_data.vbo ) {
+				glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0 );
+			}
+			glDisable( GL_RASTERIZER_DISCARD );
+		}
+		else {
+			glVertexAttribDivisor( VertexAttribute_ParticlePosition, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleVelocity, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleAccelDragRest, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleUVWH, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleStartColor, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleEndColor, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleSize, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleAgeLifetime, 1 );
+			glVertexAttribDivisor( VertexAttribute_ParticleFlags, 1 );
+			GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			glDrawElementsInstanced( primitive, dc.num_vertices, type, 0, dc.num_instances );
+		}
+	}
+	else if( dc.num_model_instances != 0 ) {
+		if( dc.mesh.indices.ebo != 0 ) {
+			GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			const void * offset = ( const void * ) uintptr_t( dc.index_offset );
+			glDrawElementsInstanced( primitive, dc.num_vertices, type, offset, dc.num_model_instances );
+		}
+		else {
+			glDrawArraysInstanced( primitive, dc.index_offset, dc.num_vertices, dc.num_model_instances );
+		}
+	}
+	else if( dc.mesh.indices.ebo != 0 ) {
+		GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		const void * offset = ( const void * ) uintptr_t( dc.index_offset );
+		if( dc.base_vertex != 0 ) {
+			glDrawElementsBaseVertex( primitive, dc.num_vertices, type, offset, dc.base_vertex );
+		}
+		else {
+			glDrawElements( primitive, dc.num_vertices, type, offset );
+		}
+	}
+	else {
+		glDrawArrays( primitive, dc.index_offset, dc.num_vertices );
+	}
+
+	glBindVertexArray( 0 );
+}
+
+static void SubmitRenderPasses( bool skip_particle_updates ) {
+	ZoneScopedN( "Submit draw calls" );
+
+	SetupRenderPass( render_passes[ 0 ] );
+	u8 pass_idx = 0;
+
+	for( u64 key : draw_call_keys ) {
+		u8 pass = u8( key >> 56 );
+		while( pass > pass_idx ) {
+			FinishRenderPass( render_passes[ pass_idx ] );
+			pass_idx++;
+			SetupRenderPass( render_passes[ pass_idx ] );
+		}
+
+		const DrawCall & dc = draw_calls[ u32( key ) ];
+		if( render_passes[ pass ].skip || ( skip_particle_updates && dc.update_data.vbo != 0 ) )
+			continue;
+
+		// lazily compiled shaders pop in when they're ready
+		if( !RequestShader( pipelines[ dc.pipeline ].shader ) )
+			continue;
+
+		SubmitDrawCall( dc );
+	}
+
+	FinishRenderPass( render_passes[ pass_idx ] );
+
+	while( pass_idx < render_passes.size() - 1 ) {
+		pass_idx++;
+		SetupRenderPass( render_passes[ pass_idx ] );
+		FinishRenderPass( render_passes[ pass_idx ] );
+	}
+}
+
+/*
+ * r_benchframe records the next frame's render passes, draw calls and
+ * uniforms to <home>/benchframes, then submits the same frame again a bunch
+ * of times and prints the CPU submit cost and GPU time of the replays, so
+ * backend changes can be A/B tested on an identical frame
+ *
+ * GL objects don't outlive the session so the file is for reading and
+ * diffing, and the replays happen at the end of the frame that got recorded
+ * while its meshes and uniforms are still alive. particle updates are left
+ * out of the replays because they would run the simulation again
+ */
+static void BenchFrame_f() {
+	int replays = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 20;
+	if( replays <= 0 ) {
+		Com_Printf( "Usage: %s [replays]\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	bench_frame_replays = u32( Min2( replays, 100 ) );
+}
+
+static bool operator<( const UniformBlock & a, const UniformBlock & b ) {
+	if( a.ubo != b.ubo )
+		return a.ubo < b.ubo;
+	if( a.offset != b.offset )
+		return a.offset < b.offset;
+	return a.size < b.size;
+}
+
+static bool operator==( const UniformBlock & a, const UniformBlock & b ) {
+	return a.ubo == b.ubo && a.offset == b.offset && a.size == b.size;
+}
+
+static void ReadUniformBlock( UniformBlock block, u8 * buf ) {
+	memset( buf, 0, block.size );
+
+	// the size gets rounded up so the last block can hang off the end
+	u32 buffer_size = UNIFORM_BUFFER_SIZE * ( persistent_ubos ? FRAMES_IN_FLIGHT : 1 );
+	u32 size = Min2( block.size, buffer_size - block.offset );
+
+	for( const UBO & ubo : ubos ) {
+		if( ubo.ubo != block.ubo )
+			continue;
+
+		if( persistent_ubos ) {
+			memcpy( buf, ubo.persistent_buffer + block.offset, size );
+		}
+		else {
+			glBindBuffer( GL_UNIFORM_BUFFER, ubo.ubo );
+			glGetBufferSubData( GL_UNIFORM_BUFFER, block.offset, size, buf );
+		}
+		return;
+	}
+}
+
+static void WriteBenchFrame( const char * path ) {
+	ZoneScoped;
+
+	DynamicString out( sys_allocator, "frame {} {}x{}: {} passes, {} draw calls, {} pipelines\n",
+		frame_number, frame_static.viewport_width, frame_static.viewport_height, render_passes.size(), draw_call_keys.size(), pipelines.size() );
+
+	NonRAIIDynamicArray< UniformBlock > blocks;
+	blocks.init( sys_allocator );
+	defer { blocks.shutdown(); };
+
+	for( size_t i = 0; i < render_passes.size(); i++ ) {
+		const RenderPass & pass = render_passes[ i ];
+		out.append( "\npass {} \"{}\" {} fbo {}", i, pass.name, pass.type == RenderPass_Blit ? "blit" : "normal", pass.target.fbo );
+		if( pass.type == RenderPass_Blit ) {
+			out.append( " from {}", pass.blit_source.fbo );
+		}
+		if( pass.clear_color ) {
+			out.append( " clear_color {.3} {.3} {.3} {.3}", pass.color.x, pass.color.y, pass.color.z, pass.color.w );
+		}
+		if( pass.clear_depth ) {
+			out.append( " clear_depth {.3}", pass.depth );
+		}
+		out.append( "{}{}\n", pass.sorted ? "" : " unsorted", pass.skip ? " skipped" : "" );
+
+		for( u64 key : draw_call_keys ) {
+			if( u8( key >> 56 ) != i )
+				continue;
+
+			const DrawCall & dc = draw_calls[ u32( key ) ];
+			const PipelineState & pipeline = pipelines[ dc.pipeline ];
+
+			out.append( "  draw {} pipeline {} program {} vao {} primitive {} vertices {} offset {} base_vertex {}",
+				u32( key ), dc.pipeline, pipeline.shader->program, dc.mesh.vao, int( dc.mesh.primitive_type ), dc.num_vertices, dc.index_offset, dc.base_vertex );
+			if( dc.num_instances != 0 ) {
+				out.append( " particles {}{}", dc.num_instances, dc.update_data.vbo != 0 ? " update" : "" );
+			}
+			if( dc.num_model_instances != 0 ) {
+				out.append( " instances {}", dc.num_model_instances );
+			}
+			out.append( "\n    blend {} depth {} cull {} write_depth {} clamp_depth {} depth_hack {} wireframe {}",
+				int( pipeline.blend_func ), int( pipeline.depth_func ), int( pipeline.cull_face ), pipeline.write_depth, pipeline.clamp_depth, pipeline.view_weapon_depth_hack, pipeline.wireframe );
+			if( pipeline.scissor.w != 0 || pipeline.scissor.h != 0 ) {
+				out.append( " scissor {} {} {} {}", pipeline.scissor.x, pipeline.scissor.y, pipeline.scissor.w, pipeline.scissor.h );
+			}
+
+			out += "\n    uniforms";
+			for( UniformSlot slot : pipeline.shader->uniforms ) {
+				UniformBlock block = FindUniformBlock( pipeline, slot );
+				if( block.size == 0 )
+					continue;
+				out.append( " {}:{}+{}", int( slot ), block.ubo, block.offset );
+				blocks.add( block );
+			}
+
+			out += "\n    textures";
+			for( TextureSlot slot : pipeline.shader->textures ) {
+				const Texture * texture = FindTexture( pipeline, slot );
+				if( texture != NULL ) {
+					out.append( " {}:{}", int( slot ), texture->texture );
+				}
+			}
+			for( TextureBufferSlot slot : pipeline.shader->texture_buffers ) {
+				GLuint texture = FindTextureBuffer( pipeline, slot );
+				if( texture != 0 ) {
+					out.append( " tb{}:{}", int( slot ), texture );
+				}
+			}
+			for( TextureArraySlot slot : pipeline.shader->texture_arrays ) {
+				GLuint texture = FindTextureArray( pipeline, slot );
+				if( texture != 0 ) {
+					out.append( " ta{}:{}", int( slot ), texture );
+				}
+			}
+			out += "\n";
+		}
+	}
+
+	std::sort( blocks.begin(), blocks.end() );
+	UniformBlock * unique_end = std::unique( blocks.begin(), blocks.end() );
+
+	out.append( "\n{} uniform blocks\n", unique_end - blocks.begin() );
+
+	u8 buf[ UNIFORM_BUFFER_SIZE ];
+	for( const UniformBlock * block = blocks.begin(); block != unique_end; block++ ) {
+		ReadUniformBlock( *block, buf );
+		out.append( "{}+{} size {}", block->ubo, block->offset, block->size );
+		for( u32 i = 0; i < block->size; i++ ) {
+			out.append( i % 32 == 0 ? "\n  {02x}" : " {02x}", buf[ i ] );
+		}
+		out += "\n";
+	}
+
+	TempAllocator temp = cls.frame_arena.temp();
+	if( !WriteFile( &temp, path, out.c_str(), out.length() ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write %s\n", path );
+		return;
+	}
+
+	Com_Printf( "Wrote frame to %s\n", path );
+}
+
+static void PrintBenchTimes( const char * name, Span< u64 > ns ) {
+	u64 total = 0;
+	for( u64 x : ns ) {
+		total += x;
+	}
+
+	std::sort( ns.begin(), ns.end() );
+	auto ms = []( u64 x ) { return x / 1000000.0; };
+
+	Com_Printf( "%-12s avg %7.3f ms, min %7.3f ms, p50 %7.3f ms, max %7.3f ms\n", name,
+		ms( total / ns.n ), ms( ns[ 0 ] ), ms( ns[ ns.n / 2 ] ), ms( ns[ ns.n - 1 ] ) );
+}
+
+static void BenchFrame( u32 replays ) {
 	ZoneScoped;
-	TracyGpuZone( "Draw call" );
 
-	SetPipelineState( dc.pipeline, dc.mesh.ccw_winding );
-
-	glBindVertexArray( dc.mesh.vao );
-	GLenum primitive = PrimitiveTypeToGL( dc.mesh.primitive_type );
+	{
+		TempAllocator temp = cls.frame_arena.temp();
+		char date[ 256 ];
+		Sys_FormatTime( date, sizeof( date ), "%y%m%d_%H%M%S" );
+		WriteBenchFrame( temp( "{}/benchframes/{}.txt", HomeDirPath(), date ) );
+	}
 
-	if( dc.num_instances != 0 ) {
-		glBindBuffer( GL_ARRAY_BUFFER, dc.instance_data.vbo );
+	u32 particle_updates = 0;
+	for( u64 key : draw_call_keys ) {
+		particle_updates += draw_calls[ u32( key ) ].update_data.vbo != 0 ? 1 : 0;
+	}
 
-		SetupAttribute( VertexAttribute_ParticlePosition, VertexFormat_Floatx4, sizeof( GPUParticle ), offsetof( GPUParticle, position ) );
-		SetupAttribute( VertexAttribute_ParticleVelocity, VertexFormat_Floatx4, sizeof( GPUParticle ), offsetof( GPUParticle, velocity ) );
-		SetupAttribute( VertexAttribute_ParticleAccelDragRest, VertexFormat_Floatx3, sizeof( GPUParticle ), offsetof( GPUParticle, acceleration ) );
-		SetupAttribute( VertexAttribute_ParticleUVWH, VertexFormat_Floatx4, sizeof( GPUParticle ), offsetof( GPUParticle, uvwh ) );
-		SetupAttribute( VertexAttribute_ParticleStartColor, VertexFormat_U8x4_Norm, sizeof( GPUParticle ), offsetof( GPUParticle, start_color ) );
-		SetupAttribute( VertexAttribute_ParticleEndColor, VertexFormat_U8x4_Norm, sizeof( GPUParticle ), offsetof( GPUParticle, end_color ) );
-		SetupAttribute( VertexAttribute_ParticleSize, VertexFormat_Floatx2, sizeof( GPUParticle ), offsetof( GPUParticle, start_size ) );
-		SetupAttribute( VertexAttribute_ParticleAgeLifetime, VertexFormat_Floatx2, sizeof( GPUParticle ), offsetof( GPUParticle, age ) );
-		SetupAttribute( VertexAttribute_ParticleFlags, VertexFormat_U32x1, sizeof( GPUParticle ), offsetof( GPUParticle, flags ) );
+	Span< u64 > cpu_ns = ALLOC_SPAN( sys_allocator, u64, replays );
+	Span< u64 > gpu_ns = ALLOC_SPAN( sys_allocator, u64, replays );
+	Span< GLuint > queries = ALLOC_SPAN( sys_allocator, GLuint, replays );
+	defer { FREE( sys_allocator, cpu_ns.ptr ); };
+	defer { FREE( sys_allocator, gpu_ns.ptr ); };
+	defer { FREE( sys_allocator, queries.ptr ); };
 
-		if( dc.update_data.vbo ) {
-			glEnable( GL_RASTERIZER_DISCARD );
-			glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, dc.update_data.vbo );
-			if( dc.feedback_data.vbo ) {
-				glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 1, dc.feedback_data.vbo );
-			}
+	glGenQueries( replays, queries.ptr );
+	defer { glDeleteQueries( replays, queries.ptr ); };
 
-			glBeginTransformFeedback( primitive );
-			GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-			const void * offset = ( const void * ) uintptr_t( dc.index_offset );
-			glDrawElements( primitive, dc.num_instances, type, offset );
-			glEndTransformFeedback();
+	// don't let the replays mess with the frame's stats
+	u32 old_skipped_ubo_binds = skipped_ubo_binds;
+	u32 old_skipped_texture_binds = skipped_texture_binds;
+	benchmarking_frame = true;
 
-			glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0 );
-			if( dc.feedback_data.vbo ) {
-				glBindBufferBase( GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0 );
-			}
-			glDisable( GL_RASTERIZER_DISCARD );
-		}
-		else {
-			glVertexAttribDivisor( VertexAttribute_ParticlePosition, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleVelocity, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleAccelDragRest, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleUVWH, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleStartColor, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleEndColor, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleSize, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleAgeLifetime, 1 );
-			glVertexAttribDivisor( VertexAttribute_ParticleFlags, 1 );
-			GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-			glDrawElementsInstanced( primitive, dc.num_vertices, type, 0, dc.num_instances );
-		}
-	}
-	else if( dc.mesh.indices.ebo != 0 ) {
-		GLenum type = dc.mesh.indices_format == IndexFormat_U16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
-		const void * offset = ( const void * ) uintptr_t( dc.index_offset );
-		glDrawElements( primitive, dc.num_vertices, type, offset );
+	for( u32 i = 0; i < replays; i++ ) {
+		u64 t0 = Sys_Nanoseconds();
+		glBeginQuery( GL_TIME_ELAPSED, queries[ i ] );
+		SubmitRenderPasses( true );
+		glEndQuery( GL_TIME_ELAPSED );
+		cpu_ns[ i ] = Sys_Nanoseconds() - t0;
 	}
-	else {
-		glDrawArrays( primitive, dc.index_offset, dc.num_vertices );
+
+	benchmarking_frame = false;
+	u32 replay_skipped_ubo_binds = skipped_ubo_binds - old_skipped_ubo_binds;
+	u32 replay_skipped_texture_binds = skipped_texture_binds - old_skipped_texture_binds;
+	skipped_ubo_binds = old_skipped_ubo_binds;
+	skipped_texture_binds = old_skipped_texture_binds;
+
+	for( u32 i = 0; i < replays; i++ ) {
+		GLuint64 elapsed;
+		glGetQueryObjectui64v( queries[ i ], GL_QUERY_RESULT, &elapsed );
+		gpu_ns[ i ] = elapsed;
 	}
 
-	glBindVertexArray( 0 );
+	Com_Printf( "Replayed %zu draw calls in %zu passes %u times", draw_call_keys.size() - particle_updates, render_passes.size(), replays );
+	if( particle_updates > 0 ) {
+		Com_Printf( ", skipping %u particle updates", particle_updates );
+	}
+	Com_Printf( "\n" );
+	PrintBenchTimes( "CPU submit", cpu_ns );
+	PrintBenchTimes( "GPU", gpu_ns );
+	Com_Printf( "Skipped binds per replay: %u UBO, %u texture\n", replay_skipped_ubo_binds / replays, replay_skipped_texture_binds / replays );
 }
 
 void RenderBackendSubmitFrame() {
-	ZoneScoped;
+	ZoneScopedSampled( "RenderBackendSubmitFrame" );
 
 	assert( in_frame );
 	assert( render_passes.size() > 0 );
-	in_frame = false;
 
 	{
-		ZoneScopedN( "Unmap UBOs" );
-		for( UBO ubo : ubos ) {
-			glBindBuffer( GL_UNIFORM_BUFFER, ubo.ubo );
-			glUnmapBuffer( GL_UNIFORM_BUFFER );
+		ZoneScopedN( "Sort draw calls" );
+
+		draw_call_keys.resize( draw_calls.size() );
+		for( size_t i = 0; i < draw_calls.size(); i++ ) {
+			draw_call_keys[ i ] = DrawCallKey( draw_calls[ i ], i );
 		}
-	}
 
-	{
-		ZoneScopedN( "Sort draw calls" );
-		std::stable_sort( draw_calls.begin(), draw_calls.end(), SortDrawCall );
+		if( draw_calls.size() > 0 ) {
+			SortDrawCallKeys();
+		}
 	}
 
-	SetupRenderPass( render_passes[ 0 ] );
-	u8 pass_idx = 0;
+	// needs to go before unmapping the UBOs so it can upload instance data
+	InstanceDrawCalls();
 
-	{
-		ZoneScopedN( "Submit draw calls" );
-		for( const DrawCall & dc : draw_calls ) {
-			while( dc.pipeline.pass > pass_idx ) {
-				FinishRenderPass();
-				pass_idx++;
-				SetupRenderPass( render_passes[ pass_idx ] );
-			}
+	in_frame = false;
 
-			SubmitDrawCall( dc );
+	if( !persistent_ubos ) {
+		ZoneScopedN( "Unmap UBOs" );
+		for( UBO ubo : ubos ) {
+			glBindBuffer( GL_UNIFORM_BUFFER, ubo.ubo );
+			glUnmapBuffer( GL_UNIFORM_BUFFER );
 		}
 	}
 
-	FinishRenderPass();
+	frame_timers[ frame_in_flight ].num_passes = 0;
 
-	while( pass_idx < render_passes.size() - 1 ) {
-		pass_idx++;
-		SetupRenderPass( render_passes[ pass_idx ] );
-		FinishRenderPass();
-	}
+	SubmitRenderPasses( false );
 
 	{
 		// OBS captures the game with glBlitFramebuffer which gets
@@ -940,6 +1816,20 @@ void RenderBackendSubmitFrame() {
 		SetPipelineState( no_scissor_test, true );
 	}
 
+	// before the bench so the replays don't count towards the frame's own timers
+	{
+		FrameTimers * timers = &frame_timers[ frame_in_flight ];
+		glQueryCounter( timers->queries[ timers->num_passes ], GL_TIMESTAMP );
+		timers->frame = frame_number;
+		timers->pending = true;
+	}
+
+	// and before the deferred deletes so meshes from this frame are still alive
+	if( bench_frame_replays != 0 ) {
+		BenchFrame( bench_frame_replays );
+		bench_frame_replays = 0;
+	}
+
 	{
 		ZoneScopedN( "Deferred mesh deletes" );
 		for( const Mesh & mesh : deferred_mesh_deletes ) {
@@ -958,34 +1848,80 @@ void RenderBackendSubmitFrame() {
 	for( const UBO & ubo : ubos ) {
 		ubo_bytes_used += ubo.bytes_used;
 	}
-	TracyPlot( "UBO utilisation", float( ubo_bytes_used ) / float( UNIFORM_BUFFER_SIZE * ARRAY_COUNT( ubos ) ) );
+	TracyPlot( "UBO utilisation", float( ubo_bytes_used ) / float( UNIFORM_BUFFER_SIZE * ubos.size() ) );
 
-	TracyPlot( "Draw calls", s64( draw_calls.size() ) );
+	TracyPlot( "Draw calls", s64( draw_call_keys.size() ) );
+	TracyPlot( "Instanced draw calls", s64( num_instanced_draw_calls ) );
 	TracyPlot( "Vertices", s64( num_vertices_this_frame ) );
+	TracyPlot( "Skipped UBO binds", s64( skipped_ubo_binds ) );
+	TracyPlot( "Skipped texture binds", s64( skipped_texture_binds ) );
+
+	frame_fences[ frame_in_flight ] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	frame_in_flight = ( frame_in_flight + 1 ) % FRAMES_IN_FLIGHT;
+	frame_number++;
 
 	TracyGpuCollect;
 }
 
+u32 FrameInFlight() {
+	return frame_in_flight;
+}
+
+u64 FrameNumber() {
+	return frame_number;
+}
+
+float GPUFrameTime() {
+	return gpu_frame_time;
+}
+
+Span< const GPUPassTime > GPUPassTimes() {
+	return Span< const GPUPassTime >( gpu_pass_times, num_gpu_pass_times );
+}
+
+GPUFrameFinish LastGPUFrameFinish() {
+	return gpu_frame_finish;
+}
+
+bool FrameFinished( u64 frame ) {
+	if( frame >= frame_number )
+		return false;
+	if( frame_number - frame >= FRAMES_IN_FLIGHT )
+		return true;
+
+	GLsync fence = frame_fences[ frame % FRAMES_IN_FLIGHT ];
+	if( fence == NULL )
+		return true;
+
+	GLenum status = glClientWaitSync( fence, 0, 0 );
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
 UniformBlock UploadUniforms( const void * data, size_t size ) {
 	assert( in_frame );
+	assert( recording_list == NULL );
 
 	UBO * ubo = NULL;
 	u32 offset = 0;
 
-	for( size_t i = 0; i < ARRAY_COUNT( ubos ); i++ ) {
-		offset = AlignPow2( ubos[ i ].bytes_used, ubo_offset_alignment );
+	for( UBO & candidate : ubos ) {
+		offset = AlignPow2( candidate.bytes_used, ubo_offset_alignment );
 		if( UNIFORM_BUFFER_SIZE - offset >= size ) {
-			ubo = &ubos[ i ];
+			ubo = &candidate;
 			break;
 		}
 	}
 
-	if( ubo == NULL )
-		Fatal( "Ran out of UBO space" );
+	if( ubo == NULL ) {
+		assert( size <= UNIFORM_BUFFER_SIZE );
+		ubo = AddUBO();
+		MapUBO( ubo );
+		offset = 0;
+	}
 
 	UniformBlock block;
 	block.ubo = ubo->ubo;
-	block.offset = offset;
+	block.offset = offset + ( persistent_ubos ? frame_in_flight * UNIFORM_BUFFER_SIZE : 0 );
 	block.size = AlignPow2( checked_cast< u32 >( size ), u32( 16 ) );
 
 	// memset so we don't leave any gaps. good for write combined memory!
@@ -1072,6 +2008,7 @@ TextureBuffer NewTextureBuffer( TextureBufferFormat format, u32 len ) {
 
 	glBindBuffer( GL_TEXTURE_BUFFER, tb.tbo );
 	glBindTexture( GL_TEXTURE_BUFFER, tb.texture );
+	InvalidateActiveTextureUnit();
 
 	GLenum internal_format;
 	u32 element_size;
@@ -1092,6 +2029,7 @@ void WriteTextureBuffer( TextureBuffer tb, const void * data, u32 len ) {
 void DeleteTextureBuffer( TextureBuffer tb ) {
 	glDeleteBuffers( 1, &tb.tbo );
 	glDeleteTextures( 1, &tb.texture );
+	InvalidateDeletedTexture( tb.texture );
 }
 
 void DeferDeleteTextureBuffer( TextureBuffer tb ) {
@@ -1106,10 +2044,9 @@ static Texture NewTextureSamples( TextureConfig config, int msaa_samples ) {
 	texture.format = config.format;
 
 	glGenTextures( 1, &texture.texture );
-	// TODO: should probably update the gl state since we bind a new texture
-	// TODO: or glactivetexture 0?
 	GLenum target = msaa_samples == 0 ? GL_TEXTURE_2D : GL_TEXTURE_2D_MULTISAMPLE;
 	glBindTexture( target, texture.texture );
+	InvalidateActiveTextureUnit();
 
 	GLenum internal_format, channels, type;
 	TextureFormatToGL( config.format, &internal_format, &channels, &type );
@@ -1189,6 +2126,7 @@ void DeleteTexture( Texture texture ) {
 	if( texture.texture == 0 )
 		return;
 	glDeleteTextures( 1, &texture.texture );
+	InvalidateDeletedTexture( texture.texture );
 }
 
 TextureArray NewTextureArray( const TextureArrayConfig & config ) {
@@ -1196,6 +2134,7 @@ TextureArray NewTextureArray( const TextureArrayConfig & config ) {
 
 	glGenTextures( 1, &ta.texture );
 	glBindTexture( GL_TEXTURE_2D_ARRAY, ta.texture );
+	InvalidateActiveTextureUnit();
 	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT );
 	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT );
 	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
@@ -1245,6 +2184,7 @@ void DeleteTextureArray( TextureArray ta ) {
 	if( ta.texture == 0 )
 		return;
 	glDeleteTextures( 1, &ta.texture );
+	InvalidateDeletedTexture( ta.texture );
 }
 
 Framebuffer NewFramebuffer( const FramebufferConfig & config ) {
@@ -1387,35 +2327,42 @@ static const char * FRAGMENT_SHADER_PRELUDE =
 	"#define FRAGMENT_SHADER 1\n"
 	"#define v2f in\n";
 
-static GLuint CompileShader( GLenum type, Span< const char * > srcs, Span< int > lens ) {
-	const char * full_srcs[ 32 ];
-	int full_lens[ 32 ];
-	GLsizei n = 0;
-
-	full_srcs[ n ] = "#version 330\n";
-	full_lens[ n ] = -1;
-	n++;
-
-	full_srcs[ n ] = type == GL_VERTEX_SHADER ? VERTEX_SHADER_PRELUDE : FRAGMENT_SHADER_PRELUDE;
-	full_lens[ n ] = -1;
-	n++;
+static void AddShaderSources( GLenum type, Span< const char * > srcs, Span< int > lens, const char ** full_srcs, int * full_lens, GLsizei * n ) {
+	full_srcs[ *n ] = "#version 330\n";
+	full_lens[ *n ] = -1;
+	( *n )++;
 
-	full_srcs[ n ] = "#define MAX_JOINTS " STRINGIFY( MAX_GLSL_UNIFORM_JOINTS ) "\n";
-	full_lens[ n ] = -1;
-	n++;
+	full_srcs[ *n ] = type == GL_VERTEX_SHADER ? VERTEX_SHADER_PRELUDE : FRAGMENT_SHADER_PRELUDE;
+	full_lens[ *n ] = -1;
+	( *n )++;
 
-	assert( n + srcs.n <= ARRAY_COUNT( full_srcs ) );
+	full_srcs[ *n ] = "#define MAX_JOINTS " STRINGIFY( MAX_GLSL_UNIFORM_JOINTS ) "\n";
+	full_lens[ *n ] = -1;
+	( *n )++;
 
 	for( size_t i = 0; i < srcs.n; i++ ) {
-		full_srcs[ n ] = srcs[ i ];
-		full_lens[ n ] = lens[ i ];
-		n++;
+		full_srcs[ *n ] = srcs[ i ];
+		full_lens[ *n ] = lens[ i ];
+		( *n )++;
 	}
+}
+
+static GLuint CompileShader( GLenum type, Span< const char * > srcs, Span< int > lens ) {
+	const char * full_srcs[ 32 ];
+	int full_lens[ 32 ];
+	GLsizei n = 0;
+
+	assert( srcs.n + 3 <= ARRAY_COUNT( full_srcs ) );
+	AddShaderSources( type, srcs, lens, full_srcs, full_lens, &n );
 
 	GLuint shader = glCreateShader( type );
 	glShaderSource( shader, n, full_srcs, full_lens );
 	glCompileShader( shader );
 
+	return shader;
+}
+
+static bool CheckShaderCompiled( GLuint shader ) {
 	GLint status;
 	glGetShaderiv( shader, GL_COMPILE_STATUS, &status );
 
@@ -1423,45 +2370,113 @@ static GLuint CompileShader( GLenum type, Span< const char * > srcs, Span< int >
 		char buf[ 1024 ];
 		glGetShaderInfoLog( shader, sizeof( buf ), NULL, buf );
 		Com_Printf( S_COLOR_YELLOW "Shader compilation failed: %s\n", buf );
-		glDeleteShader( shader );
 
 		// static char src[ 65536 ];
 		// glGetShaderSource( shader, sizeof( src ), NULL, src );
 		// printf( "%s\n", src );
 
-		return 0;
+		return false;
 	}
 
-	return shader;
+	return true;
 }
 
-bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Span< const char * > feedback_varyings ) {
-	*shader = { };
-	bool feedback = feedback_varyings.n > 0;
+/*
+ * the cache key covers everything that goes into the program, plus the
+ * driver so updates invalidate it
+ */
+static u64 ShaderCacheKey( Span< const char * > srcs, Span< int > lens, Span< const char * > feedback_varyings ) {
+	u64 hash = shader_cache_driver_hash;
+	hash = Hash64( VERTEX_SHADER_PRELUDE, strlen( VERTEX_SHADER_PRELUDE ), hash );
+	hash = Hash64( FRAGMENT_SHADER_PRELUDE, strlen( FRAGMENT_SHADER_PRELUDE ), hash );
+	hash = Hash64( STRINGIFY( MAX_GLSL_UNIFORM_JOINTS ), strlen( STRINGIFY( MAX_GLSL_UNIFORM_JOINTS ) ), hash );
 
-	GLuint vs = CompileShader( GL_VERTEX_SHADER, srcs, lens );
-	if( vs == 0 )
-		return false;
-	defer { glDeleteShader( vs ); };
+	for( size_t i = 0; i < srcs.n; i++ ) {
+		size_t len = lens[ i ] == -1 ? strlen( srcs[ i ] ) : size_t( lens[ i ] );
+		hash = Hash64( srcs[ i ], len, hash );
+	}
 
-	GLuint fs = 0;
-	if( !feedback ) {
-		fs = CompileShader( GL_FRAGMENT_SHADER, srcs, lens );
-		if( fs == 0 )
-			return false;
+	for( const char * varying : feedback_varyings ) {
+		hash = Hash64( varying, strlen( varying ), hash );
 	}
-	defer {
-		if( fs != 0 ) {
-			glDeleteShader( fs );
+
+	return hash;
+}
+
+#define SHADER_CACHE_MAGIC 0x48435347 // GSCH
+#define SHADER_CACHE_VERSION 1
+
+static const char * ShaderCachePath( TempAllocator * temp, u64 key ) {
+	return ( *temp )( "{}/shadercache/{016x}.bin", HomeDirPath(), key );
+}
+
+static bool LoadCachedProgram( GLuint program, u64 key ) {
+	TempAllocator temp = cls.frame_arena.temp();
+
+	Span< const u8 > file = MapCacheFile( &temp, ShaderCachePath( &temp, key ), SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, key );
+	if( file.ptr == NULL )
+		return false;
+	defer { UnmapFile( file ); };
+
+	Span< const u8 > data = file + CACHE_FILE_DATA_OFFSET;
+	if( data.n <= sizeof( GLenum ) )
+		return false;
+
+	GLenum format;
+	memcpy( &format, data.ptr, sizeof( format ) );
+	glProgramBinary( program, format, data.ptr + sizeof( format ), data.n - sizeof( format ) );
+
+	GLint status;
+	glGetProgramiv( program, GL_LINK_STATUS, &status );
+	return status == GL_TRUE;
+}
+
+static void SaveCachedProgram( GLuint program, u64 key ) {
+	GLint len;
+	glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &len );
+	if( len <= 0 )
+		return;
+
+	TempAllocator temp = cls.frame_arena.temp();
+
+	u8 * data = ALLOC_MANY( sys_allocator, u8, sizeof( GLenum ) + len );
+	defer { FREE( sys_allocator, data ); };
+	GLenum format;
+	glGetProgramBinary( program, len, NULL, &format, data + sizeof( format ) );
+	memcpy( data, &format, sizeof( format ) );
+
+	WriteCacheFile( ShaderCachePath( &temp, key ), SHADER_CACHE_MAGIC, SHADER_CACHE_VERSION, key, Span< const u8 >( data, sizeof( format ) + len ) );
+}
+
+bool StartShader( PendingShader * pending, Span< const char * > srcs, Span< int > lens, Span< const char * > feedback_varyings ) {
+	ZoneScoped;
+
+	*pending = { };
+	pending->feedback = feedback_varyings.n > 0;
+	pending->program = glCreateProgram();
+
+	if( shader_cache_supported ) {
+		pending->cache_key = ShaderCacheKey( srcs, lens, feedback_varyings );
+		if( LoadCachedProgram( pending->program, pending->cache_key ) ) {
+			pending->cached = true;
+			return true;
 		}
-	};
 
-	GLuint program = glCreateProgram();
-	glAttachShader( program, vs );
-	if( !feedback ) {
-		glAttachShader( program, fs );
+		// a failed glProgramBinary leaves the program unusable, so start over
+		glDeleteProgram( pending->program );
+		pending->program = glCreateProgram();
+		glProgramParameteri( pending->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
 	}
 
+	pending->vs = CompileShader( GL_VERTEX_SHADER, srcs, lens );
+	glAttachShader( pending->program, pending->vs );
+	if( !pending->feedback ) {
+		pending->fs = CompileShader( GL_FRAGMENT_SHADER, srcs, lens );
+		glAttachShader( pending->program, pending->fs );
+	}
+
+	GLuint program = pending->program;
+
 	glBindAttribLocation( program, VertexAttribute_Position, "a_Position" );
 	glBindAttribLocation( program, VertexAttribute_Normal, "a_Normal" );
 	glBindAttribLocation( program, VertexAttribute_TexCoord, "a_TexCoord" );
@@ -1479,7 +2494,7 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 	glBindAttribLocation( program, VertexAttribute_ParticleAgeLifetime, "a_ParticleAgeLifetime" );
 	glBindAttribLocation( program, VertexAttribute_ParticleFlags, "a_ParticleFlags" );
 
-	if( !feedback ) {
+	if( !pending->feedback ) {
 		glBindFragDataLocation( program, 0, "f_Albedo" );
 		glBindFragDataLocation( program, 1, "f_Normal" );
 	}
@@ -1487,8 +2502,109 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 		glTransformFeedbackVaryings( program, feedback_varyings.n, feedback_varyings.begin(), GL_INTERLEAVED_ATTRIBS );
 	}
 
+	// without KHR_parallel_shader_compile this is where the driver stalls,
+	// with it we don't block until someone asks for the status
 	glLinkProgram( program );
 
+	return true;
+}
+
+bool ShaderReady( const PendingShader & pending ) {
+	if( pending.cached || !parallel_shader_compile )
+		return true;
+
+	GLint done;
+	glGetProgramiv( pending.program, GL_COMPLETION_STATUS_KHR, &done );
+	return done == GL_TRUE;
+}
+
+static const char * uniform_slot_names[] = {
+	"u_View",
+	"u_Model",
+	"u_Material",
+	"u_Fog",
+	"u_Pose",
+	"u_Time",
+	"u_Outline",
+	"u_Text",
+	"u_PostProcess",
+	"u_ShadowMaps",
+	"u_BlueNoiseTextureParams",
+	"u_ParticleUpdate",
+	"u_Instances",
+	"u_InstanceMaterials",
+	"u_DynamicLight",
+	"u_Decal",
+};
+
+static const char * texture_slot_names[] = {
+	"u_BaseTexture",
+	"u_BlueNoiseTexture",
+	"u_DepthTexture",
+	"u_Noise",
+	"u_Screen",
+	"u_SilhouetteTexture",
+	"u_SilhouetteOutlineTexture",
+	"u_SilhouetteDepthTexture",
+};
+
+static const char * texture_buffer_slot_names[] = {
+	"u_NodeBuffer",
+	"u_LeafBuffer",
+	"u_BrushBuffer",
+	"u_PlaneBuffer",
+	"u_DecalTiles",
+	"u_DecalData",
+	"u_DynamicLightTiles",
+	"u_DynamicLightData",
+	"u_DynamicCount",
+};
+
+static const char * texture_array_slot_names[] = {
+	"u_DecalAtlases",
+	"u_ShadowmapTextureArray",
+};
+
+STATIC_ASSERT( ARRAY_COUNT( uniform_slot_names ) == UniformSlot_Count );
+STATIC_ASSERT( ARRAY_COUNT( texture_slot_names ) == TextureSlot_Count );
+STATIC_ASSERT( ARRAY_COUNT( texture_buffer_slot_names ) == TextureBufferSlot_Count );
+STATIC_ASSERT( ARRAY_COUNT( texture_array_slot_names ) == TextureArraySlot_Count );
+
+// bindings we don't have a slot for never get bound, which is what you get
+// for forgetting to set one anyway
+template< size_t N >
+static u8 FindSlot( const char * ( &names )[ N ], const char * name ) {
+	for( size_t i = 0; i < N; i++ ) {
+		if( strcmp( names[ i ], name ) == 0 ) {
+			return u8( i );
+		}
+	}
+
+	Com_Printf( S_COLOR_YELLOW "%s doesn't have a binding slot\n", name );
+	return U8_MAX;
+}
+
+bool FinishShader( Shader * shader, PendingShader pending ) {
+	ZoneScoped;
+
+	*shader = { };
+	GLuint program = pending.program;
+
+	bool compiled = true;
+	if( pending.vs != 0 ) {
+		compiled = compiled && CheckShaderCompiled( pending.vs );
+		glDeleteShader( pending.vs );
+	}
+	if( pending.fs != 0 ) {
+		compiled = compiled && CheckShaderCompiled( pending.fs );
+		glDeleteShader( pending.fs );
+	}
+
+	if( !compiled ) {
+		glDeleteProgram( program );
+		return false;
+	}
+
 	GLint status;
 	glGetProgramiv( program, GL_LINK_STATUS, &status );
 	if( status == GL_FALSE ) {
@@ -1498,13 +2614,23 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 		char buf[ 1024 ];
 		glGetProgramInfoLog( program, sizeof( buf ), NULL, buf );
 		Com_Printf( S_COLOR_YELLOW "Shader linking failed: %s\n", buf );
+		glDeleteProgram( program );
 
 		return false;
 	}
 
+	if( shader_cache_supported && !pending.cached ) {
+		SaveCachedProgram( program, pending.cache_key );
+	}
+
 	glUseProgram( program );
 	shader->program = program;
 
+	for( UniformSlot & slot : shader->uniforms ) slot = UniformSlot_None;
+	for( TextureSlot & slot : shader->textures ) slot = TextureSlot_None;
+	for( TextureBufferSlot & slot : shader->texture_buffers ) slot = TextureBufferSlot_None;
+	for( TextureArraySlot & slot : shader->texture_arrays ) slot = TextureArraySlot_None;
+
 	GLint count, maxlen;
 	glGetProgramiv( program, GL_ACTIVE_UNIFORMS, &count );
 	glGetProgramiv( program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxlen );
@@ -1526,7 +2652,7 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 			}
 
 			glUniform1i( glGetUniformLocation( program, name ), num_textures );
-			shader->textures[ num_textures ] = Hash64( name, len );
+			shader->textures[ num_textures ] = TextureSlot( FindSlot( texture_slot_names, name ) );
 			num_textures++;
 		}
 
@@ -1538,7 +2664,7 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 			}
 
 			glUniform1i( glGetUniformLocation( program, name ), ARRAY_COUNT( &Shader::textures ) + num_texture_buffers );
-			shader->texture_buffers[ num_texture_buffers ] = Hash64( name, len );
+			shader->texture_buffers[ num_texture_buffers ] = TextureBufferSlot( FindSlot( texture_buffer_slot_names, name ) );
 			num_texture_buffers++;
 		}
 
@@ -1550,7 +2676,7 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 			}
 
 			glUniform1i( glGetUniformLocation( program, name ), ARRAY_COUNT( &Shader::textures ) + ARRAY_COUNT( &Shader::texture_buffers ) + num_texture_arrays );
-			shader->texture_arrays[ num_texture_arrays ] = Hash64( name, len );
+			shader->texture_arrays[ num_texture_arrays ] = TextureArraySlot( FindSlot( texture_array_slot_names, name ) );
 			num_texture_arrays++;
 		}
 	}
@@ -1558,12 +2684,18 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 	glGetProgramiv( program, GL_ACTIVE_UNIFORM_BLOCKS, &count );
 	glGetProgramiv( program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxlen );
 
+	if( size_t( count ) > ARRAY_COUNT( shader->uniforms ) ) {
+		glDeleteProgram( program );
+		Com_Printf( S_COLOR_YELLOW "Too many uniform blocks in shader\n" );
+		return false;
+	}
+
 	for( GLint i = 0; i < count; i++ ) {
 		char name[ 128 ];
 		GLint len;
 		glGetActiveUniformBlockName( program, i, sizeof( name ), &len, name );
 		glUniformBlockBinding( program, i, i );
-		shader->uniforms[ i ] = Hash64( name, len );
+		shader->uniforms[ i ] = UniformSlot( FindSlot( uniform_slot_names, name ) );
 	}
 
 	prev_pipeline.shader = NULL;
@@ -1572,6 +2704,13 @@ bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Sp
 	return true;
 }
 
+bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Span< const char * > feedback_varyings ) {
+	PendingShader pending;
+	if( !StartShader( &pending, srcs, lens, feedback_varyings ) )
+		return false;
+	return FinishShader( shader, pending );
+}
+
 void DeleteShader( Shader shader ) {
 	if( shader.program == 0 )
 		return;
@@ -1717,25 +2856,111 @@ void DeferDeleteMesh( const Mesh & mesh ) {
 	deferred_mesh_deletes.add( mesh );
 }
 
-void DrawMesh( const Mesh & mesh, const PipelineState & pipeline, u32 num_vertices_override, u32 index_offset ) {
+void DrawMesh( const Mesh & mesh, const PipelineState & pipeline, u32 num_vertices_override, u32 index_offset, u32 base_vertex ) {
 	assert( in_frame );
 	assert( pipeline.pass != U8_MAX );
 	assert( pipeline.shader != NULL );
 
 	DrawCall dc = { };
 	dc.mesh = mesh;
-	dc.pipeline = pipeline;
 	dc.num_vertices = num_vertices_override == 0 ? mesh.num_vertices : num_vertices_override;
 	dc.index_offset = index_offset;
+	dc.base_vertex = base_vertex;
+
+	if( recording_list != NULL ) {
+		dc.pipeline = checked_cast< u32 >( recording_list->pipelines.add( pipeline ) );
+		recording_list->draw_calls.add( dc );
+		recording_list->num_vertices += dc.num_vertices;
+		return;
+	}
+
+	dc.pipeline = checked_cast< u32 >( pipelines.add( pipeline ) );
 	draw_calls.add( dc );
 
 	num_vertices_this_frame += dc.num_vertices;
 }
 
+void DrawInstanceableMesh( const Mesh & mesh, const PipelineState & pipeline, const Mat4 & transform, u32 num_vertices_override, u32 index_offset ) {
+	DrawMesh( mesh, pipeline, num_vertices_override, index_offset );
+
+	NonRAIIDynamicArray< DrawCall > * dcs = recording_list != NULL ? &recording_list->draw_calls : &draw_calls;
+	NonRAIIDynamicArray< Mat4 > * transforms = recording_list != NULL ? &recording_list->model_transforms : &model_transforms;
+
+	DrawCall & dc = ( *dcs )[ dcs->size() - 1 ];
+	dc.instanceable = true;
+	dc.model_transform = checked_cast< u32 >( transforms->add( transform ) );
+}
+
+struct ParallelDrawCallsJob {
+	JobCallback callback;
+	void * data;
+	DrawCallList * list;
+};
+
+void ParallelDrawCalls( void * datum, size_t n, size_t stride, JobCallback callback ) {
+	ZoneScoped;
+
+	assert( in_frame );
+	assert( recording_list == NULL );
+	assert( n <= ARRAY_COUNT( parallel_draw_call_lists ) );
+
+	ParallelDrawCallsJob jobs[ ARRAY_COUNT( parallel_draw_call_lists ) ];
+	for( size_t i = 0; i < n; i++ ) {
+		DrawCallList * list = &parallel_draw_call_lists[ i ];
+		list->draw_calls.clear();
+		list->pipelines.clear();
+		list->model_transforms.clear();
+		list->num_vertices = 0;
+
+		jobs[ i ].callback = callback;
+		jobs[ i ].data = ( ( char * ) datum ) + stride * i;
+		jobs[ i ].list = list;
+	}
+
+	ParallelFor( jobs, n, sizeof( jobs[ 0 ] ), []( TempAllocator * temp, void * data ) {
+		ParallelDrawCallsJob * job = ( ParallelDrawCallsJob * ) data;
+		recording_list = job->list;
+		job->callback( temp, job->data );
+		recording_list = NULL;
+	} );
+
+	{
+		ZoneScopedN( "Merge draw call lists" );
+
+		for( size_t i = 0; i < n; i++ ) {
+			const DrawCallList * list = &parallel_draw_call_lists[ i ];
+			u32 first_pipeline = checked_cast< u32 >( pipelines.size() );
+			u32 first_transform = checked_cast< u32 >( model_transforms.size() );
+
+			for( const PipelineState & pipeline : list->pipelines ) {
+				pipelines.add( pipeline );
+			}
+
+			for( const Mat4 & transform : list->model_transforms ) {
+				model_transforms.add( transform );
+			}
+
+			for( DrawCall dc : list->draw_calls ) {
+				dc.pipeline += first_pipeline;
+				if( dc.instanceable ) {
+					dc.model_transform += first_transform;
+				}
+				draw_calls.add( dc );
+			}
+
+			num_vertices_this_frame += list->num_vertices;
+		}
+	}
+}
+
 u8 AddRenderPass( const RenderPass & pass ) {
 	return checked_cast< u8 >( render_passes.add( pass ) );
 }
 
+void SkipRenderPass( u8 pass ) {
+	render_passes[ pass ].skip = true;
+}
+
 u8 AddRenderPass( const char * name, const tracy::SourceLocationData * tracy, Framebuffer target, ClearColor clear_color, ClearDepth clear_depth ) {
 	RenderPass pass;
 	pass.type = RenderPass_Normal;
@@ -1785,17 +3010,17 @@ void UpdateParticles( const Mesh & mesh, VertexBuffer vb_in, VertexBuffer vb_out
 	pipeline.pass = frame_static.particle_update_pass;
 	pipeline.shader = &shaders.particle_update;
 	u32 collision = cl.map == NULL ? 0 : 1;
-	pipeline.set_uniform( "u_ParticleUpdate", UploadUniformBlock( collision, radius, dt ) );
+	pipeline.set_uniform( UniformSlot_ParticleUpdate, UploadUniformBlock( collision, radius, dt ) );
 	if( collision ) {
-		pipeline.set_texture_buffer( "u_NodeBuffer", cl.map->nodeBuffer );
-		pipeline.set_texture_buffer( "u_LeafBuffer", cl.map->leafBuffer );
-		pipeline.set_texture_buffer( "u_BrushBuffer", cl.map->brushBuffer );
-		pipeline.set_texture_buffer( "u_PlaneBuffer", cl.map->planeBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_NodeBuffer, cl.map->nodeBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_LeafBuffer, cl.map->leafBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_BrushBuffer, cl.map->brushBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_PlaneBuffer, cl.map->planeBuffer );
 	}
 
 	DrawCall dc = { };
 	dc.mesh = mesh;
-	dc.pipeline = pipeline;
+	dc.pipeline = checked_cast< u32 >( pipelines.add( pipeline ) );
 	dc.num_instances = num_particles;
 	dc.instance_data = vb_in;
 	dc.update_data = vb_out;
@@ -1810,17 +3035,17 @@ void UpdateParticlesFeedback( const Mesh & mesh, VertexBuffer vb_in, VertexBuffe
 	pipeline.pass = frame_static.particle_update_pass;
 	pipeline.shader = &shaders.particle_update_feedback;
 	u32 collision = cl.map == NULL ? 0 : 1;
-	pipeline.set_uniform( "u_ParticleUpdate", UploadUniformBlock( collision, radius, dt ) );
+	pipeline.set_uniform( UniformSlot_ParticleUpdate, UploadUniformBlock( collision, radius, dt ) );
 	if( collision ) {
-		pipeline.set_texture_buffer( "u_NodeBuffer", cl.map->nodeBuffer );
-		pipeline.set_texture_buffer( "u_LeafBuffer", cl.map->leafBuffer );
-		pipeline.set_texture_buffer( "u_BrushBuffer", cl.map->brushBuffer );
-		pipeline.set_texture_buffer( "u_PlaneBuffer", cl.map->planeBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_NodeBuffer, cl.map->nodeBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_LeafBuffer, cl.map->leafBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_BrushBuffer, cl.map->brushBuffer );
+		pipeline.set_texture_buffer( TextureBufferSlot_PlaneBuffer, cl.map->planeBuffer );
 	}
 
 	DrawCall dc = { };
 	dc.mesh = mesh;
-	dc.pipeline = pipeline;
+	dc.pipeline = checked_cast< u32 >( pipelines.add( pipeline ) );
 	dc.num_instances = num_particles;
 	dc.instance_data = vb_in;
 	dc.update_data = vb_out;
@@ -1837,13 +3062,13 @@ void DrawInstancedParticles( const Mesh & mesh, VertexBuffer vb, BlendFunc blend
 	pipeline.shader = &shaders.particle;
 	pipeline.blend_func = blend_func;
 	pipeline.write_depth = false;
-	pipeline.set_uniform( "u_View", frame_static.view_uniforms );
-	pipeline.set_uniform( "u_Fog", frame_static.fog_uniforms );
-	pipeline.set_texture_array( "u_DecalAtlases", DecalAtlasTextureArray() );
+	pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
+	pipeline.set_uniform( UniformSlot_Fog, frame_static.fog_uniforms );
+	pipeline.set_texture_array( TextureArraySlot_DecalAtlases, DecalAtlasTextureArray() );
 
 	DrawCall dc = { };
 	dc.mesh = mesh;
-	dc.pipeline = pipeline;
+	dc.pipeline = checked_cast< u32 >( pipelines.add( pipeline ) );
 	dc.num_vertices = mesh.num_vertices;
 	dc.instance_data = vb;
 	dc.num_instances = num_particles;
@@ -1859,6 +3084,65 @@ void DownloadFramebuffer( void * buf ) {
 	prev_fbo = 0;
 }
 
+void StartFramebufferReadback( FramebufferReadback * readback ) {
+	assert( readback->fence == NULL );
+
+	u32 width = frame_static.viewport_width;
+	u32 height = frame_static.viewport_height;
+
+	if( readback->pbo == 0 ) {
+		glGenBuffers( 1, &readback->pbo );
+	}
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, readback->pbo );
+	if( readback->width != width || readback->height != height ) {
+		glBufferData( GL_PIXEL_PACK_BUFFER, width * height * sizeof( RGB8 ), NULL, GL_STREAM_READ );
+		readback->width = width;
+		readback->height = height;
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	glReadPixels( 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, NULL );
+	prev_fbo = 0;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	readback->fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+bool FinishFramebufferReadback( FramebufferReadback * readback, void * buf, bool wait ) {
+	GLsync fence = GLsync( readback->fence );
+	if( fence == NULL )
+		return false;
+
+	if( wait ) {
+		ZoneScopedN( "Wait for framebuffer readback" );
+		while( glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000 ) == GL_TIMEOUT_EXPIRED );
+	}
+	else {
+		GLenum status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+		if( status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED )
+			return false;
+	}
+
+	glDeleteSync( fence );
+	readback->fence = NULL;
+
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, readback->pbo );
+	glGetBufferSubData( GL_PIXEL_PACK_BUFFER, 0, readback->width * readback->height * sizeof( RGB8 ), buf );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	return true;
+}
+
+void DeleteFramebufferReadback( FramebufferReadback * readback ) {
+	if( readback->fence != NULL ) {
+		glDeleteSync( GLsync( readback->fence ) );
+	}
+	glDeleteBuffers( 1, &readback->pbo );
+	*readback = { };
+}
+
 void DrawInstancedParticles( VertexBuffer vb, const Model * model, u32 num_particles ) {
 	assert( in_frame );
 
@@ -1869,13 +3153,13 @@ void DrawInstancedParticles( VertexBuffer vb, const Model * model, u32 num_parti
 		pipeline.pass = frame_static.nonworld_opaque_pass;
 		pipeline.shader = &shaders.particle_model;
 		pipeline.write_depth = true;
-		pipeline.set_uniform( "u_View", frame_static.view_uniforms );
-		pipeline.set_uniform( "u_Fog", frame_static.fog_uniforms );
-		pipeline.set_uniform( "u_Model", model_uniforms );
+		pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
+		pipeline.set_uniform( UniformSlot_Fog, frame_static.fog_uniforms );
+		pipeline.set_uniform( UniformSlot_Model, model_uniforms );
 
 		const Model::Primitive primitive = model->primitives[ i ];
 		DrawCall dc = { };
-		dc.pipeline = pipeline;
+		dc.pipeline = checked_cast< u32 >( pipelines.add( pipeline ) );
 		dc.instance_data = vb;
 
 		if( primitive.num_vertices != 0 ) {
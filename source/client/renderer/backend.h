@@ -4,6 +4,7 @@
 
 #include "qcommon/types.h"
 #include "qcommon/hash.h"
+#include "qcommon/threadpool.h"
 #include "client/renderer/types.h"
 
 enum CullFace : u8 {
@@ -66,6 +67,13 @@ enum VertexFormat : u8 {
 	VertexFormat_U8x4,
 	VertexFormat_U8x4_Norm,
 
+	VertexFormat_S8x2,
+	VertexFormat_S8x2_Norm,
+	VertexFormat_S8x3,
+	VertexFormat_S8x3_Norm,
+	VertexFormat_S8x4,
+	VertexFormat_S8x4_Norm,
+
 	VertexFormat_U16x2,
 	VertexFormat_U16x2_Norm,
 	VertexFormat_U16x3,
@@ -73,6 +81,13 @@ enum VertexFormat : u8 {
 	VertexFormat_U16x4,
 	VertexFormat_U16x4_Norm,
 
+	VertexFormat_S16x2,
+	VertexFormat_S16x2_Norm,
+	VertexFormat_S16x3,
+	VertexFormat_S16x3_Norm,
+	VertexFormat_S16x4,
+	VertexFormat_S16x4_Norm,
+
 	VertexFormat_U32x1,
 
 	VertexFormat_Floatx2,
@@ -114,38 +129,14 @@ struct Framebuffer {
 };
 
 struct PipelineState {
-	struct UniformBinding {
-		u64 name_hash;
-		UniformBlock block;
-	};
-
-	struct TextureBinding {
-		u64 name_hash;
-		const Texture * texture;
-	};
-
-	struct TextureArrayBinding {
-		u64 name_hash;
-		TextureArray ta;
-	};
-
-	struct TextureBufferBinding {
-		u64 name_hash;
-		TextureBuffer tb;
-	};
-
 	struct Scissor {
 		u32 x, y, w, h;
 	};
 
-	UniformBinding uniforms[ ARRAY_COUNT( &Shader::uniforms ) ];
-	TextureBinding textures[ ARRAY_COUNT( &Shader::textures ) ];
-	TextureBufferBinding texture_buffers[ ARRAY_COUNT( &Shader::texture_buffers ) ];
-	TextureArrayBinding texture_arrays[ ARRAY_COUNT( &Shader::texture_arrays ) ];
-	size_t num_uniforms = 0;
-	size_t num_textures = 0;
-	size_t num_texture_buffers = 0;
-	size_t num_texture_arrays = 0;
+	UniformBlock uniforms[ UniformSlot_Count ] = { };
+	const Texture * textures[ TextureSlot_Count ] = { };
+	u32 texture_buffers[ TextureBufferSlot_Count ] = { };
+	u32 texture_arrays[ TextureArraySlot_Count ] = { };
 
 	u8 pass = U8_MAX;
 	const Shader * shader = NULL;
@@ -158,56 +149,20 @@ struct PipelineState {
 	bool view_weapon_depth_hack = false;
 	bool wireframe = false;
 
-	void set_uniform( StringHash name, UniformBlock block ) {
-		for( size_t i = 0; i < num_uniforms; i++ ) {
-			if( uniforms[ i ].name_hash == name.hash ) {
-				uniforms[ i ].block = block;
-				return;
-			}
-		}
-
-		uniforms[ num_uniforms ].name_hash = name.hash;
-		uniforms[ num_uniforms ].block = block;
-		num_uniforms++;
+	void set_uniform( UniformSlot slot, UniformBlock block ) {
+		uniforms[ slot ] = block;
 	}
 
-	void set_texture( StringHash name, const Texture * texture ) {
-		for( size_t i = 0; i < num_textures; i++ ) {
-			if( textures[ i ].name_hash == name.hash ) {
-				textures[ i ].texture = texture;
-				return;
-			}
-		}
-
-		textures[ num_textures ].name_hash = name.hash;
-		textures[ num_textures ].texture = texture;
-		num_textures++;
+	void set_texture( TextureSlot slot, const Texture * texture ) {
+		textures[ slot ] = texture;
 	}
 
-	void set_texture_buffer( StringHash name, TextureBuffer tb ) {
-		for( size_t i = 0; i < num_texture_buffers; i++ ) {
-			if( texture_buffers[ i ].name_hash == name.hash ) {
-				texture_buffers[ i ].tb = tb;
-				return;
-			}
-		}
-
-		texture_buffers[ num_texture_buffers ].name_hash = name.hash;
-		texture_buffers[ num_texture_buffers ].tb = tb;
-		num_texture_buffers++;
+	void set_texture_buffer( TextureBufferSlot slot, TextureBuffer tb ) {
+		texture_buffers[ slot ] = tb.texture;
 	}
 
-	void set_texture_array( StringHash name, TextureArray ta ) {
-		for( size_t i = 0; i < num_texture_arrays; i++ ) {
-			if( texture_arrays[ i ].name_hash == name.hash ) {
-				texture_arrays[ i ].ta = ta;
-				return;
-			}
-		}
-
-		texture_arrays[ num_texture_arrays ].name_hash = name.hash;
-		texture_arrays[ num_texture_arrays ].ta = ta;
-		num_texture_arrays++;
+	void set_texture_array( TextureArraySlot slot, TextureArray ta ) {
+		texture_arrays[ slot ] = ta.texture;
 	}
 };
 
@@ -306,6 +261,14 @@ struct RenderPass {
 
 	bool sorted = true;
 
+	// draw to the bottom left corner of the target instead of the whole
+	// thing. zero means use the target's size
+	u32 viewport_width = 0;
+	u32 viewport_height = 0;
+
+	// don't clear/blit or submit anything
+	bool skip = false;
+
 	Framebuffer blit_source = { };
 
 	const tracy::SourceLocationData * tracy;
@@ -327,10 +290,43 @@ void RenderBackendShutdown();
 void RenderBackendBeginFrame();
 void RenderBackendSubmitFrame();
 
+// RenderBackendBeginFrame waits on the GPU until the buffers from
+// FRAMES_IN_FLIGHT frames ago are free to overwrite
+constexpr u32 FRAMES_IN_FLIGHT = 3;
+u32 FrameInFlight();
+
+// FrameNumber is the frame being recorded, FrameFinished polls its fence
+// without blocking
+u64 FrameNumber();
+bool FrameFinished( u64 frame );
+
+// milliseconds the GPU spent on the last frame whose fence we waited on, or
+// zero if we don't have one yet
+float GPUFrameTime();
+
+struct GPUPassTime {
+	const char * name;
+	float ms;
+	float average_ms;
+};
+
+// per render pass breakdown of GPUFrameTime, in submission order
+Span< const GPUPassTime > GPUPassTimes();
+
+// when the GPU finished the last frame whose timers we read, on the
+// Sys_Nanoseconds clock. finished_ns is 0 if we don't have one yet
+struct GPUFrameFinish {
+	u64 frame;
+	u64 finished_ns;
+};
+
+GPUFrameFinish LastGPUFrameFinish();
+
 u8 AddRenderPass( const RenderPass & config );
 u8 AddRenderPass( const char * name, const tracy::SourceLocationData * tracy, ClearColor clear_color = ClearColor_Dont, ClearDepth clear_depth = ClearDepth_Dont );
 u8 AddRenderPass( const char * name, const tracy::SourceLocationData * tracy, Framebuffer target, ClearColor clear_color = ClearColor_Dont, ClearDepth clear_depth = ClearDepth_Dont );
 u8 AddUnsortedRenderPass( const char * name, const tracy::SourceLocationData * tracy, Framebuffer target = { } );
+void SkipRenderPass( u8 pass );
 void AddBlitPass( const char * name, const tracy::SourceLocationData * tracy, Framebuffer src, Framebuffer dst, ClearColor clear_color = ClearColor_Dont, ClearDepth clear_depth = ClearDepth_Dont );
 void AddResolveMSAAPass( const char * name, const tracy::SourceLocationData * tracy, Framebuffer src, Framebuffer dst, ClearColor clear_color = ClearColor_Dont, ClearDepth clear_depth = ClearDepth_Dont );
 
@@ -375,6 +371,23 @@ Framebuffer NewFramebuffer( Texture * albedo_texture, Texture * normal_texture,
 Framebuffer NewShadowFramebuffer( TextureArray texture_array, u32 layer );
 void DeleteFramebuffer( Framebuffer fb );
 
+/*
+ * StartShader kicks off compilation, or loads the program from the shader
+ * cache, and FinishShader blocks until it's done. ShaderReady says whether
+ * FinishShader would block, and is always true without parallel compile
+ */
+struct PendingShader {
+	u32 program;
+	u32 vs, fs;
+	u64 cache_key;
+	bool feedback;
+	bool cached;
+};
+
+bool StartShader( PendingShader * pending, Span< const char * > srcs, Span< int > lengths, Span< const char * > feedback_varyings = Span< const char * >() );
+bool ShaderReady( const PendingShader & pending );
+bool FinishShader( Shader * shader, PendingShader pending );
+
 bool NewShader( Shader * shader, Span< const char * > srcs, Span< int > lengths, Span< const char * > feedback_varyings = Span< const char * >() );
 void DeleteShader( Shader shader );
 
@@ -382,7 +395,28 @@ Mesh NewMesh( MeshConfig config );
 void DeleteMesh( const Mesh & mesh );
 void DeferDeleteMesh( const Mesh & mesh );
 
-void DrawMesh( const Mesh & mesh, const PipelineState & pipeline, u32 num_vertices_override = 0, u32 first_index = 0 );
+// base_vertex gets added to every index, so meshes packed into one buffer can keep their own indices
+void DrawMesh( const Mesh & mesh, const PipelineState & pipeline, u32 num_vertices_override = 0, u32 first_index = 0, u32 base_vertex = 0 );
+
+/*
+ * same as DrawMesh, but lets the backend merge the draw with others that only
+ * differ by u_Model into one instanced draw. transform has to match u_Model
+ */
+constexpr u32 MAX_MODEL_INSTANCES = 256; // 16KB of mat4s, the smallest max UBO size GL allows
+void DrawInstanceableMesh( const Mesh & mesh, const PipelineState & pipeline, const Mat4 & transform, u32 num_vertices_override = 0, u32 first_index = 0 );
+
+/*
+ * runs callback over datum on the thread pool like ParallelFor, and each job
+ * can record DrawMesh/DrawInstanceableMesh calls. jobs can't upload uniforms,
+ * so do that beforehand
+ */
+void ParallelDrawCalls( void * datum, size_t n, size_t stride, JobCallback callback );
+
+template< typename T >
+void ParallelDrawCalls( Span< T > datum, JobCallback callback ) {
+	ParallelDrawCalls( datum.ptr, datum.n, sizeof( T ), callback );
+}
+
 void UpdateParticles( const Mesh & mesh, VertexBuffer vb_in, VertexBuffer vb_out, float radius, u32 num_particles, float dt );
 void UpdateParticlesFeedback( const Mesh & mesh, VertexBuffer vb_in, VertexBuffer vb_out, VertexBuffer vb_feedback, float radius, u32 num_particles, float dt );
 void DrawInstancedParticles( const Mesh & mesh, VertexBuffer vb, BlendFunc blend_func, u32 num_particles );
@@ -390,6 +424,21 @@ void DrawInstancedParticles( VertexBuffer vb, const Model * model, u32 num_parti
 
 void DownloadFramebuffer( void * buf );
 
+/*
+ * same as DownloadFramebuffer but it doesn't wait for the GPU. start it once
+ * the frame is drawn, then finish it on a later frame. the buffer needs
+ * room for width * height RGB8s
+ */
+struct FramebufferReadback {
+	u32 pbo;
+	void * fence;
+	u32 width, height;
+};
+
+void StartFramebufferReadback( FramebufferReadback * readback );
+bool FinishFramebufferReadback( FramebufferReadback * readback, void * buf, bool wait );
+void DeleteFramebufferReadback( FramebufferReadback * readback );
+
 template< typename T > constexpr size_t Std140Alignment();
 template<> constexpr size_t Std140Alignment< s32 >() { return sizeof( s32 ); }
 template<> constexpr size_t Std140Alignment< u32 >() { return sizeof( u32 ); }
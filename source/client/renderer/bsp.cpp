@@ -17,7 +17,7 @@ enum BSPLump {
 	BSPLump_Planes,
 	BSPLump_Nodes,
 	BSPLump_Leaves,
-	BSPLump_LeafFaces_Unused,
+	BSPLump_LeafFaces,
 	BSPLump_LeafBrushes,
 	BSPLump_Models,
 	BSPLump_Brushes,
@@ -180,6 +180,7 @@ struct BSPSpans {
 	Span< const BSPPlane > planes;
 	Span< const BSPNode > nodes;
 	Span< const BSPLeaf > leaves;
+	Span< const s32 > leaffaces;
 	Span< const BSPLeafBrush > leafbrushes;
 	Span< const BSPModel > models;
 	Span< const BSPBrush > brushes;
@@ -224,6 +225,7 @@ static bool ParseBSP( BSPSpans * bsp, Span< const u8 > data ) {
 	ok = ok && ParseLump( &bsp->planes, data, BSPLump_Planes );
 	ok = ok && ParseLump( &bsp->nodes, data, BSPLump_Nodes );
 	ok = ok && ParseLump( &bsp->leaves, data, BSPLump_Leaves );
+	ok = ok && ParseLump( &bsp->leaffaces, data, BSPLump_LeafFaces );
 	ok = ok && ParseLump( &bsp->leafbrushes, data, BSPLump_LeafBrushes );
 	ok = ok && ParseLump( &bsp->indices, data, BSPLump_Indices );
 
@@ -265,6 +267,9 @@ struct BSPDrawCall {
 	u32 num_vertices;
 	const Material * material;
 
+	u32 face;
+	s32 cluster; // lowest cluster the face is in, or -1
+
 	bool patch;
 	u32 patch_width;
 	u32 patch_height;
@@ -276,6 +281,12 @@ struct BSPModelVertex {
 	Vec2 uv;
 };
 
+struct GPUBSPModelVertex {
+	Vec3 position;
+	s8 normal[ 4 ];
+	Vec2 uv;
+};
+
 struct GPUBSPPlane {
 	Vec3 normal;
 	float dist;
@@ -340,6 +351,53 @@ static int Order2BezierSubdivisions( Vec3 control0, Vec3 control1, Vec3 control2
 	return Order2BezierSubdivisions( control0, control1, control2, max_error, control0, control2, 0.0f, 1.0f );
 }
 
+struct BSPFaceCluster {
+	u32 face;
+	s32 cluster;
+};
+
+static bool operator<( const BSPFaceCluster & a, const BSPFaceCluster & b ) {
+	return a.face != b.face ? a.face < b.face : a.cluster < b.cluster;
+}
+
+static bool operator==( const BSPFaceCluster & a, const BSPFaceCluster & b ) {
+	return a.face == b.face && a.cluster == b.cluster;
+}
+
+/*
+ * every cluster each world face is in, sorted by face. only the world has
+ * leaves so it's empty for everything else
+ */
+static void FindFaceClusters( DynamicArray< BSPFaceCluster > * face_clusters, const BSPSpans & bsp, const BSPModel & bsp_model ) {
+	for( const BSPLeaf & leaf : bsp.leaves ) {
+		if( leaf.cluster < 0 || leaf.firstLeafFace < 0 || leaf.numLeafFaces < 0 )
+			continue;
+		if( size_t( leaf.firstLeafFace ) + size_t( leaf.numLeafFaces ) > bsp.leaffaces.n )
+			continue;
+
+		for( s32 i = 0; i < leaf.numLeafFaces; i++ ) {
+			u32 face = bsp.leaffaces[ leaf.firstLeafFace + i ];
+			if( face >= bsp_model.first_face && face - bsp_model.first_face < bsp_model.num_faces ) {
+				face_clusters->add( { face, leaf.cluster } );
+			}
+		}
+	}
+
+	std::sort( face_clusters->begin(), face_clusters->end() );
+	BSPFaceCluster * end = std::unique( face_clusters->begin(), face_clusters->end() );
+	face_clusters->resize( end - face_clusters->begin() );
+}
+
+static Span< const BSPFaceCluster > ClustersOfFace( const DynamicArray< BSPFaceCluster > & face_clusters, u32 face ) {
+	BSPFaceCluster key = { face, S32_MIN };
+	const BSPFaceCluster * first = std::lower_bound( face_clusters.begin(), face_clusters.end(), key );
+	const BSPFaceCluster * last = first;
+	while( last < face_clusters.end() && last->face == face ) {
+		last++;
+	}
+	return Span< const BSPFaceCluster >( first, last - first );
+}
+
 static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex > & vertices, const BSPSpans & bsp, size_t model_idx ) {
 	ZoneScoped;
 
@@ -347,11 +405,17 @@ static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex >
 	if( bsp_model.num_faces == 0 )
 		return { };
 
+	DynamicArray< BSPFaceCluster > face_clusters( sys_allocator );
+	if( model_idx == 0 ) {
+		FindFaceClusters( &face_clusters, bsp, bsp_model );
+	}
+
 	DynamicArray< BSPDrawCall > draw_calls( sys_allocator );
 	if( bsp.idbsp ) {
 		for( u32 i = 0; i < bsp_model.num_faces; i++ ) {
 			const BSPFace * face = &bsp.faces[ i + bsp_model.first_face ];
 			BSPDrawCall dc;
+			dc.face = i + bsp_model.first_face;
 
 			dc.base_vertex = face->first_vertex;
 			dc.index_offset = face->first_index;
@@ -374,6 +438,7 @@ static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex >
 		for( u32 i = 0; i < bsp_model.num_faces; i++ ) {
 			const RavenBSPFace * face = &bsp.raven_faces[ i + bsp_model.first_face ];
 			BSPDrawCall dc;
+			dc.face = i + bsp_model.first_face;
 
 			dc.base_vertex = face->first_vertex;
 			dc.index_offset = face->first_index;
@@ -393,8 +458,21 @@ static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex >
 		}
 	}
 
+	for( BSPDrawCall & dc : draw_calls ) {
+		Span< const BSPFaceCluster > clusters = ClustersOfFace( face_clusters, dc.face );
+		dc.cluster = clusters.n > 0 ? clusters[ 0 ].cluster : -1;
+	}
+
+	// opaque materials go first so the depth only passes can draw all of them
+	// as one contiguous range. each material's faces are grouped by cluster
 	std::sort( draw_calls.begin(), draw_calls.end(), []( const BSPDrawCall & a, const BSPDrawCall & b ) {
-		return a.material < b.material;
+		bool a_opaque = a.material->blend_func == BlendFunc_Disabled;
+		bool b_opaque = b.material->blend_func == BlendFunc_Disabled;
+		if( a_opaque != b_opaque )
+			return a_opaque;
+		if( a.material != b.material )
+			return a.material < b.material;
+		return a.cluster < b.cluster;
 	} );
 
 	// generate patch geometry and merge draw calls
@@ -405,18 +483,59 @@ static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex >
 	Model::Primitive first;
 	first.first_index = 0;
 	first.num_vertices = 0;
+	first.num_lods = 0;
 	first.material = draw_calls[ 0 ].material;
 	primitives.add( first );
 
+	// the world gets split into chunks of one material and one lowest
+	// cluster, each with every cluster any of its faces are in
+	bool chunked = face_clusters.size() > 0;
+	DynamicArray< Model::BSPChunk > chunks( sys_allocator );
+	DynamicArray< u32 > primitive_chunks( sys_allocator );
+	DynamicArray< s32 > chunk_clusters( sys_allocator );
+	s32 chunk_cluster = 0;
+
+	auto FinishChunk = [&]() {
+		if( chunks.size() == 0 )
+			return;
+		Model::BSPChunk & chunk = chunks.top();
+		chunk.num_indices = indices.size() - chunk.first_index;
+		s32 * first_cluster = chunk_clusters.ptr() + chunk.first_cluster;
+		std::sort( first_cluster, chunk_clusters.end() );
+		chunk.num_clusters = std::unique( first_cluster, chunk_clusters.end() ) - first_cluster;
+		chunk_clusters.resize( chunk.first_cluster + chunk.num_clusters );
+	};
+
 	for( const BSPDrawCall & dc : draw_calls ) {
-		if( dc.material != primitives.top().material ) {
+		bool new_primitive = dc.material != primitives.top().material;
+		if( new_primitive ) {
 			Model::Primitive prim;
 			prim.first_index = primitives.top().first_index + primitives.top().num_vertices;
 			prim.num_vertices = 0;
+			prim.num_lods = 0;
 			prim.material = dc.material;
 			primitives.add( prim );
 		}
 
+		if( chunked ) {
+			if( chunks.size() == 0 || new_primitive || dc.cluster != chunk_cluster ) {
+				FinishChunk();
+				if( chunks.size() == 0 || new_primitive ) {
+					primitive_chunks.add( chunks.size() );
+				}
+
+				Model::BSPChunk chunk = { };
+				chunk.first_index = indices.size();
+				chunk.first_cluster = chunk_clusters.size();
+				chunks.add( chunk );
+				chunk_cluster = dc.cluster;
+			}
+
+			for( const BSPFaceCluster & fc : ClustersOfFace( face_clusters, dc.face ) ) {
+				chunk_clusters.add( fc.cluster );
+			}
+		}
+
 		if( dc.patch ) {
 			ZoneScopedN( "Generate patch" );
 
@@ -486,44 +605,158 @@ static Model LoadBSPModel( const char * filename, DynamicArray< BSPModelVertex >
 		}
 	}
 
+	if( chunked ) {
+		FinishChunk();
+		primitive_chunks.add( chunks.size() );
+	}
+
 	for( BSPModelVertex & v : vertices ) {
 		if( v.position.z <= -1024.0f ) {
 			v.position.z = -999999.0f;
 		}
 	}
 
-	// TODO: meshopt
+	// every model gets handed the whole map's vertices, so keep only the ones
+	// it uses and merge the duplicates
+	DynamicArray< u32 > remap( sys_allocator );
+	remap.resize( vertices.size() );
+	size_t num_vertices = meshopt_generateVertexRemap( remap.ptr(), indices.ptr(), indices.size(), vertices.ptr(), vertices.size(), sizeof( BSPModelVertex ) );
+
+	DynamicArray< BSPModelVertex > model_vertices( sys_allocator );
+	model_vertices.resize( num_vertices );
+	meshopt_remapVertexBuffer( model_vertices.ptr(), vertices.ptr(), vertices.size(), sizeof( BSPModelVertex ), remap.ptr() );
+	meshopt_remapIndexBuffer( indices.ptr(), indices.ptr(), indices.size(), remap.ptr() );
+
+	{
+		ZoneScopedN( "meshopt" );
+
+		// chunks get optimised on their own so their faces stay together
+		for( const Model::Primitive & primitive : primitives ) {
+			if( primitive.num_vertices == 0 || chunked )
+				continue;
+			u32 * primitive_indices = indices.ptr() + primitive.first_index;
+			meshopt_optimizeVertexCache( primitive_indices, primitive_indices, primitive.num_vertices, num_vertices );
+			meshopt_optimizeOverdraw( primitive_indices, primitive_indices, primitive.num_vertices, &model_vertices[ 0 ].position.x, num_vertices, sizeof( BSPModelVertex ), 1.05f );
+		}
+
+		for( const Model::BSPChunk & chunk : chunks ) {
+			if( chunk.num_indices == 0 )
+				continue;
+			u32 * chunk_indices = indices.ptr() + chunk.first_index;
+			meshopt_optimizeVertexCache( chunk_indices, chunk_indices, chunk.num_indices, num_vertices );
+			meshopt_optimizeOverdraw( chunk_indices, chunk_indices, chunk.num_indices, &model_vertices[ 0 ].position.x, num_vertices, sizeof( BSPModelVertex ), 1.05f );
+		}
+
+		num_vertices = meshopt_optimizeVertexFetch( model_vertices.ptr(), indices.ptr(), indices.size(), model_vertices.ptr(), num_vertices, sizeof( BSPModelVertex ) );
+		model_vertices.resize( num_vertices );
+	}
+
+	// opaque materials are sorted first, so they're the first N indices
+	u32 num_opaque_indices = 0;
+	for( const Model::Primitive & primitive : primitives ) {
+		if( primitive.material->blend_func != BlendFunc_Disabled )
+			break;
+		num_opaque_indices += primitive.num_vertices;
+	}
+
+	// shadow maps only need positions so weld across materials/UV seams and
+	// simplify. meshopt's error is relative to the mesh extents
+	DynamicArray< u32 > shadow_indices( sys_allocator );
+	if( num_opaque_indices > 0 ) {
+		ZoneScopedN( "Generate shadow LOD" );
+
+		DynamicArray< u32 > welded( sys_allocator );
+		welded.resize( num_opaque_indices );
+		meshopt_generateShadowIndexBuffer( welded.ptr(), indices.ptr(), num_opaque_indices, model_vertices.ptr(), num_vertices, sizeof( Vec3 ), sizeof( BSPModelVertex ) );
+
+		MinMax3 extents = MinMax3::Empty();
+		for( const BSPModelVertex & v : model_vertices ) {
+			extents = Extend( extents, v.position );
+		}
+		Vec3 size = extents.maxs - extents.mins;
+		float max_extent = Max2( size.x, Max2( size.y, size.z ) );
+		float max_shadow_error = 0.5f;
+
+		shadow_indices.resize( num_opaque_indices );
+		size_t num_shadow_indices = meshopt_simplify( shadow_indices.ptr(), welded.ptr(), num_opaque_indices,
+			&model_vertices[ 0 ].position.x, num_vertices, sizeof( BSPModelVertex ),
+			0, max_extent > 0.0f ? max_shadow_error / max_extent : 0.0f );
+		shadow_indices.resize( num_shadow_indices );
+
+		meshopt_optimizeVertexCache( shadow_indices.ptr(), shadow_indices.ptr(), shadow_indices.size(), num_vertices );
+	}
 
 	Model model = { };
 	model.transform = Mat4::Identity();
+	model.bounds = MinMax3::Empty();
+	for( u32 index : indices ) {
+		model.bounds = Extend( model.bounds, model_vertices[ index ].position );
+	}
 
 	model.primitives = ALLOC_MANY( sys_allocator, Model::Primitive, primitives.size() );
 	model.num_primitives = primitives.size();
 	memcpy( model.primitives, primitives.ptr(), primitives.num_bytes() );
 
+	if( chunked ) {
+		for( Model::BSPChunk & chunk : chunks ) {
+			chunk.bounds = MinMax3::Empty();
+			for( u32 i = 0; i < chunk.num_indices; i++ ) {
+				chunk.bounds = Extend( chunk.bounds, model_vertices[ indices[ chunk.first_index + i ] ].position );
+			}
+		}
+
+		model.bsp_chunks = ALLOC_MANY( sys_allocator, Model::BSPChunk, chunks.size() );
+		model.num_bsp_chunks = chunks.size();
+		memcpy( model.bsp_chunks, chunks.ptr(), chunks.num_bytes() );
+
+		model.bsp_primitive_chunks = ALLOC_MANY( sys_allocator, u32, primitive_chunks.size() );
+		memcpy( model.bsp_primitive_chunks, primitive_chunks.ptr(), primitive_chunks.num_bytes() );
+
+		model.bsp_chunk_clusters = ALLOC_MANY( sys_allocator, s32, Max2( chunk_clusters.size(), size_t( 1 ) ) );
+		memcpy( model.bsp_chunk_clusters, chunk_clusters.ptr(), chunk_clusters.num_bytes() );
+	}
+
+	model.shadow_first_index = indices.size();
+	model.num_shadow_indices = shadow_indices.size();
+
+	DynamicArray< GPUBSPModelVertex > gpu_vertices( sys_allocator, num_vertices );
+	for( const BSPModelVertex & v : model_vertices ) {
+		GPUBSPModelVertex gpu;
+		gpu.position = v.position;
+		gpu.normal[ 0 ] = meshopt_quantizeSnorm( v.normal.x, 8 );
+		gpu.normal[ 1 ] = meshopt_quantizeSnorm( v.normal.y, 8 );
+		gpu.normal[ 2 ] = meshopt_quantizeSnorm( v.normal.z, 8 );
+		gpu.normal[ 3 ] = 0;
+		gpu.uv = v.uv;
+		gpu_vertices.add( gpu );
+	}
+
+	indices.append( shadow_indices.span() );
+
 	TempAllocator temp = cls.frame_arena.temp();
 
 	MeshConfig mesh_config;
 	mesh_config.name = temp( "{} - {}", filename, model_idx );
 	mesh_config.ccw_winding = false;
-	mesh_config.unified_buffer = NewVertexBuffer( vertices.ptr(), vertices.num_bytes() );
-	mesh_config.stride = sizeof( vertices[ 0 ] );
-	mesh_config.positions_offset = offsetof( BSPModelVertex, position );
-	mesh_config.normals_offset = offsetof( BSPModelVertex, normal );
-	mesh_config.tex_coords_offset = offsetof( BSPModelVertex, uv );
-	mesh_config.num_vertices = indices.size();
-
-	// if( num_verts <= U16_MAX ) {
-	// 	DynamicArray< u16 > indices_u16( sys_allocator, indices.size() );
-	// 	for( u32 i = 0; i < indices.size(); i++ ) {
-	// 		indices_u16.add( indices[ i ] );
-	// 	}
-	// 	mesh_config.indices = NewIndexBuffer( indices.ptr(), indices.num_bytes() );
-	// }
-	// else {
+	mesh_config.unified_buffer = NewVertexBuffer( gpu_vertices.ptr(), gpu_vertices.num_bytes() );
+	mesh_config.stride = sizeof( gpu_vertices[ 0 ] );
+	mesh_config.positions_offset = offsetof( GPUBSPModelVertex, position );
+	mesh_config.normals_offset = offsetof( GPUBSPModelVertex, normal );
+	mesh_config.normals_format = VertexFormat_S8x4_Norm;
+	mesh_config.tex_coords_offset = offsetof( GPUBSPModelVertex, uv );
+	mesh_config.num_vertices = model.shadow_first_index;
+
+	if( num_vertices <= U16_MAX ) {
+		DynamicArray< u16 > indices_u16( sys_allocator, indices.size() );
+		for( u32 index : indices ) {
+			indices_u16.add( index );
+		}
+		mesh_config.indices = NewIndexBuffer( indices_u16.ptr(), indices_u16.num_bytes() );
+	}
+	else {
 		mesh_config.indices = NewIndexBuffer( indices.ptr(), indices.num_bytes() );
 		mesh_config.indices_format = IndexFormat_U32;
-	// }
+	}
 
 	model.mesh = NewMesh( mesh_config );
 
@@ -635,6 +868,110 @@ bool LoadBSPRenderData( const char * filename, Map * map, u64 base_hash, Span< c
 	return true;
 }
 
+void DrawBSPModelShadows( const Model * model, const PipelineState & pipeline ) {
+	if( model->num_shadow_indices == 0 )
+		return;
+
+	u32 index_size = model->mesh.indices_format == IndexFormat_U16 ? sizeof( u16 ) : sizeof( u32 );
+	DrawMesh( model->mesh, pipeline, model->num_shadow_indices, model->shadow_first_index * index_size );
+}
+
+static bool BSPChunkInPVS( const Model * model, const Model::BSPChunk & chunk, const u8 * pvs, size_t num_clusters ) {
+	if( chunk.num_clusters == 0 )
+		return true;
+
+	for( u32 i = 0; i < chunk.num_clusters; i++ ) {
+		s32 cluster = model->bsp_chunk_clusters[ chunk.first_cluster + i ];
+		if( size_t( cluster ) >= num_clusters )
+			return true;
+		if( pvs[ cluster >> 3 ] & ( 1 << ( cluster & 7 ) ) )
+			return true;
+	}
+
+	return false;
+}
+
+// true unless the box is entirely behind one of the planes
+static bool BoundsInFrustum( const Vec4 * planes, size_t num_planes, const MinMax3 & bounds ) {
+	for( size_t i = 0; i < num_planes; i++ ) {
+		const Vec4 & plane = planes[ i ];
+		Vec3 p(
+			plane.x >= 0.0f ? bounds.maxs.x : bounds.mins.x,
+			plane.y >= 0.0f ? bounds.maxs.y : bounds.mins.y,
+			plane.z >= 0.0f ? bounds.maxs.z : bounds.mins.z
+		);
+		if( Dot( plane.xyz(), p ) + plane.w < 0.0f )
+			return false;
+	}
+
+	return true;
+}
+
+Span< bool > CullBSPModel( Allocator * a, const Model * model, const u8 * pvs, size_t num_clusters ) {
+	ZoneScoped;
+
+	Span< bool > visible = ALLOC_SPAN( a, bool, model->num_bsp_chunks );
+
+	// side and near planes of the view frustum, there's no far plane
+	Mat4 M = frame_static.P * frame_static.V;
+	Vec4 planes[] = {
+		M.row3() + M.row0(),
+		M.row3() - M.row0(),
+		M.row3() + M.row1(),
+		M.row3() - M.row1(),
+		M.row3() + M.row2(),
+	};
+
+	for( u32 i = 0; i < model->num_bsp_chunks; i++ ) {
+		const Model::BSPChunk & chunk = model->bsp_chunks[ i ];
+		visible[ i ] = BSPChunkInPVS( model, chunk, pvs, num_clusters ) && BoundsInFrustum( planes, ARRAY_COUNT( planes ), chunk.bounds );
+	}
+
+	return visible;
+}
+
+static void DrawBSPModelChunks( const Model * model, u32 first_chunk, u32 end_chunk, Span< const bool > visible, const PipelineState & pipeline ) {
+	u32 index_size = model->mesh.indices_format == IndexFormat_U16 ? sizeof( u16 ) : sizeof( u32 );
+
+	u32 i = first_chunk;
+	while( i < end_chunk ) {
+		if( !visible[ i ] ) {
+			i++;
+			continue;
+		}
+
+		// chunks are in index order so a run of visible ones is one range
+		u32 first_index = model->bsp_chunks[ i ].first_index;
+		u32 num_indices = 0;
+		while( i < end_chunk && visible[ i ] ) {
+			num_indices += model->bsp_chunks[ i ].num_indices;
+			i++;
+		}
+
+		if( num_indices > 0 ) {
+			DrawMesh( model->mesh, pipeline, num_indices, first_index * index_size );
+		}
+	}
+}
+
+void DrawBSPModel( const Model * model, Span< const bool > visible, const PipelineState & pipeline ) {
+	if( model->num_bsp_chunks == 0 ) {
+		DrawMesh( model->mesh, pipeline );
+		return;
+	}
+
+	DrawBSPModelChunks( model, 0, model->num_bsp_chunks, visible, pipeline );
+}
+
+void DrawBSPModelPrimitive( const Model * model, u32 primitive, Span< const bool > visible, const PipelineState & pipeline ) {
+	if( model->num_bsp_chunks == 0 ) {
+		DrawModelPrimitive( model, &model->primitives[ primitive ], pipeline );
+		return;
+	}
+
+	DrawBSPModelChunks( model, model->bsp_primitive_chunks[ primitive ], model->bsp_primitive_chunks[ primitive + 1 ], visible, pipeline );
+}
+
 void DeleteBSPRenderData( Map * map ) {
 	for( u32 i = 0; i < map->num_models; i++ ) {
 		DeleteModel( &map->models[ i ] );
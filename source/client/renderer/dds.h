@@ -29,3 +29,9 @@ struct DDSHeader {
 struct BC4Block {
 	u8 data[ 8 ];
 };
+
+// BC3 is a BC4 alpha block followed by a BC1 colour block
+struct BC3Block {
+	BC4Block alpha;
+	u8 colour[ 8 ];
+};
@@ -1,5 +1,6 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
 #include "qcommon/hash.h"
 #include "client/client.h"
 #include "client/renderer/renderer.h"
@@ -7,6 +8,7 @@
 #include "cgame/ref.h"
 
 #include "cgltf/cgltf.h"
+#include "meshoptimizer/meshoptimizer.h"
 
 // like cgltf_load_buffers, but doesn't try to load URIs
 static bool LoadBinaryBuffers( cgltf_data * data ) {
@@ -16,14 +18,61 @@ static bool LoadBinaryBuffers( cgltf_data * data ) {
 		data->buffers[0].data = const_cast< void * >( data->bin );
 	}
 
-	for( cgltf_size i = 0; i < data->buffers_count; i++ ) {
-		if( data->buffers[i].data == NULL )
+	// EXT_meshopt_compression fallback buffers have no data, which is fine
+	// as long as only compressed views point at them
+	for( cgltf_size i = 0; i < data->buffer_views_count; i++ ) {
+		const cgltf_buffer_view * view = &data->buffer_views[ i ];
+		const cgltf_buffer * buffer = view->has_meshopt_compression ? view->meshopt_compression.buffer : view->buffer;
+		if( buffer->data == NULL )
 			return false;
 	}
 
 	return true;
 }
 
+/*
+ * decode EXT_meshopt_compression views into memory owned by cgltf. cgltf's
+ * accessor functions and AccessorToSpan prefer view->data over the buffer,
+ * so everything downstream reads the decoded data. our meshoptimizer
+ * predates the filters and index sequences, so only unfiltered attributes
+ * and triangles are supported, which is what gltfpack -c writes
+ */
+static bool DecodeMeshoptBuffers( cgltf_data * data, const char * path ) {
+	ZoneScoped;
+
+	for( cgltf_size i = 0; i < data->buffer_views_count; i++ ) {
+		cgltf_buffer_view * view = &data->buffer_views[ i ];
+		if( !view->has_meshopt_compression )
+			continue;
+
+		const cgltf_meshopt_compression * mc = &view->meshopt_compression;
+		if( mc->filter != cgltf_meshopt_compression_filter_none || mc->mode == cgltf_meshopt_compression_mode_indices ) {
+			Com_Printf( S_COLOR_YELLOW "%s uses meshopt filters or index sequences, which are unsupported\n", path );
+			return false;
+		}
+
+		view->data = data->memory.alloc( data->memory.user_data, mc->count * mc->stride );
+		if( view->data == NULL )
+			return false;
+
+		const u8 * compressed = ( const u8 * ) mc->buffer->data + mc->offset;
+		int err;
+		if( mc->mode == cgltf_meshopt_compression_mode_attributes ) {
+			err = meshopt_decodeVertexBuffer( view->data, mc->count, mc->stride, compressed, mc->size );
+		}
+		else {
+			err = meshopt_decodeIndexBuffer( view->data, mc->count, mc->stride, compressed, mc->size );
+		}
+
+		if( err != 0 ) {
+			Com_Printf( S_COLOR_YELLOW "Couldn't decode meshopt compressed data in %s\n", path );
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static u8 GetNodeIdx( const cgltf_node * node ) {
 	return u8( uintptr_t( node->camera ) - 1 );
 }
@@ -33,16 +82,35 @@ static void SetNodeIdx( cgltf_node * node, u8 idx ) {
 }
 
 static Span< const u8 > AccessorToSpan( const cgltf_accessor * accessor ) {
-	cgltf_size offset = accessor->offset + accessor->buffer_view->offset;
-	return Span< const u8 >( ( const u8 * ) accessor->buffer_view->buffer->data + offset, accessor->count * accessor->stride );
+	// decoded meshopt views have their own data
+	const cgltf_buffer_view * buffer_view = accessor->buffer_view;
+	const u8 * view = buffer_view->data != NULL ? ( const u8 * ) buffer_view->data : ( const u8 * ) buffer_view->buffer->data + buffer_view->offset;
+	return Span< const u8 >( view + accessor->offset, accessor->count * accessor->stride );
+}
+
+static size_t ComponentSize( cgltf_component_type component ) {
+	switch( component ) {
+		case cgltf_component_type_r_8:
+		case cgltf_component_type_r_8u:
+			return 1;
+		case cgltf_component_type_r_16:
+		case cgltf_component_type_r_16u:
+			return 2;
+		default:
+			return 4;
+	}
 }
 
 static VertexFormat VertexFormatFromGLTF( cgltf_type dim, cgltf_component_type component, bool normalized ) {
 	if( dim == cgltf_type_vec2 ) {
 		if( component == cgltf_component_type_r_8u )
 			return normalized ? VertexFormat_U8x2_Norm : VertexFormat_U8x2;
+		if( component == cgltf_component_type_r_8 )
+			return normalized ? VertexFormat_S8x2_Norm : VertexFormat_S8x2;
 		if( component == cgltf_component_type_r_16u )
 			return normalized ? VertexFormat_U16x2_Norm : VertexFormat_U16x2;
+		if( component == cgltf_component_type_r_16 )
+			return normalized ? VertexFormat_S16x2_Norm : VertexFormat_S16x2;
 		if( component == cgltf_component_type_r_32f )
 			return VertexFormat_Floatx2;
 	}
@@ -50,8 +118,12 @@ static VertexFormat VertexFormatFromGLTF( cgltf_type dim, cgltf_component_type c
 	if( dim == cgltf_type_vec3 ) {
 		if( component == cgltf_component_type_r_8u )
 			return normalized ? VertexFormat_U8x3_Norm : VertexFormat_U8x3;
+		if( component == cgltf_component_type_r_8 )
+			return normalized ? VertexFormat_S8x3_Norm : VertexFormat_S8x3;
 		if( component == cgltf_component_type_r_16u )
 			return normalized ? VertexFormat_U16x3_Norm : VertexFormat_U16x3;
+		if( component == cgltf_component_type_r_16 )
+			return normalized ? VertexFormat_S16x3_Norm : VertexFormat_S16x3;
 		if( component == cgltf_component_type_r_32f )
 			return VertexFormat_Floatx3;
 	}
@@ -59,8 +131,12 @@ static VertexFormat VertexFormatFromGLTF( cgltf_type dim, cgltf_component_type c
 	if( dim == cgltf_type_vec4 ) {
 		if( component == cgltf_component_type_r_8u )
 			return normalized ? VertexFormat_U8x4_Norm : VertexFormat_U8x4;
+		if( component == cgltf_component_type_r_8 )
+			return normalized ? VertexFormat_S8x4_Norm : VertexFormat_S8x4;
 		if( component == cgltf_component_type_r_16u )
 			return normalized ? VertexFormat_U16x4_Norm : VertexFormat_U16x4;
+		if( component == cgltf_component_type_r_16 )
+			return normalized ? VertexFormat_S16x4_Norm : VertexFormat_S16x4;
 		if( component == cgltf_component_type_r_32f )
 			return VertexFormat_Floatx4;
 	}
@@ -68,10 +144,169 @@ static VertexFormat VertexFormatFromGLTF( cgltf_type dim, cgltf_component_type c
 	return VertexFormat_Floatx4; // TODO: actual error handling
 }
 
-static void LoadGeometry( const char * filename, Model * model, const cgltf_node * node, const Mat4 & transform ) {
+template< typename T >
+static void FillW( u8 * vertices, size_t n, T one ) {
+	for( size_t i = 0; i < n; i++ ) {
+		memcpy( vertices + i * 4 * sizeof( T ) + 3 * sizeof( T ), &one, sizeof( T ) );
+	}
+}
+
+/*
+ * separate vertex buffers have no stride, so anything that isn't tightly
+ * packed gets repacked. KHR_mesh_quantization pads vec3s to 4 byte
+ * boundaries, so we keep the padding and upload those as vec4s with w = 1,
+ * which is what the shaders would fill in for a vec3
+ */
+static VertexBuffer NewAttributeBuffer( const cgltf_accessor * accessor, VertexFormat * format ) {
+	size_t component_size = ComponentSize( accessor->component_type );
+	size_t element_size = cgltf_num_components( accessor->type ) * component_size;
+	Span< const u8 > data = AccessorToSpan( accessor );
+
+	bool padded_vec3 = accessor->type == cgltf_type_vec3 && component_size < 4 && accessor->stride == 4 * component_size;
+	if( !padded_vec3 ) {
+		*format = VertexFormatFromGLTF( accessor->type, accessor->component_type, accessor->normalized );
+		if( accessor->stride == element_size )
+			return NewVertexBuffer( data );
+
+		u8 * packed = ALLOC_MANY( sys_allocator, u8, accessor->count * element_size );
+		defer { FREE( sys_allocator, packed ); };
+		for( size_t i = 0; i < accessor->count; i++ ) {
+			memcpy( packed + i * element_size, data.ptr + i * accessor->stride, element_size );
+		}
+
+		return NewVertexBuffer( packed, checked_cast< u32 >( accessor->count * element_size ) );
+	}
+
+	*format = VertexFormatFromGLTF( cgltf_type_vec4, accessor->component_type, accessor->normalized );
+
+	u8 * padded = ALLOC_MANY( sys_allocator, u8, data.n );
+	defer { FREE( sys_allocator, padded ); };
+	memcpy( padded, data.ptr, data.n );
+
+	bool norm = accessor->normalized;
+	switch( accessor->component_type ) {
+		case cgltf_component_type_r_8u: FillW( padded, accessor->count, u8( norm ? U8_MAX : 1 ) ); break;
+		case cgltf_component_type_r_8: FillW( padded, accessor->count, s8( norm ? S8_MAX : 1 ) ); break;
+		case cgltf_component_type_r_16u: FillW( padded, accessor->count, u16( norm ? U16_MAX : 1 ) ); break;
+		case cgltf_component_type_r_16: FillW( padded, accessor->count, s16( norm ? S16_MAX : 1 ) ); break;
+		default: break;
+	}
+
+	return NewVertexBuffer( padded, checked_cast< u32 >( data.n ) );
+}
+
+/*
+ * we don't support KHR_texture_transform in materials, so bake it into the
+ * tex coords. gltfpack only writes one when it quantizes them
+ */
+static VertexBuffer NewTexCoordBuffer( const cgltf_accessor * accessor, const cgltf_material * material, VertexFormat * format ) {
+	const cgltf_texture_view * view = material == NULL ? NULL : &material->pbr_metallic_roughness.base_color_texture;
+	if( view == NULL || !view->has_transform )
+		return NewAttributeBuffer( accessor, format );
+
+	const cgltf_texture_transform & transform = view->transform;
+	float c = cosf( transform.rotation );
+	float s = sinf( transform.rotation );
+
+	Vec2 * uvs = ALLOC_MANY( sys_allocator, Vec2, accessor->count );
+	defer { FREE( sys_allocator, uvs ); };
+
+	for( size_t i = 0; i < accessor->count; i++ ) {
+		Vec2 uv;
+		cgltf_accessor_read_float( accessor, i, uv.ptr(), 2 );
+		uv.x *= transform.scale[ 0 ];
+		uv.y *= transform.scale[ 1 ];
+		uvs[ i ] = Vec2( transform.offset[ 0 ] + c * uv.x + s * uv.y, transform.offset[ 1 ] - s * uv.x + c * uv.y );
+	}
+
+	*format = VertexFormat_Floatx2;
+	return NewVertexBuffer( uvs, checked_cast< u32 >( accessor->count * sizeof( Vec2 ) ) );
+}
+
+/*
+ * each LOD is simplified from the full mesh and has to at least be a
+ * meaningful reduction on the previous one. we don't get the real error back
+ * from meshopt so the target is what gets used for LOD selection
+ */
+static void GenerateLODs( GLTFImport::Mesh * mesh, const cgltf_accessor * positions ) {
+	ZoneScoped;
+
+	constexpr float lod_errors[] = { 0.01f, 0.03f, 0.1f };
+	STATIC_ASSERT( ARRAY_COUNT( lod_errors ) == MAX_MODEL_LODS - 1 );
+
+	NonRAIIDynamicArray< u32 > * indices = &mesh->indices;
+	u32 num_indices = indices->size();
+
+	mesh->lods[ 0 ] = { 0, num_indices, 0.0f };
+	mesh->num_lods = 1;
+
+	if( positions->type != cgltf_type_vec3 || num_indices < 3 * 64 )
+		return;
+
+	// simplify quantized positions in their quantized space, the errors are relative so it doesn't matter
+	Span< const u8 > position_data = AccessorToSpan( positions );
+	size_t position_stride = positions->stride;
+	DynamicArray< float > unpacked( sys_allocator );
+	if( positions->component_type != cgltf_component_type_r_32f ) {
+		unpacked.resize( positions->count * 3 );
+		cgltf_accessor_unpack_floats( positions, unpacked.ptr(), unpacked.size() );
+		position_data = unpacked.span().cast< const u8 >();
+		position_stride = 3 * sizeof( float );
+	}
+
+	DynamicArray< u32 > lod( sys_allocator );
+	lod.resize( num_indices );
+
+	for( float error : lod_errors ) {
+		const Model::LOD & prev = mesh->lods[ mesh->num_lods - 1 ];
+
+		size_t n = meshopt_simplify( lod.ptr(), indices->ptr(), num_indices,
+			( const float * ) position_data.ptr, positions->count, position_stride,
+			prev.num_indices / 2, error );
+		if( n == 0 || n > prev.num_indices * 3 / 4 )
+			break;
+
+		meshopt_optimizeVertexCache( lod.ptr(), lod.ptr(), n, positions->count );
+
+		u32 first_index = indices->size();
+		for( size_t i = 0; i < n; i++ ) {
+			indices->add( lod[ i ] );
+		}
+
+		mesh->lods[ mesh->num_lods ] = { first_index, u32( n ), error };
+		mesh->num_lods++;
+	}
+}
+
+static void ImportMesh( GLTFImport::Mesh * mesh, const cgltf_mesh * gltf_mesh ) {
+	const cgltf_primitive & prim = gltf_mesh->primitives[ 0 ];
+
+	const cgltf_accessor * positions = NULL;
+	for( size_t i = 0; i < prim.attributes_count; i++ ) {
+		if( prim.attributes[ i ].type == cgltf_attribute_type_position ) {
+			positions = prim.attributes[ i ].data;
+		}
+	}
+
+	mesh->indices.init( sys_allocator, prim.indices->count );
+	for( size_t i = 0; i < prim.indices->count; i++ ) {
+		mesh->indices.add( checked_cast< u32 >( cgltf_accessor_read_index( prim.indices, i ) ) );
+	}
+
+	if( positions != NULL ) {
+		GenerateLODs( mesh, positions );
+	}
+	else {
+		mesh->lods[ 0 ] = { 0, u32( mesh->indices.size() ), 0.0f };
+		mesh->num_lods = 1;
+	}
+}
+
+static void LoadGeometry( const char * filename, const GLTFImport * import, Model * model, const cgltf_node * node, const Mat4 & transform ) {
 	TempAllocator temp = cls.frame_arena.temp();
 
 	const cgltf_primitive & prim = node->mesh->primitives[ 0 ];
+	const GLTFImport::Mesh * mesh = &import->meshes[ node->mesh - import->gltf->meshes ];
 
 	MeshConfig mesh_config;
 	mesh_config.name = temp( "{} - {}", filename, node->name );
@@ -81,12 +316,24 @@ static void LoadGeometry( const char * filename, Model * model, const cgltf_node
 
 		if( attr.type == cgltf_attribute_type_position ) {
 			mesh_config.num_vertices = attr.data->count;
-			mesh_config.positions = NewVertexBuffer( AccessorToSpan( attr.data ) );
+			mesh_config.positions = NewAttributeBuffer( attr.data, &mesh_config.positions_format );
+
+			// min/max are in the accessor's units, so quantized positions need normalizing
+			float scale = 1.0f;
+			if( attr.data->normalized ) {
+				switch( attr.data->component_type ) {
+					case cgltf_component_type_r_8u: scale = 1.0f / U8_MAX; break;
+					case cgltf_component_type_r_8: scale = 1.0f / S8_MAX; break;
+					case cgltf_component_type_r_16u: scale = 1.0f / U16_MAX; break;
+					case cgltf_component_type_r_16: scale = 1.0f / S16_MAX; break;
+					default: break;
+				}
+			}
 
 			Vec3 min, max;
 			for( int j = 0; j < 3; j++ ) {
-				min[ j ] = attr.data->min[ j ];
-				max[ j ] = attr.data->max[ j ];
+				min[ j ] = Max2( attr.data->min[ j ] * scale, -1.0f );
+				max[ j ] = Max2( attr.data->max[ j ] * scale, -1.0f );
 			}
 
 			model->bounds = Extend( model->bounds, ( transform * Vec4( min, 1.0f ) ).xyz() );
@@ -94,38 +341,49 @@ static void LoadGeometry( const char * filename, Model * model, const cgltf_node
 		}
 
 		if( attr.type == cgltf_attribute_type_normal ) {
-			mesh_config.normals = NewVertexBuffer( AccessorToSpan( attr.data ) );
+			mesh_config.normals = NewAttributeBuffer( attr.data, &mesh_config.normals_format );
 		}
 
 		if( attr.type == cgltf_attribute_type_texcoord ) {
-			mesh_config.tex_coords = NewVertexBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.tex_coords_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+			mesh_config.tex_coords = NewTexCoordBuffer( attr.data, prim.material, &mesh_config.tex_coords_format );
 		}
 
 		if( attr.type == cgltf_attribute_type_color ) {
-			mesh_config.colors = NewVertexBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.colors_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+			mesh_config.colors = NewAttributeBuffer( attr.data, &mesh_config.colors_format );
 		}
 
 		if( attr.type == cgltf_attribute_type_joints ) {
-			mesh_config.joints = NewVertexBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.joints_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+			mesh_config.joints = NewAttributeBuffer( attr.data, &mesh_config.joints_format );
 		}
 
 		if( attr.type == cgltf_attribute_type_weights ) {
-			mesh_config.weights = NewVertexBuffer( AccessorToSpan( attr.data ) );
-			mesh_config.weights_format = VertexFormatFromGLTF( attr.data->type, attr.data->component_type, attr.data->normalized );
+			mesh_config.weights = NewAttributeBuffer( attr.data, &mesh_config.weights_format );
 		}
 	}
 
-	mesh_config.indices = NewIndexBuffer( AccessorToSpan( prim.indices ) );
-	mesh_config.indices_format = prim.indices->component_type == cgltf_component_type_r_16u ? IndexFormat_U16 : IndexFormat_U32;
-	mesh_config.num_vertices = prim.indices->count;
-	mesh_config.ccw_winding = true;
-
 	Model::Primitive * primitive = &model->primitives[ model->num_primitives ];
 	model->num_primitives++;
 
+	memcpy( primitive->lods, mesh->lods, sizeof( primitive->lods ) );
+	primitive->num_lods = mesh->num_lods;
+
+	bool u16_indices = prim.indices->component_type == cgltf_component_type_r_16u;
+	if( u16_indices ) {
+		DynamicArray< u16 > indices_u16( sys_allocator, mesh->indices.size() );
+		for( u32 index : mesh->indices ) {
+			indices_u16.add( index );
+		}
+		mesh_config.indices = NewIndexBuffer( indices_u16.ptr(), indices_u16.num_bytes() );
+		mesh_config.indices_format = IndexFormat_U16;
+	}
+	else {
+		mesh_config.indices = NewIndexBuffer( mesh->indices.ptr(), mesh->indices.num_bytes() );
+		mesh_config.indices_format = IndexFormat_U32;
+	}
+
+	mesh_config.num_vertices = prim.indices->count;
+	mesh_config.ccw_winding = true;
+
 	primitive->mesh = NewMesh( mesh_config );
 	primitive->first_index = 0;
 	primitive->num_vertices = 0;
@@ -134,7 +392,7 @@ static void LoadGeometry( const char * filename, Model * model, const cgltf_node
 	primitive->material = FindMaterial( material_name );
 }
 
-static void LoadNode( const char * filename, Model * model, cgltf_node * gltf_node, u8 * node_idx ) {
+static void LoadNode( const char * filename, const GLTFImport * import, Model * model, cgltf_node * gltf_node, u8 * node_idx ) {
 	u8 idx = *node_idx;
 	*node_idx += 1;
 	SetNodeIdx( gltf_node, idx );
@@ -179,11 +437,11 @@ static void LoadNode( const char * filename, Model * model, cgltf_node * gltf_no
 	// TODO: this will break if multiple nodes share a mesh
 	if( gltf_node->mesh != NULL ) {
 		node->primitive = model->num_primitives;
-		LoadGeometry( filename, model, gltf_node, node->global_transform );
+		LoadGeometry( filename, import, model, gltf_node, node->global_transform );
 	}
 
 	for( size_t i = 0; i < gltf_node->children_count; i++ ) {
-		LoadNode( filename, model, gltf_node->children[ i ], node_idx );
+		LoadNode( filename, import, model, gltf_node->children[ i ], node_idx );
 	}
 
 	if( gltf_node->children_count == 0 ) {
@@ -277,6 +535,106 @@ static void LoadAnimation( Model * model, const cgltf_animation * animation ) {
 	}
 }
 
+template< typename T >
+static bool ChannelMatchesTimeline( const Model::AnimationChannel< T > & channel, const float * times, u32 n ) {
+	if( channel.samples == NULL || channel.num_samples == 1 )
+		return true;
+	if( channel.num_samples != n || channel.interpolation != InterpolationMode_Linear )
+		return false;
+
+	for( u32 i = 0; i < n; i++ ) {
+		if( Abs( channel.times[ i ] - times[ i ] ) > 0.0001f )
+			return false;
+	}
+
+	return true;
+}
+
+template< typename T >
+static T ChannelKeyframe( const Model::AnimationChannel< T > & channel, u32 keyframe, T def ) {
+	if( channel.samples == NULL )
+		return def;
+	return channel.samples[ channel.num_samples == 1 ? 0 : keyframe ];
+}
+
+static void BuildKeyframes( Model * model ) {
+	const float * times = NULL;
+	u32 n = 0;
+
+	for( u8 i = 0; i < model->num_nodes && times == NULL; i++ ) {
+		const Model::Node * node = &model->nodes[ i ];
+		if( node->rotations.samples != NULL && node->rotations.num_samples > 1 ) {
+			times = node->rotations.times;
+			n = node->rotations.num_samples;
+		}
+		else if( node->translations.samples != NULL && node->translations.num_samples > 1 ) {
+			times = node->translations.times;
+			n = node->translations.num_samples;
+		}
+		else if( node->scales.samples != NULL && node->scales.num_samples > 1 ) {
+			times = node->scales.times;
+			n = node->scales.num_samples;
+		}
+	}
+
+	if( times == NULL )
+		return;
+
+	for( u8 i = 0; i < model->num_nodes; i++ ) {
+		const Model::Node * node = &model->nodes[ i ];
+		bool ok = ChannelMatchesTimeline( node->rotations, times, n );
+		ok = ok && ChannelMatchesTimeline( node->translations, times, n );
+		ok = ok && ChannelMatchesTimeline( node->scales, times, n );
+		if( !ok )
+			return;
+	}
+
+	Model::Keyframes * keyframes = &model->keyframes;
+	keyframes->num_keyframes = n;
+	keyframes->node_stride = AlignPow2( u32( model->num_nodes ), u32( 4 ) );
+
+	size_t floats_per_keyframe = 8 * keyframes->node_stride;
+	keyframes->times = ALLOC_MANY( sys_allocator, float, n + n * floats_per_keyframe );
+	keyframes->poses = keyframes->times + n;
+	memcpy( keyframes->times, times, n * sizeof( float ) );
+
+	float frame_time = ( times[ n - 1 ] - times[ 0 ] ) / ( n - 1 );
+	bool uniform = frame_time > 0.0f;
+	for( u32 i = 0; i < n && uniform; i++ ) {
+		uniform = Abs( times[ i ] - ( times[ 0 ] + i * frame_time ) ) < 0.0001f;
+	}
+	keyframes->inv_frame_time = uniform ? 1.0f / frame_time : 0.0f;
+
+	for( u32 k = 0; k < n; k++ ) {
+		float * pose = keyframes->poses + k * floats_per_keyframe;
+		u32 stride = keyframes->node_stride;
+
+		for( u32 i = 0; i < stride; i++ ) {
+			TRS trs;
+			if( i < model->num_nodes ) {
+				const Model::Node * node = &model->nodes[ i ];
+				trs.rotation = ChannelKeyframe( node->rotations, k, node->local_transform.rotation );
+				trs.translation = ChannelKeyframe( node->translations, k, node->local_transform.translation );
+				trs.scale = ChannelKeyframe( node->scales, k, node->local_transform.scale );
+			}
+			else {
+				trs.rotation = Quaternion::Identity();
+				trs.translation = Vec3( 0.0f );
+				trs.scale = 1.0f;
+			}
+
+			pose[ 0 * stride + i ] = trs.rotation.x;
+			pose[ 1 * stride + i ] = trs.rotation.y;
+			pose[ 2 * stride + i ] = trs.rotation.z;
+			pose[ 3 * stride + i ] = trs.rotation.w;
+			pose[ 4 * stride + i ] = trs.translation.x;
+			pose[ 5 * stride + i ] = trs.translation.y;
+			pose[ 6 * stride + i ] = trs.translation.z;
+			pose[ 7 * stride + i ] = trs.scale;
+		}
+	}
+}
+
 static void LoadSkin( Model * model, const cgltf_skin * skin ) {
 	model->skin = ALLOC_MANY( sys_allocator, Model::Joint, skin->joints_count );
 	model->num_joints = skin->joints_count;
@@ -290,10 +648,12 @@ static void LoadSkin( Model * model, const cgltf_skin * skin ) {
 	}
 }
 
-bool LoadGLTFModel( Model * model, const char * path ) {
+bool ImportGLTF( GLTFImport * import, const char * path ) {
 	ZoneScoped;
 	ZoneText( path, strlen( path ) );
 
+	*import = { };
+
 	Span< const u8 > data = AssetBinary( path );
 
 	cgltf_options options = { };
@@ -305,30 +665,67 @@ bool LoadGLTFModel( Model * model, const char * path ) {
 		return false;
 	}
 
-	defer { cgltf_free( gltf ); };
-
 	if( !LoadBinaryBuffers( gltf ) ) {
 		Com_Printf( S_COLOR_YELLOW "Couldn't load buffers in %s\n", path );
+		cgltf_free( gltf );
 		return false;
 	}
 
 	if( cgltf_validate( gltf ) != cgltf_result_success ) {
 		Com_Printf( S_COLOR_YELLOW "%s is invalid GLTF\n", path );
+		cgltf_free( gltf );
+		return false;
+	}
+
+	if( !DecodeMeshoptBuffers( gltf, path ) ) {
+		cgltf_free( gltf );
 		return false;
 	}
 
 	if( gltf->scenes_count != 1 || gltf->animations_count > 1 || gltf->skins_count > 1 ) {
 		Com_Printf( S_COLOR_YELLOW "Trivial models only please (%s)\n", path );
+		cgltf_free( gltf );
 		return false;
 	}
 
 	for( size_t i = 0; i < gltf->meshes_count; i++ ) {
 		if( gltf->meshes[ i ].primitives_count != 1 ) {
 			Com_Printf( S_COLOR_YELLOW "Meshes with multiple primitives are unsupported (%s)\n", path );
+			cgltf_free( gltf );
 			return false;
 		}
 	}
 
+	import->gltf = gltf;
+	import->meshes = ALLOC_MANY( sys_allocator, GLTFImport::Mesh, gltf->meshes_count );
+	for( size_t i = 0; i < gltf->meshes_count; i++ ) {
+		ImportMesh( &import->meshes[ i ], &gltf->meshes[ i ] );
+	}
+
+	return true;
+}
+
+void FreeGLTFImport( GLTFImport * import ) {
+	if( import->gltf == NULL )
+		return;
+
+	for( size_t i = 0; i < import->gltf->meshes_count; i++ ) {
+		import->meshes[ i ].indices.shutdown();
+	}
+	FREE( sys_allocator, import->meshes );
+	cgltf_free( import->gltf );
+
+	*import = { };
+}
+
+bool LoadGLTFModel( Model * model, const GLTFImport * import, const char * path ) {
+	ZoneScoped;
+	ZoneText( path, strlen( path ) );
+
+	cgltf_data * gltf = import->gltf;
+	if( gltf == NULL )
+		return false;
+
 	*model = { };
 	model->bounds = MinMax3::Empty();
 
@@ -348,7 +745,7 @@ bool LoadGLTFModel( Model * model, const char * path ) {
 
 	u8 node_idx = 0;
 	for( size_t i = 0; i < gltf->scene->nodes_count; i++ ) {
-		LoadNode( path, model, gltf->scene->nodes[ i ], &node_idx );
+		LoadNode( path, import, model, gltf->scene->nodes[ i ], &node_idx );
 		model->nodes[ GetNodeIdx( gltf->scene->nodes[ i ] ) ].sibling = U8_MAX;
 	}
 
@@ -358,7 +755,17 @@ bool LoadGLTFModel( Model * model, const char * path ) {
 		}
 
 		LoadAnimation( model, &gltf->animations[ 0 ] );
+		BuildKeyframes( model );
 	}
 
 	return true;
 }
+
+bool LoadGLTFModel( Model * model, const char * path ) {
+	GLTFImport import;
+	if( !ImportGLTF( &import, path ) )
+		return false;
+	defer { FreeGLTFImport( &import ); };
+
+	return LoadGLTFModel( model, &import, path );
+}
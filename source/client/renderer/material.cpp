@@ -1,14 +1,19 @@
 #include <algorithm> // std::sort
+#include <emmintrin.h>
 
 #include "qcommon/base.h"
+#include "qcommon/fs.h"
 #include "qcommon/hash.h"
 #include "qcommon/hashtable.h"
+#include "qcommon/load_profile.h"
+#include "qcommon/memory_budget.h"
+#include "qcommon/serialization.h"
 #include "qcommon/string.h"
 #include "qcommon/span2d.h"
 #include "gameshared/q_shared.h"
 #include "client/client.h"
 #include "client/assets.h"
-#include "client/threadpool.h"
+#include "qcommon/threadpool.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/dds.h"
 #include "cgame/cg_dynamics.h"
@@ -28,15 +33,46 @@ constexpr u32 MAX_DECALS = 4096;
 constexpr int DECAL_ATLAS_SIZE = 2048;
 constexpr int DECAL_ATLAS_BLOCK_SIZE = DECAL_ATLAS_SIZE / 4;
 
+constexpr u32 DECAL_CACHE_MAGIC = 0x43444347; // GCDC
+constexpr u32 DECAL_CACHE_VERSION = 1;
+
 static Texture textures[ MAX_TEXTURES ];
 static void * texture_stb_data[ MAX_TEXTURES ];
 static Span2D< const BC4Block > texture_bc4_data[ MAX_TEXTURES ];
+static Span2D< const BC3Block > texture_bc3_data[ MAX_TEXTURES ];
+static u64 texture_source_hashes[ MAX_TEXTURES ];
 static u32 num_textures;
 static Hashtable< MAX_TEXTURES * 2 > textures_hashtable;
 
 static Texture missing_texture;
 static Material missing_material;
 
+/*
+ * DDS textures with a mip chain only get their small mips uploaded at load
+ * time. each frame a texture has been drawn with recently we upload one more
+ * mip level, and when that would put us over r_texture_budget the least
+ * recently used textures get dropped back down to their small mips. the
+ * full chain stays in the mapped asset so this never touches the disk
+ *
+ * BC4 is left alone because decals read it back at full size
+ */
+constexpr u32 STREAMING_INITIAL_SIZE = 128;
+constexpr size_t STREAMING_BYTES_PER_FRAME = 8 * 1024 * 1024;
+constexpr s64 STREAMING_RECENTLY_USED_MS = 1000;
+
+struct StreamedTexture {
+	StringHash asset;
+	TextureConfig config; // data can be stale if the asset got evicted
+	u32 initial_mip;
+	u32 resident_mip;
+	s64 last_used;
+	bool streamable;
+};
+
+static StreamedTexture streamed_textures[ MAX_TEXTURES ];
+static size_t streamed_bytes; // on top of what the initial mips need
+static cvar_t * r_texture_budget;
+
 static Material materials[ MAX_MATERIALS ];
 static u32 num_materials;
 static Hashtable< MAX_MATERIALS * 2 > materials_hashtable;
@@ -48,6 +84,7 @@ static Vec4 decal_uvwhs[ MAX_DECALS ];
 static u32 num_decals;
 static Hashtable< MAX_DECALS * 2 > decals_hashtable;
 static TextureArray decals_atlases;
+static u32 num_decals_atlases;
 
 bool CompressedTextureFormat( TextureFormat format ) {
 	switch( format ) {
@@ -360,11 +397,33 @@ static bool ParseMaterial( Material * material, Span< const char > name, Span< c
 	return true;
 }
 
+static TextureConfig MipChainFrom( const TextureConfig & config, u32 mip ) {
+	TextureConfig chain = config;
+	chain.width = config.width >> mip;
+	chain.height = config.height >> mip;
+	chain.num_mipmaps = config.num_mipmaps - mip;
+	chain.data = ( const u8 * ) config.data + MipmappedByteSize( config.width, config.height, mip, config.format );
+	return chain;
+}
+
+static size_t StreamedBytes( const StreamedTexture * st, u32 mip ) {
+	const TextureConfig & config = st->config;
+	return MipmappedByteSize( config.width, config.height, st->initial_mip, config.format ) - MipmappedByteSize( config.width, config.height, mip, config.format );
+}
+
 static void UnloadTexture( u64 idx ) {
+	StreamedTexture * st = &streamed_textures[ idx ];
+	if( st->streamable ) {
+		streamed_bytes -= StreamedBytes( st, st->resident_mip );
+	}
+	*st = { };
+
 	stbi_image_free( texture_stb_data[ idx ] );
 
 	texture_stb_data[ idx ] = NULL;
 	texture_bc4_data[ idx ] = Span2D< const BC4Block >();
+	texture_bc3_data[ idx ] = Span2D< const BC3Block >();
+	texture_source_hashes[ idx ] = 0;
 
 	DeleteTexture( textures[ idx ] );
 }
@@ -443,7 +502,7 @@ static void LoadBuiltinTextures() {
 	}
 }
 
-static void LoadSTBTexture( const char * path, u8 * pixels, int w, int h, int channels, const char * failure_reason ) {
+static void LoadSTBTexture( const char * path, u8 * pixels, int w, int h, int channels, u64 source_hash, const char * failure_reason ) {
 	ZoneScoped;
 	ZoneText( path, strlen( path ) );
 
@@ -467,6 +526,7 @@ static void LoadSTBTexture( const char * path, u8 * pixels, int w, int h, int ch
 
 	size_t idx = AddTexture( Hash64( StripExtension( path ) ), config );
 	texture_stb_data[ idx ] = pixels;
+	texture_source_hashes[ idx ] = source_hash;
 }
 
 static void LoadDDSTexture( const char * path ) {
@@ -522,11 +582,53 @@ static void LoadDDSTexture( const char * path ) {
 		return;
 	}
 
-	size_t idx = AddTexture( Hash64( StripExtension( path ) ), config );
-	texture_bc4_data[ idx ] = Span2D< const BC4Block >( ( const BC4Block * ) config.data, config.width / 4, config.height / 4 );
+	u32 initial_mip = 0;
+	if( config.format != TextureFormat_BC4 ) {
+		while( initial_mip + 1 < config.num_mipmaps && Max2( config.width >> initial_mip, config.height >> initial_mip ) > STREAMING_INITIAL_SIZE ) {
+			initial_mip++;
+		}
+	}
+
+	size_t idx = AddTexture( Hash64( StripExtension( path ) ), MipChainFrom( config, initial_mip ) );
+	if( idx == U64_MAX )
+		return;
+
+	// decals read the top mip straight from the asset, so streaming doesn't
+	// affect them
+	if( config.format == TextureFormat_BC4 ) {
+		texture_bc4_data[ idx ] = Span2D< const BC4Block >( ( const BC4Block * ) config.data, config.width / 4, config.height / 4 );
+		texture_source_hashes[ idx ] = Hash64( config.data, texture_bc4_data[ idx ].num_bytes() );
+	}
+	if( config.format == TextureFormat_BC3_sRGB ) {
+		texture_bc3_data[ idx ] = Span2D< const BC3Block >( ( const BC3Block * ) config.data, config.width / 4, config.height / 4 );
+		texture_source_hashes[ idx ] = Hash64( config.data, texture_bc3_data[ idx ].num_bytes() );
+	}
+
+	StreamedTexture * st = &streamed_textures[ idx ];
+	st->asset = StringHash( path );
+	st->config = config;
+	st->initial_mip = initial_mip;
+	st->resident_mip = initial_mip;
+	st->last_used = 0;
+	st->streamable = initial_mip > 0;
+
+	// decals keep pointers into BC3/BC4 data, everything else is on the GPU
+	// now and streaming asks for the asset again when it needs more mips
+	if( config.format != TextureFormat_BC4 && config.format != TextureFormat_BC3_sRGB ) {
+		AssetConsumed( st->asset );
+	}
 }
 
-static void LoadMaterialFile( const char * path, Span< const char > * material_names ) {
+struct ParsedMaterial {
+	Span< const char > name;
+	Material material;
+};
+
+/*
+ * only reads the textures, so it's safe to run on the thread pool once
+ * they're all loaded
+ */
+static void ParseMaterialFile( const char * path, NonRAIIDynamicArray< ParsedMaterial > * parsed ) {
 	Span< const char > data = AssetString( path );
 
 	while( data != "" ) {
@@ -534,25 +636,42 @@ static void LoadMaterialFile( const char * path, Span< const char > * material_n
 		if( name == "" )
 			break;
 
-		u64 hash = HashMaterialName( name );
 		ParseToken( &data, Parse_DontStopOnNewLine );
 
-		Material material = Material();
-		if( !ParseMaterial( &material, name, &data ) )
+		ParsedMaterial material;
+		material.name = name;
+		material.material = Material();
+		if( !ParseMaterial( &material.material, name, &data ) )
 			break;
 
+		material.material.name = HashMaterialName( name );
+		parsed->add( material );
+	}
+}
+
+static void AddMaterials( Span< const ParsedMaterial > parsed, Span< const char > * material_names ) {
+	for( const ParsedMaterial & material : parsed ) {
+		u64 hash = material.material.name;
+
 		u64 idx = num_materials;
 		if( !materials_hashtable.get( hash, &idx ) ) {
 			materials_hashtable.add( hash, idx );
 			num_materials++;
 		}
 
-		material_names[ idx ] = name;
-		materials[ idx ] = material;
-		materials[ idx ].name = hash;
+		material_names[ idx ] = material.name;
+		materials[ idx ] = material.material;
 	}
 }
 
+static void LoadMaterialFile( const char * path, Span< const char > * material_names ) {
+	NonRAIIDynamicArray< ParsedMaterial > parsed;
+	parsed.init( sys_allocator );
+	ParseMaterialFile( path, &parsed );
+	AddMaterials( parsed.span(), material_names );
+	parsed.shutdown();
+}
+
 struct DecodeSTBTextureJob {
 	struct {
 		const char * path;
@@ -563,6 +682,7 @@ struct DecodeSTBTextureJob {
 		int width, height;
 		int channels;
 		u8 * pixels;
+		u64 source_hash;
 		const char * failure_reason;
 	} out;
 };
@@ -571,18 +691,38 @@ struct DecalAtlasLayer {
 	BC4Block blocks[ DECAL_ATLAS_BLOCK_SIZE * DECAL_ATLAS_BLOCK_SIZE ];
 };
 
+/*
+ * alpha only, and the endpoints are always 255 and 0 so each selector comes
+ * straight from the top 3 bits of alpha. the selector lut is
+ * { 1, 7, 6, 5, 4, 3, 2, 0 }, which is ( 8 - x ) & 7 with the ends swapped
+ */
 static BC4Block FastBC4( Span2D< const RGBA8 > rgba ) {
 	BC4Block result;
 
 	result.data[ 0 ] = 255;
 	result.data[ 1 ] = 0;
 
-	constexpr u8 selector_lut[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+	const __m128i one = _mm_set1_epi32( 1 );
+	const __m128i seven = _mm_set1_epi32( 7 );
+	const __m128i eight = _mm_set1_epi32( 8 );
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i rows[ 4 ];
+	for( u32 i = 0; i < 4; i++ ) {
+		__m128i pixels = _mm_loadu_si128( ( const __m128i * ) &rgba( 0, i ) );
+		__m128i x = _mm_srli_epi32( pixels, 29 );
+		__m128i selector = _mm_and_si128( _mm_sub_epi32( eight, x ), seven );
+		__m128i ends = _mm_or_si128( _mm_cmpeq_epi32( x, zero ), _mm_cmpeq_epi32( x, seven ) );
+		rows[ i ] = _mm_xor_si128( selector, _mm_and_si128( ends, one ) );
+	}
+
+	alignas( 16 ) u8 selectors8[ 16 ];
+	__m128i packed = _mm_packus_epi16( _mm_packs_epi32( rows[ 0 ], rows[ 1 ] ), _mm_packs_epi32( rows[ 2 ], rows[ 3 ] ) );
+	_mm_store_si128( ( __m128i * ) selectors8, packed );
 
 	u64 selectors = 0;
 	for( size_t i = 0; i < 16; i++ ) {
-		u64 selector = selector_lut[ rgba( i % 4, i / 4 ).a >> 5 ];
-		selectors |= selector << ( i * 3 );
+		selectors |= u64( selectors8[ i ] ) << ( i * 3 );
 	}
 
 	memcpy( &result.data[ 2 ], &selectors, 6 );
@@ -590,19 +730,43 @@ static BC4Block FastBC4( Span2D< const RGBA8 > rgba ) {
 	return result;
 }
 
-static Span2D< BC4Block > RGBAToBC4( Span2D< const RGBA8 > rgba ) {
-	ZoneScoped;
-
-	Span2D< BC4Block > bc4 = ALLOC_SPAN2D( sys_allocator, BC4Block, rgba.w / 4, rgba.h / 4 );
+struct BC4RowJob {
+	Span2D< const RGBA8 > rgba;
+	Span2D< BC4Block > bc4;
+};
 
-	for( u32 row = 0; row < bc4.h; row++ ) {
-		for( u32 col = 0; col < bc4.w; col++ ) {
-			Span2D< const RGBA8 > rgba_block = rgba.slice( col * 4, row * 4, 4, 4 );
-			bc4( col, row ) = FastBC4( rgba_block );
-		}
+static void CompressBC4Row( TempAllocator * temp, void * data ) {
+	const BC4RowJob * job = ( const BC4RowJob * ) data;
+	for( u32 col = 0; col < job->bc4.w; col++ ) {
+		job->bc4( col, 0 ) = FastBC4( job->rgba.slice( col * 4, 0, 4, 4 ) );
 	}
+}
 
-	return bc4;
+/*
+ * streamed textures can be smaller than the data we pack from, so compressed
+ * decals take their size from the top mip
+ */
+static bool DecalSize( const Texture * texture, int * w, int * h ) {
+	u64 idx = texture - textures;
+	switch( texture->format ) {
+		case TextureFormat_RGBA_U8_sRGB:
+			*w = texture->width;
+			*h = texture->height;
+			return true;
+
+		case TextureFormat_BC4:
+			*w = texture_bc4_data[ idx ].w * 4;
+			*h = texture_bc4_data[ idx ].h * 4;
+			return true;
+
+		case TextureFormat_BC3_sRGB:
+			*w = texture_bc3_data[ idx ].w * 4;
+			*h = texture_bc3_data[ idx ].h * 4;
+			return true;
+
+		default:
+			return false;
+	}
 }
 
 static void PackDecalAtlas( Span< const char > * material_names ) {
@@ -619,13 +783,14 @@ static void PackDecalAtlas( Span< const char > * material_names ) {
 		if( !materials[ i ].decal || texture == NULL )
 			continue;
 
-		if( texture->format != TextureFormat_RGBA_U8_sRGB && texture->format != TextureFormat_BC4 ) {
-			Com_GGPrint( S_COLOR_YELLOW "Decals must be RGBA or BC4 ({})", material_names[ i ] );
+		int w, h;
+		if( !DecalSize( texture, &w, &h ) ) {
+			Com_GGPrint( S_COLOR_YELLOW "Decals must be RGBA, BC3 or BC4 ({})", material_names[ i ] );
 			continue;
 		}
 
-		if( texture->width % 4 != 0 || texture->height % 4 != 0 ) {
-			Com_GGPrint( S_COLOR_YELLOW "Decal dimensions must be a multiple of 4 ({} is {}x{})", material_names[ i ], texture->width, texture->height );
+		if( w % 4 != 0 || h % 4 != 0 ) {
+			Com_GGPrint( S_COLOR_YELLOW "Decal dimensions must be a multiple of 4 ({} is {}x{})", material_names[ i ], w, h );
 			continue;
 		}
 
@@ -635,8 +800,8 @@ static void PackDecalAtlas( Span< const char > * material_names ) {
 		num_decals++;
 
 		rect->id = i;
-		rect->w = texture->width;
-		rect->h = texture->height;
+		rect->w = w;
+		rect->h = h;
 	}
 
 	// rect packing
@@ -666,8 +831,8 @@ static void PackDecalAtlas( Span< const char > * material_names ) {
 			decals_hashtable.add( material->name, decal_idx );
 			decal_uvwhs[ decal_idx ].x = rects[ i ].x / float( DECAL_ATLAS_SIZE ) + num_atlases;
 			decal_uvwhs[ decal_idx ].y = rects[ i ].y / float( DECAL_ATLAS_SIZE );
-			decal_uvwhs[ decal_idx ].z = material->texture->width / float( DECAL_ATLAS_SIZE );
-			decal_uvwhs[ decal_idx ].w = material->texture->height / float( DECAL_ATLAS_SIZE );
+			decal_uvwhs[ decal_idx ].z = rects[ i ].w / float( DECAL_ATLAS_SIZE );
+			decal_uvwhs[ decal_idx ].w = rects[ i ].h / float( DECAL_ATLAS_SIZE );
 		}
 
 		num_atlases++;
@@ -689,33 +854,100 @@ static void PackDecalAtlas( Span< const char > * material_names ) {
 		}
 	}
 
-	// copy texture data into atlases, convert RGBA to BC4 as needed
 	Span< DecalAtlasLayer > layers = ALLOC_SPAN( sys_allocator, DecalAtlasLayer, num_atlases );
-	memset( layers.ptr, 0, layers.num_bytes() );
 	defer { FREE( sys_allocator, layers.ptr ); };
 
+	// the packing is deterministic so identical inputs give an identical
+	// atlas, and we can skip compressing it again
+	u64 cache_key = Hash64( "decalatlas" );
+	cache_key = Hash64( &num_atlases, sizeof( num_atlases ), cache_key );
 	for( u32 i = 0; i < num_decals; i++ ) {
 		const Material * material = &materials[ rects[ i ].id ];
+		u64 texture_idx = material->texture - textures;
 		u64 decal_idx;
 		bool ok = decals_hashtable.get( material->name, &decal_idx );
 		assert( ok );
 
-		u32 layer = u32( decal_uvwhs[ decal_idx ].x );
-		Span2D< BC4Block > atlas( layers[ layer ].blocks, DECAL_ATLAS_BLOCK_SIZE, DECAL_ATLAS_BLOCK_SIZE );
+		struct {
+			u64 source;
+			u32 w, h;
+			Vec4 uvwh;
+		} input;
+		input.source = texture_source_hashes[ texture_idx ];
+		input.w = rects[ i ].w;
+		input.h = rects[ i ].h;
+		input.uvwh = decal_uvwhs[ decal_idx ];
+		cache_key = Hash64( &input, sizeof( input ), cache_key );
+	}
 
-		u64 texture_idx = material->texture - textures;
-		Span2D< const BC4Block > bc4 = texture_bc4_data[ texture_idx ];
-		Span2D< BC4Block > bc4_from_rgba;
-		defer { FREE( sys_allocator, bc4_from_rgba.ptr ); };
-
-		if( material->texture->format == TextureFormat_RGBA_U8_sRGB ) {
-			Span2D< const RGBA8 > rgba = Span2D< const RGBA8 >( ( const RGBA8 * ) texture_stb_data[ texture_idx ], material->texture->width, material->texture->height );
-			bc4_from_rgba = RGBAToBC4( rgba );
-			bc4 = bc4_from_rgba;
+	TempAllocator temp = cls.frame_arena.temp();
+	const char * cache_path = temp( "{}/decalcache/{016x}.bin", HomeDirPath(), cache_key );
+
+	bool cached = false;
+	{
+		ZoneScopedN( "Load cached atlas" );
+		Span< const u8 > cache = MapCacheFile( &temp, cache_path, DECAL_CACHE_MAGIC, DECAL_CACHE_VERSION, cache_key );
+		if( cache.n == CACHE_FILE_DATA_OFFSET + layers.num_bytes() ) {
+			memcpy( layers.ptr, cache.ptr + CACHE_FILE_DATA_OFFSET, layers.num_bytes() );
+			cached = true;
+		}
+		UnmapFile( cache );
+	}
+
+	// copy texture data into atlases, convert RGBA to BC4 as needed
+	if( !cached ) {
+		memset( layers.ptr, 0, layers.num_bytes() );
+
+		DynamicArray< BC4RowJob > jobs( sys_allocator );
+
+		for( u32 i = 0; i < num_decals; i++ ) {
+			const Material * material = &materials[ rects[ i ].id ];
+			u64 decal_idx;
+			bool ok = decals_hashtable.get( material->name, &decal_idx );
+			assert( ok );
+
+			u32 layer = u32( decal_uvwhs[ decal_idx ].x );
+			Span2D< BC4Block > atlas( layers[ layer ].blocks, DECAL_ATLAS_BLOCK_SIZE, DECAL_ATLAS_BLOCK_SIZE );
+
+			assert( rects[ i ].x % 4 == 0 && rects[ i ].y % 4 == 0 );
+			Span2D< BC4Block > dst = atlas.slice( rects[ i ].x / 4, rects[ i ].y / 4, rects[ i ].w / 4, rects[ i ].h / 4 );
+
+			u64 texture_idx = material->texture - textures;
+			if( material->texture->format == TextureFormat_BC4 ) {
+				CopySpan2D( dst, texture_bc4_data[ texture_idx ] );
+				continue;
+			}
+
+			if( material->texture->format == TextureFormat_BC3_sRGB ) {
+				Span2D< const BC3Block > bc3 = texture_bc3_data[ texture_idx ];
+				for( u32 row = 0; row < dst.h; row++ ) {
+					for( u32 col = 0; col < dst.w; col++ ) {
+						dst( col, row ) = bc3( col, row ).alpha;
+					}
+				}
+				continue;
+			}
+
+			Span2D< const RGBA8 > rgba = Span2D< const RGBA8 >( ( const RGBA8 * ) texture_stb_data[ texture_idx ], rects[ i ].w, rects[ i ].h );
+			for( u32 row = 0; row < dst.h; row++ ) {
+				BC4RowJob job;
+				job.rgba = rgba.slice( 0, row * 4, rgba.w, 4 );
+				job.bc4 = dst.slice( 0, row, dst.w, 1 );
+				jobs.add( job );
+			}
+		}
+
+		{
+			ZoneScopedN( "Compress BC4" );
+
+			// don't overflow the thread pool's job queue
+			constexpr size_t batch = 1024;
+			for( size_t i = 0; i < jobs.size(); i += batch ) {
+				ParallelFor( jobs.span().slice( i, Min2( i + batch, jobs.size() ) ), CompressBC4Row );
+			}
 		}
 
-		assert( rects[ i ].x % 4 == 0 && rects[ i ].y % 4 == 0 );
-		CopySpan2D( atlas.slice( rects[ i ].x / 4, rects[ i ].y / 4, bc4.w, bc4.h ), bc4 );
+		WriteCacheFile( cache_path, DECAL_CACHE_MAGIC, DECAL_CACHE_VERSION, cache_key, layers.cast< const u8 >() );
 	}
 
 	// upload atlases
@@ -732,14 +964,78 @@ static void PackDecalAtlas( Span< const char > * material_names ) {
 		config.format = TextureFormat_BC4;
 
 		decals_atlases = NewTextureArray( config );
+		num_decals_atlases = num_atlases;
 	}
 }
 
+// the texture cooker writes foo.dds.zst next to foo.png
+static bool HasCookedTexture( const char * path ) {
+	TempAllocator temp = cls.frame_arena.temp();
+	return AssetExists( StringHash( temp( "{}.dds", StripExtension( path ) ) ) );
+}
+
+static size_t UncompressedBytesPerPixel( TextureFormat format ) {
+	switch( format ) {
+		case TextureFormat_R_U8:
+			return 1;
+
+		case TextureFormat_RA_U8:
+			return 2;
+
+		// drivers store these as RGBA
+		default:
+			return 4;
+	}
+}
+
+static size_t TextureVRAMBytes( u32 idx ) {
+	const Texture & texture = textures[ idx ];
+	if( !CompressedTextureFormat( texture.format ) ) {
+		return size_t( texture.width ) * texture.height * UncompressedBytesPerPixel( texture.format );
+	}
+
+	const StreamedTexture * st = &streamed_textures[ idx ];
+	const TextureConfig & config = st->config;
+	return MipmappedByteSize( config.width, config.height, config.num_mipmaps, config.format ) - MipmappedByteSize( config.width, config.height, st->resident_mip, config.format );
+}
+
+static void MaterialsMemoryBudget( MemoryBudget * budget ) {
+	budget->add_array( "textures", textures, num_textures );
+	budget->add_array( "texture_stb_data", texture_stb_data, num_textures );
+	budget->add_array( "texture_bc4_data", texture_bc4_data, num_textures );
+	budget->add_array( "texture_bc3_data", texture_bc3_data, num_textures );
+	budget->add_array( "texture_source_hashes", texture_source_hashes, num_textures );
+	budget->add_array( "textures_hashtable", sizeof( textures_hashtable ), num_textures, MAX_TEXTURES * 2 );
+	budget->add_array( "streamed_textures", streamed_textures, num_textures );
+	budget->add_array( "materials", materials, num_materials );
+	budget->add_array( "materials_hashtable", sizeof( materials_hashtable ), num_materials, MAX_MATERIALS * 2 );
+	budget->add_array( "decal_uvwhs", decal_uvwhs, num_decals );
+	budget->add_array( "decals_hashtable", sizeof( decals_hashtable ), num_decals, MAX_DECALS * 2 );
+
+	for( u32 i = 0; i < num_textures; i++ ) {
+		// stb textures keep their pixels around for decals
+		if( texture_stb_data[ i ] != NULL ) {
+			budget->heap_bytes += size_t( textures[ i ].width ) * textures[ i ].height * UncompressedBytesPerPixel( textures[ i ].format );
+		}
+		budget->vram_bytes += TextureVRAMBytes( i );
+	}
+
+	budget->vram_bytes += size_t( num_decals_atlases ) * DECAL_ATLAS_SIZE * DECAL_ATLAS_SIZE * BitsPerPixel( TextureFormat_BC4 ) / 8;
+}
+
 void InitMaterials() {
 	ZoneScoped;
+	LoadProfileScoped( "InitMaterials" );
 
 	num_textures = 0;
 	num_materials = 0;
+	num_decals_atlases = 0;
+
+	r_texture_budget = Cvar_Get( "r_texture_budget", "1024", CVAR_ARCHIVE );
+	for( StreamedTexture & st : streamed_textures ) {
+		st = { };
+	}
+	streamed_bytes = 0;
 
 	world_material = Material();
 	world_material.rgbgen.args[ 0 ] = 0.17f;
@@ -762,6 +1058,18 @@ void InitMaterials() {
 	{
 		ZoneScopedN( "Load disk textures" );
 
+		// LoadDDSTexture runs on the main thread, so get everything
+		// decompressed on the thread pool first
+		{
+			DynamicArray< const char * > dds_paths( sys_allocator );
+			for( const char * path : AssetPaths() ) {
+				if( FileExtension( path ) == ".dds" ) {
+					dds_paths.add( path );
+				}
+			}
+			PrefetchAssets( dds_paths.span() );
+		}
+
 		DynamicArray< DecodeSTBTextureJob > jobs( sys_allocator );
 		{
 			ZoneScopedN( "Build job list" );
@@ -769,10 +1077,11 @@ void InitMaterials() {
 			for( const char * path : AssetPaths() ) {
 				Span< const char > ext = FileExtension( path );
 
-				if( ext == ".png" || ext == ".jpg" ) {
+				if( ( ext == ".png" || ext == ".jpg" ) && !HasCookedTexture( path ) ) {
 					DecodeSTBTextureJob job;
 					job.in.path = path;
 					job.in.data = AssetBinary( path );
+					LoadProfileAddBytes( job.in.data.n );
 
 					jobs.add( job );
 				}
@@ -794,10 +1103,12 @@ void InitMaterials() {
 			ZoneText( job->in.path, strlen( job->in.path ) );
 
 			job->out.pixels = stbi_load_from_memory( job->in.data.ptr, job->in.data.num_bytes(), &job->out.width, &job->out.height, &job->out.channels, 0 );
+			job->out.failure_reason = job->out.pixels == NULL ? stbi_failure_reason() : NULL;
+			job->out.source_hash = Hash64( job->in.data );
 		} );
 
 		for( DecodeSTBTextureJob job : jobs ) {
-			LoadSTBTexture( job.in.path, job.out.pixels, job.out.width, job.out.height, job.out.channels, stbi_failure_reason() );
+			LoadSTBTexture( job.in.path, job.out.pixels, job.out.width, job.out.height, job.out.channels, job.out.source_hash, job.out.failure_reason );
 		}
 	}
 
@@ -806,31 +1117,61 @@ void InitMaterials() {
 	{
 		ZoneScopedN( "Load materials" );
 
+		struct ParseMaterialsJob {
+			const char * path;
+			NonRAIIDynamicArray< ParsedMaterial > parsed;
+		};
+
+		DynamicArray< ParseMaterialsJob > jobs( sys_allocator );
 		for( const char * path : AssetPaths() ) {
 			// game crashes if we load materials with no texture,
 			// skip editor.shader until we convert asset pointers
 			// to asset hashes
 			if( FileExtension( path ) == ".shader" && FileName( path ) != "editor.shader" ) {
-				LoadMaterialFile( path, material_names );
+				ParseMaterialsJob job;
+				job.path = path;
+				job.parsed.init( sys_allocator );
+				jobs.add( job );
 			}
 		}
+
+		ParallelFor( jobs.span(), []( TempAllocator * temp, void * data ) {
+			ParseMaterialsJob * job = ( ParseMaterialsJob * ) data;
+
+			ZoneScopedN( "Parse materials" );
+			ZoneText( job->path, strlen( job->path ) );
+
+			ParseMaterialFile( job->path, &job->parsed );
+		} );
+
+		// add them in asset order so later files still override earlier ones
+		for( ParseMaterialsJob & job : jobs ) {
+			AddMaterials( job.parsed.span(), material_names );
+			job.parsed.shutdown();
+		}
 	}
 
 	missing_material = Material();
 	missing_material.texture = &missing_texture;
 
 	PackDecalAtlas( material_names );
+
+	AddMemoryBudget( "materials", MaterialsMemoryBudget );
 }
 
 void HotloadMaterials() {
 	ZoneScoped;
 
+	// material_names below is big enough that clearing it every frame shows up
+	if( ModifiedAssetPaths().n == 0 )
+		return;
+
 	bool changes = false;
 
 	for( const char * path : ModifiedAssetPaths() ) {
 		Span< const char > ext = FileExtension( path );
 
-		if( ext == ".png" || ext == ".jpg" ) {
+		if( ( ext == ".png" || ext == ".jpg" ) && !HasCookedTexture( path ) ) {
 			Span< const u8 > data = AssetBinary( path );
 
 			int w, h, channels;
@@ -841,7 +1182,7 @@ void HotloadMaterials() {
 				pixels = stbi_load_from_memory( data.ptr, data.num_bytes(), &w, &h, &channels, 0 );
 			}
 
-			LoadSTBTexture( path, pixels, w, h, channels, stbi_failure_reason() );
+			LoadSTBTexture( path, pixels, w, h, channels, Hash64( data ), stbi_failure_reason() );
 
 			changes = true;
 		}
@@ -866,6 +1207,86 @@ void HotloadMaterials() {
 	}
 }
 
+static void SetResidentMip( u64 idx, u32 mip ) {
+	StreamedTexture * st = &streamed_textures[ idx ];
+
+	// LoadDDSTexture already validated it and hotloading resets st, so this
+	// can only fail if the asset disappeared
+	Span< const u8 > dds = AssetBinary( st->asset );
+	if( dds.num_bytes() < sizeof( DDSHeader ) )
+		return;
+	st->config.data = dds.ptr + sizeof( DDSHeader );
+
+	DeleteTexture( textures[ idx ] );
+	textures[ idx ] = NewTexture( MipChainFrom( st->config, mip ) );
+	AssetConsumed( st->asset );
+
+	streamed_bytes -= StreamedBytes( st, st->resident_mip );
+	streamed_bytes += StreamedBytes( st, mip );
+	st->resident_mip = mip;
+}
+
+static bool EvictLeastRecentlyUsedTexture( s64 now, u64 keep ) {
+	u64 lru = U64_MAX;
+	for( u32 i = 0; i < num_textures; i++ ) {
+		const StreamedTexture * st = &streamed_textures[ i ];
+		if( !st->streamable || st->resident_mip == st->initial_mip || i == keep )
+			continue;
+		if( now - st->last_used < STREAMING_RECENTLY_USED_MS )
+			continue;
+		if( lru == U64_MAX || st->last_used < streamed_textures[ lru ].last_used ) {
+			lru = i;
+		}
+	}
+
+	if( lru == U64_MAX )
+		return false;
+
+	SetResidentMip( lru, streamed_textures[ lru ].initial_mip );
+	return true;
+}
+
+void StreamMaterialTextures() {
+	ZoneScoped;
+
+	s64 now = cls.monotonicTime;
+	size_t budget = size_t( Max2( r_texture_budget->integer, 0 ) ) * 1024 * 1024;
+	size_t uploaded = 0;
+
+	for( u32 i = 0; i < num_textures && uploaded < STREAMING_BYTES_PER_FRAME; i++ ) {
+		StreamedTexture * st = &streamed_textures[ i ];
+		if( !st->streamable || st->resident_mip == 0 )
+			continue;
+		if( now - st->last_used >= STREAMING_RECENTLY_USED_MS )
+			continue;
+
+		u32 mip = st->resident_mip - 1;
+		size_t growth = StreamedBytes( st, mip ) - StreamedBytes( st, st->resident_mip );
+
+		bool fits = true;
+		while( budget != 0 && streamed_bytes + growth > budget ) {
+			if( !EvictLeastRecentlyUsedTexture( now, i ) ) {
+				fits = false;
+				break;
+			}
+		}
+
+		if( !fits )
+			continue;
+
+		SetResidentMip( i, mip );
+		uploaded += MipmappedByteSize( textures[ i ].width, textures[ i ].height, st->config.num_mipmaps - mip, st->config.format );
+	}
+
+	TracyPlot( "Streamed texture bytes", s64( streamed_bytes ) );
+}
+
+void TouchTexture( const Texture * texture ) {
+	if( texture < textures || texture >= textures + num_textures )
+		return;
+	streamed_textures[ texture - textures ].last_used = cls.monotonicTime;
+}
+
 void ShutdownMaterials() {
 	for( u32 i = 0; i < num_textures; i++ ) {
 		UnloadTexture( i );
@@ -873,6 +1294,8 @@ void ShutdownMaterials() {
 
 	DeleteTexture( missing_texture );
 	DeleteTextureArray( decals_atlases );
+
+	RemoveMemoryBudget( "materials" );
 }
 
 bool TryFindMaterial( StringHash name, const Material ** material ) {
@@ -939,16 +1362,16 @@ PipelineState MaterialToPipelineState( const Material * material, Vec4 color, bo
 		PipelineState pipeline;
 		pipeline.shader = &shaders.world;
 		pipeline.pass = frame_static.world_opaque_pass;
-		pipeline.set_uniform( "u_Fog", frame_static.fog_uniforms );
-		pipeline.set_texture( "u_BlueNoiseTexture", BlueNoiseTexture() );
-		pipeline.set_uniform( "u_BlueNoiseTextureParams", frame_static.blue_noise_uniforms );
+		pipeline.set_uniform( UniformSlot_Fog, frame_static.fog_uniforms );
+		pipeline.set_texture( TextureSlot_BlueNoiseTexture, BlueNoiseTexture() );
+		pipeline.set_uniform( UniformSlot_BlueNoiseTextureParams, frame_static.blue_noise_uniforms );
 		color.x = material->rgbgen.args[ 0 ];
 		color.y = material->rgbgen.args[ 1 ];
 		color.z = material->rgbgen.args[ 2 ];
-		pipeline.set_uniform( "u_Material", UploadMaterialUniforms( color, Vec2( 0.0f ), material->specular, material->shininess, Vec3( 0.0f ), Vec3( 0.0f ) ) );
-		pipeline.set_texture_array( "u_ShadowmapTextureArray", frame_static.shadowmap_texture_array );
-		pipeline.set_uniform( "u_ShadowMaps", frame_static.shadow_uniforms );
-		pipeline.set_texture_array( "u_DecalAtlases", DecalAtlasTextureArray() );
+		pipeline.set_uniform( UniformSlot_Material, UploadMaterialUniforms( color, Vec2( 0.0f ), material->specular, material->shininess, Vec3( 0.0f ), Vec3( 0.0f ) ) );
+		pipeline.set_texture_array( TextureArraySlot_ShadowmapTextureArray, frame_static.shadowmap_texture_array );
+		pipeline.set_uniform( UniformSlot_ShadowMaps, frame_static.shadow_uniforms );
+		pipeline.set_texture_array( TextureArraySlot_DecalAtlases, DecalAtlasTextureArray() );
 		AddDynamicsToPipeline( &pipeline );
 		return pipeline;
 	}
@@ -1028,8 +1451,9 @@ PipelineState MaterialToPipelineState( const Material * material, Vec4 color, bo
 		pipeline.write_depth = false;
 	}
 
-	pipeline.set_texture( "u_BaseTexture", material->texture );
-	pipeline.set_uniform( "u_Material", UploadMaterialUniforms( color, Vec2( material->texture->width, material->texture->height ), material->specular, material->shininess, tcmod_row0, tcmod_row1 ) );
+	TouchTexture( material->texture );
+	pipeline.set_texture( TextureSlot_BaseTexture, material->texture );
+	pipeline.set_uniform( UniformSlot_Material, UploadMaterialUniforms( color, Vec2( material->texture->width, material->texture->height ), material->specular, material->shininess, tcmod_row0, tcmod_row1 ) );
 
 	if( skinned ) {
 		pipeline.shader = material->shaded ? &shaders.standard_skinned_shaded : &shaders.standard_skinned;
@@ -68,8 +68,12 @@ u32 BitsPerPixel( TextureFormat format );
 
 void InitMaterials();
 void HotloadMaterials();
+void StreamMaterialTextures();
 void ShutdownMaterials();
 
+// marks the texture as on screen so the streaming keeps its full mips around
+void TouchTexture( const Texture * texture );
+
 const Material * FindMaterial( StringHash name, const Material * def = NULL );
 const Material * FindMaterial( const char * name, const Material * def = NULL );
 bool TryFindMaterial( StringHash name, const Material ** material );
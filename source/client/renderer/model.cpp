@@ -1,25 +1,66 @@
+#include <algorithm> // std::sort
+
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
 #include "qcommon/hashtable.h"
+#include "qcommon/load_profile.h"
+#include "qcommon/threadpool.h"
 #include "client/assets.h"
 #include "client/renderer/renderer.h"
 #include "client/renderer/model.h"
 
+#include <xmmintrin.h>
+
 constexpr u32 MAX_MODELS = 1024;
 
 static Model gltf_models[ MAX_MODELS ];
 static u32 num_gltf_models;
 static Hashtable< MAX_MODELS * 2 > gltf_models_hashtable;
 
-static void LoadGLTF( const char * path ) {
-	Span< const char > ext = FileExtension( path );
-	if( ext != ".glb" )
-		return;
-
-	Model model;
-	if( !LoadGLTFModel( &model, path ) )
-		return;
-
+static cvar_t * r_model_lod_error;
+
+/*
+ * DrawModelShadow only does the uploads and queues the primitives up, then
+ * DrawModelShadows records each cascade on its own thread. the palettes are
+ * usually in a temp allocator that's gone by then, so transforms get resolved
+ * at queue time
+ */
+struct ShadowDraw {
+	const Model * model;
+	const Model::Primitive * primitive;
+	Mat4 transform;
+	UniformBlock model_uniforms;
+	UniformBlock pose_uniforms;
+	u32 lod;
+	bool skinned;
+	u8 cascades;
+};
+
+/*
+ * world space bounds of the queued shadow draws, four at a time so each
+ * cascade can test a whole block against its frustum at once
+ */
+struct ShadowBounds4 {
+	float center_x[ 4 ], center_y[ 4 ], center_z[ 4 ];
+	float extents_x[ 4 ], extents_y[ 4 ], extents_z[ 4 ];
+};
+
+static NonRAIIDynamicArray< ShadowDraw > shadow_draws;
+static NonRAIIDynamicArray< ShadowBounds4 > shadow_bounds;
+
+struct ImportModelJob {
+	const char * path;
+	u32 order;
+	GLTFImport import;
+	bool ok;
+};
+
+static NonRAIIDynamicArray< ImportModelJob > import_jobs;
+static bool importing_models;
+static JobGroup import_group;
+
+static void AddModel( const char * path, const Model & model ) {
 	u64 hash = Hash64( StripExtension( path ) );
 
 	u64 idx = num_gltf_models;
@@ -35,14 +76,90 @@ static void LoadGLTF( const char * path ) {
 	gltf_models[ idx ] = model;
 }
 
+static void LoadGLTF( const char * path ) {
+	Span< const char > ext = FileExtension( path );
+	if( ext != ".glb" )
+		return;
+
+	LoadProfileAddBytes( AssetBinary( path ).n );
+
+	Model model;
+	if( !LoadGLTFModel( &model, path ) )
+		return;
+
+	AddModel( path, model );
+}
+
+/*
+ * importing only needs the assets, so we start it as soon as they're
+ * decompressed and let it overlap with the rest of startup. InitModels waits
+ * for it and makes the GL objects
+ */
+void StartImportingModels() {
+	ZoneScoped;
+
+	import_jobs.init( sys_allocator );
+
+	for( const char * path : AssetPaths() ) {
+		if( FileExtension( path ) == ".glb" ) {
+			ImportModelJob job = { };
+			job.path = path;
+			job.order = import_jobs.size();
+			import_jobs.add( job );
+		}
+	}
+
+	std::sort( import_jobs.begin(), import_jobs.end(), []( const ImportModelJob & a, const ImportModelJob & b ) {
+		return AssetBinary( a.path ).n > AssetBinary( b.path ).n;
+	} );
+
+	for( ImportModelJob & job : import_jobs ) {
+		ThreadPoolDo( &import_group, []( TempAllocator * temp, void * data ) {
+			ImportModelJob * job = ( ImportModelJob * ) data;
+			job->ok = ImportGLTF( &job->import, job->path );
+		}, &job );
+	}
+
+	importing_models = true;
+}
+
 void InitModels() {
 	ZoneScoped;
+	LoadProfileScoped( "InitModels" );
 
 	num_gltf_models = 0;
+	shadow_draws.init( sys_allocator );
+	shadow_bounds.init( sys_allocator );
 
-	for( const char * path : AssetPaths() ) {
-		LoadGLTF( path );
+	r_model_lod_error = Cvar_Get( "r_model_lod_error", "1", CVAR_ARCHIVE );
+
+	if( !importing_models ) {
+		StartImportingModels();
+	}
+
+	{
+		ZoneScopedN( "Wait for model imports" );
+		ThreadPoolWait( &import_group );
+	}
+
+	// add them in asset order so duplicates resolve the same way as hotloading
+	std::sort( import_jobs.begin(), import_jobs.end(), []( const ImportModelJob & a, const ImportModelJob & b ) {
+		return a.order < b.order;
+	} );
+
+	for( ImportModelJob & job : import_jobs ) {
+		LoadProfileAddBytes( AssetBinary( job.path ).n );
+
+		Model model;
+		if( job.ok && LoadGLTFModel( &model, &job.import, job.path ) ) {
+			AddModel( job.path, model );
+		}
+
+		FreeGLTFImport( &job.import );
 	}
+
+	import_jobs.shutdown();
+	importing_models = false;
 }
 
 void DeleteModel( Model * model ) {
@@ -58,11 +175,17 @@ void DeleteModel( Model * model ) {
 		FREE( sys_allocator, model->nodes[ i ].scales.times );
 	}
 
+	FREE( sys_allocator, model->keyframes.times );
+
 	DeleteMesh( model->mesh );
 
 	FREE( sys_allocator, model->primitives );
 	FREE( sys_allocator, model->nodes );
 	FREE( sys_allocator, model->skin );
+
+	FREE( sys_allocator, model->bsp_chunks );
+	FREE( sys_allocator, model->bsp_primitive_chunks );
+	FREE( sys_allocator, model->bsp_chunk_clusters );
 }
 
 void HotloadModels() {
@@ -77,6 +200,9 @@ void ShutdownModels() {
 	for( u32 i = 0; i < num_gltf_models; i++ ) {
 		DeleteModel( &gltf_models[ i ] );
 	}
+
+	shadow_draws.shutdown();
+	shadow_bounds.shutdown();
 }
 
 const Model * FindModel( StringHash name ) {
@@ -91,64 +217,180 @@ const Model * FindModel( const char * name ) {
 	return FindModel( StringHash( name ) );
 }
 
-void DrawModelPrimitive( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline ) {
+void DrawModelPrimitive( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline, u32 lod ) {
 	if( primitive->num_vertices != 0 ) {
 		u32 index_size = model->mesh.indices_format == IndexFormat_U16 ? sizeof( u16 ) : sizeof( u32 );
 		DrawMesh( model->mesh, pipeline, primitive->num_vertices, primitive->first_index * index_size );
 	}
+	else if( lod != 0 ) {
+		u32 index_size = primitive->mesh.indices_format == IndexFormat_U16 ? sizeof( u16 ) : sizeof( u32 );
+		DrawMesh( primitive->mesh, pipeline, primitive->lods[ lod ].num_indices, primitive->lods[ lod ].first_index * index_size );
+	}
 	else {
 		DrawMesh( primitive->mesh, pipeline );
 	}
 }
 
+static void DrawInstanceableModelPrimitive( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline, const Mat4 & transform, u32 lod ) {
+	if( primitive->num_vertices != 0 ) {
+		u32 index_size = model->mesh.indices_format == IndexFormat_U16 ? sizeof( u16 ) : sizeof( u32 );
+		DrawInstanceableMesh( model->mesh, pipeline, transform, primitive->num_vertices, primitive->first_index * index_size );
+	}
+	else if( lod != 0 ) {
+		u32 index_size = primitive->mesh.indices_format == IndexFormat_U16 ? sizeof( u16 ) : sizeof( u32 );
+		DrawInstanceableMesh( primitive->mesh, pipeline, transform, primitive->lods[ lod ].num_indices, primitive->lods[ lod ].first_index * index_size );
+	}
+	else {
+		DrawInstanceableMesh( primitive->mesh, pipeline, transform );
+	}
+}
+
+/*
+ * approximate height in pixels of the model's bounding sphere. LOD errors
+ * are relative to the mesh extents, so multiplying them by this gives the
+ * error in pixels
+ */
+static float ScreenSize( const Model * model, const Mat4 & transform ) {
+	if( model->bounds.mins.x > model->bounds.maxs.x )
+		return FLT_MAX;
+
+	Mat4 world_from_model = transform * model->transform;
+	Vec3 model_center = ( model->bounds.mins + model->bounds.maxs ) * 0.5f;
+	Vec3 center = ( world_from_model * Vec4( model_center, 1.0f ) ).xyz();
+
+	float scale = Max2( Max2( Length( world_from_model.col0.xyz() ), Length( world_from_model.col1.xyz() ) ), Length( world_from_model.col2.xyz() ) );
+	float radius = Length( model->bounds.maxs - model->bounds.mins ) * 0.5f * scale;
+
+	float dist = Length( center - frame_static.position );
+	if( dist <= radius )
+		return FLT_MAX;
+
+	return ( 2.0f * radius / dist ) * frame_static.P.col1.y * frame_static.viewport_height * 0.5f;
+}
+
+static u32 PrimitiveLOD( const Model::Primitive * primitive, float screen_size ) {
+	u32 lod = 0;
+	for( u32 i = 1; i < primitive->num_lods; i++ ) {
+		if( primitive->lods[ i ].error * screen_size > r_model_lod_error->value )
+			break;
+		lod = i;
+	}
+	return lod;
+}
+
+static Mat4 NodePrimitiveTransform( const Model * model, u8 node_idx, MatrixPalettes palettes, bool * skinned ) {
+	const Model::Node * node = &model->nodes[ node_idx ];
+	bool animated = palettes.node_transforms.ptr != NULL;
+	*skinned = animated && node->skinned;
+
+	if( *skinned )
+		return Mat4::Identity();
+	if( animated )
+		return palettes.node_transforms[ node_idx ];
+	return node->global_transform;
+}
+
 template< typename F >
-static void DrawNode( const Model * model, u8 node_idx, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes, UniformBlock pose_uniforms, F transform_pipeline ) {
+static void DrawNode( const Model * model, u8 node_idx, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes, UniformBlock pose_uniforms, float screen_size, F transform_pipeline ) {
 	if( node_idx == U8_MAX )
 		return;
 
 	const Model::Node * node = &model->nodes[ node_idx ];
 
 	if( node->primitive != U8_MAX ) {
-		bool animated = palettes.node_transforms.ptr != NULL;
-		bool skinned = animated && node->skinned;
+		bool skinned;
+		Mat4 primitive_transform = NodePrimitiveTransform( model, node_idx, palettes, &skinned );
+		Mat4 model_transform = transform * model->transform * primitive_transform;
+		UniformBlock model_uniforms = UploadModelUniforms( model_transform );
 
-		Mat4 primitive_transform;
+		PipelineState pipeline = MaterialToPipelineState( model->primitives[ node->primitive ].material, color, skinned );
+		pipeline.set_uniform( UniformSlot_View, frame_static.view_uniforms );
+		pipeline.set_uniform( UniformSlot_Model, model_uniforms );
 		if( skinned ) {
-			primitive_transform = Mat4::Identity();
+			pipeline.set_uniform( UniformSlot_Pose, pose_uniforms );
 		}
-		else if( animated ) {
-			primitive_transform = palettes.node_transforms[ node_idx ];
+		transform_pipeline( &pipeline, skinned );
+
+		const Model::Primitive * primitive = &model->primitives[ node->primitive ];
+		u32 lod = PrimitiveLOD( primitive, screen_size );
+
+		// skinned draws have their own u_Pose so they can never be instanced
+		if( skinned ) {
+			DrawModelPrimitive( model, primitive, pipeline, lod );
 		}
 		else {
-			primitive_transform = node->global_transform;
+			DrawInstanceableModelPrimitive( model, primitive, pipeline, model_transform, lod );
 		}
+	}
 
-		UniformBlock model_uniforms = UploadModelUniforms( transform * model->transform * primitive_transform );
+	DrawNode( model, node->first_child, transform, color, palettes, pose_uniforms, screen_size, transform_pipeline );
+	DrawNode( model, node->sibling, transform, color, palettes, pose_uniforms, screen_size, transform_pipeline );
+}
 
-		PipelineState pipeline = MaterialToPipelineState( model->primitives[ node->primitive ].material, color, skinned );
-		pipeline.set_uniform( "u_View", frame_static.view_uniforms );
-		pipeline.set_uniform( "u_Model", model_uniforms );
-		if( skinned ) {
-			pipeline.set_uniform( "u_Pose", pose_uniforms );
-		}
-		transform_pipeline( &pipeline, skinned );
+/*
+ * conservative test of the model's bounds against the view frustum. the
+ * corners go through to clip space and we only cull when all eight are on
+ * the wrong side of the same plane. the projection has no far plane so
+ * there are only five to test. bounds come from the bind pose so animated
+ * models get some slack
+ */
+static MinMax3 CullingBounds( const Model * model, MatrixPalettes palettes ) {
+	MinMax3 bounds = model->bounds;
+	if( palettes.node_transforms.ptr != NULL ) {
+		Vec3 center = ( bounds.mins + bounds.maxs ) * 0.5f;
+		Vec3 half_extents = ( bounds.maxs - bounds.mins ) * 0.75f;
+		bounds = MinMax3( center - half_extents, center + half_extents );
+	}
+	return bounds;
+}
+
+static bool ModelInView( const Model * model, const Mat4 & transform, MatrixPalettes palettes ) {
+	if( model->bounds.mins.x > model->bounds.maxs.x )
+		return true;
 
-		DrawModelPrimitive( model, &model->primitives[ node->primitive ], pipeline );
+	MinMax3 bounds = CullingBounds( model, palettes );
+
+	Mat4 clip_from_model = frame_static.P * frame_static.V * transform * model->transform;
+
+	Vec3 corners[ 8 ];
+	for( int i = 0; i < 8; i++ ) {
+		corners[ i ] = Vec3(
+			i & 1 ? bounds.maxs.x : bounds.mins.x,
+			i & 2 ? bounds.maxs.y : bounds.mins.y,
+			i & 4 ? bounds.maxs.z : bounds.mins.z
+		);
+	}
+
+	Vec4 clips[ 8 ];
+	TransformPoints( StaticSpan( clips ), clip_from_model, StaticSpan( corners ) );
+
+	u32 outside[ 5 ] = { };
+	for( const Vec4 & clip : clips ) {
+
+		outside[ 0 ] += clip.x < -clip.w ? 1 : 0;
+		outside[ 1 ] += clip.x > clip.w ? 1 : 0;
+		outside[ 2 ] += clip.y < -clip.w ? 1 : 0;
+		outside[ 3 ] += clip.y > clip.w ? 1 : 0;
+		outside[ 4 ] += clip.z < -clip.w ? 1 : 0;
 	}
 
-	DrawNode( model, node->first_child, transform, color, palettes, pose_uniforms, transform_pipeline );
-	DrawNode( model, node->sibling, transform, color, palettes, pose_uniforms, transform_pipeline );
+	for( u32 n : outside ) {
+		if( n == 8 )
+			return false;
+	}
+
+	return true;
 }
 
 void DrawModel( const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes ) {
-	UniformBlock pose_uniforms = { };
-	if( palettes.skinning_matrices.ptr != NULL ) {
-		pose_uniforms = UploadUniforms( palettes.skinning_matrices.ptr, palettes.skinning_matrices.num_bytes() );
-	}
+	if( !ModelInView( model, transform, palettes ) )
+		return;
+
+	float screen_size = ScreenSize( model, transform );
 
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		if( model->nodes[ i ].parent == U8_MAX ) {
-			DrawNode( model, i, transform, color, palettes, pose_uniforms, []( PipelineState * pipeline, bool skinned ) { } );
+			DrawNode( model, i, transform, color, palettes, palettes.skinning_uniforms, screen_size, []( PipelineState * pipeline, bool skinned ) { } );
 		}
 	}
 }
@@ -160,77 +402,209 @@ static void AddViewWeaponDepthHack( PipelineState * pipeline, bool skinned ) {
 void DrawViewWeapon( const Model * model, const Mat4 & transform ) {
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		if( model->nodes[ i ].parent == U8_MAX ) {
-			DrawNode( model, i, transform, vec4_white, MatrixPalettes(), UniformBlock(), AddViewWeaponDepthHack );
+			DrawNode( model, i, transform, vec4_white, MatrixPalettes(), UniformBlock(), FLT_MAX, AddViewWeaponDepthHack );
 		}
 	}
 }
 
-void DrawOutlinedModel( const Model * model, const Mat4 & transform, const Vec4 & color, float outline_height, MatrixPalettes palettes ) {
-	UniformBlock outline_uniforms = UploadUniformBlock( color, outline_height );
+void DrawModelSilhouette( const Model * model, const Mat4 & transform, const Vec4 & color, const Vec4 & outline_color, MatrixPalettes palettes ) {
+	if( !ModelInView( model, transform, palettes ) )
+		return;
 
-	auto MakeOutlinePipeline = [ &outline_uniforms ]( PipelineState * pipeline, bool skinned ) {
-		pipeline->shader = skinned ? &shaders.outline_skinned : &shaders.outline;
-		pipeline->pass = frame_static.nonworld_opaque_pass;
-		pipeline->cull_face = CullFace_Front;
-		pipeline->set_uniform( "u_Outline", outline_uniforms );
-	};
+	UniformBlock material_uniforms = UploadMaterialUniforms( color, Vec2( 0 ), 0.0f, 64.0f );
+	UniformBlock outline_uniforms = UploadUniformBlock( outline_color );
+	frame_static.silhouettes_drawn = true;
+	float screen_size = ScreenSize( model, transform );
 
-	UniformBlock pose_uniforms = { };
-	if( palettes.skinning_matrices.ptr != NULL ) {
-		pose_uniforms = UploadUniforms( palettes.skinning_matrices.ptr, palettes.skinning_matrices.num_bytes() );
-	}
+	auto MakeSilhouettePipeline = [ &material_uniforms, &outline_uniforms ]( PipelineState * pipeline, bool skinned ) {
+		pipeline->shader = skinned ? &shaders.write_silhouette_gbuffer_skinned : &shaders.write_silhouette_gbuffer;
+		pipeline->pass = frame_static.write_silhouette_gbuffer_pass;
+		pipeline->set_uniform( UniformSlot_Material, material_uniforms );
+		pipeline->set_uniform( UniformSlot_Outline, outline_uniforms );
+	};
 
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		if( model->nodes[ i ].parent == U8_MAX ) {
-			DrawNode( model, i, transform, color, palettes, pose_uniforms, MakeOutlinePipeline );
+			DrawNode( model, i, transform, color, palettes, palettes.skinning_uniforms, screen_size, MakeSilhouettePipeline );
 		}
 	}
 }
 
 void DrawModelSilhouette( const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes ) {
-	UniformBlock material_uniforms = UploadMaterialUniforms( color, Vec2( 0 ), 0.0f, 64.0f );
-
-	auto MakeSilhouettePipeline = [ &material_uniforms ]( PipelineState * pipeline, bool skinned ) {
-		pipeline->shader = skinned ? &shaders.write_silhouette_gbuffer_skinned : &shaders.write_silhouette_gbuffer;
-		pipeline->pass = frame_static.write_silhouette_gbuffer_pass;
-		pipeline->write_depth = false;
-		pipeline->set_uniform( "u_Material", material_uniforms );
-	};
+	DrawModelSilhouette( model, transform, color, Vec4( 0 ), palettes );
+}
 
-	UniformBlock pose_uniforms = { };
-	if( palettes.skinning_matrices.ptr != NULL ) {
-		pose_uniforms = UploadUniforms( palettes.skinning_matrices.ptr, palettes.skinning_matrices.num_bytes() );
+static void AddShadowBounds( Vec3 center, Vec3 extents ) {
+	u32 lane = shadow_draws.size() % 4;
+	if( lane == 0 ) {
+		ShadowBounds4 block = { };
+		shadow_bounds.add( block );
 	}
 
-	for( u8 i = 0; i < model->num_nodes; i++ ) {
-		if( model->nodes[ i ].parent == U8_MAX ) {
-			DrawNode( model, i, transform, color, palettes, pose_uniforms, MakeSilhouettePipeline );
-		}
+	ShadowBounds4 * block = &shadow_bounds[ shadow_bounds.size() - 1 ];
+	block->center_x[ lane ] = center.x;
+	block->center_y[ lane ] = center.y;
+	block->center_z[ lane ] = center.z;
+	block->extents_x[ lane ] = extents.x;
+	block->extents_y[ lane ] = extents.y;
+	block->extents_z[ lane ] = extents.z;
+}
+
+static void QueueNodeShadows( const Model * model, u8 node_idx, const Mat4 & transform, MatrixPalettes palettes, UniformBlock pose_uniforms, float screen_size, Vec3 center, Vec3 extents ) {
+	if( node_idx == U8_MAX )
+		return;
+
+	const Model::Node * node = &model->nodes[ node_idx ];
+
+	if( node->primitive != U8_MAX ) {
+		ShadowDraw draw;
+		draw.model = model;
+		draw.primitive = &model->primitives[ node->primitive ];
+		draw.transform = transform * model->transform * NodePrimitiveTransform( model, node_idx, palettes, &draw.skinned );
+		draw.model_uniforms = UploadModelUniforms( draw.transform );
+		draw.pose_uniforms = pose_uniforms;
+		draw.lod = PrimitiveLOD( draw.primitive, screen_size );
+		draw.cascades = U8_MAX;
+		AddShadowBounds( center, extents );
+		shadow_draws.add( draw );
 	}
+
+	QueueNodeShadows( model, node->first_child, transform, palettes, pose_uniforms, screen_size, center, extents );
+	QueueNodeShadows( model, node->sibling, transform, palettes, pose_uniforms, screen_size, center, extents );
 }
 
 void DrawModelShadow( const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes ) {
-	UniformBlock pose_uniforms = { };
-	if( palettes.skinning_matrices.ptr != NULL ) {
-		pose_uniforms = UploadUniforms( palettes.skinning_matrices.ptr, palettes.skinning_matrices.num_bytes() );
+	// models without bounds get infinite extents so they never get culled
+	Vec3 center = Vec3( 0.0f );
+	Vec3 extents = Vec3( FLT_MAX );
+	if( model->bounds.mins.x <= model->bounds.maxs.x ) {
+		MinMax3 bounds = CullingBounds( model, palettes );
+		Mat4 world_from_model = transform * model->transform;
+		Vec3 model_center = ( bounds.mins + bounds.maxs ) * 0.5f;
+		Vec3 model_extents = ( bounds.maxs - bounds.mins ) * 0.5f;
+
+		center = ( world_from_model * Vec4( model_center, 1.0f ) ).xyz();
+		extents = Vec3(
+			Abs( world_from_model.col0.x ) * model_extents.x + Abs( world_from_model.col1.x ) * model_extents.y + Abs( world_from_model.col2.x ) * model_extents.z,
+			Abs( world_from_model.col0.y ) * model_extents.x + Abs( world_from_model.col1.y ) * model_extents.y + Abs( world_from_model.col2.y ) * model_extents.z,
+			Abs( world_from_model.col0.z ) * model_extents.x + Abs( world_from_model.col1.z ) * model_extents.y + Abs( world_from_model.col2.z ) * model_extents.z
+		);
 	}
 
+	// shadow maps are lower resolution than the screen and get blurred, so
+	// they can get away with coarser LODs
+	float screen_size = ScreenSize( model, transform ) * 0.5f;
+
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		if( model->nodes[ i ].parent == U8_MAX ) {
-			for( u32 j = 0; j < frame_static.shadow_parameters.entity_cascades; j++ ) {
-				DrawNode( model, i, transform, color, palettes, pose_uniforms, [ j ]( PipelineState * pipeline, bool skinned ) {
-					pipeline->shader = skinned ? &shaders.depth_only_skinned : &shaders.depth_only;
-					pipeline->pass = frame_static.shadowmap_pass[ j ];
-					pipeline->clamp_depth = true;
-					// pipeline->cull_face = CullFace_Disabled;
-					pipeline->write_depth = true;
-					pipeline->set_uniform( "u_View", frame_static.shadowmap_view_uniforms[ j ] );
-				} );
+			QueueNodeShadows( model, i, transform, palettes, palettes.skinning_uniforms, screen_size, center, extents );
+		}
+	}
+}
+
+/*
+ * shadow maps clamp depth so only x and y need testing. the cascade matrices
+ * are orthographic, so the bounds stay boxes in light space and a box is
+ * outside if its center is further than its extents from the [-1,1] square
+ */
+static void CullShadowCascade( u32 cascade ) {
+	const Mat4 & m = frame_static.shadowmap_view_projections[ cascade ];
+
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 sign_mask = _mm_set1_ps( -0.0f );
+
+	const __m128 row0_x = _mm_set1_ps( m.col0.x );
+	const __m128 row0_y = _mm_set1_ps( m.col1.x );
+	const __m128 row0_z = _mm_set1_ps( m.col2.x );
+	const __m128 row0_w = _mm_set1_ps( m.col3.x );
+	const __m128 row1_x = _mm_set1_ps( m.col0.y );
+	const __m128 row1_y = _mm_set1_ps( m.col1.y );
+	const __m128 row1_z = _mm_set1_ps( m.col2.y );
+	const __m128 row1_w = _mm_set1_ps( m.col3.y );
+
+	const __m128 abs_row0_x = _mm_andnot_ps( sign_mask, row0_x );
+	const __m128 abs_row0_y = _mm_andnot_ps( sign_mask, row0_y );
+	const __m128 abs_row0_z = _mm_andnot_ps( sign_mask, row0_z );
+	const __m128 abs_row1_x = _mm_andnot_ps( sign_mask, row1_x );
+	const __m128 abs_row1_y = _mm_andnot_ps( sign_mask, row1_y );
+	const __m128 abs_row1_z = _mm_andnot_ps( sign_mask, row1_z );
+
+	for( u32 i = 0; i < shadow_bounds.size(); i++ ) {
+		const ShadowBounds4 & block = shadow_bounds[ i ];
+
+		__m128 center_x = _mm_loadu_ps( block.center_x );
+		__m128 center_y = _mm_loadu_ps( block.center_y );
+		__m128 center_z = _mm_loadu_ps( block.center_z );
+		__m128 extents_x = _mm_loadu_ps( block.extents_x );
+		__m128 extents_y = _mm_loadu_ps( block.extents_y );
+		__m128 extents_z = _mm_loadu_ps( block.extents_z );
+
+		__m128 light_x = _mm_add_ps( _mm_add_ps( _mm_mul_ps( row0_x, center_x ), _mm_mul_ps( row0_y, center_y ) ), _mm_add_ps( _mm_mul_ps( row0_z, center_z ), row0_w ) );
+		__m128 light_y = _mm_add_ps( _mm_add_ps( _mm_mul_ps( row1_x, center_x ), _mm_mul_ps( row1_y, center_y ) ), _mm_add_ps( _mm_mul_ps( row1_z, center_z ), row1_w ) );
+		__m128 light_extents_x = _mm_add_ps( _mm_add_ps( _mm_mul_ps( abs_row0_x, extents_x ), _mm_mul_ps( abs_row0_y, extents_y ) ), _mm_mul_ps( abs_row0_z, extents_z ) );
+		__m128 light_extents_y = _mm_add_ps( _mm_add_ps( _mm_mul_ps( abs_row1_x, extents_x ), _mm_mul_ps( abs_row1_y, extents_y ) ), _mm_mul_ps( abs_row1_z, extents_z ) );
+
+		__m128 outside_x = _mm_cmpgt_ps( _mm_sub_ps( _mm_andnot_ps( sign_mask, light_x ), light_extents_x ), one );
+		__m128 outside_y = _mm_cmpgt_ps( _mm_sub_ps( _mm_andnot_ps( sign_mask, light_y ), light_extents_y ), one );
+		int outside = _mm_movemask_ps( _mm_or_ps( outside_x, outside_y ) );
+
+		for( u32 lane = 0; lane < 4 && i * 4 + lane < shadow_draws.size(); lane++ ) {
+			if( outside & ( 1 << lane ) ) {
+				shadow_draws[ i * 4 + lane ].cascades &= ~( 1 << cascade );
 			}
 		}
 	}
 }
 
+static void DrawShadowCascade( TempAllocator * temp, void * data ) {
+	ZoneScoped;
+
+	u32 cascade = *( const u32 * ) data;
+
+	for( const ShadowDraw & draw : shadow_draws ) {
+		if( ( draw.cascades & ( 1 << cascade ) ) == 0 )
+			continue;
+
+		PipelineState pipeline;
+		pipeline.shader = draw.skinned ? &shaders.depth_only_skinned : &shaders.depth_only;
+		pipeline.pass = frame_static.shadowmap_pass[ cascade ];
+		pipeline.cull_face = draw.primitive->material->double_sided ? CullFace_Disabled : CullFace_Back;
+		pipeline.clamp_depth = true;
+		pipeline.write_depth = true;
+		pipeline.set_uniform( UniformSlot_View, frame_static.shadowmap_view_uniforms[ cascade ] );
+		pipeline.set_uniform( UniformSlot_Model, draw.model_uniforms );
+
+		if( draw.skinned ) {
+			pipeline.set_uniform( UniformSlot_Pose, draw.pose_uniforms );
+			DrawModelPrimitive( draw.model, draw.primitive, pipeline, draw.lod );
+		}
+		else {
+			DrawInstanceableModelPrimitive( draw.model, draw.primitive, pipeline, draw.transform, draw.lod );
+		}
+	}
+}
+
+void DrawModelShadows() {
+	ZoneScoped;
+
+	u32 cascades[ ARRAY_COUNT( frame_static.shadowmap_pass ) ];
+	for( u32 i = 0; i < ARRAY_COUNT( cascades ); i++ ) {
+		cascades[ i ] = i;
+	}
+
+	{
+		ZoneScopedN( "Cull shadow casters" );
+		for( u32 i = 0; i < frame_static.shadow_parameters.entity_cascades; i++ ) {
+			CullShadowCascade( i );
+		}
+	}
+
+	ParallelDrawCalls( Span< u32 >( cascades, frame_static.shadow_parameters.entity_cascades ), DrawShadowCascade );
+
+	shadow_draws.clear();
+	shadow_bounds.clear();
+}
+
 template< typename T, typename F >
 static T SampleAnimationChannel( const Model::AnimationChannel< T > & channel, float t, T def, F lerp ) {
 	if( channel.samples == NULL )
@@ -261,11 +635,114 @@ static T SampleAnimationChannel( const Model::AnimationChannel< T > & channel, f
 static Vec3 LerpVec3( Vec3 a, float t, Vec3 b ) { return Lerp( a, t, b ); }
 static float LerpFloat( float a, float t, float b ) { return Lerp( a, t, b ); }
 
+static u32 FindKeyframe( const Model::Keyframes & keyframes, float t ) {
+	const float * times = keyframes.times;
+	u32 last = keyframes.num_keyframes - 2;
+
+	// evenly spaced keyframes are O(1), and the loops only fix up rounding
+	if( keyframes.inv_frame_time > 0.0f ) {
+		u32 k = Min2( u32( ( t - times[ 0 ] ) * keyframes.inv_frame_time ), last );
+		while( k > 0 && times[ k ] > t )
+			k--;
+		while( k < last && times[ k + 1 ] < t )
+			k++;
+		return k;
+	}
+
+	u32 lo = 0;
+	u32 hi = last;
+	while( lo < hi ) {
+		u32 mid = ( lo + hi + 1 ) / 2;
+		if( times[ mid ] <= t ) {
+			lo = mid;
+		}
+		else {
+			hi = mid - 1;
+		}
+	}
+	return lo;
+}
+
+static void SampleKeyframes( Span< TRS > local_poses, const Model * model, float t ) {
+	const Model::Keyframes & keyframes = model->keyframes;
+
+	t = Clamp( keyframes.times[ 0 ], t, keyframes.times[ keyframes.num_keyframes - 1 ] );
+	u32 k = FindKeyframe( keyframes, t );
+	float frac = ( t - keyframes.times[ k ] ) / ( keyframes.times[ k + 1 ] - keyframes.times[ k ] );
+
+	u32 stride = keyframes.node_stride;
+	const float * a = keyframes.poses + k * 8 * stride;
+	const float * b = a + 8 * stride;
+
+	__m128 rt = _mm_set1_ps( frac );
+	__m128 neg_rt = _mm_set1_ps( -frac );
+	__m128 lt = _mm_set1_ps( 1.0f - frac );
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps( 1.0f );
+
+	for( u32 i = 0; i < stride; i += 4 ) {
+		__m128 channels[ 8 ];
+
+		// NLerp
+		{
+			__m128 ax = _mm_loadu_ps( a + 0 * stride + i );
+			__m128 ay = _mm_loadu_ps( a + 1 * stride + i );
+			__m128 az = _mm_loadu_ps( a + 2 * stride + i );
+			__m128 aw = _mm_loadu_ps( a + 3 * stride + i );
+			__m128 bx = _mm_loadu_ps( b + 0 * stride + i );
+			__m128 by = _mm_loadu_ps( b + 1 * stride + i );
+			__m128 bz = _mm_loadu_ps( b + 2 * stride + i );
+			__m128 bw = _mm_loadu_ps( b + 3 * stride + i );
+
+			__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), _mm_add_ps( _mm_mul_ps( az, bz ), _mm_mul_ps( aw, bw ) ) );
+			__m128 same_hemisphere = _mm_cmpgt_ps( dot, zero );
+			__m128 signed_rt = _mm_or_ps( _mm_and_ps( same_hemisphere, rt ), _mm_andnot_ps( same_hemisphere, neg_rt ) );
+
+			__m128 x = _mm_add_ps( _mm_mul_ps( ax, lt ), _mm_mul_ps( bx, signed_rt ) );
+			__m128 y = _mm_add_ps( _mm_mul_ps( ay, lt ), _mm_mul_ps( by, signed_rt ) );
+			__m128 z = _mm_add_ps( _mm_mul_ps( az, lt ), _mm_mul_ps( bz, signed_rt ) );
+			__m128 w = _mm_add_ps( _mm_mul_ps( aw, lt ), _mm_mul_ps( bw, signed_rt ) );
+
+			__m128 length_squared = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_add_ps( _mm_mul_ps( z, z ), _mm_mul_ps( w, w ) ) );
+			__m128 inv_length = _mm_div_ps( one, _mm_sqrt_ps( length_squared ) );
+
+			channels[ 0 ] = _mm_mul_ps( x, inv_length );
+			channels[ 1 ] = _mm_mul_ps( y, inv_length );
+			channels[ 2 ] = _mm_mul_ps( z, inv_length );
+			channels[ 3 ] = _mm_mul_ps( w, inv_length );
+		}
+
+		// translation and scale
+		for( u32 j = 4; j < 8; j++ ) {
+			__m128 from = _mm_loadu_ps( a + j * stride + i );
+			__m128 to = _mm_loadu_ps( b + j * stride + i );
+			channels[ j ] = _mm_add_ps( from, _mm_mul_ps( _mm_sub_ps( to, from ), rt ) );
+		}
+
+		alignas( 16 ) float lanes[ 8 ][ 4 ];
+		for( u32 j = 0; j < 8; j++ ) {
+			_mm_store_ps( lanes[ j ], channels[ j ] );
+		}
+
+		for( u32 lane = 0; lane < 4 && i + lane < model->num_nodes; lane++ ) {
+			TRS * trs = &local_poses[ i + lane ];
+			trs->rotation = Quaternion( lanes[ 0 ][ lane ], lanes[ 1 ][ lane ], lanes[ 2 ][ lane ], lanes[ 3 ][ lane ] );
+			trs->translation = Vec3( lanes[ 4 ][ lane ], lanes[ 5 ][ lane ], lanes[ 6 ][ lane ] );
+			trs->scale = lanes[ 7 ][ lane ];
+		}
+	}
+}
+
 Span< TRS > SampleAnimation( Allocator * a, const Model * model, float t ) {
 	ZoneScoped;
 
 	Span< TRS > local_poses = ALLOC_SPAN( a, TRS, model->num_nodes );
 
+	if( model->keyframes.poses != NULL ) {
+		SampleKeyframes( local_poses, model, t );
+		return local_poses;
+	}
+
 	for( u8 i = 0; i < model->num_nodes; i++ ) {
 		const Model::Node * node = &model->nodes[ i ];
 		local_poses[ i ].rotation = SampleAnimationChannel( node->rotations, t, node->local_transform.rotation, NLerp );
@@ -328,6 +805,10 @@ MatrixPalettes ComputeMatrixPalettes( Allocator * a, const Model * model, Span<
 		palettes.skinning_matrices[ i ] = palettes.node_transforms[ node_idx ] * model->skin[ i ].joint_to_bind;
 	}
 
+	if( model->num_joints != 0 ) {
+		palettes.skinning_uniforms = UploadUniforms( palettes.skinning_matrices.ptr, palettes.skinning_matrices.num_bytes() );
+	}
+
 	return palettes;
 }
 
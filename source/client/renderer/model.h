@@ -1,8 +1,11 @@
 #pragma once
 
 #include "qcommon/types.h"
+#include "qcommon/array.h"
 #include "client/renderer/types.h"
 
+constexpr u32 MAX_MODEL_LODS = 4;
+
 enum InterpolationMode {
 	InterpolationMode_Step,
 	InterpolationMode_Linear,
@@ -10,11 +13,22 @@ enum InterpolationMode {
 };
 
 struct Model {
+	struct LOD {
+		u32 first_index;
+		u32 num_indices;
+		float error; // relative to the primitive's extents
+	};
+
 	struct Primitive {
 		const Material * material;
 		Mesh mesh;
 		u32 first_index;
 		u32 num_vertices;
+
+		// glTF only. simplified copies of the mesh, stored after the full
+		// detail indices in the same index buffer. lods[ 0 ] is the full mesh
+		LOD lods[ MAX_MODEL_LODS ];
+		u32 num_lods;
 	};
 
 	template< typename T >
@@ -60,8 +74,45 @@ struct Model {
 
 	Joint * skin;
 	u8 num_joints;
+
+	// every channel resampled onto one shared timeline, stored SoA across
+	// nodes so SampleAnimation can do four nodes at a time. each keyframe is
+	// rotation xyzw, translation xyz then scale, node_stride floats each.
+	// poses is NULL if the channels don't line up and we have to sample them
+	// one at a time
+	struct Keyframes {
+		float * times;
+		float * poses;
+		u32 num_keyframes;
+		u32 node_stride;
+		float inv_frame_time; // 0 if the keyframes aren't evenly spaced
+	};
+
+	Keyframes keyframes;
+
+	// BSP models only. a position only, simplified copy of the opaque
+	// primitives for shadow maps, stored after the regular indices
+	u32 shadow_first_index;
+	u32 num_shadow_indices;
+
+	// BSP world only. the primitives cut up into runs of faces that share a
+	// lowest cluster, in index order, so the world can be culled against the
+	// PVS and the view frustum. chunks with no clusters always get drawn
+	struct BSPChunk {
+		MinMax3 bounds;
+		u32 first_index;
+		u32 num_indices;
+		u32 first_cluster;
+		u32 num_clusters;
+	};
+
+	BSPChunk * bsp_chunks;
+	u32 num_bsp_chunks;
+	u32 * bsp_primitive_chunks; // [ num_primitives + 1 ], first chunk of each primitive
+	s32 * bsp_chunk_clusters;
 };
 
+void StartImportingModels();
 void InitModels();
 void HotloadModels();
 void ShutdownModels();
@@ -72,19 +123,57 @@ const Model * FindMapModel( StringHash name );
 
 void DeleteModel( Model * model );
 
+/*
+ * ImportGLTF does the parsing, validation and LOD generation and is safe to
+ * run on the thread pool. LoadGLTFModel turns an import into a Model, which
+ * makes GL objects so it has to happen on the main thread
+ */
+struct cgltf_data;
+
+struct GLTFImport {
+	struct Mesh {
+		NonRAIIDynamicArray< u32 > indices; // the full mesh followed by each LOD
+		Model::LOD lods[ MAX_MODEL_LODS ];
+		u32 num_lods;
+	};
+
+	cgltf_data * gltf;
+	Mesh * meshes; // parallel to gltf->meshes
+};
+
+bool ImportGLTF( GLTFImport * import, const char * path );
+void FreeGLTFImport( GLTFImport * import );
+bool LoadGLTFModel( Model * model, const GLTFImport * import, const char * path );
 bool LoadGLTFModel( Model * model, const char * path );
 
 struct Map;
 bool LoadBSPRenderData( const char * filename, Map * map, u64 base_hash, Span< const u8 > data );
 void DeleteBSPRenderData( Map * map );
-
-void DrawModelPrimitive( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline );
+void DrawBSPModelShadows( const Model * model, const PipelineState & pipeline );
+
+/*
+ * CullBSPModel returns which chunks can be seen from the current view, given
+ * a bit per cluster of what's potentially visible. the draw functions merge
+ * runs of visible chunks into single draw calls, and draw the whole thing
+ * when the model isn't chunked
+ */
+Span< bool > CullBSPModel( Allocator * a, const Model * model, const u8 * pvs, size_t num_clusters );
+void DrawBSPModel( const Model * model, Span< const bool > visible, const PipelineState & pipeline );
+void DrawBSPModelPrimitive( const Model * model, u32 primitive, Span< const bool > visible, const PipelineState & pipeline );
+
+void DrawModelPrimitive( const Model * model, const Model::Primitive * primitive, const PipelineState & pipeline, u32 lod = 0 );
 void DrawModel( const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes = MatrixPalettes() );
 void DrawViewWeapon( const Model * model, const Mat4 & transform );
-void DrawOutlinedViewWeapon( const Model * model, const Mat4 & transform, const Vec4 & color, float outline_height );
+
+/*
+ * silhouettes and outlines both come from the silhouette gbuffer, so a
+ * model that wants both only gets drawn into it once. a zero alpha colour
+ * leaves that effect off
+ */
+void DrawModelSilhouette( const Model * model, const Mat4 & transform, const Vec4 & color, const Vec4 & outline_color, MatrixPalettes palettes );
 void DrawModelSilhouette( const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes = MatrixPalettes() );
-void DrawOutlinedModel( const Model * model, const Mat4 & transform, const Vec4 & color, float outline_height, MatrixPalettes palettes = MatrixPalettes() );
 void DrawModelShadow( const Model * model, const Mat4 & transform, const Vec4 & color, MatrixPalettes palettes = MatrixPalettes() );
+void DrawModelShadows();
 
 Span< TRS > SampleAnimation( Allocator * a, const Model * model, float t );
 MatrixPalettes ComputeMatrixPalettes( Allocator * a, const Model * model, Span< const TRS > local_poses );
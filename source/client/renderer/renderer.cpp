@@ -1,6 +1,9 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
+#include "qcommon/async_io.h"
 #include "qcommon/fs.h"
+#include "qcommon/hashtable.h"
+#include "qcommon/memory_budget.h"
 #include "qcommon/string.h"
 #include "client/client.h"
 #include "client/renderer/renderer.h"
@@ -24,19 +27,62 @@ static Texture blue_noise;
 static Mesh fullscreen_mesh;
 
 static constexpr size_t MaxDynamicVerts = U16_MAX;
-static Mesh dynamic_geometry_mesh;
+static Mesh dynamic_geometry_meshes[ FRAMES_IN_FLIGHT ]; // so we never write to a buffer the GPU is still reading
 static u16 dynamic_geometry_num_vertices;
 static u16 dynamic_geometry_num_indices;
 
+constexpr u32 MAX_MATERIAL_UNIFORMS = 1024;
+
+static UniformBlock material_uniforms[ MAX_MATERIAL_UNIFORMS ];
+static char material_uniforms_data[ MAX_MATERIAL_UNIFORMS ][ MATERIAL_UNIFORMS_SIZE ];
+static u32 num_material_uniforms;
+static Hashtable< MAX_MATERIAL_UNIFORMS * 2 > material_uniforms_hashtable;
+static Hashtable< MAX_MATERIAL_UNIFORMS * 2 > material_blocks_hashtable;
+
 static char last_screenshot_date[ 256 ];
 static int same_date_count;
 
-static u32 last_viewport_width, last_viewport_height;
+/*
+ * the scene framebuffers only get reallocated when the viewport grows past
+ * them or shrinks to under half their area, otherwise we draw to the bottom
+ * left corner like with dynamic resolution. resizing the window used to
+ * thrash VRAM with a new set of attachments every frame
+ */
+static u32 framebuffer_width, framebuffer_height;
 static int last_msaa;
 static ShadowQuality last_shadow_quality;
 
+/*
+ * cascades get snapped to a coarse grid in light space so their matrices
+ * only change every so often, and the world's shadows can be kept between
+ * changes. if a frame never calls RendererSetView the static passes clear
+ * the cache without refilling it, so that has to invalidate everything
+ */
+struct StaticShadowCache {
+	Mat4 view_projection;
+	const Map * map;
+	bool valid;
+};
+
+static StaticShadowCache static_shadow_cache[ 4 ];
+static bool static_shadows_pending;
+
 static cvar_t * r_samples;
 static cvar_t * r_shadow_quality;
+static cvar_t * r_dynamic_resolution;
+static cvar_t * r_dynamic_resolution_fps;
+static cvar_t * r_dynamic_resolution_min;
+
+static float resolution_scale;
+
+static void ScreenshotWritten( void * user, const char * path, bool ok ) {
+	if( ok ) {
+		Com_Printf( "Wrote %s\n", path );
+	}
+	else {
+		Com_Printf( "Couldn't write %s\n", path );
+	}
+}
 
 static void TakeScreenshot() {
 	RGB8 * framebuffer = ALLOC_MANY( sys_allocator, RGB8, frame_static.viewport_width * frame_static.viewport_height );
@@ -65,12 +111,10 @@ static void TakeScreenshot() {
 
 		path.append( ".png" );
 
-		if( WriteFile( &temp, path.c_str(), png, png_size ) ) {
-			Com_Printf( "Wrote %s\n", path.c_str() );
-		}
-		else {
-			Com_Printf( "Couldn't write %s\n", path.c_str() );
-		}
+		// stb frees png when we return so it needs a copy
+		Span< u8 > data = ALLOC_SPAN( sys_allocator, u8, png_size );
+		memcpy( data.ptr, png, png_size );
+		AsyncWriteFile( path.c_str(), data, ScreenshotWritten );
 	}, NULL, frame_static.viewport_width, frame_static.viewport_height, 3, framebuffer, 0 );
 
 	if( ok == 0 ) {
@@ -78,6 +122,25 @@ static void TakeScreenshot() {
 	}
 }
 
+static void PrintGPUStats() {
+	Span< const GPUPassTime > passes = GPUPassTimes();
+	if( passes.n == 0 ) {
+		Com_Printf( "No GPU timings yet\n" );
+		return;
+	}
+
+	Com_Printf( "%-32s %8s %8s\n", "Pass", "ms", "avg ms" );
+	float total = 0.0f;
+	float total_average = 0.0f;
+	for( const GPUPassTime & pass : passes ) {
+		Com_Printf( "%-32s %8.3f %8.3f\n", pass.name, pass.ms, pass.average_ms );
+		total += pass.ms;
+		total_average += pass.average_ms;
+	}
+	Com_Printf( "%-32s %8.3f %8.3f\n", "Total", total, total_average );
+	Com_Printf( "Resolution scale: %.2f (%ux%u)\n", frame_static.resolution_scale, frame_static.scene_width, frame_static.scene_height );
+}
+
 const char * ShadowQualityToString( ShadowQuality mode ) {
 	switch( mode ) {
 		case ShadowQuality_Low: return "Rookie";
@@ -100,6 +163,30 @@ static ShadowParameters GetShadowParameters( ShadowQuality mode ) {
 	return { };
 }
 
+/*
+ * colour targets are RGBA8, or RGB8 which drivers pad out to RGBA8, and
+ * depth/shadow targets are 24 bit depth which also takes 4 bytes
+ */
+static size_t FramebufferVRAMBytes( const Framebuffer & fb, bool albedo, bool normal, bool depth, u32 samples ) {
+	size_t bytes_per_pixel = ( albedo ? 4 : 0 ) + ( normal ? 4 : 0 ) + ( depth ? 4 : 0 );
+	return size_t( fb.width ) * fb.height * bytes_per_pixel * Max2( samples, u32( 1 ) );
+}
+
+static void RendererMemoryBudget( MemoryBudget * budget ) {
+	budget->vram_bytes += FramebufferVRAMBytes( frame_static.silhouette_gbuffer, true, true, true, 1 );
+	budget->vram_bytes += FramebufferVRAMBytes( frame_static.postprocess_fb, true, false, true, 1 );
+	if( frame_static.msaa_fb.fbo != 0 ) {
+		budget->vram_bytes += FramebufferVRAMBytes( frame_static.msaa_fb, true, false, true, frame_static.msaa_samples );
+	}
+
+	// dynamic and static cascades
+	u32 shadowmap_res = frame_static.shadow_parameters.shadowmap_res;
+	budget->vram_bytes += 2 * size_t( shadowmap_res ) * shadowmap_res * 4 * frame_static.shadow_parameters.num_cascades;
+
+	size_t dynamic_geometry_bytes = ( sizeof( Vec3 ) + sizeof( Vec2 ) + sizeof( RGBA8 ) ) * 4 * MaxDynamicVerts + sizeof( u16 ) * 6 * MaxDynamicVerts;
+	budget->vram_bytes += dynamic_geometry_bytes * ARRAY_COUNT( dynamic_geometry_meshes );
+}
+
 void InitRenderer() {
 	ZoneScoped;
 
@@ -107,11 +194,19 @@ void InitRenderer() {
 
 	r_samples = Cvar_Get( "r_samples", "0", CVAR_ARCHIVE );
 	r_shadow_quality = Cvar_Get( "r_shadow_quality", "1", CVAR_ARCHIVE );
+	r_dynamic_resolution = Cvar_Get( "r_dynamic_resolution", "0", CVAR_ARCHIVE );
+	r_dynamic_resolution_fps = Cvar_Get( "r_dynamic_resolution_fps", "240", CVAR_ARCHIVE );
+	r_dynamic_resolution_min = Cvar_Get( "r_dynamic_resolution_min", "0.5", CVAR_ARCHIVE );
+
+	resolution_scale = 1.0f;
 
 	frame_static = { };
-	last_viewport_width = U32_MAX;
-	last_viewport_height = U32_MAX;
+	framebuffer_width = 0;
+	framebuffer_height = 0;
 	last_msaa = 0;
+	last_shadow_quality = ShadowQuality( -1 );
+	static_shadows_pending = false;
+	InvalidateStaticShadows();
 
 	{
 		int w, h;
@@ -142,43 +237,66 @@ void InitRenderer() {
 		fullscreen_mesh = NewMesh( config );
 	}
 
-	{
+	for( Mesh & mesh : dynamic_geometry_meshes ) {
 		MeshConfig config;
 		config.name = "Dynamic geometry";
 		config.positions = NewVertexBuffer( sizeof( Vec3 ) * 4 * MaxDynamicVerts );
 		config.tex_coords = NewVertexBuffer( sizeof( Vec2 ) * 4 * MaxDynamicVerts );
 		config.colors = NewVertexBuffer( sizeof( RGBA8 ) * 4 * MaxDynamicVerts );
 		config.indices = NewIndexBuffer( sizeof( u16 ) * 6 * MaxDynamicVerts );
-		dynamic_geometry_mesh = NewMesh( config );
+		mesh = NewMesh( config );
 	}
 
 	Cmd_AddCommand( "screenshot", TakeScreenshot );
+	Cmd_AddCommand( "r_gpustats", PrintGPUStats );
+	AddMemoryBudget( "renderer", RendererMemoryBudget );
 	strcpy( last_screenshot_date, "" );
 	same_date_count = 0;
 
 	InitShaders();
 	InitMaterials();
 	InitText();
-	InitSkybox();
 	InitModels();
 	InitVisualEffects();
 }
 
-static void DeleteFramebuffers() {
+static void DeleteSceneFramebuffers() {
 	DeleteFramebuffer( frame_static.silhouette_gbuffer );
 	DeleteFramebuffer( frame_static.postprocess_fb );
 	DeleteFramebuffer( frame_static.msaa_fb );
 	DeleteFramebuffer( frame_static.postprocess_fb_onlycolor );
 	DeleteFramebuffer( frame_static.msaa_fb_onlycolor );
+
+	frame_static.silhouette_gbuffer = { };
+	frame_static.postprocess_fb = { };
+	frame_static.msaa_fb = { };
+	frame_static.postprocess_fb_onlycolor = { };
+	frame_static.msaa_fb_onlycolor = { };
+}
+
+static void DeleteShadowmaps() {
 	for( u32 i = 0; i < 4; i++ ) {
 		DeleteFramebuffer( frame_static.shadowmap_fb[ i ] );
+		DeleteFramebuffer( frame_static.static_shadowmap_fb[ i ] );
+		frame_static.shadowmap_fb[ i ] = { };
+		frame_static.static_shadowmap_fb[ i ] = { };
 	}
 	DeleteTextureArray( frame_static.shadowmap_texture_array );
+	DeleteTextureArray( frame_static.static_shadowmap_texture_array );
+	frame_static.shadowmap_texture_array = { };
+	frame_static.static_shadowmap_texture_array = { };
+
+	InvalidateStaticShadows();
+}
+
+void InvalidateStaticShadows() {
+	for( StaticShadowCache & cache : static_shadow_cache ) {
+		cache.valid = false;
+	}
 }
 
 void ShutdownRenderer() {
 	ShutdownModels();
-	ShutdownSkybox();
 	ShutdownText();
 	ShutdownMaterials();
 	ShutdownVisualEffects();
@@ -186,9 +304,15 @@ void ShutdownRenderer() {
 
 	DeleteTexture( blue_noise );
 	DeleteMesh( fullscreen_mesh );
-	DeleteFramebuffers();
+	for( const Mesh & mesh : dynamic_geometry_meshes ) {
+		DeleteMesh( mesh );
+	}
+	DeleteSceneFramebuffers();
+	DeleteShadowmaps();
 
 	Cmd_RemoveCommand( "screenshot" );
+	Cmd_RemoveCommand( "r_gpustats" );
+	RemoveMemoryBudget( "renderer" );
 
 	RenderBackendShutdown();
 }
@@ -307,19 +431,25 @@ static UniformBlock UploadViewUniforms( const Mat4 & V, const Mat4 & inverse_V,
 	return UploadUniformBlock( V, inverse_V, P, inverse_P, camera_pos, viewport_size, near_plane, samples, light_dir );
 }
 
-static void CreateFramebuffers() {
-	DeleteFramebuffers();
+static void CreateSceneFramebuffers( u32 width, u32 height ) {
+	DeleteSceneFramebuffers();
 
 	TextureConfig texture_config;
-	texture_config.width = frame_static.viewport_width;
-	texture_config.height = frame_static.viewport_height;
+	texture_config.width = width;
+	texture_config.height = height;
 	texture_config.wrap = TextureWrap_Clamp;
 
 	{
 		FramebufferConfig fb;
 
+		// silhouette colour, outline colour, and depth so outlines can
+		// be tested against the scene
 		texture_config.format = TextureFormat_RGBA_U8_sRGB;
 		fb.albedo_attachment = texture_config;
+		fb.normal_attachment = texture_config;
+
+		texture_config.format = TextureFormat_Depth;
+		fb.depth_attachment = texture_config;
 
 		frame_static.silhouette_gbuffer = NewFramebuffer( fb );
 	}
@@ -354,6 +484,13 @@ static void CreateFramebuffers() {
 	if( frame_static.msaa_samples > 1 ) {
 		frame_static.msaa_fb_onlycolor = NewFramebuffer( &frame_static.msaa_fb.albedo_texture, NULL, NULL );
 	}
+}
+
+static void CreateShadowmaps() {
+	DeleteShadowmaps();
+
+	TextureConfig texture_config;
+	texture_config.wrap = TextureWrap_Clamp;
 
 	{
 		FramebufferConfig fb;
@@ -365,6 +502,7 @@ static void CreateFramebuffers() {
 		config.format = TextureFormat_Shadow;
 		config.layers = frame_static.shadow_parameters.num_cascades;
 		frame_static.shadowmap_texture_array = NewTextureArray( config );
+		frame_static.static_shadowmap_texture_array = NewTextureArray( config );
 
 		texture_config.width = shadowmap_res;
 		texture_config.height = shadowmap_res;
@@ -373,10 +511,64 @@ static void CreateFramebuffers() {
 
 		for( u32 i = 0; i < 4; i++ ) {
 			frame_static.shadowmap_fb[ i ] = NewShadowFramebuffer( frame_static.shadowmap_texture_array, i );
+			frame_static.static_shadowmap_fb[ i ] = NewShadowFramebuffer( frame_static.static_shadowmap_texture_array, i );
 		}
 	}
 }
 
+/*
+ * GPU time goes roughly with the number of pixels, hence the sqrt. the
+ * timings are a few frames stale so we drop resolution quickly when we go
+ * over budget and creep back up slowly, otherwise it oscillates
+ */
+static void UpdateResolutionScale() {
+	if( r_dynamic_resolution->integer == 0 ) {
+		resolution_scale = 1.0f;
+		return;
+	}
+
+	float gpu_ms = GPUFrameTime();
+	if( gpu_ms <= 0.0f )
+		return;
+
+	constexpr float headroom = 0.9f;
+	float target_ms = 1000.0f / Max2( 1.0f, r_dynamic_resolution_fps->value );
+	float ideal = resolution_scale * sqrtf( target_ms * headroom / gpu_ms );
+	float rate = ideal < resolution_scale ? 0.5f : 0.05f;
+
+	float min_scale = Clamp( 0.25f, r_dynamic_resolution_min->value, 1.0f );
+	resolution_scale = Clamp( min_scale, Lerp( resolution_scale, rate, ideal ), 1.0f );
+
+	TracyPlot( "Resolution scale", resolution_scale );
+}
+
+static u8 AddScenePass( const char * name, const tracy::SourceLocationData * tracy, Framebuffer target, ClearColor clear_color = ClearColor_Dont, ClearDepth clear_depth = ClearDepth_Dont ) {
+	RenderPass pass;
+	pass.type = RenderPass_Normal;
+	pass.target = target;
+	pass.name = name;
+	pass.clear_color = clear_color == ClearColor_Do;
+	pass.clear_depth = clear_depth == ClearDepth_Do;
+	pass.viewport_width = frame_static.scene_width;
+	pass.viewport_height = frame_static.scene_height;
+	pass.tracy = tracy;
+	return AddRenderPass( pass );
+}
+
+static void AddSceneResolveMSAAPass( const char * name, const tracy::SourceLocationData * tracy, Framebuffer src, Framebuffer dst, ClearColor clear_color, ClearDepth clear_depth ) {
+	RenderPass pass;
+	pass.type = RenderPass_Blit;
+	pass.name = name;
+	pass.tracy = tracy;
+	pass.blit_source = src;
+	pass.target = dst;
+	pass.clear_color = clear_color == ClearColor_Do;
+	pass.clear_depth = clear_depth == ClearDepth_Do;
+	pass.viewport_width = frame_static.scene_width;
+	pass.viewport_height = frame_static.scene_height;
+	AddRenderPass( pass );
+}
+
 #if !TRACY_ENABLE
 namespace tracy {
 struct SourceLocationData {
@@ -392,6 +584,7 @@ struct SourceLocationData {
 void RendererBeginFrame( u32 viewport_width, u32 viewport_height ) {
 	HotloadShaders();
 	HotloadMaterials();
+	StreamMaterialTextures();
 	HotloadModels();
 	HotloadMaps();
 	HotloadVisualEffects();
@@ -401,6 +594,10 @@ void RendererBeginFrame( u32 viewport_width, u32 viewport_height ) {
 	dynamic_geometry_num_vertices = 0;
 	dynamic_geometry_num_indices = 0;
 
+	num_material_uniforms = 0;
+	material_uniforms_hashtable.clear();
+	material_blocks_hashtable.clear();
+
 	if( !IsPowerOf2( r_samples->integer ) || r_samples->integer > 16 || r_samples->integer == 1 ) {
 		Com_Printf( "Invalid r_samples value (%d), resetting\n", r_samples->integer );
 		Cvar_Set( "r_samples", r_samples->dvalue );
@@ -419,14 +616,36 @@ void RendererBeginFrame( u32 viewport_width, u32 viewport_height ) {
 	frame_static.shadow_quality = ShadowQuality( r_shadow_quality->integer );
 	frame_static.shadow_parameters = GetShadowParameters( frame_static.shadow_quality );
 
-	if( viewport_width != last_viewport_width || viewport_height != last_viewport_height || frame_static.msaa_samples != last_msaa || frame_static.shadow_quality != last_shadow_quality ) {
-		CreateFramebuffers();
-		last_viewport_width = viewport_width;
-		last_viewport_height = viewport_height;
-		last_msaa = frame_static.msaa_samples;
+	UpdateResolutionScale();
+	frame_static.resolution_scale = resolution_scale;
+	frame_static.scene_width = Clamp( u32( 1 ), u32( frame_static.viewport_width * resolution_scale + 0.5f ), frame_static.viewport_width );
+	frame_static.scene_height = Clamp( u32( 1 ), u32( frame_static.viewport_height * resolution_scale + 0.5f ), frame_static.viewport_height );
+	frame_static.scene_viewport = Vec2( frame_static.scene_width, frame_static.scene_height );
+	frame_static.silhouettes_drawn = false;
+
+	{
+		u32 w = frame_static.viewport_width;
+		u32 h = frame_static.viewport_height;
+		bool grew = w > framebuffer_width || h > framebuffer_height;
+		bool shrunk = u64( w ) * h * 2 < u64( framebuffer_width ) * framebuffer_height;
+		if( grew || shrunk || frame_static.msaa_samples != last_msaa ) {
+			CreateSceneFramebuffers( w, h );
+			framebuffer_width = w;
+			framebuffer_height = h;
+			last_msaa = frame_static.msaa_samples;
+		}
+	}
+
+	if( frame_static.shadow_quality != last_shadow_quality ) {
+		CreateShadowmaps();
 		last_shadow_quality = frame_static.shadow_quality;
 	}
 
+	if( static_shadows_pending ) {
+		InvalidateStaticShadows();
+	}
+	static_shadows_pending = true;
+
 	bool msaa = frame_static.msaa_samples;
 
 	frame_static.ortho_view_uniforms = UploadViewUniforms( Mat4::Identity(), Mat4::Identity(), OrthographicProjection( 0, 0, viewport_width, viewport_height, -1, 1 ), Mat4::Identity(), Vec3( 0 ), frame_static.viewport, -1, frame_static.msaa_samples, Vec3() );
@@ -437,6 +656,8 @@ void RendererBeginFrame( u32 viewport_width, u32 viewport_height ) {
 
 #define TRACY_HACK( name ) { name, __FUNCTION__, __FILE__, uint32_t( __LINE__ ), 0 }
 	static const tracy::SourceLocationData particle_update_tracy = TRACY_HACK( "Update particles" );
+	static const tracy::SourceLocationData write_static_shadowmap_tracy = TRACY_HACK( "Write static shadowmap" );
+	static const tracy::SourceLocationData copy_static_shadowmap_tracy = TRACY_HACK( "Copy static shadowmap" );
 	static const tracy::SourceLocationData write_shadowmap_tracy = TRACY_HACK( "Write shadowmap" );
 	static const tracy::SourceLocationData world_opaque_prepass_tracy = TRACY_HACK( "World z-prepass" );
 	static const tracy::SourceLocationData world_opaque_tracy = TRACY_HACK( "Render world opaque" );
@@ -455,36 +676,58 @@ void RendererBeginFrame( u32 viewport_width, u32 viewport_height ) {
 	frame_static.particle_update_pass = AddRenderPass( "Particle Update", &particle_update_tracy );
 
 	for( u32 i = 0; i < frame_static.shadow_parameters.num_cascades; i++ ) {
-		frame_static.shadowmap_pass[ i ] = AddRenderPass( "Write shadowmap", &write_shadowmap_tracy, frame_static.shadowmap_fb[ i ], ClearColor_Dont, ClearDepth_Do );
+		frame_static.static_shadowmap_pass[ i ] = AddRenderPass( "Write static shadowmap", &write_static_shadowmap_tracy, frame_static.static_shadowmap_fb[ i ], ClearColor_Dont, ClearDepth_Do );
+		AddBlitPass( "Copy static shadowmap", &copy_static_shadowmap_tracy, frame_static.static_shadowmap_fb[ i ], frame_static.shadowmap_fb[ i ], ClearColor_Dont, ClearDepth_Do );
+		frame_static.shadowmap_pass[ i ] = AddRenderPass( "Write shadowmap", &write_shadowmap_tracy, frame_static.shadowmap_fb[ i ] );
 	}
 
 	if( msaa ) {
-		frame_static.world_opaque_prepass_pass = AddRenderPass( "Render world opaque Prepass", &world_opaque_prepass_tracy, frame_static.msaa_fb, ClearColor_Do, ClearDepth_Do );
-		frame_static.world_opaque_pass = AddRenderPass( "Render world opaque", &world_opaque_tracy, frame_static.msaa_fb );
-		frame_static.sky_pass = AddRenderPass( "Render sky", &sky_tracy, frame_static.msaa_fb );
-		frame_static.add_world_outlines_pass = AddRenderPass( "Render world outlines", &add_world_outlines_tracy, frame_static.msaa_fb_onlycolor );
+		frame_static.world_opaque_prepass_pass = AddScenePass( "Render world opaque Prepass", &world_opaque_prepass_tracy, frame_static.msaa_fb, ClearColor_Do, ClearDepth_Do );
+		frame_static.world_opaque_pass = AddScenePass( "Render world opaque", &world_opaque_tracy, frame_static.msaa_fb );
+		frame_static.sky_pass = AddScenePass( "Render sky", &sky_tracy, frame_static.msaa_fb );
+		frame_static.add_world_outlines_pass = AddScenePass( "Render world outlines", &add_world_outlines_tracy, frame_static.msaa_fb_onlycolor );
 	}
 	else {
-		frame_static.world_opaque_prepass_pass = AddRenderPass( "Render world opaque Prepass", &world_opaque_prepass_tracy, frame_static.postprocess_fb, ClearColor_Do, ClearDepth_Do );
-		frame_static.world_opaque_pass = AddRenderPass( "Render world opaque", &world_opaque_tracy, frame_static.postprocess_fb );
-		frame_static.sky_pass = AddRenderPass( "Render sky", &sky_tracy, frame_static.postprocess_fb );
-		frame_static.add_world_outlines_pass = AddRenderPass( "Render world outlines", &add_world_outlines_tracy, frame_static.postprocess_fb_onlycolor );
+		frame_static.world_opaque_prepass_pass = AddScenePass( "Render world opaque Prepass", &world_opaque_prepass_tracy, frame_static.postprocess_fb, ClearColor_Do, ClearDepth_Do );
+		frame_static.world_opaque_pass = AddScenePass( "Render world opaque", &world_opaque_tracy, frame_static.postprocess_fb );
+		frame_static.sky_pass = AddScenePass( "Render sky", &sky_tracy, frame_static.postprocess_fb );
+		frame_static.add_world_outlines_pass = AddScenePass( "Render world outlines", &add_world_outlines_tracy, frame_static.postprocess_fb_onlycolor );
 	}
 
-	frame_static.write_silhouette_gbuffer_pass = AddRenderPass( "Write silhouette gbuffer", &write_silhouette_buffer_tracy, frame_static.silhouette_gbuffer, ClearColor_Do, ClearDepth_Dont );
+	frame_static.write_silhouette_gbuffer_pass = AddScenePass( "Write silhouette gbuffer", &write_silhouette_buffer_tracy, frame_static.silhouette_gbuffer, ClearColor_Do, ClearDepth_Do );
 
 	if( msaa ) {
-		frame_static.nonworld_opaque_pass = AddRenderPass( "Render nonworld opaque", &nonworld_opaque_tracy, frame_static.msaa_fb );
-		AddResolveMSAAPass( "Resolve MSAA", &msaa_tracy, frame_static.msaa_fb, frame_static.postprocess_fb, ClearColor_Do, ClearDepth_Do );
+		frame_static.nonworld_opaque_pass = AddScenePass( "Render nonworld opaque", &nonworld_opaque_tracy, frame_static.msaa_fb );
+		AddSceneResolveMSAAPass( "Resolve MSAA", &msaa_tracy, frame_static.msaa_fb, frame_static.postprocess_fb, ClearColor_Do, ClearDepth_Do );
 	}
 	else {
-		frame_static.nonworld_opaque_pass = AddRenderPass( "Render nonworld opaque", &nonworld_opaque_tracy, frame_static.postprocess_fb );
+		frame_static.nonworld_opaque_pass = AddScenePass( "Render nonworld opaque", &nonworld_opaque_tracy, frame_static.postprocess_fb );
 	}
 
-	frame_static.transparent_pass = AddRenderPass( "Render transparent", &transparent_tracy, frame_static.postprocess_fb );
-	frame_static.add_silhouettes_pass = AddRenderPass( "Render silhouettes", &silhouettes_tracy, frame_static.postprocess_fb );
-	frame_static.ui_pass = AddUnsortedRenderPass( "Render UI", &ui_tracy, frame_static.postprocess_fb );
-	frame_static.postprocess_pass = AddRenderPass( "Postprocess", &postprocess_tracy, ClearColor_Do );
+	frame_static.transparent_pass = AddScenePass( "Render transparent", &transparent_tracy, frame_static.postprocess_fb );
+	frame_static.add_silhouettes_pass = AddScenePass( "Render silhouettes", &silhouettes_tracy, frame_static.postprocess_fb_onlycolor );
+
+	// with dynamic resolution the HUD goes on after the upscale so it stays
+	// sharp, at the cost of skipping the postprocess effects
+	//
+	// the postprocess pass writes every pixel so it doesn't get cleared
+	if( r_dynamic_resolution->integer == 0 ) {
+		RenderPass ui;
+		ui.type = RenderPass_Normal;
+		ui.name = "Render UI";
+		ui.target = frame_static.postprocess_fb;
+		ui.sorted = false;
+		ui.viewport_width = frame_static.viewport_width;
+		ui.viewport_height = frame_static.viewport_height;
+		ui.tracy = &ui_tracy;
+		frame_static.ui_pass = AddRenderPass( ui );
+
+		frame_static.postprocess_pass = AddRenderPass( "Postprocess", &postprocess_tracy );
+	}
+	else {
+		frame_static.postprocess_pass = AddRenderPass( "Postprocess", &postprocess_tracy );
+		frame_static.ui_pass = AddUnsortedRenderPass( "Render UI", &ui_tracy );
+	}
 	frame_static.post_ui_pass = AddUnsortedRenderPass( "Render Post UI", &post_ui_tracy );
 }
 
@@ -508,6 +751,7 @@ void SetupShadowCascades() {
 	const u32 num_planes = ARRAY_COUNT( cascade_dist );
 	const u32 num_cascades = num_planes - 1;
 	const u32 num_corners = 4;
+	const float snap_divisions = 16.0f;
 
 	cascade_dist[ 0 ] = near_plane;
 	for( u32 i = 0; i < num_cascades; i++ ) {
@@ -541,6 +785,9 @@ void SetupShadowCascades() {
 		}
 	}
 
+	Mat4 light_view = ViewMatrix( Vec3( 0.0f ), frame_static.light_direction );
+	Mat4 inverse_light_view = InvertViewMatrix( light_view, Vec3( 0.0f ) );
+
 	Vec3 shadow_camera_positions[ num_planes ];
 	Mat4 shadow_views[ num_planes ];
 	Mat4 shadow_projections[ num_planes ];
@@ -554,6 +801,17 @@ void SetupShadowCascades() {
 			radius = Max2( radius, dist );
 		}
 		radius = roundf( radius * 16.0f ) / 16.0f;
+
+		// pad by half a step so the slice still fits however far the
+		// center gets snapped
+		if( i > 0 ) {
+			float step = 2.0f * radius / snap_divisions;
+			Vec3 center = ( light_view * Vec4( frustum_centers[ i ], 1.0f ) ).xyz();
+			center = Vec3( roundf( center.x / step ), roundf( center.y / step ), roundf( center.z / step ) ) * step;
+			frustum_centers[ i ] = ( inverse_light_view * Vec4( center, 1.0f ) ).xyz();
+			radius += step * 0.5f;
+		}
+
 		shadow_camera_positions[ i ] = frustum_centers[ i ] - frame_static.light_direction * radius;
 
 		shadow_views[ i ] = ViewMatrix( shadow_camera_positions[ i ], frame_static.light_direction );
@@ -578,6 +836,22 @@ void SetupShadowCascades() {
 			shadow_projection.col3.y += rounded_offset.y;
 		}
 
+		frame_static.shadowmap_view_projections[ i ] = shadow_projection * shadow_view;
+
+		if( i < frame_static.shadow_parameters.num_cascades ) {
+			StaticShadowCache * cache = &static_shadow_cache[ i ];
+			const Mat4 & view_projection = frame_static.shadowmap_view_projections[ i ];
+			bool dirty = !cache->valid || cache->map != cl.map || memcmp( &cache->view_projection, &view_projection, sizeof( Mat4 ) ) != 0;
+
+			frame_static.static_shadowmap_dirty[ i ] = dirty;
+			if( !dirty ) {
+				SkipRenderPass( frame_static.static_shadowmap_pass[ i ] );
+			}
+
+			cache->view_projection = view_projection;
+			cache->map = cl.map;
+			cache->valid = true;
+		}
 		frame_static.shadowmap_view_uniforms[ i ] = UploadViewUniforms( shadow_view, Mat4::Identity(), shadow_projection, Mat4::Identity(), shadow_camera_position, Vec2(), cascade_dist[ i ], 0, frame_static.light_direction );
 
 		Mat4 inv_shadow_view = InvertViewMatrix( shadow_view, shadow_camera_position );
@@ -619,11 +893,20 @@ void RendererSetView( Vec3 position, EulerDegrees3 angles, float vertical_fov )
 	// frame_static.light_direction = Normalize( frame_static.light_direction );
 
 	SetupShadowCascades();
+	static_shadows_pending = false;
 
-	frame_static.view_uniforms = UploadViewUniforms( frame_static.V, frame_static.inverse_V, frame_static.P, frame_static.inverse_P, position, frame_static.viewport, near_plane, frame_static.msaa_samples, frame_static.light_direction );
+	frame_static.view_uniforms = UploadViewUniforms( frame_static.V, frame_static.inverse_V, frame_static.P, frame_static.inverse_P, position, frame_static.scene_viewport, near_plane, frame_static.msaa_samples, frame_static.light_direction );
 }
 
 void RendererSubmitFrame() {
+	DrawModelShadows();
+
+	// clearing the gbuffer and compositing it are two full resolution
+	// passes for nothing when no players are in view
+	if( !frame_static.silhouettes_drawn ) {
+		SkipRenderPass( frame_static.write_silhouette_gbuffer_pass );
+		SkipRenderPass( frame_static.add_silhouettes_pass );
+	}
 	RenderBackendSubmitFrame();
 }
 
@@ -640,6 +923,12 @@ u16 DynamicMeshBaseIndex() {
 }
 
 void DrawDynamicMesh( const PipelineState & pipeline, const DynamicMesh & mesh ) {
+	// drop it rather than wrap the u16 counters and corrupt everything else this frame
+	if( dynamic_geometry_num_vertices + mesh.num_vertices > MaxDynamicVerts || dynamic_geometry_num_indices + mesh.num_indices > U16_MAX )
+		return;
+
+	const Mesh & dynamic_geometry_mesh = dynamic_geometry_meshes[ FrameInFlight() ];
+
 	WriteVertexBuffer( dynamic_geometry_mesh.positions, mesh.positions, mesh.num_vertices * sizeof( mesh.positions[ 0 ] ), dynamic_geometry_num_vertices * sizeof( mesh.positions[ 0 ] ) );
 	WriteVertexBuffer( dynamic_geometry_mesh.tex_coords, mesh.uvs, mesh.num_vertices * sizeof( mesh.uvs[ 0 ] ), dynamic_geometry_num_vertices * sizeof( mesh.uvs[ 0 ] ) );
 	WriteVertexBuffer( dynamic_geometry_mesh.colors, mesh.colors, mesh.num_vertices * sizeof( mesh.colors[ 0 ] ), dynamic_geometry_num_vertices * sizeof( mesh.colors[ 0 ] ) );
@@ -673,6 +962,39 @@ UniformBlock UploadModelUniforms( const Mat4 & M ) {
 	return UploadUniformBlock( M );
 }
 
+/*
+ * identical material uniforms share a block so the backend can instance draws
+ * that use them
+ */
 UniformBlock UploadMaterialUniforms( const Vec4 & color, const Vec2 & texture_size, float specular, float shininess, Vec3 tcmod_row0, Vec3 tcmod_row1 ) {
-	return UploadUniformBlock( color, tcmod_row0, tcmod_row1, texture_size, specular, shininess );
+	STATIC_ASSERT( ( Std140Size< Vec4, Vec3, Vec3, Vec2, float, float >( 0 ) ) == MATERIAL_UNIFORMS_SIZE );
+	char buf[ MATERIAL_UNIFORMS_SIZE ] = { };
+	SerializeUniforms( buf, 0, color, tcmod_row0, tcmod_row1, texture_size, specular, shininess );
+
+	u64 hash = Hash64( buf, sizeof( buf ) );
+	u64 idx;
+	if( material_uniforms_hashtable.get( hash, &idx ) ) {
+		return material_uniforms[ idx ];
+	}
+
+	UniformBlock block = UploadUniforms( buf, sizeof( buf ) );
+	if( num_material_uniforms < ARRAY_COUNT( material_uniforms ) && material_uniforms_hashtable.add( hash, num_material_uniforms ) ) {
+		u64 block_key[] = { block.ubo, block.offset };
+		if( material_blocks_hashtable.add( Hash64( block_key, sizeof( block_key ) ), num_material_uniforms ) ) {
+			memcpy( material_uniforms_data[ num_material_uniforms ], buf, sizeof( buf ) );
+		}
+
+		material_uniforms[ num_material_uniforms ] = block;
+		num_material_uniforms++;
+	}
+
+	return block;
+}
+
+const void * FindMaterialUniforms( UniformBlock block ) {
+	u64 block_key[] = { block.ubo, block.offset };
+	u64 idx;
+	if( !material_blocks_hashtable.get( Hash64( block_key, sizeof( block_key ) ), &idx ) )
+		return NULL;
+	return material_uniforms_data[ idx ];
 }
@@ -29,6 +29,13 @@ struct FrameStatic {
 	u32 viewport_width, viewport_height;
 	u32 last_viewport_width, last_viewport_height;
 	Vec2 viewport;
+
+	// the 3D scene gets drawn to the bottom left of the scene framebuffers
+	// at this resolution, and postprocess scales it back up. the
+	// framebuffers are at least as big as the viewport, maybe bigger
+	u32 scene_width, scene_height;
+	Vec2 scene_viewport;
+	float resolution_scale;
 	float aspect_ratio;
 	int msaa_samples;
 	ShadowQuality shadow_quality;
@@ -45,6 +52,7 @@ struct FrameStatic {
 
 	Mat4 V, inverse_V;
 	Mat4 P, inverse_P;
+	Mat4 shadowmap_view_projections[ 4 ];
 	Vec3 light_direction;
 	Vec3 position;
 	float vertical_fov;
@@ -56,16 +64,25 @@ struct FrameStatic {
 	Framebuffer msaa_fb_onlycolor;
 	Framebuffer postprocess_fb_onlycolor;
 	Framebuffer shadowmap_fb[ 4 ];
+	Framebuffer static_shadowmap_fb[ 4 ];
 
 	TextureArray shadowmap_texture_array;
+	TextureArray static_shadowmap_texture_array;
 
 	u8 particle_update_pass;
 	u8 shadowmap_pass[ 4 ];
+
+	// the world only needs drawing into static_shadowmap_pass when the
+	// cached layer is out of date. it gets copied into shadowmap_fb
+	// before shadowmap_pass every frame
+	u8 static_shadowmap_pass[ 4 ];
+	bool static_shadowmap_dirty[ 4 ];
 	u8 world_opaque_prepass_pass;
 	u8 world_opaque_pass;
 	u8 add_world_outlines_pass;
 
 	u8 write_silhouette_gbuffer_pass;
+	bool silhouettes_drawn;
 
 	u8 nonworld_opaque_pass;
 	u8 sky_pass;
@@ -97,6 +114,7 @@ void ShutdownRenderer();
 
 void RendererBeginFrame( u32 viewport_width, u32 viewport_height );
 void RendererSetView( Vec3 position, EulerDegrees3 angles, float vertical_fov );
+void InvalidateStaticShadows();
 void RendererSubmitFrame();
 
 const Texture * BlueNoiseTexture();
@@ -114,4 +132,10 @@ void DrawDynamicMesh( const PipelineState & pipeline, const DynamicMesh & mesh )
 UniformBlock UploadModelUniforms( const Mat4 & M );
 UniformBlock UploadMaterialUniforms( const Vec4 & color, const Vec2 & texture_size, float specular, float shininess, Vec3 tcmod_row0 = Vec3( 1, 0, 0 ), Vec3 tcmod_row1 = Vec3( 0, 1, 0 ) );
 
+// the material table: CPU copy of a block UploadMaterialUniforms returned
+// this frame, so instanced draws can pack their materials into
+// u_InstanceMaterials. NULL if the block didn't come from there
+constexpr size_t MATERIAL_UNIFORMS_SIZE = 64;
+const void * FindMaterialUniforms( UniformBlock block );
+
 const char * ShadowQualityToString( ShadowQuality mode );
@@ -1,13 +1,14 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
 #include "qcommon/array.h"
+#include "qcommon/string.h"
 #include "client/client.h"
 #include "client/assets.h"
 #include "client/renderer/renderer.h"
 
 Shaders shaders;
 
-static void BuildShaderSrcs( const char * path, const char * defines, DynamicArray< const char * > * srcs, DynamicArray< int > * lengths ) {
+static void BuildShaderSrcs( const char * path, const char * defines, NonRAIIDynamicArray< const char * > * srcs, NonRAIIDynamicArray< int > * lengths ) {
 	ZoneScoped;
 	ZoneText( path, strlen( path ) );
 
@@ -53,140 +54,262 @@ static void BuildShaderSrcs( const char * path, const char * defines, DynamicArr
 	lengths->add( -1 );
 }
 
-static void ReplaceShader( Shader * shader, Span< const char * > srcs, Span< int > lens, Span< const char * > feedback_varyings = Span< const char * >() ) {
+/*
+ * every shader is a glsl file plus a set of features that turn into
+ * defines. the shaders we draw with every frame get compiled at startup and
+ * everything else gets compiled the first time a draw call uses it, so
+ * e.g. skinned variants cost nothing until there's a player model on
+ * screen. compiles go through StartShader so they're async with
+ * KHR_parallel_shader_compile and come out of the program binary cache
+ * after the first run
+ *
+ * results get swapped in as they finish. when hotloading the old shader
+ * keeps drawing until the new one is ready
+ */
+
+enum ShaderFeature : u32 {
+	ShaderFeature_Shaded = 1 << 0,
+	ShaderFeature_VertexColors = 1 << 1,
+	ShaderFeature_Instanced = 1 << 2,
+	ShaderFeature_Skinned = 1 << 3,
+	ShaderFeature_World = 1 << 4,
+	ShaderFeature_MSAA = 1 << 5,
+	ShaderFeature_Feedback = 1 << 6,
+	ShaderFeature_Model = 1 << 7,
+};
+
+struct ShaderVariant {
+	const char * path;
+	u32 features;
+	Span< const char * > feedback_varyings;
+	bool lazy;
+	bool requested;
+};
+
+static ShaderVariant variants[ sizeof( Shaders ) / sizeof( Shader ) ];
+
+struct QueuedShader {
+	Shader * shader;
+	PendingShader pending;
+};
+
+static QueuedShader queued_shaders[ 64 ];
+static u32 num_queued_shaders;
+
+static const char * update_no_feedback[] = {
+	"v_ParticlePosition",
+	"v_ParticleVelocity",
+	"v_ParticleAccelDragRest",
+	"v_ParticleUVWH",
+	"v_ParticleStartColor",
+	"v_ParticleEndColor",
+	"v_ParticleSize",
+	"v_ParticleAgeLifetime",
+	"v_ParticleFlags",
+};
+
+static const char * update_feedback[] = {
+	"v_ParticlePosition",
+	"v_ParticleVelocity",
+	"v_ParticleAccelDragRest",
+	"v_ParticleUVWH",
+	"v_ParticleStartColor",
+	"v_ParticleEndColor",
+	"v_ParticleSize",
+	"v_ParticleAgeLifetime",
+	"v_ParticleFlags",
+	"gl_NextBuffer",
+	"v_FeedbackPositionNormal",
+	"v_FeedbackColorParm",
+};
+
+// shaders only live in the Shaders struct, see DrawCallKey
+static size_t ShaderIndex( const Shader * shader ) {
+	size_t idx = ( uintptr_t( shader ) - uintptr_t( &shaders ) ) / sizeof( Shader );
+	assert( idx < ARRAY_COUNT( variants ) );
+	return idx;
+}
+
+static void AddVariant( Shader * shader, const char * path, u32 features = 0, bool lazy = false, Span< const char * > feedback_varyings = Span< const char * >() ) {
+	ShaderVariant * variant = &variants[ ShaderIndex( shader ) ];
+	variant->path = path;
+	variant->features = features;
+	variant->feedback_varyings = feedback_varyings;
+	variant->lazy = lazy;
+	variant->requested = false;
+}
+
+static void AddVariants() {
+	constexpr bool lazy = true;
+
+	AddVariant( &shaders.standard, "glsl/standard.glsl" );
+	AddVariant( &shaders.standard_shaded, "glsl/standard.glsl", ShaderFeature_Shaded );
+	AddVariant( &shaders.standard_vertexcolors, "glsl/standard.glsl", ShaderFeature_VertexColors, lazy );
+
+	AddVariant( &shaders.standard_instanced, "glsl/standard.glsl", ShaderFeature_Instanced, lazy );
+	AddVariant( &shaders.standard_shaded_instanced, "glsl/standard.glsl", ShaderFeature_Shaded | ShaderFeature_Instanced, lazy );
+
+	AddVariant( &shaders.standard_skinned, "glsl/standard.glsl", ShaderFeature_Skinned, lazy );
+	AddVariant( &shaders.standard_skinned_shaded, "glsl/standard.glsl", ShaderFeature_Skinned | ShaderFeature_Shaded, lazy );
+	AddVariant( &shaders.standard_skinned_vertexcolors, "glsl/standard.glsl", ShaderFeature_Skinned | ShaderFeature_VertexColors, lazy );
+
+	AddVariant( &shaders.depth_only, "glsl/depth_only.glsl" );
+	AddVariant( &shaders.depth_only_skinned, "glsl/depth_only.glsl", ShaderFeature_Skinned, lazy );
+	AddVariant( &shaders.depth_only_instanced, "glsl/depth_only.glsl", ShaderFeature_Instanced, lazy );
+
+	AddVariant( &shaders.world, "glsl/standard.glsl", ShaderFeature_World | ShaderFeature_Shaded );
+	AddVariant( &shaders.postprocess_world_gbuffer, "glsl/postprocess_world_gbuffer.glsl", 0, lazy );
+	AddVariant( &shaders.postprocess_world_gbuffer_msaa, "glsl/postprocess_world_gbuffer.glsl", ShaderFeature_MSAA, lazy );
+
+	AddVariant( &shaders.write_silhouette_gbuffer, "glsl/write_silhouette_gbuffer.glsl" );
+	AddVariant( &shaders.write_silhouette_gbuffer_skinned, "glsl/write_silhouette_gbuffer.glsl", ShaderFeature_Skinned, lazy );
+	AddVariant( &shaders.postprocess_silhouette_gbuffer, "glsl/postprocess_silhouette_gbuffer.glsl" );
+
+	AddVariant( &shaders.scope, "glsl/scope.glsl", 0, lazy );
+
+	// skipping a particle update would leave the buffers stale so they don't get compiled lazily
+	AddVariant( &shaders.particle_update, "glsl/particle_update.glsl", 0, false, Span< const char * >( update_no_feedback, ARRAY_COUNT( update_no_feedback ) ) );
+	AddVariant( &shaders.particle_update_feedback, "glsl/particle_update.glsl", ShaderFeature_Feedback, false, Span< const char * >( update_feedback, ARRAY_COUNT( update_feedback ) ) );
+	AddVariant( &shaders.particle, "glsl/particle.glsl" );
+	AddVariant( &shaders.particle_model, "glsl/particle.glsl", ShaderFeature_Model, lazy );
+
+	AddVariant( &shaders.skybox, "glsl/skybox.glsl" );
+
+	AddVariant( &shaders.text, "glsl/text.glsl" );
+
+	AddVariant( &shaders.blur, "glsl/blur.glsl" );
+	AddVariant( &shaders.postprocess, "glsl/postprocess.glsl" );
+
+	for( const ShaderVariant & variant : variants ) {
+		assert( variant.path != NULL );
+	}
+}
+
+static const char * ShaderDefines( Allocator * a, u32 features ) {
+	DynamicString defines( a );
+
+	if( features & ShaderFeature_World ) {
+		defines.append( "#define APPLY_DRAWFLAT 1\n" );
+		defines.append( "#define APPLY_FOG 1\n" );
+		defines.append( "#define APPLY_DECALS 1\n" );
+		defines.append( "#define APPLY_DLIGHTS 1\n" );
+		defines.append( "#define APPLY_SHADOWS 1\n" );
+		defines.append( "#define TILE_SIZE {}\n", TILE_SIZE );
+		defines.append( "#define DLIGHT_CUTOFF {}\n", DLIGHT_CUTOFF );
+	}
+	if( features & ShaderFeature_Shaded )
+		defines.append( "#define SHADED 1\n" );
+	if( features & ShaderFeature_VertexColors )
+		defines.append( "#define VERTEX_COLORS 1\n" );
+	if( features & ShaderFeature_Instanced )
+		defines.append( "#define INSTANCED 1\n#define MAX_INSTANCES {}\n", MAX_MODEL_INSTANCES );
+	if( features & ShaderFeature_Skinned )
+		defines.append( "#define SKINNED 1\n" );
+	if( features & ShaderFeature_MSAA )
+		defines.append( "#define MSAA 1\n" );
+	if( features & ShaderFeature_Feedback )
+		defines.append( "#define FEEDBACK 1\n" );
+	if( features & ShaderFeature_Model )
+		defines.append( "#define MODEL 1\n" );
+
+	return ( *a )( "{}", defines.c_str() );
+}
+
+static bool QueueShader( Shader * shader ) {
 	ZoneScoped;
 
+	assert( num_queued_shaders < ARRAY_COUNT( queued_shaders ) );
+
+	const ShaderVariant & variant = variants[ ShaderIndex( shader ) ];
+
+	TempAllocator temp = cls.frame_arena.temp();
+	SmallDynamicArray< const char *, 16 > srcs( &temp );
+	SmallDynamicArray< int, 16 > lengths( &temp );
+
+	const char * defines = variant.features == 0 ? NULL : ShaderDefines( &temp, variant.features );
+	BuildShaderSrcs( variant.path, defines, &srcs, &lengths );
+
+	QueuedShader * queued = &queued_shaders[ num_queued_shaders ];
+	if( !StartShader( &queued->pending, srcs.span(), lengths.span(), variant.feedback_varyings ) )
+		return false;
+
+	queued->shader = shader;
+	num_queued_shaders++;
+
+	return true;
+}
+
+static void FinishQueuedShader( u32 i ) {
+	QueuedShader * queued = &queued_shaders[ i ];
+
 	Shader new_shader;
-	if( !NewShader( &new_shader, srcs, lens, feedback_varyings ) )
-		return;
+	if( FinishShader( &new_shader, queued->pending ) ) {
+		DeleteShader( *queued->shader );
+		*queued->shader = new_shader;
+	}
 
-	DeleteShader( *shader );
-	*shader = new_shader;
+	num_queued_shaders--;
+	*queued = queued_shaders[ num_queued_shaders ];
+}
+
+static void FinishQueuedShaders( bool block ) {
+	ZoneScoped;
+
+	u32 i = 0;
+	while( i < num_queued_shaders ) {
+		if( !block && !ShaderReady( queued_shaders[ i ].pending ) ) {
+			i++;
+			continue;
+		}
+
+		FinishQueuedShader( i );
+	}
 }
 
 static void LoadShaders() {
 	ZoneScoped;
 
-	TempAllocator temp = cls.frame_arena.temp();
-	DynamicArray< const char * > srcs( &temp );
-	DynamicArray< int > lengths( &temp );
-
-	BuildShaderSrcs( "glsl/standard.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.standard, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/standard.glsl", "#define SHADED 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.standard_shaded, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/standard.glsl", "#define VERTEX_COLORS 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.standard_vertexcolors, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/standard.glsl", "#define SKINNED 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.standard_skinned, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/standard.glsl", "#define SKINNED 1\n#define SHADED 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.standard_skinned_shaded, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/standard.glsl", "#define SKINNED 1\n#define VERTEX_COLORS 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.standard_skinned_vertexcolors, srcs.span(), lengths.span() );
-
-	const char * world_defines = temp(
-		"#define APPLY_DRAWFLAT 1\n"
-		"#define APPLY_FOG 1\n"
-		"#define APPLY_DECALS 1\n"
-		"#define APPLY_DLIGHTS 1\n"
-		"#define APPLY_SHADOWS 1\n"
-		"#define SHADED 1\n"
-		"#define TILE_SIZE {}\n"
-		"#define DLIGHT_CUTOFF {}\n", TILE_SIZE, DLIGHT_CUTOFF );
-	BuildShaderSrcs( "glsl/standard.glsl", world_defines, &srcs, &lengths );
-	ReplaceShader( &shaders.world, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/depth_only.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.depth_only, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/depth_only.glsl", "#define SKINNED 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.depth_only_skinned, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/postprocess_world_gbuffer.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.postprocess_world_gbuffer, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/postprocess_world_gbuffer.glsl", "#define MSAA 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.postprocess_world_gbuffer_msaa, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/write_silhouette_gbuffer.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.write_silhouette_gbuffer, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/write_silhouette_gbuffer.glsl", "#define SKINNED 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.write_silhouette_gbuffer_skinned, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/postprocess_silhouette_gbuffer.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.postprocess_silhouette_gbuffer, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/outline.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.outline, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/outline.glsl", "#define SKINNED 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.outline_skinned, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/scope.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.scope, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/particle_update.glsl", NULL, &srcs, &lengths );
-	const char * update_no_feedback[] = {
-		"v_ParticlePosition",
-		"v_ParticleVelocity",
-		"v_ParticleAccelDragRest",
-		"v_ParticleUVWH",
-		"v_ParticleStartColor",
-		"v_ParticleEndColor",
-		"v_ParticleSize",
-		"v_ParticleAgeLifetime",
-		"v_ParticleFlags",
-	};
-	ReplaceShader( &shaders.particle_update, srcs.span(), lengths.span(), Span< const char *>( update_no_feedback, ARRAY_COUNT( update_no_feedback ) ) );
-
-	BuildShaderSrcs( "glsl/particle_update.glsl", "#define FEEDBACK 1\n", &srcs, &lengths );
-	const char * update_feedback[] = {
-		"v_ParticlePosition",
-		"v_ParticleVelocity",
-		"v_ParticleAccelDragRest",
-		"v_ParticleUVWH",
-		"v_ParticleStartColor",
-		"v_ParticleEndColor",
-		"v_ParticleSize",
-		"v_ParticleAgeLifetime",
-		"v_ParticleFlags",
-		"gl_NextBuffer",
-		"v_FeedbackPositionNormal",
-		"v_FeedbackColorParm",
-	};
-	ReplaceShader( &shaders.particle_update_feedback, srcs.span(), lengths.span(), Span< const char *>( update_feedback, ARRAY_COUNT( update_feedback ) ) );
-
-	BuildShaderSrcs( "glsl/particle.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.particle, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/particle.glsl", "#define MODEL 1\n", &srcs, &lengths );
-	ReplaceShader( &shaders.particle_model, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/skybox.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.skybox, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/text.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.text, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/blur.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.blur, srcs.span(), lengths.span() );
-
-	BuildShaderSrcs( "glsl/postprocess.glsl", NULL, &srcs, &lengths );
-	ReplaceShader( &shaders.postprocess, srcs.span(), lengths.span() );
+	Shader * all_shaders = ( Shader * ) &shaders;
+	for( size_t i = 0; i < ARRAY_COUNT( variants ); i++ ) {
+		if( !variants[ i ].lazy || variants[ i ].requested ) {
+			QueueShader( &all_shaders[ i ] );
+		}
+	}
+}
+
+bool RequestShader( const Shader * shader ) {
+	if( shader->program != 0 )
+		return true;
+
+	ShaderVariant * variant = &variants[ ShaderIndex( shader ) ];
+	if( variant->requested )
+		return false;
+
+	// if it failed to compile there's no point trying again until it gets hotloaded
+	variant->requested = true;
+	if( !QueueShader( const_cast< Shader * >( shader ) ) )
+		return false;
+
+	// cached programs and drivers without parallel compile are ready right away
+	u32 idx = num_queued_shaders - 1;
+	if( ShaderReady( queued_shaders[ idx ].pending ) ) {
+		FinishQueuedShader( idx );
+	}
+
+	return shader->program != 0;
 }
 
 void InitShaders() {
 	shaders = { };
+	num_queued_shaders = 0;
+	AddVariants();
 	LoadShaders();
+	FinishQueuedShaders( true );
 }
 
 void HotloadShaders() {
+	FinishQueuedShaders( false );
+
 	bool need_hotload = false;
 	for( const char * path : ModifiedAssetPaths() ) {
 		if( FileExtension( path ) == ".glsl" ) {
@@ -196,10 +319,12 @@ void HotloadShaders() {
 	}
 
 	if( need_hotload ) {
+		FinishQueuedShaders( true );
 		LoadShaders();
 	}
 }
 
 void ShutdownShaders() {
+	FinishQueuedShaders( true );
 	DeleteShader( shaders.text );
 }
@@ -7,12 +7,16 @@ struct Shaders {
 	Shader standard_shaded;
 	Shader standard_vertexcolors;
 
+	Shader standard_instanced;
+	Shader standard_shaded_instanced;
+
 	Shader standard_skinned;
 	Shader standard_skinned_shaded;
 	Shader standard_skinned_vertexcolors;
 
 	Shader depth_only;
 	Shader depth_only_skinned;
+	Shader depth_only_instanced;
 
 	Shader world;
 	Shader postprocess_world_gbuffer;
@@ -22,9 +26,6 @@ struct Shaders {
 	Shader write_silhouette_gbuffer_skinned;
 	Shader postprocess_silhouette_gbuffer;
 
-	Shader outline;
-	Shader outline_skinned;
-
 	Shader scope;
 
 	Shader particle_update;
@@ -45,3 +46,6 @@ extern Shaders shaders;
 void InitShaders();
 void HotloadShaders();
 void ShutdownShaders();
+
+// returns whether the shader is ready to draw with, and starts compiling it if it isn't
+bool RequestShader( const Shader * shader );
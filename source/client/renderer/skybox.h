@@ -2,6 +2,4 @@
 
 #include "qcommon/types.h"
 
-void InitSkybox();
-void ShutdownSkybox();
 void DrawSkybox();
@@ -146,48 +146,225 @@ const Font * RegisterFont( const char * path ) {
 	return font;
 }
 
-static void DrawText( const Font * font, float pixel_size, Span< const char > str, float x, float y, Vec4 color, bool border, Vec4 border_color ) {
-	if( font == NULL )
-		return;
+/*
+ * glyph quads in font units, relative to the start of the string. the HUD
+ * draws mostly the same strings every frame so we keep the last few hundred
+ * around
+ */
+struct CachedTextLayout {
+	u64 key;
+	TextLayout layout;
+};
 
-	y += pixel_size * font->ascent;
+static CachedTextLayout text_layouts[ 256 ];
 
-	ImGuiShaderAndMaterial sam;
-	sam.shader = &shaders.text;
-	sam.material = &font->material;
-	sam.uniform_name = "u_Text";
-	sam.uniform_block = UploadUniformBlock(
-		color, border_color,
-		Vec2( font->atlas.width, font->atlas.height ),
-		font->dSDF_dTexel, border ? 1 : 0 );
+/*
+ * most of what we draw is ASCII, so decode a chunk at a time instead of
+ * stepping the DFA for every byte. f returns false to stop early
+ */
+template< typename F >
+static bool ForEachGlyph( const Font * font, Span< const char > str, F f ) {
+	u32 codepoints[ 256 ];
 
-	ImDrawList * bg = ImGui::GetBackgroundDrawList();
-	bg->PushTextureID( sam );
+	while( str.n > 0 ) {
+		size_t bytes_read;
+		size_t n = DecodeUTF8( str, Span< u32 >( codepoints, ARRAY_COUNT( codepoints ) ), &bytes_read );
 
-	u32 state = 0;
-	u32 c = 0;
-	for( size_t i = 0; i < str.n; i++ ) {
-		if( DecodeUTF8( &state, &c, str[ i ] ) != 0 )
-			continue;
-		if( c > 255 )
-			c = '?';
+		for( size_t i = 0; i < n; i++ ) {
+			u32 c = codepoints[ i ] > 255 ? '?' : codepoints[ i ];
+			if( !f( &font->glyphs[ c ] ) )
+				return false;
+		}
 
-		const Glyph * glyph = &font->glyphs[ c ];
+		str = str.slice( bytes_read, str.n );
+	}
 
+	return true;
+}
+
+static bool LayOutText( TextLayout * layout, const Font * font, Span< const char > str ) {
+	layout->font = font;
+	layout->num_quads = 0;
+
+	float x = 0.0f;
+	float width = 0.0f;
+	MinMax1 y_extents = MinMax1::Empty();
+	const Glyph * last_glyph = NULL;
+
+	bool fits = ForEachGlyph( font, str, [&]( const Glyph * glyph ) {
 		if( glyph->bounds.mins.x != glyph->bounds.maxs.x && glyph->bounds.mins.y != glyph->bounds.maxs.y ) {
+			if( layout->num_quads == ARRAY_COUNT( layout->quads ) )
+				return false;
+
 			// TODO: this is bogus. it should expand glyphs by 1 or
 			// 2 pixels to allow for border/antialiasing, up to a
 			// limit determined by font->glyph_padding
-			Vec2 mins = Vec2( x, y ) + pixel_size * ( glyph->bounds.mins - font->glyph_padding );
-			Vec2 maxs = Vec2( x, y ) + pixel_size * ( glyph->bounds.maxs + font->glyph_padding );
-			bg->PrimReserve( 6, 4 );
-			bg->PrimRectUV( mins, maxs, glyph->uv_bounds.mins, glyph->uv_bounds.maxs, IM_COL32_WHITE );
+			GlyphQuad * quad = &layout->quads[ layout->num_quads ];
+			quad->bounds.mins = Vec2( x, 0.0f ) + glyph->bounds.mins - font->glyph_padding;
+			quad->bounds.maxs = Vec2( x, 0.0f ) + glyph->bounds.maxs + font->glyph_padding;
+			quad->uv_bounds = glyph->uv_bounds;
+			layout->num_quads++;
 		}
 
-		x += pixel_size * glyph->advance;
+		x += glyph->advance;
+		width += glyph->advance;
+		y_extents.lo = Min2( glyph->bounds.mins.y, y_extents.lo );
+		y_extents.hi = Max2( glyph->bounds.maxs.y, y_extents.hi );
 		// TODO: kerning
+
+		last_glyph = glyph;
+		return true;
+	} );
+
+	if( !fits )
+		return false;
+
+	if( last_glyph == NULL ) {
+		layout->bounds = MinMax2( Vec2( 0 ), Vec2( 0 ) );
+	}
+	else {
+		width -= last_glyph->advance;
+		width += last_glyph->bounds.maxs.x - last_glyph->bounds.mins.x;
+		layout->bounds = MinMax2( Vec2( 0, y_extents.lo ), Vec2( width, y_extents.hi ) );
+	}
+
+	return true;
+}
+
+// returns NULL if the string has too many glyphs to cache
+static const TextLayout * GetTextLayout( const Font * font, Span< const char > str ) {
+	u64 key = Hash64( str.ptr, str.n, Hash64( u64( uintptr_t( font ) ) ) );
+	CachedTextLayout * cached = &text_layouts[ key % ARRAY_COUNT( text_layouts ) ];
+	if( cached->key == key )
+		return &cached->layout;
+
+	if( !LayOutText( &cached->layout, font, str ) ) {
+		cached->key = 0;
+		return NULL;
+	}
+
+	cached->key = key;
+	return &cached->layout;
+}
+
+bool LayOutText( TextLayout * layout, const Font * font, const char * str ) {
+	if( font == NULL || !LayOutText( layout, font, MakeSpan( str ) ) ) {
+		layout->font = NULL;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * text colour goes in the vertices so consecutive strings drawn with the same
+ * font and border share a uniform block, which lets ImGui merge them into a
+ * single draw call
+ */
+struct TextUniforms {
+	const Font * font;
+	bool border;
+	Vec4 border_color;
+	UniformBlock block;
+};
+
+static TextUniforms text_uniforms[ 16 ];
+static u32 num_text_uniforms;
+static u64 text_uniforms_frame;
+
+static UniformBlock UploadTextUniforms( const Font * font, bool border, Vec4 border_color ) {
+	if( text_uniforms_frame != FrameNumber() ) {
+		text_uniforms_frame = FrameNumber();
+		num_text_uniforms = 0;
+	}
+
+	for( u32 i = 0; i < num_text_uniforms; i++ ) {
+		const TextUniforms & uniforms = text_uniforms[ i ];
+		if( uniforms.font == font && uniforms.border == border && uniforms.border_color == border_color ) {
+			return uniforms.block;
+		}
 	}
 
+	UniformBlock block = UploadUniformBlock( border_color, Vec2( font->atlas.width, font->atlas.height ), font->dSDF_dTexel, border ? 1 : 0 );
+	if( num_text_uniforms < ARRAY_COUNT( text_uniforms ) ) {
+		text_uniforms[ num_text_uniforms ] = { font, border, border_color, block };
+		num_text_uniforms++;
+	}
+
+	return block;
+}
+
+static ImDrawList * BeginText( const Font * font, Vec4 color, bool border, Vec4 border_color, ImU32 * col ) {
+	// the shader scales the border alpha by the text alpha
+	if( border ) {
+		border_color.w = color.w > 0.0f ? border_color.w / color.w : 0.0f;
+	}
+	else {
+		border_color = Vec4( 0.0f );
+	}
+
+	ImGuiShaderAndMaterial sam;
+	sam.shader = &shaders.text;
+	sam.material = &font->material;
+	sam.uniform_slot = UniformSlot_Text;
+	sam.uniform_block = UploadTextUniforms( font, border, border_color );
+
+	RGBA8 rgba = LinearTosRGB( color );
+	*col = IM_COL32( rgba.r, rgba.g, rgba.b, rgba.a );
+
+	ImDrawList * bg = ImGui::GetBackgroundDrawList();
+	bg->PushTextureID( sam );
+	return bg;
+}
+
+static void DrawTextLayout( ImDrawList * bg, const TextLayout & layout, float pixel_size, float x, float y, ImU32 col ) {
+	bg->PrimReserve( layout.num_quads * 6, layout.num_quads * 4 );
+	for( u32 i = 0; i < layout.num_quads; i++ ) {
+		const GlyphQuad * quad = &layout.quads[ i ];
+		Vec2 mins = Vec2( x, y ) + pixel_size * quad->bounds.mins;
+		Vec2 maxs = Vec2( x, y ) + pixel_size * quad->bounds.maxs;
+		bg->PrimRectUV( mins, maxs, quad->uv_bounds.mins, quad->uv_bounds.maxs, col );
+	}
+}
+
+static void DrawText( const Font * font, float pixel_size, Span< const char > str, float x, float y, Vec4 color, bool border, Vec4 border_color ) {
+	if( font == NULL )
+		return;
+
+	y += pixel_size * font->ascent;
+
+	ImU32 col;
+	ImDrawList * bg = BeginText( font, color, border, border_color, &col );
+
+	const TextLayout * layout = GetTextLayout( font, str );
+	if( layout != NULL ) {
+		DrawTextLayout( bg, *layout, pixel_size, x, y, col );
+	}
+	else {
+		ForEachGlyph( font, str, [&]( const Glyph * glyph ) {
+			if( glyph->bounds.mins.x != glyph->bounds.maxs.x && glyph->bounds.mins.y != glyph->bounds.maxs.y ) {
+				Vec2 mins = Vec2( x, y ) + pixel_size * ( glyph->bounds.mins - font->glyph_padding );
+				Vec2 maxs = Vec2( x, y ) + pixel_size * ( glyph->bounds.maxs + font->glyph_padding );
+				bg->PrimReserve( 6, 4 );
+				bg->PrimRectUV( mins, maxs, glyph->uv_bounds.mins, glyph->uv_bounds.maxs, col );
+			}
+
+			x += pixel_size * glyph->advance;
+			return true;
+		} );
+	}
+
+	bg->PopTextureID();
+}
+
+void DrawText( const TextLayout & layout, float pixel_size, float x, float y, Vec4 color, bool border ) {
+	if( layout.font == NULL )
+		return;
+
+	y += pixel_size * layout.font->ascent;
+
+	ImU32 col;
+	ImDrawList * bg = BeginText( layout.font, color, border, Vec4( 0, 0, 0, color.w ), &col );
+	DrawTextLayout( bg, layout, pixel_size, x, y, col );
 	bg->PopTextureID();
 }
 
@@ -201,37 +378,38 @@ void DrawText( const Font * font, float pixel_size, const char * str, float x, f
 }
 
 MinMax2 TextBounds( const Font * font, float pixel_size, const char * str ) {
+	const TextLayout * layout = GetTextLayout( font, MakeSpan( str ) );
+	if( layout != NULL ) {
+		return MinMax2( pixel_size * layout->bounds.mins, pixel_size * layout->bounds.maxs );
+	}
+
 	float width = 0.0f;
 	MinMax1 y_extents = MinMax1::Empty();
 
-	u32 state = 0;
-	u32 c = 0;
-	const Glyph * glyph = NULL;
+	const Glyph * last_glyph = NULL;
 
-	for( const char * p = str; *p != '\0'; p++ ) {
-		if( DecodeUTF8( &state, &c, *p ) != 0 )
-			continue;
-		if( c > 255 )
-			c = '?';
-
-		glyph = &font->glyphs[ c ];
+	ForEachGlyph( font, MakeSpan( str ), [&]( const Glyph * glyph ) {
 		width += glyph->advance;
 		y_extents.lo = Min2( glyph->bounds.mins.y, y_extents.lo );
 		y_extents.hi = Max2( glyph->bounds.maxs.y, y_extents.hi );
-	}
+		last_glyph = glyph;
+		return true;
+	} );
 
-	if( glyph == NULL )
+	if( last_glyph == NULL )
 		return MinMax2( Vec2( 0 ), Vec2( 0 ) );
 
-	width -= glyph->advance;
-	width += glyph->bounds.maxs.x - glyph->bounds.mins.x;
+	width -= last_glyph->advance;
+	width += last_glyph->bounds.maxs.x - last_glyph->bounds.mins.x;
 
 	return MinMax2( pixel_size * Vec2( 0, y_extents.lo ), pixel_size * Vec2( width, y_extents.hi ) );
 }
 
-static void DrawText( const Font * font, float pixel_size, const char * str, Alignment align, float x, float y, Vec4 color, bool border, Vec4 border_color ) {
-	MinMax2 bounds = TextBounds( font, pixel_size, str );
+MinMax2 TextBounds( const TextLayout & layout, float pixel_size ) {
+	return MinMax2( pixel_size * layout.bounds.mins, pixel_size * layout.bounds.maxs );
+}
 
+static Vec2 AlignText( const Font * font, float pixel_size, MinMax2 bounds, Alignment align, float x, float y ) {
 	if( align.x == XAlignment_Center ) {
 		x -= bounds.maxs.x / 2.0f;
 	}
@@ -247,7 +425,20 @@ static void DrawText( const Font * font, float pixel_size, const char * str, Ali
 		y += ( bounds.maxs.y - bounds.mins.y ) / 2.0f;
 	}
 
-	DrawText( font, pixel_size, MakeSpan( str ), x, y, color, border, border_color );
+	return Vec2( x, y );
+}
+
+static void DrawText( const Font * font, float pixel_size, const char * str, Alignment align, float x, float y, Vec4 color, bool border, Vec4 border_color ) {
+	Vec2 pos = AlignText( font, pixel_size, TextBounds( font, pixel_size, str ), align, x, y );
+	DrawText( font, pixel_size, MakeSpan( str ), pos.x, pos.y, color, border, border_color );
+}
+
+void DrawText( const TextLayout & layout, float pixel_size, Alignment align, float x, float y, Vec4 color, bool border ) {
+	if( layout.font == NULL )
+		return;
+
+	Vec2 pos = AlignText( layout.font, pixel_size, TextBounds( layout, pixel_size ), align, x, y );
+	DrawText( layout, pixel_size, pos.x, pos.y, color, border );
 }
 
 void DrawText( const Font * font, float pixel_size, const char * str, Alignment align, float x, float y, Vec4 color, bool border ) {
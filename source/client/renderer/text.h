@@ -28,3 +28,33 @@ void DrawText( const Font * font, float pixel_size,
 	const char * str,
 	Alignment align, float x, float y,
 	Vec4 color, Vec4 border_color );
+
+/*
+ * a string laid out once, for text that gets drawn every frame for a while
+ * and shouldn't have to go through the shared layout cache. layouts are in
+ * font units so they stay valid across resolution and size changes, but
+ * they belong to one font
+ */
+struct GlyphQuad {
+	MinMax2 bounds;
+	MinMax2 uv_bounds;
+};
+
+struct TextLayout {
+	const Font * font;
+	MinMax2 bounds;
+	u32 num_quads;
+	GlyphQuad quads[ 64 ];
+};
+
+// returns false if the string has too many glyphs
+bool LayOutText( TextLayout * layout, const Font * font, const char * str );
+
+MinMax2 TextBounds( const TextLayout & layout, float pixel_size );
+
+void DrawText( const TextLayout & layout, float pixel_size,
+	float x, float y,
+	Vec4 color, bool border = false );
+void DrawText( const TextLayout & layout, float pixel_size,
+	Alignment align, float x, float y,
+	Vec4 color, bool border = false );
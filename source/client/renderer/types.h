@@ -20,12 +20,79 @@ enum IndexFormat : u8 {
 	IndexFormat_U32,
 };
 
+/*
+ * every uniform block and sampler the shaders use gets a fixed slot, so
+ * pipelines can store their bindings by slot and shaders work out which slot
+ * each of their bindings reads when they get linked, instead of matching
+ * names on every draw call. new names in the GLSL need adding here and to
+ * the names in backend.cpp
+ */
+enum UniformSlot : u8 {
+	UniformSlot_View,
+	UniformSlot_Model,
+	UniformSlot_Material,
+	UniformSlot_Fog,
+	UniformSlot_Pose,
+	UniformSlot_Time,
+	UniformSlot_Outline,
+	UniformSlot_Text,
+	UniformSlot_PostProcess,
+	UniformSlot_ShadowMaps,
+	UniformSlot_BlueNoiseTextureParams,
+	UniformSlot_ParticleUpdate,
+	UniformSlot_Instances,
+	UniformSlot_InstanceMaterials,
+	UniformSlot_DynamicLight,
+	UniformSlot_Decal,
+
+	UniformSlot_Count,
+	UniformSlot_None = U8_MAX,
+};
+
+enum TextureSlot : u8 {
+	TextureSlot_BaseTexture,
+	TextureSlot_BlueNoiseTexture,
+	TextureSlot_DepthTexture,
+	TextureSlot_Noise,
+	TextureSlot_Screen,
+	TextureSlot_SilhouetteTexture,
+	TextureSlot_SilhouetteOutlineTexture,
+	TextureSlot_SilhouetteDepthTexture,
+
+	TextureSlot_Count,
+	TextureSlot_None = U8_MAX,
+};
+
+enum TextureBufferSlot : u8 {
+	TextureBufferSlot_NodeBuffer,
+	TextureBufferSlot_LeafBuffer,
+	TextureBufferSlot_BrushBuffer,
+	TextureBufferSlot_PlaneBuffer,
+	TextureBufferSlot_DecalTiles,
+	TextureBufferSlot_DecalData,
+	TextureBufferSlot_DynamicLightTiles,
+	TextureBufferSlot_DynamicLightData,
+	TextureBufferSlot_DynamicCount,
+
+	TextureBufferSlot_Count,
+	TextureBufferSlot_None = U8_MAX,
+};
+
+enum TextureArraySlot : u8 {
+	TextureArraySlot_DecalAtlases,
+	TextureArraySlot_ShadowmapTextureArray,
+
+	TextureArraySlot_Count,
+	TextureArraySlot_None = U8_MAX,
+};
+
+// indexed by binding point, _None for unused ones
 struct Shader {
 	u32 program;
-	u64 uniforms[ 8 ];
-	u64 textures[ 4 ];
-	u64 texture_buffers[ 8 ];
-	u64 texture_arrays[ 2 ];
+	UniformSlot uniforms[ 8 ];
+	TextureSlot textures[ 4 ];
+	TextureBufferSlot texture_buffers[ 8 ];
+	TextureArraySlot texture_arrays[ 2 ];
 };
 
 struct VertexBuffer {
@@ -95,6 +162,9 @@ struct TRS {
 struct MatrixPalettes {
 	Span< Mat4 > node_transforms;
 	Span< Mat4 > skinning_matrices;
+
+	// uploaded once by ComputeMatrixPalettes and shared by every pass
+	UniformBlock skinning_uniforms;
 };
 
 struct Font;
@@ -41,6 +41,8 @@ const char * const svc_strings[256] = {
 	"svc_servercs", // reliable command as unreliable for demos
 	"svc_frame",
 	"svc_demoinfo",
+	"svc_configstrings",
+	"svc_events",
 };
 
 void _SHOWNET( msg_t *msg, const char *s, int shownet ) {
@@ -71,13 +73,53 @@ static void SNAP_ParsePlayerstate( msg_t *msg, const SyncPlayerState *oldstate,
 	MSG_ReadDeltaPlayerState( msg, oldstate, state );
 }
 
+/*
+* Parsed entities live in a ring shared by every snapshot, and entities that
+* didn't change point at the state from the frame they were delta'd from
+* instead of being copied. Every snapshot in the backup, plus the copies
+* cgame keeps, must still be able to reach its states. States older than
+* ENTITY_RING_MAX_AGE get copied to the head before the ring can wrap over
+* them. Each frame writes at most MAX_PARSE_ENTITIES states, so the
+* remaining space covers that many frames.
+*/
+
+#define ENTITY_RING_FRAMES ( UPDATE_BACKUP + 2 )
+#define ENTITY_RING_SIZE ( ENTITY_RING_FRAMES * MAX_PARSE_ENTITIES * 3 / 2 )
+#define ENTITY_RING_MAX_AGE ( ENTITY_RING_SIZE - ENTITY_RING_FRAMES * MAX_PARSE_ENTITIES )
+
+static SyncEntityState entity_ring[ ENTITY_RING_SIZE ];
+static size_t entity_ring_head;
+
+static SyncEntityState * SNAP_AllocEntityState() {
+	SyncEntityState * state = &entity_ring[ entity_ring_head ];
+	entity_ring_head = ( entity_ring_head + 1 ) % ENTITY_RING_SIZE;
+	return state;
+}
+
+/*
+* SNAP_AddUnchangedEntity
+*/
+static void SNAP_AddUnchangedEntity( snapshot_t *frame, const SyncEntityState *old ) {
+	size_t idx = old - entity_ring;
+	size_t age = ( entity_ring_head + ENTITY_RING_SIZE - idx ) % ENTITY_RING_SIZE;
+	if( age > ENTITY_RING_MAX_AGE ) {
+		SyncEntityState * state = SNAP_AllocEntityState();
+		*state = *old;
+		old = state;
+	}
+
+	frame->parsedEntities[frame->numEntities & ( MAX_PARSE_ENTITIES - 1 )] = old;
+	frame->numEntities++;
+}
+
 /*
 * SNAP_ParseDeltaEntity
 *
 * Parses deltas from the given base and adds the resulting entity to the current frame
 */
-static void SNAP_ParseDeltaEntity( msg_t *msg, snapshot_t *frame, int newnum, SyncEntityState *old ) {
-	SyncEntityState * state = &frame->parsedEntities[frame->numEntities & ( MAX_PARSE_ENTITIES - 1 )];
+static void SNAP_ParseDeltaEntity( msg_t *msg, snapshot_t *frame, int newnum, const SyncEntityState *old ) {
+	SyncEntityState * state = SNAP_AllocEntityState();
+	frame->parsedEntities[frame->numEntities & ( MAX_PARSE_ENTITIES - 1 )] = state;
 	frame->numEntities++;
 	MSG_ReadDeltaEntity( msg, old, state );
 	state->number = newnum;
@@ -90,6 +132,9 @@ void SNAP_ParseBaseline( msg_t *msg, SyncEntityState *baselines ) {
 	bool remove;
 	int newnum = MSG_ReadEntityNumber( msg, &remove );
 	assert( !remove );
+	if( newnum >= MAX_BASELINES ) {
+		Com_Error( "SNAP_ParseBaseline: bad number:%i", newnum );
+	}
 
 	if( !remove ) {
 		SyncEntityState nullstate = { };
@@ -107,7 +152,7 @@ void SNAP_ParseBaseline( msg_t *msg, SyncEntityState *baselines ) {
 static void SNAP_ParsePacketEntities( msg_t *msg, snapshot_t *oldframe, snapshot_t *newframe, SyncEntityState *baselines, int shownet ) {
 	int newnum;
 	bool remove;
-	SyncEntityState *oldstate = NULL;
+	const SyncEntityState *oldstate = NULL;
 	int oldindex, oldnum;
 
 	newframe->numEntities = 0;
@@ -119,7 +164,7 @@ static void SNAP_ParsePacketEntities( msg_t *msg, snapshot_t *oldframe, snapshot
 	} else if( oldindex >= oldframe->numEntities ) {
 		oldnum = 99999;
 	} else {
-		oldstate = &oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
+		oldstate = oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
 		oldnum = oldstate->number;
 	}
 
@@ -142,22 +187,31 @@ static void SNAP_ParsePacketEntities( msg_t *msg, snapshot_t *oldframe, snapshot
 				Com_Printf( "   unchanged: %i\n", oldnum );
 			}
 
-			newframe->parsedEntities[newframe->numEntities & ( MAX_PARSE_ENTITIES - 1 )] = *oldstate;
-			newframe->numEntities++;
+			SNAP_AddUnchangedEntity( newframe, oldstate );
 
 			oldindex++;
 			if( oldindex >= oldframe->numEntities ) {
 				oldnum = 99999;
 			} else {
-				oldstate = &oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
+				oldstate = oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
 				oldnum = oldstate->number;
 			}
 		}
 
 		// delta from baseline
 		if( oldnum > newnum ) {
+			// the remove bit on a new entity means it uses a class baseline
 			if( remove ) {
-				Com_Printf( "U_REMOVE: oldnum > newnum (can't remove from baseline!)\n" );
+				u64 class_baseline = MSG_ReadUintBase128( msg );
+				if( class_baseline >= MAX_CLASS_BASELINES ) {
+					Com_Error( "CL_ParsePacketEntities: bad class baseline:%i", int( class_baseline ) );
+				}
+
+				if( shownet == 3 ) {
+					Com_Printf( "   class baseline: %i %i\n", newnum, int( class_baseline ) );
+				}
+
+				SNAP_ParseDeltaEntity( msg, newframe, newnum, &baselines[MAX_EDICTS + class_baseline] );
 				continue;
 			}
 
@@ -185,7 +239,7 @@ static void SNAP_ParsePacketEntities( msg_t *msg, snapshot_t *oldframe, snapshot
 				if( oldindex >= oldframe->numEntities ) {
 					oldnum = 99999;
 				} else {
-					oldstate = &oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
+					oldstate = oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
 					oldnum = oldstate->number;
 				}
 				continue;
@@ -202,7 +256,7 @@ static void SNAP_ParsePacketEntities( msg_t *msg, snapshot_t *oldframe, snapshot
 			if( oldindex >= oldframe->numEntities ) {
 				oldnum = 99999;
 			} else {
-				oldstate = &oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
+				oldstate = oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
 				oldnum = oldstate->number;
 			}
 			continue;
@@ -216,14 +270,13 @@ static void SNAP_ParsePacketEntities( msg_t *msg, snapshot_t *oldframe, snapshot
 			Com_Printf( "   unchanged: %i\n", oldnum );
 		}
 
-		newframe->parsedEntities[newframe->numEntities & ( MAX_PARSE_ENTITIES - 1 )] = *oldstate;
-		newframe->numEntities++;
+		SNAP_AddUnchangedEntity( newframe, oldstate );
 
 		oldindex++;
 		if( oldindex >= oldframe->numEntities ) {
 			oldnum = 99999;
 		} else {
-			oldstate = &oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
+			oldstate = oldframe->parsedEntities[oldindex & ( MAX_PARSE_ENTITIES - 1 )];
 			oldnum = oldstate->number;
 		}
 	}
@@ -390,5 +443,24 @@ snapshot_t *SNAP_ParseFrame( msg_t *msg, snapshot_t *lastFrame, snapshot_t *back
 	}
 	SNAP_ParsePacketEntities( msg, deltaframe, newframe, baselines, showNet );
 
+	// read events
+	cmd = MSG_ReadUint8( msg );
+	_SHOWNET( msg, svc_strings[cmd], showNet );
+	if( cmd != svc_events ) {
+		Com_Error( "SNAP_ParseFrame: not events" );
+	}
+
+	u64 num_events = MSG_ReadUintBase128( msg );
+	if( num_events > ARRAY_COUNT( newframe->events ) ) {
+		Com_Error( "SNAP_ParseFrame: too many events" );
+	}
+
+	SyncSnapEvent baseline = { };
+	for( u64 i = 0; i < num_events; i++ ) {
+		MSG_ReadDeltaSnapEvent( msg, &baseline, &newframe->events[ i ] );
+		baseline = newframe->events[ i ];
+	}
+	newframe->numEvents = num_events;
+
 	return newframe;
 }
@@ -8,13 +8,14 @@ struct ImmediateSoundHandle {
 
 extern cvar_t * s_device;
 
+void S_StartDecodingSounds();
 bool S_Init();
 void S_Shutdown();
 
 const char * GetAudioDevicesAsSequentialStrings();
 
 void S_Update( Vec3 origin, Vec3 velocity, const mat3_t axis );
-void S_UpdateEntity( int ent_num, Vec3 origin, Vec3 velocity );
+void S_UpdateEntities( Span< const int > ent_nums, Span< const Vec3 > origins, Span< const Vec3 > velocities );
 
 void S_StartFixedSound( StringHash name, Vec3 origin, int channel, float volume );
 void S_StartEntitySound( StringHash name, int ent_num, int channel, float volume );
@@ -0,0 +1,251 @@
+#include <algorithm>
+
+#include "qcommon/base.h"
+#include "qcommon/fs.h"
+#include "qcommon/string.h"
+#include "client/client.h"
+#include "client/timedemo.h"
+#include "client/renderer/renderer.h"
+
+/*
+ * plays a demo with a fixed step and no frame cap, timing every frame from
+ * the moment the demo goes active until it ends. each frame is split into
+ * cgame (SCR_UpdateScreen, which runs cgame and records the draw calls),
+ * submit (RendererSubmitFrame) and other (everything else, like reading
+ * the demo, input and SwapBuffers)
+ *
+ * GPU times only come back FRAMES_IN_FLIGHT frames later, so they get
+ * matched up with their frame by frame number and the last few frames
+ * don't have one
+ *
+ * it prints avg/p1/p50/p99/max for each column and writes every frame to
+ * <home>/timedemos/<date>.csv
+ */
+
+struct TimedemoSample {
+	s64 gametime;
+	float frame_ms;
+	float phase_ms[ TimedemoPhase_Count ];
+	float other_ms;
+	float gpu_ms; // negative if we didn't get one
+};
+
+static struct {
+	bool running;
+	bool recording;
+	u32 fps;
+	char * demo;
+
+	u64 frames_started;
+	u64 first_frame;
+	u64 last_frame_ns;
+	u64 marks[ TimedemoPhase_Count ];
+
+	NonRAIIDynamicArray< TimedemoSample > samples;
+} timedemo;
+
+static cvar_t * cl_timedemo_fps;
+
+static float NsToMs( u64 ns ) {
+	return ns / 1000000.0f;
+}
+
+static void PrintColumn( const char * name, Span< float > ms ) {
+	if( ms.n == 0 ) {
+		Com_Printf( "%-8s %8s\n", name, "none" );
+		return;
+	}
+
+	float total = 0.0f;
+	for( float x : ms ) {
+		total += x;
+	}
+
+	std::sort( ms.begin(), ms.end() );
+	auto percentile = [&]( float p ) {
+		return ms[ Min2( size_t( p * ms.n ), ms.n - 1 ) ];
+	};
+
+	Com_Printf( "%-8s %8.3f %8.3f %8.3f %8.3f %8.3f\n", name, total / ms.n, percentile( 0.01f ), percentile( 0.5f ), percentile( 0.99f ), ms[ ms.n - 1 ] );
+}
+
+static void WriteCSV() {
+	TempAllocator temp = cls.frame_arena.temp();
+
+	char date[ 256 ];
+	Sys_FormatTime( date, sizeof( date ), "%y%m%d_%H%M%S" );
+	const char * path = temp( "{}/timedemos/{}.csv", HomeDirPath(), date );
+
+	DynamicString csv( sys_allocator, "frame,gametime,frame_ms,other_ms,cgame_ms,submit_ms,gpu_ms\n" );
+	for( size_t i = 0; i < timedemo.samples.size(); i++ ) {
+		const TimedemoSample & sample = timedemo.samples[ i ];
+		csv.append( "{},{},{.3},{.3},{.3},{.3},", i, sample.gametime, sample.frame_ms, sample.other_ms,
+			sample.phase_ms[ TimedemoPhase_CGame ], sample.phase_ms[ TimedemoPhase_Submit ] );
+		if( sample.gpu_ms >= 0.0f ) {
+			csv.append( "{.3}", sample.gpu_ms );
+		}
+		csv += "\n";
+	}
+
+	if( !WriteFile( &temp, path, csv.c_str(), csv.length() ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write %s\n", path );
+		return;
+	}
+
+	Com_Printf( "Wrote %s\n", path );
+}
+
+static float SampleColumn( const TimedemoSample & sample, size_t column ) {
+	switch( column ) {
+		case 0: return sample.frame_ms;
+		case 1: return sample.other_ms;
+		case 2: return sample.phase_ms[ TimedemoPhase_CGame ];
+		case 3: return sample.phase_ms[ TimedemoPhase_Submit ];
+		default: return sample.gpu_ms;
+	}
+}
+
+static void PrintReport() {
+	size_t n = timedemo.samples.size();
+	if( n == 0 ) {
+		Com_Printf( "timedemo: %s didn't draw any frames\n", timedemo.demo );
+		return;
+	}
+
+	float total_ms = 0.0f;
+	for( const TimedemoSample & sample : timedemo.samples ) {
+		total_ms += sample.frame_ms;
+	}
+
+	Com_Printf( "timedemo: %s, %zu frames in %.2fs, %.1f fps, stepping %u fps\n", timedemo.demo, n, total_ms / 1000.0f, n * 1000.0f / total_ms, timedemo.fps );
+	Com_Printf( "%-8s %8s %8s %8s %8s %8s\n", "ms", "avg", "p1", "p50", "p99", "max" );
+
+	Span< float > column = ALLOC_SPAN( sys_allocator, float, n );
+	defer { FREE( sys_allocator, column.ptr ); };
+
+	const char * names[] = { "frame", "other", "cgame", "submit", "gpu" };
+	for( size_t i = 0; i < ARRAY_COUNT( names ); i++ ) {
+		size_t m = 0;
+		for( const TimedemoSample & sample : timedemo.samples ) {
+			float ms = SampleColumn( sample, i );
+			if( ms >= 0.0f ) {
+				column[ m++ ] = ms;
+			}
+		}
+		PrintColumn( names[ i ], column.slice( 0, m ) );
+	}
+
+	WriteCSV();
+}
+
+static void StopTimedemo() {
+	PrintReport();
+
+	timedemo.samples.shutdown();
+	FREE( sys_allocator, timedemo.demo );
+	timedemo.demo = NULL;
+	timedemo.running = false;
+}
+
+static void Timedemo_f() {
+	if( timedemo.running ) {
+		StopTimedemo();
+		if( Cmd_Argc() < 2 ) {
+			return;
+		}
+	}
+
+	if( Cmd_Argc() < 2 ) {
+		Com_Printf( "Usage: %s <demoname>, run it again to stop early\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	char * demo = CopyString( sys_allocator, Cmd_Argv( 1 ) );
+
+	CL_StartDemo( demo, false );
+	if( !cls.demo.playing ) {
+		FREE( sys_allocator, demo );
+		return;
+	}
+
+	if( Cvar_Integer( "vid_vsync" ) != 0 ) {
+		Com_Printf( S_COLOR_YELLOW "vid_vsync is on so the frame times will be capped at the refresh rate\n" );
+	}
+
+	timedemo.running = true;
+	timedemo.recording = false;
+	timedemo.fps = u32( Clamp( 1, cl_timedemo_fps->integer, 1000 ) );
+	timedemo.demo = demo;
+	timedemo.frames_started = 0;
+	timedemo.samples.init( sys_allocator );
+}
+
+void InitTimedemo() {
+	cl_timedemo_fps = Cvar_Get( "cl_timedemo_fps", "60", CVAR_ARCHIVE );
+
+	Cmd_AddCommand( "timedemo", Timedemo_f );
+}
+
+void ShutdownTimedemo() {
+	if( timedemo.running ) {
+		StopTimedemo();
+	}
+
+	Cmd_RemoveCommand( "timedemo" );
+}
+
+bool TimedemoRunning() {
+	return timedemo.running;
+}
+
+// same as DemoVideoFrameMsec
+int TimedemoFrameMsec() {
+	u64 n = timedemo.frames_started;
+	return int( ( n + 1 ) * 1000 / timedemo.fps - n * 1000 / timedemo.fps );
+}
+
+void TimedemoMark( TimedemoPhase phase ) {
+	if( timedemo.running ) {
+		timedemo.marks[ phase ] = Sys_Nanoseconds();
+	}
+}
+
+void TimedemoFrame() {
+	if( !timedemo.running )
+		return;
+
+	if( !cls.demo.playing ) {
+		StopTimedemo();
+		return;
+	}
+
+	u64 now = Sys_Nanoseconds();
+	timedemo.frames_started++;
+
+	if( cls.state != CA_ACTIVE )
+		return;
+
+	// the first active frame still has loading in it
+	if( !timedemo.recording ) {
+		timedemo.recording = true;
+		timedemo.first_frame = FrameNumber();
+		timedemo.last_frame_ns = now;
+		return;
+	}
+
+	TimedemoSample sample;
+	sample.gametime = cls.gametime;
+	sample.frame_ms = NsToMs( now - timedemo.last_frame_ns );
+	sample.other_ms = NsToMs( timedemo.marks[ TimedemoPhase_CGame ] - timedemo.last_frame_ns );
+	sample.phase_ms[ TimedemoPhase_CGame ] = NsToMs( timedemo.marks[ TimedemoPhase_Submit ] - timedemo.marks[ TimedemoPhase_CGame ] );
+	sample.phase_ms[ TimedemoPhase_Submit ] = NsToMs( now - timedemo.marks[ TimedemoPhase_Submit ] );
+	sample.gpu_ms = -1.0f;
+	timedemo.samples.add( sample );
+
+	GPUFrameFinish finish = LastGPUFrameFinish();
+	if( finish.finished_ns != 0 && finish.frame >= timedemo.first_frame && finish.frame - timedemo.first_frame < timedemo.samples.size() ) {
+		timedemo.samples[ finish.frame - timedemo.first_frame ].gpu_ms = GPUFrameTime();
+	}
+
+	timedemo.last_frame_ns = now;
+}
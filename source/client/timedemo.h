@@ -0,0 +1,24 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+void InitTimedemo();
+void ShutdownTimedemo();
+
+/*
+ * timedemo plays a demo as fast as it can draw, advancing it by a fixed step
+ * every frame like demovideo, so runs on the same demo do the same work
+ */
+bool TimedemoRunning();
+int TimedemoFrameMsec();
+
+enum TimedemoPhase {
+	TimedemoPhase_CGame,
+	TimedemoPhase_Submit,
+
+	TimedemoPhase_Count
+};
+
+// call at the start of each phase, and TimedemoFrame once the frame has been submitted
+void TimedemoMark( TimedemoPhase phase );
+void TimedemoFrame();
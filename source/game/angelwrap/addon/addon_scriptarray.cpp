@@ -535,16 +535,23 @@ void CScriptArray::Resize( int delta, asUINT at ) {
 	}
 
 	if( buffer->maxElements < buffer->numElements + delta ) {
+		// grow geometrically so scripts calling insertLast in a loop don't
+		// reallocate and copy the whole array every time
+		asUINT capacity = buffer->numElements + delta;
+		if( u64( buffer->maxElements ) * 2 * elementSize <= 0x7FFFFFFF ) {
+			capacity = Max2( capacity, buffer->maxElements * 2 );
+		}
+
 		// Allocate memory for the buffer
 		SArrayBuffer *newBuffer;
 		#if defined( __S3E__ ) // Marmalade doesn't understand (nothrow)
-		newBuffer = (SArrayBuffer*)QAS_NEWARRAY( asBYTE, sizeof( SArrayBuffer ) - 1 + elementSize * ( buffer->numElements + delta ) );
+		newBuffer = (SArrayBuffer*)QAS_NEWARRAY( asBYTE, sizeof( SArrayBuffer ) - 1 + elementSize * capacity );
 		#else
-		newBuffer = (SArrayBuffer*)QAS_NEWARRAY( asBYTE, sizeof( SArrayBuffer ) - 1 + elementSize * ( buffer->numElements + delta ) );
+		newBuffer = (SArrayBuffer*)QAS_NEWARRAY( asBYTE, sizeof( SArrayBuffer ) - 1 + elementSize * capacity );
 		#endif
 		if( newBuffer ) {
 			newBuffer->numElements = buffer->numElements + delta;
-			newBuffer->maxElements = newBuffer->numElements;
+			newBuffer->maxElements = capacity;
 		} else {
 			// Out of memory
 			asIScriptContext *ctx = asGetActiveContext();
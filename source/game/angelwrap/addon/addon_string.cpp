@@ -27,29 +27,90 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define CONST_STRING_BITFLAG    ( 1 << 31 )
 #define ENABLE_STRING_IMPLICIT_CASTS
 
+/*
+* string pool
+*
+* scripts churn through a lot of short lived strings (every concatenation and
+* every cvar read makes one), so released objects go on a free list instead of
+* back to the heap, and anything that fits in inline_buffer never touches the
+* heap at all. heap buffers grow geometrically so repeated += is amortised
+*/
+
+#define MAX_FREE_STRINGS 1024
+
+static asstring_t *free_strings;
+static unsigned int num_free_strings;
+
+static inline bool objectString_IsInline( const asstring_t *object ) {
+	return object->buffer == object->inline_buffer;
+}
+
 static inline asstring_t *objectString_Alloc() {
-	static asstring_t *object;
+	asstring_t *object = free_strings;
+	if( object != NULL ) {
+		free_strings = ( asstring_t * )object->buffer;
+		num_free_strings--;
+	} else {
+		object = new asstring_t;
+	}
 
-	object = new asstring_t;
 	object->asRefCount = 1;
+	object->buffer = object->inline_buffer;
+	object->size = sizeof( object->inline_buffer );
+	object->len = 0;
+	object->buffer[0] = '\0';
 	return object;
 }
 
+static inline void objectString_Free( asstring_t *object ) {
+	if( !objectString_IsInline( object ) ) {
+		delete[] object->buffer;
+	}
+
+	if( num_free_strings == MAX_FREE_STRINGS ) {
+		delete object;
+		return;
+	}
+
+	object->buffer = ( char * )free_strings;
+	free_strings = object;
+	num_free_strings++;
+}
+
+/*
+* objectString_Reserve
+*
+* makes room for size bytes, including the terminator. only for fresh
+* objects, the old contents are not kept
+*/
+static void objectString_Reserve( asstring_t *self, unsigned int size ) {
+	if( size <= self->size ) {
+		return;
+	}
+
+	unsigned int capacity = Max2( self->size * 2, size ) & ~CONST_STRING_BITFLAG;
+	char *buffer = new char[capacity];
+	buffer[0] = '\0';
+
+	if( !objectString_IsInline( self ) ) {
+		delete[] self->buffer;
+	}
+
+	self->buffer = buffer;
+	self->size = capacity;
+}
+
 asstring_t *objectString_FactoryBuffer( const char *buffer, unsigned int length ) {
 	asstring_t *object;
 	unsigned int size = ( length + 1 ) & ~CONST_STRING_BITFLAG;
 
 	length = size - 1;
 	object = objectString_Alloc();
-	object->buffer = new char[size];
-	object->len = length;
-	object->size = size;
+	objectString_Reserve( object, size );
 	if( buffer ) {
 		memcpy( object->buffer, buffer, length );
 		object->buffer[length] = '\0';
-	} else {
-		object->len = 0;
-		object->buffer[0] = '\0';
+		object->len = length;
 	}
 	return object;
 }
@@ -59,6 +120,10 @@ const asstring_t *objectString_ConstFactoryBuffer( const char *buffer, unsigned
 	uint8_t *rawmem;
 	unsigned int size = ( length + 1 ) & ~CONST_STRING_BITFLAG;
 
+	if( size <= ASSTRING_INLINE_SIZE ) {
+		return objectString_FactoryBuffer( buffer, length );
+	}
+
 	length = size - 1;
 	rawmem = new uint8_t[sizeof( asstring_t ) + size];
 	object = ( asstring_t * )rawmem;
@@ -73,19 +138,23 @@ const asstring_t *objectString_ConstFactoryBuffer( const char *buffer, unsigned
 }
 
 asstring_t *objectString_AssignString( asstring_t *self, const char *string, size_t strlen_ ) {
-	unsigned int size;
-
-	if( strlen_ >= self->size ) {
-		delete[] self->buffer;
-
-		size = ( strlen_ + 1 ) & ~CONST_STRING_BITFLAG;
+	unsigned int size = ( strlen_ + 1 ) & ~CONST_STRING_BITFLAG;
+
+	strlen_ = size - 1;
+	if( size > self->size ) {
+		// string may point into our own buffer, so copy before freeing it
+		char *buffer = new char[size];
+		memcpy( buffer, string, strlen_ );
+		if( !objectString_IsInline( self ) ) {
+			delete[] self->buffer;
+		}
+		self->buffer = buffer;
 		self->size = size;
-		self->buffer = new char[size];
-		strlen_ = size - 1;
+	} else {
+		memmove( self->buffer, string, strlen_ );
 	}
 
 	self->len = strlen_;
-	memcpy( self->buffer, string, strlen_ );
 	self->buffer[strlen_] = '\0';
 
 	return self;
@@ -104,18 +173,34 @@ static asstring_t *objectString_AssignPattern( asstring_t *self, const char *pat
 
 static asstring_t *objectString_AddAssignString( asstring_t *self, const char *string, size_t strlen_ ) {
 	if( strlen_ ) {
-		char *tem = self->buffer;
-		unsigned int length = strlen_ + self->len;
-		unsigned int size = ( length + 1 ) & ~CONST_STRING_BITFLAG;
+		unsigned int length = ( ( strlen_ + self->len + 1 ) & ~CONST_STRING_BITFLAG ) - 1;
+		unsigned int old_len = self->len;
+		const char *src = string;
+
+		// appending ourselves to ourselves: remember where the source sits
+		// relative to the buffer in case Reserve moves it
+		bool aliased = string >= self->buffer && string < self->buffer + self->size;
+		size_t offset = aliased ? string - self->buffer : 0;
+
+		char *old_buffer = self->buffer;
+		bool was_inline = objectString_IsInline( self );
+		if( length + 1 > self->size ) {
+			unsigned int capacity = Max2( self->size * 2, length + 1 ) & ~CONST_STRING_BITFLAG;
+			self->buffer = new char[capacity];
+			self->size = capacity;
+			memcpy( self->buffer, old_buffer, old_len );
+			if( aliased ) {
+				src = self->buffer + offset;
+			}
+		}
 
-		length = size - 1;
+		memmove( self->buffer + old_len, src, length - old_len );
+		self->buffer[length] = '\0';
 		self->len = length;
-		self->size = size;
-		self->buffer = new char[size];
 
-		snprintf( self->buffer, size, "%s%s", tem, string );
-
-		delete[] tem;
+		if( old_buffer != self->buffer && !was_inline ) {
+			delete[] old_buffer;
+		}
 	}
 
 	return self;
@@ -134,9 +219,12 @@ static asstring_t *objectString_AddAssignPattern( asstring_t *self, const char *
 
 static asstring_t *objectString_AddString( asstring_t *first, const char *second, size_t seclen ) {
 	asstring_t *self = objectString_FactoryBuffer( NULL, first->len + seclen );
+	unsigned int length = ( ( first->len + seclen + 1 ) & ~CONST_STRING_BITFLAG ) - 1;
 
-	snprintf( self->buffer, self->size, "%s%s", first->buffer, second );
-	self->len = self->size - 1;
+	memcpy( self->buffer, first->buffer, first->len );
+	memcpy( self->buffer + first->len, second, length - first->len );
+	self->buffer[length] = '\0';
+	self->len = length;
 	return self;
 }
 
@@ -184,8 +272,7 @@ void objectString_Release( asstring_t *obj ) {
 
 	if( !obj->asRefCount ) {
 		if( ( obj->size & CONST_STRING_BITFLAG ) == 0 ) {
-			delete[] obj->buffer;
-			delete obj;
+			objectString_Free( obj );
 		} else {
 			uint8_t *rawmem = ( uint8_t * )obj;
 			delete[] rawmem;
@@ -25,10 +25,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "addon/addon_vec3.h"
 #include "addon/addon_cvar.h"
 #include "qcommon/fs.h"
+#include "qcommon/hash.h"
 #include "qcommon/string.h"
 
-#include <list>
-#include <map>
 
 static void *qasAlloc( size_t size ) {
 	return G_Malloc( size );
@@ -40,13 +39,46 @@ static void qasFree( void *mem ) {
 
 // ============================================================================
 
-// list of contexts in the same engine
-typedef std::list<asIScriptContext *> qasContextList;
+/*
+ * contexts are pooled per engine. a context can be reused as soon as it's
+ * not running, including after a failed run, so scripts calling back into the
+ * game only ever need as many contexts as calls are nested
+ */
+
+#define MAX_CONTEXT_POOLS 4
+#define MAX_POOLED_CONTEXTS 32
+
+struct ContextPool {
+	asIScriptEngine * engine;
+	asIScriptContext * contexts[ MAX_POOLED_CONTEXTS ];
+	size_t num_contexts;
+};
+
+static ContextPool context_pools[ MAX_CONTEXT_POOLS ];
+
+static ContextPool * FindContextPool( asIScriptEngine * engine ) {
+	for( ContextPool & pool : context_pools ) {
+		if( pool.engine == engine ) {
+			return &pool;
+		}
+	}
+
+	return NULL;
+}
 
-// engine -> contexts key/value pairs
-typedef std::map<asIScriptEngine *, qasContextList> qasEngineContextMap;
+static ContextPool * AddContextPool( asIScriptEngine * engine ) {
+	ContextPool * pool = FindContextPool( NULL );
+	if( pool != NULL ) {
+		pool->engine = engine;
+		pool->num_contexts = 0;
+	}
+	return pool;
+}
 
-qasEngineContextMap contexts;
+static bool ContextIsIdle( const asIScriptContext * ctx ) {
+	asEContextState state = ctx->GetState();
+	return state != asEXECUTION_ACTIVE && state != asEXECUTION_SUSPENDED && state != asEXECUTION_PREPARED;
+}
 
 // ============================================================================
 
@@ -132,16 +164,13 @@ void qasReleaseEngine( asIScriptEngine *engine ) {
 	}
 
 	// release all contexts linked to this engine
-	qasContextList &ctxList = contexts[engine];
-	for( qasContextList::iterator it = ctxList.begin(); it != ctxList.end(); it++ ) {
-		asIScriptContext *ctx = *it;
-		ctx->Release();
-	}
-	ctxList.clear();
-
-	qasEngineContextMap::iterator it = contexts.find( engine );
-	if( it != contexts.end() ) {
-		contexts.erase( it );
+	ContextPool * pool = FindContextPool( engine );
+	if( pool != NULL ) {
+		for( size_t i = 0; i < pool->num_contexts; i++ ) {
+			pool->contexts[ i ]->Release();
+		}
+		pool->engine = NULL;
+		pool->num_contexts = 0;
 	}
 
 	engine->Release();
@@ -155,6 +184,14 @@ static asIScriptContext *qasCreateContext( asIScriptEngine *engine ) {
 		return NULL;
 	}
 
+	ContextPool * pool = FindContextPool( engine );
+	if( pool == NULL ) {
+		pool = AddContextPool( engine );
+	}
+	if( pool == NULL || pool->num_contexts == ARRAY_COUNT( pool->contexts ) ) {
+		Fatal( "qasCreateContext: too many nested script calls" );
+	}
+
 	// always new
 	ctx = engine->CreateContext();
 	if( !ctx ) {
@@ -173,8 +210,8 @@ static asIScriptContext *qasCreateContext( asIScriptEngine *engine ) {
 		return NULL;
 	}
 
-	qasContextList &ctxList = contexts[engine];
-	ctxList.push_back( ctx );
+	pool->contexts[ pool->num_contexts ] = ctx;
+	pool->num_contexts++;
 
 	return ctx;
 }
@@ -184,9 +221,16 @@ void qasReleaseContext( asIScriptContext *ctx ) {
 		return;
 	}
 
-	asIScriptEngine *engine = ctx->GetEngine();
-	qasContextList &ctxList = contexts[engine];
-	ctxList.remove( ctx );
+	ContextPool * pool = FindContextPool( ctx->GetEngine() );
+	if( pool != NULL ) {
+		for( size_t i = 0; i < pool->num_contexts; i++ ) {
+			if( pool->contexts[ i ] == ctx ) {
+				pool->num_contexts--;
+				Swap2( &pool->contexts[ i ], &pool->contexts[ pool->num_contexts ] );
+				break;
+			}
+		}
+	}
 
 	ctx->Release();
 }
@@ -197,11 +241,12 @@ asIScriptContext *qasAcquireContext( asIScriptEngine *engine ) {
 	}
 
 	// try to reuse any context linked to this engine
-	qasContextList &ctxList = contexts[engine];
-	for( qasContextList::iterator it = ctxList.begin(); it != ctxList.end(); it++ ) {
-		asIScriptContext *ctx = *it;
-		if( ctx->GetState() == asEXECUTION_FINISHED ) {
-			return ctx;
+	ContextPool * pool = FindContextPool( engine );
+	if( pool != NULL ) {
+		for( size_t i = 0; i < pool->num_contexts; i++ ) {
+			if( ContextIsIdle( pool->contexts[ i ] ) ) {
+				return pool->contexts[ i ];
+			}
 		}
 	}
 
@@ -217,7 +262,209 @@ asIScriptContext *qasGetActiveContext() {
 * Scripts
 **************************************/
 
+/*
+ * compiled scripts are cached in the homedir, keyed by a hash of the script
+ * sources, the angelscript version and everything the game registered with
+ * the engine. if any of those change, or the cache can't be loaded for any
+ * other reason, we fall back to compiling from source and rewrite the cache
+ */
+
+#define BYTECODE_CACHE_MAGIC U64( 0x3142435361436d62 )
+
+struct BytecodeCacheHeader {
+	u64 magic;
+	u64 key;
+	u64 size;
+	u64 hash;
+};
+
+class BytecodeWriter : public asIBinaryStream {
+public:
+	DynamicArray< u8 > buf;
+
+	BytecodeWriter() : buf( sys_allocator ) { }
+
+	void Read( void * ptr, asUINT size ) {
+		assert( false );
+	}
+
+	void Write( const void * ptr, asUINT size ) {
+		size_t old_size = buf.extend( size );
+		memcpy( buf.ptr() + old_size, ptr, size );
+	}
+};
+
+class BytecodeReader : public asIBinaryStream {
+public:
+	Span< const u8 > data;
+	size_t cursor;
+	bool overflowed;
+
+	BytecodeReader( Span< const u8 > data_ ) : data( data_ ), cursor( 0 ), overflowed( false ) { }
+
+	void Read( void * ptr, asUINT size ) {
+		if( size > data.n - cursor ) {
+			overflowed = true;
+			memset( ptr, 0, size );
+			return;
+		}
+
+		memcpy( ptr, data.ptr + cursor, size );
+		cursor += size;
+	}
+
+	void Write( const void * ptr, asUINT size ) {
+		assert( false );
+	}
+};
+
+static u64 HashString( const char * str, u64 hash ) {
+	if( str == NULL )
+		return Hash64( hash );
+	return Hash64( str, strlen( str ) + 1, hash );
+}
+
+static u64 HashFunctionDecl( const asIScriptFunction * func, u64 hash ) {
+	if( func == NULL )
+		return hash;
+	return HashString( func->GetDeclaration( true, true, true ), hash );
+}
+
+static u64 HashRegisteredInterface( const asIScriptEngine * engine ) {
+	ZoneScoped;
+
+	u64 hash = Hash64( ANGELSCRIPT_VERSION_STRING );
+
+	for( asUINT i = 0; i < engine->GetGlobalFunctionCount(); i++ ) {
+		hash = HashFunctionDecl( engine->GetGlobalFunctionByIndex( i ), hash );
+	}
+
+	for( asUINT i = 0; i < engine->GetGlobalPropertyCount(); i++ ) {
+		const char * name;
+		const char * ns;
+		int type_id;
+		bool is_const;
+		engine->GetGlobalPropertyByIndex( i, &name, &ns, &type_id, &is_const );
+		hash = HashString( ns, HashString( name, hash ) );
+		hash = HashString( engine->GetTypeDeclaration( type_id, true ), hash );
+		hash = Hash64( &is_const, sizeof( is_const ), hash );
+	}
+
+	for( asUINT i = 0; i < engine->GetObjectTypeCount(); i++ ) {
+		const asIObjectType * type = engine->GetObjectTypeByIndex( i );
+		hash = HashString( type->GetNamespace(), HashString( type->GetName(), hash ) );
+
+		asDWORD flags = type->GetFlags();
+		asUINT size = type->GetSize();
+		hash = Hash64( &flags, sizeof( flags ), hash );
+		hash = Hash64( &size, sizeof( size ), hash );
+
+		for( asUINT j = 0; j < type->GetPropertyCount(); j++ ) {
+			int offset;
+			type->GetProperty( j, NULL, NULL, NULL, &offset );
+			hash = HashString( type->GetPropertyDeclaration( j, true ), hash );
+			hash = Hash64( &offset, sizeof( offset ), hash );
+		}
+
+		for( asUINT j = 0; j < type->GetFactoryCount(); j++ ) {
+			hash = HashFunctionDecl( type->GetFactoryByIndex( j ), hash );
+		}
+
+		for( asUINT j = 0; j < type->GetMethodCount(); j++ ) {
+			hash = HashFunctionDecl( type->GetMethodByIndex( j ), hash );
+		}
+
+		for( asUINT j = 0; j < type->GetBehaviourCount(); j++ ) {
+			asEBehaviours behaviour;
+			hash = HashFunctionDecl( type->GetBehaviourByIndex( j, &behaviour ), hash );
+			hash = Hash64( &behaviour, sizeof( behaviour ), hash );
+		}
+	}
+
+	for( asUINT i = 0; i < engine->GetEnumCount(); i++ ) {
+		int type_id;
+		const char * ns;
+		hash = HashString( ns, HashString( engine->GetEnumByIndex( i, &type_id, &ns ), hash ) );
+		for( int j = 0; j < engine->GetEnumValueCount( type_id ); j++ ) {
+			int value;
+			hash = HashString( engine->GetEnumValueByIndex( type_id, j, &value ), hash );
+			hash = Hash64( &value, sizeof( value ), hash );
+		}
+	}
+
+	for( asUINT i = 0; i < engine->GetFuncdefCount(); i++ ) {
+		hash = HashFunctionDecl( engine->GetFuncdefByIndex( i ), hash );
+	}
+
+	return hash;
+}
+
+static bool LoadCachedBytecode( asIScriptModule * mod, const char * path, u64 key ) {
+	ZoneScoped;
+
+	Span< u8 > data = ReadFileBinary( sys_allocator, path );
+	defer { FREE( sys_allocator, data.ptr ); };
+	if( data.ptr == NULL || data.n < sizeof( BytecodeCacheHeader ) ) {
+		return false;
+	}
+
+	BytecodeCacheHeader header;
+	memcpy( &header, data.ptr, sizeof( header ) );
+	Span< const u8 > bytecode = data.slice( sizeof( header ), data.n );
+
+	if( header.magic != BYTECODE_CACHE_MAGIC || header.key != key || header.size != bytecode.n ) {
+		return false;
+	}
+
+	if( header.hash != Hash64( bytecode ) ) {
+		Com_Printf( S_COLOR_YELLOW "Script cache '%s' is corrupt\n", path );
+		return false;
+	}
+
+	BytecodeReader reader( bytecode );
+	int error = mod->LoadByteCode( &reader );
+	if( error < 0 || reader.overflowed || reader.cursor != bytecode.n ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't load script cache '%s'\n", path );
+		return false;
+	}
+
+	return true;
+}
+
+static void SaveCachedBytecode( const asIScriptModule * mod, const char * path, u64 key ) {
+	ZoneScoped;
+
+	BytecodeWriter writer;
+
+	BytecodeCacheHeader header = { };
+	writer.Write( &header, sizeof( header ) );
+
+	if( mod->SaveByteCode( &writer ) < 0 ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't serialize compiled script\n" );
+		return;
+	}
+
+	Span< const u8 > bytecode = writer.buf.span().slice( sizeof( header ), writer.buf.size() );
+	header.magic = BYTECODE_CACHE_MAGIC;
+	header.key = key;
+	header.size = bytecode.n;
+	header.hash = Hash64( bytecode );
+	memcpy( writer.buf.ptr(), &header, sizeof( header ) );
+
+	TempAllocator temp = svs.frame_arena.temp();
+	if( !WriteFile( &temp, path, writer.buf.ptr(), writer.buf.num_bytes() ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write script cache '%s'\n", path );
+	}
+}
+
+struct ScriptSection {
+	char * path;
+	char * contents;
+};
+
 asIScriptModule *qasLoadScriptProject( asIScriptEngine *engine, const char *filename ) {
+	ZoneScoped;
+
 	DynamicString path( sys_allocator, "{}/base/progs/gametypes/{}.gt", RootDirPath(), filename );
 	char * contents = ReadFileString( sys_allocator, path.c_str() );
 	defer { FREE( sys_allocator, contents ); };
@@ -226,46 +473,79 @@ asIScriptModule *qasLoadScriptProject( asIScriptEngine *engine, const char *file
 		return NULL;
 	}
 
-	asIScriptModule * mod = engine->GetModule( GAMETYPE_SCRIPTS_MODULE_NAME, asGM_CREATE_IF_NOT_EXISTS );
-	if( mod == NULL ) {
-		Com_Printf( S_COLOR_RED "qasBuildGameScript: GetModule '%s' failed\n", GAMETYPE_SCRIPTS_MODULE_NAME );
-		return NULL;
-	}
-
-	bool ok = false;
+	SmallDynamicArray< ScriptSection, 64 > sections( sys_allocator );
 	defer {
-		if( !ok ) {
-			engine->DiscardModule( GAMETYPE_SCRIPTS_MODULE_NAME );
+		for( ScriptSection & section : sections ) {
+			FREE( sys_allocator, section.path );
+			FREE( sys_allocator, section.contents );
 		}
 	};
 
+	u64 key = HashRegisteredInterface( engine );
+
 	Span< const char > cursor = MakeSpan( contents );
 	while( true ) {
 		Span< const char > section = ParseToken( &cursor, Parse_DontStopOnNewLine );
 		if( section.ptr == NULL )
 			break;
 
-		DynamicString section_path( sys_allocator, "{}/base/progs/gametypes/{}", RootDirPath(), section );
-		char * section_contents = ReadFileString( sys_allocator, section_path.c_str() );
-		defer { FREE( sys_allocator, section_contents ); };
+		char * section_path = ( *sys_allocator )( "{}/base/progs/gametypes/{}", RootDirPath(), section );
+		char * section_contents = ReadFileString( sys_allocator, section_path );
+		sections.add( { section_path, section_contents } );
 		if( section_contents == NULL ) {
-			Com_Printf( "Couldn't read script section: '%s'\n", section_path.c_str() );
+			Com_Printf( "Couldn't read script section: '%s'\n", section_path );
 			return NULL;
 		}
 
-		int error = mod->AddScriptSection( section_path.c_str(), section_contents );
+		key = HashString( section_contents, Hash64( section.ptr, section.n, key ) );
+	}
+
+	DynamicString cache_path( sys_allocator, "{}/base/cache/gametypes/{}.asc", HomeDirPath(), filename );
+
+	asIScriptModule * mod = engine->GetModule( GAMETYPE_SCRIPTS_MODULE_NAME, asGM_ALWAYS_CREATE );
+	if( mod == NULL ) {
+		Com_Printf( S_COLOR_RED "qasBuildGameScript: GetModule '%s' failed\n", GAMETYPE_SCRIPTS_MODULE_NAME );
+		return NULL;
+	}
+
+	if( LoadCachedBytecode( mod, cache_path.c_str(), key ) ) {
+		return mod;
+	}
+
+	// the failed load can leave the module half initialised, so start over
+	mod = engine->GetModule( GAMETYPE_SCRIPTS_MODULE_NAME, asGM_ALWAYS_CREATE );
+	if( mod == NULL ) {
+		Com_Printf( S_COLOR_RED "qasBuildGameScript: GetModule '%s' failed\n", GAMETYPE_SCRIPTS_MODULE_NAME );
+		return NULL;
+	}
+
+	bool ok = false;
+	defer {
+		if( !ok ) {
+			engine->DiscardModule( GAMETYPE_SCRIPTS_MODULE_NAME );
+		}
+	};
+
+	for( const ScriptSection & section : sections ) {
+		int error = mod->AddScriptSection( section.path, section.contents );
 		if( error != 0 ) {
-			Com_GGPrint( S_COLOR_RED "* Failed to add the script section {} with error {}\n", section, error );
+			Com_GGPrint( S_COLOR_RED "* Failed to add the script section {} with error {}\n", section.path, error );
 			return NULL;
 		}
 	}
 
-	int error = mod->Build();
+	int error;
+	{
+		ZoneScopedN( "Build" );
+		error = mod->Build();
+	}
 	if( error != 0 ) {
 		Com_Printf( S_COLOR_RED "* Failed to build script '%s'\n", filename );
 		return NULL;
 	}
 
+	SaveCachedBytecode( mod, cache_path.c_str(), key );
+
 	ok = true;
 	return mod;
 }
@@ -1,5 +1,29 @@
 #include "game/g_local.h"
 #include "gameshared/gs_public.h"
+#include "qcommon/threadpool.h"
+#include "qcommon/threads.h"
+
+#define MIN_PARALLEL_BOTS 8
+
+/*
+* bots think in two steps. at the start of the tick AI_PlanThinks runs the
+* discretionary decisions (joining teams, readying up) round-robin within
+* g_botthinkbudget microseconds, then builds every bot's UserCommand from a
+* read-only view of its state, on the thread pool when there are enough bots.
+* AI_Think applies the plan when the bot's client think comes around, and
+* replans inline if something moved the bot in between
+*/
+
+struct BotPlan {
+	bool valid;
+	bool ghosting;
+	Vec3 angles;
+	s16 delta_angles[ 3 ];
+	UserCommand ucmd;
+};
+
+static BotPlan bot_plans[ MAX_CLIENTS ];
+static int next_decision_bot;
 
 static const char * bot_names[] = {
 	"vic",
@@ -52,6 +76,7 @@ void AI_SpawnBot() {
 	ent->think = NULL;
 	ent->nextThink = level.time + 500 + RandomUniform( &svs.rng, 0, 2000 );
 	ent->classname = "bot";
+	G_UpdateEdictIndex( ent );
 	ent->die = player_die;
 
 	AI_Respawn( ent );
@@ -66,66 +91,135 @@ void AI_Respawn( edict_t * ent ) {
 	ent->r.client->level.last_activity = level.time;
 }
 
-static void AI_SpecThink( edict_t * self ) {
-	self->nextThink = level.time + 100;
+static bool AI_IsThinkingBot( const edict_t * ent ) {
+	return ent->r.inuse && ( ent->r.svflags & SVF_FAKECLIENT ) && PF_GetClientState( PLAYERNUM( ent ) ) >= CS_SPAWNED;
+}
 
-	if( !level.canSpawnEntities )
-		return;
+static bool AI_NeedsDecision( const edict_t * self ) {
+	if( G_ISGHOSTING( self ) ) {
+		return level.canSpawnEntities && self->r.client->team == TEAM_SPECTATOR && !self->r.client->queueTimeStamp;
+	}
+	return server_gs.gameState.match_state <= MatchState_Warmup && !level.ready[ PLAYERNUM( self ) ];
+}
 
-	if( self->r.client->team == TEAM_SPECTATOR ) {
-		// try to join a team
-		if( !self->r.client->queueTimeStamp ) {
-			G_Teams_JoinAnyTeam( self, false );
-		}
+static void AI_Decide( edict_t * self ) {
+	if( G_ISGHOSTING( self ) ) {
+		G_Teams_JoinAnyTeam( self, false );
+	}
+	else {
+		G_Match_Ready( self );
+	}
+}
 
-		if( self->r.client->team == TEAM_SPECTATOR ) { // couldn't join, delay the next think
-			self->nextThink = level.time + 100;
-		} else {
-			self->nextThink = level.time + 1;
-		}
-		return;
+static void AI_Plan( const edict_t * self, BotPlan * plan ) {
+	const gclient_t * client = self->r.client;
+
+	plan->valid = true;
+	plan->ghosting = G_ISGHOSTING( self );
+	plan->angles = self->s.angles;
+	for( int i = 0; i < 3; i++ ) {
+		plan->delta_angles[ i ] = client->ps.pmove.delta_angles[ i ];
 	}
 
-	UserCommand ucmd;
-	memset( &ucmd, 0, sizeof( UserCommand ) );
+	memset( &plan->ucmd, 0, sizeof( UserCommand ) );
+
+	if( !plan->ghosting ) {
+		// set up for pmove
+		plan->ucmd.angles[ 0 ] = (short)ANGLE2SHORT( self->s.angles.x ) - client->ps.pmove.delta_angles[ 0 ];
+		plan->ucmd.angles[ 1 ] = (short)ANGLE2SHORT( self->s.angles.y ) - client->ps.pmove.delta_angles[ 1 ];
+		plan->ucmd.angles[ 2 ] = (short)ANGLE2SHORT( self->s.angles.z ) - client->ps.pmove.delta_angles[ 2 ];
+	}
 
 	// set approximate ping and show values
-	ucmd.serverTimeStamp = svs.gametime;
-	ucmd.msec = (uint8_t)game.frametime;
+	plan->ucmd.msec = u8( game.frametime );
+	plan->ucmd.serverTimeStamp = svs.gametime;
+}
 
-	ClientThink( self, &ucmd, 0 );
+static bool AI_PlanIsCurrent( const edict_t * self, const BotPlan * plan ) {
+	if( !plan->valid || plan->ghosting != G_ISGHOSTING( self ) || plan->angles != self->s.angles ) {
+		return false;
+	}
+	for( int i = 0; i < 3; i++ ) {
+		if( plan->delta_angles[ i ] != self->r.client->ps.pmove.delta_angles[ i ] ) {
+			return false;
+		}
+	}
+	return plan->ucmd.serverTimeStamp == svs.gametime;
 }
 
-static void AI_GameThink( edict_t * self ) {
-	if( server_gs.gameState.match_state <= MatchState_Warmup ) {
-		G_Match_Ready( self );
+static void AI_RunDecisions() {
+	ZoneScoped;
+
+	u64 start = Sys_Microseconds();
+	u64 budget = u64( Max2( 0, g_botthinkbudget->integer ) );
+	int maxclients = server_gs.maxclients;
+
+	// start where the last frame ran out of budget so no bot starves
+	for( int i = 0; i < maxclients; i++ ) {
+		int playernum = ( next_decision_bot + i ) % maxclients;
+		edict_t * ent = game.edicts + 1 + playernum;
+		if( !AI_IsThinkingBot( ent ) || !AI_NeedsDecision( ent ) ) {
+			continue;
+		}
+
+		if( Sys_Microseconds() - start >= budget ) {
+			next_decision_bot = playernum;
+			return;
+		}
+
+		AI_Decide( ent );
 	}
+}
 
-	UserCommand ucmd;
-	memset( &ucmd, 0, sizeof( UserCommand ) );
+void AI_PlanThinks() {
+	ZoneScoped;
 
-	// set up for pmove
-	ucmd.angles[ 0 ] = (short)ANGLE2SHORT( self->s.angles.x ) - self->r.client->ps.pmove.delta_angles[ 0 ];
-	ucmd.angles[ 1 ] = (short)ANGLE2SHORT( self->s.angles.y ) - self->r.client->ps.pmove.delta_angles[ 1 ];
-	ucmd.angles[ 2 ] = (short)ANGLE2SHORT( self->s.angles.z ) - self->r.client->ps.pmove.delta_angles[ 2 ];
+	AI_RunDecisions();
 
-	self->r.client->ps.pmove.delta_angles[ 0 ] = 0;
-	self->r.client->ps.pmove.delta_angles[ 1 ] = 0;
-	self->r.client->ps.pmove.delta_angles[ 2 ] = 0;
+	int entnums[ MAX_CLIENTS ];
+	size_t num_bots = 0;
 
-	// set approximate ping and show values
-	ucmd.msec = u8( game.frametime );
-	ucmd.serverTimeStamp = svs.gametime;
+	for( int i = 0; i < server_gs.maxclients; i++ ) {
+		const edict_t * ent = game.edicts + 1 + i;
+		bot_plans[ i ].valid = false;
+		if( AI_IsThinkingBot( ent ) ) {
+			entnums[ num_bots++ ] = ENTNUM( ent );
+		}
+	}
+
+	if( GetCoreCount() == 1 || num_bots < MIN_PARALLEL_BOTS ) {
+		for( size_t i = 0; i < num_bots; i++ ) {
+			const edict_t * ent = &game.edicts[ entnums[ i ] ];
+			AI_Plan( ent, &bot_plans[ PLAYERNUM( ent ) ] );
+		}
+		return;
+	}
 
-	ClientThink( self, &ucmd, 0 );
-	self->nextThink = level.time + 1;
+	ParallelFor( Span< int >( entnums, num_bots ), []( TempAllocator * temp, void * data ) {
+		const edict_t * ent = &game.edicts[ *( const int * ) data ];
+		AI_Plan( ent, &bot_plans[ PLAYERNUM( ent ) ] );
+	} );
 }
 
 void AI_Think( edict_t * self ) {
-	if( G_ISGHOSTING( self ) ) {
-		AI_SpecThink( self );
+	BotPlan * plan = &bot_plans[ PLAYERNUM( self ) ];
+	if( !AI_PlanIsCurrent( self, plan ) ) {
+		AI_Plan( self, plan );
+	}
+	plan->valid = false;
+
+	if( plan->ghosting ) {
+		// spectators only think about joining a team, which AI_RunDecisions handles
+		if( !level.canSpawnEntities || self->r.client->team == TEAM_SPECTATOR ) {
+			return;
+		}
 	}
 	else {
-		AI_GameThink( self );
+		self->r.client->ps.pmove.delta_angles[ 0 ] = 0;
+		self->r.client->ps.pmove.delta_angles[ 1 ] = 0;
+		self->r.client->ps.pmove.delta_angles[ 2 ] = 0;
 	}
+
+	ClientThink( self, &plan->ucmd, 0 );
+	self->nextThink = level.time + ( plan->ghosting ? 100 : 1 );
 }
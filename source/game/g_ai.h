@@ -2,4 +2,5 @@
 
 void AI_SpawnBot();
 void AI_Respawn( edict_t * ent );
+void AI_PlanThinks();
 void AI_Think( edict_t * self );
@@ -26,10 +26,15 @@ constexpr const char * GAMETYPE_SCRIPTS_MODULE_NAME = "gametype";
 
 // public interfaces
 
+#define ASSTRING_INLINE_SIZE 32
+
+// short strings live in inline_buffer, buffer only points at the heap once
+// they outgrow it
 typedef struct asstring_s {
 	char *buffer;
 	unsigned int len, size;
 	int asRefCount;
+	char inline_buffer[ ASSTRING_INLINE_SIZE ];
 } asstring_t;
 
 struct asvec3_t {
@@ -21,17 +21,31 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "game/g_local.h"
 #include "game/g_ascript.h"
 
+/*
+* gametype callbacks are resolved once when the script loads. calls then only
+* need a pooled context prepared with the function from the table
+*/
+
+static const char * gametype_function_decls[] = {
+	"void GT_InitGametype()",
+	"void GT_SpawnGametype()",
+	"void GT_MatchStateStarted()",
+	"bool GT_MatchStateFinished( int incomingMatchState )",
+	"void GT_ThinkRules()",
+	"void GT_PlayerRespawn( Entity @ent, int old_team, int new_team )",
+	"void GT_ScoreEvent( Client @client, const String &score_event, const String &args )",
+	"Entity @GT_SelectSpawnPoint( Entity @ent )",
+	"bool GT_Command( Client @client, const String &cmdString, const String &argsString, int argc )",
+	"void GT_Shutdown()",
+};
+
+STATIC_ASSERT( ARRAY_COUNT( gametype_function_decls ) == GametypeScriptFunction_Count );
+
 static void GT_ResetScriptData() {
-	level.gametype.initFunc = NULL;
-	level.gametype.spawnFunc = NULL;
-	level.gametype.matchStateStartedFunc = NULL;
-	level.gametype.matchStateFinishedFunc = NULL;
-	level.gametype.thinkRulesFunc = NULL;
-	level.gametype.playerRespawnFunc = NULL;
-	level.gametype.scoreEventFunc = NULL;
-	level.gametype.selectSpawnPointFunc = NULL;
-	level.gametype.clientCommandFunc = NULL;
-	level.gametype.shutdownFunc = NULL;
+	for( asIScriptFunction *& func : level.gametype.functions ) {
+		func = NULL;
+	}
+	G_asClearSpawnFunctionCache();
 }
 
 void GT_asShutdownScript() {
@@ -51,113 +65,76 @@ void GT_asShutdownScript() {
 	game.asEngine->DiscardModule( GAMETYPE_SCRIPTS_MODULE_NAME );
 }
 
-//"void GT_SpawnGametype()"
-void GT_asCallSpawn() {
-	if( !level.gametype.spawnFunc ) {
-		return;
+static asIScriptContext * GT_asPrepare( GametypeScriptFunction func ) {
+	if( level.gametype.functions[ func ] == NULL ) {
+		return NULL;
 	}
 
 	asIScriptContext * ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	int error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.spawnFunc ) );
-	if( error < 0 ) {
-		return;
+	if( ctx->Prepare( level.gametype.functions[ func ] ) < 0 ) {
+		return NULL;
 	}
 
-	error = ctx->Execute();
+	return ctx;
+}
+
+static void GT_asExecute( asIScriptContext * ctx ) {
+	int error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 	}
 }
 
-//"void GT_MatchStateStarted()"
-void GT_asCallMatchStateStarted() {
-	int error;
-	asIScriptContext *ctx;
-
-	if( !level.gametype.matchStateStartedFunc ) {
+//"void GT_SpawnGametype()"
+void GT_asCallSpawn() {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_Spawn );
+	if( ctx == NULL ) {
 		return;
 	}
 
-	ctx = game.asExport->asAcquireContext( game.asEngine );
+	GT_asExecute( ctx );
+}
 
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.matchStateStartedFunc ) );
-	if( error < 0 ) {
+//"void GT_MatchStateStarted()"
+void GT_asCallMatchStateStarted() {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_MatchStateStarted );
+	if( ctx == NULL ) {
 		return;
 	}
 
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 }
 
 //"bool GT_MatchStateFinished( int incomingMatchState )"
 bool GT_asCallMatchStateFinished( int incomingMatchState ) {
-	int error;
-	asIScriptContext *ctx;
-	bool result;
-
-	if( !level.gametype.matchStateFinishedFunc ) {
-		return true;
-	}
-
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.matchStateFinishedFunc ) );
-	if( error < 0 ) {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_MatchStateFinished );
+	if( ctx == NULL ) {
 		return true;
 	}
 
 	// Now we need to pass the parameters to the script function.
 	ctx->SetArgDWord( 0, incomingMatchState );
 
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 
 	// Retrieve the return from the context
-	result = ctx->GetReturnByte() == 0 ? false : true;
-
-	return result;
+	return ctx->GetReturnByte() == 0 ? false : true;
 }
 
 //"void GT_ThinkRules()"
 void GT_asCallThinkRules() {
-	int error;
-	asIScriptContext *ctx;
-
-	if( !level.gametype.thinkRulesFunc ) {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_ThinkRules );
+	if( ctx == NULL ) {
 		return;
 	}
 
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.thinkRulesFunc ) );
-	if( error < 0 ) {
-		return;
-	}
-
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 }
 
 //"void GT_playerRespawn( Entity @ent, int old_team, int new_team )"
 void GT_asCallPlayerRespawn( edict_t *ent, int old_team, int new_team ) {
-	int error;
-	asIScriptContext *ctx;
-
-	if( !level.gametype.playerRespawnFunc ) {
-		return;
-	}
-
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.playerRespawnFunc ) );
-	if( error < 0 ) {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_PlayerRespawn );
+	if( ctx == NULL ) {
 		return;
 	}
 
@@ -166,22 +143,11 @@ void GT_asCallPlayerRespawn( edict_t *ent, int old_team, int new_team ) {
 	ctx->SetArgDWord( 1, old_team );
 	ctx->SetArgDWord( 2, new_team );
 
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 }
 
 //"void GT_scoreEvent( Client @client, String &score_event, String &args )"
 void GT_asCallScoreEvent( gclient_t *client, const char *score_event, const char *args ) {
-	int error;
-	asIScriptContext *ctx;
-	asstring_t *s1, *s2;
-
-	if( !level.gametype.scoreEventFunc ) {
-		return;
-	}
-
 	if( !score_event || !score_event[0] ) {
 		return;
 	}
@@ -190,25 +156,20 @@ void GT_asCallScoreEvent( gclient_t *client, const char *score_event, const char
 		args = "";
 	}
 
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.scoreEventFunc ) );
-	if( error < 0 ) {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_ScoreEvent );
+	if( ctx == NULL ) {
 		return;
 	}
 
 	// Now we need to pass the parameters to the script function.
-	s1 = game.asExport->asStringFactoryBuffer( score_event, strlen( score_event ) );
-	s2 = game.asExport->asStringFactoryBuffer( args, strlen( args ) );
+	asstring_t * s1 = game.asExport->asStringFactoryBuffer( score_event, strlen( score_event ) );
+	asstring_t * s2 = game.asExport->asStringFactoryBuffer( args, strlen( args ) );
 
 	ctx->SetArgObject( 0, client );
 	ctx->SetArgObject( 1, s1 );
 	ctx->SetArgObject( 2, s2 );
 
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 
 	game.asExport->asStringRelease( s1 );
 	game.asExport->asStringRelease( s2 );
@@ -216,66 +177,41 @@ void GT_asCallScoreEvent( gclient_t *client, const char *score_event, const char
 
 //"Entity @GT_SelectSpawnPoint( Entity @ent )"
 edict_t *GT_asCallSelectSpawnPoint( edict_t *ent ) {
-	int error;
-	asIScriptContext *ctx;
-
-	if( !level.gametype.selectSpawnPointFunc ) {
-		return NULL;
-	}
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.selectSpawnPointFunc ) );
-	if( error < 0 ) {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_SelectSpawnPoint );
+	if( ctx == NULL ) {
 		return NULL;
 	}
 
 	// Now we need to pass the parameters to the script function.
 	ctx->SetArgObject( 0, ent );
 
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 
 	return ( edict_t * )ctx->GetReturnObject();
 }
 
 //"bool GT_Command( Client @client, String &cmdString, String &argsString, int argc )"
 bool GT_asCallGameCommand( gclient_t *client, const char *cmd, const char *args, int argc ) {
-	int error;
-	asIScriptContext *ctx;
-	asstring_t *s1, *s2;
-
-	if( !level.gametype.clientCommandFunc ) {
-		return false; // should have a hardcoded backup
-
-	}
-
 	// check for having any command to parse
 	if( !cmd || !cmd[0] ) {
 		return false;
 	}
 
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.clientCommandFunc ) );
-	if( error < 0 ) {
-		return false;
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_ClientCommand );
+	if( ctx == NULL ) {
+		return false; // should have a hardcoded backup
 	}
 
 	// Now we need to pass the parameters to the script function.
-	s1 = game.asExport->asStringFactoryBuffer( cmd, strlen( cmd ) );
-	s2 = game.asExport->asStringFactoryBuffer( args, strlen( args ) );
+	asstring_t * s1 = game.asExport->asStringFactoryBuffer( cmd, strlen( cmd ) );
+	asstring_t * s2 = game.asExport->asStringFactoryBuffer( args, strlen( args ) );
 
 	ctx->SetArgObject( 0, client );
 	ctx->SetArgObject( 1, s1 );
 	ctx->SetArgObject( 2, s2 );
 	ctx->SetArgDWord( 3, argc );
 
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 
 	game.asExport->asStringRelease( s1 );
 	game.asExport->asStringRelease( s2 );
@@ -286,146 +222,44 @@ bool GT_asCallGameCommand( gclient_t *client, const char *cmd, const char *args,
 
 //"void GT_Shutdown()"
 void GT_asCallShutdown() {
-	int error;
-	asIScriptContext *ctx;
-
-	if( !level.gametype.shutdownFunc || !game.asExport ) {
+	if( !game.asExport ) {
 		return;
 	}
 
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.shutdownFunc ) );
-	if( error < 0 ) {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_Shutdown );
+	if( ctx == NULL ) {
 		return;
 	}
 
-	error = ctx->Execute();
-	if( error != asEXECUTION_FINISHED ) {
-		GT_asShutdownScript();
-	}
+	GT_asExecute( ctx );
 }
 
 static bool G_asInitializeGametypeScript( asIScriptModule *asModule ) {
-	int error;
-	asIScriptContext *ctx;
-	int funcCount;
-	const char *fdeclstr;
-
 	// grab script function calls
-	funcCount = 0;
-
-	fdeclstr = "void GT_InitGametype()";
-	level.gametype.initFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.initFunc ) {
-		Com_Printf( "* The function '%s' was not found. Can not continue.\n", fdeclstr );
-		return false;
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "void GT_SpawnGametype()";
-	level.gametype.spawnFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.spawnFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "void GT_MatchStateStarted()";
-	level.gametype.matchStateStartedFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.matchStateStartedFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "bool GT_MatchStateFinished( int incomingMatchState )";
-	level.gametype.matchStateFinishedFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.matchStateFinishedFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
+	for( int i = 0; i < GametypeScriptFunction_Count; i++ ) {
+		level.gametype.functions[ i ] = asModule->GetFunctionByDecl( gametype_function_decls[ i ] );
+		if( level.gametype.functions[ i ] == NULL && i != GametypeScriptFunction_Init ) {
+			if( developer->integer || sv_cheats->integer ) {
+				Com_Printf( "* The function '%s' was not present in the script.\n", gametype_function_decls[ i ] );
+			}
 		}
-	} else {
-		funcCount++;
 	}
 
-	fdeclstr = "void GT_ThinkRules()";
-	level.gametype.thinkRulesFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.thinkRulesFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "void GT_PlayerRespawn( Entity @ent, int old_team, int new_team )";
-	level.gametype.playerRespawnFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.playerRespawnFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "void GT_ScoreEvent( Client @client, const String &score_event, const String &args )";
-	level.gametype.scoreEventFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.scoreEventFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "Entity @GT_SelectSpawnPoint( Entity @ent )";
-	level.gametype.selectSpawnPointFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.selectSpawnPointFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "bool GT_Command( Client @client, const String &cmdString, const String &argsString, int argc )";
-	level.gametype.clientCommandFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.clientCommandFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
-	}
-
-	fdeclstr = "void GT_Shutdown()";
-	level.gametype.shutdownFunc = asModule->GetFunctionByDecl( fdeclstr );
-	if( !level.gametype.shutdownFunc ) {
-		if( developer->integer || sv_cheats->integer ) {
-			Com_Printf( "* The function '%s' was not present in the script.\n", fdeclstr );
-		}
-	} else {
-		funcCount++;
+	if( level.gametype.functions[ GametypeScriptFunction_Init ] == NULL ) {
+		Com_Printf( "* The function '%s' was not found. Can not continue.\n", gametype_function_decls[ GametypeScriptFunction_Init ] );
+		return false;
 	}
 
 	//
 	// execute the GT_InitGametype function
 	//
 
-	ctx = game.asExport->asAcquireContext( game.asEngine );
-
-	error = ctx->Prepare( static_cast<asIScriptFunction *>( level.gametype.initFunc ) );
-	if( error < 0 ) {
+	asIScriptContext * ctx = GT_asPrepare( GametypeScriptFunction_Init );
+	if( ctx == NULL ) {
 		return false;
 	}
 
-	error = ctx->Execute();
+	int error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		return false;
 	}
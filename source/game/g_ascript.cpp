@@ -363,11 +363,26 @@ static const asEnum_t asGameEnums[] = {
 	{ }
 };
 
+// looking the type up parses the declaration, so do it once per engine and
+// hold a reference so it can't be discarded along with the gametype module
+static asIObjectType *entityArrayType;
+
 static asIObjectType *asEntityArrayType() {
-	asIScriptContext *ctx = game.asExport->asGetActiveContext();
-	asIScriptEngine *engine = ctx->GetEngine();
-	asIObjectType *ot = engine->GetObjectTypeById( engine->GetTypeIdByDecl( "array<Entity @>" ) );
-	return ot;
+	if( entityArrayType == NULL ) {
+		asIScriptEngine *engine = game.asEngine;
+		entityArrayType = engine->GetObjectTypeById( engine->GetTypeIdByDecl( "array<Entity @>" ) );
+		entityArrayType->AddRef();
+	}
+	return entityArrayType;
+}
+
+static CScriptArrayInterface *asEntityArray( Span< edict_t * const > ents ) {
+	CScriptArrayInterface *arr = game.asExport->asCreateArrayCpp( ents.n, asEntityArrayType() );
+	for( size_t i = 0; i < ents.n; i++ ) {
+		*( (edict_t **)arr->At( i ) ) = ents[ i ];
+	}
+
+	return arr;
 }
 
 // CLASS: Match
@@ -512,6 +527,20 @@ static edict_t *objectTeamlist_GetPlayerEntity( int index, SyncTeamState * obj )
 	return &game.edicts[ obj->player_indices[ index ] ];
 }
 
+static CScriptArrayInterface *objectTeamlist_GetPlayers( SyncTeamState * obj ) {
+	edict_t * players[ MAX_CLIENTS ];
+	int n = 0;
+	for( int i = 0; i < obj->num_players; i++ ) {
+		int idx = obj->player_indices[ i ];
+		if( idx >= 1 && idx <= server_gs.maxclients ) {
+			players[ n ] = &game.edicts[ idx ];
+			n++;
+		}
+	}
+
+	return asEntityArray( Span< edict_t * const >( players, n ) );
+}
+
 static asstring_t *objectTeamlist_getName( SyncTeamState * obj ) {
 	const char *name = GS_TeamName( obj - server_gs.gameState.teams );
 
@@ -536,6 +565,7 @@ static const asBehavior_t teamlist_ObjectBehaviors[] = {
 
 static const asMethod_t teamlist_Methods[] = {
 	{ ASLIB_FUNCTION_DECL( Entity @, ent, ( int index ) ), asFUNCTION( objectTeamlist_GetPlayerEntity ), asCALL_CDECL_OBJLAST },
+	{ ASLIB_FUNCTION_DECL( array<Entity @> @, players, ( ) const ), asFUNCTION( objectTeamlist_GetPlayers ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( const String @, get_name, ( ) const ), asFUNCTION( objectTeamlist_getName ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( void, setScore, ( int ) const ), asFUNCTION( objectTeamlist_SetScore ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( void, addScore, ( int ) const ), asFUNCTION( objectTeamlist_AddScore ), asCALL_CDECL_OBJLAST },
@@ -858,18 +888,6 @@ static void objectGameEntity_SetVelocity( asvec3_t *vel, edict_t *self ) {
 	}
 }
 
-static asvec3_t objectGameEntity_GetAVelocity( edict_t *obj ) {
-	asvec3_t avelocity;
-
-	avelocity.v = obj->avelocity;
-
-	return avelocity;
-}
-
-static void objectGameEntity_SetAVelocity( asvec3_t *vel, edict_t *self ) {
-	self->avelocity = vel->v;
-}
-
 static asvec3_t objectGameEntity_GetOrigin( edict_t *obj ) {
 	asvec3_t origin;
 
@@ -884,17 +902,6 @@ static void objectGameEntity_SetOrigin( asvec3_t *vec, edict_t *self ) {
 	self->s.origin = vec->v;
 }
 
-static asvec3_t objectGameEntity_GetOrigin2( edict_t *obj ) {
-	asvec3_t origin;
-
-	origin.v = obj->s.origin2;
-	return origin;
-}
-
-static void objectGameEntity_SetOrigin2( asvec3_t *vec, edict_t *self ) {
-	self->s.origin2 = vec->v;
-}
-
 static asvec3_t objectGameEntity_GetAngles( edict_t *obj ) {
 	asvec3_t angles;
 
@@ -967,20 +974,18 @@ static void objectGameEntity_UseTargets( edict_t *activator, edict_t *self ) {
 }
 
 static CScriptArrayInterface *objectGameEntity_findTargets( edict_t *self ) {
-	asIObjectType *ot = asEntityArrayType();
-	CScriptArrayInterface *arr = game.asExport->asCreateArrayCpp( 0, ot );
+	static edict_t * targets[ MAX_EDICTS ];
+	size_t n = 0;
 
 	if( self->target != EMPTY_HASH ) {
-		int count = 0;
 		edict_t *ent = NULL;
 		while( ( ent = G_Find( ent, &edict_t::name, self->target ) ) != NULL ) {
-			arr->Resize( count + 1 );
-			*( (edict_t **)arr->At( count ) ) = ent;
-			count++;
+			targets[ n ] = ent;
+			n++;
 		}
 	}
 
-	return arr;
+	return asEntityArray( Span< edict_t * const >( targets, n ) );
 }
 
 static void objectGameEntity_TeleportEffect( bool in, edict_t *self ) {
@@ -1051,12 +1056,8 @@ static const asBehavior_t gedict_ObjectBehaviors[] = {
 static const asMethod_t gedict_Methods[] = {
 	{ ASLIB_FUNCTION_DECL( Vec3, get_velocity, ( ) const ), asFUNCTION( objectGameEntity_GetVelocity ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( void, set_velocity, ( const Vec3 &in ) ), asFUNCTION( objectGameEntity_SetVelocity ), asCALL_CDECL_OBJLAST },
-	{ ASLIB_FUNCTION_DECL( Vec3, get_avelocity, ( ) const ), asFUNCTION( objectGameEntity_GetAVelocity ), asCALL_CDECL_OBJLAST },
-	{ ASLIB_FUNCTION_DECL( void, set_avelocity, ( const Vec3 &in ) ), asFUNCTION( objectGameEntity_SetAVelocity ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( Vec3, get_origin, ( ) const ), asFUNCTION( objectGameEntity_GetOrigin ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( void, set_origin, ( const Vec3 &in ) ), asFUNCTION( objectGameEntity_SetOrigin ), asCALL_CDECL_OBJLAST },
-	{ ASLIB_FUNCTION_DECL( Vec3, get_origin2, ( ) const ), asFUNCTION( objectGameEntity_GetOrigin2 ), asCALL_CDECL_OBJLAST },
-	{ ASLIB_FUNCTION_DECL( void, set_origin2, ( const Vec3 &in ) ), asFUNCTION( objectGameEntity_SetOrigin2 ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( Vec3, get_angles, ( ) const ), asFUNCTION( objectGameEntity_GetAngles ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( void, set_angles, ( const Vec3 &in ) ), asFUNCTION( objectGameEntity_SetAngles ), asCALL_CDECL_OBJLAST },
 	{ ASLIB_FUNCTION_DECL( void, getSize, ( Vec3 & out, Vec3 & out ) ), asFUNCTION( objectGameEntity_GetSize ), asCALL_CDECL_OBJLAST },
@@ -1089,6 +1090,8 @@ static const asProperty_t gedict_Properties[] = {
 	{ ASLIB_PROPERTY_DECL( Entity @, owner ), offsetof( edict_t, r.owner ) },
 	{ ASLIB_PROPERTY_DECL( Entity @, enemy ), offsetof( edict_t, enemy ) },
 	{ ASLIB_PROPERTY_DECL( Entity @, activator ), offsetof( edict_t, activator ) },
+	{ ASLIB_PROPERTY_DECL( Vec3, avelocity ), offsetof( edict_t, avelocity ) },
+	{ ASLIB_PROPERTY_DECL( Vec3, origin2 ), offsetof( edict_t, s.origin2 ) },
 	{ ASLIB_PROPERTY_DECL( uint8, type ), offsetof( edict_t, s.type ) },
 	{ ASLIB_PROPERTY_DECL( uint64, model ), offsetof( edict_t, s.model.hash ) },
 	{ ASLIB_PROPERTY_DECL( uint64, model2 ), offsetof( edict_t, s.model2.hash ) },
@@ -1361,12 +1364,12 @@ static void asFunc_Cbuf_ExecuteText( asstring_t *str ) {
 }
 
 static WeaponCategory asFunc_GetWeaponCategory( WeaponType weapon ) {
-	return GS_GetWeaponDef( weapon )->category;
+	return GetWeaponInfo( weapon )->category;
 }
 
 static asstring_t * asFunc_GetWeaponShortName( WeaponType weapon ) {
-	const WeaponDef * def = GS_GetWeaponDef( weapon );
-	return game.asExport->asStringFactoryBuffer( def->short_name, strlen( def->short_name ) );
+	const WeaponInfo * info = GetWeaponInfo( weapon );
+	return game.asExport->asStringFactoryBuffer( info->short_name, strlen( info->short_name ) );
 }
 
 static u64 asFunc_Hash64( asstring_t *str ) {
@@ -1398,21 +1401,58 @@ static CScriptArrayInterface *asFunc_G_FindInRadius( asvec3_t *org, float radius
 	return arr;
 }
 
+/*
+* asFunc_G_FindTeamPlayersInRadius
+*
+* Like G_FindInRadius, but only returns players on the given team that
+* aren't ghosting, so scripts don't have to filter every entity nearby
+*/
+static CScriptArrayInterface *asFunc_G_FindTeamPlayersInRadius( asvec3_t *org, float radius, int team ) {
+	edict_t * players[ MAX_CLIENTS ];
+	int n = 0;
+
+	if( team >= 0 && team < GS_MAX_TEAMS ) {
+		const SyncTeamState * teamlist = &server_gs.gameState.teams[ team ];
+		for( int i = 0; i < teamlist->num_players; i++ ) {
+			int idx = teamlist->player_indices[ i ];
+			if( idx < 1 || idx > server_gs.maxclients ) {
+				continue;
+			}
+
+			edict_t * ent = &game.edicts[ idx ];
+			if( !ent->r.inuse || ent->s.team != team || objectGameEntity_IsGhosting( ent ) ) {
+				continue;
+			}
+
+			if( !BoundsOverlapSphere( ent->r.absmin, ent->r.absmax, org->v, radius ) ) {
+				continue;
+			}
+
+			players[ n ] = ent;
+			n++;
+		}
+	}
+
+	return asEntityArray( Span< edict_t * const >( players, n ) );
+}
+
 static CScriptArrayInterface *asFunc_G_FindByClassname( asstring_t *str ) {
 	StringHash classname = StringHash( str->buffer );
 
-	asIObjectType *ot = asEntityArrayType();
-	CScriptArrayInterface *arr = game.asExport->asCreateArrayCpp( 0, ot );
+	static edict_t * ents[ MAX_EDICTS ];
+	size_t n = 0;
 
-	int count = 0;
 	edict_t *ent = NULL;
 	while( ( ent = G_Find( ent, &edict_t::classname, classname ) ) != NULL ) {
-		arr->Resize( count + 1 );
-		*( (edict_t **)arr->At( count ) ) = ent;
-		count++;
+		ents[ n ] = ent;
+		n++;
 	}
 
-	return arr;
+	return asEntityArray( Span< edict_t * const >( ents, n ) );
+}
+
+static edict_t * asFunc_G_RandomSpawnPoint( asstring_t * str ) {
+	return G_RandomSpawnPoint( StringHash( str->buffer ) );
 }
 
 static edict_t * asFunc_G_Find( edict_t * cursor, asstring_t * str ) {
@@ -1497,7 +1537,9 @@ static const asglobfuncs_t asGameGlobFuncs[] = {
 	{ "Client @G_GetClient( int clientNum )", asFUNCTION( asFunc_GetClient ), NULL },
 	{ "Team @G_GetTeam( int team )", asFUNCTION( asFunc_GetTeamlist ), NULL },
 	{ "array<Entity @> @G_FindInRadius( const Vec3 &in, float radius )", asFUNCTION( asFunc_G_FindInRadius ), NULL },
+	{ "array<Entity @> @G_FindTeamPlayersInRadius( const Vec3 &in, float radius, int team )", asFUNCTION( asFunc_G_FindTeamPlayersInRadius ), NULL },
 	{ "array<Entity @> @G_FindByClassname( const String &in )", asFUNCTION( asFunc_G_FindByClassname ), NULL },
+	{ "Entity @G_RandomSpawnPoint( const String &in )", asFUNCTION( asFunc_G_RandomSpawnPoint ), NULL },
 	{ "Entity @G_Find( Entity @last, const String &in )", asFUNCTION( asFunc_G_Find ), NULL },
 
 	{ "void G_LoadMap( const String &name )", asFUNCTION( asFunc_G_LoadMap ), NULL },
@@ -1549,24 +1591,92 @@ static const asglobproperties_t asGlobProps[] = {
 	{ }
 };
 
+/*
+* G_asExecute
+*
+* Runs a prepared context and counts the time towards the server's
+* angelscript stats. Scripts can call back into the game and end up
+* running more scripts, so only the outermost call is timed.
+*/
+int G_asExecute( asIScriptContext * ctx ) {
+	static int depth = 0;
+
+	if( depth > 0 ) {
+		return ctx->Execute();
+	}
+
+	depth++;
+	u64 start = Sys_Microseconds();
+	int error = ctx->Execute();
+	SV_Stats_AddTime( ServerStatsPhase_AngelScript, Sys_Microseconds() - start );
+	depth--;
+
+	return error;
+}
+
+/*
+* map entities without a C++ spawn function look for one in the gametype
+* script. finding a function by declaration means parsing the declaration, so
+* remember what each classname resolved to, including when it didn't resolve
+*/
+
+#define SPAWN_FUNCTION_CACHE_SIZE 256 // power of two
+
+struct ScriptSpawnFunction {
+	u64 classname;
+	asIScriptFunction * func;
+	bool used;
+};
+
+static ScriptSpawnFunction script_spawn_functions[ SPAWN_FUNCTION_CACHE_SIZE ];
+static size_t num_script_spawn_functions;
+
+void G_asClearSpawnFunctionCache() {
+	memset( script_spawn_functions, 0, sizeof( script_spawn_functions ) );
+	num_script_spawn_functions = 0;
+}
+
+static asIScriptFunction * G_asFindSpawnFunction( Span< const char > classname ) {
+	asIScriptModule * module = game.asEngine->GetModule( GAMETYPE_SCRIPTS_MODULE_NAME );
+	if( module == NULL ) {
+		return NULL;
+	}
+
+	u64 hash = Hash64( classname.ptr, classname.n );
+	size_t slot = hash & ( SPAWN_FUNCTION_CACHE_SIZE - 1 );
+	while( script_spawn_functions[ slot ].used ) {
+		if( script_spawn_functions[ slot ].classname == hash ) {
+			return script_spawn_functions[ slot ].func;
+		}
+		slot = ( slot + 1 ) & ( SPAWN_FUNCTION_CACHE_SIZE - 1 );
+	}
+
+	TempAllocator temp = svs.frame_arena.temp();
+	DynamicString signature( &temp, "void {}( Entity @ ent )", classname );
+	asIScriptFunction * func = module->GetFunctionByDecl( signature.c_str() );
+
+	// keep the table sparse so probes stay short
+	if( num_script_spawn_functions < SPAWN_FUNCTION_CACHE_SIZE / 2 ) {
+		script_spawn_functions[ slot ].classname = hash;
+		script_spawn_functions[ slot ].func = func;
+		script_spawn_functions[ slot ].used = true;
+		num_script_spawn_functions++;
+	}
+
+	return func;
+}
+
 // map entity spawning
 bool G_asCallMapEntitySpawnScript( Span< const char > classname, edict_t *ent ) {
 	int error;
 	asIScriptContext *asContext;
-	asIScriptEngine *asEngine = game.asEngine;
-	asIScriptModule *asSpawnModule;
 	asIScriptFunction *asSpawnFunc;
 
-	if( !asEngine ) {
+	if( !game.asEngine ) {
 		return false;
 	}
 
-	TempAllocator temp = svs.frame_arena.temp();
-	DynamicString signature( &temp, "void {}( Entity @ ent )", classname );
-
-	asSpawnModule = asEngine->GetModule( GAMETYPE_SCRIPTS_MODULE_NAME );
-	asSpawnFunc = asSpawnModule ? asSpawnModule->GetFunctionByDecl( signature.c_str() ) : NULL;
-
+	asSpawnFunc = G_asFindSpawnFunction( classname );
 	if( !asSpawnFunc ) {
 		return false;
 	}
@@ -1576,7 +1686,7 @@ bool G_asCallMapEntitySpawnScript( Span< const char > classname, edict_t *ent )
 	ent->asSpawnFunc = asSpawnFunc;
 
 	// call the spawn function
-	asContext = game.asExport->asAcquireContext( asEngine );
+	asContext = game.asExport->asAcquireContext( game.asEngine );
 	error = asContext->Prepare( asSpawnFunc );
 	if( error < 0 ) {
 		return false;
@@ -1585,7 +1695,7 @@ bool G_asCallMapEntitySpawnScript( Span< const char > classname, edict_t *ent )
 	// Now we need to pass the parameters to the script function.
 	asContext->SetArgObject( 0, ent );
 
-	error = asContext->Execute();
+	error = G_asExecute( asContext );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 		ent->asSpawnFunc = NULL;
@@ -1654,7 +1764,7 @@ void G_asCallMapEntityThink( edict_t *ent ) {
 	// Now we need to pass the parameters to the script function.
 	ctx->SetArgObject( 0, ent );
 
-	error = ctx->Execute();
+	error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 	}
@@ -1689,7 +1799,7 @@ void G_asCallMapEntityTouch( edict_t *ent, edict_t *other, cplane_t *plane, int
 	ctx->SetArgObject( 2, &normal );
 	ctx->SetArgDWord( 3, surfFlags );
 
-	error = ctx->Execute();
+	error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 	}
@@ -1716,7 +1826,7 @@ void G_asCallMapEntityUse( edict_t *ent, edict_t *other, edict_t *activator ) {
 	ctx->SetArgObject( 1, other );
 	ctx->SetArgObject( 2, activator );
 
-	error = ctx->Execute();
+	error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 	}
@@ -1744,7 +1854,7 @@ void G_asCallMapEntityPain( edict_t *ent, edict_t *other, float kick, float dama
 	ctx->SetArgFloat( 2, kick );
 	ctx->SetArgFloat( 3, damage );
 
-	error = ctx->Execute();
+	error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 	}
@@ -1771,7 +1881,7 @@ void G_asCallMapEntityDie( edict_t *ent, edict_t *inflicter, edict_t *attacker,
 	ctx->SetArgObject( 1, inflicter );
 	ctx->SetArgObject( 2, attacker );
 
-	error = ctx->Execute();
+	error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 	}
@@ -1796,7 +1906,7 @@ void G_asCallMapEntityStop( edict_t *ent ) {
 	// Now we need to pass the parameters to the script function.
 	ctx->SetArgObject( 0, ent );
 
-	error = ctx->Execute();
+	error = G_asExecute( ctx );
 	if( error != asEXECUTION_FINISHED ) {
 		GT_asShutdownScript();
 	}
@@ -1807,6 +1917,7 @@ void G_asCallMapEntityStop( edict_t *ent ) {
 */
 static void G_ResetGameModuleScriptData() {
 	game.asEngine = NULL;
+	entityArrayType = NULL;
 }
 
 /*
@@ -2023,6 +2134,10 @@ void G_asShutdownGameModuleEngine() {
 		return;
 	}
 
+	if( entityArrayType != NULL ) {
+		entityArrayType->Release();
+	}
+
 	game.asExport->asReleaseEngine( game.asEngine );
 	G_ResetGameModuleScriptData();
 }
@@ -83,3 +83,5 @@ typedef struct asglobproperties_s {
 #define ASLIB_FUNCTION_DECL( type,name,params )   (#type " " #name #params )
 
 #define ASLIB_PROPERTY_DECL( type,name )          #type " " #name
+
+int G_asExecute( asIScriptContext * ctx );
@@ -161,6 +161,9 @@ static bool G_VoteMapValidate( callvotedata_t *data, bool first ) {
 		return false;
 	}
 
+	TempAllocator temp = svs.frame_arena.temp();
+	RefreshMapList( &temp );
+
 	if( MapExists( mapname ) ) {
 		// check if valid map is in map pool when on
 		if( g_enforce_map_pool->integer ) {
@@ -191,6 +194,7 @@ valid_map:
 			G_Free( data->string );
 		}
 		data->string = G_CopyString( mapname );
+		G_PrefetchMap( mapname );
 		return true;
 	}
 
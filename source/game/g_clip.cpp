@@ -18,41 +18,122 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <algorithm> // std::sort
+
 #include "game/g_local.h"
+#include "qcommon/array.h"
 #include "qcommon/cmodel.h"
+#include "qcommon/fs.h"
+#include "qcommon/hashmap.h"
+#include "qcommon/rng.h"
+#include "qcommon/string.h"
+#include "qcommon/trace_corpus.h"
 
 //===============================================================================
 //
 //ENTITY AREA CHECKING
 //
+// entities are linked into a loose grid with several levels, each level having
+// cells twice as big as the one below. an entity goes into exactly one cell, on
+// the finest level whose cells are at least as big as the entity, picked by the
+// centre of the entity. that means an entity can stick out of its cell by up to
+// half a cell, so queries grow by half a cell on each level
+//
+// most entities are small so most levels are empty and queries skip them.
+// bounds are kept in SoA form so queries can reject entities without touching
+// their edicts, and relinking an entity that stays in the same cell only
+// updates its bounds
+//
 //FIXME: this use of "area" is different from the bsp file use
 //===============================================================================
 
-#define AREA_GRID       128
-#define AREA_GRIDNODES  ( AREA_GRID * AREA_GRID )
-#define AREA_GRIDMINSIZE 64.0f  // minimum areagrid cell size, smaller values
-// work better for lots of small objects, higher
-// values for large objects
-
-typedef struct
-{
-	link_t grid[AREA_GRIDNODES];
-	link_t outside;
-	Vec3 bias;
-	Vec3 scale;
+#define LOOSE_GRID_MAX_LEVELS 8
+#define LOOSE_GRID_MAX_CELLS 16384 // cells on the finest level
+#define LOOSE_GRID_MIN_CELL_SIZE 64.0f
+
+#define LOOSE_GRID_NOT_LINKED U32_MAX
+
+struct LooseGridLevel {
+	float cell_size;
+	float inv_cell_size;
+	int dims[ 3 ];
+	u32 first_cell;
+	u32 num_entities;
+};
+
+struct LooseGrid {
 	Vec3 mins;
-	Vec3 maxs;
-	Vec3 size;
-	int marknumber;
+	LooseGridLevel levels[ LOOSE_GRID_MAX_LEVELS ];
+	int num_levels;
+
+	// list heads for every cell of every level, plus one for entities that
+	// are too big or not inside the grid. 0 terminates because the world
+	// never gets linked
+	u16 heads[ LOOSE_GRID_MAX_CELLS * 2 + 1 ];
+	u32 outside;
+
+	float absmin_x[ MAX_EDICTS ], absmin_y[ MAX_EDICTS ], absmin_z[ MAX_EDICTS ];
+	float absmax_x[ MAX_EDICTS ], absmax_y[ MAX_EDICTS ], absmax_z[ MAX_EDICTS ];
+	u16 next[ MAX_EDICTS ];
+	u16 prev[ MAX_EDICTS ];
+	u32 cell[ MAX_EDICTS ];
+	u8 level[ MAX_EDICTS ];
+
+	// copies of ent->r.areanum/areanum2 for GClipAreaFilter
+	s16 area[ MAX_EDICTS ];
+	s16 area2[ MAX_EDICTS ];
+};
+
+STATIC_ASSERT( MAX_EDICTS <= U16_MAX );
+
+static LooseGrid g_grid;
+
+//===============================================================================
+//
+// brush triggers that exist once the map has spawned almost never move, so they
+// get pulled out into a flat list with their collision models looked up up
+// front, and triggers that are a single axial brush reduce contact to a box
+// test. relinking one somewhere else or unlinking it drops it from the list and
+// it goes back through the grid like any other trigger
+//
+// clients also keep the list of static triggers near them between frames, and
+// only search the list again once they leave the padded bounds it was built for
+//
+//===============================================================================
 
-	// since the areagrid can have multiple references to one entity,
-	// we should avoid extensive checking on entities already encountered
-	int entmarknumber[MAX_EDICTS];
-} areagrid_t;
+#define MAX_STATIC_TRIGGERS 1024
+#define TRIGGER_CACHE_SIZE 64
+#define TRIGGER_CACHE_PADDING 128.0f
+
+struct StaticTrigger {
+	int entNum; // -1 once it's been dropped
+	StringHash model;
+	MinMax3 absbounds;
+	cmodel_t * cmodel;
+	bool is_box;
+	MinMax3 box; // world space
+};
+
+struct StaticTriggers {
+	StaticTrigger triggers[ MAX_STATIC_TRIGGERS ];
+	int num_triggers;
+	s16 index[ MAX_EDICTS ]; // -1 if not a static trigger
+	u32 generation;
+};
+
+struct TriggerTouchCache {
+	u32 generation;
+	MinMax3 bounds;
+	int num_triggers; // -1 if there were too many to cache
+	u16 triggers[ TRIGGER_CACHE_SIZE ];
+};
+
+STATIC_ASSERT( MAX_STATIC_TRIGGERS <= S16_MAX );
 
-static areagrid_t g_areagrid;
+static StaticTriggers g_static_triggers;
+static TriggerTouchCache g_trigger_caches[ MAX_CLIENTS ];
 
-#define CFRAME_UPDATE_BACKUP    64  // copies of SyncEntityState to keep buffered (1 second of backup at 62 fps).
+#define CFRAME_UPDATE_BACKUP    128  // frames of history to keep (1 second of backup at 125 fps).
 #define CFRAME_UPDATE_MASK  ( CFRAME_UPDATE_BACKUP - 1 )
 
 struct c4clipedict_t {
@@ -60,378 +141,546 @@ struct c4clipedict_t {
 	entity_shared_t r;
 };
 
-//backups of all server frames areas and edicts
-struct c4frame_t {
-	c4clipedict_t clipEdicts[MAX_EDICTS];
-	int numedicts;
+/*
+* lag compensation history
+*
+* each entity keeps its own ring of states and only gets a new one when it
+* changes, so static entities cost nothing per frame. the ring will always
+* have the newest record at or before any of the backed up frames, because
+* there can only be CFRAME_UPDATE_BACKUP - 1 records newer than it
+*
+* lookups only read the history, so they're safe to call from multiple
+* threads as long as GClip_BackUpCollisionFrame isn't running
+*/
 
-	int64_t timestamp;
+struct ClipHistoryRecord {
 	int64_t framenum;
+	c4clipedict_t clip;
+};
+
+struct ClipHistory {
+	ClipHistoryRecord records[ CFRAME_UPDATE_BACKUP ];
+	u32 head; // total records ever added, newest is head - 1
+	int64_t state_since; // first backed up frame with the current inuse/solid
+	bool inuse;
+	int solid;
 };
 
-static c4frame_t sv_collisionframes[CFRAME_UPDATE_BACKUP];
+static ClipHistory sv_cliphistory[ MAX_EDICTS ];
+static int64_t sv_collisionframe_timestamps[ CFRAME_UPDATE_BACKUP ];
 static int64_t sv_collisionFrameNum = 0;
 
-void GClip_BackUpCollisionFrame() {
-	c4frame_t *cframe;
-	edict_t *svedict;
-	int i;
+static bool GClip_HasHistory( int entNum, bool inuse, int solid ) {
+	return inuse && solid != SOLID_NOT && ( solid != SOLID_TRIGGER || ( entNum >= 1 && entNum <= server_gs.maxclients ) );
+}
+
+static int64_t GClip_FrameTimestamp( int64_t framenum ) {
+	return sv_collisionframe_timestamps[ framenum & CFRAME_UPDATE_MASK ];
+}
 
-	// fixme: should check for any validation here?
+void GClip_BackUpCollisionFrame() {
+	ZoneScoped;
 
-	cframe = &sv_collisionframes[sv_collisionFrameNum & CFRAME_UPDATE_MASK];
-	cframe->timestamp = svs.gametime;
-	cframe->framenum = sv_collisionFrameNum;
+	int64_t framenum = sv_collisionFrameNum;
+	sv_collisionframe_timestamps[ framenum & CFRAME_UPDATE_MASK ] = svs.gametime;
 	sv_collisionFrameNum++;
 
-	//memset( cframe->clipEdicts, 0, sizeof(cframe->clipEdicts) );
+	for( int i = 0; i < game.numentities; i++ ) {
+		const edict_t * svedict = &game.edicts[ i ];
+		ClipHistory * history = &sv_cliphistory[ i ];
 
-	//backup edicts
-	for( i = 0; i < game.numentities; i++ ) {
-		svedict = &game.edicts[i];
+		bool state_changed = framenum == 0 || svedict->r.inuse != history->inuse || svedict->r.solid != history->solid;
+		if( state_changed ) {
+			history->inuse = svedict->r.inuse;
+			history->solid = svedict->r.solid;
+			history->state_since = framenum;
+		}
 
-		cframe->clipEdicts[i].r.inuse = svedict->r.inuse;
-		cframe->clipEdicts[i].r.solid = svedict->r.solid;
-		if( !svedict->r.inuse || svedict->r.solid == SOLID_NOT
-			|| ( svedict->r.solid == SOLID_TRIGGER && !( i >= 1 && i <= server_gs.maxclients ) ) ) {
+		if( !GClip_HasHistory( i, svedict->r.inuse, svedict->r.solid ) ) {
 			continue;
 		}
 
-		cframe->clipEdicts[i].r = svedict->r;
-		cframe->clipEdicts[i].s = svedict->s;
+		if( !state_changed && history->head > 0 ) {
+			const c4clipedict_t * newest = &history->records[ ( history->head - 1 ) & CFRAME_UPDATE_MASK ].clip;
+			if( memcmp( &newest->s, &svedict->s, sizeof( newest->s ) ) == 0 && memcmp( &newest->r, &svedict->r, sizeof( newest->r ) ) == 0 ) {
+				continue;
+			}
+		}
+
+		ClipHistoryRecord * record = &history->records[ history->head & CFRAME_UPDATE_MASK ];
+		record->framenum = framenum;
+		record->clip.s = svedict->s;
+		record->clip.r = svedict->r;
+		history->head++;
+	}
+
+	// entities past numentities aren't in use, make sure they don't look like
+	// they were solid the whole time if they get spawned later
+	for( int i = game.numentities; i < MAX_EDICTS; i++ ) {
+		ClipHistory * history = &sv_cliphistory[ i ];
+		if( history->inuse || framenum == 0 ) {
+			history->inuse = false;
+			history->solid = SOLID_NOT;
+			history->state_since = framenum;
+		}
+	}
+}
+
+/*
+* GClip_ClipEdictAtFrame
+*
+* Finds the newest record at or before framenum with a binary search
+*/
+static const c4clipedict_t * GClip_ClipEdictAtFrame( const ClipHistory * history, int64_t framenum ) {
+	u32 oldest = history->head - Min2( history->head, u32( CFRAME_UPDATE_BACKUP ) );
+	u32 lo = oldest;
+	u32 hi = history->head;
+	while( hi - lo > 1 ) {
+		u32 mid = lo + ( hi - lo ) / 2;
+		if( history->records[ mid & CFRAME_UPDATE_MASK ].framenum <= framenum ) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
 	}
-	cframe->numedicts = game.numentities;
+
+	assert( history->records[ lo & CFRAME_UPDATE_MASK ].framenum <= framenum );
+	return &history->records[ lo & CFRAME_UPDATE_MASK ].clip;
 }
 
-static c4clipedict_t *GClip_GetClipEdictForDeltaTime( int entNum, int deltaTime ) {
-	static int index = 0;
-	static c4clipedict_t clipEnts[8];
-	static c4clipedict_t *clipent;
-	static c4clipedict_t clipentNewer; // for interpolation
-	c4frame_t *cframe = NULL;
-	int64_t backTime, cframenum;
-	unsigned bf;
-	edict_t *ent = game.edicts + entNum;
+/*
+* GClip_GetClipEdictForDeltaTime
+*
+* Returns a pointer into the history, or writes the entity into scratch
+* and returns that when it has to be interpolated or is the current entity
+*/
+static const c4clipedict_t * GClip_CurrentClipEdict( const edict_t * ent, c4clipedict_t * scratch ) {
+	scratch->s = ent->s;
+	scratch->r = ent->r;
+	return scratch;
+}
 
-	// pick one of the 8 slots to prevent overwritings
-	clipent = &clipEnts[index];
-	index = ( index + 1 ) & 7;
+static const c4clipedict_t * GClip_GetClipEdictForDeltaTime( int entNum, int deltaTime, c4clipedict_t * scratch ) {
+	const edict_t * ent = game.edicts + entNum;
 
 	if( !entNum || deltaTime >= 0 ) { // current time entity
-		clipent->r = ent->r;
-		clipent->s = ent->s;
-		return clipent;
+		return GClip_CurrentClipEdict( ent, scratch );
 	}
 
-	if( !ent->r.inuse || ent->r.solid == SOLID_NOT
-		|| ( ent->r.solid == SOLID_TRIGGER && !( entNum >= 1 && entNum <= server_gs.maxclients ) ) ) {
-		clipent->r = ent->r;
-		clipent->s = ent->s;
-		return clipent;
+	const ClipHistory * history = &sv_cliphistory[ entNum ];
+
+	if( !GClip_HasHistory( entNum, ent->r.inuse, ent->r.solid ) ) {
+		return GClip_CurrentClipEdict( ent, scratch );
 	}
 
 	// always use the latest information about moving world brushes
 	if( ent->movetype == MOVETYPE_PUSH ) {
-		clipent->r = ent->r;
-		clipent->s = ent->s;
-		return clipent;
+		return GClip_CurrentClipEdict( ent, scratch );
 	}
 
-	// clamp delta time inside the backed up limits
-	backTime = Abs( deltaTime );
-	if( g_antilag_maxtimedelta->integer ) {
-		if( g_antilag_maxtimedelta->integer < 0 ) {
-			Cvar_SetValue( "g_antilag_maxtimedelta", Abs( g_antilag_maxtimedelta->integer ) );
-		}
-		if( backTime > (int64_t)g_antilag_maxtimedelta->integer ) {
-			backTime = (int64_t)g_antilag_maxtimedelta->integer;
-		}
+	// if solid has changed since the last backup we can't step back at all
+	if( sv_collisionFrameNum < 2 || ent->r.inuse != history->inuse || ent->r.solid != history->solid ) {
+		return GClip_CurrentClipEdict( ent, scratch );
 	}
 
-	// find the first snap with timestamp < than realtime - backtime
-	cframenum = sv_collisionFrameNum;
-	for( bf = 1; bf < CFRAME_UPDATE_BACKUP && bf < sv_collisionFrameNum; bf++ ) { // never overpass limits
-		cframe = &sv_collisionframes[( cframenum - bf ) & CFRAME_UPDATE_MASK];
-
-		// if solid has changed, we can't keep moving backwards
-		if( ent->r.solid != cframe->clipEdicts[entNum].r.solid
-			|| ent->r.inuse != cframe->clipEdicts[entNum].r.inuse ) {
-			bf--;
-			if( bf == 0 ) {
-				// we can't step back from first
-				cframe = NULL;
-			} else {
-				cframe = &sv_collisionframes[( cframenum - bf ) & CFRAME_UPDATE_MASK];
-			}
-			break;
-		}
+	// clamp delta time inside the backed up limits
+	int64_t backTime = Abs( deltaTime );
+	int64_t maxtimedelta = Abs( g_antilag_maxtimedelta->integer );
+	if( maxtimedelta != 0 ) {
+		backTime = Min2( backTime, maxtimedelta );
+	}
 
-		if( svs.gametime >= cframe->timestamp + backTime ) {
-			break;
+	// find the first frame with timestamp <= realtime - backtime. timestamps
+	// go back in time as bf grows, so binary search for it
+	int64_t cframenum = sv_collisionFrameNum;
+	int64_t max_bf = Min2( int64_t( CFRAME_UPDATE_BACKUP - 1 ), cframenum - 1 );
+	int64_t lo = 1;
+	int64_t hi = max_bf + 1;
+	while( lo < hi ) {
+		int64_t mid = lo + ( hi - lo ) / 2;
+		if( svs.gametime >= GClip_FrameTimestamp( cframenum - mid ) + backTime ) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
 		}
 	}
+	int64_t bf = Min2( lo, max_bf );
+
+	// if solid has changed, we can't keep moving backwards
+	int64_t max_solid_bf = cframenum - history->state_since;
+	bool interpolate = true;
+	if( bf > max_solid_bf ) {
+		bf = max_solid_bf;
+		interpolate = false;
+	}
 
-	if( !cframe ) {
-		// current time entity
-		clipent->r = ent->r;
-		clipent->s = ent->s;
-		return clipent;
+	if( bf == 0 ) {
+		return GClip_CurrentClipEdict( ent, scratch );
 	}
 
-	// setup with older for the data that is not interpolated
-	*clipent = cframe->clipEdicts[entNum];
+	int64_t framenum = cframenum - bf;
+	int64_t timestamp = GClip_FrameTimestamp( framenum );
+	const c4clipedict_t * older = GClip_ClipEdictAtFrame( history, framenum );
 
 	// if we found an older than desired backtime frame, interpolate to find a more precise position.
-	if( svs.gametime > cframe->timestamp + backTime ) {
-		float lerpFrac;
-
-		if( bf == 1 ) {
-			// interpolate from 1st backed up to current
-			lerpFrac = (float)( ( svs.gametime - backTime ) - cframe->timestamp )
-					   / (float)( svs.gametime - cframe->timestamp );
-			clipentNewer.r = ent->r;
-			clipentNewer.s = ent->s;
-		} else {
-			// interpolate between 2 backed up
-			c4frame_t *cframeNewer = &sv_collisionframes[( cframenum - ( bf - 1 ) ) & CFRAME_UPDATE_MASK];
-			lerpFrac = (float)( ( svs.gametime - backTime ) - cframe->timestamp )
-					   / (float)( cframeNewer->timestamp - cframe->timestamp );
-			clipentNewer = cframeNewer->clipEdicts[entNum];
-		}
-
-		// interpolate
-		clipent->s.origin = Lerp( clipent->s.origin, lerpFrac, clipentNewer.s.origin );
-		clipent->r.mins = Lerp( clipent->r.mins, lerpFrac, clipentNewer.r.mins );
-		clipent->r.maxs = Lerp( clipent->r.maxs, lerpFrac, clipentNewer.r.maxs );
-		clipent->s.angles = LerpAngles( clipent->s.angles, lerpFrac, clipentNewer.s.angles );
+	if( !interpolate || svs.gametime <= timestamp + backTime ) {
+		return older;
 	}
 
-	// back time entity
-	return clipent;
-}
-
-// ClearLink is used for new headnodes
-static void GClip_ClearLink( link_t *l ) {
-	l->prev = l->next = l;
-	l->entNum = 0;
-}
+	float lerpFrac;
+	c4clipedict_t newer;
+	if( bf == 1 ) {
+		// interpolate from 1st backed up to current
+		lerpFrac = (float)( ( svs.gametime - backTime ) - timestamp ) / (float)( svs.gametime - timestamp );
+		newer.s = ent->s;
+		newer.r = ent->r;
+	} else {
+		// interpolate between 2 backed up
+		int64_t newerTimestamp = GClip_FrameTimestamp( framenum + 1 );
+		lerpFrac = (float)( ( svs.gametime - backTime ) - timestamp ) / (float)( newerTimestamp - timestamp );
+		newer = *GClip_ClipEdictAtFrame( history, framenum + 1 );
+	}
 
-static void GClip_RemoveLink( link_t *l ) {
-	l->next->prev = l->prev;
-	l->prev->next = l->next;
-	l->entNum = 0;
-}
+	// setup with older for the data that is not interpolated
+	*scratch = *older;
+	scratch->s.origin = Lerp( older->s.origin, lerpFrac, newer.s.origin );
+	scratch->r.mins = Lerp( older->r.mins, lerpFrac, newer.r.mins );
+	scratch->r.maxs = Lerp( older->r.maxs, lerpFrac, newer.r.maxs );
+	scratch->s.angles = LerpAngles( older->s.angles, lerpFrac, newer.s.angles );
 
-static void GClip_InsertLinkBefore( link_t *l, link_t *before, int entNum ) {
-	l->next = before;
-	l->prev = before->prev;
-	l->prev->next = l;
-	l->next->prev = l;
-	l->entNum = entNum;
+	// back time entity
+	return scratch;
 }
 
 /*
-* GClip_Init_AreaGrid
+* GClip_InitGrid
 */
-static void GClip_Init_AreaGrid( areagrid_t *areagrid, Vec3 world_mins, Vec3 world_maxs ) {
-	// the areagrid_marknumber is not allowed to be 0
-	if( areagrid->marknumber < 1 ) {
-		areagrid->marknumber = 1;
+static void GClip_InitGrid( LooseGrid * grid, Vec3 world_mins, Vec3 world_maxs ) {
+	Vec3 size = Vec3(
+		Max2( world_maxs.x - world_mins.x, LOOSE_GRID_MIN_CELL_SIZE ),
+		Max2( world_maxs.y - world_mins.y, LOOSE_GRID_MIN_CELL_SIZE ),
+		Max2( world_maxs.z - world_mins.z, LOOSE_GRID_MIN_CELL_SIZE )
+	);
+
+	// pick the finest cell size that keeps the bottom level under LOOSE_GRID_MAX_CELLS
+	float cell_size = Max2( LOOSE_GRID_MIN_CELL_SIZE, cbrtf( size.x * size.y * size.z / LOOSE_GRID_MAX_CELLS ) );
+	while( ceilf( size.x / cell_size ) * ceilf( size.y / cell_size ) * ceilf( size.z / cell_size ) > LOOSE_GRID_MAX_CELLS ) {
+		cell_size *= 1.25f;
 	}
 
-	// choose either the world box size, or a larger box to ensure the grid isn't too fine
-	areagrid->size.x = Max2( world_maxs.x - world_mins.x, AREA_GRID * AREA_GRIDMINSIZE );
-	areagrid->size.y = Max2( world_maxs.y - world_mins.y, AREA_GRID * AREA_GRIDMINSIZE );
-	areagrid->size.z = Max2( world_maxs.z - world_mins.z, AREA_GRID * AREA_GRIDMINSIZE );
+	grid->mins = world_mins;
+	grid->num_levels = 0;
+
+	u32 num_cells = 0;
+	while( grid->num_levels < LOOSE_GRID_MAX_LEVELS ) {
+		LooseGridLevel level;
+		level.cell_size = cell_size;
+		level.inv_cell_size = 1.0f / cell_size;
+		level.first_cell = num_cells;
+		level.num_entities = 0;
+
+		u32 level_cells = 1;
+		for( int i = 0; i < 3; i++ ) {
+			level.dims[ i ] = Max2( 1, int( ceilf( size[ i ] / cell_size ) ) );
+			level_cells *= level.dims[ i ];
+		}
+
+		if( num_cells + level_cells >= ARRAY_COUNT( grid->heads ) ) {
+			break;
+		}
 
-	// figure out the corners of such a box, centered at the center of the world box
-	areagrid->mins.x = ( world_mins.x + world_maxs.x - areagrid->size.x ) * 0.5f;
-	areagrid->mins.y = ( world_mins.y + world_maxs.y - areagrid->size.y ) * 0.5f;
-	areagrid->mins.z = ( world_mins.z + world_maxs.z - areagrid->size.z ) * 0.5f;
-	areagrid->maxs.x = ( world_mins.x + world_maxs.x + areagrid->size.x ) * 0.5f;
-	areagrid->maxs.y = ( world_mins.y + world_maxs.y + areagrid->size.y ) * 0.5f;
-	areagrid->maxs.z = ( world_mins.z + world_maxs.z + areagrid->size.z ) * 0.5f;
+		grid->levels[ grid->num_levels ] = level;
+		grid->num_levels++;
+		num_cells += level_cells;
 
-	// now calculate the actual useful info from that
-	areagrid->bias = -areagrid->mins;
-	areagrid->scale = float( AREA_GRID ) / areagrid->size;
+		if( level_cells == 1 ) {
+			break;
+		}
 
-	GClip_ClearLink( &areagrid->outside );
-	for( int i = 0; i < AREA_GRIDNODES; i++ ) {
-		GClip_ClearLink( &areagrid->grid[i] );
+		cell_size *= 2.0f;
 	}
 
-	memset( areagrid->entmarknumber, 0, sizeof( areagrid->entmarknumber ) );
+	grid->outside = num_cells;
+
+	memset( grid->heads, 0, sizeof( grid->heads ) );
+	for( u32 & cell : grid->cell ) {
+		cell = LOOSE_GRID_NOT_LINKED;
+	}
 
 	if( developer->integer ) {
-		Com_Printf( "areagrid settings: divisions %ix%ix1 : box %f %f %f "
-					": %f %f %f size %f %f %f grid %f %f %f (mingrid %f)\n",
-					AREA_GRID, AREA_GRID,
-					areagrid->mins.x, areagrid->mins.y, areagrid->mins.z,
-					areagrid->maxs.x, areagrid->maxs.y, areagrid->maxs.z,
-					areagrid->size.x, areagrid->size.y, areagrid->size.z,
-					1.0f / areagrid->scale.x, 1.0f / areagrid->scale.y, 1.0f / areagrid->scale.z,
-					AREA_GRIDMINSIZE );
+		const LooseGridLevel & bottom = grid->levels[ 0 ];
+		Com_Printf( "loose grid: %i levels, %u cells, bottom level %ix%ix%i with cell size %f\n",
+			grid->num_levels, num_cells, bottom.dims[ 0 ], bottom.dims[ 1 ], bottom.dims[ 2 ], bottom.cell_size );
 	}
 }
 
 /*
-* GClip_UnlinkEntity_AreaGrid
+* GClip_GridCellForBounds
 */
-static void GClip_UnlinkEntity_AreaGrid( edict_t *ent ) {
-	for( int i = 0; i < MAX_ENT_AREAS; i++ ) {
-		if( !ent->areagrid[i].prev ) {
-			break;
+static u32 GClip_GridCellForBounds( const LooseGrid * grid, Vec3 absmin, Vec3 absmax, int * level_idx ) {
+	Vec3 extents = absmax - absmin;
+	float extent = Max2( extents.x, Max2( extents.y, extents.z ) );
+	Vec3 centre = ( absmin + absmax ) * 0.5f - grid->mins;
+
+	for( int i = 0; i < grid->num_levels; i++ ) {
+		const LooseGridLevel * level = &grid->levels[ i ];
+		if( extent > level->cell_size ) {
+			continue;
+		}
+
+		int coords[ 3 ];
+		for( int j = 0; j < 3; j++ ) {
+			float c = centre[ j ] * level->inv_cell_size;
+			if( !( c >= 0.0f && c < level->dims[ j ] ) ) {
+				return grid->outside;
+			}
+			coords[ j ] = int( c );
 		}
-		GClip_RemoveLink( &ent->areagrid[i] );
-		ent->areagrid[i].prev = ent->areagrid[i].next = NULL;
+
+		*level_idx = i;
+		return level->first_cell + ( coords[ 2 ] * level->dims[ 1 ] + coords[ 1 ] ) * level->dims[ 0 ] + coords[ 0 ];
+	}
+
+	return grid->outside;
+}
+
+static void GClip_GridInsert( LooseGrid * grid, int entNum, u32 cell, int level ) {
+	u16 head = grid->heads[ cell ];
+	grid->next[ entNum ] = head;
+	grid->prev[ entNum ] = 0;
+	if( head != 0 ) {
+		grid->prev[ head ] = entNum;
+	}
+	grid->heads[ cell ] = entNum;
+	grid->cell[ entNum ] = cell;
+	grid->level[ entNum ] = level;
+	if( cell != grid->outside ) {
+		grid->levels[ level ].num_entities++;
+	}
+}
+
+static void GClip_GridRemove( LooseGrid * grid, int entNum ) {
+	u16 next = grid->next[ entNum ];
+	u16 prev = grid->prev[ entNum ];
+	if( prev != 0 ) {
+		grid->next[ prev ] = next;
+	} else {
+		grid->heads[ grid->cell[ entNum ] ] = next;
+	}
+	if( next != 0 ) {
+		grid->prev[ next ] = prev;
 	}
+	if( grid->cell[ entNum ] != grid->outside ) {
+		grid->levels[ grid->level[ entNum ] ].num_entities--;
+	}
+	grid->cell[ entNum ] = LOOSE_GRID_NOT_LINKED;
 }
 
 /*
-* GClip_LinkEntity_AreaGrid
+* GClip_LinkEntity_Grid
 */
-static void GClip_LinkEntity_AreaGrid( areagrid_t *areagrid, edict_t *ent ) {
-	link_t *grid;
-	int igrid[3], igridmins[3], igridmaxs[3], gridnum, entitynumber;
-
-	entitynumber = ENTNUM( ent );
-	if( entitynumber <= 0 || entitynumber >= game.maxentities || &game.edicts[ entitynumber ] != ent ) {
-		Com_Printf( "GClip_LinkEntity_AreaGrid: invalid edict %p "
+static void GClip_LinkEntity_Grid( LooseGrid * grid, edict_t *ent ) {
+	int entNum = ENTNUM( ent );
+	if( entNum <= 0 || entNum >= game.maxentities || &game.edicts[ entNum ] != ent ) {
+		Com_Printf( "GClip_LinkEntity_Grid: invalid edict %p "
 					"(edicts is %p, edict compared to prog->edicts is %i)\n",
-					(void *)ent, game.edicts, entitynumber );
+					(void *)ent, game.edicts, entNum );
 		return;
 	}
 
-	igridmins[0] = (int) floorf( ( ent->r.absmin.x + areagrid->bias.x ) * areagrid->scale.x );
-	igridmins[1] = (int) floorf( ( ent->r.absmin.y + areagrid->bias.y ) * areagrid->scale.y );
+	grid->absmin_x[ entNum ] = ent->r.absmin.x;
+	grid->absmin_y[ entNum ] = ent->r.absmin.y;
+	grid->absmin_z[ entNum ] = ent->r.absmin.z;
+	grid->absmax_x[ entNum ] = ent->r.absmax.x;
+	grid->absmax_y[ entNum ] = ent->r.absmax.y;
+	grid->absmax_z[ entNum ] = ent->r.absmax.z;
+	grid->area[ entNum ] = ent->r.areanum;
+	grid->area2[ entNum ] = ent->r.areanum2;
+
+	// most relinks are small moves that stay in the same cell
+	int level = 0;
+	u32 cell = GClip_GridCellForBounds( grid, ent->r.absmin, ent->r.absmax, &level );
+	if( cell == grid->cell[ entNum ] ) {
+		return;
+	}
 
-	//igridmins[2] = (int) floorf( (ent->r.absmin[2] + areagrid->bias[2]) * areagrid->scale[2] );
-	igridmaxs[0] = (int) floorf( ( ent->r.absmax.x + areagrid->bias.x ) * areagrid->scale.x ) + 1;
-	igridmaxs[1] = (int) floorf( ( ent->r.absmax.y + areagrid->bias.y ) * areagrid->scale.y ) + 1;
+	if( grid->cell[ entNum ] != LOOSE_GRID_NOT_LINKED ) {
+		GClip_GridRemove( grid, entNum );
+	}
+	GClip_GridInsert( grid, entNum, cell, level );
+}
 
-	//igridmaxs[2] = (int) floorf( (ent->r.absmax[2] + areagrid->bias[2]) * areagrid->scale[2] ) + 1;
-	if( igridmins[0] < 0 || igridmaxs[0] > AREA_GRID
-		|| igridmins[1] < 0 || igridmaxs[1] > AREA_GRID
-		|| ( ( igridmaxs[0] - igridmins[0] ) * ( igridmaxs[1] - igridmins[1] ) ) > MAX_ENT_AREAS ) {
-		// wow, something outside the grid, store it as such
-		GClip_InsertLinkBefore( &ent->areagrid[0], &areagrid->outside, entitynumber );
-		return;
+/*
+* GClip_UnlinkEntity_Grid
+*/
+static void GClip_UnlinkEntity_Grid( LooseGrid * grid, edict_t *ent ) {
+	int entNum = ENTNUM( ent );
+	if( grid->cell[ entNum ] != LOOSE_GRID_NOT_LINKED ) {
+		GClip_GridRemove( grid, entNum );
 	}
+}
 
-	gridnum = 0;
-	for( igrid[1] = igridmins[1]; igrid[1] < igridmaxs[1]; igrid[1]++ ) {
-		grid = areagrid->grid + igrid[1] * AREA_GRID + igridmins[0];
-		for( igrid[0] = igridmins[0]; igrid[0] < igridmaxs[0]; igrid[0]++, grid++, gridnum++ )
-			GClip_InsertLinkBefore( &ent->areagrid[gridnum], grid, entitynumber );
+static bool GClip_SolidMatchesAreaType( int solid, int areatype ) {
+	if( areatype == AREA_TRIGGERS && solid != SOLID_TRIGGER ) {
+		return false;
 	}
+	if( areatype == AREA_SOLID && ( solid == SOLID_TRIGGER || solid == SOLID_NOT ) ) {
+		return false;
+	}
+	return true;
 }
 
 /*
-* GClip_EntitiesInBox_AreaGrid
+* areas a trace can reach without going through a closed areaportal. a
+* closed portal always has a solid door in it, so entities that aren't
+* connected to any area the trace starts in can't be hit first
 */
-static int GClip_EntitiesInBox_AreaGrid( areagrid_t *areagrid, Vec3 mins, Vec3 maxs, int *list, int maxcount, int areatype, int timeDelta ) {
-	int numlist;
-	link_t *grid;
-	link_t *l;
-	c4clipedict_t *clipEnt;
-	Vec3 paddedmins, paddedmaxs;
-	int igrid[3], igridmins[3], igridmaxs[3];
+#define MAX_CLIP_FILTER_AREAS 4
 
-	paddedmins = mins;
-	paddedmaxs = maxs;
+struct GClipAreaFilter {
+	int areas[ MAX_CLIP_FILTER_AREAS ];
+	int num_areas;
+};
 
-	// FIXME: if areagrid_marknumber wraps, all entities need their
-	// ent->priv.server->areagridmarknumber reset
-	areagrid->marknumber++;
+/*
+* GClip_BuildAreaFilter
+*
+* Returns false if filtering wouldn't skip anything
+*/
+static bool GClip_BuildAreaFilter( GClipAreaFilter * filter, Vec3 mins, Vec3 maxs ) {
+	if( CM_AllAreasConnected( svs.cms ) ) {
+		return false;
+	}
 
-	igridmins[0] = (int) floorf( ( paddedmins.x + areagrid->bias.x ) * areagrid->scale.x );
-	igridmins[1] = (int) floorf( ( paddedmins.y + areagrid->bias.y ) * areagrid->scale.y );
+	int leafs[ 64 ];
+	int num_leafs = CM_BoxLeafnums( svs.cms, mins, maxs, leafs, ARRAY_COUNT( leafs ), NULL );
+	if( num_leafs >= int( ARRAY_COUNT( leafs ) ) ) {
+		return false;
+	}
 
-	//igridmins[2] = (int) ( (paddedmins[2] + areagrid->bias[2]) * areagrid->scale[2] );
-	igridmaxs[0] = (int) floorf( ( paddedmaxs.x + areagrid->bias.x ) * areagrid->scale.x ) + 1;
-	igridmaxs[1] = (int) floorf( ( paddedmaxs.y + areagrid->bias.y ) * areagrid->scale.y ) + 1;
+	filter->num_areas = 0;
+	for( int i = 0; i < num_leafs; i++ ) {
+		int area = CM_LeafArea( svs.cms, leafs[ i ] );
+		if( area < 0 ) {
+			continue;
+		}
 
-	//igridmaxs[2] = (int) ( (paddedmaxs[2] + areagrid->bias[2]) * areagrid->scale[2] ) + 1;
-	igridmins[0] = Max2( 0, igridmins[0] );
-	igridmins[1] = Max2( 0, igridmins[1] );
+		bool dupe = false;
+		for( int j = 0; j < filter->num_areas; j++ ) {
+			dupe = dupe || filter->areas[ j ] == area;
+		}
+		if( dupe ) {
+			continue;
+		}
 
-	//igridmins[2] = max( 0, igridmins[2] );
-	igridmaxs[0] = Min2( AREA_GRID, igridmaxs[0] );
-	igridmaxs[1] = Min2( AREA_GRID, igridmaxs[1] );
+		if( filter->num_areas == MAX_CLIP_FILTER_AREAS ) {
+			return false;
+		}
+		filter->areas[ filter->num_areas ] = area;
+		filter->num_areas++;
+	}
 
-	//igridmaxs[2] = min( AREA_GRID, igridmaxs[2] );
+	return filter->num_areas > 0;
+}
 
-	// paranoid debugging
-	//VectorSet( igridmins, 0, 0, 0 );VectorSet( igridmaxs, AREA_GRID, AREA_GRID, AREA_GRID );
+static bool GClip_AreaFilterAccepts( const GClipAreaFilter * filter, int area, int area2 ) {
+	if( filter == NULL || ( area < 0 && area2 < 0 ) ) {
+		return true;
+	}
 
-	numlist = 0;
+	for( int i = 0; i < filter->num_areas; i++ ) {
+		if( ( area >= 0 && CM_AreasConnected( svs.cms, filter->areas[ i ], area ) ) ||
+			( area2 >= 0 && CM_AreasConnected( svs.cms, filter->areas[ i ], area2 ) ) ) {
+			return true;
+		}
+	}
 
-	// add entities not linked into areagrid because they are too big or
-	// outside the grid bounds
-	if( areagrid->outside.next ) {
-		grid = &areagrid->outside;
-		for( l = grid->next; l != grid; l = l->next ) {
-			clipEnt = GClip_GetClipEdictForDeltaTime( l->entNum, timeDelta );
+	return false;
+}
 
-			if( areagrid->entmarknumber[l->entNum] == areagrid->marknumber ) {
+/*
+* GClip_EntitiesInCell
+*/
+static int GClip_EntitiesInCell( const LooseGrid * grid, u32 cell, Vec3 mins, Vec3 maxs, int *list, int numlist, int maxcount, int areatype, int timeDelta, const GClipAreaFilter * filter ) {
+	for( u16 e = grid->heads[ cell ]; e != 0; e = grid->next[ e ] ) {
+		if( timeDelta < 0 ) {
+			c4clipedict_t scratch;
+			const c4clipedict_t * clipEnt = GClip_GetClipEdictForDeltaTime( e, timeDelta, &scratch );
+			if( !clipEnt->r.inuse || !GClip_SolidMatchesAreaType( clipEnt->r.solid, areatype ) ) {
 				continue;
 			}
-			areagrid->entmarknumber[l->entNum] = areagrid->marknumber;
-
-			if( !clipEnt->r.inuse ) {
-				continue; // deactivated
+			if( !BoundsOverlap( mins, maxs, clipEnt->r.absmin, clipEnt->r.absmax ) ) {
+				continue;
 			}
-			if( areatype == AREA_TRIGGERS && clipEnt->r.solid != SOLID_TRIGGER ) {
+			if( !GClip_AreaFilterAccepts( filter, clipEnt->r.areanum, clipEnt->r.areanum2 ) ) {
 				continue;
 			}
-			if( areatype == AREA_SOLID &&
-				( clipEnt->r.solid == SOLID_TRIGGER || clipEnt->r.solid == SOLID_NOT ) ) {
+		} else {
+			if( mins.x > grid->absmax_x[ e ] || maxs.x < grid->absmin_x[ e ] ||
+				mins.y > grid->absmax_y[ e ] || maxs.y < grid->absmin_y[ e ] ||
+				mins.z > grid->absmax_z[ e ] || maxs.z < grid->absmin_z[ e ] ) {
 				continue;
 			}
 
-			if( BoundsOverlap( paddedmins, paddedmaxs, clipEnt->r.absmin, clipEnt->r.absmax ) ) {
-				if( numlist < maxcount ) {
-					list[numlist] = l->entNum;
-				}
-				numlist++;
+			const edict_t * ent = &game.edicts[ e ];
+			if( !ent->r.inuse || !GClip_SolidMatchesAreaType( ent->r.solid, areatype ) ) {
+				continue;
+			}
+			// CallTouches gets static triggers from GClip_StaticTriggersInBox
+			if( areatype == AREA_TRIGGERS && g_static_triggers.index[ e ] >= 0 ) {
+				continue;
+			}
+			if( !GClip_AreaFilterAccepts( filter, grid->area[ e ], grid->area2[ e ] ) ) {
+				continue;
 			}
 		}
+
+		if( numlist < maxcount ) {
+			list[ numlist ] = e;
+		}
+		numlist++;
 	}
 
-	// add grid linked entities
-	for( igrid[1] = igridmins[1]; igrid[1] < igridmaxs[1]; igrid[1]++ ) {
-		grid = areagrid->grid + igrid[1] * AREA_GRID + igridmins[0];
+	return numlist;
+}
 
-		for( igrid[0] = igridmins[0]; igrid[0] < igridmaxs[0]; igrid[0]++, grid++ ) {
-			if( !grid->next ) {
-				continue;
-			}
+/*
+* GClip_EntitiesInBox_Grid
+*/
+static int GClip_EntitiesInBox_Grid( const LooseGrid * grid, Vec3 mins, Vec3 maxs, int *list, int maxcount, int areatype, int timeDelta, const GClipAreaFilter * filter ) {
+	// add entities that are too big or outside the grid bounds
+	int numlist = GClip_EntitiesInCell( grid, grid->outside, mins, maxs, list, 0, maxcount, areatype, timeDelta, filter );
 
-			for( l = grid->next; l != grid; l = l->next ) {
-				clipEnt = GClip_GetClipEdictForDeltaTime( l->entNum, timeDelta );
+	for( int i = 0; i < grid->num_levels; i++ ) {
+		const LooseGridLevel * level = &grid->levels[ i ];
+		if( level->num_entities == 0 ) {
+			continue;
+		}
 
-				if( areagrid->entmarknumber[l->entNum] == areagrid->marknumber ) {
-					continue;
-				}
-				areagrid->entmarknumber[l->entNum] = areagrid->marknumber;
+		// find the range of cells whose loose bounds touch the box
+		float loose = level->cell_size * 0.5f;
+		int lo[ 3 ], hi[ 3 ];
+		bool empty = false;
+		for( int j = 0; j < 3; j++ ) {
+			float a = ( mins[ j ] - loose - grid->mins[ j ] ) * level->inv_cell_size;
+			float b = ( maxs[ j ] + loose - grid->mins[ j ] ) * level->inv_cell_size;
+			// clamp before truncating so it rounds down
+			lo[ j ] = int( Max2( a, 0.0f ) );
+			hi[ j ] = int( Min2( b, float( level->dims[ j ] - 1 ) ) );
+			empty = empty || b < 0.0f || a >= level->dims[ j ];
+		}
 
-				if( !clipEnt->r.inuse ) {
-					continue; // deactivated
-				}
-				if( areatype == AREA_TRIGGERS && clipEnt->r.solid != SOLID_TRIGGER ) {
-					continue;
-				}
-				if( areatype == AREA_SOLID &&
-					( clipEnt->r.solid == SOLID_TRIGGER || clipEnt->r.solid == SOLID_NOT ) ) {
-					continue;
-				}
+		if( empty ) {
+			continue;
+		}
 
-				if( BoundsOverlap( paddedmins, paddedmaxs, clipEnt->r.absmin, clipEnt->r.absmax ) ) {
-					if( numlist < maxcount ) {
-						list[numlist] = l->entNum;
+		for( int z = lo[ 2 ]; z <= hi[ 2 ]; z++ ) {
+			for( int y = lo[ 1 ]; y <= hi[ 1 ]; y++ ) {
+				u32 row = level->first_cell + ( z * level->dims[ 1 ] + y ) * level->dims[ 0 ];
+				for( int x = lo[ 0 ]; x <= hi[ 0 ]; x++ ) {
+					if( grid->heads[ row + x ] != 0 ) {
+						numlist = GClip_EntitiesInCell( grid, row + x, mins, maxs, list, numlist, maxcount, areatype, timeDelta, filter );
 					}
-					numlist++;
 				}
 			}
 		}
@@ -440,6 +689,66 @@ static int GClip_EntitiesInBox_AreaGrid( areagrid_t *areagrid, Vec3 mins, Vec3 m
 	return numlist;
 }
 
+static void GClip_ResetTraceStats();
+static void GClip_RecordTrace( TraceCorpusRecordType type, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs, int contentmask );
+
+static void GClip_ResetStaticTriggers() {
+	g_static_triggers.num_triggers = 0;
+	memset( g_static_triggers.index, -1, sizeof( g_static_triggers.index ) );
+	g_static_triggers.generation++;
+}
+
+static void GClip_DropStaticTrigger( const edict_t * ent ) {
+	int entNum = ENTNUM( ent );
+	int idx = g_static_triggers.index[ entNum ];
+	if( idx < 0 ) {
+		return;
+	}
+
+	g_static_triggers.triggers[ idx ].entNum = -1;
+	g_static_triggers.index[ entNum ] = -1;
+}
+
+/*
+* GClip_BuildStaticTriggers
+*
+* Called once the map entities have spawned
+*/
+void GClip_BuildStaticTriggers() {
+	ZoneScoped;
+
+	GClip_ResetStaticTriggers();
+
+	for( int i = server_gs.maxclients + 1; i < game.numentities; i++ ) {
+		const edict_t * ent = &game.edicts[ i ];
+		if( !ent->r.inuse || !ent->linked || ent->r.solid != SOLID_TRIGGER ) {
+			continue;
+		}
+
+		cmodel_t * cmodel = CM_TryFindCModel( CM_Server, ent->s.model );
+		if( cmodel == NULL ) {
+			continue;
+		}
+
+		if( g_static_triggers.num_triggers == MAX_STATIC_TRIGGERS ) {
+			Com_GGPrint( S_COLOR_YELLOW "Too many triggers, only indexing the first {}", MAX_STATIC_TRIGGERS );
+			break;
+		}
+
+		StaticTrigger * trigger = &g_static_triggers.triggers[ g_static_triggers.num_triggers ];
+		trigger->entNum = i;
+		trigger->model = ent->s.model;
+		trigger->absbounds = MinMax3( ent->r.absmin, ent->r.absmax );
+		trigger->cmodel = cmodel;
+		trigger->is_box = ent->s.angles == Vec3( 0.0f ) && CM_InlineModelBox( svs.cms, cmodel, &trigger->box );
+		if( trigger->is_box ) {
+			trigger->box = MinMax3( trigger->box.mins + ent->s.origin, trigger->box.maxs + ent->s.origin );
+		}
+
+		g_static_triggers.index[ i ] = g_static_triggers.num_triggers;
+		g_static_triggers.num_triggers++;
+	}
+}
 
 /*
 * GClip_ClearWorld
@@ -451,7 +760,10 @@ void GClip_ClearWorld() {
 	Vec3 world_mins, world_maxs;
 	CM_InlineModelBounds( svs.cms, world_model, &world_mins, &world_maxs );
 
-	GClip_Init_AreaGrid( &g_areagrid, world_mins, world_maxs );
+	GClip_InitGrid( &g_grid, world_mins, world_maxs );
+	GClip_ResetStaticTriggers();
+	GClip_ResetTraceStats();
+	G_StopTraceRecording();
 }
 
 /*
@@ -460,10 +772,8 @@ void GClip_ClearWorld() {
 * so it doesn't clip against itself
 */
 void GClip_UnlinkEntity( edict_t *ent ) {
-	if( !ent->linked ) {
-		return; // not linked in anywhere
-	}
-	GClip_UnlinkEntity_AreaGrid( ent );
+	GClip_UnlinkEntity_Grid( &g_grid, ent );
+	GClip_DropStaticTrigger( ent );
 	ent->linked = false;
 }
 
@@ -479,12 +789,12 @@ void GClip_LinkEntity( edict_t *ent ) {
 	int leafs[MAX_TOTAL_ENT_LEAFS];
 	int clusters[MAX_TOTAL_ENT_LEAFS];
 
-	GClip_UnlinkEntity( ent ); // unlink from old position
-
+	// entities that are already linked get moved in GClip_LinkEntity_Grid
 	if( ent == game.edicts ) {
 		return; // don't add the world
 	}
 	if( !ent->r.inuse ) {
+		GClip_UnlinkEntity( ent );
 		return;
 	}
 
@@ -577,7 +887,16 @@ void GClip_LinkEntity( edict_t *ent ) {
 	ent->linkcount++;
 	ent->linked = true;
 
-	GClip_LinkEntity_AreaGrid( &g_areagrid, ent );
+	int static_trigger = g_static_triggers.index[ ENTNUM( ent ) ];
+	if( static_trigger >= 0 ) {
+		const StaticTrigger * trigger = &g_static_triggers.triggers[ static_trigger ];
+		bool moved = ent->r.absmin != trigger->absbounds.mins || ent->r.absmax != trigger->absbounds.maxs;
+		if( moved || ent->r.solid != SOLID_TRIGGER || ent->s.model != trigger->model ) {
+			GClip_DropStaticTrigger( ent );
+		}
+	}
+
+	GClip_LinkEntity_Grid( &g_grid, ent );
 }
 
 /*
@@ -608,7 +927,7 @@ void GClip_SetAreaPortalState( edict_t *ent, bool open ) {
 * ??? does this always return the world?
 */
 int GClip_AreaEdicts( Vec3 mins, Vec3 maxs, int *list, int maxcount, int areatype, int timeDelta ) {
-	int count = GClip_EntitiesInBox_AreaGrid( &g_areagrid, mins, maxs, list, maxcount, areatype, timeDelta );
+	int count = GClip_EntitiesInBox_Grid( &g_grid, mins, maxs, list, maxcount, areatype, timeDelta, NULL );
 	return Min2( count, maxcount );
 }
 
@@ -618,7 +937,7 @@ int GClip_AreaEdicts( Vec3 mins, Vec3 maxs, int *list, int maxcount, int areatyp
 * Returns a collision model that can be used for testing or clipping an
 * object of mins/maxs size.
 */
-static cmodel_t *GClip_CollisionModelForEntity( SyncEntityState *s, entity_shared_t *r ) {
+static cmodel_t *GClip_CollisionModelForEntity( const SyncEntityState *s, const entity_shared_t *r ) {
 	cmodel_t * model = CM_TryFindCModel( CM_Server, s->model );
 	if( model != NULL ) {
 		return model;
@@ -641,7 +960,6 @@ static cmodel_t *GClip_CollisionModelForEntity( SyncEntityState *s, entity_share
 static int GClip_PointContents( Vec3 p, int timeDelta ) {
 	ZoneScoped;
 
-	c4clipedict_t *clipEnt;
 	int touch[MAX_EDICTS];
 	int i, num;
 	int contents, c2;
@@ -649,12 +967,14 @@ static int GClip_PointContents( Vec3 p, int timeDelta ) {
 
 	// get base contents from world
 	contents = CM_TransformedPointContents( CM_Server, svs.cms, p, NULL, Vec3( 0.0f ), Vec3( 0.0f ) );
+	GClip_RecordTrace( TraceCorpusRecord_PointContents, p, p, Vec3( 0.0f ), Vec3( 0.0f ), 0 );
 
 	// or in contents from all the other entities
 	num = GClip_AreaEdicts( p, p, touch, MAX_EDICTS, AREA_SOLID, timeDelta );
 
 	for( i = 0; i < num; i++ ) {
-		clipEnt = GClip_GetClipEdictForDeltaTime( touch[i], timeDelta );
+		c4clipedict_t scratch;
+		const c4clipedict_t * clipEnt = GClip_GetClipEdictForDeltaTime( touch[i], timeDelta, &scratch );
 
 		// might intersect, so do an exact clip
 		cmodel = GClip_CollisionModelForEntity( &clipEnt->s, &clipEnt->r );
@@ -685,73 +1005,97 @@ typedef struct {
 	int contentmask;
 } moveclip_t;
 
+/*
+* GClip_IgnoreEntity
+*/
+static bool GClip_IgnoreEntity( const c4clipedict_t * touch, int passent, int contentmask ) {
+	if( passent >= 0 ) {
+		// when they are offseted in time, they can be a different pointer but be the same entity
+		if( touch->s.number == passent ) {
+			return true;
+		}
+		if( touch->r.owner && ( touch->r.owner->s.number == passent ) ) {
+			return true;
+		}
+		if( game.edicts[passent].r.owner
+			&& ( game.edicts[passent].r.owner->s.number == touch->s.number ) ) {
+			return true;
+		}
+
+		// wsw : jal : never clipmove against SVF_PROJECTILE entities
+		if( touch->r.svflags & SVF_PROJECTILE ) {
+			return true;
+		}
+	}
+
+	if( ( touch->r.svflags & SVF_CORPSE ) && !( contentmask & CONTENTS_CORPSE ) ) {
+		return true;
+	}
+
+	if( touch->r.client != NULL ) {
+		int teammask = contentmask & ( CONTENTS_TEAMALPHA | CONTENTS_TEAMBETA );
+		if( teammask != 0 ) {
+			int team = teammask == CONTENTS_TEAMALPHA ? TEAM_ALPHA : TEAM_BETA;
+			if( touch->s.team != team )
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static Vec3 GClip_EntityClipAngles( const c4clipedict_t * touch ) {
+	if( CM_IsBrushModel( CM_Server, touch->s.model ) ) {
+		return touch->s.angles;
+	}
+	return Vec3( 0.0f ); // boxes don't rotate
+}
+
+/*
+* GClip_ClipToEntity
+*/
+static void GClip_ClipToEntity( trace_t * result, const c4clipedict_t * touch, cmodel_t * cmodel, Vec3 angles,
+	Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int contentmask ) {
+	trace_t trace;
+	CM_TransformedBoxTrace( CM_Server, svs.cms, NULL, &trace, start, end,
+								 mins, maxs, cmodel, contentmask,
+								 touch->s.origin, angles );
+
+	if( trace.allsolid || trace.fraction < result->fraction ) {
+		trace.ent = touch->s.number;
+		*result = trace;
+	} else if( trace.startsolid ) {
+		result->startsolid = true;
+	}
+}
+
 /*
 * GClip_ClipMoveToEntities
 */
 static void GClip_ClipMoveToEntities( moveclip_t *clip, int timeDelta ) {
 	ZoneScoped;
 
+	GClipAreaFilter filter;
+	bool use_filter = GClip_BuildAreaFilter( &filter, clip->start + clip->mins - Vec3( 1.0f ), clip->start + clip->maxs + Vec3( 1.0f ) );
+
 	int touchlist[MAX_EDICTS];
-	int num = GClip_AreaEdicts( clip->boxmins, clip->boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID, timeDelta );
+	int num = GClip_EntitiesInBox_Grid( &g_grid, clip->boxmins, clip->boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID, timeDelta, use_filter ? &filter : NULL );
+	num = Min2( num, MAX_EDICTS );
 
 	// be careful, it is possible to have an entity in this
 	// list removed before we get to it (killtriggered)
 	for( int i = 0; i < num; i++ ) {
-		c4clipedict_t * touch = GClip_GetClipEdictForDeltaTime( touchlist[i], timeDelta );
-		if( clip->passent >= 0 ) {
-			// when they are offseted in time, they can be a different pointer but be the same entity
-			if( touch->s.number == clip->passent ) {
-				continue;
-			}
-			if( touch->r.owner && ( touch->r.owner->s.number == clip->passent ) ) {
-				continue;
-			}
-			if( game.edicts[clip->passent].r.owner
-				&& ( game.edicts[clip->passent].r.owner->s.number == touch->s.number ) ) {
-				continue;
-			}
-
-			// wsw : jal : never clipmove against SVF_PROJECTILE entities
-			if( touch->r.svflags & SVF_PROJECTILE ) {
-				continue;
-			}
-		}
-
-		if( ( touch->r.svflags & SVF_CORPSE ) && !( clip->contentmask & CONTENTS_CORPSE ) ) {
+		c4clipedict_t scratch;
+		const c4clipedict_t * touch = GClip_GetClipEdictForDeltaTime( touchlist[i], timeDelta, &scratch );
+		if( GClip_IgnoreEntity( touch, clip->passent, clip->contentmask ) ) {
 			continue;
 		}
 
-		if( touch->r.client != NULL ) {
-			int teammask = clip->contentmask & ( CONTENTS_TEAMALPHA | CONTENTS_TEAMBETA );
-			if( teammask != 0 ) {
-				int team = teammask == CONTENTS_TEAMALPHA ? TEAM_ALPHA : TEAM_BETA;
-				if( touch->s.team != team )
-					continue;
-			}
-		}
-
 		// might intersect, so do an exact clip
 		cmodel_t * cmodel = GClip_CollisionModelForEntity( &touch->s, &touch->r );
+		GClip_ClipToEntity( clip->trace, touch, cmodel, GClip_EntityClipAngles( touch ),
+			clip->start, clip->mins, clip->maxs, clip->end, clip->contentmask );
 
-		Vec3 angles;
-		if( CM_IsBrushModel( CM_Server, touch->s.model ) ) {
-			angles = touch->s.angles;
-		} else {
-			angles = Vec3( 0.0f ); // boxes don't rotate
-
-		}
-
-		trace_t trace;
-		CM_TransformedBoxTrace( CM_Server, svs.cms, &trace, clip->start, clip->end,
-									 clip->mins, clip->maxs, cmodel, clip->contentmask,
-									 touch->s.origin, angles );
-
-		if( trace.allsolid || trace.fraction < clip->trace->fraction ) {
-			trace.ent = touch->s.number;
-			*( clip->trace ) = trace;
-		} else if( trace.startsolid ) {
-			clip->trace->startsolid = true;
-		}
 		if( clip->trace->allsolid ) {
 			return;
 		}
@@ -773,19 +1117,280 @@ static void GClip_TraceBounds( Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, Vec3
 }
 
 /*
-* G_Trace
+* GClip_TraceEntities
 *
-* Moves the given mins/maxs volume through the world from start to end.
-*
-* Passedict and edicts owned by passedict are explicitly not checked.
-* ------------------------------------------------------------------
-* mins and maxs are relative
-
-* if the entire move stays in a solid volume, trace.allsolid will be set,
-* trace.startsolid will be set, and trace.fraction will be 0
+* Clips a trace that has already been clipped to the world against entities
+*/
+static void GClip_TraceEntities( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs,
+								 Vec3 end, edict_t *passedict, int contentmask, int timeDelta ) {
+	if( tr->fraction == 0 ) {
+		return; // blocked by the world
+	}
 
-* if the starting point is in a solid, it will be allowed to move out
-* to an open area
+	moveclip_t clip;
+	memset( &clip, 0, sizeof( moveclip_t ) );
+	clip.trace = tr;
+	clip.contentmask = contentmask;
+	clip.start = start;
+	clip.end = end;
+	clip.mins = mins;
+	clip.maxs = maxs;
+	clip.passent = passedict ? ENTNUM( passedict ) : -1;
+
+	// create the bounding box of the entire move
+	GClip_TraceBounds( start, mins, maxs, end, &clip.boxmins, &clip.boxmaxs );
+
+	// clip to other solid entities
+	GClip_ClipMoveToEntities( &clip, timeDelta );
+}
+
+/*
+* trace stats
+*
+* with g_tracestats 1 every G_Trace/G_Trace4D/G_TraceBatch records where it
+* was called from and how long it took, and the start point gets binned
+* into a grid of TRACE_HEAT_CELL_SIZE unit cells. traces the game makes from
+* the thread pool with G_WorldTrace aren't counted
+*/
+
+#define TRACE_HEAT_CELL_SIZE 128.0f
+
+struct TraceSiteStats {
+	const char * filename;
+	int fileline;
+	u64 traces;
+	u64 calls;
+	u64 ns;
+};
+
+struct TraceHeatCell {
+	int x, y, z;
+	u64 traces;
+	u64 ns;
+};
+
+static Hashmap< TraceSiteStats, 512 > trace_sites;
+static Hashmap< TraceHeatCell, 8192 > trace_heat;
+static u64 trace_stats_dropped;
+
+static void GClip_ResetTraceStats() {
+	trace_sites.clear();
+	trace_heat.clear();
+	trace_stats_dropped = 0;
+}
+
+static u64 GClip_TraceStatsBegin() {
+	return g_tracestats->integer != 0 ? Sys_Nanoseconds() : 0;
+}
+
+static void GClip_TraceStatsEnd( u64 start_ns, const char * filename, int fileline, Vec3 start, size_t traces ) {
+	if( start_ns == 0 ) {
+		return;
+	}
+
+	u64 ns = Sys_Nanoseconds() - start_ns;
+
+	// __FILE__ strings live forever so hashing the pointer is fine
+	u64 site_key = Hash64( &filename, sizeof( filename ), fileline );
+	TraceSiteStats * site = trace_sites.get( site_key );
+	if( site == NULL ) {
+		site = trace_sites.add( site_key );
+		if( site != NULL ) {
+			*site = { };
+			site->filename = filename;
+			site->fileline = fileline;
+		}
+	}
+
+	int cell_coords[ 3 ];
+	for( int i = 0; i < 3; i++ ) {
+		cell_coords[ i ] = int( floorf( start[ i ] / TRACE_HEAT_CELL_SIZE ) );
+	}
+
+	u64 cell_key = Hash64( cell_coords, sizeof( cell_coords ) );
+	TraceHeatCell * cell = trace_heat.get( cell_key );
+	if( cell == NULL ) {
+		cell = trace_heat.add( cell_key );
+		if( cell != NULL ) {
+			*cell = { };
+			cell->x = cell_coords[ 0 ];
+			cell->y = cell_coords[ 1 ];
+			cell->z = cell_coords[ 2 ];
+		}
+	}
+
+	if( site == NULL || cell == NULL ) {
+		trace_stats_dropped++;
+		return;
+	}
+
+	site->traces += traces;
+	site->calls++;
+	site->ns += ns;
+	cell->traces += traces;
+	cell->ns += ns;
+}
+
+static void GClip_DumpTraceHeatmap() {
+	DynamicString csv( sys_allocator, "x,y,z,traces,ns\n" );
+	for( size_t i = 0; i < trace_heat.n; i++ ) {
+		const TraceHeatCell * cell = &trace_heat.values[ i ];
+		csv.append( "{},{},{},{},{}\n",
+			int( ( cell->x + 0.5f ) * TRACE_HEAT_CELL_SIZE ),
+			int( ( cell->y + 0.5f ) * TRACE_HEAT_CELL_SIZE ),
+			int( ( cell->z + 0.5f ) * TRACE_HEAT_CELL_SIZE ),
+			cell->traces, cell->ns );
+	}
+
+	TempAllocator temp = svs.frame_arena.temp();
+	const char * path = temp( "tracestats/{}.csv", sv.mapname );
+	if( !WriteFile( &temp, path, csv.c_str(), csv.length() ) ) {
+		Com_Printf( "Couldn't write %s\n", path );
+		return;
+	}
+
+	Com_Printf( "Wrote %zu cells to %s\n", trace_heat.n, path );
+}
+
+/*
+* G_TraceStats_f
+*
+* "tracestats" prints the most expensive call sites, "tracestats dump"
+* writes the heatmap to tracestats/<map>.csv and "tracestats reset" clears
+* everything
+*/
+void G_TraceStats_f() {
+	if( Cmd_Argc() >= 2 && Q_stricmp( Cmd_Argv( 1 ), "reset" ) == 0 ) {
+		GClip_ResetTraceStats();
+		return;
+	}
+
+	if( Cmd_Argc() >= 2 && Q_stricmp( Cmd_Argv( 1 ), "dump" ) == 0 ) {
+		GClip_DumpTraceHeatmap();
+		return;
+	}
+
+	if( g_tracestats->integer == 0 ) {
+		Com_Printf( "Set g_tracestats 1 to collect trace stats\n" );
+	}
+
+	TraceSiteStats sorted[ ARRAY_COUNT( trace_sites.values ) ];
+	size_t n = trace_sites.n;
+	memcpy( sorted, trace_sites.values, n * sizeof( sorted[ 0 ] ) );
+	std::sort( sorted, sorted + n, []( const TraceSiteStats & a, const TraceSiteStats & b ) {
+		return a.ns > b.ns;
+	} );
+
+	u64 total_ns = 0;
+	for( size_t i = 0; i < n; i++ ) {
+		total_ns += sorted[ i ].ns;
+	}
+
+	Com_Printf( "%-40s %10s %10s %10s %6s\n", "site", "traces", "ms", "ns/trace", "%" );
+	for( size_t i = 0; i < Min2( n, size_t( 32 ) ); i++ ) {
+		const TraceSiteStats * site = &sorted[ i ];
+		String< 64 > name( "{}:{}", FileName( site->filename ), site->fileline );
+		Com_Printf( "%-40s %10" PRIu64 " %10.2f %10" PRIu64 " %6.1f\n", name.c_str(), site->traces,
+			site->ns / 1000000.0, site->ns / Max2( site->traces, u64( 1 ) ), 100.0 * site->ns / Max2( total_ns, u64( 1 ) ) );
+	}
+
+	if( trace_stats_dropped > 0 ) {
+		Com_Printf( "%" PRIu64 " samples dropped, the tables are full\n", trace_stats_dropped );
+	}
+}
+
+/*
+* trace recording
+*
+* "tracerecord" records every world trace and point contents the game makes
+* on the main thread, and running it again writes them to
+* tracecorpus/<map>.traces for tracebench to replay. changing map stops it.
+* like trace stats, G_WorldTrace from the thread pool isn't recorded
+*/
+
+#define MAX_TRACE_RECORDS ( 1 << 21 )
+
+static NonRAIIDynamicArray< TraceCorpusRecord > trace_records;
+static bool trace_recording;
+static char trace_recording_map[ 64 ];
+
+static void GClip_RecordTrace( TraceCorpusRecordType type, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs, int contentmask ) {
+	if( !trace_recording || trace_records.size() == MAX_TRACE_RECORDS ) {
+		return;
+	}
+
+	TraceCorpusRecord record;
+	record.start = start;
+	record.end = end;
+	record.mins = mins;
+	record.maxs = maxs;
+	record.contentmask = contentmask;
+	record.type = type;
+	trace_records.add( record );
+}
+
+void G_StopTraceRecording() {
+	if( !trace_recording ) {
+		return;
+	}
+
+	trace_recording = false;
+	defer { trace_records.shutdown(); };
+
+	TraceCorpusHeader header = { };
+	header.magic = TRACE_CORPUS_MAGIC;
+	header.num_records = trace_records.size();
+	Q_strncpyz( header.map, trace_recording_map, sizeof( header.map ) );
+
+	size_t len = sizeof( header ) + trace_records.size() * sizeof( TraceCorpusRecord );
+	u8 * data = ALLOC_MANY( sys_allocator, u8, len );
+	defer { FREE( sys_allocator, data ); };
+	memcpy( data, &header, sizeof( header ) );
+	memcpy( data + sizeof( header ), trace_records.begin(), trace_records.size() * sizeof( TraceCorpusRecord ) );
+
+	TempAllocator temp = svs.frame_arena.temp();
+	const char * path = temp( "tracecorpus/{}.traces", trace_recording_map );
+	if( !WriteFile( &temp, path, data, len ) ) {
+		Com_Printf( "Couldn't write %s\n", path );
+		return;
+	}
+
+	Com_Printf( "Wrote %u traces to %s\n", header.num_records, path );
+	if( trace_records.size() == MAX_TRACE_RECORDS ) {
+		Com_Printf( "Hit the %d trace limit, the rest weren't recorded\n", MAX_TRACE_RECORDS );
+	}
+}
+
+/*
+* G_TraceRecord_f
+*/
+void G_TraceRecord_f() {
+	if( trace_recording ) {
+		G_StopTraceRecording();
+		return;
+	}
+
+	trace_records.init( sys_allocator );
+	Q_strncpyz( trace_recording_map, sv.mapname, sizeof( trace_recording_map ) );
+	trace_recording = true;
+
+	Com_Printf( "Recording traces, run tracerecord again to stop\n" );
+}
+
+/*
+* G_Trace
+*
+* Moves the given mins/maxs volume through the world from start to end.
+*
+* Passedict and edicts owned by passedict are explicitly not checked.
+* ------------------------------------------------------------------
+* mins and maxs are relative
+
+* if the entire move stays in a solid volume, trace.allsolid will be set,
+* trace.startsolid will be set, and trace.fraction will be 0
+
+* if the starting point is in a solid, it will be allowed to move out
+* to an open area
 
 * passedict is explicitly excluded from clipping checks (normally NULL)
 */
@@ -793,8 +1398,6 @@ static void GClip_Trace( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs,
 						 Vec3 end, edict_t *passedict, int contentmask, int timeDelta ) {
 	ZoneScoped;
 
-	moveclip_t clip;
-
 	if( !tr ) {
 		return;
 	}
@@ -805,42 +1408,297 @@ static void GClip_Trace( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs,
 		tr->ent = -1;
 	} else {
 		// clip to world
-		CM_TransformedBoxTrace( CM_Server, svs.cms, tr, start, end, mins, maxs, NULL, contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
+		CM_TransformedBoxTrace( CM_Server, svs.cms, NULL, tr, start, end, mins, maxs, NULL, contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
 		tr->ent = tr->fraction < 1.0 ? world->s.number : -1;
-		if( tr->fraction == 0 ) {
-			return; // blocked by the world
+		GClip_RecordTrace( TraceCorpusRecord_BoxTrace, start, end, mins, maxs, contentmask );
+	}
+
+	GClip_TraceEntities( tr, start, mins, maxs, end, passedict, contentmask, timeDelta );
+}
+
+void _G_Trace( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, const char *filename, int fileline ) {
+	u64 stats_start = GClip_TraceStatsBegin();
+	GClip_Trace( tr, start, mins, maxs, end, passedict, contentmask, 0 );
+	GClip_TraceStatsEnd( stats_start, filename, fileline, start, 1 );
+}
+
+void _G_Trace4D( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, int timeDelta, const char *filename, int fileline ) {
+	u64 stats_start = GClip_TraceStatsBegin();
+	GClip_Trace( tr, start, mins, maxs, end, passedict, contentmask, timeDelta );
+	GClip_TraceStatsEnd( stats_start, filename, fileline, start, 1 );
+}
+
+/*
+* line of sight cache
+*
+* HUD and game logic keep asking whether one entity can see another, mostly
+* player against player every frame, which is quadratic in the player count.
+* answers are kept until the next game frame, keyed by both entities and
+* both points rounded to the unit, and anything the target can't be in the
+* PVS of never gets traced at all
+*/
+
+static Hashtable< 4096 > visibility_cache;
+
+void G_ClearVisibilityCache() {
+	visibility_cache.clear();
+}
+
+static bool G_EntityInPVS( const edict_t * ent, const uint8_t * pvs ) {
+	if( ent->r.num_clusters == -1 ) {
+		return CM_HeadnodeVisible( svs.cms, ent->r.headnode, pvs );
+	}
+
+	// not linked anywhere, let the trace decide
+	if( ent->r.num_clusters == 0 ) {
+		return true;
+	}
+
+	for( int i = 0; i < ent->r.num_clusters; i++ ) {
+		int cluster = ent->r.clusternums[ i ];
+		if( pvs[ cluster >> 3 ] & ( 1 << ( cluster & 7 ) ) ) {
+			return true;
 		}
 	}
 
-	memset( &clip, 0, sizeof( moveclip_t ) );
-	clip.trace = tr;
-	clip.contentmask = contentmask;
-	clip.start = start;
-	clip.end = end;
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.passent = passedict ? ENTNUM( passedict ) : -1;
+	return false;
+}
 
-	// create the bounding box of the entire move
-	GClip_TraceBounds( start, mins, maxs, end, &clip.boxmins, &clip.boxmaxs );
+static u64 G_VisibilityKey( const edict_t * viewer, Vec3 vieworg, const edict_t * target, Vec3 point, int contentmask ) {
+	s32 key[] = {
+		ENTNUM( viewer ), ENTNUM( target ), contentmask,
+		s32( floorf( vieworg.x ) ), s32( floorf( vieworg.y ) ), s32( floorf( vieworg.z ) ),
+		s32( floorf( point.x ) ), s32( floorf( point.y ) ), s32( floorf( point.z ) ),
+	};
 
-	// clip to other solid entities
-	GClip_ClipMoveToEntities( &clip, timeDelta );
+	// Hashtable reserves 0
+	return Max2( Hash64( key, sizeof( key ) ), u64( 1 ) );
 }
 
-void G_Trace( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask ) {
-	GClip_Trace( tr, start, mins, maxs, end, passedict, contentmask, 0 );
+/*
+* G_CanSee
+*
+* Returns true if a ray from vieworg to point, ignoring viewer, hits target
+* or nothing at all. point should be inside target
+*/
+bool G_CanSee( edict_t * viewer, Vec3 vieworg, const edict_t * target, Vec3 point, int contentmask ) {
+	if( !G_EntityInPVS( target, CM_FatPVS( svs.cms, vieworg ) ) ) {
+		return false;
+	}
+
+	u64 key = G_VisibilityKey( viewer, vieworg, target, point, contentmask );
+	u64 visible;
+	if( visibility_cache.get( key, &visible ) ) {
+		return visible != 0;
+	}
+
+	trace_t trace;
+	G_Trace( &trace, vieworg, Vec3( 0.0f ), Vec3( 0.0f ), point, viewer, contentmask );
+	visible = trace.fraction == 1.0f || trace.ent == ENTNUM( target ) ? 1 : 0;
+
+	// if it's full it just doesn't get cached
+	visibility_cache.add( key, visible );
+
+	return visible != 0;
 }
 
-void G_Trace4D( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, int timeDelta ) {
-	GClip_Trace( tr, start, mins, maxs, end, passedict, contentmask, timeDelta );
+/*
+* G_WorldTrace
+*
+* The world part of G_Trace4D, safe to call from the thread pool. Finish the
+* trace on the main thread with G_Trace4DEntities
+*/
+void G_WorldTrace( CollisionCheckCounts * checkcounts, trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int contentmask ) {
+	CM_WorldBoxTrace( CM_Server, svs.cms, checkcounts, tr, start, end, mins, maxs, contentmask );
+	tr->ent = tr->fraction < 1.0 ? world->s.number : -1;
+}
+
+void G_Trace4DEntities( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, int timeDelta ) {
+	GClip_TraceEntities( tr, start, mins, maxs, end, passedict, contentmask, timeDelta );
+}
+
+/*
+* G_RewindEntities
+*
+* Copies every solid entity in bounds at timeDelta, so rays traced against
+* the copy don't have to go through the clip history again
+*/
+struct RewoundEntity {
+	c4clipedict_t clip;
+	Vec3 angles;
+};
+
+RewoundEntities G_RewindEntities( Allocator * a, MinMax3 bounds, int timeDelta ) {
+	ZoneScoped;
+
+	int touchlist[ MAX_EDICTS ];
+	int num = GClip_AreaEdicts( bounds.mins, bounds.maxs, touchlist, MAX_EDICTS, AREA_SOLID, timeDelta );
+
+	RewoundEntities rewound;
+	rewound.ents = ALLOC_SPAN( a, RewoundEntity, num );
+	rewound.timeDelta = timeDelta;
+
+	for( int i = 0; i < num; i++ ) {
+		const c4clipedict_t * clip = GClip_GetClipEdictForDeltaTime( touchlist[ i ], timeDelta, &rewound.ents[ i ].clip );
+		rewound.ents[ i ].clip = *clip;
+		rewound.ents[ i ].angles = GClip_EntityClipAngles( clip );
+	}
+
+	return rewound;
+}
+
+void G_FreeRewoundEntities( Allocator * a, RewoundEntities * rewound ) {
+	FREE( a, rewound->ents.ptr );
+	rewound->ents = Span< RewoundEntity >();
+}
+
+MinMax3 G_TraceBatchBounds( const Vec3 * starts, const Vec3 * ends, size_t n, Vec3 mins, Vec3 maxs ) {
+	MinMax3 bounds = MinMax3::Empty();
+	for( size_t i = 0; i < n; i++ ) {
+		Vec3 box_mins, box_maxs;
+		GClip_TraceBounds( starts[ i ], mins, maxs, ends[ i ], &box_mins, &box_maxs );
+		bounds.mins = Vec3( Min2( bounds.mins.x, box_mins.x ), Min2( bounds.mins.y, box_mins.y ), Min2( bounds.mins.z, box_mins.z ) );
+		bounds.maxs = Vec3( Max2( bounds.maxs.x, box_maxs.x ), Max2( bounds.maxs.y, box_maxs.y ), Max2( bounds.maxs.z, box_maxs.z ) );
+	}
+	return bounds;
+}
+
+/*
+* G_TraceRewound
+*
+* Same as calling G_Trace4D on every ray with the snapshot's timeDelta, as
+* long as the rays stay inside the snapshot's bounds
+*/
+#define MAX_TRACE_BATCH 64
+
+static void GClip_TraceRewound( const RewoundEntities * rewound, trace_t * traces, const Vec3 * starts, const Vec3 * ends, size_t n, Vec3 mins, Vec3 maxs, edict_t * passedict, int contentmask ) {
+	ZoneScoped;
+
+	while( n > MAX_TRACE_BATCH ) {
+		GClip_TraceRewound( rewound, traces, starts, ends, MAX_TRACE_BATCH, mins, maxs, passedict, contentmask );
+		traces += MAX_TRACE_BATCH;
+		starts += MAX_TRACE_BATCH;
+		ends += MAX_TRACE_BATCH;
+		n -= MAX_TRACE_BATCH;
+	}
+
+	float box_mins_x[ MAX_TRACE_BATCH ], box_mins_y[ MAX_TRACE_BATCH ], box_mins_z[ MAX_TRACE_BATCH ];
+	float box_maxs_x[ MAX_TRACE_BATCH ], box_maxs_y[ MAX_TRACE_BATCH ], box_maxs_z[ MAX_TRACE_BATCH ];
+	bool active[ MAX_TRACE_BATCH ];
+	bool any_active = false;
+
+	for( size_t i = 0; i < n; i++ ) {
+		trace_t * tr = &traces[ i ];
+		active[ i ] = true;
+
+		if( passedict == world ) {
+			memset( tr, 0, sizeof( trace_t ) );
+			tr->fraction = 1;
+			tr->ent = -1;
+		} else {
+			// clip to world
+			CM_TransformedBoxTrace( CM_Server, svs.cms, NULL, tr, starts[ i ], ends[ i ], mins, maxs, NULL, contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
+			tr->ent = tr->fraction < 1.0 ? world->s.number : -1;
+			active[ i ] = tr->fraction != 0; // blocked by the world
+		}
+
+		Vec3 box_mins, box_maxs;
+		GClip_TraceBounds( starts[ i ], mins, maxs, ends[ i ], &box_mins, &box_maxs );
+		box_mins_x[ i ] = box_mins.x;
+		box_mins_y[ i ] = box_mins.y;
+		box_mins_z[ i ] = box_mins.z;
+		box_maxs_x[ i ] = box_maxs.x;
+		box_maxs_y[ i ] = box_maxs.y;
+		box_maxs_z[ i ] = box_maxs.z;
+
+		any_active |= active[ i ];
+	}
+
+	if( !any_active ) {
+		return;
+	}
+
+	int passent = passedict ? ENTNUM( passedict ) : -1;
+
+	for( const RewoundEntity & ent : rewound->ents ) {
+		const c4clipedict_t * touch = &ent.clip;
+		if( GClip_IgnoreEntity( touch, passent, contentmask ) ) {
+			continue;
+		}
+
+		// find the rays whose boxes touch the entity. this is branchless so
+		// the compiler can vectorise it
+		Vec3 ent_mins = touch->r.absmin;
+		Vec3 ent_maxs = touch->r.absmax;
+		bool overlaps[ MAX_TRACE_BATCH ];
+		bool any_overlap = false;
+		for( size_t j = 0; j < n; j++ ) {
+			overlaps[ j ] = active[ j ]
+				& ( box_mins_x[ j ] <= ent_maxs.x ) & ( box_mins_y[ j ] <= ent_maxs.y ) & ( box_mins_z[ j ] <= ent_maxs.z )
+				& ( box_maxs_x[ j ] >= ent_mins.x ) & ( box_maxs_y[ j ] >= ent_mins.y ) & ( box_maxs_z[ j ] >= ent_mins.z );
+			any_overlap |= overlaps[ j ];
+		}
+
+		if( !any_overlap ) {
+			continue;
+		}
+
+		// box hulls get rebuilt in place so this can't be cached in the snapshot
+		cmodel_t * cmodel = GClip_CollisionModelForEntity( &touch->s, &touch->r );
+
+		for( size_t j = 0; j < n; j++ ) {
+			if( !overlaps[ j ] ) {
+				continue;
+			}
+
+			GClip_ClipToEntity( &traces[ j ], touch, cmodel, ent.angles, starts[ j ], mins, maxs, ends[ j ], contentmask );
+			if( traces[ j ].allsolid ) {
+				active[ j ] = false;
+			}
+		}
+	}
+}
+
+void _G_TraceRewound( const RewoundEntities * rewound, trace_t * traces, const Vec3 * starts, const Vec3 * ends, size_t n, Vec3 mins, Vec3 maxs, edict_t * passedict, int contentmask, const char *filename, int fileline ) {
+	u64 stats_start = GClip_TraceStatsBegin();
+	GClip_TraceRewound( rewound, traces, starts, ends, n, mins, maxs, passedict, contentmask );
+	if( n > 0 ) {
+		GClip_TraceStatsEnd( stats_start, filename, fileline, starts[ 0 ], n );
+	}
+}
+
+/*
+* G_TraceBatch
+*
+* Same as calling G_Trace4D on every ray, but rewinds entities once for the
+* box around all of them
+*/
+void _G_TraceBatch( trace_t * traces, const Vec3 * starts, const Vec3 * ends, size_t n, Vec3 mins, Vec3 maxs, edict_t * passedict, int contentmask, int timeDelta, const char *filename, int fileline ) {
+	u64 stats_start = GClip_TraceStatsBegin();
+	if( n > 0 ) {
+		TempAllocator temp = svs.frame_arena.temp();
+		RewoundEntities rewound = G_RewindEntities( &temp, G_TraceBatchBounds( starts, ends, n, mins, maxs ), timeDelta );
+		GClip_TraceRewound( &rewound, traces, starts, ends, n, mins, maxs, passedict, contentmask );
+		GClip_TraceStatsEnd( stats_start, filename, fileline, starts[ 0 ], n );
+	}
 }
 
 bool IsHeadshot( int entNum, Vec3 hit, int timeDelta ) {
-	const c4clipedict_t * clip = GClip_GetClipEdictForDeltaTime( entNum, timeDelta );
+	c4clipedict_t scratch;
+	const c4clipedict_t * clip = GClip_GetClipEdictForDeltaTime( entNum, timeDelta, &scratch );
 	return clip->r.absmax.z - hit.z <= 16.0f;
 }
 
+bool IsHeadshot( const RewoundEntities * rewound, int entNum, Vec3 hit ) {
+	for( const RewoundEntity & ent : rewound->ents ) {
+		if( ent.clip.s.number == entNum ) {
+			return ent.clip.r.absmax.z - hit.z <= 16.0f;
+		}
+	}
+
+	return IsHeadshot( entNum, hit, rewound->timeDelta );
+}
+
 //===========================================================================
 
 
@@ -860,10 +1718,23 @@ void GClip_SetBrushModel( edict_t * ent ) {
 * GClip_EntityContact
 */
 bool GClip_EntityContact( Vec3 mins, Vec3 maxs, edict_t *ent ) {
-	cmodel_t * model = CM_TryFindCModel( CM_Server, ent->s.model );
+	cmodel_t * model;
+
+	int static_trigger = g_static_triggers.index[ ENTNUM( ent ) ];
+	if( static_trigger >= 0 ) {
+		const StaticTrigger * trigger = &g_static_triggers.triggers[ static_trigger ];
+		if( trigger->is_box ) {
+			return BoundsOverlap( mins, maxs, trigger->box.mins, trigger->box.maxs );
+		}
+		model = trigger->cmodel;
+	}
+	else {
+		model = CM_TryFindCModel( CM_Server, ent->s.model );
+	}
+
 	if( model != NULL ) {
 		trace_t tr;
-		CM_TransformedBoxTrace( CM_Server, svs.cms, &tr, Vec3( 0.0f ), Vec3( 0.0f ), mins, maxs, model,
+		CM_TransformedBoxTrace( CM_Server, svs.cms, NULL, &tr, Vec3( 0.0f ), Vec3( 0.0f ), mins, maxs, model,
 									 MASK_ALL, ent->s.origin, ent->s.angles );
 
 		return tr.startsolid || tr.allsolid ? true : false;
@@ -872,9 +1743,70 @@ bool GClip_EntityContact( Vec3 mins, Vec3 maxs, edict_t *ent ) {
 	return BoundsOverlap( mins, maxs, ent->r.absmin, ent->r.absmax );
 }
 
+static int GClip_AddStaticTrigger( int idx, Vec3 mins, Vec3 maxs, int * list, int num ) {
+	const StaticTrigger * trigger = &g_static_triggers.triggers[ idx ];
+	if( trigger->entNum < 0 || !BoundsOverlap( mins, maxs, trigger->absbounds.mins, trigger->absbounds.maxs ) ) {
+		return num;
+	}
+	list[ num ] = trigger->entNum;
+	return num + 1;
+}
+
+static bool BoundsContain( const MinMax3 & outer, Vec3 mins, Vec3 maxs ) {
+	return outer.mins.x <= mins.x && outer.mins.y <= mins.y && outer.mins.z <= mins.z &&
+		outer.maxs.x >= maxs.x && outer.maxs.y >= maxs.y && outer.maxs.z >= maxs.z;
+}
+
+/*
+* GClip_StaticTriggersInBox
+*
+* list must have room for MAX_STATIC_TRIGGERS
+*/
+static int GClip_StaticTriggersInBox( const edict_t * ent, Vec3 mins, Vec3 maxs, int * list ) {
+	if( g_static_triggers.num_triggers == 0 ) {
+		return 0;
+	}
+
+	TriggerTouchCache * cache = ent->r.client != NULL ? &g_trigger_caches[ PLAYERNUM( ent ) ] : NULL;
+	if( cache != NULL && ( cache->generation != g_static_triggers.generation || !BoundsContain( cache->bounds, mins, maxs ) ) ) {
+		cache->generation = g_static_triggers.generation;
+		cache->bounds = MinMax3( mins - Vec3( TRIGGER_CACHE_PADDING ), maxs + Vec3( TRIGGER_CACHE_PADDING ) );
+		cache->num_triggers = 0;
+
+		for( int i = 0; i < g_static_triggers.num_triggers; i++ ) {
+			const StaticTrigger * trigger = &g_static_triggers.triggers[ i ];
+			if( trigger->entNum < 0 || !BoundsOverlap( cache->bounds.mins, cache->bounds.maxs, trigger->absbounds.mins, trigger->absbounds.maxs ) ) {
+				continue;
+			}
+			if( cache->num_triggers == TRIGGER_CACHE_SIZE ) {
+				cache->num_triggers = -1;
+				break;
+			}
+			cache->triggers[ cache->num_triggers ] = i;
+			cache->num_triggers++;
+		}
+	}
+
+	int num = 0;
+	if( cache == NULL || cache->num_triggers < 0 ) {
+		for( int i = 0; i < g_static_triggers.num_triggers; i++ ) {
+			num = GClip_AddStaticTrigger( i, mins, maxs, list, num );
+		}
+	}
+	else {
+		for( int i = 0; i < cache->num_triggers; i++ ) {
+			num = GClip_AddStaticTrigger( cache->triggers[ i ], mins, maxs, list, num );
+		}
+	}
+
+	return num;
+}
+
 static void CallTouches( edict_t * ent, Vec3 mins, Vec3 maxs ) {
 	int touch[ MAX_EDICTS ];
-	int num = GClip_AreaEdicts( mins, maxs, touch, MAX_EDICTS, AREA_TRIGGERS, 0 );
+	STATIC_ASSERT( MAX_STATIC_TRIGGERS <= MAX_EDICTS );
+	int num = GClip_StaticTriggersInBox( ent, mins, maxs, touch );
+	num += GClip_AreaEdicts( mins, maxs, touch + num, MAX_EDICTS - num, AREA_TRIGGERS, 0 );
 
 	for( int i = 0; i < num; i++ ) {
 		edict_t * hit = &game.edicts[ touch[ i ] ];
@@ -984,12 +1916,23 @@ int GClip_FindInRadius( Vec3 origin, float radius, int * output, int maxcount )
 }
 
 void G_SplashFrac4D( const edict_t *ent, Vec3 hitpoint, float maxradius, Vec3 * pushdir, float *frac, int timeDelta, bool selfdamage ) {
-	const c4clipedict_t *clipEnt = GClip_GetClipEdictForDeltaTime( ENTNUM( ent ), timeDelta );
+	c4clipedict_t scratch;
+	const c4clipedict_t *clipEnt = GClip_GetClipEdictForDeltaTime( ENTNUM( ent ), timeDelta, &scratch );
 	G_SplashFrac( &clipEnt->s, &clipEnt->r, hitpoint, maxradius, pushdir, frac, selfdamage );
 }
 
+void G_GetEntityBoxForDeltaTime( int entNum, int timeDelta, Vec3 * origin, Vec3 * mins, Vec3 * maxs ) {
+	c4clipedict_t scratch;
+	const c4clipedict_t *clipEnt = GClip_GetClipEdictForDeltaTime( entNum, timeDelta, &scratch );
+	*origin = clipEnt->s.origin;
+	*mins = clipEnt->r.mins;
+	*maxs = clipEnt->r.maxs;
+}
+
 SyncEntityState *G_GetEntityStateForDeltaTime( int entNum, int deltaTime ) {
-	c4clipedict_t *clipEnt;
+	// pick one of the 8 slots to prevent overwritings
+	static thread_local SyncEntityState states[ 8 ];
+	static thread_local int index;
 
 	if( entNum == -1 ) {
 		return NULL;
@@ -997,7 +1940,178 @@ SyncEntityState *G_GetEntityStateForDeltaTime( int entNum, int deltaTime ) {
 
 	assert( entNum >= 0 && entNum < MAX_EDICTS );
 
-	clipEnt = GClip_GetClipEdictForDeltaTime( entNum, deltaTime );
+	c4clipedict_t scratch;
+	SyncEntityState * state = &states[ index ];
+	index = ( index + 1 ) & 7;
+	*state = GClip_GetClipEdictForDeltaTime( entNum, deltaTime, &scratch )->s;
+
+	return state;
+}
+
+/*
+* GClip_Benchmark_f
+*
+* Times GClip_LinkEntity and GClip_AreaEdicts on the current map with a
+* batch of extra projectile sized entities. Queries are a mix of hull
+* sized boxes, splashes and long traces, and the RNG is seeded so runs
+* are comparable across builds
+*/
+void GClip_Benchmark_f() {
+	int num_queries = Cmd_Argc() >= 2 ? atoi( Cmd_Argv( 1 ) ) : 100000;
+	int num_projectiles = Cmd_Argc() >= 3 ? atoi( Cmd_Argv( 2 ) ) : 256;
+
+	cmodel_t * world_model = CM_FindCModel( CM_Server, StringHash( svs.cms->world_hash ) );
+	Vec3 world_mins, world_maxs;
+	CM_InlineModelBounds( svs.cms, world_model, &world_mins, &world_maxs );
+
+	RNG rng = NewRNG( 0x1234, 0x5678 );
+
+	auto random_point = [&]() {
+		return Vec3(
+			RandomUniformFloat( &rng, world_mins.x, world_maxs.x ),
+			RandomUniformFloat( &rng, world_mins.y, world_maxs.y ),
+			RandomUniformFloat( &rng, world_mins.z, world_maxs.z )
+		);
+	};
+
+	edict_t * projectiles[ MAX_EDICTS ];
+	Vec3 velocities[ MAX_EDICTS ];
+	num_projectiles = Clamp( 0, num_projectiles, MAX_EDICTS - game.numentities );
+	for( int i = 0; i < num_projectiles; i++ ) {
+		edict_t * ent = G_Spawn();
+		ent->r.solid = SOLID_YES;
+		ent->r.svflags = SVF_PROJECTILE;
+		ent->r.mins = Vec3( -2.0f );
+		ent->r.maxs = Vec3( 2.0f );
+		ent->s.origin = random_point();
+		GClip_LinkEntity( ent );
+		projectiles[ i ] = ent;
+		velocities[ i ] = Vec3( RandomFloat11( &rng ), RandomFloat11( &rng ), RandomFloat11( &rng ) ) * 20.0f;
+	}
+
+	// move projectiles like they would in a frame, bouncing off the world bounds
+	u64 link_start = Sys_Microseconds();
+	for( int frame = 0; frame < 64; frame++ ) {
+		for( int i = 0; i < num_projectiles; i++ ) {
+			Vec3 & origin = projectiles[ i ]->s.origin;
+			origin += velocities[ i ];
+			for( int j = 0; j < 3; j++ ) {
+				if( origin[ j ] < world_mins[ j ] || origin[ j ] > world_maxs[ j ] ) {
+					velocities[ i ][ j ] = -velocities[ i ][ j ];
+					origin[ j ] = Clamp( world_mins[ j ], origin[ j ], world_maxs[ j ] );
+				}
+			}
+			GClip_LinkEntity( projectiles[ i ] );
+		}
+	}
+	u64 link_time = Sys_Microseconds() - link_start;
+
+	// queries either start anywhere in the world, or near solid entities like
+	// most of the game's traces do
+	Vec3 origins[ MAX_EDICTS ];
+	int num_origins = 0;
+	for( int i = 1; i < game.numentities; i++ ) {
+		const edict_t * ent = &game.edicts[ i ];
+		if( ent->r.inuse && ent->linked && ent->r.solid == SOLID_YES ) {
+			origins[ num_origins ] = ent->s.origin;
+			num_origins++;
+		}
+	}
+
+	const char * query_names[] = { "hull", "splash", "trace" };
+	int queries_per_type = Max2( 1, num_queries / int( ARRAY_COUNT( query_names ) * 2 ) );
+
+	Com_Printf( "%d entities, %d links: %.3fus/link\n", game.numentities, num_projectiles * 64,
+		num_projectiles == 0 ? 0.0 : double( link_time ) / ( num_projectiles * 64 ) );
+
+	for( int local = 0; local < 2; local++ ) {
+		if( local == 1 && num_origins == 0 ) {
+			break;
+		}
+
+		for( size_t type = 0; type < ARRAY_COUNT( query_names ); type++ ) {
+			u64 hits = 0;
+			u64 query_start = Sys_Microseconds();
+			for( int i = 0; i < queries_per_type; i++ ) {
+				Vec3 start;
+				if( local == 1 ) {
+					Vec3 jitter = Vec3( RandomFloat11( &rng ), RandomFloat11( &rng ), RandomFloat11( &rng ) ) * 128.0f;
+					start = RandomElement( &rng, origins, num_origins ) + jitter;
+				} else {
+					start = random_point();
+				}
+
+				Vec3 mins, maxs;
+				switch( type ) {
+					case 0:
+						mins = start - Vec3( 16.0f );
+						maxs = start + Vec3( 16.0f );
+						break;
+					case 1:
+						mins = start - Vec3( 150.0f );
+						maxs = start + Vec3( 150.0f );
+						break;
+					default: {
+						Vec3 end = start + Normalize( random_point() - start ) * 2048.0f;
+						GClip_TraceBounds( start, Vec3( -4.0f ), Vec3( 4.0f ), end, &mins, &maxs );
+					} break;
+				}
+
+				int touch[ MAX_EDICTS ];
+				hits += GClip_AreaEdicts( mins, maxs, touch, MAX_EDICTS, AREA_SOLID, 0 );
+			}
+			u64 query_time = Sys_Microseconds() - query_start;
+
+			Com_Printf( "%-6s %-6s queries: %.3fus/query, %.1f hits/query\n", local == 1 ? "local" : "random", query_names[ type ],
+				double( query_time ) / queries_per_type, double( hits ) / queries_per_type );
+		}
+	}
+
+	// shotgun blasts near solid entities, traced one pellet at a time and batched
+	if( num_origins > 0 ) {
+		constexpr int pellets = 25;
+		int blasts = Max2( 1, num_queries / ( pellets * 2 ) );
+		u64 single_time = 0;
+		u64 batch_time = 0;
+		int mismatches = 0;
+
+		for( int i = 0; i < blasts; i++ ) {
+			Vec3 jitter = Vec3( RandomFloat11( &rng ), RandomFloat11( &rng ), RandomFloat11( &rng ) ) * 128.0f;
+			Vec3 start = RandomElement( &rng, origins, num_origins ) + jitter;
+			Vec3 dir = Normalize( random_point() - start );
+
+			Vec3 starts[ pellets ];
+			Vec3 ends[ pellets ];
+			for( int j = 0; j < pellets; j++ ) {
+				Vec3 spread = Vec3( RandomFloat11( &rng ), RandomFloat11( &rng ), RandomFloat11( &rng ) ) * 0.05f;
+				starts[ j ] = start;
+				ends[ j ] = start + Normalize( dir + spread ) * 2048.0f;
+			}
 
-	return &clipEnt->s;
+			trace_t single[ pellets ];
+			u64 single_start = Sys_Microseconds();
+			for( int j = 0; j < pellets; j++ ) {
+				G_Trace4D( &single[ j ], starts[ j ], Vec3( 0.0f ), Vec3( 0.0f ), ends[ j ], NULL, MASK_SHOT, 0 );
+			}
+			single_time += Sys_Microseconds() - single_start;
+
+			trace_t batch[ pellets ];
+			u64 batch_start = Sys_Microseconds();
+			G_TraceBatch( batch, starts, ends, pellets, Vec3( 0.0f ), Vec3( 0.0f ), NULL, MASK_SHOT, 0 );
+			batch_time += Sys_Microseconds() - batch_start;
+
+			for( int j = 0; j < pellets; j++ ) {
+				if( single[ j ].ent != batch[ j ].ent || single[ j ].fraction != batch[ j ].fraction ) {
+					mismatches++;
+				}
+			}
+		}
+
+		Com_Printf( "shotgun blasts: %.3fus/blast single, %.3fus/blast batched, %d mismatched pellets\n",
+			double( single_time ) / blasts, double( batch_time ) / blasts, mismatches );
+	}
+
+	for( int i = 0; i < num_projectiles; i++ ) {
+		G_FreeEdict( projectiles[ i ] );
+	}
 }
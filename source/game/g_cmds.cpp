@@ -382,9 +382,9 @@ static void Cmd_Spray_f( edict_t * ent ) {
 
 	ent->r.client->level.last_spray = svs.realtime;
 
-	edict_t * event = G_SpawnEvent( EV_SPRAY, Random64( &svs.rng ), &trace.endpos );
-	event->s.angles = ent->r.client->ps.viewangles;
-	event->s.origin2 = trace.plane.normal;
+	SyncSnapEvent * event = G_SpawnEvent( EV_SPRAY, Random64( &svs.rng ), &trace.endpos );
+	event->angles = ent->r.client->ps.viewangles;
+	event->origin2 = trace.plane.normal;
 }
 
 struct g_vsays_t {
@@ -428,9 +428,9 @@ static void G_vsay_f( edict_t *ent ) {
 		u64 entropy = Random32( &svs.rng );
 		u64 parm = u64( vsay->id ) | ( entropy << 16 );
 
-		edict_t * event = G_SpawnEvent( EV_VSAY, parm, NULL );
-		event->r.svflags |= SVF_BROADCAST; // force sending even when not in PVS
-		event->s.ownerNum = ent->s.number;
+		SyncSnapEvent * event = G_SpawnEvent( EV_VSAY, parm, NULL );
+		event->svflags |= SVF_BROADCAST; // force sending even when not in PVS
+		event->ownerNum = ent->s.number;
 
 		return;
 	}
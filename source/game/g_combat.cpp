@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "game/g_local.h"
+#include "game/g_statstream.h"
 
 bool G_IsTeamDamage( SyncEntityState *targ, SyncEntityState *attacker ) {
 	if( !level.gametype.isTeamBased )
@@ -26,70 +27,6 @@ bool G_IsTeamDamage( SyncEntityState *targ, SyncEntityState *attacker ) {
 	return targ->number != attacker->number && targ->team == attacker->team;
 }
 
-static bool G_CanSplashDamage( edict_t *targ, edict_t *inflictor, cplane_t *plane, Vec3 pos, int timeDelta ) {
-	constexpr float SPLASH_DAMAGE_TRACE_FRAC_EPSILON = 1.0f / 32.0f;
-
-	trace_t trace;
-
-	// bmodels need special checking because their origin is 0,0,0
-	if( targ->movetype == MOVETYPE_PUSH ) {
-		// NOT FOR PLAYERS only for entities that can push the players
-		Vec3 dest = ( targ->r.absmin + targ->r.absmax ) * 0.5f;
-		G_Trace4D( &trace, pos, Vec3( 0.0f ), Vec3( 0.0f ), dest, inflictor, MASK_SOLID, timeDelta );
-		if( trace.fraction >= 1.0 - SPLASH_DAMAGE_TRACE_FRAC_EPSILON || trace.ent == ENTNUM( targ ) ) {
-			return true;
-		}
-
-		return false;
-	}
-
-	Vec3 origin = pos;
-	if( plane != NULL ) {
-		// up by 9 units to account for stairs
-		origin += plane->normal * 9.0f;
-	}
-
-	// This is for players
-	G_Trace4D( &trace, origin, Vec3( 0.0f ), Vec3( 0.0f ), targ->s.origin, inflictor, MASK_SOLID, timeDelta );
-	if( trace.fraction >= 1.0 - SPLASH_DAMAGE_TRACE_FRAC_EPSILON || trace.ent == ENTNUM( targ ) ) {
-		return true;
-	}
-
-	Vec3 dest = targ->s.origin;
-	dest.x += 15.0;
-	dest.y += 15.0;
-	G_Trace4D( &trace, origin, Vec3( 0.0f ), Vec3( 0.0f ), dest, inflictor, MASK_SOLID, timeDelta );
-	if( trace.fraction >= 1.0 - SPLASH_DAMAGE_TRACE_FRAC_EPSILON || trace.ent == ENTNUM( targ ) ) {
-		return true;
-	}
-
-	dest = targ->s.origin;
-	dest.x += 15.0;
-	dest.y -= 15.0;
-	G_Trace4D( &trace, origin, Vec3( 0.0f ), Vec3( 0.0f ), dest, inflictor, MASK_SOLID, timeDelta );
-	if( trace.fraction >= 1.0 - SPLASH_DAMAGE_TRACE_FRAC_EPSILON || trace.ent == ENTNUM( targ ) ) {
-		return true;
-	}
-
-	dest = targ->s.origin;
-	dest.x -= 15.0;
-	dest.y += 15.0;
-	G_Trace4D( &trace, origin, Vec3( 0.0f ), Vec3( 0.0f ), dest, inflictor, MASK_SOLID, timeDelta );
-	if( trace.fraction >= 1.0 - SPLASH_DAMAGE_TRACE_FRAC_EPSILON || trace.ent == ENTNUM( targ ) ) {
-		return true;
-	}
-
-	dest = targ->s.origin;
-	dest.x -= 15.0;
-	dest.y -= 15.0;
-	G_Trace4D( &trace, origin, Vec3( 0.0f ), Vec3( 0.0f ), dest, inflictor, MASK_SOLID, timeDelta );
-	if( trace.fraction >= 1.0 - SPLASH_DAMAGE_TRACE_FRAC_EPSILON || trace.ent == ENTNUM( targ ) ) {
-		return true;
-	}
-
-	return false;
-}
-
 void G_Killed( edict_t *targ, edict_t *inflictor, edict_t *attacker, int assistorNo, DamageType damage_type, int damage ) {
 	if( targ->health < -999 ) {
 		targ->health = -999;
@@ -117,6 +54,7 @@ void G_Killed( edict_t *targ, edict_t *inflictor, edict_t *attacker, int assisto
 		}
 	}
 
+	G_StatStreamKill( attacker, targ, assistorNo, damage_type );
 	G_Gametype_ScoreEvent( attacker ? attacker->r.client : NULL, "kill", va( "%i %i %i", targ->s.number, ( inflictor == world ) ? -1 : ENTNUM( inflictor ), ENTNUM( attacker ) ) );
 
 	G_CallDie( targ, inflictor, attacker, assistorNo, damage_type, damage );
@@ -205,13 +143,13 @@ void SpawnDamageEvents( const edict_t * attacker, edict_t * victim, float damage
 		G_SpawnEvent( EV_HEADSHOT, 0, &victim->s.origin );
 	}
 
-	edict_t * damage_number = G_SpawnEvent( EV_DAMAGE, parm, &victim->s.origin );
-	damage_number->r.svflags |= SVF_OWNERANDCHASERS;
-	damage_number->s.ownerNum = ENTNUM( attacker );
+	SyncSnapEvent * damage_number = G_SpawnEvent( EV_DAMAGE, parm, &victim->s.origin );
+	damage_number->svflags |= SVF_OWNERANDCHASERS;
+	damage_number->ownerNum = ENTNUM( attacker );
 
-	edict_t * blood = G_SpawnEvent( EV_BLOOD, HEALTH_TO_INT( damage ), &pos );
-	blood->s.origin2 = dir;
-	blood->s.team = victim->s.team;
+	SyncSnapEvent * blood = G_SpawnEvent( EV_BLOOD, HEALTH_TO_INT( damage ), &pos );
+	blood->origin2 = dir;
+	blood->team = victim->s.team;
 
 	if( !G_IsDead( victim ) && level.time >= victim->pain_debounce_time ) {
 		G_AddEvent( victim, EV_PAIN, victim->health <= 25 ? PAIN_20 : PAIN_100, true );
@@ -291,6 +229,7 @@ void G_Damage( edict_t *targ, edict_t *inflictor, edict_t *attacker, Vec3 pushdi
 	}
 
 	G_Gametype_ScoreEvent( attacker->r.client, "dmg", va( "%i %f %i", targ->s.number, damage, attacker->s.number ) );
+	G_StatStreamDamage( attacker, targ, damage_type, take );
 
 	if( statDmg ) {
 		G_ClientGetStats( targ )->total_damage_received += take;
@@ -337,9 +276,9 @@ void G_Damage( edict_t *targ, edict_t *inflictor, edict_t *attacker, Vec3 pushdi
 
 	if( G_IsDead( targ ) ) {
 		if( targ->s.type != ET_CORPSE && attacker != targ ) {
-			edict_t * killed = G_SpawnEvent( EV_DAMAGE, 255 << 1, &targ->s.origin );
-			killed->r.svflags |= SVF_OWNERANDCHASERS;
-			killed->s.ownerNum = ENTNUM( attacker );
+			SyncSnapEvent * killed = G_SpawnEvent( EV_DAMAGE, 255 << 1, &targ->s.origin );
+			killed->svflags |= SVF_OWNERANDCHASERS;
+			killed->ownerNum = ENTNUM( attacker );
 		}
 
 		int topAssistorNo = G_FindTopAssistor( targ, attacker );
@@ -397,7 +336,162 @@ void G_SplashFrac( const SyncEntityState *s, const entity_shared_t *r, Vec3 poin
 	*pushdir = Normalize( center_of_mass - point );
 }
 
+/*
+* splash finds everything it hits before applying any of it. the candidates'
+* boxes are gathered once and culled by distance in a loop the compiler can
+* vectorise, then line of sight to everything still in range is checked with
+* batched traces. every target is judged against the world as it was when the
+* splash happened, so damaging one target can't change whether another is hit
+*/
+
+struct SplashHit {
+	edict_t * ent;
+	float frac;
+	Vec3 pushdir;
+};
+
+static bool SplashTraceReached( const trace_t & trace, const edict_t * targ ) {
+	constexpr float SPLASH_DAMAGE_TRACE_FRAC_EPSILON = 1.0f / 32.0f;
+	return trace.fraction >= 1.0 - SPLASH_DAMAGE_TRACE_FRAC_EPSILON || trace.ent == ENTNUM( targ );
+}
+
+static Span< SplashHit > G_FindSplashHits( Allocator * a, Span< edict_t * const > candidates, const int * falloff_time_deltas,
+		Vec3 pos, float radius, edict_t * inflictor, cplane_t * plane, int timeDelta, bool selfdamage ) {
+	size_t n = candidates.n;
+	SplashHit * hits = ALLOC_MANY( a, SplashHit, n );
+	if( n == 0 ) {
+		return Span< SplashHit >( hits, 0 );
+	}
+
+	float * origin_x = ALLOC_MANY( a, float, n );
+	float * origin_y = ALLOC_MANY( a, float, n );
+	float * origin_z = ALLOC_MANY( a, float, n );
+	float * mins_x = ALLOC_MANY( a, float, n );
+	float * mins_y = ALLOC_MANY( a, float, n );
+	float * mins_z = ALLOC_MANY( a, float, n );
+	float * maxs_x = ALLOC_MANY( a, float, n );
+	float * maxs_y = ALLOC_MANY( a, float, n );
+	float * maxs_z = ALLOC_MANY( a, float, n );
+	bool * in_range = ALLOC_MANY( a, bool, n );
+
+	for( size_t i = 0; i < n; i++ ) {
+		Vec3 origin, mins, maxs;
+		G_GetEntityBoxForDeltaTime( ENTNUM( candidates[ i ] ), falloff_time_deltas[ i ], &origin, &mins, &maxs );
+		origin_x[ i ] = origin.x;
+		origin_y[ i ] = origin.y;
+		origin_z[ i ] = origin.z;
+		mins_x[ i ] = mins.x;
+		mins_y[ i ] = mins.y;
+		mins_z[ i ] = mins.z;
+		maxs_x[ i ] = maxs.x;
+		maxs_y[ i ] = maxs.y;
+		maxs_z[ i ] = maxs.z;
+	}
+
+	// same maths as G_SplashFrac but branchless, with some slack so it never
+	// culls something G_SplashFrac would hit
+	float cull_radius = radius + 1.0f;
+	for( size_t i = 0; i < n; i++ ) {
+		float innerradius = ( maxs_x[ i ] + maxs_y[ i ] - mins_x[ i ] - mins_y[ i ] ) * 0.25f;
+		float lo = origin_z[ i ] + mins_z[ i ] + innerradius;
+		float hi = origin_z[ i ] + maxs_z[ i ] - innerradius;
+		float closest_z = Max2( lo, Min2( pos.z, hi ) );
+
+		float dx = pos.x - origin_x[ i ];
+		float dy = pos.y - origin_y[ i ];
+		float dz = pos.z - closest_z;
+		in_range[ i ] = dx * dx + dy * dy + dz * dz < cull_radius * cull_radius;
+	}
+
+	// direct line of sight to the middle of bmodels or the origin of everything else
+	Vec3 origin = pos;
+	if( plane != NULL ) {
+		// up by 9 units to account for stairs
+		origin += plane->normal * 9.0f;
+	}
+
+	Vec3 * starts = ALLOC_MANY( a, Vec3, n );
+	Vec3 * ends = ALLOC_MANY( a, Vec3, n );
+	size_t num_hits = 0;
+
+	for( size_t i = 0; i < n; i++ ) {
+		if( !in_range[ i ] ) {
+			continue;
+		}
+
+		edict_t * targ = candidates[ i ];
+		SplashHit * hit = &hits[ num_hits ];
+		G_SplashFrac4D( targ, pos, radius, &hit->pushdir, &hit->frac, falloff_time_deltas[ i ], selfdamage );
+		if( hit->frac == 0.0f ) {
+			continue;
+		}
+
+		hit->ent = targ;
+		// bmodels need special checking because their origin is 0,0,0
+		if( targ->movetype == MOVETYPE_PUSH ) {
+			starts[ num_hits ] = pos;
+			ends[ num_hits ] = ( targ->r.absmin + targ->r.absmax ) * 0.5f;
+		}
+		else {
+			starts[ num_hits ] = origin;
+			ends[ num_hits ] = targ->s.origin;
+		}
+		num_hits++;
+	}
+
+	trace_t * traces = ALLOC_MANY( a, trace_t, num_hits );
+	G_TraceBatch( traces, starts, ends, num_hits, Vec3( 0.0f ), Vec3( 0.0f ), inflictor, MASK_SOLID, timeDelta );
+
+	// then the corners of players that weren't directly visible
+	size_t * blocked = ALLOC_MANY( a, size_t, num_hits );
+	size_t num_blocked = 0;
+	for( size_t i = 0; i < num_hits; i++ ) {
+		if( !SplashTraceReached( traces[ i ], hits[ i ].ent ) && hits[ i ].ent->movetype != MOVETYPE_PUSH ) {
+			blocked[ num_blocked++ ] = i;
+		}
+	}
+
+	static const Vec3 corners[] = {
+		Vec3( 15.0f, 15.0f, 0.0f ),
+		Vec3( 15.0f, -15.0f, 0.0f ),
+		Vec3( -15.0f, 15.0f, 0.0f ),
+		Vec3( -15.0f, -15.0f, 0.0f ),
+	};
+
+	Vec3 * corner_starts = ALLOC_MANY( a, Vec3, num_blocked * ARRAY_COUNT( corners ) );
+	Vec3 * corner_ends = ALLOC_MANY( a, Vec3, num_blocked * ARRAY_COUNT( corners ) );
+	trace_t * corner_traces = ALLOC_MANY( a, trace_t, num_blocked * ARRAY_COUNT( corners ) );
+	for( size_t i = 0; i < num_blocked; i++ ) {
+		for( size_t j = 0; j < ARRAY_COUNT( corners ); j++ ) {
+			corner_starts[ i * ARRAY_COUNT( corners ) + j ] = origin;
+			corner_ends[ i * ARRAY_COUNT( corners ) + j ] = hits[ blocked[ i ] ].ent->s.origin + corners[ j ];
+		}
+	}
+	G_TraceBatch( corner_traces, corner_starts, corner_ends, num_blocked * ARRAY_COUNT( corners ), Vec3( 0.0f ), Vec3( 0.0f ), inflictor, MASK_SOLID, timeDelta );
+
+	bool * visible = ALLOC_MANY( a, bool, num_hits );
+	for( size_t i = 0; i < num_hits; i++ ) {
+		visible[ i ] = SplashTraceReached( traces[ i ], hits[ i ].ent );
+	}
+	for( size_t i = 0; i < num_blocked; i++ ) {
+		for( size_t j = 0; j < ARRAY_COUNT( corners ); j++ ) {
+			visible[ blocked[ i ] ] |= SplashTraceReached( corner_traces[ i * ARRAY_COUNT( corners ) + j ], hits[ blocked[ i ] ].ent );
+		}
+	}
+
+	size_t num_visible = 0;
+	for( size_t i = 0; i < num_hits; i++ ) {
+		if( visible[ i ] ) {
+			hits[ num_visible++ ] = hits[ i ];
+		}
+	}
+
+	return Span< SplashHit >( hits, num_visible );
+}
+
 void G_RadiusKnockback( const WeaponDef * def, edict_t *attacker, Vec3 pos, cplane_t *plane, DamageType damage_type, int timeDelta ) {
+	ZoneScoped;
+
 	float maxknockback = def->knockback;
 	float minknockback = def->min_knockback;
 	float radius = def->splash_radius;
@@ -408,25 +502,33 @@ void G_RadiusKnockback( const WeaponDef * def, edict_t *attacker, Vec3 pos, cpla
 	int touch[MAX_EDICTS];
 	int numtouch = GClip_FindInRadius4D( pos, radius, touch, MAX_EDICTS, timeDelta );
 
+	edict_t * candidates[MAX_EDICTS];
+	int time_deltas[MAX_EDICTS];
+	size_t num_candidates = 0;
+
 	for( int i = 0; i < numtouch; i++ ) {
 		edict_t * ent = game.edicts + touch[i];
 		if( !ent->takedamage || G_IsTeamDamage( &ent->s, &attacker->s ) )
 			continue;
 
-		float frac;
-		Vec3 pushDir;
-		G_SplashFrac4D( ent, pos, radius, &pushDir, &frac, timeDelta, false );
-		if( frac == 0.0f )
-			continue;
+		candidates[ num_candidates ] = ent;
+		time_deltas[ num_candidates ] = timeDelta;
+		num_candidates++;
+	}
 
-		if( G_CanSplashDamage( ent, NULL, plane, pos, timeDelta ) ) {
-			float knockback = Lerp( minknockback, frac, maxknockback );
-			G_KnockBackPush( ent, attacker, pushDir, knockback, 0 );
-		}
+	TempAllocator temp = svs.frame_arena.temp();
+	Span< SplashHit > hits = G_FindSplashHits( &temp, Span< edict_t * const >( candidates, num_candidates ), time_deltas,
+		pos, radius, NULL, plane, timeDelta, false );
+
+	for( const SplashHit & hit : hits ) {
+		float knockback = Lerp( minknockback, hit.frac, maxknockback );
+		G_KnockBackPush( hit.ent, attacker, hit.pushdir, knockback, 0 );
 	}
 }
 
 void G_RadiusDamage( edict_t *inflictor, edict_t *attacker, cplane_t *plane, edict_t *ignore, DamageType damage_type ) {
+	ZoneScoped;
+
 	assert( inflictor );
 
 	float maxdamage = inflictor->projectileInfo.maxDamage;
@@ -442,29 +544,29 @@ void G_RadiusDamage( edict_t *inflictor, edict_t *attacker, cplane_t *plane, edi
 	int touch[MAX_EDICTS];
 	int numtouch = GClip_FindInRadius4D( inflictor->s.origin, radius, touch, MAX_EDICTS, inflictor->timeDelta );
 
+	edict_t * candidates[MAX_EDICTS];
+	int time_deltas[MAX_EDICTS];
+	size_t num_candidates = 0;
+
 	for( int i = 0; i < numtouch; i++ ) {
 		edict_t * ent = game.edicts + touch[i];
 		if( ent == ignore || !ent->takedamage )
 			continue;
 
-		int timeDelta;
-		if( ent == attacker && ent->r.client ) {
-			timeDelta = 0;
-		} else {
-			timeDelta = inflictor->timeDelta;
-		}
+		candidates[ num_candidates ] = ent;
+		time_deltas[ num_candidates ] = ent == attacker && ent->r.client ? 0 : inflictor->timeDelta;
+		num_candidates++;
+	}
 
-		float frac;
-		Vec3 pushDir;
-		bool is_selfdamage = inflictor->r.client != NULL && attacker == inflictor;
-		G_SplashFrac4D( ent, inflictor->s.origin, radius, &pushDir, &frac, timeDelta, is_selfdamage );
-		if( frac == 0.0f )
-			continue;
+	bool is_selfdamage = inflictor->r.client != NULL && attacker == inflictor;
 
-		if( G_CanSplashDamage( ent, inflictor, plane, inflictor->s.origin, inflictor->timeDelta ) ) {
-			float damage = Lerp( mindamage, frac, maxdamage );
-			float knockback = Lerp( minknockback, frac, maxknockback );
-			G_Damage( ent, inflictor, attacker, pushDir, inflictor->velocity, inflictor->s.origin, damage, knockback, DAMAGE_RADIUS, damage_type );
-		}
+	TempAllocator temp = svs.frame_arena.temp();
+	Span< SplashHit > hits = G_FindSplashHits( &temp, Span< edict_t * const >( candidates, num_candidates ), time_deltas,
+		inflictor->s.origin, radius, inflictor, plane, inflictor->timeDelta, is_selfdamage );
+
+	for( const SplashHit & hit : hits ) {
+		float damage = Lerp( mindamage, hit.frac, maxdamage );
+		float knockback = Lerp( minknockback, hit.frac, maxknockback );
+		G_Damage( hit.ent, inflictor, attacker, hit.pushdir, inflictor->velocity, inflictor->s.origin, damage, knockback, DAMAGE_RADIUS, damage_type );
 	}
 }
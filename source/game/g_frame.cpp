@@ -20,7 +20,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/string.h"
+#include "qcommon/zone_sampler.h"
 #include "game/g_local.h"
+#include "game/g_statstream.h"
 
 void G_Timeout_Reset() {
 	G_GamestatSetFlag( GAMESTAT_FLAG_PAUSED, false );
@@ -256,6 +258,7 @@ void G_ClearSnap() {
 	server_gs.gameState.clock_override = 0;
 
 	// clear all events in the snap
+	game.events.num_events = 0;
 	for( ent = &game.edicts[0]; ENTNUM( ent ) < game.numentities; ent++ ) {
 		if( ISEVENTENTITY( &ent->s ) ) { // events do not persist after a snapshot
 			G_FreeEdict( ent );
@@ -288,6 +291,28 @@ void G_ClearSnap() {
 	}
 }
 
+/*
+* G_SyncHotComponents
+*/
+static void G_SyncHotComponents( const edict_t * ent ) {
+	EdictHotComponents * hot = &game.hot;
+	int num = ENTNUM( ent );
+	u8 movetype = u8( ent->movetype );
+	u8 solid = u8( ent->r.solid );
+
+	bool changed = hot->svflags[ num ] != ent->r.svflags || hot->origin[ num ] != ent->s.origin ||
+		hot->velocity[ num ] != ent->velocity || hot->movetype[ num ] != movetype || hot->solid[ num ] != solid;
+
+	u64 bit = U64( 1 ) << u64( num % 64 );
+	hot->dirty[ num / 64 ] = changed ? hot->dirty[ num / 64 ] | bit : hot->dirty[ num / 64 ] & ~bit;
+
+	hot->svflags[ num ] = ent->r.svflags;
+	hot->origin[ num ] = ent->s.origin;
+	hot->velocity[ num ] = ent->velocity;
+	hot->movetype[ num ] = movetype;
+	hot->solid[ num ] = solid;
+}
+
 /*
 * G_SnapFrame
 * It's time to send a new snap, so set the world up for sending
@@ -302,6 +327,7 @@ void G_SnapFrame() {
 	// exit level
 	if( level.exitNow ) {
 		G_ExitLevel();
+		game.hot.num_edicts = 0; // the edicts were all respawned
 		return;
 	}
 
@@ -317,6 +343,7 @@ void G_SnapFrame() {
 		// ignore ents without visible models unless they have an effect
 		if( !ent->r.inuse ) {
 			ent->r.svflags |= SVF_NOCLIENT;
+			G_SyncHotComponents( ent );
 			continue;
 		}
 
@@ -325,7 +352,11 @@ void G_SnapFrame() {
 			entity_sound_backup[ENTNUM( ent )] = ent->s.sound;
 			ent->s.sound = EMPTY_HASH;
 		}
+
+		G_SyncHotComponents( ent );
 	}
+
+	game.hot.num_edicts = game.numentities;
 }
 
 //===================================================================
@@ -335,6 +366,8 @@ void G_SnapFrame() {
 static void G_RunEntities() {
 	ZoneScoped;
 
+	G_TraceProjectilesParallel();
+
 	edict_t *ent;
 
 	for( ent = &game.edicts[0]; ENTNUM( ent ) < game.numentities; ent++ ) {
@@ -363,6 +396,8 @@ static void G_RunEntities() {
 static void G_RunClients() {
 	ZoneScoped;
 
+	AI_PlanThinks();
+
 	for( int i = 0; i < server_gs.maxclients; i++ ) {
 		edict_t *ent = game.edicts + 1 + i;
 		if( !ent->r.inuse )
@@ -373,13 +408,17 @@ static void G_RunClients() {
 }
 
 void G_RunFrame( unsigned int msec ) {
-	ZoneScoped;
+	ZoneScopedSampled( "G_RunFrame" );
 
 	G_CheckCvars();
+	G_StatStreamFrame();
 
 	game.frametime = msec;
 	G_Timeout_Update( msec );
 
+	// things are about to move
+	G_ClearVisibilityCache();
+
 	G_CallVotes_Think();
 
 	if( GS_MatchPaused( &server_gs ) ) {
@@ -412,6 +451,7 @@ void G_RunFrame( unsigned int msec ) {
 	G_RunEntities();
 	G_RunGametype();
 	GClip_BackUpCollisionFrame();
+	G_FlushEdictIndex();
 
 	game.prevServerTime = svs.gametime;
 }
@@ -206,6 +206,8 @@ void G_Match_LaunchState( int matchState ) {
 
 			G_Timeout_Reset();
 			level.forceExit = false;
+
+			G_PrefetchNextMap();
 		}
 		break;
 
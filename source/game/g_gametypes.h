@@ -26,17 +26,25 @@ extern cvar_t *g_warmup_timelimit;
 #define G_CHALLENGERS_MIN_JOINTEAM_MAPTIME  9000 // must wait 10 seconds before joining
 #define GAMETYPE_PROJECT_EXTENSION          ".gt"
 
+class asIScriptFunction;
+
+enum GametypeScriptFunction {
+	GametypeScriptFunction_Init,
+	GametypeScriptFunction_Spawn,
+	GametypeScriptFunction_MatchStateStarted,
+	GametypeScriptFunction_MatchStateFinished,
+	GametypeScriptFunction_ThinkRules,
+	GametypeScriptFunction_PlayerRespawn,
+	GametypeScriptFunction_ScoreEvent,
+	GametypeScriptFunction_SelectSpawnPoint,
+	GametypeScriptFunction_ClientCommand,
+	GametypeScriptFunction_Shutdown,
+
+	GametypeScriptFunction_Count
+};
+
 typedef struct {
-	void *initFunc;
-	void *spawnFunc;
-	void *matchStateStartedFunc;
-	void *matchStateFinishedFunc;
-	void *thinkRulesFunc;
-	void *playerRespawnFunc;
-	void *scoreEventFunc;
-	void *selectSpawnPointFunc;
-	void *clientCommandFunc;
-	void *shutdownFunc;
+	asIScriptFunction * functions[ GametypeScriptFunction_Count ];
 
 	bool isTeamBased;
 	bool hasChallengersQueue;
@@ -83,6 +83,9 @@ struct game_locals_t {
 	struct angelwrap_api_s *asExport;
 	asIScriptEngine *asEngine;
 
+	EdictHotComponents hot;
+	SnapEvents events;
+
 	unsigned int frametime;         // in milliseconds
 	int snapFrameTime;              // in milliseconds
 	int64_t prevServerTime;         // last frame's server time
@@ -180,6 +183,7 @@ extern cvar_t *developer;
 extern cvar_t *filterban;
 
 extern cvar_t *g_maxvelocity;
+extern cvar_t *g_tracestats;
 
 extern cvar_t *sv_cheats;
 
@@ -200,6 +204,7 @@ extern cvar_t *g_scorelimit;
 
 extern cvar_t *g_projectile_prestep;
 extern cvar_t *g_numbots;
+extern cvar_t *g_botthinkbudget;
 extern cvar_t *g_maxtimeouts;
 
 extern cvar_t *g_respawn_delay_min;
@@ -262,6 +267,8 @@ void G_SpawnQueue_AddClient( edict_t *ent );
 void G_SpawnQueue_RemoveClient( edict_t *ent );
 void G_SpawnQueue_Think();
 
+void G_ResetSpawnPoints();
+edict_t * G_RandomSpawnPoint( StringHash classname );
 void SelectSpawnPoint( edict_t *ent, edict_t **spawnpoint, Vec3 * origin, Vec3 * angles );
 void SP_post_match_camera( edict_t *ent );
 
@@ -315,6 +322,7 @@ void G_asClearEntityBehaviors( edict_t *ent );
 void G_asReleaseEntityBehaviors( edict_t *ent );
 
 bool G_asCallMapEntitySpawnScript( Span< const char > classname, edict_t *ent );
+void G_asClearSpawnFunctionCache();
 
 void G_asInitGameModuleEngine();
 void G_asShutdownGameModuleEngine();
@@ -351,6 +359,9 @@ void G_AddCommand( const char *name, gamecommandfunc_t cmdfunc );
 bool KillBox( edict_t *ent, DamageType damage_type, Vec3 knockback );
 float LookAtKillerYAW( edict_t *self, edict_t *inflictor, edict_t *attacker );
 edict_t * G_Find( edict_t * cursor, StringHash edict_t::* field, StringHash value );
+void G_UpdateEdictIndex( const edict_t * ent );
+void G_FlushEdictIndex();
+void G_ResetEdictIndex();
 edict_t * G_PickTarget( StringHash name );
 void G_UseTargets( edict_t *ent, edict_t *activator );
 void G_SetMovedir( Vec3 * angles, Vec3 * movedir );
@@ -359,12 +370,14 @@ void G_InitMover( edict_t *ent );
 void G_InitEdict( edict_t *e );
 edict_t *G_Spawn();
 void G_FreeEdict( edict_t *e );
+void G_ResetFreeEdicts();
+void G_EdictStats_f();
 
 char *_G_CopyString( const char *in, const char *filename, int fileline );
 #define G_CopyString( in ) _G_CopyString( in, __FILE__, __LINE__ )
 
 void G_AddEvent( edict_t *ent, int event, u64 parm, bool highPriority );
-edict_t *G_SpawnEvent( int event, u64 parm, const Vec3 * origin );
+SyncSnapEvent *G_SpawnEvent( int event, u64 parm, const Vec3 * origin );
 void G_MorphEntityIntoEvent( edict_t *ent, int event, u64 parm );
 
 void G_CallThink( edict_t *ent );
@@ -435,21 +448,48 @@ void SP_trigger_key( edict_t *ent );
 //
 // g_clip.c
 //
-#define MAX_ENT_AREAS 16
+int G_PointContents( Vec3 p );
+int G_PointContents4D( Vec3 p, int timeDelta );
 
-struct link_t {
-	link_t *prev, *next;
-	int entNum;
+// the call site is recorded for g_tracestats
+void _G_Trace( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, const char *filename, int fileline );
+void _G_Trace4D( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, int timeDelta, const char *filename, int fileline );
+void _G_TraceBatch( trace_t * traces, const Vec3 * starts, const Vec3 * ends, size_t n, Vec3 mins, Vec3 maxs, edict_t * passedict, int contentmask, int timeDelta, const char *filename, int fileline );
+#define G_Trace( ... ) _G_Trace( __VA_ARGS__, __FILE__, __LINE__ )
+#define G_Trace4D( ... ) _G_Trace4D( __VA_ARGS__, __FILE__, __LINE__ )
+#define G_TraceBatch( ... ) _G_TraceBatch( __VA_ARGS__, __FILE__, __LINE__ )
+
+/*
+ * every solid entity in bounds rewound to timeDelta, so any number of rays,
+ * from any number of shooters, can be traced against it without rewinding
+ * per trace. it's a copy so it doesn't care what happens to the entities or
+ * the clip history afterwards
+ */
+struct RewoundEntity;
+struct RewoundEntities {
+	Span< RewoundEntity > ents;
+	int timeDelta;
 };
 
-int G_PointContents( Vec3 p );
-void G_Trace( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask );
-int G_PointContents4D( Vec3 p, int timeDelta );
-void G_Trace4D( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, int timeDelta );
+RewoundEntities G_RewindEntities( Allocator * a, MinMax3 bounds, int timeDelta );
+void G_FreeRewoundEntities( Allocator * a, RewoundEntities * rewound );
+MinMax3 G_TraceBatchBounds( const Vec3 * starts, const Vec3 * ends, size_t n, Vec3 mins, Vec3 maxs );
+void _G_TraceRewound( const RewoundEntities * rewound, trace_t * traces, const Vec3 * starts, const Vec3 * ends, size_t n, Vec3 mins, Vec3 maxs, edict_t * passedict, int contentmask, const char *filename, int fileline );
+#define G_TraceRewound( ... ) _G_TraceRewound( __VA_ARGS__, __FILE__, __LINE__ )
+void G_TraceStats_f();
+void G_TraceRecord_f();
+void G_StopTraceRecording();
+bool G_CanSee( edict_t * viewer, Vec3 vieworg, const edict_t * target, Vec3 point, int contentmask );
+void G_ClearVisibilityCache();
+struct CollisionCheckCounts;
+void G_WorldTrace( CollisionCheckCounts * checkcounts, trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int contentmask );
+void G_Trace4DEntities( trace_t *tr, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, edict_t *passedict, int contentmask, int timeDelta );
 void GClip_BackUpCollisionFrame();
 int GClip_FindInRadius4D( Vec3 org, float rad, int *list, int maxcount, int timeDelta );
 void G_SplashFrac4D( const edict_t *ent, Vec3 hitpoint, float maxradius, Vec3 * pushdir, float *frac, int timeDelta, bool selfdamage );
+void G_GetEntityBoxForDeltaTime( int entNum, int timeDelta, Vec3 * origin, Vec3 * mins, Vec3 * maxs );
 void GClip_ClearWorld();
+void GClip_BuildStaticTriggers();
 void GClip_SetBrushModel( edict_t * ent );
 void GClip_SetAreaPortalState( edict_t *ent, bool open );
 void GClip_LinkEntity( edict_t *ent );
@@ -460,6 +500,7 @@ SyncEntityState *G_GetEntityStateForDeltaTime( int entNum, int deltaTime );
 int GClip_FindInRadius( Vec3 org, float rad, int *list, int maxcount );
 
 bool IsHeadshot( int entNum, Vec3 hit, int timeDelta );
+bool IsHeadshot( const RewoundEntities * rewound, int entNum, Vec3 hit );
 
 // BoxEdicts() can return a list of either solid or trigger entities
 // FIXME: eliminate AREA_ distinction?
@@ -467,6 +508,7 @@ bool IsHeadshot( int entNum, Vec3 hit, int timeDelta );
 #define AREA_SOLID      1
 #define AREA_TRIGGERS   2
 int GClip_AreaEdicts( Vec3 mins, Vec3 maxs, int *list, int maxcount, int areatype, int timeDelta );
+void GClip_Benchmark_f();
 bool GClip_EntityContact( Vec3 mins, Vec3 maxs, edict_t *ent );
 
 //
@@ -505,6 +547,9 @@ void SP_decal( edict_t * ent );
 void G_FireWeapon( edict_t * ent, u64 parm );
 void G_UseGadget( edict_t * ent, GadgetType gadget, u64 parm );
 
+// fills in templates for entities spawned after the map loads, returns how many
+size_t G_ClassBaselines( Span< SyncEntityState > baselines );
+
 //
 // g_chasecam	//newgametypes
 //
@@ -586,6 +631,7 @@ void G_Snap_UpdateWeaponListMessages();
 // g_phys.c
 //
 void SV_Impact( edict_t *e1, trace_t *trace );
+void G_TraceProjectilesParallel();
 void G_RunEntity( edict_t *ent );
 int G_BoxSlideMove( edict_t *ent, int contentmask, float slideBounce, float friction );
 
@@ -600,6 +646,7 @@ int G_BoxSlideMove( edict_t *ent, int contentmask, float slideBounce, float fric
 void G_Init( unsigned int framemsec );
 void G_Shutdown();
 void G_ExitLevel();
+void G_PrefetchNextMap();
 void G_GamestatSetFlag( int flag, bool b );
 void G_Timeout_Reset();
 
@@ -620,6 +667,8 @@ void G_RespawnLevel();
 void G_ResetLevel();
 void G_InitLevel( const char *mapname, int64_t levelTime );
 void G_LoadMap( const char * name );
+void G_FreeCachedMaps();
+void G_PrefetchMap( const char * name );
 
 //
 // g_awards.c
@@ -795,9 +844,6 @@ struct edict_t {
 
 	int linkcount;
 
-	// physics grid areas this edict is linked into
-	link_t areagrid[MAX_ENT_AREAS];
-
 	SyncEntityState olds; // state in the last sent frame snap
 
 	int movetype;
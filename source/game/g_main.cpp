@@ -19,6 +19,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "game/g_local.h"
+#include "game/g_statstream.h"
+#include "qcommon/memory_budget.h"
 
 game_locals_t game;
 gs_state_t server_gs;
@@ -38,6 +40,7 @@ cvar_t *g_select_empty;
 cvar_t *filterban;
 
 cvar_t *g_maxvelocity;
+cvar_t *g_tracestats;
 
 cvar_t *sv_cheats;
 
@@ -56,6 +59,7 @@ cvar_t *g_inactivity_maxtime;
 
 cvar_t *g_projectile_prestep;
 cvar_t *g_numbots;
+cvar_t *g_botthinkbudget;
 cvar_t *g_maxtimeouts;
 cvar_t *g_antilag;
 cvar_t *g_antilag_maxtimedelta;
@@ -121,6 +125,18 @@ void G_GamestatSetFlag( int flag, bool b ) {
 	}
 }
 
+static void G_MemoryBudget( MemoryBudget * budget ) {
+	int clients_in_use = 0;
+	for( int i = 0; i < server_gs.maxclients; i++ ) {
+		if( game.edicts[ i + 1 ].r.inuse ) {
+			clients_in_use++;
+		}
+	}
+
+	budget->add_array( "game.edicts", game.maxentities * sizeof( game.edicts[ 0 ] ), game.numentities, game.maxentities, true );
+	budget->add_array( "game.clients", server_gs.maxclients * sizeof( game.clients[ 0 ] ), clients_in_use, server_gs.maxclients, true );
+}
+
 /*
 * G_Init
 *
@@ -145,6 +161,8 @@ void G_Init( unsigned int framemsec ) {
 		Cvar_SetValue( "g_maxvelocity", 20 );
 	}
 
+	g_tracestats = Cvar_Get( "g_tracestats", "0", 0 );
+
 	developer = Cvar_Get( "developer", "0", 0 );
 
 	// latched vars
@@ -159,6 +177,7 @@ void G_Init( unsigned int framemsec ) {
 	g_respawn_delay_min = Cvar_Get( "g_respawn_delay_min", "600", CVAR_DEVELOPER );
 	g_respawn_delay_max = Cvar_Get( "g_respawn_delay_max", "6000", CVAR_DEVELOPER );
 	g_numbots = Cvar_Get( "g_numbots", "0", CVAR_ARCHIVE );
+	g_botthinkbudget = Cvar_Get( "g_botthinkbudget", "250", CVAR_ARCHIVE );
 	g_deadbody_followkiller = Cvar_Get( "g_deadbody_followkiller", "1", CVAR_DEVELOPER );
 	g_maxtimeouts = Cvar_Get( "g_maxtimeouts", "2", CVAR_ARCHIVE );
 	g_antilag_maxtimedelta = Cvar_Get( "g_antilag_maxtimedelta", "200", CVAR_ARCHIVE );
@@ -206,7 +225,11 @@ void G_Init( unsigned int framemsec ) {
 
 	game.numentities = server_gs.maxclients + 1;
 
-	SV_LocateEntities( game.edicts, game.numentities, game.maxentities );
+	SV_LocateEntities( game.edicts, &game.hot, &game.events, game.numentities, game.maxentities );
+
+	AddMemoryBudget( "game", G_MemoryBudget );
+
+	G_InitStatStream();
 
 	// server console commands
 	G_AddServerCommands();
@@ -221,6 +244,9 @@ void G_Init( unsigned int framemsec ) {
 void G_Shutdown() {
 	Com_Printf( "==== G_Shutdown ====\n" );
 
+	RemoveMemoryBudget( "game" );
+	G_ShutdownStatStream();
+
 	GT_asCallShutdown();
 
 	GT_asShutdownScript();
@@ -229,6 +255,7 @@ void G_Shutdown() {
 	SV_WriteIPList();
 
 	G_RemoveCommands();
+	G_StopTraceRecording();
 
 	G_FreeCallvotes();
 
@@ -335,23 +362,27 @@ static void G_UpdateMapRotation() {
 /*
 * G_MapRotationNormal
 */
-static const char *G_MapRotationNormal() {
+static const char *G_MapRotationNormal( bool advance ) {
 	G_UpdateMapRotation();
 
 	if( !map_rotation_count ) {
 		return NULL;
 	}
 
-	map_rotation_current++;
+	int next = map_rotation_current + 1;
+
+	if( next >= map_rotation_count || map_rotation_p[next] == NULL ) {
+		next = 0;
+	}
 
-	if( map_rotation_current >= map_rotation_count || map_rotation_p[map_rotation_current] == NULL ) {
-		map_rotation_current = 0;
+	if( advance ) {
+		map_rotation_current = next;
 	}
 
-	return map_rotation_p[map_rotation_current];
+	return map_rotation_p[next];
 }
 
-static const char *G_NextMap() {
+static const char *G_NextMap( bool advance ) {
 	if( strlen( level.callvote_map ) > 0 )
 		return level.callvote_map;
 
@@ -360,10 +391,23 @@ static const char *G_NextMap() {
 		return sv.mapname;
 	}
 
-	const char *next = G_MapRotationNormal();
+	const char *next = G_MapRotationNormal( advance );
 	return next ? next : sv.mapname;
 }
 
+/*
+* G_PrefetchNextMap
+* Starts loading the map G_ExitLevel is going to change to
+*/
+void G_PrefetchNextMap() {
+	const char *nextmapname = G_NextMap( false );
+	if( !Q_stricmp( nextmapname, sv.mapname ) ) {
+		return;
+	}
+
+	G_PrefetchMap( nextmapname );
+}
+
 /*
 * G_ExitLevel
 */
@@ -372,7 +416,7 @@ void G_ExitLevel() {
 
 	level.exitNow = false;
 
-	const char *nextmapname = G_NextMap();
+	const char *nextmapname = G_NextMap( true );
 
 	// if it's the same map see if we can restart without loading
 	if( !level.hardReset && !Q_stricmp( nextmapname, sv.mapname ) ) {
@@ -29,9 +29,9 @@ void ThrowSmallPileOfGibs( edict_t *self, Vec3 knockback, int damage ) {
 	Vec3 origin = self->s.origin;
 	self->s.origin.z += 4;
 
-	edict_t * event = G_SpawnEvent( EV_GIB, damage, &origin );
-	event->s.team = self->s.team;
-	event->s.origin2 = self->velocity + knockback;
+	SyncSnapEvent * event = G_SpawnEvent( EV_GIB, damage, &origin );
+	event->team = self->s.team;
+	event->origin2 = self->velocity + knockback;
 }
 
 void BecomeExplosion1( edict_t *self ) {
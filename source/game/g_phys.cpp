@@ -19,6 +19,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "game/g_local.h"
+#include "qcommon/cmodel.h"
+#include "qcommon/threadpool.h"
+#include "qcommon/threads.h"
 
 //================================================================================
 
@@ -216,7 +219,7 @@ static bool SV_Push( edict_t *pusher, Vec3 move, Vec3 amove ) {
 			continue;
 		}
 
-		if( !check->areagrid[0].prev ) {
+		if( !check->linked ) {
 			continue; // not linked in anywhere
 		}
 
@@ -510,24 +513,114 @@ static void SV_Physics_Toss( edict_t *ent ) {
 
 //============================================================================
 
-static void SV_Physics_LinearProjectile( edict_t *ent ) {
+/*
+* linear projectiles only trace, and the world can't change during a frame,
+* so their world traces get done up front on the thread pool. the entity
+* clipping, impacts and touches still happen one entity at a time in
+* G_RunEntities so nothing depends on thread timing
+*/
+
+#define MIN_PROJECTILES_PER_JOB 16
+#define MIN_PARALLEL_PROJECTILES 32
+
+struct ProjectileWorldTrace {
+	bool valid;
 	Vec3 start, end;
+	Vec3 mins, maxs;
 	int mask;
 	trace_t trace;
-	bool wasinwater;
+};
 
-	wasinwater = ent->waterlevel;
+struct ProjectileTraceJob {
+	const int * entnums;
+	size_t n;
+};
+
+static ProjectileWorldTrace projectile_traces[ MAX_EDICTS ];
 
-	mask = ( ent->r.clipmask ) ? ent->r.clipmask : MASK_SOLID;
+static int LinearProjectileMask( const edict_t * ent ) {
+	return ent->r.clipmask ? ent->r.clipmask : MASK_SOLID;
+}
 
+static void LinearProjectileMove( const edict_t * ent, Vec3 * start, Vec3 * end ) {
 	// find its current position given the starting timeStamp
 	float endFlyTime = float( svs.gametime - ent->s.linearMovementTimeStamp ) * 0.001f;
 	float startFlyTime = float( Max2( s64( 0 ), game.prevServerTime - ent->s.linearMovementTimeStamp ) ) * 0.001f;
 
-	start = ent->s.linearMovementBegin + ent->s.linearMovementVelocity * startFlyTime;
-	end = ent->s.linearMovementBegin + ent->s.linearMovementVelocity * endFlyTime;
+	*start = ent->s.linearMovementBegin + ent->s.linearMovementVelocity * startFlyTime;
+	*end = ent->s.linearMovementBegin + ent->s.linearMovementVelocity * endFlyTime;
+}
+
+void G_TraceProjectilesParallel() {
+	ZoneScoped;
+
+	static int entnums[ MAX_EDICTS ];
+	size_t num_projectiles = 0;
+
+	for( int i = 0; i < game.numentities; i++ ) {
+		const edict_t * ent = &game.edicts[ i ];
+		projectile_traces[ i ].valid = false;
+
+		if( !ent->r.inuse || ISEVENTENTITY( &ent->s ) || ent->movetype != MOVETYPE_LINEARPROJECTILE ) {
+			continue;
+		}
+		entnums[ num_projectiles++ ] = i;
+	}
+
+	u32 cores = GetCoreCount();
+	if( !level.canSpawnEntities || cores == 1 || num_projectiles < MIN_PARALLEL_PROJECTILES ) {
+		return;
+	}
+
+	// one job per core so each thread only clears its checkcounts once
+	ProjectileTraceJob jobs[ MAX_EDICTS / MIN_PROJECTILES_PER_JOB ];
+	size_t num_jobs = Min2( size_t( cores ), num_projectiles / MIN_PROJECTILES_PER_JOB );
+	size_t per_job = ( num_projectiles + num_jobs - 1 ) / num_jobs;
+	for( size_t i = 0; i < num_jobs; i++ ) {
+		size_t first = i * per_job;
+		jobs[ i ].entnums = entnums + first;
+		jobs[ i ].n = Min2( num_projectiles - first, per_job );
+	}
+
+	ParallelFor( Span< ProjectileTraceJob >( jobs, num_jobs ), []( TempAllocator * temp, void * data ) {
+		const ProjectileTraceJob * job = ( const ProjectileTraceJob * ) data;
+		CollisionCheckCounts checkcounts = CM_NewCheckCounts( temp, svs.cms );
+
+		for( size_t i = 0; i < job->n; i++ ) {
+			const edict_t * ent = &game.edicts[ job->entnums[ i ] ];
+			ProjectileWorldTrace * pt = &projectile_traces[ job->entnums[ i ] ];
+
+			LinearProjectileMove( ent, &pt->start, &pt->end );
+			pt->mins = ent->r.mins;
+			pt->maxs = ent->r.maxs;
+			pt->mask = LinearProjectileMask( ent );
+			G_WorldTrace( &checkcounts, &pt->trace, pt->start, pt->mins, pt->maxs, pt->end, pt->mask );
+			pt->valid = true;
+		}
+	} );
+}
+
+static void SV_Physics_LinearProjectile( edict_t *ent ) {
+	Vec3 start, end;
+	int mask;
+	trace_t trace;
+	bool wasinwater;
+
+	wasinwater = ent->waterlevel;
+
+	mask = LinearProjectileMask( ent );
+	LinearProjectileMove( ent, &start, &end );
+
+	// the think might have moved us since the world trace was done
+	ProjectileWorldTrace * pt = &projectile_traces[ ENTNUM( ent ) ];
+	if( pt->valid && pt->start == start && pt->end == end && pt->mins == ent->r.mins && pt->maxs == ent->r.maxs && pt->mask == mask ) {
+		trace = pt->trace;
+		G_Trace4DEntities( &trace, start, ent->r.mins, ent->r.maxs, end, ent, mask, ent->timeDelta );
+	} else {
+		G_Trace4D( &trace, start, ent->r.mins, ent->r.maxs, end, ent, mask, ent->timeDelta );
+	}
+	pt->valid = false;
 
-	G_Trace4D( &trace, start, ent->r.mins, ent->r.maxs, end, ent, mask, ent->timeDelta );
 	ent->s.origin = trace.endpos;
 	GClip_LinkEntity( ent );
 	SV_Impact( ent, &trace );
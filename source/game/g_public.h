@@ -49,3 +49,32 @@ struct entity_shared_t {
 	int clipmask;
 	edict_t *owner;
 };
+
+/*
+ * hot components
+ *
+ * the fields the per snapshot entity loops read, pulled out of edict_t into
+ * parallel arrays so the per client culling streams a few KB instead of
+ * striding over every edict. edict_t stays authoritative: G_SnapFrame
+ * refreshes these once the sim is done, right before the server builds
+ * snapshots. dirty has a bit set for every edict whose hot components
+ * changed since the previous refresh
+ */
+struct EdictHotComponents {
+	int num_edicts;
+	u32 svflags[ MAX_EDICTS ];
+	Vec3 origin[ MAX_EDICTS ];
+	Vec3 velocity[ MAX_EDICTS ];
+	u8 movetype[ MAX_EDICTS ];
+	u8 solid[ MAX_EDICTS ];
+	u64 dirty[ MAX_EDICTS / 64 ];
+};
+
+/*
+ * events spawned since the last snapshot. G_ClearSnap empties it once the
+ * snapshots have been built
+ */
+struct SnapEvents {
+	int num_events;
+	SyncSnapEvent events[ MAX_SNAP_EVENTS ];
+};
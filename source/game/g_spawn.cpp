@@ -19,10 +19,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/base.h"
+#include "qcommon/array.h"
 #include "qcommon/compression.h"
 #include "qcommon/cmodel.h"
 #include "qcommon/fs.h"
+#include "qcommon/load_profile.h"
+#include "qcommon/threadpool.h"
 #include "game/g_local.h"
+#include "game/g_statstream.h"
 
 enum EntityFieldType {
 	EntityField_Int,
@@ -147,59 +151,98 @@ static bool SpawnEntity( edict_t * ent ) {
 	return false;
 }
 
-static void ED_ParseField( Span< const char > key, Span< const char > value, edict_t * ent ) {
+/*
+ * map entities get parsed into a flat array of field values and cached, so
+ * round restarts only have to rerun the spawn functions. gladiator cycles
+ * through a handful of maps so we keep a few of them around
+ */
+
+#define MAX_PARSED_MAPS 8
+
+union EntityFieldValue {
+	int i;
+	float f;
+	u64 hash;
+	Vec3 v;
+	RGBA8 rgba;
+};
+
+struct ParsedEntityField {
+	u8 field;
+	EntityFieldValue value;
+};
+
+struct ParsedEntity {
+	size_t first_field;
+	size_t num_fields;
+	s64 classname; // offset into classnames, -1 if there's no classname key
+	size_t classname_len;
+};
+
+struct ParsedMapEntities {
+	u64 key;
+	NonRAIIDynamicArray< ParsedEntity > entities;
+	NonRAIIDynamicArray< ParsedEntityField > fields;
+	NonRAIIDynamicArray< char > classnames;
+};
+
+static ParsedMapEntities parsed_maps_storage[ MAX_PARSED_MAPS ];
+static ParsedMapEntities * parsed_maps[ MAX_PARSED_MAPS ]; // least recently used first, then unused slots
+static size_t num_parsed_maps;
+
+static EntityFieldValue ED_ParseFieldValue( EntityFieldType type, Span< const char > value ) {
+	EntityFieldValue v;
+
+	switch( type ) {
+		case EntityField_StringHash:
+			v.hash = StringHash( value ).hash;
+			break;
+		case EntityField_Asset:
+			if( value[ 0 ] == '*' ) {
+				v.hash = Hash64( value.ptr, value.n, svs.cms->base_hash );
+			}
+			else {
+				v.hash = StringHash( value ).hash;
+			}
+			break;
+		case EntityField_Int:
+			v.i = SpanToInt( value, 0 );
+			break;
+		case EntityField_Float:
+			v.f = SpanToFloat( value, 0.0f );
+			break;
+		case EntityField_Angle:
+			v.v = Vec3( 0.0f, SpanToFloat( value, 0.0f ), 0.0f );
+			break;
+
+		case EntityField_Vec3:
+			v.v.x = ParseFloat( &value, 0.0f, Parse_StopOnNewLine );
+			v.v.y = ParseFloat( &value, 0.0f, Parse_StopOnNewLine );
+			v.v.z = ParseFloat( &value, 0.0f, Parse_StopOnNewLine );
+			break;
+
+		case EntityField_RGBA:
+			v.rgba.r = ParseInt( &value, 255, Parse_StopOnNewLine );
+			v.rgba.g = ParseInt( &value, 255, Parse_StopOnNewLine );
+			v.rgba.b = ParseInt( &value, 255, Parse_StopOnNewLine );
+			v.rgba.a = ParseInt( &value, 255, Parse_StopOnNewLine );
+			break;
+	}
+
+	return v;
+}
+
+static void ED_ParseField( ParsedMapEntities * parsed, Span< const char > key, Span< const char > value ) {
 	StringHash key_hash = StringHash( key );
 
-	for( EntityField f : entity_keys ) {
-		if( f.name != key_hash )
+	for( size_t i = 0; i < ARRAY_COUNT( entity_keys ); i++ ) {
+		if( entity_keys[ i ].name != key_hash )
 			continue;
 
-		uint8_t *b;
-		if( f.temp ) {
-			b = (uint8_t *)&st;
-		} else {
-			b = (uint8_t *)ent;
-		}
-
-		switch( f.type ) {
-			case EntityField_StringHash:
-				*(StringHash *)( b + f.ofs ) = StringHash( value );
-				break;
-			case EntityField_Asset:
-				if( value[ 0 ] == '*' ) {
-					*(StringHash *)( b + f.ofs ) = StringHash( Hash64( value.ptr, value.n, svs.cms->base_hash ) );
-				}
-				else {
-					*(StringHash *)( b + f.ofs ) = StringHash( value );
-				}
-				break;
-			case EntityField_Int:
-				*(int *)( b + f.ofs ) = SpanToInt( value, 0 );
-				break;
-			case EntityField_Float:
-				*(float *)( b + f.ofs ) = SpanToFloat( value, 0.0f );
-				break;
-			case EntityField_Angle:
-				*(Vec3 *)( b + f.ofs ) = Vec3( 0.0f, SpanToFloat( value, 0.0f ), 0.0f );
-				break;
-
-			case EntityField_Vec3: {
-				Vec3 vec;
-				vec.x = ParseFloat( &value, 0.0f, Parse_StopOnNewLine );
-				vec.y = ParseFloat( &value, 0.0f, Parse_StopOnNewLine );
-				vec.z = ParseFloat( &value, 0.0f, Parse_StopOnNewLine );
-				*(Vec3 *)( b + f.ofs ) = vec;
-			} break;
-
-			case EntityField_RGBA: {
-				RGBA8 rgba;
-				rgba.r = ParseInt( &value, 255, Parse_StopOnNewLine );
-				rgba.g = ParseInt( &value, 255, Parse_StopOnNewLine );
-				rgba.b = ParseInt( &value, 255, Parse_StopOnNewLine );
-				rgba.a = ParseInt( &value, 255, Parse_StopOnNewLine );
-				*(RGBA8 *)( b + f.ofs ) = rgba;
-			} break;
-		}
+		ParsedEntityField field;
+		field.field = i;
+		field.value = ED_ParseFieldValue( entity_keys[ i ].type, value );
+		parsed->fields.add( field );
 		return;
 	}
 
@@ -208,9 +251,45 @@ static void ED_ParseField( Span< const char > key, Span< const char > value, edi
 	}
 }
 
-static void ED_ParseEntity( Span< const char > * cursor, edict_t * ent ) {
-	memset( &st, 0, sizeof( st ) );
-	st.spawn_probability = 1.0f;
+static void ED_ApplyField( const ParsedEntityField * field, edict_t * ent ) {
+	const EntityField & f = entity_keys[ field->field ];
+
+	uint8_t *b;
+	if( f.temp ) {
+		b = (uint8_t *)&st;
+	} else {
+		b = (uint8_t *)ent;
+	}
+
+	switch( f.type ) {
+		case EntityField_StringHash:
+		case EntityField_Asset:
+			*(StringHash *)( b + f.ofs ) = StringHash( field->value.hash );
+			if( !f.temp ) {
+				G_UpdateEdictIndex( ent );
+			}
+			break;
+		case EntityField_Int:
+			*(int *)( b + f.ofs ) = field->value.i;
+			break;
+		case EntityField_Float:
+			*(float *)( b + f.ofs ) = field->value.f;
+			break;
+		case EntityField_Angle:
+		case EntityField_Vec3:
+			*(Vec3 *)( b + f.ofs ) = field->value.v;
+			break;
+		case EntityField_RGBA:
+			*(RGBA8 *)( b + f.ofs ) = field->value.rgba;
+			break;
+	}
+}
+
+static void ED_ParseEntity( Span< const char > * cursor, ParsedMapEntities * parsed ) {
+	ParsedEntity ent;
+	ent.first_field = parsed->fields.size();
+	ent.classname = -1;
+	ent.classname_len = 0;
 
 	while( true ) {
 		Span< const char > key = ParseToken( cursor, Parse_DontStopOnNewLine );
@@ -228,12 +307,82 @@ static void ED_ParseEntity( Span< const char > * cursor, edict_t * ent ) {
 			Fatal( "ED_ParseEntity: closing brace without data" );
 		}
 
-		ED_ParseField( key, value, ent );
+		ED_ParseField( parsed, key, value );
 
 		if( StrCaseEqual( key, "classname" ) ) {
-			st.classname = value;
+			ent.classname = parsed->classnames.extend( value.n );
+			ent.classname_len = value.n;
+			memcpy( parsed->classnames.ptr() + ent.classname, value.ptr, value.n );
+		}
+	}
+
+	ent.num_fields = parsed->fields.size() - ent.first_field;
+	parsed->entities.add( ent );
+}
+
+static void ED_ParseEntities( ParsedMapEntities * parsed ) {
+	ZoneScoped;
+
+	Span< const char > cursor = MakeSpan( CM_EntityString( svs.cms ) );
+
+	while( true ) {
+		// parse the opening brace
+		Span< const char > brace = ParseToken( &cursor, Parse_DontStopOnNewLine );
+		if( brace == "" )
+			break;
+		if( brace != "{" ) {
+			Fatal( "SpawnMapEntities: entity string doesn't begin with {" );
 		}
+
+		ED_ParseEntity( &cursor, parsed );
+	}
+}
+
+static void G_RemoveParsedMap( size_t idx ) {
+	ParsedMapEntities * parsed = parsed_maps[ idx ];
+	parsed->entities.shutdown();
+	parsed->fields.shutdown();
+	parsed->classnames.shutdown();
+
+	memmove( parsed_maps + idx, parsed_maps + idx + 1, ( num_parsed_maps - idx - 1 ) * sizeof( parsed_maps[ 0 ] ) );
+	num_parsed_maps--;
+	parsed_maps[ num_parsed_maps ] = parsed;
+}
+
+static const ParsedMapEntities * G_GetParsedMapEntities() {
+	if( parsed_maps[ 0 ] == NULL ) {
+		for( size_t i = 0; i < ARRAY_COUNT( parsed_maps ); i++ ) {
+			parsed_maps[ i ] = &parsed_maps_storage[ i ];
+		}
+	}
+
+	u64 key = Hash64( &svs.ent_string_checksum, sizeof( svs.ent_string_checksum ), svs.cms->base_hash );
+
+	for( size_t i = 0; i < num_parsed_maps; i++ ) {
+		ParsedMapEntities * parsed = parsed_maps[ i ];
+		if( parsed->key != key )
+			continue;
+
+		memmove( parsed_maps + i, parsed_maps + i + 1, ( num_parsed_maps - i - 1 ) * sizeof( parsed_maps[ 0 ] ) );
+		parsed_maps[ num_parsed_maps - 1 ] = parsed;
+		return parsed;
 	}
+
+	if( num_parsed_maps == ARRAY_COUNT( parsed_maps ) ) {
+		G_RemoveParsedMap( 0 );
+	}
+
+	ParsedMapEntities * parsed = parsed_maps[ num_parsed_maps ];
+	num_parsed_maps++;
+
+	parsed->key = key;
+	parsed->entities.init( sys_allocator );
+	parsed->fields.init( sys_allocator );
+	parsed->classnames.init( sys_allocator );
+
+	ED_ParseEntities( parsed );
+
+	return parsed;
 }
 
 static void G_FreeEntities() {
@@ -250,25 +399,26 @@ static void G_FreeEntities() {
 	}
 
 	game.numentities = server_gs.maxclients + 1;
+
+	G_ResetFreeEdicts();
+	G_ResetEdictIndex();
+	G_ResetSpawnPoints();
 }
 
 static void SpawnMapEntities() {
+	ZoneScoped;
+	LoadProfileScoped( "SpawnMapEntities" );
+
 	level.spawnedTimeStamp = svs.gametime;
 	level.canSpawnEntities = true;
 
-	Span< const char > cursor = MakeSpan( CM_EntityString( svs.cms ) );
-	edict_t * ent = NULL;
+	const ParsedMapEntities * parsed = G_GetParsedMapEntities();
 
-	while( true ) {
-		// parse the opening brace
-		Span< const char > brace = ParseToken( &cursor, Parse_DontStopOnNewLine );
-		if( brace == "" )
-			break;
-		if( brace != "{" ) {
-			Fatal( "SpawnMapEntities: entity string doesn't begin with {" );
-		}
+	for( size_t i = 0; i < parsed->entities.size(); i++ ) {
+		const ParsedEntity * parsed_ent = &parsed->entities[ i ];
 
-		if( ent == NULL ) {
+		edict_t * ent;
+		if( i == 0 ) {
 			ent = world;
 			G_InitEdict( world );
 		}
@@ -276,7 +426,15 @@ static void SpawnMapEntities() {
 			ent = G_Spawn();
 		}
 
-		ED_ParseEntity( &cursor, ent );
+		memset( &st, 0, sizeof( st ) );
+		st.spawn_probability = 1.0f;
+		if( parsed_ent->classname >= 0 ) {
+			st.classname = Span< const char >( parsed->classnames.ptr() + parsed_ent->classname, parsed_ent->classname_len );
+		}
+
+		for( size_t j = 0; j < parsed_ent->num_fields; j++ ) {
+			ED_ApplyField( &parsed->fields[ parsed_ent->first_field + j ], ent );
+		}
 
 		bool ok = true;
 		bool rng = Probability( &svs.rng, st.spawn_probability );
@@ -289,8 +447,10 @@ static void SpawnMapEntities() {
 		}
 	}
 
+	GClip_BuildStaticTriggers();
+
 	// make sure server got the edicts data
-	SV_LocateEntities( game.edicts, game.numentities, game.maxentities );
+	SV_LocateEntities( game.edicts, &game.hot, &game.events, game.numentities, game.maxentities );
 }
 
 /*
@@ -300,6 +460,8 @@ static void SpawnMapEntities() {
 * parsing textual entity definitions out of an ent file.
 */
 void G_InitLevel( const char *mapname, int64_t levelTime ) {
+	LoadProfileScoped( "G_InitLevel" );
+
 	TempAllocator temp = svs.frame_arena.temp();
 
 	G_asGarbageCollect( true );
@@ -316,6 +478,7 @@ void G_InitLevel( const char *mapname, int64_t levelTime ) {
 	const char * path = temp( "maps/{}", mapname );
 	server_gs.gameState.map = StringHash( path );
 	server_gs.gameState.map_checksum = svs.cms->checksum;
+	G_StatStreamMap( mapname );
 
 	G_FreeEntities();
 
@@ -375,39 +538,240 @@ void G_RespawnLevel() {
 	G_InitLevel( sv.mapname, level.time );
 }
 
-void G_LoadMap( const char * name ) {
+/*
+* gametypes like gladiator switch between a handful of maps every round, so
+* keep their collision models around rather than reparsing the BSP and
+* rebuilding the fat PVS each time. the file still gets read and checksummed
+* so hotloading picks up changes
+*/
+
+#define MAX_CACHED_MAPS 8
+
+static CollisionModel * cached_maps[ MAX_CACHED_MAPS ]; // least recently used first
+static size_t num_cached_maps;
+
+static void G_RemoveCachedMap( size_t idx ) {
+	CM_Free( CM_Server, cached_maps[ idx ] );
+	memmove( cached_maps + idx, cached_maps + idx + 1, ( num_cached_maps - idx - 1 ) * sizeof( cached_maps[ 0 ] ) );
+	num_cached_maps--;
+}
+
+static CollisionModel * G_FindCachedMap( u64 base_hash, size_t * idx ) {
+	for( size_t i = 0; i < num_cached_maps; i++ ) {
+		if( cached_maps[ i ]->base_hash == base_hash ) {
+			*idx = i;
+			return cached_maps[ i ];
+		}
+	}
+
+	return NULL;
+}
+
+// takes ownership of prefetched, which is an unregistered CM_ParseMap result or NULL
+static CollisionModel * G_LoadCollisionModel( Span< const u8 > data, u32 checksum, u64 base_hash, CollisionModel * prefetched ) {
+	size_t idx;
+	CollisionModel * cached = G_FindCachedMap( base_hash, &idx );
+	if( cached != NULL ) {
+		// cmodels are keyed by map name so an old version can't stick around
+		if( cached->checksum != checksum ) {
+			G_RemoveCachedMap( idx );
+		}
+		else {
+			if( prefetched != NULL ) {
+				CM_Free( CM_Server, prefetched );
+			}
+
+			memmove( cached_maps + idx, cached_maps + idx + 1, ( num_cached_maps - idx - 1 ) * sizeof( cached_maps[ 0 ] ) );
+			cached_maps[ num_cached_maps - 1 ] = cached;
+
+			CM_ResetAreaPortals( cached );
+			return cached;
+		}
+	}
+
+	if( num_cached_maps == ARRAY_COUNT( cached_maps ) ) {
+		G_RemoveCachedMap( 0 );
+	}
+
+	// on a listen server the client has almost certainly loaded the same map already
+	const CollisionModel * client_cms = CL_FindMapCollisionModel( base_hash );
+
+	CollisionModel * cms;
+	if( prefetched != NULL && prefetched->checksum == checksum ) {
+		CM_RegisterMap( CM_Server, prefetched );
+		cms = prefetched;
+	}
+	else {
+		if( prefetched != NULL ) {
+			CM_Free( CM_Server, prefetched );
+		}
+
+		if( client_cms != NULL && client_cms->checksum == checksum ) {
+			cms = CM_ShareMap( CM_Server, CM_Client, client_cms );
+		}
+		else {
+			cms = CM_LoadMap( CM_Server, data, base_hash );
+		}
+	}
+
+	cached_maps[ num_cached_maps ] = cms;
+	num_cached_maps++;
+
+	return cms;
+}
+
+/*
+* map votes and intermissions prefetch the map that's probably coming next,
+* so the map change doesn't have to wait on the disk, decompression and
+* parsing the BSP. the collision model gets parsed but not registered, since
+* the game is still tracing against the current map, and G_LoadMap registers
+* it if the file hasn't changed since. there's only ever one prefetch going,
+* on the thread pool
+*/
+
+struct MapPrefetch {
+	char name[ MAX_CONFIGSTRING_CHARS ];
+	u64 base_hash;
+	bool parse; // false if we already have a collision model for it
+	Span< u8 > data;
+	size_t file_bytes;
+	u32 checksum;
+	CollisionModel * cms;
+	JobGroup group;
+	bool active;
+};
+
+static MapPrefetch map_prefetch;
+
+// returns NULL if the map doesn't exist or doesn't decompress
+static Span< u8 > G_ReadMapData( TempAllocator * temp, const char * name, size_t * file_bytes ) {
+	const char * bsp_path = ( *temp )( "{}/base/maps/{}.bsp", RootDirPath(), name );
+	Span< u8 > data = ReadFileBinary( sys_allocator, bsp_path );
+	if( data.ptr != NULL ) {
+		*file_bytes = data.n;
+		return data;
+	}
+
+	const char * zst_path = ( *temp )( "{}.zst", bsp_path );
+	Span< u8 > compressed = ReadFileBinary( sys_allocator, zst_path );
+	defer { FREE( sys_allocator, compressed.ptr ); };
+	if( compressed.ptr == NULL ) {
+		return Span< u8 >();
+	}
+
+	if( !Decompress( zst_path, sys_allocator, compressed, &data ) ) {
+		FREE( sys_allocator, data.ptr );
+		return Span< u8 >();
+	}
+
+	*file_bytes = compressed.n;
+	return data;
+}
+
+static void G_PrefetchMapJob( TempAllocator * temp, void * data ) {
+	map_prefetch.data = G_ReadMapData( temp, map_prefetch.name, &map_prefetch.file_bytes );
+	if( map_prefetch.data.ptr == NULL )
+		return;
+
+	if( map_prefetch.parse ) {
+		map_prefetch.cms = CM_ParseMap( map_prefetch.data, map_prefetch.base_hash );
+		map_prefetch.checksum = map_prefetch.cms->checksum;
+	}
+	else {
+		map_prefetch.checksum = Hash32( map_prefetch.data.ptr, map_prefetch.data.n );
+	}
+}
+
+static void G_CancelMapPrefetch() {
+	if( !map_prefetch.active )
+		return;
+
+	ThreadPoolWait( &map_prefetch.group );
+	FREE( sys_allocator, map_prefetch.data.ptr );
+	if( map_prefetch.cms != NULL ) {
+		CM_Free( CM_Server, map_prefetch.cms );
+	}
+	map_prefetch.data = Span< u8 >();
+	map_prefetch.cms = NULL;
+	map_prefetch.active = false;
+}
+
+void G_PrefetchMap( const char * name ) {
+	if( map_prefetch.active && strcmp( map_prefetch.name, name ) == 0 )
+		return;
+
+	G_CancelMapPrefetch();
+
 	TempAllocator temp = svs.frame_arena.temp();
 
-	if( svs.cms != NULL ) {
-		CM_Free( CM_Server, svs.cms );
+	Q_strncpyz( map_prefetch.name, name, sizeof( map_prefetch.name ) );
+	map_prefetch.base_hash = Hash64( temp( "maps/{}", name ) );
+
+	size_t idx;
+	map_prefetch.parse = G_FindCachedMap( map_prefetch.base_hash, &idx ) == NULL && CL_FindMapCollisionModel( map_prefetch.base_hash ) == NULL;
+
+	map_prefetch.data = Span< u8 >();
+	map_prefetch.file_bytes = 0;
+	map_prefetch.cms = NULL;
+	map_prefetch.active = true;
+	ThreadPoolDo( &map_prefetch.group, G_PrefetchMapJob );
+}
+
+void G_FreeCachedMaps() {
+	G_CancelMapPrefetch();
+
+	while( num_cached_maps > 0 ) {
+		G_RemoveCachedMap( num_cached_maps - 1 );
 	}
+	svs.cms = NULL;
+
+	while( num_parsed_maps > 0 ) {
+		G_RemoveParsedMap( num_parsed_maps - 1 );
+	}
+}
+
+void G_LoadMap( const char * name ) {
+	LoadProfileScoped( "G_LoadMap" );
+
+	TempAllocator temp = svs.frame_arena.temp();
 
 	Q_strncpyz( sv.mapname, name, sizeof( sv.mapname ) );
 
 	const char * base_path = temp( "maps/{}", name );
 
 	Span< u8 > data;
+	size_t file_bytes = 0;
+	u32 checksum = 0;
+	CollisionModel * prefetched = NULL;
 	defer { FREE( sys_allocator, data.ptr ); };
 
-	const char * bsp_path = temp( "{}/base/maps/{}.bsp", RootDirPath(), name );
-	data = ReadFileBinary( sys_allocator, bsp_path );
+	if( map_prefetch.active && strcmp( map_prefetch.name, name ) == 0 ) {
+		ThreadPoolWait( &map_prefetch.group );
+		data = map_prefetch.data;
+		file_bytes = map_prefetch.file_bytes;
+		checksum = map_prefetch.checksum;
+		prefetched = map_prefetch.cms;
+		map_prefetch.data = Span< u8 >();
+		map_prefetch.cms = NULL;
+		map_prefetch.active = false;
+	}
+	else {
+		G_CancelMapPrefetch();
+	}
 
+	// also retry if the prefetch failed, in case the map showed up since
 	if( data.ptr == NULL ) {
-		const char * zst_path = temp( "{}.zst", bsp_path );
-		Span< u8 > compressed = ReadFileBinary( sys_allocator, zst_path );
-		defer { FREE( sys_allocator, compressed.ptr ); };
-		if( compressed.ptr == NULL ) {
-			Fatal( "Couldn't find map %s", name );
-		}
-
-		bool ok = Decompress( zst_path, sys_allocator, compressed, &data );
-		if( !ok ) {
-			Fatal( "Couldn't decompress %s", zst_path );
+		data = G_ReadMapData( &temp, name, &file_bytes );
+		if( data.ptr == NULL ) {
+			Fatal( "Couldn't load map %s", name );
 		}
+		checksum = Hash32( data.ptr, data.n );
 	}
 
+	LoadProfileAddBytes( file_bytes );
+
 	u64 base_hash = Hash64( base_path );
-	svs.cms = CM_LoadMap( CM_Server, data, base_hash );
+	svs.cms = G_LoadCollisionModel( data, checksum, base_hash, prefetched );
 	svs.ent_string_checksum = Hash64( CM_EntityString( svs.cms ), CM_EntityStringLen( svs.cms ) );
 
 	server_gs.gameState.map = StringHash( base_hash );
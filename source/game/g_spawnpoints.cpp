@@ -38,6 +38,121 @@ static edict_t * G_FindPostMatchCamera() {
 	return G_Find( NULL, &edict_t::classname, "info_player_intermission" );
 }
 
+/*
+* spawn points are map entities that never move, so remember the entities of
+* each class scripts pick from, and the drop to floor trace against the world
+* for each spot. respawns then only clip the cached trace against entities,
+* which keeps round starts where everyone spawns at once cheap
+*/
+
+#define MAX_SPAWN_POINTS 256
+#define MAX_SPAWN_POINT_CLASSES 16
+#define SPAWN_DROP_CACHE_SIZE 256
+
+struct SpawnPointClass {
+	StringHash classname;
+	size_t first, n;
+};
+
+struct SpawnDrop {
+	int entnum;
+	Vec3 start;
+	trace_t world_trace;
+};
+
+static int spawn_points[ MAX_SPAWN_POINTS ];
+static size_t num_spawn_points;
+static SpawnPointClass spawn_point_classes[ MAX_SPAWN_POINT_CLASSES ];
+static size_t num_spawn_point_classes;
+
+static SpawnDrop spawn_drops[ SPAWN_DROP_CACHE_SIZE ]; // direct mapped by entnum
+
+void G_ResetSpawnPoints() {
+	num_spawn_points = 0;
+	num_spawn_point_classes = 0;
+	for( SpawnDrop & drop : spawn_drops ) {
+		drop.entnum = -1;
+	}
+}
+
+static bool SpawnPointClassIsValid( const SpawnPointClass * cls ) {
+	for( size_t i = 0; i < cls->n; i++ ) {
+		const edict_t * ent = &game.edicts[ spawn_points[ cls->first + i ] ];
+		if( !ent->r.inuse || ent->classname != cls->classname ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static const SpawnPointClass * AddSpawnPointClass( StringHash classname ) {
+	if( num_spawn_point_classes == ARRAY_COUNT( spawn_point_classes ) ) {
+		return NULL;
+	}
+
+	size_t first = num_spawn_points;
+
+	edict_t * ent = NULL;
+	while( ( ent = G_Find( ent, &edict_t::classname, classname ) ) != NULL ) {
+		if( num_spawn_points == ARRAY_COUNT( spawn_points ) ) {
+			num_spawn_points = first;
+			return NULL;
+		}
+		spawn_points[ num_spawn_points ] = ENTNUM( ent );
+		num_spawn_points++;
+	}
+
+	SpawnPointClass * cls = &spawn_point_classes[ num_spawn_point_classes ];
+	cls->classname = classname;
+	cls->first = first;
+	cls->n = num_spawn_points - first;
+	num_spawn_point_classes++;
+
+	return cls;
+}
+
+static const SpawnPointClass * FindSpawnPointClass( StringHash classname ) {
+	for( size_t i = 0; i < num_spawn_point_classes; i++ ) {
+		const SpawnPointClass * cls = &spawn_point_classes[ i ];
+		if( cls->classname != classname ) {
+			continue;
+		}
+
+		if( SpawnPointClassIsValid( cls ) ) {
+			return cls;
+		}
+
+		// a script freed or renamed one of them, start over
+		num_spawn_points = 0;
+		num_spawn_point_classes = 0;
+		break;
+	}
+
+	return AddSpawnPointClass( classname );
+}
+
+edict_t * G_RandomSpawnPoint( StringHash classname ) {
+	const SpawnPointClass * cls = FindSpawnPointClass( classname );
+	if( cls == NULL ) {
+		static edict_t * ents[ MAX_EDICTS ];
+		size_t n = 0;
+
+		edict_t * ent = NULL;
+		while( ( ent = G_Find( ent, &edict_t::classname, classname ) ) != NULL ) {
+			ents[ n ] = ent;
+			n++;
+		}
+
+		return n == 0 ? NULL : ents[ RandomUniform( &svs.rng, 0, n ) ];
+	}
+
+	if( cls->n == 0 ) {
+		return NULL;
+	}
+
+	return &game.edicts[ spawn_points[ cls->first + RandomUniform( &svs.rng, 0, cls->n ) ] ];
+}
+
 void SelectSpawnPoint( edict_t * ent, edict_t ** spawnpoint, Vec3 * origin, Vec3 * angles ) {
 	edict_t * spot;
 
@@ -61,7 +176,23 @@ void SelectSpawnPoint( edict_t * ent, edict_t ** spawnpoint, Vec3 * origin, Vec3
 	Vec3 start = *origin + Vec3( 0.0f, 0.0f, 16.0f );
 	Vec3 end = *origin - Vec3( 0.0f, 0.0f, 512.0f );
 
-	G_Trace( &trace, start, playerbox_stand_mins, playerbox_stand_maxs, end, ent, MASK_PLAYERSOLID );
+	if( spot == world ) {
+		G_Trace( &trace, start, playerbox_stand_mins, playerbox_stand_maxs, end, ent, MASK_PLAYERSOLID );
+	}
+	else {
+		SpawnDrop * drop = &spawn_drops[ ENTNUM( spot ) % ARRAY_COUNT( spawn_drops ) ];
+		if( drop->entnum != ENTNUM( spot ) || drop->start != start ) {
+			TempAllocator temp = svs.frame_arena.temp();
+			CollisionCheckCounts checkcounts = CM_NewCheckCounts( &temp, svs.cms );
+
+			drop->entnum = ENTNUM( spot );
+			drop->start = start;
+			G_WorldTrace( &checkcounts, &drop->world_trace, start, playerbox_stand_mins, playerbox_stand_maxs, end, MASK_PLAYERSOLID );
+		}
+
+		trace = drop->world_trace;
+		G_Trace4DEntities( &trace, start, playerbox_stand_mins, playerbox_stand_maxs, end, ent, MASK_PLAYERSOLID, 0 );
+	}
 
 	*origin = trace.endpos + trace.plane.normal;
 }
@@ -0,0 +1,211 @@
+#include <atomic>
+
+#include "qcommon/base.h"
+#include "qcommon/fs.h"
+#include "qcommon/spsc_queue.h"
+#include "qcommon/threads.h"
+#include "game/g_local.h"
+#include "game/g_statstream.h"
+
+/*
+ * the game thread pushes events into a lock-free queue and a writer thread
+ * appends them to the file, so stats never touch the disk from the game
+ * thread. the writer gets woken once a frame. if it falls a whole queue
+ * behind we count what we dropped and tell the stream once there's room
+ */
+
+static SPSCQueue< StatEvent, 4096 > stat_events;
+
+static struct {
+	bool enabled;
+	FILE * file;
+	Thread * thread;
+	Semaphore * wake;
+	std::atomic< bool > shutting_down;
+
+	u32 dropped;
+	MatchState match_state;
+	RoundState round_state;
+	u8 round_num;
+} stat_stream;
+
+static cvar_t * g_statstream;
+
+static void StatStreamThread( void * data ) {
+	StatEvent buf[ 64 ];
+
+	while( true ) {
+		Wait( stat_stream.wake );
+		bool shutting_down = stat_stream.shutting_down.load( std::memory_order_acquire );
+
+		size_t n = 0;
+		while( stat_events.pop( &buf[ n ] ) ) {
+			n++;
+			if( n == ARRAY_COUNT( buf ) ) {
+				WritePartialFile( stat_stream.file, buf, sizeof( buf ) );
+				n = 0;
+			}
+		}
+
+		WritePartialFile( stat_stream.file, buf, n * sizeof( buf[ 0 ] ) );
+		fflush( stat_stream.file );
+
+		if( shutting_down )
+			break;
+	}
+}
+
+static StatEvent NewStatEvent( StatEventType type ) {
+	StatEvent event = { };
+	event.time = svs.gametime;
+	event.type = type;
+	event.entity = -1;
+	event.target = -1;
+	event.assistor = -1;
+	return event;
+}
+
+static void PushStatEvent( const StatEvent & event ) {
+	if( !stat_stream.enabled )
+		return;
+
+	if( !stat_events.push( event ) ) {
+		stat_stream.dropped++;
+	}
+}
+
+static s16 StatEntity( const edict_t * ent ) {
+	return ent == NULL ? -1 : s16( ENTNUM( ent ) );
+}
+
+void G_InitStatStream() {
+	g_statstream = Cvar_Get( "g_statstream", "0", CVAR_ARCHIVE | CVAR_LATCH );
+
+	stat_stream.enabled = false;
+	if( g_statstream->integer == 0 )
+		return;
+
+	TempAllocator temp = svs.frame_arena.temp();
+
+	char date[ 256 ];
+	Sys_FormatTime( date, sizeof( date ), "%y%m%d_%H%M%S" );
+	const char * path = temp( "{}/stats/{}.stats", HomeDirPath(), date );
+
+	if( !CreatePathForFile( &temp, path ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't create the directory for %s\n", path );
+		return;
+	}
+
+	stat_stream.file = OpenFile( &temp, path, "wb" );
+	if( stat_stream.file == NULL ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't open %s\n", path );
+		return;
+	}
+
+	StatStreamHeader header;
+	header.magic = STAT_STREAM_MAGIC;
+	header.event_size = sizeof( StatEvent );
+	WritePartialFile( stat_stream.file, &header, sizeof( header ) );
+
+	stat_events.clear();
+	stat_stream.enabled = true;
+	stat_stream.dropped = 0;
+	stat_stream.match_state = server_gs.gameState.match_state;
+	stat_stream.round_state = server_gs.gameState.round_state;
+	stat_stream.round_num = server_gs.gameState.round_num;
+
+	stat_stream.wake = NewSemaphore();
+	stat_stream.shutting_down.store( false, std::memory_order_release );
+	stat_stream.thread = NewThread( StatStreamThread );
+
+	Com_Printf( "Writing stats to %s\n", path );
+}
+
+void G_ShutdownStatStream() {
+	if( !stat_stream.enabled )
+		return;
+
+	stat_stream.enabled = false;
+	stat_stream.shutting_down.store( true, std::memory_order_release );
+	Signal( stat_stream.wake );
+	JoinThread( stat_stream.thread );
+	DeleteSemaphore( stat_stream.wake );
+
+	fclose( stat_stream.file );
+	stat_stream.file = NULL;
+
+	if( stat_stream.dropped > 0 ) {
+		Com_Printf( S_COLOR_YELLOW "The stats writer fell behind, %u events were dropped at the end\n", stat_stream.dropped );
+	}
+}
+
+void G_StatStreamFrame() {
+	if( !stat_stream.enabled )
+		return;
+
+	if( stat_stream.dropped > 0 ) {
+		StatEvent event = NewStatEvent( StatEvent_Dropped );
+		event.count = stat_stream.dropped;
+		if( stat_events.push( event ) ) {
+			stat_stream.dropped = 0;
+		}
+	}
+
+	// gametype scripts set these directly, so look for changes here
+	const SyncGameState & state = server_gs.gameState;
+	if( state.match_state != stat_stream.match_state ) {
+		StatEvent event = NewStatEvent( StatEvent_MatchState );
+		event.state = state.match_state;
+		PushStatEvent( event );
+		stat_stream.match_state = state.match_state;
+	}
+
+	if( state.round_state != stat_stream.round_state || state.round_num != stat_stream.round_num ) {
+		StatEvent event = NewStatEvent( StatEvent_RoundState );
+		event.state = state.round_state;
+		event.round = state.round_num;
+		PushStatEvent( event );
+		stat_stream.round_state = state.round_state;
+		stat_stream.round_num = state.round_num;
+	}
+
+	Signal( stat_stream.wake );
+}
+
+void G_StatStreamMap( const char * map ) {
+	StatEvent event = NewStatEvent( StatEvent_Map );
+	Q_strncpyz( event.name, map, sizeof( event.name ) );
+	PushStatEvent( event );
+}
+
+void G_StatStreamPlayerJoin( const edict_t * ent ) {
+	StatEvent event = NewStatEvent( StatEvent_PlayerJoin );
+	event.entity = StatEntity( ent );
+	event.state = u8( ent->r.client->team );
+	Q_strncpyz( event.name, ent->r.client->netname, sizeof( event.name ) );
+	PushStatEvent( event );
+}
+
+void G_StatStreamPlayerLeave( const edict_t * ent ) {
+	StatEvent event = NewStatEvent( StatEvent_PlayerLeave );
+	event.entity = StatEntity( ent );
+	PushStatEvent( event );
+}
+
+void G_StatStreamDamage( const edict_t * attacker, const edict_t * target, DamageType damage_type, float damage ) {
+	StatEvent event = NewStatEvent( StatEvent_Damage );
+	event.entity = StatEntity( attacker );
+	event.target = StatEntity( target );
+	event.damage_type = damage_type.encoded;
+	event.damage = damage;
+	PushStatEvent( event );
+}
+
+void G_StatStreamKill( const edict_t * attacker, const edict_t * victim, int assistor, DamageType damage_type ) {
+	StatEvent event = NewStatEvent( StatEvent_Kill );
+	event.entity = StatEntity( attacker );
+	event.target = StatEntity( victim );
+	event.assistor = s16( assistor );
+	event.damage_type = damage_type.encoded;
+	PushStatEvent( event );
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * with g_statstream 1 the game writes stats events to
+ * <home>/stats/<date>.stats for external stats tracking. a stream is a
+ * StatStreamHeader followed by StatEvents, straight out of memory, and it
+ * gets flushed every frame so it can be tailed while the server runs
+ */
+
+constexpr u32 STAT_STREAM_MAGIC = 0x31545453; // STS1
+
+enum StatEventType : u8 {
+	StatEvent_Map,
+	StatEvent_MatchState,
+	StatEvent_RoundState,
+	StatEvent_PlayerJoin,
+	StatEvent_PlayerLeave,
+	StatEvent_Damage,
+	StatEvent_Kill,
+	StatEvent_Dropped, // the writer fell behind and this many events got thrown away
+};
+
+struct StatStreamHeader {
+	u32 magic;
+	u32 event_size;
+};
+
+struct StatEvent {
+	s64 time; // svs.gametime
+	StatEventType type;
+	u8 state; // MatchState, RoundState, or the team for joins
+	u8 round;
+	u8 damage_type; // DamageType::encoded
+	s16 entity; // player for joins and leaves, attacker for damage and kills, -1 for none
+	s16 target; // damaged or killed entity
+	s16 assistor;
+	u16 padding;
+	float damage;
+	u32 count;
+	char name[ 64 ]; // map or player name
+};
+
+STATIC_ASSERT( sizeof( StatEvent ) == 96 );
+
+struct edict_t;
+struct DamageType;
+
+void G_InitStatStream();
+void G_ShutdownStatStream();
+
+// watches for match and round state changes and wakes the writer
+void G_StatStreamFrame();
+
+void G_StatStreamMap( const char * map );
+void G_StatStreamPlayerJoin( const edict_t * ent );
+void G_StatStreamPlayerLeave( const edict_t * ent );
+void G_StatStreamDamage( const edict_t * attacker, const edict_t * target, DamageType damage_type, float damage );
+void G_StatStreamKill( const edict_t * attacker, const edict_t * victim, int assistor, DamageType damage_type );
@@ -343,6 +343,11 @@ void G_AddServerCommands() {
 	Cmd_AddCommand( "removeip", Cmd_RemoveIP_f );
 	Cmd_AddCommand( "listip", Cmd_ListIP_f );
 	Cmd_AddCommand( "writeip", Cmd_WriteIP_f );
+
+	Cmd_AddCommand( "clipbench", GClip_Benchmark_f );
+	Cmd_AddCommand( "edictstats", G_EdictStats_f );
+	Cmd_AddCommand( "tracestats", G_TraceStats_f );
+	Cmd_AddCommand( "tracerecord", G_TraceRecord_f );
 }
 
 /*
@@ -362,4 +367,9 @@ void G_RemoveCommands() {
 	Cmd_RemoveCommand( "removeip" );
 	Cmd_RemoveCommand( "listip" );
 	Cmd_RemoveCommand( "writeip" );
+
+	Cmd_RemoveCommand( "clipbench" );
+	Cmd_RemoveCommand( "edictstats" );
+	Cmd_RemoveCommand( "tracestats" );
+	Cmd_RemoveCommand( "tracerecord" );
 }
@@ -77,7 +77,6 @@ static void target_laser_think( edict_t *self ) {
 	trace_t tr;
 	Vec3 point;
 	Vec3 last_movedir;
-	int count;
 
 	// our lifetime has expired
 	if( self->delay && ( self->wait * 1000 < level.time ) ) {
@@ -89,12 +88,6 @@ static void target_laser_think( edict_t *self ) {
 		return;
 	}
 
-	if( self->spawnflags & 0x80000000 ) {
-		count = 8;
-	} else {
-		count = 4;
-	}
-
 	if( self->enemy ) {
 		last_movedir = self->moveinfo.movedir;
 		point = self->enemy->r.absmin + self->enemy->r.size * 0.5f;
@@ -129,12 +122,9 @@ static void target_laser_think( edict_t *self ) {
 		// if we hit something that's not a monster or player or is immune to lasers, we're done
 		if( !game.edicts[tr.ent].r.client ) {
 			if( self->spawnflags & 0x80000000 ) {
-				edict_t *event;
-
 				self->spawnflags &= ~0x80000000;
 
-				event = G_SpawnEvent( EV_LASER_SPARKS, DirToU64( tr.plane.normal ), &tr.endpos );
-				event->s.counterNum = count;
+				G_SpawnEvent( EV_LASER_SPARKS, DirToU64( tr.plane.normal ), &tr.endpos );
 			}
 			break;
 		}
@@ -21,7 +21,144 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "game/g_local.h"
 #include "qcommon/cmodel.h"
 
-edict_t * G_Find( edict_t * cursor, StringHash edict_t::* field, StringHash value ) {
+/*
+ * name/classname index
+ *
+ * each indexed field keeps a hash table of chains sorted by entity number, so
+ * G_Find only visits entities that hash to the value it's looking for.
+ *
+ * lots of code assigns classnames right after G_Spawn, so rather than hooking
+ * every assignment, entities are marked dirty by G_InitEdict/ED_ParseField and
+ * get reindexed before every lookup until the end of the frame
+ */
+
+#define EDICT_INDEX_BUCKETS 1024
+
+enum EdictIndexField {
+	EdictIndexField_Name,
+	EdictIndexField_Classname,
+
+	EdictIndexField_Count
+};
+
+static StringHash edict_t::* const indexed_fields[] = { &edict_t::name, &edict_t::classname };
+
+STATIC_ASSERT( ARRAY_COUNT( indexed_fields ) == EdictIndexField_Count );
+
+// entity numbers are stored + 1 so the zeroed index is empty
+struct EdictIndex {
+	StringHash indexed[ EdictIndexField_Count ][ MAX_EDICTS ];
+	u16 buckets[ EdictIndexField_Count ][ EDICT_INDEX_BUCKETS ];
+	u16 prev[ EdictIndexField_Count ][ MAX_EDICTS ];
+	u16 next[ EdictIndexField_Count ][ MAX_EDICTS ];
+
+	bool dirty[ MAX_EDICTS ];
+	u16 dirty_list[ MAX_EDICTS ];
+	size_t num_dirty;
+};
+
+static EdictIndex edict_index;
+
+static u16 * EdictIndexBucket( int field, StringHash value ) {
+	return &edict_index.buckets[ field ][ value.hash & ( EDICT_INDEX_BUCKETS - 1 ) ];
+}
+
+static void EdictIndexUnlink( int field, int num ) {
+	u16 prev = edict_index.prev[ field ][ num ];
+	u16 next = edict_index.next[ field ][ num ];
+
+	if( prev != 0 ) {
+		edict_index.next[ field ][ prev - 1 ] = next;
+	}
+	else {
+		*EdictIndexBucket( field, edict_index.indexed[ field ][ num ] ) = next;
+	}
+
+	if( next != 0 ) {
+		edict_index.prev[ field ][ next - 1 ] = prev;
+	}
+}
+
+static void EdictIndexLink( int field, int num, StringHash value ) {
+	u16 * bucket = EdictIndexBucket( field, value );
+
+	u16 prev = 0;
+	u16 next = *bucket;
+	while( next != 0 && next - 1 < num ) {
+		prev = next;
+		next = edict_index.next[ field ][ next - 1 ];
+	}
+
+	edict_index.prev[ field ][ num ] = prev;
+	edict_index.next[ field ][ num ] = next;
+
+	if( prev != 0 ) {
+		edict_index.next[ field ][ prev - 1 ] = num + 1;
+	}
+	else {
+		*bucket = num + 1;
+	}
+
+	if( next != 0 ) {
+		edict_index.prev[ field ][ next - 1 ] = num + 1;
+	}
+}
+
+static void ReindexEdict( const edict_t * ent ) {
+	int num = ENTNUM( ent );
+
+	for( int i = 0; i < EdictIndexField_Count; i++ ) {
+		StringHash value = ent->*indexed_fields[ i ];
+		StringHash * indexed = &edict_index.indexed[ i ][ num ];
+		if( *indexed == value )
+			continue;
+
+		if( *indexed != EMPTY_HASH ) {
+			EdictIndexUnlink( i, num );
+		}
+		if( value != EMPTY_HASH ) {
+			EdictIndexLink( i, num, value );
+		}
+		*indexed = value;
+	}
+}
+
+static void ReindexDirtyEdicts() {
+	for( size_t i = 0; i < edict_index.num_dirty; i++ ) {
+		ReindexEdict( &game.edicts[ edict_index.dirty_list[ i ] ] );
+	}
+}
+
+void G_UpdateEdictIndex( const edict_t * ent ) {
+	int num = ENTNUM( ent );
+	if( edict_index.dirty[ num ] )
+		return;
+
+	edict_index.dirty[ num ] = true;
+	edict_index.dirty_list[ edict_index.num_dirty ] = num;
+	edict_index.num_dirty++;
+}
+
+void G_FlushEdictIndex() {
+	ZoneScoped;
+
+	ReindexDirtyEdicts();
+
+	for( size_t i = 0; i < edict_index.num_dirty; i++ ) {
+		edict_index.dirty[ edict_index.dirty_list[ i ] ] = false;
+	}
+	edict_index.num_dirty = 0;
+}
+
+void G_ResetEdictIndex() {
+	memset( &edict_index, 0, sizeof( edict_index ) );
+
+	for( int i = 0; i < game.numentities; i++ ) {
+		G_UpdateEdictIndex( &game.edicts[ i ] );
+	}
+}
+
+static edict_t * G_FindLinear( edict_t * cursor, StringHash edict_t::* field, StringHash value ) {
 	if( cursor == NULL ) {
 		cursor = world;
 	}
@@ -41,6 +178,48 @@ edict_t * G_Find( edict_t * cursor, StringHash edict_t::* field, StringHash valu
 	return NULL;
 }
 
+edict_t * G_Find( edict_t * cursor, StringHash edict_t::* field, StringHash value ) {
+	int field_idx = -1;
+	for( int i = 0; i < EdictIndexField_Count; i++ ) {
+		if( field == indexed_fields[ i ] ) {
+			field_idx = i;
+		}
+	}
+
+	if( field_idx == -1 || value == EMPTY_HASH ) {
+		return G_FindLinear( cursor, field, value );
+	}
+
+	ReindexDirtyEdicts();
+
+	int start = cursor == NULL ? -1 : ENTNUM( cursor );
+
+	// continue from the cursor if it's still in the chain, otherwise it got
+	// freed/renamed and we have to walk from the head
+	u16 node;
+	if( start >= 0 && edict_index.indexed[ field_idx ][ start ] == value ) {
+		node = edict_index.next[ field_idx ][ start ];
+	}
+	else {
+		node = *EdictIndexBucket( field_idx, value );
+	}
+
+	while( node != 0 ) {
+		int num = node - 1;
+		node = edict_index.next[ field_idx ][ num ];
+
+		if( num <= start || num >= game.numentities )
+			continue;
+
+		edict_t * ent = &game.edicts[ num ];
+		if( ent->r.inuse && ent->*field == value ) {
+			return ent;
+		}
+	}
+
+	return NULL;
+}
+
 edict_t * G_PickTarget( StringHash name ) {
 	edict_t * cursor = NULL;
 
@@ -162,6 +341,110 @@ char *_G_CopyString( const char *in, const char *filename, int fileline ) {
 	return out;
 }
 
+/*
+ * free edict lists
+ *
+ * freed edicts that can be reused straight away go on the ready stack, and
+ * everything else waits in a FIFO ordered by freetime until it has been free
+ * for EDICT_REUSE_DELAY. that keeps the "don't reuse recently freed edicts"
+ * rule from the old linear search without having to scan for a slot
+ */
+
+#define EDICT_REUSE_DELAY 500
+
+enum EdictFreeState : u8 {
+	EdictFreeState_InUse,
+	EdictFreeState_Ready,
+	EdictFreeState_Cooling,
+};
+
+struct EdictFreeLists {
+	EdictFreeState state[ MAX_EDICTS ];
+
+	u16 ready[ MAX_EDICTS ];
+	size_t num_ready;
+
+	u16 cooling[ MAX_EDICTS ];
+	size_t cooling_head;
+	size_t num_cooling;
+
+	int live;
+	int peak_live;
+	int peak_numentities;
+	u64 spawns;
+	u64 forced_reuses;
+};
+
+static EdictFreeLists free_edicts;
+
+static bool IsReservedEdict( int num ) {
+	return num <= server_gs.maxclients;
+}
+
+static void PushCoolingEdict( int num ) {
+	free_edicts.cooling[ ( free_edicts.cooling_head + free_edicts.num_cooling ) % MAX_EDICTS ] = num;
+	free_edicts.num_cooling++;
+}
+
+static int PopCoolingEdict() {
+	int num = free_edicts.cooling[ free_edicts.cooling_head ];
+	free_edicts.cooling_head = ( free_edicts.cooling_head + 1 ) % MAX_EDICTS;
+	free_edicts.num_cooling--;
+	return num;
+}
+
+static void AddFreeEdict( const edict_t * ed ) {
+	int num = ENTNUM( ed );
+	if( IsReservedEdict( num ) || free_edicts.state[ num ] != EdictFreeState_InUse )
+		return;
+
+	free_edicts.live--;
+
+	// the first couple seconds of server time can involve a lot of
+	// freeing and allocating, so relax the replacement policy
+	if( ed->freetime < level.spawnedTimeStamp + 2000 ) {
+		free_edicts.state[ num ] = EdictFreeState_Ready;
+		free_edicts.ready[ free_edicts.num_ready ] = num;
+		free_edicts.num_ready++;
+	}
+	else {
+		free_edicts.state[ num ] = EdictFreeState_Cooling;
+		PushCoolingEdict( num );
+	}
+}
+
+static void PromoteCooledEdicts() {
+	while( free_edicts.num_cooling > 0 ) {
+		int num = free_edicts.cooling[ free_edicts.cooling_head ];
+		if( svs.realtime <= game.edicts[ num ].freetime + EDICT_REUSE_DELAY )
+			break;
+
+		PopCoolingEdict();
+		free_edicts.state[ num ] = EdictFreeState_Ready;
+		free_edicts.ready[ free_edicts.num_ready ] = num;
+		free_edicts.num_ready++;
+	}
+}
+
+static edict_t * TakeFreeEdict( int num ) {
+	free_edicts.state[ num ] = EdictFreeState_InUse;
+	free_edicts.live++;
+	free_edicts.peak_live = Max2( free_edicts.peak_live, free_edicts.live );
+	free_edicts.spawns++;
+	return &game.edicts[ num ];
+}
+
+void G_ResetFreeEdicts() {
+	memset( &free_edicts, 0, sizeof( free_edicts ) );
+}
+
+void G_EdictStats_f() {
+	Com_Printf( "%d/%d edicts in use, peak %d\n", free_edicts.live, game.maxentities - server_gs.maxclients - 1, free_edicts.peak_live );
+	Com_Printf( "%d allocated, peak %d\n", game.numentities, free_edicts.peak_numentities );
+	Com_Printf( "%zu ready, %zu recently freed\n", free_edicts.num_ready, free_edicts.num_cooling );
+	Com_Printf( "%" PRIu64 " spawns, %" PRIu64 " reused a recently freed edict\n", free_edicts.spawns, free_edicts.forced_reuses );
+}
+
 void G_FreeEdict( edict_t *ed ) {
 	bool evt = ISEVENTENTITY( &ed->s );
 
@@ -171,11 +454,14 @@ void G_FreeEdict( edict_t *ed ) {
 
 	memset( ed, 0, sizeof( *ed ) );
 	ed->s.number = ENTNUM( ed );
+	ReindexEdict( ed );
 	ed->r.svflags = SVF_NOCLIENT;
 
 	if( !evt && ( level.spawnedTimeStamp != svs.realtime ) ) {
 		ed->freetime = svs.realtime; // ET_EVENT or ET_SOUND don't need to wait to be reused
 	}
+
+	AddFreeEdict( ed );
 }
 
 void G_InitEdict( edict_t *e ) {
@@ -195,6 +481,8 @@ void G_InitEdict( edict_t *e ) {
 	// clear the old state data
 	memset( &e->olds, 0, sizeof( e->olds ) );
 	memset( &e->snap, 0, sizeof( e->snap ) );
+
+	G_UpdateEdictIndex( e );
 }
 
 /*
@@ -211,39 +499,37 @@ edict_t *G_Spawn() {
 		Com_Printf( "WARNING: Spawning entity before map entities have been spawned\n" );
 	}
 
-	int i;
-	edict_t * freed = NULL;
-	edict_t * e = &game.edicts[server_gs.maxclients + 1];
-	for( i = server_gs.maxclients + 1; i < game.numentities; i++, e++ ) {
-		if( e->r.inuse ) {
+	PromoteCooledEdicts();
+
+	while( free_edicts.num_ready > 0 ) {
+		free_edicts.num_ready--;
+		int num = free_edicts.ready[ free_edicts.num_ready ];
+		if( free_edicts.state[ num ] != EdictFreeState_Ready || game.edicts[ num ].r.inuse )
 			continue;
-		}
 
-		// the first couple seconds of server time can involve a lot of
-		// freeing and allocating, so relax the replacement policy
-		if( e->freetime < level.spawnedTimeStamp + 2000 || svs.realtime > e->freetime + 500 ) {
-			G_InitEdict( e );
-			return e;
-		}
+		edict_t * e = TakeFreeEdict( num );
+		G_InitEdict( e );
+		return e;
+	}
 
+	if( game.numentities == game.maxentities ) {
 		// this is going to be our second chance to spawn an entity in case all free
 		// entities have been freed only recently
-		if( !freed ) {
-			freed = e;
+		if( free_edicts.num_cooling == 0 ) {
+			Fatal( "G_Spawn: no free edicts" );
 		}
-	}
 
-	if( i == game.maxentities ) {
-		if( freed ) {
-			G_InitEdict( freed );
-			return freed;
-		}
-		Fatal( "G_Spawn: no free edicts" );
+		free_edicts.forced_reuses++;
+		edict_t * e = TakeFreeEdict( PopCoolingEdict() );
+		G_InitEdict( e );
+		return e;
 	}
 
+	edict_t * e = TakeFreeEdict( game.numentities );
 	game.numentities++;
+	free_edicts.peak_numentities = Max2( free_edicts.peak_numentities, game.numentities );
 
-	SV_LocateEntities( game.edicts, game.numentities, game.maxentities );
+	SV_LocateEntities( game.edicts, &game.hot, &game.events, game.numentities, game.maxentities );
 
 	G_InitEdict( e );
 
@@ -272,19 +558,28 @@ void G_AddEvent( edict_t *ent, int event, u64 parm, bool highPriority ) {
 	ent->eventPriority[eventNum] = highPriority;
 }
 
-edict_t *G_SpawnEvent( int event, u64 parm, const Vec3 * origin ) {
-	edict_t * ent = G_Spawn();
-	ent->s.type = ET_EVENT;
-	ent->r.solid = SOLID_NOT;
-	ent->r.svflags &= ~SVF_NOCLIENT;
-	if( origin ) {
-		ent->s.origin = *origin;
+SyncSnapEvent *G_SpawnEvent( int event, u64 parm, const Vec3 * origin ) {
+	// callers fill in the rest, so give them somewhere to write when we're full
+	static SyncSnapEvent overflow;
+
+	SnapEvents * events = &game.events;
+	if( events->num_events == ARRAY_COUNT( events->events ) ) {
+		Com_DPrintf( "G_SpawnEvent: too many events this snapshot\n" );
+		overflow = { };
+		return &overflow;
 	}
-	G_AddEvent( ent, event, parm, true );
 
-	GClip_LinkEntity( ent );
+	SyncSnapEvent * ev = &events->events[ events->num_events ];
+	events->num_events++;
 
-	return ent;
+	*ev = { };
+	ev->event.type = event;
+	ev->event.parm = parm;
+	if( origin ) {
+		ev->origin = *origin;
+	}
+
+	return ev;
 }
 
 void G_MorphEntityIntoEvent( edict_t *ent, int event, u64 parm ) {
@@ -635,7 +930,7 @@ float LookAtKillerYAW( edict_t *self, edict_t *inflictor, edict_t *attacker ) {
 //==============================================================================
 
 static void G_SpawnTeleportEffect( edict_t *ent, bool respawn, bool in ) {
-	edict_t *event;
+	SyncSnapEvent *event;
 
 	if( !ent || !ent->r.client ) {
 		return;
@@ -647,7 +942,7 @@ static void G_SpawnTeleportEffect( edict_t *ent, bool respawn, bool in ) {
 
 	// add a teleportation effect
 	event = G_SpawnEvent( respawn ? EV_PLAYER_RESPAWN : ( in ? EV_PLAYER_TELEPORT_IN : EV_PLAYER_TELEPORT_OUT ), 0, &ent->s.origin );
-	event->s.ownerNum = ENTNUM( ent );
+	event->ownerNum = ENTNUM( ent );
 }
 
 void G_TeleportEffect( edict_t *ent, bool in ) {
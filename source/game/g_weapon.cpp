@@ -23,6 +23,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "game/g_local.h"
 
 #define ARBULLETHACK // ffs : hack for the assault rifle
+#define MAX_PELLETS 64 // pellets and blade traces are traced together with G_TraceBatch
 
 static bool CanHit(const edict_t *projectile, const edict_t *target)
 {
@@ -49,9 +50,8 @@ static void W_Explode_ARBullet(edict_t *ent, edict_t *other, cplane_t *plane)
 
 	G_RadiusDamage(ent, ent->r.owner, plane, other, ent->projectileInfo.damage_type);
 
-	edict_t *event = G_SpawnEvent(ent->s.type == ET_ARBULLET ? EV_ARBULLET_EXPLOSION : EV_BUBBLE_EXPLOSION, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
-	event->s.weapon = Min2(ent->projectileInfo.radius / 8, 127);
-	event->s.team = ent->s.team;
+	SyncSnapEvent *event = G_SpawnEvent(ent->s.type == ET_ARBULLET ? EV_ARBULLET_EXPLOSION : EV_BUBBLE_EXPLOSION, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
+	event->team = ent->s.team;
 
 	G_FreeEdict(ent);
 }
@@ -306,19 +306,28 @@ static void W_Fire_Blade(edict_t *self, Vec3 start, Vec3 angles, int timeDelta)
 
 	int dmgflags = 0;
 
+	assert(traces <= MAX_PELLETS);
+
+	Vec3 starts[MAX_PELLETS];
+	Vec3 ends[MAX_PELLETS];
+	Vec3 dirs[MAX_PELLETS];
 	for( int i = 0; i < traces; i++ )
 	{
 		Vec3 new_angles = angles;
 		new_angles.y += Lerp( -slash_angle, float( i ) / float( traces - 1 ), slash_angle );
-		Vec3 dir;
-		AngleVectors(new_angles, &dir, NULL, NULL);
-		Vec3 end = start + dir * def->range;
+		AngleVectors(new_angles, &dirs[i], NULL, NULL);
+		starts[i] = start;
+		ends[i] = start + dirs[i] * def->range;
+	}
 
-		trace_t trace;
-		G_Trace4D(&trace, start, Vec3(0.0f), Vec3(0.0f), end, self, MASK_SHOT, timeDelta);
-		if (trace.ent != -1 && game.edicts[trace.ent].takedamage)
+	trace_t trace[MAX_PELLETS];
+	G_TraceBatch(trace, starts, ends, traces, Vec3(0.0f), Vec3(0.0f), self, MASK_SHOT, timeDelta);
+
+	for( int i = 0; i < traces; i++ )
+	{
+		if (trace[i].ent != -1 && game.edicts[trace[i].ent].takedamage)
 		{
-			G_Damage(&game.edicts[trace.ent], self, self, dir, dir, trace.endpos, def->damage, def->knockback, dmgflags, Weapon_Knife);
+			G_Damage(&game.edicts[trace[i].ent], self, self, dirs[i], dirs[i], trace[i].endpos, def->damage, def->knockback, dmgflags, Weapon_Knife);
 			break;
 		}
 	}
@@ -372,12 +381,37 @@ static void W_Fire_Shotgun(edict_t *self, Vec3 start, Vec3 angles, int timeDelta
 	float damage_dealt[MAX_CLIENTS + 1] = {};
 	Vec3 hit_locations[MAX_CLIENTS + 1] = {}; // arbitrary trace end pos to use as blood origin
 
+	assert(def->projectile_count <= MAX_PELLETS);
+
+	// trace all the pellets together, the same as GS_TraceBullet does one at a time
+	Vec3 starts[MAX_PELLETS];
+	Vec3 ends[MAX_PELLETS];
 	for (int i = 0; i < def->projectile_count; i++)
 	{
-		Vec2 spread = FixedSpreadPattern(i, def->spread);
+		starts[i] = start;
+		ends[i] = BulletEnd(start, dir, right, up, FixedSpreadPattern(i, def->spread), def->range);
+	}
+
+	// the wallbang traces are shorter so the same snapshot covers them
+	TempAllocator temp = svs.frame_arena.temp();
+	MinMax3 bounds = G_TraceBatchBounds(starts, ends, def->projectile_count, Vec3(0.0f), Vec3(0.0f));
+	RewoundEntities rewound = G_RewindEntities(&temp, bounds, timeDelta);
+
+	trace_t traces[MAX_PELLETS];
+	G_TraceRewound(&rewound, traces, starts, ends, def->projectile_count, Vec3(0.0f), Vec3(0.0f), self, MASK_WALLBANG);
+
+	for (int i = 0; i < def->projectile_count; i++)
+	{
+		ends[i] = traces[i].endpos;
+	}
+
+	trace_t wallbangs[MAX_PELLETS];
+	G_TraceRewound(&rewound, wallbangs, starts, ends, def->projectile_count, Vec3(0.0f), Vec3(0.0f), self, MASK_SHOT);
 
-		trace_t trace, wallbang;
-		GS_TraceBullet(&server_gs, &trace, &wallbang, start, dir, right, up, spread, def->range, ENTNUM(self), timeDelta);
+	for (int i = 0; i < def->projectile_count; i++)
+	{
+		const trace_t & trace = traces[i];
+		const trace_t & wallbang = wallbangs[i];
 		if (trace.ent != -1 && game.edicts[trace.ent].takedamage)
 		{
 			int dmgflags = trace.endpos == wallbang.endpos ? 0 : DAMAGE_WALLBANG;
@@ -413,10 +447,8 @@ static void W_Grenade_ExplodeDir(edict_t *ent, Vec3 normal)
 
 	G_RadiusDamage(ent, ent->r.owner, NULL, ent->enemy, Weapon_GrenadeLauncher);
 
-	int radius = ((ent->projectileInfo.radius * 1 / 8) > 127) ? 127 : (ent->projectileInfo.radius * 1 / 8);
-	edict_t *event = G_SpawnEvent(EV_GRENADE_EXPLOSION, DirToU64(dir), &ent->s.origin);
-	event->s.weapon = radius;
-	event->s.team = ent->s.team;
+	SyncSnapEvent *event = G_SpawnEvent(EV_GRENADE_EXPLOSION, DirToU64(dir), &ent->s.origin);
+	event->team = ent->s.team;
 
 	G_FreeEdict(ent);
 }
@@ -496,8 +528,8 @@ static void W_Touch_Stake(edict_t *ent, edict_t *other, cplane_t *plane, int sur
 	{
 		G_Damage(other, ent, ent->r.owner, ent->velocity, ent->velocity, ent->s.origin, ent->projectileInfo.maxDamage, ent->projectileInfo.maxKnockback, 0, Weapon_StakeGun);
 		ent->enemy = other;
-		edict_t *event = G_SpawnEvent(EV_STAKE_IMPALE, DirToU64(-SafeNormalize(ent->velocity)), &ent->s.origin);
-		event->s.team = ent->s.team;
+		SyncSnapEvent *event = G_SpawnEvent(EV_STAKE_IMPALE, DirToU64(-SafeNormalize(ent->velocity)), &ent->s.origin);
+		event->team = ent->s.team;
 		G_FreeEdict(ent);
 	}
 	else
@@ -507,8 +539,8 @@ static void W_Touch_Stake(edict_t *ent, edict_t *other, cplane_t *plane, int sur
 		// ent->nextThink = level.time + def->range;
 		ent->movetype = MOVETYPE_NONE;
 		ent->s.sound = "";
-		edict_t *event = G_SpawnEvent(EV_STAKE_IMPACT, DirToU64(-SafeNormalize(ent->velocity)), &ent->s.origin);
-		event->s.team = ent->s.team;
+		SyncSnapEvent *event = G_SpawnEvent(EV_STAKE_IMPACT, DirToU64(-SafeNormalize(ent->velocity)), &ent->s.origin);
+		event->team = ent->s.team;
 	}
 }
 
@@ -544,9 +576,8 @@ static void W_Touch_Rocket(edict_t *ent, edict_t *other, cplane_t *plane, int su
 
 	G_RadiusDamage(ent, ent->r.owner, plane, other, Weapon_RocketLauncher);
 
-	edict_t *event = G_SpawnEvent(EV_ROCKET_EXPLOSION, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
-	event->s.weapon = Min2(ent->projectileInfo.radius / 8, 255);
-	event->s.team = ent->s.team;
+	SyncSnapEvent *event = G_SpawnEvent(EV_ROCKET_EXPLOSION, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
+	event->team = ent->s.team;
 
 	G_FreeEdict(ent);
 }
@@ -625,12 +656,16 @@ static void W_Fire_Railgun(edict_t *self, Vec3 start, Vec3 angles, int timeDelta
 
 	edict_t *ignore = self;
 
+	// the trail can go through lots of players, rewind them all once
+	TempAllocator temp = svs.frame_arena.temp();
+	RewoundEntities rewound = G_RewindEntities(&temp, G_TraceBatchBounds(&start, &end, 1, Vec3(0.0f), Vec3(0.0f)), timeDelta);
+
 	trace_t tr;
 	tr.ent = -1;
 
 	while (ignore)
 	{
-		G_Trace4D(&tr, from, Vec3(0.0f), Vec3(0.0f), end, ignore, MASK_WALLBANG, timeDelta);
+		G_TraceRewound(&rewound, &tr, &from, &end, 1, Vec3(0.0f), Vec3(0.0f), ignore, MASK_WALLBANG);
 
 		from = tr.endpos;
 		ignore = NULL;
@@ -657,7 +692,7 @@ static void W_Fire_Railgun(edict_t *self, Vec3 start, Vec3 angles, int timeDelta
 		if (hit != self && hit->takedamage)
 		{
 			int dmgflags = 0;
-			if (IsHeadshot(tr.ent, tr.endpos, timeDelta))
+			if (IsHeadshot(&rewound, tr.ent, tr.endpos))
 			{
 				dmgflags |= DAMAGE_HEADSHOT;
 			}
@@ -665,8 +700,8 @@ static void W_Fire_Railgun(edict_t *self, Vec3 start, Vec3 angles, int timeDelta
 			G_Damage(hit, self, self, dir, dir, tr.endpos, def->damage, def->knockback, dmgflags, Weapon_Railgun);
 
 			// spawn a impact event on each damaged ent
-			edict_t *event = G_SpawnEvent(EV_BOLT_EXPLOSION, DirToU64(tr.plane.normal), &tr.endpos);
-			event->s.team = self->s.team;
+			SyncSnapEvent *event = G_SpawnEvent(EV_BOLT_EXPLOSION, DirToU64(tr.plane.normal), &tr.endpos);
+			event->team = self->s.team;
 
 			// if we hit a teammate stop the trace
 			if (G_IsTeamDamage(&hit->s, &self->s))
@@ -787,8 +822,8 @@ static void W_Touch_RifleBullet(edict_t *ent, edict_t *other, cplane_t *plane, i
 		return;
 	}
 
-	edict_t *event = G_SpawnEvent(EV_RIFLEBULLET_IMPACT, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
-	event->s.team = ent->s.team;
+	SyncSnapEvent *event = G_SpawnEvent(EV_RIFLEBULLET_IMPACT, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
+	event->team = ent->s.team;
 
 	if (other->takedamage && ent->enemy != other)
 	{
@@ -815,10 +850,8 @@ static void StickyBulletExplodeNormal( edict_t * ent, Vec3 normal ) {
 
 	G_RadiusDamage(ent, ent->r.owner, NULL, ent->enemy, Weapon_AutoSniper);
 
-	int radius = ((ent->projectileInfo.radius * 1 / 8) > 127) ? 127 : (ent->projectileInfo.radius * 1 / 8);
-	edict_t *event = G_SpawnEvent(EV_GRENADE_EXPLOSION, DirToU64(dir), &ent->s.origin);
-	event->s.weapon = radius;
-	event->s.team = ent->s.team;
+	SyncSnapEvent *event = G_SpawnEvent(EV_GRENADE_EXPLOSION, DirToU64(dir), &ent->s.origin);
+	event->team = ent->s.team;
 
 	G_FreeEdict(ent);
 }
@@ -890,16 +923,16 @@ static void W_Touch_Blast(edict_t *ent, edict_t *other, cplane_t *plane, int sur
 
 	if (other->takedamage)
 	{
-		edict_t *event = G_SpawnEvent(EV_BLAST_IMPACT, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
-		event->s.team = ent->s.team;
+		SyncSnapEvent *event = G_SpawnEvent(EV_BLAST_IMPACT, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
+		event->team = ent->s.team;
 		G_Damage(other, ent, ent->r.owner, ent->velocity, ent->velocity, ent->s.origin, ent->projectileInfo.maxDamage, ent->projectileInfo.maxKnockback, 0, ent->projectileInfo.damage_type);
 		ent->enemy = other;
 		G_FreeEdict(ent);
 		return;
 	}
 
-	edict_t *event = G_SpawnEvent(EV_BLAST_BOUNCE, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
-	event->s.team = ent->s.team;
+	SyncSnapEvent *event = G_SpawnEvent(EV_BLAST_BOUNCE, DirToU64(plane ? plane->normal : Vec3(0.0f)), &ent->s.origin);
+	event->team = ent->s.team;
 
 	if (ent->num_bounces >= 5)
 	{
@@ -1113,8 +1146,8 @@ static void TouchStunGrenade(edict_t *ent, edict_t *other, cplane_t *plane, int
 static void ExplodeStunGrenade( edict_t * grenade ) {
 	const GadgetDef * def = GetGadgetDef( Gadget_StunGrenade );
 
-	edict_t * event = G_SpawnEvent( EV_STUN_GRENADE_EXPLOSION, 0, &grenade->s.origin );
-	event->s.team = grenade->s.team;
+	SyncSnapEvent * event = G_SpawnEvent( EV_STUN_GRENADE_EXPLOSION, 0, &grenade->s.origin );
+	event->team = grenade->s.team;
 
 	int touch[ MAX_EDICTS ];
 	int numtouch = GClip_FindInRadius4D( grenade->s.origin, def->splash_radius + playerbox_stand_viewheight, touch, ARRAY_COUNT( touch ), grenade->timeDelta );
@@ -1174,3 +1207,50 @@ void G_UseGadget( edict_t * ent, GadgetType gadget, u64 parm ) {
 			break;
 	}
 }
+
+/*
+ * templates for the entities the weapons spawn, so new ones can go out as a
+ * delta against something with the right type, model and sound instead of
+ * an empty baseline. keep these in sync with the functions above
+ */
+struct ClassBaseline {
+	EntityType type;
+	const char * model;
+	const char * sound;
+	bool linear;
+};
+
+static const ClassBaseline class_baselines[] = {
+	{ ET_GRENADE, "weapons/gl/grenade", NULL, false },
+	{ ET_STAKE, "weapons/stake/stake", "weapons/stake/trail", false },
+	{ ET_ROCKET, "weapons/rl/rocket", "weapons/rl/trail", true },
+	{ ET_ROCKET, "weapons/autosniper/bullet", "weapons/autosniper/fuse", true },
+	{ ET_ARBULLET, "weapons/ar/projectile", "weapons/ar/trail", true },
+	{ ET_BUBBLE, NULL, "weapons/bg/trail", true },
+	{ ET_RIFLEBULLET, "weapons/rifle/bullet", "weapons/bullet_whizz", true },
+	{ ET_BLAST, NULL, "weapons/mb/trail", false },
+	{ ET_BLAST, NULL, "weapons/road/trail", false },
+	{ ET_THROWING_AXE, "weapons/axe/model", "weapons/axe/trail", false },
+	{ ET_GENERIC, "weapons/stungrenade/model", NULL, false },
+	{ ET_LASERBEAM, NULL, NULL, false },
+};
+
+size_t G_ClassBaselines( Span< SyncEntityState > baselines ) {
+	size_t n = Min2( baselines.n, ARRAY_COUNT( class_baselines ) );
+
+	for( size_t i = 0; i < n; i++ ) {
+		const ClassBaseline & cls = class_baselines[ i ];
+		SyncEntityState * base = &baselines[ i ];
+		*base = { };
+		base->type = cls.type;
+		if( cls.model != NULL ) {
+			base->model = StringHash( cls.model );
+		}
+		if( cls.sound != NULL ) {
+			base->sound = StringHash( cls.sound );
+		}
+		base->linearMovement = cls.linear;
+	}
+
+	return n;
+}
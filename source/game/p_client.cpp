@@ -18,6 +18,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "game/g_local.h"
+#include "game/g_statstream.h"
 
 constexpr int PLAYER_MASS = 200;
 
@@ -115,9 +116,9 @@ static edict_t *CreateCorpse( edict_t *ent, edict_t *attacker, DamageType damage
 		parm |= 1;
 	}
 
-	edict_t * event = G_SpawnEvent( EV_DIE, parm, NULL );
-	event->r.svflags |= SVF_BROADCAST;
-	event->s.ownerNum = body->s.number;
+	SyncSnapEvent * event = G_SpawnEvent( EV_DIE, parm, NULL );
+	event->svflags |= SVF_BROADCAST;
+	event->ownerNum = body->s.number;
 
 	ent->s.ownerNum = body->s.number;
 
@@ -323,6 +324,7 @@ void G_ClientRespawn( edict_t *self, bool ghost ) {
 	} else {
 		self->classname = "player";
 	}
+	G_UpdateEdictIndex( self );
 
 	self->r.mins = playerbox_stand_mins;
 	self->r.maxs = playerbox_stand_maxs;
@@ -493,6 +495,7 @@ void ClientBegin( edict_t *ent ) {
 	ent->movetype = MOVETYPE_NOCLIP; // allow freefly
 
 	G_PrintMsg( NULL, "%s entered the game\n", client->netname );
+	G_StatStreamPlayerJoin( ent );
 
 	client->connecting = false;
 
@@ -792,6 +795,7 @@ void ClientDisconnect( edict_t *ent, const char *reason ) {
 
 	// let the gametype scripts know this client just disconnected
 	G_Gametype_ScoreEvent( ent->r.client, "disconnect", NULL );
+	G_StatStreamPlayerLeave( ent );
 
 	ent->r.inuse = false;
 	ent->r.svflags = SVF_NOCLIENT;
@@ -852,10 +856,10 @@ void G_PredictedFireWeapon( int entNum, u64 parm ) {
 	Vec3 start = ent->s.origin;
 	start.z += ent->r.client->ps.viewheight;
 
-	edict_t * event = G_SpawnEvent( EV_FIREWEAPON, parm, &start );
-	event->s.ownerNum = entNum;
-	event->s.origin2 = ent->r.client->ps.viewangles;
-	event->s.team = ent->s.team;
+	SyncSnapEvent * event = G_SpawnEvent( EV_FIREWEAPON, parm, &start );
+	event->ownerNum = entNum;
+	event->origin2 = ent->r.client->ps.viewangles;
+	event->team = ent->s.team;
 }
 
 void G_PredictedUseGadget( int entNum, GadgetType gadget, u64 parm ) {
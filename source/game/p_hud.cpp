@@ -67,11 +67,10 @@ static unsigned int G_FindPointedPlayer( edict_t *self ) {
 			Vec3 boxpoints[8];
 			BuildBoxPoints( boxpoints, other->s.origin, Vec3( 4.0f ), Vec3( 4.0f ) );
 			for( int j = 0; j < 8; j++ ) {
-				trace_t trace;
-				G_Trace( &trace, vieworg, Vec3( 0.0f ), Vec3( 0.0f ), boxpoints[j], self, MASK_SHOT | MASK_OPAQUE );
-				if( trace.ent && trace.ent == ENTNUM( other ) ) {
+				if( G_CanSee( self, vieworg, other, boxpoints[j], MASK_SHOT | MASK_OPAQUE ) ) {
 					value_best = value;
 					best = ENTNUM( other );
+					break;
 				}
 			}
 		}
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/qcommon.h"
+#include "qcommon/threadpool.h"
 #include "gameshared/gs_weapons.h"
 
 #define SPEEDKEY    500.0f
@@ -64,9 +65,10 @@ typedef struct {
 	float dashPlayerSpeed;
 } pml_t;
 
-static pmove_t *pm;
-static pml_t pml;
-static const gs_state_t * pmove_gs;
+// thread_local so PmoveBatch can run players on different threads
+static thread_local pmove_t *pm;
+static thread_local pml_t pml;
+static thread_local const gs_state_t * pmove_gs;
 
 // movement parameters
 
@@ -95,6 +97,70 @@ constexpr float pm_dashupspeed = ( 174.0f * GRAVITY_COMPENSATE );
 constexpr float pm_wjupspeed = ( 350.0f * GRAVITY_COMPENSATE );
 constexpr float pm_wjbouncefactor = 0.4f;
 
+// pmove repeats a lot of traces, e.g. PM_CategorizePosition runs the same
+// ground trace before and after the move when the player is standing still.
+// nothing moves during a pmove so we can reuse the results. the keys are
+// exact because reusing a trace from a slightly different position would
+// make prediction disagree with the server
+#define PM_TRACE_MEMO_SIZE 16
+#define PM_CONTENTS_MEMO_SIZE 4
+
+struct PMoveTraceMemo {
+	Vec3 start, end;
+	Vec3 mins, maxs;
+	int contentmask;
+	trace_t trace;
+};
+
+struct PMoveContentsMemo {
+	Vec3 point;
+	int contents;
+};
+
+static thread_local PMoveTraceMemo trace_memo[ PM_TRACE_MEMO_SIZE ];
+static thread_local size_t num_trace_memos;
+
+static thread_local PMoveContentsMemo contents_memo[ PM_CONTENTS_MEMO_SIZE ];
+static thread_local size_t num_contents_memos;
+
+static void PM_Trace( trace_t * trace, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end ) {
+	for( size_t i = 0; i < Min2( num_trace_memos, size_t( PM_TRACE_MEMO_SIZE ) ); i++ ) {
+		const PMoveTraceMemo * memo = &trace_memo[ i ];
+		if( memo->start == start && memo->end == end && memo->mins == mins && memo->maxs == maxs && memo->contentmask == pm->contentmask ) {
+			*trace = memo->trace;
+			return;
+		}
+	}
+
+	pmove_gs->api.Trace( trace, start, mins, maxs, end, pm->playerState->POVnum, pm->contentmask, 0 );
+
+	PMoveTraceMemo * memo = &trace_memo[ num_trace_memos % PM_TRACE_MEMO_SIZE ];
+	memo->start = start;
+	memo->end = end;
+	memo->mins = mins;
+	memo->maxs = maxs;
+	memo->contentmask = pm->contentmask;
+	memo->trace = *trace;
+	num_trace_memos++;
+}
+
+static int PM_PointContents( Vec3 point ) {
+	for( size_t i = 0; i < Min2( num_contents_memos, size_t( PM_CONTENTS_MEMO_SIZE ) ); i++ ) {
+		if( contents_memo[ i ].point == point ) {
+			return contents_memo[ i ].contents;
+		}
+	}
+
+	int contents = pmove_gs->api.PointContents( point, 0 );
+
+	PMoveContentsMemo * memo = &contents_memo[ num_contents_memos % PM_CONTENTS_MEMO_SIZE ];
+	memo->point = point;
+	memo->contents = contents;
+	num_contents_memos++;
+
+	return contents;
+}
+
 static float pm_wjminspeed() {
 	return ( pml.maxWalkSpeed + pml.maxPlayerSpeed ) * 0.5f;
 }
@@ -130,7 +196,7 @@ static void PlayerTouchWall( int nbTestDir, float maxZnormal, Vec3 * normal ) {
 		Vec3 end = pml.origin + dir;
 
 		trace_t trace;
-		pmove_gs->api.Trace( &trace, pml.origin, mins, maxs, end, pm->playerState->POVnum, pm->contentmask, 0 );
+		PM_Trace( &trace, pml.origin, mins, maxs, end );
 
 		if( trace.allsolid )
 			return;
@@ -209,7 +275,7 @@ static int PM_SlideMove() {
 		Vec3 end = pml.origin + pml.velocity * remainingTime;
 
 		trace_t trace;
-		pmove_gs->api.Trace( &trace, pml.origin, pm->mins, pm->maxs, end, pm->playerState->POVnum, pm->contentmask, 0 );
+		PM_Trace( &trace, pml.origin, pm->mins, pm->maxs, end );
 		if( trace.allsolid ) { // trapped into a solid
 			pml.origin = last_valid_origin;
 			return SLIDEMOVEFLAG_TRAPPED;
@@ -338,7 +404,7 @@ static void PM_StepSlideMove() {
 
 	Vec3 up = start_o + Vec3( 0.0f, 0.0f, STEPSIZE );
 
-	pmove_gs->api.Trace( &trace, up, pm->mins, pm->maxs, up, pm->playerState->POVnum, pm->contentmask, 0 );
+	PM_Trace( &trace, up, pm->mins, pm->maxs, up );
 	if( trace.allsolid ) {
 		return; // can't step up
 	}
@@ -351,7 +417,7 @@ static void PM_StepSlideMove() {
 
 	// push down the final amount
 	Vec3 down = pml.origin - Vec3( 0.0f, 0.0f, STEPSIZE );
-	pmove_gs->api.Trace( &trace, pml.origin, pm->mins, pm->maxs, down, pm->playerState->POVnum, pm->contentmask, 0 );
+	PM_Trace( &trace, pml.origin, pm->mins, pm->maxs, down );
 	if( !trace.allsolid ) {
 		pml.origin = trace.endpos;
 	}
@@ -619,7 +685,7 @@ static void PM_Move() {
 */
 static void PM_GroundTrace( trace_t *trace ) {
 	Vec3 point = pml.origin - Vec3( 0.0f, 0.0f, 0.25f );
-	pmove_gs->api.Trace( trace, pml.origin, pm->mins, pm->maxs, point, pm->playerState->POVnum, pm->contentmask, 0 );
+	PM_Trace( trace, pml.origin, pm->mins, pm->maxs, point );
 }
 
 static bool PM_GoodPosition( Vec3 origin, trace_t *trace ) {
@@ -627,7 +693,7 @@ static bool PM_GoodPosition( Vec3 origin, trace_t *trace ) {
 		return true;
 	}
 
-	pmove_gs->api.Trace( trace, origin, pm->mins, pm->maxs, origin, pm->playerState->POVnum, pm->contentmask, 0 );
+	PM_Trace( trace, origin, pm->mins, pm->maxs, origin );
 
 	return !trace->allsolid;
 }
@@ -713,17 +779,17 @@ static void PM_CategorizePosition() {
 
 	Vec3 point = pml.origin;
 	point.z += pm->mins.z + 1.0f;
-	int cont = pmove_gs->api.PointContents( point, 0 );
+	int cont = PM_PointContents( point );
 
 	if( cont & MASK_WATER ) {
 		pm->watertype = cont;
 		pm->waterlevel = 1;
 		point.z = pml.origin.z + pm->mins.z + sample1;
-		cont = pmove_gs->api.PointContents( point, 0 );
+		cont = PM_PointContents( point );
 		if( cont & MASK_WATER ) {
 			pm->waterlevel = 2;
 			point.z = pml.origin.z + pm->mins.z + sample2;
-			cont = pmove_gs->api.PointContents( point, 0 );
+			cont = PM_PointContents( point );
 			if( cont & MASK_WATER ) {
 				pm->waterlevel = 3;
 			}
@@ -896,7 +962,7 @@ static void PM_CheckWallJump() {
 		// don't walljump if our height is smaller than a step
 		// unless jump is pressed or the player is moving faster than dash speed and upwards
 		float hspeed = Length( Vec3( pml.velocity.x, pml.velocity.y, 0 ) );
-		pmove_gs->api.Trace( &trace, pml.origin, pm->mins, pm->maxs, point, pm->playerState->POVnum, pm->contentmask, 0 );
+		PM_Trace( &trace, pml.origin, pm->mins, pm->maxs, point );
 
 		if( pml.upPush >= 10
 			|| ( hspeed > pm->playerState->pmove.dash_speed && pml.velocity.z > 8 )
@@ -959,7 +1025,7 @@ static void PM_CheckSpecialMovement() {
 	// check for ladder
 	Vec3 spot = pml.origin + pml.flatforward;
 	trace_t trace;
-	pmove_gs->api.Trace( &trace, pml.origin, pm->mins, pm->maxs, spot, pm->playerState->POVnum, pm->contentmask, 0 );
+	PM_Trace( &trace, pml.origin, pm->mins, pm->maxs, spot );
 	if( trace.fraction < 1 && ( trace.surfFlags & SURF_LADDER ) ) {
 		pml.ladder = true;
 		pm->ladder = true;
@@ -972,13 +1038,13 @@ static void PM_CheckSpecialMovement() {
 
 	spot = pml.origin + pml.flatforward * 30;
 	spot.z += 4;
-	cont = pmove_gs->api.PointContents( spot, 0 );
+	cont = PM_PointContents( spot );
 	if( !( cont & CONTENTS_SOLID ) ) {
 		return;
 	}
 
 	spot.z += 16;
-	cont = pmove_gs->api.PointContents( spot, 0 );
+	cont = PM_PointContents( spot );
 	if( cont ) {
 		return;
 	}
@@ -1052,7 +1118,7 @@ static void PM_FlyMove( bool doclip ) {
 	if( doclip ) {
 		Vec3 end = pml.origin + pml.frametime * pml.velocity;
 
-		pmove_gs->api.Trace( &trace, pml.origin, pm->mins, pm->maxs, end, pm->playerState->POVnum, pm->contentmask, 0 );
+		PM_Trace( &trace, pml.origin, pm->mins, pm->maxs, end );
 
 		pml.origin = trace.endpos;
 	} else {
@@ -1124,7 +1190,7 @@ static void PM_AdjustBBox() {
 		wishviewheight = playerbox_stand_viewheight - ( crouchFrac * ( playerbox_stand_viewheight - playerbox_crouch_viewheight ) );
 
 		// check that the head is not blocked
-		pmove_gs->api.Trace( &trace, pml.origin, wishmins, wishmaxs, pml.origin, pm->playerState->POVnum, pm->contentmask, 0 );
+		PM_Trace( &trace, pml.origin, wishmins, wishmaxs, pml.origin );
 		if( trace.allsolid || trace.startsolid ) {
 			// can't do the uncrouching, let the time alone and use old position
 			pm->mins = curmins;
@@ -1189,6 +1255,8 @@ static void PM_BeginMove() {
 
 	// clear all pmove local vars
 	memset( &pml, 0, sizeof( pml ) );
+	num_trace_memos = 0;
+	num_contents_memos = 0;
 
 	pml.origin = pm->playerState->pmove.origin;
 	pml.velocity = pm->playerState->pmove.velocity;
@@ -1453,3 +1521,27 @@ void Pmove( const gs_state_t * gs, pmove_t *pmove ) {
 		}
 	}
 }
+
+struct PmoveBatchJob {
+	const gs_state_t * gs;
+	pmove_t * pmove;
+};
+
+void PmoveBatch( const gs_state_t * gs, Span< pmove_t > pmoves ) {
+	ZoneScoped;
+
+	PmoveBatchJob * jobs = ALLOC_MANY( sys_allocator, PmoveBatchJob, pmoves.n );
+	defer { FREE( sys_allocator, jobs ); };
+
+	for( size_t i = 0; i < pmoves.n; i++ ) {
+		jobs[ i ].gs = gs;
+		jobs[ i ].pmove = &pmoves[ i ];
+	}
+
+	// players are cheap next to the cost of handing out a job, so hand
+	// them out a few at a time
+	ParallelFor( Span< PmoveBatchJob >( jobs, pmoves.n ), []( TempAllocator * temp, void * data ) {
+		const PmoveBatchJob * job = ( const PmoveBatchJob * ) data;
+		Pmove( job->gs, job->pmove );
+	}, 16 );
+}
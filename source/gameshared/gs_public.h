@@ -152,6 +152,14 @@ void GS_LinearMovementDelta( const SyncEntityState *ent, int64_t oldTime, int64_
 
 void Pmove( const gs_state_t * gs, pmove_t *pmove );
 
+/*
+ * same results as calling Pmove on each of them in order, but the players
+ * get spread over the thread pool. each player has to have its own
+ * playerState, and the gs_state_t callbacks have to be safe to call from
+ * any thread. events and traces from different players can interleave
+ */
+void PmoveBatch( const gs_state_t * gs, Span< pmove_t > pmoves );
+
 //===============================================================
 
 #define HEALTH_TO_INT( x )    ( ( x ) < 1.0f ? (int)ceilf( ( x ) ) : (int)floorf( ( x ) + 0.5f ) )
@@ -5,6 +5,11 @@
 #define MAX_CLIENTS                 16
 #define MAX_EDICTS                  1024        // must change protocol to increase more
 
+// baselines past MAX_EDICTS are templates for entities spawned after the map
+// has loaded, see SNAP_ClassBaseline
+#define MAX_CLASS_BASELINES         64
+#define MAX_BASELINES               ( MAX_EDICTS + MAX_CLASS_BASELINES )
+
 enum MatchState : u8 {
 	MatchState_Warmup,
 	MatchState_Countdown,
@@ -258,6 +263,22 @@ struct SyncEntityState {
 	int team;                           // team in the game
 };
 
+/*
+ * events that don't belong to an entity, like explosions and impacts. they
+ * go out as a list on the snapshot instead of each taking up an edict
+ */
+#define MAX_SNAP_EVENTS 512
+
+struct SyncSnapEvent {
+	SyncEvent event;
+	unsigned int svflags;           // the same visibility filters as entities, e.g. SVF_BROADCAST
+	Vec3 origin;
+	Vec3 origin2;
+	Vec3 angles;
+	int ownerNum;
+	int team;
+};
+
 struct pmove_state_t {
 	int pm_type;
 
@@ -11,33 +11,39 @@
 #define WEAPONUP_TIME_VERY_SLOW 1000
 #define HITSCAN_RANGE 9001
 
-const WeaponDef weapon_defs[] = {
+constexpr WeaponInfo weapon_infos[] = {
 	{ "", "", WeaponCategory_Count }, // Weapon_None
 
-	{
-		/* name                 */ "Knife",
-		/* short name           */ "gb",
-		/* category             */ WeaponCategory_Count,
+	{ "Knife", "gb", WeaponCategory_Count },
+	{ "9mm", "9mm", WeaponCategory_Backup },
+	{ "SMG", "mg", WeaponCategory_Secondary },
+	{ "Deagle", "deagle", WeaponCategory_Secondary },
+	{ "Shotgun", "rg", WeaponCategory_Secondary },
+	{ "Burst Rifle", "br", WeaponCategory_Primary },
+	{ "Stakes", "stake", WeaponCategory_Backup },
+	{ "Grenades", "gl", WeaponCategory_Secondary },
+	{ "Rockets", "rl", WeaponCategory_Primary },
+	{ "Assault Rifle", "ar", WeaponCategory_Primary },
+	{ "BubbleGun", "bg", WeaponCategory_Backup },
+	{ "Laser", "lg", WeaponCategory_Primary },
+	{ "Railgun", "eb", WeaponCategory_Primary },
+	{ "Sniper", "sniper", WeaponCategory_Primary },
+	{ "Auto sniper", "autosniper", WeaponCategory_Backup },
+	{ "Rifle", "rifle", WeaponCategory_Secondary },
+	{ "MasterBlaster", "mb", WeaponCategory_Backup },
+	{ "Road Gun", "road", WeaponCategory_Secondary },
+#if 0
+	{ "Minigun", "minigun", WeaponCategory_Backup },
+#endif
+};
 
-		/* projectile count     */ 8,
-		/* clip size            */ 0,
-		/* reload time          */ 0,
-		/* staged reloading     */ false,
+constexpr WeaponDef weapon_defs[] = {
+	{ }, // Weapon_None
 
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_FAST,
-		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 600,
+	{ // Knife
+		// firing
 		/* timeout / range      */ 85,
-		/* max recoil           */ EulerDegrees2( 0.0f, 0.0f ),
-		/* min recoil           */ EulerDegrees2( 0.0f, 0.0f ),
-		/* recoil recovery      */ 0.0f,
-		/* firing mode          */ FiringMode_Auto,
-
-		/* zoom fov             */ 0.0f,
-		/* zoom inaccuracy      */ 0.0f,
-
-		// damages
+		/* projectile count     */ 8,
 		/* damage               */ 25,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.0f,
@@ -45,36 +51,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 20,
-	},
-
-	{
-		/* name                 */ "9mm",
-		/* short name           */ "9mm",
-		/* category             */ WeaponCategory_Backup,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 15,
-		/* reload time          */ 1500,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
+		// ammo and timings (in msecs)
+		/* clip size            */ 0,
+		/* refire time          */ 600,
+		/* reload time          */ 0,
 		/* weapon up time       */ WEAPONUP_TIME_FAST,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 120,
-		/* timeout / range      */ HITSCAN_RANGE,
-		/* max recoil           */ EulerDegrees2( 125.0f, 20.0f ),
-		/* min recoil           */ EulerDegrees2( 100.0f, -20.0f ),
-		/* recoil recovery      */ 2000.0f,
-		/* firing mode          */ FiringMode_SemiAuto,
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 0.0f, 0.0f ),
+		/* min recoil           */ EulerDegrees2( 0.0f, 0.0f ),
+		/* recoil recovery      */ 0.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // 9mm
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 1,
 		/* damage               */ 12,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.5f,
@@ -82,37 +82,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 0,
-	},
 
-	{
-		/* name                 */ "SMG",
-		/* short name           */ "mg",
-		/* category             */ WeaponCategory_Secondary,
-
-		/* projectile count     */ 1,
-		/* clip size            */ 25,
+		// ammo and timings (in msecs)
+		/* clip size            */ 15,
+		/* refire time          */ 120,
 		/* reload time          */ 1500,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
+		/* weapon up time       */ WEAPONUP_TIME_FAST,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 75,
-		/* timeout / range      */ HITSCAN_RANGE,
-
-		/* max recoil           */ EulerDegrees2( 80.0f, 25.0f ),
-		/* min recoil           */ EulerDegrees2( 50.0f, -25.0f ),
-		/* recoil recovery      */ 1500.0f,
-		/* firing mode          */ FiringMode_Auto,
+		/* firing mode          */ FiringMode_SemiAuto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 125.0f, 20.0f ),
+		/* min recoil           */ EulerDegrees2( 100.0f, -20.0f ),
+		/* recoil recovery      */ 2000.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // SMG
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 1,
 		/* damage               */ 9,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.5f,
@@ -120,36 +113,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 0,
-	},
 
-	{
-		/* name                 */ "Deagle",
-		/* short name           */ "deagle",
-		/* category             */ WeaponCategory_Secondary,
-
-		/* projectile count     */ 1,
-		/* clip size            */ 7,
+		// ammo and timings (in msecs)
+		/* clip size            */ 25,
+		/* refire time          */ 75,
 		/* reload time          */ 1500,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
 		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 500,
-		/* timeout / range      */ HITSCAN_RANGE,
-		/* max recoil           */ EulerDegrees2( 325.0f, 40.0f ),
-		/* min recoil           */ EulerDegrees2( 300.0f, -40.0f ),
-		/* recoil recovery      */ 3250.0f,
-		/* firing mode          */ FiringMode_SemiAuto,
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 80.0f, 25.0f ),
+		/* min recoil           */ EulerDegrees2( 50.0f, -25.0f ),
+		/* recoil recovery      */ 1500.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Deagle
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 1,
 		/* damage               */ 25,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.8f,
@@ -157,36 +144,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "Shotgun",
-		/* short name           */ "rg",
-		/* category             */ WeaponCategory_Secondary,
-
-		/* projectile count     */ 25,
-		/* clip size            */ 5,
-		/* reload time          */ 600,
-		/* staged reloading     */ true,
 
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_SLOW,
+		// ammo and timings (in msecs)
+		/* clip size            */ 7,
+		/* refire time          */ 500,
+		/* reload time          */ 1500,
+		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 1250,
-		/* timeout / range      */ HITSCAN_RANGE,
-		/* max recoil           */ EulerDegrees2( 325.0f, -50.0f ),
-		/* min recoil           */ EulerDegrees2( 275.0f, -40.0f ),
-		/* recoil recovery      */ 1500.0f,
-		/* firing mode          */ FiringMode_Auto,
+		/* firing mode          */ FiringMode_SemiAuto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 325.0f, 40.0f ),
+		/* min recoil           */ EulerDegrees2( 300.0f, -40.0f ),
+		/* recoil recovery      */ 3250.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Shotgun
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 25,
 		/* damage               */ 2,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.5f,
@@ -194,36 +175,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 50,
-	},
-
-	{
-		/* name                 */ "Burst Rifle",
-		/* short name           */ "br",
-		/* category             */ WeaponCategory_Primary,
 
-		/* projectile count     */ 1,
+		// ammo and timings (in msecs)
 		/* clip size            */ 5,
+		/* refire time          */ 1250,
 		/* reload time          */ 600,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
+		/* weapon up time       */ WEAPONUP_TIME_SLOW,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 35,
-		/* timeout / range      */ HITSCAN_RANGE,
-		/* max recoil           */ EulerDegrees2( 80.0f, -20.0f ),
-		/* min recoil           */ EulerDegrees2( 70.0f, -10.0f ),
-		/* recoil recovery      */ 2500.0f,
-		/* firing mode          */ FiringMode_Clip,
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ true,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 325.0f, -50.0f ),
+		/* min recoil           */ EulerDegrees2( 275.0f, -40.0f ),
+		/* recoil recovery      */ 1500.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Burst Rifle
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 1,
 		/* damage               */ 9,
 		/* self damage          */ 0.0f,
 		/* wallbang damage      */ 0.75,
@@ -231,36 +206,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "Stakes",
-		/* short name           */ "stake",
-		/* category             */ WeaponCategory_Backup,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 1,
-		/* reload time          */ 1000,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
+		// ammo and timings (in msecs)
+		/* clip size            */ 5,
+		/* refire time          */ 35,
+		/* reload time          */ 600,
 		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 500,
-		/* timeout / range      */ 5000,
-		/* max recoil           */ EulerDegrees2( 250.0f, 5.0f ),
-		/* min recoil           */ EulerDegrees2( 250.0f, -5.0f ),
-		/* recoil recovery      */ 2000.0f,
-		/* firing mode          */ FiringMode_Auto,
+		/* firing mode          */ FiringMode_Clip,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 80.0f, -20.0f ),
+		/* min recoil           */ EulerDegrees2( 70.0f, -10.0f ),
+		/* recoil recovery      */ 2500.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Stakes
+		// firing
+		/* timeout / range      */ 5000,
+		/* projectile count     */ 1,
 		/* damage               */ 50,
 		/* self damage          */ 1.0f,
 		/* wallbang damage      */ 0.0f,
@@ -268,36 +237,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 120,
 		/* splash min damage    */ 15,
 		/* splash min knockback */ 50,
-
-		// projectile def
 		/* speed                */ 2000,
 		/* spread               */ 0,
-	},
 
-	{
-		/* name                 */ "Grenades",
-		/* short name           */ "gl",
-		/* category             */ WeaponCategory_Secondary,
-
-		/* projectile count     */ 1,
-		/* clip size            */ 5,
-		/* reload time          */ 600,
-		/* staged reloading     */ true,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_SLOW,
+		// ammo and timings (in msecs)
+		/* clip size            */ 1,
+		/* refire time          */ 500,
+		/* reload time          */ 1000,
+		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 1000,
-		/* timeout / range      */ 2000,
-		/* max recoil           */ EulerDegrees2( 300.0f, 5.0f ),
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
+
+		// aiming
+		/* max recoil           */ EulerDegrees2( 250.0f, 5.0f ),
 		/* min recoil           */ EulerDegrees2( 250.0f, -5.0f ),
 		/* recoil recovery      */ 2000.0f,
-		/* firing mode          */ FiringMode_SemiAuto,
-
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Grenades
+		// firing
+		/* timeout / range      */ 2000,
+		/* projectile count     */ 1,
 		/* damage               */ 40,
 		/* self damage          */ 1.0f,
 		/* wallbang damage      */ 0.0f,
@@ -305,36 +268,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 120,
 		/* splash min damage    */ 10,
 		/* splash min knockback */ 50,
-
-		// projectile def
 		/* speed                */ 1400,
 		/* spread               */ 0,
-	},
 
-	{
-		/* name                 */ "Rockets",
-		/* short name           */ "rl",
-		/* category             */ WeaponCategory_Primary,
-
-		/* projectile count     */ 1,
+		// ammo and timings (in msecs)
 		/* clip size            */ 5,
+		/* refire time          */ 1000,
 		/* reload time          */ 600,
-		/* staged reloading     */ true,
-
-		// timings (in msecs)
 		/* weapon up time       */ WEAPONUP_TIME_SLOW,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 1000,
-		/* timeout / range      */ 10000,
+		/* firing mode          */ FiringMode_SemiAuto,
+		/* staged reloading     */ true,
+
+		// aiming
 		/* max recoil           */ EulerDegrees2( 300.0f, 5.0f ),
-		/* min recoil           */ EulerDegrees2( 200.0f, -5.0f ),
+		/* min recoil           */ EulerDegrees2( 250.0f, -5.0f ),
 		/* recoil recovery      */ 2000.0f,
-		/* firing mode          */ FiringMode_Auto,
-
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Rockets
+		// firing
+		/* timeout / range      */ 10000,
+		/* projectile count     */ 1,
 		/* damage               */ 40,
 		/* self damage          */ 1.0f,
 		/* wallbang damage      */ 0.0f,
@@ -342,36 +299,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 120,
 		/* splash min damage    */ 10,
 		/* splash min knockback */ 50,
-
-		// projectile def
 		/* speed                */ 1400,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "Assault Rifle",
-		/* short name           */ "ar",
-		/* category             */ WeaponCategory_Primary,
-
-		/* projectile count     */ 1,
-		/* clip size            */ 30,
-		/* reload time          */ 1500,
-		/* staged reloading     */ false,
 
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
+		// ammo and timings (in msecs)
+		/* clip size            */ 5,
+		/* refire time          */ 1000,
+		/* reload time          */ 600,
+		/* weapon up time       */ WEAPONUP_TIME_SLOW,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 50,
-		/* timeout / range      */ 10000,
-		/* max recoil           */ EulerDegrees2( 80.0f, 25.0f ),
-		/* min recoil           */ EulerDegrees2( 50.0f, -25.0f ),
-		/* recoil recovery      */ 1350.0f,
 		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ true,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 300.0f, 5.0f ),
+		/* min recoil           */ EulerDegrees2( 200.0f, -5.0f ),
+		/* recoil recovery      */ 2000.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Assault Rifle
+		// firing
+		/* timeout / range      */ 10000,
+		/* projectile count     */ 1,
 		/* damage               */ 8,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 1.0f, //not implemented
@@ -379,36 +330,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 45,
 		/* splash min damage    */ 7,
 		/* splash min knockback */ 5,
-
-		// projectile def
 		/* speed                */ 3500,
 		/* spread               */ 0.0f,
-	},
-
-	{
-		/* name                 */ "BubbleGun",
-		/* short name           */ "bg",
-		/* category             */ WeaponCategory_Backup,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 15,
+		// ammo and timings (in msecs)
+		/* clip size            */ 30,
+		/* refire time          */ 50,
 		/* reload time          */ 1500,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
 		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 175,
-		/* timeout / range      */ 10000,
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
+
+		// aiming
 		/* max recoil           */ EulerDegrees2( 80.0f, 25.0f ),
 		/* min recoil           */ EulerDegrees2( 50.0f, -25.0f ),
 		/* recoil recovery      */ 1350.0f,
-		/* firing mode          */ FiringMode_Auto,
-
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // BubbleGun
+		// firing
+		/* timeout / range      */ 10000,
+		/* projectile count     */ 1,
 		/* damage               */ 15,
 		/* self damage          */ 1,
 		/* wallbang damage      */ 0.0f,
@@ -416,36 +361,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 80,
 		/* splash min damage    */ 14,
 		/* splash min knockback */ 25,
-
-		// projectile def
 		/* speed                */ 650,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "Laser",
-		/* short name           */ "lg",
-		/* category             */ WeaponCategory_Primary,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 40,
+		// ammo and timings (in msecs)
+		/* clip size            */ 15,
+		/* refire time          */ 175,
 		/* reload time          */ 1500,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_FAST,
+		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 50,
-		/* timeout / range      */ 900,
-		/* max recoil           */ EulerDegrees2( 0.0f, 0.0f ),
-		/* min recoil           */ EulerDegrees2( 0.0f, 0.0f ),
-		/* recoil recovery      */ 0.0f,
-		/* firing mode          */ FiringMode_Smooth,
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 80.0f, 25.0f ),
+		/* min recoil           */ EulerDegrees2( 50.0f, -25.0f ),
+		/* recoil recovery      */ 1350.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Laser
+		// firing
+		/* timeout / range      */ 900,
+		/* projectile count     */ 1,
 		/* damage               */ 5,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.0f,
@@ -453,36 +392,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "Railgun",
-		/* short name           */ "eb",
-		/* category             */ WeaponCategory_Primary,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 0,
-		/* reload time          */ 500, // time to fully charge for rail
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_SLOW,
+		// ammo and timings (in msecs)
+		/* clip size            */ 40,
+		/* refire time          */ 50,
+		/* reload time          */ 1500,
+		/* weapon up time       */ WEAPONUP_TIME_FAST,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 1000,
-		/* timeout / range      */ HITSCAN_RANGE,
-		/* max recoil           */ EulerDegrees2( 150.0f, 40.0f ),
-		/* min recoil           */ EulerDegrees2( 100.0f, -40.0f ),
-		/* recoil recovery      */ 1000.0f,
-		/* firing mode          */ FiringMode_Auto,
+		/* firing mode          */ FiringMode_Smooth,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 0.0f, 0.0f ),
+		/* min recoil           */ EulerDegrees2( 0.0f, 0.0f ),
+		/* recoil recovery      */ 0.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Railgun
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 1,
 		/* damage               */ 38,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 1.0f, //not implemented
@@ -490,36 +423,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "Sniper",
-		/* short name           */ "sniper",
-		/* category             */ WeaponCategory_Primary,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 1,
-		/* reload time          */ 2000,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_VERY_SLOW,
+		// ammo and timings (in msecs)
+		/* clip size            */ 0,
+		/* refire time          */ 1000,
+		/* reload time          */ 500, // time to fully charge for rail
+		/* weapon up time       */ WEAPONUP_TIME_SLOW,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 500,
-		/* timeout / range      */ HITSCAN_RANGE,
-		/* max recoil           */ EulerDegrees2( 275.0f, 5.0f ),
-		/* min recoil           */ EulerDegrees2( 250.0f, -5.0f ),
-		/* recoil recovery      */ 1750.0f,
 		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
 
-		/* zoom fov             */ 25.0f,
-		/* zoom inaccuracy      */ 30.0f,
+		// aiming
+		/* max recoil           */ EulerDegrees2( 150.0f, 40.0f ),
+		/* min recoil           */ EulerDegrees2( 100.0f, -40.0f ),
+		/* recoil recovery      */ 1000.0f,
+		/* zoom fov             */ 0.0f,
+		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Sniper
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 1,
 		/* damage               */ 50,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 1.0f,
@@ -527,36 +454,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "Auto sniper",
-		/* short name           */ "autosniper",
-		/* category             */ WeaponCategory_Backup,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 5,
+		// ammo and timings (in msecs)
+		/* clip size            */ 1,
+		/* refire time          */ 500,
 		/* reload time          */ 2000,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
+		/* weapon up time       */ WEAPONUP_TIME_VERY_SLOW,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 420,
-		/* timeout / range      */ 6969,
-		/* max recoil           */ EulerDegrees2( 200.0f, 5.0f ),
-		/* min recoil           */ EulerDegrees2( 175.0f, -5.0f ),
-		/* recoil recovery      */ 1750.0f,
 		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
 
-		/* zoom fov             */ 40.0f,
-		/* zoom inaccuracy      */ 5.0f,
+		// aiming
+		/* max recoil           */ EulerDegrees2( 275.0f, 5.0f ),
+		/* min recoil           */ EulerDegrees2( 250.0f, -5.0f ),
+		/* recoil recovery      */ 1750.0f,
+		/* zoom fov             */ 25.0f,
+		/* zoom inaccuracy      */ 30.0f,
+	},
 
-		// damages
+	{ // Auto sniper
+		// firing
+		/* timeout / range      */ 6969,
+		/* projectile count     */ 1,
 		/* damage               */ 25,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 1.0f,
@@ -564,36 +485,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 80,
 		/* splash min damage    */ 5,
 		/* splash min knockback */ 20,
-
-		// projectile def
 		/* speed                */ 4000,
 		/* spread               */ 2000, // fuse time
-	},
-
-	{
-		/* name                 */ "Rifle",
-		/* short name           */ "rifle",
-		/* category             */ WeaponCategory_Secondary,
 
-		/* projectile count     */ 1,
+		// ammo and timings (in msecs)
 		/* clip size            */ 5,
+		/* refire time          */ 420,
 		/* reload time          */ 2000,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
 		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 600,
-		/* timeout / range      */ 10000,
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
+
+		// aiming
 		/* max recoil           */ EulerDegrees2( 200.0f, 5.0f ),
 		/* min recoil           */ EulerDegrees2( 175.0f, -5.0f ),
-		/* recoil recovery      */ 1500.0f,
-		/* firing mode          */ FiringMode_SemiAuto,
-
-		/* zoom fov             */ 0.0f,
-		/* zoom inaccuracy      */ 0.0f,
+		/* recoil recovery      */ 1750.0f,
+		/* zoom fov             */ 40.0f,
+		/* zoom inaccuracy      */ 5.0f,
+	},
 
-		// damages
+	{ // Rifle
+		// firing
+		/* timeout / range      */ 10000,
+		/* projectile count     */ 1,
 		/* damage               */ 40,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 1.0f, //not implemented
@@ -601,36 +516,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ 5500,
 		/* spread               */ 0,
-	},
-
-	{
-		/* name                 */ "MasterBlaster",
-		/* short name           */ "mb",
-		/* category             */ WeaponCategory_Backup,
 
-		/* projectile count     */ 10,
-		/* clip size            */ 6,
-		/* reload time          */ 1500,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
+		// ammo and timings (in msecs)
+		/* clip size            */ 5,
+		/* refire time          */ 600,
+		/* reload time          */ 2000,
 		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 500,
-		/* timeout / range      */ 5000,
-		/* max recoil           */ EulerDegrees2( 300.0f, 25.0f ),
-		/* min recoil           */ EulerDegrees2( 275.0f, -25.0f ),
-		/* recoil recovery      */ 2000.0f,
-		/* firing mode          */ FiringMode_Auto,
+		/* firing mode          */ FiringMode_SemiAuto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 200.0f, 5.0f ),
+		/* min recoil           */ EulerDegrees2( 175.0f, -5.0f ),
+		/* recoil recovery      */ 1500.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // MasterBlaster
+		// firing
+		/* timeout / range      */ 5000,
+		/* projectile count     */ 10,
 		/* damage               */ 3,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.0f,
@@ -638,36 +547,30 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ 3000,
 		/* spread               */ 25,
-	},
 
-	{
-		/* name                 */ "Road Gun",
-		/* short name           */ "road",
-		/* category             */ WeaponCategory_Secondary,
-
-		/* projectile count     */ 1,
-		/* clip size            */ 20,
+		// ammo and timings (in msecs)
+		/* clip size            */ 6,
+		/* refire time          */ 500,
 		/* reload time          */ 1500,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_FAST,
+		/* weapon up time       */ WEAPONUP_TIME_NORMAL,
 		/* weapon down time     */ WEAPONDOWN_TIME,
-		/* refire time          */ 75,
-		/* timeout / range      */ 5000,
-		/* max recoil           */ EulerDegrees2( 80.0f, 25.0f ),
-		/* min recoil           */ EulerDegrees2( 70.0f, -25.0f ),
-		/* recoil recovery      */ 1500.0f,
 		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 300.0f, 25.0f ),
+		/* min recoil           */ EulerDegrees2( 275.0f, -25.0f ),
+		/* recoil recovery      */ 2000.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+	{ // Road Gun
+		// firing
+		/* timeout / range      */ 5000,
+		/* projectile count     */ 1,
 		/* damage               */ 8,
 		/* self damage          */ 0,
 		/* wallbang damage      */ 0.0f,
@@ -675,56 +578,81 @@ const WeaponDef weapon_defs[] = {
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ 3000,
 		/* spread               */ 0,
-	},
-
-#if 0
-	{
-		/* name                 */ "Minigun",
-		/* short name           */ "minigun",
-		/* category             */ WeaponCategory_Backup,
 
-		/* projectile count     */ 1,
-		/* clip size            */ 0,
-		/* reload time          */ 0,
-		/* staged reloading     */ false,
-
-		// timings (in msecs)
-		/* weapon up time       */ WEAPONUP_TIME_VERY_SLOW,
-		/* weapon down time     */ WEAPONDOWN_TIME,
+		// ammo and timings (in msecs)
+		/* clip size            */ 20,
 		/* refire time          */ 75,
-		/* timeout / range      */ HITSCAN_RANGE,
-		/* max recoil           */ EulerDegrees2( 0.0f, 0.0f ),
-		/* min recoil           */ EulerDegrees2( 0.0f, 0.0f ),
-		/* recoil recovery      */ 1000.0f,
+		/* reload time          */ 1500,
+		/* weapon up time       */ WEAPONUP_TIME_FAST,
+		/* weapon down time     */ WEAPONDOWN_TIME,
 		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
 
+		// aiming
+		/* max recoil           */ EulerDegrees2( 80.0f, 25.0f ),
+		/* min recoil           */ EulerDegrees2( 70.0f, -25.0f ),
+		/* recoil recovery      */ 1500.0f,
 		/* zoom fov             */ 0.0f,
 		/* zoom inaccuracy      */ 0.0f,
+	},
 
-		// damages
+#if 0
+	{ // Minigun
+		// firing
+		/* timeout / range      */ HITSCAN_RANGE,
+		/* projectile count     */ 1,
 		/* damage               */ 9,
 		/* self damage          */ 0,
+		/* wallbang damage      */ 0.0f,
 		/* knockback            */ 30,
 		/* splash radius        */ 0,
 		/* splash min damage    */ 0,
 		/* splash min knockback */ 0,
-
-		// projectile def
 		/* speed                */ INSTANT,
 		/* spread               */ 250,
+
+		// ammo and timings (in msecs)
+		/* clip size            */ 0,
+		/* refire time          */ 75,
+		/* reload time          */ 0,
+		/* weapon up time       */ WEAPONUP_TIME_VERY_SLOW,
+		/* weapon down time     */ WEAPONDOWN_TIME,
+		/* firing mode          */ FiringMode_Auto,
+		/* staged reloading     */ false,
+
+		// aiming
+		/* max recoil           */ EulerDegrees2( 0.0f, 0.0f ),
+		/* min recoil           */ EulerDegrees2( 0.0f, 0.0f ),
+		/* recoil recovery      */ 1000.0f,
+		/* zoom fov             */ 0.0f,
+		/* zoom inaccuracy      */ 0.0f,
 	},
+
 #endif
 };
 
+// Weapon_None is left empty so start checking after it
+constexpr bool ValidWeaponDefs( size_t i ) {
+	return i == Weapon_Count || (
+		weapon_defs[ i ].projectile_count > 0 &&
+		weapon_defs[ i ].refire_time > 0 &&
+		weapon_defs[ i ].range > 0 &&
+		( !weapon_defs[ i ].staged_reloading || weapon_defs[ i ].clip_size > 0 ) &&
+		weapon_infos[ i ].name[ 0 ] != '\0' &&
+		weapon_infos[ i ].short_name[ 0 ] != '\0' &&
+		ValidWeaponDefs( i + 1 )
+	);
+}
+
 STATIC_ASSERT( ARRAY_COUNT( weapon_defs ) == Weapon_Count );
+STATIC_ASSERT( ARRAY_COUNT( weapon_infos ) == Weapon_Count );
+STATIC_ASSERT( ValidWeaponDefs( Weapon_None + 1 ) );
 
-const WeaponDef * GS_GetWeaponDef( WeaponType weapon ) {
+const WeaponInfo * GetWeaponInfo( WeaponType weapon ) {
 	assert( weapon < Weapon_Count );
-	return &weapon_defs[ weapon ];
+	return &weapon_infos[ weapon ];
 }
 
 const GadgetDef gadget_defs[] = {
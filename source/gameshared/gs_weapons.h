@@ -14,41 +14,46 @@ enum WeaponCategory {
 	WeaponCategory_Count
 };
 
-struct WeaponDef {
-	const char * name;
-	const char * short_name;
-
-	WeaponCategory category;
-
+/*
+ * WeaponDef is what we read while players are shooting, split off from the
+ * names so it's flat and indexed directly by WeaponType. everything the
+ * fire path reads is at the start and fits in the first cache line
+ */
+struct alignas( 64 ) WeaponDef {
+	s32 range;
 	int projectile_count;
+	int damage;
+	float selfdamage;
+	float wallbangdamage;
+	float knockback;
+	float splash_radius;
+	float min_damage;
+	float min_knockback;
+	int speed;
+	float spread;
+
 	int clip_size;
+	u16 refire_time;
 	u16 reload_time;
-	bool staged_reloading;
-
 	u16 switch_in_time;
 	u16 switch_out_time;
-	u16 refire_time;
-	s64 range;
+	FiringMode firing_mode;
+	bool staged_reloading;
 
 	EulerDegrees2 recoil_max;
 	EulerDegrees2 recoil_min;
 	float recoil_recover;
 
-	FiringMode firing_mode;
-
 	float zoom_fov;
 	float zoom_spread;
+};
 
-	int damage;
-	float selfdamage;
-	float wallbangdamage;
-	float knockback;
-	float splash_radius;
-	float min_damage;
-	float min_knockback;
+STATIC_ASSERT( offsetof( WeaponDef, staged_reloading ) < 64 );
 
-	int speed;
-	float spread;
+struct WeaponInfo {
+	const char * name;
+	const char * short_name;
+	WeaponCategory category;
 };
 
 struct GadgetDef {
@@ -72,12 +77,20 @@ struct GadgetDef {
 void UpdateWeapons( const gs_state_t * gs, SyncPlayerState * ps, UserCommand cmd, int timeDelta );
 void ClearInventory( SyncPlayerState * ps );
 
-const WeaponDef * GS_GetWeaponDef( WeaponType weapon );
+extern const WeaponDef weapon_defs[ Weapon_Count ];
+
+inline const WeaponDef * GS_GetWeaponDef( WeaponType weapon ) {
+	assert( weapon < Weapon_Count );
+	return &weapon_defs[ weapon ];
+}
+
+const WeaponInfo * GetWeaponInfo( WeaponType weapon );
 const GadgetDef * GetGadgetDef( GadgetType gadget );
 
 WeaponSlot * GS_FindWeapon( SyncPlayerState * player, WeaponType weapon );
 const WeaponSlot * GS_FindWeapon( const SyncPlayerState * player, WeaponType weapon );
 
+Vec3 BulletEnd( Vec3 start, Vec3 dir, Vec3 right, Vec3 up, Vec2 spread, int range );
 void GS_TraceBullet( const gs_state_t * gs, trace_t * trace, trace_t * wallbang_trace, Vec3 start, Vec3 dir, Vec3 right, Vec3 up, Vec2 spread, int range, int ignore, int timeDelta );
 Vec2 RandomSpreadPattern( u16 entropy, float spread );
 float ZoomSpreadness( s16 zoom_time, const WeaponDef * def );
@@ -90,7 +90,6 @@ enum pmtype_t {
 //==============================================
 
 constexpr const char * MASTER_SERVERS[] = { "dpmaster.deathmask.net", "excalibur.nvg.ntnu.no" };
-#define SERVER_PINGING_TIMEOUT              50
 #define LAN_SERVER_PINGING_TIMEOUT          20
 
 // SyncEntityState is the information conveyed from the server
@@ -50,4 +50,6 @@ struct cvar_t {
 	bool modified;          // set each time the cvar is changed
 	float value;
 	int integer;
+
+	u64 name_hash; // CaseInsensitiveHash64( name )
 };
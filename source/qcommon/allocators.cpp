@@ -155,17 +155,496 @@ struct SystemAllocator final : public Allocator {
 	}
 };
 
+/*
+ * PoolAllocator
+ *
+ * small allocations come out of size class free lists, and each thread keeps
+ * a few of each size itself so most allocations and frees never touch shared
+ * state. threads move batches to and from the shared lists when their cache
+ * runs dry or fills up. chunks are never given back to malloc
+ *
+ * every allocation has a 16 byte header with its size class so deallocate
+ * knows where it goes, and anything bigger than the biggest class goes
+ * straight to malloc. the header also has room for the allocation profiler
+ */
+
+#include <atomic>
+
+static constexpr u32 pool_size_classes[] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048 };
+static constexpr u32 POOL_LARGE = ARRAY_COUNT( pool_size_classes );
+STATIC_ASSERT( POOL_LARGE == ARRAY_COUNT( &PoolAllocatorStats::classes ) );
+static constexpr size_t POOL_CHUNK_SIZE = 64 * 1024;
+static constexpr u32 POOL_BATCH_SIZE = 32;
+
+struct alignas( 16 ) PoolHeader {
+	size_t size;
+	u16 size_class;
+	u16 callsite; // 0 if the profiler wasn't running
+	u32 birth_ms;
+};
+
+STATIC_ASSERT( sizeof( PoolHeader ) == 16 );
+
+struct PoolFreeNode {
+	PoolFreeNode * next;
+};
+
+// everything here is zero initialised so the pool works before constructors run
+struct PoolSizeClass {
+	std::atomic_flag lock;
+	PoolFreeNode * free;
+
+	// slots that aren't on the shared free list, so either in use or in a thread's cache
+	size_t handed_out;
+	size_t peak_handed_out;
+	size_t chunks;
+};
+
+static PoolSizeClass pool_classes[ POOL_LARGE ];
+static std::atomic< size_t > pool_large_allocations;
+static std::atomic< size_t > pool_large_bytes;
+
+struct PoolThreadCache {
+	PoolFreeNode * free[ POOL_LARGE ];
+	u32 num_free[ POOL_LARGE ];
+	bool dead;
+
+	~PoolThreadCache();
+};
+
+static thread_local PoolThreadCache pool_cache;
+
+static void LockSizeClass( PoolSizeClass * sc ) {
+	while( sc->lock.test_and_set( std::memory_order_acquire ) ) {
+		continue;
+	}
+}
+
+static void UnlockSizeClass( PoolSizeClass * sc ) {
+	sc->lock.clear( std::memory_order_release );
+}
+
+static u32 PoolSizeClassForSize( size_t size ) {
+	for( u32 i = 0; i < POOL_LARGE; i++ ) {
+		if( size <= pool_size_classes[ i ] )
+			return i;
+	}
+	return POOL_LARGE;
+}
+
+// takes up to n slots off the shared list, carving up a new chunk if it's empty
+static PoolFreeNode * TakeSharedSlots( u32 size_class, u32 n, u32 * taken ) {
+	PoolSizeClass * sc = &pool_classes[ size_class ];
+	LockSizeClass( sc );
+	defer { UnlockSizeClass( sc ); };
+
+	if( sc->free == NULL ) {
+		u8 * chunk = ( u8 * ) malloc( POOL_CHUNK_SIZE );
+		if( chunk == NULL ) {
+			*taken = 0;
+			return NULL;
+		}
+
+		size_t slot_size = sizeof( PoolHeader ) + pool_size_classes[ size_class ];
+		size_t num_slots = POOL_CHUNK_SIZE / slot_size;
+		for( size_t i = 0; i < num_slots; i++ ) {
+			PoolFreeNode * node = ( PoolFreeNode * ) ( chunk + ( num_slots - i - 1 ) * slot_size );
+			node->next = sc->free;
+			sc->free = node;
+		}
+
+		sc->chunks++;
+	}
+
+	PoolFreeNode * first = sc->free;
+	PoolFreeNode * last = first;
+	u32 count = 1;
+	while( count < n && last->next != NULL ) {
+		last = last->next;
+		count++;
+	}
+
+	sc->free = last->next;
+	last->next = NULL;
+
+	sc->handed_out += count;
+	sc->peak_handed_out = Max2( sc->handed_out, sc->peak_handed_out );
+
+	*taken = count;
+	return first;
+}
+
+static void ReturnSharedSlots( u32 size_class, PoolFreeNode * first, PoolFreeNode * last, u32 n ) {
+	PoolSizeClass * sc = &pool_classes[ size_class ];
+	LockSizeClass( sc );
+	last->next = sc->free;
+	sc->free = first;
+	sc->handed_out -= n;
+	UnlockSizeClass( sc );
+}
+
+PoolThreadCache::~PoolThreadCache() {
+	for( u32 i = 0; i < POOL_LARGE; i++ ) {
+		if( num_free[ i ] == 0 )
+			continue;
+
+		PoolFreeNode * last = free[ i ];
+		while( last->next != NULL ) {
+			last = last->next;
+		}
+		ReturnSharedSlots( i, free[ i ], last, num_free[ i ] );
+
+		free[ i ] = NULL;
+		num_free[ i ] = 0;
+	}
+
+	// anything freed on this thread from here on goes straight back to the shared lists
+	dead = true;
+}
+
+static PoolHeader * PoolAllocateSlot( u32 size_class ) {
+	PoolThreadCache * cache = &pool_cache;
+	if( cache->dead ) {
+		u32 taken;
+		return ( PoolHeader * ) TakeSharedSlots( size_class, 1, &taken );
+	}
+
+	if( cache->num_free[ size_class ] == 0 ) {
+		cache->free[ size_class ] = TakeSharedSlots( size_class, POOL_BATCH_SIZE, &cache->num_free[ size_class ] );
+		if( cache->num_free[ size_class ] == 0 )
+			return NULL;
+	}
+
+	PoolFreeNode * node = cache->free[ size_class ];
+	cache->free[ size_class ] = node->next;
+	cache->num_free[ size_class ]--;
+
+	return ( PoolHeader * ) node;
+}
+
+static void PoolFreeSlot( PoolHeader * header ) {
+	u32 size_class = header->size_class;
+	PoolFreeNode * node = ( PoolFreeNode * ) header;
+
+	PoolThreadCache * cache = &pool_cache;
+	if( cache->dead ) {
+		ReturnSharedSlots( size_class, node, node, 1 );
+		return;
+	}
+
+	node->next = cache->free[ size_class ];
+	cache->free[ size_class ] = node;
+	cache->num_free[ size_class ]++;
+
+	// keep one batch around so alternating alloc/free doesn't bounce slots back and forth
+	if( cache->num_free[ size_class ] >= POOL_BATCH_SIZE * 2 ) {
+		PoolFreeNode * first = cache->free[ size_class ];
+		PoolFreeNode * last = first;
+		for( u32 i = 1; i < POOL_BATCH_SIZE; i++ ) {
+			last = last->next;
+		}
+
+		cache->free[ size_class ] = last->next;
+		cache->num_free[ size_class ] -= POOL_BATCH_SIZE;
+		ReturnSharedSlots( size_class, first, last, POOL_BATCH_SIZE );
+	}
+}
+
+/*
+ * allocation profiler
+ *
+ * costs one relaxed load per allocation when it's off. when it's on every
+ * allocation and free of a profiled allocation takes a spinlock, which is
+ * fine for finding leaks on a live server but you wouldn't leave it on
+ */
+
+STATIC_ASSERT( MAX_PROFILED_CALLSITES <= U16_MAX );
+
+static AllocationCallsite profiler_callsites[ MAX_PROFILED_CALLSITES ]; // 0 is unused
+static u16 profiler_callsite_slots[ MAX_PROFILED_CALLSITES * 2 ];
+static u32 profiler_num_callsites;
+static std::atomic_flag profiler_lock;
+static std::atomic< bool > profiler_enabled;
+static std::atomic< u32 > profiler_time;
+static u32 profiler_reset_time;
+
+static void LockProfiler() {
+	while( profiler_lock.test_and_set( std::memory_order_acquire ) ) {
+		continue;
+	}
+}
+
+static void UnlockProfiler() {
+	profiler_lock.clear( std::memory_order_release );
+}
+
+// func is part of the key because templates share file:line
+static u16 FindOrAddCallsite( const char * func, const char * file, int line ) {
+	u64 hash = u64( uintptr_t( func ) ) * 0x9e3779b97f4a7c15ull;
+	hash ^= u64( uintptr_t( file ) ) * 0xc2b2ae3d27d4eb4full;
+	hash ^= u64( line ) * 0x165667b19e3779f9ull;
+	hash ^= hash >> 32;
+
+	constexpr size_t mask = ARRAY_COUNT( profiler_callsite_slots ) - 1;
+	for( size_t i = 0; i < ARRAY_COUNT( profiler_callsite_slots ); i++ ) {
+		u16 * slot = &profiler_callsite_slots[ ( hash + i ) & mask ];
+		if( *slot != 0 ) {
+			const AllocationCallsite * callsite = &profiler_callsites[ *slot ];
+			if( callsite->func == func && callsite->file == file && callsite->line == line )
+				return *slot;
+			continue;
+		}
+
+		if( profiler_num_callsites + 1 == MAX_PROFILED_CALLSITES )
+			return 0;
+
+		profiler_num_callsites++;
+		*slot = u16( profiler_num_callsites );
+
+		AllocationCallsite * callsite = &profiler_callsites[ *slot ];
+		*callsite = { };
+		callsite->func = func;
+		callsite->file = file;
+		callsite->line = line;
+
+		return *slot;
+	}
+
+	return 0;
+}
+
+static void ProfileAllocation( PoolHeader * header, const char * func, const char * file, int line ) {
+	header->callsite = 0;
+	if( !profiler_enabled.load( std::memory_order_relaxed ) )
+		return;
+
+	LockProfiler();
+	defer { UnlockProfiler(); };
+
+	header->callsite = FindOrAddCallsite( func, file, line );
+	if( header->callsite == 0 )
+		return;
+
+	header->birth_ms = profiler_time.load( std::memory_order_relaxed );
+
+	AllocationCallsite * callsite = &profiler_callsites[ header->callsite ];
+	callsite->allocations++;
+	callsite->bytes += header->size;
+	callsite->live++;
+	callsite->live_bytes += header->size;
+	callsite->peak_live_bytes = Max2( callsite->peak_live_bytes, callsite->live_bytes );
+}
+
+static void ProfileFree( const PoolHeader * header ) {
+	if( header->callsite == 0 )
+		return;
+
+	LockProfiler();
+
+	AllocationCallsite * callsite = &profiler_callsites[ header->callsite ];
+	callsite->frees++;
+	callsite->lifetime_ms += profiler_time.load( std::memory_order_relaxed ) - header->birth_ms;
+	callsite->live--;
+	callsite->live_bytes -= header->size;
+
+	UnlockProfiler();
+}
+
+bool EnableAllocationProfiler( bool enable ) {
+#if defined( __SANITIZE_ADDRESS__ ) || defined( __SANITIZE_THREAD__ )
+	return !enable;
+#else
+	if( enable && !profiler_enabled.load( std::memory_order_relaxed ) ) {
+		ResetAllocationProfiler();
+	}
+	profiler_enabled.store( enable, std::memory_order_relaxed );
+	return true;
+#endif
+}
+
+bool AllocationProfilerEnabled() {
+	return profiler_enabled.load( std::memory_order_relaxed );
+}
+
+void ResetAllocationProfiler() {
+	LockProfiler();
+	defer { UnlockProfiler(); };
+
+	for( u32 i = 1; i <= profiler_num_callsites; i++ ) {
+		AllocationCallsite * callsite = &profiler_callsites[ i ];
+		callsite->allocations = 0;
+		callsite->frees = 0;
+		callsite->bytes = 0;
+		callsite->lifetime_ms = 0;
+		callsite->peak_live_bytes = callsite->live_bytes;
+	}
+
+	profiler_reset_time = profiler_time.load( std::memory_order_relaxed );
+}
+
+void SetAllocationProfilerTime( s64 ms ) {
+	profiler_time.store( u32( ms ), std::memory_order_relaxed );
+}
+
+size_t GetAllocationProfile( Span< AllocationCallsite > out, s64 * duration_ms ) {
+	LockProfiler();
+	defer { UnlockProfiler(); };
+
+	for( size_t i = 0; i < Min2( out.n, size_t( profiler_num_callsites ) ); i++ ) {
+		out[ i ] = profiler_callsites[ i + 1 ];
+	}
+
+	*duration_ms = profiler_time.load( std::memory_order_relaxed ) - profiler_reset_time;
+
+	return profiler_num_callsites;
+}
+
+struct PoolAllocator final : public Allocator {
+	AllocationTracker tracker;
+
+	void * try_allocate( size_t size, size_t alignment, const char * func, const char * file, int line ) {
+		assert( alignment <= 16 );
+
+		u32 size_class = PoolSizeClassForSize( size );
+		PoolHeader * header;
+		if( size_class == POOL_LARGE ) {
+			header = ( PoolHeader * ) malloc( sizeof( PoolHeader ) + size );
+			if( header == NULL )
+				return NULL;
+			pool_large_allocations.fetch_add( 1, std::memory_order_relaxed );
+			pool_large_bytes.fetch_add( size, std::memory_order_relaxed );
+		}
+		else {
+			header = PoolAllocateSlot( size_class );
+			if( header == NULL )
+				return NULL;
+		}
+
+		header->size = size;
+		header->size_class = size_class;
+		ProfileAllocation( header, func, file, line );
+
+		void * ptr = header + 1;
+		TracyAlloc( ptr, size );
+		tracker.track( ptr, func, file, line );
+		return ptr;
+	}
+
+	void * try_reallocate( void * ptr, size_t current_size, size_t new_size, size_t alignment, const char * func, const char * file, int line ) {
+		if( ptr == NULL )
+			return try_allocate( new_size, alignment, func, file, line );
+
+		assert( alignment <= 16 );
+
+		PoolHeader * header = ( PoolHeader * ) ptr - 1;
+		u32 new_size_class = PoolSizeClassForSize( new_size );
+
+		bool fits_in_place = header->size_class != POOL_LARGE && new_size <= pool_size_classes[ header->size_class ];
+		bool both_large = header->size_class == POOL_LARGE && new_size_class == POOL_LARGE;
+
+		if( fits_in_place || both_large ) {
+			TracyFree( ptr );
+			tracker.untrack( ptr, func, file, line );
+			ProfileFree( header );
+
+			if( both_large ) {
+				PoolHeader * new_header = ( PoolHeader * ) realloc( header, sizeof( PoolHeader ) + new_size );
+				if( new_header == NULL ) {
+					TracyAlloc( ptr, header->size );
+					tracker.track( ptr, func, file, line );
+					ProfileAllocation( header, func, file, line );
+					return NULL;
+				}
+
+				pool_large_bytes.fetch_add( new_size - new_header->size, std::memory_order_relaxed );
+				header = new_header;
+				ptr = header + 1;
+			}
+
+			header->size = new_size;
+			ProfileAllocation( header, func, file, line );
+			TracyAlloc( ptr, new_size );
+			tracker.track( ptr, func, file, line );
+			return ptr;
+		}
+
+		void * new_ptr = try_allocate( new_size, alignment, func, file, line );
+		if( new_ptr == NULL )
+			return NULL;
+
+		memcpy( new_ptr, ptr, Min2( header->size, new_size ) );
+		deallocate( ptr, func, file, line );
+
+		return new_ptr;
+	}
+
+	void deallocate( void * ptr, const char * func, const char * file, int line ) {
+		if( ptr == NULL )
+			return;
+
+		TracyFree( ptr );
+		tracker.untrack( ptr, func, file, line );
+
+		PoolHeader * header = ( PoolHeader * ) ptr - 1;
+		ProfileFree( header );
+		if( header->size_class == POOL_LARGE ) {
+			pool_large_allocations.fetch_sub( 1, std::memory_order_relaxed );
+			pool_large_bytes.fetch_sub( header->size, std::memory_order_relaxed );
+			free( header );
+		}
+		else {
+			PoolFreeSlot( header );
+		}
+	}
+};
+
+PoolAllocatorStats GetPoolAllocatorStats() {
+	PoolAllocatorStats stats = { };
+
+	for( u32 i = 0; i < POOL_LARGE; i++ ) {
+		PoolSizeClass * sc = &pool_classes[ i ];
+		LockSizeClass( sc );
+		stats.classes[ i ].size = pool_size_classes[ i ];
+		stats.classes[ i ].chunks = sc->chunks;
+		stats.classes[ i ].in_use = sc->handed_out;
+		stats.classes[ i ].peak = sc->peak_handed_out;
+		UnlockSizeClass( sc );
+	}
+
+	stats.large_allocations = pool_large_allocations.load( std::memory_order_relaxed );
+	stats.large_bytes = pool_large_bytes.load( std::memory_order_relaxed );
+
+	return stats;
+}
+
 /*
  * ArenaAllocator
  */
 
+struct ArenaBlock {
+	ArenaBlock * prev;
+	u8 * cursor;
+	u8 * top;
+	size_t size;
+};
+
+// keeps the first allocation in a block 16 byte aligned
+static constexpr size_t ArenaBlockHeaderSize = ( sizeof( ArenaBlock ) + 15 ) & ~size_t( 15 );
+
 TempAllocator::TempAllocator( const TempAllocator & other ) {
 	arena = other.arena;
 	old_cursor = other.old_cursor;
+	old_block = other.old_block;
+	old_block_cursor = other.old_block_cursor;
 	arena->num_temp_allocators++;
 }
 
 TempAllocator::~TempAllocator() {
+	arena->free_blocks( old_block );
+	if( old_block != NULL ) {
+		old_block->cursor = old_block_cursor;
+	}
+
 	arena->cursor = old_cursor;
 	arena->num_temp_allocators--;
 	ASAN_POISON_MEMORY_REGION( arena->cursor, arena->top - arena->cursor );
@@ -181,13 +660,18 @@ void * TempAllocator::try_reallocate( void * ptr, size_t current_size, size_t ne
 
 void TempAllocator::deallocate( void * ptr, const char * func, const char * file, int line ) { }
 
-ArenaAllocator::ArenaAllocator( void * mem, size_t size ) {
+ArenaAllocator::ArenaAllocator( void * mem, size_t size, Allocator * overflow_ ) {
 	ASAN_POISON_MEMORY_REGION( mem, size );
 	memory = ( u8 * ) mem;
 	top = memory + size;
 	cursor = memory;
 	cursor_max = cursor;
 	num_temp_allocators = 0;
+
+	overflow = overflow_;
+	blocks = NULL;
+	overflow_size = 0;
+	overflow_max = 0;
 }
 
 void * ArenaAllocator::try_allocate( size_t size, size_t alignment, const char * func, const char * file, int line ) {
@@ -200,35 +684,81 @@ void * ArenaAllocator::try_reallocate( void * ptr, size_t current_size, size_t n
 	return try_temp_reallocate( ptr, current_size, new_size, alignment, func, file, line );
 }
 
-void * ArenaAllocator::try_temp_allocate( size_t size, size_t alignment, const char * func, const char * file, int line ) {
-	assert( IsPowerOf2( alignment ) );
-	u8 * aligned = ( u8 * ) ( size_t( cursor + alignment - 1 ) & ~( alignment - 1 ) );
+static void * BumpAllocate( u8 ** cursor, u8 * top, size_t size, size_t alignment ) {
+	u8 * aligned = ( u8 * ) ( size_t( *cursor + alignment - 1 ) & ~( alignment - 1 ) );
 	if( aligned + size > top )
 		return NULL;
 	ASAN_UNPOISON_MEMORY_REGION( aligned, size );
-	cursor = aligned + size;
-	cursor_max = Max2( cursor, cursor_max );
+	*cursor = aligned + size;
 	return aligned;
 }
 
+void * ArenaAllocator::try_temp_allocate( size_t size, size_t alignment, const char * func, const char * file, int line ) {
+	assert( IsPowerOf2( alignment ) );
+
+	/*
+	 * once we've spilled into a block everything goes in the newest one, so
+	 * freeing works like a stack the same as it does with one block
+	 */
+	if( blocks == NULL ) {
+		void * mem = BumpAllocate( &cursor, top, size, alignment );
+		if( mem != NULL ) {
+			cursor_max = Max2( cursor, cursor_max );
+			return mem;
+		}
+	}
+	else {
+		void * mem = BumpAllocate( &blocks->cursor, blocks->top, size, alignment );
+		if( mem != NULL )
+			return mem;
+	}
+
+	if( overflow == NULL )
+		return NULL;
+
+	// double up each time so something growing a big array doesn't make
+	// a new block for every resize
+	size_t block_size = blocks == NULL ? size_t( top - memory ) : blocks->size * 2;
+	block_size = Max2( block_size, size + alignment );
+
+	ArenaBlock * block = ( ArenaBlock * ) overflow->try_allocate( ArenaBlockHeaderSize + block_size, 16, func, file, line );
+	if( block == NULL )
+		return NULL;
+
+	block->prev = blocks;
+	block->cursor = ( u8 * ) block + ArenaBlockHeaderSize;
+	block->top = block->cursor + block_size;
+	block->size = block_size;
+	blocks = block;
+
+	overflow_size += block_size;
+	overflow_max = Max2( overflow_size, overflow_max );
+
+	return BumpAllocate( &block->cursor, block->top, size, alignment );
+}
+
 void * ArenaAllocator::try_temp_reallocate( void * ptr, size_t current_size, size_t new_size, size_t alignment, const char * func, const char * file, int line ) {
 	if( ptr == NULL )
 		return try_temp_allocate( new_size, alignment, func, file, line );
 
-	if( ptr == cursor - current_size && size_t( ptr ) % alignment == 0 ) {
-		assert( size_t( ptr ) % alignment == 0 );
-		u8 * new_cursor = cursor - current_size + new_size;
-		if( new_cursor > top )
-			return NULL;
+	u8 ** current_cursor = blocks == NULL ? &cursor : &blocks->cursor;
+	u8 * current_top = blocks == NULL ? top : blocks->top;
 
-		ASAN_UNPOISON_MEMORY_REGION( ptr, new_size );
-		if( new_cursor < cursor ) {
-			ASAN_POISON_MEMORY_REGION( new_cursor, cursor - new_cursor );
+	if( ptr == *current_cursor - current_size && size_t( ptr ) % alignment == 0 ) {
+		assert( size_t( ptr ) % alignment == 0 );
+		u8 * new_cursor = *current_cursor - current_size + new_size;
+		if( new_cursor <= current_top ) {
+			ASAN_UNPOISON_MEMORY_REGION( ptr, new_size );
+			if( new_cursor < *current_cursor ) {
+				ASAN_POISON_MEMORY_REGION( new_cursor, *current_cursor - new_cursor );
+			}
+
+			*current_cursor = new_cursor;
+			if( blocks == NULL ) {
+				cursor_max = Max2( cursor, cursor_max );
+			}
+			return ptr;
 		}
-
-		cursor = new_cursor;
-		cursor_max = Max2( cursor, cursor_max );
-		return ptr;
 	}
 
 	void * mem = try_temp_allocate( new_size, alignment, func, file, line );
@@ -240,20 +770,33 @@ void * ArenaAllocator::try_temp_reallocate( void * ptr, size_t current_size, siz
 
 void ArenaAllocator::deallocate( void * ptr, const char * func, const char * file, int line ) { }
 
+void ArenaAllocator::free_blocks( ArenaBlock * keep ) {
+	while( blocks != keep ) {
+		ArenaBlock * prev = blocks->prev;
+		overflow_size -= blocks->size;
+		FREE( overflow, blocks );
+		blocks = prev;
+	}
+}
+
 TempAllocator ArenaAllocator::temp() {
 	num_temp_allocators++;
 
 	TempAllocator t;
 	t.arena = this;
 	t.old_cursor = cursor;
+	t.old_block = blocks;
+	t.old_block_cursor = blocks == NULL ? NULL : blocks->cursor;
 	return t;
 }
 
 void ArenaAllocator::clear() {
 	assert( num_temp_allocators == 0 );
+	free_blocks( NULL );
 	ASAN_POISON_MEMORY_REGION( memory, top - memory );
 	cursor = memory;
 	cursor_max = cursor;
+	overflow_max = 0;
 }
 
 void * ArenaAllocator::get_memory() {
@@ -261,8 +804,52 @@ void * ArenaAllocator::get_memory() {
 }
 
 float ArenaAllocator::max_utilisation() const {
-	return float( cursor_max - cursor ) / float( top - cursor );
+	return float( cursor_max - cursor + overflow_max ) / float( top - cursor );
+}
+
+size_t ArenaAllocator::high_water_mark() const {
+	return size_t( cursor_max - memory ) + overflow_max;
+}
+
+/*
+ * FrameArena
+ */
+
+void FrameArena::init( Allocator * a, size_t size ) {
+	allocator = a;
+	for( ArenaAllocator & arena : arenas ) {
+		arena = ArenaAllocator( ALLOC_SIZE( a, size, 16 ), size, a );
+	}
+	current = 0;
+	high_water = 0;
+}
+
+void FrameArena::shutdown() {
+	for( ArenaAllocator & arena : arenas ) {
+		arena.clear();
+		FREE( allocator, arena.get_memory() );
+	}
 }
 
+bool FrameArena::flip() {
+	size_t frame_high_water = arenas[ current ].high_water_mark();
+	bool spilled = arenas[ current ].max_utilisation() > 1.0f;
+	bool new_high_water = frame_high_water > high_water;
+	high_water = Max2( high_water, frame_high_water );
+
+	current ^= 1;
+	arenas[ current ].clear();
+
+	return spilled && new_high_water;
+}
+
+/*
+ * the sanitizers need to see each allocation individually, so they get malloc
+ */
+#if defined( __SANITIZE_ADDRESS__ ) || defined( __SANITIZE_THREAD__ )
 static SystemAllocator sys_allocator_;
+#else
+static PoolAllocator sys_allocator_;
+#endif
+
 Allocator * sys_allocator = &sys_allocator_;
@@ -2,7 +2,58 @@
 
 extern Allocator * sys_allocator;
 
+struct PoolAllocatorStats {
+	// in use and peak include slots sitting in thread caches
+	struct {
+		u32 size;
+		size_t chunks;
+		size_t in_use;
+		size_t peak;
+	} classes[ 14 ];
+
+	size_t large_allocations;
+	size_t large_bytes;
+};
+
+PoolAllocatorStats GetPoolAllocatorStats();
+
+/*
+ * the allocation profiler groups sys_allocator allocations by the callsite
+ * that ALLOC'd them. it only sees allocations made while it's running, and
+ * callsites stick around until exit so their indices stay stable across
+ * calls to GetAllocationProfile
+ */
+constexpr size_t MAX_PROFILED_CALLSITES = 4096;
+
+struct AllocationCallsite {
+	const char * func;
+	const char * file;
+	int line;
+
+	u64 allocations;
+	u64 frees;
+	u64 bytes;
+	u64 lifetime_ms; // summed over freed allocations
+
+	size_t live;
+	size_t live_bytes;
+	size_t peak_live_bytes;
+};
+
+// returns false if sys_allocator can't be profiled, e.g. under the sanitizers
+bool EnableAllocationProfiler( bool enable );
+bool AllocationProfilerEnabled();
+
+// zeroes the running totals, live allocations are still counted
+void ResetAllocationProfiler();
+
+void SetAllocationProfilerTime( s64 ms );
+
+// returns the number of callsites, which can be more than out.n. duration_ms is time since the last reset
+size_t GetAllocationProfile( Span< AllocationCallsite > out, s64 * duration_ms );
+
 struct ArenaAllocator;
+struct ArenaBlock;
 struct TempAllocator final : public Allocator {
 	TempAllocator() = default;
 	TempAllocator( const TempAllocator & other );
@@ -17,13 +68,20 @@ struct TempAllocator final : public Allocator {
 private:
 	ArenaAllocator * arena;
 	u8 * old_cursor;
+	ArenaBlock * old_block;
+	u8 * old_block_cursor;
 
 	friend struct ArenaAllocator;
 };
 
+/*
+ * if you give it an overflow allocator, running out of space gets you a new
+ * block from that instead of NULL. blocks are freed when the TempAllocator
+ * that was live when they got allocated goes away, or on clear()
+ */
 struct ArenaAllocator final : public Allocator {
 	ArenaAllocator() = default;
-	ArenaAllocator( void * mem, size_t size );
+	ArenaAllocator( void * mem, size_t size, Allocator * overflow = NULL );
 
 	void * try_allocate( size_t size, size_t alignment, const char * func, const char * file, int line );
 	void * try_reallocate( void * ptr, size_t current_size, size_t new_size, size_t alignment, const char * func, const char * file, int line );
@@ -34,22 +92,59 @@ struct ArenaAllocator final : public Allocator {
 	void clear();
 	void * get_memory();
 
+	// goes over 1 if it had to grow
 	float max_utilisation() const;
 
+	// most bytes in use at once since the last clear(), including overflow blocks
+	size_t high_water_mark() const;
+
 private:
 	u8 * memory;
 	u8 * top;
 	u8 * cursor;
 	u8 * cursor_max;
 
+	Allocator * overflow;
+	ArenaBlock * blocks;
+	size_t overflow_size;
+	size_t overflow_max;
+
 	u32 num_temp_allocators;
 
 	void * try_temp_allocate( size_t size, size_t alignment, const char * func, const char * file, int line );
 	void * try_temp_reallocate( void * ptr, size_t current_size, size_t new_size, size_t alignment, const char * func, const char * file, int line );
+	void free_blocks( ArenaBlock * keep );
 
 	friend struct TempAllocator;
 };
 
+/*
+ * a pair of arenas that swap every frame, so allocations stay good until the
+ * end of the frame after the one that made them. that lets a frame hand data
+ * to the next one without copying. running out of space spills into the
+ * allocator the arena was made with instead of failing
+ */
+struct FrameArena {
+	void init( Allocator * a, size_t size );
+	void shutdown();
+
+	// frees the older frame's allocations and makes it current. returns
+	// true if the frame that just ended spilled and set a new high water mark
+	bool flip();
+
+	TempAllocator temp() { return arenas[ current ].temp(); }
+	ArenaAllocator * previous_frame() { return &arenas[ current ^ 1 ]; }
+
+	float max_utilisation() const { return arenas[ current ].max_utilisation(); }
+	size_t high_water_mark() const { return high_water; }
+
+private:
+	Allocator * allocator;
+	ArenaAllocator arenas[ 2 ];
+	size_t current;
+	size_t high_water;
+};
+
 template< typename... Rest >
 char * Allocator::operator()( const char * fmt, const Rest & ... rest ) {
 	size_t len = ggformat( NULL, 0, fmt, rest... );
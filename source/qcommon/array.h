@@ -1,5 +1,7 @@
 #pragma once
 
+#include <type_traits>
+
 #include "qcommon/types.h"
 #include "qcommon/asan.h"
 
@@ -9,6 +11,16 @@ class NonRAIIDynamicArray {
 	size_t n;
 	size_t capacity;
 	T * elems;
+	bool owns_elems; // false while elems is SmallDynamicArray's inline buffer
+
+protected:
+	void init_inline( Allocator * a_, T * buf, size_t buf_capacity ) {
+		a = a_;
+		capacity = buf_capacity;
+		elems = buf;
+		owns_elems = false;
+		clear();
+	}
 
 public:
 	virtual ~NonRAIIDynamicArray() = default;
@@ -17,11 +29,18 @@ public:
 		a = a_;
 		capacity = initial_capacity;
 		elems = capacity == 0 ? NULL : ALLOC_MANY( a, T, capacity );
+		owns_elems = true;
 		clear();
 	}
 
 	void shutdown() {
-		FREE( a, elems );
+		if( owns_elems ) {
+			FREE( a, elems );
+		}
+		else {
+			// it's going back on the stack
+			ASAN_UNPOISON_MEMORY_REGION( elems, capacity * sizeof( T ) );
+		}
 	}
 
 	size_t add( const T & x ) {
@@ -30,10 +49,29 @@ public:
 		return idx;
 	}
 
+	// appends with one memcpy, returns the index of the first new element
+	size_t append( Span< const T > xs ) {
+		STATIC_ASSERT( std::is_trivially_copyable< T >::value );
+		size_t idx = extend( xs.n );
+		if( xs.n > 0 ) {
+			memcpy( elems + idx, xs.ptr, xs.num_bytes() );
+		}
+		return idx;
+	}
+
 	void clear() {
 		resize( 0 );
 	}
 
+	void reserve( size_t new_capacity ) {
+		if( new_capacity > capacity ) {
+			grow( new_capacity );
+			ASAN_UNPOISON_MEMORY_REGION( elems, n * sizeof( T ) );
+			ASAN_POISON_MEMORY_REGION( elems + n, ( capacity - n ) * sizeof( T ) );
+		}
+	}
+
+	// doesn't initialise anything, so new elements are garbage
 	void resize( size_t new_size ) {
 		if( new_size < n ) {
 			n = new_size;
@@ -51,8 +89,7 @@ public:
 		while( new_capacity < new_size )
 			new_capacity *= 2;
 
-		elems = REALLOC_MANY( a, T, elems, capacity, new_capacity );
-		capacity = new_capacity;
+		grow( new_capacity );
 		n = new_size;
 
 		ASAN_UNPOISON_MEMORY_REGION( elems, n * sizeof( T ) );
@@ -97,6 +134,21 @@ public:
 
 	Span< T > span() { return Span< T >( elems, n ); }
 	Span< const T > span() const { return Span< const T >( elems, n ); }
+
+private:
+	void grow( size_t new_capacity ) {
+		if( owns_elems ) {
+			elems = REALLOC_MANY( a, T, elems, capacity, new_capacity );
+		}
+		else {
+			T * new_elems = ALLOC_MANY( a, T, new_capacity );
+			ASAN_UNPOISON_MEMORY_REGION( elems, capacity * sizeof( T ) );
+			memcpy( new_elems, elems, n * sizeof( T ) );
+			elems = new_elems;
+			owns_elems = true;
+		}
+		capacity = new_capacity;
+	}
 };
 
 template< typename T >
@@ -116,3 +168,27 @@ public:
 		shutdown();
 	}
 };
+
+/*
+ * a DynamicArray that starts out with room for N elements inside itself, so
+ * short lists never touch the allocator
+ */
+template< typename T, size_t N >
+class SmallDynamicArray : public NonRAIIDynamicArray< T > {
+	using NonRAIIDynamicArray< T >::init;
+	using NonRAIIDynamicArray< T >::init_inline;
+	using NonRAIIDynamicArray< T >::shutdown;
+
+	alignas( T ) u8 storage[ N * sizeof( T ) ];
+
+public:
+	NONCOPYABLE( SmallDynamicArray );
+
+	SmallDynamicArray( Allocator * a_ ) {
+		init_inline( a_, ( T * ) storage, N );
+	}
+
+	~SmallDynamicArray() {
+		shutdown();
+	}
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * base.pak is everything under base/ packed into one file, so startup is one
+ * mmap instead of thousands of opens and reads:
+ *
+ *   AssetArchiveHeader
+ *   AssetArchiveEntry[ num_entries ], sorted by hash
+ *   null terminated paths
+ *   data, each blob starting on an ASSET_ARCHIVE_ALIGNMENT boundary
+ *
+ * hashes are Hash64 of the path with any .zst stripped off, same as the keys
+ * AssetBinary uses. stored blobs are followed by a null terminator that isn't
+ * counted in size, so AssetString can hand them out straight from the
+ * mapping. zstd blobs are the .zst files from base/ copied in as is
+ *
+ * version 1 archives hashed paths with fnv1a. they still load, the paths get
+ * rehashed on load, but get repacked when you can
+ */
+
+constexpr u32 ASSET_ARCHIVE_MAGIC = 0x4B415046; // FPAK
+constexpr u32 ASSET_ARCHIVE_VERSION = 2;
+constexpr u64 ASSET_ARCHIVE_ALIGNMENT = 16;
+
+enum AssetArchiveEncoding : u32 {
+	AssetArchiveEncoding_Stored,
+	AssetArchiveEncoding_Zstd,
+};
+
+struct AssetArchiveHeader {
+	u32 magic;
+	u32 version;
+	u64 num_entries;
+};
+
+struct AssetArchiveEntry {
+	u64 hash;
+	u64 path_offset;
+	u64 data_offset;
+	u64 data_size; // bytes in the archive
+	u64 size; // bytes once decoded
+	u32 encoding;
+	u32 padding;
+};
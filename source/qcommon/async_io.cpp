@@ -0,0 +1,251 @@
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/async_io.h"
+#include "qcommon/fs.h"
+#include "qcommon/threads.h"
+#include "qcommon/zone_sampler.h"
+
+/*
+ * everything goes through one ring. [completed, done) have finished and are
+ * waiting for their callbacks on the main thread, and [done, tail) are
+ * waiting for the I/O thread. only the I/O thread touches the request at
+ * done, and only the main thread moves completed and tail
+ *
+ * this is a plain blocking thread on every platform rather than io_uring or
+ * IOCP. the requests are whole files or big sequential chunks, so one thread
+ * doing them in order keeps up fine and we get one code path
+ */
+
+enum AsyncIOType {
+	AsyncIO_ReadFile,
+	AsyncIO_WriteFile,
+	AsyncIO_FSRead,
+	AsyncIO_FSWrite,
+};
+
+struct AsyncIORequest {
+	AsyncIOType type;
+	char * path;
+	int fs_file;
+	Span< u8 > data;
+
+	void * user;
+	AsyncReadFileCallback read_file_callback;
+	AsyncWriteFileCallback write_file_callback;
+	AsyncFSReadCallback fs_read_callback;
+
+	// results
+	char * contents;
+	size_t len;
+	int bytes_read;
+	bool ok;
+};
+
+static AsyncIORequest requests[ 1024 ];
+static u64 completed;
+static u64 done;
+static u64 tail;
+
+static Mutex * mutex;
+static Semaphore * work_sem;
+static Semaphore * flush_sem;
+static bool flushing;
+static bool shutting_down;
+
+static Thread * io_thread;
+static ArenaAllocator io_arena;
+
+static void RunRequest( AsyncIORequest * req ) {
+	ZoneScoped;
+	if( req->path != NULL ) {
+		ZoneText( req->path, strlen( req->path ) );
+	}
+
+	switch( req->type ) {
+		case AsyncIO_ReadFile:
+			req->contents = ReadFileString( sys_allocator, req->path, &req->len );
+			req->ok = req->contents != NULL;
+			break;
+
+		case AsyncIO_WriteFile: {
+			// write next to it and rename over it so nobody ever sees half a file
+			TempAllocator temp = io_arena.temp();
+			const char * tmp_path = temp( "{}.tmp", req->path );
+			req->ok = WriteFile( &temp, tmp_path, req->data.ptr, req->data.n ) && MoveFile( &temp, tmp_path, req->path, MoveFile_DoReplace );
+			if( !req->ok ) {
+				RemoveFile( &temp, tmp_path );
+			}
+			FREE( sys_allocator, req->data.ptr );
+		} break;
+
+		case AsyncIO_FSRead:
+			req->bytes_read = FS_Read( req->data.ptr, req->data.n, req->fs_file );
+			req->ok = req->bytes_read >= 0;
+			break;
+
+		case AsyncIO_FSWrite:
+			req->ok = FS_Write( req->data.ptr, req->data.n, req->fs_file ) == int( req->data.n );
+			FREE( sys_allocator, req->data.ptr );
+			break;
+	}
+}
+
+static void AsyncIOThread( void * data ) {
+#if TRACY_ENABLE
+	tracy::SetThreadName( "Async I/O" );
+#endif
+
+	while( true ) {
+		Wait( work_sem );
+		if( shutting_down )
+			break;
+
+		RunRequest( &requests[ done % ARRAY_COUNT( requests ) ] );
+
+		Lock( mutex );
+		done++;
+		if( flushing && done == tail ) {
+			flushing = false;
+			Signal( flush_sem );
+		}
+		Unlock( mutex );
+	}
+}
+
+void InitAsyncIO() {
+	completed = 0;
+	done = 0;
+	tail = 0;
+	flushing = false;
+	shutting_down = false;
+
+	mutex = NewMutex();
+	work_sem = NewSemaphore();
+	flush_sem = NewSemaphore();
+
+	constexpr size_t arena_size = 64 * 1024; // 64KB
+	io_arena = ArenaAllocator( ALLOC_SIZE( sys_allocator, arena_size, 16 ), arena_size, sys_allocator );
+
+	io_thread = NewThread( AsyncIOThread );
+}
+
+void ShutdownAsyncIO() {
+	AsyncIOFlush();
+
+	shutting_down = true;
+	Signal( work_sem );
+	JoinThread( io_thread );
+
+	FREE( sys_allocator, io_arena.get_memory() );
+
+	DeleteSemaphore( flush_sem );
+	DeleteSemaphore( work_sem );
+	DeleteMutex( mutex );
+}
+
+static void RunCallback( AsyncIORequest * req ) {
+	switch( req->type ) {
+		case AsyncIO_ReadFile:
+			req->read_file_callback( req->user, req->path, req->contents, req->len );
+			break;
+
+		case AsyncIO_WriteFile:
+			if( req->write_file_callback != NULL ) {
+				req->write_file_callback( req->user, req->path, req->ok );
+			}
+			break;
+
+		case AsyncIO_FSRead:
+			req->fs_read_callback( req->user, req->bytes_read );
+			break;
+
+		case AsyncIO_FSWrite:
+			if( !req->ok ) {
+				Com_Printf( S_COLOR_RED "Async write failed\n" );
+			}
+			break;
+	}
+
+	FREE( sys_allocator, req->path );
+}
+
+void AsyncIOFrame() {
+	ZoneScopedSampled( "AsyncIOFrame" );
+
+	Lock( mutex );
+	u64 finished = done;
+	Unlock( mutex );
+
+	// callbacks can make new requests, which only ever touch tail
+	while( completed < finished ) {
+		RunCallback( &requests[ completed % ARRAY_COUNT( requests ) ] );
+		completed++;
+	}
+}
+
+void AsyncIOFlush() {
+	ZoneScoped;
+
+	Lock( mutex );
+	bool wait = done != tail;
+	flushing = wait;
+	Unlock( mutex );
+
+	if( wait ) {
+		Wait( flush_sem );
+	}
+
+	AsyncIOFrame();
+}
+
+static AsyncIORequest * NewRequest( AsyncIOType type ) {
+	if( tail - completed == ARRAY_COUNT( requests ) ) {
+		AsyncIOFlush();
+	}
+
+	AsyncIORequest * req = &requests[ tail % ARRAY_COUNT( requests ) ];
+	*req = { };
+	req->type = type;
+	return req;
+}
+
+static void SubmitRequest() {
+	Lock( mutex );
+	tail++;
+	Unlock( mutex );
+
+	Signal( work_sem );
+}
+
+void AsyncReadFile( const char * path, AsyncReadFileCallback callback, void * user ) {
+	AsyncIORequest * req = NewRequest( AsyncIO_ReadFile );
+	req->path = CopyString( sys_allocator, path );
+	req->read_file_callback = callback;
+	req->user = user;
+	SubmitRequest();
+}
+
+void AsyncWriteFile( const char * path, Span< u8 > data, AsyncWriteFileCallback callback, void * user ) {
+	AsyncIORequest * req = NewRequest( AsyncIO_WriteFile );
+	req->path = CopyString( sys_allocator, path );
+	req->data = data;
+	req->write_file_callback = callback;
+	req->user = user;
+	SubmitRequest();
+}
+
+void AsyncFSRead( int file, Span< u8 > buffer, AsyncFSReadCallback callback, void * user ) {
+	AsyncIORequest * req = NewRequest( AsyncIO_FSRead );
+	req->fs_file = file;
+	req->data = buffer;
+	req->fs_read_callback = callback;
+	req->user = user;
+	SubmitRequest();
+}
+
+void AsyncFSWrite( int file, Span< u8 > data ) {
+	AsyncIORequest * req = NewRequest( AsyncIO_FSWrite );
+	req->fs_file = file;
+	req->data = data;
+	SubmitRequest();
+}
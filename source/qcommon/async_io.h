@@ -0,0 +1,38 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * file I/O that runs on its own thread so the main thread never waits on
+ * the disk. requests run one at a time in the order they were made, and
+ * their callbacks run on the main thread from AsyncIOFrame/AsyncIOFlush, so
+ * they can touch whatever they like. only make requests from the main thread
+ */
+
+void InitAsyncIO();
+void ShutdownAsyncIO(); // finishes everything first
+
+// runs the callbacks of anything that finished, call it once a frame
+void AsyncIOFrame();
+
+// waits for everything in flight and runs the callbacks
+void AsyncIOFlush();
+
+// contents is NULL if it failed, otherwise null terminated and yours to FREE from sys_allocator
+using AsyncReadFileCallback = void ( * )( void * user, const char * path, char * contents, size_t len );
+using AsyncWriteFileCallback = void ( * )( void * user, const char * path, bool ok );
+
+void AsyncReadFile( const char * path, AsyncReadFileCallback callback, void * user = NULL );
+
+// takes ownership of data, which has to come from sys_allocator. it writes
+// to path.tmp and renames that over path, so path is never half written
+void AsyncWriteFile( const char * path, Span< u8 > data, AsyncWriteFileCallback callback = NULL, void * user = NULL );
+
+/*
+ * the same for FS_* handles, e.g. demos. don't touch the handle yourself
+ * while it has requests in flight, flush first
+ */
+using AsyncFSReadCallback = void ( * )( void * user, int bytes_read );
+
+void AsyncFSRead( int file, Span< u8 > buffer, AsyncFSReadCallback callback, void * user = NULL );
+void AsyncFSWrite( int file, Span< u8 > data ); // takes ownership like AsyncWriteFile
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pmmintrin.h>
 
 #include "qcommon/platform.h"
 #include "qcommon/types.h"
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string.h>
+#include <emmintrin.h>
+
+#if COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+#include "qcommon/types.h"
+
+/*
+ * bit sets stored as u64s so we can skip over empty words and find set bits
+ * with a count trailing zeroes instead of testing them one at a time
+ *
+ * bit i lives in word i / 64, so on little endian the layout is the same as
+ * the byte arrays with bit i in byte i / 8 we use elsewhere
+ */
+
+constexpr size_t BitSetWords( size_t bits ) {
+	return ( bits + 63 ) / 64;
+}
+
+inline u32 LowestSetBit( u64 x ) {
+#if COMPILER_MSVC
+	unsigned long i;
+	_BitScanForward64( &i, x );
+	return i;
+#else
+	return __builtin_ctzll( x );
+#endif
+}
+
+inline bool TestBit( const u64 * words, size_t i ) {
+	return ( words[ i / 64 ] & ( u64( 1 ) << ( i % 64 ) ) ) != 0;
+}
+
+inline void SetBit( u64 * words, size_t i ) {
+	words[ i / 64 ] |= u64( 1 ) << ( i % 64 );
+}
+
+// returns whether the bit was already set
+inline bool TestAndSetBit( u64 * words, size_t i ) {
+	u64 bit = u64( 1 ) << ( i % 64 );
+	bool was_set = ( words[ i / 64 ] & bit ) != 0;
+	words[ i / 64 ] |= bit;
+	return was_set;
+}
+
+inline void OrBits( u64 * dst, const u64 * src, size_t num_words ) {
+	size_t i = 0;
+	for( ; i + 2 <= num_words; i += 2 ) {
+		__m128i a = _mm_loadu_si128( ( const __m128i * ) ( dst + i ) );
+		__m128i b = _mm_loadu_si128( ( const __m128i * ) ( src + i ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst + i ), _mm_or_si128( a, b ) );
+	}
+	for( ; i < num_words; i++ ) {
+		dst[ i ] |= src[ i ];
+	}
+}
+
+// calls f with the index of every set bit in ascending order
+template< typename F >
+void ForEachSetBit( const u64 * words, size_t num_words, F f ) {
+	for( size_t i = 0; i < num_words; i++ ) {
+		u64 word = words[ i ];
+		while( word != 0 ) {
+			f( i * 64 + LowestSetBit( word ) );
+			word &= word - 1;
+		}
+	}
+}
+
+template< size_t N >
+struct BitSet {
+	u64 words[ BitSetWords( N ) ];
+
+	void clear() {
+		memset( words, 0, sizeof( words ) );
+	}
+
+	bool test( size_t i ) const {
+		assert( i < N );
+		return TestBit( words, i );
+	}
+
+	void set( size_t i ) {
+		assert( i < N );
+		SetBit( words, i );
+	}
+
+	bool test_and_set( size_t i ) {
+		assert( i < N );
+		return TestAndSetBit( words, i );
+	}
+
+	void operator|=( const BitSet & other ) {
+		OrBits( words, other.words, BitSetWords( N ) );
+	}
+
+	template< typename F >
+	void for_each( F f ) const {
+		ForEachSetBit( words, BitSetWords( N ), f );
+	}
+};
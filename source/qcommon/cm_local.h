@@ -29,5 +29,12 @@ void    CM_InitBoxHull( CollisionModel *cms );
 void    CM_InitOctagonHull( CollisionModel *cms );
 
 void    CM_FloodAreaConnections( CollisionModel *cms );
+void    CM_BuildFatPVS( CollisionModel *cms );
 
-void CM_LoadQ3BrushModel( CModelServerOrClient soc, CollisionModel * cms, Span< const u8 > data );
+constexpr size_t CM_BrushPlanesFloats( int numsides ) {
+	return AlignPow2( size_t( numsides ), size_t( 4 ) ) * 4;
+}
+
+void CM_BuildBrushPlanes( cbrush_t * brush, float * planes );
+
+void CM_LoadQ3BrushModel( CollisionModel * cms, Span< const u8 > data );
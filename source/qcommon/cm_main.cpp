@@ -18,9 +18,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <emmintrin.h>
+
 #include "qcommon/qcommon.h"
 #include "qcommon/cm_local.h"
+#include "qcommon/bitset.h"
 #include "qcommon/hashmap.h"
+#include "qcommon/load_profile.h"
 #include "qcommon/string.h"
 
 static Hashmap< cmodel_t, 4096 > client_cmodels;
@@ -34,6 +38,8 @@ static void CM_AllocateCheckCounts( CollisionModel *cms ) {
 	cms->checkcount = 0;
 	cms->map_brush_checkcheckouts = ALLOC_MANY( sys_allocator, int, cms->numbrushes );
 	cms->map_face_checkcheckouts = ALLOC_MANY( sys_allocator, int, cms->numfaces );
+	memset( cms->map_brush_checkcheckouts, 0, cms->numbrushes * sizeof( int ) );
+	memset( cms->map_face_checkcheckouts, 0, cms->numfaces * sizeof( int ) );
 }
 
 static void CM_FreeCheckCounts( CollisionModel *cms ) {
@@ -51,6 +57,67 @@ static void CM_FreeCheckCounts( CollisionModel *cms ) {
 }
 
 static void CM_Clear( CModelServerOrClient soc, CollisionModel * cms ) {
+	bool last_reference = true;
+	if( cms->refcount != NULL ) {
+		( *cms->refcount )--;
+		last_reference = *cms->refcount == 0;
+		if( last_reference ) {
+			FREE( sys_allocator, cms->refcount );
+		}
+		cms->refcount = NULL;
+	}
+
+	for( u32 i = 0; i < cms->num_models; i++ ) {
+		if( cms->unregistered_cmodels != NULL ) {
+			FREE( sys_allocator, cms->unregistered_cmodels[ i ].markfaces );
+			FREE( sys_allocator, cms->unregistered_cmodels[ i ].markbrushes );
+			continue;
+		}
+
+		String< 16 > suffix( "*{}", i );
+		u64 hash = Hash64( suffix.c_str(), suffix.length(), cms->base_hash );
+		cmodel_t * model = GetCModels( soc )->get( hash );
+
+		if( last_reference ) {
+			FREE( sys_allocator, model->markfaces );
+			FREE( sys_allocator, model->markbrushes );
+		}
+
+		bool ok = GetCModels( soc )->remove( hash );
+		assert( ok );
+	}
+
+	if( cms->unregistered_cmodels != NULL ) {
+		FREE( sys_allocator, cms->unregistered_cmodels );
+		cms->unregistered_cmodels = NULL;
+	}
+
+	if( cms->map_areas != &cms->map_area_empty ) {
+		FREE( sys_allocator, cms->map_areas );
+		cms->map_areas = &cms->map_area_empty;
+		cms->numareas = 0;
+	}
+
+	if( cms->map_areaportals ) {
+		FREE( sys_allocator, cms->map_areaportals );
+		cms->map_areaportals = NULL;
+	}
+
+	if( cms->map_areabits ) {
+		FREE( sys_allocator, cms->map_areabits );
+		cms->map_areabits = NULL;
+	}
+
+	if( cms->map_pvs_cache_rows ) {
+		FREE( sys_allocator, cms->map_pvs_cache_rows );
+		cms->map_pvs_cache_rows = NULL;
+	}
+
+	CM_FreeCheckCounts( cms );
+
+	if( !last_reference )
+		return;
+
 	if( cms->map_shaderrefs ) {
 		FREE( sys_allocator, cms->map_shaderrefs[0].name );
 		FREE( sys_allocator, cms->map_shaderrefs );
@@ -59,26 +126,20 @@ static void CM_Clear( CModelServerOrClient soc, CollisionModel * cms ) {
 	}
 
 	if( cms->map_faces ) {
-		for( int i = 0; i < cms->numfaces; i++ ) {
-			FREE( sys_allocator, cms->map_faces[i].facets );
+		if( cms->map_baked_facets != NULL ) {
+			FREE( sys_allocator, cms->map_baked_facets );
+			cms->map_baked_facets = NULL;
+		}
+		else {
+			for( int i = 0; i < cms->numfaces; i++ ) {
+				FREE( sys_allocator, cms->map_faces[i].facets );
+			}
 		}
 		FREE( sys_allocator, cms->map_faces );
 		cms->map_faces = NULL;
 		cms->numfaces = 0;
 	}
 
-	for( u32 i = 0; i < cms->num_models; i++ ) {
-		String< 16 > suffix( "*{}", i );
-		u64 hash = Hash64( suffix.c_str(), suffix.length(), cms->base_hash );
-		cmodel_t * model = GetCModels( soc )->get( hash );
-
-		FREE( sys_allocator, model->markfaces );
-		FREE( sys_allocator, model->markbrushes );
-
-		bool ok = GetCModels( soc )->remove( hash );
-		assert( ok );
-	}
-
 	if( cms->map_nodes ) {
 		FREE( sys_allocator, cms->map_nodes );
 		cms->map_nodes = NULL;
@@ -97,17 +158,6 @@ static void CM_Clear( CModelServerOrClient soc, CollisionModel * cms ) {
 		cms->numleafs = 0;
 	}
 
-	if( cms->map_areas != &cms->map_area_empty ) {
-		FREE( sys_allocator, cms->map_areas );
-		cms->map_areas = &cms->map_area_empty;
-		cms->numareas = 0;
-	}
-
-	if( cms->map_areaportals ) {
-		FREE( sys_allocator, cms->map_areaportals );
-		cms->map_areaportals = NULL;
-	}
-
 	if( cms->map_planes ) {
 		FREE( sys_allocator, cms->map_planes );
 		cms->map_planes = NULL;
@@ -132,9 +182,35 @@ static void CM_Clear( CModelServerOrClient soc, CollisionModel * cms ) {
 		cms->numbrushes = 0;
 	}
 
-	if( cms->map_pvs ) {
-		FREE( sys_allocator, cms->map_pvs );
-		cms->map_pvs = NULL;
+	if( cms->map_bvh_nodes ) {
+		FREE( sys_allocator, cms->map_bvh_nodes );
+		FREE( sys_allocator, cms->map_bvh_items );
+		FREE( sys_allocator, cms->map_bvh_item_bounds );
+		cms->map_bvh_nodes = NULL;
+		cms->map_bvh_items = NULL;
+		cms->map_bvh_item_bounds = NULL;
+	}
+
+	if( cms->map_brush_planes ) {
+		FREE( sys_allocator, cms->map_brush_planes );
+		cms->map_brush_planes = NULL;
+	}
+
+	if( cms->map_pvs_rle ) {
+		FREE( sys_allocator, cms->map_pvs_rle );
+		FREE( sys_allocator, cms->map_pvs_rle_offsets );
+		cms->map_pvs_rle = NULL;
+		cms->map_pvs_rle_offsets = NULL;
+		cms->map_numclusters = 0;
+		cms->map_pvs_rowsize = 0;
+	}
+
+	if( cms->map_fatpvs ) {
+		FREE( sys_allocator, cms->map_fatpvs );
+		FREE( sys_allocator, cms->map_cluster_fatpvs );
+		cms->map_fatpvs = NULL;
+		cms->map_cluster_fatpvs = NULL;
+		cms->num_fatpvs_rows = 0;
 	}
 
 	if( cms->map_entitystring != &cms->map_entitystring_empty ) {
@@ -142,8 +218,6 @@ static void CM_Clear( CModelServerOrClient soc, CollisionModel * cms ) {
 		cms->map_entitystring = &cms->map_entitystring_empty;
 	}
 
-	CM_FreeCheckCounts( cms );
-
 	ClearBounds( &cms->world_mins, &cms->world_maxs );
 }
 
@@ -155,11 +229,29 @@ MAP LOADING
 ===============================================================================
 */
 
+static void CM_AllocateAreas( CollisionModel * cms ) {
+	cms->map_areas = ALLOC_MANY( sys_allocator, carea_t, cms->numareas );
+	cms->map_areaportals = ALLOC_MANY( sys_allocator, int, cms->numareas * cms->numareas );
+	cms->map_areabits = ALLOC_MANY( sys_allocator, u64, cms->numareas * BitSetWords( cms->numareas ) );
+
+	memset( cms->map_areaportals, 0, cms->numareas * cms->numareas * sizeof( *cms->map_areaportals ) );
+	CM_FloodAreaConnections( cms );
+}
+
 /*
 * CM_LoadMap
 * Loads in the map and all submodels
 */
 CollisionModel * CM_LoadMap( CModelServerOrClient soc, Span< const u8 > data, u64 base_hash ) {
+	LoadProfileScoped( "CM_LoadMap" );
+	LoadProfileAddBytes( data.n );
+
+	CollisionModel * cms = CM_ParseMap( data, base_hash );
+	CM_RegisterMap( soc, cms );
+	return cms;
+}
+
+CollisionModel * CM_ParseMap( Span< const u8 > data, u64 base_hash ) {
 	ZoneScoped;
 
 	CollisionModel * cms = ALLOC( sys_allocator, CollisionModel );
@@ -172,25 +264,84 @@ CollisionModel * CM_LoadMap( CModelServerOrClient soc, Span< const u8 > data, u6
 
 	CM_InitBoxHull( cms );
 	CM_InitOctagonHull( cms );
-	CM_Clear( soc, cms );
+	CM_Clear( CM_Server, cms ); // there are no submodels yet so it doesn't matter whose
 
-	CM_LoadQ3BrushModel( soc, cms, data );
+	CM_LoadQ3BrushModel( cms, data );
 
-	if( cms->numareas ) {
-		cms->map_areas = ALLOC_MANY( sys_allocator, carea_t, cms->numareas );
-		cms->map_areaportals = ALLOC_MANY( sys_allocator, int, cms->numareas * cms->numareas );
+	cms->refcount = ALLOC( sys_allocator, int );
+	*cms->refcount = 1;
 
-		memset( cms->map_areaportals, 0, cms->numareas * cms->numareas * sizeof( *cms->map_areaportals ) );
-		CM_FloodAreaConnections( cms );
+	if( cms->numareas ) {
+		CM_AllocateAreas( cms );
 	}
 
 	CM_AllocateCheckCounts( cms );
 
 	memset( cms->nullrow, 255, MAX_CM_LEAFS / 8 );
 
+	CM_BuildFatPVS( cms );
+
 	return cms;
 }
 
+void CM_RegisterMap( CModelServerOrClient soc, CollisionModel * cms ) {
+	assert( cms->unregistered_cmodels != NULL );
+
+	for( u32 i = 0; i < cms->num_models; i++ ) {
+		*CM_NewCModel( soc, cms->unregistered_cmodels[ i ].hash ) = cms->unregistered_cmodels[ i ];
+	}
+
+	FREE( sys_allocator, cms->unregistered_cmodels );
+	cms->unregistered_cmodels = NULL;
+}
+
+CollisionModel * CM_ShareMap( CModelServerOrClient soc, CModelServerOrClient from, const CollisionModel * cms ) {
+	ZoneScoped;
+
+	CollisionModel * shared = ALLOC( sys_allocator, CollisionModel );
+	*shared = *cms;
+
+	( *shared->refcount )++;
+
+	// pointers to cms's own members have to point at ours
+	if( cms->map_leafs == &cms->map_leaf_empty ) {
+		shared->map_leafs = &shared->map_leaf_empty;
+	}
+	if( cms->map_entitystring == &cms->map_entitystring_empty ) {
+		shared->map_entitystring = &shared->map_entitystring_empty;
+	}
+
+	CM_InitBoxHull( shared );
+	CM_InitOctagonHull( shared );
+
+	shared->map_areas = &shared->map_area_empty;
+	shared->map_areaportals = NULL;
+	shared->map_areabits = NULL;
+	if( shared->numareas ) {
+		CM_AllocateAreas( shared );
+	}
+
+	if( cms->map_pvs_cache_rows != NULL ) {
+		size_t stride = ( shared->map_pvs_rowsize + 15 ) & ~15;
+		shared->map_pvs_cache_rows = ( uint8_t * ) ALLOC_SIZE( sys_allocator, Max2( PVS_CACHE_ROWS * stride, size_t( 16 ) ), 16 );
+		for( int i = 0; i < PVS_CACHE_ROWS; i++ ) {
+			shared->map_pvs_cache_clusters[i] = -1;
+			shared->map_pvs_cache_used[i] = 0;
+		}
+		shared->map_pvs_cache_clock = 0;
+	}
+
+	CM_AllocateCheckCounts( shared );
+
+	for( u32 i = 0; i < shared->num_models; i++ ) {
+		String< 16 > suffix( "*{}", i );
+		u64 hash = Hash64( suffix.c_str(), suffix.length(), shared->base_hash );
+		*CM_NewCModel( soc, hash ) = *CM_FindCModel( from, StringHash( hash ) );
+	}
+
+	return shared;
+}
+
 void CM_Free( CModelServerOrClient soc, CollisionModel * cms ) {
 	CM_Clear( soc, cms );
 	FREE( sys_allocator, cms );
@@ -226,6 +377,35 @@ void CM_InlineModelBounds( const CollisionModel *cms, const cmodel_t *cmodel, Ve
 	}
 }
 
+/*
+* CM_InlineModelBox
+*
+* Returns true if the model is a single axial brush, in which case an
+* untransformed box is touching it exactly when it overlaps *box
+*/
+bool CM_InlineModelBox( const CollisionModel *cms, const cmodel_t *cmodel, MinMax3 * box ) {
+	if( cmodel->builtin || cmodel->hash == cms->world_hash || cmodel->nummarkbrushes != 1 || cmodel->nummarkfaces != 0 ) {
+		return false;
+	}
+
+	const cbrush_t * brush = &cmodel->brushes[ cmodel->markbrushes[ 0 ] ];
+	if( brush->numsides != 6 || brush->contents == 0 ) {
+		return false;
+	}
+
+	// CM_BoundBrush takes the bounds from the first six sides
+	for( int i = 0; i < brush->numsides; i++ ) {
+		Vec3 normal = brush->brushsides[ i ].plane.normal;
+		int nonzero = ( normal.x != 0.0f ) + ( normal.y != 0.0f ) + ( normal.z != 0.0f );
+		if( nonzero != 1 ) {
+			return false;
+		}
+	}
+
+	*box = MinMax3( brush->mins, brush->maxs );
+	return true;
+}
+
 size_t CM_EntityStringLen( const CollisionModel * cms ) {
 	return cms->numentitychars;
 }
@@ -257,33 +437,101 @@ PVS
 */
 
 int CM_ClusterRowSize( const CollisionModel *cms ) {
-	return cms->map_pvs ? cms->map_pvs->rowsize : MAX_CM_LEAFS / 8;
+	return cms->map_pvs_rle ? cms->map_pvs_rowsize : MAX_CM_LEAFS / 8;
 }
 
 static int CM_ClusterRowLongs( const CollisionModel *cms ) {
-	return cms->map_pvs ? ( cms->map_pvs->rowsize + 3 ) / 4 : MAX_CM_LEAFS / 32;
+	return cms->map_pvs_rle ? ( cms->map_pvs_rowsize + 3 ) / 4 : MAX_CM_LEAFS / 32;
 }
 
 int CM_NumClusters( const CollisionModel *cms ) {
-	return cms->map_pvs ? cms->map_pvs->numclusters : 0;
+	return cms->map_pvs_rle ? cms->map_numclusters : 0;
 }
 
-static inline const uint8_t *CM_ClusterPVS( const CollisionModel *cms, int cluster ) {
-	const dvis_t *vis = cms->map_pvs;
+static void CM_DecompressPVSRow( const uint8_t *in, int rowsize, uint8_t *out ) {
+	int i = 0;
+	while( i < rowsize ) {
+		if( *in != 0 ) {
+			out[i++] = *in++;
+			continue;
+		}
+
+		int run = Min2( int( in[1] ), rowsize - i );
+		memset( out + i, 0, run );
+		i += run;
+		in += 2;
+	}
+}
 
-	if( cluster == -1 || !vis ) {
+/*
+* CM_OrCompressedPVSRow
+* Or a compressed row into out without decompressing it first, zero runs are
+* skipped entirely
+*/
+static void CM_OrCompressedPVSRow( const uint8_t *in, int rowsize, uint8_t *out ) {
+	int i = 0;
+	while( i < rowsize ) {
+		if( *in != 0 ) {
+			out[i++] |= *in++;
+			continue;
+		}
+
+		i += in[1];
+		in += 2;
+	}
+}
+
+static void CM_OrPVSRows( uint8_t *out, const uint8_t *src, int longs ) {
+	int i = 0;
+	for( ; i + 4 <= longs; i += 4 ) {
+		__m128i a = _mm_loadu_si128( ( const __m128i * )( out + i * 4 ) );
+		__m128i b = _mm_loadu_si128( ( const __m128i * )( src + i * 4 ) );
+		_mm_storeu_si128( ( __m128i * )( out + i * 4 ), _mm_or_si128( a, b ) );
+	}
+	for( ; i < longs; i++ ) {
+		( (int *)out )[i] |= ( (const int *)src )[i];
+	}
+}
+
+/*
+* CM_ClusterPVS
+* Returns the decompressed row for cluster, which stays valid until
+* PVS_CACHE_ROWS other clusters have been looked up
+*/
+static const uint8_t *CM_ClusterPVS( CollisionModel *cms, int cluster ) {
+	if( cluster == -1 || !cms->map_pvs_rle ) {
 		return cms->nullrow;
 	}
 
-	return ( const uint8_t * )vis->data + cluster * vis->rowsize;
+	size_t stride = ( cms->map_pvs_rowsize + 15 ) & ~15;
+	cms->map_pvs_cache_clock++;
+
+	int oldest = 0;
+	for( int i = 0; i < PVS_CACHE_ROWS; i++ ) {
+		if( cms->map_pvs_cache_clusters[i] == cluster ) {
+			cms->map_pvs_cache_used[i] = cms->map_pvs_cache_clock;
+			return cms->map_pvs_cache_rows + i * stride;
+		}
+		if( cms->map_pvs_cache_used[i] < cms->map_pvs_cache_used[oldest] ) {
+			oldest = i;
+		}
+	}
+
+	uint8_t *row = cms->map_pvs_cache_rows + oldest * stride;
+	CM_DecompressPVSRow( cms->map_pvs_rle + cms->map_pvs_rle_offsets[cluster], cms->map_pvs_rowsize, row );
+	cms->map_pvs_cache_clusters[oldest] = cluster;
+	cms->map_pvs_cache_used[oldest] = cms->map_pvs_cache_clock;
+
+	return row;
 }
 
 int CM_NumAreas( const CollisionModel *cms ) {
 	return cms->numareas;
 }
 
+// in bytes, rounded up to whole words
 int CM_AreaRowSize( const CollisionModel *cms ) {
-	return ( cms->numareas + 7 ) / 8;
+	return BitSetWords( cms->numareas ) * sizeof( u64 );
 }
 
 /*
@@ -317,6 +565,8 @@ static void CM_FloodArea_r( CollisionModel *cms, int areanum, int floodnum ) {
 	}
 }
 
+static void CM_BuildAreaBits( CollisionModel *cms );
+
 void CM_FloodAreaConnections( CollisionModel *cms ) {
 	int i;
 	int floodnum;
@@ -331,6 +581,9 @@ void CM_FloodAreaConnections( CollisionModel *cms ) {
 		floodnum++;
 		CM_FloodArea_r( cms, i, floodnum );
 	}
+	cms->numfloods = floodnum;
+
+	CM_BuildAreaBits( cms );
 }
 
 void CM_SetAreaPortalState( CollisionModel *cms, int area1, int area2, bool open ) {
@@ -360,6 +613,20 @@ void CM_SetAreaPortalState( CollisionModel *cms, int area1, int area2, bool open
 	CM_FloodAreaConnections( cms );
 }
 
+/*
+* CM_ResetAreaPortals
+*
+* Closes every portal, as if the map was freshly loaded
+*/
+void CM_ResetAreaPortals( CollisionModel *cms ) {
+	if( cms->numareas == 0 ) {
+		return;
+	}
+
+	memset( cms->map_areaportals, 0, cms->numareas * cms->numareas * sizeof( *cms->map_areaportals ) );
+	CM_FloodAreaConnections( cms );
+}
+
 bool CM_AreasConnected( const CollisionModel *cms, int area1, int area2 ) {
 	if( area1 == area2 ) {
 		return true;
@@ -378,40 +645,76 @@ bool CM_AreasConnected( const CollisionModel *cms, int area1, int area2 ) {
 	return false;
 }
 
-static int CM_MergeAreaBits( CollisionModel *cms, uint8_t *buffer, int area ) {
-	int i;
+/*
+* CM_AllAreasConnected
+* Lets callers skip per area checks when no areaportal is closed
+*/
+bool CM_AllAreasConnected( const CollisionModel *cms ) {
+	return cms->numfloods <= 1;
+}
 
+static int CM_MergeAreaBits( CollisionModel *cms, u64 *buffer, int area ) {
 	if( area < 0 ) {
 		return CM_AreaRowSize( cms );
 	}
 
-	for( i = 0; i < cms->numareas; i++ ) {
-		if( CM_AreasConnected( cms, i, area ) ) {
-			buffer[i >> 3] |= 1 << ( i & 7 );
-		}
-	}
+	size_t words = BitSetWords( cms->numareas );
+	OrBits( buffer, cms->map_areabits + area * words, words );
 
 	return CM_AreaRowSize( cms );
 }
 
-void CM_WriteAreaBits( CollisionModel *cms, uint8_t *buffer ) {
-	int rowsize = CM_AreaRowSize( cms );
-	int bytes = rowsize * cms->numareas;
+/*
+* CM_BuildAreaBits
+*
+* Two areas are connected iff they're in the same flood, so every area in a
+* flood gets the same row. Build it in the row of the flood's first area and
+* copy it to the others
+*/
+static void CM_BuildAreaBits( CollisionModel *cms ) {
+	if( cms->map_areabits == NULL ) {
+		return;
+	}
+
+	size_t words = BitSetWords( cms->numareas );
+	memset( cms->map_areabits, 0, words * sizeof( u64 ) * cms->numareas );
 
-	memset( buffer, 0, bytes );
+	int * flood_rows = ALLOC_MANY( sys_allocator, int, cms->numfloods + 1 );
+	defer { FREE( sys_allocator, flood_rows ); };
+	for( int i = 0; i <= cms->numfloods; i++ ) {
+		flood_rows[ i ] = -1;
+	}
 
 	for( int i = 0; i < cms->numareas; i++ ) {
-		uint8_t * row = buffer + i * rowsize;
-		CM_MergeAreaBits( cms, row, i );
+		int floodnum = cms->map_areas[ i ].floodnum;
+		if( flood_rows[ floodnum ] == -1 ) {
+			flood_rows[ floodnum ] = i;
+		}
+		SetBit( cms->map_areabits + flood_rows[ floodnum ] * words, i );
+	}
+
+	for( int i = 0; i < cms->numareas; i++ ) {
+		int first = flood_rows[ cms->map_areas[ i ].floodnum ];
+		if( first != i ) {
+			memcpy( cms->map_areabits + i * words, cms->map_areabits + first * words, words * sizeof( u64 ) );
+		}
 	}
 }
 
+void CM_WriteAreaBits( CollisionModel *cms, u64 *buffer ) {
+	if( cms->numareas == 0 ) {
+		return;
+	}
+
+	memcpy( buffer, cms->map_areabits, CM_AreaRowSize( cms ) * cms->numareas );
+}
+
 /*
 * CM_HeadnodeVisible
 * Returns true if any leaf under headnode has a cluster that
 * is potentially visible
 */
-bool CM_HeadnodeVisible( CollisionModel *cms, int nodenum, uint8_t *visbits ) {
+bool CM_HeadnodeVisible( CollisionModel *cms, int nodenum, const uint8_t *visbits ) {
 	int cluster;
 	cnode_t *node;
 
@@ -469,12 +772,11 @@ void CM_MergePVS( CollisionModel *cms, Vec3 org, uint8_t *out ) {
 			continue; // already have the cluster we want
 		}
 		src = CM_ClusterPVS( cms, leafs[i] );
-		for( j = 0; j < longs; j++ )
-			( (int *)out )[j] |= ( (int *)src )[j];
+		CM_OrPVSRows( out, src, longs );
 	}
 }
 
-int CM_MergeVisSets( CollisionModel *cms, Vec3 org, uint8_t *pvs, uint8_t *areabits ) {
+int CM_MergeVisSets( CollisionModel *cms, Vec3 org, uint8_t *pvs, u64 *areabits ) {
 	int area;
 
 	assert( pvs || areabits );
@@ -492,3 +794,102 @@ int CM_MergeVisSets( CollisionModel *cms, Vec3 org, uint8_t *pvs, uint8_t *areab
 
 	return CM_AreaRowSize( cms ); // areabytes
 }
+
+/*
+* CM_BuildFatPVS
+* For each cluster, merge the PVS of every cluster touched by a 9 unit box
+* anywhere inside it, so CM_FatPVS matches CM_MergePVS at any point in the
+* cluster without walking the BSP. Solid leafs are skipped, otherwise any
+* cluster next to a wall would see everything.
+*/
+void CM_BuildFatPVS( CollisionModel *cms ) {
+	ZoneScoped;
+
+	int numclusters = CM_NumClusters( cms );
+	if( numclusters == 0 ) {
+		return;
+	}
+
+	int rowsize = CM_ClusterRowSize( cms );
+	int longs = CM_ClusterRowLongs( cms );
+	size_t rowbytes = longs * sizeof( int );
+
+	u8 * rows = ALLOC_MANY( sys_allocator, u8, numclusters * rowbytes );
+	memset( rows, 0, numclusters * rowbytes );
+	defer { FREE( sys_allocator, rows ); };
+
+	int * leafs = ALLOC_MANY( sys_allocator, int, cms->numleafs );
+	defer { FREE( sys_allocator, leafs ); };
+
+	for( int i = 0; i < cms->numleafs; i++ ) {
+		const cleaf_t * leaf = &cms->map_leafs[ i ];
+		if( leaf->cluster < 0 || leaf->cluster >= numclusters ) {
+			continue;
+		}
+
+		u8 * out = rows + leaf->cluster * rowbytes;
+		int count = CM_BoxLeafnums( cms, leaf->mins - Vec3( 9.0f ), leaf->maxs + Vec3( 9.0f ), leafs, cms->numleafs, NULL );
+
+		for( int j = 0; j < count; j++ ) {
+			int cluster = CM_LeafCluster( cms, leafs[ j ] );
+			if( cluster < 0 || cluster >= numclusters ) {
+				continue;
+			}
+
+			// every cluster gets visited from lots of leafs, which would
+			// thrash the row cache, so or in the compressed rows directly
+			CM_OrCompressedPVSRow( cms->map_pvs_rle + cms->map_pvs_rle_offsets[ cluster ], rowsize, out );
+		}
+	}
+
+	// dedupe
+	u64 * hashes = ALLOC_MANY( sys_allocator, u64, numclusters );
+	defer { FREE( sys_allocator, hashes ); };
+
+	cms->map_cluster_fatpvs = ALLOC_MANY( sys_allocator, int, numclusters );
+	cms->num_fatpvs_rows = 0;
+
+	for( int i = 0; i < numclusters; i++ ) {
+		const u8 * row = rows + i * rowbytes;
+		u64 hash = Hash64( row, rowsize );
+
+		int idx = -1;
+		for( int j = 0; j < cms->num_fatpvs_rows; j++ ) {
+			if( hashes[ j ] == hash && memcmp( rows + j * rowbytes, row, rowsize ) == 0 ) {
+				idx = j;
+				break;
+			}
+		}
+
+		if( idx == -1 ) {
+			idx = cms->num_fatpvs_rows;
+			hashes[ idx ] = hash;
+			memmove( rows + idx * rowbytes, row, rowbytes );
+			cms->num_fatpvs_rows++;
+		}
+
+		cms->map_cluster_fatpvs[ i ] = idx;
+	}
+
+	cms->map_fatpvs = ALLOC_MANY( sys_allocator, u8, cms->num_fatpvs_rows * rowbytes );
+	memcpy( cms->map_fatpvs, rows, cms->num_fatpvs_rows * rowbytes );
+
+	Com_DPrintf( "CM_BuildFatPVS: %i clusters, %i unique rows\n", numclusters, cms->num_fatpvs_rows );
+}
+
+/*
+* CM_FatPVS
+* Returns the merged PVS of everything that can be seen from near org
+*/
+const uint8_t *CM_FatPVS( const CollisionModel *cms, Vec3 org ) {
+	if( cms->map_fatpvs == NULL ) {
+		return cms->nullrow;
+	}
+
+	int cluster = CM_LeafCluster( cms, CM_PointLeafnum( cms, org ) );
+	if( cluster < 0 ) {
+		return cms->nullrow;
+	}
+
+	return cms->map_fatpvs + cms->map_cluster_fatpvs[ cluster ] * CM_ClusterRowLongs( cms ) * sizeof( int );
+}
@@ -18,11 +18,16 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <algorithm> // std::nth_element
+
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/fs.h"
 #include "qcommon/hash.h"
 #include "qcommon/string.h"
 #include "qcommon/cm_local.h"
 #include "qcommon/patch.h"
+#include "qcommon/serialization.h"
 
 #define MAX_LIGHTMAPS       4
 #define MAX_FACET_PLANES 32
@@ -389,7 +394,12 @@ static void CM_CreatePatch( CollisionModel *cms, cface_t *patch, cshaderref_t *s
 	}
 
 	if( patch->numfacets ) {
-		u8 * fdata = ( u8 * ) ALLOC_SIZE( sys_allocator, patch->numfacets * sizeof( cbrush_t ) + totalsides * ( sizeof( cbrushside_t ) + sizeof( cplane_t ) ), 16 );
+		size_t planefloats = 0;
+		for( int i = 0; i < patch->numfacets; i++ ) {
+			planefloats += CM_BrushPlanesFloats( facets[ i ].numsides );
+		}
+
+		u8 * fdata = ( u8 * ) ALLOC_SIZE( sys_allocator, patch->numfacets * sizeof( cbrush_t ) + totalsides * ( sizeof( cbrushside_t ) + sizeof( cplane_t ) ) + planefloats * sizeof( float ), 16 );
 
 		patch->facets = ( cbrush_t * )fdata; fdata += patch->numfacets * sizeof( cbrush_t );
 		memcpy( patch->facets, facets, patch->numfacets * sizeof( cbrush_t ) );
@@ -408,6 +418,12 @@ static void CM_CreatePatch( CollisionModel *cms, cface_t *patch, cshaderref_t *s
 			}
 		}
 
+		for( int i = 0; i < patch->numfacets; i++ ) {
+			cbrush_t * facet = &patch->facets[ i ];
+			CM_BuildBrushPlanes( facet, ( float * )fdata );
+			fdata += CM_BrushPlanesFloats( facet->numsides ) * sizeof( float );
+		}
+
 		patch->contents = shaderref->contents;
 
 		patch->mins -= Vec3( 1.0f );
@@ -594,7 +610,318 @@ static void CMod_LoadFaces_RBSP( CollisionModel *cms, lump_t *l ) {
 	}
 }
 
-static void CMod_LoadSubmodels( CModelServerOrClient soc, CollisionModel *cms, lump_t *l ) {
+/*
+* baked patch collision
+*
+* tessellating patches into facets is most of the map load, so the facets get
+* written to base/cache/maps after the first load and read back as one block
+* on the next. the file is pointer free, every pointer is an offset from the
+* start of the facet data, and they're fixed up in place after reading so the
+* faces point straight into the file buffer
+*
+* the file is named after a hash of the bsp and the facet layout, so editing
+* the map just misses the cache. bump BAKED_CM_VERSION if the tessellation
+* changes
+*/
+
+#define BAKED_CM_MAGIC 0x4d43424b // KBCM
+#define BAKED_CM_VERSION 2
+
+struct BakedFace {
+	int contents;
+	int numfacets;
+	Vec3 mins, maxs;
+	u64 facets;
+};
+
+static u64 CM_BakedCollisionKey( const CollisionModel * cms ) {
+	u32 layout[] = {
+		cms->checksum,
+		BAKED_CM_VERSION,
+		CM_SUBDIV_LEVEL,
+		MAX_FACET_PLANES,
+		u32( sizeof( cbrush_t ) ),
+		u32( sizeof( cbrushside_t ) ),
+		u32( sizeof( BakedFace ) ),
+	};
+	return Hash64( layout, sizeof( layout ) );
+}
+
+static char * CM_BakedCollisionPath( Allocator * a, u64 key ) {
+	if( HomeDirPath() == NULL ) {
+		return NULL;
+	}
+	return ( *a )( "{}/base/cache/maps/{016x}.cm", HomeDirPath(), key );
+}
+
+static size_t CM_BakedFacetsSize( const cface_t * face ) {
+	size_t size = face->numfacets * sizeof( cbrush_t );
+	for( int i = 0; i < face->numfacets; i++ ) {
+		size += face->facets[ i ].numsides * sizeof( cbrushside_t );
+	}
+	size = AlignPow2( size, size_t( 16 ) );
+	for( int i = 0; i < face->numfacets; i++ ) {
+		size += CM_BrushPlanesFloats( face->facets[ i ].numsides ) * sizeof( float );
+	}
+	return size;
+}
+
+static bool CM_LoadBakedFaces( CollisionModel * cms, const char * path, u64 key, int count ) {
+	ZoneScoped;
+
+	Span< u8 > file = ReadCacheFile( sys_allocator, path, BAKED_CM_MAGIC, BAKED_CM_VERSION, key );
+	if( file.ptr == NULL ) {
+		return false;
+	}
+
+	size_t data_offset = CACHE_FILE_DATA_OFFSET + AlignPow2( count * sizeof( BakedFace ), size_t( 16 ) );
+	if( file.n < data_offset ) {
+		FREE( sys_allocator, file.ptr );
+		return false;
+	}
+
+	const BakedFace * in = ( const BakedFace * )( file.ptr + CACHE_FILE_DATA_OFFSET );
+	u8 * data = file.ptr + data_offset;
+
+	cms->map_faces = ALLOC_MANY( sys_allocator, cface_t, count );
+	cms->numfaces = count;
+	cms->map_baked_facets = file.ptr;
+
+	for( int i = 0; i < count; i++ ) {
+		cface_t * out = &cms->map_faces[ i ];
+		out->contents = in[ i ].contents;
+		out->numfacets = in[ i ].numfacets;
+		out->mins = in[ i ].mins;
+		out->maxs = in[ i ].maxs;
+		out->facets = out->numfacets == 0 ? NULL : ( cbrush_t * )( data + in[ i ].facets );
+
+		for( int j = 0; j < out->numfacets; j++ ) {
+			cbrush_t * facet = &out->facets[ j ];
+			facet->brushsides = ( cbrushside_t * )( data + uintptr_t( facet->brushsides ) );
+			facet->simd_planes = ( float * )( data + uintptr_t( facet->simd_planes ) );
+		}
+	}
+
+	return true;
+}
+
+static void CM_SaveBakedFaces( const CollisionModel * cms, const char * path, u64 key ) {
+	ZoneScoped;
+
+	size_t data_offset = AlignPow2( cms->numfaces * sizeof( BakedFace ), size_t( 16 ) );
+	size_t data_size = 0;
+	for( int i = 0; i < cms->numfaces; i++ ) {
+		data_size += CM_BakedFacetsSize( &cms->map_faces[ i ] );
+	}
+
+	size_t file_size = data_offset + data_size;
+	u8 * file = ( u8 * ) ALLOC_SIZE( sys_allocator, file_size, 16 );
+	defer { FREE( sys_allocator, file ); };
+	memset( file, 0, file_size );
+
+	BakedFace * out = ( BakedFace * ) file;
+	u8 * data = file + data_offset;
+	size_t cursor = 0;
+
+	for( int i = 0; i < cms->numfaces; i++ ) {
+		const cface_t * face = &cms->map_faces[ i ];
+		out[ i ].contents = face->contents;
+		out[ i ].numfacets = face->numfacets;
+		out[ i ].mins = face->mins;
+		out[ i ].maxs = face->maxs;
+		out[ i ].facets = cursor;
+
+		cbrush_t * facets = ( cbrush_t * )( data + cursor );
+		size_t sides = cursor + face->numfacets * sizeof( cbrush_t );
+		size_t planes = sides;
+		for( int j = 0; j < face->numfacets; j++ ) {
+			planes += face->facets[ j ].numsides * sizeof( cbrushside_t );
+		}
+		planes = AlignPow2( planes, size_t( 16 ) );
+
+		for( int j = 0; j < face->numfacets; j++ ) {
+			const cbrush_t * facet = &face->facets[ j ];
+			size_t num_plane_floats = CM_BrushPlanesFloats( facet->numsides );
+
+			facets[ j ] = *facet;
+			facets[ j ].brushsides = ( cbrushside_t * )uintptr_t( sides );
+			facets[ j ].simd_planes = ( float * )uintptr_t( planes );
+
+			memcpy( data + sides, facet->brushsides, facet->numsides * sizeof( cbrushside_t ) );
+			memcpy( data + planes, facet->simd_planes, num_plane_floats * sizeof( float ) );
+			sides += facet->numsides * sizeof( cbrushside_t );
+			planes += num_plane_floats * sizeof( float );
+		}
+
+		cursor += CM_BakedFacetsSize( face );
+	}
+
+	if( !WriteCacheFile( path, BAKED_CM_MAGIC, BAKED_CM_VERSION, key, Span< const u8 >( file, file_size ) ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write collision cache '%s'\n", path );
+	}
+}
+
+/*
+* BVH building
+*
+* top down, splitting at the median centre along the longest axis until
+* there are few enough items to test them one by one
+*/
+
+#define BVH_LEAF_ITEMS 4
+
+// traces test all of a leaf node's items with one SSE compare
+STATIC_ASSERT( BVH_LEAF_ITEMS <= 4 );
+
+struct BVHBuildItem {
+	Vec3 mins, maxs;
+	Vec3 centre;
+	int item;
+};
+
+struct BVHBuilder {
+	NonRAIIDynamicArray< CollisionBVHNode > nodes;
+	NonRAIIDynamicArray< int > items;
+	NonRAIIDynamicArray< MinMax3 > item_bounds;
+	NonRAIIDynamicArray< BVHBuildItem > build;
+};
+
+static void CM_BuildBVH_r( BVHBuilder * builder, u32 node_idx, BVHBuildItem * build, size_t n ) {
+	Vec3 mins, maxs, centre_mins, centre_maxs;
+	ClearBounds( &mins, &maxs );
+	ClearBounds( &centre_mins, &centre_maxs );
+	for( size_t i = 0; i < n; i++ ) {
+		AddPointToBounds( build[ i ].mins, &mins, &maxs );
+		AddPointToBounds( build[ i ].maxs, &mins, &maxs );
+		AddPointToBounds( build[ i ].centre, &centre_mins, &centre_maxs );
+	}
+
+	builder->nodes[ node_idx ].mins = mins;
+	builder->nodes[ node_idx ].maxs = maxs;
+
+	if( n <= BVH_LEAF_ITEMS ) {
+		builder->nodes[ node_idx ].first = builder->items.size();
+		builder->nodes[ node_idx ].num_items = n;
+		for( size_t i = 0; i < n; i++ ) {
+			builder->items.add( build[ i ].item );
+			builder->item_bounds.add( MinMax3( build[ i ].mins, build[ i ].maxs ) );
+		}
+		return;
+	}
+
+	Vec3 extents = centre_maxs - centre_mins;
+	int axis = 0;
+	if( extents.y > extents[ axis ] )
+		axis = 1;
+	if( extents.z > extents[ axis ] )
+		axis = 2;
+
+	size_t half = n / 2;
+	std::nth_element( build, build + half, build + n, [axis]( const BVHBuildItem & a, const BVHBuildItem & b ) {
+		return a.centre[ axis ] < b.centre[ axis ];
+	} );
+
+	u32 children = builder->nodes.extend( 2 );
+	builder->nodes[ node_idx ].first = children;
+	builder->nodes[ node_idx ].num_items = 0;
+
+	CM_BuildBVH_r( builder, children, build, half );
+	CM_BuildBVH_r( builder, children + 1, build + half, n - half );
+}
+
+static int CM_BuildBVH( BVHBuilder * builder, BVHBuildItem * build, size_t n ) {
+	if( n == 0 ) {
+		return -1;
+	}
+
+	u32 root = builder->nodes.extend( 1 );
+	CM_BuildBVH_r( builder, root, build, n );
+	return root;
+}
+
+static void AddBVHBuildItem( BVHBuilder * builder, Vec3 mins, Vec3 maxs, int item ) {
+	BVHBuildItem b;
+	b.mins = mins;
+	b.maxs = maxs;
+	b.centre = ( mins + maxs ) * 0.5f;
+	b.item = item;
+	builder->build.add( b );
+}
+
+static int CM_BuildBrushesBVH( const CollisionModel * cms, BVHBuilder * builder,
+		const int * markbrushes, int nummarkbrushes, const int * markfaces, int nummarkfaces ) {
+	builder->build.clear();
+
+	for( int i = 0; i < nummarkbrushes; i++ ) {
+		const cbrush_t * brush = &cms->map_brushes[ markbrushes[ i ] ];
+		if( brush->numsides == 0 )
+			continue;
+		AddBVHBuildItem( builder, brush->mins, brush->maxs, markbrushes[ i ] );
+	}
+
+	for( int i = 0; i < nummarkfaces; i++ ) {
+		const cface_t * patch = &cms->map_faces[ markfaces[ i ] ];
+		if( patch->numfacets == 0 )
+			continue;
+		AddBVHBuildItem( builder, patch->mins, patch->maxs, -1 - markfaces[ i ] );
+	}
+
+	return CM_BuildBVH( builder, builder->build.ptr(), builder->build.size() );
+}
+
+static void CM_InitBVHBuilder( BVHBuilder * builder ) {
+	builder->nodes.init( sys_allocator );
+	builder->items.init( sys_allocator );
+	builder->item_bounds.init( sys_allocator );
+	builder->build.init( sys_allocator );
+}
+
+static void CM_BuildPatchAndLeafBVHs( CollisionModel * cms, BVHBuilder * builder ) {
+	ZoneScoped;
+
+	for( int i = 0; i < cms->numfaces; i++ ) {
+		cface_t * patch = &cms->map_faces[ i ];
+
+		builder->build.clear();
+		for( int j = 0; j < patch->numfacets; j++ ) {
+			AddBVHBuildItem( builder, patch->facets[ j ].mins, patch->facets[ j ].maxs, j );
+		}
+		patch->bvh_root = CM_BuildBVH( builder, builder->build.ptr(), builder->build.size() );
+	}
+
+	for( int i = 0; i < cms->numleafs; i++ ) {
+		cleaf_t * leaf = &cms->map_leafs[ i ];
+		leaf->bvh_root = CM_BuildBrushesBVH( cms, builder, leaf->markbrushes, leaf->nummarkbrushes, leaf->markfaces, leaf->nummarkfaces );
+	}
+	cms->map_leaf_empty.bvh_root = -1;
+}
+
+static void CM_FinishBVHs( CollisionModel * cms, BVHBuilder * builder ) {
+	cms->map_bvh_nodes = ALLOC_MANY( sys_allocator, CollisionBVHNode, builder->nodes.size() );
+	memcpy( cms->map_bvh_nodes, builder->nodes.ptr(), builder->nodes.num_bytes() );
+	cms->map_bvh_items = ALLOC_MANY( sys_allocator, int, builder->items.size() );
+	memcpy( cms->map_bvh_items, builder->items.ptr(), builder->items.num_bytes() );
+
+	// padded so the last node's loads stay in bounds
+	size_t stride = builder->items.size() + 4;
+	cms->map_bvh_item_bounds_stride = stride;
+	cms->map_bvh_item_bounds = ALLOC_MANY( sys_allocator, float, stride * 6 );
+	memset( cms->map_bvh_item_bounds, 0, stride * 6 * sizeof( float ) );
+	for( size_t i = 0; i < builder->item_bounds.size(); i++ ) {
+		const MinMax3 & bounds = builder->item_bounds[ i ];
+		for( int j = 0; j < 3; j++ ) {
+			cms->map_bvh_item_bounds[ stride * j + i ] = bounds.mins[ j ];
+			cms->map_bvh_item_bounds[ stride * ( j + 3 ) + i ] = bounds.maxs[ j ];
+		}
+	}
+
+	builder->nodes.shutdown();
+	builder->items.shutdown();
+	builder->item_bounds.shutdown();
+	builder->build.shutdown();
+}
+
+static void CMod_LoadSubmodels( CollisionModel *cms, BVHBuilder * bvh, lump_t *l ) {
 	const dmodel_t * in = ( dmodel_t * )( cms->cmod_base + l->fileofs );
 	if( l->filelen % sizeof( *in ) ) {
 		Fatal( "CMod_LoadSubmodels: funny lump size" );
@@ -605,12 +932,14 @@ static void CMod_LoadSubmodels( CModelServerOrClient soc, CollisionModel *cms, l
 	}
 
 	cms->num_models = count;
+	cms->unregistered_cmodels = ALLOC_MANY( sys_allocator, cmodel_t, count );
 
 	for( int i = 0; i < count; i++, in++ ) {
 		String< 16 > suffix( "*{}", i );
 		u64 hash = Hash64( suffix.c_str(), suffix.length(), cms->base_hash );
 
-		cmodel_t * model = CM_NewCModel( soc, hash );
+		cmodel_t * model = &cms->unregistered_cmodels[ i ];
+		*model = { };
 
 		model->hash = hash;
 		model->faces = cms->map_faces;
@@ -639,6 +968,13 @@ static void CMod_LoadSubmodels( CModelServerOrClient soc, CollisionModel *cms, l
 			model->mins[j] = LittleFloat( in->mins[j] ) - 1;
 			model->maxs[j] = LittleFloat( in->maxs[j] ) + 1;
 		}
+
+		// the world goes through the BSP instead
+		if( i == 0 ) {
+			model->bvh_root = -1;
+		} else {
+			model->bvh_root = CM_BuildBrushesBVH( cms, bvh, model->markbrushes, model->nummarkbrushes, model->markfaces, model->nummarkfaces );
+		}
 	}
 }
 
@@ -721,6 +1057,10 @@ static void CMod_LoadLeafs( CollisionModel *cms, lump_t *l ) {
 		out->contents = 0;
 		out->cluster = LittleLong( in->cluster );
 		out->area = LittleLong( in->area );
+		for( j = 0; j < 3; j++ ) {
+			out->mins[j] = LittleLong( in->mins[j] );
+			out->maxs[j] = LittleLong( in->maxs[j] );
+		}
 		out->markbrushes = cms->map_markbrushes + LittleLong( in->firstleafbrush );
 		out->nummarkbrushes = LittleLong( in->numleafbrushes );
 		out->markfaces = cms->map_markfaces + LittleLong( in->firstleafface );
@@ -886,20 +1226,100 @@ static void CMod_LoadBrushes( CollisionModel *cms, lump_t *l ) {
 		out->brushsides = cms->map_brushsides + LittleLong( in->firstside );
 		CM_BoundBrush( out );
 	}
+
+	size_t planefloats = 0;
+	for( i = 0; i < count; i++ ) {
+		planefloats += CM_BrushPlanesFloats( cms->map_brushes[i].numsides );
+	}
+
+	float * planes = cms->map_brush_planes = ALLOC_MANY( sys_allocator, float, planefloats );
+	for( i = 0; i < count; i++ ) {
+		CM_BuildBrushPlanes( &cms->map_brushes[i], planes );
+		planes += CM_BrushPlanesFloats( cms->map_brushes[i].numsides );
+	}
+}
+
+/*
+* CMod_CompressVisRow
+*
+* zero bytes are followed by a run length, everything else is copied through.
+* returns the compressed size, and only measures if out is NULL
+*/
+static size_t CMod_CompressVisRow( const uint8_t *in, int rowsize, uint8_t *out ) {
+	size_t len = 0;
+	for( int i = 0; i < rowsize; ) {
+		if( in[i] != 0 ) {
+			if( out != NULL ) {
+				out[len] = in[i];
+			}
+			len++;
+			i++;
+			continue;
+		}
+
+		int run = 1;
+		while( i + run < rowsize && run < 255 && in[i + run] == 0 ) {
+			run++;
+		}
+
+		if( out != NULL ) {
+			out[len] = 0;
+			out[len + 1] = uint8_t( run );
+		}
+		len += 2;
+		i += run;
+	}
+
+	return len;
 }
 
 static void CMod_LoadVisibility( CollisionModel *cms, lump_t *l ) {
 	cms->map_visdatasize = l->filelen;
 	if( !cms->map_visdatasize ) {
-		cms->map_pvs = NULL;
 		return;
 	}
 
-	cms->map_pvs = ( dvis_t * ) ALLOC_SIZE( sys_allocator, cms->map_visdatasize, 16 );
-	memcpy( cms->map_pvs, cms->cmod_base + l->fileofs, cms->map_visdatasize );
+	if( l->filelen < int( 2 * sizeof( int ) ) ) {
+		Fatal( "CMod_LoadVisibility: funny lump size" );
+	}
+
+	const uint8_t *base = cms->cmod_base + l->fileofs;
+	int header[2];
+	memcpy( header, base, sizeof( header ) );
+	int numclusters = LittleLong( header[0] );
+	int rowsize = LittleLong( header[1] );
+
+	if( numclusters < 0 || rowsize < 0 || rowsize > MAX_CM_LEAFS / 8 || int64_t( numclusters ) * rowsize > l->filelen - int( sizeof( header ) ) ) {
+		Fatal( "CMod_LoadVisibility: funny lump size" );
+	}
+
+	const uint8_t *rows = base + sizeof( header );
 
-	cms->map_pvs->numclusters = LittleLong( cms->map_pvs->numclusters );
-	cms->map_pvs->rowsize = LittleLong( cms->map_pvs->rowsize );
+	cms->map_pvs_rle_offsets = ALLOC_MANY( sys_allocator, u32, numclusters + 1 );
+	size_t compressed_size = 0;
+	for( int i = 0; i < numclusters; i++ ) {
+		cms->map_pvs_rle_offsets[i] = u32( compressed_size );
+		compressed_size += CMod_CompressVisRow( rows + i * rowsize, rowsize, NULL );
+	}
+	cms->map_pvs_rle_offsets[numclusters] = u32( compressed_size );
+
+	cms->map_pvs_rle = ALLOC_MANY( sys_allocator, uint8_t, Max2( compressed_size, size_t( 1 ) ) );
+	for( int i = 0; i < numclusters; i++ ) {
+		CMod_CompressVisRow( rows + i * rowsize, rowsize, cms->map_pvs_rle + cms->map_pvs_rle_offsets[i] );
+	}
+
+	cms->map_numclusters = numclusters;
+	cms->map_pvs_rowsize = rowsize;
+
+	size_t stride = ( rowsize + 15 ) & ~15;
+	cms->map_pvs_cache_rows = ( uint8_t * ) ALLOC_SIZE( sys_allocator, Max2( PVS_CACHE_ROWS * stride, size_t( 16 ) ), 16 );
+	for( int i = 0; i < PVS_CACHE_ROWS; i++ ) {
+		cms->map_pvs_cache_clusters[i] = -1;
+		cms->map_pvs_cache_used[i] = 0;
+	}
+	cms->map_pvs_cache_clock = 0;
+
+	Com_DPrintf( "CMod_LoadVisibility: %i clusters, %i -> %" PRIu64 " bytes\n", numclusters, numclusters * rowsize, u64( compressed_size ) );
 }
 
 static void CMod_LoadEntityString( CollisionModel *cms, lump_t *l ) {
@@ -912,7 +1332,7 @@ static void CMod_LoadEntityString( CollisionModel *cms, lump_t *l ) {
 	memcpy( cms->map_entitystring, cms->cmod_base + l->fileofs, l->filelen );
 }
 
-void CM_LoadQ3BrushModel( CModelServerOrClient soc, CollisionModel * cms, Span< const u8 > data ) {
+void CM_LoadQ3BrushModel( CollisionModel * cms, Span< const u8 > data ) {
 	dheader_t header;
 	memcpy( &header, data.ptr, sizeof( header ) );
 
@@ -935,18 +1355,36 @@ void CM_LoadQ3BrushModel( CModelServerOrClient soc, CollisionModel * cms, Span<
 	}
 	CMod_LoadBrushes( cms, &header.lumps[LUMP_BRUSHES] );
 	CMod_LoadMarkBrushes( cms, &header.lumps[LUMP_LEAFBRUSHES] );
-	if( idbsp ) {
-		CMod_LoadVertexes( cms, &header.lumps[LUMP_VERTEXES] );
-		CMod_LoadFaces( cms, &header.lumps[LUMP_FACES] );
-	}
-	else {
-		CMod_LoadVertexes_RBSP( cms, &header.lumps[LUMP_VERTEXES] );
-		CMod_LoadFaces_RBSP( cms, &header.lumps[LUMP_FACES] );
+
+	u64 baked_key = CM_BakedCollisionKey( cms );
+	char * baked_path = CM_BakedCollisionPath( sys_allocator, baked_key );
+	defer { FREE( sys_allocator, baked_path ); };
+
+	int num_faces = header.lumps[LUMP_FACES].filelen / ( idbsp ? sizeof( dface_t ) : sizeof( rdface_t ) );
+	if( baked_path == NULL || !CM_LoadBakedFaces( cms, baked_path, baked_key, num_faces ) ) {
+		if( idbsp ) {
+			CMod_LoadVertexes( cms, &header.lumps[LUMP_VERTEXES] );
+			CMod_LoadFaces( cms, &header.lumps[LUMP_FACES] );
+		}
+		else {
+			CMod_LoadVertexes_RBSP( cms, &header.lumps[LUMP_VERTEXES] );
+			CMod_LoadFaces_RBSP( cms, &header.lumps[LUMP_FACES] );
+		}
+
+		if( baked_path != NULL ) {
+			CM_SaveBakedFaces( cms, baked_path, baked_key );
+		}
 	}
 	CMod_LoadMarkFaces( cms, &header.lumps[LUMP_LEAFFACES] );
 	CMod_LoadLeafs( cms, &header.lumps[LUMP_LEAFS] );
 	CMod_LoadNodes( cms, &header.lumps[LUMP_NODES] );
-	CMod_LoadSubmodels( soc, cms, &header.lumps[LUMP_MODELS] );
+
+	BVHBuilder bvh;
+	CM_InitBVHBuilder( &bvh );
+	CM_BuildPatchAndLeafBVHs( cms, &bvh );
+	CMod_LoadSubmodels( cms, &bvh, &header.lumps[LUMP_MODELS] );
+	CM_FinishBVHs( cms, &bvh );
+
 	CMod_LoadVisibility( cms, &header.lumps[LUMP_VISIBILITY] );
 	CMod_LoadEntityString( cms, &header.lumps[LUMP_ENTITIES] );
 
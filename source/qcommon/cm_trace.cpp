@@ -18,6 +18,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <xmmintrin.h>
+
 #include "qcommon/qcommon.h"
 #include "qcommon/cm_local.h"
 
@@ -28,7 +30,7 @@ typedef struct {
 	Vec3 leaf_mins, leaf_maxs;
 } boxLeafsWork_t;
 
-typedef struct {
+typedef struct traceWork_t {
 	int contents;
 	int checkcount;
 
@@ -50,6 +52,14 @@ typedef struct {
 
 	int *brush_checkcounts;
 	int *face_checkcounts;
+	int hull_checkcount; // box and octagon hulls only have one brush
+
+	// capsule traces only
+	Vec3 capsule_center;
+	float capsule_radius, capsule_halfheight;
+
+	void ( *clip )( struct traceWork_t *, const cbrush_t * );
+	void ( *test )( struct traceWork_t *, const cbrush_t * );
 } traceWork_t;
 
 /*
@@ -70,6 +80,7 @@ void CM_InitBoxHull( CollisionModel *cms ) {
 
 	cms->box_cmodel->brushes = cms->box_brush;
 	cms->box_cmodel->builtin = true;
+	cms->box_cmodel->bvh_root = -1;
 	cms->box_cmodel->nummarkfaces = 0;
 	cms->box_cmodel->markfaces = NULL;
 	cms->box_cmodel->markbrushes = cms->box_markbrushes;
@@ -90,6 +101,8 @@ void CM_InitBoxHull( CollisionModel *cms ) {
 			p->normal[i >> 1] = 1;
 		}
 	}
+
+	CM_BuildBrushPlanes( cms->box_brush, cms->box_planes );
 }
 
 /*
@@ -117,6 +130,7 @@ void CM_InitOctagonHull( CollisionModel *cms ) {
 
 	cms->oct_cmodel->brushes = cms->oct_brush;
 	cms->oct_cmodel->builtin = true;
+	cms->oct_cmodel->bvh_root = -1;
 	cms->oct_cmodel->nummarkfaces = 0;
 	cms->oct_cmodel->markfaces = NULL;
 	cms->oct_cmodel->markbrushes = cms->oct_markbrushes;
@@ -149,6 +163,8 @@ void CM_InitOctagonHull( CollisionModel *cms ) {
 		cplane_t * p = &s->plane;
 		p->normal = oct_dirs[i - 6];
 	}
+
+	CM_BuildBrushPlanes( cms->oct_brush, cms->oct_planes );
 }
 
 /*
@@ -167,6 +183,8 @@ cmodel_t *CM_ModelForBBox( CollisionModel *cms, Vec3 mins, Vec3 maxs ) {
 	cms->box_cmodel->mins = mins;
 	cms->box_cmodel->maxs = maxs;
 
+	CM_BuildBrushPlanes( cms->box_brush, cms->box_planes );
+
 	return cms->box_cmodel;
 }
 
@@ -226,6 +244,8 @@ cmodel_t *CM_OctagonModelForBBox( CollisionModel *cms, Vec3 mins, Vec3 maxs ) {
 	cms->oct_brushsides[9].plane.normal = Vec3( cosa, -sina, 0 );
 	cms->oct_brushsides[9].plane.dist = d;
 
+	CM_BuildBrushPlanes( cms->oct_brush, cms->oct_planes );
+
 	return cms->oct_cmodel;
 }
 
@@ -449,72 +469,174 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON    ( 1.0f / 32.0f )
 
-static void CM_ClipBoxToBrush( traceWork_t *tw, const cbrush_t *brush ) {
-	ZoneScoped;
-
-	if( !brush->numsides ) {
-		return;
+/*
+* CM_BuildBrushPlanes
+*
+* Padding planes have a zero normal and positive dist, so everything is
+* behind them and they never clip anything
+*/
+void CM_BuildBrushPlanes( cbrush_t * brush, float * planes ) {
+	brush->simd_planes = planes;
+
+	for( int i = 0; i < brush->numsides; i += 4 ) {
+		float * group = planes + i * 4;
+		for( int j = 0; j < 4; j++ ) {
+			if( i + j < brush->numsides ) {
+				const cplane_t * p = &brush->brushsides[ i + j ].plane;
+				group[ j + 0 ] = p->normal.x;
+				group[ j + 4 ] = p->normal.y;
+				group[ j + 8 ] = p->normal.z;
+				group[ j + 12 ] = p->dist;
+			} else {
+				group[ j + 0 ] = 0.0f;
+				group[ j + 4 ] = 0.0f;
+				group[ j + 8 ] = 0.0f;
+				group[ j + 12 ] = 1.0f;
+			}
+		}
 	}
+}
 
-	float enterfrac = -1.0f;
-	float leavefrac = 1.0f;
-	float enterfrac2 = -1.0f;
+static inline __m128 Select( __m128 mask, __m128 a, __m128 b ) {
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
 
-	const cplane_t * clipplane = NULL;
+/*
+* the clipping kernels only need the distance from each plane to the point
+* of the moving shape that's furthest behind it, so the box and capsule
+* kernels are the same code with a different TraceShape
+*/
+struct BoxTraceShape {
+	__m128 mins_x, mins_y, mins_z;
+	__m128 maxs_x, maxs_y, maxs_z;
+
+	explicit BoxTraceShape( const traceWork_t * tw ) {
+		mins_x = _mm_set1_ps( tw->mins.x );
+		mins_y = _mm_set1_ps( tw->mins.y );
+		mins_z = _mm_set1_ps( tw->mins.z );
+		maxs_x = _mm_set1_ps( tw->maxs.x );
+		maxs_y = _mm_set1_ps( tw->maxs.y );
+		maxs_z = _mm_set1_ps( tw->maxs.z );
+	}
 
-	bool getout = false;
-	bool startout = false;
-	const cbrushside_t * leadside = NULL;
-	const cbrushside_t * side = brush->brushsides;
+	__m128 PlaneDistance( __m128 normal_x, __m128 normal_y, __m128 normal_z, __m128 x, __m128 y, __m128 z ) const {
+		const __m128 zero = _mm_setzero_ps();
+		__m128 offset_x = Select( _mm_cmplt_ps( normal_x, zero ), maxs_x, mins_x );
+		__m128 offset_y = Select( _mm_cmplt_ps( normal_y, zero ), maxs_y, mins_y );
+		__m128 offset_z = Select( _mm_cmplt_ps( normal_z, zero ), maxs_z, mins_z );
 
-	for( int i = 0; i < brush->numsides; i++, side++ ) {
-		const cplane_t * p = &side->plane;
+		return _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( normal_x, _mm_add_ps( x, offset_x ) ),
+			_mm_mul_ps( normal_y, _mm_add_ps( y, offset_y ) ) ),
+			_mm_mul_ps( normal_z, _mm_add_ps( z, offset_z ) ) );
+	}
+};
 
-		Vec3 offset;
-		for( int j = 0; j < 3; j++ ) {
-			offset[ j ] = p->normal[ j ] < 0 ? tw->maxs[ j ] : tw->mins[ j ];
-		}
+/*
+* a vertical capsule is a segment from center - halfheight to
+* center + halfheight swept by radius, so its support distance along n is
+* radius + halfheight * |n.z|. brushes have axial bevel planes so this is as
+* good as the box kernel at edges and corners
+*/
+struct CapsuleTraceShape {
+	__m128 center_x, center_y, center_z;
+	__m128 radius, halfheight;
+
+	explicit CapsuleTraceShape( const traceWork_t * tw ) {
+		center_x = _mm_set1_ps( tw->capsule_center.x );
+		center_y = _mm_set1_ps( tw->capsule_center.y );
+		center_z = _mm_set1_ps( tw->capsule_center.z );
+		radius = _mm_set1_ps( tw->capsule_radius );
+		halfheight = _mm_set1_ps( tw->capsule_halfheight );
+	}
 
-		Vec3 start_offset, end_offset;
-		start_offset = tw->start + offset;
-		end_offset = tw->end + offset;
+	__m128 PlaneDistance( __m128 normal_x, __m128 normal_y, __m128 normal_z, __m128 x, __m128 y, __m128 z ) const {
+		__m128 abs_z = _mm_andnot_ps( _mm_set1_ps( -0.0f ), normal_z );
+		__m128 support = _mm_add_ps( radius, _mm_mul_ps( halfheight, abs_z ) );
 
-		float d1 = Dot( p->normal, start_offset ) - p->dist;
-		float d2 = Dot( p->normal, end_offset ) - p->dist;
+		__m128 d = _mm_add_ps( _mm_add_ps(
+			_mm_mul_ps( normal_x, _mm_add_ps( x, center_x ) ),
+			_mm_mul_ps( normal_y, _mm_add_ps( y, center_y ) ) ),
+			_mm_mul_ps( normal_z, _mm_add_ps( z, center_z ) ) );
+		return _mm_sub_ps( d, support );
+	}
+};
 
-		if( d2 > 0 ) {
-			getout = true; // endpoint is not in solid
-		}
-		if( d1 > 0 ) {
-			startout = true;
-		}
+/*
+* CM_ClipShapeToBrush
+*
+* Does 4 brush sides at a time. Each lane keeps its own best enter/leave
+* fractions, which get combined at the end, breaking ties by side index so
+* we pick the same plane as going through the sides in order
+*/
+template< typename TraceShape >
+static void CM_ClipShapeToBrush( traceWork_t *tw, const cbrush_t *brush ) {
+	ZoneScoped;
+
+	if( !brush->numsides ) {
+		return;
+	}
 
-		// if completely in front of face, no intersection
-		if( d1 > 0 && d2 >= d1 ) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+
+	const __m128 start_x = _mm_set1_ps( tw->start.x );
+	const __m128 start_y = _mm_set1_ps( tw->start.y );
+	const __m128 start_z = _mm_set1_ps( tw->start.z );
+	const __m128 end_x = _mm_set1_ps( tw->end.x );
+	const __m128 end_y = _mm_set1_ps( tw->end.y );
+	const __m128 end_z = _mm_set1_ps( tw->end.z );
+	const TraceShape shape( tw );
+
+	__m128 enterfrac = _mm_set1_ps( -1.0f );
+	__m128 enterfrac2 = _mm_set1_ps( -1.0f );
+	__m128 enterside = zero;
+	__m128 leavefrac = one;
+	__m128 side_idx = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+
+	int getout = 0;
+	int startout = 0;
+
+	for( int i = 0; i < brush->numsides; i += 4 ) {
+		const float * group = brush->simd_planes + i * 4;
+		__m128 normal_x = _mm_loadu_ps( group + 0 );
+		__m128 normal_y = _mm_loadu_ps( group + 4 );
+		__m128 normal_z = _mm_loadu_ps( group + 8 );
+		__m128 dist = _mm_loadu_ps( group + 12 );
+
+		__m128 d1 = _mm_sub_ps( shape.PlaneDistance( normal_x, normal_y, normal_z, start_x, start_y, start_z ), dist );
+		__m128 d2 = _mm_sub_ps( shape.PlaneDistance( normal_x, normal_y, normal_z, end_x, end_y, end_z ), dist );
+
+		__m128 d1_out = _mm_cmpgt_ps( d1, zero );
+		__m128 d2_out = _mm_cmpgt_ps( d2, zero );
+
+		// if completely in front of any face, no intersection
+		if( _mm_movemask_ps( _mm_and_ps( d1_out, _mm_cmpge_ps( d2, d1 ) ) ) != 0 ) {
 			return;
 		}
 
-		if( d1 <= 0 && d2 <= 0 ) {
-			continue;
-		}
+		startout |= _mm_movemask_ps( d1_out );
+		getout |= _mm_movemask_ps( d2_out );
 
 		// crosses face
-		float f = d1 - d2;
-		if( f > 0 ) {       // enter
-			f = d1 / f;
-			if( f > enterfrac ) {
-				enterfrac = f;
-				clipplane = p;
-				leadside = side;
-				enterfrac2 = ( d1 - DIST_EPSILON ) / ( d1 - d2 ); // nudged fraction
-			}
-		}
-		else if( f < 0 ) {   // leave
-			f = d1 / f;
-			if( f < leavefrac ) {
-				leavefrac = f;
-			}
-		}
+		__m128 crosses = _mm_or_ps( d1_out, d2_out );
+		__m128 denom = _mm_sub_ps( d1, d2 );
+		__m128 enter = _mm_and_ps( crosses, _mm_cmpgt_ps( denom, zero ) );
+		__m128 leave = _mm_and_ps( crosses, _mm_cmplt_ps( denom, zero ) );
+		denom = Select( _mm_or_ps( enter, leave ), denom, one );
+
+		__m128 f = _mm_div_ps( d1, denom );
+		__m128 f2 = _mm_div_ps( _mm_sub_ps( d1, _mm_set1_ps( DIST_EPSILON ) ), denom ); // nudged fraction
+
+		__m128 later_enter = _mm_and_ps( enter, _mm_cmpgt_ps( f, enterfrac ) );
+		enterfrac = Select( later_enter, f, enterfrac );
+		enterfrac2 = Select( later_enter, f2, enterfrac2 );
+		enterside = Select( later_enter, side_idx, enterside );
+
+		__m128 earlier_leave = _mm_and_ps( leave, _mm_cmplt_ps( f, leavefrac ) );
+		leavefrac = Select( earlier_leave, f, leavefrac );
+
+		side_idx = _mm_add_ps( side_idx, _mm_set1_ps( 4.0f ) );
 	}
 
 	if( !startout ) {
@@ -529,41 +651,62 @@ static void CM_ClipBoxToBrush( traceWork_t *tw, const cbrush_t *brush ) {
 		return;
 	}
 
-	if( enterfrac <= -1 || enterfrac > leavefrac ) {
+	float lane_enterfrac[ 4 ], lane_enterfrac2[ 4 ], lane_enterside[ 4 ], lane_leavefrac[ 4 ];
+	_mm_storeu_ps( lane_enterfrac, enterfrac );
+	_mm_storeu_ps( lane_enterfrac2, enterfrac2 );
+	_mm_storeu_ps( lane_enterside, enterside );
+	_mm_storeu_ps( lane_leavefrac, leavefrac );
+
+	int best = 0;
+	float leave = lane_leavefrac[ 0 ];
+	for( int i = 1; i < 4; i++ ) {
+		if( lane_enterfrac[ i ] > lane_enterfrac[ best ] || ( lane_enterfrac[ i ] == lane_enterfrac[ best ] && lane_enterside[ i ] < lane_enterside[ best ] ) ) {
+			best = i;
+		}
+		leave = Min2( leave, lane_leavefrac[ i ] );
+	}
+
+	float enter = lane_enterfrac[ best ];
+	if( enter <= -1 || enter > leave ) {
 		return;
 	}
 
 	// check if this will reduce the collision time range
-	if( enterfrac < tw->realfraction ) {
-		if( enterfrac2 < tw->trace->fraction ) {
-			tw->realfraction = enterfrac;
-			tw->trace->plane = *clipplane;
+	if( enter < tw->realfraction ) {
+		if( lane_enterfrac2[ best ] < tw->trace->fraction ) {
+			const cbrushside_t * leadside = &brush->brushsides[ int( lane_enterside[ best ] ) ];
+			tw->realfraction = enter;
+			tw->trace->plane = leadside->plane;
 			tw->trace->surfFlags = leadside->surfFlags;
 			tw->trace->contents = brush->contents;
-			tw->trace->fraction = enterfrac2;
+			tw->trace->fraction = lane_enterfrac2[ best ];
 		}
 	}
 }
 
-static void CM_TestBoxInBrush( traceWork_t *tw, const cbrush_t *brush ) {
+template< typename TraceShape >
+static void CM_TestShapeInBrush( traceWork_t *tw, const cbrush_t *brush ) {
 	ZoneScoped;
 
 	if( !brush->numsides ) {
 		return;
 	}
 
-	const cbrushside_t * side = brush->brushsides;
-	for( int i = 0; i < brush->numsides; i++, side++ ) {
-		const cplane_t * p = &side->plane;
+	const __m128 start_x = _mm_set1_ps( tw->start.x );
+	const __m128 start_y = _mm_set1_ps( tw->start.y );
+	const __m128 start_z = _mm_set1_ps( tw->start.z );
+	const TraceShape shape( tw );
 
-		Vec3 offset;
-		for( int j = 0; j < 3; j++ ) {
-			offset[ j ] = p->normal[ j ] < 0 ? tw->maxs[ j ] : tw->mins[ j ];
-		}
+	for( int i = 0; i < brush->numsides; i += 4 ) {
+		const float * group = brush->simd_planes + i * 4;
+		__m128 normal_x = _mm_loadu_ps( group + 0 );
+		__m128 normal_y = _mm_loadu_ps( group + 4 );
+		__m128 normal_z = _mm_loadu_ps( group + 8 );
+		__m128 dist = _mm_loadu_ps( group + 12 );
 
-		Vec3 start_offset = tw->start + offset;
+		__m128 d = shape.PlaneDistance( normal_x, normal_y, normal_z, start_x, start_y, start_z );
 
-		if( Dot( p->normal, start_offset ) > p->dist ) {
+		if( _mm_movemask_ps( _mm_cmpgt_ps( d, dist ) ) != 0 ) {
 			return;
 		}
 	}
@@ -637,12 +780,163 @@ static void CM_CollideBox( traceWork_t *tw, const int *markbrushes, int nummarkb
 	}
 }
 
+/*
+* CM_CollideBVH
+*
+* same as CM_CollideBox but walks a BVH instead of testing every brush/patch
+*/
+#define BVH_STACK_SIZE 64
+
+/*
+* CM_OverlappingBVHItems
+*
+* Returns a bitmask of which of a leaf node's items touch the trace box
+*/
+static inline int CM_OverlappingBVHItems( const traceWork_t *tw, const CollisionBVHNode * node ) {
+	const CollisionModel * cms = tw->cms;
+	size_t stride = cms->map_bvh_item_bounds_stride;
+	const float * bounds = cms->map_bvh_item_bounds + node->first;
+
+	__m128 overlap = _mm_cmple_ps( _mm_loadu_ps( bounds ), _mm_set1_ps( tw->absmaxs.x ) );
+	overlap = _mm_and_ps( overlap, _mm_cmple_ps( _mm_loadu_ps( bounds + stride ), _mm_set1_ps( tw->absmaxs.y ) ) );
+	overlap = _mm_and_ps( overlap, _mm_cmple_ps( _mm_loadu_ps( bounds + stride * 2 ), _mm_set1_ps( tw->absmaxs.z ) ) );
+	overlap = _mm_and_ps( overlap, _mm_cmpge_ps( _mm_loadu_ps( bounds + stride * 3 ), _mm_set1_ps( tw->absmins.x ) ) );
+	overlap = _mm_and_ps( overlap, _mm_cmpge_ps( _mm_loadu_ps( bounds + stride * 4 ), _mm_set1_ps( tw->absmins.y ) ) );
+	overlap = _mm_and_ps( overlap, _mm_cmpge_ps( _mm_loadu_ps( bounds + stride * 5 ), _mm_set1_ps( tw->absmins.z ) ) );
+
+	return _mm_movemask_ps( overlap ) & ( ( 1 << node->num_items ) - 1 );
+}
+
+static void CM_CollidePatchBVH( traceWork_t *tw, const cface_t *patch, void ( *func )( traceWork_t *, const cbrush_t *b ) ) {
+	const CollisionModel * cms = tw->cms;
+
+	u32 stack[ BVH_STACK_SIZE ];
+	size_t stack_size = 0;
+	stack[ stack_size++ ] = patch->bvh_root;
+
+	while( stack_size > 0 ) {
+		const CollisionBVHNode * node = &cms->map_bvh_nodes[ stack[ --stack_size ] ];
+		if( !BoundsOverlap( node->mins, node->maxs, tw->absmins, tw->absmaxs ) ) {
+			continue;
+		}
+
+		if( node->num_items == 0 ) {
+			assert( stack_size + 2 <= BVH_STACK_SIZE );
+			stack[ stack_size++ ] = node->first + 1;
+			stack[ stack_size++ ] = node->first;
+			continue;
+		}
+
+		int overlapping = CM_OverlappingBVHItems( tw, node );
+		for( u32 i = 0; i < node->num_items; i++ ) {
+			if( ( overlapping & ( 1 << i ) ) == 0 ) {
+				continue;
+			}
+
+			const cbrush_t * facet = &patch->facets[ cms->map_bvh_items[ node->first + i ] ];
+			func( tw, facet );
+			if( !tw->trace->fraction ) {
+				return;
+			}
+		}
+	}
+}
+
+static void CM_CollideBVH( traceWork_t *tw, int root, void ( *func )( traceWork_t *, const cbrush_t *b ) ) {
+	ZoneScoped;
+
+	if( root < 0 ) {
+		return;
+	}
+
+	const CollisionModel * cms = tw->cms;
+	const cbrush_t *brushes = tw->brushes;
+	const cface_t *faces = tw->faces;
+	int checkcount = tw->checkcount;
+
+	u32 stack[ BVH_STACK_SIZE ];
+	size_t stack_size = 0;
+	stack[ stack_size++ ] = root;
+
+	while( stack_size > 0 ) {
+		const CollisionBVHNode * node = &cms->map_bvh_nodes[ stack[ --stack_size ] ];
+		if( !BoundsOverlap( node->mins, node->maxs, tw->absmins, tw->absmaxs ) ) {
+			continue;
+		}
+
+		if( node->num_items == 0 ) {
+			assert( stack_size + 2 <= BVH_STACK_SIZE );
+			stack[ stack_size++ ] = node->first + 1;
+			stack[ stack_size++ ] = node->first;
+			continue;
+		}
+
+		// most items in a visited node don't touch the trace box, so test
+		// their bounds together before touching the brushes
+		int overlapping = CM_OverlappingBVHItems( tw, node );
+		for( u32 i = 0; i < node->num_items; i++ ) {
+			if( ( overlapping & ( 1 << i ) ) == 0 ) {
+				continue;
+			}
+
+			int item = cms->map_bvh_items[ node->first + i ];
+
+			if( item >= 0 ) {
+				const cbrush_t *b = brushes + item;
+
+				if( tw->brush_checkcounts[item] == checkcount ) {
+					continue; // already checked this brush
+				}
+				tw->brush_checkcounts[item] = checkcount;
+
+				if( !( b->contents & tw->contents ) ) {
+					continue;
+				}
+				func( tw, b );
+			} else {
+				int mf = -1 - item;
+				const cface_t *patch = faces + mf;
+
+				if( tw->face_checkcounts[mf] == checkcount ) {
+					continue; // already checked this patch
+				}
+				tw->face_checkcounts[mf] = checkcount;
+
+				if( !( patch->contents & tw->contents ) ) {
+					continue;
+				}
+				CM_CollidePatchBVH( tw, patch, func );
+			}
+
+			if( !tw->trace->fraction ) {
+				return;
+			}
+		}
+	}
+}
+
 static inline void CM_ClipBox( traceWork_t *tw, const int *markbrushes, int nummarkbrushes, const int *markfaces, int nummarkfaces ) {
-	CM_CollideBox( tw, markbrushes, nummarkbrushes, markfaces, nummarkfaces, CM_ClipBoxToBrush );
+	CM_CollideBox( tw, markbrushes, nummarkbrushes, markfaces, nummarkfaces, tw->clip );
 }
 
 static inline void CM_TestBox( traceWork_t *tw, const int *markbrushes, int nummarkbrushes, const int *markfaces, int nummarkfaces ) {
-	CM_CollideBox( tw, markbrushes, nummarkbrushes, markfaces, nummarkfaces, CM_TestBoxInBrush );
+	CM_CollideBox( tw, markbrushes, nummarkbrushes, markfaces, nummarkfaces, tw->test );
+}
+
+static void CM_ClipModel( traceWork_t *tw, const cmodel_t *cmodel ) {
+	if( cmodel->builtin ) {
+		CM_ClipBox( tw, cmodel->markbrushes, cmodel->nummarkbrushes, cmodel->markfaces, cmodel->nummarkfaces );
+	} else {
+		CM_CollideBVH( tw, cmodel->bvh_root, tw->clip );
+	}
+}
+
+static void CM_TestModel( traceWork_t *tw, const cmodel_t *cmodel ) {
+	if( cmodel->builtin ) {
+		CM_TestBox( tw, cmodel->markbrushes, cmodel->nummarkbrushes, cmodel->markfaces, cmodel->nummarkfaces );
+	} else {
+		CM_CollideBVH( tw, cmodel->bvh_root, tw->test );
+	}
 }
 
 static void CM_RecursiveHullCheck( traceWork_t *tw, int num, float p1f, float p2f, Vec3 p1, Vec3 p2 ) {
@@ -658,7 +952,7 @@ static void CM_RecursiveHullCheck( traceWork_t *tw, int num, float p1f, float p2
 
 		leaf = &cms->map_leafs[ -1 - num ];
 		if( leaf->contents & tw->contents ) {
-			CM_ClipBox( tw, leaf->markbrushes, leaf->nummarkbrushes, leaf->markfaces, leaf->nummarkfaces );
+			CM_CollideBVH( tw, leaf->bvh_root, tw->clip );
 		}
 		return;
 	}
@@ -720,9 +1014,9 @@ static void CM_RecursiveHullCheck( traceWork_t *tw, int num, float p1f, float p2
 	CM_RecursiveHullCheck( tw, node->children[ side ^ 1 ], midf, p2f, mid, p2 );
 }
 
-static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, trace_t *tr,
+static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, CollisionCheckCounts *checkcounts, trace_t *tr,
 	Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
-	const cmodel_t *cmodel, Vec3 origin, int brushmask ) {
+	const cmodel_t *cmodel, Vec3 origin, int brushmask, bool capsule = false ) {
 
 	ZoneScoped;
 
@@ -732,12 +1026,16 @@ static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, trace_t *tr,
 	memset( tr, 0, sizeof( *tr ) );
 	tr->fraction = 1;
 
-	cms->checkcount++;  // for multi-check avoidance
-
 	memset( tw, 0, sizeof( *tw ) );
 	// the epsilon considers blockers with realfraction == 1 and nudged fraction < 1
 	tw->realfraction = 1 + DIST_EPSILON;
-	tw->checkcount = cms->checkcount;
+	if( checkcounts != NULL ) {
+		checkcounts->checkcount++;
+		tw->checkcount = checkcounts->checkcount;
+	} else {
+		cms->checkcount++;  // for multi-check avoidance
+		tw->checkcount = cms->checkcount;
+	}
 	tw->trace = tr;
 	tw->contents = brushmask;
 	tw->cms = cms;
@@ -746,6 +1044,20 @@ static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, trace_t *tr,
 	tw->mins = mins;
 	tw->maxs = maxs;
 
+	if( capsule ) {
+		// the biggest vertical capsule that fits in the box
+		Vec3 half = ( maxs - mins ) * 0.5f;
+		tw->capsule_center = ( mins + maxs ) * 0.5f;
+		tw->capsule_radius = Min2( Min2( half.x, half.y ), half.z );
+		tw->capsule_halfheight = half.z - tw->capsule_radius;
+		tw->clip = CM_ClipShapeToBrush< CapsuleTraceShape >;
+		tw->test = CM_TestShapeInBrush< CapsuleTraceShape >;
+	}
+	else {
+		tw->clip = CM_ClipShapeToBrush< BoxTraceShape >;
+		tw->test = CM_TestShapeInBrush< BoxTraceShape >;
+	}
+
 	// build a bounding box of the entire move
 	Vec3 startmins = start + tw->mins;
 	Vec3 startmaxs = start + tw->maxs;
@@ -761,12 +1073,12 @@ static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, trace_t *tr,
 	tw->brushes = cmodel->brushes;
 	tw->faces = cmodel->faces;
 
-	if( cmodel == cms->oct_cmodel ) {
-		tw->brush_checkcounts = &cms->oct_checkcount;
-		tw->face_checkcounts = NULL;
-	} else if( cmodel == cms->box_cmodel ) {
-		tw->brush_checkcounts = &cms->box_checkcount;
+	if( cmodel->builtin ) {
+		tw->brush_checkcounts = &tw->hull_checkcount;
 		tw->face_checkcounts = NULL;
+	} else if( checkcounts != NULL ) {
+		tw->brush_checkcounts = checkcounts->brushes;
+		tw->face_checkcounts = checkcounts->faces;
 	} else {
 		tw->brush_checkcounts = cms->map_brush_checkcheckouts;
 		tw->face_checkcounts = cms->map_face_checkcheckouts;
@@ -786,7 +1098,7 @@ static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, trace_t *tr,
 				const cleaf_t * leaf = &cms->map_leafs[ leafs[ i ] ];
 
 				if( leaf->contents & brushmask ) {
-					CM_TestBox( tw, leaf->markbrushes, leaf->nummarkbrushes, leaf->markfaces, leaf->nummarkfaces );
+					CM_CollideBVH( tw, leaf->bvh_root, tw->test );
 					if( tr->allsolid ) {
 						break;
 					}
@@ -795,7 +1107,7 @@ static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, trace_t *tr,
 		}
 		else {
 			if( BoundsOverlap( cmodel->mins, cmodel->maxs, tw->absmins, tw->absmaxs ) ) {
-				CM_TestBox( tw, cmodel->markbrushes, cmodel->nummarkbrushes, cmodel->markfaces, cmodel->nummarkfaces );
+				CM_TestModel( tw, cmodel );
 			}
 		}
 
@@ -817,23 +1129,15 @@ static void CM_BoxTrace( traceWork_t *tw, CollisionModel *cms, trace_t *tr,
 		CM_RecursiveHullCheck( tw, 0, 0, 1, start, end );
 	}
 	else if( BoundsOverlap( cmodel->mins, cmodel->maxs, tw->absmins, tw->absmaxs ) ) {
-		CM_ClipBox( tw, cmodel->markbrushes, cmodel->nummarkbrushes, cmodel->markfaces, cmodel->nummarkfaces );
+		CM_ClipModel( tw, cmodel );
 	}
 
 	tr->fraction = Clamp01( tr->fraction );
 	tr->endpos = Lerp( start, tr->fraction, end );
 }
 
-/*
-* CM_TransformedBoxTrace
-*
-* Handles offseting and rotation of the end points for moving and
-* rotating entities
-*/
-void CM_TransformedBoxTrace( CModelServerOrClient soc, CollisionModel * cms, trace_t * tr, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
-							 const cmodel_t *cmodel, int brushmask, Vec3 origin, Vec3 angles ) {
-	ZoneScoped;
-
+static void CM_TransformedTrace( CModelServerOrClient soc, CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * tr, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
+							 const cmodel_t *cmodel, int brushmask, Vec3 origin, Vec3 angles, bool capsule ) {
 	Vec3 start_l, end_l;
 	Vec3 a, temp;
 	mat3_t axis;
@@ -881,7 +1185,7 @@ void CM_TransformedBoxTrace( CModelServerOrClient soc, CollisionModel * cms, tra
 	}
 
 	// sweep the box through the model
-	CM_BoxTrace( &tw, cms, tr, start_l, end_l, mins, maxs, cmodel, origin, brushmask );
+	CM_BoxTrace( &tw, cms, checkcounts, tr, start_l, end_l, mins, maxs, cmodel, origin, brushmask, capsule );
 
 	if( rotated && tr->fraction != 1.0 ) {
 		a = -angles;
@@ -893,3 +1197,57 @@ void CM_TransformedBoxTrace( CModelServerOrClient soc, CollisionModel * cms, tra
 
 	tr->endpos = Lerp( start, tr->fraction, end );
 }
+
+/*
+* CM_TransformedBoxTrace
+*
+* Handles offseting and rotation of the end points for moving and
+* rotating entities. pass NULL checkcounts to use the ones owned by cms
+* on the main thread
+*/
+void CM_TransformedBoxTrace( CModelServerOrClient soc, CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * tr, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
+							 const cmodel_t *cmodel, int brushmask, Vec3 origin, Vec3 angles ) {
+	ZoneScoped;
+	CM_TransformedTrace( soc, cms, checkcounts, tr, start, end, mins, maxs, cmodel, brushmask, origin, angles, false );
+}
+
+/*
+* CM_TransformedCapsuleTrace
+*
+* Same as CM_TransformedBoxTrace but sweeps the biggest vertical capsule
+* that fits in mins/maxs. patches are facet brushes so they go through the
+* same kernel
+*/
+void CM_TransformedCapsuleTrace( CModelServerOrClient soc, CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * tr, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
+							 const cmodel_t *cmodel, int brushmask, Vec3 origin, Vec3 angles ) {
+	ZoneScoped;
+	CM_TransformedTrace( soc, cms, checkcounts, tr, start, end, mins, maxs, cmodel, brushmask, origin, angles, true );
+}
+
+CollisionCheckCounts CM_NewCheckCounts( Allocator * a, const CollisionModel * cms ) {
+	CollisionCheckCounts checkcounts;
+	checkcounts.checkcount = 0;
+	checkcounts.brushes = ALLOC_MANY( a, int, cms->numbrushes );
+	checkcounts.faces = ALLOC_MANY( a, int, cms->numfaces );
+	memset( checkcounts.brushes, 0, cms->numbrushes * sizeof( int ) );
+	memset( checkcounts.faces, 0, cms->numfaces * sizeof( int ) );
+	return checkcounts;
+}
+
+/*
+* CM_WorldBoxTrace
+*
+* The world is never modified after loading, so this is safe to call from
+* the thread pool as long as each thread brings its own checkcounts. the
+* same goes for CM_TransformedBoxTrace against inline models
+*/
+void CM_WorldBoxTrace( CModelServerOrClient soc, CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * tr,
+		Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs, int brushmask ) {
+	ZoneScoped;
+
+	const cmodel_t * world = CM_FindCModel( soc, StringHash( cms->world_hash ) );
+
+	traceWork_t tw;
+	CM_BoxTrace( &tw, cms, checkcounts, tr, start, end, mins, maxs, world, Vec3( 0.0f ), brushmask );
+	tr->endpos = Lerp( start, tr->fraction, end );
+}
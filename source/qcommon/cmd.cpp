@@ -17,13 +17,16 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
-#include <algorithm> // std::sort
+#include <algorithm> // std::sort, std::lower_bound
 
 #include "qcommon/qcommon.h"
 #include "qcommon/array.h"
+#include "qcommon/dynamic_hashtable.h"
 #include "qcommon/fs.h"
+#include "qcommon/glob.h"
+#include "qcommon/hash.h"
+#include "qcommon/mpsc_queue.h"
 #include "qcommon/string.h"
-#include "qcommon/q_trie.h"
 
 static bool cmd_preinitialized = false;
 static bool cmd_initialized = false;
@@ -53,6 +56,9 @@ static mempool_t *cbuf_pool;
 #define Cbuf_Malloc( size ) Mem_Alloc( cbuf_pool, size )
 #define Cbuf_Free( data ) Mem_Free( data )
 
+// text from other threads, copied with sys_allocator
+static MPSCQueue< char *, 1024 > cbuf_queue;
+
 /*
 * Cbuf_Init
 */
@@ -77,6 +83,11 @@ void Cbuf_Shutdown() {
 		return;
 	}
 
+	char * text;
+	while( cbuf_queue.pop( &text ) ) {
+		FREE( sys_allocator, text );
+	}
+
 	Cbuf_Free( cbuf_text );
 	cbuf_text = NULL;
 	cbuf_text_size = 0;
@@ -175,6 +186,23 @@ void Cbuf_AddText( const char *text ) {
 	}
 }
 
+bool Cbuf_QueueText( const char * text ) {
+	char * copy = CopyString( sys_allocator, text );
+	if( !cbuf_queue.push( copy ) ) {
+		FREE( sys_allocator, copy );
+		return false;
+	}
+	return true;
+}
+
+static void Cbuf_DrainQueue() {
+	char * text;
+	while( cbuf_queue.pop( &text ) ) {
+		Cbuf_AddText( text );
+		FREE( sys_allocator, text );
+	}
+}
+
 /*
 * Cbuf_InsertText
 *
@@ -229,6 +257,8 @@ void Cbuf_Execute() {
 	char line[MAX_STRING_CHARS];
 	bool quotes, quoteskip;
 
+	Cbuf_DrainQueue();
+
 	while( cbuf_text_tail != cbuf_text_head ) {
 		// find a \n or ; line break
 		i = 0;
@@ -444,11 +474,33 @@ static size_t cmd_argv_sizes[MAX_STRING_TOKENS];
 static char cmd_null_string[] = "";
 static char cmd_args[MAX_STRING_CHARS];
 
-static trie_t *cmd_function_trie = NULL;
+/*
+ * commands are looked up by CaseInsensitiveHash64( name ), and also kept
+ * sorted by name for cmdlist and tab completion
+ */
+static NonRAIIDynamicHashtable cmd_functions;
+static NonRAIIDynamicArray< cmd_function_t * > cmds_by_name;
 
-static int Cmd_PatternMatchesFunction( void *cmd, const void *pattern ) {
-	assert( cmd );
-	return !pattern || Com_GlobMatch( (const char *) pattern, ( (cmd_function_t *) cmd )->name, false );
+static cmd_function_t * Cmd_Find( const char * cmd_name ) {
+	u64 cmd;
+	if( !cmd_functions.get( CaseInsensitiveHash64( cmd_name ), &cmd ) )
+		return NULL;
+	return ( cmd_function_t * ) uintptr_t( cmd );
+}
+
+static bool Cmd_NameLess( const cmd_function_t * cmd, const char * name ) {
+	return Q_stricmp( cmd->name, name ) < 0;
+}
+
+// the commands that start with partial
+static Span< cmd_function_t * > Cmd_PrefixMatches( const char * partial ) {
+	size_t partial_len = strlen( partial );
+	cmd_function_t ** first = std::lower_bound( cmds_by_name.begin(), cmds_by_name.end(), partial, Cmd_NameLess );
+	cmd_function_t ** last = first;
+	while( last != cmds_by_name.end() && Q_strnicmp( ( *last )->name, partial, partial_len ) == 0 ) {
+		last++;
+	}
+	return Span< cmd_function_t * >( first, last - first );
 }
 
 // The functions that execute commands get their parameters with these
@@ -570,9 +622,12 @@ void Cmd_AddCommand( const char *cmd_name, xcommand_t function ) {
 	}
 
 	// fail if the command already exists
-	assert( cmd_function_trie );
 	assert( cmd_name );
-	if( Trie_Find( cmd_function_trie, cmd_name, TRIE_EXACT_MATCH, (void **)&cmd ) == TRIE_OK ) {
+	cmd = Cmd_Find( cmd_name );
+	if( cmd != NULL ) {
+		if( Q_stricmp( cmd->name, cmd_name ) != 0 ) {
+			Fatal( "Command name hash collision: %s and %s", cmd->name, cmd_name );
+		}
 		cmd->function = function;
 		cmd->completion_func = NULL;
 		Com_DPrintf( "Cmd_AddCommand: %s already defined\n", cmd_name );
@@ -584,7 +639,12 @@ void Cmd_AddCommand( const char *cmd_name, xcommand_t function ) {
 	strcpy( cmd->name, cmd_name );
 	cmd->function = function;
 	cmd->completion_func = NULL;
-	Trie_Insert( cmd_function_trie, cmd_name, cmd );
+	cmd_functions.add( CaseInsensitiveHash64( cmd_name ), uintptr_t( cmd ) );
+
+	size_t idx = std::lower_bound( cmds_by_name.begin(), cmds_by_name.end(), cmd_name, Cmd_NameLess ) - cmds_by_name.begin();
+	cmds_by_name.extend( 1 );
+	memmove( cmds_by_name.begin() + idx + 1, cmds_by_name.begin() + idx, ( cmds_by_name.size() - idx - 1 ) * sizeof( cmd_function_t * ) );
+	cmds_by_name[ idx ] = cmd;
 }
 
 /*
@@ -597,13 +657,21 @@ void Cmd_RemoveCommand( const char *cmd_name ) {
 		return;
 	}
 
-	assert( cmd_function_trie );
 	assert( cmd_name );
-	if( Trie_Remove( cmd_function_trie, cmd_name, (void **)&cmd ) == TRIE_OK ) {
-		Mem_ZoneFree( cmd );
-	} else {
+	cmd = Cmd_Find( cmd_name );
+	if( cmd == NULL ) {
 		Com_Printf( "Cmd_RemoveCommand: %s not added\n", cmd_name );
+		return;
 	}
+
+	cmd_functions.remove( CaseInsensitiveHash64( cmd_name ) );
+
+	size_t idx = std::lower_bound( cmds_by_name.begin(), cmds_by_name.end(), cmd->name, Cmd_NameLess ) - cmds_by_name.begin();
+	assert( cmds_by_name[ idx ] == cmd );
+	memmove( cmds_by_name.begin() + idx, cmds_by_name.begin() + idx + 1, ( cmds_by_name.size() - idx - 1 ) * sizeof( cmd_function_t * ) );
+	cmds_by_name.resize( cmds_by_name.size() - 1 );
+
+	Mem_ZoneFree( cmd );
 }
 
 /*
@@ -611,11 +679,8 @@ void Cmd_RemoveCommand( const char *cmd_name ) {
 * used by the cvar code to check for cvar / command name overlap
 */
 bool Cmd_Exists( const char *cmd_name ) {
-	cmd_function_t *cmd;
-
-	assert( cmd_function_trie );
 	assert( cmd_name );
-	return Trie_Find( cmd_function_trie, cmd_name, TRIE_EXACT_MATCH, (void **)&cmd ) == TRIE_OK;
+	return Cmd_Find( cmd_name ) != NULL;
 }
 
 /*
@@ -629,7 +694,8 @@ void Cmd_SetCompletionFunc( const char *cmd_name, xcompletionf_t completion_func
 		return;
 	}
 
-	if( Trie_Find( cmd_function_trie, cmd_name, TRIE_EXACT_MATCH, (void **)&cmd ) == TRIE_OK ) {
+	cmd = Cmd_Find( cmd_name );
+	if( cmd != NULL ) {
 		cmd->completion_func = completion_func;
 		return;
 	}
@@ -645,10 +711,7 @@ int Cmd_CompleteCountPossible( const char *partial ) {
 	if( !partial[0] ) {
 		return 0;
 	} else {
-		unsigned int matches;
-		assert( cmd_function_trie );
-		Trie_NoOfMatches( cmd_function_trie, partial, &matches );
-		return matches;
+		return int( Cmd_PrefixMatches( partial ).n );
 	}
 }
 
@@ -656,18 +719,13 @@ int Cmd_CompleteCountPossible( const char *partial ) {
 * Cmd_CompleteBuildList
 */
 const char **Cmd_CompleteBuildList( const char *partial ) {
-	trie_dump_t *dump;
-	const char **buf;
-	unsigned int i;
-
-	assert( cmd_function_trie );
 	assert( partial );
-	Trie_Dump( cmd_function_trie, partial, TRIE_DUMP_VALUES, &dump );
-	buf = (const char **) Mem_TempMalloc( sizeof( char * ) * ( dump->size + 1 ) );
-	for( i = 0; i < dump->size; ++i )
-		buf[i] = ( (cmd_function_t *) ( dump->key_value_vector[i].value ) )->name;
-	buf[dump->size] = NULL;
-	Trie_FreeDump( dump );
+	Span< cmd_function_t * > matches = Cmd_PrefixMatches( partial );
+	const char ** buf = (const char **) Mem_TempMalloc( sizeof( char * ) * ( matches.n + 1 ) );
+	for( size_t i = 0; i < matches.n; i++ ) {
+		buf[ i ] = matches[ i ]->name;
+	}
+	buf[ matches.n ] = NULL;
 	return buf;
 }
 
@@ -677,9 +735,8 @@ const char **Cmd_CompleteBuildList( const char *partial ) {
 * Find a possible single matching command
 */
 const char **Cmd_CompleteBuildArgListExt( const char *command, const char *arguments ) {
-	cmd_function_t *cmd = NULL;
-
-	if( Trie_Find( cmd_function_trie, command, TRIE_EXACT_MATCH, (void **)&cmd ) != TRIE_OK ) {
+	const cmd_function_t * cmd = Cmd_Find( command );
+	if( cmd == NULL ) {
 		return NULL;
 	}
 	if( cmd->completion_func ) {
@@ -829,8 +886,8 @@ void Cmd_ExecuteString( const char *text ) {
 	// that does not break seperation of concerns.
 	// Aiwa, 07-14-2006
 
-	assert( cmd_function_trie );
-	if( Trie_Find( cmd_function_trie, str, TRIE_EXACT_MATCH, (void **)&cmd ) == TRIE_OK ) {
+	cmd = Cmd_Find( str );
+	if( cmd != NULL ) {
 		// check functions
 		if( !cmd->function ) {
 			// forward to server command
@@ -849,25 +906,21 @@ void Cmd_ExecuteString( const char *text ) {
 * Cmd_List_f
 */
 static void Cmd_List_f() {
-	trie_dump_t *dump = NULL;
-	unsigned int i;
-	char *pattern;
-
-	if( Cmd_Argc() == 1 ) {
-		pattern = NULL; // no wildcard
-	} else {
-		pattern = Cmd_Args();
+	bool filter = Cmd_Argc() > 1;
+	GlobPattern pattern = { };
+	if( filter ) {
+		pattern = CompileGlob( Cmd_Args(), false );
 	}
 
 	Com_Printf( "\nCommands:\n" );
-	assert( cmd_function_trie );
-	Trie_DumpIf( cmd_function_trie, "", TRIE_DUMP_VALUES, Cmd_PatternMatchesFunction, pattern, &dump );
-	for( i = 0; i < dump->size; ++i ) {
-		cmd_function_t *const cmd = (cmd_function_t *) dump->key_value_vector[i].value;
-		Com_Printf( "%s\n", cmd->name );
+	int n = 0;
+	for( const cmd_function_t * cmd : cmds_by_name ) {
+		if( !filter || GlobMatch( pattern, cmd->name ) ) {
+			Com_Printf( "%s\n", cmd->name );
+			n++;
+		}
 	}
-	Trie_FreeDump( dump );
-	Com_Printf( "%i commands\n", i );
+	Com_Printf( "%i commands\n", n );
 }
 
 /*
@@ -877,9 +930,8 @@ void Cmd_PreInit() {
 	assert( !cmd_preinitialized );
 	assert( !cmd_initialized );
 
-	assert( !cmd_function_trie );
-
-	Trie_Create( TRIE_CASE_INSENSITIVE, &cmd_function_trie );
+	cmd_functions.init( sys_allocator );
+	cmds_by_name.init( sys_allocator );
 
 	cmd_preinitialized = true;
 }
@@ -891,8 +943,6 @@ void Cmd_Init() {
 	assert( !cmd_initialized );
 	assert( cmd_preinitialized );
 
-	assert( cmd_function_trie );
-
 	//
 	// register our commands
 	//
@@ -907,36 +957,30 @@ void Cmd_Init() {
 
 void Cmd_Shutdown() {
 	if( cmd_initialized ) {
-		unsigned int i;
-		trie_dump_t *dump;
-
-		assert( cmd_function_trie );
-
 		Cmd_RemoveCommand( "cmdlist" );
 		Cmd_RemoveCommand( "exec" );
 		Cmd_RemoveCommand( "config" );
 
 		// this is somewhat ugly IMO
-		for( i = 0; i < MAX_STRING_TOKENS && cmd_argv_sizes[i]; i++ ) {
+		for( int i = 0; i < MAX_STRING_TOKENS && cmd_argv_sizes[i]; i++ ) {
 			FREE( sys_allocator, cmd_argv[i] );
 			cmd_argv_sizes[i] = 0;
 		}
 
-		Trie_Dump( cmd_function_trie, "", TRIE_DUMP_VALUES, &dump );
-		for( i = 0; i < dump->size; ++i ) {
+		while( cmds_by_name.size() > 0 ) {
+			const char * name = cmds_by_name.top()->name;
 #ifndef PUBLIC_BUILD
-			Com_Printf( "Warning: Command %s was never removed\n",
-						( (cmd_function_t *)dump->key_value_vector[i].value )->name );
+			Com_Printf( "Warning: Command %s was never removed\n", name );
 #endif
-			Cmd_RemoveCommand( ( (cmd_function_t *)dump->key_value_vector[i].value )->name );
+			Cmd_RemoveCommand( name );
 		}
-		Trie_FreeDump( dump );
 
 		cmd_initialized = false;
 	}
 
 	if( cmd_preinitialized ) {
-		Trie_Destroy( cmd_function_trie );
+		cmd_functions.shutdown();
+		cmds_by_name.shutdown();
 
 		cmd_preinitialized = false;
 	}
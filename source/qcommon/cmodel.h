@@ -24,6 +24,7 @@
 #include "qcommon/hash.h"
 
 #define MAX_CM_LEAFS        ( MAX_MAP_LEAFS )
+#define PVS_CACHE_ROWS      8
 
 struct cshaderref_t {
 	int contents;
@@ -48,6 +49,10 @@ struct cbrush_t {
 	Vec3 mins, maxs;
 
 	cbrushside_t *brushsides;
+
+	// the side planes in groups of 4 as { x[4], y[4], z[4], dist[4] } for
+	// the SIMD clipping code, padded out with planes nothing can be in front of
+	float *simd_planes;
 };
 
 struct cface_t {
@@ -57,12 +62,25 @@ struct cface_t {
 	Vec3 mins, maxs;
 
 	cbrush_t *facets;
+
+	int bvh_root; // over the facets
+};
+
+// leaf/inline model BVHs point at brushes, or patches as -1 - face, patch
+// BVHs point at facets. leaf nodes own num_items entries of map_bvh_items
+// starting at first, other nodes have their children at first and first + 1
+struct CollisionBVHNode {
+	Vec3 mins, maxs;
+	u32 first;
+	u32 num_items;
 };
 
 struct cleaf_t {
 	int contents;
 	int cluster;
 
+	Vec3 mins, maxs;
+
 	int area;
 
 	int nummarkbrushes;
@@ -70,6 +88,8 @@ struct cleaf_t {
 
 	int *markbrushes;
 	int *markfaces;
+
+	int bvh_root; // -1 if empty
 };
 
 struct cmodel_t {
@@ -91,6 +111,8 @@ struct cmodel_t {
 	// which treats brush models as leafs
 	int *markfaces;
 	int *markbrushes;
+
+	int bvh_root; // -1 if empty or builtin
 };
 
 struct carea_t {
@@ -98,12 +120,22 @@ struct carea_t {
 	int floodvalid;
 };
 
+enum CModelServerOrClient {
+	CM_Client,
+	CM_Server,
+};
+
 struct CollisionModel {
 	u64 base_hash;
 	u64 world_hash;
 
+	// everything loaded from the BSP is shared by every CollisionModel made
+	// with CM_ShareMap and freed along with the last one. NULL until loaded
+	int *refcount;
+
 	int checkcount;
 	int floodvalid;
+	int numfloods;                  // 1 if every area is connected
 
 	u32 checksum;
 
@@ -127,10 +159,12 @@ struct CollisionModel {
 	int *map_markbrushes;
 
 	u32 num_models;
+	cmodel_t * unregistered_cmodels; // from CM_ParseMap, NULL once CM_RegisterMap adds them to the cmodels
 	Vec3 world_mins, world_maxs;
 
 	int numbrushes;
 	cbrush_t *map_brushes;
+	float *map_brush_planes;
 
 	int numfaces;
 	cface_t *map_faces;
@@ -138,6 +172,17 @@ struct CollisionModel {
 	int nummarkfaces;
 	int *map_markfaces;
 
+	// facets point into this when they were loaded from the collision cache
+	u8 *map_baked_facets;
+
+	CollisionBVHNode *map_bvh_nodes;
+	int *map_bvh_items;
+
+	// item mins xyz then maxs xyz, map_bvh_item_bounds_stride floats each,
+	// so a leaf node's items can be tested against the trace box together
+	float *map_bvh_item_bounds;
+	size_t map_bvh_item_bounds_stride;
+
 	Vec3 *map_verts;              // this will be freed
 	int numvertexes;
 
@@ -149,8 +194,28 @@ struct CollisionModel {
 	carea_t *map_areas;             // = &map_area_empty;
 	int *map_areaportals;
 
-	dvis_t *map_pvs;
+	// the vis lump is mostly zeros, so rows are stored zero run length
+	// encoded and CM_ClusterPVS decompresses them into a small LRU
 	int map_visdatasize;
+	int map_numclusters;
+	int map_pvs_rowsize;
+	uint8_t *map_pvs_rle;
+	u32 *map_pvs_rle_offsets;       // [numclusters + 1], into map_pvs_rle
+	uint8_t *map_pvs_cache_rows;    // [PVS_CACHE_ROWS], 16 byte aligned
+	int map_pvs_cache_clusters[PVS_CACHE_ROWS];
+	u32 map_pvs_cache_used[PVS_CACHE_ROWS];
+	u32 map_pvs_cache_clock;
+
+	// everything that can be seen from anywhere near a cluster, for snapshot
+	// culling. neighbouring clusters mostly end up with identical rows, so
+	// they're deduplicated
+	int *map_cluster_fatpvs;        // [numclusters], index into map_fatpvs
+	uint8_t *map_fatpvs;
+	int num_fatpvs_rows;
+
+	// CM_WriteAreaBits output, rebuilt whenever an areaportal changes state.
+	// a row of BitSetWords( numareas ) words per area
+	u64 *map_areabits;
 
 	uint8_t nullrow[MAX_CM_LEAFS / 8];
 
@@ -163,26 +228,39 @@ struct CollisionModel {
 	// cm_trace.c
 	cbrushside_t box_brushsides[6];
 	cbrush_t box_brush[1];
+	float box_planes[2 * 16];
 	int box_markbrushes[1];
 	cmodel_t box_cmodel[1];
-	int box_checkcount;
 
 	cbrushside_t oct_brushsides[10];
 	cbrush_t oct_brush[1];
+	float oct_planes[3 * 16];
 	int oct_markbrushes[1];
 	cmodel_t oct_cmodel[1];
-	int oct_checkcount;
 
 	int *map_brush_checkcheckouts;
 	int *map_face_checkcheckouts;
 };
 
-enum CModelServerOrClient {
-	CM_Client,
-	CM_Server,
-};
-
 CollisionModel * CM_LoadMap( CModelServerOrClient soc, Span< const u8 > data, u64 base_hash );
+
+/*
+ * CM_LoadMap split in two. CM_ParseMap only touches the CollisionModel it
+ * makes, so it can run on the thread pool while the game keeps tracing
+ * against the current map. the submodels go in the server or client cmodels
+ * with CM_RegisterMap, which has to run on the thread that uses them. an
+ * unregistered map can still be freed with CM_Free
+ */
+CollisionModel * CM_ParseMap( Span< const u8 > data, u64 base_hash );
+void CM_RegisterMap( CModelServerOrClient soc, CollisionModel * cms );
+
+/*
+ * makes a CollisionModel for soc that shares the map data with cms, so a
+ * listen server doesn't load and keep a second copy of the client's map.
+ * the areaportal state, PVS cache and trace check counts still get their own
+ * copies, so either side can trace without disturbing the other
+ */
+CollisionModel * CM_ShareMap( CModelServerOrClient soc, CModelServerOrClient from, const CollisionModel * cms );
 void CM_Free( CModelServerOrClient soc,  CollisionModel * cms );
 
 cmodel_t * CM_FindCModel( CModelServerOrClient soc, StringHash hash );
@@ -199,12 +277,28 @@ size_t CM_EntityStringLen( const CollisionModel *cms );
 cmodel_t *CM_ModelForBBox( CollisionModel *cms, Vec3 mins, Vec3 maxs );
 cmodel_t *CM_OctagonModelForBBox( CollisionModel *cms, Vec3 mins, Vec3 maxs );
 void CM_InlineModelBounds( const CollisionModel *cms, const cmodel_t *cmodel, Vec3 * mins, Vec3 * maxs );
+bool CM_InlineModelBox( const CollisionModel *cms, const cmodel_t *cmodel, MinMax3 * box );
 
 // returns an ORed contents mask
 int CM_TransformedPointContents( CModelServerOrClient soc, CollisionModel * cms, Vec3 p, cmodel_t *cmodel, Vec3 origin, Vec3 angles );
 
-void CM_TransformedBoxTrace( CModelServerOrClient soc, CollisionModel * cms, trace_t * tr, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
+// brush/patch dedupe state for tracing off the main thread. box and
+// octagon hulls get rebuilt in place by CM_ModelForBBox, so tracing against
+// those is still main thread only
+struct CollisionCheckCounts {
+	int checkcount;
+	int * brushes;
+	int * faces;
+};
+
+void CM_TransformedBoxTrace( CModelServerOrClient soc, CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * tr, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
 							 const cmodel_t *cmodel, int brushmask, Vec3 origin, Vec3 angles );
+void CM_TransformedCapsuleTrace( CModelServerOrClient soc, CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * tr, Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs,
+							 const cmodel_t *cmodel, int brushmask, Vec3 origin, Vec3 angles );
+
+CollisionCheckCounts CM_NewCheckCounts( Allocator * a, const CollisionModel * cms );
+void CM_WorldBoxTrace( CModelServerOrClient soc, CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * tr,
+	Vec3 start, Vec3 end, Vec3 mins, Vec3 maxs, int brushmask );
 
 int CM_ClusterRowSize( const CollisionModel *cms );
 int CM_AreaRowSize( const CollisionModel *cms );
@@ -218,9 +312,12 @@ int CM_LeafCluster( const CollisionModel *cms, int leafnum );
 int CM_LeafArea( const CollisionModel *cms, int leafnum );
 
 void CM_SetAreaPortalState( CollisionModel *cms, int area1, int area2, bool open );
+void CM_ResetAreaPortals( CollisionModel *cms );
 bool CM_AreasConnected( const CollisionModel *cms, int area1, int area2 );
+bool CM_AllAreasConnected( const CollisionModel *cms );
 
-void CM_WriteAreaBits( CollisionModel *cms, uint8_t *buffer );
-bool CM_HeadnodeVisible( CollisionModel *cms, int headnode, uint8_t *visbits );
+void CM_WriteAreaBits( CollisionModel *cms, u64 *buffer );
+bool CM_HeadnodeVisible( CollisionModel *cms, int headnode, const uint8_t *visbits );
+const uint8_t *CM_FatPVS( const CollisionModel *cms, Vec3 org );
 
 void CM_MergePVS( CollisionModel *cms, Vec3 org, uint8_t *out );
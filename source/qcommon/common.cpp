@@ -19,14 +19,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/qcommon.h"
+#include "qcommon/async_io.h"
 #include "qcommon/cmodel.h"
 #include "qcommon/csprng.h"
 #include "qcommon/fpe.h"
 #include "qcommon/fs.h"
 #include "qcommon/glob.h"
+#include "qcommon/load_profile.h"
 #include "qcommon/maplist.h"
+#include "qcommon/memory_budget.h"
 #include "qcommon/threads.h"
 #include "qcommon/version.h"
+#include "qcommon/zone_sampler.h"
 
 #include <errno.h>
 #include <setjmp.h>
@@ -276,6 +280,40 @@ void Com_SetServerState( server_state_t state ) {
 	server_state = state;
 }
 
+/*
+ * dedicated server frame clock
+ *
+ * frames are measured in microseconds but Qcommon_Frame only gets whole
+ * milliseconds, and the remainder carries over to the next frame. so
+ * Com_FrameClock is exactly where the game's millisecond clock is, and the
+ * server can sleep until a deadline relative to it instead of sleeping a
+ * millisecond short and spinning the rest
+ */
+static u64 frame_clock;
+
+void Com_ResetFrameClock() {
+	frame_clock = Sys_Microseconds();
+}
+
+unsigned int Com_WaitForFrame() {
+	ZoneScopedN( "Interframe" );
+
+	while( true ) {
+		u64 now = Sys_Microseconds();
+		u64 msec = ( now - frame_clock ) / 1000;
+		if( msec > 0 ) {
+			frame_clock += msec * 1000;
+			return msec;
+		}
+
+		Sys_SleepMicroseconds( frame_clock + 1000 - now );
+	}
+}
+
+u64 Com_FrameClock() {
+	return frame_clock;
+}
+
 connstate_t Com_ClientState() {
 	return client_state;
 }
@@ -499,6 +537,8 @@ void Qcommon_Init( int argc, char **argv ) {
 
 	com_print_mutex = NewMutex();
 
+	InitLoadProfiler();
+
 	// initialize memory manager
 	Memory_Init();
 
@@ -529,6 +569,7 @@ void Qcommon_Init( int argc, char **argv ) {
 
 	InitFS();
 	FS_Init();
+	InitAsyncIO();
 
 	if( !is_dedicated_server ) {
 		ExecDefaultCfg();
@@ -561,6 +602,9 @@ void Qcommon_Init( int argc, char **argv ) {
 
 	com_showtrace =     Cvar_Get( "com_showtrace", "0", 0 );
 
+	InitZoneSampler();
+	InitMemoryBudgets();
+
 	Cvar_Get( "gamename", APPLICATION_NOSPACES, CVAR_SERVERINFO | CVAR_READONLY );
 	versioncvar = Cvar_Get( "version", APP_VERSION " " ARCH " " OSNAME, CVAR_SERVERINFO | CVAR_READONLY );
 
@@ -583,7 +627,7 @@ void Qcommon_Init( int argc, char **argv ) {
 * Qcommon_Frame
 */
 void Qcommon_Frame( unsigned int realMsec ) {
-	ZoneScoped;
+	ZoneScopedSampled( "Qcommon_Frame" );
 
 	static unsigned int gameMsec;
 
@@ -591,10 +635,15 @@ void Qcommon_Frame( unsigned int realMsec ) {
 		Com_Quit();
 	}
 
+	SetAllocationProfilerTime( Sys_Milliseconds() );
+
 	if( setjmp( abortframe ) ) {
 		return; // an ERR_DROP was thrown
 	}
 
+	ZoneSamplerFrame();
+	AsyncIOFrame();
+
 	if( logconsole && logconsole->modified ) {
 		logconsole->modified = false;
 		Com_ReopenConsoleLog();
@@ -622,6 +671,8 @@ void Qcommon_Frame( unsigned int realMsec ) {
 
 	SV_Frame( realMsec, gameMsec );
 	CL_Frame( realMsec, gameMsec );
+
+	MemoryBudgetsFrame();
 }
 
 /*
@@ -632,6 +683,10 @@ void Qcommon_Shutdown() {
 	NET_Shutdown();
 	Key_Shutdown();
 
+	ShutdownAsyncIO();
+	ShutdownZoneSampler();
+	ShutdownMemoryBudgets();
+
 	Qcommon_ShutdownCommands();
 	Memory_ShutdownCommands();
 
@@ -647,5 +702,7 @@ void Qcommon_Shutdown() {
 	Cbuf_Shutdown();
 	Memory_Shutdown();
 
+	ShutdownLoadProfiler();
+
 	DeleteMutex( com_print_mutex );
 }
@@ -1,9 +1,48 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/compression.h"
 
 #include "zstd/zstd.h"
 
-bool Decompress( const char * name, Allocator * a, Span< const u8 > compressed, Span< u8 > * decompressed ) {
+/*
+ * creating a ZSTD_DCtx allocates a few hundred KB of tables, which one-shot
+ * ZSTD_decompress does on every call. instead each thread keeps one around
+ * for as long as it lives, so the thread pool can decompress in parallel
+ * without them fighting over a shared context
+ */
+struct ThreadDCtx {
+	ZSTD_DCtx * dctx = NULL;
+
+	~ThreadDCtx() {
+		ZSTD_freeDCtx( dctx );
+	}
+};
+
+static thread_local ThreadDCtx thread_dctx;
+
+static ZSTD_DCtx * GetDCtx( const DecompressionDictionary * dict ) {
+	if( thread_dctx.dctx == NULL ) {
+		thread_dctx.dctx = ZSTD_createDCtx();
+		if( thread_dctx.dctx == NULL ) {
+			Fatal( "ZSTD_createDCtx" );
+		}
+	}
+
+	ZSTD_DCtx_reset( thread_dctx.dctx, ZSTD_reset_session_only );
+	ZSTD_DCtx_refDDict( thread_dctx.dctx, ( const ZSTD_DDict * ) dict );
+	return thread_dctx.dctx;
+}
+
+DecompressionDictionary * NewDecompressionDictionary( Span< const u8 > dict ) {
+	return ( DecompressionDictionary * ) ZSTD_createDDict( dict.ptr, dict.n );
+}
+
+void DeleteDecompressionDictionary( DecompressionDictionary * dict ) {
+	ZSTD_freeDDict( ( ZSTD_DDict * ) dict );
+}
+
+static bool IsZstd( const char * name, Span< const u8 > compressed ) {
 	if( compressed.n < 4 ) {
 		Com_Printf( S_COLOR_RED "Compressed data too short: %s\n", name );
 		return false;
@@ -15,22 +54,165 @@ bool Decompress( const char * name, Allocator * a, Span< const u8 > compressed,
 		return false;
 	}
 
+	return true;
+}
+
+bool DecompressedSize( const char * name, Span< const u8 > compressed, size_t * size ) {
+	if( !IsZstd( name, compressed ) )
+		return false;
+
 	unsigned long long decompressed_size = ZSTD_getFrameContentSize( compressed.ptr, compressed.n );
 	if( decompressed_size == ZSTD_CONTENTSIZE_ERROR || decompressed_size == ZSTD_CONTENTSIZE_UNKNOWN ) {
 		Com_Printf( S_COLOR_RED "Can't decompress %s\n", name );
 		return false;
 	}
 
-	*decompressed = ALLOC_SPAN( a, u8, decompressed_size );
-	{
-		ZoneScopedN( "ZSTD_decompress" );
-		size_t r = ZSTD_decompress( decompressed->ptr, decompressed->n, compressed.ptr, compressed.n );
-		if( r != decompressed_size ) {
+	*size = decompressed_size;
+	return true;
+}
+
+bool DecompressInto( const char * name, Span< const u8 > compressed, Span< u8 > out, size_t * written, const DecompressionDictionary * dict ) {
+	ZoneScopedN( "ZSTD_decompressDCtx" );
+
+	if( !IsZstd( name, compressed ) )
+		return false;
+
+	size_t r = ZSTD_decompressDCtx( GetDCtx( dict ), out.ptr, out.n, compressed.ptr, compressed.n );
+	if( ZSTD_isError( r ) ) {
+		Com_Printf( S_COLOR_RED "Can't decompress %s: %s\n", name, ZSTD_getErrorName( r ) );
+		return false;
+	}
+
+	*written = r;
+	return true;
+}
+
+static bool AppendToArray( void * user, Span< const u8 > decompressed ) {
+	NonRAIIDynamicArray< u8 > * output = ( NonRAIIDynamicArray< u8 > * ) user;
+	size_t old_size = output->extend( decompressed.n );
+	memcpy( output->ptr() + old_size, decompressed.ptr, decompressed.n );
+	return true;
+}
+
+/*
+ * frames written by a streaming compressor don't record their size, so
+ * stream them into a growing buffer instead
+ */
+static bool DecompressUnknownSize( const char * name, Allocator * a, Span< const u8 > compressed, Span< u8 > * decompressed, size_t padding, const DecompressionDictionary * dict ) {
+	NonRAIIDynamicArray< u8 > output;
+	output.init( a );
+
+	DecompressionStream * stream = NewDecompressionStream( sys_allocator, dict );
+	defer { DeleteDecompressionStream( stream ); };
+
+	bool ok = DecompressStream( stream, name, compressed, AppendToArray, &output );
+	if( ok && !DecompressionStreamFinished( stream ) ) {
+		Com_Printf( S_COLOR_RED "Can't decompress %s: truncated\n", name );
+		ok = false;
+	}
+
+	if( !ok ) {
+		output.shutdown();
+		return false;
+	}
+
+	size_t size = output.size();
+	output.extend( padding );
+	memset( output.ptr() + size, 0, padding );
+
+	*decompressed = Span< u8 >( output.ptr(), size );
+	return true;
+}
+
+bool Decompress( const char * name, Allocator * a, Span< const u8 > compressed, Span< u8 > * decompressed, size_t padding, const DecompressionDictionary * dict ) {
+	if( !IsZstd( name, compressed ) )
+		return false;
+
+	unsigned long long decompressed_size = ZSTD_getFrameContentSize( compressed.ptr, compressed.n );
+	if( decompressed_size == ZSTD_CONTENTSIZE_UNKNOWN ) {
+		return DecompressUnknownSize( name, a, compressed, decompressed, padding, dict );
+	}
+
+	if( decompressed_size == ZSTD_CONTENTSIZE_ERROR ) {
+		Com_Printf( S_COLOR_RED "Can't decompress %s\n", name );
+		return false;
+	}
+
+	*decompressed = ALLOC_SPAN( a, u8, decompressed_size + padding );
+	decompressed->n = decompressed_size;
+	memset( decompressed->ptr + decompressed->n, 0, padding );
+
+	size_t written;
+	if( !DecompressInto( name, compressed, *decompressed, &written, dict ) || written != decompressed_size ) {
+		FREE( a, decompressed->ptr );
+		return false;
+	}
+
+	return true;
+}
+
+struct DecompressionStream {
+	Allocator * a;
+	ZSTD_DStream * dstream;
+	Span< u8 > buffer;
+	bool finished;
+};
+
+DecompressionStream * NewDecompressionStream( Allocator * a, const DecompressionDictionary * dict ) {
+	DecompressionStream * stream = ALLOC( a, DecompressionStream );
+	stream->a = a;
+	stream->dstream = ZSTD_createDStream();
+	if( stream->dstream == NULL ) {
+		Fatal( "ZSTD_createDStream" );
+	}
+	ZSTD_DCtx_refDDict( stream->dstream, ( const ZSTD_DDict * ) dict );
+	stream->buffer = ALLOC_SPAN( a, u8, ZSTD_DStreamOutSize() );
+	stream->finished = false;
+	return stream;
+}
+
+void DeleteDecompressionStream( DecompressionStream * stream ) {
+	if( stream == NULL )
+		return;
+	ZSTD_freeDStream( stream->dstream );
+	FREE( stream->a, stream->buffer.ptr );
+	FREE( stream->a, stream );
+}
+
+bool DecompressStream( DecompressionStream * stream, const char * name, Span< const u8 > compressed, DecompressCallback callback, void * user ) {
+	ZoneScopedN( "ZSTD_decompressStream" );
+
+	ZSTD_inBuffer input = { compressed.ptr, compressed.n, 0 };
+	while( true ) {
+		if( stream->finished ) {
+			if( input.pos < input.size ) {
+				Com_Printf( S_COLOR_RED "Can't decompress %s: trailing data\n", name );
+				return false;
+			}
+			return true;
+		}
+
+		ZSTD_outBuffer output = { stream->buffer.ptr, stream->buffer.n, 0 };
+		size_t r = ZSTD_decompressStream( stream->dstream, &output, &input );
+		if( ZSTD_isError( r ) ) {
 			Com_Printf( S_COLOR_RED "Can't decompress %s: %s\n", name, ZSTD_getErrorName( r ) );
-			FREE( sys_allocator, decompressed->ptr );
 			return false;
 		}
+
+		stream->finished = r == 0;
+
+		if( output.pos > 0 && !callback( user, stream->buffer.slice( 0, output.pos ) ) ) {
+			return false;
+		}
+
+		// if the output buffer filled up there might be more to flush
+		// even with all the input consumed
+		if( input.pos == input.size && output.pos < output.size ) {
+			return true;
+		}
 	}
+}
 
-	return true;
+bool DecompressionStreamFinished( const DecompressionStream * stream ) {
+	return stream->finished;
 }
@@ -2,4 +2,33 @@
 
 #include "qcommon/types.h"
 
-bool Decompress( const char * name, Allocator * a, Span< const u8 > compressed, Span< u8 > * decompressed );
+// a ZSTD_DDict, for data compressed with `zstd --train` dictionaries
+struct DecompressionDictionary;
+
+DecompressionDictionary * NewDecompressionDictionary( Span< const u8 > dict );
+void DeleteDecompressionDictionary( DecompressionDictionary * dict );
+
+// reads the size out of the zstd frame header without decompressing anything
+bool DecompressedSize( const char * name, Span< const u8 > compressed, size_t * size );
+
+// padding is zeroed bytes allocated past the end of decompressed, e.g. 1 to
+// get a null terminator
+bool Decompress( const char * name, Allocator * a, Span< const u8 > compressed, Span< u8 > * decompressed, size_t padding = 0, const DecompressionDictionary * dict = NULL );
+
+// fails if it doesn't fit in out
+bool DecompressInto( const char * name, Span< const u8 > compressed, Span< u8 > out, size_t * written, const DecompressionDictionary * dict = NULL );
+
+/*
+ * for when the compressed data arrives in pieces or the output is too big to
+ * want all at once. feed it compressed data as you get it and the callback
+ * gets called with each decompressed chunk. return false from the callback
+ * to stop
+ */
+struct DecompressionStream;
+
+using DecompressCallback = bool ( * )( void * user, Span< const u8 > decompressed );
+
+DecompressionStream * NewDecompressionStream( Allocator * a, const DecompressionDictionary * dict = NULL );
+void DeleteDecompressionStream( DecompressionStream * stream );
+bool DecompressStream( DecompressionStream * stream, const char * name, Span< const u8 > compressed, DecompressCallback callback, void * user );
+bool DecompressionStreamFinished( const DecompressionStream * stream );
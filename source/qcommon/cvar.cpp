@@ -18,9 +18,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <algorithm> // std::lower_bound
+#include <atomic>
+#include <new>
+
 #include "qcommon/qcommon.h"
-#include "qcommon/q_trie.h"
+#include "qcommon/array.h"
 #include "qcommon/fs.h"
+#include "qcommon/glob.h"
+#include "qcommon/hash.h"
 #include "qcommon/string.h"
 #include "qcommon/threads.h"
 #include "client/console.h"
@@ -28,21 +34,35 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 static bool cvar_initialized = false;
 static bool cvar_preinitialized = false;
 
-static trie_t *cvar_trie = NULL;
+/*
+ * cvars never go away before shutdown, so lookups go through an insert only
+ * hashtable that gets read without taking cvar_mutex. registering a cvar
+ * stores it into an empty slot, and growing publishes a bigger copy. old
+ * copies are kept until shutdown because another thread might still be
+ * probing one, which costs at most as much memory as the current table
+ *
+ * cvars_by_name is kept sorted for listing and tab completion, and only
+ * gets touched with cvar_mutex held
+ */
+struct CvarTable {
+	Span< std::atomic< cvar_t * > > slots;
+	CvarTable * older;
+};
+
+static std::atomic< CvarTable * > cvar_table;
+static size_t num_cvars;
+static NonRAIIDynamicArray< cvar_t * > cvars_by_name;
 static Mutex *cvar_mutex = NULL;
 
 static bool Cvar_FlagIsSet( cvar_flag_t flags, cvar_flag_t flag ) {
 	return ( bool )( ( flags & flag ) != 0 );
 }
 
-static int Cvar_HasFlags( void *cvar, const void *flags ) {
-	assert( cvar );
-	return Cvar_FlagIsSet( ( (cvar_t *) cvar )->flags, *(const cvar_flag_t *) flags );
+static bool Cvar_HasFlags( const cvar_t * var, const void * flags ) {
+	return Cvar_FlagIsSet( var->flags, *(const cvar_flag_t *) flags );
 }
 
-static int Cvar_IsLatched( void *cvar, const void *flags ) {
-	const cvar_t *const var = (cvar_t *) cvar;
-	assert( cvar );
+static bool Cvar_IsLatched( const cvar_t * var, const void * flags ) {
 	return Cvar_FlagIsSet( var->flags, *(const cvar_flag_t *) flags ) && var->latched_string;
 }
 
@@ -60,14 +80,107 @@ static cvar_flag_t Cvar_FlagsClear( cvar_flag_t *flags ) {
 
 static void Cvar_SetModified( cvar_t *var ) {
 	var->modified = true;
+	if( Cvar_FlagIsSet( var->flags, CVAR_SERVERINFO ) ) {
+		serverinfo_generation++;
+	}
+	if( Cvar_FlagIsSet( var->flags, CVAR_ARCHIVE ) ) {
+		config_modified = true;
+	}
 }
 
 bool Cvar_CheatsAllowed() {
 	return Com_ClientState() < CA_CONNECTED || Com_DemoPlaying() || ( Com_ServerState() && Cvar_Value( "sv_cheats" ) );
 }
 
-static int Cvar_PatternMatches( void *cvar, const void *pattern ) {
-	return !pattern || Com_GlobMatch( (const char *) pattern, ( (cvar_t *) cvar )->name, false );
+static bool Cvar_PatternMatches( const cvar_t * var, const void * pattern ) {
+	return GlobMatch( *( const GlobPattern * ) pattern, var->name );
+}
+
+static CvarTable * NewCvarTable( size_t capacity ) {
+	CvarTable * table = ALLOC( sys_allocator, CvarTable );
+	table->slots = ALLOC_SPAN( sys_allocator, std::atomic< cvar_t * >, capacity );
+	for( std::atomic< cvar_t * > & slot : table->slots ) {
+		new ( &slot ) std::atomic< cvar_t * >( NULL );
+	}
+	table->older = NULL;
+	return table;
+}
+
+static cvar_t * FindCvar( const CvarTable * table, u64 hash ) {
+	size_t mask = table->slots.n - 1;
+	for( size_t i = hash & mask; true; i = ( i + 1 ) & mask ) {
+		cvar_t * var = table->slots[ i ].load( std::memory_order_acquire );
+		if( var == NULL || var->name_hash == hash )
+			return var;
+	}
+}
+
+static void InsertCvar( CvarTable * table, cvar_t * var ) {
+	size_t mask = table->slots.n - 1;
+	for( size_t i = var->name_hash & mask; true; i = ( i + 1 ) & mask ) {
+		if( table->slots[ i ].load( std::memory_order_relaxed ) == NULL ) {
+			table->slots[ i ].store( var, std::memory_order_release );
+			return;
+		}
+	}
+}
+
+static bool CvarNameLess( const cvar_t * var, const char * name ) {
+	return Q_stricmp( var->name, name ) < 0;
+}
+
+// call with cvar_mutex held
+static void RegisterCvar( cvar_t * var ) {
+	CvarTable * table = cvar_table.load( std::memory_order_relaxed );
+	if( ( num_cvars + 1 ) * 2 > table->slots.n ) {
+		CvarTable * bigger = NewCvarTable( table->slots.n * 2 );
+		for( const std::atomic< cvar_t * > & slot : table->slots ) {
+			cvar_t * existing = slot.load( std::memory_order_relaxed );
+			if( existing != NULL ) {
+				InsertCvar( bigger, existing );
+			}
+		}
+
+		bigger->older = table;
+		cvar_table.store( bigger, std::memory_order_release );
+		table = bigger;
+	}
+
+	InsertCvar( table, var );
+	num_cvars++;
+
+	size_t idx = std::lower_bound( cvars_by_name.begin(), cvars_by_name.end(), var->name, CvarNameLess ) - cvars_by_name.begin();
+	cvars_by_name.extend( 1 );
+	memmove( cvars_by_name.begin() + idx + 1, cvars_by_name.begin() + idx, ( cvars_by_name.size() - idx - 1 ) * sizeof( cvar_t * ) );
+	cvars_by_name[ idx ] = var;
+}
+
+using CvarFilter = bool ( * )( const cvar_t * var, const void * data );
+
+/*
+ * copies out the cvars that start with prefix and pass filter, in
+ * alphabetical order, so callers can work on them without holding the lock
+ */
+static Span< cvar_t * > DumpCvars( const char * prefix, CvarFilter filter, const void * data ) {
+	Lock( cvar_mutex );
+	defer { Unlock( cvar_mutex ); };
+
+	size_t prefix_len = strlen( prefix );
+	cvar_t ** first = std::lower_bound( cvars_by_name.begin(), cvars_by_name.end(), prefix, CvarNameLess );
+
+	Span< cvar_t * > dump = ALLOC_SPAN( sys_allocator, cvar_t *, cvars_by_name.end() - first );
+	size_t n = 0;
+	for( cvar_t ** it = first; it != cvars_by_name.end(); it++ ) {
+		if( Q_strnicmp( ( *it )->name, prefix, prefix_len ) != 0 )
+			break;
+		if( filter == NULL || filter( *it, data ) ) {
+			dump[ n ] = *it;
+			n++;
+		}
+	}
+	dump.n = n;
+
+	return dump;
 }
 
 /*
@@ -91,12 +204,9 @@ bool Cvar_Initialized() {
 * Cvar_Find
 */
 cvar_t *Cvar_Find( const char *var_name ) {
-	cvar_t *cvar;
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_Find( cvar_trie, var_name, TRIE_EXACT_MATCH, (void **)&cvar );
-	Unlock( cvar_mutex );
-	return cvar;
+	const CvarTable * table = cvar_table.load( std::memory_order_acquire );
+	assert( table != NULL );
+	return FindCvar( table, CaseInsensitiveHash64( var_name ) );
 }
 
 /*
@@ -153,16 +263,17 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, cvar_flag_t flags
 		}
 	}
 
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_Find( cvar_trie, var_name, TRIE_EXACT_MATCH, (void **)&var );
-	Unlock( cvar_mutex );
+	var = Cvar_Find( var_name );
 
 	if( !var_value ) {
 		return NULL;
 	}
 
 	if( var ) {
+		if( Q_stricmp( var->name, var_name ) != 0 ) {
+			Fatal( "Cvar name hash collision: %s and %s", var->name, var_name );
+		}
+
 		bool reset = false;
 
 		if( !var->dvalue || strcmp( var->dvalue, var_value ) ) {
@@ -199,6 +310,9 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, cvar_flag_t flags
 			userinfo_modified = true; // transmit at next oportunity
 
 		}
+		if( Cvar_FlagIsSet( flags, CVAR_SERVERINFO ) ) {
+			serverinfo_generation++;
+		}
 		Cvar_FlagSet( &var->flags, flags );
 		return var;
 	}
@@ -218,11 +332,22 @@ cvar_t *Cvar_Get( const char *var_name, const char *var_value, cvar_flag_t flags
 	var->value = atof( var->string );
 	var->integer = Q_rint( var->value );
 	var->flags = flags;
+	var->name_hash = CaseInsensitiveHash64( var_name );
 	Cvar_SetModified( var );
 
 	Lock( cvar_mutex );
-	Trie_Insert( cvar_trie, var_name, var );
-	Unlock( cvar_mutex );
+	defer { Unlock( cvar_mutex ); };
+
+	// another thread might have registered it since we looked
+	cvar_t * existing = FindCvar( cvar_table.load( std::memory_order_relaxed ), var->name_hash );
+	if( existing != NULL ) {
+		Mem_ZoneFree( var->string );
+		Mem_ZoneFree( var->dvalue );
+		Mem_ZoneFree( var );
+		return existing;
+	}
+
+	RegisterCvar( var );
 
 	return var;
 }
@@ -277,6 +402,9 @@ static cvar_t *Cvar_Set2( const char *var_name, const char *value, bool force )
 			if( Com_ServerState() ) {
 				Com_Printf( "%s will be changed upon restarting.\n", var->name );
 				var->latched_string = ZoneCopyString( (char *) value );
+				if( Cvar_FlagIsSet( var->flags, CVAR_ARCHIVE ) ) {
+					config_modified = true; // the latched value is what gets archived
+				}
 			} else {
 				Mem_ZoneFree( var->string ); // free the old value string
 				var->string = ZoneCopyString( value );
@@ -338,6 +466,10 @@ cvar_t *Cvar_FullSet( const char *var_name, const char *value, cvar_flag_t flags
 		return Cvar_Get( var_name, value, flags );
 	}
 
+	if( Cvar_FlagIsSet( var->flags, CVAR_SERVERINFO ) || Cvar_FlagIsSet( flags, CVAR_SERVERINFO ) ) {
+		serverinfo_generation++;
+	}
+
 	if( overwrite_flags ) {
 		var->flags = flags;
 	} else {
@@ -368,8 +500,6 @@ void Cvar_SetValue( const char *var_name, float value ) {
 * Any variables with CVAR_LATCHED will now be updated
 */
 void Cvar_GetLatchedVars( cvar_flag_t flags ) {
-	unsigned int i;
-	trie_dump_t *dump = NULL;
 	cvar_flag_t latchFlags;
 
 	Cvar_FlagsClear( &latchFlags );
@@ -379,19 +509,19 @@ void Cvar_GetLatchedVars( cvar_flag_t flags ) {
 		return;
 	}
 
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_DumpIf( cvar_trie, "", TRIE_DUMP_VALUES, Cvar_IsLatched, &flags, &dump );
-	Unlock( cvar_mutex );
-	for( i = 0; i < dump->size; ++i ) {
-		cvar_t * var = ( cvar_t * ) dump->key_value_vector[i].value;
+	Span< cvar_t * > dump = DumpCvars( "", Cvar_IsLatched, &flags );
+	defer { FREE( sys_allocator, dump.ptr ); };
+
+	for( cvar_t * var : dump ) {
 		Mem_ZoneFree( var->string );
 		var->string = var->latched_string;
 		var->latched_string = NULL;
 		var->value = atof( var->string );
 		var->integer = Q_rint( var->value );
+		if( Cvar_FlagIsSet( var->flags, CVAR_SERVERINFO ) ) {
+			serverinfo_generation++;
+		}
 	}
-	Trie_FreeDump( dump );
 }
 
 /*
@@ -400,23 +530,18 @@ void Cvar_GetLatchedVars( cvar_flag_t flags ) {
 * All cheat variables with be reset to default unless cheats are allowed
 */
 void Cvar_FixCheatVars() {
-	trie_dump_t *dump = NULL;
-	unsigned int i;
 	cvar_flag_t flags = CVAR_CHEAT;
 
 	if( Cvar_CheatsAllowed() ) {
 		return;
 	}
 
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_DumpIf( cvar_trie, "", TRIE_DUMP_VALUES, Cvar_HasFlags, &flags, &dump );
-	Unlock( cvar_mutex );
-	for( i = 0; i < dump->size; ++i ) {
-		cvar_t * var = ( cvar_t * ) dump->key_value_vector[i].value;
+	Span< cvar_t * > dump = DumpCvars( "", Cvar_HasFlags, &flags );
+	defer { FREE( sys_allocator, dump.ptr ); };
+
+	for( cvar_t * var : dump ) {
 		Cvar_ForceSet( var->name, var->dvalue );
 	}
-	Trie_FreeDump( dump );
 }
 
 
@@ -532,16 +657,12 @@ static void Cvar_Toggle_f() {
 }
 
 void Cvar_WriteVariables( DynamicString * config ) {
-	trie_dump_t *dump = NULL;
 	cvar_flag_t cvar_archive = CVAR_ARCHIVE;
 
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_DumpIf( cvar_trie, "", TRIE_DUMP_VALUES, Cvar_HasFlags, &cvar_archive, &dump );
-	Unlock( cvar_mutex );
+	Span< cvar_t * > dump = DumpCvars( "", Cvar_HasFlags, &cvar_archive );
+	defer { FREE( sys_allocator, dump.ptr ); };
 
-	for( unsigned int i = 0; i < dump->size; ++i ) {
-		cvar_t * var = ( cvar_t * ) dump->key_value_vector[i].value;
+	for( const cvar_t * var : dump ) {
 		if( ( var->flags & CVAR_FROMCONFIG ) == 0 && strcmp( var->string, var->dvalue ) == 0 )
 			continue;
 
@@ -564,31 +685,22 @@ void Cvar_WriteVariables( DynamicString * config ) {
 
 		config->append( "{} {} \"{}\"\r\n", set, var->name, value );
 	}
-	Trie_FreeDump( dump );
 }
 
 /*
 * Cvar_List_f
 */
 static void Cvar_List_f() {
-	trie_dump_t *dump = NULL;
-	unsigned int i;
-	char *pattern;
-
-	if( Cmd_Argc() == 1 ) {
-		pattern = NULL;
-	} else {
-		pattern = Cmd_Args();
+	GlobPattern pattern = { };
+	if( Cmd_Argc() > 1 ) {
+		pattern = CompileGlob( Cmd_Args(), false );
 	}
 
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_DumpIf( cvar_trie, "", TRIE_DUMP_VALUES, Cvar_PatternMatches, pattern, &dump );
-	Unlock( cvar_mutex );
+	Span< cvar_t * > dump = DumpCvars( "", Cmd_Argc() > 1 ? Cvar_PatternMatches : NULL, &pattern );
+	defer { FREE( sys_allocator, dump.ptr ); };
 
 	Com_Printf( "\nConsole variables:\n" );
-	for( i = 0; i < dump->size; ++i ) {
-		cvar_t * var = ( cvar_t * ) dump->key_value_vector[i].value;
+	for( const cvar_t * var : dump ) {
 		if( is_public_build && Cvar_FlagIsSet( var->flags, CVAR_DEVELOPER ) ) {
 			continue;
 		}
@@ -621,28 +733,24 @@ static void Cvar_List_f() {
 		}
 		Com_Printf( " %s \"%s\", default: \"%s\"\n", var->name, var->string, var->dvalue );
 	}
-	Com_Printf( "%i variables\n", i );
-
-	Trie_FreeDump( dump );
+	Com_Printf( "%i variables\n", int( dump.n ) );
 }
 
 bool userinfo_modified;
+u32 serverinfo_generation;
+bool config_modified;
 
 static char *Cvar_BitInfo( int bit ) {
 	static char info[MAX_INFO_STRING];
-	trie_dump_t *dump = NULL;
-	unsigned int i;
+	cvar_flag_t flags = bit;
 
 	info[0] = 0;
 
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_DumpIf( cvar_trie, "", TRIE_DUMP_VALUES, Cvar_HasFlags, &bit, &dump );
-	Unlock( cvar_mutex );
+	Span< cvar_t * > dump = DumpCvars( "", Cvar_HasFlags, &flags );
+	defer { FREE( sys_allocator, dump.ptr ); };
 
 	// make sure versioncvar comes first
-	for( i = dump->size; i > 0; --i ) {
-		cvar_t * var = ( cvar_t * ) dump->key_value_vector[i - 1].value;
+	for( const cvar_t * var : dump ) {
 		if( var == versioncvar ) {
 			Info_SetValueForKey( info, var->name, var->string );
 			break;
@@ -650,15 +758,12 @@ static char *Cvar_BitInfo( int bit ) {
 	}
 
 	// dump other cvars
-	for( i = 0; i < dump->size; ++i ) {
-		cvar_t * var = ( cvar_t * ) dump->key_value_vector[i].value;
+	for( const cvar_t * var : dump ) {
 		if( var != versioncvar ) {
 			Info_SetValueForKey( info, var->name, var->string );
 		}
 	}
 
-	Trie_FreeDump( dump );
-
 	return info;
 }
 
@@ -682,70 +787,49 @@ char *Cvar_Serverinfo() {
 * Cvar_NotDeveloper
 */
 #ifdef PUBLIC_BUILD
-static int Cvar_NotDeveloper( void *cvar, const void *nothing ) {
-	return !Cvar_FlagIsSet( ( (cvar_t *)cvar )->flags, CVAR_DEVELOPER );
+static bool Cvar_NotDeveloper( const cvar_t * var, const void * nothing ) {
+	return !Cvar_FlagIsSet( var->flags, CVAR_DEVELOPER );
 }
+#else
+static constexpr CvarFilter Cvar_NotDeveloper = NULL;
 #endif
 
+static const char ** Cvar_CompleteBuildListFiltered( const char * partial, CvarFilter filter, const void * data ) {
+	Span< cvar_t * > dump = DumpCvars( partial, filter, data );
+	defer { FREE( sys_allocator, dump.ptr ); };
+
+	const char ** buf = (const char **) Mem_TempMalloc( sizeof( char * ) * ( dump.n + 1 ) );
+	for( size_t i = 0; i < dump.n; i++ ) {
+		buf[ i ] = dump[ i ]->name;
+	}
+	buf[ dump.n ] = NULL;
+	return buf;
+}
+
 /*
 * CVar_CompleteCountPossible
 */
 int Cvar_CompleteCountPossible( const char *partial ) {
-	unsigned int matches;
-	assert( cvar_trie );
 	assert( partial );
-	Lock( cvar_mutex );
-#ifdef PUBLIC_BUILD
-	Trie_NoOfMatchesIf( cvar_trie, partial, Cvar_NotDeveloper, NULL, &matches );
-#else
-	Trie_NoOfMatches( cvar_trie, partial, &matches );
-#endif
-	Unlock( cvar_mutex );
-	return matches;
+
+	Span< cvar_t * > dump = DumpCvars( partial, Cvar_NotDeveloper, NULL );
+	defer { FREE( sys_allocator, dump.ptr ); };
+
+	return int( dump.n );
 }
 
 /*
 * CVar_CompleteBuildList
 */
 const char **Cvar_CompleteBuildList( const char *partial ) {
-	trie_dump_t *dump = NULL;
-	const char **buf;
-	unsigned int i;
-
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-#ifdef PUBLIC_BUILD
-	Trie_DumpIf( cvar_trie, partial, TRIE_DUMP_VALUES, Cvar_NotDeveloper, NULL, &dump );
-#else
-	Trie_Dump( cvar_trie, partial, TRIE_DUMP_VALUES, &dump );
-#endif
-	Unlock( cvar_mutex );
-	buf = (const char **) Mem_TempMalloc( sizeof( char * ) * ( dump->size + 1 ) );
-	for( i = 0; i < dump->size; ++i )
-		buf[i] = ( ( cvar_t * ) dump->key_value_vector[i].value )->name;
-	buf[dump->size] = NULL;
-	Trie_FreeDump( dump );
-	return buf;
+	return Cvar_CompleteBuildListFiltered( partial, Cvar_NotDeveloper, NULL );
 }
 
 /*
 * Cvar_CompleteBuildListWithFlag
 */
 const char **Cvar_CompleteBuildListWithFlag( const char *partial, cvar_flag_t flag ) {
-	trie_dump_t *dump = NULL;
-	const char **buf;
-	unsigned int i;
-
-	assert( cvar_trie );
-	Lock( cvar_mutex );
-	Trie_DumpIf( cvar_trie, partial, TRIE_DUMP_VALUES, Cvar_HasFlags, &flag, &dump );
-	Unlock( cvar_mutex );
-	buf = (const char **) Mem_TempMalloc( sizeof( char * ) * ( dump->size + 1 ) );
-	for( i = 0; i < dump->size; ++i )
-		buf[i] = ( ( cvar_t * ) dump->key_value_vector[i].value )->name;
-	buf[dump->size] = NULL;
-	Trie_FreeDump( dump );
-	return buf;
+	return Cvar_CompleteBuildListFiltered( partial, Cvar_HasFlags, &flag );
 }
 
 /*
@@ -769,11 +853,13 @@ void Cvar_PreInit() {
 	assert( !cvar_initialized );
 	assert( !cvar_preinitialized );
 
-	assert( !cvar_trie );
+	assert( cvar_table.load( std::memory_order_relaxed ) == NULL );
 
 	cvar_mutex = NewMutex();
 
-	Trie_Create( TRIE_CASE_INSENSITIVE, &cvar_trie );
+	cvar_table.store( NewCvarTable( 1024 ), std::memory_order_release );
+	num_cvars = 0;
+	cvars_by_name.init( sys_allocator );
 
 	cvar_preinitialized = true;
 }
@@ -787,8 +873,6 @@ void Cvar_Init() {
 	assert( !cvar_initialized );
 	assert( cvar_preinitialized );
 
-	assert( cvar_trie );
-
 	Cmd_AddCommand( "set", Cvar_Set_f );
 	Cmd_AddCommand( "seta", Cvar_Seta_f );
 	Cmd_AddCommand( "setau", Cvar_Setau_f );
@@ -818,12 +902,8 @@ void Cvar_Init() {
 */
 void Cvar_Shutdown() {
 	if( cvar_initialized ) {
-		unsigned int i;
-		trie_dump_t *dump;
 		extern cvar_t *developer, *developer_memory;
 
-		assert( cvar_trie );
-
 		// NULL out some console variables so that we won't try to read from
 		// the memory pointers after the data has already been freed but before we
 		// reset the pointers to NULL
@@ -840,12 +920,7 @@ void Cvar_Shutdown() {
 		Cmd_RemoveCommand( "toggle" );
 		Cmd_RemoveCommand( "cvarlist" );
 
-		Lock( cvar_mutex );
-		Trie_Dump( cvar_trie, "", TRIE_DUMP_VALUES, &dump );
-		Unlock( cvar_mutex );
-		for( i = 0; i < dump->size; ++i ) {
-			cvar_t * var = ( cvar_t * ) dump->key_value_vector[i].value;
-
+		for( cvar_t * var : cvars_by_name ) {
 			if( var->string ) {
 				Mem_ZoneFree( var->string );
 			}
@@ -854,18 +929,21 @@ void Cvar_Shutdown() {
 			}
 			Mem_ZoneFree( var );
 		}
-		Trie_FreeDump( dump );
+		cvars_by_name.clear();
 
 		cvar_initialized = false;
 	}
 
 	if( cvar_preinitialized ) {
-		assert( cvar_trie );
-
-		Lock( cvar_mutex );
-		Trie_Destroy( cvar_trie );
-		Unlock( cvar_mutex );
-		cvar_trie = NULL;
+		CvarTable * table = cvar_table.exchange( NULL );
+		while( table != NULL ) {
+			CvarTable * older = table->older;
+			FREE( sys_allocator, table->slots.ptr );
+			FREE( sys_allocator, table );
+			table = older;
+		}
+		num_cvars = 0;
+		cvars_by_name.shutdown();
 
 		DeleteMutex( cvar_mutex );
 
@@ -8,6 +8,14 @@ bool Cvar_Initialized();
 // that the client knows to send it to the server
 extern bool userinfo_modified;
 
+// this is bumped each time a CVAR_SERVERINFO variable changes so the
+// server knows to rebuild its info strings
+extern u32 serverinfo_generation;
+
+// this is set each time a CVAR_ARCHIVE variable or a bind changes so the
+// client knows config.cfg needs writing
+extern bool config_modified;
+
 cvar_t *Cvar_Get( const char *var_name, const char *value, cvar_flag_t flags );
 cvar_t *Cvar_Set( const char *var_name, const char *value );
 cvar_t *Cvar_ForceSet( const char *var_name, const char *value );
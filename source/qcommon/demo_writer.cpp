@@ -0,0 +1,191 @@
+#include <atomic>
+#include <new>
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/async_io.h"
+#include "qcommon/demo_writer.h"
+#include "qcommon/threadpool.h"
+
+#include "zstd/zstd.h"
+
+// the disk sees a handful of big writes a minute instead of one per
+// snapshot. demos get a keyframe every SNAP_DEMO_KEYFRAME_INTERVAL, which
+// ends the chunk early, so this only matters for very busy servers
+static constexpr size_t DEMO_CHUNK_SIZE = 1024 * 1024;
+static constexpr int DEMO_ZSTD_LEVEL = 9;
+
+struct DemoChunk {
+	Span< u8 > raw;
+	size_t raw_len;
+
+	Span< u8 > compressed;
+	std::atomic< bool > done;
+
+	int offset;
+};
+
+struct DemoWriter {
+	int file;
+
+	NonRAIIDynamicArray< DemoChunk * > chunks;
+	DemoChunk * current;
+	size_t next_write;
+	int offset; // where the next chunk handed to the I/O thread goes
+
+	JobGroup jobs;
+};
+
+// same idea as ThreadDCtx in compression.cpp
+struct ThreadCCtx {
+	ZSTD_CCtx * cctx = NULL;
+
+	~ThreadCCtx() {
+		ZSTD_freeCCtx( cctx );
+	}
+};
+
+static thread_local ThreadCCtx thread_cctx;
+
+static void CompressChunk( TempAllocator * temp, void * data ) {
+	ZoneScoped;
+
+	DemoChunk * chunk = ( DemoChunk * ) data;
+
+	if( thread_cctx.cctx == NULL ) {
+		thread_cctx.cctx = ZSTD_createCCtx();
+		if( thread_cctx.cctx == NULL ) {
+			Fatal( "ZSTD_createCCtx" );
+		}
+	}
+
+	chunk->compressed = ALLOC_SPAN( sys_allocator, u8, ZSTD_compressBound( chunk->raw_len ) );
+	size_t r = ZSTD_compressCCtx( thread_cctx.cctx, chunk->compressed.ptr, chunk->compressed.n, chunk->raw.ptr, chunk->raw_len, DEMO_ZSTD_LEVEL );
+	if( ZSTD_isError( r ) ) {
+		Fatal( "ZSTD_compressCCtx: %s", ZSTD_getErrorName( r ) );
+	}
+	chunk->compressed.n = r;
+
+	FREE( sys_allocator, chunk->raw.ptr );
+	chunk->raw = Span< u8 >();
+
+	chunk->done.store( true, std::memory_order_release );
+}
+
+static void WriteFinishedChunks( DemoWriter * writer ) {
+	while( writer->next_write < writer->chunks.size() ) {
+		DemoChunk * chunk = writer->chunks[ writer->next_write ];
+		if( !chunk->done.load( std::memory_order_acquire ) )
+			break;
+
+		chunk->offset = writer->offset;
+		writer->offset += int( chunk->compressed.n );
+		AsyncFSWrite( writer->file, chunk->compressed );
+		chunk->compressed = Span< u8 >();
+
+		writer->next_write++;
+	}
+}
+
+static void SubmitChunk( DemoWriter * writer ) {
+	if( writer->current == NULL )
+		return;
+
+	ThreadPoolDo( &writer->jobs, CompressChunk, writer->current );
+	writer->current = NULL;
+}
+
+static void AppendToChunk( DemoWriter * writer, const void * data, size_t n ) {
+	if( writer->current == NULL ) {
+		DemoChunk * chunk = new ( ALLOC( sys_allocator, DemoChunk ) ) DemoChunk();
+		// room for one more message past DEMO_CHUNK_SIZE so they never get split
+		chunk->raw = ALLOC_SPAN( sys_allocator, u8, DEMO_CHUNK_SIZE + MAX_MSGLEN + 4 );
+		chunk->raw_len = 0;
+		chunk->done.store( false, std::memory_order_relaxed );
+		chunk->offset = -1;
+
+		writer->chunks.add( chunk );
+		writer->current = chunk;
+	}
+
+	DemoChunk * chunk = writer->current;
+	assert( chunk->raw_len + n <= chunk->raw.n );
+	memcpy( chunk->raw.ptr + chunk->raw_len, data, n );
+	chunk->raw_len += n;
+}
+
+DemoWriter * NewDemoWriter( int file ) {
+	DemoWriter * writer = new ( ALLOC( sys_allocator, DemoWriter ) ) DemoWriter();
+	writer->file = file;
+	writer->chunks.init( sys_allocator );
+	writer->current = NULL;
+	writer->next_write = 0;
+	writer->offset = 0;
+	return writer;
+}
+
+void DemoWriterMessage( DemoWriter * writer, const msg_t * msg ) {
+	if( msg->cursize == 0 )
+		return;
+
+	int len = LittleLong( int( msg->cursize ) );
+	AppendToChunk( writer, &len, sizeof( len ) );
+	AppendToChunk( writer, msg->data, msg->cursize );
+
+	if( writer->current->raw_len >= DEMO_CHUNK_SIZE ) {
+		SubmitChunk( writer );
+	}
+
+	WriteFinishedChunks( writer );
+}
+
+int DemoWriterKeyframe( DemoWriter * writer ) {
+	SubmitChunk( writer );
+	return int( writer->chunks.size() );
+}
+
+static void FreeDemoWriter( DemoWriter * writer ) {
+	for( DemoChunk * chunk : writer->chunks ) {
+		FREE( sys_allocator, chunk->raw.ptr );
+		FREE( sys_allocator, chunk->compressed.ptr );
+		chunk->~DemoChunk();
+		FREE( sys_allocator, chunk );
+	}
+	writer->chunks.shutdown();
+
+	writer->~DemoWriter();
+	FREE( sys_allocator, writer );
+}
+
+void CloseDemoWriter( DemoWriter * writer, const char * meta_data, size_t meta_data_realsize, DemoKeyframe * keyframes, int num_keyframes ) {
+	ZoneScoped;
+
+	int end = LittleLong( -1 );
+	AppendToChunk( writer, &end, sizeof( end ) );
+	SubmitChunk( writer );
+
+	ThreadPoolWait( &writer->jobs );
+	WriteFinishedChunks( writer );
+
+	for( int i = 0; i < num_keyframes; i++ ) {
+		size_t chunk = size_t( keyframes[ i ].offset );
+		keyframes[ i ].offset = chunk < writer->chunks.size() ? writer->chunks[ chunk ]->offset : writer->offset;
+	}
+
+	msg_t msg;
+	Span< u8 > trailer = ALLOC_SPAN( sys_allocator, u8, SNAP_MAX_DEMO_TRAILER_SIZE );
+	MSG_Init( &msg, trailer.ptr, trailer.n );
+	SNAP_WriteDemoTrailer( &msg, writer->offset, meta_data, meta_data_realsize, keyframes, num_keyframes );
+	trailer.n = msg.cursize;
+	AsyncFSWrite( writer->file, trailer );
+
+	AsyncIOFlush();
+
+	FreeDemoWriter( writer );
+}
+
+void DeleteDemoWriter( DemoWriter * writer ) {
+	ThreadPoolWait( &writer->jobs );
+	FreeDemoWriter( writer );
+}
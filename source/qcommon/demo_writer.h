@@ -0,0 +1,35 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * writes zstd demos without the main thread touching compression or the
+ * disk. messages pile up in memory, each chunk gets compressed into its own
+ * zstd frame on the thread pool, and finished chunks go to the I/O thread in
+ * order in one big write each. the meta data and keyframes go in a trailer
+ * at the end, see SNAP_WriteDemoTrailer
+ *
+ * file has to be opened without SNAP_DEMO_GZ, and left alone until
+ * CloseDemoWriter returns
+ */
+
+struct DemoWriter;
+struct DemoKeyframe;
+struct msg_t;
+
+DemoWriter * NewDemoWriter( int file );
+
+// same [len][data] layout as SNAP_RecordDemoMessage
+void DemoWriterMessage( DemoWriter * writer, const msg_t * msg );
+
+/*
+ * keyframes have to start a chunk so playback can start decompressing from
+ * them. returns the chunk, which CloseDemoWriter turns into a file offset
+ */
+int DemoWriterKeyframe( DemoWriter * writer );
+
+// writes the end of demo marker and the trailer, waits for everything to hit the disk and frees writer
+void CloseDemoWriter( DemoWriter * writer, const char * meta_data, size_t meta_data_realsize, DemoKeyframe * keyframes, int num_keyframes );
+
+// throws away anything not written yet, for canceling
+void DeleteDemoWriter( DemoWriter * writer );
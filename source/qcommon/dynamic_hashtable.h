@@ -0,0 +1,229 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#if COMPILER_MSVC
+#include <intrin.h>
+#endif
+
+#include "qcommon/types.h"
+
+/*
+ * same interface as Hashtable but on the heap, and it grows instead of
+ * failing when it fills up
+ *
+ * like Hashtable, keys are expected to be hashes already. it's linear
+ * probing with a control byte per slot, either Empty or the top 7 bits of
+ * the slot's key, so lookups can check 16 slots at once with
+ * SSE2 and only look at keys whose control byte matches. the control bytes
+ * have a copy of the first 16 on the end so groups can run off the end of
+ * the table without wrapping
+ *
+ * removing shifts the rest of the run back instead of leaving tombstones,
+ * so lookups can always stop at the first empty slot
+ */
+class NonRAIIDynamicHashtable {
+	static constexpr u8 Empty = 0x80;
+	static constexpr size_t GroupSize = 16;
+	static constexpr size_t MinCapacity = 16;
+
+	struct Slot {
+		u64 key;
+		u64 value;
+	};
+
+	Allocator * a;
+	u8 * ctrl;
+	Slot * slots;
+	size_t capacity;
+	size_t n;
+
+public:
+	void init( Allocator * a_, size_t initial_capacity = 0 ) {
+		a = a_;
+		ctrl = NULL;
+		slots = NULL;
+		capacity = 0;
+		n = 0;
+
+		if( initial_capacity > 0 ) {
+			// leave room for initial_capacity entries without growing
+			grow( initial_capacity + initial_capacity / 7 + 1 );
+		}
+	}
+
+	void shutdown() {
+		FREE( a, ctrl );
+	}
+
+	bool add( u64 key, u64 value ) {
+		size_t i;
+		if( find( key, &i ) )
+			return false;
+
+		if( ( n + 1 ) * 8 > capacity * 7 ) {
+			grow( capacity * 2 );
+		}
+
+		insert( key, value );
+		return true;
+	}
+
+	bool update( u64 key, u64 value ) {
+		size_t i;
+		if( !find( key, &i ) )
+			return false;
+
+		slots[ i ].value = value;
+		return true;
+	}
+
+	bool get( u64 key, u64 * value ) const {
+		size_t i;
+		if( !find( key, &i ) )
+			return false;
+
+		*value = slots[ i ].value;
+		return true;
+	}
+
+	bool remove( u64 key ) {
+		size_t hole;
+		if( !find( key, &hole ) )
+			return false;
+
+		size_t mask = capacity - 1;
+		size_t i = ( hole + 1 ) & mask;
+		while( ctrl[ i ] != Empty ) {
+			// slide i into the hole unless its home is between the hole and i
+			size_t home = slots[ i ].key & mask;
+			if( ( ( i - home ) & mask ) >= ( ( i - hole ) & mask ) ) {
+				set_ctrl( hole, ctrl[ i ] );
+				slots[ hole ] = slots[ i ];
+				hole = i;
+			}
+
+			i = ( i + 1 ) & mask;
+		}
+
+		set_ctrl( hole, Empty );
+		n--;
+		return true;
+	}
+
+	size_t size() const {
+		return n;
+	}
+
+	void clear() {
+		if( ctrl != NULL ) {
+			memset( ctrl, Empty, capacity + GroupSize );
+		}
+		n = 0;
+	}
+
+private:
+	static u8 tag( u64 key ) {
+		return u8( key >> 57 );
+	}
+
+	static u32 LowestBit( u32 x ) {
+#if COMPILER_MSVC
+		unsigned long i;
+		_BitScanForward( &i, x );
+		return i;
+#else
+		return __builtin_ctz( x );
+#endif
+	}
+
+	void set_ctrl( size_t i, u8 c ) {
+		ctrl[ i ] = c;
+		if( i < GroupSize ) {
+			ctrl[ capacity + i ] = c;
+		}
+	}
+
+	bool find( u64 key, size_t * idx ) const {
+		if( n == 0 )
+			return false;
+
+		size_t mask = capacity - 1;
+		size_t pos = key & mask;
+
+		__m128i tags = _mm_set1_epi8( char( tag( key ) ) );
+		__m128i empties = _mm_set1_epi8( char( Empty ) );
+
+		while( true ) {
+			__m128i group = _mm_loadu_si128( ( const __m128i * ) ( ctrl + pos ) );
+			u32 matches = _mm_movemask_epi8( _mm_cmpeq_epi8( group, tags ) );
+			u32 empty = _mm_movemask_epi8( _mm_cmpeq_epi8( group, empties ) );
+
+			// anything after the first empty slot is a different run
+			if( empty != 0 ) {
+				matches &= ( 1u << LowestBit( empty ) ) - 1;
+			}
+
+			while( matches != 0 ) {
+				size_t i = ( pos + LowestBit( matches ) ) & mask;
+				if( slots[ i ].key == key ) {
+					*idx = i;
+					return true;
+				}
+				matches &= matches - 1;
+			}
+
+			if( empty != 0 )
+				return false;
+
+			pos = ( pos + GroupSize ) & mask;
+		}
+	}
+
+	void insert( u64 key, u64 value ) {
+		size_t mask = capacity - 1;
+		size_t pos = key & mask;
+
+		__m128i empties = _mm_set1_epi8( char( Empty ) );
+
+		while( true ) {
+			__m128i group = _mm_loadu_si128( ( const __m128i * ) ( ctrl + pos ) );
+			u32 empty = _mm_movemask_epi8( _mm_cmpeq_epi8( group, empties ) );
+			if( empty != 0 ) {
+				size_t i = ( pos + LowestBit( empty ) ) & mask;
+				set_ctrl( i, tag( key ) );
+				slots[ i ].key = key;
+				slots[ i ].value = value;
+				n++;
+				return;
+			}
+
+			pos = ( pos + GroupSize ) & mask;
+		}
+	}
+
+	void grow( size_t min_capacity ) {
+		size_t new_capacity = MinCapacity;
+		while( new_capacity < min_capacity )
+			new_capacity *= 2;
+
+		u8 * old_ctrl = ctrl;
+		Slot * old_slots = slots;
+		size_t old_capacity = capacity;
+
+		// one allocation, control bytes first so slots stay 16 byte aligned
+		size_t ctrl_bytes = new_capacity + GroupSize;
+		ctrl = ( u8 * ) ALLOC_SIZE( a, ctrl_bytes + new_capacity * sizeof( Slot ), 16 );
+		slots = ( Slot * ) ( ctrl + ctrl_bytes );
+		capacity = new_capacity;
+		clear();
+
+		for( size_t i = 0; i < old_capacity; i++ ) {
+			if( old_ctrl[ i ] != Empty ) {
+				insert( old_slots[ i ].key, old_slots[ i ].value );
+			}
+		}
+
+		FREE( a, old_ctrl );
+	}
+};
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/qcommon.h"
+#include "qcommon/dynamic_hashtable.h"
 #include "qcommon/hash.h"
 #include "qcommon/threads.h"
 
@@ -53,6 +54,11 @@ typedef struct searchpath_s {
 	char *path;
 	struct searchpath_s *base;      // parent basepath
 	struct searchpath_s *next;
+
+	// see FS_IndexSearchPath
+	bool indexed;
+	FSWatcher *watcher;
+	NonRAIIDynamicHashtable files;
 } searchpath_t;
 
 typedef struct {
@@ -72,6 +78,7 @@ static searchpath_t *fs_base_searchpaths;       // same as above, but without ex
 static searchpath_t *fs_root_searchpath;        // base path directory
 static searchpath_t *fs_write_searchpath;       // write directory
 static searchpath_t *fs_downloads_searchpath;   // write directory for downloads from game servers
+static searchpath_t *fs_write_game_searchpath;  // gamedir in the write directory
 
 static mempool_t *fs_mempool;
 
@@ -102,6 +109,127 @@ static char *FS_CopyString( const char *in ) {
 	return out;
 }
 
+/*
+ * game search paths keep a hashed index of every file under them, so finding
+ * a file is a lookup per search path instead of an fopen per search path.
+ * the index gets built when the search path is added and an FSWatcher keeps
+ * it up to date. if we can't watch the directory we don't index it and fall
+ * back to probing the disk
+ *
+ * the watcher only tells us about files appearing, so files that get deleted
+ * behind our back stay in the index. everything that finds a file opens it
+ * anyway, and forgets it with FS_UnindexFile if that fails
+ *
+ * like the watcher, the index skips hidden files and directories, and looking
+ * up anything under one goes to the disk
+ */
+static u64 FS_IndexKey( const char *filename ) {
+#if PLATFORM_WINDOWS
+	// paths are case insensitive
+	char lower[FS_MAX_PATH];
+	Q_strncpyz( lower, filename, sizeof( lower ) );
+	Q_strlwr( lower );
+	return Hash64( lower );
+#else
+	return Hash64( filename );
+#endif
+}
+
+static bool FS_IndexCovers( const searchpath_t *search, const char *filename ) {
+	return search->indexed && strstr( filename, "/." ) == NULL;
+}
+
+static void FS_IndexFile( searchpath_t *search, const char *filename ) {
+	if( search != NULL && FS_IndexCovers( search, filename ) ) {
+		search->files.add( FS_IndexKey( filename ), 0 );
+	}
+}
+
+static void FS_UnindexFile( searchpath_t *search, const char *filename ) {
+	if( search != NULL && FS_IndexCovers( search, filename ) ) {
+		search->files.remove( FS_IndexKey( filename ) );
+	}
+}
+
+static void FS_IndexDirectory( searchpath_t *search, char *relative, size_t relative_len ) {
+	char full[FS_MAX_PATH];
+	snprintf( full, sizeof( full ), "%s/%s", search->path, relative );
+
+	ListDirHandle scan = BeginListDir( sys_allocator, full );
+
+	const char *name;
+	bool dir;
+	while( ListDirNext( &scan, &name, &dir ) ) {
+		if( name[0] == '.' ) {
+			continue;
+		}
+
+		size_t len = ( size_t ) snprintf( relative + relative_len, FS_MAX_PATH - relative_len, "%s%s", relative_len == 0 ? "" : "/", name );
+		if( relative_len + len >= FS_MAX_PATH ) {
+			continue;
+		}
+
+		if( dir ) {
+			FS_IndexDirectory( search, relative, relative_len + len );
+		} else {
+			search->files.add( FS_IndexKey( relative ), 0 );
+		}
+	}
+
+	relative[relative_len] = '\0';
+}
+
+/*
+* FS_IndexSearchPath
+*
+* (re)builds the index from scratch, the watcher has to exist first so we
+* don't miss files that appear halfway through
+*/
+static void FS_IndexSearchPath( searchpath_t *search ) {
+	if( search->watcher == NULL ) {
+		search->watcher = NewFSWatcher( sys_allocator, search->path );
+		if( search->watcher == NULL ) {
+			// usually this means the directory doesn't exist yet
+			Com_DPrintf( "Can't watch %s, searching it without an index\n", search->path );
+			search->indexed = false;
+			return;
+		}
+	}
+
+	search->files.clear();
+
+	char relative[FS_MAX_PATH] = "";
+	FS_IndexDirectory( search, relative, 0 );
+	search->indexed = true;
+}
+
+/*
+* FS_PollIndex
+*
+* we only need to do this after a miss, because the watcher doesn't report
+* deletes and anything already in the index gets checked when it's opened
+*/
+static void FS_PollIndex( searchpath_t *search ) {
+	if( !search->indexed ) {
+		return;
+	}
+
+	bool rescan = false;
+	const char *path;
+	while( PollFSWatcher( search->watcher, &path ) ) {
+		if( path == NULL ) {
+			rescan = true;
+			continue;
+		}
+
+		search->files.add( FS_IndexKey( path ), 0 );
+	}
+
+	if( rescan ) {
+		FS_IndexSearchPath( search );
+	}
+}
+
 /*
 * FS_SearchDirectoryForFile
 */
@@ -115,10 +243,20 @@ static bool FS_SearchDirectoryForFile( searchpath_t *search, const char *filenam
 
 	snprintf( tempname, sizeof( tempname ), "%s/%s", search->path, filename );
 
-	f = fopen( tempname, "rb" );
-	if( f ) {
-		fclose( f );
-		found = true;
+	if( FS_IndexCovers( search, filename ) ) {
+		u64 key = FS_IndexKey( filename );
+		u64 unused;
+		found = search->files.get( key, &unused );
+		if( !found ) {
+			FS_PollIndex( search );
+			found = search->files.get( key, &unused );
+		}
+	} else {
+		f = fopen( tempname, "rb" );
+		if( f ) {
+			fclose( f );
+			found = true;
+		}
 	}
 
 	if( found && path ) {
@@ -211,6 +349,37 @@ static searchpath_t *FS_SearchPathForBaseFile( const char *filename, char *path,
 	return NULL;
 }
 
+/*
+* FS_OpenSearchPathFile
+*
+* Finds the file in the search path and opens it for reading, skipping over
+* files that are still in the index after getting deleted
+*/
+static FILE *FS_OpenSearchPathFile( const char *filename, bool base, char *path, size_t path_size ) {
+	while( true ) {
+		searchpath_t *search;
+		if( base ) {
+			search = FS_SearchPathForBaseFile( filename, path, path_size );
+		} else {
+			search = FS_SearchPathForFile( filename, path, path_size );
+		}
+
+		if( !search ) {
+			return NULL;
+		}
+
+		assert( path[0] != '\0' );
+		FILE *f = fopen( path, "rb" );
+		if( f || !FS_IndexCovers( search, filename ) ) {
+			return f;
+		}
+
+		Lock( fs_searchpaths_mutex );
+		FS_UnindexFile( search, filename );
+		Unlock( fs_searchpaths_mutex );
+	}
+}
+
 /*
 * FS_OpenFileHandle
 */
@@ -283,25 +452,14 @@ static void FS_CloseFileHandle( filehandle_t *fh ) {
 * FS_FileExists
 */
 static int FS_FileExists( const char *filename, bool base ) {
-	searchpath_t *search;
 	char tempname[FS_MAX_PATH];
 
-	if( base ) {
-		search = FS_SearchPathForBaseFile( filename, tempname, sizeof( tempname ) );
-	} else {
-		search = FS_SearchPathForFile( filename, tempname, sizeof( tempname ) );
-	}
-
-	if( !search ) {
+	FILE *f = FS_OpenSearchPathFile( filename, base, tempname, sizeof( tempname ) );
+	if( !f ) {
 		return -1;
 	}
 
-	assert( tempname[0] != '\0' );
-	if( tempname[0] != '\0' ) {
-		return FS_FileLength( fopen( tempname, "rb" ), true );
-	}
-
-	return -1;
+	return FS_FileLength( f, true );
 }
 
 /*
@@ -409,7 +567,6 @@ int FS_FOpenAbsoluteFile( const char *filename, int *filenum, int mode ) {
 * Finds the file in the search path. Returns filesize and an open handle
 */
 static int _FS_FOpenFile( const char *filename, int *filenum, int mode, bool base ) {
-	searchpath_t *search;
 	filehandle_t *file;
 	bool gz;
 	bool update;
@@ -462,6 +619,12 @@ static int _FS_FOpenFile( const char *filename, int *filenum, int mode, bool bas
 			return -1;
 		}
 
+		if( !base ) {
+			Lock( fs_searchpaths_mutex );
+			FS_IndexFile( fs_write_game_searchpath, filename );
+			Unlock( fs_searchpaths_mutex );
+		}
+
 		end = 0;
 		if( mode == FS_APPEND || mode == FS_READ || update ) {
 			end = f ? FS_FileLength( f, false ) : 0;
@@ -480,25 +643,14 @@ static int _FS_FOpenFile( const char *filename, int *filenum, int mode, bool bas
 		return end;
 	}
 
-	if( base ) {
-		search = FS_SearchPathForBaseFile( filename, tempname, sizeof( tempname ) );
-	} else {
-		search = FS_SearchPathForFile( filename, tempname, sizeof( tempname ) );
-	}
-
-	if( !search ) {
-		goto notfound_dprint;
-	}
-
 	int end;
 	FILE *f;
 
-	assert( tempname[0] != '\0' );
-	if( tempname[0] == '\0' ) {
-		goto error;
+	f = FS_OpenSearchPathFile( filename, base, tempname, sizeof( tempname ) );
+	if( !f ) {
+		goto notfound_dprint;
 	}
 
-	f = fopen( tempname, "rb" );
 	end = FS_FileLength( f, gz );
 
 	if( gz ) {
@@ -520,7 +672,6 @@ static int _FS_FOpenFile( const char *filename, int *filenum, int mode, bool bas
 notfound_dprint:
 	Com_DPrintf( "FS_FOpen%sFile: can't find %s\n", ( base ? "Base" : "" ), filename );
 
-error:
 	*filenum = 0;
 	return -1;
 }
@@ -845,7 +996,17 @@ static bool _FS_RemoveFile( const char *filename, bool base ) {
 		return false;
 	}
 
-	return ( FS_RemoveAbsoluteFile( fullname ) );
+	if( !FS_RemoveAbsoluteFile( fullname ) ) {
+		return false;
+	}
+
+	if( !base ) {
+		Lock( fs_searchpaths_mutex );
+		FS_UnindexFile( fs_write_game_searchpath, filename );
+		Unlock( fs_searchpaths_mutex );
+	}
+
+	return true;
 }
 
 /*
@@ -885,7 +1046,21 @@ bool _FS_MoveFile( const char *src, const char *dst, bool base, const char *dir
 	} else {
 		fulldestname = va_r( temp, sizeof( temp ), "%s/%s/%s", dir, FS_GameDirectory(), dst );
 	}
-	return rename( fullname, fulldestname ) == 0 ? true : false;
+
+	if( rename( fullname, fulldestname ) != 0 ) {
+		return false;
+	}
+
+	// FS_AbsoluteNameForFile found src in the first search path that has it,
+	// and that has to be the write directory
+	if( !base && strcmp( dir, FS_WriteDirectory() ) == 0 ) {
+		Lock( fs_searchpaths_mutex );
+		FS_UnindexFile( fs_write_game_searchpath, src );
+		FS_IndexFile( fs_write_game_searchpath, dst );
+		Unlock( fs_searchpaths_mutex );
+	}
+
+	return true;
 }
 
 /*
@@ -1001,6 +1176,13 @@ static void FS_TouchGamePath( searchpath_t *basepath, const char *gamedir ) {
 	search->base = basepath;
 	snprintf( search->path, path_size, "%s/%s", basepath->path, gamedir );
 
+	search->files.init( sys_allocator );
+	FS_IndexSearchPath( search );
+
+	if( basepath == fs_write_searchpath ) {
+		fs_write_game_searchpath = search;
+	}
+
 	search->next = fs_searchpaths;
 	fs_searchpaths = search;
 }
@@ -1116,10 +1298,14 @@ void FS_Shutdown() {
 		search = fs_searchpaths;
 		fs_searchpaths = search->next;
 
+		DeleteFSWatcher( search->watcher );
+		search->files.shutdown();
 		FS_Free( search->path );
 		FS_Free( search );
 	}
 
+	fs_write_game_searchpath = NULL;
+
 	Unlock( fs_searchpaths_mutex );
 
 	while( fs_basepaths ) {
@@ -25,9 +25,14 @@ size_t FileSize( FILE * file );
 
 bool FileExists( Allocator * temp, const char * path );
 bool WriteFile( TempAllocator * temp, const char * path, const void * data, size_t len );
+bool CreatePathForFile( Allocator * a, const char * path ); // makes the directories above path
 bool MoveFile( Allocator * a, const char * old_path, const char * new_path, MoveFileReplace replace );
 bool RemoveFile( Allocator * a, const char * path );
 
+// read only, and the mapping outlives any changes to the file on disk
+bool MapFile( Allocator * a, const char * path, Span< const u8 > * mapped );
+void UnmapFile( Span< const u8 > mapped );
+
 struct ListDirHandle {
 	char impl[ 64 ];
 };
@@ -41,3 +46,18 @@ struct FileMetadata {
 };
 
 FileMetadata FileMetadataOrZeroes( TempAllocator * temp, const char * path );
+
+/*
+ * recursively watches a directory for files getting written, created or
+ * moved in, skipping hidden files and directories like LoadAssetsRecursive.
+ * NewFSWatcher returns NULL if the directory can't be watched, so fall back
+ * to scanning
+ */
+struct FSWatcher;
+
+FSWatcher * NewFSWatcher( Allocator * a, const char * path );
+void DeleteFSWatcher( FSWatcher * watcher );
+
+// path is relative to the watched directory and lives until the next call. it
+// comes back NULL if the OS dropped events and you need to rescan everything
+bool PollFSWatcher( FSWatcher * watcher, const char ** path );
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
 #include "glob.h"
 
@@ -180,3 +181,154 @@ match:
 
 	return *t == '\0';
 }
+
+static bool IsGlobSpecial( char c ) {
+	return c == '*' || c == '?' || c == '[' || c == ']' || c == '\\';
+}
+
+static bool OnlyStars( Span< const char > str ) {
+	for( char c : str ) {
+		if( c != '*' )
+			return false;
+	}
+	return true;
+}
+
+static bool NoSpecials( Span< const char > str ) {
+	for( char c : str ) {
+		if( IsGlobSpecial( c ) )
+			return false;
+	}
+	return true;
+}
+
+static bool LiteralEqual( const char * a, Span< const char > b, bool casecmp ) {
+	if( casecmp )
+		return memcmp( a, b.ptr, b.n ) == 0;
+
+	for( size_t i = 0; i < b.n; i++ ) {
+		if( tolower( (unsigned char) a[ i ] ) != tolower( (unsigned char) b[ i ] ) )
+			return false;
+	}
+	return true;
+}
+
+static const char * FindLiteral( Span< const char > haystack, Span< const char > needle, bool casecmp ) {
+	if( haystack.n < needle.n )
+		return NULL;
+
+	char first = needle[ 0 ];
+	char other_case = casecmp ? first : char( islower( (unsigned char) first ) ? toupper( (unsigned char) first ) : tolower( (unsigned char) first ) );
+
+	const char * cursor = haystack.ptr;
+	const char * last = haystack.end() - needle.n + 1;
+	while( cursor < last ) {
+		const char * found = ( const char * ) memchr( cursor, first, last - cursor );
+		if( other_case != first ) {
+			const char * found_other = ( const char * ) memchr( cursor, other_case, ( found == NULL ? last : found ) - cursor );
+			if( found_other != NULL ) {
+				found = found_other;
+			}
+		}
+
+		if( found == NULL )
+			return NULL;
+
+		if( LiteralEqual( found + 1, needle + 1, casecmp ) )
+			return found;
+
+		cursor = found + 1;
+	}
+
+	return NULL;
+}
+
+GlobPattern CompileGlob( const char * pattern, bool casecmp ) {
+	GlobPattern glob = { };
+	glob.pattern = pattern;
+	glob.casecmp = casecmp;
+
+	size_t len = strlen( pattern );
+
+	size_t prefix_len = 0;
+	while( prefix_len < len && !IsGlobSpecial( pattern[ prefix_len ] ) ) {
+		prefix_len++;
+	}
+	glob.prefix = Span< const char >( pattern, prefix_len );
+
+	if( prefix_len == len ) {
+		glob.kind = GlobKind_Literal;
+		return glob;
+	}
+
+	size_t suffix_start = len;
+	while( suffix_start > prefix_len && !IsGlobSpecial( pattern[ suffix_start - 1 ] ) ) {
+		suffix_start--;
+	}
+	glob.suffix = Span< const char >( pattern + suffix_start, len - suffix_start );
+
+	Span< const char > middle( pattern + prefix_len, suffix_start - prefix_len );
+	if( OnlyStars( middle ) ) {
+		glob.kind = GlobKind_PrefixSuffix;
+		return glob;
+	}
+
+	// *abc*
+	size_t contains_start = 0;
+	while( contains_start < middle.n && middle[ contains_start ] == '*' ) {
+		contains_start++;
+	}
+	size_t contains_end = middle.n;
+	while( contains_end > contains_start && middle[ contains_end - 1 ] == '*' ) {
+		contains_end--;
+	}
+
+	Span< const char > contains = middle.slice( contains_start, contains_end );
+	if( contains_start > 0 && contains_end < middle.n && NoSpecials( contains ) ) {
+		glob.kind = GlobKind_Contains;
+		glob.contains = contains;
+		return glob;
+	}
+
+	glob.kind = GlobKind_General;
+	return glob;
+}
+
+bool GlobMatch( const GlobPattern & pattern, const char * text ) {
+	size_t len = strlen( text );
+
+	if( pattern.kind == GlobKind_Literal ) {
+		return len == pattern.prefix.n && LiteralEqual( text, pattern.prefix, pattern.casecmp );
+	}
+
+	if( len < pattern.prefix.n + pattern.suffix.n )
+		return false;
+	if( !LiteralEqual( text, pattern.prefix, pattern.casecmp ) )
+		return false;
+	if( !LiteralEqual( text + len - pattern.suffix.n, pattern.suffix, pattern.casecmp ) )
+		return false;
+
+	switch( pattern.kind ) {
+		case GlobKind_PrefixSuffix:
+			return true;
+
+		case GlobKind_Contains: {
+			Span< const char > middle( text + pattern.prefix.n, len - pattern.prefix.n - pattern.suffix.n );
+			return FindLiteral( middle, pattern.contains, pattern.casecmp ) != NULL;
+		}
+
+		default:
+			return glob_match( pattern.pattern + pattern.prefix.n, text + pattern.prefix.n, pattern.casecmp ) != 0;
+	}
+}
+
+size_t GlobMatchMany( const GlobPattern & pattern, Span< const char * const > strings, size_t * matches ) {
+	size_t n = 0;
+	for( size_t i = 0; i < strings.n; i++ ) {
+		if( GlobMatch( pattern, strings[ i ] ) ) {
+			matches[ n ] = i;
+			n++;
+		}
+	}
+	return n;
+}
@@ -20,4 +20,39 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #pragma once
 
+#include "qcommon/types.h"
+
 int glob_match( const char *pattern, const char *text, const int casecmp );
+
+/*
+ * glob_match reparses the pattern for every string it looks at, which adds
+ * up when filtering thousands of demos or cvars. CompileGlob pulls out the
+ * literal text at the start and end of the pattern so most strings get
+ * rejected with a compare, and patterns that are only literals and stars
+ * skip glob_match entirely
+ *
+ * the pattern has to outlive the GlobPattern
+ */
+
+enum GlobKind {
+	GlobKind_Literal, // abc
+	GlobKind_PrefixSuffix, // abc*, *abc, ab*cd
+	GlobKind_Contains, // *abc*, ab*cd*ef
+	GlobKind_General,
+};
+
+struct GlobPattern {
+	GlobKind kind;
+	bool casecmp;
+	const char * pattern;
+	Span< const char > prefix;
+	Span< const char > suffix;
+	Span< const char > contains;
+};
+
+GlobPattern CompileGlob( const char * pattern, bool casecmp );
+bool GlobMatch( const GlobPattern & pattern, const char * text );
+
+// writes the indices of the strings that match to matches, which needs to
+// be as big as strings, and returns how many there were
+size_t GlobMatchMany( const GlobPattern & pattern, Span< const char * const > strings, size_t * matches );
@@ -1,4 +1,15 @@
-#include <stdint.h>
+#include <immintrin.h>
+
+#include "qcommon/types.h"
+#include "qcommon/half_float.h"
+
+#if COMPILER_MSVC
+#include <intrin.h>
+#define F16C_TARGET
+#else
+#include <cpuid.h>
+#define F16C_TARGET __attribute__(( target( "f16c" ) ))
+#endif
 
 /*
  * https://gist.github.com/rygorous/2144712
@@ -62,3 +73,145 @@ float HalfToFloat(uint16_t h) {
 	o.u |= (h & 0x8000) << 16;
 	return o.f;
 }
+
+/*
+ * batch versions of the above. the SSE2 paths are the same algorithms four
+ * lanes at a time, the F16C instructions do eight at a time and need the OS
+ * to save the AVX registers, so check for that too
+ */
+
+static bool CPUHasF16C() {
+	u32 ecx;
+#if COMPILER_MSVC
+	int info[ 4 ];
+	__cpuid( info, 1 );
+	ecx = info[ 2 ];
+#else
+	u32 eax, ebx, edx;
+	if( __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) == 0 )
+		return false;
+#endif
+
+	constexpr u32 osxsave = 1 << 27;
+	constexpr u32 avx = 1 << 28;
+	constexpr u32 f16c = 1 << 29;
+	if( ( ecx & ( osxsave | avx | f16c ) ) != ( osxsave | avx | f16c ) )
+		return false;
+
+#if COMPILER_MSVC
+	u64 xcr0 = _xgetbv( 0 );
+#else
+	u32 lo, hi;
+	asm( "xgetbv" : "=a" ( lo ), "=d" ( hi ) : "c" ( 0 ) );
+	u64 xcr0 = lo | ( u64( hi ) << 32 );
+#endif
+
+	return ( xcr0 & 6 ) == 6; // XMM and YMM state
+}
+
+static bool HasF16C() {
+	static bool has_f16c = CPUHasF16C();
+	return has_f16c;
+}
+
+static __m128i Select( __m128i mask, __m128i a, __m128i b ) {
+	return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+}
+
+// returns the halves sign extended to 32 bits so they survive _mm_packs_epi32
+static __m128i FloatToHalfSSE2( __m128 x ) {
+	const __m128i f32infty = _mm_set1_epi32( 255 << 23 );
+	const __m128i f16max = _mm_set1_epi32( ( 127 + 16 ) << 23 );
+	const __m128i min_normal = _mm_set1_epi32( 113 << 23 );
+	const __m128i denorm_magic = _mm_set1_epi32( ( ( 127 - 15 ) + ( 23 - 10 ) + 1 ) << 23 );
+	const __m128i normal_bias = _mm_set1_epi32( ( ( 15 - 127 ) << 23 ) + 0xfff );
+
+	__m128i bits = _mm_castps_si128( x );
+	__m128i sign = _mm_and_si128( bits, _mm_set1_epi32( 0x80000000u ) );
+	__m128i f = _mm_xor_si128( bits, sign );
+
+	// compare the bits rather than using cmpunord, which -ffast-math is allowed to fold away
+	__m128i nan = _mm_cmpgt_epi32( f, f32infty );
+	__m128i inf_or_nan = _mm_or_si128( _mm_set1_epi32( 0x7c00 ), _mm_and_si128( nan, _mm_set1_epi32( 0x200 ) ) );
+
+	__m128 denorm_sum = _mm_add_ps( _mm_castsi128_ps( f ), _mm_castsi128_ps( denorm_magic ) );
+	__m128i denorm = _mm_sub_epi32( _mm_castps_si128( denorm_sum ), denorm_magic );
+
+	__m128i mant_odd = _mm_and_si128( _mm_srli_epi32( f, 13 ), _mm_set1_epi32( 1 ) );
+	__m128i normal = _mm_srli_epi32( _mm_add_epi32( _mm_add_epi32( f, normal_bias ), mant_odd ), 13 );
+
+	__m128i finite = Select( _mm_cmplt_epi32( f, min_normal ), denorm, normal );
+	__m128i o = Select( _mm_cmplt_epi32( f, f16max ), finite, inf_or_nan );
+
+	return _mm_or_si128( o, _mm_srai_epi32( sign, 16 ) );
+}
+
+// h is zero extended to 32 bits
+static __m128 HalfToFloatSSE2( __m128i h ) {
+	const __m128i shifted_exp = _mm_set1_epi32( 0x7c00 << 13 );
+	const __m128i exp_bias = _mm_set1_epi32( ( 127 - 15 ) << 23 );
+	const __m128 magic = _mm_castsi128_ps( _mm_set1_epi32( 113 << 23 ) );
+
+	__m128i o = _mm_slli_epi32( _mm_and_si128( h, _mm_set1_epi32( 0x7fff ) ), 13 );
+	__m128i exp = _mm_and_si128( o, shifted_exp );
+	o = _mm_add_epi32( o, exp_bias );
+
+	__m128i inf_or_nan = _mm_cmpeq_epi32( exp, shifted_exp );
+	o = _mm_add_epi32( o, _mm_and_si128( inf_or_nan, _mm_set1_epi32( ( 128 - 16 ) << 23 ) ) );
+
+	__m128 denorm = _mm_sub_ps( _mm_castsi128_ps( _mm_add_epi32( o, _mm_set1_epi32( 1 << 23 ) ) ), magic );
+	o = Select( _mm_cmpeq_epi32( exp, _mm_setzero_si128() ), _mm_castps_si128( denorm ), o );
+
+	__m128i sign = _mm_slli_epi32( _mm_and_si128( h, _mm_set1_epi32( 0x8000 ) ), 16 );
+	return _mm_castsi128_ps( _mm_or_si128( o, sign ) );
+}
+
+F16C_TARGET static size_t FloatToHalfF16C( Span< const float > src, Span< u16 > dst ) {
+	size_t i = 0;
+	for( ; i + 8 <= src.n; i += 8 ) {
+		__m128i h = _mm256_cvtps_ph( _mm256_loadu_ps( src.ptr + i ), _MM_FROUND_TO_NEAREST_INT );
+		_mm_storeu_si128( ( __m128i * ) ( dst.ptr + i ), h );
+	}
+	return i;
+}
+
+F16C_TARGET static size_t HalfToFloatF16C( Span< const u16 > src, Span< float > dst ) {
+	size_t i = 0;
+	for( ; i + 8 <= src.n; i += 8 ) {
+		__m128i h = _mm_loadu_si128( ( const __m128i * ) ( src.ptr + i ) );
+		_mm256_storeu_ps( dst.ptr + i, _mm256_cvtph_ps( h ) );
+	}
+	return i;
+}
+
+void FloatToHalf( Span< const float > src, Span< u16 > dst ) {
+	assert( src.n == dst.n );
+
+	size_t i = HasF16C() ? FloatToHalfF16C( src, dst ) : 0;
+
+	for( ; i + 8 <= src.n; i += 8 ) {
+		__m128i lo = FloatToHalfSSE2( _mm_loadu_ps( src.ptr + i ) );
+		__m128i hi = FloatToHalfSSE2( _mm_loadu_ps( src.ptr + i + 4 ) );
+		_mm_storeu_si128( ( __m128i * ) ( dst.ptr + i ), _mm_packs_epi32( lo, hi ) );
+	}
+
+	for( ; i < src.n; i++ ) {
+		dst[ i ] = FloatToHalf( src[ i ] );
+	}
+}
+
+void HalfToFloat( Span< const u16 > src, Span< float > dst ) {
+	assert( src.n == dst.n );
+
+	size_t i = HasF16C() ? HalfToFloatF16C( src, dst ) : 0;
+
+	for( ; i + 8 <= src.n; i += 8 ) {
+		__m128i h = _mm_loadu_si128( ( const __m128i * ) ( src.ptr + i ) );
+		_mm_storeu_ps( dst.ptr + i, HalfToFloatSSE2( _mm_unpacklo_epi16( h, _mm_setzero_si128() ) ) );
+		_mm_storeu_ps( dst.ptr + i + 4, HalfToFloatSSE2( _mm_unpackhi_epi16( h, _mm_setzero_si128() ) ) );
+	}
+
+	for( ; i < src.n; i++ ) {
+		dst[ i ] = HalfToFloat( src[ i ] );
+	}
+}
@@ -2,5 +2,16 @@
 
 #include <stdint.h>
 
+#include "qcommon/types.h"
+
 uint16_t FloatToHalf( float x );
 float HalfToFloat( uint16_t h );
+
+/*
+ * converts whole arrays, 8 at a time with F16C if the CPU has it and 4 at
+ * a time with SSE2 otherwise. the spans have to be the same length. both
+ * paths round to nearest even like the scalar versions, but F16C keeps NaN
+ * payloads where the scalar and SSE2 versions give 0x7e00
+ */
+void FloatToHalf( Span< const float > src, Span< u16 > dst );
+void HalfToFloat( Span< const u16 > src, Span< float > dst );
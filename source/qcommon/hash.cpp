@@ -1,6 +1,10 @@
 #include "qcommon/base.h"
 #include "hash.h"
 
+#if COMPILER_MSVC
+#include <intrin.h>
+#endif
+
 u32 Hash32( const void * data, size_t n, u32 hash ) {
 	const u32 prime = U32( 16777619 );
 
@@ -11,7 +15,44 @@ u32 Hash32( const void * data, size_t n, u32 hash ) {
 	return hash;
 }
 
-u64 Hash64( const void * data, size_t n, u64 hash ) {
+static u64 Mul128Fold( u64 a, u64 b ) {
+#if COMPILER_MSVC
+	u64 hi;
+	u64 lo = _umul128( a, b, &hi );
+	return lo ^ hi;
+#else
+	__uint128_t r = __uint128_t( a ) * b;
+	return u64( r ) ^ u64( r >> 64 );
+#endif
+}
+
+static u64 ReadLE( const u8 * p, size_t n ) {
+	u64 x = 0;
+	memcpy( &x, p, n );
+	return x;
+}
+
+u64 Hash64( const void * data, size_t n, u64 seed ) {
+	using namespace Hash64Impl;
+
+	const u8 * p = ( const u8 * ) data;
+	u64 h = seed ^ P0;
+
+	size_t remaining = n;
+	while( remaining >= 16 ) {
+		h = Mul128Fold( ReadLE( p, 8 ) ^ P1, ReadLE( p + 8, 8 ) ^ h );
+		p += 16;
+		remaining -= 16;
+	}
+
+	u64 a = ReadLE( p, Min2( remaining, size_t( 8 ) ) );
+	u64 b = remaining > 8 ? ReadLE( p + 8, remaining - 8 ) : 0;
+	h = Mul128Fold( a ^ P1, b ^ h );
+
+	return Mul128Fold( h ^ P2, u64( n ) ^ P1 );
+}
+
+u64 Hash64Incremental( const void * data, size_t n, u64 hash ) {
 	const u64 prime = U64( 1099511628211 );
 
 	const char * cdata = ( const char * ) data;
@@ -29,6 +70,17 @@ u64 Hash64( const char * str ) {
 	return Hash64( str, strlen( str ) );
 }
 
+u64 CaseInsensitiveHash64( const char * str ) {
+	const u64 prime = U64( 1099511628211 );
+
+	u64 hash = U64( 14695981039346656037 );
+	for( const char * p = str; *p != '\0'; p++ ) {
+		char c = *p >= 'A' && *p <= 'Z' ? *p - 'A' + 'a' : *p;
+		hash = ( hash ^ c ) * prime;
+	}
+	return hash;
+}
+
 u64 Hash64( u64 x ) {
 	x = ( x ^ ( x >> 30 ) ) * U64( 0xbf58476d1ce4e5b9 );
 	x = ( x ^ ( x >> 27 ) ) * U64( 0x94d049bb133111eb );
@@ -4,13 +4,26 @@
 
 // fnv1a
 u32 Hash32( const void * data, size_t n, u32 basis = U32( 2166136261 ) );
-u64 Hash64( const void * data, size_t n, u64 basis = U64( 14695981039346656037 ) );
-
 u32 Hash32( const char * str );
+
+/*
+ * wyhash style, 16 bytes per 64x64->128 multiply. seeding with another hash
+ * is fine for combining things, but unlike fnv1a Hash64( b, Hash64( a ) ) is
+ * not Hash64( ab ), so use Hash64Incremental for data that arrives in pieces
+ *
+ * Hash64_CT below has to give the same results
+ */
+u64 Hash64( const void * data, size_t n, u64 seed = 0 );
 u64 Hash64( const char * str );
 
+// fnv1a, Hash64Incremental( b, n, Hash64Incremental( a, m ) ) == Hash64Incremental( ab, m + n )
+u64 Hash64Incremental( const void * data, size_t n, u64 basis = U64( 14695981039346656037 ) );
+
 u64 Hash64( u64 x );
 
+// for names that are looked up case insensitively, like cvars and commands
+u64 CaseInsensitiveHash64( const char * str );
+
 template< typename T >
 u32 Hash32( Span< const T > data ) {
 	return Hash32( data.ptr, data.num_bytes() );
@@ -26,8 +39,41 @@ constexpr u32 Hash32_CT( const char * str, size_t n, u32 basis = U32( 2166136261
 	return n == 0 ? basis : Hash32_CT( str + 1, n - 1, ( basis ^ str[ 0 ] ) * U32( 16777619 ) );
 }
 
-constexpr u64 Hash64_CT( const char * str, size_t n, u64 basis = U64( 14695981039346656037 ) ) {
-	return n == 0 ? basis : Hash64_CT( str + 1, n - 1, ( basis ^ str[ 0 ] ) * U64( 1099511628211 ) );
+namespace Hash64Impl {
+	constexpr u64 P0 = U64( 0xa0761d6478bd642f );
+	constexpr u64 P1 = U64( 0xe7037ed1a0b428db );
+	constexpr u64 P2 = U64( 0x8ebc6af09c88c6e3 );
+	constexpr u64 Low32 = U64( 0xffffffff );
+
+	// lo ^ hi of a 128 bit product, done in 32 bit halves because c++11 constexpr
+	constexpr u64 MixFinal( u64 ll, u64 hh, u64 hl, u64 cross ) {
+		return ( ( cross << 32 ) | ( ll & Low32 ) ) ^ ( hh + ( hl >> 32 ) + ( cross >> 32 ) );
+	}
+
+	constexpr u64 MixCross( u64 ll, u64 hl, u64 lh, u64 hh ) {
+		return MixFinal( ll, hh, hl, ( ll >> 32 ) + ( hl & Low32 ) + lh );
+	}
+
+	constexpr u64 Mix( u64 a, u64 b ) {
+		return MixCross( ( a & Low32 ) * ( b & Low32 ), ( a >> 32 ) * ( b & Low32 ), ( a & Low32 ) * ( b >> 32 ), ( a >> 32 ) * ( b >> 32 ) );
+	}
+
+	// n <= 8 bytes, little endian
+	constexpr u64 Read( const char * str, size_t n ) {
+		return n == 0 ? 0 : u64( u8( str[ 0 ] ) ) | ( Read( str + 1, n - 1 ) << 8 );
+	}
+
+	constexpr u64 Tail( const char * str, size_t n, u64 h ) {
+		return Mix( Read( str, n < 8 ? n : 8 ) ^ P1, ( n > 8 ? Read( str + 8, n - 8 ) : 0 ) ^ h );
+	}
+
+	constexpr u64 Blocks( const char * str, size_t n, u64 h ) {
+		return n >= 16 ? Blocks( str + 16, n - 16, Mix( Read( str, 8 ) ^ P1, Read( str + 8, 8 ) ^ h ) ) : Tail( str, n, h );
+	}
+}
+
+constexpr u64 Hash64_CT( const char * str, size_t n, u64 seed = 0 ) {
+	return Hash64Impl::Mix( Hash64Impl::Blocks( str, n, seed ^ Hash64Impl::P0 ) ^ Hash64Impl::P2, u64( n ) ^ Hash64Impl::P1 );
 }
 
 struct StringHash {
@@ -45,4 +45,9 @@ public:
 
 		return true;
 	}
+
+	void clear() {
+		ht.clear();
+		n = 0;
+	}
 };
@@ -257,28 +257,29 @@ inline Mat4 Mat4Scale( float s ) {
 	return Mat4Scale( s, s, s );
 }
 
-inline Mat4 operator*( const Mat4 & lhs, const Mat4 & rhs ) {
-	return Mat4(
-		Dot( lhs.row0(), rhs.col0 ),
-		Dot( lhs.row0(), rhs.col1 ),
-		Dot( lhs.row0(), rhs.col2 ),
-		Dot( lhs.row0(), rhs.col3 ),
-
-		Dot( lhs.row1(), rhs.col0 ),
-		Dot( lhs.row1(), rhs.col1 ),
-		Dot( lhs.row1(), rhs.col2 ),
-		Dot( lhs.row1(), rhs.col3 ),
+/*
+ * Mat4 multiplies go through SSE. each lane adds the products up in the same
+ * order as Dot( row, col ), so it gives the same bits as the scalar maths
+ * would without -ffast-math. with it the compiler is free to reorder the
+ * scalar sums, but there's nothing here for it to reorder, so these give the
+ * same results in debug and release and are fine to use in gameshared
+ */
 
-		Dot( lhs.row2(), rhs.col0 ),
-		Dot( lhs.row2(), rhs.col1 ),
-		Dot( lhs.row2(), rhs.col2 ),
-		Dot( lhs.row2(), rhs.col3 ),
+inline __m128 Mat4MulColumn( const Mat4 & m, __m128 v ) {
+	__m128 r = _mm_mul_ps( _mm_load_ps( &m.col0.x ), _mm_shuffle_ps( v, v, _MM_SHUFFLE( 0, 0, 0, 0 ) ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_load_ps( &m.col1.x ), _mm_shuffle_ps( v, v, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_load_ps( &m.col2.x ), _mm_shuffle_ps( v, v, _MM_SHUFFLE( 2, 2, 2, 2 ) ) ) );
+	r = _mm_add_ps( r, _mm_mul_ps( _mm_load_ps( &m.col3.x ), _mm_shuffle_ps( v, v, _MM_SHUFFLE( 3, 3, 3, 3 ) ) ) );
+	return r;
+}
 
-		Dot( lhs.row3(), rhs.col0 ),
-		Dot( lhs.row3(), rhs.col1 ),
-		Dot( lhs.row3(), rhs.col2 ),
-		Dot( lhs.row3(), rhs.col3 )
-	);
+inline Mat4 operator*( const Mat4 & lhs, const Mat4 & rhs ) {
+	Mat4 r;
+	_mm_store_ps( &r.col0.x, Mat4MulColumn( lhs, _mm_load_ps( &rhs.col0.x ) ) );
+	_mm_store_ps( &r.col1.x, Mat4MulColumn( lhs, _mm_load_ps( &rhs.col1.x ) ) );
+	_mm_store_ps( &r.col2.x, Mat4MulColumn( lhs, _mm_load_ps( &rhs.col2.x ) ) );
+	_mm_store_ps( &r.col3.x, Mat4MulColumn( lhs, _mm_load_ps( &rhs.col3.x ) ) );
+	return r;
 }
 
 inline void operator*=( Mat4 & lhs, const Mat4 & rhs ) {
@@ -286,12 +287,107 @@ inline void operator*=( Mat4 & lhs, const Mat4 & rhs ) {
 }
 
 inline Vec4 operator*( const Mat4 & m, const Vec4 & v ) {
-	return Vec4(
-		Dot( m.row0(), v ),
-		Dot( m.row1(), v ),
-		Dot( m.row2(), v ),
-		Dot( m.row3(), v )
+	Vec4 r;
+	_mm_storeu_ps( &r.x, Mat4MulColumn( m, _mm_loadu_ps( &v.x ) ) );
+	return r;
+}
+
+// out[ i ] = m * Vec4( points[ i ], 1 )
+inline void TransformPoints( Span< Vec4 > out, const Mat4 & m, Span< const Vec3 > points ) {
+	assert( out.n == points.n );
+
+	__m128 col0 = _mm_load_ps( &m.col0.x );
+	__m128 col1 = _mm_load_ps( &m.col1.x );
+	__m128 col2 = _mm_load_ps( &m.col2.x );
+	__m128 col3 = _mm_load_ps( &m.col3.x );
+
+	for( size_t i = 0; i < points.n; i++ ) {
+		__m128 r = _mm_mul_ps( col0, _mm_set1_ps( points[ i ].x ) );
+		r = _mm_add_ps( r, _mm_mul_ps( col1, _mm_set1_ps( points[ i ].y ) ) );
+		r = _mm_add_ps( r, _mm_mul_ps( col2, _mm_set1_ps( points[ i ].z ) ) );
+		r = _mm_add_ps( r, col3 );
+		_mm_storeu_ps( &out[ i ].x, r );
+	}
+}
+
+/*
+ * general inverse by splitting into 2x2 blocks, see "Fast 4x4 matrix
+ * inverse with SSE SIMD, explained" by Eric Zhang. it's rows in, rows out
+ * there, but inverse and transpose commute so columns work just as well.
+ * singular matrices give you infs and nans
+ */
+
+// the 2x2 matrices here are a b c d in one register, for [ a b ] [ c d ]
+inline __m128 Mat2Mul( __m128 a, __m128 b ) {
+	return _mm_add_ps(
+		_mm_mul_ps( a, _mm_shuffle_ps( b, b, _MM_SHUFFLE( 3, 0, 3, 0 ) ) ),
+		_mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 2, 3, 0, 1 ) ), _mm_shuffle_ps( b, b, _MM_SHUFFLE( 1, 2, 1, 2 ) ) )
+	);
+}
+
+// adj( a ) * b
+inline __m128 Mat2AdjMul( __m128 a, __m128 b ) {
+	return _mm_sub_ps(
+		_mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 0, 0, 3, 3 ) ), b ),
+		_mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 2, 2, 1, 1 ) ), _mm_shuffle_ps( b, b, _MM_SHUFFLE( 1, 0, 3, 2 ) ) )
+	);
+}
+
+// a * adj( b )
+inline __m128 Mat2MulAdj( __m128 a, __m128 b ) {
+	return _mm_sub_ps(
+		_mm_mul_ps( a, _mm_shuffle_ps( b, b, _MM_SHUFFLE( 0, 3, 0, 3 ) ) ),
+		_mm_mul_ps( _mm_shuffle_ps( a, a, _MM_SHUFFLE( 2, 3, 0, 1 ) ), _mm_shuffle_ps( b, b, _MM_SHUFFLE( 1, 2, 1, 2 ) ) )
+	);
+}
+
+inline Mat4 Inverse( const Mat4 & m ) {
+	__m128 c0 = _mm_load_ps( &m.col0.x );
+	__m128 c1 = _mm_load_ps( &m.col1.x );
+	__m128 c2 = _mm_load_ps( &m.col2.x );
+	__m128 c3 = _mm_load_ps( &m.col3.x );
+
+	__m128 A = _mm_movelh_ps( c0, c1 );
+	__m128 B = _mm_movehl_ps( c1, c0 );
+	__m128 C = _mm_movelh_ps( c2, c3 );
+	__m128 D = _mm_movehl_ps( c3, c2 );
+
+	// |A| |B| |C| |D|
+	__m128 dets = _mm_sub_ps(
+		_mm_mul_ps( _mm_shuffle_ps( c0, c2, _MM_SHUFFLE( 2, 0, 2, 0 ) ), _mm_shuffle_ps( c1, c3, _MM_SHUFFLE( 3, 1, 3, 1 ) ) ),
+		_mm_mul_ps( _mm_shuffle_ps( c0, c2, _MM_SHUFFLE( 3, 1, 3, 1 ) ), _mm_shuffle_ps( c1, c3, _MM_SHUFFLE( 2, 0, 2, 0 ) ) )
 	);
+	__m128 det_a = _mm_shuffle_ps( dets, dets, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+	__m128 det_b = _mm_shuffle_ps( dets, dets, _MM_SHUFFLE( 1, 1, 1, 1 ) );
+	__m128 det_c = _mm_shuffle_ps( dets, dets, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+	__m128 det_d = _mm_shuffle_ps( dets, dets, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+
+	__m128 DC = Mat2AdjMul( D, C );
+	__m128 AB = Mat2AdjMul( A, B );
+
+	__m128 X = _mm_sub_ps( _mm_mul_ps( det_d, A ), Mat2Mul( B, DC ) );
+	__m128 W = _mm_sub_ps( _mm_mul_ps( det_a, D ), Mat2Mul( C, AB ) );
+	__m128 Y = _mm_sub_ps( _mm_mul_ps( det_b, C ), Mat2MulAdj( D, AB ) );
+	__m128 Z = _mm_sub_ps( _mm_mul_ps( det_c, B ), Mat2MulAdj( A, DC ) );
+
+	// |M| = |A||D| + |B||C| - tr( adj( A ) B adj( D ) C )
+	__m128 tr = _mm_mul_ps( AB, _mm_shuffle_ps( DC, DC, _MM_SHUFFLE( 3, 1, 2, 0 ) ) );
+	tr = _mm_hadd_ps( tr, tr );
+	tr = _mm_hadd_ps( tr, tr );
+	__m128 det = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( det_a, det_d ), _mm_mul_ps( det_b, det_c ) ), tr );
+
+	__m128 inv_det = _mm_div_ps( _mm_setr_ps( 1.0f, -1.0f, -1.0f, 1.0f ), det );
+	X = _mm_mul_ps( X, inv_det );
+	Y = _mm_mul_ps( Y, inv_det );
+	Z = _mm_mul_ps( Z, inv_det );
+	W = _mm_mul_ps( W, inv_det );
+
+	Mat4 r;
+	_mm_store_ps( &r.col0.x, _mm_shuffle_ps( X, Y, _MM_SHUFFLE( 1, 3, 1, 3 ) ) );
+	_mm_store_ps( &r.col1.x, _mm_shuffle_ps( X, Y, _MM_SHUFFLE( 0, 2, 0, 2 ) ) );
+	_mm_store_ps( &r.col2.x, _mm_shuffle_ps( Z, W, _MM_SHUFFLE( 1, 3, 1, 3 ) ) );
+	_mm_store_ps( &r.col3.x, _mm_shuffle_ps( Z, W, _MM_SHUFFLE( 0, 2, 0, 2 ) ) );
+	return r;
 }
 
 inline Mat4 operator-( const Mat4 & m ) {
@@ -0,0 +1,183 @@
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/fs.h"
+#include "qcommon/load_profile.h"
+#include "qcommon/string.h"
+#include "qcommon/threads.h"
+
+#define MAX_LOAD_PHASES 256
+
+struct LoadPhase {
+	String< 64 > name;
+	s32 parent;
+	u32 depth;
+	bool main_thread;
+	u64 start_ns, end_ns;
+	u64 bytes;
+	u64 pool_busy_start, pool_busy_end;
+};
+
+static Mutex * profile_mutex;
+
+static LoadPhase phases[ MAX_LOAD_PHASES ];
+static u32 num_phases;
+static u32 dropped_phases;
+static bool report_open;
+static s32 reporting_phase; // innermost open phase on the thread that started the report
+static u64 pool_busy_ns;
+
+static thread_local s32 current_phase = -1;
+static thread_local bool owns_report = false;
+
+void InitLoadProfiler() {
+	profile_mutex = NewMutex();
+	num_phases = 0;
+	report_open = false;
+	pool_busy_ns = 0;
+}
+
+void ShutdownLoadProfiler() {
+	DeleteMutex( profile_mutex );
+	profile_mutex = NULL;
+}
+
+static float ToMilliseconds( u64 ns ) {
+	return ns / 1000000.0f;
+}
+
+/*
+* utilisation assumes the thread running the phase is busy throughout, and
+* adds on whatever the thread pool workers managed in the meantime
+*/
+static void WriteLoadProfile() {
+	u32 cores = GetCoreCount();
+	const LoadPhase * root = &phases[ 0 ];
+
+	DynamicString json( sys_allocator );
+	json += "{";
+	json.append( "\"name\":\"{}\",\"ms\":{.3},\"cores\":{},\"dropped\":{},\"phases\":[",
+		root->name, ToMilliseconds( root->end_ns - root->start_ns ), cores, dropped_phases );
+
+	for( u32 i = 0; i < num_phases; i++ ) {
+		const LoadPhase * phase = &phases[ i ];
+		u64 ns = phase->end_ns - phase->start_ns;
+		u64 pool_ns = phase->pool_busy_end - phase->pool_busy_start;
+		float utilisation = ns == 0 ? 0.0f : ( ns + pool_ns ) / float( ns * cores );
+
+		json += i == 0 ? "{" : ",{";
+		json.append( "\"name\":\"{}\",\"parent\":{},\"depth\":{},\"thread\":\"{}\",\"start_ms\":{.3},\"ms\":{.3},\"bytes\":{},\"pool_ms\":{.3},\"utilisation\":{.3}",
+			phase->name, phase->parent, phase->depth, phase->main_thread ? "main" : "other",
+			ToMilliseconds( phase->start_ns - root->start_ns ), ToMilliseconds( ns ),
+			phase->bytes, ToMilliseconds( pool_ns ), Min2( utilisation, 1.0f ) );
+		json += "}";
+	}
+
+	json += "]";
+	json += "}";
+
+	u8 arena_memory[ 1024 ];
+	ArenaAllocator arena( arena_memory, sizeof( arena_memory ) );
+	TempAllocator temp = arena.temp();
+
+	const char * path = temp( "{}/profiles/{}.json", HomeDirPath(), root->name );
+	if( !WriteFile( &temp, path, json.c_str(), json.length() ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write load profile '%s'\n", path );
+		return;
+	}
+
+	Com_Printf( "%s took %.1fms, wrote %s\n", root->name.c_str(), ToMilliseconds( root->end_ns - root->start_ns ), path );
+}
+
+LoadProfileScope::LoadProfileScope( const char * name ) {
+	phase = -1;
+	previous = current_phase;
+
+	if( profile_mutex == NULL ) {
+		return;
+	}
+
+	u64 now = Sys_Nanoseconds();
+
+	Lock( profile_mutex );
+
+	if( !report_open ) {
+		report_open = true;
+		owns_report = true;
+		num_phases = 0;
+		dropped_phases = 0;
+		reporting_phase = -1;
+	}
+
+	if( num_phases == ARRAY_COUNT( phases ) ) {
+		dropped_phases++;
+	}
+	else {
+		phase = num_phases;
+		num_phases++;
+
+		LoadPhase * p = &phases[ phase ];
+		p->name.clear();
+		p->name += name;
+		p->parent = current_phase >= 0 ? current_phase : reporting_phase;
+		p->depth = p->parent >= 0 ? phases[ p->parent ].depth + 1 : 0;
+		p->main_thread = owns_report;
+		p->start_ns = now;
+		p->end_ns = now;
+		p->bytes = 0;
+		p->pool_busy_start = pool_busy_ns;
+		p->pool_busy_end = pool_busy_ns;
+
+		current_phase = phase;
+		if( owns_report ) {
+			reporting_phase = phase;
+		}
+	}
+
+	Unlock( profile_mutex );
+}
+
+LoadProfileScope::~LoadProfileScope() {
+	if( phase < 0 ) {
+		return;
+	}
+
+	u64 now = Sys_Nanoseconds();
+
+	Lock( profile_mutex );
+
+	phases[ phase ].end_ns = now;
+	phases[ phase ].pool_busy_end = pool_busy_ns;
+
+	current_phase = previous;
+
+	if( owns_report ) {
+		reporting_phase = previous;
+		if( previous < 0 ) {
+			WriteLoadProfile();
+			report_open = false;
+			owns_report = false;
+		}
+	}
+
+	Unlock( profile_mutex );
+}
+
+void LoadProfileAddBytes( size_t bytes ) {
+	if( profile_mutex == NULL || current_phase < 0 ) {
+		return;
+	}
+
+	Lock( profile_mutex );
+	phases[ current_phase ].bytes += bytes;
+	Unlock( profile_mutex );
+}
+
+void LoadProfileAddThreadPoolTime( u64 ns ) {
+	if( profile_mutex == NULL ) {
+		return;
+	}
+
+	Lock( profile_mutex );
+	pool_busy_ns += ns;
+	Unlock( profile_mutex );
+}
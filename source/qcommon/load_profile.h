@@ -0,0 +1,33 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * nested timers for map changes and asset loading. the first scope to open
+ * starts a report, scopes opened inside it record their parents, and when it
+ * closes the report gets written to <home>/profiles/<name>.json. scopes opened
+ * on other threads while a report is running hang off whatever the reporting
+ * thread was doing at the time
+ *
+ * this is always on, including in release builds, so it only takes a lock
+ * at the start and end of each phase
+ */
+
+struct LoadProfileScope {
+	s32 phase;
+	s32 previous;
+
+	LoadProfileScope( const char * name );
+	~LoadProfileScope();
+};
+
+#define LoadProfileScoped( name ) LoadProfileScope COUNTER_NAME( load_profile_ )( name )
+
+void InitLoadProfiler();
+void ShutdownLoadProfiler();
+
+// counts towards the innermost phase open on the calling thread
+void LoadProfileAddBytes( size_t bytes );
+
+// called by the thread pool workers after each job
+void LoadProfileAddThreadPoolTime( u64 ns );
@@ -3,85 +3,173 @@
 #include "qcommon/base.h"
 #include "qcommon/qcommon.h"
 #include "qcommon/array.h"
+#include "qcommon/dynamic_hashtable.h"
 #include "qcommon/fs.h"
+#include "qcommon/hash.h"
 #include "qcommon/maplist.h"
 
-static NonRAIIDynamicArray< char * > maps;
+static NonRAIIDynamicArray< MapInfo > maps;
+static NonRAIIDynamicArray< const char * > map_names;
+static NonRAIIDynamicHashtable maps_by_name; // Hash64( name ) -> index into maps
 
-void InitMapList() {
-	maps.init( sys_allocator );
-	RefreshMapList( sys_allocator );
-}
+static FSWatcher * maps_watcher;
 
 static void FreeMaps() {
-	for( char * map : maps ) {
-		FREE( sys_allocator, map );
+	for( const MapInfo & map : maps ) {
+		FREE( sys_allocator, const_cast< char * >( map.name ) );
 	}
 
 	maps.clear();
+	map_names.clear();
+	maps_by_name.clear();
+}
+
+static bool MapInfoLess( const MapInfo & a, const MapInfo & b ) {
+	int cmp = Q_stricmp( a.name, b.name );
+	return cmp == 0 ? strcmp( a.name, b.name ) < 0 : cmp < 0;
+}
+
+static void ScanMaps( const char * path ) {
+	FreeMaps();
+
+	ListDirHandle scan = BeginListDir( sys_allocator, path );
+
+	const char * filename;
+	bool dir;
+	while( ListDirNext( &scan, &filename, &dir ) ) {
+		if( dir )
+			continue;
+
+		Span< const char > ext = FileExtension( filename );
+		bool zst = ext == ".bsp.zst";
+		if( ext != ".bsp" && !zst )
+			continue;
+
+		u8 arena_memory[ 1024 ];
+		ArenaAllocator arena( arena_memory, sizeof( arena_memory ) );
+		TempAllocator temp = arena.temp();
+
+		Span< const char > name = StripExtension( filename );
+		u64 hash = Hash64( name.ptr, name.n );
+
+		// maps can have both a .bsp and a .bsp.zst
+		u64 idx;
+		if( !maps_by_name.get( hash, &idx ) ) {
+			idx = maps.add( { } );
+			maps_by_name.add( hash, idx );
+
+			MapInfo * map = &maps[ idx ];
+			map->name = ( *sys_allocator )( "{}", name );
+			map->base_hash = Hash64( temp( "maps/{}", name ) );
+			map->compressed = true;
+		}
+
+		MapInfo * map = &maps[ idx ];
+		FileMetadata metadata = FileMetadataOrZeroes( &temp, temp( "{}/{}", path, filename ) );
+		if( zst ) {
+			map->downloadable = true;
+		}
+		if( !zst || map->compressed ) {
+			map->size = metadata.size;
+			map->modified_time = metadata.modified_time;
+		}
+		if( !zst ) {
+			map->compressed = false;
+		}
+	}
+
+	std::sort( maps.begin(), maps.end(), MapInfoLess );
+
+	maps_by_name.clear();
+	for( size_t i = 0; i < maps.size(); i++ ) {
+		map_names.add( maps[ i ].name );
+		maps_by_name.add( Hash64( maps[ i ].name ), i );
+	}
+}
+
+void InitMapList() {
+	maps.init( sys_allocator );
+	map_names.init( sys_allocator );
+	maps_by_name.init( sys_allocator );
+	maps_watcher = NULL;
+
+	RefreshMapList( sys_allocator );
 }
 
 void ShutdownMapList() {
 	FreeMaps();
 	maps.shutdown();
+	map_names.shutdown();
+	maps_by_name.shutdown();
+
+	if( maps_watcher != NULL ) {
+		DeleteFSWatcher( maps_watcher );
+		maps_watcher = NULL;
+	}
 }
 
 void RefreshMapList( Allocator * a ) {
-	FreeMaps();
-
 	char * path = ( *a )( "{}/base/maps", RootDirPath() );
 	defer { FREE( a, path ); };
 
-	ListDirHandle scan = BeginListDir( a, path );
+	// make the watcher before scanning so we don't miss maps that show up halfway through
+	if( maps_watcher == NULL ) {
+		maps_watcher = NewFSWatcher( sys_allocator, path );
+		ScanMaps( path );
+		return;
+	}
 
-	const char * name;
-	bool dir;
-	while( ListDirNext( &scan, &name, &dir ) ) {
-		if( dir )
+	bool rescan = false;
+	const char * changed;
+	while( PollFSWatcher( maps_watcher, &changed ) ) {
+		if( changed == NULL ) {
+			rescan = true;
 			continue;
+		}
 
-		Span< const char > ext = FileExtension( name );
+		Span< const char > ext = FileExtension( changed );
 		if( ext == ".bsp" || ext == ".bsp.zst" ) {
-			char * map = ( *sys_allocator )( "{}", StripExtension( name ) );
-			maps.add( map );
+			rescan = true;
 		}
 	}
 
-	std::sort( maps.begin(), maps.end(), []( const char * a, const char * b ) {
-		return strcmp( a, b ) < 0;
-	} );
+	if( rescan ) {
+		ScanMaps( path );
+	}
 }
 
 Span< const char * > GetMapList() {
-	return maps.span().cast< const char * >();
+	return map_names.span();
+}
+
+const MapInfo * FindMapInfo( const char * name ) {
+	u64 idx;
+	if( !maps_by_name.get( Hash64( name ), &idx ) )
+		return NULL;
+	return &maps[ idx ];
 }
 
 bool MapExists( const char * name ) {
-	for( const char * map : maps ) {
-		if( strcmp( map, name ) == 0 ) {
-			return true;
-		}
-	}
+	return FindMapInfo( name ) != NULL;
+}
 
-	return false;
+static bool MapNameLess( const MapInfo & map, const char * prefix ) {
+	return Q_strnicmp( map.name, prefix, strlen( prefix ) ) < 0;
 }
 
 const char ** CompleteMapName( const char * prefix ) {
-	size_t n = 0;
-	for( const char * map : maps ) {
-		if( Q_strnicmp( prefix, map, strlen( prefix ) ) == 0 ) {
-			n++;
-		}
+	size_t prefix_len = strlen( prefix );
+	const MapInfo * first = std::lower_bound( maps.begin(), maps.end(), prefix, MapNameLess );
+	const MapInfo * last = first;
+	while( last != maps.end() && Q_strnicmp( last->name, prefix, prefix_len ) == 0 ) {
+		last++;
 	}
 
+	size_t n = last - first;
 	const char ** buf = ( const char ** ) Mem_TempMalloc( sizeof( const char * ) * ( n + 1 ) );
 
-	size_t i = 0;
-	for( const char * map : maps ) {
-		if( Q_strnicmp( prefix, map, strlen( prefix ) ) == 0 ) {
-			buf[ i ] = map;
-			i++;
-		}
+	for( size_t i = 0; i < n; i++ ) {
+		buf[ i ] = first[ i ].name;
 	}
 
 	return buf;
@@ -2,11 +2,29 @@
 
 #include "qcommon/types.h"
 
+/*
+ * the map list is sorted by name and indexed by Hash64( name ), so lookups
+ * don't touch the disk. an FSWatcher on base/maps tells RefreshMapList when
+ * it needs to rescan, which it only does when something changed. the
+ * watcher doesn't see deletes, so a deleted map sticks around until
+ * something else changes in the directory
+ */
+
+struct MapInfo {
+	const char * name;
+	u64 base_hash; // Hash64( "maps/<name>" ), the map's StringHash
+	u64 size; // of the .bsp, or the .bsp.zst if there's no .bsp
+	s64 modified_time;
+	bool compressed; // there's only a .bsp.zst
+	bool downloadable; // there's a .bsp.zst for clients to download
+};
+
 void InitMapList();
 void ShutdownMapList();
 
 void RefreshMapList( Allocator * a );
 Span< const char * > GetMapList();
 bool MapExists( const char * name );
+const MapInfo * FindMapInfo( const char * name );
 
 const char ** CompleteMapName( const char * prefix );
@@ -18,6 +18,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <algorithm> // std::sort
+
 #include "qcommon/qcommon.h"
 #include "qcommon/threads.h"
 
@@ -551,6 +553,18 @@ static void Mem_CountPoolStats( mempool_t *pool, int *count, int *size, int *rea
 	}
 }
 
+size_t Mem_TotalSize() {
+	int size = 0;
+
+	Lock( memMutex );
+	for( mempool_t * pool = poolChain; pool; pool = pool->next ) {
+		Mem_CountPoolStats( pool, NULL, &size, NULL );
+	}
+	Unlock( memMutex );
+
+	return size;
+}
+
 static void Mem_PrintStats() {
 	int count, size, real;
 	int total, totalsize, realsize;
@@ -664,8 +678,175 @@ static void MemList_f() {
 static void MemStats_f() {
 	Mem_CheckSentinelsGlobal();
 	Mem_PrintStats();
+
+	PoolAllocatorStats pool = GetPoolAllocatorStats();
+	Com_Printf( "pool allocator:\n" " size  chunks  in use    peak\n" );
+	for( const auto & sc : pool.classes ) {
+		if( sc.chunks > 0 ) {
+			Com_GGPrint( "{5} {7} {7} {7}", sc.size, sc.chunks, sc.in_use, sc.peak );
+		}
+	}
+	Com_GGPrint( "large: {} allocations, {}k", pool.large_allocations, pool.large_bytes / 1024 );
+}
+
+/*
+ * allocprofile
+ */
+
+struct AllocationSnapshot {
+	Span< AllocationCallsite > callsites;
+	s64 duration_ms;
+};
+
+// the two most recent snapshots, for diffing
+static AllocationSnapshot alloc_snapshots[ 2 ];
+
+static AllocationSnapshot TakeAllocationSnapshot() {
+	AllocationSnapshot snapshot;
+	snapshot.callsites = ALLOC_SPAN( sys_allocator, AllocationCallsite, MAX_PROFILED_CALLSITES );
+	snapshot.callsites.n = GetAllocationProfile( snapshot.callsites, &snapshot.duration_ms );
+	return snapshot;
+}
+
+static int AllocProfileCountArg( int arg ) {
+	if( Cmd_Argc() <= arg )
+		return 20;
+	int n = atoi( Cmd_Argv( arg ) );
+	return n > 0 ? n : 20;
+}
+
+static void PrintAllocationCallsites( Span< const AllocationCallsite > callsites, size_t n, s64 duration_ms ) {
+	Com_Printf( "    allocs    alloc/s    total k      live    live k    peak k  avg life\n" );
+	for( size_t i = 0; i < Min2( n, callsites.n ); i++ ) {
+		const AllocationCallsite & c = callsites[ i ];
+		u64 per_second = duration_ms > 0 ? c.allocations * 1000 / u64( duration_ms ) : 0;
+		u64 avg_lifetime = c.frees > 0 ? c.lifetime_ms / c.frees : 0;
+		Com_GGPrint( "{10} {10} {10} {9} {9} {9} {7}ms  {} ({}:{})",
+			c.allocations, per_second, c.bytes / 1024, c.live, c.live_bytes / 1024, c.peak_live_bytes / 1024, avg_lifetime,
+			c.func, c.file, c.line );
+	}
+}
+
+static void AllocProfileTop() {
+	const char * key = Cmd_Argc() > 3 ? Cmd_Argv( 3 ) : "bytes";
+
+	AllocationSnapshot snapshot = TakeAllocationSnapshot();
+	defer { FREE( sys_allocator, snapshot.callsites.ptr ); };
+
+	AllocationCallsite * begin = snapshot.callsites.begin();
+	AllocationCallsite * end = snapshot.callsites.end();
+	if( !Q_stricmp( key, "count" ) ) {
+		std::sort( begin, end, []( const AllocationCallsite & a, const AllocationCallsite & b ) { return a.allocations > b.allocations; } );
+	}
+	else if( !Q_stricmp( key, "live" ) ) {
+		std::sort( begin, end, []( const AllocationCallsite & a, const AllocationCallsite & b ) { return a.live_bytes > b.live_bytes; } );
+	}
+	else {
+		std::sort( begin, end, []( const AllocationCallsite & a, const AllocationCallsite & b ) { return a.bytes > b.bytes; } );
+	}
+
+	Com_GGPrint( "{} callsites over {.1}s, sorted by {}:", snapshot.callsites.n, snapshot.duration_ms / 1000.0, key );
+	PrintAllocationCallsites( snapshot.callsites, AllocProfileCountArg( 2 ), snapshot.duration_ms );
 }
 
+static void AllocProfileSnapshot() {
+	FREE( sys_allocator, alloc_snapshots[ 0 ].callsites.ptr );
+	alloc_snapshots[ 0 ] = alloc_snapshots[ 1 ];
+	alloc_snapshots[ 1 ] = TakeAllocationSnapshot();
+	Com_GGPrint( "Took allocation snapshot with {} callsites", alloc_snapshots[ 1 ].callsites.n );
+}
+
+/*
+ * callsites never move so the snapshots can be matched up by index. live
+ * counts are diffed directly, and everything else is a running total that
+ * gets diffed unless a reset happened in between
+ */
+static void AllocProfileDiff() {
+	const AllocationSnapshot & before = alloc_snapshots[ 0 ];
+	const AllocationSnapshot & after = alloc_snapshots[ 1 ];
+	if( before.callsites.ptr == NULL ) {
+		Com_Printf( "Need two snapshots to diff, use allocprofile snapshot\n" );
+		return;
+	}
+
+	bool reset = after.duration_ms < before.duration_ms;
+	s64 duration_ms = reset ? after.duration_ms : after.duration_ms - before.duration_ms;
+
+	Span< AllocationCallsite > diff = ALLOC_SPAN( sys_allocator, AllocationCallsite, after.callsites.n );
+	defer { FREE( sys_allocator, diff.ptr ); };
+
+	size_t n = 0;
+	for( size_t i = 0; i < after.callsites.n; i++ ) {
+		AllocationCallsite d = after.callsites[ i ];
+		if( i < before.callsites.n && !reset ) {
+			const AllocationCallsite & b = before.callsites[ i ];
+			d.allocations -= b.allocations;
+			d.frees -= b.frees;
+			d.bytes -= b.bytes;
+			d.lifetime_ms -= b.lifetime_ms;
+		}
+		if( i < before.callsites.n ) {
+			// wraps for callsites that shrank, which the sort treats as a decrease
+			d.live -= before.callsites[ i ].live;
+			d.live_bytes -= before.callsites[ i ].live_bytes;
+		}
+
+		if( d.allocations != 0 || d.live != 0 ) {
+			diff[ n ] = d;
+			n++;
+		}
+	}
+	diff.n = n;
+
+	std::sort( diff.begin(), diff.end(), []( const AllocationCallsite & a, const AllocationCallsite & b ) {
+		if( s64( a.live_bytes ) != s64( b.live_bytes ) )
+			return s64( a.live_bytes ) > s64( b.live_bytes );
+		return a.allocations > b.allocations;
+	} );
+
+	Com_GGPrint( "{} callsites changed over {.1}s, sorted by live bytes gained:", diff.n, duration_ms / 1000.0 );
+	Com_Printf( "    allocs    alloc/s    total k  live +/-  live k +/-\n" );
+	for( size_t i = 0; i < Min2( size_t( AllocProfileCountArg( 2 ) ), diff.n ); i++ ) {
+		const AllocationCallsite & c = diff[ i ];
+		u64 per_second = duration_ms > 0 ? c.allocations * 1000 / u64( duration_ms ) : 0;
+		Com_GGPrint( "{10} {10} {10} {9} {11}  {} ({}:{})",
+			c.allocations, per_second, c.bytes / 1024, s64( c.live ), s64( c.live_bytes ) / 1024,
+			c.func, c.file, c.line );
+	}
+}
+
+static void AllocProfile_f() {
+	const char * cmd = Cmd_Argc() > 1 ? Cmd_Argv( 1 ) : "";
+
+	if( !Q_stricmp( cmd, "start" ) ) {
+		if( !EnableAllocationProfiler( true ) ) {
+			Com_Printf( "The allocation profiler doesn't work in this build\n" );
+			return;
+		}
+		Com_Printf( "Allocation profiler started\n" );
+	}
+	else if( !Q_stricmp( cmd, "stop" ) ) {
+		EnableAllocationProfiler( false );
+		Com_Printf( "Allocation profiler stopped\n" );
+	}
+	else if( !Q_stricmp( cmd, "reset" ) ) {
+		ResetAllocationProfiler();
+	}
+	else if( !Q_stricmp( cmd, "top" ) ) {
+		AllocProfileTop();
+	}
+	else if( !Q_stricmp( cmd, "snapshot" ) ) {
+		AllocProfileSnapshot();
+	}
+	else if( !Q_stricmp( cmd, "diff" ) ) {
+		AllocProfileDiff();
+	}
+	else {
+		Com_Printf( "Usage: %s start|stop|reset|snapshot\n", Cmd_Argv( 0 ) );
+		Com_Printf( "       %s top [n] [bytes|count|live]\n", Cmd_Argv( 0 ) );
+		Com_Printf( "       %s diff [n]: compares the last two snapshots\n", Cmd_Argv( 0 ) );
+	}
+}
 
 /*
 * Memory_Init
@@ -691,6 +872,7 @@ void Memory_InitCommands() {
 
 	Cmd_AddCommand( "memlist", MemList_f );
 	Cmd_AddCommand( "memstats", MemStats_f );
+	Cmd_AddCommand( "allocprofile", AllocProfile_f );
 
 	commands_initialized = true;
 }
@@ -740,4 +922,11 @@ void Memory_ShutdownCommands() {
 
 	Cmd_RemoveCommand( "memlist" );
 	Cmd_RemoveCommand( "memstats" );
+	Cmd_RemoveCommand( "allocprofile" );
+
+	EnableAllocationProfiler( false );
+	for( AllocationSnapshot & snapshot : alloc_snapshots ) {
+		FREE( sys_allocator, snapshot.callsites.ptr );
+		snapshot = { };
+	}
 }
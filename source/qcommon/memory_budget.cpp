@@ -0,0 +1,160 @@
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/memory_budget.h"
+
+constexpr size_t MAX_MEMORY_BUDGETS = 64;
+
+// arrays smaller than this aren't worth shrinking even if they're empty
+constexpr size_t OVERPROVISIONED_MIN_BYTES = 256 * 1024;
+
+struct RegisteredBudget {
+	const char * name;
+	MemoryBudgetCallback callback;
+
+	const char * array_names[ MAX_MEMORY_BUDGET_ARRAYS ];
+	size_t peak_used_bytes[ MAX_MEMORY_BUDGET_ARRAYS ];
+};
+
+static RegisteredBudget budgets[ MAX_MEMORY_BUDGETS ];
+static size_t num_budgets;
+
+static MemoryBudget PollBudget( RegisteredBudget * rb ) {
+	MemoryBudget budget = { };
+	rb->callback( &budget );
+
+	for( size_t i = 0; i < budget.num_arrays; i++ ) {
+		const MemoryBudget::FixedArray & arr = budget.arrays[ i ];
+		if( rb->array_names[ i ] != arr.name ) {
+			rb->array_names[ i ] = arr.name;
+			rb->peak_used_bytes[ i ] = 0;
+		}
+		rb->peak_used_bytes[ i ] = Max2( rb->peak_used_bytes[ i ], arr.used_bytes );
+	}
+
+	return budget;
+}
+
+static size_t ArrayBytes( const MemoryBudget & budget, bool on_heap ) {
+	size_t bytes = 0;
+	for( size_t i = 0; i < budget.num_arrays; i++ ) {
+		if( budget.arrays[ i ].on_heap == on_heap ) {
+			bytes += budget.arrays[ i ].bytes;
+		}
+	}
+	return bytes;
+}
+
+static size_t SysAllocatorBytes() {
+	PoolAllocatorStats stats = GetPoolAllocatorStats();
+
+	size_t bytes = stats.large_bytes;
+	for( const auto & size_class : stats.classes ) {
+		bytes += size_class.in_use * size_class.size;
+	}
+
+	return bytes;
+}
+
+static bool Overprovisioned( size_t bytes, size_t peak_used_bytes ) {
+	return bytes >= OVERPROVISIONED_MIN_BYTES && peak_used_bytes < bytes / 4;
+}
+
+static size_t KB( size_t bytes ) {
+	return ( bytes + 1023 ) / 1024;
+}
+
+static float Percent( size_t used, size_t bytes ) {
+	return bytes == 0 ? 0.0f : 100.0f * used / bytes;
+}
+
+static void MemoryBudget_f() {
+	bool list_arrays = Cmd_Argc() >= 2 && Q_stricmp( Cmd_Argv( 1 ), "all" ) == 0;
+
+	size_t total_static = 0;
+	size_t total_vram = 0;
+	size_t num_overprovisioned = 0;
+
+	Com_Printf( "%-24s %10s %10s %10s\n", "budget", "static", "heap", "vram" );
+
+	for( size_t i = 0; i < num_budgets; i++ ) {
+		RegisteredBudget * rb = &budgets[ i ];
+		MemoryBudget budget = PollBudget( rb );
+
+		size_t static_bytes = ArrayBytes( budget, false );
+		size_t heap_bytes = budget.heap_bytes + ArrayBytes( budget, true );
+		Com_Printf( "%-24s %9zuK %9zuK %9zuK\n", rb->name, KB( static_bytes ), KB( heap_bytes ), KB( budget.vram_bytes ) );
+
+		for( size_t j = 0; j < budget.num_arrays; j++ ) {
+			const MemoryBudget::FixedArray & arr = budget.arrays[ j ];
+			bool overprovisioned = Overprovisioned( arr.bytes, rb->peak_used_bytes[ j ] );
+			if( overprovisioned ) {
+				num_overprovisioned++;
+			}
+
+			if( list_arrays || overprovisioned ) {
+				Com_Printf( "%s  %-22s %9zuK %5.1f%% used, %5.1f%% peak%s%s\n", overprovisioned ? S_COLOR_YELLOW : "",
+					arr.name, KB( arr.bytes ), Percent( arr.used_bytes, arr.bytes ), Percent( rb->peak_used_bytes[ j ], arr.bytes ),
+					arr.on_heap ? ", on the heap" : "", overprovisioned ? ", overprovisioned" : "" );
+			}
+		}
+
+		total_static += static_bytes;
+		total_vram += budget.vram_bytes;
+	}
+
+	size_t sys_allocator_bytes = SysAllocatorBytes();
+	size_t mempool_bytes = Mem_TotalSize();
+
+	Com_Printf( "static %zuK, sys_allocator %zuK, mempools %zuK, vram %zuK\n", KB( total_static ), KB( sys_allocator_bytes ), KB( mempool_bytes ), KB( total_vram ) );
+	Com_Printf( "total %zuK without vram\n", KB( total_static + sys_allocator_bytes + mempool_bytes ) );
+	if( num_overprovisioned > 0 ) {
+		Com_Printf( "%zu arrays over %zuK have never been more than 25%% full\n", num_overprovisioned, KB( OVERPROVISIONED_MIN_BYTES ) );
+	}
+}
+
+void InitMemoryBudgets() {
+	num_budgets = 0;
+
+	Cmd_AddCommand( "membudget", MemoryBudget_f );
+}
+
+void ShutdownMemoryBudgets() {
+	Cmd_RemoveCommand( "membudget" );
+}
+
+void AddMemoryBudget( const char * name, MemoryBudgetCallback callback ) {
+	RemoveMemoryBudget( name );
+
+	if( num_budgets == ARRAY_COUNT( budgets ) ) {
+		Com_Printf( S_COLOR_YELLOW "Too many memory budgets, ignoring %s\n", name );
+		return;
+	}
+
+	RegisteredBudget * rb = &budgets[ num_budgets ];
+	*rb = { };
+	rb->name = name;
+	rb->callback = callback;
+	num_budgets++;
+}
+
+void RemoveMemoryBudget( const char * name ) {
+	for( size_t i = 0; i < num_budgets; i++ ) {
+		if( strcmp( budgets[ i ].name, name ) == 0 ) {
+			budgets[ i ] = budgets[ num_budgets - 1 ];
+			num_budgets--;
+			return;
+		}
+	}
+}
+
+void MemoryBudgetsFrame() {
+	ZoneScoped;
+
+	for( size_t i = 0; i < num_budgets; i++ ) {
+		MemoryBudget budget = PollBudget( &budgets[ i ] );
+		TracyPlot( budgets[ i ].name, s64( ArrayBytes( budget, false ) + ArrayBytes( budget, true ) + budget.heap_bytes + budget.vram_bytes ) );
+	}
+
+	TracyPlot( "sys_allocator bytes", s64( SysAllocatorBytes() ) );
+	TracyPlot( "Mempool bytes", s64( Mem_TotalSize() ) );
+}
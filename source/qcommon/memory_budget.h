@@ -0,0 +1,61 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * subsystems register a callback that fills in how much memory they're
+ * holding on to. fixed size arrays get listed one by one with how much of
+ * them is live, heap is what they know they've allocated, and vram is an
+ * estimate from the sizes and formats of their GPU resources
+ *
+ * budgets get polled once a frame to keep a high water mark for each array
+ * and feed the Tracy plots, and membudget prints everything. big arrays
+ * that have never been more than a quarter full get flagged so we know
+ * which MAX_WHATEVERs are worth shrinking
+ *
+ * heap numbers are a breakdown, they mostly come out of sys_allocator or a
+ * mempool so the totals come from those instead of adding them up again
+ */
+
+constexpr size_t MAX_MEMORY_BUDGET_ARRAYS = 16;
+
+struct MemoryBudget {
+	struct FixedArray {
+		const char * name;
+		size_t bytes;
+		size_t used_bytes;
+		bool on_heap; // allocated once up front, so counted by the heap totals
+	};
+
+	FixedArray arrays[ MAX_MEMORY_BUDGET_ARRAYS ];
+	size_t num_arrays;
+
+	size_t heap_bytes;
+	size_t vram_bytes;
+
+	void add_array( const char * name, size_t bytes, size_t used, size_t capacity, bool on_heap = false ) {
+		assert( num_arrays < ARRAY_COUNT( arrays ) );
+		FixedArray * arr = &arrays[ num_arrays ];
+		arr->name = name;
+		arr->bytes = bytes;
+		arr->used_bytes = capacity == 0 ? 0 : size_t( double( bytes ) * Min2( used, capacity ) / capacity );
+		arr->on_heap = on_heap;
+		num_arrays++;
+	}
+
+	template< typename T, size_t N >
+	void add_array( const char * name, const T ( &arr )[ N ], size_t used ) {
+		add_array( name, sizeof( arr ), used, N );
+	}
+};
+
+typedef void ( *MemoryBudgetCallback )( MemoryBudget * budget );
+
+void InitMemoryBudgets();
+void ShutdownMemoryBudgets();
+
+// name has to stick around until RemoveMemoryBudget
+void AddMemoryBudget( const char * name, MemoryBudgetCallback callback );
+void RemoveMemoryBudget( const char * name );
+
+void MemoryBudgetsFrame();
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+
+#include "qcommon/types.h"
+
+/*
+ * lock-free bounded queue for any number of threads pushing and exactly one
+ * thread popping. each slot has a sequence number saying whose turn it is,
+ * so producers only contend on claiming a slot and never wait on the
+ * consumer. push fails when it's full
+ */
+template< typename T, size_t N >
+class MPSCQueue {
+	STATIC_ASSERT( IsPowerOf2( N ) );
+
+	struct Slot {
+		std::atomic< u64 > seq;
+		T item;
+	};
+
+	Slot slots[ N ];
+
+	// on separate cache lines so producers don't fight with the consumer
+	alignas( 64 ) std::atomic< u64 > tail;
+	alignas( 64 ) u64 head; // only touched by the consumer
+
+public:
+	MPSCQueue() {
+		clear();
+	}
+
+	// only when no thread is using it
+	void clear() {
+		for( size_t i = 0; i < N; i++ ) {
+			slots[ i ].seq.store( i, std::memory_order_relaxed );
+		}
+		tail.store( 0, std::memory_order_relaxed );
+		head = 0;
+	}
+
+	bool push( const T & x ) {
+		u64 t = tail.load( std::memory_order_relaxed );
+		while( true ) {
+			Slot * slot = &slots[ t % N ];
+			s64 diff = s64( slot->seq.load( std::memory_order_acquire ) - t );
+
+			if( diff == 0 ) {
+				// compare_exchange reloads t if another producer got there first
+				if( tail.compare_exchange_weak( t, t + 1, std::memory_order_relaxed ) ) {
+					slot->item = x;
+					slot->seq.store( t + 1, std::memory_order_release );
+					return true;
+				}
+			}
+			else if( diff < 0 ) {
+				// the consumer hasn't freed this slot from the last lap yet
+				return false;
+			}
+			else {
+				t = tail.load( std::memory_order_relaxed );
+			}
+		}
+	}
+
+	bool pop( T * x ) {
+		Slot * slot = &slots[ head % N ];
+		if( slot->seq.load( std::memory_order_acquire ) != head + 1 )
+			return false;
+
+		*x = slot->item;
+		slot->seq.store( head + N, std::memory_order_release );
+		head++;
+		return true;
+	}
+};
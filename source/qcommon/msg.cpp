@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "qcommon/qcommon.h"
 #include "qcommon/half_float.h"
+#include "qcommon/hash.h"
 #include "qcommon/serialization.h"
 
 #define MAX_MSG_STRING_CHARS    2048
@@ -63,11 +64,19 @@ struct DeltaBuffer {
 	u32 num_fields;
 	u32 field_mask_read_cursor;
 
+	// partial byte for bit packed fields, flushed before any byte aligned data
+	u64 bits;
+	u32 num_bits;
+
 	bool serializing;
 	bool error;
 };
 
-static void MSG_WriteDeltaBuffer( msg_t * msg, const DeltaBuffer & delta ) {
+static void FlushBits( DeltaBuffer * buf );
+
+static void MSG_WriteDeltaBuffer( msg_t * msg, DeltaBuffer & delta ) {
+	FlushBits( &delta );
+
 	MSG_WriteUintBase128( msg, delta.num_fields );
 	u8 bytes = ( delta.num_fields + 7 ) / 8;
 	MSG_WriteData( msg, delta.field_mask, bytes );
@@ -131,7 +140,69 @@ static bool GetBit( DeltaBuffer * buf ) {
 	return b;
 }
 
+static void FlushBits( DeltaBuffer * buf ) {
+	if( buf->num_bits == 0 )
+		return;
+
+	if( buf->error || buf->cursor == buf->end ) {
+		buf->error = true;
+		return;
+	}
+
+	*buf->cursor = u8( buf->bits );
+	buf->cursor++;
+	buf->bits = 0;
+	buf->num_bits = 0;
+}
+
+static void AlignBits( DeltaBuffer * buf ) {
+	buf->bits = 0;
+	buf->num_bits = 0;
+}
+
+static void AddBits( DeltaBuffer * buf, u32 x, u32 n ) {
+	assert( n <= 32 );
+
+	buf->bits |= u64( x & ( ( U64( 1 ) << n ) - 1 ) ) << buf->num_bits;
+	buf->num_bits += n;
+
+	while( buf->num_bits >= 8 ) {
+		if( buf->error || buf->cursor == buf->end ) {
+			buf->error = true;
+			return;
+		}
+
+		*buf->cursor = u8( buf->bits );
+		buf->cursor++;
+		buf->bits >>= 8;
+		buf->num_bits -= 8;
+	}
+}
+
+static u32 GetBits( DeltaBuffer * buf, u32 n ) {
+	assert( n <= 32 );
+
+	while( buf->num_bits < n ) {
+		if( buf->error || buf->cursor == buf->end ) {
+			buf->error = true;
+			return 0;
+		}
+
+		buf->bits |= u64( *buf->cursor ) << buf->num_bits;
+		buf->cursor++;
+		buf->num_bits += 8;
+	}
+
+	u32 x = u32( buf->bits & ( ( U64( 1 ) << n ) - 1 ) );
+	buf->bits >>= n;
+	buf->num_bits -= n;
+
+	return x;
+}
+
 static void AddBytes( DeltaBuffer * buf, const void * data, size_t n ) {
+	FlushBits( buf );
+
 	if( buf->error || size_t( buf->end - buf->cursor ) < n ) {
 		buf->error = true;
 		return;
@@ -142,6 +213,8 @@ static void AddBytes( DeltaBuffer * buf, const void * data, size_t n ) {
 }
 
 static void GetBytes( DeltaBuffer * buf, void * data, size_t n ) {
+	AlignBits( buf );
+
 	if( buf->error || size_t( buf->end - buf->cursor ) < n ) {
 		buf->error = true;
 		memset( data, 0, n );
@@ -244,6 +317,65 @@ static void DeltaAngle( DeltaBuffer * buf, Vec3 & v, const Vec3 & baseline ) {
 	}
 }
 
+/*
+ * fixed point fields packed into the bit stream. values are rounded to a
+ * multiple of step and clamped to a signed range of the given bit width, so
+ * both sides agree on the value as long as they use the same schema
+ */
+struct Quantization {
+	float step;
+	u32 bits;
+};
+
+constexpr Quantization Quantize_Position = { 1.0f / 8.0f, 24 }; // +-1M units
+constexpr Quantization Quantize_Velocity = { 1.0f / 8.0f, 20 }; // +-64k units/s
+constexpr Quantization Quantize_Angle = { 360.0f / 65536.0f, 16 };
+
+static s32 Quantize( float x, Quantization q ) {
+	s32 max = ( s32( 1 ) << ( q.bits - 1 ) ) - 1;
+	return Clamp( -max - 1, s32( roundf( x / q.step ) ), max );
+}
+
+static void DeltaQuantized( DeltaBuffer * buf, float & x, const float & baseline, Quantization q ) {
+	s32 qx = Quantize( x, q );
+	s32 qbaseline = Quantize( baseline, q );
+
+	if( buf->serializing ) {
+		AddBit( buf, qx != qbaseline );
+		if( qx != qbaseline ) {
+			AddBits( buf, u32( qx ), q.bits );
+		}
+	}
+	else {
+		if( GetBit( buf ) ) {
+			u32 sign_bit = u32( 1 ) << ( q.bits - 1 );
+			u32 raw = GetBits( buf, q.bits );
+			qx = s32( ( raw ^ sign_bit ) - sign_bit );
+		}
+		else {
+			qx = qbaseline;
+		}
+
+		x = qx * q.step;
+	}
+}
+
+static void DeltaQuantized( DeltaBuffer * buf, Vec3 & v, const Vec3 & baseline, Quantization q ) {
+	for( int i = 0; i < 3; i++ ) {
+		DeltaQuantized( buf, v[ i ], baseline[ i ], q );
+	}
+}
+
+static void DeltaQuantizedAngle( DeltaBuffer * buf, Vec3 & v, const Vec3 & baseline ) {
+	for( int i = 0; i < 3; i++ ) {
+		float angle = AngleNormalize180( v[ i ] );
+		DeltaQuantized( buf, angle, AngleNormalize180( baseline[ i ] ), Quantize_Angle );
+		if( !buf->serializing ) {
+			v[ i ] = angle;
+		}
+	}
+}
+
 //==================================================
 // WRITE FUNCTIONS
 //==================================================
@@ -510,8 +642,8 @@ static void Delta( DeltaBuffer * buf, SyncEvent & event, const SyncEvent & basel
 static void Delta( DeltaBuffer * buf, SyncEntityState & ent, const SyncEntityState & baseline ) {
 	Delta( buf, ent.events, baseline.events );
 
-	Delta( buf, ent.origin, baseline.origin );
-	DeltaAngle( buf, ent.angles, baseline.angles );
+	DeltaQuantized( buf, ent.origin, baseline.origin, Quantize_Position );
+	DeltaQuantizedAngle( buf, ent.angles, baseline.angles );
 
 	Delta( buf, ent.bounds, baseline.bounds );
 
@@ -535,14 +667,14 @@ static void Delta( DeltaBuffer * buf, SyncEntityState & ent, const SyncEntitySta
 	Delta( buf, ent.radius, baseline.radius );
 	Delta( buf, ent.team, baseline.team );
 
-	Delta( buf, ent.origin2, baseline.origin2 );
+	Delta( buf, ent.origin2, baseline.origin2 ); // sometimes a direction, keep full precision
 
 	Delta( buf, ent.linearMovementTimeStamp, baseline.linearMovementTimeStamp );
 	Delta( buf, ent.linearMovement, baseline.linearMovement );
 	Delta( buf, ent.linearMovementDuration, baseline.linearMovementDuration );
-	Delta( buf, ent.linearMovementVelocity, baseline.linearMovementVelocity );
-	Delta( buf, ent.linearMovementBegin, baseline.linearMovementBegin );
-	Delta( buf, ent.linearMovementEnd, baseline.linearMovementEnd );
+	DeltaQuantized( buf, ent.linearMovementVelocity, baseline.linearMovementVelocity, Quantize_Velocity );
+	DeltaQuantized( buf, ent.linearMovementBegin, baseline.linearMovementBegin, Quantize_Position );
+	DeltaQuantized( buf, ent.linearMovementEnd, baseline.linearMovementEnd, Quantize_Position );
 	Delta( buf, ent.linearMovementTimeDelta, baseline.linearMovementTimeDelta );
 
 	Delta( buf, ent.silhouetteColor, baseline.silhouetteColor );
@@ -585,12 +717,61 @@ void MSG_WriteDeltaEntity( msg_t * msg, const SyncEntityState * baseline, const
 	MSG_WriteDeltaBuffer( msg, delta );
 }
 
+/*
+* MSG_WriteDeltaEntityFromClass
+*
+* For new entities that delta against baselines[ MAX_EDICTS + class_baseline ].
+* The remove bit means nothing for an entity that isn't in the old frame, so
+* it flags that the class baseline index comes next
+*/
+void MSG_WriteDeltaEntityFromClass( msg_t * msg, int class_baseline, const SyncEntityState * baseline, const SyncEntityState * ent ) {
+	u8 buf[ MAX_MSGLEN ];
+	DeltaBuffer delta = DeltaWriter( buf, sizeof( buf ) );
+
+	Delta( &delta, *const_cast< SyncEntityState * >( ent ), *baseline );
+
+	MSG_WriteEntityNumber( msg, ent->number, true );
+	MSG_WriteUintBase128( msg, class_baseline );
+	MSG_WriteDeltaBuffer( msg, delta );
+}
+
 void MSG_ReadDeltaEntity( msg_t * msg, const SyncEntityState * baseline, SyncEntityState * ent ) {
 	DeltaBuffer delta = MSG_StartReadingDeltaBuffer( msg );
 	Delta( &delta, *ent, *baseline );
 	MSG_FinishReadingDeltaBuffer( msg, delta );
 }
 
+//==================================================
+// DELTA SNAPSHOT EVENTS
+//==================================================
+
+static void Delta( DeltaBuffer * buf, SyncSnapEvent & ev, const SyncSnapEvent & baseline ) {
+	Delta( buf, ev.event, baseline.event );
+	Delta( buf, ev.svflags, baseline.svflags );
+	DeltaQuantized( buf, ev.origin, baseline.origin, Quantize_Position );
+	Delta( buf, ev.origin2, baseline.origin2 ); // sometimes a direction, keep full precision
+	DeltaQuantizedAngle( buf, ev.angles, baseline.angles );
+	Delta( buf, ev.ownerNum, baseline.ownerNum );
+	Delta( buf, ev.team, baseline.team );
+}
+
+/*
+ * events are delta'd against the previous event in the snapshot, since a
+ * burst of them tends to share a team and be close together
+ */
+void MSG_WriteDeltaSnapEvent( msg_t * msg, const SyncSnapEvent * baseline, const SyncSnapEvent * ev ) {
+	u8 buf[ MAX_MSGLEN ];
+	DeltaBuffer delta = DeltaWriter( buf, sizeof( buf ) );
+	Delta( &delta, *const_cast< SyncSnapEvent * >( ev ), *baseline );
+	MSG_WriteDeltaBuffer( msg, delta );
+}
+
+void MSG_ReadDeltaSnapEvent( msg_t * msg, const SyncSnapEvent * baseline, SyncSnapEvent * ev ) {
+	DeltaBuffer delta = MSG_StartReadingDeltaBuffer( msg );
+	Delta( &delta, *ev, *baseline );
+	MSG_FinishReadingDeltaBuffer( msg, delta );
+}
+
 //==================================================
 // DELTA USER CMDS
 //==================================================
@@ -725,6 +906,24 @@ void MSG_ReadDeltaPlayerState( msg_t * msg, const SyncPlayerState * baseline, Sy
 	MSG_FinishReadingDeltaBuffer( msg, delta );
 }
 
+bool MSG_PlayerStatesMatch( const SyncPlayerState * a, const SyncPlayerState * b ) {
+	// Delta rounds some fields in place
+	SyncPlayerState copy = *a;
+
+	u8 buf[ MAX_MSGLEN ];
+	DeltaBuffer delta = DeltaWriter( buf, sizeof( buf ) );
+
+	Delta( &delta, copy, *b );
+
+	for( u8 x : delta.field_mask ) {
+		if( x != 0 ) {
+			return false;
+		}
+	}
+
+	return !delta.error;
+}
+
 //==================================================
 // DELTA GAME STATES
 //==================================================
@@ -738,6 +937,39 @@ static void Delta( DeltaBuffer * buf, SyncScoreboardPlayer & player, const SyncS
 	Delta( buf, player.alive, baseline.alive );
 }
 
+static bool operator==( const SyncScoreboardPlayer & a, const SyncScoreboardPlayer & b ) {
+	return a.ping == b.ping && a.score == b.score && a.kills == b.kills &&
+		a.ready == b.ready && a.carrier == b.carrier && a.alive == b.alive;
+}
+
+/*
+ * DeltaRows
+ *
+ * each row gets one bit saying whether it differs from the baseline, and only
+ * changed rows delta their fields. most scoreboard rows don't change between
+ * snapshots so this keeps the field mask from growing with the player count
+ */
+template< typename T, size_t N >
+static void DeltaRows( DeltaBuffer * buf, T ( &rows )[ N ], const T ( &baseline )[ N ] ) {
+	for( size_t i = 0; i < N; i++ ) {
+		if( buf->serializing ) {
+			bool changed = !( rows[ i ] == baseline[ i ] );
+			AddBit( buf, changed );
+			if( changed ) {
+				Delta( buf, rows[ i ], baseline[ i ] );
+			}
+		}
+		else {
+			if( GetBit( buf ) ) {
+				Delta( buf, rows[ i ], baseline[ i ] );
+			}
+			else {
+				rows[ i ] = baseline[ i ];
+			}
+		}
+	}
+}
+
 static void Delta( DeltaBuffer * buf, SyncTeamState & team, const SyncTeamState & baseline ) {
 	Delta( buf, team.player_indices, baseline.player_indices );
 	Delta( buf, team.score, baseline.score );
@@ -763,7 +995,7 @@ static void Delta( DeltaBuffer * buf, SyncGameState & state, const SyncGameState
 	DeltaEnum( buf, state.round_state, baseline.round_state );
 	DeltaEnum( buf, state.round_type, baseline.round_type );
 	Delta( buf, state.teams, baseline.teams );
-	Delta( buf, state.players, baseline.players );
+	DeltaRows( buf, state.players, baseline.players );
 	Delta( buf, state.map, baseline.map );
 	Delta( buf, state.map_checksum, baseline.map_checksum );
 	Delta( buf, state.bomb, baseline.bomb );
@@ -793,3 +1025,13 @@ void MSG_ReadDeltaGameState( msg_t * msg, const SyncGameState * baseline, SyncGa
 	Delta( &delta, *state, *baseline );
 	MSG_FinishReadingDeltaBuffer( msg, delta );
 }
+
+u64 ConfigstringBlockHash( const char ( *configstrings )[ MAX_CONFIGSTRING_CHARS ], size_t block ) {
+	u64 hash = Hash64( u64( block ) );
+	size_t end = Min2( ( block + 1 ) * CONFIGSTRING_BLOCK_SIZE, size_t( MAX_CONFIGSTRINGS ) );
+	for( size_t i = block * CONFIGSTRING_BLOCK_SIZE; i < end; i++ ) {
+		// include the terminator so "a" "" and "" "a" are different
+		hash = Hash64( configstrings[ i ], strlen( configstrings[ i ] ) + 1, hash );
+	}
+	return hash;
+}
@@ -36,6 +36,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #endif
 
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/rng.h"
 #include "qcommon/sys_net.h"
 
 #define MAX_LOOPBACK    4
@@ -68,6 +70,17 @@ static loopback_t loopbacks[2];
 static char errorstring[MAX_PRINTMSG];
 static bool net_initialized = false;
 
+struct queued_send_t {
+	const socket_t *socket;
+	netadr_t address;
+	size_t length;
+	uint8_t data[MAX_PACKETLEN];
+};
+
+static queued_send_t queued_sends[64];
+static int num_queued_sends;
+static bool batching_sends = false;
+
 /*
 =============================================================================
 PRIVATE FUNCTIONS
@@ -335,6 +348,102 @@ static bool NET_UDP_SendPacket( const socket_t *socket, const void *data, size_t
 	return true;
 }
 
+/*
+* NET_UDP_GetPackets
+*/
+static int NET_UDP_GetPackets( const socket_t *socket, netadr_t *addresses, msg_t *messages, int n ) {
+	struct sockaddr_storage from[ 64 ];
+	sys_datagram_t datagrams[ 64 ];
+
+	assert( socket && socket->open && socket->type == SOCKET_UDP );
+	assert( addresses );
+	assert( messages );
+
+	n = Min2( n, int( ARRAY_COUNT( datagrams ) ) );
+	for( int i = 0; i < n; i++ ) {
+		assert( messages[ i ].data );
+		assert( messages[ i ].maxsize > 0 );
+
+		datagrams[ i ].data = messages[ i ].data;
+		datagrams[ i ].length = messages[ i ].maxsize;
+		datagrams[ i ].address = &from[ i ];
+	}
+
+	int ret = Sys_NET_RecvDatagrams( socket->handle, datagrams, n );
+	if( ret == SOCKET_ERROR ) {
+		net_error_t err;
+
+		NET_SetErrorStringFromLastError( "recvfrom" );
+
+		err = Sys_NET_GetLastError();
+		if( err == NET_ERR_WOULDBLOCK || err == NET_ERR_CONNRESET ) { // would block
+			return 0;
+		}
+
+		return -1;
+	}
+
+	// move the good packets to the front
+	int received = 0;
+	for( int i = 0; i < ret; i++ ) {
+		if( !SockaddressToAddress( (struct sockaddr*)&from[ i ], &addresses[ received ] ) ) {
+			continue;
+		}
+
+		if( datagrams[ i ].length == messages[ i ].maxsize ) {
+			NET_SetErrorString( "Oversized packet" );
+			continue;
+		}
+
+		Swap2( &messages[ i ], &messages[ received ] );
+		messages[ received ].readcount = 0;
+		messages[ received ].cursize = datagrams[ i ].length;
+		received++;
+	}
+
+	return received == 0 ? -1 : received;
+}
+
+/*
+* NET_UDP_SendPackets
+*/
+static int NET_UDP_SendPackets( const socket_t *socket, const netpacket_t *packets, int n ) {
+	struct sockaddr_storage addrs[ 64 ];
+	sys_datagram_t datagrams[ 64 ];
+
+	assert( socket && socket->open && socket->type == SOCKET_UDP );
+	assert( packets );
+
+	int sent = 0;
+	while( sent < n ) {
+		int batch = Min2( n - sent, int( ARRAY_COUNT( datagrams ) ) );
+		for( int i = 0; i < batch; i++ ) {
+			const netpacket_t * packet = &packets[ sent + i ];
+			assert( packet->length > 0 );
+			assert( packet->address.type != NA_NOTRANSMIT );
+
+			if( !AddressToSockaddress( &packet->address, &addrs[ i ] ) ) {
+				return sent;
+			}
+
+			datagrams[ i ].data = const_cast< void * >( packet->data );
+			datagrams[ i ].length = packet->length;
+			datagrams[ i ].address = &addrs[ i ];
+			datagrams[ i ].addrlen = addrs[ i ].ss_family == AF_INET6 ? sizeof( struct sockaddr_in6 ) : sizeof( struct sockaddr_in );
+		}
+
+		int ret = Sys_NET_SendDatagrams( socket->handle, datagrams, batch );
+		if( ret == SOCKET_ERROR ) {
+			NET_SetErrorStringFromLastError( "sendto" );
+			return sent;
+		}
+
+		sent += ret;
+	}
+
+	return sent;
+}
+
 /*
 * NET_IP_OpenSocket
 */
@@ -527,6 +636,26 @@ static int NET_TCP_Send( const socket_t *socket, const void *data, size_t length
 	return ret;
 }
 
+/*
+* NET_TCP_SendFile
+*/
+static int NET_TCP_SendFile( const socket_t *socket, FILE *file, size_t offset, size_t length ) {
+	assert( socket && socket->open && socket->type == SOCKET_TCP );
+	assert( file );
+	assert( length > 0 );
+
+	int ret = Sys_NET_SendFile( socket->handle, file, offset, length );
+	if( ret == SOCKET_ERROR ) {
+		NET_SetErrorStringFromLastError( "sendfile" );
+		if( Sys_NET_GetLastError() == NET_ERR_WOULDBLOCK ) { // would block
+			return 0;
+		}
+		return -1;
+	}
+
+	return ret;
+}
+
 /*
 * NET_TCP_Listen
 */
@@ -739,6 +868,251 @@ static bool NET_TCP_SendPacket( const socket_t *socket, const void *data, size_t
 	return true;
 }
 
+/*
+=============================================================================
+LINK SIMULATOR
+=============================================================================
+*/
+
+/*
+* Fakes a bad connection on client sockets so netcode changes can be tested
+* without external tools. Everything a client socket sends or receives goes
+* through a timed queue, so a listen server gets each direction simulated
+* once and a remote server gets the player's end of the link. Server
+* sockets are never touched, which also keeps the queue on the main thread.
+*
+* net_sim_latency is round trip, half of it goes each way. net_sim_jitter
+* adds up to that many ms per packet without reordering them, and
+* net_sim_reorder is the percentage held back long enough for later packets
+* to overtake them. net_sim_bandwidth caps each direction of each socket in
+* KB/s, with a second of buffering before it starts dropping. net_sim_seed
+* makes runs repeatable.
+*
+* Queued packets only go out when the socket is used, so the delays are
+* rounded up to the client's frame time.
+*/
+
+#define NET_SIM_MAX_BUFFERING 1000000 // usec
+
+struct SimulatedPacket {
+	const socket_t *socket;
+	bool incoming;
+	netadr_t address;
+	int64_t due; // usec
+	uint64_t seq;
+	Span< uint8_t > data;
+};
+
+struct SimulatedLink {
+	const socket_t *socket;
+	bool incoming;
+	int64_t busy_until;
+	int64_t last_due;
+};
+
+static cvar_t *net_sim_latency;
+static cvar_t *net_sim_jitter;
+static cvar_t *net_sim_loss;
+static cvar_t *net_sim_reorder;
+static cvar_t *net_sim_bandwidth;
+static cvar_t *net_sim_seed;
+
+static NonRAIIDynamicArray< SimulatedPacket > sim_packets;
+static NonRAIIDynamicArray< SimulatedLink > sim_links;
+static RNG sim_rng;
+static uint64_t sim_seq;
+
+static bool NET_SimEnabled() {
+	return net_sim_latency->value > 0 || net_sim_jitter->value > 0 || net_sim_loss->value > 0 ||
+		net_sim_reorder->value > 0 || net_sim_bandwidth->value > 0;
+}
+
+static bool NET_SimSocket( const socket_t *socket ) {
+	if( socket->server || socket->type == SOCKET_TCP ) {
+		return false;
+	}
+
+	// keep draining after it gets turned off
+	return NET_SimEnabled() || sim_packets.size() > 0;
+}
+
+static SimulatedLink *NET_SimFindLink( const socket_t *socket, bool incoming ) {
+	for( SimulatedLink & link : sim_links ) {
+		if( link.socket == socket && link.incoming == incoming ) {
+			return &link;
+		}
+	}
+
+	SimulatedLink link = { };
+	link.socket = socket;
+	link.incoming = incoming;
+	return &sim_links[ sim_links.add( link ) ];
+}
+
+static void NET_SimQueue( const socket_t *socket, bool incoming, const netadr_t *address, const void *data, size_t length, int64_t now ) {
+	if( net_sim_seed->modified ) {
+		sim_rng = NewRNG( net_sim_seed->integer, 0 );
+		net_sim_seed->modified = false;
+	}
+
+	if( RandomFloat01( &sim_rng ) * 100.0f < net_sim_loss->value ) {
+		return;
+	}
+
+	SimulatedLink *link = NET_SimFindLink( socket, incoming );
+
+	int64_t depart = now;
+	if( net_sim_bandwidth->value > 0 ) {
+		int64_t transmit = int64_t( length * 1000000.0 / ( net_sim_bandwidth->value * 1024.0 ) );
+		depart = Max2( now, link->busy_until ) + transmit;
+		if( depart - now > NET_SIM_MAX_BUFFERING ) {
+			return;
+		}
+		link->busy_until = depart;
+	}
+
+	double latency = Max2( 0.0f, net_sim_latency->value ) * 0.5f + RandomFloat01( &sim_rng ) * Max2( 0.0f, net_sim_jitter->value );
+	int64_t due = depart + int64_t( latency * 1000.0 );
+
+	if( RandomFloat01( &sim_rng ) * 100.0f < net_sim_reorder->value ) {
+		due += int64_t( RandomUniformFloat( &sim_rng, 10.0f, 20.0f + Max2( 0.0f, net_sim_jitter->value ) ) * 1000.0f );
+	}
+	else {
+		due = Max2( due, link->last_due );
+		link->last_due = due;
+	}
+
+	SimulatedPacket packet;
+	packet.socket = socket;
+	packet.incoming = incoming;
+	packet.address = *address;
+	packet.due = due;
+	packet.seq = sim_seq++;
+	packet.data = ALLOC_SPAN( sys_allocator, uint8_t, length );
+	memcpy( packet.data.ptr, data, length );
+	sim_packets.add( packet );
+}
+
+// the oldest due packet, so packets due at the same time keep their order
+static SimulatedPacket *NET_SimNextDue( const socket_t *socket, bool incoming, int64_t now ) {
+	SimulatedPacket *next = NULL;
+	for( SimulatedPacket & packet : sim_packets ) {
+		if( packet.incoming != incoming || packet.due > now ) {
+			continue;
+		}
+		if( socket != NULL && packet.socket != socket ) {
+			continue;
+		}
+		if( next == NULL || packet.due < next->due || ( packet.due == next->due && packet.seq < next->seq ) ) {
+			next = &packet;
+		}
+	}
+	return next;
+}
+
+static void NET_SimRemove( SimulatedPacket *packet ) {
+	FREE( sys_allocator, packet->data.ptr );
+	*packet = sim_packets.top();
+	sim_packets.resize( sim_packets.size() - 1 );
+}
+
+static void NET_SimFlushSends( int64_t now ) {
+	SimulatedPacket *packet;
+	while( ( packet = NET_SimNextDue( NULL, false, now ) ) != NULL ) {
+		if( packet->socket->type == SOCKET_LOOPBACK ) {
+			NET_Loopback_SendPacket( packet->socket, packet->data.ptr, packet->data.n, &packet->address );
+		} else {
+			NET_UDP_SendPacket( packet->socket, packet->data.ptr, packet->data.n, &packet->address );
+		}
+		NET_SimRemove( packet );
+	}
+}
+
+static bool NET_Sim_SendPacket( const socket_t *socket, const void *data, size_t length, const netadr_t *address ) {
+	int64_t now = Sys_Microseconds();
+	NET_SimQueue( socket, false, address, data, length, now );
+	NET_SimFlushSends( now );
+	return true;
+}
+
+static int NET_Sim_GetPacket( const socket_t *socket, netadr_t *address, msg_t *message ) {
+	int64_t now = Sys_Microseconds();
+	NET_SimFlushSends( now );
+
+	// move everything that has really arrived into the queue
+	while( true ) {
+		int ret = socket->type == SOCKET_LOOPBACK ? NET_Loopback_GetPacket( socket, address, message ) : NET_UDP_GetPacket( socket, address, message );
+		if( ret == 0 ) {
+			break;
+		}
+		if( ret == -1 ) {
+			return -1;
+		}
+		NET_SimQueue( socket, true, address, message->data, message->cursize, now );
+	}
+
+	SimulatedPacket *packet = NET_SimNextDue( socket, true, now );
+	if( packet == NULL ) {
+		return 0;
+	}
+
+	if( packet->data.n > message->maxsize ) {
+		NET_SimRemove( packet );
+		NET_SetErrorString( "Oversized packet" );
+		return -1;
+	}
+
+	*address = packet->address;
+	memcpy( message->data, packet->data.ptr, packet->data.n );
+	message->readcount = 0;
+	message->cursize = packet->data.n;
+	NET_SimRemove( packet );
+
+	return 1;
+}
+
+static void NET_SimCloseSocket( const socket_t *socket ) {
+	for( size_t i = 0; i < sim_packets.size(); ) {
+		if( sim_packets[ i ].socket == socket ) {
+			NET_SimRemove( &sim_packets[ i ] );
+		} else {
+			i++;
+		}
+	}
+
+	for( size_t i = 0; i < sim_links.size(); ) {
+		if( sim_links[ i ].socket == socket ) {
+			sim_links[ i ] = sim_links.top();
+			sim_links.resize( sim_links.size() - 1 );
+		} else {
+			i++;
+		}
+	}
+}
+
+static void NET_InitSim() {
+	net_sim_latency = Cvar_Get( "net_sim_latency", "0", CVAR_DEVELOPER );
+	net_sim_jitter = Cvar_Get( "net_sim_jitter", "0", CVAR_DEVELOPER );
+	net_sim_loss = Cvar_Get( "net_sim_loss", "0", CVAR_DEVELOPER );
+	net_sim_reorder = Cvar_Get( "net_sim_reorder", "0", CVAR_DEVELOPER );
+	net_sim_bandwidth = Cvar_Get( "net_sim_bandwidth", "0", CVAR_DEVELOPER );
+	net_sim_seed = Cvar_Get( "net_sim_seed", "0", CVAR_DEVELOPER );
+
+	sim_packets.init( sys_allocator );
+	sim_links.init( sys_allocator );
+	sim_rng = NewRNG( net_sim_seed->integer, 0 );
+	net_sim_seed->modified = false;
+	sim_seq = 0;
+}
+
+static void NET_ShutdownSim() {
+	for( SimulatedPacket & packet : sim_packets ) {
+		FREE( sys_allocator, packet.data.ptr );
+	}
+	sim_packets.shutdown();
+	sim_links.shutdown();
+}
+
 /*
 =============================================================================
 PUBLIC FUNCTIONS
@@ -759,6 +1133,10 @@ int NET_GetPacket( const socket_t *socket, netadr_t *address, msg_t *message ) {
 		return -1;
 	}
 
+	if( NET_SimSocket( socket ) ) {
+		return NET_Sim_GetPacket( socket, address, message );
+	}
+
 	switch( socket->type ) {
 		case SOCKET_LOOPBACK:
 			return NET_Loopback_GetPacket( socket, address, message );
@@ -776,6 +1154,37 @@ int NET_GetPacket( const socket_t *socket, netadr_t *address, msg_t *message ) {
 	}
 }
 
+/*
+* NET_GetPackets
+*
+* Receives up to n packets with as few syscalls as possible. messages may be
+* reordered, the received packets end up at the front.
+*
+* >0	number of packets received
+* 0	not ready
+* -1	error
+*/
+int NET_GetPackets( const socket_t *socket, netadr_t *addresses, msg_t *messages, int n ) {
+	assert( socket->open );
+
+	if( !socket->open ) {
+		return -1;
+	}
+
+	if( socket->type == SOCKET_UDP && !NET_SimSocket( socket ) ) {
+		return NET_UDP_GetPackets( socket, addresses, messages, n );
+	}
+
+	for( int i = 0; i < n; i++ ) {
+		int ret = NET_GetPacket( socket, &addresses[ i ], &messages[ i ] );
+		if( ret != 1 ) {
+			return i > 0 ? i : ret;
+		}
+	}
+
+	return n;
+}
+
 /*
 * NET_Get
 *
@@ -806,6 +1215,95 @@ int NET_Get( const socket_t *socket, netadr_t *address, void *data, size_t lengt
 	}
 }
 
+/*
+* NET_SendPackets
+*
+* Returns the number of packets sent. UDP sockets send them with as few
+* syscalls as possible.
+*/
+int NET_SendPackets( const socket_t *socket, const netpacket_t *packets, int n ) {
+	assert( socket->open );
+
+	if( !socket->open ) {
+		return 0;
+	}
+
+	if( socket->type == SOCKET_UDP && !NET_SimSocket( socket ) ) {
+		return NET_UDP_SendPackets( socket, packets, n );
+	}
+
+	for( int i = 0; i < n; i++ ) {
+		if( !NET_SendPacket( socket, packets[ i ].data, packets[ i ].length, &packets[ i ].address ) ) {
+			return i;
+		}
+	}
+
+	return n;
+}
+
+/*
+* NET_BeginBatchedSends
+*
+* UDP packets sent with NET_SendPacket are queued until NET_FlushBatchedSends
+* and then sent with NET_SendPackets. Errors are reported at flush time.
+*/
+void NET_BeginBatchedSends() {
+	assert( !batching_sends );
+	batching_sends = true;
+}
+
+static void NET_SendBatch( const socket_t *socket, const netpacket_t *packets, int n ) {
+	int sent = NET_SendPackets( socket, packets, n );
+	if( sent < n ) {
+		Com_Printf( "NET_SendPackets: Error: %s (%i packets dropped)\n", NET_ErrorString(), n - sent );
+	}
+}
+
+void NET_FlushBatchedSends() {
+	ZoneScoped;
+
+	netpacket_t packets[ ARRAY_COUNT( queued_sends ) ];
+
+	assert( batching_sends );
+
+	// send runs of packets on the same socket together
+	int start = 0;
+	for( int i = 0; i < num_queued_sends; i++ ) {
+		if( queued_sends[ i ].socket != queued_sends[ start ].socket ) {
+			NET_SendBatch( queued_sends[ start ].socket, packets + start, i - start );
+			start = i;
+		}
+
+		packets[ i ].data = queued_sends[ i ].data;
+		packets[ i ].length = queued_sends[ i ].length;
+		packets[ i ].address = queued_sends[ i ].address;
+	}
+
+	if( num_queued_sends > 0 ) {
+		NET_SendBatch( queued_sends[ start ].socket, packets + start, num_queued_sends - start );
+	}
+
+	num_queued_sends = 0;
+	batching_sends = false;
+}
+
+static bool NET_QueueBatchedSend( const socket_t *socket, const void *data, size_t length, const netadr_t *address ) {
+	if( num_queued_sends == ARRAY_COUNT( queued_sends ) ) {
+		NET_FlushBatchedSends();
+		batching_sends = true;
+	}
+
+	queued_send_t * queued = &queued_sends[ num_queued_sends ];
+	queued->socket = socket;
+	queued->address = *address;
+	queued->length = length;
+	memcpy( queued->data, data, length );
+
+	num_queued_sends++;
+
+	return true;
+}
+
 /*
 * NET_SendPacket
 */
@@ -820,11 +1318,18 @@ bool NET_SendPacket( const socket_t *socket, const void *data, size_t length, co
 		return true;
 	}
 
+	if( NET_SimSocket( socket ) ) {
+		return NET_Sim_SendPacket( socket, data, length, address );
+	}
+
 	switch( socket->type ) {
 		case SOCKET_LOOPBACK:
 			return NET_Loopback_SendPacket( socket, data, length, address );
 
 		case SOCKET_UDP:
+			if( batching_sends && length <= MAX_PACKETLEN ) {
+				return NET_QueueBatchedSend( socket, data, length, address );
+			}
 			return NET_UDP_SendPacket( socket, data, length, address );
 
 		case SOCKET_TCP:
@@ -867,6 +1372,24 @@ int NET_Send( const socket_t *socket, const void *data, size_t length, const net
 	}
 }
 
+/*
+* NET_SendFile
+*/
+int NET_SendFile( const socket_t *socket, FILE *file, size_t offset, size_t length ) {
+	assert( socket->open );
+
+	if( !socket->open ) {
+		return -1;
+	}
+
+	if( socket->type != SOCKET_TCP ) {
+		NET_SetErrorString( "Operation not supported by the socket type" );
+		return -1;
+	}
+
+	return NET_TCP_SendFile( socket, file, offset, length );
+}
+
 /*
 * NET_AddressToString
 */
@@ -1388,6 +1911,8 @@ void NET_CloseSocket( socket_t *socket ) {
 		return;
 	}
 
+	NET_SimCloseSocket( socket );
+
 	switch( socket->type ) {
 		case SOCKET_LOOPBACK:
 			NET_Loopback_CloseSocket( socket );
@@ -1409,15 +1934,15 @@ void NET_CloseSocket( socket_t *socket ) {
 }
 
 /*
-* NET_Sleep
+* NET_SleepUntil
 */
-void NET_Sleep( int msec, socket_t *sockets[] ) {
+bool NET_SleepUntil( u64 deadline, socket_t *sockets[] ) {
 	struct timeval timeout;
 	fd_set fdset;
 	int i;
 
 	if( !sockets || !sockets[0] ) {
-		return;
+		return false;
 	}
 
 	FD_ZERO( &fdset );
@@ -1433,14 +1958,85 @@ void NET_Sleep( int msec, socket_t *sockets[] ) {
 				break;
 
 			default:
-				Com_Printf( "Warning: Invalid socket type on Sys_NET_Sleep\n" );
-				return;
+				Com_Printf( "Warning: Invalid socket type on NET_SleepUntil\n" );
+				return false;
 		}
 	}
 
-	timeout.tv_sec = msec / 1000;
-	timeout.tv_usec = ( msec % 1000 ) * 1000;
-	select( FD_SETSIZE, &fdset, NULL, NULL, &timeout );
+	u64 now = Sys_Microseconds();
+	u64 usec = deadline > now ? deadline - now : 0;
+	timeout.tv_sec = usec / 1000000;
+	timeout.tv_usec = usec % 1000000;
+	return select( FD_SETSIZE, &fdset, NULL, NULL, &timeout ) > 0;
+}
+
+/*
+* NET_NewPoller
+*/
+NetPoller * NET_NewPoller() {
+	return Sys_NET_NewPoller();
+}
+
+/*
+* NET_DeletePoller
+*/
+void NET_DeletePoller( NetPoller *poller ) {
+	Sys_NET_DeletePoller( poller );
+}
+
+/*
+* NET_PollerAdd
+*/
+bool NET_PollerAdd( NetPoller *poller, const socket_t *socket, u32 flags, void *user ) {
+	assert( socket->open && socket->type != SOCKET_LOOPBACK );
+
+	if( !Sys_NET_PollerAdd( poller, socket->handle, flags, user ) ) {
+		NET_SetErrorStringFromLastError( "NET_PollerAdd" );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+* NET_PollerModify
+*/
+bool NET_PollerModify( NetPoller *poller, const socket_t *socket, u32 flags, void *user ) {
+	assert( socket->open && socket->type != SOCKET_LOOPBACK );
+
+	if( !Sys_NET_PollerModify( poller, socket->handle, flags, user ) ) {
+		NET_SetErrorStringFromLastError( "NET_PollerModify" );
+		return false;
+	}
+
+	return true;
+}
+
+/*
+* NET_PollerRemove
+*
+* Must be called before the socket is closed
+*/
+void NET_PollerRemove( NetPoller *poller, const socket_t *socket ) {
+	if( socket->open && socket->type != SOCKET_LOOPBACK ) {
+		Sys_NET_PollerRemove( poller, socket->handle );
+	}
+}
+
+/*
+* NET_Poll
+*
+* Waits up to msec milliseconds for any of the sockets to become ready and
+* fills in events. Returns how many there were, or -1 on error.
+*/
+int NET_Poll( NetPoller *poller, int msec, NetPollEvent *events, int n ) {
+	int ret = Sys_NET_Poll( poller, msec, events, n );
+	if( ret == SOCKET_ERROR ) {
+		NET_SetErrorStringFromLastError( "NET_Poll" );
+		return -1;
+	}
+
+	return ret;
 }
 
 /*
@@ -1536,6 +2132,7 @@ void NET_Init() {
 	assert( !net_initialized );
 
 	Sys_NET_Init();
+	NET_InitSim();
 
 	net_initialized = true;
 }
@@ -1550,6 +2147,7 @@ void NET_Shutdown() {
 
 	errorstring[0] = '\0';
 
+	NET_ShutdownSim();
 	Sys_NET_Shutdown();
 
 	net_initialized = false;
@@ -20,6 +20,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "qcommon/qcommon.h"
 #include "qcommon/csprng.h"
+#include "qcommon/fs.h"
+#include "qcommon/string.h"
 
 #if defined ( __MACOSX__ )
 #include <arpa/inet.h>
@@ -85,6 +87,15 @@ static cvar_t *showpackets;
 static cvar_t *showdrop;
 static cvar_t *net_showfragments;
 
+// bytes per second
+#define NETCHAN_INITIAL_BANDWIDTH 128000.0f
+#define NETCHAN_MIN_BANDWIDTH 8000.0f
+#define NETCHAN_MAX_BANDWIDTH 1000000.0f
+
+#define NETCHAN_RTT_SLACK 20.0f // msecs
+
+#define NETCHAN_LOSS_SMOOTHING 0.02f // per packet, so roughly the last 50
+
 /*
 * Netchan_OutOfBand
 *
@@ -135,6 +146,64 @@ void Netchan_Setup( netchan_t *chan, const socket_t *socket, const netadr_t *add
 	chan->session_id = session_id;
 	chan->incomingSequence = 0;
 	chan->outgoingSequence = 1;
+	chan->bandwidth = NETCHAN_INITIAL_BANDWIDTH;
+}
+
+/*
+* Netchan_RecordSent
+*/
+static void Netchan_RecordSent( netchan_t *chan, int sequence, size_t bytes, bool first ) {
+	int idx = sequence & NETCHAN_SENT_MASK;
+	if( first ) {
+		chan->sentTime[idx] = Sys_Milliseconds();
+		chan->sentBytes[idx] = 0;
+	}
+	chan->sentBytes[idx] += bytes;
+}
+
+/*
+* Netchan_UpdateBandwidth
+*
+* Delay based: as long as the round trip stays near the lowest we've seen
+* the link isn't queueing, so let the estimate grow. When it climbs we're
+* overrunning something along the way, so back off.
+*/
+static void Netchan_UpdateBandwidth( netchan_t *chan, int sequence_ack ) {
+	if( sequence_ack <= chan->bandwidthAcknowledged || sequence_ack >= chan->outgoingSequence ) {
+		return;
+	}
+
+	int first = Max2( chan->bandwidthAcknowledged + 1, sequence_ack - NETCHAN_SENT_BACKUP + 1 );
+	size_t acked = 0;
+	for( int i = first; i <= sequence_ack; i++ ) {
+		acked += chan->sentBytes[i & NETCHAN_SENT_MASK];
+	}
+	chan->bandwidthAcknowledged = sequence_ack;
+
+	float rtt = float( Sys_Milliseconds() - chan->sentTime[sequence_ack & NETCHAN_SENT_MASK] );
+	if( chan->smoothedRTT == 0.0f ) {
+		chan->smoothedRTT = rtt;
+		chan->minRTT = rtt;
+	}
+	chan->smoothedRTT = Lerp( chan->smoothedRTT, 0.125f, rtt );
+	chan->minRTT = Min2( rtt, chan->minRTT + 0.05f ); // let it drift up in case the route changes
+
+	if( chan->smoothedRTT > chan->minRTT * 1.5f + NETCHAN_RTT_SLACK ) {
+		chan->bandwidth *= 0.85f;
+	} else {
+		chan->bandwidth += acked * 0.25f;
+	}
+
+	chan->bandwidth = Clamp( NETCHAN_MIN_BANDWIDTH, chan->bandwidth, NETCHAN_MAX_BANDWIDTH );
+}
+
+/*
+* Netchan_BandwidthBudget
+*
+* How many bytes we can send over the next msecs without overrunning the link
+*/
+size_t Netchan_BandwidthBudget( const netchan_t *chan, int msecs ) {
+	return size_t( chan->bandwidth * msecs / 1000.0f );
 }
 
 
@@ -206,23 +275,162 @@ static int Netchan_ZLibDecompressChunk( const uint8_t *source, unsigned long sou
 	return result;
 }
 
+//=============================================================
+// Zstd compression
+//=============================================================
+
+#include "zstd/zstd.h"
+
+// the dictionary is trained offline on recorded gamestate/snapshot traffic
+// with `zstd --train` and shipped in base/. peers that don't have the same
+// dictionary fall back to plain zstd, and old peers to zlib
+#define NETCHAN_ZSTD_DICT "netchan.zdict"
+#define NETCHAN_ZSTD_LEVEL 6
+
+static ZSTD_CCtx * zstd_cctx;
+static ZSTD_DCtx * zstd_dctx;
+static ZSTD_CDict * zstd_cdict;
+static ZSTD_DDict * zstd_ddict;
+static unsigned int zstd_dict_id;
+
+static void Netchan_InitZstd() {
+	// compression only ever runs on the main thread so every netchan can
+	// share one pair of contexts
+	zstd_cctx = ZSTD_createCCtx();
+	zstd_dctx = ZSTD_createDCtx();
+	ZSTD_CCtx_setParameter( zstd_cctx, ZSTD_c_compressionLevel, NETCHAN_ZSTD_LEVEL );
+	ZSTD_CCtx_setParameter( zstd_cctx, ZSTD_c_checksumFlag, 0 );
+	ZSTD_CCtx_setParameter( zstd_cctx, ZSTD_c_dictIDFlag, 0 ); // negotiated at connect time
+
+	DynamicString path( sys_allocator, "{}/base/" NETCHAN_ZSTD_DICT, RootDirPath() );
+	Span< u8 > dict = ReadFileBinary( sys_allocator, path.c_str() );
+	defer { FREE( sys_allocator, dict.ptr ); };
+	if( dict.ptr == NULL ) {
+		return;
+	}
+
+	zstd_dict_id = ZSTD_getDictID_fromDict( dict.ptr, dict.n );
+	if( zstd_dict_id == 0 ) {
+		Com_Printf( S_COLOR_YELLOW "%s isn't a zstd dictionary\n", path.c_str() );
+		return;
+	}
+
+	zstd_cdict = ZSTD_createCDict( dict.ptr, dict.n, NETCHAN_ZSTD_LEVEL );
+	zstd_ddict = ZSTD_createDDict( dict.ptr, dict.n );
+	if( zstd_cdict == NULL || zstd_ddict == NULL ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't load %s\n", path.c_str() );
+		ZSTD_freeCDict( zstd_cdict );
+		ZSTD_freeDDict( zstd_ddict );
+		zstd_cdict = NULL;
+		zstd_ddict = NULL;
+		zstd_dict_id = 0;
+	}
+}
+
+static void Netchan_ShutdownZstd() {
+	ZSTD_freeCDict( zstd_cdict );
+	ZSTD_freeDDict( zstd_ddict );
+	ZSTD_freeCCtx( zstd_cctx );
+	ZSTD_freeDCtx( zstd_dctx );
+	zstd_cdict = NULL;
+	zstd_ddict = NULL;
+	zstd_cctx = NULL;
+	zstd_dctx = NULL;
+	zstd_dict_id = 0;
+}
+
+static int Netchan_ZstdCompressChunk( const uint8_t *source, size_t sourceLen, uint8_t *dest, size_t destLen, bool dict ) {
+	ZSTD_CCtx_reset( zstd_cctx, ZSTD_reset_session_only );
+	ZSTD_CCtx_refCDict( zstd_cctx, dict ? zstd_cdict : NULL );
+
+	size_t r = ZSTD_compress2( zstd_cctx, dest, destLen, source, sourceLen );
+	if( ZSTD_isError( r ) ) {
+		Com_DPrintf( "Zstd error on compress: %s\n", ZSTD_getErrorName( r ) );
+		return -1;
+	}
+
+	return r;
+}
+
+static int Netchan_ZstdDecompressChunk( const uint8_t *source, size_t sourceLen, uint8_t *dest, size_t destLen, bool dict ) {
+	size_t r;
+	if( dict ) {
+		r = ZSTD_decompress_usingDDict( zstd_dctx, dest, destLen, source, sourceLen, zstd_ddict );
+	} else {
+		r = ZSTD_decompressDCtx( zstd_dctx, dest, destLen, source, sourceLen );
+	}
+
+	if( ZSTD_isError( r ) ) {
+		Com_DPrintf( "Zstd error on decompress: %s\n", ZSTD_getErrorName( r ) );
+		return -1;
+	}
+
+	return r;
+}
+
+/*
+* Netchan_CompressionOffer
+*
+* The best compression we support, sent along with the connect packet
+*/
+const char * Netchan_CompressionOffer() {
+	return Netchan_CompressionName( zstd_dict_id != 0 ? NetchanCompression_ZstdDict : NetchanCompression_Zstd );
+}
+
+/*
+* Netchan_NegotiateCompression
+*
+* Picks the best compression both sides support from the other side's offer
+*/
+NetchanCompression Netchan_NegotiateCompression( const char * offer ) {
+	if( strncmp( offer, "zstd", 4 ) != 0 ) {
+		return NetchanCompression_ZLib;
+	}
+
+	if( offer[ 4 ] == ':' && zstd_dict_id != 0 ) {
+		u64 dict_id = StringToU64( offer + 5, 0 );
+		if( dict_id == zstd_dict_id ) {
+			return NetchanCompression_ZstdDict;
+		}
+	}
+
+	return NetchanCompression_Zstd;
+}
+
+const char * Netchan_CompressionName( NetchanCompression compression ) {
+	static char name[ 32 ];
+
+	switch( compression ) {
+		case NetchanCompression_Zstd:
+			return "zstd";
+		case NetchanCompression_ZstdDict:
+			snprintf( name, sizeof( name ), "zstd:%u", zstd_dict_id );
+			return name;
+		default:
+			return "zlib";
+	}
+}
+
 /*
 * Netchan_CompressMessage
 */
-int Netchan_CompressMessage( msg_t *msg ) {
+int Netchan_CompressMessage( const netchan_t *chan, msg_t *msg ) {
 	int length;
 
 	if( msg == NULL || !msg->data ) {
 		return 0;
 	}
 
-	// zero-fill our buffer
-	length = 0;
-	memset( msg_process_data, 0, sizeof( msg_process_data ) );
-
 	//compress the message
-	length = Netchan_ZLibCompressChunk( msg->data, msg->cursize,
-										msg_process_data, sizeof( msg_process_data ), Z_BEST_COMPRESSION, -MAX_WBITS );
+	if( chan->compression == NetchanCompression_ZLib ) {
+		// zero-fill our buffer
+		memset( msg_process_data, 0, sizeof( msg_process_data ) );
+		length = Netchan_ZLibCompressChunk( msg->data, msg->cursize,
+											msg_process_data, sizeof( msg_process_data ), Z_BEST_COMPRESSION, -MAX_WBITS );
+	} else {
+		length = Netchan_ZstdCompressChunk( msg->data, msg->cursize,
+											msg_process_data, sizeof( msg_process_data ), chan->compression == NetchanCompression_ZstdDict );
+	}
 	if( length < 0 ) { // failed to compress, return the error
 		return length;
 	}
@@ -242,7 +450,7 @@ int Netchan_CompressMessage( msg_t *msg ) {
 /*
 * Netchan_DecompressMessage
 */
-int Netchan_DecompressMessage( msg_t *msg ) {
+int Netchan_DecompressMessage( const netchan_t *chan, msg_t *msg ) {
 	int length;
 
 	if( msg == NULL || !msg->data ) {
@@ -253,7 +461,12 @@ int Netchan_DecompressMessage( msg_t *msg ) {
 		return 0;
 	}
 
-	length = Netchan_ZLibDecompressChunk( msg->data + msg->readcount, msg->cursize - msg->readcount, msg_process_data, ( sizeof( msg_process_data ) - msg->readcount ), -MAX_WBITS );
+	if( chan->compression == NetchanCompression_ZLib ) {
+		length = Netchan_ZLibDecompressChunk( msg->data + msg->readcount, msg->cursize - msg->readcount, msg_process_data, ( sizeof( msg_process_data ) - msg->readcount ), -MAX_WBITS );
+	} else {
+		length = Netchan_ZstdDecompressChunk( msg->data + msg->readcount, msg->cursize - msg->readcount,
+											  msg_process_data, sizeof( msg_process_data ) - msg->readcount, chan->compression == NetchanCompression_ZstdDict );
+	}
 	if( length < 0 ) {
 		return length;
 	}
@@ -313,7 +526,7 @@ bool Netchan_TransmitNextFragment( netchan_t *chan ) {
 
 	// send the game port if we are a client
 	if( !chan->socket->server ) {
-		MSG_WriteUint64( &send, client_session_id );
+		MSG_WriteUint64( &send, chan->session_id );
 	}
 
 	// copy the reliable message to the packet first
@@ -335,6 +548,8 @@ bool Netchan_TransmitNextFragment( netchan_t *chan ) {
 		return false;
 	}
 
+	Netchan_RecordSent( chan, chan->outgoingSequence, send.cursize, chan->unsentFragmentStart == 0 );
+
 	if( showpackets->integer ) {
 		Com_Printf( "%s send %4li : s=%i fragment=%li,%i\n", NET_SocketToString( chan->socket ), send.cursize,
 					chan->outgoingSequence, chan->unsentFragmentStart, fragmentLength );
@@ -395,6 +610,10 @@ bool Netchan_Transmit( netchan_t *chan, msg_t *msg ) {
 		chan->unsentIsCompressed = msg->compressed;
 		memcpy( chan->unsentBuffer, msg->data, msg->cursize );
 
+		// the message didn't fit in a packet and the rest of it will trickle
+		// out over the next frames, aim lower
+		chan->bandwidth = Max2( chan->bandwidth * 0.95f, NETCHAN_MIN_BANDWIDTH );
+
 		// only send the first fragment now
 		return Netchan_TransmitNextFragment( chan );
 	}
@@ -426,6 +645,8 @@ bool Netchan_Transmit( netchan_t *chan, msg_t *msg ) {
 		return false;
 	}
 
+	Netchan_RecordSent( chan, chan->outgoingSequence - 1, send.cursize, true );
+
 	if( showpackets->integer ) {
 		Com_Printf( "%s send %4li : s=%i ack=%i\n", NET_SocketToString( chan->socket ), send.cursize,
 					chan->outgoingSequence - 1, chan->incomingSequence );
@@ -521,6 +742,13 @@ bool Netchan_Process( netchan_t *chan, msg_t *msg ) {
 	// dropped packets don't keep the message from being used
 	//
 	chan->dropped = sequence - ( chan->incomingSequence + 1 );
+
+	// count each missing packet, then this one
+	for( int i = 0; i < Min2( chan->dropped, 16 ); i++ ) {
+		chan->loss = Lerp( chan->loss, NETCHAN_LOSS_SMOOTHING, 1.0f );
+	}
+	chan->loss = Lerp( chan->loss, NETCHAN_LOSS_SMOOTHING, 0.0f );
+
 	if( chan->dropped > 0 ) {
 		if( showdrop->integer || showpackets->integer ) {
 			Com_Printf( "%s:Dropped %i packets at %i\n", NET_AddressToString( &chan->remoteAddress ), chan->dropped,
@@ -603,6 +831,8 @@ bool Netchan_Process( netchan_t *chan, msg_t *msg ) {
 	chan->incoming_acknowledged = sequence_ack;
 	// wsw : jal[end]
 
+	Netchan_UpdateBandwidth( chan, sequence_ack );
+
 	return true;
 }
 
@@ -619,10 +849,13 @@ void Netchan_Init() {
 	showpackets = Cvar_Get( "showpackets", "0", 0 );
 	showdrop = Cvar_Get( "showdrop", "0", 0 );
 	net_showfragments = Cvar_Get( "net_showfragments", "0", 0 );
+
+	Netchan_InitZstd();
 }
 
 /*
 * Netchan_Shutdown
 */
 void Netchan_Shutdown() {
+	Netchan_ShutdownZstd();
 }
@@ -92,6 +92,8 @@ void MSG_WriteString( msg_t *sb, const char *s );
 void MSG_WriteDeltaUsercmd( msg_t * msg, const UserCommand * baseline , const UserCommand * cmd );
 void MSG_WriteEntityNumber( msg_t * msg, int number, bool remove );
 void MSG_WriteDeltaEntity( msg_t * msg, const SyncEntityState * baseline, const SyncEntityState * ent, bool force );
+void MSG_WriteDeltaEntityFromClass( msg_t * msg, int class_baseline, const SyncEntityState * baseline, const SyncEntityState * ent );
+void MSG_WriteDeltaSnapEvent( msg_t * msg, const SyncSnapEvent * baseline, const SyncSnapEvent * ev );
 void MSG_WriteDeltaPlayerState( msg_t * msg, const SyncPlayerState * baseline, const SyncPlayerState * player );
 void MSG_WriteDeltaGameState( msg_t * msg, const SyncGameState * baseline, const SyncGameState * state );
 
@@ -110,7 +112,9 @@ char *MSG_ReadStringLine( msg_t *sb );
 void MSG_ReadDeltaUsercmd( msg_t * msg, const UserCommand * baseline, UserCommand * cmd );
 int MSG_ReadEntityNumber( msg_t * msg, bool * remove );
 void MSG_ReadDeltaEntity( msg_t * msg, const SyncEntityState * baseline, SyncEntityState * ent );
+void MSG_ReadDeltaSnapEvent( msg_t * msg, const SyncSnapEvent * baseline, SyncSnapEvent * ev );
 void MSG_ReadDeltaPlayerState( msg_t * msg, const SyncPlayerState * baseline, SyncPlayerState * player );
+bool MSG_PlayerStatesMatch( const SyncPlayerState * a, const SyncPlayerState * b ); // same after going over the network
 void MSG_ReadDeltaGameState( msg_t * msg, const SyncGameState * baseline, SyncGameState * state );
 void MSG_ReadData( msg_t *sb, void *buffer, size_t length );
 
@@ -121,16 +125,43 @@ void MSG_ReadData( msg_t *sb, void *buffer, size_t length );
 // define this 0 to disable compression of demo files
 #define SNAP_DEMO_GZ                    FS_GZ
 
+// full snapshots plus every configstring, so jumps can start from the nearest
+// one instead of the start of the demo
+#define SNAP_DEMO_KEYFRAME_INTERVAL     10000
+#define SNAP_MAX_DEMO_KEYFRAMES         1024
+
+struct DemoKeyframe {
+	int64_t server_time;
+	int64_t reliable_sequence;      // server commands up to here are already in the configstrings
+	int offset;                     // uncompressed for gzipped demos, the start of a zstd frame for zstd demos
+};
+
 void SNAP_RecordDemoMessage( int demofile, msg_t *msg, int offset );
 int SNAP_ReadDemoMessage( int demofile, msg_t *msg );
+using DemoMessageWriter = void ( * )( void *user, msg_t *msg );
+
+void SNAP_WriteDemoGamestate( DemoMessageWriter write, void *user, unsigned int spawncount, unsigned int snapFrameTime,
+	const char *configstrings, SyncEntityState *baselines );
 void SNAP_BeginDemoRecording( int demofile, unsigned int spawncount, unsigned int snapFrameTime,
 	const char *configstrings, SyncEntityState *baselines );
-void SNAP_StopDemoRecording( int demofile );
+int SNAP_WriteDemoConfigstrings( msg_t *msg, const char *configstrings, int first );
+int SNAP_StopDemoRecording( int demofile, const DemoKeyframe *keyframes, int num_keyframes );
+int SNAP_ReadDemoKeyframes( int demofile, int index_offset, DemoKeyframe *keyframes, int max_keyframes );
 void SNAP_WriteDemoMetaData( const char *filename, const char *meta_data, size_t meta_data_realsize );
 size_t SNAP_ClearDemoMeta( char *meta_data, size_t meta_data_max_size );
 size_t SNAP_SetDemoMetaKeyValue( char *meta_data, size_t meta_data_max_size, size_t meta_data_realsize,
 								 const char *key, const char *value );
 size_t SNAP_ReadDemoMetaData( int demofile, char *meta_data, size_t meta_data_size );
+const char *SNAP_GetDemoMetaValue( const char *meta_data, size_t meta_data_realsize, const char *key );
+
+#define SNAP_MAX_DEMO_TRAILER_SIZE      ( SNAP_MAX_DEMO_META_DATA_SIZE + SNAP_MAX_DEMO_KEYFRAMES * 20 + 64 )
+#define SNAP_DEMO_TRAILER_MAGIC         0x52544443 // CDTR, the last four bytes of a zstd demo
+
+bool SNAP_IsZstdDemo( int demofile );
+void SNAP_WriteDemoTrailer( msg_t *msg, int trailer_offset, const char *meta_data, size_t meta_data_realsize,
+	const DemoKeyframe *keyframes, int num_keyframes );
+bool SNAP_ReadDemoTrailer( int demofile, char *meta_data, size_t meta_data_size, size_t *meta_data_realsize,
+	DemoKeyframe *keyframes, int max_keyframes, int *num_keyframes );
 
 //============================================================================
 
@@ -199,6 +230,8 @@ enum svc_ops_e {
 	svc_servercs,           //tmp jalfixme : send reliable commands as unreliable
 	svc_frame,
 	svc_demoinfo,
+	svc_configstrings,      // [int] cmdNum [uintbase128] count { [uintbase128] index [string] value }
+	svc_events,             // [uintbase128] count { [delta from previous event] }
 };
 
 //==============================================
@@ -219,6 +252,14 @@ enum clc_ops_e {
 #define FRAMESNAP_FLAG_ALLENTITIES  ( 1 << 1 )
 #define FRAMESNAP_FLAG_MULTIPOV     ( 1 << 2 )
 
+// reconnecting clients send the hash of each block of configstrings they
+// still have from last time, so the server only resends the blocks that
+// changed instead of the whole table
+#define CONFIGSTRING_BLOCK_SIZE 8
+#define NUM_CONFIGSTRING_BLOCKS ( ( MAX_CONFIGSTRINGS + CONFIGSTRING_BLOCK_SIZE - 1 ) / CONFIGSTRING_BLOCK_SIZE )
+
+u64 ConfigstringBlockHash( const char ( *configstrings )[ MAX_CONFIGSTRING_CHARS ], size_t block );
+
 /*
 ==============================================================
 
@@ -241,6 +282,9 @@ The + command line options are also added to the command buffer.
 void Cbuf_Init();
 void Cbuf_Shutdown();
 void Cbuf_AddText( const char *text );
+// any thread can call this. the text gets appended at the start of the next
+// Cbuf_Execute, and it returns false if too much is queued already
+bool Cbuf_QueueText( const char * text );
 void Cbuf_ExecuteText( int exec_when, const char *text );
 void Cbuf_AddEarlyCommands( bool clear );
 bool Cbuf_AddLateCommands();
@@ -382,13 +426,48 @@ void        NET_CloseSocket( socket_t *socket );
 bool        NET_Listen( const socket_t *socket );
 int         NET_Accept( const socket_t *socket, socket_t *newsocket, netadr_t *address );
 
+struct netpacket_t {
+	const void *data;
+	size_t length;
+	netadr_t address;
+};
+
 int         NET_GetPacket( const socket_t *socket, netadr_t *address, msg_t *message );
 bool        NET_SendPacket( const socket_t *socket, const void *data, size_t length, const netadr_t *address );
 
+int         NET_GetPackets( const socket_t *socket, netadr_t *addresses, msg_t *messages, int n );
+int         NET_SendPackets( const socket_t *socket, const netpacket_t *packets, int n );
+
+void        NET_BeginBatchedSends();
+void        NET_FlushBatchedSends();
+
 int         NET_Get( const socket_t *socket, netadr_t *address, void *data, size_t length );
 int         NET_Send( const socket_t *socket, const void *data, size_t length, const netadr_t *address );
+int         NET_SendFile( const socket_t *socket, FILE *file, size_t offset, size_t length );
+
+bool        NET_SleepUntil( u64 deadline, socket_t *sockets[] ); // deadline is Sys_Microseconds, returns true if a socket woke it
+
+// readiness notifications for lots of sockets, without scanning them all
+struct NetPoller;
+
+enum NetPollFlags {
+	NetPoll_Read = 1 << 0,
+	NetPoll_Write = 1 << 1,
+	NetPoll_Error = 1 << 2, // reported whether you asked for it or not
+};
+
+struct NetPollEvent {
+	void *user;
+	u32 flags;
+};
+
+NetPoller * NET_NewPoller();
+void        NET_DeletePoller( NetPoller *poller );
+bool        NET_PollerAdd( NetPoller *poller, const socket_t *socket, u32 flags, void *user );
+bool        NET_PollerModify( NetPoller *poller, const socket_t *socket, u32 flags, void *user );
+void        NET_PollerRemove( NetPoller *poller, const socket_t *socket );
+int         NET_Poll( NetPoller *poller, int msec, NetPollEvent *events, int n );
 
-void        NET_Sleep( int msec, socket_t *sockets[] );
 int         NET_Monitor( int msec, socket_t *sockets[],
 						 void ( *read_cb )( socket_t *socket, void* ),
 						 void ( *write_cb )( socket_t *socket, void* ),
@@ -420,8 +499,18 @@ void    NET_BroadcastAddress( netadr_t *address, int port );
 
 //============================================================================
 
+enum NetchanCompression {
+	NetchanCompression_ZLib,
+	NetchanCompression_Zstd,
+	NetchanCompression_ZstdDict,
+};
+
+#define NETCHAN_SENT_BACKUP 64 // must be power of two
+#define NETCHAN_SENT_MASK ( NETCHAN_SENT_BACKUP - 1 )
+
 struct netchan_t {
 	const socket_t *socket;
+	NetchanCompression compression;
 
 	int dropped;                // between last packet and previous
 
@@ -445,6 +534,16 @@ struct netchan_t {
 	size_t unsentLength;
 	uint8_t unsentBuffer[MAX_MSGLEN];
 	bool unsentIsCompressed;
+
+	// bandwidth estimation, fed by acks and fragmentation
+	int64_t sentTime[NETCHAN_SENT_BACKUP];
+	size_t sentBytes[NETCHAN_SENT_BACKUP];
+	int bandwidthAcknowledged;  // last outgoing sequence we accounted for
+	float minRTT;
+	float smoothedRTT;
+	float bandwidth;            // bytes per second we think the link can take
+
+	float loss;                 // smoothed fraction of incoming packets that never arrived
 };
 
 extern netadr_t net_from;
@@ -457,8 +556,12 @@ bool Netchan_Process( netchan_t *chan, msg_t *msg );
 bool Netchan_Transmit( netchan_t *chan, msg_t *msg );
 bool Netchan_PushAllFragments( netchan_t *chan );
 bool Netchan_TransmitNextFragment( netchan_t *chan );
-int Netchan_CompressMessage( msg_t *msg );
-int Netchan_DecompressMessage( msg_t *msg );
+size_t Netchan_BandwidthBudget( const netchan_t *chan, int msecs );
+int Netchan_CompressMessage( const netchan_t *chan, msg_t *msg );
+int Netchan_DecompressMessage( const netchan_t *chan, msg_t *msg );
+const char * Netchan_CompressionOffer();
+NetchanCompression Netchan_NegotiateCompression( const char * offer );
+const char * Netchan_CompressionName( NetchanCompression compression );
 void Netchan_OutOfBand( const socket_t *socket, const netadr_t *address, size_t length, const uint8_t *data );
 
 #ifndef _MSC_VER
@@ -576,6 +679,10 @@ void        Com_SetDemoPlaying( bool state );
 server_state_t Com_ServerState();
 void Com_SetServerState( server_state_t state );
 
+void Com_ResetFrameClock();
+unsigned int Com_WaitForFrame();
+u64 Com_FrameClock();
+
 extern cvar_t *developer;
 extern const bool is_dedicated_server;
 extern cvar_t *versioncvar;
@@ -613,6 +720,7 @@ void _Mem_CheckSentinels( void *data, const char *filename, int fileline );
 void _Mem_CheckSentinelsGlobal( const char *filename, int fileline );
 
 size_t Mem_PoolTotalSize( mempool_t *pool );
+size_t Mem_TotalSize();
 
 #define Mem_AllocExt( pool, size, z ) _Mem_AllocExt( pool, size, 0, z, 0, 0, __FILE__, __LINE__ )
 #define Mem_Alloc( pool, size ) _Mem_Alloc( pool, size, 0, 0, __FILE__, __LINE__ )
@@ -673,7 +781,9 @@ void ShowErrorAndAbortImpl( const char * msg, const char * file, int line );
 
 int64_t Sys_Milliseconds();
 uint64_t Sys_Microseconds();
+uint64_t Sys_Nanoseconds(); // only good for measuring durations
 void Sys_Sleep( unsigned int millis );
+void Sys_SleepMicroseconds( u64 usec );
 bool Sys_FormatTime( char * buf, size_t buf_size, const char * fmt );
 
 const char * Sys_ConsoleInput();
@@ -699,6 +809,10 @@ void CL_Shutdown();
 void CL_Frame( int realMsec, int gameMsec );
 void Con_Print( const char *text );
 
+// NULL if there's no client or it doesn't have the map
+struct CollisionModel;
+const CollisionModel * CL_FindMapCollisionModel( u64 base_hash );
+
 void SV_Init();
 void SV_Shutdown( const char *finalmsg );
 void SV_ShutdownGame( const char *finalmsg, bool reconnect );
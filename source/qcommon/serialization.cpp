@@ -1,23 +1,53 @@
-#include "qcommon/base.h"
-#include "serialization.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/fs.h"
+#include "qcommon/hash.h"
+#include "qcommon/serialization.h"
 
-template< typename T >
-static void SerializeFundamental( SerializationBuffer * buf, T & x ) {
-	if( buf->error || size_t( buf->end - buf->cursor ) < sizeof( T ) ) {
+void SerializeBytes( SerializationBuffer * buf, void * data, size_t n ) {
+	if( buf->measuring ) {
+		buf->cursor += n;
+		return;
+	}
+
+	if( buf->error || buf->size - buf->cursor < n ) {
 		buf->error = true;
 		if( !buf->serializing )
-			memset( &x, 0, sizeof( T ) );
+			memset( data, 0, n );
 		return;
 	}
 
 	if( buf->serializing ) {
-		memcpy( buf->cursor, &x, sizeof( T ) );
+		memcpy( buf->buf + buf->cursor, data, n );
 	}
 	else {
-		memcpy( &x, buf->cursor, sizeof( T ) );
+		memcpy( data, buf->buf + buf->cursor, n );
 	}
 
-	buf->cursor += sizeof( T );
+	buf->cursor += n;
+}
+
+void SerializeAlign( SerializationBuffer * buf, size_t alignment ) {
+	size_t padding = AlignPow2( buf->cursor, alignment ) - buf->cursor;
+	if( buf->measuring ) {
+		buf->cursor += padding;
+		return;
+	}
+
+	if( buf->error || buf->size - buf->cursor < padding ) {
+		buf->error = true;
+		return;
+	}
+
+	if( buf->serializing ) {
+		memset( buf->buf + buf->cursor, 0, padding );
+	}
+
+	buf->cursor += padding;
+}
+
+template< typename T >
+static void SerializeFundamental( SerializationBuffer * buf, T & x ) {
+	SerializeBytes( buf, &x, sizeof( T ) );
 }
 
 void Serialize( SerializationBuffer * buf, s8 & x ) { SerializeFundamental( buf, x ); }
@@ -50,3 +80,83 @@ void Serialize( SerializationBuffer * buf, Quaternion & q ) { *buf & q.x & q.y &
 void Serialize( SerializationBuffer * buf, MinMax1 & b ) { *buf & b.lo & b.hi; }
 void Serialize( SerializationBuffer * buf, MinMax2 & b ) { *buf & b.mins & b.maxs; }
 void Serialize( SerializationBuffer * buf, MinMax3 & b ) { *buf & b.mins & b.maxs; }
+
+bool WriteCacheFile( const char * path, u32 magic, u32 version, u64 key, Span< const u8 > data ) {
+	ZoneScoped;
+
+	CacheFileHeader header = { };
+	header.magic = magic;
+	header.version = version;
+	header.key = key;
+	header.data_size = data.n;
+	header.hash = Hash64( data.ptr, data.n );
+
+	u8 arena_memory[ 1024 ];
+	ArenaAllocator arena( arena_memory, sizeof( arena_memory ) );
+	TempAllocator temp = arena.temp();
+
+	const char * tmp_path = temp( "{}.tmp", path );
+	if( !CreatePathForFile( &temp, tmp_path ) )
+		return false;
+
+	FILE * file = OpenFile( &temp, tmp_path, "wb" );
+	if( file == NULL )
+		return false;
+
+	bool ok = WritePartialFile( file, &header, sizeof( header ) ) && WritePartialFile( file, data.ptr, data.n );
+	fclose( file );
+
+	if( !ok || !MoveFile( &temp, tmp_path, path, MoveFile_DoReplace ) ) {
+		RemoveFile( &temp, tmp_path );
+		return false;
+	}
+
+	return true;
+}
+
+static bool CacheFileValid( Span< const u8 > file, const char * path, u32 magic, u32 version, u64 key ) {
+	if( file.n < sizeof( CacheFileHeader ) )
+		return false;
+
+	CacheFileHeader header;
+	memcpy( &header, file.ptr, sizeof( header ) );
+	if( header.magic != magic || header.version != version || header.key != key || header.data_size != file.n - CACHE_FILE_DATA_OFFSET )
+		return false;
+
+	if( header.hash != Hash64( file.ptr + CACHE_FILE_DATA_OFFSET, header.data_size ) ) {
+		Com_Printf( S_COLOR_YELLOW "Cache file '%s' is corrupt\n", path );
+		return false;
+	}
+
+	return true;
+}
+
+Span< u8 > ReadCacheFile( Allocator * a, const char * path, u32 magic, u32 version, u64 key ) {
+	ZoneScoped;
+
+	Span< u8 > file = ReadFileBinary( a, path );
+	if( file.ptr == NULL )
+		return Span< u8 >();
+
+	if( !CacheFileValid( file, path, magic, version, key ) ) {
+		FREE( a, file.ptr );
+		return Span< u8 >();
+	}
+
+	return file;
+}
+
+Span< const u8 > MapCacheFile( Allocator * temp, const char * path, u32 magic, u32 version, u64 key ) {
+	ZoneScoped;
+
+	Span< const u8 > file;
+	if( !MapFile( temp, path, &file ) )
+		return Span< const u8 >();
+
+	if( !CacheFileValid( file, path, magic, version, key ) ) {
+		UnmapFile( file );
+		return Span< const u8 >();
+	}
+
+	return file;
+}
@@ -2,21 +2,28 @@
 
 #include "qcommon/types.h"
 
+#include <type_traits>
+
 enum SerializationMode {
 	SerializationMode_Serializing,
 	SerializationMode_Deserializing,
+	SerializationMode_Measuring, // serializes without writing anything so you can size the buffer
 };
 
 struct SerializationBuffer {
-	char * cursor;
-	char * end;
+	char * buf;
+	size_t cursor;
+	size_t size;
 	bool serializing;
+	bool measuring;
 	bool error;
 
-	SerializationBuffer( SerializationMode mode, char * buf, size_t buf_size ) {
-		cursor = buf;
-		end = buf + buf_size;
-		serializing = mode == SerializationMode_Serializing;
+	SerializationBuffer( SerializationMode mode, char * buf_, size_t buf_size ) {
+		buf = buf_;
+		cursor = 0;
+		size = buf_size;
+		serializing = mode != SerializationMode_Deserializing;
+		measuring = mode == SerializationMode_Measuring;
 		error = false;
 	}
 };
@@ -35,6 +42,19 @@ bool Deserialize( T & x, const char * buf, size_t buf_size ) {
 	return !sb.error;
 }
 
+template< typename T >
+size_t SerializedSize( const T & x ) {
+	SerializationBuffer sb( SerializationMode_Measuring, NULL, 0 );
+	Serialize( &sb, const_cast< T & >( x ) );
+	return sb.cursor;
+}
+
+void SerializeBytes( SerializationBuffer * buf, void * data, size_t n );
+
+// pads with zeroes. offsets are from the start of the buffer, so keep that
+// aligned too if you want the result to be aligned in memory
+void SerializeAlign( SerializationBuffer * buf, size_t alignment );
+
 void Serialize( SerializationBuffer * buf, s8 & x );
 void Serialize( SerializationBuffer * buf, s16 & x );
 void Serialize( SerializationBuffer * buf, s32 & x );
@@ -65,8 +85,64 @@ void Serialize( SerializationBuffer * buf, T ( &arr )[ N ] ) {
 	}
 }
 
+/*
+ * spans of PODs go in as a u64 count and one memcpy. deserializing doesn't
+ * copy anything, it points the span into the buffer, so the span is only
+ * good for as long as the buffer is and you can deserialize straight out of
+ * a mapping. that needs the elements to be aligned in the buffer, otherwise
+ * it fails
+ */
+template< typename T >
+void Serialize( SerializationBuffer * buf, Span< const T > & span ) {
+	STATIC_ASSERT( std::is_trivially_copyable< T >::value );
+
+	u64 n = span.n;
+	Serialize( buf, n );
+	SerializeAlign( buf, alignof( T ) );
+
+	if( buf->serializing ) {
+		SerializeBytes( buf, const_cast< T * >( span.ptr ), span.num_bytes() );
+		return;
+	}
+
+	bool fits = !buf->error && n <= ( buf->size - buf->cursor ) / sizeof( T );
+	if( !fits || uintptr_t( buf->buf + buf->cursor ) % alignof( T ) != 0 ) {
+		buf->error = true;
+		span = Span< const T >();
+		return;
+	}
+
+	span = Span< const T >( ( const T * ) ( buf->buf + buf->cursor ), n );
+	buf->cursor += n * sizeof( T );
+}
+
 template< typename T >
 SerializationBuffer & operator&( SerializationBuffer & buf, T & v ) {
 	Serialize( &buf, v );
 	return buf;
 }
+
+/*
+ * cache files are a CacheFileHeader followed by the data, which starts 16
+ * byte aligned so it can be used in place. the key should cover everything
+ * the data was built from, and the version gets bumped when the layout
+ * changes. anything that doesn't match, including a bad hash, reads back as
+ * missing so callers just rebuild
+ */
+struct CacheFileHeader {
+	u32 magic;
+	u32 version;
+	u64 key;
+	u64 data_size;
+	u64 hash; // of the data
+};
+
+constexpr size_t CACHE_FILE_DATA_OFFSET = sizeof( CacheFileHeader );
+STATIC_ASSERT( CACHE_FILE_DATA_OFFSET % 16 == 0 );
+
+// written to a temp file and renamed so readers never see half a file
+bool WriteCacheFile( const char * path, u32 magic, u32 version, u64 key, Span< const u8 > data );
+
+// these return the whole file, the data starts at CACHE_FILE_DATA_OFFSET
+Span< u8 > ReadCacheFile( Allocator * a, const char * path, u32 magic, u32 version, u64 key );
+Span< const u8 > MapCacheFile( Allocator * temp, const char * path, u32 magic, u32 version, u64 key );
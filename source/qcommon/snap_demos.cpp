@@ -21,6 +21,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qcommon/qcommon.h"
 #include "qcommon/version.h"
 
+#include "zstd/zstd.h"
+
 #define DEMO_SAFEWRITE( demofile,msg,force ) \
 	if( force || ( msg )->cursize > ( msg )->maxsize / 2 ) \
 	{ \
@@ -28,6 +30,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 		MSG_Clear( msg ); \
 	}
 
+#define DEMO_SAFEWRITE_TO( write,user,msg,force ) \
+	if( force || ( msg )->cursize > ( msg )->maxsize / 2 ) \
+	{ \
+		write( user, msg ); \
+		MSG_Clear( msg ); \
+	}
+
 static char dummy_meta_data[SNAP_MAX_DEMO_META_DATA_SIZE];
 
 /*
@@ -144,9 +153,12 @@ static void SNAP_RecordDemoMetaDataMessage( int demofile, msg_t *msg ) {
 }
 
 /*
-* SNAP_BeginDemoRecording
+* SNAP_WriteDemoGamestate
+*
+* Writes serverdata, configstrings and baselines, handing each message to
+* write as it fills up
 */
-void SNAP_BeginDemoRecording( int demofile, unsigned int spawncount, unsigned int snapFrameTime,
+void SNAP_WriteDemoGamestate( DemoMessageWriter write, void *user, unsigned int spawncount, unsigned int snapFrameTime,
 		const char *configstrings, SyncEntityState *baselines ) {
 	msg_t msg;
 	uint8_t msg_buffer[MAX_MSGLEN];
@@ -155,10 +167,6 @@ void SNAP_BeginDemoRecording( int demofile, unsigned int spawncount, unsigned in
 
 	MSG_Init( &msg, msg_buffer, sizeof( msg_buffer ) );
 
-	SNAP_DemoMetaDataMessage( &msg, "", 0 );
-
-	SNAP_RecordDemoMetaDataMessage( demofile, &msg );
-
 	// serverdata message
 	MSG_WriteUint8( &msg, svc_serverdata );
 	MSG_WriteInt32( &msg, APP_PROTOCOL_VERSION );
@@ -174,30 +182,70 @@ void SNAP_BeginDemoRecording( int demofile, unsigned int spawncount, unsigned in
 			MSG_WriteUint8( &msg, svc_servercs );
 			MSG_WriteString( &msg, va( "cs %i \"%s\"", i, configstring ) );
 
-			DEMO_SAFEWRITE( demofile, &msg, false );
+			DEMO_SAFEWRITE_TO( write, user, &msg, false );
 		}
 	}
 
 	// baselines
 	memset( &nullstate, 0, sizeof( nullstate ) );
 
-	for( int i = 0; i < MAX_EDICTS; i++ ) {
+	for( int i = 0; i < MAX_BASELINES; i++ ) {
 		base = &baselines[i];
 		if( base->number != 0 ) {
 			MSG_WriteUint8( &msg, svc_spawnbaseline );
 			MSG_WriteDeltaEntity( &msg, &nullstate, base, true );
 
-			DEMO_SAFEWRITE( demofile, &msg, false );
+			DEMO_SAFEWRITE_TO( write, user, &msg, false );
 		}
 	}
 
 	// client expects the server data to be in a separate packet
-	DEMO_SAFEWRITE( demofile, &msg, true );
+	DEMO_SAFEWRITE_TO( write, user, &msg, true );
 
 	MSG_WriteUint8( &msg, svc_servercs );
 	MSG_WriteString( &msg, "precache" );
 
-	DEMO_SAFEWRITE( demofile, &msg, true );
+	DEMO_SAFEWRITE_TO( write, user, &msg, true );
+}
+
+static void SNAP_WriteDemoFileMessage( void *user, msg_t *msg ) {
+	SNAP_RecordDemoMessage( *( int * )user, msg, 0 );
+}
+
+/*
+* SNAP_BeginDemoRecording
+*/
+void SNAP_BeginDemoRecording( int demofile, unsigned int spawncount, unsigned int snapFrameTime,
+		const char *configstrings, SyncEntityState *baselines ) {
+	msg_t msg;
+	uint8_t msg_buffer[MAX_MSGLEN];
+
+	MSG_Init( &msg, msg_buffer, sizeof( msg_buffer ) );
+
+	SNAP_DemoMetaDataMessage( &msg, "", 0 );
+
+	SNAP_RecordDemoMetaDataMessage( demofile, &msg );
+
+	SNAP_WriteDemoGamestate( SNAP_WriteDemoFileMessage, &demofile, spawncount, snapFrameTime, configstrings, baselines );
+}
+
+/*
+* SNAP_WriteDemoConfigstrings
+*
+* Writes configstrings from first onwards until msg is half full, and returns
+* where the next message should carry on from. Keyframes lead with these so
+* playback can start from them without the gamestate
+*/
+int SNAP_WriteDemoConfigstrings( msg_t *msg, const char *configstrings, int first ) {
+	int i;
+
+	for( i = first; i < MAX_CONFIGSTRINGS && msg->cursize <= msg->maxsize / 2; i++ ) {
+		const char *configstring = configstrings + i * MAX_CONFIGSTRING_CHARS;
+		MSG_WriteUint8( msg, svc_servercs );
+		MSG_WriteString( msg, va( "cs %i \"%s\"", i, configstring ) );
+	}
+
+	return i;
 }
 
 /*
@@ -280,15 +328,83 @@ done:
 	return meta_data_realsize;
 }
 
+/*
+* SNAP_GetDemoMetaValue
+*/
+const char *SNAP_GetDemoMetaValue( const char *meta_data, size_t meta_data_realsize, const char *key ) {
+	const char *end = meta_data + meta_data_realsize;
+
+	for( const char *s = meta_data; s < end && *s; ) {
+		const char *m_val = s + strlen( s ) + 1;
+		if( m_val >= end ) {
+			break;
+		}
+
+		if( !Q_stricmp( s, key ) ) {
+			return m_val;
+		}
+
+		s = m_val + strlen( m_val ) + 1;
+	}
+
+	return NULL;
+}
+
 /*
 * SNAP_StopDemoRecording
+*
+* Writes the end of demo marker followed by the keyframe index, and returns
+* the offset of the index for the meta data
 */
-void SNAP_StopDemoRecording( int demofile ) {
+int SNAP_StopDemoRecording( int demofile, const DemoKeyframe *keyframes, int num_keyframes ) {
 	int i;
+	msg_t msg;
+	uint8_t msg_buffer[MAX_MSGLEN];
 
 	// finishup
 	i = LittleLong( -1 );
 	FS_Write( &i, 4, demofile );
+
+	int index_offset = FS_Tell( demofile );
+
+	MSG_Init( &msg, msg_buffer, sizeof( msg_buffer ) );
+	MSG_WriteInt32( &msg, num_keyframes );
+	for( i = 0; i < num_keyframes; i++ ) {
+		MSG_WriteInt64( &msg, keyframes[i].server_time );
+		MSG_WriteInt64( &msg, keyframes[i].reliable_sequence );
+		MSG_WriteInt32( &msg, keyframes[i].offset );
+	}
+	SNAP_RecordDemoMessage( demofile, &msg, 0 );
+
+	return index_offset;
+}
+
+/*
+* SNAP_ReadDemoKeyframes
+*
+* Leaves the file position wherever the index ended
+*/
+int SNAP_ReadDemoKeyframes( int demofile, int index_offset, DemoKeyframe *keyframes, int max_keyframes ) {
+	msg_t msg;
+	uint8_t msg_buffer[MAX_MSGLEN];
+
+	if( FS_Seek( demofile, index_offset, FS_SEEK_SET ) < 0 ) {
+		return 0;
+	}
+
+	MSG_Init( &msg, msg_buffer, sizeof( msg_buffer ) );
+	if( SNAP_ReadDemoMessage( demofile, &msg ) <= 0 ) {
+		return 0;
+	}
+
+	int num_keyframes = Min2( MSG_ReadInt32( &msg ), max_keyframes );
+	for( int i = 0; i < num_keyframes; i++ ) {
+		keyframes[i].server_time = MSG_ReadInt64( &msg );
+		keyframes[i].reliable_sequence = MSG_ReadInt64( &msg );
+		keyframes[i].offset = MSG_ReadInt32( &msg );
+	}
+
+	return Max2( num_keyframes, 0 );
 }
 
 /*
@@ -329,7 +445,7 @@ void SNAP_WriteDemoMetaData( const char *filename, const char *meta_data, size_t
 	if( compressed_msg ) {
 		int origfile;
 
-		if( FS_FOpenFile( filename, &origfile, FS_READ | FS_UPDATE ) != -1 ) {
+		if( FS_FOpenBaseFile( filename, &origfile, FS_READ | FS_UPDATE ) != -1 ) {
 			FS_Write( compressed_msg, filelen, origfile );
 			FS_FCloseFile( origfile );
 		}
@@ -388,3 +504,111 @@ size_t SNAP_ReadDemoMetaData( int demofile, char *meta_data, size_t meta_data_si
 
 	return meta_data_realsize;
 }
+
+/*
+* SNAP_IsZstdDemo
+*
+* Server demos are zstd with the meta data and keyframes in a trailer, client
+* demos are gzipped with the meta data up front. Open the file without
+* SNAP_DEMO_GZ to check, this leaves it at the start
+*/
+bool SNAP_IsZstdDemo( int demofile ) {
+	u32 magic = 0;
+	FS_Seek( demofile, 0, FS_SEEK_SET );
+	bool zstd = FS_Read( &magic, sizeof( magic ), demofile ) == sizeof( magic ) && LittleLong( magic ) == ZSTD_MAGICNUMBER;
+	FS_Seek( demofile, 0, FS_SEEK_SET );
+	return zstd;
+}
+
+/*
+* SNAP_WriteDemoTrailer
+*
+* The trailer is a zstd skippable frame, so decompressing the whole file
+* just skips it. It ends with where it starts so readers can find it from
+* the end of the file
+*/
+void SNAP_WriteDemoTrailer( msg_t *msg, int trailer_offset, const char *meta_data, size_t meta_data_realsize,
+		const DemoKeyframe *keyframes, int num_keyframes ) {
+	meta_data_realsize = Min2( meta_data_realsize, size_t( SNAP_MAX_DEMO_META_DATA_SIZE ) );
+
+	MSG_WriteInt32( msg, ZSTD_MAGIC_SKIPPABLE_START );
+	int size_pos = msg->cursize;
+	MSG_WriteInt32( msg, 0 );
+
+	MSG_WriteInt32( msg, meta_data_realsize );
+	MSG_WriteData( msg, meta_data, meta_data_realsize );
+
+	MSG_WriteInt32( msg, num_keyframes );
+	for( int i = 0; i < num_keyframes; i++ ) {
+		MSG_WriteInt64( msg, keyframes[i].server_time );
+		MSG_WriteInt64( msg, keyframes[i].reliable_sequence );
+		MSG_WriteInt32( msg, keyframes[i].offset );
+	}
+
+	MSG_WriteInt32( msg, trailer_offset );
+	MSG_WriteInt32( msg, SNAP_DEMO_TRAILER_MAGIC );
+
+	int end = msg->cursize;
+	msg->cursize = size_pos;
+	MSG_WriteInt32( msg, end - size_pos - 4 );
+	msg->cursize = end;
+}
+
+/*
+* SNAP_ReadDemoTrailer
+*/
+bool SNAP_ReadDemoTrailer( int demofile, char *meta_data, size_t meta_data_size, size_t *meta_data_realsize,
+		DemoKeyframe *keyframes, int max_keyframes, int *num_keyframes ) {
+	int footer[2];
+	if( FS_Seek( demofile, -int( sizeof( footer ) ), FS_SEEK_END ) < 0 || FS_Read( footer, sizeof( footer ), demofile ) != sizeof( footer ) ) {
+		return false;
+	}
+	if( LittleLong( footer[1] ) != SNAP_DEMO_TRAILER_MAGIC ) {
+		return false;
+	}
+
+	int header[2];
+	if( FS_Seek( demofile, LittleLong( footer[0] ), FS_SEEK_SET ) < 0 || FS_Read( header, sizeof( header ), demofile ) != sizeof( header ) ) {
+		return false;
+	}
+	if( u32( LittleLong( header[0] ) ) != ZSTD_MAGIC_SKIPPABLE_START || LittleLong( header[1] ) > SNAP_MAX_DEMO_TRAILER_SIZE ) {
+		return false;
+	}
+
+	uint8_t *buffer = ( uint8_t * )Mem_TempMalloc( SNAP_MAX_DEMO_TRAILER_SIZE );
+	int size = LittleLong( header[1] );
+	bool ok = FS_Read( buffer, size, demofile ) == size;
+
+	if( ok ) {
+		msg_t msg;
+		MSG_Init( &msg, buffer, SNAP_MAX_DEMO_TRAILER_SIZE );
+		msg.cursize = size;
+
+		size_t realsize = Min2( size_t( MSG_ReadInt32( &msg ) ), size_t( SNAP_MAX_DEMO_META_DATA_SIZE ) );
+		if( meta_data != NULL && meta_data_size > 0 ) {
+			memcpy( meta_data, msg.data + msg.readcount, Min2( realsize, meta_data_size ) );
+			meta_data[Min2( realsize, meta_data_size - 1 )] = '\0';
+		}
+		if( meta_data_realsize != NULL ) {
+			*meta_data_realsize = Min2( realsize, meta_data_size );
+		}
+		MSG_SkipData( &msg, realsize );
+
+		int n = MSG_ReadInt32( &msg );
+		if( keyframes != NULL ) {
+			n = Clamp( 0, n, max_keyframes );
+			for( int i = 0; i < n; i++ ) {
+				keyframes[i].server_time = MSG_ReadInt64( &msg );
+				keyframes[i].reliable_sequence = MSG_ReadInt64( &msg );
+				keyframes[i].offset = MSG_ReadInt32( &msg );
+			}
+			*num_keyframes = n;
+		}
+
+		ok = msg.readcount <= msg.cursize;
+	}
+
+	Mem_TempFree( buffer );
+
+	return ok;
+}
@@ -18,37 +18,357 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <algorithm> // std::sort
+
 #include "qcommon/qcommon.h"
 #include "qcommon/cmodel.h"
+#include "qcommon/hash.h"
+#include "qcommon/hashtable.h"
+#include "qcommon/threads.h"
 #include "server/server.h"
 
 /*
 =========================================================================
 
+Entity delta cache
+
+Every client's copy of an entity in a given snapshot is identical, so the
+delta from (entity, source frame) to the current frame is the same bytes
+for everyone who acked that source frame. Encode it once per server frame
+and memcpy it for everyone else.
+
+=========================================================================
+*/
+
+#define MAX_DELTA_CACHE_ENTRIES 4096
+#define MAX_ENTITY_DEFERRED_FRAMES 8
+#define DELTA_CACHE_DATA_SIZE ( 256 * 1024 )
+
+struct EntityDeltaCacheEntry {
+	u64 key;
+	u32 offset;
+	u32 size;
+};
+
+static EntityDeltaCacheEntry delta_cache_entries[ MAX_DELTA_CACHE_ENTRIES ];
+static u32 num_delta_cache_entries;
+static Hashtable< MAX_DELTA_CACHE_ENTRIES * 2 > delta_cache_hashtable;
+
+static u8 delta_cache_data[ DELTA_CACHE_DATA_SIZE ];
+static u32 delta_cache_data_used;
+
+/*
+Clients that see the same entities and acked the same frame, mostly
+spectators chasing the same player, get byte identical packetentities, so
+the whole thing gets cached too.
+*/
+
+#define MAX_PACKET_ENTITIES_CACHE_ENTRIES 64
+#define PACKET_ENTITIES_CACHE_DATA_SIZE ( 512 * 1024 )
+
+static EntityDeltaCacheEntry packet_entities_cache_entries[ MAX_PACKET_ENTITIES_CACHE_ENTRIES ];
+static u32 num_packet_entities_cache_entries;
+static Hashtable< MAX_PACKET_ENTITIES_CACHE_ENTRIES * 2 > packet_entities_cache_hashtable;
+
+static u8 packet_entities_cache_data[ PACKET_ENTITIES_CACHE_DATA_SIZE ];
+static u32 packet_entities_cache_data_used;
+
+// snapshots can be encoded from multiple threads
+static Mutex * delta_cache_mutex;
+
+void SNAP_InitDeltaCache() {
+	delta_cache_mutex = NewMutex();
+	num_delta_cache_entries = 0;
+	delta_cache_data_used = 0;
+	num_packet_entities_cache_entries = 0;
+	packet_entities_cache_data_used = 0;
+}
+
+void SNAP_ShutdownDeltaCache() {
+	DeleteMutex( delta_cache_mutex );
+}
+
+/*
+* SNAP_ClearDeltaCache
+*
+* Must be called whenever entity states may have changed, i.e. before the
+* game runs again.
+*/
+void SNAP_ClearDeltaCache() {
+	if( num_packet_entities_cache_entries != 0 ) {
+		TracyPlot( "Snapshot packetentities cache entries", s64( num_packet_entities_cache_entries ) );
+
+		packet_entities_cache_hashtable.clear();
+		num_packet_entities_cache_entries = 0;
+		packet_entities_cache_data_used = 0;
+	}
+
+	if( num_delta_cache_entries == 0 )
+		return;
+
+	TracyPlot( "Snapshot delta cache entries", s64( num_delta_cache_entries ) );
+
+	delta_cache_hashtable.clear();
+	num_delta_cache_entries = 0;
+	delta_cache_data_used = 0;
+}
+
+/*
+* SNAP_WriteDeltaEntity
+*
+* class_baseline is -1 to delta against from as usual
+*/
+static void SNAP_WriteDeltaEntity( msg_t *msg, int class_baseline, const SyncEntityState *from, SyncEntityState *to, bool force ) {
+	if( class_baseline == -1 ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+	} else {
+		MSG_WriteDeltaEntityFromClass( msg, class_baseline, from, to );
+	}
+}
+
+/*
+* SNAP_WriteCachedDeltaEntity
+*
+* from_frame is the frame the source state was snapshotted on, or -1 for the baseline
+*/
+static void SNAP_WriteCachedDeltaEntity( msg_t *msg, int64_t from_frame, int class_baseline, const SyncEntityState *from, SyncEntityState *to, bool force ) {
+	// entity numbers fit in 16 bits, and frame numbers won't hit 2^47 any time soon
+	u64 key = ( u64( from_frame + 1 ) << 16 ) | u64( to->number );
+	u64 hash = Hash64( key ) | 1; // hashtable doesn't allow 0
+
+	Lock( delta_cache_mutex );
+
+	u64 idx;
+	if( delta_cache_hashtable.get( hash, &idx ) ) {
+		const EntityDeltaCacheEntry * entry = &delta_cache_entries[ idx ];
+		bool hit = entry->key == key;
+		if( hit ) {
+			MSG_WriteData( msg, delta_cache_data + entry->offset, entry->size );
+		}
+
+		Unlock( delta_cache_mutex );
+
+		// on a hash collision just don't cache it
+		if( !hit ) {
+			SNAP_WriteDeltaEntity( msg, class_baseline, from, to, force );
+		}
+		return;
+	}
+
+	Unlock( delta_cache_mutex );
+
+	size_t start = msg->cursize;
+	SNAP_WriteDeltaEntity( msg, class_baseline, from, to, force );
+	size_t size = msg->cursize - start;
+
+	Lock( delta_cache_mutex );
+	defer { Unlock( delta_cache_mutex ); };
+
+	if( num_delta_cache_entries == ARRAY_COUNT( delta_cache_entries ) || delta_cache_data_used + size > sizeof( delta_cache_data ) )
+		return;
+
+	// another thread may have beaten us to it, which is fine
+	if( !delta_cache_hashtable.add( hash, num_delta_cache_entries ) )
+		return;
+
+	EntityDeltaCacheEntry * entry = &delta_cache_entries[ num_delta_cache_entries ];
+	entry->key = key;
+	entry->offset = delta_cache_data_used;
+	entry->size = size;
+	memcpy( delta_cache_data + delta_cache_data_used, msg->data + start, size );
+
+	num_delta_cache_entries++;
+	delta_cache_data_used += size;
+}
+
+/*
+* SNAP_ClassBaseline
+*
+* Entities that were spawned with the map delta against their own baseline.
+* Anything spawned later, or reusing a slot for something else, deltas
+* against the class baseline that looks the most like it, or -1 for none
+*/
+static int SNAP_ClassBaseline( const SyncEntityState *baselines, const SyncEntityState *ent ) {
+	const SyncEntityState * own = &baselines[ent->number];
+	if( own->number != 0 && own->type == ent->type ) {
+		return -1;
+	}
+
+	int best = -1;
+	int best_score = -1;
+	for( int i = 0; i < MAX_CLASS_BASELINES; i++ ) {
+		const SyncEntityState * base = &baselines[MAX_EDICTS + i];
+		if( base->number == 0 ) {
+			break;
+		}
+		if( base->type != ent->type ) {
+			continue;
+		}
+
+		int score = ( base->model == ent->model ? 2 : 0 ) + ( base->sound == ent->sound ? 1 : 0 );
+		if( score > best_score ) {
+			best = i;
+			best_score = score;
+		}
+	}
+
+	return best;
+}
+
+/*
+* SNAP_PacketEntitiesKey
+*
+* Returns 0 if the update can't be shared
+*/
+static u64 SNAP_PacketEntitiesKey( const client_snapshot_t *from, const client_snapshot_t *to ) {
+	u64 from_hash = from == NULL ? 1 : from->entitiesHash;
+	if( from_hash == 0 || to->entitiesHash == 0 ) {
+		return 0;
+	}
+
+	return Hash64( &from_hash, sizeof( from_hash ), to->entitiesHash ) | 1;
+}
+
+/*
+* SNAP_WriteCachedPacketEntities
+*
+* Returns false if it's not in the cache or doesn't fit
+*/
+static bool SNAP_WriteCachedPacketEntities( msg_t *msg, u64 key, size_t budget ) {
+	Lock( delta_cache_mutex );
+	defer { Unlock( delta_cache_mutex ); };
+
+	u64 idx;
+	if( !packet_entities_cache_hashtable.get( key, &idx ) ) {
+		return false;
+	}
+
+	const EntityDeltaCacheEntry * entry = &packet_entities_cache_entries[ idx ];
+	size_t limit = budget == 0 ? msg->maxsize : Min2( budget, msg->maxsize );
+	if( entry->key != key || msg->cursize + entry->size > limit ) {
+		return false;
+	}
+
+	MSG_WriteData( msg, packet_entities_cache_data + entry->offset, entry->size );
+	return true;
+}
+
+static void SNAP_CachePacketEntities( u64 key, const u8 *data, size_t size ) {
+	Lock( delta_cache_mutex );
+	defer { Unlock( delta_cache_mutex ); };
+
+	if( num_packet_entities_cache_entries == ARRAY_COUNT( packet_entities_cache_entries ) || packet_entities_cache_data_used + size > sizeof( packet_entities_cache_data ) )
+		return;
+
+	if( !packet_entities_cache_hashtable.add( key, num_packet_entities_cache_entries ) )
+		return;
+
+	EntityDeltaCacheEntry * entry = &packet_entities_cache_entries[ num_packet_entities_cache_entries ];
+	entry->key = key;
+	entry->offset = packet_entities_cache_data_used;
+	entry->size = size;
+	memcpy( packet_entities_cache_data + packet_entities_cache_data_used, data, size );
+
+	num_packet_entities_cache_entries++;
+	packet_entities_cache_data_used += size;
+}
+
+/*
+=========================================================================
+
 Encode a client frame onto the network channel
 
 =========================================================================
 */
 
+static bool SNAP_IsDeferred( const client_snapshot_t *frame, int num ) {
+	return frame != NULL && ( frame->deferred[num >> 3] & ( 1 << ( num & 7 ) ) ) != 0;
+}
+
 /*
-* SNAP_EmitPacketEntities
+* SNAP_EntityPriority
+*
+* Higher is more important. Close entities, entities that moved a lot and the
+* player we're pointing at go first, and anything we've been holding back
+* for a while slowly floats to the top so it can't starve.
 *
-* Writes a delta update of an SyncEntityState list to the message.
+* Linear movers don't send their origin, see SNAP_SyncedOrigin, so distance
+* comes from the edict. They never count as having moved.
 */
-static void SNAP_EmitPacketEntities( ginfo_t *gi, client_snapshot_t *from, client_snapshot_t *to, msg_t *msg, SyncEntityState *baselines, SyncEntityState *client_entities, int num_client_entities ) {
+static float SNAP_EntityPriority( const client_t *client, const SyncPlayerState *ps, const SyncEntityState *oldent, const SyncEntityState *newent ) {
+	float dist = Length( EDICT_NUM( newent->number )->s.origin - ps->pmove.origin );
+	float priority = 1.0f / ( 1.0f + dist / 512.0f );
+
+	priority += Min2( Length( newent->origin - oldent->origin ) / 64.0f, 1.0f );
+
+	if( newent->number == ps->pointed_player ) {
+		priority += 2.0f;
+	}
+
+	priority += client->entityDeferredFrames[newent->number] * 0.25f;
+
+	return priority;
+}
+
+/*
+* SNAP_CanDeferEntity
+*
+* Events, teleports and our own POV have to go out right away
+*/
+static bool SNAP_CanDeferEntity( const client_t *client, const SyncPlayerState *ps, const SyncEntityState *newent ) {
+	if( newent->number == int( ps->POVnum ) || newent->teleported ) {
+		return false;
+	}
+	if( newent->events[0].type != 0 || newent->events[1].type != 0 ) {
+		return false;
+	}
+	return client->entityDeferredFrames[newent->number] < MAX_ENTITY_DEFERRED_FRAMES;
+}
+
+struct PacketEntityRecord {
+	SyncEntityState *oldent;
+	SyncEntityState *newent;
+	u32 offset;
+	u32 size;
+	float priority;
+	bool deferrable;
+	bool deferred;
+};
+
+/*
+* SNAP_EncodePacketEntities
+*
+* If budget is non-zero and the update doesn't fit, the least important
+* entity updates are deferred: the frame keeps the state the client already
+* has, so they get picked up by the delta from a later snapshot rather than
+* pushing this one into fragments. Returns how many entities were deferred.
+*/
+static int SNAP_EncodePacketEntities( client_t *client, client_snapshot_t *from, int64_t from_frame, client_snapshot_t *to, msg_t *msg, SyncEntityState *baselines, SyncEntityState *client_entities, int num_client_entities, size_t budget ) {
 	SyncEntityState *oldent, *newent;
 	int oldindex, newindex;
 	int oldnum, newnum;
 	int from_num_entities;
 
-	MSG_WriteUint8( msg, svc_packetentities );
-
 	if( !from ) {
 		from_num_entities = 0;
 	} else {
 		from_num_entities = from->num_entities;
 	}
 
+	// with a budget everything goes through a scratch buffer first so we know what it costs
+	msg_t scratch;
+	uint8_t scratch_data[MAX_MSGLEN];
+	PacketEntityRecord records[MAX_SNAPSHOT_ENTITIES * 2];
+	int num_records = 0;
+
+	msg_t *out = msg;
+	if( budget != 0 ) {
+		MSG_Init( &scratch, scratch_data, Min2( sizeof( scratch_data ), msg->maxsize - msg->cursize ) );
+		out = &scratch;
+	}
+
+	const SyncPlayerState *ps = &to->ps[0];
+
 	newindex = 0;
 	oldindex = 0;
 	while( newindex < to->num_entities || oldindex < from_num_entities ) {
@@ -68,34 +388,138 @@ static void SNAP_EmitPacketEntities( ginfo_t *gi, client_snapshot_t *from, clien
 			oldnum = oldent->number;
 		}
 
+		PacketEntityRecord *record = &records[num_records];
+		record->oldent = NULL;
+		record->newent = NULL;
+		record->offset = out->cursize;
+		record->deferrable = false;
+		record->deferred = false;
+
 		if( newnum == oldnum ) {
 			// delta update from old position
 			// because the force parm is false, this will not result
 			// in any bytes being emited if the entity has not changed at all
 			// note that players are always 'newentities', this updates their oldorigin always
 			// and prevents warping ( wsw : jal : I removed it from the players )
-			MSG_WriteDeltaEntity( msg, oldent, newent, false );
+			// deferred states are specific to this client, so they can't share the cache
+			if( SNAP_IsDeferred( from, oldnum ) ) {
+				MSG_WriteDeltaEntity( out, oldent, newent, false );
+			} else {
+				SNAP_WriteCachedDeltaEntity( out, from_frame, -1, oldent, newent, false );
+			}
+			record->oldent = oldent;
+			record->newent = newent;
+			if( budget != 0 && out->cursize != record->offset && SNAP_CanDeferEntity( client, ps, newent ) ) {
+				record->deferrable = true;
+				record->priority = SNAP_EntityPriority( client, ps, oldent, newent );
+			}
 			oldindex++;
 			newindex++;
-			continue;
 		}
-
-		if( newnum < oldnum ) {
+		else if( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity( msg, &baselines[newnum], newent, true );
+			int class_baseline = SNAP_ClassBaseline( baselines, newent );
+			const SyncEntityState * baseline = class_baseline == -1 ? &baselines[newnum] : &baselines[MAX_EDICTS + class_baseline];
+			SNAP_WriteCachedDeltaEntity( out, -1, class_baseline, baseline, newent, true );
+			record->newent = newent;
 			newindex++;
-			continue;
 		}
-
-		if( newnum > oldnum ) {
+		else {
 			// the old entity isn't present in the new message
-			MSG_WriteEntityNumber( msg, oldnum, true );
+			MSG_WriteEntityNumber( out, oldnum, true );
 			oldindex++;
+		}
+
+		record->size = out->cursize - record->offset;
+		num_records++;
+	}
+
+	if( budget == 0 ) {
+		MSG_WriteEntityNumber( msg, 0, false ); // end of packetentities
+		return 0;
+	}
+
+	// drop the least important updates until it fits
+	size_t used = msg->cursize + out->cursize;
+	if( used > budget ) {
+		PacketEntityRecord *deferrable[ARRAY_COUNT( records )];
+		int num_deferrable = 0;
+		for( int i = 0; i < num_records; i++ ) {
+			if( records[i].deferrable ) {
+				deferrable[num_deferrable++] = &records[i];
+			}
+		}
+
+		std::sort( deferrable, deferrable + num_deferrable, []( const PacketEntityRecord *a, const PacketEntityRecord *b ) {
+			return a->priority < b->priority;
+		} );
+
+		for( int i = 0; i < num_deferrable && used > budget; i++ ) {
+			deferrable[i]->deferred = true;
+			used -= deferrable[i]->size;
+		}
+	}
+
+	int num_deferred = 0;
+	for( int i = 0; i < num_records; i++ ) {
+		PacketEntityRecord *record = &records[i];
+
+		if( record->newent != NULL ) {
+			int num = record->newent->number;
+			client->entityDeferredFrames[num] = record->deferred ? client->entityDeferredFrames[num] + 1 : 0;
+		}
+
+		if( !record->deferred ) {
+			MSG_WriteData( msg, scratch.data + record->offset, record->size );
 			continue;
 		}
+
+		// keep what the client already has. this frame's copy is private to
+		// the client now, so remember not to use the cache when deltaing from it
+		int num = record->newent->number;
+		*record->newent = *record->oldent;
+		memset( record->newent->events, 0, sizeof( record->newent->events ) );
+		record->newent->teleported = false;
+		to->deferred[num >> 3] |= 1 << ( num & 7 );
+
+		MSG_WriteDeltaEntity( msg, record->oldent, record->newent, false );
+		num_deferred++;
 	}
 
 	MSG_WriteEntityNumber( msg, 0, false ); // end of packetentities
+
+	return num_deferred;
+}
+
+/*
+* SNAP_EmitPacketEntities
+*
+* Writes a delta update of an SyncEntityState list to the message, reusing
+* another client's encoding when it would be byte identical.
+*/
+static int SNAP_EmitPacketEntities( client_t *client, client_snapshot_t *from, int64_t from_frame, client_snapshot_t *to, msg_t *msg, SyncEntityState *baselines, SyncEntityState *client_entities, int num_client_entities, size_t budget ) {
+	MSG_WriteUint8( msg, svc_packetentities );
+
+	u64 key = SNAP_PacketEntitiesKey( from, to );
+	if( key != 0 && SNAP_WriteCachedPacketEntities( msg, key, budget ) ) {
+		for( int i = 0; i < to->num_entities; i++ ) {
+			const SyncEntityState * ent = &client_entities[( to->first_entity + i ) % num_client_entities];
+			client->entityDeferredFrames[ent->number] = 0;
+		}
+		return 0;
+	}
+
+	size_t start = msg->cursize;
+	int deferred = SNAP_EncodePacketEntities( client, from, from_frame, to, msg, baselines, client_entities, num_client_entities, budget );
+
+	if( deferred != 0 ) {
+		to->entitiesHash = 0;
+	}
+	else if( key != 0 ) {
+		SNAP_CachePacketEntities( key, msg->data + start, msg->cursize - start );
+	}
+
+	return deferred;
 }
 
 /*
@@ -114,6 +538,23 @@ static void SNAP_WritePlayerstateToClient( msg_t *msg, const SyncPlayerState *op
 	MSG_WriteDeltaPlayerState( msg, ops, ps );
 }
 
+/*
+* SNAP_WriteEventsToClient
+*
+* Events only go out once, so there's nothing to delta against in older
+* frames. Each one is delta'd against the one before it instead.
+*/
+static void SNAP_WriteEventsToClient( const client_snapshot_t *frame, msg_t *msg ) {
+	MSG_WriteUint8( msg, svc_events );
+	MSG_WriteUintBase128( msg, frame->num_events );
+
+	SyncSnapEvent baseline = { };
+	for( int i = 0; i < frame->num_events; i++ ) {
+		MSG_WriteDeltaSnapEvent( msg, &baseline, &frame->events[ i ] );
+		baseline = frame->events[ i ];
+	}
+}
+
 /*
 * SNAP_WriteMultiPOVCommands
 */
@@ -222,10 +663,14 @@ static void SNAP_WriteMultiPOVCommands( ginfo_t *gi, client_t *client, msg_t *ms
 }
 
 /*
-* SNAP_WriteFrameSnapToClient
+* SNAP_WriteFrameSnapHeaderToClient
+*
+* Writes everything that depends on mutable client state: the delta choice,
+* the frame header and game commands. Returns the frame being delta'd from,
+* which is what SNAP_WriteFrameSnapBodyToClient wants along with oldframe.
 */
-void SNAP_WriteFrameSnapToClient( ginfo_t *gi, client_t *client, msg_t *msg, int64_t frameNum, int64_t gameTime,
-								  SyncEntityState *baselines, client_entities_t *client_entities ) {
+int64_t SNAP_WriteFrameSnapHeaderToClient( ginfo_t *gi, client_t *client, msg_t *msg, int64_t frameNum, int64_t gameTime,
+										   client_snapshot_t **oldframe_out ) {
 	client_snapshot_t *frame, *oldframe;
 	int flags, i, index;
 
@@ -304,10 +749,27 @@ void SNAP_WriteFrameSnapToClient( ginfo_t *gi, client_t *client, msg_t *msg, int
 	}
 	MSG_WriteInt16( msg, -1 );
 
+	client->lastSentFrameNum = frameNum;
+
+	*oldframe_out = oldframe;
+	return client->lastframe;
+}
+
+/*
+* SNAP_WriteFrameSnapBodyToClient
+*
+* Writes the gamestate, playerstates and entities. Only reads the client's
+* frames and writes its entityDeferredFrames, so it can run off the main
+* thread while the next frame is simulated.
+*/
+int SNAP_WriteFrameSnapBodyToClient( client_t *client, client_snapshot_t *oldframe, int64_t from_frame, int64_t frameNum, msg_t *msg,
+									 SyncEntityState *baselines, client_entities_t *client_entities, size_t budget ) {
+	client_snapshot_t *frame = &client->snapShots[frameNum & UPDATE_MASK];
+
 	SNAP_WriteDeltaGameStateToClient( oldframe, frame, msg );
 
 	// delta encode the playerstate
-	for( i = 0; i < frame->numplayers; i++ ) {
+	for( int i = 0; i < frame->numplayers; i++ ) {
 		if( oldframe && oldframe->numplayers > i ) {
 			SNAP_WritePlayerstateToClient( msg, &oldframe->ps[i], &frame->ps[i] );
 		} else {
@@ -317,9 +779,28 @@ void SNAP_WriteFrameSnapToClient( ginfo_t *gi, client_t *client, msg_t *msg, int
 	MSG_WriteUint8( msg, 0 );
 
 	// delta encode the entities
-	SNAP_EmitPacketEntities( gi, oldframe, frame, msg, baselines, client_entities->entities, client_entities->num_entities );
+	// multiview frames have no single viewer to prioritise around
+	if( frame->multipov ) {
+		budget = 0;
+	}
+	int deferred = SNAP_EmitPacketEntities( client, oldframe, from_frame, frame, msg, baselines, client_entities->entities, client_entities->num_entities, budget );
 
-	client->lastSentFrameNum = frameNum;
+	SNAP_WriteEventsToClient( frame, msg );
+
+	return deferred;
+}
+
+/*
+* SNAP_WriteFrameSnapToClient
+*
+* budget is how many bytes the whole message should fit in, or 0 for no
+* limit. Returns how many entity updates were deferred to fit it.
+*/
+int SNAP_WriteFrameSnapToClient( ginfo_t *gi, client_t *client, msg_t *msg, int64_t frameNum, int64_t gameTime,
+								  SyncEntityState *baselines, client_entities_t *client_entities, size_t budget ) {
+	client_snapshot_t *oldframe;
+	int64_t from_frame = SNAP_WriteFrameSnapHeaderToClient( gi, client, msg, frameNum, gameTime, &oldframe );
+	return SNAP_WriteFrameSnapBodyToClient( client, oldframe, from_frame, frameNum, msg, baselines, client_entities, budget );
 }
 
 /*
@@ -330,21 +811,10 @@ Build a client frame structure
 =============================================================================
 */
 
-/*
-* SNAP_FatPVS
-*
-* The client will interpolate the view position,
-* so we can't use a single PVS point
-*/
-static void SNAP_FatPVS( CollisionModel *cms, Vec3 org, uint8_t *fatpvs ) {
-	memset( fatpvs, 0, CM_ClusterRowSize( cms ) );
-	CM_MergePVS( cms, org, fatpvs );
-}
-
 /*
 * SNAP_BitsCullEntity
 */
-static bool SNAP_PVSCullEntity( CollisionModel *cms, edict_t *ent, uint8_t *bits ) {
+static bool SNAP_PVSCullEntity( CollisionModel *cms, edict_t *ent, const uint8_t *bits ) {
 	// too many leafs for individual check, go by headnode
 	if( ent->r.num_clusters == -1 ) {
 		if( !CM_HeadnodeVisible( cms, ent->r.headnode, bits ) ) {
@@ -366,13 +836,6 @@ static bool SNAP_PVSCullEntity( CollisionModel *cms, edict_t *ent, uint8_t *bits
 
 //=====================================================================
 
-#define MAX_SNAPSHOT_ENTITIES   1024
-typedef struct {
-	int numSnapshotEntities;
-	int snapshotEntities[MAX_SNAPSHOT_ENTITIES];
-	uint8_t entityAddedToSnapList[MAX_EDICTS / 8];
-} snapshotEntityNumbers_t;
-
 /*
 * SNAP_AddEntNumToSnapList
 */
@@ -385,12 +848,11 @@ static bool SNAP_AddEntNumToSnapList( int entNum, snapshotEntityNumbers_t *entLi
 	}
 
 	// don't double add entities
-	if( entList->entityAddedToSnapList[entNum >> 3] & (1 << (entNum & 7)) ) {
+	if( entList->entityAddedToSnapList.test_and_set( entNum ) ) {
 		return false;
 	}
 
 	entList->snapshotEntities[entList->numSnapshotEntities++] = entNum;
-	entList->entityAddedToSnapList[entNum >> 3] |=  (1 << (entNum & 7));
 	return true;
 }
 
@@ -398,16 +860,14 @@ static bool SNAP_AddEntNumToSnapList( int entNum, snapshotEntityNumbers_t *entLi
 * SNAP_SortSnapList
 */
 static void SNAP_SortSnapList( snapshotEntityNumbers_t *entsList ) {
-	int i;
-
 	entsList->numSnapshotEntities = 0;
 
-	// avoid adding world to the list by all costs
-	for( i = 1; i < MAX_EDICTS; i++ ) {
-		if( entsList->entityAddedToSnapList[i >> 3] & (1 << (i & 7)) ) {
-			entsList->snapshotEntities[entsList->numSnapshotEntities++] = i;
+	entsList->entityAddedToSnapList.for_each( [entsList]( size_t i ) {
+		// avoid adding world to the list by all costs
+		if( i != 0 ) {
+			entsList->snapshotEntities[entsList->numSnapshotEntities++] = int( i );
 		}
-	}
+	} );
 }
 
 /*
@@ -420,58 +880,87 @@ static float SNAP_GainForAttenuation( float dist ) {
 }
 
 /*
-* SNAP_SnapCullSoundEntity
+* SNAP_SnapCullSound
 */
-static bool SNAP_SnapCullSoundEntity( CollisionModel *cms, edict_t *ent, Vec3 listener_origin ) {
+static bool SNAP_SnapCullSound( Vec3 origin, Vec3 listener_origin ) {
 	// extend the influence sphere cause the player could be moving
-	float dist = Length( listener_origin - ent->s.origin ) - 128;
+	float dist = Length( listener_origin - origin ) - 128;
 	float gain = SNAP_GainForAttenuation( dist < 0 ? 0 : dist );
 	return gain <= 0.05f;
 }
 
+enum SnapFilterResult {
+	SnapFilter_Cull,
+	SnapFilter_Send,
+	SnapFilter_CheckVisibility,
+};
+
 /*
-* SNAP_SnapCullEntity
+* SNAP_FilterBySVFlags
+*
+* The team/owner filters, shared by entities and events
 */
-static bool SNAP_SnapCullEntity( CollisionModel *cms, edict_t *ent, edict_t *clent, client_snapshot_t *frame,
-								Vec3 vieworg, int viewarea, uint8_t *fatpvs ) {
-	// filters: this entity has been disabled for comunication
-	if( ent->r.svflags & SVF_NOCLIENT ) {
-		return true;
-	}
-
-	// send all entities
-	if( frame->allentities ) {
-		return false;
-	}
-
+static SnapFilterResult SNAP_FilterBySVFlags( unsigned int svflags, int team, int ownerNum, const edict_t *clent ) {
 	// filters: transmit only to clients in the same team as this entity
 	// broadcasting is less important than team specifics
-	if( ( ent->r.svflags & SVF_ONLYTEAM ) && ( clent && ent->s.team != clent->s.team ) ) {
-		return true;
+	if( ( svflags & SVF_ONLYTEAM ) && ( clent && team != clent->s.team ) ) {
+		return SnapFilter_Cull;
 	}
 
 	// send only to owner
-	if( ( ent->r.svflags & SVF_ONLYOWNER ) && ( clent && ent->s.ownerNum != clent->s.number ) ) {
-		return true;
+	if( ( svflags & SVF_ONLYOWNER ) && ( clent && ownerNum != clent->s.number ) ) {
+		return SnapFilter_Cull;
 	}
 
-	if( ( ent->r.svflags & SVF_OWNERANDCHASERS ) && clent ) {
-		bool self = ent->s.ownerNum == clent->s.number;
-		bool spec = ent->s.ownerNum == clent->r.client->resp.chase.target;
+	if( ( svflags & SVF_OWNERANDCHASERS ) && clent ) {
+		bool self = ownerNum == clent->s.number;
+		bool spec = ownerNum == clent->r.client->resp.chase.target;
 		if( !self && !spec )
-			return true;
+			return SnapFilter_Cull;
+	}
+
+	if( ( svflags & SVF_NEVEROWNER ) && ( clent && ownerNum == clent->s.number ) ) {
+		return SnapFilter_Cull;
+	}
+
+	if( svflags & SVF_BROADCAST ) { // send to everyone
+		return SnapFilter_Send;
 	}
 
-	if( ( ent->r.svflags & SVF_NEVEROWNER ) && ( clent && ent->s.ownerNum == clent->s.number ) ) {
+	if( ( svflags & SVF_FORCETEAM ) && ( clent && team == clent->s.team ) ) {
+		return SnapFilter_Send;
+	}
+
+	return SnapFilter_CheckVisibility;
+}
+
+/*
+* SNAP_AreaVisible
+*/
+static bool SNAP_AreaVisible( CollisionModel *cms, const client_snapshot_t *frame, int viewarea, int areanum ) {
+	// this is the same as CM_AreasConnected but portal's visibility included
+	const u64 * areabits = frame->areabits + viewarea * BitSetWords( CM_NumAreas( cms ) );
+	return TestBit( areabits, areanum );
+}
+
+/*
+* SNAP_SnapCullEntity
+*/
+static bool SNAP_SnapCullEntity( CollisionModel *cms, edict_t *ent, edict_t *clent, client_snapshot_t *frame,
+								Vec3 vieworg, int viewarea, const uint8_t *fatpvs ) {
+	// filters: this entity has been disabled for comunication
+	if( ent->r.svflags & SVF_NOCLIENT ) {
 		return true;
 	}
 
-	if( ent->r.svflags & SVF_BROADCAST ) { // send to everyone
+	// send all entities
+	if( frame->allentities ) {
 		return false;
 	}
 
-	if( ( ent->r.svflags & SVF_FORCETEAM ) && ( clent && ent->s.team == clent->s.team ) ) {
-		return false;
+	SnapFilterResult filter = SNAP_FilterBySVFlags( ent->r.svflags, ent->s.team, ent->s.ownerNum, clent );
+	if( filter != SnapFilter_CheckVisibility ) {
+		return filter == SnapFilter_Cull;
 	}
 
 	if( ent->r.areanum < 0 ) {
@@ -479,11 +968,9 @@ static bool SNAP_SnapCullEntity( CollisionModel *cms, edict_t *ent, edict_t *cle
 	}
 
 	if( viewarea >= 0 ) {
-		// this is the same as CM_AreasConnected but portal's visibility included
-		uint8_t * areabits = frame->areabits + viewarea * CM_AreaRowSize( cms );
-		if( !( areabits[ent->r.areanum >> 3] & ( 1 << ( ent->r.areanum & 7 ) ) ) ) {
+		if( !SNAP_AreaVisible( cms, frame, viewarea, ent->r.areanum ) ) {
 			// doors can legally straddle two areas, so we may need to check another one
-			if( ent->r.areanum2 < 0 || !( areabits[ent->r.areanum2 >> 3] & ( 1 << ( ent->r.areanum2 & 7 ) ) ) ) {
+			if( ent->r.areanum2 < 0 || !SNAP_AreaVisible( cms, frame, viewarea, ent->r.areanum2 ) ) {
 				return true; // blocked by a door
 			}
 		}
@@ -505,7 +992,7 @@ static bool SNAP_SnapCullEntity( CollisionModel *cms, edict_t *ent, edict_t *cle
 	// PVS culling alone may not be used on pure sounds, entities with
 	// events and regular entities emitting sounds
 	if( snd_cull_only || ent->s.events[0].type || ent->s.sound != EMPTY_HASH ) {
-		snd_culled = SNAP_SnapCullSoundEntity( cms, ent, vieworg );
+		snd_culled = SNAP_SnapCullSound( ent->s.origin, vieworg );
 	}
 
 	// pure sound emitters don't use PVS culling at all
@@ -516,18 +1003,77 @@ static bool SNAP_SnapCullEntity( CollisionModel *cms, edict_t *ent, edict_t *cle
 	return snd_culled && SNAP_PVSCullEntity( cms, ent, fatpvs );    // cull by PVS
 }
 
+/*
+* SNAP_SnapCullEvent
+*
+* Same rules as an event entity sitting at the event's origin
+*/
+static bool SNAP_SnapCullEvent( CollisionModel *cms, const SyncSnapEvent *ev, const edict_t *clent, const client_snapshot_t *frame,
+								Vec3 vieworg, int viewarea, const uint8_t *fatpvs ) {
+	if( frame->allentities ) {
+		return false;
+	}
+
+	SnapFilterResult filter = SNAP_FilterBySVFlags( ev->svflags, ev->team, ev->ownerNum, clent );
+	if( filter != SnapFilter_CheckVisibility ) {
+		return filter == SnapFilter_Cull;
+	}
+
+	int leafnum = CM_PointLeafnum( cms, ev->origin );
+	int areanum = CM_LeafArea( cms, leafnum );
+	if( areanum < 0 ) {
+		return true;
+	}
+
+	if( viewarea >= 0 && !SNAP_AreaVisible( cms, frame, viewarea, areanum ) ) {
+		return true; // blocked by a door
+	}
+
+	// events can be heard through walls
+	if( !SNAP_SnapCullSound( ev->origin, vieworg ) ) {
+		return false;
+	}
+
+	int cluster = CM_LeafCluster( cms, leafnum );
+	return cluster < 0 || !( fatpvs[cluster >> 3] & ( 1 << ( cluster & 7 ) ) );
+}
+
+/*
+* SNAP_BuildSnapEventsList
+*/
+static void SNAP_BuildSnapEventsList( CollisionModel *cms, ginfo_t *gi, const edict_t *clent, Vec3 vieworg, client_snapshot_t *frame ) {
+	const uint8_t * pvs = CM_FatPVS( cms, vieworg );
+	int viewarea = CM_LeafArea( cms, CM_PointLeafnum( cms, vieworg ) );
+
+	frame->num_events = 0;
+	for( int i = 0; i < gi->events->num_events; i++ ) {
+		const SyncSnapEvent * ev = &gi->events->events[ i ];
+		if( SNAP_SnapCullEvent( cms, ev, clent, frame, vieworg, viewarea, pvs ) ) {
+			continue;
+		}
+
+		frame->events[ frame->num_events ] = *ev;
+		frame->num_events++;
+	}
+}
+
 /*
 * SNAP_AddEntitiesVisibleAtOrigin
 */
 static void SNAP_AddEntitiesVisibleAtOrigin( CollisionModel *cms, ginfo_t *gi, edict_t *clent, Vec3 vieworg,
 											int viewarea, client_snapshot_t *frame, snapshotEntityNumbers_t *entList ) {
-	uint8_t * pvs = ( uint8_t * ) alloca( CM_ClusterRowSize( cms ) );
-	SNAP_FatPVS( cms, vieworg, pvs );
+	// the client will interpolate the view position, so we can't use a single PVS point
+	const uint8_t * pvs = CM_FatPVS( cms, vieworg );
 
 	// add the entities to the list
 	for( int entNum = 1; entNum < gi->num_edicts; entNum++ ) {
 		edict_t * ent = EDICT_NUM( entNum );
 
+		// reject disabled entities from the hot arrays without touching the edict
+		if( entNum < gi->hot->num_edicts && ( gi->hot->svflags[ entNum ] & SVF_NOCLIENT ) && ent != clent ) {
+			continue;
+		}
+
 		// fix number if broken
 		if( ent->s.number != entNum ) {
 			Com_Printf( "FIXING ENT->S.NUMBER: %i %i!!!\n", ent->s.number, entNum );
@@ -565,7 +1111,7 @@ static void SNAP_BuildSnapEntitiesList( CollisionModel *cms, ginfo_t *gi, edict_
 	int leafnum, clientarea;
 
 	entList->numSnapshotEntities = 0;
-	memset( entList->entityAddedToSnapList, 0, sizeof( entList->entityAddedToSnapList ) );
+	entList->entityAddedToSnapList.clear();
 
 	// find the client's PVS
 	leafnum = CM_PointLeafnum( cms, vieworg );
@@ -591,36 +1137,26 @@ static void SNAP_BuildSnapEntitiesList( CollisionModel *cms, ginfo_t *gi, edict_
 }
 
 /*
-* SNAP_BuildClientFrameSnap
+* SNAP_BeginClientFrameSnap
 *
-* Decides which entities are going to be visible to the client, and
-* copies off the playerstat and areabits.
+* Allocates the frame's storage and fills in everything that doesn't depend
+* on visibility. Not thread safe. Returns false if the client shouldn't get
+* a snapshot this frame.
 */
-void SNAP_BuildClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameNum, int64_t timeStamp,
-								client_t *client,
-								SyncGameState *gameState, client_entities_t *client_entities,
-								mempool_t *mempool ) {
-	int e, i, ne;
-	Vec3 org;
+bool SNAP_BeginClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameNum, int64_t timeStamp,
+								client_t *client, SyncGameState *gameState, mempool_t *mempool ) {
+	int i, numareas;
 	edict_t *ent, *clent;
 	client_snapshot_t *frame;
-	SyncEntityState *state;
-	int numplayers, numareas;
-	snapshotEntityNumbers_t entsList;
 
 	assert( gameState );
 
 	clent = client->edict;
 	if( clent && !clent->r.client ) {   // allow NULL ent for server record
-		return;     // not in game yet
-
+		return false;     // not in game yet
 	}
-	if( clent ) {
-		org = clent->s.origin;
-		org.z += clent->r.client->ps.viewheight;
-	} else {
+	if( !clent ) {
 		assert( client->mv );
-		org = Vec3( 0.0f );
 	}
 
 	// this is the frame we are creating
@@ -646,10 +1182,9 @@ void SNAP_BuildClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameN
 			Mem_Free( frame->areabits );
 			frame->areabits = NULL;
 		}
-		frame->areabits = (uint8_t*)Mem_Alloc( mempool, numareas );
+		frame->areabits = (u64*)Mem_Alloc( mempool, numareas );
 	}
 
-	// grab the current SyncPlayerState
 	if( frame->multipov ) {
 		frame->numplayers = 0;
 		for( i = 0; i < gi->max_clients; i++ ) {
@@ -672,6 +1207,48 @@ void SNAP_BuildClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameN
 		frame->ps_size = frame->numplayers;
 	}
 
+	// the events get culled into here, which might happen off the main thread
+	frame->num_events = 0;
+	if( frame->events_size < gi->events->num_events ) {
+		if( frame->events ) {
+			Mem_Free( frame->events );
+		}
+		frame->events_size = MAX_SNAP_EVENTS;
+		frame->events = ( SyncSnapEvent * )Mem_Alloc( mempool, sizeof( SyncSnapEvent ) * frame->events_size );
+	}
+
+	// store current match state information
+	frame->gameState = *gameState;
+
+	memset( frame->deferred, 0, sizeof( frame->deferred ) );
+
+	return true;
+}
+
+/*
+* SNAP_CullClientFrameSnap
+*
+* Copies off the playerstates and areabits, and decides which entities are
+* going to be visible to the client. Only touches the client's own frame, so
+* different clients can be culled in parallel.
+*/
+void SNAP_CullClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameNum, client_t *client, snapshotEntityNumbers_t *entsList ) {
+	ZoneScoped;
+
+	int i, numplayers;
+	Vec3 org;
+	edict_t *ent;
+	edict_t *clent = client->edict;
+	client_snapshot_t *frame = &client->snapShots[frameNum & UPDATE_MASK];
+
+	if( clent ) {
+		org = clent->s.origin;
+		org.z += clent->r.client->ps.viewheight;
+	} else {
+		org = Vec3( 0.0f );
+	}
+
+	// grab the current SyncPlayerState
 	if( frame->multipov ) {
 		numplayers = 0;
 		for( i = 0; i < gi->max_clients; i++ ) {
@@ -688,34 +1265,78 @@ void SNAP_BuildClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameN
 	}
 
 	// build up the list of visible entities
-	//=============================
-	SNAP_BuildSnapEntitiesList( cms, gi, clent, org, frame, &entsList );
+	SNAP_BuildSnapEntitiesList( cms, gi, clent, org, frame, entsList );
+	SNAP_BuildSnapEventsList( cms, gi, clent, org, frame );
+}
 
-	// store current match state information
-	frame->gameState = *gameState;
+/*
+* SNAP_SyncedOrigin
+*
+* The client works out where linear movers are from linearMovementBegin,
+* linearMovementVelocity and the timestamp, and throws away the origin we
+* send. Pinning it to linearMovementBegin means the delta never has to
+* resend it while they fly. Events still need the real origin.
+*/
+static Vec3 SNAP_SyncedOrigin( const SyncEntityState * state ) {
+	if( state->linearMovement && state->events[ 0 ].type == 0 ) {
+		return state->linearMovementBegin;
+	}
+	return state->origin;
+}
 
-	//=============================
+/*
+* SNAP_FinishClientFrameSnap
+*
+* Dumps the visible entities into the circular client_entities array. Not
+* thread safe.
+*/
+void SNAP_FinishClientFrameSnap( int64_t frameNum, client_t *client, const snapshotEntityNumbers_t *entsList, client_entities_t *client_entities ) {
+	client_snapshot_t *frame = &client->snapShots[frameNum & UPDATE_MASK];
 
-	// dump the entities list
-	ne = client_entities->next_entities;
+	int ne = client_entities->next_entities;
 	frame->num_entities = 0;
 	frame->first_entity = ne;
 
-	for( e = 0; e < entsList.numSnapshotEntities; e++ ) {
+	u64 hash = Hash64( &frameNum, sizeof( frameNum ) );
+
+	for( int e = 0; e < entsList->numSnapshotEntities; e++ ) {
 		// add it to the circular client_entities array
-		ent = EDICT_NUM( entsList.snapshotEntities[e] );
-		state = &client_entities->entities[ne % client_entities->num_entities];
+		const edict_t *ent = EDICT_NUM( entsList->snapshotEntities[e] );
+		SyncEntityState *state = &client_entities->entities[ne % client_entities->num_entities];
 
 		*state = ent->s;
+		state->origin = SNAP_SyncedOrigin( state );
 		state->svflags = ent->r.svflags;
 
+		hash = Hash64( &state->number, sizeof( state->number ), hash );
+
 		frame->num_entities++;
 		ne++;
 	}
 
+	frame->entitiesHash = hash | 1;
 	client_entities->next_entities = ne;
 }
 
+/*
+* SNAP_BuildClientFrameSnap
+*
+* Decides which entities are going to be visible to the client, and
+* copies off the playerstat and areabits.
+*/
+void SNAP_BuildClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameNum, int64_t timeStamp,
+								client_t *client,
+								SyncGameState *gameState, client_entities_t *client_entities,
+								mempool_t *mempool ) {
+	if( !SNAP_BeginClientFrameSnap( cms, gi, frameNum, timeStamp, client, gameState, mempool ) ) {
+		return;
+	}
+
+	snapshotEntityNumbers_t entsList;
+	SNAP_CullClientFrameSnap( cms, gi, frameNum, client, &entsList );
+	SNAP_FinishClientFrameSnap( frameNum, client, &entsList, client_entities );
+}
+
 /*
 * SNAP_FreeClientFrame
 *
@@ -733,6 +1354,13 @@ static void SNAP_FreeClientFrame( client_snapshot_t *frame ) {
 		frame->ps = NULL;
 	}
 	frame->ps_size = 0;
+
+	if( frame->events ) {
+		Mem_Free( frame->events );
+		frame->events = NULL;
+	}
+	frame->events_size = 0;
+	frame->num_events = 0;
 }
 
 /*
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+
+#include "qcommon/types.h"
+
+/*
+ * lock-free queue for exactly one thread pushing and one other thread
+ * popping. neither side ever waits on the other, push just fails when
+ * it's full
+ */
+template< typename T, size_t N >
+class SPSCQueue {
+	STATIC_ASSERT( IsPowerOf2( N ) );
+
+	T items[ N ];
+
+	// on separate cache lines so the two threads don't fight over them
+	alignas( 64 ) std::atomic< u64 > head;
+	alignas( 64 ) std::atomic< u64 > tail;
+
+public:
+	SPSCQueue() {
+		clear();
+	}
+
+	// only when neither thread is using it
+	void clear() {
+		head.store( 0, std::memory_order_relaxed );
+		tail.store( 0, std::memory_order_relaxed );
+	}
+
+	bool push( const T & x ) {
+		u64 t = tail.load( std::memory_order_relaxed );
+		if( t - head.load( std::memory_order_acquire ) == N )
+			return false;
+
+		items[ t % N ] = x;
+		tail.store( t + 1, std::memory_order_release );
+		return true;
+	}
+
+	bool pop( T * x ) {
+		u64 h = head.load( std::memory_order_relaxed );
+		if( h == tail.load( std::memory_order_acquire ) )
+			return false;
+
+		*x = items[ h % N ];
+		head.store( h + 1, std::memory_order_release );
+		return true;
+	}
+};
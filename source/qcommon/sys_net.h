@@ -29,3 +29,29 @@ net_error_t Sys_NET_GetLastError();
 
 void        Sys_NET_SocketClose( socket_handle_t handle );
 int         Sys_NET_SocketIoctl( socket_handle_t handle, long request, ioctl_param_t* param );
+
+struct sockaddr_storage;
+
+struct sys_datagram_t {
+	void *data;
+	size_t length;                      // buffer size when receiving, set to the datagram size
+	struct sockaddr_storage *address;
+	int addrlen;                        // set when receiving
+};
+
+// return the number of datagrams received/sent, or SOCKET_ERROR if the first one failed
+int         Sys_NET_RecvDatagrams( socket_handle_t handle, sys_datagram_t *datagrams, int n );
+int         Sys_NET_SendDatagrams( socket_handle_t handle, const sys_datagram_t *datagrams, int n );
+
+// sends part of a file over a TCP socket without copying it through userspace
+// return the number of bytes sent, or SOCKET_ERROR
+int         Sys_NET_SendFile( socket_handle_t handle, FILE *file, size_t offset, size_t length );
+
+// epoll/WSAPoll, flags are NetPollFlags
+NetPoller * Sys_NET_NewPoller();
+void        Sys_NET_DeletePoller( NetPoller *poller );
+bool        Sys_NET_PollerAdd( NetPoller *poller, socket_handle_t handle, u32 flags, void *user );
+bool        Sys_NET_PollerModify( NetPoller *poller, socket_handle_t handle, u32 flags, void *user );
+void        Sys_NET_PollerRemove( NetPoller *poller, socket_handle_t handle );
+// returns the number of events, or SOCKET_ERROR
+int         Sys_NET_Poll( NetPoller *poller, int msec, NetPollEvent *events, int n );
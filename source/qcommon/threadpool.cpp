@@ -0,0 +1,454 @@
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/load_profile.h"
+#include "qcommon/threads.h"
+#include "qcommon/threadpool.h"
+
+/*
+ * every worker has its own deque. new jobs go on the back of the submitting
+ * thread's deque and it takes them back off the back, so it keeps working on
+ * whatever is still in cache, and idle workers steal from the front of
+ * everyone else's. threads that aren't workers, i.e. the main thread, share
+ * one extra deque
+ *
+ * the deques each have their own lock so submitting and stealing only ever
+ * contend with one other thread at a time, rather than everything going
+ * through one global queue
+ *
+ * jobs that depend on a group sit in a side list until the group's last job
+ * finishes, and the generation stops a group that got freed and reallocated
+ * at the same address from picking up someone else's dependents
+ *
+ * job temp allocations come out of per-thread arenas that spill into blocks
+ * from sys_allocator when a job needs more, so big decodes are slower rather
+ * than fatal. threadpool_arenas prints how far each one has gone
+ */
+
+struct Job {
+	JobCallback callback;
+	void * data;
+	JobGroup * group;
+};
+
+struct JobDeque {
+	Mutex * mutex;
+	Job jobs[ 4096 ];
+	size_t head;
+	size_t tail;
+};
+
+struct DeferredJob {
+	Job job;
+	JobGroup * depends_on;
+	u64 generation;
+};
+
+struct Worker {
+	Thread * thread;
+	ArenaAllocator arena;
+	u32 idx;
+
+	// written by the worker after each job so other threads can read it
+	std::atomic< float > arena_max_utilisation;
+	char plot_name[ 64 ];
+};
+
+static Worker workers[ 32 ];
+static u32 num_workers;
+
+// one per worker plus one for everyone else
+static JobDeque deques[ ARRAY_COUNT( workers ) + 1 ];
+static u32 num_deques;
+
+static DeferredJob deferred_jobs[ 1024 ];
+static u32 num_deferred_jobs;
+static Mutex * deferred_mutex;
+
+static JobGroup all_jobs;
+static std::atomic< u64 > next_generation;
+
+static Semaphore * jobs_sem;
+static std::atomic< u32 > sleeping_workers;
+static Semaphore * completion_sem;
+static std::atomic< u32 > waiting_threads;
+static std::atomic< bool > shutting_down;
+
+// for jobs that get picked up by threads that aren't workers
+static ArenaAllocator caller_arena;
+
+static thread_local u32 thread_deque = U32_MAX;
+static thread_local ArenaAllocator * thread_arena = NULL;
+
+static ArenaAllocator * ThreadArena() {
+	return thread_arena != NULL ? thread_arena : &caller_arena;
+}
+
+static JobDeque * OwnDeque() {
+	return &deques[ thread_deque == U32_MAX ? num_workers : thread_deque ];
+}
+
+static void AddToGroup( JobGroup * group ) {
+	if( group->pending.fetch_add( 1 ) == 0 ) {
+		group->generation = next_generation++;
+	}
+}
+
+static void PushJobs( const Job * jobs, size_t n ) {
+	JobDeque * deque = OwnDeque();
+
+	Lock( deque->mutex );
+	assert( deque->tail - deque->head + n <= ARRAY_COUNT( deque->jobs ) );
+	for( size_t i = 0; i < n; i++ ) {
+		deque->jobs[ deque->tail % ARRAY_COUNT( deque->jobs ) ] = jobs[ i ];
+		deque->tail++;
+	}
+	Unlock( deque->mutex );
+
+	u32 sleeping = sleeping_workers.load();
+	if( sleeping > 0 ) {
+		Signal( jobs_sem, checked_cast< int >( Min2( size_t( sleeping ), n ) ) );
+	}
+}
+
+static bool PopJob( JobDeque * deque, Job * job ) {
+	Lock( deque->mutex );
+	defer { Unlock( deque->mutex ); };
+
+	if( deque->head == deque->tail )
+		return false;
+
+	deque->tail--;
+	*job = deque->jobs[ deque->tail % ARRAY_COUNT( deque->jobs ) ];
+	return true;
+}
+
+static bool StealJob( JobDeque * deque, Job * job ) {
+	Lock( deque->mutex );
+	defer { Unlock( deque->mutex ); };
+
+	if( deque->head == deque->tail )
+		return false;
+
+	*job = deque->jobs[ deque->head % ARRAY_COUNT( deque->jobs ) ];
+	deque->head++;
+	return true;
+}
+
+static bool FindJob( Job * job ) {
+	JobDeque * own = OwnDeque();
+	if( PopJob( own, job ) )
+		return true;
+
+	u32 start = u32( own - deques );
+	for( u32 i = 1; i < num_deques; i++ ) {
+		if( StealJob( &deques[ ( start + i ) % num_deques ], job ) ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void GroupFinished( JobGroup * group, u64 generation ) {
+	Job released[ ARRAY_COUNT( deferred_jobs ) ];
+	size_t num_released = 0;
+
+	{
+		Lock( deferred_mutex );
+		defer { Unlock( deferred_mutex ); };
+
+		for( u32 i = 0; i < num_deferred_jobs; ) {
+			const DeferredJob * deferred = &deferred_jobs[ i ];
+			if( deferred->depends_on == group && deferred->generation == generation ) {
+				released[ num_released ] = deferred->job;
+				num_released++;
+
+				num_deferred_jobs--;
+				deferred_jobs[ i ] = deferred_jobs[ num_deferred_jobs ];
+			}
+			else {
+				i++;
+			}
+		}
+	}
+
+	if( num_released > 0 ) {
+		PushJobs( released, num_released );
+	}
+
+	u32 waiting = waiting_threads.load();
+	if( waiting > 0 ) {
+		Signal( completion_sem, checked_cast< int >( waiting ) );
+	}
+}
+
+static void FinishJob( JobGroup * group ) {
+	// read the generation before the decrement because the group can be
+	// gone as soon as pending hits zero
+	u64 generation = group->generation.load();
+	if( group->pending.fetch_sub( 1 ) == 1 ) {
+		GroupFinished( group, generation );
+	}
+}
+
+static void RunJob( const Job & job ) {
+	{
+		TempAllocator temp = ThreadArena()->temp();
+		job.callback( &temp, job.data );
+	}
+
+	if( job.group != NULL ) {
+		FinishJob( job.group );
+	}
+	FinishJob( &all_jobs );
+}
+
+static void ThreadPoolWorker( void * data ) {
+#if TRACY_ENABLE
+	tracy::SetThreadName( "Thread pool worker" );
+#endif
+
+	Worker * worker = ( Worker * ) data;
+	thread_deque = worker->idx;
+	thread_arena = &worker->arena;
+
+	while( true ) {
+		Job job;
+		bool found = FindJob( &job );
+
+		if( !found ) {
+			// go to sleep, but look again after saying so, or a job that
+			// gets pushed in between would never wake us up
+			sleeping_workers++;
+			found = FindJob( &job );
+			if( !found ) {
+				Wait( jobs_sem );
+			}
+			sleeping_workers--;
+		}
+
+		if( shutting_down )
+			break;
+
+		if( found ) {
+			u64 start = Sys_Nanoseconds();
+			RunJob( job );
+			LoadProfileAddThreadPoolTime( Sys_Nanoseconds() - start );
+		}
+	}
+}
+
+static constexpr size_t arena_size = 1024 * 1024; // 1MB
+
+static void PrintArenas_f() {
+	Com_Printf( "Thread pool arena high-water marks (%zuKB each):\n", arena_size / 1024 );
+	for( u32 i = 0; i < num_workers; i++ ) {
+		float utilisation = workers[ i ].arena_max_utilisation;
+		Com_Printf( "%sworker %u: %.0f%%\n", utilisation > 1.0f ? S_COLOR_YELLOW : "", i, utilisation * 100.0f );
+	}
+}
+
+void ThreadPoolPlotArenas() {
+	for( u32 i = 0; i < num_workers; i++ ) {
+		TracyPlot( workers[ i ].plot_name, workers[ i ].arena_max_utilisation.load() );
+	}
+}
+
+void InitThreadPool() {
+	ZoneScoped;
+
+	shutting_down = false;
+	sleeping_workers = 0;
+	waiting_threads = 0;
+	next_generation = 1;
+	all_jobs.pending = 0;
+	num_deferred_jobs = 0;
+
+	deferred_mutex = NewMutex();
+	jobs_sem = NewSemaphore();
+	completion_sem = NewSemaphore();
+
+	num_workers = Min2( GetCoreCount() - 1, u32( ARRAY_COUNT( workers ) ) );
+	num_deques = num_workers + 1;
+
+	for( u32 i = 0; i < num_deques; i++ ) {
+		deques[ i ].mutex = NewMutex();
+		deques[ i ].head = 0;
+		deques[ i ].tail = 0;
+	}
+
+	caller_arena = ArenaAllocator( ALLOC_SIZE( sys_allocator, arena_size, 16 ), arena_size, sys_allocator );
+	thread_arena = &caller_arena;
+
+	for( u32 i = 0; i < num_workers; i++ ) {
+		void * arena_memory = ALLOC_SIZE( sys_allocator, arena_size, 16 );
+		workers[ i ].arena = ArenaAllocator( arena_memory, arena_size, sys_allocator );
+		workers[ i ].idx = i;
+		workers[ i ].arena_max_utilisation = 0.0f;
+		ggformat( workers[ i ].plot_name, sizeof( workers[ i ].plot_name ), "Thread pool worker {} arena max utilisation", i );
+		workers[ i ].thread = NewThread( ThreadPoolWorker, &workers[ i ] );
+	}
+
+	Cmd_AddCommand( "threadpool_arenas", PrintArenas_f );
+}
+
+void ShutdownThreadPool() {
+	ZoneScoped;
+
+	Cmd_RemoveCommand( "threadpool_arenas" );
+
+	shutting_down = true;
+
+	for( u32 i = 0; i < num_workers; i++ ) {
+		Signal( jobs_sem );
+	}
+
+	for( u32 i = 0; i < num_workers; i++ ) {
+		JoinThread( workers[ i ].thread );
+		FREE( sys_allocator, workers[ i ].arena.get_memory() );
+	}
+
+	FREE( sys_allocator, caller_arena.get_memory() );
+	thread_arena = NULL;
+
+	for( u32 i = 0; i < num_deques; i++ ) {
+		DeleteMutex( deques[ i ].mutex );
+	}
+
+	DeleteSemaphore( completion_sem );
+	DeleteSemaphore( jobs_sem );
+	DeleteMutex( deferred_mutex );
+}
+
+void ThreadPoolDo( JobGroup * group, JobCallback callback, void * data ) {
+	ZoneScoped;
+
+	if( group != NULL ) {
+		AddToGroup( group );
+	}
+	AddToGroup( &all_jobs );
+
+	Job job = { callback, data, group };
+	PushJobs( &job, 1 );
+}
+
+void ThreadPoolDo( JobCallback callback, void * data ) {
+	ThreadPoolDo( NULL, callback, data );
+}
+
+void ThreadPoolDoAfter( JobGroup * group, JobGroup * depends_on, JobCallback callback, void * data ) {
+	ZoneScoped;
+
+	if( group != NULL ) {
+		AddToGroup( group );
+	}
+	AddToGroup( &all_jobs );
+
+	Job job = { callback, data, group };
+
+	{
+		Lock( deferred_mutex );
+		defer { Unlock( deferred_mutex ); };
+
+		// the last job in depends_on takes this lock before releasing its
+		// dependents, so if it's still pending it will see this one
+		if( depends_on->pending != 0 ) {
+			assert( num_deferred_jobs < ARRAY_COUNT( deferred_jobs ) );
+			DeferredJob * deferred = &deferred_jobs[ num_deferred_jobs ];
+			deferred->job = job;
+			deferred->depends_on = depends_on;
+			deferred->generation = depends_on->generation;
+			num_deferred_jobs++;
+			return;
+		}
+	}
+
+	PushJobs( &job, 1 );
+}
+
+void ThreadPoolWait( JobGroup * group ) {
+	ZoneScoped;
+
+	while( group->pending != 0 ) {
+		Job job;
+		if( FindJob( &job ) ) {
+			RunJob( job );
+			continue;
+		}
+
+		// same dance as the workers, pending has to be checked after we
+		// say we're waiting
+		waiting_threads++;
+		bool found = FindJob( &job );
+		if( !found && group->pending != 0 ) {
+			Wait( completion_sem );
+		}
+		waiting_threads--;
+
+		if( found ) {
+			RunJob( job );
+		}
+	}
+}
+
+void ThreadPoolFinish() {
+	ThreadPoolWait( &all_jobs );
+}
+
+struct ParallelForContext {
+	char * datum;
+	size_t n;
+	size_t stride;
+	size_t grain;
+	JobCallback callback;
+	std::atomic< size_t > next;
+};
+
+static void ParallelForJob( TempAllocator * temp, void * data ) {
+	ParallelForContext * pf = ( ParallelForContext * ) data;
+
+	while( true ) {
+		size_t start = pf->next.fetch_add( pf->grain );
+		if( start >= pf->n )
+			break;
+
+		size_t end = Min2( start + pf->grain, pf->n );
+		for( size_t i = start; i < end; i++ ) {
+			TempAllocator item_temp = ThreadArena()->temp();
+			pf->callback( &item_temp, pf->datum + pf->stride * i );
+		}
+	}
+}
+
+void ParallelFor( void * datum, size_t n, size_t stride, JobCallback callback, size_t grain ) {
+	ZoneScoped;
+
+	if( n == 0 )
+		return;
+
+	ParallelForContext pf;
+	pf.datum = ( char * ) datum;
+	pf.n = n;
+	pf.stride = stride;
+	pf.grain = Max2( grain, size_t( 1 ) );
+	pf.callback = callback;
+	pf.next = 0;
+
+	// one job per worker that could help, each of which pulls items until
+	// they're all gone
+	size_t chunks = ( n + pf.grain - 1 ) / pf.grain;
+	size_t helpers = Min2( chunks - 1, size_t( num_workers ) );
+
+	JobGroup group;
+	Job jobs[ ARRAY_COUNT( workers ) ];
+	for( size_t i = 0; i < helpers; i++ ) {
+		AddToGroup( &group );
+		AddToGroup( &all_jobs );
+		jobs[ i ] = { ParallelForJob, &pf, &group };
+	}
+	PushJobs( jobs, helpers );
+
+	ParallelForJob( NULL, &pf );
+
+	ThreadPoolWait( &group );
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+
+#include "qcommon/types.h"
+
+using JobCallback = void ( * )( TempAllocator * temp, void * data );
+
+/*
+ * jobs can go in a group so you can wait on just those jobs, or have more
+ * jobs start once they're all done. groups need to outlive their jobs and
+ * anything waiting on them, e.g. put them on the stack and wait before
+ * returning
+ */
+struct JobGroup {
+	std::atomic< u32 > pending;
+	std::atomic< u64 > generation;
+
+	JobGroup() : pending( 0 ), generation( 0 ) { }
+};
+
+void InitThreadPool();
+void ShutdownThreadPool();
+
+// plots each worker's arena high-water mark, call it once a frame
+void ThreadPoolPlotArenas();
+
+void ThreadPoolDo( JobCallback callback, void * data = NULL );
+void ThreadPoolDo( JobGroup * group, JobCallback callback, void * data = NULL );
+
+// runs the job once everything currently in depends_on has finished
+void ThreadPoolDoAfter( JobGroup * group, JobGroup * depends_on, JobCallback callback, void * data = NULL );
+
+// runs jobs while it waits, so it's fine to call from inside a job
+void ThreadPoolWait( JobGroup * group );
+
+// waits for every job, including ones in groups. don't call it from a job
+void ThreadPoolFinish();
+
+/*
+ * threads grab grain items at a time, so make it bigger when the items are
+ * tiny. the calling thread helps, and it only waits for its own items
+ */
+void ParallelFor( void * datum, size_t n, size_t stride, JobCallback callback, size_t grain = 1 );
+
+template< typename T >
+void ParallelFor( Span< T > datum, JobCallback callback, size_t grain = 1 ) {
+	ParallelFor( datum.ptr, datum.n, sizeof( T ), callback, grain );
+}
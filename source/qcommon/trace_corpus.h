@@ -0,0 +1,31 @@
+#pragma once
+
+#include "qcommon/types.h"
+
+/*
+ * world traces recorded from a live server with the tracerecord command,
+ * for tracebench to replay. a corpus is a TraceCorpusHeader followed by
+ * num_records TraceCorpusRecords, straight out of memory
+ */
+
+constexpr u32 TRACE_CORPUS_MAGIC = 0x31435254; // TRC1
+
+enum TraceCorpusRecordType : u32 {
+	TraceCorpusRecord_BoxTrace,
+	TraceCorpusRecord_PointContents,
+};
+
+struct TraceCorpusHeader {
+	u32 magic;
+	u32 num_records;
+	char map[ 64 ];
+};
+
+struct TraceCorpusRecord {
+	Vec3 start, end;
+	Vec3 mins, maxs;
+	s32 contentmask;
+	TraceCorpusRecordType type;
+};
+
+STATIC_ASSERT( sizeof( TraceCorpusRecord ) == 14 * sizeof( u32 ) );
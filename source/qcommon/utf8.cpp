@@ -22,9 +22,15 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <emmintrin.h>
 
 #include "gameshared/q_shared.h"
 #include "gameshared/q_math.h"
+#include "qcommon/utf8.h"
+
+#if COMPILER_MSVC
+#include <intrin.h>
+#endif
 
 // See http://bjoern.hoehrmann.de/utf-8/decoder/dfa/ for details.
 #define UTF8_ACCEPT 0
@@ -62,6 +68,65 @@ uint32_t DecodeUTF8( uint32_t * state, uint32_t * codep, char byte ) {
 	return DecodeUTF8( state, codep, uint32_t( uint8_t( byte ) ) );
 }
 
+static uint32_t LowestBit( uint32_t x ) {
+#if COMPILER_MSVC
+	unsigned long i;
+	_BitScanForward( &i, x );
+	return i;
+#else
+	return __builtin_ctz( x );
+#endif
+}
+
+size_t DecodeUTF8( Span< const char > str, Span< uint32_t > codepoints, size_t * bytes_read ) {
+	size_t n = 0;
+	size_t i = 0;
+	uint32_t state = UTF8_ACCEPT;
+	uint32_t c = 0;
+
+	while( i < str.n && n < codepoints.n ) {
+		if( state == UTF8_ACCEPT && str.n - i >= 16 && codepoints.n - n >= 16 ) {
+			__m128i bytes = _mm_loadu_si128( ( const __m128i * ) ( str.ptr + i ) );
+			int high_bits = _mm_movemask_epi8( bytes );
+
+			if( high_bits == 0 ) {
+				__m128i zero = _mm_setzero_si128();
+				__m128i lo = _mm_unpacklo_epi8( bytes, zero );
+				__m128i hi = _mm_unpackhi_epi8( bytes, zero );
+				_mm_storeu_si128( ( __m128i * ) ( codepoints.ptr + n + 0 ), _mm_unpacklo_epi16( lo, zero ) );
+				_mm_storeu_si128( ( __m128i * ) ( codepoints.ptr + n + 4 ), _mm_unpackhi_epi16( lo, zero ) );
+				_mm_storeu_si128( ( __m128i * ) ( codepoints.ptr + n + 8 ), _mm_unpacklo_epi16( hi, zero ) );
+				_mm_storeu_si128( ( __m128i * ) ( codepoints.ptr + n + 12 ), _mm_unpackhi_epi16( hi, zero ) );
+				n += 16;
+				i += 16;
+				continue;
+			}
+
+			// copy the ASCII up to the first multibyte sequence
+			uint32_t ascii = LowestBit( uint32_t( high_bits ) );
+			for( uint32_t j = 0; j < ascii; j++ ) {
+				codepoints[ n ] = uint8_t( str[ i ] );
+				n++;
+				i++;
+			}
+		}
+
+		uint32_t decoded = DecodeUTF8( &state, &c, str[ i ] );
+		i++;
+
+		if( decoded == UTF8_ACCEPT ) {
+			codepoints[ n ] = c;
+			n++;
+		}
+		else if( decoded == UTF8_REJECT ) {
+			i = str.n;
+		}
+	}
+
+	*bytes_read = i;
+	return n;
+}
+
 const char * StrChrUTF8( const char * str, uint32_t needle ) {
 	uint32_t state = 0;
 	uint32_t c = 0;
@@ -2,8 +2,18 @@
 
 #include <stdint.h>
 
+#include "qcommon/types.h"
+
 uint32_t DecodeUTF8( uint32_t * state, uint32_t * codep, uint32_t byte );
 uint32_t DecodeUTF8( uint32_t * state, uint32_t * codep, char byte );
 
+/*
+ * decodes as much of str as fits in codepoints, and sets bytes_read to how
+ * far it got so long strings can be decoded a chunk at a time. runs of
+ * ASCII get copied 16 bytes at a time and everything else goes through the
+ * DFA. invalid sequences end the string, like they do with the DFA
+ */
+size_t DecodeUTF8( Span< const char > str, Span< uint32_t > codepoints, size_t * bytes_read );
+
 char * StrChrUTF8( char * p, uint32_t c );
 const char * StrChrUTF8( const char * p, uint32_t c );
@@ -0,0 +1,193 @@
+#if defined( _MSC_VER )
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "qcommon/base.h"
+#include "qcommon/qcommon.h"
+#include "qcommon/fs.h"
+#include "qcommon/string.h"
+#include "qcommon/zone_sampler.h"
+
+/*
+ * every thread gets its own ring the first time it closes a zone, so
+ * writers never share anything. dumping reads the rings while they're
+ * still being written, so it checks the head again afterwards and throws
+ * away anything that could have been overwritten in the meantime
+ */
+
+constexpr u32 ZONE_RING_SIZE = 16384;
+constexpr u32 MAX_ZONE_RINGS = 64;
+STATIC_ASSERT( IsPowerOf2( ZONE_RING_SIZE ) );
+
+struct SampledZoneEntry {
+	const char * name;
+	u64 start, end;
+};
+
+struct ZoneRing {
+	SampledZoneEntry entries[ ZONE_RING_SIZE ];
+	std::atomic< u64 > head;
+};
+
+std::atomic< bool > zone_sampler_enabled;
+
+static std::atomic< ZoneRing * > rings[ MAX_ZONE_RINGS ];
+static std::atomic< u32 > num_rings;
+static thread_local ZoneRing * thread_ring;
+static thread_local bool thread_ring_dropped;
+
+// TSC to Sys_Nanoseconds, sampled at init and again when dumping
+static u64 calibration_tsc;
+static u64 calibration_ns;
+
+static cvar_t * com_zonesampler;
+
+u64 ReadTSC() {
+	return __rdtsc();
+}
+
+static ZoneRing * ThreadRing() {
+	if( thread_ring != NULL || thread_ring_dropped )
+		return thread_ring;
+
+	u32 idx = num_rings.fetch_add( 1 );
+	if( idx >= MAX_ZONE_RINGS ) {
+		thread_ring_dropped = true;
+		return NULL;
+	}
+
+	thread_ring = ALLOC( sys_allocator, ZoneRing );
+	thread_ring->head.store( 0 );
+	rings[ idx ].store( thread_ring );
+
+	return thread_ring;
+}
+
+void FinishSampledZone( const char * name, u64 start ) {
+	ZoneRing * ring = ThreadRing();
+	if( ring == NULL )
+		return;
+
+	u64 head = ring->head.load( std::memory_order_relaxed );
+	SampledZoneEntry * entry = &ring->entries[ head % ZONE_RING_SIZE ];
+	entry->name = name;
+	entry->start = start;
+	entry->end = ReadTSC();
+	ring->head.store( head + 1, std::memory_order_release );
+}
+
+static double TSCToMicroseconds( u64 tsc, double ns_per_tick ) {
+	return ( s64( tsc - calibration_tsc ) * ns_per_tick ) / 1000.0;
+}
+
+static void DumpZones_f() {
+	u64 now_tsc = ReadTSC();
+	u64 now_ns = Sys_Nanoseconds();
+	double ns_per_tick = now_tsc == calibration_tsc ? 0.0 : double( now_ns - calibration_ns ) / double( now_tsc - calibration_tsc );
+
+	DynamicString json( sys_allocator );
+	json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	u64 num_zones = 0;
+	u64 num_torn = 0;
+
+	Span< SampledZoneEntry > copy = ALLOC_SPAN( sys_allocator, SampledZoneEntry, ZONE_RING_SIZE );
+	defer { FREE( sys_allocator, copy.ptr ); };
+
+	u32 n = Min2( num_rings.load(), MAX_ZONE_RINGS );
+	for( u32 i = 0; i < n; i++ ) {
+		ZoneRing * ring = rings[ i ].load();
+		if( ring == NULL )
+			continue;
+
+		u64 head = ring->head.load( std::memory_order_acquire );
+		u64 tail = head > ZONE_RING_SIZE ? head - ZONE_RING_SIZE : 0;
+		for( u64 j = tail; j < head; j++ ) {
+			copy[ j - tail ] = ring->entries[ j % ZONE_RING_SIZE ];
+		}
+
+		// anything below this got written over while we were copying
+		u64 new_head = ring->head.load( std::memory_order_acquire );
+		u64 safe_tail = new_head > ZONE_RING_SIZE ? new_head - ZONE_RING_SIZE : 0;
+
+		json += first ? "{" : ",{";
+		json.append( "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":{},\"args\":", i );
+		json += "{";
+		json.append( "\"name\":\"thread {}\"", i );
+		json += "}}";
+		first = false;
+
+		for( u64 j = tail; j < head; j++ ) {
+			if( j < safe_tail ) {
+				num_torn++;
+				continue;
+			}
+
+			const SampledZoneEntry & entry = copy[ j - tail ];
+			double ts = TSCToMicroseconds( entry.start, ns_per_tick );
+			double dur = TSCToMicroseconds( entry.end, ns_per_tick ) - ts;
+			json += ",{";
+			json.append( "\"name\":\"{}\",\"ph\":\"X\",\"pid\":0,\"tid\":{},\"ts\":{.3},\"dur\":{.3}", entry.name, i, ts, dur );
+			json += "}";
+			num_zones++;
+		}
+	}
+
+	json += "]}";
+
+	u8 arena_memory[ 1024 ];
+	ArenaAllocator arena( arena_memory, sizeof( arena_memory ) );
+	TempAllocator temp = arena.temp();
+
+	char date[ 256 ];
+	Sys_FormatTime( date, sizeof( date ), "%y%m%d_%H%M%S" );
+
+	const char * path = temp( "{}/profiles/zones_{}.json", HomeDirPath(), date );
+	if( !WriteFile( &temp, path, json.c_str(), json.length() ) ) {
+		Com_Printf( S_COLOR_YELLOW "Couldn't write '%s'\n", path );
+		return;
+	}
+
+	Com_Printf( "Wrote %" PRIu64 " zones from %u threads to %s", num_zones, n, path );
+	if( num_torn > 0 ) {
+		Com_Printf( ", dropped %" PRIu64 " that got overwritten while dumping", num_torn );
+	}
+	Com_Printf( "\n" );
+
+	if( !zone_sampler_enabled.load() ) {
+		Com_Printf( "com_zonesampler is off, turn it on to record zones\n" );
+	}
+}
+
+void InitZoneSampler() {
+	calibration_tsc = ReadTSC();
+	calibration_ns = Sys_Nanoseconds();
+
+	com_zonesampler = Cvar_Get( "com_zonesampler", "0", 0 );
+	zone_sampler_enabled.store( com_zonesampler->integer != 0 );
+	com_zonesampler->modified = false;
+
+	Cmd_AddCommand( "dumpzones", DumpZones_f );
+}
+
+void ShutdownZoneSampler() {
+	zone_sampler_enabled.store( false );
+
+	Cmd_RemoveCommand( "dumpzones" );
+
+	u32 n = Min2( num_rings.load(), MAX_ZONE_RINGS );
+	for( u32 i = 0; i < n; i++ ) {
+		FREE( sys_allocator, rings[ i ].exchange( NULL ) );
+	}
+	num_rings.store( 0 );
+	thread_ring = NULL;
+}
+
+void ZoneSamplerFrame() {
+	if( com_zonesampler->modified ) {
+		zone_sampler_enabled.store( com_zonesampler->integer != 0 );
+		com_zonesampler->modified = false;
+	}
+}
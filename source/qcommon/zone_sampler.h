@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+
+#include "qcommon/types.h"
+
+/*
+ * Tracy gets compiled out of release builds, so a handful of coarse zones
+ * also go through this. while com_zonesampler is on, each zone stamps the
+ * TSC when it opens and closes and writes one entry into its thread's ring
+ * buffer, and dumpzones writes the rings to <home>/profiles as a Chrome
+ * trace that chrome://tracing or ui.perfetto.dev can open
+ *
+ * when it's off a zone costs one relaxed load. it's meant for frame level
+ * zones, not per entity or per draw call ones
+ */
+
+extern std::atomic< bool > zone_sampler_enabled;
+
+u64 ReadTSC();
+void FinishSampledZone( const char * name, u64 start );
+
+struct SampledZone {
+	const char * name;
+	u64 start;
+
+	SampledZone( const char * name_ ) {
+		name = name_;
+		start = zone_sampler_enabled.load( std::memory_order_relaxed ) ? ReadTSC() : 0;
+	}
+
+	~SampledZone() {
+		if( start != 0 ) {
+			FinishSampledZone( name, start );
+		}
+	}
+};
+
+#define ZoneScopedSampled( name ) ZoneScopedN( name ); SampledZone COUNTER_NAME( sampled_zone_ )( name )
+
+void InitZoneSampler();
+void ShutdownZoneSampler();
+
+// picks up changes to com_zonesampler
+void ZoneSamplerFrame();
@@ -7,5 +7,7 @@ void CL_Disconnect( const char * message ) { }
 
 void Con_Print( const char * text ) { }
 
+const CollisionModel * CL_FindMapCollisionModel( u64 base_hash ) { return NULL; }
+
 void Key_Init() { }
 void Key_Shutdown() { }
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "qcommon/qcommon.h"
+#include "qcommon/bitset.h"
 #include "qcommon/rng.h"
 #include "game/g_local.h"
 
@@ -35,9 +36,12 @@
 // initializing (precache commands, static sounds / objects, etc)
 
 struct client_t;
+struct DemoWriter;
 struct ginfo_t {
 	edict_t *edicts;
 	client_t *clients;
+	const EdictHotComponents *hot;
+	const SnapEvents *events;
 
 	int num_edicts;         // current number, <= max_edicts
 	int max_edicts;
@@ -53,7 +57,7 @@ struct server_t {
 	char mapname[MAX_CONFIGSTRING_CHARS];               // map name
 
 	char configstrings[MAX_CONFIGSTRINGS][MAX_CONFIGSTRING_CHARS];
-	SyncEntityState baselines[MAX_EDICTS];
+	SyncEntityState baselines[MAX_BASELINES];
 
 	//
 	// global variables shared between game and server
@@ -68,15 +72,20 @@ struct client_snapshot_t {
 	bool allentities;
 	bool multipov;
 	int numareas;
-	uint8_t *areabits;                  // portalarea visibility bits
+	u64 *areabits;                      // portalarea visibility bits
 	int numplayers;
 	int ps_size;
 	SyncPlayerState *ps;                 // [numplayers]
 	int num_entities;
 	int first_entity;                   // into the circular sv.client_entities[]
+	int num_events;
+	int events_size;
+	SyncSnapEvent *events;              // [num_events], the game's events that passed culling
 	int64_t sentTimeStamp;         // time at what this frame snap was sent to the clients
 	unsigned int UcmdExecuted;
 	SyncGameState gameState;
+	uint8_t deferred[MAX_EDICTS / 8];   // entities holding an older state because we were over budget
+	u64 entitiesHash;                   // frame number + visible entity list, 0 if deferred entities make it private
 };
 
 struct game_command_t {
@@ -105,6 +114,11 @@ struct client_t {
 	int64_t reliableAcknowledge;   // last acknowledged reliable message
 	int64_t reliableSent;          // last sent reliable message, not necesarily acknowledged yet
 
+	// configstring blocks SV_Configstrings_f still has to send. clients that
+	// kept configstrings from before get empty ones too, to clear theirs
+	BitSet< NUM_CONFIGSTRING_BLOCKS > stale_configstrings;
+	bool configstrings_delta;
+
 	game_command_t gameCommands[MAX_RELIABLE_COMMANDS];
 	int64_t gameCommandCurrent;             // position in the gameCommands table
 
@@ -132,6 +146,11 @@ struct client_t {
 
 	client_snapshot_t snapShots[UPDATE_BACKUP]; // updates can be delta'd from here
 
+	// adaptive snapshot rate
+	int snapshotInterval;           // in server frames, 0 means every frame
+	int64_t nextSnapshotFrame;
+	uint8_t entityDeferredFrames[MAX_EDICTS]; // how long each entity has been held back
+
 	int challenge;                  // challenge of this user, randomly generated
 
 	netchan_t netchan;
@@ -170,6 +189,9 @@ struct server_static_demo_t {
 	client_t client;                // special client for writing the messages
 	char meta_data[SNAP_MAX_DEMO_META_DATA_SIZE];
 	size_t meta_data_realsize;
+	DemoWriter *writer;
+	DemoKeyframe keyframes[SNAP_MAX_DEMO_KEYFRAMES];
+	int num_keyframes;
 };
 
 struct client_entities_t {
@@ -183,7 +205,7 @@ struct server_static_t {
 	int64_t realtime;               // real world time - always increasing, no clamping, etc
 	int64_t gametime;               // game world time - always increasing, no clamping, etc
 
-	ArenaAllocator frame_arena;
+	FrameArena frame_arena;
 
 	RNG rng;
 
@@ -247,6 +269,15 @@ extern cvar_t *sv_debug_serverCmd;
 
 extern cvar_t *sv_demodir;
 
+extern cvar_t *sv_parallel_snapshots;
+extern cvar_t *sv_adaptive_snapshots;
+extern cvar_t *sv_pipelined_snapshots;
+
+extern cvar_t *sv_hibernate;
+
+extern cvar_t *sv_fps;
+extern cvar_t *sv_pps;
+
 //===========================================================
 
 //
@@ -259,6 +290,7 @@ void SV_ShutdownOperatorCommands();
 
 void SV_SendServerinfo( client_t *client );
 void SV_UserinfoChanged( client_t *cl );
+void SV_UpdateFrameTimes();
 
 void SV_MasterHeartbeat();
 
@@ -291,6 +323,13 @@ bool SV_SendClientsFragments();
 void SV_InitClientMessage( client_t *client, msg_t *msg, uint8_t *data, size_t size );
 bool SV_SendMessageToClient( client_t *client, msg_t *msg );
 void SV_ResetClientFrameCounters();
+void SV_LockNetchans();
+void SV_UnlockNetchans();
+
+void SV_InitSnapshotPipeline();
+void SV_ShutdownSnapshotPipeline();
+void SV_WaitForPipelinedSnapshots();
+bool SV_PipelinedSnapshotsEnabled();
 
 enum redirect_t {
 	RD_NONE,
@@ -319,6 +358,8 @@ void SV_BroadcastCommand( _Printf_format_string_ const char *format, ... );
 // sv_client.c
 //
 void SV_ParseClientMessage( client_t *client, msg_t *msg );
+void SV_ClearClientSessions();
+client_t * SV_FindClientBySession( u64 session_id );
 bool SV_ClientConnect( const socket_t *socket, const netadr_t *address, client_t *client, char *userinfo,
 	u64 session_id, int challenge, bool fakeClient );
 
@@ -355,7 +396,7 @@ int PF_GetClientState( int numClient );
 void PF_GameCmd( edict_t *ent, const char *cmd );
 void PF_ConfigString( int index, const char *val );
 const char *PF_GetConfigString( int index );
-void SV_LocateEntities( edict_t *edicts, int num_edicts, int max_edicts );
+void SV_LocateEntities( edict_t *edicts, const EdictHotComponents *hot, const SnapEvents *events, int num_edicts, int max_edicts );
 
 //
 // sv_demos.c
@@ -382,14 +423,56 @@ bool SV_Web_Running();
 bool SV_Web_AddGameClient( const char *session, int clientNum, const netadr_t *netAdr );
 void SV_Web_RemoveGameClient( const char *session );
 
+//
+// sv_stats.c
+//
+enum ServerStatsPhase {
+	ServerStatsPhase_ReadPackets,
+	ServerStatsPhase_GameFrame,
+	ServerStatsPhase_AngelScript,
+	ServerStatsPhase_Snapshots,
+	ServerStatsPhase_Send,
+	ServerStatsPhase_Tick,
+	ServerStatsPhase_WakeLate,
+
+	ServerStatsPhase_Count
+};
+
+void SV_Stats_Init();
+void SV_Stats_Shutdown();
+void SV_Stats_BeginTick();
+void SV_Stats_EndTick();
+void SV_Stats_AddTime( ServerStatsPhase phase, u64 usec );
+void SV_Stats_AddIdleTime( u64 usec );
+char * SV_Stats_CopyJSON( Allocator * a, size_t * length );
+void SV_Stats_f();
+
 //
 // snap_write
 //
-void SNAP_WriteFrameSnapToClient( ginfo_t *gi, client_t *client, msg_t *msg, int64_t frameNum, int64_t gameTime,
-	SyncEntityState *baselines, client_entities_t *client_entities );
+#define MAX_SNAPSHOT_ENTITIES   1024
+struct snapshotEntityNumbers_t {
+	int numSnapshotEntities;
+	int snapshotEntities[MAX_SNAPSHOT_ENTITIES];
+	BitSet< MAX_EDICTS > entityAddedToSnapList;
+};
+
+int SNAP_WriteFrameSnapToClient( ginfo_t *gi, client_t *client, msg_t *msg, int64_t frameNum, int64_t gameTime,
+	SyncEntityState *baselines, client_entities_t *client_entities, size_t budget );
+int64_t SNAP_WriteFrameSnapHeaderToClient( ginfo_t *gi, client_t *client, msg_t *msg, int64_t frameNum, int64_t gameTime,
+	client_snapshot_t **oldframe );
+int SNAP_WriteFrameSnapBodyToClient( client_t *client, client_snapshot_t *oldframe, int64_t from_frame, int64_t frameNum, msg_t *msg,
+	SyncEntityState *baselines, client_entities_t *client_entities, size_t budget );
 
 void SNAP_BuildClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameNum, int64_t timeStamp,
 	client_t *client,
 	SyncGameState *gameState, client_entities_t *client_entities,
 	mempool_t *mempool );
+bool SNAP_BeginClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameNum, int64_t timeStamp,
+	client_t *client, SyncGameState *gameState, mempool_t *mempool );
+void SNAP_CullClientFrameSnap( CollisionModel *cms, ginfo_t *gi, int64_t frameNum, client_t *client, snapshotEntityNumbers_t *entsList );
+void SNAP_FinishClientFrameSnap( int64_t frameNum, client_t *client, const snapshotEntityNumbers_t *entsList, client_entities_t *client_entities );
 void SNAP_FreeClientFrames( client_t * client );
+void SNAP_InitDeltaCache();
+void SNAP_ShutdownDeltaCache();
+void SNAP_ClearDeltaCache();
@@ -229,6 +229,7 @@ void SV_InitOperatorCommands() {
 	Cmd_AddCommand( "status", SV_Status_f );
 	Cmd_AddCommand( "serverinfo", SV_Serverinfo_f );
 	Cmd_AddCommand( "dumpuser", SV_DumpUser_f );
+	Cmd_AddCommand( "serverstats", SV_Stats_f );
 
 	Cmd_AddCommand( "map", SV_Map_f );
 	Cmd_AddCommand( "devmap", SV_Map_f );
@@ -256,6 +257,7 @@ void SV_ShutdownOperatorCommands() {
 	Cmd_RemoveCommand( "status" );
 	Cmd_RemoveCommand( "serverinfo" );
 	Cmd_RemoveCommand( "dumpuser" );
+	Cmd_RemoveCommand( "serverstats" );
 
 	Cmd_RemoveCommand( "map" );
 	Cmd_RemoveCommand( "devmap" );
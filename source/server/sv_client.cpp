@@ -20,6 +20,53 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "server/server.h"
 #include "qcommon/version.h"
+#include "qcommon/hash.h"
+#include "qcommon/hashtable.h"
+#include "qcommon/string.h"
+
+// session_id -> index into svs.clients, for dispatching sequenced packets
+static Hashtable< MAX_CLIENTS * 2 > client_sessions;
+
+static u64 SessionKey( u64 session_id ) {
+	// Hashtable reserves 0 and the top bit
+	return ( Hash64( session_id ) >> 1 ) | 1;
+}
+
+static void SV_RemoveClientSession( const client_t * client ) {
+	u64 idx;
+	u64 key = SessionKey( client->netchan.session_id );
+	if( client_sessions.get( key, &idx ) && idx == u64( client - svs.clients ) ) {
+		client_sessions.remove( key );
+	}
+}
+
+void SV_ClearClientSessions() {
+	client_sessions.clear();
+}
+
+/*
+* SV_FindClientBySession
+*/
+client_t * SV_FindClientBySession( u64 session_id ) {
+	u64 idx;
+	if( svs.clients == NULL || !client_sessions.get( SessionKey( session_id ), &idx ) ) {
+		return NULL;
+	}
+
+	if( idx >= u64( sv_maxclients->integer ) ) {
+		return NULL;
+	}
+
+	client_t * cl = &svs.clients[ idx ];
+	if( cl->state == CS_FREE || cl->state == CS_ZOMBIE ) {
+		return NULL;
+	}
+	if( cl->edict && ( cl->edict->r.svflags & SVF_FAKECLIENT ) ) {
+		return NULL;
+	}
+
+	return cl->netchan.session_id == session_id ? cl : NULL;
+}
 
 //============================================================================
 //
@@ -28,6 +75,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //============================================================================
 
 void SV_ClientResetCommandBuffers( client_t *client ) {
+	SV_WaitForPipelinedSnapshots();
+
 	// reset the reliable commands buffer
 	client->clientCommandExecuted = 0;
 	client->reliableAcknowledge = 0;
@@ -44,6 +93,8 @@ void SV_ClientResetCommandBuffers( client_t *client ) {
 	// reset snapshots delta-compression
 	client->lastframe = -1;
 	client->lastSentFrameNum = 0;
+	client->nextSnapshotFrame = 0;
+	memset( client->entityDeferredFrames, 0, sizeof( client->entityDeferredFrames ) );
 }
 
 /*
@@ -66,6 +117,9 @@ bool SV_ClientConnect( const socket_t *socket, const netadr_t *address, client_t
 
 
 	// the connection is accepted, set up the client slot
+	if( client->state != CS_FREE ) {
+		SV_RemoveClientSession( client );
+	}
 	memset( client, 0, sizeof( *client ) );
 	client->edict = ent;
 	client->challenge = challenge; // save challenge for checksumming
@@ -104,6 +158,12 @@ bool SV_ClientConnect( const socket_t *socket, const netadr_t *address, client_t
 		} else {
 			Netchan_Setup( &client->netchan, socket, address, session_id );
 		}
+
+		u64 key = SessionKey( session_id );
+		u64 idx = client - svs.clients;
+		if( !client_sessions.add( key, idx ) ) {
+			client_sessions.update( key, idx );
+		}
 	}
 
 	// parse some info from the info strings
@@ -135,6 +195,8 @@ void SV_DropClient( client_t *drop, int type, const char *format, ... ) {
 	char *reason;
 	char string[1024];
 
+	SV_WaitForPipelinedSnapshots();
+
 	if( format ) {
 		va_start( argptr, format );
 		vsnprintf( string, sizeof( string ), format, argptr );
@@ -169,6 +231,10 @@ void SV_DropClient( client_t *drop, int type, const char *format, ... ) {
 
 	SNAP_FreeClientFrames( drop );
 
+	if( !( drop->edict && ( drop->edict->r.svflags & SVF_FAKECLIENT ) ) ) {
+		SV_RemoveClientSession( drop );
+	}
+
 	SV_Web_RemoveGameClient( drop->session );
 
 	if( drop->individual_socket ) {
@@ -240,6 +306,30 @@ static void SV_New_f( client_t *client ) {
 	client->state = CS_CONNECTING;
 }
 
+/*
+* SV_FindStaleConfigstrings
+*
+* Compares the block hashes a reconnecting client sent with ours. Clients
+* with nothing from before send no hashes and get everything.
+*/
+static void SV_FindStaleConfigstrings( client_t *client, const char *hashes ) {
+	client->stale_configstrings.clear();
+	client->configstrings_delta = strlen( hashes ) == NUM_CONFIGSTRING_BLOCKS * 16;
+
+	int stale = 0;
+	for( size_t i = 0; i < NUM_CONFIGSTRING_BLOCKS; i++ ) {
+		String< 17 > hash( "{016x}", ConfigstringBlockHash( sv.configstrings, i ) );
+		if( !client->configstrings_delta || strncmp( hashes + i * 16, hash.c_str(), 16 ) != 0 ) {
+			client->stale_configstrings.set( i );
+			stale++;
+		}
+	}
+
+	if( client->configstrings_delta ) {
+		Com_DPrintf( "%s needs %i of %i configstring blocks\n", client->name, stale, NUM_CONFIGSTRING_BLOCKS );
+	}
+}
+
 /*
 * SV_Configstrings_f
 */
@@ -270,10 +360,19 @@ static void SV_Configstrings_f( client_t *client ) {
 		start = 0;
 	}
 
+	if( start == 0 ) {
+		SV_FindStaleConfigstrings( client, Cmd_Argv( 3 ) );
+	}
+
 	// write a packet full of data
 	while( start < MAX_CONFIGSTRINGS &&
 		   client->reliableSequence - client->reliableAcknowledge < MAX_RELIABLE_COMMANDS - 8 ) {
-		if( sv.configstrings[start][0] ) {
+		if( !client->stale_configstrings.test( start / CONFIGSTRING_BLOCK_SIZE ) ) {
+			start = Min2( ( start / CONFIGSTRING_BLOCK_SIZE + 1 ) * CONFIGSTRING_BLOCK_SIZE, MAX_CONFIGSTRINGS );
+			continue;
+		}
+
+		if( sv.configstrings[start][0] || client->configstrings_delta ) {
 			SV_SendServerCommand( client, "cs %i \"%s\"", start, sv.configstrings[start] );
 		}
 		start++;
@@ -319,7 +418,7 @@ static void SV_Baselines_f( client_t *client ) {
 	// write a packet full of data
 	SV_InitClientMessage( client, &tmpMessage, NULL, 0 );
 
-	while( tmpMessage.cursize < FRAGMENT_SIZE * 3 && start < MAX_EDICTS ) {
+	while( tmpMessage.cursize < FRAGMENT_SIZE * 3 && start < MAX_BASELINES ) {
 		base = &sv.baselines[start];
 		if( base->number != 0 ) {
 			MSG_WriteUint8( &tmpMessage, svc_spawnbaseline );
@@ -329,7 +428,7 @@ static void SV_Baselines_f( client_t *client ) {
 	}
 
 	// send next command
-	if( start == MAX_EDICTS ) {
+	if( start == MAX_BASELINES ) {
 		SV_SendServerCommand( client, "precache %i \"%s\"", svs.spawncount, sv.mapname );
 	} else {
 		SV_SendServerCommand( client, "cmd baselines %i %i", svs.spawncount, start );
@@ -573,17 +672,24 @@ static void SV_ParseMoveCommand( client_t *client, msg_t *msg ) {
 	}
 
 	ucmdFirst = ucmdHead > ucmdCount ? ucmdHead - ucmdCount : 0;
+
+	// clients resend ucmds we may already have to cover for packet loss.
+	// those still have to be read to get through the delta chain, but
+	// they go in a scratch cmd so the copy we already have stays put
+	unsigned int alreadyReceived = client->UcmdReceived;
 	client->UcmdReceived = ucmdHead < 1 ? 0 : ucmdHead - 1;
 
 	// read the user commands
+	memset( &nullcmd, 0, sizeof( nullcmd ) );
+	UserCommand scratch[ 2 ];
+	const UserCommand * base = &nullcmd; // first one isn't delta compressed
 	for( i = ucmdFirst; i < ucmdHead; i++ ) {
-		if( i == ucmdFirst ) { // first one isn't delta compressed
-			memset( &nullcmd, 0, sizeof( nullcmd ) );
-			// jalfixme: check for too old overflood
-			MSG_ReadDeltaUsercmd( msg, &nullcmd, &client->ucmds[i & CMD_MASK] );
-		} else {
-			MSG_ReadDeltaUsercmd( msg, &client->ucmds[( i - 1 ) & CMD_MASK], &client->ucmds[i & CMD_MASK] );
-		}
+		bool duplicate = alreadyReceived > 0 && i <= alreadyReceived;
+		UserCommand * cmd = duplicate ? &scratch[ i & 1 ] : &client->ucmds[i & CMD_MASK];
+
+		// jalfixme: check for too old overflood
+		MSG_ReadDeltaUsercmd( msg, base, cmd );
+		base = cmd;
 	}
 
 	if( client->state != CS_SPAWNED ) {
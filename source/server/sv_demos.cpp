@@ -25,25 +25,34 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "server/server.h"
 #include "qcommon/array.h"
+#include "qcommon/async_io.h"
+#include "qcommon/demo_writer.h"
 #include "qcommon/fs.h"
+#include "qcommon/glob.h"
 #include "qcommon/string.h"
 
 #define SV_DEMO_DIR va( "demos/server%s%s", sv_demodir->string[0] ? "/" : "", sv_demodir->string[0] ? sv_demodir->string : "" )
 
 static void SV_Demo_WriteMessage( msg_t *msg ) {
-	assert( svs.demo.file );
-	if( !svs.demo.file ) {
+	assert( svs.demo.writer != NULL );
+	if( svs.demo.writer == NULL ) {
 		return;
 	}
 
-	SNAP_RecordDemoMessage( svs.demo.file, msg, 0 );
+	DemoWriterMessage( svs.demo.writer, msg );
+}
+
+static void SV_Demo_WriteGamestateMessage( void *user, msg_t *msg ) {
+	SV_Demo_WriteMessage( msg );
 }
 
 static void SV_Demo_WriteStartMessages() {
 	// clear demo meta data, we'll write some keys later
 	svs.demo.meta_data_realsize = SNAP_ClearDemoMeta( svs.demo.meta_data, sizeof( svs.demo.meta_data ) );
+	svs.demo.num_keyframes = 0;
 
-	SNAP_BeginDemoRecording( svs.demo.file, svs.spawncount, svc.snapFrameTime, sv.configstrings[0], sv.baselines );
+	// the meta data goes at the end, so no svc_demoinfo up front
+	SNAP_WriteDemoGamestate( SV_Demo_WriteGamestateMessage, NULL, svs.spawncount, svc.snapFrameTime, sv.configstrings[0], sv.baselines );
 }
 
 void SV_Demo_WriteSnap() {
@@ -71,6 +80,25 @@ void SV_Demo_WriteSnap() {
 
 	MSG_Init( &msg, msg_buffer, sizeof( msg_buffer ) );
 
+	// every so often write out everything playback needs to start from here
+	bool keyframe = svs.demo.num_keyframes < SNAP_MAX_DEMO_KEYFRAMES && ( svs.demo.num_keyframes == 0 ||
+		svs.gametime >= svs.demo.keyframes[svs.demo.num_keyframes - 1].server_time + SNAP_DEMO_KEYFRAME_INTERVAL );
+	if( keyframe ) {
+		DemoKeyframe *kf = &svs.demo.keyframes[svs.demo.num_keyframes++];
+		kf->server_time = svs.gametime;
+		kf->reliable_sequence = svs.demo.client.reliableSent;
+		kf->offset = DemoWriterKeyframe( svs.demo.writer );
+
+		for( int cs = 0; cs < MAX_CONFIGSTRINGS; ) {
+			cs = SNAP_WriteDemoConfigstrings( &msg, sv.configstrings[0], cs );
+			SV_Demo_WriteMessage( &msg );
+			MSG_Clear( &msg );
+		}
+
+		svs.demo.client.nodelta = true;
+		svs.demo.client.nodelta_frame = 0;
+	}
+
 	SV_BuildClientFrameSnap( &svs.demo.client );
 
 	SV_WriteFrameSnapToClient( &svs.demo.client, &msg );
@@ -79,6 +107,10 @@ void SV_Demo_WriteSnap() {
 
 	SV_Demo_WriteMessage( &msg );
 
+	if( keyframe ) {
+		svs.demo.client.nodelta = false;
+	}
+
 	svs.demo.duration = svs.gametime - svs.demo.basetime;
 	svs.demo.client.lastframe = sv.framenum; // FIXME: is this needed?
 }
@@ -154,7 +186,7 @@ void SV_Demo_Start_f() {
 	snprintf( svs.demo.tempname, demofilename_size, "%s.rec", svs.demo.filename );
 
 	// open it
-	if( FS_FOpenBaseFile( svs.demo.tempname, &svs.demo.file, FS_WRITE | SNAP_DEMO_GZ ) == -1 ) {
+	if( FS_FOpenBaseFile( svs.demo.tempname, &svs.demo.file, FS_WRITE ) == -1 ) {
 		Com_Printf( "Error: Couldn't open file: %s\n", svs.demo.tempname );
 		Mem_ZoneFree( svs.demo.filename );
 		svs.demo.filename = NULL;
@@ -165,6 +197,8 @@ void SV_Demo_Start_f() {
 
 	Com_Printf( "Recording server demo: %s\n", svs.demo.filename );
 
+	svs.demo.writer = NewDemoWriter( svs.demo.file );
+
 	SV_Demo_InitClient();
 
 	// write serverdata, configstrings and baselines
@@ -173,10 +207,8 @@ void SV_Demo_Start_f() {
 	svs.demo.localtime = time( NULL );
 	SV_Demo_WriteStartMessages();
 
-	// write one nodelta frame
-	svs.demo.client.nodelta = true;
+	// the first frame is always a keyframe
 	SV_Demo_WriteSnap();
-	svs.demo.client.nodelta = false;
 }
 
 static void SV_Demo_Stop( bool cancel, bool silent ) {
@@ -188,13 +220,25 @@ static void SV_Demo_Stop( bool cancel, bool silent ) {
 	}
 
 	if( cancel ) {
+		DeleteDemoWriter( svs.demo.writer );
+		AsyncIOFlush();
+
 		Com_Printf( "Canceled server demo recording: %s\n", svs.demo.filename );
 	} else {
-		SNAP_StopDemoRecording( svs.demo.file );
+		// write some meta information about the match/demo
+		SV_SetDemoMetaKeyValue( "hostname", sv.configstrings[CS_HOSTNAME] );
+		SV_SetDemoMetaKeyValue( "localtime", va( "%" PRIi64, (int64_t)svs.demo.localtime ) );
+		SV_SetDemoMetaKeyValue( "multipov", "1" );
+		SV_SetDemoMetaKeyValue( "duration", va( "%u", (int)ceilf( (double)svs.demo.duration / 1000.0 ) ) );
+		SV_SetDemoMetaKeyValue( "mapname", sv.mapname );
+		SV_SetDemoMetaKeyValue( "matchscore", sv.configstrings[CS_MATCHSCORE] );
+
+		CloseDemoWriter( svs.demo.writer, svs.demo.meta_data, svs.demo.meta_data_realsize, svs.demo.keyframes, svs.demo.num_keyframes );
 
 		Com_Printf( "Stopped server demo recording: %s\n", svs.demo.filename );
 	}
 
+	svs.demo.writer = NULL;
 	FS_FCloseFile( svs.demo.file );
 	svs.demo.file = 0;
 
@@ -203,16 +247,6 @@ static void SV_Demo_Stop( bool cancel, bool silent ) {
 			Com_Printf( "Error: Failed to delete the temporary server demo file\n" );
 		}
 	} else {
-		// write some meta information about the match/demo
-		SV_SetDemoMetaKeyValue( "hostname", sv.configstrings[CS_HOSTNAME] );
-		SV_SetDemoMetaKeyValue( "localtime", va( "%" PRIi64, (int64_t)svs.demo.localtime ) );
-		SV_SetDemoMetaKeyValue( "multipov", "1" );
-		SV_SetDemoMetaKeyValue( "duration", va( "%u", (int)ceilf( (double)svs.demo.duration / 1000.0 ) ) );
-		SV_SetDemoMetaKeyValue( "mapname", sv.mapname );
-		SV_SetDemoMetaKeyValue( "matchscore", sv.configstrings[CS_MATCHSCORE] );
-
-		SNAP_WriteDemoMetaData( svs.demo.tempname, svs.demo.meta_data, svs.demo.meta_data_realsize );
-
 		TempAllocator temp = svs.frame_arena.temp();
 		if( !MoveFile( &temp, svs.demo.tempname, svs.demo.filename, MoveFile_DoReplace ) ) {
 			Com_Printf( "Error: Failed to rename the server demo file\n" );
@@ -313,12 +347,24 @@ void SV_DemoList_f( client_t *client ) {
 		}
 	};
 
+	// demolist [pattern], numbered the same as the unfiltered list so demoget still works
+	Span< size_t > matches = ALLOC_SPAN( &temp, size_t, demos.size() );
+	if( Cmd_Argc() >= 2 ) {
+		GlobPattern pattern = CompileGlob( Cmd_Argv( 1 ), false );
+		matches.n = GlobMatchMany( pattern, Span< const char * const >( demos.begin(), demos.size() ), matches.ptr );
+	}
+	else {
+		for( size_t i = 0; i < demos.size(); i++ ) {
+			matches[ i ] = i;
+		}
+	}
+
 	DynamicString output( &temp, "pr \"Available demos:\n" );
 
-	size_t start = demos.size() - Min2( demos.size(), size_t( 10 ) );
+	size_t start = matches.n - Min2( matches.n, size_t( 10 ) );
 
-	for( size_t i = start; i < demos.size(); i++ ) {
-		output.append( "{}: {}\n", i + 1, demos[ i ] );
+	for( size_t i = start; i < matches.n; i++ ) {
+		output.append( "{}: {}\n", matches[ i ] + 1, demos[ matches[ i ] ] );
 	}
 
 	output += "\"";
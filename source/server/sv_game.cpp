@@ -122,8 +122,10 @@ void SV_ShutdownGameProgs() {
 	G_Shutdown();
 }
 
-void SV_LocateEntities( edict_t *edicts, int num_edicts, int max_edicts ) {
+void SV_LocateEntities( edict_t *edicts, const EdictHotComponents *hot, const SnapEvents *events, int num_edicts, int max_edicts ) {
 	sv.gi.edicts = edicts;
+	sv.gi.hot = hot;
+	sv.gi.events = events;
 	sv.gi.clients = svs.clients;
 	sv.gi.num_edicts = num_edicts;
 	sv.gi.max_edicts = max_edicts;
@@ -22,6 +22,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qcommon/cmodel.h"
 #include "qcommon/csprng.h"
 #include "qcommon/hash.h"
+#include "qcommon/load_profile.h"
+#include "qcommon/memory_budget.h"
+#include "qcommon/string.h"
 
 server_constant_t svc;              // constant server info (trully persistant since sv_init)
 server_static_t svs;                // persistant server info
@@ -32,7 +35,8 @@ server_t sv;                 // local server
 *
 * Entity baselines are used to compress the update messages
 * to the clients -- only the fields that differ from the
-* baseline will be transmitted
+* baseline will be transmitted. Entities spawned later, like
+* projectiles, use the class baselines that come after them
 */
 static void SV_CreateBaseline() {
 	for( int entnum = 1; entnum < sv.gi.num_edicts; entnum++ ) {
@@ -43,6 +47,12 @@ static void SV_CreateBaseline() {
 
 		sv.baselines[entnum] = svent->s;
 	}
+
+	Span< SyncEntityState > class_baselines( sv.baselines + MAX_EDICTS, MAX_CLASS_BASELINES );
+	size_t num_class_baselines = G_ClassBaselines( class_baselines );
+	for( size_t i = 0; i < num_class_baselines; i++ ) {
+		class_baselines[ i ].number = int( MAX_EDICTS + i );
+	}
 }
 
 /*
@@ -58,6 +68,11 @@ void SV_SetServerConfigStrings() {
 * Change the server to a new map, taking all connected clients along with it.
 */
 static void SV_SpawnServer( const char *mapname, bool devmap ) {
+	String< 64 > profile_name( "map_{}", mapname );
+	LoadProfileScope profile( profile_name.c_str() );
+
+	SV_WaitForPipelinedSnapshots();
+
 	if( devmap ) {
 		Cvar_ForceSet( "sv_cheats", "1" );
 	}
@@ -109,6 +124,25 @@ static void SV_SpawnServer( const char *mapname, bool devmap ) {
 	Com_SetServerState( sv.state );
 }
 
+/*
+* SV_MemoryBudget
+*
+* each client gets its own share of client_entities, so they both only get
+* used as much as the server fills up
+*/
+static void SV_MemoryBudget( MemoryBudget * budget ) {
+	size_t maxclients = sv_maxclients->integer;
+	size_t connected = 0;
+	for( size_t i = 0; i < maxclients; i++ ) {
+		if( svs.clients[ i ].state != CS_FREE ) {
+			connected++;
+		}
+	}
+
+	budget->add_array( "svs.clients", sizeof( client_t ) * maxclients, connected, maxclients, true );
+	budget->add_array( "svs.client_entities", sizeof( SyncEntityState ) * svs.client_entities.num_entities, connected, maxclients, true );
+}
+
 /*
 * SV_InitGame
 * A brand new game has been started
@@ -145,10 +179,15 @@ void SV_InitGame() {
 		Cvar_FullSet( "sv_maxclients", va( "%i", MAX_CLIENTS ), CVAR_SERVERINFO | CVAR_LATCH, true );
 	}
 
+	// sv_fps and sv_pps are latched too
+	SV_UpdateFrameTimes();
+
 	svs.spawncount = RandomUniform( &svs.rng, 0, S16_MAX );
 	svs.clients = ( client_t * ) Mem_Alloc( sv_mempool, sizeof( client_t ) * sv_maxclients->integer );
+	SV_ClearClientSessions();
 	svs.client_entities.num_entities = sv_maxclients->integer * UPDATE_BACKUP * MAX_SNAP_ENTITIES;
 	svs.client_entities.entities = ( SyncEntityState * ) Mem_Alloc( sv_mempool, sizeof( SyncEntityState ) * svs.client_entities.num_entities );
+	AddMemoryBudget( "server", SV_MemoryBudget );
 
 	// init network stuff
 
@@ -242,6 +281,10 @@ void SV_ShutdownGame( const char *finalmsg, bool reconnect ) {
 		return;
 	}
 
+	SV_WaitForPipelinedSnapshots();
+
+	RemoveMemoryBudget( "server" );
+
 	if( svs.demo.file ) {
 		SV_Demo_Stop_f();
 	}
@@ -262,6 +305,7 @@ void SV_ShutdownGame( const char *finalmsg, bool reconnect ) {
 	if( svs.clients ) {
 		Mem_Free( svs.clients );
 		svs.clients = NULL;
+		SV_ClearClientSessions();
 	}
 
 	if( svs.client_entities.entities ) {
@@ -269,10 +313,7 @@ void SV_ShutdownGame( const char *finalmsg, bool reconnect ) {
 		memset( &svs.client_entities, 0, sizeof( svs.client_entities ) );
 	}
 
-	if( svs.cms ) {
-		CM_Free( CM_Server, svs.cms );
-		svs.cms = NULL;
-	}
+	G_FreeCachedMaps();
 
 	Com_SetServerState( ss_dead );
 	svs.initialized = false;
@@ -315,6 +356,7 @@ void SV_Map( const char * map, bool devmap ) {
 		}
 
 		svs.clients[i].lastframe = -1;
+		svs.clients[i].nextSnapshotFrame = 0;
 		memset( svs.clients[i].gameCommands, 0, sizeof( svs.clients[i].gameCommands ) );
 	}
 
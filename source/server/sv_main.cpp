@@ -19,8 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server/server.h"
+#include "qcommon/threadpool.h"
 #include "qcommon/version.h"
 #include "qcommon/csprng.h"
+#include "qcommon/zone_sampler.h"
 
 static bool sv_initialized = false;
 
@@ -58,6 +60,15 @@ cvar_t *sv_debug_serverCmd;
 
 cvar_t *sv_demodir;
 
+cvar_t *sv_parallel_snapshots;
+cvar_t *sv_adaptive_snapshots;
+cvar_t *sv_pipelined_snapshots;
+
+cvar_t *sv_hibernate;
+
+cvar_t *sv_fps;
+cvar_t *sv_pps;
+
 //============================================================================
 
 /*
@@ -109,6 +120,9 @@ static void SV_CalcPings() {
 * SV_ProcessPacket
 */
 static bool SV_ProcessPacket( netchan_t *netchan, msg_t *msg ) {
+	SV_LockNetchans();
+	defer { SV_UnlockNetchans(); };
+
 	if( !Netchan_Process( netchan, msg ) ) {
 		return false; // wasn't accepted for some reason
 	}
@@ -119,7 +133,7 @@ static bool SV_ProcessPacket( netchan_t *netchan, msg_t *msg ) {
 	MSG_ReadInt32( msg ); // sequence_ack
 	MSG_ReadUint64( msg ); // session_id
 	if( msg->compressed ) {
-		int zerror = Netchan_DecompressMessage( msg );
+		int zerror = Netchan_DecompressMessage( netchan, msg );
 		if( zerror < 0 ) {
 			// compression error. Drop the packet
 			Com_DPrintf( "SV_ProcessPacket: Compression error %i. Dropping packet\n", zerror );
@@ -136,8 +150,10 @@ static bool SV_ProcessPacket( netchan_t *netchan, msg_t *msg ) {
 static void SV_ReadPackets() {
 	ZoneScoped;
 
-	static msg_t msg;
-	static uint8_t msgData[MAX_MSGLEN];
+	constexpr int batch_size = 16;
+	static msg_t msgs[ batch_size ];
+	static uint8_t msgData[ batch_size ][ MAX_MSGLEN ];
+	netadr_t addresses[ batch_size ];
 
 	socket_t * sockets[] = {
 		&svs.socket_loopback,
@@ -145,7 +161,9 @@ static void SV_ReadPackets() {
 		&svs.socket_udp6,
 	};
 
-	MSG_Init( &msg, msgData, sizeof( msgData ) );
+	for( int i = 0; i < batch_size; i++ ) {
+		MSG_Init( &msgs[ i ], msgData[ i ], sizeof( msgData[ i ] ) );
+	}
 
 	for( size_t socketind = 0; socketind < ARRAY_COUNT( sockets ); socketind++ ) {
 		socket_t * socket = sockets[socketind];
@@ -155,45 +173,42 @@ static void SV_ReadPackets() {
 		}
 
 		int ret;
-		netadr_t address;
-		while( ( ret = NET_GetPacket( socket, &address, &msg ) ) != 0 ) {
+		while( ( ret = NET_GetPackets( socket, addresses, msgs, batch_size ) ) != 0 ) {
 			if( ret == -1 ) {
-				Com_Printf( "NET_GetPacket: Error: %s\n", NET_ErrorString() );
+				Com_Printf( "NET_GetPackets: Error: %s\n", NET_ErrorString() );
 				continue;
 			}
 
-			// check for connectionless packet (0xffffffff) first
-			if( *(int *)msg.data == -1 ) {
-				SV_ConnectionlessPacket( socket, &address, &msg );
-				continue;
-			}
-
-			MSG_BeginReading( &msg );
-			MSG_ReadInt32( &msg ); // sequence number
-			MSG_ReadInt32( &msg ); // sequence number
-			u64 session_id = MSG_ReadUint64( &msg );
+			for( int p = 0; p < ret; p++ ) {
+				msg_t * msg = &msgs[ p ];
+				const netadr_t * address = &addresses[ p ];
 
-			for( int i = 0; i < sv_maxclients->integer; i++ ) {
-				client_t * cl = &svs.clients[ i ];
-
-				if( cl->state == CS_FREE || cl->state == CS_ZOMBIE ) {
-					continue;
-				}
-				if( cl->edict && ( cl->edict->r.svflags & SVF_FAKECLIENT ) ) {
+				// check for connectionless packet (0xffffffff) first
+				if( *(int *)msg->data == -1 ) {
+					SV_ConnectionlessPacket( socket, address, msg );
 					continue;
 				}
 
-				if( cl->netchan.session_id != session_id ) {
+				MSG_BeginReading( msg );
+				MSG_ReadInt32( msg ); // sequence number
+				MSG_ReadInt32( msg ); // sequence number
+				u64 session_id = MSG_ReadUint64( msg );
+
+				client_t * cl = SV_FindClientBySession( session_id );
+				if( cl == NULL ) {
 					continue;
 				}
 
-				cl->netchan.remoteAddress = address;
+				cl->netchan.remoteAddress = *address;
 
-				if( SV_ProcessPacket( &cl->netchan, &msg ) ) { // this is a valid, sequenced packet, so process it
+				if( SV_ProcessPacket( &cl->netchan, msg ) ) { // this is a valid, sequenced packet, so process it
 					cl->lastPacketReceivedTime = svs.realtime;
-					SV_ParseClientMessage( cl, &msg );
+					SV_ParseClientMessage( cl, msg );
 				}
+			}
 
+			// a short read means the socket is drained
+			if( ret < batch_size ) {
 				break;
 			}
 		}
@@ -214,15 +229,15 @@ static void SV_ReadPackets() {
 		// not while, we only handle one packet per client at a time here
 		int ret;
 		netadr_t address;
-		if( ( ret = NET_GetPacket( cl->netchan.socket, &address, &msg ) ) != 0 ) {
+		if( ( ret = NET_GetPacket( cl->netchan.socket, &address, &msgs[ 0 ] ) ) != 0 ) {
 			if( ret == -1 ) {
 				Com_Printf( "Error receiving packet from %s: %s\n", NET_AddressToString( &cl->netchan.remoteAddress ),
 							NET_ErrorString() );
 			} else {
-				if( SV_ProcessPacket( &cl->netchan, &msg ) ) {
+				if( SV_ProcessPacket( &cl->netchan, &msgs[ 0 ] ) ) {
 					// this is a valid, sequenced packet, so process it
 					cl->lastPacketReceivedTime = svs.realtime;
-					SV_ParseClientMessage( cl, &msg );
+					SV_ParseClientMessage( cl, &msgs[ 0 ] );
 				}
 			}
 		}
@@ -305,9 +320,121 @@ static void SV_CheckLatchedUserinfoChanges() {
 	}
 }
 
-//#define WORLDFRAMETIME 25 // 40fps
-//#define WORLDFRAMETIME 20 // 50fps
-#define WORLDFRAMETIME 16 // 62.5fps
+#define HIBERNATE_FRAMETIME 1000
+
+#define MIN_SV_FPS 20
+#define MAX_SV_FPS 250
+#define MIN_SV_PPS 5
+
+/*
+* SV_UpdateFrameTimes
+*
+* the game runs every gameFrameTime and snapshots go out every
+* snapFrameTime, so the simulation rate can go up without sending more
+* snapshots. both are latched so they only change with the map
+*/
+void SV_UpdateFrameTimes() {
+	float fps = Clamp( float( MIN_SV_FPS ), sv_fps->value, float( MAX_SV_FPS ) );
+	float pps = Clamp( float( MIN_SV_PPS ), sv_pps->value, fps );
+
+	svc.gameFrameTime = Max2( 1, int( 1000.0f / fps ) );
+	svc.snapFrameTime = Max2( svc.gameFrameTime, unsigned( 1000.0f / pps ) );
+}
+
+/*
+* SV_SleepUntil
+*
+* sleep until deadline or a packet arrives, whichever comes first
+*/
+static void SV_SleepUntil( u64 deadline ) {
+	socket_t *sockets[] = { &svs.socket_udp, &svs.socket_udp6 };
+	socket_t *opened_sockets[ARRAY_COUNT( sockets ) + 1];
+	size_t sock_ind, open_ind;
+
+	// Pass only the opened sockets to the sleep function
+	open_ind = 0;
+	for( sock_ind = 0; sock_ind < ARRAY_COUNT( sockets ); sock_ind++ ) {
+		socket_t *sock = sockets[sock_ind];
+		if( sock->open ) {
+			opened_sockets[open_ind] = sock;
+			open_ind++;
+		}
+	}
+	opened_sockets[open_ind] = NULL;
+
+	u64 sleep_start = Sys_Microseconds();
+	bool woke_for_packet = NET_SleepUntil( deadline, opened_sockets );
+	u64 sleep_end = Sys_Microseconds();
+	SV_Stats_AddIdleTime( sleep_end - sleep_start );
+
+	// how far past the deadline the OS woke us up
+	if( !woke_for_packet && sleep_end > deadline ) {
+		SV_Stats_AddTime( ServerStatsPhase_WakeLate, sleep_end - deadline );
+	}
+}
+
+/*
+* SV_ShouldHibernate
+*
+* nobody is going to see what happens on a server with only bots on it
+*/
+static bool SV_ShouldHibernate() {
+	if( !is_dedicated_server || !sv_hibernate->integer || svs.demo.writer != NULL ) {
+		return false;
+	}
+
+	for( int i = 0; i < sv_maxclients->integer; i++ ) {
+		const client_t * cl = &svs.clients[ i ];
+		if( cl->state == CS_FREE || cl->state == CS_ZOMBIE ) {
+			continue;
+		}
+		if( cl->edict && ( cl->edict->r.svflags & SVF_FAKECLIENT ) ) {
+			continue;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+/*
+* SV_RunHibernatingFrame
+*
+* while nobody is connected we only run one game frame a second, and sleep
+* until then unless a packet arrives. the game frame is still gameFrameTime
+* long so nothing in the game sees a giant timestep, the game just runs in
+* slow motion and most thinks never come round
+*/
+static bool SV_RunHibernatingFrame( int msec ) {
+	ZoneScoped;
+
+	static int64_t hibernateTime = 0;
+
+	hibernateTime += msec;
+	if( hibernateTime < HIBERNATE_FRAMETIME ) {
+		SV_SleepUntil( Com_FrameClock() + u64( HIBERNATE_FRAMETIME - hibernateTime ) * 1000 );
+		return false;
+	}
+
+	hibernateTime = 0;
+
+	SV_CalcPings();
+
+	u64 game_start = Sys_Microseconds();
+	G_RunFrame( svc.gameFrameTime );
+	SV_Stats_AddTime( ServerStatsPhase_GameFrame, Sys_Microseconds() - game_start );
+
+	// still snap so map changes etc happen
+	sv.framenum++;
+	u64 snap_start = Sys_Microseconds();
+	G_SnapFrame();
+	SV_Stats_AddTime( ServerStatsPhase_Snapshots, Sys_Microseconds() - snap_start );
+
+	sv.nextSnapTime = svs.gametime + svc.snapFrameTime;
+
+	return true;
+}
+
 /*
 * SV_RunGameFrame
 */
@@ -319,6 +446,11 @@ static bool SV_RunGameFrame( int msec ) {
 	bool refreshGameModule;
 	bool sentFragments;
 
+	if( SV_ShouldHibernate() ) {
+		accTime = 0;
+		return SV_RunHibernatingFrame( msec );
+	}
+
 	accTime += msec;
 
 	refreshSnapshot = false;
@@ -327,7 +459,7 @@ static bool SV_RunGameFrame( int msec ) {
 	sentFragments = SV_SendClientsFragments();
 
 	// see if it's time to run a new game frame
-	if( accTime >= WORLDFRAMETIME ) {
+	if( accTime >= svc.gameFrameTime ) {
 		refreshGameModule = true;
 	}
 
@@ -339,25 +471,11 @@ static bool SV_RunGameFrame( int msec ) {
 
 	// if there aren't pending packets to be sent, we can sleep
 	if( is_dedicated_server && !sentFragments && !refreshSnapshot ) {
-		int sleeptime = Min2( WORLDFRAMETIME - ( accTime + 1 ), sv.nextSnapTime - ( svs.gametime + 1 ) );
+		// wake up exactly when the next frame or snapshot is due
+		int64_t sleeptime = Min2( svc.gameFrameTime - accTime, sv.nextSnapTime - svs.gametime );
 
 		if( sleeptime > 0 ) {
-			socket_t *sockets[] = { &svs.socket_udp, &svs.socket_udp6 };
-			socket_t *opened_sockets[ARRAY_COUNT( sockets ) + 1];
-			size_t sock_ind, open_ind;
-
-			// Pass only the opened sockets to the sleep function
-			open_ind = 0;
-			for( sock_ind = 0; sock_ind < ARRAY_COUNT( sockets ); sock_ind++ ) {
-				socket_t *sock = sockets[sock_ind];
-				if( sock->open ) {
-					opened_sockets[open_ind] = sock;
-					open_ind++;
-				}
-			}
-			opened_sockets[open_ind] = NULL;
-
-			NET_Sleep( sleeptime, opened_sockets );
+			SV_SleepUntil( Com_FrameClock() + u64( sleeptime ) * 1000 );
 		}
 	}
 
@@ -367,18 +485,20 @@ static bool SV_RunGameFrame( int msec ) {
 		// update ping based on the last known frame from all clients
 		SV_CalcPings();
 
-		if( accTime >= WORLDFRAMETIME ) {
-			moduleTime = WORLDFRAMETIME;
-			accTime -= WORLDFRAMETIME;
-			if( accTime >= WORLDFRAMETIME ) { // don't let it accumulate more than 1 frame
-				accTime = WORLDFRAMETIME - 1;
+		if( accTime >= svc.gameFrameTime ) {
+			moduleTime = svc.gameFrameTime;
+			accTime -= svc.gameFrameTime;
+			if( accTime >= svc.gameFrameTime ) { // don't let it accumulate more than 1 frame
+				accTime = svc.gameFrameTime - 1;
 			}
 		} else {
 			moduleTime = accTime;
 			accTime = 0;
 		}
 
+		u64 game_start = Sys_Microseconds();
 		G_RunFrame( moduleTime );
+		SV_Stats_AddTime( ServerStatsPhase_GameFrame, Sys_Microseconds() - game_start );
 	}
 
 	// if we don't have to send a snapshot we are done here
@@ -387,7 +507,9 @@ static bool SV_RunGameFrame( int msec ) {
 
 		// set up for sending a snapshot
 		sv.framenum++;
+		u64 snap_start = Sys_Microseconds();
 		G_SnapFrame();
+		SV_Stats_AddTime( ServerStatsPhase_Snapshots, Sys_Microseconds() - snap_start );
 
 		// set time for next snapshot
 		extraSnapTime = (int)( svs.gametime - sv.nextSnapTime );
@@ -420,10 +542,15 @@ static void SV_CheckDefaultMap() {
 * SV_Frame
 */
 void SV_Frame( unsigned realmsec, unsigned gamemsec ) {
-	ZoneScoped;
+	ZoneScopedSampled( "SV_Frame" );
 
 	TracyPlot( "Server frame arena max utilisation", svs.frame_arena.max_utilisation() );
-	svs.frame_arena.clear();
+	if( is_dedicated_server ) {
+		ThreadPoolPlotArenas();
+	}
+	if( svs.frame_arena.flip() ) {
+		Com_DPrintf( "Server frame arena overflowed, high water mark %" PRIuPTR "k\n", uintptr_t( svs.frame_arena.high_water_mark() / 1024 ) );
+	}
 
 	u64 entropy[ 2 ];
 	CSPRNG( entropy, sizeof( entropy ) );
@@ -438,11 +565,16 @@ void SV_Frame( unsigned realmsec, unsigned gamemsec ) {
 	svs.realtime += realmsec;
 	svs.gametime += gamemsec;
 
+	SV_Stats_BeginTick();
+	defer { SV_Stats_EndTick(); };
+
 	// check timeouts
 	SV_CheckTimeouts();
 
 	// get packets from clients
+	u64 read_start = Sys_Microseconds();
 	SV_ReadPackets();
+	SV_Stats_AddTime( ServerStatsPhase_ReadPackets, Sys_Microseconds() - read_start );
 
 	// apply latched userinfo changes
 	SV_CheckLatchedUserinfoChanges();
@@ -458,6 +590,12 @@ void SV_Frame( unsigned realmsec, unsigned gamemsec ) {
 		// send a heartbeat to the master if needed
 		SV_MasterHeartbeat();
 
+		// entity states are about to change, so the cached deltas are stale.
+		// pipelined snapshots are still using them, so they get cleared later
+		if( !SV_PipelinedSnapshotsEnabled() ) {
+			SNAP_ClearDeltaCache();
+		}
+
 		// clear teleport flags, etc for next frame
 		G_ClearSnap();
 	}
@@ -523,8 +661,7 @@ void SV_Init() {
 	memset( &svc, 0, sizeof( svc ) );
 
 	constexpr size_t frame_arena_size = 1024 * 1024; // 1MB
-	void * frame_arena_memory = ALLOC_SIZE( sys_allocator, frame_arena_size, 16 );
-	svs.frame_arena = ArenaAllocator( frame_arena_memory, frame_arena_size );
+	svs.frame_arena.init( sys_allocator, frame_arena_size );
 
 	u64 entropy[ 2 ];
 	CSPRNG( entropy, sizeof( entropy ) );
@@ -532,6 +669,15 @@ void SV_Init() {
 
 	SV_InitOperatorCommands();
 
+	// the client runs its own thread pool
+	if( is_dedicated_server ) {
+		InitThreadPool();
+	}
+
+	SNAP_InitDeltaCache();
+	SV_Stats_Init();
+	SV_InitSnapshotPipeline();
+
 	sv_mempool = Mem_AllocPool( NULL, "Server" );
 
 	Cvar_Get( "protocol", va( "%i", APP_PROTOCOL_VERSION ), CVAR_SERVERINFO | CVAR_NOSET );
@@ -575,15 +721,20 @@ void SV_Init() {
 
 	sv_debug_serverCmd = Cvar_Get( "sv_debug_serverCmd", "0", CVAR_ARCHIVE );
 
+	sv_parallel_snapshots = Cvar_Get( "sv_parallel_snapshots", "1", CVAR_ARCHIVE );
+	sv_adaptive_snapshots = Cvar_Get( "sv_adaptive_snapshots", "1", CVAR_ARCHIVE );
+	sv_pipelined_snapshots = Cvar_Get( "sv_pipelined_snapshots", "1", CVAR_ARCHIVE );
+
+	sv_hibernate = Cvar_Get( "sv_hibernate", "1", CVAR_ARCHIVE );
+
+	sv_fps = Cvar_Get( "sv_fps", "62.5", CVAR_ARCHIVE | CVAR_SERVERINFO | CVAR_LATCH );
+	sv_pps = Cvar_Get( "sv_pps", "20", CVAR_ARCHIVE | CVAR_SERVERINFO | CVAR_LATCH );
+
 	// this is a message holder for shared use
 	MSG_Init( &tmpMessage, tmpMessageData, sizeof( tmpMessageData ) );
 
 	// init server updates ratio
-	constexpr float pps = 20.0f;
-	constexpr float fps = 62.0f;
-	STATIC_ASSERT( fps >= pps );
-	svc.snapFrameTime = int( 1000.0f / pps );
-	svc.gameFrameTime = int( 1000.0f / fps );
+	SV_UpdateFrameTimes();
 
 	//init the master servers list
 	SV_InitMaster();
@@ -606,10 +757,18 @@ void SV_Shutdown( const char *finalmsg ) {
 
 	SV_Web_Shutdown();
 	SV_ShutdownGame( finalmsg, false );
+	SV_ShutdownSnapshotPipeline();
 
 	SV_ShutdownOperatorCommands();
 
 	Mem_FreePool( &sv_mempool );
 
-	FREE( sys_allocator, svs.frame_arena.get_memory() );
+	SNAP_ShutdownDeltaCache();
+	SV_Stats_Shutdown();
+
+	if( is_dedicated_server ) {
+		ShutdownThreadPool();
+	}
+
+	svs.frame_arena.shutdown();
 }
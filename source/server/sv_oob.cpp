@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server/server.h"
+#include "qcommon/hash.h"
 #include "qcommon/version.h"
 
 static netadr_t sv_masters[ ARRAY_COUNT( MASTER_SERVERS ) ];
@@ -114,19 +115,64 @@ void SV_MasterHeartbeat() {
 
 //============================================================================
 
+/*
+* SV_InfoStringKey
+*
+* Hashes everything that goes into the info strings, so they only get
+* rebuilt when one of them changes. This is a lot cheaper than building them.
+*/
+static u64 SV_InfoStringKey( bool fullStatus ) {
+	u64 key = Hash64( u64( serverinfo_generation ) );
+	key = Hash64( &sv_maxclients->integer, sizeof( sv_maxclients->integer ), key );
+	key = Hash64( sv.mapname, strlen( sv.mapname ), key );
+	key = Hash64( sv_hostname->string, strlen( sv_hostname->string ), key );
+
+	const char * password = Cvar_String( "password" );
+	key = Hash64( password, strlen( password ), key );
+
+	for( int i = 0; i < sv_maxclients->integer; i++ ) {
+		const client_t * cl = &svs.clients[i];
+		bool connected = cl->state >= CS_CONNECTED;
+		key = Hash64( &connected, sizeof( connected ), key );
+		if( !connected ) {
+			continue;
+		}
+
+		bool bot = ( cl->edict->r.svflags & SVF_FAKECLIENT ) != 0;
+		key = Hash64( &bot, sizeof( bot ), key );
+
+		if( fullStatus ) {
+			key = Hash64( &cl->edict->r.client->r.frags, sizeof( cl->edict->r.client->r.frags ), key );
+			key = Hash64( &cl->ping, sizeof( cl->ping ), key );
+			key = Hash64( &cl->edict->s.team, sizeof( cl->edict->s.team ), key );
+			key = Hash64( cl->name, strlen( cl->name ), key );
+		}
+	}
+
+	return key | 1; // 0 means nothing cached
+}
+
 /*
 * SV_LongInfoString
 * Builds the string that is sent as heartbeats and status replies
 */
 static char *SV_LongInfoString( bool fullStatus ) {
 	char tempstr[1024] = { 0 };
-	static char status[MAX_MSGLEN - 16];
+	static char status_cache[2][MAX_MSGLEN - 16];
+	static u64 status_cache_key[2];
 	int i, bots, count;
 	client_t *cl;
 	size_t statusLength;
 	size_t tempstrLength;
 
-	Q_strncpyz( status, Cvar_Serverinfo(), sizeof( status ) );
+	char * status = status_cache[fullStatus];
+	u64 key = SV_InfoStringKey( fullStatus );
+	if( status_cache_key[fullStatus] == key ) {
+		return status;
+	}
+	status_cache_key[fullStatus] = key;
+
+	Q_strncpyz( status, Cvar_Serverinfo(), sizeof( status_cache[0] ) );
 
 	statusLength = strlen( status );
 
@@ -147,10 +193,10 @@ static char *SV_LongInfoString( bool fullStatus ) {
 	}
 	snprintf( tempstr + strlen( tempstr ), sizeof( tempstr ) - strlen( tempstr ), "\\clients\\%i%s", count, fullStatus ? "\n" : "" );
 	tempstrLength = strlen( tempstr );
-	if( statusLength + tempstrLength >= sizeof( status ) ) {
+	if( statusLength + tempstrLength >= sizeof( status_cache[0] ) ) {
 		return status; // can't hold any more
 	}
-	Q_strncpyz( status + statusLength, tempstr, sizeof( status ) - statusLength );
+	Q_strncpyz( status + statusLength, tempstr, sizeof( status_cache[0] ) - statusLength );
 	statusLength += tempstrLength;
 
 	if( fullStatus ) {
@@ -160,10 +206,10 @@ static char *SV_LongInfoString( bool fullStatus ) {
 				snprintf( tempstr, sizeof( tempstr ), "%i %i \"%s\" %i\n",
 							 cl->edict->r.client->r.frags, cl->ping, cl->name, cl->edict->s.team );
 				tempstrLength = strlen( tempstr );
-				if( statusLength + tempstrLength >= sizeof( status ) ) {
+				if( statusLength + tempstrLength >= sizeof( status_cache[0] ) ) {
 					break; // can't hold any more
 				}
-				Q_strncpyz( status + statusLength, tempstr, sizeof( status ) - statusLength );
+				Q_strncpyz( status + statusLength, tempstr, sizeof( status_cache[0] ) - statusLength );
 				statusLength += tempstrLength;
 			}
 		}
@@ -180,9 +226,16 @@ static char *SV_LongInfoString( bool fullStatus ) {
 #define MAX_SVCINFOSTRING_LEN ( MAX_STRING_SVCINFOSTRING - 4 )
 static char *SV_ShortInfoString() {
 	static char string[MAX_STRING_SVCINFOSTRING];
+	static u64 string_key;
 	char hostname[64];
 	char entry[20];
 
+	u64 key = SV_InfoStringKey( false );
+	if( string_key == key ) {
+		return string;
+	}
+	string_key = key;
+
 	int bots = 0;
 	int count = 0;
 	for( int i = 0; i < sv_maxclients->integer; i++ ) {
@@ -424,6 +477,7 @@ static void SVC_DirectConnect( const socket_t *socket, const netadr_t *address )
 
 	u64 session_id = StringToU64( Cmd_Argv( 2 ), 0 );
 	int challenge = atoi( Cmd_Argv( 3 ) );
+	NetchanCompression compression = Netchan_NegotiateCompression( Cmd_Argv( 5 ) );
 
 	if( !Info_Validate( Cmd_Argv( 4 ) ) ) {
 		Netchan_OutOfBandPrint( socket, address, "reject\n%i\n%i\nInvalid userinfo string\n", DROP_TYPE_GENERAL, 0 );
@@ -547,8 +601,10 @@ static void SVC_DirectConnect( const socket_t *socket, const netadr_t *address )
 		return;
 	}
 
+	newcl->netchan.compression = compression;
+
 	// send the connect packet to the client
-	Netchan_OutOfBandPrint( socket, address, "client_connect\n%s", newcl->session );
+	Netchan_OutOfBandPrint( socket, address, "client_connect\n%s\n%s", newcl->session, Netchan_CompressionName( compression ) );
 }
 
 /*
@@ -674,21 +730,88 @@ static void SVC_RemoteCommand( const socket_t *socket, const netadr_t *address )
 struct connectionless_cmd_t {
 	const char *name;
 	void ( *func )( const socket_t *socket, const netadr_t *address );
+	bool query; // also counts against the global query budget
 };
 
 static connectionless_cmd_t connectionless_cmds[] = {
-	{ "ping", SVC_Ping },
-	{ "ack", SVC_Ack },
-	{ "info", SVC_InfoResponse },
-	{ "getinfo", SVC_GetInfoResponse },
-	{ "getstatus", SVC_GetStatusResponse },
-	{ "getchallenge", SVC_GetChallenge },
-	{ "connect", SVC_DirectConnect },
-	{ "rcon", SVC_RemoteCommand },
-
-	{ NULL, NULL }
+	{ "ping", SVC_Ping, true },
+	{ "ack", SVC_Ack, false },
+	{ "info", SVC_InfoResponse, true },
+	{ "getinfo", SVC_GetInfoResponse, true },
+	{ "getstatus", SVC_GetStatusResponse, true },
+	{ "getchallenge", SVC_GetChallenge, false },
+	{ "connect", SVC_DirectConnect, false },
+	{ "rcon", SVC_RemoteCommand, false },
+
+	{ NULL, NULL, false }
+};
+
+/*
+* Token buckets for connectionless packets. Every source address gets a
+* small burst and a slow refill, and queries share a global budget on top
+* of that so spoofed floods can't turn us into an amplifier.
+*
+* Addresses are hashed into a fixed table without the port, so collisions
+* only make the limit stricter.
+*/
+#define OOB_ADDRESS_BUCKETS 1024
+#define OOB_ADDRESS_BURST 10
+#define OOB_ADDRESS_RATE 5 // packets per second
+#define OOB_QUERY_BURST 100
+#define OOB_QUERY_RATE 50
+
+struct oob_bucket_t {
+	s64 last_refill;
+	float tokens;
 };
 
+static oob_bucket_t oob_address_buckets[ OOB_ADDRESS_BUCKETS ];
+static oob_bucket_t oob_query_bucket;
+
+static bool SV_TakeToken( oob_bucket_t * bucket, float burst, float rate ) {
+	if( bucket->last_refill == 0 ) {
+		bucket->tokens = burst;
+	}
+	else {
+		float dt = ( svs.realtime - bucket->last_refill ) * 0.001f;
+		bucket->tokens = Min2( burst, bucket->tokens + dt * rate );
+	}
+	bucket->last_refill = Max2( svs.realtime, s64( 1 ) );
+
+	if( bucket->tokens < 1.0f ) {
+		return false;
+	}
+
+	bucket->tokens -= 1.0f;
+	return true;
+}
+
+static oob_bucket_t * SV_AddressBucket( const netadr_t * address ) {
+	u64 hash = Hash64( &address->type, sizeof( address->type ) );
+	if( address->type == NA_IP ) {
+		hash = Hash64( address->address.ipv4.ip, sizeof( address->address.ipv4.ip ), hash );
+	}
+	else if( address->type == NA_IP6 ) {
+		hash = Hash64( address->address.ipv6.ip, sizeof( address->address.ipv6.ip ), hash );
+	}
+	return &oob_address_buckets[ hash % OOB_ADDRESS_BUCKETS ];
+}
+
+/*
+* SV_AllowConnectionlessPacket
+*/
+static bool SV_AllowConnectionlessPacket( const netadr_t * address, const connectionless_cmd_t * cmd ) {
+	if( NET_IsLocalAddress( address ) ) {
+		return true;
+	}
+
+	if( !SV_TakeToken( SV_AddressBucket( address ), OOB_ADDRESS_BURST, OOB_ADDRESS_RATE ) ) {
+		return false;
+	}
+
+	return !cmd->query || SV_TakeToken( &oob_query_bucket, OOB_QUERY_BURST, OOB_QUERY_RATE );
+}
+
 /*
 * SV_ConnectionlessPacket
 *
@@ -711,6 +834,10 @@ void SV_ConnectionlessPacket( const socket_t *socket, const netadr_t *address, m
 
 	for( cmd = connectionless_cmds; cmd->name; cmd++ ) {
 		if( !strcmp( c, cmd->name ) ) {
+			if( !SV_AllowConnectionlessPacket( address, cmd ) ) {
+				Com_DPrintf( "Dropping rate limited %s from %s\n", c, NET_AddressToString( address ) );
+				return;
+			}
 			cmd->func( socket, address );
 			return;
 		}
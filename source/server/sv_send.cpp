@@ -20,11 +20,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // sv_main.c -- server main program
 
 #include "server.h"
+#include "qcommon/threadpool.h"
+#include "qcommon/threads.h"
 
 // shared message buffer to be used for occasional messages
 msg_t tmpMessage;
 uint8_t tmpMessageData[MAX_MSGLEN];
 
+// the netchan shares compression contexts and buffers between channels, and
+// pipelined snapshots get sent from their own thread
+static Mutex * netchan_mutex;
+
+// adaptive snapshot rate
+#define MIN_SNAPSHOT_BUDGET 400 // bytes. always leave room for playerstate and events
+#define MAX_SNAPSHOT_INTERVAL 3 // every 4th frame at worst
+#define MAX_DEFERRED_BEFORE_SLOWDOWN 4
 
 
 //=============================================================================
@@ -49,6 +59,27 @@ void SV_FlushRedirect( int sv_redirected, const char *outputbuf, const void *ext
 //
 //=============================================================================
 
+// game commands where only the latest one in a frame matters
+static const char * superseding_game_commands[] = {
+	"cp",
+	"changeloadout",
+};
+
+static bool SV_SameCommandName( const char * a, const char * b ) {
+	size_t len_a = strcspn( a, " " );
+	size_t len_b = strcspn( b, " " );
+	return len_a == len_b && strncmp( a, b, len_a ) == 0;
+}
+
+static bool SV_IsSupersedingGameCommand( const char * cmd ) {
+	for( const char * name : superseding_game_commands ) {
+		if( SV_SameCommandName( cmd, name ) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*
 * SV_AddGameCommand
 */
@@ -65,13 +96,126 @@ void SV_AddGameCommand( client_t *client, const char *cmd ) {
 
 	assert( strlen( cmd ) < MAX_STRING_CHARS );
 
+	int64_t framenum = client->lastSentFrameNum ? client->lastSentFrameNum + 1 : sv.framenum;
+
+	// coalesce with the commands already queued for this frame. the client
+	// would see them all at once so duplicates and superseded commands are
+	// just wasted bandwidth
+	bool supersedes = SV_IsSupersedingGameCommand( cmd );
+	for( int64_t i = client->gameCommandCurrent; i > client->gameCommandCurrent - MAX_RELIABLE_COMMANDS; i-- ) {
+		game_command_t * queued = &client->gameCommands[i & ( MAX_RELIABLE_COMMANDS - 1 )];
+		if( !queued->command[0] || queued->framenum != framenum ) {
+			break;
+		}
+
+		if( strcmp( queued->command, cmd ) == 0 ) {
+			return;
+		}
+
+		if( supersedes && SV_SameCommandName( queued->command, cmd ) ) {
+			Q_strncpyz( queued->command, cmd, sizeof( queued->command ) );
+			return;
+		}
+	}
+
 	client->gameCommandCurrent++;
 	index = client->gameCommandCurrent & ( MAX_RELIABLE_COMMANDS - 1 );
 	Q_strncpyz( client->gameCommands[index].command, cmd, sizeof( client->gameCommands[index].command ) );
-	if( client->lastSentFrameNum ) {
-		client->gameCommands[index].framenum = client->lastSentFrameNum + 1;
-	} else {
-		client->gameCommands[index].framenum = sv.framenum;
+	client->gameCommands[index].framenum = framenum;
+}
+
+/*
+* SV_NextConfigstring
+*
+* Iterates over the index/value pairs of a (possibly batched) "cs" command,
+* with cursor starting just past the "cs". Configstrings can't contain
+* quotes so we don't need the full tokenizer, which would also clobber
+* Cmd_Argv for whoever is calling us.
+*/
+struct configstring_entry_t {
+	int index;
+	const char * value;
+	size_t length;
+};
+
+static bool SV_NextConfigstring( const char ** cursor, configstring_entry_t * entry, bool * malformed ) {
+	const char * p = *cursor;
+	*malformed = false;
+
+	while( *p == ' ' ) {
+		p++;
+	}
+	if( *p == '\0' ) {
+		return false;
+	}
+
+	char * end;
+	long index = strtol( p, &end, 10 );
+	if( end == p || *end != ' ' || end[1] != '"' || index < 0 || index >= MAX_CONFIGSTRINGS ) {
+		*malformed = true;
+		return false;
+	}
+
+	const char * value = end + 2;
+	const char * close = strchr( value, '"' );
+	if( close == NULL ) {
+		*malformed = true;
+		return false;
+	}
+
+	entry->index = index;
+	entry->value = value;
+	entry->length = close - value;
+	*cursor = close + 1;
+	return true;
+}
+
+/*
+* SV_RemovePendingConfigstring
+*
+* Drops any value for the given configstring from "cs" commands that
+* haven't been sent yet, because the one being added supersedes it.
+* Commands that were already sent can't be touched since the client may
+* have executed them.
+*/
+static void SV_RemovePendingConfigstring( client_t *client, int index ) {
+	for( int64_t i = client->reliableSequence; i > client->reliableSent; i-- ) {
+		char * otherCmd = client->reliableCommands[i & ( MAX_RELIABLE_COMMANDS - 1 )];
+		if( strncmp( otherCmd, "cs ", 3 ) != 0 ) {
+			continue;
+		}
+
+		char rebuilt[MAX_STRING_CHARS];
+		Q_strncpyz( rebuilt, "cs", sizeof( rebuilt ) );
+		size_t rebuilt_length = 2;
+		int remaining = 0;
+		bool removed = false;
+
+		const char * cursor = otherCmd + 2;
+		configstring_entry_t entry;
+		bool malformed;
+		while( SV_NextConfigstring( &cursor, &entry, &malformed ) ) {
+			if( entry.index == index ) {
+				removed = true;
+				continue;
+			}
+
+			int n = snprintf( rebuilt + rebuilt_length, sizeof( rebuilt ) - rebuilt_length, " %i \"%.*s\"", entry.index, int( entry.length ), entry.value );
+			rebuilt_length = Min2( rebuilt_length + n, sizeof( rebuilt ) - 1 );
+			remaining++;
+		}
+
+		if( malformed || !removed ) {
+			continue;
+		}
+
+		// empty commands are skipped by SV_AddReliableCommandsToMessage
+		if( remaining == 0 ) {
+			otherCmd[0] = '\0';
+		}
+		else {
+			Q_strncpyz( otherCmd, rebuilt, MAX_STRING_CHARS );
+		}
 	}
 }
 
@@ -102,6 +246,13 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
 	// to find a pending "cs" command that has space in it. If we'll find one,
 	// we'll batch this there, if not, we'll create a new one.
 	if( !strncmp( cmd, "cs ", 3 ) ) {
+		const char * cursor = cmd + 2;
+		configstring_entry_t entry;
+		bool malformed;
+		while( SV_NextConfigstring( &cursor, &entry, &malformed ) ) {
+			SV_RemovePendingConfigstring( client, entry.index );
+		}
+
 		// length of the index/value (leave room for one space and null char)
 		size_t len = strlen( cmd ) - 1;
 		for( i = client->reliableSequence; i > client->reliableSent; i-- ) {
@@ -176,6 +327,43 @@ void SV_SendServerCommand( client_t *cl, const char *format, ... ) {
 	}
 }
 
+/*
+* SV_WriteConfigstringsCommand
+*
+* "cs" commands make up nearly all of the reliable traffic, so send them
+* as index/value pairs instead of text. Returns false if the command
+* should go out as a string.
+*/
+static bool SV_WriteConfigstringsCommand( msg_t *msg, int64_t sequence, const char *cmd ) {
+	if( strncmp( cmd, "cs ", 3 ) != 0 ) {
+		return false;
+	}
+
+	configstring_entry_t entries[MAX_STRING_CHARS / 4];
+	size_t num_entries = 0;
+
+	const char * cursor = cmd + 2;
+	bool malformed;
+	while( num_entries < ARRAY_COUNT( entries ) && SV_NextConfigstring( &cursor, &entries[num_entries], &malformed ) ) {
+		num_entries++;
+	}
+
+	if( malformed || num_entries == 0 || *cursor != '\0' ) {
+		return false;
+	}
+
+	MSG_WriteUint8( msg, svc_configstrings );
+	MSG_WriteInt32( msg, sequence );
+	MSG_WriteUintBase128( msg, num_entries );
+	for( size_t i = 0; i < num_entries; i++ ) {
+		MSG_WriteUintBase128( msg, entries[i].index );
+		MSG_WriteData( msg, entries[i].value, entries[i].length );
+		MSG_WriteUint8( msg, 0 );
+	}
+
+	return true;
+}
+
 /*
 * SV_AddReliableCommandsToMessage
 *
@@ -198,9 +386,11 @@ void SV_AddReliableCommandsToMessage( client_t *client, msg_t *msg ) {
 		if( !strlen( client->reliableCommands[i & ( MAX_RELIABLE_COMMANDS - 1 )] ) ) {
 			continue;
 		}
-		MSG_WriteUint8( msg, svc_servercmd );
-		MSG_WriteInt32( msg, i );
-		MSG_WriteString( msg, client->reliableCommands[i & ( MAX_RELIABLE_COMMANDS - 1 )] );
+		if( !SV_WriteConfigstringsCommand( msg, i, client->reliableCommands[i & ( MAX_RELIABLE_COMMANDS - 1 )] ) ) {
+			MSG_WriteUint8( msg, svc_servercmd );
+			MSG_WriteInt32( msg, i );
+			MSG_WriteString( msg, client->reliableCommands[i & ( MAX_RELIABLE_COMMANDS - 1 )] );
+		}
 		if( sv_debug_serverCmd->integer ) {
 			Com_Printf( "SV_AddServerCommandsToMessage(%i):%s\n", i,
 						client->reliableCommands[i & ( MAX_RELIABLE_COMMANDS - 1 )] );
@@ -268,7 +458,11 @@ bool SV_SendClientsFragments() {
 			continue;
 		}
 
-		if( !Netchan_TransmitNextFragment( &client->netchan ) ) {
+		SV_LockNetchans();
+		bool ok = Netchan_TransmitNextFragment( &client->netchan );
+		SV_UnlockNetchans();
+
+		if( !ok ) {
 			Com_Printf( "Error sending fragment to %s: %s\n", NET_AddressToString( &client->netchan.remoteAddress ),
 						NET_ErrorString() );
 			continue;
@@ -289,7 +483,7 @@ bool SV_Netchan_Transmit( netchan_t *netchan, msg_t *msg ) {
 		return false;
 	}
 
-	int zerror = Netchan_CompressMessage( msg );
+	int zerror = Netchan_CompressMessage( netchan, msg );
 	if( zerror < 0 ) { // it's compression error, just send uncompressed
 		Com_DPrintf( "SV_Netchan_Transmit (ignoring compression): Compression error %i\n", zerror );
 	}
@@ -328,7 +522,20 @@ bool SV_SendMessageToClient( client_t *client, msg_t *msg ) {
 
 	// transmit the message data
 	client->lastPacketSentTime = svs.realtime;
-	return SV_Netchan_Transmit( &client->netchan, msg );
+
+	SV_LockNetchans();
+	bool ok = SV_Netchan_Transmit( &client->netchan, msg );
+	SV_UnlockNetchans();
+
+	return ok;
+}
+
+void SV_LockNetchans() {
+	Lock( netchan_mutex );
+}
+
+void SV_UnlockNetchans() {
+	Unlock( netchan_mutex );
 }
 
 /*
@@ -350,11 +557,47 @@ void SV_ResetClientFrameCounters() {
 	}
 }
 
+/*
+* SV_SnapshotBudget
+*
+* How many bytes the next snapshot should fit in, or 0 for no limit
+*/
+static size_t SV_SnapshotBudget( client_t *client ) {
+	if( !sv_adaptive_snapshots->integer || client == &svs.demo.client ) {
+		return 0;
+	}
+
+	// it's been this long since the last snapshot, and it will be this long until the next one
+	int msecs = svc.snapFrameTime * ( client->snapshotInterval + 1 );
+	return Max2( Netchan_BandwidthBudget( &client->netchan, msecs ), size_t( MIN_SNAPSHOT_BUDGET ) );
+}
+
+/*
+* SV_UpdateSnapshotInterval
+*/
+static void SV_UpdateSnapshotInterval( client_t *client, int64_t frameNum, size_t budget, size_t size, int deferred ) {
+	if( budget == 0 ) {
+		return;
+	}
+
+	// if we had to hold a lot back, or it still didn't fit, send less often so
+	// each snapshot gets a bigger share. come back up once there's headroom
+	if( size > budget || deferred > MAX_DEFERRED_BEFORE_SLOWDOWN ) {
+		client->snapshotInterval = Min2( client->snapshotInterval + 1, MAX_SNAPSHOT_INTERVAL );
+	} else if( deferred == 0 && size < budget / 2 ) {
+		client->snapshotInterval = Max2( client->snapshotInterval - 1, 0 );
+	}
+
+	client->nextSnapshotFrame = frameNum + 1 + client->snapshotInterval;
+}
+
 /*
 * SV_WriteFrameSnapToClient
 */
 void SV_WriteFrameSnapToClient( client_t *client, msg_t *msg ) {
-	SNAP_WriteFrameSnapToClient( &sv.gi, client, msg, sv.framenum, svs.gametime, sv.baselines, &svs.client_entities );
+	size_t budget = SV_SnapshotBudget( client );
+	int deferred = SNAP_WriteFrameSnapToClient( &sv.gi, client, msg, sv.framenum, svs.gametime, sv.baselines, &svs.client_entities, budget );
+	SV_UpdateSnapshotInterval( client, sv.framenum, budget, msg->cursize, deferred );
 }
 
 /*
@@ -386,6 +629,244 @@ static bool SV_SendClientDatagram( client_t *client ) {
 	return SV_SendMessageToClient( client, &tmpMessage );
 }
 
+struct SnapshotJob {
+	client_t * client;
+	bool built;
+	snapshotEntityNumbers_t entities;
+	msg_t msg;
+	uint8_t msg_data[ MAX_MSGLEN ];
+
+	// for pipelined snapshots
+	client_snapshot_t * oldframe;
+	int64_t from_frame;
+	size_t budget;
+};
+
+static SnapshotJob snapshot_jobs[ MAX_CLIENTS ];
+
+/*
+* SV_SendClientHeartbeat
+*
+* Send pending reliable commands, or send heartbeats for not timing out
+*/
+static void SV_SendClientHeartbeat( client_t *client ) {
+	if( client->reliableSequence > client->reliableAcknowledge ||
+		svs.realtime - client->lastPacketSentTime > 1000 ) {
+		SV_InitClientMessage( client, &tmpMessage, NULL, 0 );
+		SV_AddReliableCommandsToMessage( client, &tmpMessage );
+		if( !SV_SendMessageToClient( client, &tmpMessage ) ) {
+			Com_Printf( "Error sending message to %s: %s\n", client->name, NET_ErrorString() );
+		}
+	}
+}
+
+/*
+* SV_SendClientDatagramsParallel
+*
+* Culling and encoding only touch the client's own frame so they run on the
+* thread pool. Everything that touches shared state (allocating frame
+* storage, the circular entities buffer, the netchan) stays on this thread,
+* and packets still go out in client order.
+*/
+static void SV_SendClientDatagramsParallel( Span< SnapshotJob > jobs ) {
+	ZoneScoped;
+
+	for( SnapshotJob & job : jobs ) {
+		job.built = SNAP_BeginClientFrameSnap( svs.cms, &sv.gi, sv.framenum, svs.gametime,
+			job.client, &server_gs.gameState, sv_mempool );
+	}
+
+	ParallelFor( jobs, []( TempAllocator * temp, void * data ) {
+		SnapshotJob * job = ( SnapshotJob * ) data;
+		if( job->built ) {
+			SNAP_CullClientFrameSnap( svs.cms, &sv.gi, sv.framenum, job->client, &job->entities );
+		}
+	} );
+
+	for( const SnapshotJob & job : jobs ) {
+		if( job.built ) {
+			SNAP_FinishClientFrameSnap( sv.framenum, job.client, &job.entities, &svs.client_entities );
+		}
+	}
+
+	ParallelFor( jobs, []( TempAllocator * temp, void * data ) {
+		SnapshotJob * job = ( SnapshotJob * ) data;
+		SV_InitClientMessage( job->client, &job->msg, job->msg_data, sizeof( job->msg_data ) );
+		SV_AddReliableCommandsToMessage( job->client, &job->msg );
+		SV_WriteFrameSnapToClient( job->client, &job->msg );
+	} );
+
+	for( SnapshotJob & job : jobs ) {
+		if( !SV_SendMessageToClient( job.client, &job.msg ) ) {
+			Com_Printf( "Error sending message to %s: %s\n", job.client->name, NET_ErrorString() );
+		}
+	}
+}
+
+/*
+* pipelined snapshots
+*
+* On dedicated servers the snapshot bodies are encoded and sent from their
+* own thread so they overlap the next frame's packet reading and game sim.
+* The main thread builds the frames and writes everything that depends on
+* client state the sim can change (reliable commands, game commands, the
+* delta base), then hands the rest off and waits for it before it touches
+* client frames again.
+*
+* Nothing more needs to be double buffered: client frames and
+* client_entities are already UPDATE_BACKUP deep rings, and the sim only
+* touches edicts, which the frames hold copies of.
+*/
+
+static Thread * pipeline_thread;
+static Semaphore * pipeline_start;
+static Semaphore * pipeline_done;
+static bool pipeline_shutting_down;
+
+static bool pipeline_busy; // main thread only
+
+// owned by the pipeline thread while it's busy
+static size_t pipeline_num_jobs;
+static int64_t pipeline_framenum;
+static u64 pipeline_encode_time;
+static u64 pipeline_send_time;
+
+static void SV_PipelineThread( void * data ) {
+#if TRACY_ENABLE
+	tracy::SetThreadName( "Snapshot pipeline" );
+#endif
+
+	while( true ) {
+		Wait( pipeline_start );
+		if( pipeline_shutting_down ) {
+			break;
+		}
+
+		{
+			ZoneScopedN( "Encode pipelined snapshots" );
+
+			// the thread pool can't be driven from two threads at once, so encode in series here
+			u64 start = Sys_Microseconds();
+			for( size_t i = 0; i < pipeline_num_jobs; i++ ) {
+				SnapshotJob * job = &snapshot_jobs[ i ];
+				int deferred = SNAP_WriteFrameSnapBodyToClient( job->client, job->oldframe, job->from_frame, pipeline_framenum,
+					&job->msg, sv.baselines, &svs.client_entities, job->budget );
+				SV_UpdateSnapshotInterval( job->client, pipeline_framenum, job->budget, job->msg.cursize, deferred );
+			}
+			pipeline_encode_time = Sys_Microseconds() - start;
+		}
+
+		{
+			ZoneScopedN( "Send pipelined snapshots" );
+
+			// batching is global state, so the main thread gets it to itself and
+			// these go out one at a time
+			u64 start = Sys_Microseconds();
+			for( size_t i = 0; i < pipeline_num_jobs; i++ ) {
+				SnapshotJob * job = &snapshot_jobs[ i ];
+
+				SV_LockNetchans();
+				bool ok = SV_Netchan_Transmit( &job->client->netchan, &job->msg );
+				SV_UnlockNetchans();
+
+				if( !ok ) {
+					Com_Printf( "Error sending message to %s: %s\n", job->client->name, NET_ErrorString() );
+				}
+			}
+			pipeline_send_time = Sys_Microseconds() - start;
+		}
+
+		Signal( pipeline_done );
+	}
+}
+
+void SV_InitSnapshotPipeline() {
+	netchan_mutex = NewMutex();
+
+	if( !is_dedicated_server ) {
+		return;
+	}
+
+	pipeline_shutting_down = false;
+	pipeline_busy = false;
+	pipeline_start = NewSemaphore();
+	pipeline_done = NewSemaphore();
+	pipeline_thread = NewThread( SV_PipelineThread );
+}
+
+void SV_ShutdownSnapshotPipeline() {
+	if( is_dedicated_server ) {
+		SV_WaitForPipelinedSnapshots();
+
+		pipeline_shutting_down = true;
+		Signal( pipeline_start );
+		JoinThread( pipeline_thread );
+
+		DeleteSemaphore( pipeline_done );
+		DeleteSemaphore( pipeline_start );
+	}
+
+	DeleteMutex( netchan_mutex );
+}
+
+/*
+* SV_WaitForPipelinedSnapshots
+*
+* Must be called before anything outside the packet/sim path touches a
+* spawned client's frames, e.g. dropping it or changing map
+*/
+void SV_WaitForPipelinedSnapshots() {
+	if( !pipeline_busy ) {
+		return;
+	}
+
+	ZoneScoped;
+
+	Wait( pipeline_done );
+	pipeline_busy = false;
+
+	SV_Stats_AddTime( ServerStatsPhase_Snapshots, pipeline_encode_time );
+	SV_Stats_AddTime( ServerStatsPhase_Send, pipeline_send_time );
+}
+
+bool SV_PipelinedSnapshotsEnabled() {
+	return is_dedicated_server && sv_pipelined_snapshots->integer != 0;
+}
+
+/*
+* SV_SendClientDatagramsPipelined
+*/
+static void SV_SendClientDatagramsPipelined( Span< SnapshotJob > jobs ) {
+	ZoneScoped;
+
+	for( SnapshotJob & job : jobs ) {
+		job.built = SNAP_BeginClientFrameSnap( svs.cms, &sv.gi, sv.framenum, svs.gametime,
+			job.client, &server_gs.gameState, sv_mempool );
+	}
+
+	ParallelFor( jobs, []( TempAllocator * temp, void * data ) {
+		SnapshotJob * job = ( SnapshotJob * ) data;
+		if( job->built ) {
+			SNAP_CullClientFrameSnap( svs.cms, &sv.gi, sv.framenum, job->client, &job->entities );
+		}
+	} );
+
+	for( SnapshotJob & job : jobs ) {
+		if( job.built ) {
+			SNAP_FinishClientFrameSnap( sv.framenum, job.client, &job.entities, &svs.client_entities );
+		}
+
+		SV_InitClientMessage( job.client, &job.msg, job.msg_data, sizeof( job.msg_data ) );
+		SV_AddReliableCommandsToMessage( job.client, &job.msg );
+		job.budget = SV_SnapshotBudget( job.client );
+		job.from_frame = SNAP_WriteFrameSnapHeaderToClient( &sv.gi, job.client, &job.msg, sv.framenum, svs.gametime, &job.oldframe );
+		job.client->lastPacketSentTime = svs.realtime;
+	}
+
+	pipeline_num_jobs = jobs.n;
+	pipeline_framenum = sv.framenum;
+}
+
 /*
 * SV_SendClientMessages
 */
@@ -394,6 +875,21 @@ void SV_SendClientMessages() {
 
 	int i;
 	client_t *client;
+	size_t num_jobs = 0;
+
+	bool pipelined = SV_PipelinedSnapshotsEnabled();
+
+	// the last batch has to be out of the way before we can reuse the jobs,
+	// and the delta cache has to outlive it
+	SV_WaitForPipelinedSnapshots();
+	if( pipelined ) {
+		SNAP_ClearDeltaCache();
+	}
+
+	u64 snapshots_start = Sys_Microseconds();
+
+	// send everything with as few syscalls as possible
+	NET_BeginBatchedSends();
 
 	// send a message to each connected client
 	for( i = 0, client = svs.clients; i < sv_maxclients->integer; i++, client++ ) {
@@ -406,20 +902,53 @@ void SV_SendClientMessages() {
 			continue;
 		}
 
-		if( client->state == CS_SPAWNED ) {
-			if( !SV_SendClientDatagram( client ) ) {
-				Com_Printf( "Error sending message to %s: %s\n", client->name, NET_ErrorString() );
-			}
-		} else {
-			// send pending reliable commands, or send heartbeats for not timing out
-			if( client->reliableSequence > client->reliableAcknowledge ||
-				svs.realtime - client->lastPacketSentTime > 1000 ) {
-				SV_InitClientMessage( client, &tmpMessage, NULL, 0 );
-				SV_AddReliableCommandsToMessage( client, &tmpMessage );
-				if( !SV_SendMessageToClient( client, &tmpMessage ) ) {
-					Com_Printf( "Error sending message to %s: %s\n", client->name, NET_ErrorString() );
-				}
-			}
+		if( client->state != CS_SPAWNED ) {
+			SV_SendClientHeartbeat( client );
+			continue;
+		}
+
+		// skip snapshots for clients that can't keep up with the full rate
+		if( sv_adaptive_snapshots->integer && sv.framenum < client->nextSnapshotFrame ) {
+			SV_SendClientHeartbeat( client );
+			continue;
+		}
+
+		if( pipelined || sv_parallel_snapshots->integer ) {
+			snapshot_jobs[ num_jobs ].client = client;
+			num_jobs++;
+			continue;
 		}
+
+		if( !SV_SendClientDatagram( client ) ) {
+			Com_Printf( "Error sending message to %s: %s\n", client->name, NET_ErrorString() );
+		}
+	}
+
+	if( pipelined ) {
+		if( num_jobs > 0 ) {
+			SV_SendClientDatagramsPipelined( Span< SnapshotJob >( snapshot_jobs, num_jobs ) );
+		}
+	}
+	// not worth waking the thread pool for one client
+	else if( num_jobs == 1 ) {
+		if( !SV_SendClientDatagram( snapshot_jobs[ 0 ].client ) ) {
+			Com_Printf( "Error sending message to %s: %s\n", snapshot_jobs[ 0 ].client->name, NET_ErrorString() );
+		}
+	}
+	else if( num_jobs > 1 ) {
+		SV_SendClientDatagramsParallel( Span< SnapshotJob >( snapshot_jobs, num_jobs ) );
+	}
+
+	u64 send_start = Sys_Microseconds();
+	SV_Stats_AddTime( ServerStatsPhase_Snapshots, send_start - snapshots_start );
+
+	NET_FlushBatchedSends();
+
+	SV_Stats_AddTime( ServerStatsPhase_Send, Sys_Microseconds() - send_start );
+
+	// don't start sending until we're done batching
+	if( pipelined && num_jobs > 0 ) {
+		pipeline_busy = true;
+		Signal( pipeline_start );
 	}
 }
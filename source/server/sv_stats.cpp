@@ -0,0 +1,197 @@
+#include <algorithm> // std::sort
+
+#include "server/server.h"
+#include "qcommon/string.h"
+#include "qcommon/threads.h"
+
+/*
+ * always on tick profiler
+ *
+ * each phase accumulates time over SV_Frame calls, and the tick is committed
+ * when the game module runs. the last STATS_WINDOW committed ticks are kept so we
+ * can report percentiles, and once a second the summary gets rebuilt into
+ * a JSON string that the web thread can copy out
+ */
+
+#define STATS_WINDOW 1024 // ~16s of game frames
+#define STATS_BUCKETS 16 // [0, 64us), [64us, 128us), ..., [1s, inf)
+
+static const char * phase_names[] = {
+	"read_packets",
+	"game_frame",
+	"angelscript",
+	"snapshots",
+	"send",
+	"tick",
+	"wake_late",
+};
+
+STATIC_ASSERT( ARRAY_COUNT( phase_names ) == ServerStatsPhase_Count );
+
+struct ServerStatsSummary {
+	u32 p50, p90, p99, max;
+	float mean;
+	u32 buckets[ STATS_BUCKETS ];
+};
+
+static u32 samples[ ServerStatsPhase_Count ][ STATS_WINDOW ];
+static u64 num_ticks;
+
+static u64 pending[ ServerStatsPhase_Count ];
+static u64 pending_idle;
+static u64 frame_start;
+static bool tick_ran_game;
+
+static Mutex * json_mutex;
+static String< 4096 > json;
+static s64 next_json_update;
+
+void SV_Stats_Init() {
+	memset( samples, 0, sizeof( samples ) );
+	num_ticks = 0;
+	memset( pending, 0, sizeof( pending ) );
+	pending_idle = 0;
+	tick_ran_game = false;
+
+	json_mutex = NewMutex();
+	json.clear();
+	json += "{}";
+	next_json_update = 0;
+}
+
+void SV_Stats_Shutdown() {
+	DeleteMutex( json_mutex );
+	json_mutex = NULL;
+}
+
+void SV_Stats_AddTime( ServerStatsPhase phase, u64 usec ) {
+	pending[ phase ] += usec;
+	if( phase == ServerStatsPhase_GameFrame ) {
+		tick_ran_game = true;
+	}
+}
+
+void SV_Stats_AddIdleTime( u64 usec ) {
+	pending_idle += usec;
+}
+
+void SV_Stats_BeginTick() {
+	frame_start = Sys_Microseconds();
+}
+
+static u32 Bucket( u32 usec ) {
+	u32 bucket = 0;
+	for( u32 bound = 64; bucket < STATS_BUCKETS - 1 && usec >= bound; bound *= 2 ) {
+		bucket++;
+	}
+	return bucket;
+}
+
+static ServerStatsSummary Summarise( ServerStatsPhase phase ) {
+	ServerStatsSummary summary = { };
+
+	size_t n = Min2( num_ticks, u64( STATS_WINDOW ) );
+	if( n == 0 ) {
+		return summary;
+	}
+
+	static u32 sorted[ STATS_WINDOW ];
+	memcpy( sorted, samples[ phase ], n * sizeof( u32 ) );
+	std::sort( sorted, sorted + n );
+
+	u64 total = 0;
+	for( size_t i = 0; i < n; i++ ) {
+		total += sorted[ i ];
+		summary.buckets[ Bucket( sorted[ i ] ) ]++;
+	}
+
+	summary.p50 = sorted[ ( n - 1 ) * 50 / 100 ];
+	summary.p90 = sorted[ ( n - 1 ) * 90 / 100 ];
+	summary.p99 = sorted[ ( n - 1 ) * 99 / 100 ];
+	summary.max = sorted[ n - 1 ];
+	summary.mean = float( total ) / n;
+
+	return summary;
+}
+
+static void SV_Stats_UpdateJSON() {
+	int clients = 0;
+	for( int i = 0; i < sv_maxclients->integer; i++ ) {
+		if( svs.clients[ i ].state >= CS_CONNECTED ) {
+			clients++;
+		}
+	}
+
+	// ggformat can't mix escaped braces with arguments, so add them separately
+	String< 4096 > new_json;
+	new_json += "{";
+	new_json.append( "\"window\":{},\"ticks\":{},\"clients\":{},\"phases\":", Min2( num_ticks, u64( STATS_WINDOW ) ), num_ticks, clients );
+	new_json += "{";
+
+	for( int i = 0; i < ServerStatsPhase_Count; i++ ) {
+		ServerStatsSummary summary = Summarise( ServerStatsPhase( i ) );
+		new_json.append( "{}\"{}\":", i == 0 ? "" : ",", phase_names[ i ] );
+		new_json += "{";
+		new_json.append( "\"p50\":{},\"p90\":{},\"p99\":{},\"max\":{},\"mean\":{.1},\"histogram\":[",
+			summary.p50, summary.p90, summary.p99, summary.max, summary.mean );
+		for( int j = 0; j < STATS_BUCKETS; j++ ) {
+			new_json.append( "{}{}", j == 0 ? "" : ",", summary.buckets[ j ] );
+		}
+		new_json += "]";
+		new_json += "}";
+	}
+
+	new_json += "}";
+	new_json += "}";
+
+	Lock( json_mutex );
+	json = new_json;
+	Unlock( json_mutex );
+}
+
+void SV_Stats_EndTick() {
+	// only count time spent in SV_Frame, minus time spent waiting for packets
+	u64 elapsed = Sys_Microseconds() - frame_start;
+	pending[ ServerStatsPhase_Tick ] += elapsed - Min2( elapsed, pending_idle );
+	pending_idle = 0;
+
+	if( !tick_ran_game ) {
+		return;
+	}
+
+	size_t slot = num_ticks % STATS_WINDOW;
+	for( int i = 0; i < ServerStatsPhase_Count; i++ ) {
+		samples[ i ][ slot ] = u32( Min2( pending[ i ], u64( U32_MAX ) ) );
+	}
+	num_ticks++;
+
+	memset( pending, 0, sizeof( pending ) );
+	tick_ran_game = false;
+
+	if( svs.realtime >= next_json_update ) {
+		SV_Stats_UpdateJSON();
+		next_json_update = svs.realtime + 1000;
+	}
+}
+
+/*
+* SV_Stats_CopyJSON
+*
+* Called from the web thread
+*/
+char * SV_Stats_CopyJSON( Allocator * a, size_t * length ) {
+	Lock( json_mutex );
+	*length = json.length();
+	char * copy = CopyString( a, json.c_str() );
+	Unlock( json_mutex );
+	return copy;
+}
+
+void SV_Stats_f() {
+	Com_Printf( "%" PRIu64 " ticks, last %" PRIu64 " (all times in us):\n", num_ticks, Min2( num_ticks, u64( STATS_WINDOW ) ) );
+	Com_Printf( "%-14s %8s %8s %8s %8s %8s\n", "phase", "mean", "p50", "p90", "p99", "max" );
+	for( int i = 0; i < ServerStatsPhase_Count; i++ ) {
+		ServerStatsSummary summary = Summarise( ServerStatsPhase( i ) );
+		Com_Printf( "%-14s %8.1f %8u %8u %8u %8u\n", phase_names[ i ], summary.mean, summary.p50, summary.p90, summary.p99, summary.max );
+	}
+}
@@ -18,6 +18,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#include <atomic>
+
 #include "server/server.h"
 #include "qcommon/q_trie.h"
 #include "qcommon/fs.h"
@@ -32,6 +34,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define HTTP_SERVER_SLEEP_TIME                  50 // milliseconds
 
+#define MAX_HTTP_GAME_CLIENT_EVENTS             256 // must be a power of two
+
+// everybody downloads the next map at the same time, so keep them in memory
+#define MAX_HTTP_CACHED_FILES                   16
+#define MAX_HTTP_CACHE_SIZE                     ( 256 * 1024 * 1024 )
+
 enum http_query_method_t {
 	HTTP_METHOD_NONE,
 	HTTP_METHOD_GET,
@@ -41,10 +49,12 @@ enum http_query_method_t {
 enum http_response_code_t {
 	HTTP_RESP_NONE = 0,
 	HTTP_RESP_OK = 200,
+	HTTP_RESP_PARTIAL_CONTENT = 206,
 	HTTP_RESP_BAD_REQUEST = 400,
 	HTTP_RESP_FORBIDDEN = 403,
 	HTTP_RESP_NOT_FOUND = 404,
 	HTTP_RESP_REQUEST_TOO_LARGE = 413,
+	HTTP_RESP_RANGE_NOT_SATISFIABLE = 416,
 };
 
 enum sv_http_connstate_t {
@@ -56,7 +66,7 @@ enum sv_http_connstate_t {
 
 struct sv_http_stream_t {
 	size_t header_length;
-	char header_buf[256];
+	char header_buf[512];
 	size_t header_buf_p;
 	bool header_done;
 };
@@ -73,17 +83,34 @@ struct sv_http_request_t {
 	char *clientSession;
 	netadr_t realAddr;
 
+	char range[64];
+	char if_range[32];
+
 	bool got_start_line;
 };
 
+struct sv_http_cached_file_t {
+	char * filename;
+	Span< u8 > data;
+	u64 hash; // of the whole file, so clients can check downloads
+	s64 modified_time;
+	int refs;
+	s64 last_used;
+};
+
 struct sv_http_response_t {
 	http_response_code_t code;
 	sv_http_stream_t stream;
 
 	FILE * file;
+	sv_http_cached_file_t * cached;     // the body comes from here instead of file if not NULL
+	char * body;                        // or from here, for generated responses
+	const char * content_type;          // NULL for file downloads
 	char * filename;
 	size_t filesize;
-	size_t filesent;
+	u64 etag;
+	size_t range_begin, range_end;      // the part of the file we're sending, end is exclusive
+	size_t filesent;                    // relative to range_begin
 };
 
 struct sv_http_connection_t {
@@ -92,6 +119,7 @@ struct sv_http_connection_t {
 
 	socket_t socket;
 	netadr_t address;
+	bool polling_write;
 
 	int64_t last_active;
 
@@ -105,6 +133,16 @@ struct http_game_client_t {
 	netadr_t remoteAddress;
 };
 
+enum http_game_client_event_type_t {
+	HTTP_GAME_CLIENT_ADD,
+	HTTP_GAME_CLIENT_REMOVE,
+};
+
+struct http_game_client_event_t {
+	http_game_client_event_type_t type;
+	http_game_client_t client;
+};
+
 static bool sv_http_initialized = false;
 static volatile bool sv_http_running = false;
 
@@ -113,8 +151,23 @@ static sv_http_connection_t sv_http_connections[MAX_INCOMING_HTTP_CONNECTIONS];
 static socket_t sv_socket_http;
 static socket_t sv_socket_http6;
 
+// only touched by the web thread
 static trie_t *sv_http_clients = NULL;
-static Mutex *sv_http_clients_mutex = NULL;
+
+// the game thread tells the web thread about clients coming and going
+// through a single producer/single consumer ring, so neither ever waits
+// on the other
+static http_game_client_event_t sv_http_client_events[MAX_HTTP_GAME_CLIENT_EVENTS];
+static std::atomic< u32 > sv_http_client_events_head; // only written by the game thread
+static std::atomic< u32 > sv_http_client_events_tail; // only written by the web thread
+
+static sv_http_cached_file_t sv_http_cached_files[MAX_HTTP_CACHED_FILES];
+static size_t sv_http_cache_size;
+
+static ArenaAllocator sv_http_arena;
+
+static NetPoller *sv_http_poller = NULL;
+static int64_t sv_http_next_timeout_check;
 
 static Thread *sv_http_thread = NULL;
 static void SV_Web_ThreadProc( void *param );
@@ -143,11 +196,94 @@ static void SV_Web_ResetRequest( sv_http_request_t *request ) {
 
 	NET_InitAddress( &request->realAddr, NA_NOTRANSMIT );
 
+	request->range[0] = '\0';
+	request->if_range[0] = '\0';
+
 	request->got_start_line = false;
 	request->error = HTTP_RESP_NONE;
 	request->clientNum = -1;
 }
 
+static void SV_Web_FreeCachedFile( sv_http_cached_file_t *cached ) {
+	sv_http_cache_size -= cached->data.n;
+	FREE( sys_allocator, cached->filename );
+	FREE( sys_allocator, cached->data.ptr );
+	*cached = { };
+}
+
+/*
+* SV_Web_GetCachedFile
+*
+* Returns the contents of the file with a reference held, or NULL if it's
+* too big to cache. Reloads it if it changed on disk.
+*/
+static sv_http_cached_file_t *SV_Web_GetCachedFile( const char *filename, FileMetadata metadata ) {
+	for( sv_http_cached_file_t & cached : sv_http_cached_files ) {
+		if( cached.filename != NULL && strcmp( cached.filename, filename ) == 0 &&
+			cached.data.n == metadata.size && cached.modified_time == metadata.modified_time ) {
+			cached.refs++;
+			cached.last_used = Sys_Milliseconds();
+			return &cached;
+		}
+	}
+
+	if( metadata.size > MAX_HTTP_CACHE_SIZE ) {
+		return NULL;
+	}
+
+	// make room, least recently used first. files that are still being sent stay put
+	sv_http_cached_file_t *slot = NULL;
+	while( true ) {
+		sv_http_cached_file_t *lru = NULL;
+		for( sv_http_cached_file_t & cached : sv_http_cached_files ) {
+			if( cached.filename == NULL ) {
+				if( slot == NULL ) {
+					slot = &cached;
+				}
+				continue;
+			}
+
+			if( cached.refs == 0 && ( lru == NULL || cached.last_used < lru->last_used ) ) {
+				lru = &cached;
+			}
+		}
+
+		if( slot != NULL && sv_http_cache_size + metadata.size <= MAX_HTTP_CACHE_SIZE ) {
+			break;
+		}
+
+		if( lru == NULL ) {
+			return NULL;
+		}
+
+		SV_Web_FreeCachedFile( lru );
+	}
+
+	Span< u8 > data = ReadFileBinary( sys_allocator, filename );
+	if( data.ptr == NULL || data.n != metadata.size ) {
+		FREE( sys_allocator, data.ptr );
+		return NULL;
+	}
+
+	slot->filename = CopyString( sys_allocator, filename );
+	slot->data = data;
+	slot->hash = Hash64Incremental( data.ptr, data.n );
+	slot->modified_time = metadata.modified_time;
+	slot->refs = 1;
+	slot->last_used = Sys_Milliseconds();
+	sv_http_cache_size += data.n;
+
+	return slot;
+}
+
+static void SV_Web_FreeCachedFiles() {
+	for( sv_http_cached_file_t & cached : sv_http_cached_files ) {
+		if( cached.filename != NULL ) {
+			SV_Web_FreeCachedFile( &cached );
+		}
+	}
+}
+
 static void SV_Web_ResetResponse( sv_http_response_t *response ) {
 	if( response->filename ) {
 		FREE( sys_allocator, response->filename );
@@ -157,8 +293,20 @@ static void SV_Web_ResetResponse( sv_http_response_t *response ) {
 		fclose( response->file );
 		response->file = NULL;
 	}
+	if( response->cached ) {
+		response->cached->refs--;
+		response->cached = NULL;
+	}
+	if( response->body ) {
+		FREE( sys_allocator, response->body );
+		response->body = NULL;
+	}
 
+	response->content_type = NULL;
 	response->filesize = 0;
+	response->etag = 0;
+	response->range_begin = 0;
+	response->range_end = 0;
 	response->filesent = 0;
 
 	SV_Web_ResetStream( &response->stream );
@@ -187,64 +335,98 @@ static void SV_Web_InitConnections() {
 	memset( sv_http_connections, 0, sizeof( sv_http_connections ) );
 }
 
+static void SV_Web_CloseConnection( sv_http_connection_t *con ) {
+	NET_PollerRemove( sv_http_poller, &con->socket );
+	NET_CloseSocket( &con->socket );
+	SV_Web_FreeConnection( con );
+}
+
 static void SV_Web_ShutdownConnections() {
 	for( sv_http_connection_t & con : sv_http_connections ) {
-		if( con.state == HTTP_CONN_STATE_NONE )
-			continue;
-
-		if( con.open ) {
-			NET_CloseSocket( &con.socket );
-			SV_Web_FreeConnection( &con );
+		if( con.state != HTTP_CONN_STATE_NONE ) {
+			SV_Web_CloseConnection( &con );
 		}
 	}
 }
 
-bool SV_Web_AddGameClient( const char *session, int clientNum, const netadr_t *netAdr ) {
-	http_game_client_t *client;
-	trie_error_t trie_error;
-
-	if( !sv_http_initialized ) {
+static bool SV_Web_PushGameClientEvent( http_game_client_event_type_t type, const char *session, int clientNum, const netadr_t *netAdr ) {
+	u32 head = sv_http_client_events_head.load( std::memory_order_relaxed );
+	u32 tail = sv_http_client_events_tail.load( std::memory_order_acquire );
+	if( head - tail == MAX_HTTP_GAME_CLIENT_EVENTS ) {
+		Com_DPrintf( "HTTP client event queue is full\n" );
 		return false;
 	}
 
-	client = ( http_game_client_t * ) Mem_ZoneMalloc( sizeof( *client ) );
-	if( !client ) {
-		return false;
+	http_game_client_event_t *event = &sv_http_client_events[head & ( MAX_HTTP_GAME_CLIENT_EVENTS - 1 )];
+	event->type = type;
+	memcpy( event->client.session, session, HTTP_CLIENT_SESSION_SIZE );
+	event->client.clientNum = clientNum;
+	if( netAdr != NULL ) {
+		event->client.remoteAddress = *netAdr;
 	}
 
-	memcpy( client->session, session, HTTP_CLIENT_SESSION_SIZE );
-	client->clientNum = clientNum;
-	client->remoteAddress = *netAdr;
+	sv_http_client_events_head.store( head + 1, std::memory_order_release );
 
-	Lock( sv_http_clients_mutex );
-	trie_error = Trie_Insert( sv_http_clients, client->session, (void *)client );
-	Unlock( sv_http_clients_mutex );
+	return true;
+}
 
-	if( trie_error != TRIE_OK ) {
-		Mem_ZoneFree( client );
+bool SV_Web_AddGameClient( const char *session, int clientNum, const netadr_t *netAdr ) {
+	if( !sv_http_initialized ) {
 		return false;
 	}
 
-	return true;
+	return SV_Web_PushGameClientEvent( HTTP_GAME_CLIENT_ADD, session, clientNum, netAdr );
 }
 
 void SV_Web_RemoveGameClient( const char *session ) {
-	http_game_client_t *client;
-	trie_error_t trie_error;
-
 	if( !sv_http_initialized ) {
 		return;
 	}
 
-	Lock( sv_http_clients_mutex );
-	trie_error = Trie_Remove( sv_http_clients, session, (void **)&client );
-	Unlock( sv_http_clients_mutex );
+	SV_Web_PushGameClientEvent( HTTP_GAME_CLIENT_REMOVE, session, -1, NULL );
+}
 
-	if( trie_error != TRIE_OK ) {
-		return;
+/*
+* SV_Web_ProcessGameClientEvents
+*
+* Applies everything the game thread queued up to our copy of the clients
+*/
+static void SV_Web_ProcessGameClientEvents() {
+	u32 tail = sv_http_client_events_tail.load( std::memory_order_relaxed );
+	u32 head = sv_http_client_events_head.load( std::memory_order_acquire );
+
+	for( ; tail != head; tail++ ) {
+		const http_game_client_event_t *event = &sv_http_client_events[tail & ( MAX_HTTP_GAME_CLIENT_EVENTS - 1 )];
+		http_game_client_t *client;
+
+		if( event->type == HTTP_GAME_CLIENT_ADD ) {
+			client = ( http_game_client_t * ) Mem_ZoneMalloc( sizeof( *client ) );
+			*client = event->client;
+			if( Trie_Insert( sv_http_clients, client->session, (void *)client ) != TRIE_OK ) {
+				Mem_ZoneFree( client );
+			}
+		}
+		else {
+			if( Trie_Remove( sv_http_clients, event->client.session, (void **)&client ) == TRIE_OK ) {
+				Mem_ZoneFree( client );
+			}
+		}
 	}
 
-	Mem_ZoneFree( client );
+	sv_http_client_events_tail.store( tail, std::memory_order_release );
+}
+
+static void SV_Web_FreeGameClients() {
+	trie_dump_t *dump;
+
+	Trie_Dump( sv_http_clients, "", TRIE_DUMP_VALUES, &dump );
+	for( unsigned int i = 0; i < dump->size; i++ ) {
+		Mem_ZoneFree( dump->key_value_vector[i].value );
+	}
+	Trie_FreeDump( dump );
+
+	Trie_Destroy( sv_http_clients );
+	sv_http_clients = NULL;
 }
 
 static bool SV_Web_FindGameClientBySession( const char *session, int clientNum ) {
@@ -258,9 +440,7 @@ static bool SV_Web_FindGameClientBySession( const char *session, int clientNum )
 		return false;
 	}
 
-	Lock( sv_http_clients_mutex );
 	trie_error = Trie_Find( sv_http_clients, session, TRIE_EXACT_MATCH, (void **)&client );
-	Unlock( sv_http_clients_mutex );
 
 	if( trie_error != TRIE_OK ) {
 		return false;
@@ -280,9 +460,7 @@ static bool SV_Web_FindGameClientBySession( const char *session, int clientNum )
 static bool SV_Web_FindGameClientByAddress( const netadr_t *netadr ) {
 	trie_dump_t *dump;
 
-	Lock( sv_http_clients_mutex );
 	Trie_Dump( sv_http_clients, "", TRIE_DUMP_VALUES, &dump );
-	Unlock( sv_http_clients_mutex );
 
 	bool valid_address = false;
 	for( unsigned int i = 0; i < dump->size; i++ ) {
@@ -330,21 +508,30 @@ static int SV_Web_Send( sv_http_connection_t *con, const void *sendbuf, size_t s
 	return sent;
 }
 
-static s64 SendFileChunk( sv_http_connection_t * con, FILE * f ) {
-	char buf[ 8192 ];
-	size_t r = fread( buf, 1, sizeof( buf ), f );
-	if( r < sizeof( buf ) && ferror( f ) ) {
-		return -1;
+/*
+* SendFileChunk
+*
+* Sends as much of the body as the socket will take, straight from the
+* cache or with sendfile, so it never gets copied through a buffer here
+*/
+static int SendFileChunk( sv_http_connection_t * con ) {
+	sv_http_response_t * response = &con->response;
+	size_t offset = response->range_begin + response->filesent;
+	size_t length = Min2( response->range_end - offset, size_t( S32_MAX ) );
+
+	if( response->cached != NULL ) {
+		return SV_Web_Send( con, response->cached->data.ptr + offset, length );
 	}
 
-	size_t sent = 0;
-	while( sent < r ) {
-		int w = SV_Web_Send( con, buf + sent, r - sent );
-		if( w < 0 )
-			return -1;
-		sent += w;
+	if( response->body != NULL ) {
+		return SV_Web_Send( con, response->body + offset, length );
 	}
 
+	int sent = NET_SendFile( &con->socket, response->file, offset, length );
+	if( sent < 0 ) {
+		Com_DPrintf( "HTTP transmission error to %s\n", NET_AddressToString( &con->address ) );
+		con->open = false;
+	}
 	return sent;
 }
 
@@ -418,6 +605,12 @@ static void SV_Web_AnalyzeHeader( sv_http_request_t *request, const char *key, c
 	else if( !Q_stricmp( key, "X-Session" ) ) {
 		request->clientSession = ZoneCopyString( value );
 	}
+	else if( !Q_stricmp( key, "Range" ) ) {
+		Q_strncpyz( request->range, value, sizeof( request->range ) );
+	}
+	else if( !Q_stricmp( key, "If-Range" ) ) {
+		Q_strncpyz( request->if_range, value, sizeof( request->if_range ) );
+	}
 }
 
 /*
@@ -561,14 +754,68 @@ static void SV_Web_ReceiveRequest( socket_t *socket, sv_http_connection_t *con )
 static const char *SV_Web_ResponseCodeMessage( http_response_code_t code ) {
 	switch( code ) {
 		case HTTP_RESP_OK: return "OK";
+		case HTTP_RESP_PARTIAL_CONTENT: return "Partial Content";
 		case HTTP_RESP_BAD_REQUEST: return "Bad Request";
 		case HTTP_RESP_FORBIDDEN: return "Forbidden";
 		case HTTP_RESP_NOT_FOUND: return "Not Found";
 		case HTTP_RESP_REQUEST_TOO_LARGE: return "Request Entity Too Large";
+		case HTTP_RESP_RANGE_NOT_SATISFIABLE: return "Range Not Satisfiable";
 		default: return "Unknown Error";
 	}
 }
 
+/*
+* SV_Web_ParseRange
+*
+* Only handles a single range, anything fancier gets the whole file.
+* Returns false if the range doesn't overlap the file.
+*/
+static bool SV_Web_ParseRange( const char *range, size_t filesize, size_t *begin, size_t *end ) {
+	*begin = 0;
+	*end = filesize;
+
+	if( strncmp( range, "bytes=", 6 ) != 0 || strchr( range, ',' ) != NULL ) {
+		return true;
+	}
+
+	char first[32], last[32];
+	const char *dash = strchr( range + 6, '-' );
+	if( dash == NULL || size_t( dash - ( range + 6 ) ) >= sizeof( first ) ) {
+		return true;
+	}
+
+	Q_strncpyz( first, range + 6, dash - ( range + 6 ) + 1 );
+	Q_strncpyz( last, dash + 1, sizeof( last ) );
+
+	u64 a, b;
+	bool has_first = TryStringToU64( first, &a );
+	bool has_last = TryStringToU64( last, &b );
+
+	if( has_first ) {
+		if( a >= filesize ) {
+			return false;
+		}
+		*begin = a;
+		if( has_last ) {
+			if( b < a ) {
+				return true;
+			}
+			*end = Min2( b + 1, u64( filesize ) );
+		}
+		return true;
+	}
+
+	// bytes=-n is the last n bytes
+	if( has_last ) {
+		if( b == 0 ) {
+			return false;
+		}
+		*begin = filesize - Min2( b, u64( filesize ) );
+	}
+
+	return true;
+}
+
 static void SV_Web_RouteRequest( const sv_http_request_t *request, sv_http_response_t *response ) {
 	response->filename = CopyString( sys_allocator, request->resource );
 
@@ -577,6 +824,15 @@ static void SV_Web_RouteRequest( const sv_http_request_t *request, sv_http_respo
 		return;
 	}
 
+	if( strcmp( request->resource, "stats" ) == 0 ) {
+		response->body = SV_Stats_CopyJSON( sys_allocator, &response->filesize );
+		response->content_type = "application/json";
+		response->code = HTTP_RESP_OK;
+		response->range_begin = 0;
+		response->range_end = response->filesize;
+		return;
+	}
+
 	// check for malicious URL's
 	if( !COM_ValidateRelativeFilename( request->resource ) ) {
 		response->code = HTTP_RESP_FORBIDDEN;
@@ -596,7 +852,35 @@ static void SV_Web_RouteRequest( const sv_http_request_t *request, sv_http_respo
 	}
 
 	response->filesize = FileSize( response->file );
+
+	TempAllocator temp = sv_http_arena.temp();
+	FileMetadata metadata = FileMetadataOrZeroes( &temp, request->resource );
+	response->etag = Hash64( &metadata, sizeof( metadata ), Hash64( request->resource ) );
+
+	if( ext == ".bsp.zst" && metadata.size == response->filesize ) {
+		response->cached = SV_Web_GetCachedFile( request->resource, metadata );
+		if( response->cached != NULL ) {
+			fclose( response->file );
+			response->file = NULL;
+		}
+	}
+
 	response->code = HTTP_RESP_OK;
+	response->range_begin = 0;
+	response->range_end = response->filesize;
+
+	// a resumed download only gets the rest of the file if it hasn't changed
+	if( request->range[0] != '\0' ) {
+		String< 32 > etag( "\"{016x}\"", response->etag );
+		if( request->if_range[0] == '\0' || etag == request->if_range ) {
+			if( !SV_Web_ParseRange( request->range, response->filesize, &response->range_begin, &response->range_end ) ) {
+				response->code = HTTP_RESP_RANGE_NOT_SATISFIABLE;
+			}
+			else if( response->range_begin != 0 || response->range_end != response->filesize ) {
+				response->code = HTTP_RESP_PARTIAL_CONTENT;
+			}
+		}
+	}
 }
 
 static void SV_Web_RespondToQuery( sv_http_connection_t *con ) {
@@ -610,13 +894,24 @@ static void SV_Web_RespondToQuery( sv_http_connection_t *con ) {
 	else {
 		SV_Web_RouteRequest( request, response );
 
-		if( response->file ) {
+		bool has_body = response->code == HTTP_RESP_OK || response->code == HTTP_RESP_PARTIAL_CONTENT;
+		if( has_body && response->content_type == NULL ) {
 			Com_Printf( "HTTP serving file '%s' to '%s'\n", response->filename, NET_AddressToString( &con->address ) );
 		}
 
-		if( request->method == HTTP_METHOD_HEAD && response->file != NULL ) {
-			fclose( response->file );
-			response->file = NULL;
+		if( request->method == HTTP_METHOD_HEAD || !has_body ) {
+			if( response->file != NULL ) {
+				fclose( response->file );
+				response->file = NULL;
+			}
+			if( response->cached != NULL ) {
+				response->cached->refs--;
+				response->cached = NULL;
+			}
+			if( response->body != NULL ) {
+				FREE( sys_allocator, response->body );
+				response->body = NULL;
+			}
 		}
 	}
 
@@ -626,14 +921,31 @@ static void SV_Web_RespondToQuery( sv_http_connection_t *con ) {
 	headers.append( "HTTP/1.1 {} {}\r\n", response->code, SV_Web_ResponseCodeMessage( response->code ) );
 	headers.append( "Server: " APPLICATION "\r\n" );
 
-	if( response->code == HTTP_RESP_OK ) {
+	if( response->content_type != NULL && response->code == HTTP_RESP_OK ) {
+		headers.append( "Content-Type: {}\r\n", response->content_type );
 		headers.append( "Content-Length: {}\r\n", response->filesize );
+		headers.append( "Cache-Control: no-store\r\n" );
+		headers += "\r\n";
+	}
+	else if( response->code == HTTP_RESP_OK || response->code == HTTP_RESP_PARTIAL_CONTENT ) {
+		headers.append( "Content-Length: {}\r\n", response->range_end - response->range_begin );
+		headers.append( "Accept-Ranges: bytes\r\n" );
+		headers.append( "ETag: \"{016x}\"\r\n", response->etag );
+		if( response->cached != NULL ) {
+			headers.append( "X-Content-Hash: {016x}\r\n", response->cached->hash );
+		}
+		if( response->code == HTTP_RESP_PARTIAL_CONTENT ) {
+			headers.append( "Content-Range: bytes {}-{}/{}\r\n", response->range_begin, response->range_end - 1, response->filesize );
+		}
 		headers.append( "Content-Disposition: attachment; filename=\"{}\"\r\n", FileName( response->filename ) );
 		headers += "\r\n";
 	}
 	else {
 		String< 64 > error( "{} {}\n", response->code, SV_Web_ResponseCodeMessage( response->code ) );;
 
+		if( response->code == HTTP_RESP_RANGE_NOT_SATISFIABLE ) {
+			headers.append( "Content-Range: bytes */{}\r\n", response->filesize );
+		}
 		headers.append( "Content-Type: text/plain\r\n" );
 		headers.append( "Content-Length: {}\r\n", error.length() );
 		headers += "\r\n";
@@ -650,7 +962,7 @@ static void SV_Web_SendResponse( sv_http_connection_t *con ) {
 	sv_http_response_t *response = &con->response;
 	sv_http_stream_t *stream = &response->stream;
 
-	while( sv_http_running ) {
+	while( stream->header_buf_p < stream->header_length && sv_http_running ) {
 		const char * sendbuf = stream->header_buf + stream->header_buf_p;
 		size_t sendbuf_size = stream->header_length - stream->header_buf_p;
 		int sent = SV_Web_Send( con, sendbuf, sendbuf_size );
@@ -659,14 +971,12 @@ static void SV_Web_SendResponse( sv_http_connection_t *con ) {
 
 		stream->header_buf_p += sent;
 		total_sent += sent;
-
-		if( stream->header_buf_p >= stream->header_length ) {
-			break;
-		}
 	}
 
-	while( response->filesent < response->filesize && sv_http_running ) {
-		int sent = SendFileChunk( con, response->file );
+	bool header_done = stream->header_buf_p >= stream->header_length;
+	bool has_body = response->file != NULL || response->cached != NULL || response->body != NULL;
+	while( header_done && has_body && response->range_begin + response->filesent < response->range_end && sv_http_running ) {
+		int sent = SendFileChunk( con );
 		if( sent <= 0 )
 			break;
 		response->filesent += sent;
@@ -677,7 +987,11 @@ static void SV_Web_SendResponse( sv_http_connection_t *con ) {
 		con->last_active = Sys_Milliseconds();
 	}
 
-	con->open = false;
+	// otherwise we pick up where we left off when the socket is writable again
+	bool body_done = !has_body || response->range_begin + response->filesent >= response->range_end;
+	if( header_done && body_done ) {
+		con->open = false;
+	}
 }
 
 static void SV_Web_WriteResponse( socket_t *socket, sv_http_connection_t *con ) {
@@ -755,13 +1069,23 @@ static void SV_Web_Listen( socket_t *socket ) {
 			continue;
 		}
 
-		Com_DPrintf( "HTTP connection accepted from %s\n", NET_AddressToString( &newaddress ) );
 		con = SV_Web_AllocConnection();
 		if( !con ) {
-			break;
+			Com_DPrintf( "HTTP connection refused for %s, too many connections\n", NET_AddressToString( &newaddress ) );
+			NET_CloseSocket( &newsocket );
+			continue;
 		}
+
+		if( !NET_PollerAdd( sv_http_poller, &newsocket, NetPoll_Read, con ) ) {
+			Com_Printf( "HTTP connection from %s failed: %s\n", NET_AddressToString( &newaddress ), NET_ErrorString() );
+			NET_CloseSocket( &newsocket );
+			continue;
+		}
+
+		Com_DPrintf( "HTTP connection accepted from %s\n", NET_AddressToString( &newaddress ) );
 		con->socket = newsocket;
 		con->address = newaddress;
+		con->polling_write = false;
 		con->last_active = Sys_Milliseconds();
 		con->open = true;
 		con->state = HTTP_CONN_STATE_RECV;
@@ -787,76 +1111,103 @@ void SV_Web_Init() {
 		return;
 	}
 
+	sv_http_poller = NET_NewPoller();
+	if( sv_socket_http.address.type == NA_IP ) {
+		NET_PollerAdd( sv_http_poller, &sv_socket_http, NetPoll_Read, &sv_socket_http );
+	}
+	if( sv_socket_http6.address.type == NA_IP6 ) {
+		NET_PollerAdd( sv_http_poller, &sv_socket_http6, NetPoll_Read, &sv_socket_http6 );
+	}
+	sv_http_next_timeout_check = 0;
+
 	sv_http_running = true;
 
 	Trie_Create( TRIE_CASE_SENSITIVE, &sv_http_clients );
-	sv_http_clients_mutex = NewMutex();
+	sv_http_client_events_head.store( 0 );
+	sv_http_client_events_tail.store( 0 );
 	sv_http_thread = NewThread( SV_Web_ThreadProc );
 }
 
+/*
+* SV_Web_HandleConnectionEvent
+*/
+static void SV_Web_HandleConnectionEvent( sv_http_connection_t *con, u32 flags ) {
+	if( flags & NetPoll_Error ) {
+		con->open = false;
+		return;
+	}
+
+	if( flags & NetPoll_Read ) {
+		SV_Web_ReceiveRequest( &con->socket, con );
+	}
+
+	// start responding as soon as the request is in, since the socket is
+	// almost certainly writable, and only wait on it if that didn't finish
+	if( con->open && con->state != HTTP_CONN_STATE_RECV ) {
+		SV_Web_WriteResponse( &con->socket, con );
+
+		if( con->open && !con->polling_write ) {
+			con->polling_write = NET_PollerModify( sv_http_poller, &con->socket, NetPoll_Write, con );
+			if( !con->polling_write ) {
+				con->open = false;
+			}
+		}
+	}
+}
+
 static void SV_Web_Frame() {
-	socket_t *sockets[MAX_INCOMING_HTTP_CONNECTIONS + 1];
-	void *connections[MAX_INCOMING_HTTP_CONNECTIONS];
+	NetPollEvent events[MAX_INCOMING_HTTP_CONNECTIONS + 2];
 
 	if( !sv_http_initialized ) {
 		return;
 	}
 
-	// accept new connections
-	if( sv_socket_http.address.type == NA_IP ) {
-		SV_Web_Listen( &sv_socket_http );
-	}
-	if( sv_socket_http6.address.type == NA_IP6 ) {
-		SV_Web_Listen( &sv_socket_http6 );
+	SV_Web_ProcessGameClientEvents();
+
+	int num_events = NET_Poll( sv_http_poller, HTTP_SERVER_SLEEP_TIME, events, ARRAY_COUNT( events ) );
+	if( num_events < 0 ) {
+		Com_Printf( "HTTP poll failed: %s\n", NET_ErrorString() );
+		return;
 	}
 
-	// handle incoming data
-	int num_sockets = 0;
-	for( sv_http_connection_t & con : sv_http_connections ) {
-		if( con.state == HTTP_CONN_STATE_NONE )
+	for( int i = 0; i < num_events && sv_http_running; i++ ) {
+		// accept new connections
+		if( events[i].user == &sv_socket_http || events[i].user == &sv_socket_http6 ) {
+			SV_Web_Listen( ( socket_t * ) events[i].user );
 			continue;
-		sockets[num_sockets] = &con.socket;
-		connections[num_sockets] = &con;
-		num_sockets++;
-	}
-	sockets[num_sockets] = NULL;
+		}
 
-	if( num_sockets != 0 ) {
-		NET_Monitor( HTTP_SERVER_SLEEP_TIME, sockets,
-					 ( void ( * )( socket_t *, void* ) )SV_Web_ReceiveRequest,
-					 ( void ( * )( socket_t *, void* ) )SV_Web_WriteResponse,
-					 NULL, connections );
-	} else {
-		// sleep on network sockets if got nothing else to do
-		if( sv_socket_http.address.type == NA_IP ) {
-			sockets[num_sockets++] = &sv_socket_http;
+		sv_http_connection_t *con = ( sv_http_connection_t * ) events[i].user;
+		if( con->state == HTTP_CONN_STATE_NONE ) {
+			continue;
 		}
-		if( sv_socket_http6.address.type == NA_IP6 ) {
-			sockets[num_sockets++] = &sv_socket_http6;
+
+		SV_Web_HandleConnectionEvent( con, events[i].flags );
+
+		if( !con->open ) {
+			SV_Web_CloseConnection( con );
 		}
-		sockets[num_sockets] = NULL;
-		NET_Sleep( HTTP_SERVER_SLEEP_TIME, sockets );
 	}
 
-	// close dead connections
+	// close timed out connections
 	if( !sv_http_running ) {
 		return;
 	}
+
+	int64_t now = Sys_Milliseconds();
+	if( now < sv_http_next_timeout_check ) {
+		return;
+	}
+	sv_http_next_timeout_check = now + 1000;
+
 	for( sv_http_connection_t & con : sv_http_connections ) {
 		if( con.state == HTTP_CONN_STATE_NONE )
 			continue;
 
-		if( con.open ) {
-			unsigned int timeout = con.state == HTTP_CONN_STATE_RECV ? INCOMING_HTTP_CONNECTION_RECV_TIMEOUT : INCOMING_HTTP_CONNECTION_SEND_TIMEOUT;
-			if( Sys_Milliseconds() > con.last_active + timeout * 1000 ) {
-				con.open = false;
-				Com_DPrintf( "HTTP connection timeout from %s\n", NET_AddressToString( &con.address ) );
-			}
-		}
-
-		if( !con.open ) {
-			NET_CloseSocket( &con.socket );
-			SV_Web_FreeConnection( &con );
+		unsigned int timeout = con.state == HTTP_CONN_STATE_RECV ? INCOMING_HTTP_CONNECTION_RECV_TIMEOUT : INCOMING_HTTP_CONNECTION_SEND_TIMEOUT;
+		if( now > con.last_active + timeout * 1000 ) {
+			Com_DPrintf( "HTTP connection timeout from %s\n", NET_AddressToString( &con.address ) );
+			SV_Web_CloseConnection( &con );
 		}
 	}
 }
@@ -866,11 +1217,19 @@ bool SV_Web_Running() {
 }
 
 static void SV_Web_ThreadProc( void *param ) {
+	constexpr size_t arena_size = 64 * 1024;
+	void * arena_memory = ALLOC_SIZE( sys_allocator, arena_size, 16 );
+	sv_http_arena = ArenaAllocator( arena_memory, arena_size );
+
 	while( sv_http_running ) {
 		SV_Web_Frame();
 	}
 
 	SV_Web_ShutdownConnections();
+	SV_Web_FreeGameClients();
+	SV_Web_FreeCachedFiles();
+
+	FREE( sys_allocator, arena_memory );
 }
 
 void SV_Web_Shutdown() {
@@ -881,6 +1240,11 @@ void SV_Web_Shutdown() {
 	sv_http_running = false;
 	JoinThread( sv_http_thread );
 
+	NET_PollerRemove( sv_http_poller, &sv_socket_http );
+	NET_PollerRemove( sv_http_poller, &sv_socket_http6 );
+	NET_DeletePoller( sv_http_poller );
+	sv_http_poller = NULL;
+
 	NET_CloseSocket( &sv_socket_http );
 	NET_CloseSocket( &sv_socket_http6 );
 
@@ -1,20 +1,73 @@
+#include <inttypes.h>
+
 #include "qcommon/base.h"
 #include "qcommon/fs.h"
+#include "qcommon/hash.h"
+#include "qcommon/hashtable.h"
 #include "qcommon/span2d.h"
 #include "qcommon/string.h"
+#include "qcommon/threads.h"
 #include "client/renderer/dds.h"
 
 #include "rgbcx/rgbcx.h"
 #include "stb/stb_image.h"
 #include "stb/stb_image_resize.h"
+#include "zstd/zstd.h"
+
+/*
+ * texture cooker. give it a PNG/JPG or a directory and it writes foo.dds.zst
+ * next to every foo.png, which the game loads instead of decoding the PNG
+ *
+ * single channel images and RGBA images with all white RGB become BC4, like
+ * decals want, RGB and opaque RGBA become BC1, and everything else becomes
+ * BC3. you can force a format for things like normal maps
+ *
+ * when cooking a directory we keep <dir>/.texturecache, which maps each
+ * source path to a hash of its contents, so unchanged images get skipped
+ */
+
+// bump this to recook everything
+constexpr u64 COOKER_VERSION = 1;
+constexpr int ZSTD_LEVEL = 19;
+constexpr u32 BC1_LEVEL = 10;
 
 void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
 	printf( "%s\n", msg );
 	abort();
 }
 
+enum CookResult {
+	CookResult_Failed,
+	CookResult_Cooked,
+	CookResult_UpToDate,
+};
+
+struct CookJob {
+	char * src_path;
+	char * dst_path;
+	u64 cached_hash;
+	u64 source_hash;
+	CookResult result;
+};
+
+static DDSTextureFormat forced_format;
+static bool has_forced_format;
+
+static Mutex * jobs_mutex;
+static Mutex * print_mutex;
+static Span< CookJob > jobs;
+static size_t next_job;
+
+template< typename... Rest >
+static void Print( const char * fmt, const Rest & ... rest ) {
+	Lock( print_mutex );
+	ggprint( fmt, rest... );
+	Unlock( print_mutex );
+}
+
 static u32 BlockFormatMipLevels( u32 w, u32 h ) {
-	u32 dim = Max2( w, h );
+	// every level has to be a whole number of blocks
+	u32 dim = Min2( w, h );
 	u32 levels = 0;
 
 	while( dim >= 4 ) {
@@ -30,105 +83,399 @@ static void MipDims( u32 * mip_w, u32 * mip_h, u32 w, u32 h, u32 level ) {
 	*mip_h = Max2( h >> level, u32( 1 ) );
 }
 
-static u32 MipSize( u32 w, u32 h, u32 level ) {
-	MipDims( &w, &h, w, h, level );
-	return w * h;
+static u32 BlockBytes( DDSTextureFormat format ) {
+	return format == DDSTextureFormat_BC1 || format == DDSTextureFormat_BC4 ? 8 : 16;
 }
 
-int main( int argc, char ** argv ) {
-	if( argc != 2 ) {
-		printf( "Usage: bc4 <single channel image.png>\n" );
-		return 1;
+static const char * FormatName( DDSTextureFormat format ) {
+	switch( format ) {
+		case DDSTextureFormat_BC1: return "BC1";
+		case DDSTextureFormat_BC3: return "BC3";
+		case DDSTextureFormat_BC4: return "BC4";
+		case DDSTextureFormat_BC5: return "BC5";
 	}
+	return "?";
+}
 
-	int w, h, comp;
-	u8 * pixels = stbi_load( argv[ 1 ], &w, &h, &comp, 1 );
-	if( pixels == NULL ) {
-		printf( "Can't load image: %s\n", stbi_failure_reason() );
-		return 1;
+static bool ParseFormat( const char * str, DDSTextureFormat * format ) {
+	struct {
+		const char * name;
+		DDSTextureFormat format;
+	} formats[] = {
+		{ "bc1", DDSTextureFormat_BC1 },
+		{ "bc3", DDSTextureFormat_BC3 },
+		{ "bc4", DDSTextureFormat_BC4 },
+		{ "bc5", DDSTextureFormat_BC5 },
+	};
+
+	for( auto f : formats ) {
+		if( strcmp( str, f.name ) == 0 ) {
+			*format = f.format;
+			return true;
+		}
 	}
-	defer { stbi_image_free( pixels ); };
 
-	if( !IsPowerOf2( w ) || !IsPowerOf2( h ) ) {
-		printf( "Image must be power of 2 dimensions\n" );
-		return 1;
+	return false;
+}
+
+static bool IsCookableImage( const char * path ) {
+	const char * ext = strrchr( path, '.' );
+	return ext != NULL && ( strcmp( ext, ".png" ) == 0 || strcmp( ext, ".jpg" ) == 0 );
+}
+
+static Span< u8 > ReadFile( const char * path ) {
+	FILE * file = OpenFile( sys_allocator, path, "rb" );
+	if( file == NULL )
+		return Span< u8 >();
+	defer { fclose( file ); };
+
+	fseek( file, 0, SEEK_END );
+	size_t size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	Span< u8 > contents = ALLOC_SPAN( sys_allocator, u8, size );
+	if( fread( contents.ptr, 1, size, file ) != size ) {
+		FREE( sys_allocator, contents.ptr );
+		return Span< u8 >();
 	}
 
-	if( comp != 1 ) {
-		printf( "Image must be single channel\n" );
-		return 1;
+	return contents;
+}
+
+static bool Exists( const char * path ) {
+	FILE * file = OpenFile( sys_allocator, path, "rb" );
+	if( file == NULL )
+		return false;
+	fclose( file );
+	return true;
+}
+
+static DDSTextureFormat PickFormat( Span2D< const RGBA8 > rgba, int channels ) {
+	if( has_forced_format )
+		return forced_format;
+
+	if( channels == 1 )
+		return DDSTextureFormat_BC4;
+	if( channels == 3 )
+		return DDSTextureFormat_BC1;
+
+	bool white = channels == 4;
+	bool opaque = true;
+	for( u32 y = 0; y < rgba.h; y++ ) {
+		for( u32 x = 0; x < rgba.w; x++ ) {
+			RGBA8 p = rgba( x, y );
+			white = white && p.r == 255 && p.g == 255 && p.b == 255;
+			opaque = opaque && p.a == 255;
+		}
 	}
 
-	u32 num_levels = BlockFormatMipLevels( w, h );
-	u32 total_size = 0;
-	for( u32 i = 0; i < num_levels; i++ ) {
-		total_size += MipSize( w, h, i );
+	if( white )
+		return DDSTextureFormat_BC4;
+	return opaque ? DDSTextureFormat_BC1 : DDSTextureFormat_BC3;
+}
+
+static void EncodeBlock( DDSTextureFormat format, u8 * dst, const RGBA8 * block, u32 bc4_channel ) {
+	const u8 * pixels = ( const u8 * ) block;
+	switch( format ) {
+		case DDSTextureFormat_BC1:
+			rgbcx::encode_bc1( BC1_LEVEL, dst, pixels, false, false );
+			break;
+		case DDSTextureFormat_BC3:
+			rgbcx::encode_bc3( BC1_LEVEL, dst, pixels );
+			break;
+		case DDSTextureFormat_BC4:
+			rgbcx::encode_bc4( dst, pixels + bc4_channel, 4 );
+			break;
+		case DDSTextureFormat_BC5:
+			rgbcx::encode_bc5( dst, pixels, 0, 1, 4 );
+			break;
 	}
+}
 
-	constexpr u32 BC4BitsPerPixel = 4;
-	constexpr u32 BC4BlockSize = ( 4 * 4 * BC4BitsPerPixel ) / 8;
+static bool Cook( CookJob * job, Span< const u8 > png ) {
+	int w, h, channels;
+	u8 * pixels = stbi_load_from_memory( png.ptr, png.num_bytes(), &w, &h, &channels, 4 );
+	if( pixels == NULL ) {
+		Print( "{}: can't load image: {}\n", job->src_path, stbi_failure_reason() );
+		return false;
+	}
+	defer { stbi_image_free( pixels ); };
+
+	if( !IsPowerOf2( w ) || !IsPowerOf2( h ) || w < 4 || h < 4 ) {
+		Print( "{}: image must be power of 2 dimensions and at least 4x4, got {}x{}\n", job->src_path, w, h );
+		return false;
+	}
 
-	u32 bc4_bytes = ( total_size * BC4BitsPerPixel ) / 8;
-	Span< u8 > bc4 = ALLOC_SPAN( sys_allocator, u8, bc4_bytes );
-	u32 bc4_cursor = 0;
+	// stb expands grey to grey grey grey and grey alpha to grey grey grey alpha
+	Span2D< const RGBA8 > rgba( ( const RGBA8 * ) pixels, w, h );
+	DDSTextureFormat format = PickFormat( rgba, channels );
+	u32 bc4_channel = channels == 4 ? 3 : 0;
+	bool srgb = format == DDSTextureFormat_BC1 || format == DDSTextureFormat_BC3;
 
-	u8 * resized = ALLOC_MANY( sys_allocator, u8, w * h );
+	u32 num_levels = BlockFormatMipLevels( w, h );
+	size_t total_size = 0;
+	for( u32 i = 0; i < num_levels; i++ ) {
+		u32 mip_w, mip_h;
+		MipDims( &mip_w, &mip_h, w, h, i );
+		total_size += ( mip_w / 4 ) * ( mip_h / 4 ) * BlockBytes( format );
+	}
 
-	defer { FREE( sys_allocator, bc4.ptr ); };
+	size_t dds_size = sizeof( DDSHeader ) + total_size;
+	u8 * dds = ALLOC_MANY( sys_allocator, u8, dds_size );
+	RGBA8 * resized = ALLOC_MANY( sys_allocator, RGBA8, w * h );
+	defer { FREE( sys_allocator, dds ); };
 	defer { FREE( sys_allocator, resized ); };
 
-	rgbcx::init();
+	DDSHeader header = { };
+	header.magic = DDSMagic;
+	header.height = h;
+	header.width = w;
+	header.mipmap_count = num_levels;
+	header.format = format;
+	memcpy( dds, &header, sizeof( header ) );
 
+	size_t cursor = sizeof( DDSHeader );
 	for( u32 i = 0; i < num_levels; i++ ) {
 		u32 mip_w, mip_h;
 		MipDims( &mip_w, &mip_h, w, h, i );
 
-		int ok = stbir_resize_uint8(
-			pixels, w, h, 0,
-			resized, mip_w, mip_h, 0,
-			1
-		);
+		int ok;
+		if( srgb ) {
+			ok = stbir_resize_uint8_srgb( pixels, w, h, 0, ( u8 * ) resized, mip_w, mip_h, 0, 4, 3, 0 );
+		}
+		else {
+			ok = stbir_resize_uint8( pixels, w, h, 0, ( u8 * ) resized, mip_w, mip_h, 0, 4 );
+		}
 
 		if( ok == 0 ) {
-			printf( "stb_image_resize died lol\n" );
-			return 1;
+			Print( "{}: stb_image_resize died lol\n", job->src_path );
+			return false;
 		}
 
-		Span2D< const u8 > mip = Span2D< u8 >( resized, mip_w, mip_h );
+		Span2D< const RGBA8 > mip( resized, mip_w, mip_h );
 
 		for( u32 row = 0; row < mip_h / 4; row++ ) {
 			for( u32 col = 0; col < mip_w / 4; col++ ) {
-				Span2D< const u8 > src = mip.slice( col * 4, row * 4, 4, 4 );
-				u8 src_block[ 16 ];
-				CopySpan2D( Span2D< u8 >( src_block, 4, 4 ), src );
-
-				Span< u8 > dst = bc4.slice( bc4_cursor, bc4_cursor + BC4BlockSize );
-				rgbcx::encode_bc4( dst.ptr, src_block, 1 );
-				bc4_cursor += BC4BlockSize;
+				RGBA8 block[ 16 ];
+				CopySpan2D( Span2D< RGBA8 >( block, 4, 4 ), mip.slice( col * 4, row * 4, 4, 4 ) );
+				EncodeBlock( format, dds + cursor, block, bc4_channel );
+				cursor += BlockBytes( format );
 			}
 		}
 	}
 
-	assert( bc4_cursor == bc4.num_bytes() );
+	assert( cursor == dds_size );
 
-	DDSHeader dds_header = { };
-	dds_header.magic = DDSMagic;
-	dds_header.height = h;
-	dds_header.width = w;
-	dds_header.mipmap_count = num_levels;
-	dds_header.format = DDSTextureFormat_BC4;
+	size_t compressed_max = ZSTD_compressBound( dds_size );
+	u8 * compressed = ALLOC_MANY( sys_allocator, u8, compressed_max );
+	defer { FREE( sys_allocator, compressed ); };
+
+	size_t compressed_size = ZSTD_compress( compressed, compressed_max, dds, dds_size, ZSTD_LEVEL );
+	if( ZSTD_isError( compressed_size ) ) {
+		Print( "{}: can't compress: {}\n", job->src_path, ZSTD_getErrorName( compressed_size ) );
+		return false;
+	}
+
+	FILE * file = OpenFile( sys_allocator, job->dst_path, "wb" );
+	if( file == NULL ) {
+		Print( "Can't open {} for writing\n", job->dst_path );
+		return false;
+	}
+
+	bool written = fwrite( compressed, 1, compressed_size, file ) == compressed_size;
+	fclose( file );
+	if( !written ) {
+		Print( "Can't write {}\n", job->dst_path );
+		return false;
+	}
+
+	Print( "{} -> {} ({}x{} {})\n", job->src_path, job->dst_path, w, h, FormatName( format ) );
+
+	return true;
+}
 
-	DynamicString dds_path( sys_allocator, "{}.dds", argv[ 1 ] );
+static void CookJobs( void * data ) {
+	while( true ) {
+		Lock( jobs_mutex );
+		size_t idx = next_job;
+		next_job++;
+		Unlock( jobs_mutex );
 
-	FILE * dds = OpenFile( sys_allocator, dds_path.c_str(), "wb" );
-	if( dds == NULL ) {
-		printf( "Can't open %s for writing\n", dds_path.c_str() );
+		if( idx >= jobs.n )
+			break;
+
+		CookJob * job = &jobs[ idx ];
+
+		Span< u8 > png = ReadFile( job->src_path );
+		defer { FREE( sys_allocator, png.ptr ); };
+		if( png.ptr == NULL ) {
+			Print( "Can't read {}\n", job->src_path );
+			job->result = CookResult_Failed;
+			continue;
+		}
+
+		u64 basis = Hash64( COOKER_VERSION );
+		if( has_forced_format ) {
+			basis = Hash64( basis ^ forced_format );
+		}
+		job->source_hash = Hash64( png.ptr, png.num_bytes(), basis );
+
+		if( job->source_hash == job->cached_hash && Exists( job->dst_path ) ) {
+			job->result = CookResult_UpToDate;
+			continue;
+		}
+
+		job->result = Cook( job, png ) ? CookResult_Cooked : CookResult_Failed;
+	}
+}
+
+static void AddJob( DynamicArray< CookJob > * list, const char * path ) {
+	const char * ext = strrchr( path, '.' );
+
+	CookJob job = { };
+	job.src_path = ( *sys_allocator )( "{}", path );
+	job.dst_path = ( *sys_allocator )( "{}.dds.zst", Span< const char >( path, ext - path ) );
+	list->add( job );
+}
+
+static void FindImages( DynamicArray< CookJob > * list, const char * dir ) {
+	ListDirHandle scan = BeginListDir( sys_allocator, dir );
+
+	const char * name;
+	bool is_dir;
+	while( ListDirNext( &scan, &name, &is_dir ) ) {
+		// skip ., .., .git, etc
+		if( name[ 0 ] == '.' )
+			continue;
+
+		char * path = ( *sys_allocator )( "{}/{}", dir, name );
+		defer { FREE( sys_allocator, path ); };
+
+		if( is_dir ) {
+			FindImages( list, path );
+		}
+		else if( IsCookableImage( path ) ) {
+			AddJob( list, path );
+		}
+	}
+}
+
+static Hashtable< 16384 > cache;
+
+static void LoadCache( const char * path ) {
+	Span< u8 > contents = ReadFile( path );
+	defer { FREE( sys_allocator, contents.ptr ); };
+
+	const char * cursor = ( const char * ) contents.ptr;
+	const char * end = cursor + contents.n;
+	while( cursor < end ) {
+		u64 path_hash, source_hash;
+		int chars;
+		if( sscanf( cursor, "%" SCNx64 " %" SCNx64 "\n%n", &path_hash, &source_hash, &chars ) != 2 )
+			break;
+		cache.add( path_hash, source_hash );
+		cursor += chars;
+	}
+}
+
+static void SaveCache( const char * path ) {
+	DynamicString contents( sys_allocator );
+	for( const CookJob & job : jobs ) {
+		if( job.result != CookResult_Failed ) {
+			contents.append( "{016x} {016x}\n", Hash64( job.src_path ), job.source_hash );
+		}
+	}
+
+	FILE * file = OpenFile( sys_allocator, path, "wb" );
+	if( file == NULL ) {
+		printf( "Can't write %s\n", path );
+		return;
+	}
+	fwrite( contents.c_str(), 1, contents.length(), file );
+	fclose( file );
+}
+
+int main( int argc, char ** argv ) {
+	if( argc != 2 && argc != 3 ) {
+		printf( "Usage: bc4 <image.png|directory> [bc1|bc3|bc4|bc5]\n" );
 		return 1;
 	}
 
-	fwrite( &dds_header, sizeof( dds_header ), 1, dds );
-	fwrite( bc4.ptr, sizeof( bc4[ 0 ] ), bc4.n, dds );
-	fclose( dds );
+	if( argc == 3 ) {
+		if( !ParseFormat( argv[ 2 ], &forced_format ) ) {
+			printf( "Unknown format %s\n", argv[ 2 ] );
+			return 1;
+		}
+		has_forced_format = true;
+	}
+
+	const char * root = argv[ 1 ];
+	size_t root_len = strlen( root );
+	while( root_len > 1 && root[ root_len - 1 ] == '/' ) {
+		root_len--;
+	}
+
+	DynamicArray< CookJob > list( sys_allocator );
+	char * cache_path = NULL;
+	defer { FREE( sys_allocator, cache_path ); };
+
+	if( IsCookableImage( root ) ) {
+		AddJob( &list, root );
+	}
+	else {
+		char * dir = ( *sys_allocator )( "{}", Span< const char >( root, root_len ) );
+		defer { FREE( sys_allocator, dir ); };
+
+		FindImages( &list, dir );
+		cache_path = ( *sys_allocator )( "{}/.texturecache", dir );
+		LoadCache( cache_path );
+
+		for( CookJob & job : list ) {
+			cache.get( Hash64( job.src_path ), &job.cached_hash );
+		}
+	}
+
+	defer {
+		for( CookJob & job : list ) {
+			FREE( sys_allocator, job.src_path );
+			FREE( sys_allocator, job.dst_path );
+		}
+	};
+
+	rgbcx::init();
+
+	jobs = list.span();
+	next_job = 0;
+	jobs_mutex = NewMutex();
+	print_mutex = NewMutex();
+	defer { DeleteMutex( jobs_mutex ); };
+	defer { DeleteMutex( print_mutex ); };
+
+	{
+		Thread * threads[ 64 ];
+		u32 num_threads = Min2( GetCoreCount(), u32( ARRAY_COUNT( threads ) ) );
+		for( u32 i = 0; i < num_threads; i++ ) {
+			threads[ i ] = NewThread( CookJobs, NULL );
+		}
+		for( u32 i = 0; i < num_threads; i++ ) {
+			JoinThread( threads[ i ] );
+		}
+	}
+
+	u32 cooked = 0;
+	u32 up_to_date = 0;
+	u32 failed = 0;
+	for( const CookJob & job : jobs ) {
+		cooked += job.result == CookResult_Cooked ? 1 : 0;
+		up_to_date += job.result == CookResult_UpToDate ? 1 : 0;
+		failed += job.result == CookResult_Failed ? 1 : 0;
+	}
+
+	if( cache_path != NULL ) {
+		SaveCache( cache_path );
+	}
+
+	ggprint( "{} cooked, {} up to date, {} failed\n", cooked, up_to_date, failed );
 
-	return 0;
+	return failed == 0 ? 0 : 1;
 }
@@ -15,6 +15,7 @@ bin( "bc4", {
 		"source/tools/bc4/bc4.cpp",
 		"source/qcommon/allocators.cpp",
 		"source/qcommon/base.cpp",
+		"source/qcommon/hash.cpp",
 		platform_srcs,
 	},
 
@@ -24,6 +25,7 @@ bin( "bc4", {
 		"stb_image",
 		"stb_image_resize",
 		"tracy",
+		"zstd",
 	},
 
 	gcc_extra_ldflags = "-lm -lpthread -ldl -no-pie -static-libstdc++",
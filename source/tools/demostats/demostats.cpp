@@ -0,0 +1,524 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "zlib/zlib.h"
+#include "zstd/zstd.h"
+
+#include "qcommon/qcommon.h"
+#include "cgame/cg_public.h"
+#include "gameshared/gs_weapons.h"
+
+/*
+ * runs demos through the snapshot parser as fast as they decode and prints
+ * what happened in them as JSON, one object per line, for stats pipelines.
+ * there's no renderer, sound or cgame, we fire events off the parsed
+ * entities the same way CG_FireEntityEvents does
+ *
+ * server demos are the ones you want, they're multipov so they have every
+ * player's damage and position in them. client demos only have what that
+ * client could see
+ */
+
+snapshot_t *SNAP_ParseFrame( msg_t *msg, snapshot_t *lastFrame, snapshot_t *backup, SyncEntityState *baselines, int showNet );
+void SNAP_ParseBaseline( msg_t *msg, SyncEntityState *baselines );
+
+void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
+	fprintf( stderr, "%s\n", msg );
+	abort();
+}
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vfprintf( stderr, format, argptr );
+	va_end( argptr );
+}
+
+void Com_DPrintf( const char * format, ... ) { }
+
+void Com_Error( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vfprintf( stderr, format, argptr );
+	va_end( argptr );
+	fprintf( stderr, "\n" );
+	exit( 1 );
+}
+
+struct DemoState {
+	SyncEntityState baselines[ MAX_BASELINES ];
+	snapshot_t backup[ UPDATE_BACKUP ];
+	char configstrings[ MAX_CONFIGSTRINGS ][ MAX_CONFIGSTRING_CHARS ];
+
+	int64_t start_time;
+	int64_t last_time;
+	int64_t next_positions_time;
+	size_t frames;
+};
+
+static void PrintJSONString( const char * str ) {
+	putchar( '"' );
+	for( const char * p = str; *p != '\0'; p++ ) {
+		unsigned char c = *p;
+		if( c == '"' || c == '\\' ) {
+			printf( "\\%c", c );
+		}
+		else if( c < 0x20 ) {
+			printf( "\\u%04x", c );
+		}
+		else {
+			putchar( c );
+		}
+	}
+	putchar( '"' );
+}
+
+static void PrintVec3( Vec3 v ) {
+	printf( "[%.1f,%.1f,%.1f]", v.x, v.y, v.z );
+}
+
+// player entity numbers start at 1
+static void PrintPlayer( const DemoState * demo, const char * key, int ent ) {
+	printf( ",\"%s\":%d,\"%s_name\":", key, ent, key );
+	if( ent >= 1 && ent <= MAX_CLIENTS ) {
+		PrintJSONString( demo->configstrings[ CS_PLAYERINFOS + ent - 1 ] );
+	}
+	else {
+		printf( "null" );
+	}
+}
+
+static const char * DamageTypeName( DamageType type ) {
+	WeaponType weapon;
+	GadgetType gadget;
+	WorldDamage world;
+	DamageCategory category = DecodeDamageType( type, &weapon, &gadget, &world );
+
+	if( category == DamageCategory_Weapon ) {
+		return GetWeaponInfo( weapon )->short_name;
+	}
+	if( category == DamageCategory_Gadget ) {
+		return GetGadgetDef( gadget )->short_name;
+	}
+
+	switch( world ) {
+		case WorldDamage_Slime: return "slime";
+		case WorldDamage_Lava: return "lava";
+		case WorldDamage_Crush: return "crush";
+		case WorldDamage_Telefrag: return "telefrag";
+		case WorldDamage_Suicide: return "suicide";
+		case WorldDamage_Explosion: return "explosion";
+		case WorldDamage_Trigger: return "trigger";
+		case WorldDamage_Laser: return "laser";
+		case WorldDamage_Spike: return "spike";
+		case WorldDamage_Void: return "void";
+	}
+
+	return "unknown";
+}
+
+static void SetConfigstring( DemoState * demo, int idx, const char * str ) {
+	if( idx < 0 || idx >= MAX_CONFIGSTRINGS ) {
+		Com_Error( "Bad configstring index: %d", idx );
+	}
+	Q_strncpyz( demo->configstrings[ idx ], str, sizeof( demo->configstrings[ idx ] ) );
+}
+
+/*
+ * cs <index> "<string>" [<index> "<string>" ...]
+ */
+static void ParseConfigstringCommand( DemoState * demo, const char * cmd ) {
+	if( strncmp( cmd, "cs ", 3 ) != 0 ) {
+		return;
+	}
+
+	const char * p = cmd + 3;
+	while( true ) {
+		char * end;
+		long idx = strtol( p, &end, 10 );
+		if( end == p ) {
+			return;
+		}
+
+		p = end;
+		while( *p == ' ' ) {
+			p++;
+		}
+		if( *p != '"' ) {
+			return;
+		}
+		p++;
+
+		const char * close = strchr( p, '"' );
+		if( close == NULL ) {
+			return;
+		}
+
+		char str[ MAX_CONFIGSTRING_CHARS ];
+		size_t len = Min2( size_t( close - p ), sizeof( str ) - 1 );
+		memcpy( str, p, len );
+		str[ len ] = '\0';
+		SetConfigstring( demo, int( idx ), str );
+
+		p = close + 1;
+	}
+}
+
+static void PrintObituary( const DemoState * demo, int64_t time, const char * cmd ) {
+	int victim, attacker, assistor, damage_type, wallbang;
+	if( sscanf( cmd, "obry %d %d %d %d %d", &victim, &attacker, &assistor, &damage_type, &wallbang ) != 5 ) {
+		return;
+	}
+
+	DamageType type;
+	type.encoded = u8( damage_type );
+
+	printf( "{\"type\":\"kill\",\"time\":%" PRIi64, time );
+	PrintPlayer( demo, "victim", victim );
+	PrintPlayer( demo, "attacker", attacker );
+	PrintPlayer( demo, "assist", assistor );
+	printf( ",\"weapon\":\"%s\",\"wallbang\":%s}\n", DamageTypeName( type ), wallbang == 1 ? "true" : "false" );
+}
+
+/*
+ * damage events are spawned at the victim's origin and don't say who the
+ * victim was, so take the closest player
+ */
+static int ClosestPlayer( const snapshot_t * snap, Vec3 origin ) {
+	int best = 0;
+	float best_dist = FLT_MAX;
+	for( int i = 0; i < snap->numEntities; i++ ) {
+		const SyncEntityState * ent = snap->parsedEntities[ i ];
+		if( ent->type != ET_PLAYER ) {
+			continue;
+		}
+
+		float dist = LengthSquared( ent->origin - origin );
+		if( dist < best_dist ) {
+			best = ent->number;
+			best_dist = dist;
+		}
+	}
+
+	return best;
+}
+
+static void PrintEntityEvents( const DemoState * demo, const snapshot_t * snap, int64_t time ) {
+	for( int i = 0; i < snap->numEntities; i++ ) {
+		const SyncEntityState * ent = snap->parsedEntities[ i ];
+
+		for( int j = 0; j < 2; j++ ) {
+			if( ent->events[ j ].type != EV_DAMAGE ) {
+				continue;
+			}
+
+			u64 parm = ent->events[ j ].parm;
+			int damage = int( parm >> 1 );
+			bool headshot = ( parm & 1 ) != 0;
+
+			// 255 is the kill marker, we get those from obituaries
+			if( damage == 255 ) {
+				continue;
+			}
+
+			printf( "{\"type\":\"damage\",\"time\":%" PRIi64, time );
+			PrintPlayer( demo, "victim", ClosestPlayer( snap, ent->origin ) );
+			PrintPlayer( demo, "attacker", ent->ownerNum );
+			printf( ",\"damage\":%d,\"headshot\":%s,\"origin\":", damage, headshot ? "true" : "false" );
+			PrintVec3( ent->origin );
+			printf( "}\n" );
+		}
+	}
+}
+
+static void PrintPlayerPosition( const DemoState * demo, const SyncPlayerState * ps, int64_t time ) {
+	printf( "{\"type\":\"position\",\"time\":%" PRIi64, time );
+	PrintPlayer( demo, "player", ps->POVnum );
+	printf( ",\"team\":%d,\"health\":%d,\"weapon\":\"%s\",\"origin\":", ps->team, ps->health, GetWeaponInfo( ps->weapon )->short_name );
+	PrintVec3( ps->pmove.origin );
+	printf( ",\"velocity\":" );
+	PrintVec3( ps->pmove.velocity );
+	printf( "}\n" );
+}
+
+static void PrintFrame( DemoState * demo, const snapshot_t * snap, int positions_interval ) {
+	if( demo->frames == 0 ) {
+		demo->start_time = snap->serverTime;
+		demo->next_positions_time = snap->serverTime;
+	}
+	demo->frames++;
+	demo->last_time = snap->serverTime;
+
+	int64_t time = snap->serverTime - demo->start_time;
+
+	for( int i = 0; i < snap->numgamecommands; i++ ) {
+		const char * cmd = snap->gamecommandsData + snap->gamecommands[ i ].commandOffset;
+		if( strncmp( cmd, "obry ", 5 ) == 0 ) {
+			PrintObituary( demo, time, cmd );
+		}
+	}
+
+	PrintEntityEvents( demo, snap, time );
+
+	if( positions_interval > 0 && snap->serverTime >= demo->next_positions_time ) {
+		if( snap->multipov ) {
+			for( int i = 0; i < snap->numplayers; i++ ) {
+				PrintPlayerPosition( demo, &snap->playerStates[ i ], time );
+			}
+		}
+		else {
+			PrintPlayerPosition( demo, &snap->playerState, time );
+		}
+		demo->next_positions_time += positions_interval;
+	}
+}
+
+static void PrintMetaData( const char * meta_data, size_t len ) {
+	const char * end = meta_data + len;
+	const char * s = meta_data;
+	while( s < end && *s != '\0' ) {
+		const char * value = s + strnlen( s, end - s ) + 1;
+		if( value >= end ) {
+			break;
+		}
+
+		printf( "," );
+		PrintJSONString( s );
+		printf( ":" );
+		PrintJSONString( value );
+
+		s = value + strnlen( value, end - value ) + 1;
+	}
+}
+
+/*
+ * server demos are zstd frames with a skippable trailer on the end, which
+ * ZSTD_decompressStream skips over by itself. gzread passes files that
+ * aren't gzipped through untouched, so both go through the same gzFile
+ */
+struct DemoReader {
+	gzFile gz;
+	ZSTD_DStream * zstd;
+	ZSTD_inBuffer input;
+	u8 buf[ 64 * 1024 ];
+};
+
+static bool OpenDemo( DemoReader * reader, const char * path ) {
+	reader->gz = gzopen( path, "rb" );
+	if( reader->gz == NULL )
+		return false;
+
+	reader->zstd = NULL;
+	reader->input = { reader->buf, 0, 0 };
+
+	u32 magic;
+	if( gzread( reader->gz, &magic, sizeof( magic ) ) == sizeof( magic ) && LittleLong( magic ) == ZSTD_MAGICNUMBER ) {
+		reader->zstd = ZSTD_createDStream();
+	}
+	gzrewind( reader->gz );
+
+	return true;
+}
+
+static void CloseDemo( DemoReader * reader ) {
+	ZSTD_freeDStream( reader->zstd );
+	gzclose( reader->gz );
+}
+
+static size_t ReadDemoBytes( DemoReader * reader, void * dst, size_t n ) {
+	if( reader->zstd == NULL ) {
+		int r = gzread( reader->gz, dst, n );
+		return r < 0 ? 0 : size_t( r );
+	}
+
+	ZSTD_outBuffer output = { dst, n, 0 };
+	while( output.pos < output.size ) {
+		if( reader->input.pos == reader->input.size ) {
+			int r = gzread( reader->gz, reader->buf, sizeof( reader->buf ) );
+			reader->input = { reader->buf, size_t( Max2( r, 0 ) ), 0 };
+		}
+
+		size_t before = output.pos;
+		size_t r = ZSTD_decompressStream( reader->zstd, &output, &reader->input );
+		if( ZSTD_isError( r ) ) {
+			Com_Error( "Can't decompress demo: %s", ZSTD_getErrorName( r ) );
+		}
+
+		if( reader->input.size == 0 && output.pos == before )
+			break;
+	}
+
+	return output.pos;
+}
+
+static bool ReadDemoMessage( DemoReader * reader, msg_t * msg ) {
+	s32 len;
+	if( ReadDemoBytes( reader, &len, sizeof( len ) ) != sizeof( len ) || len == -1 ) {
+		return false;
+	}
+	len = LittleLong( len );
+
+	if( len < 0 || size_t( len ) > msg->maxsize ) {
+		Com_Error( "Bad demo message length: %d", len );
+	}
+
+	if( ReadDemoBytes( reader, msg->data, len ) != size_t( len ) ) {
+		Com_Error( "Demo file is truncated" );
+	}
+
+	msg->cursize = len;
+	msg->readcount = 0;
+	return true;
+}
+
+// zstd demos keep their meta data in the trailer, see SNAP_WriteDemoTrailer
+static void PrintTrailerMetaData( const char * path ) {
+	FILE * file = fopen( path, "rb" );
+	if( file == NULL )
+		return;
+	defer { fclose( file ); };
+
+	s32 footer[ 2 ];
+	if( fseek( file, -s32( sizeof( footer ) ), SEEK_END ) != 0 || fread( footer, sizeof( footer ), 1, file ) != 1 )
+		return;
+	if( LittleLong( footer[ 1 ] ) != SNAP_DEMO_TRAILER_MAGIC )
+		return;
+
+	// skippable frame magic, frame size, meta data size
+	s32 header[ 3 ];
+	if( fseek( file, LittleLong( footer[ 0 ] ), SEEK_SET ) != 0 || fread( header, sizeof( header ), 1, file ) != 1 )
+		return;
+
+	size_t len = Min2( size_t( LittleLong( header[ 2 ] ) ), size_t( SNAP_MAX_DEMO_META_DATA_SIZE ) );
+	static char meta_data[ SNAP_MAX_DEMO_META_DATA_SIZE ];
+	if( fread( meta_data, 1, len, file ) == len ) {
+		PrintMetaData( meta_data, len );
+	}
+}
+
+static bool ProcessDemo( const char * path, int positions_interval ) {
+	static DemoReader reader;
+	if( !OpenDemo( &reader, path ) ) {
+		fprintf( stderr, "Can't open %s\n", path );
+		return false;
+	}
+	defer { CloseDemo( &reader ); };
+
+	static DemoState demo;
+	memset( &demo, 0, sizeof( demo ) );
+	snapshot_t * last_frame = NULL;
+
+	uint8_t msg_buf[ MAX_MSGLEN ];
+	msg_t msg;
+	MSG_Init( &msg, msg_buf, sizeof( msg_buf ) );
+
+	u64 t0 = Sys_Microseconds();
+
+	printf( "{\"type\":\"demo\",\"path\":" );
+	PrintJSONString( path );
+	if( reader.zstd != NULL ) {
+		PrintTrailerMetaData( path );
+	}
+
+	bool printed_header = false;
+
+	while( ReadDemoMessage( &reader, &msg ) ) {
+		while( msg.readcount < msg.cursize ) {
+			int cmd = MSG_ReadUint8( &msg );
+			switch( cmd ) {
+				case svc_servercmd:
+					MSG_ReadInt32( &msg );
+					ParseConfigstringCommand( &demo, MSG_ReadString( &msg ) );
+					break;
+
+				case svc_servercs:
+					ParseConfigstringCommand( &demo, MSG_ReadString( &msg ) );
+					break;
+
+				case svc_configstrings: {
+					MSG_ReadInt32( &msg );
+					u64 count = MSG_ReadUintBase128( &msg );
+					for( u64 i = 0; i < count && msg.readcount < msg.cursize; i++ ) {
+						int idx = MSG_ReadUintBase128( &msg );
+						SetConfigstring( &demo, idx, MSG_ReadString( &msg ) );
+					}
+				} break;
+
+				case svc_serverdata:
+					MSG_ReadInt32( &msg );
+					MSG_ReadInt32( &msg );
+					MSG_ReadInt16( &msg );
+					MSG_ReadInt16( &msg );
+					MSG_ReadString( &msg );
+					break;
+
+				case svc_spawnbaseline:
+					SNAP_ParseBaseline( &msg, demo.baselines );
+					break;
+
+				case svc_demoinfo: {
+					MSG_ReadInt32( &msg );
+					MSG_ReadInt32( &msg );
+					size_t meta_data_realsize = MSG_ReadInt32( &msg );
+					size_t meta_data_maxsize = MSG_ReadInt32( &msg );
+					meta_data_realsize = Min2( meta_data_realsize, meta_data_maxsize );
+					if( !printed_header ) {
+						PrintMetaData( ( const char * ) msg.data + msg.readcount, Min2( meta_data_realsize, msg.cursize - msg.readcount ) );
+					}
+					MSG_SkipData( &msg, meta_data_maxsize );
+				} break;
+
+				case svc_frame: {
+					if( !printed_header ) {
+						printf( "}\n" );
+						printed_header = true;
+					}
+
+					snapshot_t * snap = SNAP_ParseFrame( &msg, last_frame, demo.backup, demo.baselines, 0 );
+					if( snap->valid ) {
+						last_frame = snap;
+						PrintFrame( &demo, snap, positions_interval );
+					}
+				} break;
+
+				default:
+					Com_Error( "Unknown demo message: %d", cmd );
+			}
+		}
+	}
+
+	if( !printed_header ) {
+		printf( "}\n" );
+	}
+
+	u64 usec = Sys_Microseconds() - t0;
+	int64_t duration = demo.frames == 0 ? 0 : demo.last_time - demo.start_time;
+
+	printf( "{\"type\":\"end\",\"frames\":%zu,\"duration\":%" PRIi64 "}\n", demo.frames, duration );
+	fprintf( stderr, "%s: %zu frames in %.1fms, %.0fx realtime\n", path, demo.frames, usec / 1000.0, usec == 0 ? 0.0 : duration * 1000.0 / usec );
+
+	return true;
+}
+
+int main( int argc, char ** argv ) {
+	int positions_interval = 1000;
+	int first_demo = 1;
+
+	if( argc >= 3 && strcmp( argv[ 1 ], "-positions" ) == 0 ) {
+		positions_interval = atoi( argv[ 2 ] );
+		first_demo = 3;
+	}
+
+	if( first_demo >= argc ) {
+		fprintf( stderr, "Usage: demostats [-positions <msecs>] <demo" APP_DEMO_EXTENSION_STR ">...\n" );
+		fprintf( stderr, "Prints kills, damage and player positions as JSON lines. -positions 0 turns positions off\n" );
+		return 1;
+	}
+
+	bool ok = true;
+	for( int i = first_demo; i < argc; i++ ) {
+		ok = ProcessDemo( argv[ i ], positions_interval ) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
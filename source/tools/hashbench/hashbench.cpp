@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <new>
+
+#include "qcommon/qcommon.h"
+#include "qcommon/dynamic_hashtable.h"
+#include "qcommon/hash.h"
+#include "qcommon/hashtable.h"
+
+/*
+ * runs the same workload through Hashtable and NonRAIIDynamicHashtable and
+ * reports ns per op. keys are Hash64s like asset and material names, and
+ * the fixed tables are sized the way the engine sizes them, twice the
+ * number of entries
+ *
+ * both tables have to return the same thing for every op or it fails
+ *
+ * then it does the same for string hashing, fnv1a against Hash64 on
+ * asset path sized strings and big buffers, and checks Hash64_CT agrees
+ * with Hash64
+ */
+
+void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
+	printf( "%s\n", msg );
+	abort();
+}
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+}
+
+void Com_DPrintf( const char * format, ... ) { }
+
+void Com_Error( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+enum BenchOp {
+	BenchOp_Add,
+	BenchOp_GetHit,
+	BenchOp_GetMiss,
+	BenchOp_Remove,
+	BenchOp_GetMixed,
+
+	BenchOp_Count
+};
+
+static const char * bench_op_names[] = { "add", "get hit", "get miss", "remove", "get mixed" };
+STATIC_ASSERT( ARRAY_COUNT( bench_op_names ) == BenchOp_Count );
+
+struct BenchResults {
+	u64 usec[ BenchOp_Count ];
+	u64 ops[ BenchOp_Count ];
+	u64 checksum;
+};
+
+static u64 Key( size_t i ) {
+	return Hash64( u64( i ) + 1 );
+}
+
+// visits [0, n) out of order so lookups don't walk the table in insertion order
+static size_t Shuffle( size_t i, size_t n ) {
+	return ( i * 7919 ) % n;
+}
+
+template< typename Table >
+static void Bench( Table * table, size_t n, int rounds, BenchResults * results ) {
+	*results = { };
+
+	for( int round = 0; round < rounds; round++ ) {
+		table->clear();
+
+		u64 t0 = Sys_Microseconds();
+		for( size_t i = 0; i < n; i++ ) {
+			results->checksum += table->add( Key( i ), i ) ? 1 : 0;
+		}
+		results->usec[ BenchOp_Add ] += Sys_Microseconds() - t0;
+		results->ops[ BenchOp_Add ] += n;
+
+		t0 = Sys_Microseconds();
+		for( size_t i = 0; i < n; i++ ) {
+			u64 value;
+			if( table->get( Key( Shuffle( i, n ) ), &value ) ) {
+				results->checksum += value;
+			}
+		}
+		results->usec[ BenchOp_GetHit ] += Sys_Microseconds() - t0;
+		results->ops[ BenchOp_GetHit ] += n;
+
+		t0 = Sys_Microseconds();
+		for( size_t i = 0; i < n; i++ ) {
+			u64 value;
+			if( table->get( Key( n + i ), &value ) ) {
+				results->checksum += value;
+			}
+		}
+		results->usec[ BenchOp_GetMiss ] += Sys_Microseconds() - t0;
+		results->ops[ BenchOp_GetMiss ] += n;
+
+		t0 = Sys_Microseconds();
+		for( size_t i = 0; i < n; i += 2 ) {
+			results->checksum += table->remove( Key( Shuffle( i, n ) ) ) ? 3 : 0;
+		}
+		results->usec[ BenchOp_Remove ] += Sys_Microseconds() - t0;
+		results->ops[ BenchOp_Remove ] += ( n + 1 ) / 2;
+
+		t0 = Sys_Microseconds();
+		for( size_t i = 0; i < n; i++ ) {
+			u64 value;
+			if( table->get( Key( Shuffle( i, n ) ), &value ) ) {
+				results->checksum += value * 5;
+			}
+		}
+		results->usec[ BenchOp_GetMixed ] += Sys_Microseconds() - t0;
+		results->ops[ BenchOp_GetMixed ] += n;
+	}
+}
+
+static void PrintResults( const char * name, const BenchResults & results ) {
+	printf( "  %-10s", name );
+	for( int i = 0; i < BenchOp_Count; i++ ) {
+		double ns = results.ops[ i ] == 0 ? 0.0 : results.usec[ i ] * 1000.0 / results.ops[ i ];
+		printf( " %9.2f", ns );
+	}
+	printf( "\n" );
+}
+
+template< size_t N >
+static bool BenchSize( int rounds ) {
+	// Hashtable stores everything inline so it doesn't fit on the stack
+	Hashtable< N * 2 > * fixed = new ( ALLOC( sys_allocator, Hashtable< N * 2 > ) ) Hashtable< N * 2 >();
+	defer { FREE( sys_allocator, fixed ); };
+
+	NonRAIIDynamicHashtable dynamic;
+	dynamic.init( sys_allocator );
+	defer { dynamic.shutdown(); };
+
+	BenchResults fixed_results, dynamic_results;
+	Bench( fixed, N, rounds, &fixed_results );
+	Bench( &dynamic, N, rounds, &dynamic_results );
+
+	printf( "%zu entries, ns/op:\n", N );
+	printf( "  %-10s", "" );
+	for( const char * op : bench_op_names ) {
+		printf( " %9s", op );
+	}
+	printf( "\n" );
+	PrintResults( "Hashtable", fixed_results );
+	PrintResults( "dynamic", dynamic_results );
+
+	if( fixed_results.checksum != dynamic_results.checksum ) {
+		printf( "  mismatch: %016" PRIx64 " vs %016" PRIx64 "\n", fixed_results.checksum, dynamic_results.checksum );
+		return false;
+	}
+
+	return true;
+}
+
+// must match the runtime version, see HashCTMatches
+static constexpr u64 ct_hash = Hash64_CT( "models/players/rigg/model", 25 );
+STATIC_ASSERT( ct_hash != 0 );
+
+static bool HashCTMatches() {
+	const char str[] = "sounds/vsay/yes/0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXY";
+	STATIC_ASSERT( sizeof( str ) > 65 );
+
+	bool ok = ct_hash == Hash64( "models/players/rigg/model" );
+	for( size_t i = 0; i <= 64; i++ ) {
+		ok = ok && Hash64_CT( str, i ) == Hash64( str, i );
+		ok = ok && Hash64_CT( str, i, 12345 ) == Hash64( str, i, 12345 );
+	}
+
+	if( !ok ) {
+		printf( "Hash64_CT doesn't match Hash64\n" );
+	}
+
+	return ok;
+}
+
+template< typename F >
+static double StringHashNs( Span< const u8 > data, size_t len, size_t iters, u64 * checksum, F hash ) {
+	u64 t0 = Sys_Microseconds();
+	for( size_t i = 0; i < iters; i++ ) {
+		size_t offset = ( i * 7 ) % ( data.n - len + 1 );
+		*checksum += hash( data.ptr + offset, len );
+	}
+	return ( Sys_Microseconds() - t0 ) * 1000.0 / iters;
+}
+
+static void BenchStringHash( int rounds ) {
+	constexpr size_t buffer_size = 1024 * 1024;
+	Span< u8 > data = ALLOC_SPAN( sys_allocator, u8, buffer_size + 64 );
+	defer { FREE( sys_allocator, data.ptr ); };
+
+	for( size_t i = 0; i < data.n; i++ ) {
+		data[ i ] = 'a' + Hash64( u64( i ) ) % 26;
+	}
+
+	auto fnv = []( const u8 * p, size_t n ) { return Hash64Incremental( p, n ); };
+	auto wy = []( const u8 * p, size_t n ) { return Hash64( p, n ); };
+
+	printf( "string hashing, ns/hash:\n" );
+	printf( "  %-10s %9s %9s\n", "bytes", "fnv1a", "Hash64" );
+
+	u64 checksum = 0;
+	const size_t lengths[] = { 8, 16, 24, 32, 48, 64, 256, buffer_size };
+	for( size_t len : lengths ) {
+		size_t iters = Max2( size_t( rounds ) * 100000 / ( len + 16 ), size_t( 4 ) );
+		double fnv_ns = StringHashNs( data, len, iters, &checksum, fnv );
+		double wy_ns = StringHashNs( data, len, iters, &checksum, wy );
+		printf( "  %-10zu %9.2f %9.2f\n", len, fnv_ns, wy_ns );
+	}
+
+	// so the loops don't get optimised out
+	if( checksum == 0 ) {
+		printf( "  checksum is zero\n" );
+	}
+}
+
+int main( int argc, char ** argv ) {
+	if( argc > 2 ) {
+		printf( "Usage: hashbench [rounds]\n" );
+		return 1;
+	}
+
+	int rounds = argc == 2 ? atoi( argv[ 1 ] ) : 100;
+	if( rounds <= 0 ) {
+		printf( "Rounds must be positive\n" );
+		return 1;
+	}
+
+	bool ok = true;
+	ok = BenchSize< 64 >( rounds * 64 ) && ok;
+	ok = BenchSize< 1024 >( rounds * 4 ) && ok;
+	ok = BenchSize< 4096 >( rounds ) && ok;
+	ok = BenchSize< 65536 >( Max2( rounds / 16, 1 ) ) && ok;
+
+	ok = HashCTMatches() && ok;
+	BenchStringHash( rounds );
+
+	printf( ok ? "ok\n" : "failed\n" );
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,784 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <algorithm>
+
+#include "qcommon/qcommon.h"
+#include "qcommon/array.h"
+#include "qcommon/csprng.h"
+#include "qcommon/fs.h"
+#include "qcommon/rng.h"
+#include "qcommon/version.h"
+#include "cgame/cg_public.h"
+
+/*
+ * connects a swarm of headless clients to a server over real UDP netchans,
+ * has them run around on a script, and reports how the snapshots hold up
+ * as the swarm grows. each step doubles the number of clients until it
+ * gets to the requested count, waits for all of them to be in the game,
+ * then measures for a while
+ *
+ * the server doesn't tell clients how long its frames take, so tick time
+ * is measured from the outside: snapshots are sent once per server frame,
+ * so the gaps between them arriving stretch out and get late when the
+ * server can't keep up. loss comes from netchan sequence gaps and server
+ * frames that never showed up
+ *
+ * every client comes from the same address, so run the server with
+ * sv_iplimit 0 or it will only let 3 in
+ *
+ * snap_read keeps one entity ring for everything it parses, sized for a
+ * single client's backup. clients delta off their newest frame and parse
+ * one at a time, so in practice they all fit, but don't trust the parsed
+ * entities for anything beyond keeping the delta chain going
+ */
+
+snapshot_t *SNAP_ParseFrame( msg_t *msg, snapshot_t *lastFrame, snapshot_t *backup, SyncEntityState *baselines, int showNet );
+void SNAP_ParseBaseline( msg_t *msg, SyncEntityState *baselines );
+
+void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
+	printf( "%s\n", msg );
+	abort();
+}
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+}
+
+void Com_DPrintf( const char * format, ... ) { }
+
+void Com_Error( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+// netchan only asks for its debug cvars, leave them all off
+cvar_t * Cvar_Get( const char * var_name, const char * value, cvar_flag_t flags ) {
+	static cvar_t off = { };
+	return &off;
+}
+
+#define PACKETS_PER_SECOND 62
+#define MAX_UCMD_RESEND 3
+#define CONNECT_RESEND_MSEC 1000
+#define HANDSHAKE_RESEND_MSEC 100
+#define TIMEOUT_MSEC 10000
+#define JOIN_TIMEOUT_MSEC 30000
+#define SETTLE_MSEC 2000
+
+enum LoadClientState {
+	LoadClientState_Disconnected,
+	LoadClientState_Connecting, // waiting on challenge or client_connect
+	LoadClientState_Handshake, // waiting on serverdata
+	LoadClientState_Connected, // loading, waiting on the first snapshot
+	LoadClientState_Active,
+};
+
+struct LoadClientStats {
+	u64 bytes_in, bytes_out;
+	u64 packets_in, packets_out;
+	u64 packets_dropped;
+	u64 snaps;
+	u64 frames_skipped;
+	u64 late_snaps;
+};
+
+struct LoadClient {
+	int index;
+	LoadClientState state;
+	socket_t socket;
+	netchan_t netchan;
+	u64 session_id;
+	int challenge;
+	bool joined;
+
+	s64 connect_time;
+	s64 last_packet_received;
+	s64 last_packet_sent;
+
+	char reliable_commands[ MAX_RELIABLE_COMMANDS ][ MAX_STRING_CHARS ];
+	s64 reliable_sequence;
+	s64 reliable_acknowledged;
+	s64 last_executed_server_command;
+
+	// kept across reconnects like the real client does
+	char configstrings[ MAX_CONFIGSTRINGS ][ MAX_CONFIGSTRING_CHARS ];
+	bool have_configstrings;
+
+	int servercount;
+	int snap_frame_time;
+	snapshot_t * snapshots;
+	SyncEntityState * baselines;
+	s64 received_snap_num;
+	s64 last_server_time;
+	s64 last_snap_arrival; // usec
+
+	UserCommand cmds[ CMD_BACKUP ];
+	s64 cmd_num;
+	s64 ucmd_acknowledged;
+	u8 last_buttons;
+	RNG rng;
+
+	LoadClientStats stats;
+};
+
+struct LoadTest {
+	netadr_t server;
+	LoadClient * clients;
+	int num_clients; // how many have been started
+	int max_clients;
+	bool join;
+
+	s64 start_time;
+	u64 disconnects;
+
+	NonRAIIDynamicArray< u32 > snap_intervals; // usec
+};
+
+static LoadTest test;
+
+static void AddReliableCommand( LoadClient * client, const char * cmd ) {
+	client->reliable_sequence++;
+	if( client->reliable_sequence - client->reliable_acknowledged > MAX_RELIABLE_COMMANDS ) {
+		printf( "client %d: reliable command overflow\n", client->index );
+		return;
+	}
+
+	Q_strncpyz( client->reliable_commands[ client->reliable_sequence & ( MAX_RELIABLE_COMMANDS - 1 ) ], cmd, sizeof( client->reliable_commands[ 0 ] ) );
+}
+
+static void ResetSnapshots( LoadClient * client ) {
+	client->received_snap_num = 0;
+	client->last_server_time = 0;
+	client->last_snap_arrival = 0;
+	memset( client->baselines, 0, MAX_BASELINES * sizeof( SyncEntityState ) );
+}
+
+static void Disconnect( LoadClient * client, const char * reason ) {
+	if( client->state >= LoadClientState_Handshake ) {
+		printf( "client %d: disconnected: %s\n", client->index, reason );
+		test.disconnects++;
+	}
+	client->state = LoadClientState_Disconnected;
+	client->connect_time = Sys_Milliseconds();
+}
+
+static void StartConnecting( LoadClient * client, s64 now ) {
+	CSPRNG( &client->session_id, sizeof( client->session_id ) );
+	client->state = LoadClientState_Connecting;
+	client->challenge = 0;
+	client->joined = false;
+	client->connect_time = now - CONNECT_RESEND_MSEC;
+	client->last_packet_received = now;
+	client->reliable_sequence = 0;
+	client->reliable_acknowledged = 0;
+	client->last_executed_server_command = 0;
+	client->cmd_num = 0;
+	client->ucmd_acknowledged = 0;
+	client->last_buttons = 0;
+	ResetSnapshots( client );
+}
+
+static void SendConnect( LoadClient * client ) {
+	Netchan_OutOfBandPrint( &client->socket, &test.server, "connect %d %" PRIu64 " %d \"\\name\\loadtest%02d\" %s\n",
+		APP_PROTOCOL_VERSION, client->session_id, client->challenge, client->index, Netchan_CompressionOffer() );
+}
+
+static void ConnectionlessPacket( LoadClient * client, msg_t * msg, s64 now ) {
+	MSG_BeginReading( msg );
+	MSG_ReadInt32( msg ); // -1
+
+	const char * line = MSG_ReadStringLine( msg );
+	Span< const char > cmd = ParseToken( &line, Parse_StopOnNewLine );
+
+	if( StrEqual( cmd, "challenge" ) ) {
+		if( client->state != LoadClientState_Connecting )
+			return;
+		client->challenge = SpanToInt( ParseToken( &line, Parse_StopOnNewLine ), 0 );
+		client->connect_time = now;
+		SendConnect( client );
+		return;
+	}
+
+	if( StrEqual( cmd, "client_connect" ) ) {
+		if( client->state != LoadClientState_Connecting )
+			return;
+		MSG_ReadStringLine( msg ); // session
+		Netchan_Setup( &client->netchan, &client->socket, &test.server, client->session_id );
+		client->netchan.compression = Netchan_NegotiateCompression( MSG_ReadStringLine( msg ) );
+		client->state = LoadClientState_Handshake;
+		client->last_packet_received = now;
+		AddReliableCommand( client, "new" );
+		return;
+	}
+
+	if( StrEqual( cmd, "reject" ) ) {
+		if( client->state != LoadClientState_Connecting )
+			return;
+		MSG_ReadStringLine( msg ); // type
+		MSG_ReadStringLine( msg ); // flags
+		printf( "client %d: rejected: %s\n", client->index, MSG_ReadStringLine( msg ) );
+		client->state = LoadClientState_Disconnected;
+		client->connect_time = now;
+		return;
+	}
+
+	if( StrEqual( cmd, "print" ) ) {
+		printf( "client %d: %s", client->index, MSG_ReadString( msg ) );
+	}
+}
+
+static void ParseServerCommand( LoadClient * client, const char * text ) {
+	const char * cursor = text;
+	Span< const char > cmd = ParseToken( &cursor, Parse_DontStopOnNewLine );
+
+	if( StrEqual( cmd, "precache" ) ) {
+		int spawncount = SpanToInt( ParseToken( &cursor, Parse_DontStopOnNewLine ), 0 );
+		char begin[ 32 ];
+		snprintf( begin, sizeof( begin ), "begin %d", spawncount );
+		AddReliableCommand( client, begin );
+		return;
+	}
+
+	if( StrEqual( cmd, "cmd" ) ) {
+		if( cursor == NULL )
+			return;
+		while( *cursor == ' ' )
+			cursor++;
+		AddReliableCommand( client, cursor );
+		return;
+	}
+
+	if( StrEqual( cmd, "changing" ) ) {
+		ResetSnapshots( client );
+		client->state = LoadClientState_Connected;
+		return;
+	}
+
+	if( StrEqual( cmd, "reconnect" ) ) {
+		ResetSnapshots( client );
+		client->state = LoadClientState_Handshake;
+		client->joined = false;
+		AddReliableCommand( client, "new" );
+		return;
+	}
+
+	if( StrEqual( cmd, "disconnect" ) || StrEqual( cmd, "forcereconnect" ) ) {
+		Disconnect( client, text );
+		return;
+	}
+
+	// cs and everything else
+}
+
+static void ParseFrame( LoadClient * client, msg_t * msg ) {
+	snapshot_t * old_snap = client->received_snap_num > 0 ? &client->snapshots[ client->received_snap_num & UPDATE_MASK ] : NULL;
+	snapshot_t * snap = SNAP_ParseFrame( msg, old_snap, client->snapshots, client->baselines, 0 );
+	if( !snap->valid )
+		return;
+
+	u64 now = Sys_Microseconds();
+	LoadClientStats * stats = &client->stats;
+
+	if( client->received_snap_num > 0 ) {
+		s64 gap = snap->serverFrame - client->received_snap_num - 1;
+		if( gap > 0 ) {
+			stats->frames_skipped += gap;
+		}
+		else if( gap == 0 ) {
+			// only back to back frames say anything about the server's tick
+			u64 interval = now - client->last_snap_arrival;
+			test.snap_intervals.add( u32( Min2( interval, u64( U32_MAX ) ) ) );
+			if( interval * 2 > u64( client->snap_frame_time ) * 1000 * 3 ) {
+				stats->late_snaps++;
+			}
+		}
+	}
+
+	client->received_snap_num = snap->serverFrame;
+	client->last_server_time = snap->serverTime;
+	client->last_snap_arrival = now;
+	stats->snaps++;
+
+	if( client->state == LoadClientState_Connected ) {
+		client->state = LoadClientState_Active;
+		if( test.join && !client->joined ) {
+			AddReliableCommand( client, "join" );
+			client->joined = true;
+		}
+	}
+}
+
+static void ParseServerMessage( LoadClient * client, msg_t * msg ) {
+	while( msg->readcount < msg->cursize && client->state != LoadClientState_Disconnected ) {
+		int cmd = MSG_ReadUint8( msg );
+		switch( cmd ) {
+			case svc_servercmd: {
+				int cmd_num = MSG_ReadInt32( msg );
+				const char * text = MSG_ReadString( msg );
+				if( cmd_num > client->last_executed_server_command ) {
+					client->last_executed_server_command = cmd_num;
+					ParseServerCommand( client, text );
+				}
+			} break;
+
+			case svc_servercs:
+				ParseServerCommand( client, MSG_ReadString( msg ) );
+				break;
+
+			case svc_configstrings: {
+				int cmd_num = MSG_ReadInt32( msg );
+				bool execute = cmd_num > client->last_executed_server_command;
+				client->last_executed_server_command = Max2( client->last_executed_server_command, s64( cmd_num ) );
+
+				u64 count = MSG_ReadUintBase128( msg );
+				for( u64 i = 0; i < count && msg->readcount < msg->cursize; i++ ) {
+					u64 index = MSG_ReadUintBase128( msg );
+					const char * value = MSG_ReadString( msg );
+					if( execute && index < MAX_CONFIGSTRINGS ) {
+						Q_strncpyz( client->configstrings[ index ], value, sizeof( client->configstrings[ index ] ) );
+						client->have_configstrings = true;
+					}
+				}
+			} break;
+
+			case svc_serverdata: {
+				if( client->state != LoadClientState_Handshake )
+					return; // serverdata is always sent alone
+
+				int protocol = MSG_ReadInt32( msg );
+				if( protocol != APP_PROTOCOL_VERSION ) {
+					Disconnect( client, "wrong protocol version" );
+					return;
+				}
+
+				client->servercount = MSG_ReadInt32( msg );
+				client->snap_frame_time = MSG_ReadInt16( msg );
+				MSG_ReadInt16( msg ); // playernum
+				MSG_ReadString( msg ); // download url
+
+				ResetSnapshots( client );
+				client->state = LoadClientState_Connected;
+
+				char configstrings[ MAX_STRING_CHARS ];
+				int n = snprintf( configstrings, sizeof( configstrings ), "configstrings %d 0", client->servercount );
+				if( client->have_configstrings ) {
+					n += snprintf( configstrings + n, sizeof( configstrings ) - n, " " );
+					for( size_t i = 0; i < NUM_CONFIGSTRING_BLOCKS; i++ ) {
+						n += snprintf( configstrings + n, sizeof( configstrings ) - n, "%016" PRIx64, ConfigstringBlockHash( client->configstrings, i ) );
+					}
+				}
+				AddReliableCommand( client, configstrings );
+			} break;
+
+			case svc_spawnbaseline:
+				SNAP_ParseBaseline( msg, client->baselines );
+				break;
+
+			case svc_clcack:
+				client->reliable_acknowledged = MSG_ReadUintBase128( msg );
+				client->ucmd_acknowledged = MSG_ReadUintBase128( msg );
+				break;
+
+			case svc_frame:
+				ParseFrame( client, msg );
+				break;
+
+			default:
+				Disconnect( client, "illegible server message" );
+				return;
+		}
+	}
+}
+
+static void ReadPackets( LoadClient * client, s64 now ) {
+	static uint8_t data[ MAX_MSGLEN ];
+
+	while( true ) {
+		msg_t msg;
+		MSG_Init( &msg, data, sizeof( data ) );
+
+		netadr_t address;
+		int ret = NET_GetPacket( &client->socket, &address, &msg );
+		if( ret == 0 )
+			break;
+		if( ret == -1 ) {
+			printf( "client %d: %s\n", client->index, NET_ErrorString() );
+			break;
+		}
+
+		if( !NET_CompareAddress( &address, &test.server ) )
+			continue;
+
+		client->stats.bytes_in += msg.cursize;
+		client->stats.packets_in++;
+
+		if( *( int * ) msg.data == -1 ) {
+			ConnectionlessPacket( client, &msg, now );
+			continue;
+		}
+
+		if( client->state < LoadClientState_Handshake )
+			continue;
+
+		if( !Netchan_Process( &client->netchan, &msg ) )
+			continue;
+
+		MSG_BeginReading( &msg );
+		MSG_ReadInt32( &msg ); // sequence
+		MSG_ReadInt32( &msg ); // sequence_ack
+		if( msg.compressed && Netchan_DecompressMessage( &client->netchan, &msg ) < 0 )
+			continue;
+
+		client->stats.packets_dropped += client->netchan.dropped;
+		client->last_packet_received = now;
+
+		ParseServerMessage( client, &msg );
+	}
+}
+
+static void WriteReliableCommands( LoadClient * client, msg_t * msg ) {
+	for( s64 i = client->reliable_acknowledged + 1; i <= client->reliable_sequence; i++ ) {
+		MSG_WriteUint8( msg, clc_clientcommand );
+		MSG_WriteIntBase128( msg, i );
+		MSG_WriteString( msg, client->reliable_commands[ i & ( MAX_RELIABLE_COMMANDS - 1 ) ] );
+	}
+}
+
+/*
+ * strafes in circles, jumps every so often and taps attack, with each
+ * client out of phase so they don't all do the same thing
+ */
+static void ScriptUserCommand( LoadClient * client, UserCommand * cmd, s64 now, int msec ) {
+	float t = ( now - test.start_time ) * 0.001f + client->index * 0.37f;
+	s64 ms = s64( t * 1000.0f );
+
+	*cmd = { };
+	cmd->msec = u8( Clamp( 1, msec, 200 ) );
+	cmd->angles[ YAW ] = ANGLE2SHORT( t * 90.0f );
+	cmd->angles[ PITCH ] = ANGLE2SHORT( sinf( t ) * 10.0f );
+	cmd->forwardmove = 127;
+	cmd->sidemove = ( ms / 2000 ) % 2 == 0 ? 127 : -127;
+	cmd->upmove = ms % 1500 < 100 ? 127 : 0;
+	cmd->buttons = ms % 1000 < 200 ? BUTTON_ATTACK : 0;
+	cmd->down_edges = cmd->buttons & ~client->last_buttons;
+	cmd->entropy = u16( Random32( &client->rng ) );
+
+	// what the client would be drawing at, one snapshot behind the newest
+	s64 since_snap = s64( Sys_Microseconds() - client->last_snap_arrival ) / 1000;
+	cmd->serverTimeStamp = client->last_server_time + since_snap - client->snap_frame_time;
+
+	client->last_buttons = cmd->buttons;
+}
+
+static void Transmit( LoadClient * client, msg_t * msg, s64 now ) {
+	Netchan_PushAllFragments( &client->netchan );
+
+	if( msg->cursize > 60 ) {
+		Netchan_CompressMessage( &client->netchan, msg );
+	}
+
+	// header is two sequence numbers and the session id
+	client->stats.bytes_out += msg->cursize + 16;
+	client->stats.packets_out++;
+	client->last_packet_sent = now;
+
+	Netchan_Transmit( &client->netchan, msg );
+}
+
+static void SendMessage( LoadClient * client, s64 now ) {
+	uint8_t data[ MAX_MSGLEN ];
+	msg_t msg;
+	MSG_Init( &msg, data, sizeof( data ) );
+
+	MSG_WriteUint8( &msg, clc_svcack );
+	MSG_WriteIntBase128( &msg, client->last_executed_server_command );
+	WriteReliableCommands( client, &msg );
+
+	if( client->state == LoadClientState_Active ) {
+		int msec = int( now - client->last_packet_sent );
+		client->cmd_num++;
+		ScriptUserCommand( client, &client->cmds[ client->cmd_num & CMD_MASK ], now, msec );
+
+		s64 head = client->cmd_num + 1;
+		s64 first = Max2( client->ucmd_acknowledged + 1, head - 1 - MAX_UCMD_RESEND );
+		first = Min2( first, client->cmd_num );
+
+		MSG_WriteUint8( &msg, clc_move );
+		MSG_WriteInt32( &msg, client->received_snap_num > 0 ? client->received_snap_num : -1 );
+		MSG_WriteInt32( &msg, head );
+		MSG_WriteUint8( &msg, head - first );
+
+		UserCommand nullcmd = { };
+		const UserCommand * base = &nullcmd;
+		for( s64 i = first; i < head; i++ ) {
+			const UserCommand * cmd = &client->cmds[ i & CMD_MASK ];
+			MSG_WriteDeltaUsercmd( &msg, base, cmd );
+			base = cmd;
+		}
+	}
+
+	Transmit( client, &msg, now );
+}
+
+static void SendDisconnect( LoadClient * client, s64 now ) {
+	if( client->state < LoadClientState_Handshake )
+		return;
+
+	// like the real client, send it 3 times in case some get lost
+	AddReliableCommand( client, "disconnect" );
+	for( int i = 0; i < 3; i++ ) {
+		SendMessage( client, now );
+	}
+	client->state = LoadClientState_Disconnected;
+}
+
+static void ClientFrame( LoadClient * client, s64 now ) {
+	switch( client->state ) {
+		case LoadClientState_Disconnected:
+			break;
+
+		case LoadClientState_Connecting:
+			if( now - client->connect_time >= CONNECT_RESEND_MSEC ) {
+				client->connect_time = now;
+				if( client->challenge == 0 ) {
+					Netchan_OutOfBandPrint( &client->socket, &test.server, "getchallenge\n" );
+				}
+				else {
+					SendConnect( client );
+				}
+			}
+			break;
+
+		case LoadClientState_Handshake:
+		case LoadClientState_Connected:
+			if( client->netchan.unsentFragments ) {
+				Netchan_TransmitNextFragment( &client->netchan );
+			}
+			else if( now - client->last_packet_sent >= HANDSHAKE_RESEND_MSEC ) {
+				SendMessage( client, now );
+			}
+			break;
+
+		case LoadClientState_Active:
+			if( client->netchan.unsentFragments ) {
+				Netchan_TransmitNextFragment( &client->netchan );
+			}
+			else if( now - client->last_packet_sent >= 1000 / PACKETS_PER_SECOND ) {
+				SendMessage( client, now );
+			}
+			break;
+	}
+
+	if( client->state >= LoadClientState_Handshake && now - client->last_packet_received > TIMEOUT_MSEC ) {
+		Disconnect( client, "timed out" );
+	}
+}
+
+static bool InitClient( LoadClient * client, int index ) {
+	memset( client, 0, sizeof( *client ) );
+	client->index = index;
+	client->rng = NewRNG( Hash64( u64( index ) ), 0 );
+	client->snapshots = ALLOC_MANY( sys_allocator, snapshot_t, UPDATE_BACKUP );
+	client->baselines = ALLOC_MANY( sys_allocator, SyncEntityState, MAX_BASELINES );
+	memset( client->snapshots, 0, UPDATE_BACKUP * sizeof( snapshot_t ) );
+
+	netadr_t address;
+	NET_InitAddress( &address, test.server.type );
+	if( !NET_OpenSocket( &client->socket, SOCKET_UDP, &address, false ) ) {
+		printf( "Couldn't open a socket: %s\n", NET_ErrorString() );
+		return false;
+	}
+
+	return true;
+}
+
+static void ShutdownClient( LoadClient * client ) {
+	NET_CloseSocket( &client->socket );
+	FREE( sys_allocator, client->snapshots );
+	FREE( sys_allocator, client->baselines );
+}
+
+static void Frame() {
+	s64 now = Sys_Milliseconds();
+
+	for( int i = 0; i < test.num_clients; i++ ) {
+		ReadPackets( &test.clients[ i ], now );
+	}
+
+	// challenges are per address, so only one client can connect at a time
+	bool connecting = false;
+	for( int i = 0; i < test.num_clients; i++ ) {
+		LoadClient * client = &test.clients[ i ];
+		bool retry = now - client->connect_time >= CONNECT_RESEND_MSEC;
+		if( client->state == LoadClientState_Disconnected && !connecting && retry ) {
+			StartConnecting( client, now );
+		}
+		connecting = connecting || client->state == LoadClientState_Connecting;
+		ClientFrame( client, now );
+	}
+
+	Sys_SleepMicroseconds( 1000 );
+}
+
+static int NumActive() {
+	int active = 0;
+	for( int i = 0; i < test.num_clients; i++ ) {
+		active += test.clients[ i ].state == LoadClientState_Active ? 1 : 0;
+	}
+	return active;
+}
+
+static void RunFor( s64 msec ) {
+	s64 end = Sys_Milliseconds() + msec;
+	while( Sys_Milliseconds() < end ) {
+		Frame();
+	}
+}
+
+static bool GrowTo( int n ) {
+	while( test.num_clients < n ) {
+		if( !InitClient( &test.clients[ test.num_clients ], test.num_clients ) )
+			return false;
+		test.num_clients++;
+	}
+
+	s64 deadline = Sys_Milliseconds() + JOIN_TIMEOUT_MSEC;
+	while( NumActive() < n ) {
+		if( Sys_Milliseconds() > deadline ) {
+			printf( "Only %d of %d clients got in\n", NumActive(), n );
+			return false;
+		}
+		Frame();
+	}
+
+	return true;
+}
+
+static u32 Percentile( Span< const u32 > sorted, double p ) {
+	return sorted[ Min2( size_t( p * sorted.n ), sorted.n - 1 ) ];
+}
+
+static void PrintHeader() {
+	printf( "%7s %8s %27s %6s %6s %6s %11s %11s\n", "clients", "snaps/s", "snap gap p50/p99/max ms", "late", "loss", "skipped", "in KB/s", "out KB/s" );
+}
+
+static void Measure( int seconds ) {
+	for( int i = 0; i < test.num_clients; i++ ) {
+		test.clients[ i ].stats = { };
+	}
+	test.snap_intervals.clear();
+
+	u64 t0 = Sys_Microseconds();
+	RunFor( seconds * 1000 );
+	double elapsed = ( Sys_Microseconds() - t0 ) / 1000000.0;
+
+	LoadClientStats total = { };
+	for( int i = 0; i < test.num_clients; i++ ) {
+		const LoadClientStats & stats = test.clients[ i ].stats;
+		total.bytes_in += stats.bytes_in;
+		total.bytes_out += stats.bytes_out;
+		total.packets_in += stats.packets_in;
+		total.packets_out += stats.packets_out;
+		total.packets_dropped += stats.packets_dropped;
+		total.snaps += stats.snaps;
+		total.frames_skipped += stats.frames_skipped;
+		total.late_snaps += stats.late_snaps;
+	}
+
+	Span< u32 > intervals = test.snap_intervals.span();
+	std::sort( intervals.begin(), intervals.end() );
+
+	double n = test.num_clients;
+	double p50 = 0, p99 = 0, max = 0;
+	if( intervals.n > 0 ) {
+		p50 = Percentile( intervals, 0.5 ) / 1000.0;
+		p99 = Percentile( intervals, 0.99 ) / 1000.0;
+		max = intervals[ intervals.n - 1 ] / 1000.0;
+	}
+
+	auto percent = []( u64 x, u64 total ) {
+		return total == 0 ? 0.0 : 100.0 * x / total;
+	};
+
+	printf( "%7d %8.1f %8.1f %8.1f %8.1f %5.1f%% %5.1f%% %5.1f%% %11.1f %11.1f\n", test.num_clients,
+		total.snaps / n / elapsed, p50, p99, max,
+		percent( total.late_snaps, total.snaps ),
+		percent( total.packets_dropped, total.packets_in + total.packets_dropped ),
+		percent( total.frames_skipped, total.snaps + total.frames_skipped ),
+		total.bytes_in / n / elapsed / 1024.0, total.bytes_out / n / elapsed / 1024.0 );
+}
+
+int main( int argc, char ** argv ) {
+	if( argc < 3 || argc > 5 ) {
+		printf( "Usage: loadtest <server[:port]> <clients> [seconds per step] [nojoin]\n" );
+		return 1;
+	}
+
+	test.max_clients = atoi( argv[ 2 ] );
+	int seconds = argc >= 4 ? atoi( argv[ 3 ] ) : 10;
+	test.join = !( argc == 5 && strcmp( argv[ 4 ], "nojoin" ) == 0 );
+	if( test.max_clients <= 0 || test.max_clients > MAX_CLIENTS || seconds <= 0 ) {
+		printf( "Clients must be between 1 and %d and seconds must be positive\n", MAX_CLIENTS );
+		return 1;
+	}
+
+	InitFS();
+	InitCSPRNG();
+	NET_Init();
+	Netchan_Init();
+
+	if( !NET_StringToAddress( argv[ 1 ], &test.server ) ) {
+		printf( "Can't resolve %s\n", argv[ 1 ] );
+		return 1;
+	}
+	if( NET_GetAddressPort( &test.server ) == 0 ) {
+		NET_SetAddressPort( &test.server, PORT_SERVER );
+	}
+
+	test.clients = ALLOC_MANY( sys_allocator, LoadClient, test.max_clients );
+	test.snap_intervals.init( sys_allocator );
+	test.start_time = Sys_Milliseconds();
+
+	printf( "Load testing %s with up to %d clients, %d seconds per step\n", NET_AddressToString( &test.server ), test.max_clients, seconds );
+	PrintHeader();
+
+	int n = 1;
+	while( true ) {
+		if( !GrowTo( n ) )
+			break;
+
+		RunFor( SETTLE_MSEC );
+		Measure( seconds );
+
+		if( n == test.max_clients )
+			break;
+		n = Min2( n * 2, test.max_clients );
+	}
+
+	if( test.disconnects > 0 ) {
+		printf( "%" PRIu64 " disconnects\n", test.disconnects );
+	}
+
+	s64 now = Sys_Milliseconds();
+	for( int i = 0; i < test.num_clients; i++ ) {
+		SendDisconnect( &test.clients[ i ], now );
+		ShutdownClient( &test.clients[ i ] );
+	}
+
+	test.snap_intervals.shutdown();
+	FREE( sys_allocator, test.clients );
+
+	Netchan_Shutdown();
+	NET_Shutdown();
+	ShutdownCSPRNG();
+	ShutdownFS();
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+local windows_srcs = {
+	"source/windows/win_fs.cpp",
+	"source/windows/win_net.cpp",
+	"source/windows/win_threads.cpp",
+	"source/windows/win_time.cpp",
+}
+
+local linux_srcs = {
+	"source/unix/unix_fs.cpp",
+	"source/unix/unix_net.cpp",
+	"source/unix/unix_threads.cpp",
+	"source/unix/unix_time.cpp",
+}
+
+local platform_srcs = OS == "windows" and windows_srcs or linux_srcs
+
+bin( "loadtest", {
+	srcs = {
+		"source/tools/loadtest/loadtest.cpp",
+		"source/client/snap_read.cpp",
+		"source/qcommon/allocators.cpp",
+		"source/qcommon/base.cpp",
+		"source/qcommon/csprng.cpp",
+		"source/qcommon/fs.cpp",
+		"source/qcommon/half_float.cpp",
+		"source/qcommon/hash.cpp",
+		"source/qcommon/msg.cpp",
+		"source/qcommon/net.cpp",
+		"source/qcommon/net_chan.cpp",
+		"source/qcommon/rng.cpp",
+		"source/qcommon/strtonum.cpp",
+		"source/qcommon/utf8.cpp",
+		"source/gameshared/q_math.cpp",
+		"source/gameshared/q_shared.cpp",
+		platform_srcs,
+	},
+
+	libs = {
+		"ggentropy",
+		"ggformat",
+		"monocypher",
+		"tracy",
+		"zlib",
+		"zstd",
+	},
+
+	gcc_extra_ldflags = "-lm -lpthread -ldl -no-pie -static-libstdc++",
+	msvc_extra_ldflags = "ws2_32.lib mswsock.lib",
+} )
@@ -0,0 +1,246 @@
+#include <algorithm>
+
+#include "qcommon/base.h"
+#include "qcommon/array.h"
+#include "qcommon/asset_archive.h"
+#include "qcommon/fs.h"
+#include "qcommon/hash.h"
+
+#include "zstd/zstd.h"
+
+/*
+ * packs a base/ directory into base.pak, see asset_archive.h for the layout
+ *
+ * .zst files get copied in as is and the game decompresses them at startup
+ * like it does loose .zst files. if foo and foo.zst both exist we keep foo,
+ * same as the game does
+ */
+
+void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
+	printf( "%s\n", msg );
+	abort();
+}
+
+struct PackEntry {
+	char * path; // game path without .zst
+	u64 hash;
+	AssetArchiveEncoding encoding;
+	Span< u8 > data;
+	u64 size;
+
+	u64 path_offset;
+	u64 data_offset;
+};
+
+static bool ReadFile( const char * path, Span< u8 > * contents ) {
+	FILE * file = OpenFile( sys_allocator, path, "rb" );
+	if( file == NULL )
+		return false;
+	defer { fclose( file ); };
+
+	fseek( file, 0, SEEK_END );
+	size_t size = ftell( file );
+	fseek( file, 0, SEEK_SET );
+
+	*contents = ALLOC_SPAN( sys_allocator, u8, size );
+	if( fread( contents->ptr, 1, size, file ) != size ) {
+		FREE( sys_allocator, contents->ptr );
+		return false;
+	}
+
+	return true;
+}
+
+static bool AddFile( DynamicArray< PackEntry > * entries, const char * full_path, const char * game_path ) {
+	Span< const char > path = MakeSpan( game_path );
+	const char * ext = strrchr( game_path, '.' );
+	bool zstd = ext != NULL && strcmp( ext, ".zst" ) == 0;
+	if( zstd ) {
+		path.n -= strlen( ext );
+	}
+
+	Span< u8 > data;
+	if( !ReadFile( full_path, &data ) ) {
+		printf( "Can't read %s\n", full_path );
+		return false;
+	}
+
+	PackEntry entry = { };
+	entry.path = ( *sys_allocator )( "{}", path );
+	entry.hash = Hash64( path );
+	entry.encoding = zstd ? AssetArchiveEncoding_Zstd : AssetArchiveEncoding_Stored;
+	entry.data = data;
+	entry.size = data.n;
+
+	if( zstd ) {
+		unsigned long long size = ZSTD_getFrameContentSize( data.ptr, data.n );
+		if( size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN ) {
+			printf( "%s isn't a zstd file or doesn't record its decompressed size\n", full_path );
+			FREE( sys_allocator, entry.path );
+			FREE( sys_allocator, data.ptr );
+			return false;
+		}
+		entry.size = size;
+	}
+
+	entries->add( entry );
+	return true;
+}
+
+static bool FindAssets( DynamicArray< PackEntry > * entries, const char * dir, size_t skip ) {
+	ListDirHandle scan = BeginListDir( sys_allocator, dir );
+
+	const char * name;
+	bool is_dir;
+	bool ok = true;
+	while( ListDirNext( &scan, &name, &is_dir ) ) {
+		// skip ., .., .git, .texturecache, etc
+		if( name[ 0 ] == '.' )
+			continue;
+
+		char * path = ( *sys_allocator )( "{}/{}", dir, name );
+		defer { FREE( sys_allocator, path ); };
+
+		if( is_dir ) {
+			ok = FindAssets( entries, path, skip ) && ok;
+		}
+		else {
+			ok = AddFile( entries, path, path + skip ) && ok;
+		}
+	}
+
+	return ok;
+}
+
+static void FreeEntry( PackEntry * entry ) {
+	FREE( sys_allocator, entry->path );
+	FREE( sys_allocator, entry->data.ptr );
+}
+
+static bool WritePadding( FILE * file, u64 * cursor, u64 alignment ) {
+	const u8 zeroes[ ASSET_ARCHIVE_ALIGNMENT ] = { };
+	u64 n = AlignPow2( *cursor, alignment ) - *cursor;
+	*cursor += n;
+	return fwrite( zeroes, 1, n, file ) == n;
+}
+
+int main( int argc, char ** argv ) {
+	if( argc != 3 ) {
+		printf( "Usage: packassets <base directory> <base.pak>\n" );
+		return 1;
+	}
+
+	const char * root = argv[ 1 ];
+	size_t root_len = strlen( root );
+	while( root_len > 1 && root[ root_len - 1 ] == '/' ) {
+		root_len--;
+	}
+
+	char * dir = ( *sys_allocator )( "{}", Span< const char >( root, root_len ) );
+	defer { FREE( sys_allocator, dir ); };
+
+	DynamicArray< PackEntry > entries( sys_allocator );
+	defer {
+		for( PackEntry & entry : entries ) {
+			FreeEntry( &entry );
+		}
+	};
+
+	if( !FindAssets( &entries, dir, root_len + 1 ) )
+		return 1;
+
+	// stored before zstd so the dedupe below keeps the uncompressed copy
+	std::sort( entries.begin(), entries.end(), []( const PackEntry & a, const PackEntry & b ) {
+		if( a.hash != b.hash )
+			return a.hash < b.hash;
+		return a.encoding < b.encoding;
+	} );
+
+	size_t num_entries = 0;
+	for( size_t i = 0; i < entries.size(); i++ ) {
+		if( num_entries > 0 && entries[ num_entries - 1 ].hash == entries[ i ].hash ) {
+			if( strcmp( entries[ num_entries - 1 ].path, entries[ i ].path ) != 0 ) {
+				printf( "Asset hash name collision: %s and %s\n", entries[ num_entries - 1 ].path, entries[ i ].path );
+				return 1;
+			}
+			FreeEntry( &entries[ i ] );
+			continue;
+		}
+
+		entries[ num_entries ] = entries[ i ];
+		num_entries++;
+	}
+	entries.resize( num_entries );
+
+	// lay everything out
+	u64 cursor = sizeof( AssetArchiveHeader ) + num_entries * sizeof( AssetArchiveEntry );
+	for( PackEntry & entry : entries ) {
+		entry.path_offset = cursor;
+		cursor += strlen( entry.path ) + 1;
+	}
+
+	u64 total_stored = 0;
+	for( PackEntry & entry : entries ) {
+		cursor = AlignPow2( cursor, ASSET_ARCHIVE_ALIGNMENT );
+		entry.data_offset = cursor;
+		cursor += entry.data.n;
+		if( entry.encoding == AssetArchiveEncoding_Stored ) {
+			cursor++;
+		}
+		total_stored += entry.size;
+	}
+
+	const char * out_path = argv[ 2 ];
+	FILE * file = OpenFile( sys_allocator, out_path, "wb" );
+	if( file == NULL ) {
+		printf( "Can't write %s\n", out_path );
+		return 1;
+	}
+
+	bool ok = true;
+	cursor = 0;
+
+	AssetArchiveHeader header = { };
+	header.magic = ASSET_ARCHIVE_MAGIC;
+	header.version = ASSET_ARCHIVE_VERSION;
+	header.num_entries = num_entries;
+	ok = ok && fwrite( &header, sizeof( header ), 1, file ) == 1;
+	cursor += sizeof( header );
+
+	for( const PackEntry & entry : entries ) {
+		AssetArchiveEntry e = { };
+		e.hash = entry.hash;
+		e.path_offset = entry.path_offset;
+		e.data_offset = entry.data_offset;
+		e.data_size = entry.data.n;
+		e.size = entry.size;
+		e.encoding = entry.encoding;
+		ok = ok && fwrite( &e, sizeof( e ), 1, file ) == 1;
+		cursor += sizeof( e );
+	}
+
+	for( const PackEntry & entry : entries ) {
+		size_t len = strlen( entry.path ) + 1;
+		ok = ok && fwrite( entry.path, 1, len, file ) == len;
+		cursor += len;
+	}
+
+	for( const PackEntry & entry : entries ) {
+		ok = ok && WritePadding( file, &cursor, ASSET_ARCHIVE_ALIGNMENT );
+		ok = ok && fwrite( entry.data.ptr, 1, entry.data.n, file ) == entry.data.n;
+		cursor += entry.data.n;
+		if( entry.encoding == AssetArchiveEncoding_Stored ) {
+			ok = ok && fputc( '\0', file ) != EOF;
+			cursor++;
+		}
+	}
+
+	ok = fclose( file ) == 0 && ok;
+	if( !ok ) {
+		printf( "Couldn't write %s\n", out_path );
+		return 1;
+	}
+
+	printf( "Packed %zu assets into %s, %.1fMB on disk, %.1fMB decoded\n", num_entries, out_path, cursor / 1000000.0, total_stored / 1000000.0 );
+	return 0;
+}
@@ -0,0 +1,48 @@
+local windows_srcs = {
+	"source/windows/win_fs.cpp",
+	"source/windows/win_threads.cpp",
+	"source/windows/win_time.cpp",
+}
+
+local linux_srcs = {
+	"source/unix/unix_fs.cpp",
+	"source/unix/unix_threads.cpp",
+	"source/unix/unix_time.cpp",
+}
+
+local platform_srcs = OS == "windows" and windows_srcs or linux_srcs
+
+bin( "pmovebench", {
+	srcs = {
+		"source/tools/pmovebench/pmovebench.cpp",
+		"source/qcommon/allocators.cpp",
+		"source/qcommon/base.cpp",
+		"source/qcommon/cm_main.cpp",
+		"source/qcommon/cm_q3bsp.cpp",
+		"source/qcommon/cm_trace.cpp",
+		"source/qcommon/compression.cpp",
+		"source/qcommon/fs.cpp",
+		"source/qcommon/hash.cpp",
+		"source/qcommon/load_profile.cpp",
+		"source/qcommon/patch.cpp",
+		"source/qcommon/rng.cpp",
+		"source/qcommon/serialization.cpp",
+		"source/qcommon/strtonum.cpp",
+		"source/qcommon/threadpool.cpp",
+		"source/qcommon/utf8.cpp",
+		"source/gameshared/gs_pmove.cpp",
+		"source/gameshared/gs_slidebox.cpp",
+		"source/gameshared/gs_weapondefs.cpp",
+		"source/gameshared/q_math.cpp",
+		"source/gameshared/q_shared.cpp",
+		platform_srcs,
+	},
+
+	libs = {
+		"ggformat",
+		"tracy",
+		"zstd",
+	},
+
+	gcc_extra_ldflags = "-lm -lpthread -ldl -no-pie -static-libstdc++",
+} )
@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <atomic>
+
+#include "qcommon/qcommon.h"
+#include "qcommon/cmodel.h"
+#include "qcommon/compression.h"
+#include "qcommon/fs.h"
+#include "qcommon/hash.h"
+#include "qcommon/rng.h"
+#include "qcommon/threadpool.h"
+#include "gameshared/gs_public.h"
+
+/*
+ * runs lots of players through Pmove on a real map and reports how fast it
+ * is and how many traces it does
+ *
+ * every player gets their own seeded UserCommand stream, so runs are
+ * deterministic and the per step hashes can be diffed across builds. the
+ * whole thing runs against a server and a client collision model, and they
+ * must agree on every step, which is what prediction relies on
+ *
+ * then it runs the server side again through PmoveBatch, which has to come
+ * out bit for bit the same as calling Pmove on each player
+ */
+
+void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
+	printf( "%s\n", msg );
+	abort();
+}
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+}
+
+void Com_DPrintf( const char * format, ... ) { }
+
+void Cmd_AddCommand( const char * cmd_name, xcommand_t function ) { }
+void Cmd_RemoveCommand( const char * cmd_name ) { }
+
+void Com_Error( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+#define FRAME_MSEC 16
+
+struct BenchPlayer {
+	SyncPlayerState ps;
+	UserCommand cmd;
+	RNG rng;
+	int intent_msec;
+	float yaw_speed, pitch;
+	u64 event_hash;
+};
+
+static CModelServerOrClient bench_soc;
+static CollisionModel * bench_cms;
+static BenchPlayer * bench_players;
+static std::atomic< u64 > num_traces;
+static std::atomic< u64 > num_point_contents;
+static std::atomic< u64 > num_events;
+
+// PmoveBatch traces from every thread, so each one needs its own checkcounts
+struct ThreadCheckCounts {
+	const CollisionModel * cms;
+	CollisionCheckCounts checkcounts;
+};
+
+static ThreadCheckCounts thread_checkcounts[ 256 ];
+static std::atomic< size_t > num_thread_checkcounts;
+static thread_local ThreadCheckCounts * this_thread_checkcounts;
+
+static CollisionCheckCounts * BenchCheckCounts() {
+	if( this_thread_checkcounts == NULL ) {
+		size_t idx = num_thread_checkcounts.fetch_add( 1 );
+		if( idx >= ARRAY_COUNT( thread_checkcounts ) ) {
+			Com_Error( "Too many threads" );
+		}
+		this_thread_checkcounts = &thread_checkcounts[ idx ];
+	}
+
+	// the server and client maps share brushes so the sizes match, but do
+	// it properly anyway
+	ThreadCheckCounts * tc = this_thread_checkcounts;
+	if( tc->cms != bench_cms ) {
+		if( tc->cms != NULL ) {
+			FREE( sys_allocator, tc->checkcounts.brushes );
+			FREE( sys_allocator, tc->checkcounts.faces );
+		}
+		tc->cms = bench_cms;
+		tc->checkcounts = CM_NewCheckCounts( sys_allocator, bench_cms );
+	}
+
+	return &tc->checkcounts;
+}
+
+static void FreeCheckCounts() {
+	for( size_t i = 0; i < Min2( num_thread_checkcounts.load(), ARRAY_COUNT( thread_checkcounts ) ); i++ ) {
+		if( thread_checkcounts[ i ].cms != NULL ) {
+			FREE( sys_allocator, thread_checkcounts[ i ].checkcounts.brushes );
+			FREE( sys_allocator, thread_checkcounts[ i ].checkcounts.faces );
+		}
+	}
+}
+
+static void BenchTrace( trace_t * t, Vec3 start, Vec3 mins, Vec3 maxs, Vec3 end, int ignore, int contentmask, int timeDelta ) {
+	num_traces++;
+	CM_TransformedBoxTrace( bench_soc, bench_cms, BenchCheckCounts(), t, start, end, mins, maxs, NULL, contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
+	t->ent = t->fraction < 1.0f ? 0 : -1;
+}
+
+static int BenchPointContents( Vec3 p, int timeDelta ) {
+	num_point_contents++;
+	return CM_TransformedPointContents( bench_soc, bench_cms, p, NULL, Vec3( 0.0f ), Vec3( 0.0f ) );
+}
+
+static SyncEntityState * BenchGetEntityState( int entNum, int deltaTime ) {
+	static SyncEntityState state;
+	state = { };
+	state.number = entNum;
+	return &state;
+}
+
+// hashed per player so it doesn't matter what order PmoveBatch runs them in
+static void BenchPredictedEvent( int entNum, int ev, u64 parm ) {
+	num_events++;
+	BenchPlayer * player = &bench_players[ entNum - 1 ];
+	u64 data[] = { u64( entNum ), u64( ev ), parm };
+	player->event_hash = Hash64( data, sizeof( data ), player->event_hash );
+}
+
+static void BenchPredictedFireWeapon( int entNum, u64 weapon_and_entropy ) { }
+static void BenchPredictedUseGadget( int entNum, GadgetType gadget, u64 parm ) { }
+static void BenchTouchTriggers( pmove_t * pm, Vec3 previous_origin ) { }
+
+static bool LoadMap( CModelServerOrClient soc, const char * path, CollisionModel ** cms ) {
+	Span< u8 > data = ReadFileBinary( sys_allocator, path );
+	if( data.ptr == NULL ) {
+		printf( "Can't open %s\n", path );
+		return false;
+	}
+	defer { FREE( sys_allocator, data.ptr ); };
+
+	Span< u8 > decompressed = data;
+	bool compressed = StrCaseEqual( LastFileExtension( path ), ".zst" );
+	if( compressed && !Decompress( path, sys_allocator, data, &decompressed ) ) {
+		printf( "Can't decompress %s\n", path );
+		return false;
+	}
+	defer { if( compressed ) FREE( sys_allocator, decompressed.ptr ); };
+
+	*cms = CM_LoadMap( soc, decompressed, Hash64( path ) );
+	return true;
+}
+
+/*
+ * players spawn on the map's spawn points, dropped to the floor like
+ * SelectSpawnPoint does
+ */
+static size_t FindSpawnPoints( CollisionModel * cms, Vec3 * spawns, size_t max_spawns ) {
+	size_t n = 0;
+	Span< const char > cursor = MakeSpan( CM_EntityString( cms ) );
+
+	while( n < max_spawns ) {
+		Span< const char > brace = ParseToken( &cursor, Parse_DontStopOnNewLine );
+		if( brace != "{" )
+			break;
+
+		bool is_spawn = false;
+		bool has_origin = false;
+		Vec3 origin = Vec3( 0.0f );
+		while( true ) {
+			Span< const char > key = ParseToken( &cursor, Parse_DontStopOnNewLine );
+			if( key == "}" || key.ptr == NULL )
+				break;
+			Span< const char > value = ParseToken( &cursor, Parse_StopOnNewLine );
+
+			if( key == "classname" ) {
+				is_spawn = StartsWith( value, "spawn_" ) || StartsWith( value, "info_player_" );
+			}
+			else if( key == "origin" ) {
+				for( int i = 0; i < 3; i++ ) {
+					origin[ i ] = ParseFloat( &value, 0.0f, Parse_StopOnNewLine );
+				}
+				has_origin = true;
+			}
+		}
+
+		if( is_spawn && has_origin ) {
+			spawns[ n ] = origin;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static Vec3 DropToFloor( Vec3 origin ) {
+	trace_t trace;
+	Vec3 start = origin + Vec3( 0.0f, 0.0f, 16.0f );
+	Vec3 end = origin - Vec3( 0.0f, 0.0f, 512.0f );
+	BenchTrace( &trace, start, playerbox_stand_mins, playerbox_stand_maxs, end, 0, MASK_PLAYERSOLID, 0 );
+	return trace.endpos + trace.plane.normal;
+}
+
+static void SpawnPlayer( BenchPlayer * player, int idx, Vec3 origin ) {
+	*player = { };
+	player->rng = NewRNG( idx, 0 );
+
+	SyncPlayerState * ps = &player->ps;
+	ps->POVnum = idx + 1;
+	ps->playerNum = idx;
+	ps->pmove.pm_type = PM_NORMAL;
+	ps->pmove.features = PMFEAT_DEFAULT;
+	ps->pmove.max_speed = DEFAULT_PLAYERSPEED;
+	ps->pmove.jump_speed = DEFAULT_JUMPSPEED;
+	ps->pmove.dash_speed = DEFAULT_DASHSPEED;
+	ps->pmove.origin = origin;
+	ps->viewangles.y = RandomFloat01( &player->rng ) * 360.0f;
+	player->cmd.angles[ YAW ] = ANGLE2SHORT( ps->viewangles.y );
+}
+
+/*
+ * something like a person playing: hold a direction for a while, turn,
+ * and occasionally jump, dash, crouch or walk
+ */
+static void NextCommand( BenchPlayer * player ) {
+	UserCommand * cmd = &player->cmd;
+	RNG * rng = &player->rng;
+
+	player->intent_msec -= FRAME_MSEC;
+	if( player->intent_msec <= 0 ) {
+		player->intent_msec = RandomUniform( rng, 200, 2000 );
+		player->yaw_speed = RandomUniformFloat( rng, -180.0f, 180.0f );
+		player->pitch = RandomUniformFloat( rng, -30.0f, 30.0f );
+
+		const s8 moves[] = { -127, 0, 127, 127 };
+		cmd->forwardmove = RandomElement( rng, moves );
+		cmd->sidemove = RandomElement( rng, moves ) * ( Probability( rng, 0.5f ) ? 1 : -1 );
+		cmd->upmove = 0;
+	}
+
+	u8 old_buttons = cmd->buttons;
+	cmd->buttons = 0;
+	if( Probability( rng, 0.02f ) )
+		cmd->buttons |= BUTTON_SPECIAL;
+	if( Probability( rng, 0.05f ) )
+		cmd->buttons |= BUTTON_WALK;
+	cmd->down_edges = cmd->buttons & ~old_buttons;
+
+	if( Probability( rng, 0.03f ) )
+		cmd->upmove = 127;
+	else if( Probability( rng, 0.01f ) )
+		cmd->upmove = -127;
+	else if( cmd->upmove > 0 )
+		cmd->upmove = 0;
+
+	float yaw = SHORT2ANGLE( cmd->angles[ YAW ] ) + player->yaw_speed * FRAME_MSEC * 0.001f;
+	cmd->angles[ YAW ] = ANGLE2SHORT( yaw );
+	cmd->angles[ PITCH ] = ANGLE2SHORT( player->pitch );
+	cmd->msec = FRAME_MSEC;
+	cmd->serverTimeStamp += FRAME_MSEC;
+}
+
+struct RunStats {
+	u64 usec;
+	u64 steps;
+	u64 traces;
+	u64 point_contents;
+	u64 events;
+	u64 hash;
+	u64 * frame_hashes;
+};
+
+static void Run( CModelServerOrClient soc, CollisionModel * cms, Span< const Vec3 > spawns, int num_players, int num_frames, bool batch, RunStats * stats ) {
+	bench_soc = soc;
+	bench_cms = cms;
+	num_traces = 0;
+	num_point_contents = 0;
+	num_events = 0;
+
+	gs_state_t gs = { };
+	gs.module = soc == CM_Server ? GS_MODULE_GAME : GS_MODULE_CGAME;
+	gs.maxclients = num_players;
+	gs.api.Trace = BenchTrace;
+	gs.api.GetEntityState = BenchGetEntityState;
+	gs.api.PointContents = BenchPointContents;
+	gs.api.PredictedEvent = BenchPredictedEvent;
+	gs.api.PredictedFireWeapon = BenchPredictedFireWeapon;
+	gs.api.PredictedUseGadget = BenchPredictedUseGadget;
+	gs.api.PMoveTouchTriggers = BenchTouchTriggers;
+
+	BenchPlayer * players = ALLOC_MANY( sys_allocator, BenchPlayer, num_players );
+	defer { FREE( sys_allocator, players ); };
+	bench_players = players;
+
+	pmove_t * pmoves = ALLOC_MANY( sys_allocator, pmove_t, num_players );
+	defer { FREE( sys_allocator, pmoves ); };
+
+	for( int i = 0; i < num_players; i++ ) {
+		SpawnPlayer( &players[ i ], i, DropToFloor( spawns[ i % spawns.n ] ) );
+	}
+
+	u64 hash = Hash64( u64( 0 ) );
+	u64 usec = 0;
+
+	for( int frame = 0; frame < num_frames; frame++ ) {
+		for( int i = 0; i < num_players; i++ ) {
+			NextCommand( &players[ i ] );
+		}
+
+		u64 t0 = Sys_Microseconds();
+		for( int i = 0; i < num_players; i++ ) {
+			pmoves[ i ] = { };
+			pmoves[ i ].playerState = &players[ i ].ps;
+			pmoves[ i ].cmd = players[ i ].cmd;
+		}
+		if( batch ) {
+			PmoveBatch( &gs, Span< pmove_t >( pmoves, num_players ) );
+		}
+		else {
+			for( int i = 0; i < num_players; i++ ) {
+				Pmove( &gs, &pmoves[ i ] );
+			}
+		}
+		usec += Sys_Microseconds() - t0;
+
+		u64 frame_hash = 0;
+		for( int i = 0; i < num_players; i++ ) {
+			const SyncPlayerState * ps = &players[ i ].ps;
+			frame_hash = Hash64( &players[ i ].event_hash, sizeof( players[ i ].event_hash ), frame_hash );
+			frame_hash = Hash64( &ps->pmove, sizeof( ps->pmove ), frame_hash );
+			frame_hash = Hash64( &ps->viewangles, sizeof( ps->viewangles ), frame_hash );
+			frame_hash = Hash64( &ps->viewheight, sizeof( ps->viewheight ), frame_hash );
+		}
+		stats->frame_hashes[ frame ] = frame_hash;
+		hash = Hash64( &frame_hash, sizeof( frame_hash ), hash );
+	}
+
+	stats->usec = usec;
+	stats->steps = u64( num_players ) * num_frames;
+	stats->traces = num_traces;
+	stats->point_contents = num_point_contents;
+	stats->events = num_events;
+	stats->hash = hash;
+}
+
+int main( int argc, char ** argv ) {
+	if( argc < 2 || argc > 5 ) {
+		printf( "Usage: pmovebench <map.bsp[.zst]> [players] [frames] [-v]\n" );
+		return 1;
+	}
+
+	int num_players = argc >= 3 ? atoi( argv[ 2 ] ) : 2048;
+	int num_frames = argc >= 4 ? atoi( argv[ 3 ] ) : 600;
+	bool verbose = argc == 5 && strcmp( argv[ 4 ], "-v" ) == 0;
+	if( num_players <= 0 || num_frames <= 0 ) {
+		printf( "Players and frames must be positive\n" );
+		return 1;
+	}
+
+	// same as a listen server, the client shares the server's map data
+	CollisionModel * server_cms;
+	if( !LoadMap( CM_Server, argv[ 1 ], &server_cms ) ) {
+		return 1;
+	}
+	defer { CM_Free( CM_Server, server_cms ); };
+
+	CollisionModel * client_cms = CM_ShareMap( CM_Client, CM_Server, server_cms );
+	defer { CM_Free( CM_Client, client_cms ); };
+
+	InitThreadPool();
+	defer { ShutdownThreadPool(); };
+	defer { FreeCheckCounts(); };
+
+	Vec3 spawns[ 256 ];
+	size_t num_spawns = FindSpawnPoints( server_cms, spawns, ARRAY_COUNT( spawns ) );
+	if( num_spawns == 0 ) {
+		printf( "Map has no spawn points\n" );
+		return 1;
+	}
+
+	RunStats server = { };
+	RunStats client = { };
+	RunStats batch = { };
+	server.frame_hashes = ALLOC_MANY( sys_allocator, u64, num_frames );
+	client.frame_hashes = ALLOC_MANY( sys_allocator, u64, num_frames );
+	batch.frame_hashes = ALLOC_MANY( sys_allocator, u64, num_frames );
+	defer { FREE( sys_allocator, server.frame_hashes ); };
+	defer { FREE( sys_allocator, client.frame_hashes ); };
+	defer { FREE( sys_allocator, batch.frame_hashes ); };
+
+	Span< const Vec3 > spawns_span( spawns, num_spawns );
+	Run( CM_Server, server_cms, spawns_span, num_players, num_frames, false, &server );
+	Run( CM_Client, client_cms, spawns_span, num_players, num_frames, false, &client );
+	Run( CM_Server, server_cms, spawns_span, num_players, num_frames, true, &batch );
+
+	int first_mismatch = -1;
+	int first_batch_mismatch = -1;
+	for( int i = 0; i < num_frames; i++ ) {
+		if( verbose ) {
+			printf( "frame %d: %016" PRIx64 "\n", i, server.frame_hashes[ i ] );
+		}
+		if( first_mismatch == -1 && server.frame_hashes[ i ] != client.frame_hashes[ i ] ) {
+			first_mismatch = i;
+		}
+		if( first_batch_mismatch == -1 && server.frame_hashes[ i ] != batch.frame_hashes[ i ] ) {
+			first_batch_mismatch = i;
+		}
+	}
+
+	printf( "%d players, %d frames, %zu spawn points\n", num_players, num_frames, num_spawns );
+	auto report = []( const char * name, const RunStats & stats ) {
+		printf( "%s: %8.1f ns/step, %6.2f traces/step, %6.2f point contents/step, %6.3f events/step\n", name,
+			stats.usec * 1000.0 / stats.steps, double( stats.traces ) / stats.steps,
+			double( stats.point_contents ) / stats.steps, double( stats.events ) / stats.steps );
+	};
+	report( "server", server );
+	report( "client", client );
+	report( "batch", batch );
+	printf( "hash: %016" PRIx64 "\n", server.hash );
+
+	bool ok = true;
+	if( first_mismatch != -1 ) {
+		printf( "client/server: FAILED (first mismatch on frame %d)\n", first_mismatch );
+		ok = false;
+	}
+	else {
+		printf( "client/server: ok\n" );
+	}
+
+	if( first_batch_mismatch != -1 ) {
+		printf( "batch/scalar: FAILED (first mismatch on frame %d)\n", first_batch_mismatch );
+		ok = false;
+	}
+	else {
+		printf( "batch/scalar: ok\n" );
+	}
+
+	return ok ? 0 : 1;
+}
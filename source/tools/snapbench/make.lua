@@ -0,0 +1,39 @@
+local windows_srcs = {
+	"source/windows/win_fs.cpp",
+	"source/windows/win_threads.cpp",
+	"source/windows/win_time.cpp",
+}
+
+local linux_srcs = {
+	"source/unix/unix_fs.cpp",
+	"source/unix/unix_threads.cpp",
+	"source/unix/unix_time.cpp",
+}
+
+local platform_srcs = OS == "windows" and windows_srcs or linux_srcs
+
+bin( "snapbench", {
+	srcs = {
+		"source/tools/snapbench/snapbench.cpp",
+		"source/client/snap_read.cpp",
+		"source/qcommon/allocators.cpp",
+		"source/qcommon/base.cpp",
+		"source/qcommon/half_float.cpp",
+		"source/qcommon/hash.cpp",
+		"source/qcommon/msg.cpp",
+		"source/qcommon/rng.cpp",
+		"source/qcommon/strtonum.cpp",
+		"source/gameshared/q_math.cpp",
+		"source/gameshared/q_shared.cpp",
+		platform_srcs,
+	},
+
+	libs = {
+		"ggformat",
+		"tracy",
+		"zlib",
+		"zstd",
+	},
+
+	gcc_extra_ldflags = "-lm -lpthread -ldl -no-pie -static-libstdc++",
+} )
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "zlib/zlib.h"
+#include "zstd/zstd.h"
+
+#include "qcommon/qcommon.h"
+#include "cgame/cg_public.h"
+
+/*
+ * replays the snapshots from a demo through the delta encoders and reports
+ * how fast they are, how big the output is, and whether everything decodes
+ * back to exactly what went in
+ *
+ * server demos are the interesting input because they're multipov, so
+ * they have every player and entity in them
+ */
+
+snapshot_t *SNAP_ParseFrame( msg_t *msg, snapshot_t *lastFrame, snapshot_t *backup, SyncEntityState *baselines, int showNet );
+void SNAP_ParseBaseline( msg_t *msg, SyncEntityState *baselines );
+
+void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
+	printf( "%s\n", msg );
+	abort();
+}
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+}
+
+void Com_DPrintf( const char * format, ... ) { }
+
+void Com_Error( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+struct Frame {
+	SyncGameState game_state;
+	int num_players;
+	SyncPlayerState * players;
+	int num_entities;
+	SyncEntityState * entities;
+};
+
+struct Demo {
+	SyncEntityState baselines[ MAX_BASELINES ];
+	Frame * frames;
+	size_t num_frames;
+	size_t capacity;
+
+	size_t original_bytes;
+	u64 decode_usec;
+};
+
+static void AddFrame( Demo * demo, const snapshot_t * snap ) {
+	if( demo->num_frames == demo->capacity ) {
+		demo->capacity = Max2( demo->capacity * 2, size_t( 256 ) );
+		demo->frames = REALLOC_MANY( sys_allocator, Frame, demo->frames, demo->num_frames, demo->capacity );
+	}
+
+	Frame * frame = &demo->frames[ demo->num_frames ];
+	demo->num_frames++;
+
+	frame->game_state = snap->gameState;
+	frame->num_players = snap->numplayers;
+	frame->players = ALLOC_MANY( sys_allocator, SyncPlayerState, snap->numplayers );
+	memcpy( frame->players, snap->playerStates, snap->numplayers * sizeof( SyncPlayerState ) );
+	frame->num_entities = snap->numEntities;
+	frame->entities = ALLOC_MANY( sys_allocator, SyncEntityState, snap->numEntities );
+	for( int i = 0; i < snap->numEntities; i++ ) {
+		frame->entities[ i ] = *snap->parsedEntities[ i ];
+	}
+}
+
+static void FreeDemo( Demo * demo ) {
+	for( size_t i = 0; i < demo->num_frames; i++ ) {
+		FREE( sys_allocator, demo->frames[ i ].players );
+		FREE( sys_allocator, demo->frames[ i ].entities );
+	}
+	FREE( sys_allocator, demo->frames );
+}
+
+/*
+ * server demos are zstd frames with a skippable trailer on the end, which
+ * ZSTD_decompressStream skips over by itself. gzread passes files that
+ * aren't gzipped through untouched, so both go through the same gzFile
+ */
+struct DemoReader {
+	gzFile gz;
+	ZSTD_DStream * zstd;
+	ZSTD_inBuffer input;
+	u8 buf[ 64 * 1024 ];
+};
+
+static bool OpenDemo( DemoReader * reader, const char * path ) {
+	reader->gz = gzopen( path, "rb" );
+	if( reader->gz == NULL )
+		return false;
+
+	reader->zstd = NULL;
+	reader->input = { reader->buf, 0, 0 };
+
+	u32 magic;
+	if( gzread( reader->gz, &magic, sizeof( magic ) ) == sizeof( magic ) && LittleLong( magic ) == ZSTD_MAGICNUMBER ) {
+		reader->zstd = ZSTD_createDStream();
+	}
+	gzrewind( reader->gz );
+
+	return true;
+}
+
+static void CloseDemo( DemoReader * reader ) {
+	ZSTD_freeDStream( reader->zstd );
+	gzclose( reader->gz );
+}
+
+static size_t ReadDemoBytes( DemoReader * reader, void * dst, size_t n ) {
+	if( reader->zstd == NULL ) {
+		int r = gzread( reader->gz, dst, n );
+		return r < 0 ? 0 : size_t( r );
+	}
+
+	ZSTD_outBuffer output = { dst, n, 0 };
+	while( output.pos < output.size ) {
+		if( reader->input.pos == reader->input.size ) {
+			int r = gzread( reader->gz, reader->buf, sizeof( reader->buf ) );
+			reader->input = { reader->buf, size_t( Max2( r, 0 ) ), 0 };
+		}
+
+		size_t before = output.pos;
+		size_t r = ZSTD_decompressStream( reader->zstd, &output, &reader->input );
+		if( ZSTD_isError( r ) ) {
+			Com_Error( "Can't decompress demo: %s", ZSTD_getErrorName( r ) );
+		}
+
+		if( reader->input.size == 0 && output.pos == before )
+			break;
+	}
+
+	return output.pos;
+}
+
+static bool ReadDemoMessage( DemoReader * reader, msg_t * msg ) {
+	s32 len;
+	if( ReadDemoBytes( reader, &len, sizeof( len ) ) != sizeof( len ) || len == -1 ) {
+		return false;
+	}
+	len = LittleLong( len );
+
+	if( len < 0 || size_t( len ) > msg->maxsize ) {
+		Com_Error( "Bad demo message length: %d", len );
+	}
+
+	if( ReadDemoBytes( reader, msg->data, len ) != size_t( len ) ) {
+		Com_Error( "Demo file is truncated" );
+	}
+
+	msg->cursize = len;
+	msg->readcount = 0;
+	return true;
+}
+
+static bool LoadDemo( const char * path, Demo * demo ) {
+	static DemoReader reader;
+	if( !OpenDemo( &reader, path ) ) {
+		printf( "Can't open %s\n", path );
+		return false;
+	}
+	defer { CloseDemo( &reader ); };
+
+	static snapshot_t backup[ UPDATE_BACKUP ];
+	snapshot_t * last_frame = NULL;
+
+	uint8_t msg_buf[ MAX_MSGLEN ];
+	msg_t msg;
+	MSG_Init( &msg, msg_buf, sizeof( msg_buf ) );
+
+	while( ReadDemoMessage( &reader, &msg ) ) {
+		while( msg.readcount < msg.cursize ) {
+			int cmd = MSG_ReadUint8( &msg );
+			switch( cmd ) {
+				case svc_servercmd:
+					MSG_ReadInt32( &msg );
+					MSG_ReadString( &msg );
+					break;
+
+				case svc_servercs:
+					MSG_ReadString( &msg );
+					break;
+
+				case svc_configstrings: {
+					MSG_ReadInt32( &msg );
+					u64 count = MSG_ReadUintBase128( &msg );
+					for( u64 i = 0; i < count && msg.readcount < msg.cursize; i++ ) {
+						MSG_ReadUintBase128( &msg );
+						MSG_ReadString( &msg );
+					}
+				} break;
+
+				case svc_serverdata:
+					MSG_ReadInt32( &msg );
+					MSG_ReadInt32( &msg );
+					MSG_ReadInt16( &msg );
+					MSG_ReadInt16( &msg );
+					MSG_ReadString( &msg );
+					break;
+
+				case svc_spawnbaseline:
+					SNAP_ParseBaseline( &msg, demo->baselines );
+					break;
+
+				case svc_demoinfo:
+					MSG_SkipData( &msg, MSG_ReadInt32( &msg ) );
+					break;
+
+				case svc_frame: {
+					size_t start = msg.readcount;
+					u64 t0 = Sys_Microseconds();
+					snapshot_t * snap = SNAP_ParseFrame( &msg, last_frame, backup, demo->baselines, 0 );
+					demo->decode_usec += Sys_Microseconds() - t0;
+					demo->original_bytes += msg.readcount - start;
+
+					if( snap->valid ) {
+						last_frame = snap;
+						AddFrame( demo, snap );
+					}
+				} break;
+
+				default:
+					Com_Error( "Unknown demo message: %d", cmd );
+			}
+		}
+	}
+
+	return true;
+}
+
+struct EncodeStats {
+	u64 usec;
+	size_t bytes;
+	size_t count;
+	size_t mismatches;
+};
+
+/*
+ * entities are encoded the same way SNAP_WritePacketEntities does it:
+ * merge the two sorted lists, delta against the previous state if the
+ * entity was there last frame and against the baseline otherwise
+ */
+static void EncodeEntities( msg_t * msg, const Demo * demo, const Frame * from, const Frame * to ) {
+	int from_idx = 0;
+	int to_idx = 0;
+	while( from_idx < from->num_entities || to_idx < to->num_entities ) {
+		int from_num = from_idx < from->num_entities ? from->entities[ from_idx ].number : 9999;
+		int to_num = to_idx < to->num_entities ? to->entities[ to_idx ].number : 9999;
+
+		if( from_num == to_num ) {
+			MSG_WriteDeltaEntity( msg, &from->entities[ from_idx ], &to->entities[ to_idx ], false );
+			from_idx++;
+			to_idx++;
+		}
+		else if( to_num < from_num ) {
+			MSG_WriteDeltaEntity( msg, &demo->baselines[ to_num ], &to->entities[ to_idx ], true );
+			to_idx++;
+		}
+		else {
+			MSG_WriteEntityNumber( msg, from_num, true );
+			from_idx++;
+		}
+	}
+
+	MSG_WriteIntBase128( msg, 0 );
+}
+
+static void DecodeEntities( msg_t * msg, const Demo * demo, const Frame * from, const Frame * to, EncodeStats * stats ) {
+	int from_idx = 0;
+	int to_idx = 0;
+
+	while( true ) {
+		bool remove;
+		int num = MSG_ReadEntityNumber( msg, &remove );
+		if( num == 0 || msg->readcount > msg->cursize ) {
+			break;
+		}
+
+		// unchanged entities were skipped by the encoder
+		while( from_idx < from->num_entities && from->entities[ from_idx ].number < num ) {
+			from_idx++;
+		}
+
+		bool in_from = from_idx < from->num_entities && from->entities[ from_idx ].number == num;
+		if( remove ) {
+			if( in_from ) {
+				from_idx++;
+			}
+			continue;
+		}
+
+		const SyncEntityState * baseline = in_from ? &from->entities[ from_idx ] : &demo->baselines[ num ];
+		SyncEntityState decoded;
+		memset( &decoded, 0, sizeof( decoded ) );
+		MSG_ReadDeltaEntity( msg, baseline, &decoded );
+		decoded.number = num;
+
+		while( to_idx < to->num_entities && to->entities[ to_idx ].number < num ) {
+			to_idx++;
+		}
+		if( to_idx >= to->num_entities || memcmp( &decoded, &to->entities[ to_idx ], sizeof( decoded ) ) != 0 ) {
+			stats->mismatches++;
+		}
+
+		if( in_from ) {
+			from_idx++;
+		}
+	}
+}
+
+static void Benchmark( const Demo * demo, int iterations ) {
+	EncodeStats game_state = { };
+	EncodeStats players = { };
+	EncodeStats entities = { };
+	EncodeStats roundtrip = { };
+
+	static uint8_t msg_buf[ MAX_MSGLEN ];
+	msg_t msg;
+	MSG_Init( &msg, msg_buf, sizeof( msg_buf ) );
+
+	Frame empty = { };
+
+	for( int iter = 0; iter < iterations; iter++ ) {
+		for( size_t i = 0; i < demo->num_frames; i++ ) {
+			const Frame * from = i == 0 ? &empty : &demo->frames[ i - 1 ];
+			const Frame * to = &demo->frames[ i ];
+			bool last_iter = iter == iterations - 1;
+
+			// game state
+			MSG_Clear( &msg );
+			u64 t0 = Sys_Microseconds();
+			MSG_WriteDeltaGameState( &msg, i == 0 ? NULL : &from->game_state, &to->game_state );
+			game_state.usec += Sys_Microseconds() - t0;
+			game_state.count++;
+			game_state.bytes += msg.cursize;
+
+			if( last_iter ) {
+				SyncGameState decoded;
+				memset( &decoded, 0, sizeof( decoded ) );
+				MSG_BeginReading( &msg );
+				MSG_ReadDeltaGameState( &msg, i == 0 ? NULL : &from->game_state, &decoded );
+				if( memcmp( &decoded, &to->game_state, sizeof( decoded ) ) != 0 ) {
+					roundtrip.mismatches++;
+				}
+			}
+
+			// player states
+			MSG_Clear( &msg );
+			t0 = Sys_Microseconds();
+			for( int p = 0; p < to->num_players; p++ ) {
+				MSG_WriteDeltaPlayerState( &msg, p < from->num_players ? &from->players[ p ] : NULL, &to->players[ p ] );
+			}
+			players.usec += Sys_Microseconds() - t0;
+			players.count += to->num_players;
+			players.bytes += msg.cursize;
+
+			if( last_iter ) {
+				MSG_BeginReading( &msg );
+				for( int p = 0; p < to->num_players; p++ ) {
+					SyncPlayerState decoded;
+					memset( &decoded, 0, sizeof( decoded ) );
+					MSG_ReadDeltaPlayerState( &msg, p < from->num_players ? &from->players[ p ] : NULL, &decoded );
+					if( memcmp( &decoded, &to->players[ p ], sizeof( decoded ) ) != 0 ) {
+						roundtrip.mismatches++;
+					}
+				}
+			}
+
+			// entities
+			MSG_Clear( &msg );
+			t0 = Sys_Microseconds();
+			EncodeEntities( &msg, demo, from, to );
+			entities.usec += Sys_Microseconds() - t0;
+			entities.count += to->num_entities;
+			entities.bytes += msg.cursize;
+
+			if( last_iter ) {
+				MSG_BeginReading( &msg );
+				t0 = Sys_Microseconds();
+				DecodeEntities( &msg, demo, from, to, &roundtrip );
+				roundtrip.usec += Sys_Microseconds() - t0;
+				roundtrip.count += to->num_entities;
+			}
+		}
+	}
+
+	size_t frames = demo->num_frames * iterations;
+	auto ns_per = []( const EncodeStats & stats ) {
+		return stats.count == 0 ? 0.0 : stats.usec * 1000.0 / stats.count;
+	};
+	auto bytes_per_frame = [&]( const EncodeStats & stats ) {
+		return double( stats.bytes ) / frames;
+	};
+
+	printf( "%zu frames, %d iterations\n", demo->num_frames, iterations );
+	printf( "demo:       %8.1f bytes/snapshot, %8.1f us/snapshot to decode\n",
+		double( demo->original_bytes ) / demo->num_frames, double( demo->decode_usec ) / demo->num_frames );
+	printf( "game state: %8.1f bytes/snapshot, %8.1f ns/state\n", bytes_per_frame( game_state ), ns_per( game_state ) );
+	printf( "players:    %8.1f bytes/snapshot, %8.1f ns/player\n", bytes_per_frame( players ), ns_per( players ) );
+	printf( "entities:   %8.1f bytes/snapshot, %8.1f ns/entity encode, %8.1f ns/entity decode\n",
+		bytes_per_frame( entities ), ns_per( entities ), ns_per( roundtrip ) );
+	printf( "round trip: %s (%zu mismatches)\n", roundtrip.mismatches == 0 ? "ok" : "FAILED", roundtrip.mismatches );
+}
+
+int main( int argc, char ** argv ) {
+	if( argc < 2 || argc > 3 ) {
+		printf( "Usage: snapbench <demo" APP_DEMO_EXTENSION_STR "> [iterations]\n" );
+		return 1;
+	}
+
+	int iterations = argc == 3 ? atoi( argv[ 2 ] ) : 10;
+	if( iterations <= 0 ) {
+		printf( "Iterations must be positive\n" );
+		return 1;
+	}
+
+	static Demo demo;
+	if( !LoadDemo( argv[ 1 ], &demo ) ) {
+		return 1;
+	}
+	defer { FreeDemo( &demo ); };
+
+	if( demo.num_frames == 0 ) {
+		printf( "Demo has no frames\n" );
+		return 1;
+	}
+
+	Benchmark( &demo, iterations );
+
+	return 0;
+}
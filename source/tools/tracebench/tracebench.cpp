@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <algorithm>
+
+#include "qcommon/qcommon.h"
+#include "qcommon/cmodel.h"
+#include "qcommon/compression.h"
+#include "qcommon/fs.h"
+#include "qcommon/hash.h"
+#include "qcommon/trace_corpus.h"
+
+/*
+ * replays traces recorded on a live server with tracerecord against the
+ * map they came from, and reports ns per trace, percentiles, and how many
+ * brushes and patch faces each trace tests
+ *
+ * the results get hashed so a collision change that's meant to be a pure
+ * speedup can check it still gives the same answers
+ */
+
+void ShowErrorAndAbortImpl( const char * msg, const char * file, int line ) {
+	printf( "%s\n", msg );
+	abort();
+}
+
+void Com_Printf( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+}
+
+void Com_DPrintf( const char * format, ... ) { }
+
+void Cmd_AddCommand( const char * cmd_name, xcommand_t function ) { }
+void Cmd_RemoveCommand( const char * cmd_name ) { }
+
+void Com_Error( const char * format, ... ) {
+	va_list argptr;
+	va_start( argptr, format );
+	vprintf( format, argptr );
+	va_end( argptr );
+	printf( "\n" );
+	exit( 1 );
+}
+
+#define ROUNDS 5
+
+static bool LoadMap( const char * path, CollisionModel ** cms ) {
+	Span< u8 > data = ReadFileBinary( sys_allocator, path );
+	if( data.ptr == NULL ) {
+		printf( "Can't open %s\n", path );
+		return false;
+	}
+	defer { FREE( sys_allocator, data.ptr ); };
+
+	Span< u8 > decompressed = data;
+	bool compressed = StrCaseEqual( LastFileExtension( path ), ".zst" );
+	if( compressed && !Decompress( path, sys_allocator, data, &decompressed ) ) {
+		printf( "Can't decompress %s\n", path );
+		return false;
+	}
+	defer { if( compressed ) FREE( sys_allocator, decompressed.ptr ); };
+
+	*cms = CM_LoadMap( CM_Server, decompressed, Hash64( path ) );
+	return true;
+}
+
+static bool LoadCorpus( const char * path, Span< u8 > * data, Span< const TraceCorpusRecord > * records ) {
+	*data = ReadFileBinary( sys_allocator, path );
+	if( data->ptr == NULL ) {
+		printf( "Can't open %s\n", path );
+		return false;
+	}
+
+	TraceCorpusHeader header;
+	if( data->n < sizeof( header ) ) {
+		printf( "%s is too small to be a trace corpus\n", path );
+		return false;
+	}
+	memcpy( &header, data->ptr, sizeof( header ) );
+
+	if( header.magic != TRACE_CORPUS_MAGIC || data->n != sizeof( header ) + size_t( header.num_records ) * sizeof( TraceCorpusRecord ) ) {
+		printf( "%s isn't a trace corpus\n", path );
+		return false;
+	}
+
+	header.map[ sizeof( header.map ) - 1 ] = '\0';
+	printf( "%s: %u traces recorded on %s\n", path, header.num_records, header.map );
+
+	*records = Span< const TraceCorpusRecord >( ( const TraceCorpusRecord * ) ( data->ptr + sizeof( header ) ), header.num_records );
+	return true;
+}
+
+static void BoxTrace( CollisionModel * cms, CollisionCheckCounts * checkcounts, trace_t * trace, const TraceCorpusRecord & record ) {
+	CM_TransformedBoxTrace( CM_Server, cms, checkcounts, trace, record.start, record.end, record.mins, record.maxs, NULL, record.contentmask, Vec3( 0.0f ), Vec3( 0.0f ) );
+}
+
+static int PointContents( CollisionModel * cms, const TraceCorpusRecord & record ) {
+	return CM_TransformedPointContents( CM_Server, cms, record.start, NULL, Vec3( 0.0f ), Vec3( 0.0f ) );
+}
+
+static u64 CountTested( const int * checkcounts, int n, int checkcount ) {
+	u64 tested = 0;
+	for( int i = 0; i < n; i++ ) {
+		tested += checkcounts[ i ] == checkcount ? 1 : 0;
+	}
+	return tested;
+}
+
+static void PrintPercentiles( const char * name, Span< u32 > ns ) {
+	if( ns.n == 0 ) {
+		printf( "  %-15s none\n", name );
+		return;
+	}
+
+	std::sort( ns.begin(), ns.end() );
+	auto percentile = [&]( double p ) {
+		return ns[ Min2( size_t( p * ns.n ), ns.n - 1 ) ];
+	};
+
+	printf( "  %-15s p50 %6u ns, p90 %6u ns, p99 %6u ns, max %8u ns\n", name,
+		percentile( 0.5 ), percentile( 0.9 ), percentile( 0.99 ), ns[ ns.n - 1 ] );
+}
+
+static bool BenchMap( const char * map_path, const char * corpus_path ) {
+	CollisionModel * cms;
+	if( !LoadMap( map_path, &cms ) ) {
+		return false;
+	}
+	defer { CM_Free( CM_Server, cms ); };
+
+	Span< u8 > corpus;
+	Span< const TraceCorpusRecord > records;
+	defer { FREE( sys_allocator, corpus.ptr ); };
+	if( !LoadCorpus( corpus_path, &corpus, &records ) ) {
+		return false;
+	}
+
+	CollisionCheckCounts checkcounts = CM_NewCheckCounts( sys_allocator, cms );
+	defer { FREE( sys_allocator, checkcounts.brushes ); };
+	defer { FREE( sys_allocator, checkcounts.faces ); };
+
+	// split them up so each kind gets timed on its own
+	Span< TraceCorpusRecord > traces = ALLOC_SPAN( sys_allocator, TraceCorpusRecord, records.n );
+	Span< TraceCorpusRecord > points = ALLOC_SPAN( sys_allocator, TraceCorpusRecord, records.n );
+	defer { FREE( sys_allocator, traces.ptr ); };
+	defer { FREE( sys_allocator, points.ptr ); };
+	traces.n = 0;
+	points.n = 0;
+	for( const TraceCorpusRecord & record : records ) {
+		if( record.type == TraceCorpusRecord_BoxTrace ) {
+			traces[ traces.n++ ] = record;
+		}
+		else {
+			points[ points.n++ ] = record;
+		}
+	}
+
+	// first pass checks the answers and counts what got tested, which is
+	// too slow to do while timing
+	u64 hash = Hash64( u64( 0 ) );
+	u64 brushes_tested = 0;
+	u64 faces_tested = 0;
+	for( const TraceCorpusRecord & record : traces ) {
+		trace_t trace;
+		BoxTrace( cms, &checkcounts, &trace, record );
+		brushes_tested += CountTested( checkcounts.brushes, cms->numbrushes, checkcounts.checkcount );
+		faces_tested += CountTested( checkcounts.faces, cms->numfaces, checkcounts.checkcount );
+
+		u32 flags = ( trace.startsolid ? 1 : 0 ) | ( trace.allsolid ? 2 : 0 );
+		hash = Hash64( &trace.fraction, sizeof( trace.fraction ), hash );
+		hash = Hash64( &trace.endpos, sizeof( trace.endpos ), hash );
+		hash = Hash64( &trace.plane.normal, sizeof( trace.plane.normal ), hash );
+		hash = Hash64( &trace.contents, sizeof( trace.contents ), hash );
+		hash = Hash64( &flags, sizeof( flags ), hash );
+	}
+	for( const TraceCorpusRecord & record : points ) {
+		int contents = PointContents( cms, record );
+		hash = Hash64( &contents, sizeof( contents ), hash );
+	}
+
+	u64 trace_ns = 0;
+	u64 point_ns = 0;
+	int checksum = 0;
+	for( int round = 0; round < ROUNDS; round++ ) {
+		u64 t0 = Sys_Nanoseconds();
+		for( const TraceCorpusRecord & record : traces ) {
+			trace_t trace;
+			BoxTrace( cms, &checkcounts, &trace, record );
+			checksum += trace.contents;
+		}
+		u64 t1 = Sys_Nanoseconds();
+		for( const TraceCorpusRecord & record : points ) {
+			checksum += PointContents( cms, record );
+		}
+		u64 t2 = Sys_Nanoseconds();
+
+		trace_ns += t1 - t0;
+		point_ns += t2 - t1;
+	}
+
+	// timing each one separately costs a clock read per trace, so the
+	// percentiles come from their own pass
+	Span< u32 > trace_samples = ALLOC_SPAN( sys_allocator, u32, traces.n );
+	Span< u32 > point_samples = ALLOC_SPAN( sys_allocator, u32, points.n );
+	defer { FREE( sys_allocator, trace_samples.ptr ); };
+	defer { FREE( sys_allocator, point_samples.ptr ); };
+	for( size_t i = 0; i < traces.n; i++ ) {
+		trace_t trace;
+		u64 t0 = Sys_Nanoseconds();
+		BoxTrace( cms, &checkcounts, &trace, traces[ i ] );
+		trace_samples[ i ] = u32( Min2( Sys_Nanoseconds() - t0, u64( U32_MAX ) ) );
+		checksum += trace.contents;
+	}
+	for( size_t i = 0; i < points.n; i++ ) {
+		u64 t0 = Sys_Nanoseconds();
+		checksum += PointContents( cms, points[ i ] );
+		point_samples[ i ] = u32( Min2( Sys_Nanoseconds() - t0, u64( U32_MAX ) ) );
+	}
+
+	printf( "%s: %zu box traces, %zu point contents, %d brushes, %d patch faces\n", map_path, traces.n, points.n, cms->numbrushes, cms->numfaces );
+	if( traces.n > 0 ) {
+		printf( "  %-15s %8.1f ns/trace, %7.2f brushes/trace, %7.2f faces/trace\n", "box traces",
+			double( trace_ns ) / ROUNDS / traces.n, double( brushes_tested ) / traces.n, double( faces_tested ) / traces.n );
+	}
+	if( points.n > 0 ) {
+		printf( "  %-15s %8.1f ns/call\n", "point contents", double( point_ns ) / ROUNDS / points.n );
+	}
+	PrintPercentiles( "box traces", trace_samples );
+	PrintPercentiles( "point contents", point_samples );
+	printf( "  hash: %016" PRIx64 "\n", hash );
+
+	// so the timed loops don't get optimised out
+	if( checksum == 0x12345678 ) {
+		printf( "  checksum is unlucky\n" );
+	}
+
+	return true;
+}
+
+int main( int argc, char ** argv ) {
+	if( argc < 3 || argc % 2 != 1 ) {
+		printf( "Usage: tracebench <map.bsp[.zst]> <corpus.traces> [<map.bsp[.zst]> <corpus.traces> ...]\n" );
+		return 1;
+	}
+
+	bool ok = true;
+	for( int i = 1; i < argc; i += 2 ) {
+		ok = BenchMap( argv[ i ], argv[ i + 1 ] ) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -18,6 +18,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qcommon/qcommon.h"
+#include "qcommon/array.h"
 #include "qcommon/fs.h"
 #include "qcommon/sys_fs.h"
 
@@ -27,6 +28,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/fs.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 
@@ -78,6 +81,30 @@ bool CreateDirectory( Allocator * a, const char * path ) {
 	return mkdir( path, 0755 ) == 0 || errno == EEXIST;
 }
 
+bool MapFile( Allocator * a, const char * path, Span< const u8 > * mapped ) {
+	int fd = open( path, O_RDONLY );
+	if( fd == -1 )
+		return false;
+	defer { close( fd ); };
+
+	struct stat buf;
+	if( fstat( fd, &buf ) == -1 || buf.st_size == 0 )
+		return false;
+
+	void * ptr = mmap( NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if( ptr == MAP_FAILED )
+		return false;
+
+	*mapped = Span< const u8 >( ( const u8 * ) ptr, buf.st_size );
+	return true;
+}
+
+void UnmapFile( Span< const u8 > mapped ) {
+	if( mapped.ptr != NULL ) {
+		munmap( const_cast< u8 * >( mapped.ptr ), mapped.n );
+	}
+}
+
 struct ListDirHandleImpl {
 	DIR * dir;
 };
@@ -136,6 +163,220 @@ FileMetadata FileMetadataOrZeroes( TempAllocator * temp, const char * path ) {
 	return metadata;
 }
 
+/*
+ * inotify isn't recursive so every directory gets its own watch, and new
+ * directories get walked when they show up in case files landed in them
+ * before we were watching
+ */
+struct WatchedDir {
+	int wd;
+	char * path; // relative to root, "" for root itself
+};
+
+struct FSWatcher {
+	Allocator * a;
+	int fd;
+	char * root;
+	NonRAIIDynamicArray< WatchedDir > dirs;
+	NonRAIIDynamicArray< char * > pending;
+	char * last_path;
+	bool missed_dirs;
+
+	alignas( inotify_event ) char events[ 4096 ];
+	size_t events_len;
+	size_t events_cursor;
+};
+
+static char * JoinRelativePath( Allocator * a, const char * dir, const char * name ) {
+	if( dir[ 0 ] == '\0' )
+		return CopyString( a, name );
+	return ( *a )( "{}/{}", dir, name );
+}
+
+static void WatchRecursive( FSWatcher * watcher, const char * relative, bool report_files ) {
+	Allocator * a = watcher->a;
+
+	char * full = JoinRelativePath( a, watcher->root, relative );
+	defer { FREE( a, full ); };
+
+	// usually this is running out of fs.inotify.max_user_watches
+	int wd = inotify_add_watch( watcher->fd, full, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR );
+	if( wd == -1 ) {
+		watcher->missed_dirs = true;
+		return;
+	}
+
+	// watches are per inode, so a directory that got moved comes back with
+	// the wd it already had
+	bool already_watched = false;
+	for( WatchedDir & dir : watcher->dirs ) {
+		if( dir.wd == wd ) {
+			FREE( a, dir.path );
+			dir.path = CopyString( a, relative );
+			already_watched = true;
+		}
+	}
+
+	if( !already_watched ) {
+		WatchedDir dir = { wd, CopyString( a, relative ) };
+		watcher->dirs.add( dir );
+	}
+
+	ListDirHandle scan = BeginListDir( a, full );
+
+	const char * name;
+	bool is_dir;
+	while( ListDirNext( &scan, &name, &is_dir ) ) {
+		if( name[ 0 ] == '.' )
+			continue;
+
+		char * child = JoinRelativePath( a, relative, name );
+		if( is_dir ) {
+			WatchRecursive( watcher, child, report_files );
+			FREE( a, child );
+		}
+		else if( report_files ) {
+			watcher->pending.add( child );
+		}
+		else {
+			FREE( a, child );
+		}
+	}
+}
+
+FSWatcher * NewFSWatcher( Allocator * a, const char * path ) {
+	int fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if( fd == -1 )
+		return NULL;
+
+	FSWatcher * watcher = ALLOC( a, FSWatcher );
+	watcher->a = a;
+	watcher->fd = fd;
+	watcher->root = CopyString( a, path );
+	watcher->dirs.init( a );
+	watcher->pending.init( a );
+	watcher->last_path = NULL;
+	watcher->missed_dirs = false;
+	watcher->events_len = 0;
+	watcher->events_cursor = 0;
+
+	WatchRecursive( watcher, "", false );
+
+	// if we can't see everything it's better to fall back to scanning
+	if( watcher->missed_dirs ) {
+		DeleteFSWatcher( watcher );
+		return NULL;
+	}
+
+	return watcher;
+}
+
+void DeleteFSWatcher( FSWatcher * watcher ) {
+	if( watcher == NULL )
+		return;
+
+	Allocator * a = watcher->a;
+
+	close( watcher->fd );
+
+	for( WatchedDir & dir : watcher->dirs ) {
+		FREE( a, dir.path );
+	}
+	for( char * path : watcher->pending ) {
+		FREE( a, path );
+	}
+
+	watcher->dirs.shutdown();
+	watcher->pending.shutdown();
+	FREE( a, watcher->last_path );
+	FREE( a, watcher->root );
+	FREE( a, watcher );
+}
+
+static void RemoveWatchedDir( FSWatcher * watcher, int wd ) {
+	for( size_t i = 0; i < watcher->dirs.size(); i++ ) {
+		if( watcher->dirs[ i ].wd == wd ) {
+			FREE( watcher->a, watcher->dirs[ i ].path );
+			watcher->dirs[ i ] = watcher->dirs.top();
+			watcher->dirs.resize( watcher->dirs.size() - 1 );
+			return;
+		}
+	}
+}
+
+static const WatchedDir * FindWatchedDir( const FSWatcher * watcher, int wd ) {
+	for( const WatchedDir & dir : watcher->dirs ) {
+		if( dir.wd == wd ) {
+			return &dir;
+		}
+	}
+	return NULL;
+}
+
+bool PollFSWatcher( FSWatcher * watcher, const char ** path ) {
+	Allocator * a = watcher->a;
+
+	FREE( a, watcher->last_path );
+	watcher->last_path = NULL;
+
+	while( true ) {
+		if( watcher->pending.size() > 0 ) {
+			watcher->last_path = watcher->pending.top();
+			watcher->pending.resize( watcher->pending.size() - 1 );
+			*path = watcher->last_path;
+			return true;
+		}
+
+		if( watcher->events_cursor == watcher->events_len ) {
+			ssize_t n = read( watcher->fd, watcher->events, sizeof( watcher->events ) );
+			if( n <= 0 )
+				return false;
+			watcher->events_len = size_t( n );
+			watcher->events_cursor = 0;
+		}
+
+		const inotify_event * event = ( const inotify_event * ) ( watcher->events + watcher->events_cursor );
+		watcher->events_cursor += sizeof( inotify_event ) + event->len;
+
+		if( event->mask & IN_Q_OVERFLOW ) {
+			*path = NULL;
+			return true;
+		}
+
+		if( event->mask & IN_IGNORED ) {
+			RemoveWatchedDir( watcher, event->wd );
+			continue;
+		}
+
+		if( event->len == 0 || event->name[ 0 ] == '.' )
+			continue;
+
+		const WatchedDir * dir = FindWatchedDir( watcher, event->wd );
+		if( dir == NULL )
+			continue;
+
+		char * relative = JoinRelativePath( a, dir->path, event->name );
+
+		if( event->mask & IN_ISDIR ) {
+			if( event->mask & ( IN_CREATE | IN_MOVED_TO ) ) {
+				WatchRecursive( watcher, relative, true );
+			}
+			FREE( a, relative );
+			continue;
+		}
+
+		// new files get reported when they're closed
+		if( event->mask & IN_CREATE ) {
+			FREE( a, relative );
+			continue;
+		}
+
+		watcher->last_path = relative;
+		*path = relative;
+		return true;
+	}
+}
+
 char * GetExePath( Allocator * a ) {
 	size_t buf_size = 1024;
 	char * buf = ALLOC_MANY( a, char, buf_size );
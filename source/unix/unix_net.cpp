@@ -26,6 +26,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <sys/param.h>
 #include <sys/ioctl.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/epoll.h>
 #include <errno.h>
 #include <arpa/inet.h>
 
@@ -52,6 +54,132 @@ int Sys_NET_SocketIoctl( socket_handle_t handle, long request, ioctl_param_t* pa
 	return ioctl( handle, request, param );
 }
 
+int Sys_NET_RecvDatagrams( socket_handle_t handle, sys_datagram_t * datagrams, int n ) {
+	mmsghdr msgs[ 64 ];
+	iovec iovs[ 64 ];
+	n = Min2( n, int( ARRAY_COUNT( msgs ) ) );
+
+	memset( msgs, 0, n * sizeof( msgs[ 0 ] ) );
+	for( int i = 0; i < n; i++ ) {
+		iovs[ i ].iov_base = datagrams[ i ].data;
+		iovs[ i ].iov_len = datagrams[ i ].length;
+		msgs[ i ].msg_hdr.msg_name = datagrams[ i ].address;
+		msgs[ i ].msg_hdr.msg_namelen = sizeof( sockaddr_storage );
+		msgs[ i ].msg_hdr.msg_iov = &iovs[ i ];
+		msgs[ i ].msg_hdr.msg_iovlen = 1;
+	}
+
+	int ret = recvmmsg( handle, msgs, n, MSG_DONTWAIT, NULL );
+	if( ret == -1 ) {
+		return SOCKET_ERROR;
+	}
+
+	// truncated datagrams come back with length == buffer size, same as recvfrom
+	for( int i = 0; i < ret; i++ ) {
+		datagrams[ i ].length = msgs[ i ].msg_len;
+		datagrams[ i ].addrlen = msgs[ i ].msg_hdr.msg_namelen;
+	}
+
+	return ret;
+}
+
+int Sys_NET_SendDatagrams( socket_handle_t handle, const sys_datagram_t * datagrams, int n ) {
+	mmsghdr msgs[ 64 ];
+	iovec iovs[ 64 ];
+	n = Min2( n, int( ARRAY_COUNT( msgs ) ) );
+
+	memset( msgs, 0, n * sizeof( msgs[ 0 ] ) );
+	for( int i = 0; i < n; i++ ) {
+		iovs[ i ].iov_base = datagrams[ i ].data;
+		iovs[ i ].iov_len = datagrams[ i ].length;
+		msgs[ i ].msg_hdr.msg_name = datagrams[ i ].address;
+		msgs[ i ].msg_hdr.msg_namelen = datagrams[ i ].addrlen;
+		msgs[ i ].msg_hdr.msg_iov = &iovs[ i ];
+		msgs[ i ].msg_hdr.msg_iovlen = 1;
+	}
+
+	int ret = sendmmsg( handle, msgs, n, MSG_NOSIGNAL );
+	return ret == -1 ? SOCKET_ERROR : ret;
+}
+
+int Sys_NET_SendFile( socket_handle_t handle, FILE * file, size_t offset, size_t length ) {
+	off_t off = offset;
+	ssize_t ret = sendfile( handle, fileno( file ), &off, length );
+	return ret == -1 ? SOCKET_ERROR : int( ret );
+}
+
+struct NetPoller {
+	int fd;
+};
+
+static u32 EpollEvents( u32 flags ) {
+	u32 events = 0;
+	if( flags & NetPoll_Read )
+		events |= EPOLLIN;
+	if( flags & NetPoll_Write )
+		events |= EPOLLOUT;
+	return events;
+}
+
+NetPoller * Sys_NET_NewPoller() {
+	int fd = epoll_create1( EPOLL_CLOEXEC );
+	if( fd == -1 ) {
+		FatalErrno( "epoll_create1" );
+	}
+
+	NetPoller * poller = ALLOC( sys_allocator, NetPoller );
+	poller->fd = fd;
+	return poller;
+}
+
+void Sys_NET_DeletePoller( NetPoller * poller ) {
+	close( poller->fd );
+	FREE( sys_allocator, poller );
+}
+
+static bool EpollCtl( NetPoller * poller, int op, socket_handle_t handle, u32 flags, void * user ) {
+	epoll_event event = { };
+	event.events = EpollEvents( flags );
+	event.data.ptr = user;
+	return epoll_ctl( poller->fd, op, handle, &event ) == 0;
+}
+
+bool Sys_NET_PollerAdd( NetPoller * poller, socket_handle_t handle, u32 flags, void * user ) {
+	return EpollCtl( poller, EPOLL_CTL_ADD, handle, flags, user );
+}
+
+bool Sys_NET_PollerModify( NetPoller * poller, socket_handle_t handle, u32 flags, void * user ) {
+	return EpollCtl( poller, EPOLL_CTL_MOD, handle, flags, user );
+}
+
+void Sys_NET_PollerRemove( NetPoller * poller, socket_handle_t handle ) {
+	epoll_ctl( poller->fd, EPOLL_CTL_DEL, handle, NULL );
+}
+
+int Sys_NET_Poll( NetPoller * poller, int msec, NetPollEvent * events, int n ) {
+	epoll_event epoll_events[ 64 ];
+	n = Min2( n, int( ARRAY_COUNT( epoll_events ) ) );
+
+	int ret = epoll_wait( poller->fd, epoll_events, n, msec );
+	if( ret == -1 ) {
+		return errno == EINTR ? 0 : SOCKET_ERROR;
+	}
+
+	for( int i = 0; i < ret; i++ ) {
+		u32 e = epoll_events[ i ].events;
+		events[ i ].user = epoll_events[ i ].data.ptr;
+		events[ i ].flags = 0;
+		if( e & EPOLLIN )
+			events[ i ].flags |= NetPoll_Read;
+		if( e & EPOLLOUT )
+			events[ i ].flags |= NetPoll_Write;
+		if( e & ( EPOLLERR | EPOLLHUP ) )
+			events[ i ].flags |= NetPoll_Error;
+	}
+
+	return ret;
+}
+
 void Sys_NET_Init() {
 }
 
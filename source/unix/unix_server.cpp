@@ -67,31 +67,17 @@ void Sys_Quit() {
 }
 
 int main( int argc, char **argv ) {
-	unsigned int oldtime, newtime, time;
-
 	InitSig();
 
 	Qcommon_Init( argc, argv );
 
 	fcntl( 0, F_SETFL, fcntl( 0, F_GETFL, 0 ) | O_NONBLOCK );
 
-	oldtime = Sys_Milliseconds();
+	Com_ResetFrameClock();
 	while( true ) {
 		FrameMark;
 
-		// find time spent rendering last frame
-		do {
-			ZoneScopedN( "Interframe" );
-
-			newtime = Sys_Milliseconds();
-			time = newtime - oldtime;
-			if( time > 0 ) {
-				break;
-			}
-		} while( 1 );
-		oldtime = newtime;
-
-		Qcommon_Frame( time );
+		Qcommon_Frame( Com_WaitForFrame() );
 	}
 }
 
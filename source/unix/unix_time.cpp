@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -20,6 +21,12 @@ u64 Sys_Microseconds() {
 	return usec - base_usec;
 }
 
+u64 Sys_Nanoseconds() {
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return u64( ts.tv_sec ) * 1000000000 + u64( ts.tv_nsec );
+}
+
 s64 Sys_Milliseconds() {
 	return Sys_Microseconds() / 1000;
 }
@@ -28,6 +35,13 @@ void Sys_Sleep( unsigned int millis ) {
 	usleep( millis * 1000 );
 }
 
+void Sys_SleepMicroseconds( u64 usec ) {
+	struct timespec ts;
+	ts.tv_sec = usec / 1000000;
+	ts.tv_nsec = ( usec % 1000000 ) * 1000;
+	while( nanosleep( &ts, &ts ) == -1 && errno == EINTR );
+}
+
 bool Sys_FormatTime( char * buf, size_t buf_size, const char * fmt ) {
 	time_t now = time( NULL );
 	struct tm tm;
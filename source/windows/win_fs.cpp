@@ -100,6 +100,39 @@ bool CreateDirectory( Allocator * a, const char * path ) {
 	return CreateDirectoryW( wide_path, NULL ) != 0 || GetLastError() == ERROR_ALREADY_EXISTS;
 }
 
+bool MapFile( Allocator * a, const char * path, Span< const u8 > * mapped ) {
+	wchar_t * wide_path = UTF8ToWide( a, path );
+	defer { FREE( a, wide_path ); };
+
+	HANDLE file = CreateFileW( wide_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( file == INVALID_HANDLE_VALUE )
+		return false;
+	defer { CloseHandle( file ); };
+
+	LARGE_INTEGER size;
+	if( GetFileSizeEx( file, &size ) == 0 || size.QuadPart == 0 )
+		return false;
+
+	HANDLE mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( mapping == NULL )
+		return false;
+	defer { CloseHandle( mapping ); };
+
+	// the view keeps the mapping alive after we close the handles
+	void * ptr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	if( ptr == NULL )
+		return false;
+
+	*mapped = Span< const u8 >( ( const u8 * ) ptr, size.QuadPart );
+	return true;
+}
+
+void UnmapFile( Span< const u8 > mapped ) {
+	if( mapped.ptr != NULL ) {
+		UnmapViewOfFile( mapped.ptr );
+	}
+}
+
 struct ListDirHandleImpl {
 	HANDLE handle;
 	Allocator * a;
@@ -199,6 +232,161 @@ FileMetadata FileMetadataOrZeroes( TempAllocator * temp, const char * path ) {
 	return metadata;
 }
 
+/*
+ * ReadDirectoryChangesW can watch the whole tree from one handle. the OS
+ * fills buffer in the background, and we copy it out to results and start the
+ * next read before handing out paths
+ */
+struct FSWatcher {
+	Allocator * a;
+	HANDLE dir;
+	char * root;
+	OVERLAPPED overlapped;
+	char * last_path;
+	bool reading;
+
+	alignas( DWORD ) u8 buffer[ 64 * 1024 ];
+	alignas( DWORD ) u8 results[ 64 * 1024 ];
+	size_t results_len;
+	size_t results_cursor;
+};
+
+static bool QueueDirectoryRead( FSWatcher * watcher ) {
+	DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+	return ReadDirectoryChangesW( watcher->dir, watcher->buffer, sizeof( watcher->buffer ), TRUE, filter, NULL, &watcher->overlapped, NULL ) != 0;
+}
+
+FSWatcher * NewFSWatcher( Allocator * a, const char * path ) {
+	wchar_t * wide = UTF8ToWide( a, path );
+	defer { FREE( a, wide ); };
+
+	HANDLE dir = CreateFileW( wide, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL );
+	if( dir == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	FSWatcher * watcher = ALLOC( a, FSWatcher );
+	watcher->a = a;
+	watcher->dir = dir;
+	watcher->root = CopyString( a, path );
+	watcher->overlapped = { };
+	watcher->overlapped.hEvent = CreateEventW( NULL, TRUE, FALSE, NULL );
+	watcher->last_path = NULL;
+	watcher->reading = true;
+	watcher->results_len = 0;
+	watcher->results_cursor = 0;
+
+	if( watcher->overlapped.hEvent == NULL || !QueueDirectoryRead( watcher ) ) {
+		if( watcher->overlapped.hEvent != NULL ) {
+			CloseHandle( watcher->overlapped.hEvent );
+		}
+		CloseHandle( dir );
+		FREE( a, watcher->root );
+		FREE( a, watcher );
+		return NULL;
+	}
+
+	return watcher;
+}
+
+void DeleteFSWatcher( FSWatcher * watcher ) {
+	if( watcher == NULL )
+		return;
+
+	// wait for the cancel to go through so the OS stops writing to buffer
+	if( watcher->reading ) {
+		DWORD dont_care;
+		CancelIoEx( watcher->dir, &watcher->overlapped );
+		GetOverlappedResult( watcher->dir, &watcher->overlapped, &dont_care, TRUE );
+	}
+
+	CloseHandle( watcher->overlapped.hEvent );
+	CloseHandle( watcher->dir );
+
+	Allocator * a = watcher->a;
+	FREE( a, watcher->last_path );
+	FREE( a, watcher->root );
+	FREE( a, watcher );
+}
+
+static bool IsHiddenPath( const char * path ) {
+	return path[ 0 ] == '.' || strstr( path, "/." ) != NULL;
+}
+
+bool PollFSWatcher( FSWatcher * watcher, const char ** path ) {
+	Allocator * a = watcher->a;
+
+	FREE( a, watcher->last_path );
+	watcher->last_path = NULL;
+
+	while( true ) {
+		if( watcher->results_cursor == watcher->results_len ) {
+			if( !watcher->reading )
+				return false;
+
+			DWORD bytes;
+			if( GetOverlappedResult( watcher->dir, &watcher->overlapped, &bytes, FALSE ) == 0 )
+				return false;
+
+			memcpy( watcher->results, watcher->buffer, bytes );
+			watcher->results_len = bytes;
+			watcher->results_cursor = 0;
+
+			watcher->reading = QueueDirectoryRead( watcher );
+
+			// zero bytes means the buffer overflowed and we lost everything
+			if( bytes == 0 ) {
+				*path = NULL;
+				return true;
+			}
+		}
+
+		const FILE_NOTIFY_INFORMATION * info = ( const FILE_NOTIFY_INFORMATION * ) ( watcher->results + watcher->results_cursor );
+		if( info->NextEntryOffset == 0 ) {
+			watcher->results_cursor = watcher->results_len;
+		}
+		else {
+			watcher->results_cursor += info->NextEntryOffset;
+		}
+
+		if( info->Action != FILE_ACTION_ADDED && info->Action != FILE_ACTION_MODIFIED && info->Action != FILE_ACTION_RENAMED_NEW_NAME )
+			continue;
+
+		size_t name_len = info->FileNameLength / sizeof( wchar_t );
+		wchar_t * wide_name = ALLOC_MANY( a, wchar_t, name_len + 1 );
+		defer { FREE( a, wide_name ); };
+		memcpy( wide_name, info->FileName, info->FileNameLength );
+		wide_name[ name_len ] = L'\0';
+
+		char * relative = WideToUTF8( a, wide_name );
+		for( char * c = relative; *c != '\0'; c++ ) {
+			if( *c == '\\' ) {
+				*c = '/';
+			}
+		}
+
+		if( IsHiddenPath( relative ) ) {
+			FREE( a, relative );
+			continue;
+		}
+
+		// directories get modified events when things inside them change
+		DynamicString full( a, "{}/{}", watcher->root, relative );
+		wchar_t * wide_full = UTF8ToWide( a, full.c_str() );
+		DWORD attributes = GetFileAttributesW( wide_full );
+		FREE( a, wide_full );
+
+		if( attributes == INVALID_FILE_ATTRIBUTES || ( attributes & FILE_ATTRIBUTE_DIRECTORY ) != 0 ) {
+			FREE( a, relative );
+			continue;
+		}
+
+		watcher->last_path = relative;
+		*path = relative;
+		return true;
+	}
+}
+
 char * GetExePath( Allocator * a ) {
 	DWORD buf_size = 1024;
 	wchar_t * wide_buf = ALLOC_MANY( a, wchar_t, buf_size );
@@ -22,6 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <io.h>
 #include <winsock2.h>
 #include <mswsock.h>
+#include <ws2tcpip.h>
 
 #include "qcommon/qcommon.h"
 #include "qcommon/sys_net.h"
@@ -47,6 +48,161 @@ int Sys_NET_SocketIoctl( socket_handle_t handle, long request, ioctl_param_t* pa
 	return ioctlsocket( handle, request, param );
 }
 
+// winsock has no batched UDP calls so just loop
+
+int Sys_NET_RecvDatagrams( socket_handle_t handle, sys_datagram_t * datagrams, int n ) {
+	for( int i = 0; i < n; i++ ) {
+		int addrlen = sizeof( sockaddr_storage );
+		int ret = recvfrom( handle, ( char * ) datagrams[ i ].data, datagrams[ i ].length, 0, ( sockaddr * ) datagrams[ i ].address, &addrlen );
+		if( ret == SOCKET_ERROR ) {
+			// report the error on the next call
+			return i == 0 ? SOCKET_ERROR : i;
+		}
+
+		datagrams[ i ].length = ret;
+		datagrams[ i ].addrlen = addrlen;
+	}
+
+	return n;
+}
+
+int Sys_NET_SendDatagrams( socket_handle_t handle, const sys_datagram_t * datagrams, int n ) {
+	for( int i = 0; i < n; i++ ) {
+		int ret = sendto( handle, ( const char * ) datagrams[ i ].data, datagrams[ i ].length, 0, ( const sockaddr * ) datagrams[ i ].address, datagrams[ i ].addrlen );
+		if( ret == SOCKET_ERROR ) {
+			return i == 0 ? SOCKET_ERROR : i;
+		}
+	}
+
+	return n;
+}
+
+int Sys_NET_SendFile( socket_handle_t handle, FILE * file, size_t offset, size_t length ) {
+	// TransmitFile blocks until it's done on non-overlapped sockets, so
+	// keep each call small enough not to hold up the other connections
+	DWORD chunk = DWORD( Min2( length, size_t( 64 * 1024 ) ) );
+
+	HANDLE h = ( HANDLE ) _get_osfhandle( _fileno( file ) );
+	LARGE_INTEGER pos;
+	pos.QuadPart = offset;
+	if( !SetFilePointerEx( h, pos, NULL, FILE_BEGIN ) ) {
+		return SOCKET_ERROR;
+	}
+
+	if( !TransmitFile( handle, h, chunk, 0, NULL, NULL, TF_USE_KERNEL_APC ) ) {
+		return SOCKET_ERROR;
+	}
+
+	return int( chunk );
+}
+
+// winsock has no epoll, and IOCP wants the whole server built around it,
+// so go with WSAPoll. it's still a linear scan in the kernel but there's
+// no FD_SETSIZE limit
+#define MAX_POLLED_SOCKETS 1024
+
+struct NetPoller {
+	WSAPOLLFD fds[ MAX_POLLED_SOCKETS ];
+	void * users[ MAX_POLLED_SOCKETS ];
+	u32 n;
+};
+
+static SHORT PollEvents( u32 flags ) {
+	SHORT events = 0;
+	if( flags & NetPoll_Read )
+		events |= POLLRDNORM;
+	if( flags & NetPoll_Write )
+		events |= POLLWRNORM;
+	return events;
+}
+
+NetPoller * Sys_NET_NewPoller() {
+	NetPoller * poller = ALLOC( sys_allocator, NetPoller );
+	poller->n = 0;
+	return poller;
+}
+
+void Sys_NET_DeletePoller( NetPoller * poller ) {
+	FREE( sys_allocator, poller );
+}
+
+static s64 FindPolledSocket( const NetPoller * poller, socket_handle_t handle ) {
+	for( u32 i = 0; i < poller->n; i++ ) {
+		if( poller->fds[ i ].fd == handle ) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool Sys_NET_PollerAdd( NetPoller * poller, socket_handle_t handle, u32 flags, void * user ) {
+	if( poller->n == ARRAY_COUNT( poller->fds ) || FindPolledSocket( poller, handle ) != -1 ) {
+		return false;
+	}
+
+	poller->fds[ poller->n ].fd = handle;
+	poller->fds[ poller->n ].events = PollEvents( flags );
+	poller->fds[ poller->n ].revents = 0;
+	poller->users[ poller->n ] = user;
+	poller->n++;
+	return true;
+}
+
+bool Sys_NET_PollerModify( NetPoller * poller, socket_handle_t handle, u32 flags, void * user ) {
+	s64 idx = FindPolledSocket( poller, handle );
+	if( idx == -1 ) {
+		return false;
+	}
+
+	poller->fds[ idx ].events = PollEvents( flags );
+	poller->users[ idx ] = user;
+	return true;
+}
+
+void Sys_NET_PollerRemove( NetPoller * poller, socket_handle_t handle ) {
+	s64 idx = FindPolledSocket( poller, handle );
+	if( idx == -1 ) {
+		return;
+	}
+
+	poller->n--;
+	poller->fds[ idx ] = poller->fds[ poller->n ];
+	poller->users[ idx ] = poller->users[ poller->n ];
+}
+
+int Sys_NET_Poll( NetPoller * poller, int msec, NetPollEvent * events, int n ) {
+	// WSAPoll fails with nothing to poll
+	if( poller->n == 0 ) {
+		Sleep( msec );
+		return 0;
+	}
+
+	int ret = WSAPoll( poller->fds, poller->n, msec );
+	if( ret == SOCKET_ERROR ) {
+		return SOCKET_ERROR;
+	}
+
+	int num_events = 0;
+	for( u32 i = 0; i < poller->n && num_events < n; i++ ) {
+		SHORT revents = poller->fds[ i ].revents;
+		if( revents == 0 )
+			continue;
+
+		NetPollEvent * event = &events[ num_events ];
+		event->user = poller->users[ i ];
+		event->flags = 0;
+		if( revents & POLLRDNORM )
+			event->flags |= NetPoll_Read;
+		if( revents & POLLWRNORM )
+			event->flags |= NetPoll_Write;
+		if( revents & ( POLLERR | POLLHUP | POLLNVAL ) )
+			event->flags |= NetPoll_Error;
+		num_events++;
+	}
+
+	return num_events;
+}
+
 static void WSAError( const char * name ) {
 	int err = WSAGetLastError();
 
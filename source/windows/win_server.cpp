@@ -22,28 +22,13 @@ void Sys_Init() {
 }
 
 int main( int argc, char ** argv ) {
-	int64_t oldtime, newtime, time;
-
 	Qcommon_Init( argc, argv );
 
-	oldtime = Sys_Milliseconds();
-
+	Com_ResetFrameClock();
 	while( true ) {
 		FrameMark;
 
-		do {
-			ZoneScopedN( "Interframe" );
-
-			newtime = Sys_Milliseconds();
-			time = newtime - oldtime;
-			if( time > 0 ) {
-				break;
-			}
-			Sys_Sleep( 0 );
-		} while( 1 );
-		oldtime = newtime;
-
-		Qcommon_Frame( time );
+		Qcommon_Frame( Com_WaitForFrame() );
 	}
 
 	return 0;
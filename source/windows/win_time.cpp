@@ -29,6 +29,16 @@ u64 Sys_Microseconds() {
 	return usec - base_usec;
 }
 
+u64 Sys_Nanoseconds() {
+	LARGE_INTEGER now;
+	QueryPerformanceCounter( &now );
+
+	// split to avoid overflowing
+	u64 whole = now.QuadPart / hwtimer_freq.QuadPart;
+	u64 frac = now.QuadPart % hwtimer_freq.QuadPart;
+	return whole * 1000000000 + ( frac * 1000000000 ) / hwtimer_freq.QuadPart;
+}
+
 s64 Sys_Milliseconds() {
 	return Sys_Microseconds() / 1000;
 }
@@ -37,6 +47,11 @@ void Sys_Sleep( unsigned int millis ) {
 	Sleep( millis );
 }
 
+void Sys_SleepMicroseconds( u64 usec ) {
+	// Sleep only does milliseconds, round up so we don't wake early and spin
+	Sleep( DWORD( ( usec + 999 ) / 1000 ) );
+}
+
 bool Sys_FormatTime( char * buf, size_t buf_size, const char * fmt ) {
 	time_t now = time( NULL );
 	struct tm tm;